@@ -37,6 +37,9 @@
 #define DEST_IP "109.228.130.124"
 #define DEST_PORT 24944
 
+/* when skipping through tracks, don't look up every one of them */
+#define CURRENT_ID_INTERVAL 1000
+
 static time_t start_time;
 static const gchar *server_version = "unknown";
 static gchar *output_plugin;
@@ -252,7 +255,12 @@ main (int argc, char **argv)
 
 	start_time = time (NULL);
 
-	XMMS_CALLBACK_SET (conn, xmmsc_broadcast_playback_current_id, handle_current_id, conn);
+	{
+		xmmsc_result_t *res;
+		res = xmmsc_broadcast_playback_current_id_throttled (conn, CURRENT_ID_INTERVAL);
+		xmmsc_result_notifier_set (res, handle_current_id, conn);
+		xmmsc_result_unref (res);
+	}
 	XMMS_CALLBACK_SET (conn, xmmsc_main_stats, handle_stats, NULL);
 	XMMS_CALLBACK_SET (conn, xmmsc_broadcast_config_value_changed, handle_config, NULL);
 	XMMS_CALLBACK_SET (conn, xmmsc_broadcast_quit, handle_quit, ml);
@@ -85,6 +85,9 @@ cdef extern from "xmmsclient/xmmsclient.h":
 	bint xmmsc_io_in_handle  (xmmsc_connection_t *c)
 	int  xmmsc_io_fd_get     (xmmsc_connection_t *c)
 
+	void xmmsc_batch_begin  (xmmsc_connection_t *c)
+	void xmmsc_batch_commit (xmmsc_connection_t *c)
+
 	char *xmmsc_get_last_error (xmmsc_connection_t *c)
 
 	xmmsc_result_t *xmmsc_quit(xmmsc_connection_t *c)
@@ -187,6 +190,8 @@ cdef extern from "xmmsclient/xmmsclient.h":
 	xmmsc_result_t *xmmsc_medialib_add_entry_full      (xmmsc_connection_t *c, char *url, xmmsv_t *args)
 	xmmsc_result_t *xmmsc_medialib_add_entry_encoded   (xmmsc_connection_t *c, char *url)
 	xmmsc_result_t *xmmsc_medialib_get_info            (xmmsc_connection_t *c, int id)
+	void            xmmsc_medialib_cache_set_size      (xmmsc_connection_t *c, int size)
+	xmmsv_t        *xmmsc_medialib_cache_get           (xmmsc_connection_t *c, int id)
 	xmmsc_result_t *xmmsc_medialib_import_path         (xmmsc_connection_t *c, char *path)
 	xmmsc_result_t *xmmsc_medialib_import_path_encoded (xmmsc_connection_t *c, char *path)
 	xmmsc_result_t *xmmsc_medialib_rehash              (xmmsc_connection_t *c, unsigned int)
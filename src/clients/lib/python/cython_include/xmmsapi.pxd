@@ -33,6 +33,7 @@ cdef class XmmsResult:
 	cpdef is_error(self)
 	cpdef xmmsvalue(self)
 	cpdef value(self)
+	cpdef lazy_value(self)
 
 ctypedef int VisResultCommand
 cdef enum:
@@ -54,8 +55,11 @@ cdef class XmmsVisResult(XmmsResult):
 cdef class XmmsVisChunk:
 	cdef short *data
 	cdef int sample_count
+	cdef Py_ssize_t shape
+	cdef Py_ssize_t stride
 
 	cdef set_data(self, short *data, int sample_count)
+	cdef adopt_data(self, short *data, int sample_count)
 	cpdef get_buffer(self)
 	cpdef get_data(self)
 
@@ -130,6 +134,8 @@ cdef class XmmsCore:
 	cpdef want_ioout(self)
 	cpdef set_need_out_fun(self, fun)
 	cpdef get_fd(self)
+	cpdef batch_begin(self)
+	cpdef batch_commit(self)
 	cpdef connect(self, path=*, disconnect_func=*)
 	cdef XmmsResult _create_result(self, cb, xmmsc_result_t *res, Cls)
 	cdef XmmsResult create_result(self, cb, xmmsc_result_t *res)
@@ -192,6 +198,8 @@ cdef class XmmsApi(XmmsCore):
 	cpdef XmmsResult medialib_remove_entry(self, int id, cb=*)
 	cpdef XmmsResult medialib_move_entry(self, int id, url, cb=*, encoded=*)
 	cpdef XmmsResult medialib_get_info(self, int id, cb=*)
+	cpdef medialib_cache_set_size(self, int size)
+	cpdef medialib_cache_get(self, int id)
 	cpdef XmmsResult medialib_rehash(self, int id=*, cb=*)
 	cpdef XmmsResult medialib_get_id(self, url, cb=*, encoded=*)
 	cpdef XmmsResult medialib_import_path(self, path, cb=*, encoded=*)
@@ -20,6 +20,8 @@ cdef class XmmsValue:
 	cpdef get_float(self)
 	cpdef get_string(self)
 	cpdef get_bin(self)
+	cpdef get_bin_view(self)
+	cpdef get_int_array(self)
 	cpdef get_coll(self)
 	cpdef get_dict(self)
 	cpdef get_dict_iter(self)
@@ -27,6 +29,7 @@ cdef class XmmsValue:
 	cpdef get_list(self)
 	cpdef get_list_iter(self)
 	cpdef value(self)
+	cpdef lazy(self)
 	cpdef copy(self, cls=*)
 
 cdef class XmmsValueC2C(XmmsValue):
@@ -42,6 +45,24 @@ cdef class XmmsDictIter:
 	cdef xmmsv_t *val
 	cdef xmmsv_dict_iter_t *it
 
+cdef class XmmsBinView:
+	cdef xmmsv_t *val
+
+cdef class XmmsLazyValue:
+	cdef object sourcepref
+	cdef xmmsv_t *val
+
+	cdef init_value(self, XmmsValue value, int vtype)
+
+cdef class XmmsLazyList(XmmsLazyValue):
+	pass
+
+cdef class XmmsLazyDict(XmmsLazyValue):
+	pass
+
+cdef class XmmsLazyPropDict(XmmsLazyValue):
+	cdef xmmsv_t *get_sources(self, key)
+
 cdef class CollectionRef:
 	cdef xmmsv_t *coll
 
@@ -5,6 +5,7 @@ Python bindings for XMMS2.
 # CImports
 from cpython.mem cimport PyMem_Malloc, PyMem_Free
 from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.buffer cimport PyBUF_WRITABLE, PyBUF_FORMAT, PyBUF_ND, PyBUF_STRIDES
 cimport cython
 from xmmsutils cimport from_unicode, to_unicode
 from cxmmsvalue cimport *
@@ -260,6 +261,13 @@ cdef class XmmsResult:
 	cpdef value(self):
 		return self.xmmsvalue().value()
 
+	cpdef lazy_value(self):
+		"""
+		Like `value`, but lists and dicts are only converted when their
+		items are accessed, see `XmmsValue.lazy`.
+		"""
+		return self.xmmsvalue().lazy()
+
 
 cdef class XmmsVisResult(XmmsResult):
 	#cdef XmmsValue _val
@@ -329,8 +337,14 @@ cdef class XmmsVisResult(XmmsResult):
 			return XmmsResult.xmmsvalue(self)
 
 cdef class XmmsVisChunk:
+	"""
+	A chunk of visualization data. It supports the buffer protocol, so
+	memoryview(chunk) gives access to the samples without copying them.
+	"""
 	#cdef short *data
 	#cdef int sample_count
+	#cdef Py_ssize_t shape
+	#cdef Py_ssize_t stride
 
 	def __cinit__(self):
 		self.data = NULL
@@ -351,9 +365,46 @@ cdef class XmmsVisChunk:
 			self.data[i] = data[i]
 		self.sample_count = sample_count
 
+	cdef adopt_data(self, short *data, int sample_count):
+		if self.data != NULL:
+			PyMem_Free(self.data)
+		self.data = data
+		self.sample_count = sample_count
+
 	def __len__(self):
 		return self.sample_count
 
+	def __getbuffer__(self, Py_buffer *buffer, int flags):
+		if self.data == NULL:
+			raise BufferError("chunk data not initialized")
+		if flags & PyBUF_WRITABLE:
+			raise BufferError("chunk data is read only")
+		self.shape = self.sample_count
+		self.stride = sizeof (short)
+		buffer.buf = <void *>self.data
+		buffer.obj = self
+		buffer.len = sizeof (short) * self.sample_count
+		buffer.readonly = 1
+		buffer.itemsize = sizeof (short)
+		if flags & PyBUF_FORMAT:
+			buffer.format = "h"
+		else:
+			buffer.format = NULL
+		buffer.ndim = 1
+		if flags & PyBUF_ND:
+			buffer.shape = &self.shape
+		else:
+			buffer.shape = NULL
+		if flags & PyBUF_STRIDES:
+			buffer.strides = &self.stride
+		else:
+			buffer.strides = NULL
+		buffer.suboffsets = NULL
+		buffer.internal = NULL
+
+	def __releasebuffer__(self, Py_buffer *buffer):
+		pass
+
 	cpdef get_buffer(self):
 		"""
 		Get the chunk buffer
@@ -1006,6 +1057,20 @@ cdef class XmmsCore:
 		"""
 		return xmmsc_io_fd_get(self.conn)
 
+	cpdef batch_begin(self):
+		"""
+		Start a batch of commands. The commands are queued until
+		:meth:`batch_commit` is called, and then sent to the daemon
+		together. Batches may nest.
+		"""
+		xmmsc_batch_begin(self.conn)
+
+	cpdef batch_commit(self):
+		"""
+		Send the commands queued since :meth:`batch_begin`.
+		"""
+		xmmsc_batch_commit(self.conn)
+
 	cpdef connect(self, path = None, disconnect_func = None):
 		"""
 		Connect to the appropriate IPC path, for communication with the
@@ -1620,6 +1685,29 @@ cdef class XmmsApi(XmmsCore):
 		res.ispropdict = 1
 		return res
 
+	cpdef medialib_cache_set_size(self, int size):
+		"""
+		Cache the information returned by `medialib_get_info` for up to
+		size entries, kept up to date with the changes the server
+		broadcasts. A size of 0 disables the cache.
+		"""
+		xmmsc_medialib_cache_set_size(self.conn, size)
+
+	cpdef medialib_cache_get(self, int id):
+		"""
+		:return: The cached information about the medialib entry, or
+		None if it isn't cached.
+		"""
+		cdef xmmsv_t *info
+		cdef XmmsValue obj
+		info = xmmsc_medialib_cache_get(self.conn, id)
+		if info == NULL:
+			return None
+		obj = XmmsValue(self.source_preference.get())
+		obj.set_value(info, 1)
+		xmmsv_unref(info)
+		return obj.value()
+
 	cpdef XmmsResult medialib_rehash(self, int id = 0, cb = None):
 		"""
 		Force the medialib to check that metadata stored is up to date.
@@ -2227,8 +2315,7 @@ cdef class XmmsApi(XmmsCore):
 			PyMem_Free(buf)
 			raise VisualizationError("Unrecoverable error in visualization")
 		chunk = XmmsVisChunk()
-		chunk.set_data(buf, size)
-		PyMem_Free(buf)
+		chunk.adopt_data(buf, size)
 		return chunk
 
 	cpdef visualization_shutdown(self, int handle):
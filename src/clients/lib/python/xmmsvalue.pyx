@@ -4,9 +4,13 @@ Python bindings for xmmsv manipulations.
 
 from xmmsutils cimport *
 from cpython.bytes cimport PyBytes_FromStringAndSize
+from cpython.buffer cimport PyBuffer_FillInfo
+from cpython cimport array
 cimport cython
 from cxmmsvalue cimport *
 
+import array
+
 VALUE_TYPE_NONE   = XMMSV_TYPE_NONE
 VALUE_TYPE_ERROR  = XMMSV_TYPE_ERROR
 VALUE_TYPE_INT64  = XMMSV_TYPE_INT64
@@ -39,6 +43,8 @@ COLLECTION_TYPE_IDLIST       = XMMS_COLLECTION_TYPE_IDLIST
 
 from propdict import PropDict # xmmsclient.propdict
 
+cdef array.array _int_array_template = array.array('i', [])
+
 
 cdef xmmsv_t *create_native_value(value) except NULL:
 	cdef xmmsv_t *ret = NULL
@@ -200,6 +206,29 @@ cdef class XmmsValue:
 			raise ValueError("Failed to retrieve value")
 		return PyBytes_FromStringAndSize(<char *>ret, rlen)
 
+	cpdef get_bin_view(self):
+		"""
+		Get binary data from the result structure without copying it.
+
+		:return: A read only view on the binary data.
+		:rtype: memoryview
+		"""
+		if not xmmsv_is_type(self.val, XMMSV_TYPE_BIN):
+			raise ValueError("Failed to retrieve value")
+		return memoryview(XmmsBinView(self))
+
+	cpdef get_int_array(self):
+		"""
+		Get a list of integers, such as a list of media ids, from the
+		result structure without creating a Python int for each entry.
+
+		:return: The integers.
+		:rtype: array('i')
+		"""
+		if not xmmsv_is_type(self.val, XMMSV_TYPE_LIST):
+			raise ValueError("The value is not a list")
+		return int_array_from_list(self.val)
+
 	cpdef get_coll(self):
 		"""
 		Get data from the result structure as a Collection.
@@ -276,6 +305,25 @@ cdef class XmmsValue:
 		else:
 			raise TypeError("Unknown value type from the server: %d" % vtype)
 
+	cpdef lazy(self):
+		"""
+		Like `value`, but lists and dicts are wrapped instead of being
+		converted, and their items are only converted when accessed.
+
+		:return: An `XmmsLazyList`, `XmmsLazyDict` or
+		`XmmsLazyPropDict`, or the value itself for other types.
+		"""
+		cdef xmmsv_type_t vtype
+		vtype = self.get_type()
+
+		if vtype == XMMSV_TYPE_LIST:
+			return XmmsLazyList(self)
+		elif vtype == XMMSV_TYPE_DICT:
+			if self.ispropdict:
+				return XmmsLazyPropDict(self)
+			return XmmsLazyDict(self)
+		return self.value()
+
 	cpdef copy(self, cls=None):
 		if cls is None:
 			cls = XmmsValue
@@ -417,6 +465,283 @@ cdef class XmmsDictIter:
 		return (to_unicode(key), v)
 
 
+cdef class XmmsBinView:
+	"""
+	Buffer over the data of a binary value, the value is kept alive for
+	as long as the buffer is used.
+	"""
+	#cdef xmmsv_t *val
+
+	def __cinit__(self):
+		self.val = NULL
+
+	def __dealloc__(self):
+		if self.val != NULL:
+			xmmsv_unref(self.val)
+
+	def __init__(self, XmmsValue value):
+		if value.get_type() != XMMSV_TYPE_BIN:
+			raise TypeError("The value is not binary data.")
+		self.val = xmmsv_ref(value.val)
+
+	def __getbuffer__(self, Py_buffer *buffer, int flags):
+		cdef const_uchar *data = NULL
+		cdef unsigned int rlen = 0
+		if not xmmsv_get_bin(self.val, &data, &rlen):
+			raise BufferError("Failed to retrieve value")
+		PyBuffer_FillInfo(buffer, self, <void *>data, rlen, 1, flags)
+
+	def __releasebuffer__(self, Py_buffer *buffer):
+		pass
+
+
+cdef int_array_from_list(xmmsv_t *ids):
+	cdef array.array ret
+	cdef int64_t x = 0
+	cdef int l, i
+
+	l = xmmsv_list_get_size(ids)
+	ret = array.clone(_int_array_template, l, zero=False)
+	for i in range(l):
+		if not xmmsv_list_get_int64(ids, i, &x):
+			raise ValueError("The list contains a value that is not an integer")
+		ret.data.as_ints[i] = <int>x
+	return ret
+
+
+cdef lazy_value(xmmsv_t *val, sourcepref):
+	cdef XmmsValue v
+	v = XmmsValue(sourcepref)
+	v.set_value(val)
+	return v.lazy()
+
+
+cdef class XmmsLazyValue:
+	#cdef object sourcepref
+	#cdef xmmsv_t *val
+
+	def __cinit__(self):
+		self.val = NULL
+
+	def __dealloc__(self):
+		if self.val != NULL:
+			xmmsv_unref(self.val)
+
+	cdef init_value(self, XmmsValue value, int vtype):
+		if value.get_type() != vtype:
+			raise TypeError("The value has the wrong type.")
+		self.val = xmmsv_ref(value.val)
+		self.sourcepref = value.sourcepref
+
+	def xmmsvalue(self):
+		"""
+		:return: The wrapped `XmmsValue`.
+		"""
+		cdef XmmsValue v
+		v = XmmsValue(self.sourcepref)
+		v.set_value(self.val)
+		return v
+
+
+cdef class XmmsLazyList(XmmsLazyValue):
+	"""
+	Read only sequence over a list value, converting the items when
+	they are accessed.
+	"""
+	def __init__(self, XmmsValue value):
+		self.init_value(value, XMMSV_TYPE_LIST)
+
+	def __len__(self):
+		return xmmsv_list_get_size(self.val)
+
+	def __getitem__(self, i):
+		cdef xmmsv_t *item = NULL
+		cdef int l
+
+		l = xmmsv_list_get_size(self.val)
+		if isinstance(i, slice):
+			return [self[j] for j in range(*i.indices(l))]
+		if i < 0:
+			i += l
+		if not xmmsv_list_get(self.val, i, &item):
+			raise IndexError("Index out of range")
+		return lazy_value(item, self.sourcepref)
+
+	def __iter__(self):
+		cdef xmmsv_t *item = NULL
+		cdef int i = 0
+		while xmmsv_list_get(self.val, i, &item):
+			yield lazy_value(item, self.sourcepref)
+			i += 1
+
+	def __repr__(self):
+		return repr(list(self))
+
+
+cdef class XmmsLazyDict(XmmsLazyValue):
+	"""
+	Read only mapping over a dict value, converting the values when
+	they are accessed.
+	"""
+	def __init__(self, XmmsValue value):
+		self.init_value(value, XMMSV_TYPE_DICT)
+
+	def __len__(self):
+		return xmmsv_dict_get_size(self.val)
+
+	def __getitem__(self, key):
+		cdef xmmsv_t *item = NULL
+		if not isinstance(key, (unicode, bytes)):
+			raise KeyError(key)
+		k = from_unicode(key)
+		if not xmmsv_dict_get(self.val, <char *>k, &item):
+			raise KeyError(key)
+		return lazy_value(item, self.sourcepref)
+
+	def __contains__(self, key):
+		if not isinstance(key, (unicode, bytes)):
+			return False
+		k = from_unicode(key)
+		return xmmsv_dict_has_key(self.val, <char *>k)
+
+	def __iter__(self):
+		return iter(self.keys())
+
+	def get(self, key, default=None):
+		try:
+			return self[key]
+		except KeyError:
+			return default
+
+	def keys(self):
+		cdef xmmsv_dict_iter_t *it = NULL
+		cdef const_char *key = NULL
+		ret = []
+		xmmsv_get_dict_iter(self.val, &it)
+		while xmmsv_dict_iter_pair(it, &key, NULL):
+			ret.append(to_unicode(key))
+			xmmsv_dict_iter_next(it)
+		xmmsv_dict_iter_explicit_destroy(it)
+		return ret
+
+	def values(self):
+		return [self[k] for k in self.keys()]
+
+	def items(self):
+		return [(k, self[k]) for k in self.keys()]
+
+	def __repr__(self):
+		return repr(dict(self.items()))
+
+
+cdef class XmmsLazyPropDict(XmmsLazyValue):
+	"""
+	Read only mapping over a source dict, like `PropDict` but only
+	converting the values that are accessed. Keys are (source, key)
+	tuples, or a key resolved with the source preference.
+	"""
+	def __init__(self, XmmsValue value):
+		self.init_value(value, XMMSV_TYPE_DICT)
+		if self.sourcepref is None:
+			self.sourcepref = []
+
+	property sources:
+		def __get__(self):
+			return self.sourcepref
+
+	cdef xmmsv_t *get_sources(self, key):
+		cdef xmmsv_t *sources = NULL
+		k = from_unicode(key)
+		if not xmmsv_dict_get(self.val, <char *>k, &sources):
+			return NULL
+		return sources
+
+	def __getitem__(self, item):
+		cdef xmmsv_t *sources
+		cdef xmmsv_t *value = NULL
+		cdef xmmsv_dict_iter_t *it = NULL
+		cdef const_char *source = NULL
+
+		if isinstance(item, tuple) and len(item) == 2:
+			sources = self.get_sources(item[1])
+			s = from_unicode(item[0])
+			if sources != NULL and xmmsv_dict_get(sources, <char *>s, &value):
+				return lazy_value(value, self.sourcepref)
+			raise KeyError(item)
+
+		if not isinstance(item, (unicode, bytes)):
+			raise KeyError(item)
+
+		sources = self.get_sources(item)
+		if sources == NULL:
+			raise KeyError(item)
+
+		for src in self.sourcepref:
+			if src.endswith('*'):
+				prefix = from_unicode(src[:-1])
+				xmmsv_get_dict_iter(sources, &it)
+				while xmmsv_dict_iter_pair(it, &source, &value):
+					if (<bytes>source).startswith(prefix):
+						xmmsv_dict_iter_explicit_destroy(it)
+						return lazy_value(value, self.sourcepref)
+					xmmsv_dict_iter_next(it)
+				xmmsv_dict_iter_explicit_destroy(it)
+			else:
+				s = from_unicode(src)
+				if xmmsv_dict_get(sources, <char *>s, &value):
+					return lazy_value(value, self.sourcepref)
+		raise KeyError(item)
+
+	def __contains__(self, item):
+		try:
+			self[item]
+			return True
+		except KeyError:
+			return False
+
+	def has_key(self, item):
+		return item in self
+
+	def get(self, item, default=None):
+		try:
+			return self[item]
+		except KeyError:
+			return default
+
+	def keys(self):
+		cdef xmmsv_dict_iter_t *it = NULL
+		cdef xmmsv_dict_iter_t *sit = NULL
+		cdef const_char *key = NULL
+		cdef const_char *source = NULL
+		cdef xmmsv_t *sources = NULL
+		ret = []
+		xmmsv_get_dict_iter(self.val, &it)
+		while xmmsv_dict_iter_pair(it, &key, &sources):
+			if xmmsv_get_dict_iter(sources, &sit):
+				while xmmsv_dict_iter_pair(sit, &source, NULL):
+					ret.append((to_unicode(source), to_unicode(key)))
+					xmmsv_dict_iter_next(sit)
+				xmmsv_dict_iter_explicit_destroy(sit)
+			xmmsv_dict_iter_next(it)
+		xmmsv_dict_iter_explicit_destroy(it)
+		return ret
+
+	def __iter__(self):
+		return iter(self.keys())
+
+	def __len__(self):
+		return len(self.keys())
+
+	def values(self):
+		return [self[k] for k in self.keys()]
+
+	def items(self):
+		return [(k, self[k]) for k in self.keys()]
+
+	def __repr__(self):
+		return repr(dict(self.items()))
+
+
 cdef class CollectionRef:
 	def __cinit__(self):
 		self.coll = NULL
@@ -783,6 +1108,10 @@ cdef class CollectionIDList(CollectionRef):
 		"""Returns a _COPY_ of the idlist as an ordinary list"""
 		return list(self)
 
+	def array(self):
+		"""Returns a _COPY_ of the idlist as an array('i')"""
+		return int_array_from_list(xmmsv_coll_idlist_get(self.coll))
+
 	def __repr__(self):
 		return repr(self.list())
 
@@ -54,9 +54,9 @@ namespace Xmms
 
 	Coll Coll::operator=( const Coll& src )
 	{
+		xmmsv_ref( src.coll_ );
 		unref();
 		coll_ = src.coll_;
-		ref();
 		return *this;
 	}
 
@@ -95,13 +95,18 @@ namespace Xmms
 	}
 
 	string Coll::getAttribute( const string &attrname ) const
+	{
+		return string( getAttributeCString( attrname.c_str() ) );
+	}
+
+	const char* Coll::getAttributeCString( const char* attrname ) const
 	{
 		const char *val;
-		if( !xmmsv_coll_attribute_get_string( coll_, attrname.c_str(), &val ) ) {
-			throw no_such_key_error( "No such attribute: " + attrname );
+		if( !xmmsv_coll_attribute_get_string( coll_, attrname, &val ) ) {
+			throw no_such_key_error( string( "No such attribute: " ) + attrname );
 		}
 
-		return string( val );
+		return val;
 	}
 
 	void Coll::removeAttribute( const string &attrname )
@@ -59,16 +59,18 @@ namespace Xmms
 
 	Dict::~Dict()
 	{
-		xmmsv_unref( value_ );
+		if( value_ ) {
+			xmmsv_unref( value_ );
+		}
 	}
 
 	void Dict::setValue( xmmsv_t *newval )
 	{
+		xmmsv_ref( newval );
 		if( value_ ) {
 			xmmsv_unref( value_ );
 		}
 		value_ = newval;
-		xmmsv_ref( value_ );
 	}
 
 	bool Dict::contains( const std::string& key ) const
@@ -103,6 +105,36 @@ namespace Xmms
 
 	}
 
+	int32_t Dict::getInt( const char* key ) const
+	{
+		xmmsv_t *elem;
+		int32_t ret;
+
+		if( !xmmsv_dict_get( value_, key, &elem ) ) {
+			throw no_such_key_error( std::string( "No such key: " ) + key );
+		}
+		if( !xmmsv_get_int32( elem, &ret ) ) {
+			throw wrong_type_error( std::string( "Failed to get value for " ) + key );
+		}
+
+		return ret;
+	}
+
+	const char* Dict::getCString( const char* key ) const
+	{
+		xmmsv_t *elem;
+		const char *ret;
+
+		if( !xmmsv_dict_get( value_, key, &elem ) ) {
+			throw no_such_key_error( std::string( "No such key: " ) + key );
+		}
+		if( !xmmsv_get_string( elem, &ret ) ) {
+			throw wrong_type_error( std::string( "Failed to get value for " ) + key );
+		}
+
+		return ret;
+	}
+
 	static void
 	getValue( Dict::Variant& val, xmmsv_t *value )
 	{
@@ -176,17 +208,19 @@ namespace Xmms
 	PropDict& PropDict::operator=( const PropDict& dict )
 	{
 		Dict::operator=( dict );
+		xmmsv_ref( dict.propdict_ );
 		if( propdict_ ) {
 			xmmsv_unref( propdict_ );
 		}
 		propdict_ = dict.propdict_;
-		xmmsv_ref( propdict_ );
 		return *this;
 	}
 
 	PropDict::~PropDict()
 	{
-		xmmsv_unref( propdict_ );
+		if( propdict_ ) {
+			xmmsv_unref( propdict_ );
+		}
 	}
 
 	void PropDict::setSource( const std::string& src )
@@ -322,6 +356,14 @@ namespace Xmms
 		return tmp;
 	}
 
+	const char*
+	Dict::const_iterator::key() const
+	{
+		const char* key = 0;
+		xmmsv_dict_iter_pair( it_, &key, NULL );
+		return key;
+	}
+
 	bool
 	Dict::const_iterator::valid() const
 	{
@@ -157,6 +157,26 @@ namespace Xmms
 		return PropDictResult( res, ml_ );
 	}
 
+	void Medialib::setCacheSize( int size ) const
+	{
+		check( connected_ );
+		xmmsc_medialib_cache_set_size( conn_, size );
+	}
+
+	PropDict Medialib::getCachedInfo( int id ) const
+	{
+		check( connected_ );
+
+		xmmsv_t* info = xmmsc_medialib_cache_get( conn_, id );
+		if( !info ) {
+			throw no_such_key_error( "Entry not in the cache" );
+		}
+
+		PropDict dict( info );
+		xmmsv_unref( info );
+		return dict;
+	}
+
 	VoidResult Medialib::pathImport( const std::string& path ) const
 	{
 		xmmsc_result_t* res =
@@ -17,60 +17,88 @@
 #include <Ecore.h>
 
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <xmmsclient/xmmsclient.h>
 #include <xmmsclient/xmmsclient-ecore.h>
 
+typedef struct {
+	xmmsc_connection_t *conn;
+	Ecore_Fd_Handler *handler;
+	int flags;
+} xmmsc_ecore_t;
+
 static Eina_Bool
 on_fd_data (void *udata, Ecore_Fd_Handler *handler)
 {
-	xmmsc_connection_t *c = udata;
-	int ret = 0;
+	xmmsc_ecore_t *ecore = udata;
+	int ret = 1;
 
 	if (ecore_main_fd_handler_active_get (handler, ECORE_FD_ERROR)) {
-		xmmsc_io_disconnect (c);
-		return ret;
+		xmmsc_io_disconnect (ecore->conn);
+		return 0;
 	}
 
+	/* reads every message that has arrived */
 	if (ecore_main_fd_handler_active_get (handler, ECORE_FD_READ))
-		ret = xmmsc_io_in_handle (c);
+		ret = xmmsc_io_in_handle (ecore->conn);
 
-	if (ecore_main_fd_handler_active_get (handler, ECORE_FD_WRITE))
-		ret = xmmsc_io_out_handle (c);
+	/* and writes what their results asked for right away */
+	if (ret > 0 && xmmsc_io_want_out (ecore->conn))
+		ret = xmmsc_io_out_handle (ecore->conn);
 
-	return ret;
+	return ret > 0;
 }
 
-static void
-on_prepare (void *udata, Ecore_Fd_Handler *handler)
+static int
+want_flags (xmmsc_connection_t *c)
 {
-	xmmsc_connection_t *c = udata;
 	int flags = ECORE_FD_READ | ECORE_FD_ERROR;
 
 	if (xmmsc_io_want_out (c))
 		flags |= ECORE_FD_WRITE;
 
-	ecore_main_fd_handler_active_set (handler, flags);
+	return flags;
+}
+
+static void
+on_prepare (void *udata, Ecore_Fd_Handler *handler)
+{
+	xmmsc_ecore_t *ecore = udata;
+	int flags = want_flags (ecore->conn);
+
+	/* only touch the handler when the output queue changed state */
+	if (flags != ecore->flags) {
+		ecore_main_fd_handler_active_set (handler, flags);
+		ecore->flags = flags;
+	}
 }
 
 void *
 xmmsc_mainloop_ecore_init (xmmsc_connection_t *c)
 {
-	Ecore_Fd_Handler *fdh;
-	int flags = ECORE_FD_READ | ECORE_FD_ERROR;
+	xmmsc_ecore_t *ecore;
 
-	if (xmmsc_io_want_out (c))
-		flags |= ECORE_FD_WRITE;
+	ecore = calloc (1, sizeof (xmmsc_ecore_t));
+	if (!ecore)
+		return NULL;
 
-	fdh = ecore_main_fd_handler_add (xmmsc_io_fd_get (c), flags,
-	                                 on_fd_data, c, NULL, NULL);
-	ecore_main_fd_handler_prepare_callback_set (fdh, on_prepare, c);
+	ecore->conn = c;
+	ecore->flags = want_flags (c);
+	ecore->handler = ecore_main_fd_handler_add (xmmsc_io_fd_get (c),
+	                                            ecore->flags, on_fd_data,
+	                                            ecore, NULL, NULL);
+	ecore_main_fd_handler_prepare_callback_set (ecore->handler,
+	                                            on_prepare, ecore);
 
-	return fdh;
+	return ecore;
 }
 
 void
 xmmsc_mainloop_ecore_shutdown (xmmsc_connection_t *c, void *udata)
 {
-	ecore_main_fd_handler_del (udata);
+	xmmsc_ecore_t *ecore = udata;
+
+	ecore_main_fd_handler_del (ecore->handler);
+	free (ecore);
 }
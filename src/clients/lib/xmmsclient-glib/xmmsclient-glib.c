@@ -19,94 +19,111 @@
 #include <xmmsclient/xmmsclient.h>
 #include <xmmsclient/xmmsclient-glib.h>
 
+/* One source polls the connection for both directions. The events it
+ * waits for are worked out again before each poll, so any number of
+ * commands sent during an iteration cost a single write, and no watch
+ * is added or removed as the output queue fills and empties.
+ */
 typedef struct {
+	GSource source;
 	xmmsc_connection_t *conn;
-	GIOChannel *iochan;
-	gboolean write_pending;
-	guint source_id;
-} xmmsc_glib_watch_t;
+	GPollFD pollfd;
+} xmmsc_glib_source_t;
 
 static gboolean
-xmmsc_glib_read_cb (GIOChannel *iochan, GIOCondition cond, gpointer data)
+xmmsc_glib_prepare (GSource *source, gint *timeout)
 {
-	xmmsc_glib_watch_t *watch = data;
-	gboolean ret = FALSE;
-
-	g_return_val_if_fail (watch, FALSE);
-	if (!(cond & G_IO_IN)) {
-		xmmsc_io_disconnect (watch->conn);
-	} else {
-		ret = xmmsc_io_in_handle (watch->conn);
+	xmmsc_glib_source_t *xsource = (xmmsc_glib_source_t *) source;
+
+	xsource->pollfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
+	if (xmmsc_io_want_out (xsource->conn)) {
+		xsource->pollfd.events |= G_IO_OUT;
 	}
 
-	return ret;
+	*timeout = -1;
+
+	return FALSE;
 }
 
 static gboolean
-xmmsc_glib_write_cb (GIOChannel *iochan, GIOCondition cond, gpointer data)
+xmmsc_glib_check (GSource *source)
 {
-	xmmsc_glib_watch_t *watch = data;
+	xmmsc_glib_source_t *xsource = (xmmsc_glib_source_t *) source;
+
+	return xsource->pollfd.revents != 0;
+}
 
-	g_return_val_if_fail (watch, FALSE);
-	xmmsc_io_out_handle (watch->conn);
+static gboolean
+xmmsc_glib_dispatch (GSource *source, GSourceFunc callback, gpointer data)
+{
+	xmmsc_glib_source_t *xsource = (xmmsc_glib_source_t *) source;
+	gushort revents = xsource->pollfd.revents;
+
+	if (revents & G_IO_IN) {
+		/* reads every message that has arrived */
+		if (!xmmsc_io_in_handle (xsource->conn)) {
+			return FALSE;
+		}
+	} else if (revents & (G_IO_ERR | G_IO_HUP)) {
+		xmmsc_io_disconnect (xsource->conn);
+		return FALSE;
+	}
 
-	return !!xmmsc_io_want_out (watch->conn);
+	/* also write what the results just read asked for, rather than
+	   waiting for the next poll to say the socket is writable */
+	if (xmmsc_io_want_out (xsource->conn)) {
+		if (!xmmsc_io_out_handle (xsource->conn)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
 }
 
 static void
-xmmsc_mainloop_need_out_cb (gboolean need_out, void *data)
+xmmsc_glib_finalize (GSource *source)
 {
-	xmmsc_glib_watch_t *watch = data;
-
-	g_return_if_fail (watch);
-	if (need_out && !watch->write_pending) {
-		g_io_add_watch (watch->iochan,
-		                G_IO_OUT,
-		                xmmsc_glib_write_cb,
-		                watch);
-		watch->write_pending = TRUE;
-	} else if (!need_out) {
-		/* our write_cb has finished writing */
-		watch->write_pending = FALSE;
-	}
+	xmmsc_glib_source_t *xsource = (xmmsc_glib_source_t *) source;
+
+	xmmsc_unref (xsource->conn);
 }
 
+static GSourceFuncs xmmsc_glib_source_funcs = {
+	xmmsc_glib_prepare,
+	xmmsc_glib_check,
+	xmmsc_glib_dispatch,
+	xmmsc_glib_finalize
+};
+
 void *
 xmmsc_mainloop_gmain_init (xmmsc_connection_t *c)
 {
-	xmmsc_glib_watch_t *watch;
-	gint fd;
+	xmmsc_glib_source_t *xsource;
+	GSource *source;
 
 	g_return_val_if_fail (c, NULL);
-	fd = xmmsc_io_fd_get (c);
 
-	watch = g_new0 (xmmsc_glib_watch_t, 1);
-	watch->conn = xmmsc_ref (c);
-	watch->iochan = g_io_channel_unix_new (fd);
+	source = g_source_new (&xmmsc_glib_source_funcs,
+	                       sizeof (xmmsc_glib_source_t));
 
-	xmmsc_io_need_out_callback_set (c, xmmsc_mainloop_need_out_cb, watch);
-	watch->source_id = g_io_add_watch (watch->iochan,
-	                                   G_IO_IN | G_IO_ERR | G_IO_HUP,
-	                                   xmmsc_glib_read_cb,
-	                                   watch);
-	g_io_channel_unref (watch->iochan);
+	xsource = (xmmsc_glib_source_t *) source;
+	xsource->conn = xmmsc_ref (c);
+	xsource->pollfd.fd = xmmsc_io_fd_get (c);
+	xsource->pollfd.events = G_IO_IN | G_IO_ERR | G_IO_HUP;
 
-	if (xmmsc_io_want_out (c)) {
-		xmmsc_mainloop_need_out_cb (TRUE, watch);
-	}
+	g_source_add_poll (source, &xsource->pollfd);
+	g_source_attach (source, NULL);
 
-	return watch;
+	return source;
 }
 
 void
 xmmsc_mainloop_gmain_shutdown (xmmsc_connection_t *c, void *data)
 {
-	g_return_if_fail (data != NULL);
-
-	xmmsc_glib_watch_t *watch = (xmmsc_glib_watch_t *) data;
+	GSource *source = data;
 
-	g_source_remove (watch->source_id);
-	xmmsc_unref (watch->conn);
+	g_return_if_fail (source != NULL);
 
-	g_free (watch);
+	g_source_destroy (source);
+	g_source_unref (source);
 }
@@ -79,3 +79,23 @@ xmmsc_bindata_list (xmmsc_connection_t *c)
 	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_BINDATA, XMMS_IPC_COMMAND_BINDATA_LIST,
 	                       XMMSV_LIST_END);
 }
+
+/**
+ * Retrieve an image from the servers bindata directory scaled down
+ * to fit size x size pixels, as a "png" or "jpeg". The server makes
+ * it once and keeps it, so asking for it again is cheap.
+ */
+xmmsc_result_t *
+xmmsc_bindata_retrieve_scaled (xmmsc_connection_t *c, const char *hash,
+                               int size, const char *format)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!hash, "with a NULL hash", NULL);
+	x_api_error_if (!format, "with a NULL format", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_BINDATA, XMMS_IPC_COMMAND_BINDATA_RETRIEVE_SCALED,
+	                       XMMSV_LIST_ENTRY_STR (hash),
+	                       XMMSV_LIST_ENTRY_INT (size),
+	                       XMMSV_LIST_ENTRY_STR (format),
+	                       XMMSV_LIST_END);
+}
@@ -302,6 +302,69 @@ xmmsc_coll_query (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch)
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Run a query whose result is kept on the server and retrieved in
+ * pages with #xmmsc_coll_query_cursor_next.
+ *
+ * @param conn  The connection to the server.
+ * @param coll  The collection used to query.
+ * @param fetch The fetch specification, applied to each page.
+ * @return An int with the id of the cursor.
+ */
+xmmsc_result_t*
+xmmsc_coll_query_cursor_open (xmmsc_connection_t *conn, xmmsv_t *coll,
+                              xmmsv_t *fetch)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (!coll, "with a NULL collection", NULL);
+	x_api_error_if (!fetch, "with a NULL fetch specification", NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_OPEN,
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (coll)),
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (fetch)),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Fetch the next page of a query cursor.
+ *
+ * @param conn  The connection to the server.
+ * @param id    The id of the cursor.
+ * @param count The maximum number of media in the page.
+ * @return An xmmsv_t with the structure specified in fetch, or an empty
+ * list once all media have been fetched.
+ */
+xmmsc_result_t*
+xmmsc_coll_query_cursor_next (xmmsc_connection_t *conn, int id, int count)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (count <= 0, "with a non-positive count", NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_NEXT,
+	                       XMMSV_LIST_ENTRY_INT (id),
+	                       XMMSV_LIST_ENTRY_INT (count),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Release a query cursor on the server.
+ *
+ * @param conn  The connection to the server.
+ * @param id    The id of the cursor.
+ */
+xmmsc_result_t*
+xmmsc_coll_query_cursor_close (xmmsc_connection_t *conn, int id)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_COLLECTION,
+	                       XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_CLOSE,
+	                       XMMSV_LIST_ENTRY_INT (id),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Request the collection changed broadcast from the server. Everytime someone
  * manipulates a collection this will be emitted.
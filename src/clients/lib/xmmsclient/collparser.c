@@ -17,10 +17,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 
 #include <xmmsclient/xmmsclient.h>
 #include <xmmsclientpriv/xmmsclient.h>
+#include <xmmscpriv/xmmsv.h>
 #include <xmmsc/xmmsc_idnumbers.h>
 
 
@@ -45,8 +45,71 @@ xmmsv_coll_prop_short[] = { { 'a', "artist" },
                             { 'u', "url" } };
 
 
-#define TOKEN_MATCH_CHAR(symbol, type) if (*tmp == (symbol)) { *newpos = tmp + 1; return coll_token_new (type, NULL); }
-#define TOKEN_MATCH_STRING(expr, type) if (strncmp (expr, tmp, strlen (expr)) == 0) { *newpos = tmp + strlen (expr); return coll_token_new (type, NULL); }
+/* Character classes of the default tokenizer */
+#define CHAR_OPERATOR  (1 << 0)  /* a token by itself, see coll_char_token */
+#define CHAR_PROP_END  (1 << 1)  /* ends a property name */
+#define CHAR_BOUNDARY  (1 << 2)  /* ends an unquoted string */
+#define CHAR_SEQUENCE  (1 << 3)  /* may appear in an integer sequence */
+#define CHAR_WILDCARD  (1 << 4)  /* makes a string a pattern */
+#define CHAR_KEYWORD   (1 << 5)  /* may start a keyword */
+#define CHAR_QUOTE     (1 << 6)  /* starts a quoted string */
+
+static const unsigned char
+coll_char_class[256] = { ['('] = CHAR_OPERATOR | CHAR_BOUNDARY,
+                         [')'] = CHAR_OPERATOR | CHAR_BOUNDARY,
+                         ['#'] = CHAR_OPERATOR,
+                         ['+'] = CHAR_OPERATOR,
+                         [':'] = CHAR_OPERATOR | CHAR_PROP_END,
+                         ['~'] = CHAR_OPERATOR | CHAR_PROP_END,
+                         ['<'] = CHAR_OPERATOR | CHAR_PROP_END,
+                         ['>'] = CHAR_OPERATOR | CHAR_PROP_END,
+                         ['0'] = CHAR_SEQUENCE, ['1'] = CHAR_SEQUENCE,
+                         ['2'] = CHAR_SEQUENCE, ['3'] = CHAR_SEQUENCE,
+                         ['4'] = CHAR_SEQUENCE, ['5'] = CHAR_SEQUENCE,
+                         ['6'] = CHAR_SEQUENCE, ['7'] = CHAR_SEQUENCE,
+                         ['8'] = CHAR_SEQUENCE, ['9'] = CHAR_SEQUENCE,
+                         [','] = CHAR_SEQUENCE, ['-'] = CHAR_SEQUENCE,
+                         ['*'] = CHAR_WILDCARD, ['?'] = CHAR_WILDCARD,
+                         ['O'] = CHAR_KEYWORD, ['A'] = CHAR_KEYWORD,
+                         ['N'] = CHAR_KEYWORD, ['i'] = CHAR_KEYWORD,
+                         ['"'] = CHAR_QUOTE, ['\''] = CHAR_QUOTE };
+
+static const xmmsv_coll_token_type_t
+coll_char_token[256] = { ['('] = XMMS_COLLECTION_TOKEN_GROUP_OPEN,
+                         [')'] = XMMS_COLLECTION_TOKEN_GROUP_CLOSE,
+                         ['#'] = XMMS_COLLECTION_TOKEN_SYMBOL_ID,
+                         ['+'] = XMMS_COLLECTION_TOKEN_OPFIL_HAS,
+                         [':'] = XMMS_COLLECTION_TOKEN_OPFIL_EQUALS,
+                         ['~'] = XMMS_COLLECTION_TOKEN_OPFIL_MATCH,
+                         ['<'] = XMMS_COLLECTION_TOKEN_OPFIL_SMALLER,
+                         ['>'] = XMMS_COLLECTION_TOKEN_OPFIL_GREATER };
+
+typedef struct {
+	const char *str;
+	int len;
+	xmmsv_coll_token_type_t type;
+} xmmsv_coll_keyword_t;
+
+static const xmmsv_coll_keyword_t
+coll_keywords[] = { { "OR", 2, XMMS_COLLECTION_TOKEN_OPSET_UNION },
+                    { "AND", 3, XMMS_COLLECTION_TOKEN_OPSET_INTERSECTION },
+                    { "NOT", 3, XMMS_COLLECTION_TOKEN_OPSET_COMPLEMENT },
+                    { "in:", 3, XMMS_COLLECTION_TOKEN_REFERENCE } };
+
+#define CHAR_IS(c, class) (coll_char_class[(unsigned char) (c)] & (class))
+
+/* Patterns parsed with the default parser are cached, as clients tend
+ * to parse the same ones over and over again, e.g. while completing.
+ */
+#define PARSE_CACHE_SIZE 32
+
+typedef struct {
+	char *pattern;
+	xmmsv_t *coll;
+} xmmsv_coll_parse_cache_t;
+
+static xmmsv_coll_parse_cache_t parse_cache[PARSE_CACHE_SIZE];
+static char parse_cache_lock;
 
 #define TOKEN_ASSERT(token, tktype) do { \
 	if (!token || (token->type != tktype)) { \
@@ -91,6 +154,10 @@ static void coll_append_universe (xmmsv_t *coll);
 static char *coll_parse_prop (xmmsv_coll_token_t *token);
 static char *coll_parse_strval (xmmsv_coll_token_t *token);
 
+static xmmsv_t *coll_parse_cache_lookup (const char *pattern);
+static void coll_parse_cache_insert (const char *pattern, xmmsv_t *coll);
+static size_t coll_token_length (const char *str, char quote);
+
 static char *string_substr (char *start, char *end);
 static char *string_intadd (char *number, int delta);
 
@@ -134,10 +201,25 @@ static char *string_intadd (char *number, int delta);
 int
 xmmsv_coll_parse (const char *pattern, xmmsv_t** coll)
 {
-	return xmmsv_coll_parse_custom (pattern,
-	                                xmmsv_coll_default_parse_tokens,
-	                                xmmsv_coll_default_parse_build,
-	                                coll);
+	xmmsv_t *cached;
+
+	cached = coll_parse_cache_lookup (pattern);
+	if (cached) {
+		*coll = xmmsv_copy (cached);
+		xmmsv_unref (cached);
+		return 1;
+	}
+
+	if (!xmmsv_coll_parse_custom (pattern,
+	                              xmmsv_coll_default_parse_tokens,
+	                              xmmsv_coll_default_parse_build,
+	                              coll)) {
+		return 0;
+	}
+
+	coll_parse_cache_insert (pattern, *coll);
+
+	return 1;
 }
 
 /**
@@ -227,31 +309,41 @@ xmmsv_coll_default_parse_tokens (const char *str, const char **newpos)
 	}
 	tmp = str;
 
-	TOKEN_MATCH_CHAR ('(', XMMS_COLLECTION_TOKEN_GROUP_OPEN);
-	TOKEN_MATCH_CHAR (')', XMMS_COLLECTION_TOKEN_GROUP_CLOSE);
-	TOKEN_MATCH_CHAR ('#', XMMS_COLLECTION_TOKEN_SYMBOL_ID);
-	TOKEN_MATCH_CHAR ('+', XMMS_COLLECTION_TOKEN_OPFIL_HAS);
-	TOKEN_MATCH_CHAR (':', XMMS_COLLECTION_TOKEN_OPFIL_EQUALS);
-	TOKEN_MATCH_CHAR ('~', XMMS_COLLECTION_TOKEN_OPFIL_MATCH);
-	TOKEN_MATCH_STRING ("<=", XMMS_COLLECTION_TOKEN_OPFIL_SMALLEREQ);
-	TOKEN_MATCH_STRING (">=", XMMS_COLLECTION_TOKEN_OPFIL_GREATEREQ);
-	TOKEN_MATCH_CHAR ('<', XMMS_COLLECTION_TOKEN_OPFIL_SMALLER);
-	TOKEN_MATCH_CHAR ('>', XMMS_COLLECTION_TOKEN_OPFIL_GREATER);
+	if (CHAR_IS (*tmp, CHAR_OPERATOR)) {
+		type = coll_char_token[(unsigned char) *tmp];
+		*newpos = tmp + 1;
+
+		/* <= and >= */
+		if (tmp[1] == '=') {
+			if (type == XMMS_COLLECTION_TOKEN_OPFIL_SMALLER) {
+				type = XMMS_COLLECTION_TOKEN_OPFIL_SMALLEREQ;
+				*newpos = tmp + 2;
+			} else if (type == XMMS_COLLECTION_TOKEN_OPFIL_GREATER) {
+				type = XMMS_COLLECTION_TOKEN_OPFIL_GREATEREQ;
+				*newpos = tmp + 2;
+			}
+		}
 
-	TOKEN_MATCH_STRING ("OR", XMMS_COLLECTION_TOKEN_OPSET_UNION);
-	TOKEN_MATCH_STRING ("AND", XMMS_COLLECTION_TOKEN_OPSET_INTERSECTION);
-	TOKEN_MATCH_STRING ("NOT", XMMS_COLLECTION_TOKEN_OPSET_COMPLEMENT);
+		return coll_token_new (type, NULL);
+	}
 
-	TOKEN_MATCH_STRING ("in:", XMMS_COLLECTION_TOKEN_REFERENCE);
+	if (CHAR_IS (*tmp, CHAR_KEYWORD)) {
+		for (i = 0; i < X_N_ELEMENTS (coll_keywords); i++) {
+			if (strncmp (coll_keywords[i].str, tmp, coll_keywords[i].len) == 0) {
+				*newpos = tmp + coll_keywords[i].len;
+				return coll_token_new (coll_keywords[i].type, NULL);
+			}
+		}
+	}
 
 	/* Starting with double-quote => STRING or PATTERN */
-	if (*tmp == '"' || *tmp == '\'') {
+	if (CHAR_IS (*tmp, CHAR_QUOTE)) {
 		i = 0;
 		quote = *tmp;
 		type = XMMS_COLLECTION_TOKEN_STRING;
 
 		tmp++;
-		strval = x_new0 (char, strlen (tmp) + 1);
+		strval = x_new0 (char, coll_token_length (tmp, quote) + 1);
 
 		while (*tmp != '\0' && (escape || *tmp != quote)) {
 			if (!escape && (*tmp == '\\')) {
@@ -259,7 +351,7 @@ xmmsv_coll_default_parse_tokens (const char *str, const char **newpos)
 			} else {
 				if (escape) {
 					escape = 0;
-				} else if ((*tmp == '*') || (*tmp == '?')) {
+				} else if (CHAR_IS (*tmp, CHAR_WILDCARD)) {
 					type = XMMS_COLLECTION_TOKEN_PATTERN;
 				}
 				strval[i++] = *tmp;
@@ -278,7 +370,7 @@ xmmsv_coll_default_parse_tokens (const char *str, const char **newpos)
 
 	i = 0;
 	type = XMMS_COLLECTION_TOKEN_INTEGER;
-	strval = x_new0 (char, strlen (tmp) + 1);
+	strval = x_new0 (char, coll_token_length (tmp, '\0') + 1);
 	while (*tmp != '\0' && (escape || *tmp != ' ')) {
 
 		/* Control input chars, escape mechanism, etc */
@@ -287,15 +379,14 @@ xmmsv_coll_default_parse_tokens (const char *str, const char **newpos)
 				escape = 1;
 				tmp++;
 				continue;
-			} else if (*tmp == ':' || *tmp == '~' ||
-			           *tmp == '<' || *tmp == '>') {
+			} else if (CHAR_IS (*tmp, CHAR_PROP_END)) {
 				/* that was a property name, ends with a colon */
 				if (tmp - str == 1)
 					type = XMMS_COLLECTION_TOKEN_PROP_SHORT;
 				else
 					type = XMMS_COLLECTION_TOKEN_PROP_LONG;
 				break;
-			} else if (*tmp == '(' || *tmp == ')') {
+			} else if (CHAR_IS (*tmp, CHAR_BOUNDARY)) {
 				/* boundary char, stop parsing the string */
 				break;
 			}
@@ -312,13 +403,13 @@ xmmsv_coll_default_parse_tokens (const char *str, const char **newpos)
 
 		/* matches [0-9,-] => SEQUENCE */
 		case XMMS_COLLECTION_TOKEN_SEQUENCE:
-			if (!isdigit (*tmp) && (*tmp != ',') && (*tmp != '-')) {
+			if (!CHAR_IS (*tmp, CHAR_SEQUENCE)) {
 				type = XMMS_COLLECTION_TOKEN_STRING;
 			}
 
 		/* contains [*?] => PATTERN */
 		case XMMS_COLLECTION_TOKEN_STRING:
-			if (!escape && (*tmp == '*' || *tmp == '?')) {
+			if (!escape && CHAR_IS (*tmp, CHAR_WILDCARD)) {
 				type = XMMS_COLLECTION_TOKEN_PATTERN;
 			}
 			break;
@@ -1085,6 +1176,84 @@ coll_parse_strval (xmmsv_coll_token_t *token)
 	return token->string;
 }
 
+/* Get a reference to the cached collection for a pattern, if any, and
+ * move it to the front of the cache.
+ */
+static xmmsv_t *
+coll_parse_cache_lookup (const char *pattern)
+{
+	xmmsv_coll_parse_cache_t entry;
+	xmmsv_t *coll = NULL;
+	int i;
+
+	_xmmsv_spin_lock (&parse_cache_lock);
+
+	for (i = 0; i < PARSE_CACHE_SIZE && parse_cache[i].pattern; i++) {
+		if (strcmp (parse_cache[i].pattern, pattern) == 0) {
+			entry = parse_cache[i];
+			memmove (parse_cache + 1, parse_cache, i * sizeof (entry));
+			parse_cache[0] = entry;
+
+			coll = xmmsv_ref (entry.coll);
+			break;
+		}
+	}
+
+	_xmmsv_spin_unlock (&parse_cache_lock);
+
+	return coll;
+}
+
+/* Cache a frozen copy of a parsed collection, dropping the least
+ * recently used one when full.
+ */
+static void
+coll_parse_cache_insert (const char *pattern, xmmsv_t *coll)
+{
+	xmmsv_coll_parse_cache_t entry, last;
+
+	entry.pattern = strdup (pattern);
+	entry.coll = xmmsv_freeze (xmmsv_copy (coll));
+
+	_xmmsv_spin_lock (&parse_cache_lock);
+
+	last = parse_cache[PARSE_CACHE_SIZE - 1];
+	memmove (parse_cache + 1, parse_cache,
+	         (PARSE_CACHE_SIZE - 1) * sizeof (entry));
+	parse_cache[0] = entry;
+
+	_xmmsv_spin_unlock (&parse_cache_lock);
+
+	if (last.pattern) {
+		free (last.pattern);
+		xmmsv_unref (last.coll);
+	}
+}
+
+/* Get the length of the token at str, up to the closing quote or the
+ * first unescaped delimiter when not quoted, so its value can be
+ * allocated without going through the rest of the pattern.
+ */
+static size_t
+coll_token_length (const char *str, char quote)
+{
+	const char *tmp;
+	int escape = 0;
+
+	for (tmp = str; *tmp != '\0'; tmp++) {
+		if (escape) {
+			escape = 0;
+		} else if (*tmp == '\\') {
+			escape = 1;
+		} else if (quote ? *tmp == quote
+		                 : (*tmp == ' ' || CHAR_IS (*tmp, CHAR_PROP_END | CHAR_BOUNDARY))) {
+			break;
+		}
+	}
+
+	return tmp - str;
+}
+
 /* Create a new string from a substring of an existing string, between
  * start and end.
  */
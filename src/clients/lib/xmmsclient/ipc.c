@@ -36,8 +36,17 @@
 struct xmmsc_ipc_St {
 	xmms_ipc_transport_t *transport;
 	xmms_ipc_msg_t *read_msg;
-	x_list_t *results_list;
+	/* outstanding results, hashed on their cookie */
+	x_list_t **results;
+	unsigned int results_size;
+	unsigned int results_count;
 	x_queue_t *out_msg;
+	/* bytes of the head of out_msg already written */
+	uint32_t out_xfered;
+	/* nesting depth of xmmsc_ipc_batch_begin */
+	int batch;
+	/* ring the server puts large messages in, if any */
+	xmms_ipc_shm_t *shm;
 	char *error;
 	bool disconnect;
 	void *lockdata;
@@ -56,6 +65,15 @@ struct xmmsc_ipc_St {
 static inline void xmmsc_ipc_lock (xmmsc_ipc_t *ipc);
 static inline void xmmsc_ipc_unlock (xmmsc_ipc_t *ipc);
 static void xmmsc_ipc_exec_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *msg);
+static void xmmsc_ipc_exec_shm_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *notice);
+
+/* Cookies are handed out in sequence, so the low bits spread them
+ * evenly over the buckets. */
+#define XMMSC_IPC_RESULTS_MIN_SIZE 64
+#define XMMSC_IPC_RESULTS_BUCKET(ipc, cookie) (&(ipc)->results[(cookie) & ((ipc)->results_size - 1)])
+
+/* Number of queued messages gathered into one write. */
+#define XMMSC_IPC_WRITE_BATCH 16
 
 
 int
@@ -77,7 +95,11 @@ xmmsc_ipc_io_in_callback (xmmsc_ipc_t *ipc)
 			   because exec_msg can cause reentrancy */
 			ipc->read_msg = NULL;
 
-			xmmsc_ipc_exec_msg (ipc, msg);
+			if (xmms_ipc_msg_get_cmd (msg) == XMMS_IPC_COMMAND_SHM) {
+				xmmsc_ipc_exec_shm_msg (ipc, msg);
+			} else {
+				xmmsc_ipc_exec_msg (ipc, msg);
+			}
 
 		} else {
 
@@ -91,12 +113,75 @@ xmmsc_ipc_io_in_callback (xmmsc_ipc_t *ipc)
 	return !disco;
 }
 
+static bool
+xmmsc_ipc_has_out (xmmsc_ipc_t *ipc)
+{
+	return !x_queue_is_empty (ipc->out_msg) && !ipc->disconnect;
+}
+
 int
 xmmsc_ipc_io_out (xmmsc_ipc_t *ipc)
 {
 	x_return_val_if_fail (ipc, false);
 
-	return !x_queue_is_empty (ipc->out_msg) && !ipc->disconnect;
+	/* hold back output until the batch is committed */
+	return !ipc->batch && xmmsc_ipc_has_out (ipc);
+}
+
+/**
+ * Write as much of the queued messages as the transport takes,
+ * gathering several messages into each write.
+ */
+static bool
+xmmsc_ipc_write_queued (xmmsc_ipc_t *ipc, bool *disconnected)
+{
+	unsigned char heads[XMMSC_IPC_WRITE_BATCH][XMMS_IPC_MSG_HEAD_LEN];
+	xmms_ipc_transport_vec_t vec[XMMSC_IPC_WRITE_BATCH * 2];
+	xmms_ipc_msg_t *msg;
+	x_list_t *n;
+	int i, nvec, ret;
+	uint32_t xfered, left;
+
+	while (!x_queue_is_empty (ipc->out_msg)) {
+		xfered = ipc->out_xfered;
+		nvec = 0;
+
+		for (i = 0, n = ipc->out_msg->head;
+		     i < XMMSC_IPC_WRITE_BATCH && n; i++, n = n->next) {
+			nvec += xmms_ipc_msg_get_unwritten (n->data, false, 0, xfered,
+			                                    heads[i], vec + nvec);
+			xfered = 0;
+		}
+
+		ret = xmms_ipc_transport_writev (ipc->transport, vec, nvec);
+
+		if (ret == SOCKET_ERROR) {
+			if (!xmms_socket_error_recoverable ()) {
+				*disconnected = true;
+			}
+			return false;
+		} else if (ret == 0) {
+			*disconnected = true;
+			return false;
+		}
+
+		while (ret > 0) {
+			msg = x_queue_peek_head (ipc->out_msg);
+			left = xmms_ipc_msg_get_size (msg) - ipc->out_xfered;
+
+			if ((uint32_t) ret < left) {
+				ipc->out_xfered += ret;
+				break;
+			}
+
+			ret -= left;
+			ipc->out_xfered = 0;
+			x_queue_pop_head (ipc->out_msg);
+			xmms_ipc_msg_destroy (msg);
+		}
+	}
+
+	return true;
 }
 
 int
@@ -107,15 +192,7 @@ xmmsc_ipc_io_out_callback (xmmsc_ipc_t *ipc)
 	x_return_val_if_fail (ipc, false);
 	x_return_val_if_fail (!ipc->disconnect, false);
 
-	while (!x_queue_is_empty (ipc->out_msg)) {
-		xmms_ipc_msg_t *msg = x_queue_peek_head (ipc->out_msg);
-		if (xmms_ipc_msg_write_transport (msg, ipc->transport, &disco)) {
-			x_queue_pop_head (ipc->out_msg);
-			xmms_ipc_msg_destroy (msg);
-		} else {
-			break;
-		}
-	}
+	xmmsc_ipc_write_queued (ipc, &disco);
 
 	if (disco) {
 		xmmsc_ipc_disconnect (ipc);
@@ -128,6 +205,36 @@ xmmsc_ipc_io_out_callback (xmmsc_ipc_t *ipc)
 	return !disco;
 }
 
+/**
+ * Start queueing messages without asking the mainloop to write them,
+ * so that a run of commands is written in as few syscalls as
+ * possible. Batches nest.
+ */
+void
+xmmsc_ipc_batch_begin (xmmsc_ipc_t *ipc)
+{
+	x_return_if_fail (ipc);
+
+	ipc->batch++;
+}
+
+/**
+ * End a batch started with #xmmsc_ipc_batch_begin. When the outermost
+ * batch ends, the queued messages are handed to the mainloop.
+ */
+void
+xmmsc_ipc_batch_end (xmmsc_ipc_t *ipc)
+{
+	x_return_if_fail (ipc);
+	x_return_if_fail (ipc->batch > 0);
+
+	if (--ipc->batch == 0 && xmmsc_ipc_has_out (ipc)) {
+		if (ipc->need_out_callback) {
+			ipc->need_out_callback (1, ipc->need_out_data);
+		}
+	}
+}
+
 xmms_socket_t
 xmmsc_ipc_fd_get (xmmsc_ipc_t *ipc)
 {
@@ -170,7 +277,8 @@ xmmsc_ipc_init (void)
 	xmmsc_ipc_t *ipc;
 	ipc = x_new0 (xmmsc_ipc_t, 1);
 	ipc->disconnect = false;
-	ipc->results_list = NULL;
+	ipc->results_size = XMMSC_IPC_RESULTS_MIN_SIZE;
+	ipc->results = x_new0 (x_list_t *, ipc->results_size);
 	ipc->out_msg = x_queue_new ();
 
 	return ipc;
@@ -202,6 +310,65 @@ xmmsc_ipc_lock_set (xmmsc_ipc_t *ipc, void *lock, void (*lockfunc)(void *), void
 	ipc->unlockfunc = unlockfunc;
 }
 
+/* Double the buckets, should hold the lock */
+static void
+xmmsc_ipc_results_grow (xmmsc_ipc_t *ipc)
+{
+	x_list_t **old, *n;
+	unsigned int i, old_size;
+
+	old = ipc->results;
+	old_size = ipc->results_size;
+
+	ipc->results_size *= 2;
+	ipc->results = x_new0 (x_list_t *, ipc->results_size);
+
+	for (i = 0; i < old_size; i++) {
+		for (n = old[i]; n; n = x_list_next (n)) {
+			x_list_t **bucket;
+			bucket = XMMSC_IPC_RESULTS_BUCKET (ipc, xmmsc_result_cookie_get (n->data));
+			*bucket = x_list_prepend (*bucket, n->data);
+		}
+		x_list_free (old[i]);
+	}
+
+	free (old);
+}
+
+/* Add res to the bucket of cookie, should hold the lock */
+static void
+xmmsc_ipc_results_insert (xmmsc_ipc_t *ipc, xmmsc_result_t *res, uint32_t cookie)
+{
+	x_list_t **bucket;
+
+	if (ipc->results_count >= ipc->results_size) {
+		xmmsc_ipc_results_grow (ipc);
+	}
+
+	bucket = XMMSC_IPC_RESULTS_BUCKET (ipc, cookie);
+	*bucket = x_list_prepend (*bucket, res);
+	ipc->results_count++;
+}
+
+/* Remove res from the bucket of cookie, should hold the lock */
+static bool
+xmmsc_ipc_results_remove (xmmsc_ipc_t *ipc, xmmsc_result_t *res, uint32_t cookie)
+{
+	x_list_t **bucket, *n;
+
+	bucket = XMMSC_IPC_RESULTS_BUCKET (ipc, cookie);
+
+	for (n = *bucket; n; n = x_list_next (n)) {
+		if (n->data == res) {
+			*bucket = x_list_delete_link (*bucket, n);
+			ipc->results_count--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
 void
 xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 {
@@ -209,7 +376,23 @@ xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 	x_return_if_fail (res);
 
 	xmmsc_ipc_lock (ipc);
-	ipc->results_list = x_list_prepend (ipc->results_list, res);
+	xmmsc_ipc_results_insert (ipc, res, xmmsc_result_cookie_get (res));
+	xmmsc_ipc_unlock (ipc);
+}
+
+/**
+ * Move a registered result to its new cookie, after it was restarted.
+ */
+void
+xmmsc_ipc_result_rekey (xmmsc_ipc_t *ipc, xmmsc_result_t *res, uint32_t old_cookie)
+{
+	x_return_if_fail (ipc);
+	x_return_if_fail (res);
+
+	xmmsc_ipc_lock (ipc);
+	if (xmmsc_ipc_results_remove (ipc, res, old_cookie)) {
+		xmmsc_ipc_results_insert (ipc, res, xmmsc_result_cookie_get (res));
+	}
 	xmmsc_ipc_unlock (ipc);
 }
 
@@ -223,7 +406,7 @@ xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie)
 
 	xmmsc_ipc_lock (ipc);
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
+	for (n = *XMMSC_IPC_RESULTS_BUCKET (ipc, cookie); n; n = x_list_next (n)) {
 		xmmsc_result_t *tmp = n->data;
 
 		if (cookie == xmmsc_result_cookie_get (tmp)) {
@@ -240,21 +423,13 @@ xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie)
 void
 xmmsc_ipc_result_unregister (xmmsc_ipc_t *ipc, xmmsc_result_t *res)
 {
-	x_list_t *n;
-
 	x_return_if_fail (ipc);
 	x_return_if_fail (res);
 
 	xmmsc_ipc_lock (ipc);
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
-		xmmsc_result_t *tmp = n->data;
-
-		if (xmmsc_result_cookie_get (res) == xmmsc_result_cookie_get (tmp)) {
-			ipc->results_list = x_list_delete_link (ipc->results_list, n);
-			xmmsc_result_clear_weakrefs (res);
-			break;
-		}
+	if (xmmsc_ipc_results_remove (ipc, res, xmmsc_result_cookie_get (res))) {
+		xmmsc_result_clear_weakrefs (res);
 	}
 
 	xmmsc_ipc_unlock (ipc);
@@ -286,8 +461,9 @@ xmmsc_ipc_wait_for_event (xmmsc_ipc_t *ipc, unsigned int timeout)
 	FD_ZERO (&rfdset);
 	FD_SET (fd, &rfdset);
 
+	/* a wait flushes the current batch, if any */
 	FD_ZERO (&wfdset);
-	if (xmmsc_ipc_io_out (ipc)) {
+	if (xmmsc_ipc_has_out (ipc)) {
 		FD_SET (fd, &wfdset);
 	}
 
@@ -308,12 +484,17 @@ xmmsc_ipc_wait_for_event (xmmsc_ipc_t *ipc, unsigned int timeout)
 bool
 xmmsc_ipc_msg_write (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *msg, uint32_t cookie)
 {
+	bool had_out;
+
 	x_return_val_if_fail (ipc, false);
 
 	xmms_ipc_msg_set_cookie (msg, cookie);
+
+	/* the mainloop already waits to write a non empty queue */
+	had_out = xmmsc_ipc_has_out (ipc);
 	x_queue_push_tail (ipc->out_msg, msg);
 
-	if (ipc->need_out_callback) {
+	if (ipc->need_out_callback && !ipc->batch && !had_out) {
 		ipc->need_out_callback (1, ipc->need_out_data);
 	}
 
@@ -325,20 +506,27 @@ void
 xmmsc_ipc_destroy (xmmsc_ipc_t *ipc)
 {
 	x_list_t *n;
+	unsigned int i;
 
 	if (!ipc)
 		return;
 
-	for (n = ipc->results_list; n; n = x_list_next (n)) {
-		xmmsc_result_t *tmp = n->data;
-		xmmsc_result_clear_weakrefs (tmp);
+	for (i = 0; i < ipc->results_size; i++) {
+		for (n = ipc->results[i]; n; n = x_list_next (n)) {
+			xmmsc_result_t *tmp = n->data;
+			xmmsc_result_clear_weakrefs (tmp);
+		}
+		x_list_free (ipc->results[i]);
 	}
-
-	x_list_free (ipc->results_list);
+	free (ipc->results);
 	if (ipc->transport) {
 		xmms_ipc_transport_destroy (ipc->transport);
 	}
 
+	if (ipc->shm) {
+		xmms_ipc_shm_destroy (ipc->shm);
+	}
+
 	if (ipc->out_msg) {
 		x_queue_free (ipc->out_msg);
 	}
@@ -406,3 +594,64 @@ xmmsc_ipc_exec_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *msg)
 
 	xmmsc_result_run (res, msg);
 }
+
+/**
+ * Run the message a notice from the server points to in the shared
+ * memory ring, reading it in place, and hand its space back.
+ */
+static void
+xmmsc_ipc_exec_shm_msg (xmmsc_ipc_t *ipc, xmms_ipc_msg_t *notice)
+{
+	const unsigned char *data = NULL;
+	xmms_ipc_msg_t *msg = NULL;
+	xmmsv_t *value;
+	int32_t pos = 0, len = 0;
+
+	if (xmms_ipc_msg_get_value (notice, &value)) {
+		xmmsv_list_get_int32 (value, 0, &pos);
+		xmmsv_list_get_int32 (value, 1, &len);
+		xmmsv_unref (value);
+	}
+	xmms_ipc_msg_destroy (notice);
+
+	if (ipc->shm && len > 0) {
+		data = xmms_ipc_shm_peek (ipc->shm, pos, len);
+	}
+	if (data) {
+		msg = xmms_ipc_msg_new_from_data (data, len);
+	}
+	if (!msg) {
+		x_internal_error ("bad shared memory message from the server");
+		return;
+	}
+
+	/* the message is destroyed before any callback runs */
+	xmmsc_ipc_exec_msg (ipc, msg);
+
+	xmms_ipc_shm_release (ipc->shm, pos, len);
+}
+
+/**
+ * Whether the connection is to a server on the same host.
+ */
+bool
+xmmsc_ipc_is_local (xmmsc_ipc_t *ipc)
+{
+	x_return_val_if_fail (ipc, false);
+
+	return ipc->transport && ipc->transport->local;
+}
+
+/**
+ * Set the ring the server puts large messages in, taking ownership.
+ */
+void
+xmmsc_ipc_shm_set (xmmsc_ipc_t *ipc, xmms_ipc_shm_t *shm)
+{
+	x_return_if_fail (ipc);
+
+	if (ipc->shm) {
+		xmms_ipc_shm_destroy (ipc->shm);
+	}
+	ipc->shm = shm;
+}
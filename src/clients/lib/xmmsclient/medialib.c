@@ -99,6 +99,94 @@ xmmsc_medialib_move_entry (xmmsc_connection_t *conn, int entry, const char *url)
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Retrieve which keys the medialib keeps an index on and how many
+ * query filters ran on each key.
+ * @param conn The #xmmsc_connection_t
+ */
+xmmsc_result_t *
+xmmsc_medialib_index_stats (xmmsc_connection_t *conn)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_msg_no_arg (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                              XMMS_IPC_COMMAND_MEDIALIB_INDEX_STATS);
+}
+
+/**
+ * Rewrite the medialib database to reclaim the space of removed data.
+ * The result is a dict with the size of the database "before" and
+ * "after".
+ * @param conn The #xmmsc_connection_t
+ */
+xmmsc_result_t *
+xmmsc_medialib_compact (xmmsc_connection_t *conn)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_msg_no_arg (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                              XMMS_IPC_COMMAND_MEDIALIB_COMPACT);
+}
+
+/**
+ * Write all entries of the medialib and their properties to a file on
+ * the server. The result is the number of entries written, once the
+ * file is complete.
+ * @param conn The #xmmsc_connection_t
+ * @param path The absolute path of the file
+ */
+xmmsc_result_t *
+xmmsc_medialib_dump (xmmsc_connection_t *conn, const char *path)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (!path, "with a NULL path", NULL);
+
+	return do_methodcall (conn, XMMS_IPC_COMMAND_MEDIALIB_DUMP, path);
+}
+
+/**
+ * Add the entries of a file written by #xmmsc_medialib_dump, merged
+ * with the entries of the same url. The result is the number of
+ * entries read.
+ * @param conn The #xmmsc_connection_t
+ * @param path The absolute path of the file on the server
+ */
+xmmsc_result_t *
+xmmsc_medialib_restore (xmmsc_connection_t *conn, const char *path)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (!path, "with a NULL path", NULL);
+
+	return do_methodcall (conn, XMMS_IPC_COMMAND_MEDIALIB_RESTORE, path);
+}
+
+/**
+ * Complete a prefix of a value of a key the server keeps a token index
+ * on, see the medialib.token_index_keys config, without a query over
+ * the medialib. The result is a list of the distinct values, the most
+ * common first.
+ * @param conn The #xmmsc_connection_t
+ * @param key The property key, like artist or album
+ * @param prefix What the value starts with, ignoring case
+ * @param limit The most values to return
+ */
+xmmsc_result_t *
+xmmsc_medialib_complete (xmmsc_connection_t *conn, const char *key,
+                         const char *prefix, int limit)
+{
+	x_check_conn (conn, NULL);
+	x_api_error_if (!key, "with a NULL key", NULL);
+	x_api_error_if (!prefix, "with a NULL prefix", NULL);
+	x_api_error_if (limit <= 0, "with a limit that isn't positive", NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                       XMMS_IPC_COMMAND_MEDIALIB_COMPLETE,
+	                       XMMSV_LIST_ENTRY_STR (key),
+	                       XMMSV_LIST_ENTRY_STR (prefix),
+	                       XMMSV_LIST_ENTRY_INT (limit),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Remove a entry from the medialib
  * @param conn The #xmmsc_connection_t
@@ -204,9 +292,95 @@ xmmsc_medialib_add_entry_encoded (xmmsc_connection_t *conn, const char *url)
 	return do_methodcall (conn, XMMS_IPC_COMMAND_MEDIALIB_ADD_ENTRY, url);
 }
 
+/**
+ * Add many URLs to the medialib in one transaction. The result is a
+ * list of the entry ids, in the order of the URLs.
+ *
+ * @param conn The #xmmsc_connection_t
+ * @param urls A list of URLs to add to the medialib.
+ */
+xmmsc_result_t *
+xmmsc_medialib_add_entries (xmmsc_connection_t *conn, xmmsv_t *urls)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *encoded;
+	const char *url;
+	char *enc_url;
+
+	x_check_conn (conn, NULL);
+	x_api_error_if (!urls, "with a NULL url list", NULL);
+	x_api_error_if (!xmmsv_list_restrict_type (urls, XMMSV_TYPE_STRING),
+	                "with a non string url", NULL);
+
+	encoded = xmmsv_new_list ();
+
+	xmmsv_get_list_iter (urls, &it);
+	while (xmmsv_list_iter_entry_string (it, &url)) {
+		enc_url = xmmsv_encode_url (url);
+		if (!enc_url) {
+			xmmsv_unref (encoded);
+			return NULL;
+		}
+		xmmsv_list_append_string (encoded, enc_url);
+		free (enc_url);
+		xmmsv_list_iter_next (it);
+	}
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                       XMMS_IPC_COMMAND_MEDIALIB_ADD_ENTRIES,
+	                       XMMSV_LIST_ENTRY (encoded),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Rehash only the entries whose files changed since they were read.
+ * This runs in the background, the result is the id of the job which
+ * is listed by #xmmsc_medialib_import_status.
+ * @param conn #xmmsc_connection_t
+ */
+xmmsc_result_t *
+xmmsc_medialib_rehash_changed (xmmsc_connection_t *conn)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_msg_no_arg (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                              XMMS_IPC_COMMAND_MEDIALIB_REHASH_CHANGED);
+}
+
+/**
+ * Retrieve the progress of the import jobs started by
+ * #xmmsc_medialib_import_path.
+ * @param conn #xmmsc_connection_t
+ */
+xmmsc_result_t *
+xmmsc_medialib_import_status (xmmsc_connection_t *conn)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_msg_no_arg (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                              XMMS_IPC_COMMAND_MEDIALIB_IMPORT_STATUS);
+}
+
+/**
+ * Stop a running import job.
+ * @param conn #xmmsc_connection_t
+ * @param id The id returned by #xmmsc_medialib_import_path
+ */
+xmmsc_result_t *
+xmmsc_medialib_import_cancel (xmmsc_connection_t *conn, int id)
+{
+	x_check_conn (conn, NULL);
+
+	return xmmsc_send_cmd (conn, XMMS_IPC_OBJECT_MEDIALIB,
+	                       XMMS_IPC_COMMAND_MEDIALIB_IMPORT_CANCEL,
+	                       XMMSV_LIST_ENTRY_INT (id),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Import a all files recursivly from the directory passed
- * as argument.
+ * as argument. The import runs in the background, the result is
+ * the id of the import job.
  * @param conn #xmmsc_connection_t
  * @param path A directory to recursive search for mediafiles, this must
  * 		  include the protocol, i.e file://
@@ -304,16 +478,24 @@ xmmsc_medialib_rehash (xmmsc_connection_t *conn, int id)
 }
 
 /**
- * Retrieve information about a entry from the medialib.
+ * Retrieve information about a entry from the medialib. If the
+ * medialib cache is enabled, the reply is cached, see
+ * #xmmsc_medialib_cache_get.
  */
 xmmsc_result_t *
 xmmsc_medialib_get_info (xmmsc_connection_t *c, int id)
 {
+	xmmsc_result_t *res;
+
 	x_check_conn (c, NULL);
 
-	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MEDIALIB,
-	                       XMMS_IPC_COMMAND_MEDIALIB_GET_INFO,
-	                       XMMSV_LIST_ENTRY_INT (id), XMMSV_LIST_END);
+	res = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MEDIALIB,
+	                      XMMS_IPC_COMMAND_MEDIALIB_GET_INFO,
+	                      XMMSV_LIST_ENTRY_INT (id), XMMSV_LIST_END);
+
+	xmmsc_medialib_cache_fill (c, res, id);
+
+	return res;
 }
 
 /**
@@ -357,6 +539,63 @@ xmmsc_broadcast_medialib_entry_updated (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED);
 }
 
+/**
+ * Request the medialib_import_progress broadcast. This will be called
+ * while an import job runs and when it finishes. The argument will be
+ * a dict with the status of the job.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_medialib_import_progress (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_MEDIALIB_IMPORT_PROGRESS);
+}
+
+/**
+ * Request the medialib_entries_changed broadcast. This will be called
+ * once for all the entries changed together on the serverside. The
+ * argument will be a sorted list of medialib ids.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_medialib_entries_changed (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_MEDIALIB_ENTRIES_CHANGED);
+}
+
+/**
+ * Request the medialib_entry_updated broadcast, for the entries in
+ * the list of ids only.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_medialib_entry_updated_filtered (xmmsc_connection_t *c,
+                                                 xmmsv_t *ids)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!xmmsv_is_type (ids, XMMSV_TYPE_LIST),
+	                "with ids not a list", NULL);
+
+	return xmmsc_send_broadcast_filtered_msg (c, XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED, ids);
+}
+
+/**
+ * Request the medialib_entries_changed broadcast, for the entries in
+ * the list of ids only. Each broadcast lists just the ones of them
+ * that changed.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_medialib_entries_changed_filtered (xmmsc_connection_t *c,
+                                                   xmmsv_t *ids)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!xmmsv_is_type (ids, XMMSV_TYPE_LIST),
+	                "with ids not a list", NULL);
+
+	return xmmsc_send_broadcast_filtered_msg (c, XMMS_IPC_SIGNAL_MEDIALIB_ENTRIES_CHANGED, ids);
+}
+
 /**
  * Request the medialib_entry_removed broadcast. This will be called
  * if a entry is removed on the serverside. The argument will be an medialib
@@ -452,6 +691,72 @@ xmmsc_medialib_entry_property_set_str_with_source (xmmsc_connection_t *c,
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Set many properties of an entry in one transaction. The values in
+ * the dict must be strings or integers.
+ * Uses default source which is client/&lt;clientname&gt;
+ */
+xmmsc_result_t *
+xmmsc_medialib_entry_properties_set (xmmsc_connection_t *c, int id,
+                                     xmmsv_t *properties)
+{
+	char tmp[256];
+
+	x_check_conn (c, NULL);
+
+	snprintf (tmp, 256, "client/%s", c->clientname);
+	return xmmsc_medialib_entry_properties_set_with_source (c, id, tmp,
+	                                                        properties);
+}
+
+/**
+ * Set many properties of an entry, the same as
+ * #xmmsc_medialib_entry_properties_set but with specifing your own
+ * source.
+ */
+xmmsc_result_t *
+xmmsc_medialib_entry_properties_set_with_source (xmmsc_connection_t *c,
+                                                 int id,
+                                                 const char *source,
+                                                 xmmsv_t *properties)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!xmmsv_is_type (properties, XMMSV_TYPE_DICT),
+	                "with a non dict properties", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MEDIALIB,
+	                       XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTIES,
+	                       XMMSV_LIST_ENTRY_INT (id),
+	                       XMMSV_LIST_ENTRY_STR (source),
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (properties)),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Set one property on many entries in one transaction. The value
+ * must be a string or an integer.
+ */
+xmmsc_result_t *
+xmmsc_medialib_entries_property_set_with_source (xmmsc_connection_t *c,
+                                                 xmmsv_t *ids,
+                                                 const char *source,
+                                                 const char *key,
+                                                 xmmsv_t *value)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!ids || !xmmsv_list_restrict_type (ids, XMMSV_TYPE_INT64),
+	                "with a non int id list", NULL);
+	x_api_error_if (!value, "with a NULL value", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MEDIALIB,
+	                       XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTY_ENTRIES,
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (ids)),
+	                       XMMSV_LIST_ENTRY_STR (source),
+	                       XMMSV_LIST_ENTRY_STR (key),
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (value)),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Remove a custom field in the medialib associated with an entry.
  * Uses default source which is client/&lt;clientname&gt;
@@ -0,0 +1,384 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsclientpriv/xmmsclient.h>
+#include <xmmsc/xmmsc_idnumbers.h>
+
+typedef struct xmmsc_medialib_cache_entry_St xmmsc_medialib_cache_entry_t;
+
+struct xmmsc_medialib_cache_entry_St {
+	int id;
+	xmmsv_t *info;
+
+	/* next entry in the same bucket */
+	xmmsc_medialib_cache_entry_t *chain;
+
+	/* least recently used order, most recent first */
+	xmmsc_medialib_cache_entry_t *prev;
+	xmmsc_medialib_cache_entry_t *next;
+};
+
+struct xmmsc_medialib_cache_St {
+	int size;
+	int count;
+
+	int nbuckets;
+	xmmsc_medialib_cache_entry_t **buckets;
+
+	xmmsc_medialib_cache_entry_t *head;
+	xmmsc_medialib_cache_entry_t *tail;
+
+	/* broadcasts keeping the entries coherent */
+	xmmsc_result_t *changed;
+	xmmsc_result_t *entries_changed;
+	xmmsc_result_t *removed;
+};
+
+/* A reply to a get_info call, to be cached when it arrives */
+typedef struct {
+	xmmsc_connection_t *c;
+	int id;
+} xmmsc_medialib_cache_fill_t;
+
+static xmmsc_medialib_cache_entry_t **
+xmmsc_medialib_cache_bucket (xmmsc_medialib_cache_t *cache, int id)
+{
+	return &cache->buckets[(unsigned int) id % cache->nbuckets];
+}
+
+static void
+xmmsc_medialib_cache_unlink (xmmsc_medialib_cache_t *cache,
+                             xmmsc_medialib_cache_entry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		cache->head = entry->next;
+	}
+
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		cache->tail = entry->prev;
+	}
+}
+
+static void
+xmmsc_medialib_cache_link (xmmsc_medialib_cache_t *cache,
+                           xmmsc_medialib_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+
+	cache->head = entry;
+}
+
+static xmmsc_medialib_cache_entry_t *
+xmmsc_medialib_cache_find (xmmsc_medialib_cache_t *cache, int id)
+{
+	xmmsc_medialib_cache_entry_t *entry;
+
+	for (entry = *xmmsc_medialib_cache_bucket (cache, id); entry; entry = entry->chain) {
+		if (entry->id == id) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+xmmsc_medialib_cache_remove (xmmsc_medialib_cache_t *cache, int id)
+{
+	xmmsc_medialib_cache_entry_t **link, *entry;
+
+	for (link = xmmsc_medialib_cache_bucket (cache, id); *link; link = &(*link)->chain) {
+		if ((*link)->id == id) {
+			entry = *link;
+			*link = entry->chain;
+
+			xmmsc_medialib_cache_unlink (cache, entry);
+			xmmsv_unref (entry->info);
+			free (entry);
+			cache->count--;
+			return;
+		}
+	}
+}
+
+static void
+xmmsc_medialib_cache_insert (xmmsc_medialib_cache_t *cache, int id,
+                             xmmsv_t *info)
+{
+	xmmsc_medialib_cache_entry_t *entry, **bucket;
+
+	entry = xmmsc_medialib_cache_find (cache, id);
+	if (entry) {
+		xmmsv_unref (entry->info);
+		entry->info = xmmsv_ref (info);
+		xmmsc_medialib_cache_unlink (cache, entry);
+		xmmsc_medialib_cache_link (cache, entry);
+		return;
+	}
+
+	if (cache->count == cache->size) {
+		xmmsc_medialib_cache_remove (cache, cache->tail->id);
+	}
+
+	entry = x_new0 (xmmsc_medialib_cache_entry_t, 1);
+	if (!entry) {
+		x_oom ();
+		return;
+	}
+
+	entry->id = id;
+	entry->info = xmmsv_ref (info);
+
+	bucket = xmmsc_medialib_cache_bucket (cache, id);
+	entry->chain = *bucket;
+	*bucket = entry;
+
+	xmmsc_medialib_cache_link (cache, entry);
+	cache->count++;
+}
+
+static int
+xmmsc_medialib_cache_on_changed (xmmsv_t *val, void *udata)
+{
+	xmmsc_medialib_cache_t *cache = udata;
+	int id;
+
+	if (xmmsv_get_int (val, &id)) {
+		xmmsc_medialib_cache_remove (cache, id);
+	}
+
+	return 1;
+}
+
+static int
+xmmsc_medialib_cache_on_entries_changed (xmmsv_t *val, void *udata)
+{
+	xmmsc_medialib_cache_t *cache = udata;
+	int i, id;
+
+	for (i = 0; xmmsv_list_get_int (val, i, &id); i++) {
+		xmmsc_medialib_cache_remove (cache, id);
+	}
+
+	return 1;
+}
+
+static int
+xmmsc_medialib_cache_on_info (xmmsv_t *val, void *udata)
+{
+	xmmsc_medialib_cache_fill_t *fill = udata;
+
+	/* the cache may have been disabled since the call */
+	if (fill->c->mlib_cache && !xmmsv_is_error (val)) {
+		xmmsc_medialib_cache_insert (fill->c->mlib_cache, fill->id, val);
+	}
+
+	return 1;
+}
+
+static xmmsc_result_t *
+xmmsc_medialib_cache_subscribe (xmmsc_result_t *res,
+                                xmmsc_result_notifier_t func,
+                                xmmsc_medialib_cache_t *cache)
+{
+	if (res) {
+		xmmsc_result_notifier_set_default (res, func, cache);
+	}
+
+	return res;
+}
+
+static void
+xmmsc_medialib_cache_unsubscribe (xmmsc_result_t *res)
+{
+	if (res) {
+		xmmsc_result_disconnect (res);
+		xmmsc_result_unref (res);
+	}
+}
+
+/**
+ * @internal
+ * Free a medialib cache and stop listening for changes.
+ */
+void
+xmmsc_medialib_cache_destroy (xmmsc_medialib_cache_t *cache)
+{
+	xmmsc_medialib_cache_entry_t *entry, *next;
+
+	xmmsc_medialib_cache_unsubscribe (cache->changed);
+	xmmsc_medialib_cache_unsubscribe (cache->entries_changed);
+	xmmsc_medialib_cache_unsubscribe (cache->removed);
+
+	for (entry = cache->head; entry; entry = next) {
+		next = entry->next;
+		xmmsv_unref (entry->info);
+		free (entry);
+	}
+
+	free (cache->buckets);
+	free (cache);
+}
+
+/**
+ * @internal
+ * Cache the reply of a get_info call, if the cache is enabled.
+ */
+void
+xmmsc_medialib_cache_fill (xmmsc_connection_t *c, xmmsc_result_t *res, int id)
+{
+	xmmsc_medialib_cache_fill_t *fill;
+
+	if (!c->mlib_cache || !res) {
+		return;
+	}
+
+	fill = x_new0 (xmmsc_medialib_cache_fill_t, 1);
+	if (!fill) {
+		x_oom ();
+		return;
+	}
+
+	fill->c = c;
+	fill->id = id;
+
+	xmmsc_result_notifier_set_default_full (res, xmmsc_medialib_cache_on_info,
+	                                        fill, free);
+}
+
+/**
+ * @defgroup MedialibCache MedialibCache
+ * @ingroup MedialibControl
+ * @brief A client side cache of medialib entries.
+ *
+ * The replies to #xmmsc_medialib_get_info are kept in a least
+ * recently used cache of the given size, and removed again when the
+ * server broadcasts that the entry changed or was removed. The cache
+ * is updated while the connection processes messages, so it follows
+ * the same threading rules as the connection itself.
+ *
+ * @{
+ */
+
+/**
+ * Set the number of medialib entries to cache on this connection.
+ *
+ * @param c The connection.
+ * @param size The number of entries to keep, 0 disables the cache
+ * and frees the entries it has.
+ */
+void
+xmmsc_medialib_cache_set_size (xmmsc_connection_t *c, int size)
+{
+	xmmsc_medialib_cache_t *cache;
+
+	x_check_conn (c,);
+	x_api_error_if (size < 0, "with a negative size",);
+
+	cache = c->mlib_cache;
+
+	if (cache && size > 0) {
+		while (cache->count > size) {
+			xmmsc_medialib_cache_remove (cache, cache->tail->id);
+		}
+		cache->size = size;
+		return;
+	}
+
+	if (cache) {
+		c->mlib_cache = NULL;
+		xmmsc_medialib_cache_destroy (cache);
+	}
+
+	if (size == 0) {
+		return;
+	}
+
+	cache = x_new0 (xmmsc_medialib_cache_t, 1);
+	if (!cache) {
+		x_oom ();
+		return;
+	}
+
+	/* the bucket count is fixed, chains grow if the size does */
+	cache->size = size;
+	cache->nbuckets = size;
+	cache->buckets = x_new0 (xmmsc_medialib_cache_entry_t *, size);
+	if (!cache->buckets) {
+		x_oom ();
+		free (cache);
+		return;
+	}
+
+	cache->changed =
+		xmmsc_medialib_cache_subscribe (xmmsc_broadcast_medialib_entry_updated (c),
+		                                xmmsc_medialib_cache_on_changed, cache);
+	cache->entries_changed =
+		xmmsc_medialib_cache_subscribe (xmmsc_broadcast_medialib_entries_changed (c),
+		                                xmmsc_medialib_cache_on_entries_changed, cache);
+	cache->removed =
+		xmmsc_medialib_cache_subscribe (xmmsc_broadcast_medialib_entry_removed (c),
+		                                xmmsc_medialib_cache_on_changed, cache);
+
+	c->mlib_cache = cache;
+}
+
+/**
+ * Get the cached information about a medialib entry, as it would be
+ * returned by #xmmsc_medialib_get_info.
+ *
+ * @param c The connection.
+ * @param id The medialib id.
+ * @return A new reference to the info, or NULL if it isn't cached.
+ */
+xmmsv_t *
+xmmsc_medialib_cache_get (xmmsc_connection_t *c, int id)
+{
+	xmmsc_medialib_cache_entry_t *entry;
+
+	x_check_conn (c, NULL);
+
+	if (!c->mlib_cache) {
+		return NULL;
+	}
+
+	entry = xmmsc_medialib_cache_find (c->mlib_cache, id);
+	if (!entry) {
+		return NULL;
+	}
+
+	xmmsc_medialib_cache_unlink (c->mlib_cache, entry);
+	xmmsc_medialib_cache_link (c->mlib_cache, entry);
+
+	return xmmsv_ref (entry->info);
+}
+
+/** @} */
@@ -150,6 +150,20 @@ xmmsc_broadcast_playback_status (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_STATUS);
 }
 
+/**
+ * Like #xmmsc_broadcast_playback_status, but at most one broadcast
+ * is sent every interval milliseconds, with the newest status.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_playback_status_throttled (xmmsc_connection_t *c, int interval)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (interval < 0, "with a negative interval", NULL);
+
+	return xmmsc_send_broadcast_throttled_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_STATUS,
+	                                           NULL, interval);
+}
+
 /**
  * Make server emit the playback status.
  */
@@ -174,6 +188,32 @@ xmmsc_broadcast_playback_current_id (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID);
 }
 
+/**
+ * Like #xmmsc_broadcast_playback_current_id, but at most one broadcast
+ * is sent every interval milliseconds, with the newest id.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_playback_current_id_throttled (xmmsc_connection_t *c, int interval)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (interval < 0, "with a negative interval", NULL);
+
+	return xmmsc_send_broadcast_throttled_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID,
+	                                           NULL, interval);
+}
+
+/**
+ * Request the playback health broadcast, sent every
+ * output.health_interval seconds while playing.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_playback_health (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_HEALTH);
+}
+
 /**
  * Make server emit the current id.
  */
@@ -198,6 +238,20 @@ xmmsc_signal_playback_playtime (xmmsc_connection_t *c)
 	return xmmsc_send_signal_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME);
 }
 
+/**
+ * Like #xmmsc_signal_playback_playtime, but the server answers at
+ * most once every interval milliseconds, with the newest playtime.
+ */
+xmmsc_result_t *
+xmmsc_signal_playback_playtime_throttled (xmmsc_connection_t *c, int interval)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (interval < 0, "with a negative interval", NULL);
+
+	return xmmsc_send_signal_throttled_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME,
+	                                        interval);
+}
+
 /**
  * Make server emit the current playtime.
  */
@@ -210,6 +264,98 @@ xmmsc_playback_playtime (xmmsc_connection_t *c)
 	                              XMMS_IPC_COMMAND_PLAYBACK_PLAYTIME);
 }
 
+/**
+ * Get the current playtime together with whether it is advancing.
+ * The result is a dict with "playtime" in ms as of the reply, and
+ * "playing" set to 1 while it advances in real time. Clients showing
+ * progress can add the time passed since the reply themselves, and
+ * only ask again on status or entry changes.
+ */
+xmmsc_result_t *
+xmmsc_playback_playtime_stamp (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                              XMMS_IPC_COMMAND_PLAYBACK_PLAYTIME_STAMP);
+}
+
+/**
+ * Request the monotonic clock of the server, in microseconds.
+ *
+ * A client keeping several servers in step estimates each one's
+ * offset to its own clock NTP style: with t0 and t3 taken locally
+ * before sending and after the reply, offset = clock - (t0 + t3) / 2.
+ * Samples with the smallest t3 - t0 give the best estimates.
+ */
+xmmsc_result_t *
+xmmsc_playback_clock (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                              XMMS_IPC_COMMAND_PLAYBACK_CLOCK);
+}
+
+/**
+ * Start playback when the server clock reaches clock_us.
+ */
+xmmsc_result_t *
+xmmsc_playback_start_at (xmmsc_connection_t *c, int64_t clock_us)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (clock_us < 0, "with a negative time", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                       XMMS_IPC_COMMAND_PLAYBACK_START_AT,
+	                       XMMSV_LIST_ENTRY_INT (clock_us / 1000000),
+	                       XMMSV_LIST_ENTRY_INT (clock_us % 1000000),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Play ppm parts per million faster (or slower, if negative) than
+ * the soundcard, to follow a clock drifting from it.
+ */
+xmmsc_result_t *
+xmmsc_playback_drift_set (xmmsc_connection_t *c, int ppm)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                       XMMS_IPC_COMMAND_PLAYBACK_DRIFT_SET,
+	                       XMMSV_LIST_ENTRY_INT (ppm),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Ask for counters of each xform in the chain being decoded, to
+ * find which one is slow.
+ */
+xmmsc_result_t *
+xmmsc_playback_chain_stats (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                       XMMS_IPC_COMMAND_PLAYBACK_CHAIN_STATS,
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Ask how well the output has been kept fed: buffer fill levels,
+ * underruns, writer jitter, soundcard latency and gaps between songs.
+ */
+xmmsc_result_t *
+xmmsc_playback_health (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_PLAYBACK,
+	                       XMMS_IPC_COMMAND_PLAYBACK_HEALTH,
+	                       XMMSV_LIST_END);
+}
+
 xmmsc_result_t *
 xmmsc_playback_volume_set (xmmsc_connection_t *c,
                            const char *channel, int volume)
@@ -241,5 +387,21 @@ xmmsc_broadcast_playback_volume_changed (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED);
 }
 
+/**
+ * Like #xmmsc_broadcast_playback_volume_changed, but at most one
+ * broadcast is sent every interval milliseconds, with the newest
+ * volumes.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_playback_volume_changed_throttled (xmmsc_connection_t *c,
+                                                   int interval)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (interval < 0, "with a negative interval", NULL);
+
+	return xmmsc_send_broadcast_throttled_msg (c, XMMS_IPC_SIGNAL_PLAYBACK_VOLUME_CHANGED,
+	                                           NULL, interval);
+}
+
 /** @} */
 
@@ -239,6 +239,40 @@ xmmsc_playlist_list_entries (xmmsc_connection_t *c, const char *playlist)
 	                       XMMSV_LIST_ENTRY_STR (playlist), XMMSV_LIST_END);
 }
 
+/**
+ * Retrieve the changes made to a playlist since a version of it.
+ *
+ * The reply is a dict with the current "epoch", "version" and
+ * "position" of the playlist, and either the "changes" made since the
+ * version, as they were sent in the playlist changed broadcast, or all
+ * the "entries" of the playlist if those are not known. A client keeps
+ * the epoch and version of its copy, from the reply and the "version"
+ * of every change broadcast it applies, to catch up after reconnecting.
+ *
+ * @param c The connection structure.
+ * @param playlist The playlist, NULL for the active one.
+ * @param epoch The epoch of the version, 0 if unknown.
+ * @param version The version of the copy of the client.
+ */
+xmmsc_result_t *
+xmmsc_playlist_changes_since (xmmsc_connection_t *c, const char *playlist,
+                              int epoch, int version)
+{
+	x_check_conn (c, NULL);
+
+	/* default to the active playlist */
+	if (playlist == NULL) {
+		playlist = XMMS_ACTIVE_PLAYLIST;
+	}
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_PLAYLIST,
+	                       XMMS_IPC_COMMAND_PLAYLIST_CHANGES_SINCE,
+	                       XMMSV_LIST_ENTRY_STR (playlist),
+	                       XMMSV_LIST_ENTRY_INT (epoch),
+	                       XMMSV_LIST_ENTRY_INT (version),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Insert a medialib id at given position in playlist.
  *
@@ -794,6 +828,21 @@ xmmsc_broadcast_playlist_changed (xmmsc_connection_t *c)
 	return xmmsc_send_broadcast_msg (c, XMMS_IPC_SIGNAL_PLAYLIST_CHANGED);
 }
 
+/**
+ * Request the playlist changed broadcast, for the playlists in the
+ * list of names only.
+ */
+xmmsc_result_t *
+xmmsc_broadcast_playlist_changed_filtered (xmmsc_connection_t *c,
+                                           xmmsv_t *playlists)
+{
+	x_check_conn (c, NULL);
+	x_api_error_if (!xmmsv_is_type (playlists, XMMSV_TYPE_LIST),
+	                "with playlists not a list", NULL);
+
+	return xmmsc_send_broadcast_filtered_msg (c, XMMS_IPC_SIGNAL_PLAYLIST_CHANGED, playlists);
+}
+
 /**
  * Request the playlist current pos broadcast. When the position
  * in the playlist is changed this will be called.
@@ -202,6 +202,8 @@ xmmsc_result_disconnect (xmmsc_result_t *res)
 static void
 xmmsc_result_restart (xmmsc_result_t *res)
 {
+	uint32_t old_cookie;
+
 	x_return_if_fail (res);
 	x_return_if_fail (res->c);
 
@@ -210,7 +212,12 @@ xmmsc_result_restart (xmmsc_result_t *res)
 		return;
 	}
 
+	old_cookie = res->cookie;
 	res->cookie = xmmsc_write_signal_msg (res->c, res->restart_signal);
+
+	if (res->ipc) {
+		xmmsc_ipc_result_rekey (res->ipc, res, old_cookie);
+	}
 }
 
 static bool
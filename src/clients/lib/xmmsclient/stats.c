@@ -55,6 +55,56 @@ xmmsc_main_stats (xmmsc_connection_t *c)
 	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_STATS);
 }
 
+/**
+ * Get the spans the server traced while core.trace was set, as a
+ * Chrome trace event format document Perfetto can load.
+ */
+xmmsc_result_t *
+xmmsc_main_trace_dump (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_TRACE_DUMP);
+}
+
+/**
+ * Get the bytes the server holds for medialib results, IPC queues,
+ * xform buffers, ring buffers, collections and bindata.
+ */
+xmmsc_result_t *
+xmmsc_main_memory_stats (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_MEMORY_STATS);
+}
+
+/**
+ * Get the IPC counters the server keeps while core.ipc_metrics is
+ * set: per command call counts and latencies, and per client queue
+ * depths and traffic.
+ */
+xmmsc_result_t *
+xmmsc_ipc_metrics (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_IPC_MANAGER,
+	                              XMMS_IPC_COMMAND_IPC_MANAGER_METRICS);
+}
+
+/**
+ * Get the same counters as #xmmsc_ipc_metrics as Prometheus text.
+ */
+xmmsc_result_t *
+xmmsc_ipc_metrics_text (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_IPC_MANAGER,
+	                              XMMS_IPC_COMMAND_IPC_MANAGER_METRICS_TEXT);
+}
+
 /**
  * Request status for the mediainfo reader. It can be idle or working
  */
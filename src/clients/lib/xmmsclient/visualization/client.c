@@ -132,7 +132,15 @@ xmmsc_visualization_start (xmmsc_connection_t *c, int vv)
 		break;
 	case VIS_NEW:
 #if HAVE_SEMTIMEDOP
-		/* first try unixshm */
+		/* first try the shm ring, it needs no syscalls per chunk */
+		v->type = VIS_SHMRING;
+		res = setup_shmring_prepare (c, vv);
+		if (res) {
+			v->state = VIS_TRYING_SHMRING;
+			break;
+		}
+		/* fall through */
+	case VIS_TO_TRY_UNIXSHM:
 		v->type = VIS_UNIXSHM;
 		res = setup_shm_prepare (c, vv);
 		if (res) {
@@ -175,6 +183,14 @@ xmmsc_visualization_start_handle (xmmsc_connection_t *c, xmmsc_result_t *res)
 	case VIS_WORKING:
 	case VIS_ERRORED:
 		break;
+	case VIS_TRYING_SHMRING:
+		ret = setup_shmring_handle (res);
+		if (!ret) {
+			v->state = VIS_TO_TRY_UNIXSHM;
+		} else {
+			v->state = VIS_WORKING;
+		}
+		break;
 	case VIS_TRYING_UNIXSHM:
 		ret = setup_shm_handle (res);
 		if (!ret) {
@@ -272,6 +288,25 @@ xmmsc_visualization_properties_set (xmmsc_connection_t *c, int vv, xmmsv_t *prop
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Ask how delivery to this client is going, see the client_stats
+ * method for the keys
+ */
+xmmsc_result_t *
+xmmsc_visualization_stats (xmmsc_connection_t *c, int vv)
+{
+	xmmsc_visualization_t *v;
+
+	x_check_conn (c, NULL);
+	v = get_dataset (c, vv);
+	x_api_error_if (!v, "with unregistered visualization dataset", NULL);
+
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_VISUALIZATION,
+	                       XMMS_IPC_COMMAND_VISUALIZATION_CLIENT_STATS,
+	                       XMMSV_LIST_ENTRY_INT (v->id),
+	                       XMMSV_LIST_END);
+}
+
 /**
  * Says goodbye and cleans up
  */
@@ -293,10 +328,14 @@ xmmsc_visualization_shutdown (xmmsc_connection_t *c, int vv)
 	if (v->type == VIS_UNIXSHM) {
 		cleanup_shm (&v->transport.shm);
 	}
+	if (v->type == VIS_SHMRING) {
+		cleanup_shmring (&v->transport.ring);
+	}
 	if (v->type == VIS_UDP) {
 		cleanup_udp (&v->transport.udp);
 	}
 
+	free (v->ring);
 	free (v);
 	c->visv[vv] = NULL;
 }
@@ -306,6 +345,8 @@ package_read_do (xmmsc_visualization_t *v, short *buffer, int drawtime, unsigned
 {
 	if (v->type == VIS_UNIXSHM) {
 		return read_do_shm (&v->transport.shm, v, buffer, drawtime, blocking);
+	} else if (v->type == VIS_SHMRING) {
+		return read_do_shmring (&v->transport.ring, v, buffer, drawtime, blocking);
 	} else if (v->type == VIS_UDP) {
 		return read_do_udp (&v->transport.udp, v, buffer, drawtime, blocking);
 	}
@@ -356,4 +397,131 @@ xmmsc_visualization_chunk_get (xmmsc_connection_t *c, int vv, short *buffer, int
 	return package_read_do (v, buffer, drawtime, blocking);
 }
 
+/**
+ * Move the chunks that have arrived into the dataset's ring, waiting
+ * up to blocking ms for the first one. Chunks that don't fit are read
+ * and dropped, so the server doesn't take the client for dead.
+ *
+ * This may run in a thread of its own, next to one that calls
+ * #xmmsc_visualization_chunk_get_at.
+ */
+int
+xmmsc_visualization_chunk_pump (xmmsc_connection_t *c, int vv, unsigned int blocking)
+{
+	xmmsc_visualization_t *v;
+	xmmsc_vis_slot_t *slot, scratch;
+	unsigned int wr;
+	int n = 0, ret;
+
+	x_check_conn (c, -1);
+	v = get_dataset (c, vv);
+	x_api_error_if (!v, "with unregistered visualization dataset", -1);
+
+	if (!v->ring) {
+		v->ring = x_new0 (xmmsc_vis_slot_t, XMMSC_VIS_RING_SIZE);
+		if (!v->ring) {
+			x_oom ();
+			return -1;
+		}
+	}
+
+	for (;;) {
+		wr = v->ring_wr;
+		if (wr - v->ring_rd < XMMSC_VIS_RING_SIZE) {
+			slot = &v->ring[wr & (XMMSC_VIS_RING_SIZE - 1)];
+		} else {
+			slot = &scratch;
+		}
+
+		ret = package_read_do (v, slot->data, -1, n ? 0 : blocking);
+		if (ret < 0) {
+			return n ? n : -1;
+		}
+		if (ret == 0) {
+			return n;
+		}
+
+		if (slot != &scratch) {
+			slot->size = ret;
+			slot->timestamp = v->timestamp;
+			/* publish the slot only after it is filled */
+			__sync_synchronize ();
+			v->ring_wr = wr + 1;
+			n++;
+		}
+	}
+}
+
+/**
+ * Fetch the chunk to display at time t, in seconds as gettimeofday
+ * gives them: the newest one due by then, older ones are dropped.
+ * The play times already include the server's output latency, so
+ * t should be when the frame reaches the screen.
+ *
+ * Returns the size read, 0 if nothing is due yet, -1 on failure.
+ */
+int
+xmmsc_visualization_chunk_get_at (xmmsc_connection_t *c, int vv, short *buffer, double t)
+{
+	xmmsc_visualization_t *v;
+	xmmsc_vis_slot_t *slot, *due = NULL;
+	unsigned int rd, wr;
+
+	x_check_conn (c, -1);
+	v = get_dataset (c, vv);
+	x_api_error_if (!v, "with unregistered visualization dataset", -1);
+	x_api_error_if (!buffer, "with NULL buffer", -1);
+
+	if (!v->ring) {
+		return 0;
+	}
+
+	wr = v->ring_wr;
+	/* the slots up to wr are filled */
+	__sync_synchronize ();
+
+	for (rd = v->ring_rd; rd != wr; rd++) {
+		slot = &v->ring[rd & (XMMSC_VIS_RING_SIZE - 1)];
+		if (slot->timestamp > t) {
+			break;
+		}
+		due = slot;
+	}
+
+	if (!due) {
+		return 0;
+	}
+
+	memcpy (buffer, due->data, due->size * sizeof (short));
+
+	/* hand back the slots only after copying out */
+	__sync_synchronize ();
+	v->ring_rd = rd;
+
+	return due->size;
+}
+
+/**
+ * A file descriptor that turns readable when chunks arrive, to wait
+ * for in poll() along with others before calling
+ * #xmmsc_visualization_chunk_pump. Only UDP has one; with shared
+ * memory, -1 is returned and chunk_pump's blocking argument is the
+ * way to wait.
+ */
+int
+xmmsc_visualization_fd (xmmsc_connection_t *c, int vv)
+{
+	xmmsc_visualization_t *v;
+
+	x_check_conn (c, -1);
+	v = get_dataset (c, vv);
+	x_api_error_if (!v, "with unregistered visualization dataset", -1);
+
+	if (v->state == VIS_WORKING && v->type == VIS_UDP) {
+		return v->transport.udp.socket[0];
+	}
+
+	return -1;
+}
+
 /** @} */
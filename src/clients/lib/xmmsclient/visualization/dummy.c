@@ -22,3 +22,26 @@ read_do_shm (xmmsc_vis_unixshm_t *t, xmmsc_visualization_t *v, short *buffer, in
 {
 	return -1;
 }
+
+xmmsc_result_t *
+setup_shmring_prepare (xmmsc_connection_t *c, int32_t vv)
+{
+	return NULL;
+}
+
+bool
+setup_shmring_handle (xmmsc_result_t *res)
+{
+	return 0;
+}
+
+void
+cleanup_shmring (xmmsc_vis_shmring_t *t)
+{
+}
+
+int
+read_do_shmring (xmmsc_vis_shmring_t *t, xmmsc_visualization_t *v, short *buffer, int drawtime, unsigned int blocking)
+{
+	return -1;
+}
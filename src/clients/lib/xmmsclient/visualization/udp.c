@@ -237,7 +237,8 @@ read_do_udp (xmmsc_vis_udp_t *t, xmmsc_visualization_t *v, short *buffer, int dr
 		return ret;
 	}
 
-	old = check_drawtime (net2ts (data.timestamp), drawtime);
+	v->timestamp = net2ts (data.timestamp);
+	old = check_drawtime (v->timestamp, drawtime);
 
 	if (!old) {
 		size = ntohs (data.size);
@@ -8,6 +8,13 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <time.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 xmmsc_result_t *
 setup_shm_prepare (xmmsc_connection_t *c, int32_t vv)
@@ -158,7 +165,8 @@ read_do_shm (xmmsc_vis_unixshm_t *t, xmmsc_visualization_t *v, short *buffer, in
 		return ret;
 	}
 
-	old = check_drawtime (net2ts (src->timestamp), drawtime);
+	v->timestamp = net2ts (src->timestamp);
+	old = check_drawtime (v->timestamp, drawtime);
 
 	if (!old) {
 		size = ntohs (src->size);
@@ -172,3 +180,158 @@ read_do_shm (xmmsc_vis_unixshm_t *t, xmmsc_visualization_t *v, short *buffer, in
 	}
 	return 0;
 }
+
+xmmsc_result_t *
+setup_shmring_prepare (xmmsc_connection_t *c, int32_t vv)
+{
+	xmmsc_result_t *res;
+	xmmsc_vis_shmring_t *t;
+	xmmsc_visualization_t *v;
+	void *addr;
+	char shmidstr[32];
+
+	x_check_conn (c, 0);
+	v = get_dataset (c, vv);
+
+	t = &v->transport.ring;
+
+	t->count = XMMS_VISPACKET_RINGCOUNT;
+	t->shmid = shmget (IPC_PRIVATE, sizeof (xmmsc_vis_shmring_header_t) +
+	                   sizeof (xmmsc_vischunk_t) * t->count,
+	                   S_IRUSR | S_IWUSR);
+	if (t->shmid == -1) {
+		c->error = strdup ("Couldn't create the shared memory!");
+		return NULL;
+	}
+
+	addr = shmat (t->shmid, NULL, 0);
+	if (addr == (void *) -1) {
+		shmctl (t->shmid, IPC_RMID, NULL);
+		c->error = strdup ("Couldn't attach the shared memory!");
+		return NULL;
+	}
+
+	t->header = addr;
+	t->buffer = (xmmsc_vischunk_t *) (t->header + 1);
+	t->pos = 0;
+	t->header->count = t->count;
+	t->header->wr = 0;
+	t->header->rd = 0;
+	t->header->heartbeat = 0;
+	t->header->waiting = 0;
+
+	snprintf (shmidstr, sizeof (shmidstr), "%d", t->shmid);
+
+	res = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_VISUALIZATION,
+	                      XMMS_IPC_COMMAND_VISUALIZATION_INIT_SHMRING,
+	                      XMMSV_LIST_ENTRY_INT (v->id),
+	                      XMMSV_LIST_ENTRY_STR (shmidstr),
+	                      XMMSV_LIST_END);
+
+	if (res) {
+		xmmsc_result_visc_set (res, v);
+	}
+
+	return res;
+}
+
+bool
+setup_shmring_handle (xmmsc_result_t *res)
+{
+	bool ret;
+	xmmsc_visualization_t *visc;
+	xmmsc_vis_shmring_t *t;
+
+	visc = xmmsc_result_visc_get (res);
+	if (!visc) {
+		x_api_error_if (1, "non vis result?", -1);
+	}
+
+	t = &visc->transport.ring;
+
+	if (!xmmsc_result_iserror (res)) {
+		ret = true;
+	} else {
+		/* an older server, or one without shm: try the next transport */
+		shmdt (t->header);
+		ret = false;
+	}
+	/* removed once both sides detached, the server finds out a
+	   client is gone from the heartbeat */
+	shmctl (t->shmid, IPC_RMID, NULL);
+	return ret;
+}
+
+void
+cleanup_shmring (xmmsc_vis_shmring_t *t)
+{
+	shmdt (t->header);
+}
+
+/**
+ * Wait up to blocking ms for the server to move wr past our position.
+ */
+static void
+wait_shmring (xmmsc_vis_shmring_t *t, unsigned int blocking)
+{
+#ifdef __linux__
+	struct timespec time;
+
+	time.tv_sec = blocking / 1000;
+	time.tv_nsec = (blocking % 1000) * 1000000;
+
+	t->header->waiting = 1;
+	__sync_synchronize ();
+	/* the futex only sleeps if wr is still at pos */
+	syscall (SYS_futex, &t->header->wr, FUTEX_WAIT, t->pos, &time, NULL, 0);
+	t->header->waiting = 0;
+#else
+	xmms_sleep_ms (MIN (blocking, 10));
+#endif
+}
+
+int
+read_do_shmring (xmmsc_vis_shmring_t *t, xmmsc_visualization_t *v, short *buffer, int drawtime, unsigned int blocking)
+{
+	xmmsc_vischunk_t *src;
+	uint32_t wr;
+	int old, i, size;
+
+	t->header->heartbeat++;
+
+	wr = t->header->wr;
+	if (wr == t->pos) {
+		if (!blocking) {
+			return 0;
+		}
+		wait_shmring (t, blocking);
+		wr = t->header->wr;
+		if (wr == t->pos) {
+			return 0;
+		}
+	}
+	/* read the chunk only after seeing it published */
+	__sync_synchronize ();
+
+	src = &t->buffer[t->pos & (t->count - 1)];
+
+	v->timestamp = net2ts (src->timestamp);
+	old = check_drawtime (v->timestamp, drawtime);
+
+	if (!old) {
+		size = ntohs (src->size);
+		for (i = 0; i < size; ++i) {
+			buffer[i] = (int16_t)ntohs (src->data[i]);
+		}
+	}
+
+	/* hand the chunk back only after copying it out */
+	__sync_synchronize ();
+	t->pos++;
+	t->header->rd = t->pos;
+
+	if (!old) {
+		return size;
+	}
+	return 0;
+}
@@ -133,6 +133,48 @@ xmmsc_send_hello (xmmsc_connection_t *c)
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * @internal
+ * Hand the server a shared memory ring to put large messages in. Only
+ * tried when the server is on the same host, if it refuses everything
+ * keeps going over the socket.
+ */
+static void
+xmmsc_shm_setup (xmmsc_connection_t *c)
+{
+	xmms_ipc_shm_t *shm;
+	xmmsc_result_t *result;
+	const int size = XMMS_IPC_SHM_DEFAULT_SIZE;
+	int shmid;
+
+	if (!xmmsc_ipc_is_local (c->ipc)) {
+		return;
+	}
+
+	shm = xmms_ipc_shm_create (size);
+	if (!shm) {
+		return;
+	}
+
+	shmid = xmms_ipc_shm_id (shm);
+	xmmsc_ipc_shm_set (c->ipc, shm);
+
+	result = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_MAIN,
+	                         XMMS_IPC_COMMAND_MAIN_SHM_ATTACH,
+	                         XMMSV_LIST_ENTRY_INT (shmid),
+	                         XMMSV_LIST_ENTRY_INT (size),
+	                         XMMSV_LIST_END);
+	xmmsc_result_wait (result);
+
+	/* attached or not, nobody else gets to attach */
+	xmms_ipc_shm_unlink (shm);
+
+	if (xmmsv_is_error (xmmsc_result_get_value (result))) {
+		xmmsc_ipc_shm_set (c->ipc, NULL);
+	}
+	xmmsc_result_unref (result);
+}
+
 /**
  * Connects to the XMMS server.
  * If ipcpath is NULL, it will try to open the default path.
@@ -189,8 +231,12 @@ xmmsc_connect (xmmsc_connection_t *c, const char *ipcpath)
 		return false;
 	} else {
 		xmmsv_get_int64 (value, &c->id);
+		c->compact = true;
 	}
 	xmmsc_result_unref (result);
+
+	xmmsc_shm_setup (c);
+
 	return true;
 }
 
@@ -265,6 +311,10 @@ xmmsc_ref (xmmsc_connection_t *c)
 static void
 xmmsc_deinit (xmmsc_connection_t *c)
 {
+	if (c->mlib_cache) {
+		xmmsc_medialib_cache_destroy (c->mlib_cache);
+	}
+
 	xmmsc_ipc_destroy (c->ipc);
 
 	if (c->sc_root) {
@@ -305,6 +355,19 @@ xmmsc_quit (xmmsc_connection_t *c)
 	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_QUIT);
 }
 
+/**
+ * Tell the server to restart in place, keeping its sockets and where
+ * playback is. The connection is dropped, connect again once the
+ * server is back.
+ */
+xmmsc_result_t *
+xmmsc_restart (xmmsc_connection_t *c)
+{
+	x_check_conn (c, NULL);
+
+	return xmmsc_send_msg_no_arg (c, XMMS_IPC_OBJECT_MAIN, XMMS_IPC_COMMAND_MAIN_RESTART);
+}
+
 /**
  * Request the quit broadcast.
  * Will be called when the server is terminating.
@@ -363,6 +426,51 @@ xmmsc_send_broadcast_msg (xmmsc_connection_t *c, int signalid)
 	                       XMMSV_LIST_END);
 }
 
+/**
+ * Like #xmmsc_send_broadcast_msg, but the server only sends the
+ * broadcasts concerning the ids and names in the filter list.
+ */
+xmmsc_result_t *
+xmmsc_send_broadcast_filtered_msg (xmmsc_connection_t *c, int signalid,
+                                   xmmsv_t *filter)
+{
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST,
+	                       XMMSV_LIST_ENTRY_INT (signalid),
+	                       XMMSV_LIST_ENTRY (xmmsv_ref (filter)),
+	                       XMMSV_LIST_END);
+}
+
+/**
+ * Like #xmmsc_send_broadcast_filtered_msg, but the server sends at
+ * most one broadcast per interval milliseconds. The ones in between
+ * are coalesced, the newest state winning. filter may be NULL.
+ */
+xmmsc_result_t *
+xmmsc_send_broadcast_throttled_msg (xmmsc_connection_t *c, int signalid,
+                                    xmmsv_t *filter, int interval)
+{
+	return xmmsc_send_cmd (c, XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST,
+	                       XMMSV_LIST_ENTRY_INT (signalid),
+	                       XMMSV_LIST_ENTRY (filter ? xmmsv_ref (filter) : xmmsv_new_none ()),
+	                       XMMSV_LIST_ENTRY_INT (interval),
+	                       XMMSV_LIST_END);
+}
+
+
+/**
+ * @internal
+ * Serialize command arguments, in the compact encoding once the
+ * server is known to read it.
+ */
+static void
+xmmsc_put_args (xmmsc_connection_t *c, xmms_ipc_msg_t *msg, xmmsv_t *args)
+{
+	if (c->compact) {
+		xmms_ipc_msg_put_value_compact (msg, args);
+	} else {
+		xmms_ipc_msg_put_value (msg, args);
+	}
+}
 
 uint32_t
 xmmsc_write_signal_msg (xmmsc_connection_t *c, int signalid)
@@ -397,6 +505,27 @@ xmmsc_send_signal_msg (xmmsc_connection_t *c, int signalid)
 	return res;
 }
 
+/**
+ * Like #xmmsc_send_signal_msg, but the server answers at most once
+ * per interval milliseconds with the newest value. The interval stays
+ * with the signal when the result restarts it.
+ */
+xmmsc_result_t *
+xmmsc_send_signal_throttled_msg (xmmsc_connection_t *c, int signalid,
+                                 int interval)
+{
+	xmmsc_result_t *res;
+
+	res = xmmsc_send_cmd (c, XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_SIGNAL,
+	                      XMMSV_LIST_ENTRY_INT (signalid),
+	                      XMMSV_LIST_ENTRY_INT (interval),
+	                      XMMSV_LIST_END);
+
+	xmmsc_result_restartable (res, signalid);
+
+	return res;
+}
+
 xmmsc_result_t *
 xmmsc_send_msg_no_arg (xmmsc_connection_t *c, int object, int method)
 {
@@ -450,7 +579,7 @@ xmmsc_send_cmd (xmmsc_connection_t *c, int obj, int cmd, ...)
 	args = xmmsv_build_list_va (first_arg, ap);
 	va_end (ap);
 
-	xmms_ipc_msg_put_value (msg, args);
+	xmmsc_put_args (c, msg, args);
 	xmmsv_unref (args);
 
 	return xmmsc_send_msg (c, msg);
@@ -471,7 +600,7 @@ xmmsc_send_cmd_cookie (xmmsc_connection_t *c, int obj, int cmd, ...)
 	args = xmmsv_build_list_va (first_arg, ap);
 	va_end (ap);
 
-	xmms_ipc_msg_put_value (msg, args);
+	xmmsc_put_args (c, msg, args);
 	xmmsv_unref (args);
 
 	return xmmsc_write_msg_to_ipc (c, msg);
@@ -558,6 +687,39 @@ xmmsc_io_fd_get (xmmsc_connection_t *c)
 	return xmmsc_ipc_fd_get (c->ipc);
 }
 
+/**
+ * Start a batch of commands.
+ *
+ * Commands sent until the matching #xmmsc_batch_commit are only
+ * queued, and then written to the daemon together, which saves a
+ * round trip through the mainloop and a syscall per command when
+ * many commands are sent at once. The results are delivered as
+ * usual. Waiting on a result within a batch writes out what has been
+ * queued so far. Batches may nest; only the outermost commit writes.
+ *
+ * @param c connection to batch commands on
+ */
+void
+xmmsc_batch_begin (xmmsc_connection_t *c)
+{
+	x_check_conn (c,);
+
+	xmmsc_ipc_batch_begin (c->ipc);
+}
+
+/**
+ * Send the commands queued since #xmmsc_batch_begin.
+ *
+ * @param c connection the batch was started on
+ */
+void
+xmmsc_batch_commit (xmmsc_connection_t *c)
+{
+	x_check_conn (c,);
+
+	xmmsc_ipc_batch_end (c->ipc);
+}
+
 /**
  * Set callback for enabling/disabling writing.
  *
@@ -565,7 +727,11 @@ xmmsc_io_fd_get (xmmsc_connection_t *c)
  * iteration this function allows registration of a callback to be
  * called when output is needed or not needed any more. The arguments
  * to the callback are flag and userdata; flag is 1 if output is
- * wanted, 0 if not.
+ * wanted, 0 if not. Output is only flagged as wanted when the queue
+ * of outgoing messages stops being empty, not for every message.
+ *
+ * Mainloops that can look at #xmmsc_io_want_out before each poll, as
+ * the glib and ecore integrations do, are better off doing that.
  *
  */
 void
@@ -22,10 +22,37 @@
 
 #include <xmms_configuration.h>
 
+/* A path is submitted once it had no events for this long... */
+#define UPDATER_BATCH_QUIET_MS 1000
+/* ...or once it has been waiting for this long */
+#define UPDATER_BATCH_MAX_AGE_MS 10000
+
+typedef enum {
+	UPDATER_ACTION_ADD,
+	UPDATER_ACTION_REHASH,
+	UPDATER_ACTION_REMOVE
+} updater_action_t;
+
+typedef struct updater_pending_St {
+	updater_action_t action;
+	gint64 first;
+	gint64 last;
+} updater_pending_t;
+
+typedef struct updater_batch_St {
+	struct updater_St *updater;
+	/** For each url submitted, if its entry is to be rehashed */
+	xmmsv_t *rehash;
+} updater_batch_t;
+
 typedef struct updater_St {
 	xmmsc_connection_t *conn;
 	GHashTable *watchers;
 	GFile *root;
+
+	/** Local path -> updater_pending_t, for files with unsubmitted events */
+	GHashTable *pending;
+	guint flush_source;
 } updater_t;
 
 typedef struct updater_quit_St {
@@ -63,6 +90,8 @@ updater_new (void)
 	updater->conn = xmmsc_init ("XMMS2-Medialib-Updater");
 	updater->watchers = g_hash_table_new_full (g_str_hash, g_str_equal,
 	                                           g_free, unregister_monitor);
+	updater->pending = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                          g_free, g_free);
 
 	return updater;
 }
@@ -74,6 +103,11 @@ updater_destroy (updater_t *updater)
 	g_return_if_fail (updater->watchers);
 	g_return_if_fail (updater->conn);
 
+	if (updater->flush_source) {
+		g_source_remove (updater->flush_source);
+	}
+
+	g_hash_table_destroy (updater->pending);
 	g_hash_table_destroy (updater->watchers);
 	xmmsc_unref (updater->conn);
 	g_free (updater);
@@ -400,26 +434,6 @@ updater_subscribe_config (updater_t *updater)
 	xmmsc_result_unref (res);
 }
 
-static void
-updater_add_file (updater_t *updater, GFile *file)
-{
-	xmmsc_result_t *res;
-	gchar *path, *url;
-
-	g_return_if_fail (updater);
-	g_return_if_fail (updater->conn);
-	g_return_if_fail (file);
-
-	path = g_file_get_path (file);
-	url = g_strdup_printf ("file://%s", path);
-	g_free (path);
-
-	res = xmmsc_medialib_add_entry (updater->conn, url);
-	xmmsc_result_unref (res);
-
-	g_free (url);
-}
-
 static int
 updater_remove_file_by_id (xmmsv_t *value, void *udata)
 {
@@ -447,29 +461,6 @@ updater_remove_file_by_id (xmmsv_t *value, void *udata)
 	return FALSE;
 }
 
-static void
-updater_remove_file (updater_t *updater, GFile *file)
-{
-	xmmsc_result_t *res;
-	gchar *path, *url;
-
-	g_return_if_fail (updater);
-	g_return_if_fail (updater->conn);
-	g_return_if_fail (file);
-
-	path = g_file_get_path (file);
-	url = g_strdup_printf ("file://%s", path);
-	g_free (path);
-
-	g_debug ("removing file '%s'", url);
-
-	res = xmmsc_medialib_get_id (updater->conn, url);
-	xmmsc_result_notifier_set (res, updater_remove_file_by_id, updater);
-	xmmsc_result_unref (res);
-
-	g_free (url);
-}
-
 static int
 updater_remove_directory_by_id (xmmsv_t *value, void *udata)
 {
@@ -518,53 +509,199 @@ updater_remove_directory (updater_t *updater, GFile *file)
 	g_free (pattern);
 }
 
-static int
-updater_rehash_file_by_id (xmmsv_t *value, void *udata)
+static void
+updater_batch_free (void *udata)
 {
-	xmmsc_result_t *res;
-	updater_t *updater;
-	int mid;
+	updater_batch_t *batch = (updater_batch_t *) udata;
 
-	updater = (updater_t *) udata;
+	xmmsv_unref (batch->rehash);
+	g_free (batch);
+}
 
-	g_return_val_if_fail (updater, FALSE);
+static int
+updater_rehash_added (xmmsv_t *value, void *udata)
+{
+	updater_batch_t *batch = (updater_batch_t *) udata;
+	xmmsc_result_t *res;
+	const gchar *err;
+	gint i, mid, flag;
 
-	if (!xmmsv_get_int (value, &mid)) {
+	if (xmmsv_get_error (value, &err)) {
+		g_warning ("Couldn't add files: %s", err);
 		return FALSE;
 	}
 
-	if (!mid) {
-		g_warning ("Couldn't find requested medialib entry.");
-		return FALSE;
+	for (i = 0; xmmsv_list_get_int (value, i, &mid); i++) {
+		if (xmmsv_list_get_int (batch->rehash, i, &flag) && flag && mid) {
+			res = xmmsc_medialib_rehash (batch->updater->conn, mid);
+			xmmsc_result_unref (res);
+		}
+	}
+
+	return FALSE;
+}
+
+static void
+updater_submit_removed (updater_t *updater, GList *paths)
+{
+	xmmsc_result_t *res;
+	xmmsv_t *univ, *coll, *match;
+	gchar *encoded, *url;
+	GList *n;
+
+	univ = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNION);
+
+	for (n = paths; n; n = g_list_next (n)) {
+		encoded = xmmsv_encode_url (n->data);
+		url = g_strdup_printf ("file://%s", encoded);
+		g_free (encoded);
+
+		match = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
+		xmmsv_coll_add_operand (match, univ);
+		xmmsv_coll_attribute_set_string (match, "field", "url");
+		xmmsv_coll_attribute_set_string (match, "value", url);
+		xmmsv_coll_add_operand (coll, match);
+		xmmsv_unref (match);
+
+		g_free (url);
 	}
 
-	res = xmmsc_medialib_rehash (updater->conn, mid);
+	g_debug ("removing %u files", g_list_length (paths));
+
+	/* one query for the ids of all of them */
+	res = xmmsc_coll_query_ids (updater->conn, coll, NULL, 0, 0);
+	xmmsc_result_notifier_set (res, updater_remove_directory_by_id, updater);
 	xmmsc_result_unref (res);
 
+	xmmsv_unref (coll);
+	xmmsv_unref (univ);
+}
+
+/**
+ * Submit the files whose events have settled: new and changed files
+ * with one add_entries call, after which the changed ones are
+ * rehashed, and removed files with one query.
+ */
+static gboolean
+updater_flush (gpointer udata)
+{
+	updater_t *updater = (updater_t *) udata;
+	updater_batch_t *batch;
+	xmmsc_result_t *res;
+	xmmsv_t *urls, *rehash;
+	GList *removed = NULL;
+	GHashTableIter iter;
+	gpointer key, value;
+	gint64 now;
+
+	now = g_get_monotonic_time ();
+
+	urls = xmmsv_new_list ();
+	rehash = xmmsv_new_list ();
+
+	g_hash_table_iter_init (&iter, updater->pending);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		updater_pending_t *pending = (updater_pending_t *) value;
+		gchar *url;
+
+		if (now - pending->last < UPDATER_BATCH_QUIET_MS * 1000 &&
+		    now - pending->first < UPDATER_BATCH_MAX_AGE_MS * 1000) {
+			continue;
+		}
+
+		switch (pending->action) {
+		case UPDATER_ACTION_ADD:
+		case UPDATER_ACTION_REHASH:
+			url = g_strdup_printf ("file://%s", (gchar *) key);
+			xmmsv_list_append_string (urls, url);
+			xmmsv_list_append_int (rehash, pending->action == UPDATER_ACTION_REHASH);
+			g_free (url);
+			g_hash_table_iter_remove (&iter);
+			break;
+		case UPDATER_ACTION_REMOVE:
+			/* the key is freed with the list */
+			g_hash_table_iter_steal (&iter);
+			g_free (pending);
+			removed = g_list_prepend (removed, key);
+			break;
+		}
+	}
+
+	if (xmmsv_list_get_size (urls)) {
+		g_debug ("adding or rehashing %d files", xmmsv_list_get_size (urls));
+
+		batch = g_new0 (updater_batch_t, 1);
+		batch->updater = updater;
+		batch->rehash = xmmsv_ref (rehash);
+
+		res = xmmsc_medialib_add_entries (updater->conn, urls);
+		xmmsc_result_notifier_set_full (res, updater_rehash_added, batch,
+		                                updater_batch_free);
+		xmmsc_result_unref (res);
+	}
+
+	if (removed) {
+		updater_submit_removed (updater, removed);
+		g_list_free_full (removed, g_free);
+	}
+
+	xmmsv_unref (urls);
+	xmmsv_unref (rehash);
+
+	if (g_hash_table_size (updater->pending)) {
+		return TRUE;
+	}
+
+	updater->flush_source = 0;
 	return FALSE;
 }
 
+/**
+ * Remember an event on a file until it has settled. Events on a path
+ * are merged into one action, e.g. a file created and then written to
+ * is only added, and a file deleted and created again is rehashed.
+ */
 static void
-updater_rehash_file (updater_t *updater, GFile *file)
+updater_queue (updater_t *updater, GFile *file, updater_action_t action)
 {
-	xmmsc_result_t *res;
-	gchar *path, *url;
+	updater_pending_t *pending;
+	gchar *path;
+	gint64 now;
 
 	g_return_if_fail (updater);
-	g_return_if_fail (updater->conn);
 	g_return_if_fail (file);
 
 	path = g_file_get_path (file);
-	url = g_strdup_printf ("file://%s", path);
-	g_free (path);
+	if (!path) {
+		return;
+	}
 
-	g_debug ("resolving entry '%s'", url);
+	now = g_get_monotonic_time ();
 
-	res = xmmsc_medialib_get_id (updater->conn, url);
-	xmmsc_result_notifier_set (res, updater_rehash_file_by_id, updater);
-	xmmsc_result_unref (res);
+	pending = g_hash_table_lookup (updater->pending, path);
+	if (!pending) {
+		pending = g_new0 (updater_pending_t, 1);
+		pending->action = action;
+		pending->first = now;
+		g_hash_table_insert (updater->pending, path, pending);
+	} else {
+		if (action == UPDATER_ACTION_REMOVE) {
+			pending->action = UPDATER_ACTION_REMOVE;
+		} else if (pending->action == UPDATER_ACTION_REMOVE) {
+			/* replaced, the entry may still be there */
+			pending->action = UPDATER_ACTION_REHASH;
+		}
+		/* a new file that changes is still only added */
+		g_free (path);
+	}
 
-	g_free (url);
+	pending->last = now;
+
+	if (!updater->flush_source) {
+		updater->flush_source = g_timeout_add (UPDATER_BATCH_QUIET_MS / 2,
+		                                       updater_flush, updater);
+	}
 }
 
 static void
@@ -583,7 +720,7 @@ on_entity_created (updater_t *updater, GFile *entity)
 		break;
 	case G_FILE_TYPE_REGULAR:
 		g_debug ("file created");
-		updater_add_file (updater, entity);
+		updater_queue (updater, entity, UPDATER_ACTION_ADD);
 		break;
 	default:
 		g_debug ("something else created: %d", (int) type);
@@ -602,7 +739,7 @@ on_entity_changed (updater_t *updater, GFile *entity)
 	type = g_file_query_file_type (entity, G_FILE_QUERY_INFO_NONE, NULL);
 	switch (type) {
 	case G_FILE_TYPE_REGULAR:
-		updater_rehash_file (updater, entity);
+		updater_queue (updater, entity, UPDATER_ACTION_REHASH);
 		break;
 	default:
 		g_debug ("something else changed: %d", (int) type);
@@ -625,7 +762,7 @@ on_entity_deleted (updater_t *updater, GFile *entity)
 	if (updater_remove_watcher (updater, entity)) {
 		updater_remove_directory (updater, entity);
 	} else {
-		updater_remove_file (updater, entity);
+		updater_queue (updater, entity, UPDATER_ACTION_REMOVE);
 	}
 }
 
@@ -134,12 +134,58 @@ refresh_active_playlist (xmmsv_t *val, void *udata)
 	return TRUE;
 }
 
+static void
+reload_active_playlist_entries (cli_cache_t *cache)
+{
+	xmmsc_result_t *refres;
+
+	refres = xmmsc_playlist_list_entries (cache->conn, XMMS_ACTIVE_PLAYLIST);
+	xmmsc_result_notifier_set (refres, &refresh_active_playlist, cache);
+	xmmsc_result_unref (refres);
+	freshness_requested (&cache->freshness_active_playlist);
+}
+
+/* Reorder the cached playlist as described by the permutation of a
+ * replace, returns FALSE if it can't be applied. */
+static gboolean
+permute_active_playlist (cli_cache_t *cache, xmmsv_t *val, gint size)
+{
+	const guchar *data;
+	guint len;
+	guint32 pos;
+	xmmsv_t *permutation, *entries;
+	gint i, id;
+
+	if (!freshness_is_fresh (&cache->freshness_active_playlist) ||
+	    xmmsv_list_get_size (cache->active_playlist) != size ||
+	    !xmmsv_dict_get (val, "permutation", &permutation) ||
+	    !xmmsv_get_bin (permutation, &data, &len) ||
+	    len != size * sizeof (guint32)) {
+		return FALSE;
+	}
+
+	entries = xmmsv_new_list ();
+
+	for (i = 0; i < size; i++) {
+		memcpy (&pos, data + i * sizeof (guint32), sizeof (guint32));
+		if (!xmmsv_list_get_int (cache->active_playlist, GUINT32_FROM_BE (pos), &id)) {
+			xmmsv_unref (entries);
+			return FALSE;
+		}
+		xmmsv_list_append_int (entries, id);
+	}
+
+	xmmsv_unref (cache->active_playlist);
+	cache->active_playlist = entries;
+
+	return TRUE;
+}
+
 static gint
 update_active_playlist (xmmsv_t *val, void *udata)
 {
 	cli_cache_t *cache = (cli_cache_t *) udata;
-	xmmsc_result_t *refres;
-	gint pos, newpos, type;
+	gint pos, newpos, type, size;
 	gint id;
 	const gchar *name;
 
@@ -173,14 +219,26 @@ update_active_playlist (xmmsv_t *val, void *udata)
 		xmmsv_list_remove (cache->active_playlist, pos);
 		break;
 
+	case XMMS_PLAYLIST_CHANGED_REPLACE:
+		/* Shuffle, sort and clear can be applied without a reload */
+		if (xmmsv_dict_entry_get_int (val, "size", &size)) {
+			if (size == 0 &&
+			    freshness_is_fresh (&cache->freshness_active_playlist)) {
+				xmmsv_list_clear (cache->active_playlist);
+				break;
+			}
+			if (permute_active_playlist (cache, val, size)) {
+				break;
+			}
+		}
+		reload_active_playlist_entries (cache);
+		break;
+
 	case XMMS_PLAYLIST_CHANGED_SHUFFLE:
 	case XMMS_PLAYLIST_CHANGED_SORT:
 	case XMMS_PLAYLIST_CHANGED_CLEAR:
 		/* Oops, reload the whole playlist */
-		refres = xmmsc_playlist_list_entries (cache->conn, XMMS_ACTIVE_PLAYLIST);
-		xmmsc_result_notifier_set (refres, &refresh_active_playlist, cache);
-		xmmsc_result_unref (refres);
-		freshness_requested (&cache->freshness_active_playlist);
+		reload_active_playlist_entries (cache);
 		break;
 	}
 
@@ -191,7 +249,6 @@ static gint
 reload_active_playlist (xmmsv_t *val, void *udata)
 {
 	cli_cache_t *cache = (cli_cache_t *) udata;
-	xmmsc_result_t *refres;
 	const gchar *buf;
 
 	/* FIXME: Also listen to playlist renames, in case the active PL is renamed! */
@@ -202,10 +259,7 @@ reload_active_playlist (xmmsv_t *val, void *udata)
 	}
 
 	/* Get all the entries again */
-	refres = xmmsc_playlist_list_entries (cache->conn, XMMS_ACTIVE_PLAYLIST);
-	xmmsc_result_notifier_set (refres, &refresh_active_playlist, cache);
-	xmmsc_result_unref (refres);
-	freshness_requested (&cache->freshness_active_playlist);
+	reload_active_playlist_entries (cache);
 
 	return TRUE;
 }
@@ -14,6 +14,7 @@
  *  General Public License for more details.
  */
 
+#include <stdio.h>
 #include <string.h>
 
 #include <glib.h>
@@ -32,12 +33,19 @@ struct column_display_St {
 	gint termwidth;
 	gint availchars;
 	gchar *buffer;       /* Used to render strings. */
+	GString *out;        /* Rows not written to stdout yet. */
 	/* string used to highlight current track in classic list display */
 	const gchar *list_marker;
 	/* the string used if the row isn't marked with list_marker */
 	gchar *list_marker_pad;
+	gsize list_marker_len;
+	gsize list_marker_pad_len;
 };
 
+/* Rows are written out once this much is buffered, or when the
+ * display is flushed. */
+#define COLUMN_DISPLAY_FLUSH_SIZE (64 * 1024)
+
 struct column_def_St {
 	const gchar *name;
 	union {
@@ -56,7 +64,6 @@ struct column_def_St {
 /* FIXME:
    - make columns as narrow as possible (check widest value)
    - no width restriction when sending to a pipe (currently 80)
-   - use a GString to accomodate unknown buffer size
    - proper column_width on all platforms
 */
 
@@ -78,9 +85,25 @@ crop_string (gchar *dest, const gchar *str, guint max_len)
 	const gunichar space = g_utf8_get_char (" ");
 
 	if (!str || max_len == 0 ) {
+		*dest = '\0';
 		return 0;
 	}
 
+	/* Most values fit, copy those without converting them */
+	for (iter = str; *iter && columns <= max_len; iter = g_utf8_next_char (iter)) {
+		gunichar ch = (guchar) *iter;
+		if (ch >= 0x80) {
+			ch = g_utf8_get_char (iter);
+		}
+		columns += g_unichar_iswide (ch) ? 2 : 1;
+	}
+	if (!*iter && columns <= max_len) {
+		memmove (dest, str, iter - str);
+		*(dest + (iter - str)) = '\0';
+		return columns;
+	}
+	columns = 0;
+
 	ucslen = sizeof(gunichar) * max_len;
 	buffer = g_malloc (ucslen);
 	tmp = buffer;
@@ -184,15 +207,24 @@ result_to_string (xmmsv_t *val, column_def_t *coldef, gchar *buffer)
 }
 
 static void
-print_fixed_width_string (const gchar *value, gint width, gint realsize,
+append_padding (column_display_t *disp, gint length, gchar padchar)
+{
+	while (length-- > 0) {
+		g_string_append_c (disp->out, padchar);
+	}
+}
+
+static void
+print_fixed_width_string (column_display_t *disp, const gchar *value,
+                          gint width, gint realsize,
                           column_def_align_t align, gchar padchar)
 {
 	if (align == COLUMN_DEF_ALIGN_LEFT) {
-		g_printf ("%s", value);
-		print_padding (width - realsize, padchar);
+		g_string_append (disp->out, value);
+		append_padding (disp, width - realsize, padchar);
 	} else {
-		print_padding (width - realsize, padchar);
-		g_printf ("%s", value);
+		append_padding (disp, width - realsize, padchar);
+		g_string_append (disp->out, value);
 	}
 }
 
@@ -204,13 +236,13 @@ print_string_using_coldef (column_display_t *disp, column_def_t *coldef,
 	case COLUMN_DEF_SIZE_FIXED:
 	case COLUMN_DEF_SIZE_RELATIVE:
 		/* Print fixed, with padding/alignment */
-		print_fixed_width_string (disp->buffer, coldef->size, realsize,
+		print_fixed_width_string (disp, disp->buffer, coldef->size, realsize,
 		                          coldef->align, ' ');
 		break;
 
 	case COLUMN_DEF_SIZE_AUTO:
 		/* Just print the string */
-		g_printf ("%s", disp->buffer);
+		g_string_append (disp->out, disp->buffer);
 		break;
 	}
 }
@@ -277,6 +309,7 @@ column_display_init (void)
 	disp->termwidth = find_terminal_width ();
 	disp->availchars = 0;
 	disp->buffer = NULL;
+	disp->out = g_string_sized_new (COLUMN_DISPLAY_FLUSH_SIZE);
 	disp->list_marker_pad = NULL;
 
 	return disp;
@@ -343,6 +376,9 @@ column_display_free (column_display_t *disp)
 	}
 	g_array_free (disp->cols, TRUE);
 
+	column_display_flush (disp);
+	g_string_free (disp->out, TRUE);
+
 	g_free (disp->list_marker_pad);
 	g_free (disp->buffer);
 	g_free (disp);
@@ -358,19 +394,18 @@ column_display_print_header (column_display_t *disp)
 
 	/* Display Result head line */
 	headstr = _("--[Result]-");
-	print_fixed_width_string (headstr, disp->termwidth, strlen (headstr),
+	print_fixed_width_string (disp, headstr, disp->termwidth, strlen (headstr),
 	                          COLUMN_DEF_ALIGN_LEFT, '-');
-	g_printf ("\n");
+	g_string_append_c (disp->out, '\n');
 
 	/* Display column headers */
 	for (i = 0; i < disp->cols->len; ++i) {
 		coldef = g_array_index (disp->cols, column_def_t *, i);
 		realsize = g_snprintf (disp->buffer, coldef->size + 1, "%s", coldef->name);
-		print_fixed_width_string (disp->buffer, coldef->size, realsize,
+		print_fixed_width_string (disp, disp->buffer, coldef->size, realsize,
 		                          coldef->align, ' ');
 	}
-	g_printf ("\n");
-
+	g_string_append_c (disp->out, '\n');
 }
 
 void
@@ -381,9 +416,10 @@ column_display_print_footer (column_display_t *disp)
 	realsize = g_snprintf (disp->buffer, disp->termwidth + 1,
 	                       _("-[Count:%6.d]--"), disp->counter);
 
-	print_fixed_width_string (disp->buffer, disp->termwidth, realsize,
+	print_fixed_width_string (disp, disp->buffer, disp->termwidth, realsize,
 	                          COLUMN_DEF_ALIGN_RIGHT, '-');
-	g_printf ("\n");
+	g_string_append_c (disp->out, '\n');
+	column_display_flush (disp);
 }
 
 void
@@ -391,6 +427,7 @@ column_display_print_footer_totaltime (column_display_t *disp)
 {
 	gchar *time = format_time (disp->total_time, TRUE);
 
+	column_display_flush (disp);
 	g_printf (_("Total playtime: %s\n"), time);
 
 	g_free (time);
@@ -436,12 +473,80 @@ column_display_prepare (column_display_t *disp)
 	disp->buffer = g_new0 (gchar, (disp->termwidth * sizeof(gunichar)) + 1);
 }
 
+static void
+column_display_add_key (xmmsv_t *keys, const gchar *key)
+{
+	const gchar *k;
+	gint i;
+
+	for (i = 0; xmmsv_list_get_string (keys, i, &k); i++) {
+		if (strcmp (k, key) == 0) {
+			return;
+		}
+	}
+
+	xmmsv_list_append_string (keys, key);
+}
+
+/* Get the list of medialib properties needed to display rows, so they
+ * can be fetched for many rows at once.
+ */
+xmmsv_t *
+column_display_get_properties (column_display_t *disp)
+{
+	column_def_t *coldef;
+	const gchar *next, *end;
+	xmmsv_t *keys;
+	gint i;
+
+	keys = xmmsv_new_list ();
+
+	/* the id, the total time and what enrich_mediainfo uses */
+	column_display_add_key (keys, "id");
+	column_display_add_key (keys, "duration");
+	column_display_add_key (keys, "title");
+	column_display_add_key (keys, "url");
+
+	for (i = 0; i < disp->cols->len; ++i) {
+		coldef = g_array_index (disp->cols, column_def_t *, i);
+
+		if (coldef->render == column_display_render_property) {
+			column_display_add_key (keys, coldef->arg.string);
+		} else if (coldef->render == column_display_render_time) {
+			column_display_add_key (keys, coldef->arg.udata);
+		} else if (coldef->render == column_display_render_format) {
+			for (next = coldef->arg.udata; (next = strstr (next, "${")); next = end) {
+				gchar *key;
+
+				next += 2;
+				end = next + strcspn (next, "}");
+
+				key = g_strndup (next, end - next);
+				column_display_add_key (keys, key);
+				g_free (key);
+			}
+		}
+	}
+
+	return keys;
+}
+
 void
 column_display_set_position (column_display_t *disp, gint pos)
 {
 	disp->counter = pos;
 }
 
+/** Write the buffered rows to stdout. */
+void
+column_display_flush (column_display_t *disp)
+{
+	if (disp->out->len > 0) {
+		fwrite (disp->out->str, 1, disp->out->len, stdout);
+		g_string_truncate (disp->out, 0);
+	}
+}
+
 void
 column_display_print (column_display_t *disp, xmmsv_t *val)
 {
@@ -462,7 +567,7 @@ column_display_print (column_display_t *disp, xmmsv_t *val)
 				availchars = (availchars >= colwidth ? availchars - colwidth : 0);
 			}
 		}
-		g_printf ("\n");
+		g_string_append_c (disp->out, '\n');
 
 		if (xmmsv_dict_entry_get_int (val, "duration", &millisecs)) {
 			disp->total_time += millisecs;
@@ -470,7 +575,11 @@ column_display_print (column_display_t *disp, xmmsv_t *val)
 
 		disp->counter++;
 	} else {
-		g_printf (_("Server error: %s\n"), err);
+		g_string_append_printf (disp->out, _("Server error: %s\n"), err);
+	}
+
+	if (disp->out->len >= COLUMN_DISPLAY_FLUSH_SIZE) {
+		column_display_flush (disp);
 	}
 }
 
@@ -499,9 +608,12 @@ column_display_render_highlight (column_display_t *disp, column_def_t *coldef,
 	gint realsize, highlight = GPOINTER_TO_INT(coldef->arg.udata);
 
 	if (disp->counter == highlight) {
-		realsize = g_printf ("%s", disp->list_marker);
+		g_string_append_len (disp->out, disp->list_marker, disp->list_marker_len);
+		realsize = disp->list_marker_len;
 	} else {
-		realsize = g_printf ("%s", disp->list_marker_pad);
+		g_string_append_len (disp->out, disp->list_marker_pad,
+		                     disp->list_marker_pad_len);
+		realsize = disp->list_marker_pad_len;
 	}
 
 	return realsize;
@@ -525,12 +637,10 @@ gint
 column_display_render_text (column_display_t *disp, column_def_t *coldef,
                             xmmsv_t *val)
 {
-	gint realsize;
-	const gchar *sep = coldef->name;
-
-	realsize = g_printf ("%s", sep);
+	/* the size of a separator is its length */
+	g_string_append_len (disp->out, coldef->name, coldef->requested_size);
 
-	return realsize;
+	return coldef->requested_size;
 }
 
 /** Interpret int/uint value as a time */
@@ -609,6 +719,7 @@ column_display_set_list_marker (column_display_t *disp, const gchar *marker)
 	gchar *ansi_seq, *ansi_seq_end;
 
 	disp->list_marker = marker;
+	disp->list_marker_len = strlen (marker);
 
 	marker_pad = g_string_new (marker);
 	ansi_seq = marker_pad->str;
@@ -630,6 +741,7 @@ column_display_set_list_marker (column_display_t *disp, const gchar *marker)
 	/* reusing ansi_seq to keep place in marker_pad */
 	for (ansi_seq = marker_pad->str; *ansi_seq; *ansi_seq++ = ' ');
 	disp->list_marker_pad = marker_pad->str;
+	disp->list_marker_pad_len = strlen (marker_pad->str);
 	g_string_free (marker_pad, FALSE);
 }
 
@@ -44,6 +44,7 @@ void column_display_add_special (column_display_t *disp, const gchar *label, voi
 void column_display_free (column_display_t *disp);
 void column_display_prepare (column_display_t *disp);
 void column_display_print (column_display_t *disp, xmmsv_t *res);
+void column_display_flush (column_display_t *disp);
 void column_display_print_header (column_display_t *disp);
 void column_display_print_footer (column_display_t *disp);
 void column_display_print_footer_totaltime (column_display_t *disp);
@@ -57,6 +58,7 @@ gint column_display_render_property (column_display_t *disp, column_def_t *colde
 gint column_display_render_format (column_display_t *disp, column_def_t *coldef, xmmsv_t *val);
 
 void column_display_set_position (column_display_t *disp, gint pos);
+xmmsv_t *column_display_get_properties (column_display_t *disp);
 
 void column_display_set_list_marker (column_display_t *disp, const gchar *marker);
 
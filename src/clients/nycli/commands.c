@@ -162,6 +162,11 @@ CLI_SIMPLE_SETUP("server sync", cli_server_sync,
                  NULL,
                  _("Force the saving of collections to the disk (otherwise only performed on shutdown)"))
 
+CLI_SIMPLE_SETUP("server restart", cli_server_restart,
+                 COMMAND_REQ_CONNECTION | COMMAND_REQ_NO_AUTOSTART,
+                 NULL,
+                 _("Restart the server in place, continuing playback where it was."))
+
 CLI_SIMPLE_SETUP("server shutdown", cli_server_shutdown,
                  COMMAND_REQ_CONNECTION | COMMAND_REQ_NO_AUTOSTART,
                  NULL,
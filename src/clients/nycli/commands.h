@@ -70,6 +70,7 @@ gboolean cli_server_plugins (cli_context_t *ctx, command_t *cmd);
 gboolean cli_server_volume (cli_context_t *ctx, command_t *cmd);
 gboolean cli_server_stats (cli_context_t *ctx, command_t *cmd);
 gboolean cli_server_sync (cli_context_t *ctx, command_t *cmd);
+gboolean cli_server_restart (cli_context_t *ctx, command_t *cmd);
 gboolean cli_server_shutdown (cli_context_t *ctx, command_t *cmd);
 
 void cli_play_setup (command_action_t *action);
@@ -114,6 +115,7 @@ void cli_server_plugins_setup (command_action_t *action);
 void cli_server_volume_setup (command_action_t *action);
 void cli_server_stats_setup (command_action_t *action);
 void cli_server_sync_setup (command_action_t *action);
+void cli_server_restart_setup (command_action_t *action);
 void cli_server_shutdown_setup (command_action_t *action);
 
 void help_command (cli_context_t *ctx, GList *cmdnames, gchar **cmd, gint num_args, cmd_type_t cmdtype);
@@ -159,6 +161,7 @@ static const command_setup_func commandlist[] =
 	cli_server_property_setup,
 	cli_server_rehash_setup,
 	cli_server_remove_setup,
+	cli_server_restart_setup,
 	cli_server_shutdown_setup,
 	cli_server_stats_setup,
 	cli_server_sync_setup,
@@ -36,19 +36,28 @@
 
 typedef struct cli_move_positions_St {
 	xmmsc_connection_t *sync;
+	cli_pipeline_t *pipeline;
 	const gchar *playlist;
 	gint inc;
 	gint pos;
 } cli_move_positions_t;
 
 typedef struct cli_list_positions_St {
-	xmmsc_connection_t *sync;
-	column_display_t *coldisp;
+	GArray *rows;
 	xmmsv_t *entries;
 } cli_list_positions_t;
 
+/** A row of a listing, the metadata is fetched page by page */
+typedef struct cli_list_row_St {
+	gint pos;
+	gint id;
+} cli_list_row_t;
+
+#define CLI_LIST_PAGE_SIZE 256
+
 typedef struct cli_remove_positions_St {
 	xmmsc_connection_t *sync;
+	cli_pipeline_t *pipeline;
 	const gchar *playlist;
 } cli_remove_positions_t;
 
@@ -231,27 +240,90 @@ cli_list_classic_column_display (cli_context_t *ctx)
 
 
 static void
-cli_list_print_row (column_display_t *coldisp, xmmsv_t *propdict)
+cli_list_print_page_infos (column_display_t *coldisp, cli_list_row_t *rows,
+                           gint count, xmmsv_t *infos)
+{
+	GHashTable *table;
+	xmmsv_t *info;
+	gint i, id;
+
+	table = g_hash_table_new (NULL, NULL);
+
+	for (i = 0; xmmsv_list_get (infos, i, &info); i++) {
+		if (xmmsv_dict_entry_get_int (info, "id", &id)) {
+			enrich_mediainfo (info);
+			g_hash_table_insert (table, GINT_TO_POINTER (id), info);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		info = g_hash_table_lookup (table, GINT_TO_POINTER (rows[i].id));
+		if (info != NULL) {
+			column_display_set_position (coldisp, rows[i].pos);
+			column_display_print (coldisp, info);
+		}
+	}
+
+	/* show the page before fetching the next one */
+	column_display_flush (coldisp);
+
+	g_hash_table_destroy (table);
+}
+
+/* Fetch the metadata of a page of rows with one query, and print it */
+static void
+cli_list_print_page (xmmsc_connection_t *conn, column_display_t *coldisp,
+                     xmmsv_t *properties, cli_list_row_t *rows, gint count)
+{
+	xmmsv_t *coll;
+	gint i;
+
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	for (i = 0; i < count; i++) {
+		xmmsv_coll_idlist_append (coll, rows[i].id);
+	}
+
+	XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_coll_query_infos, conn, coll, NULL, 0, 0, properties, NULL),
+	                 FUNC_CALL_P (cli_list_print_page_infos, coldisp, rows, count, XMMS_PREV_VALUE));
+
+	xmmsv_unref (coll);
+}
+
+/* Print rows a page at a time, so the first ones show up right away
+ * however long the list is.
+ */
+static void
+cli_list_print_rows (cli_context_t *ctx, column_display_t *coldisp,
+                     GArray *rows)
 {
-	xmmsv_t *info = xmmsv_propdict_to_dict (propdict, NULL);
-	enrich_mediainfo (info);
-	column_display_print (coldisp, info);
+	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	xmmsv_t *properties;
+	gint i;
+
+	properties = column_display_get_properties (coldisp);
+
+	for (i = 0; i < rows->len; i += CLI_LIST_PAGE_SIZE) {
+		cli_list_print_page (conn, coldisp, properties,
+		                     &g_array_index (rows, cli_list_row_t, i),
+		                     MIN (CLI_LIST_PAGE_SIZE, rows->len - i));
+	}
+
+	xmmsv_unref (properties);
 }
 
 static void
 cli_list_print_positions_row (gint pos, void *udata)
 {
 	cli_list_positions_t *pack = (cli_list_positions_t *) udata;
-	gint id;
+	cli_list_row_t row;
 
 	if (pos >= xmmsv_list_get_size (pack->entries)) {
 		return;
 	}
 
-	if (xmmsv_list_get_int (pack->entries, pos, &id)) {
-		column_display_set_position (pack->coldisp, pos);
-		XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_medialib_get_info, pack->sync, id),
-		                 FUNC_CALL_P (cli_list_print_row, pack->coldisp, XMMS_PREV_VALUE));
+	if (xmmsv_list_get_int (pack->entries, pos, &row.id)) {
+		row.pos = pos;
+		g_array_append_val (pack->rows, row);
 	}
 }
 
@@ -260,38 +332,44 @@ cli_list_print_positions (cli_context_t *ctx, column_display_t *coldisp,
                           xmmsv_t *list, gpointer udata)
 {
 	cli_list_positions_t pudata = {
-		.sync = cli_context_xmms_sync (ctx),
-		.coldisp = coldisp,
+		.rows = g_array_new (FALSE, FALSE, sizeof (cli_list_row_t)),
 		.entries = list
 	};
 	playlist_positions_t *positions = (playlist_positions_t *) udata;
 	playlist_positions_foreach (positions, cli_list_print_positions_row, TRUE, &pudata);
+
+	cli_list_print_rows (ctx, coldisp, pudata.rows);
+	g_array_free (pudata.rows, TRUE);
 }
 
 static void
 cli_list_print_ids (cli_context_t *ctx, column_display_t *coldisp,
                     xmmsv_t *list, gpointer udata)
 {
-	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
 	xmmsv_list_iter_t *it;
 	GTree *lookup = NULL;
-	gint id;
+	GArray *rows;
+	cli_list_row_t row;
 
 	xmmsv_t *filter = (xmmsv_t *) udata;
 
 	if (filter != NULL)
 		lookup = g_tree_new_from_xmmsv (filter);
 
+	rows = g_array_new (FALSE, FALSE, sizeof (cli_list_row_t));
+
 	xmmsv_get_list_iter (list, &it);
-	while (xmmsv_list_iter_entry_int (it, &id)) {
-		column_display_set_position (coldisp, xmmsv_list_iter_tell (it));
-		if (lookup == NULL || g_tree_lookup (lookup, GINT_TO_POINTER (id)) != NULL) {
-			XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_medialib_get_info, conn, id),
-			                 FUNC_CALL_P (cli_list_print_row, coldisp, XMMS_PREV_VALUE));
+	while (xmmsv_list_iter_entry_int (it, &row.id)) {
+		if (lookup == NULL || g_tree_lookup (lookup, GINT_TO_POINTER (row.id)) != NULL) {
+			row.pos = xmmsv_list_iter_tell (it);
+			g_array_append_val (rows, row);
 		}
 		xmmsv_list_iter_next (it);
 	}
 
+	cli_list_print_rows (ctx, coldisp, rows);
+	g_array_free (rows, TRUE);
+
 	if (lookup)
 		g_tree_destroy (lookup);
 }
@@ -485,12 +563,12 @@ cli_add_playlist_file (cli_context_t *ctx, const gchar *url,
  * Add a file specified by a url to a playlist at a given id.
  */
 static void
-cli_add_file (cli_context_t *ctx, const gchar *url,
+cli_add_file (cli_context_t *ctx, cli_pipeline_t *pipeline, const gchar *url,
               const gchar *playlist, gint pos, xmmsv_t *attrs)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
 	gchar *decoded = decode_url (url);
-	XMMS_CALL (xmmsc_playlist_insert_full, conn, playlist, pos, decoded, attrs);
+	XMMS_CALL_PIPELINED (pipeline, xmmsc_playlist_insert_full, conn, playlist, pos, decoded, attrs);
 	g_free (decoded);
 }
 
@@ -500,18 +578,19 @@ cli_add_file (cli_context_t *ctx, const gchar *url,
  * Add a directory to a playlist recursively at a given position.
  */
 static void
-cli_add_dir (cli_context_t *ctx, const gchar *url,
+cli_add_dir (cli_context_t *ctx, cli_pipeline_t *pipeline, const gchar *url,
              const gchar *playlist, gint pos)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
-	XMMS_CALL (xmmsc_playlist_rinsert_encoded, conn, playlist, pos, url);
+	XMMS_CALL_PIPELINED (pipeline, xmmsc_playlist_rinsert_encoded, conn, playlist, pos, url);
 }
 
 /**
  * Helper function for cli_add.
  *
  * Process and add file arguments to a playlist at a given position.
- * The files may be regular or playlist files.
+ * The files may be regular or playlist files. The inserts are
+ * pipelined, they are sent in order without waiting for each reply.
  *
  * @return whether media has been added to the playlist.
  */
@@ -520,6 +599,7 @@ cli_add_fileargs (cli_context_t *ctx, command_t *cmd,
                   const gchar *playlist, gint pos)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	cli_pipeline_t *pipeline;
 	gint i;
 	gboolean plsfile, norecurs, ret = FALSE;
 	xmmsv_t *attributes;
@@ -527,6 +607,7 @@ cli_add_fileargs (cli_context_t *ctx, command_t *cmd,
 	command_flag_boolean_get (cmd, "pls", &plsfile);
 	command_flag_boolean_get (cmd, "non-recursive", &norecurs);
 	attributes = cli_add_parse_attributes (cmd);
+	pipeline = cli_pipeline_new ();
 
 	for (i = 0; i < command_arg_count (cmd); i++) {
 		GList *files, *it;
@@ -557,13 +638,13 @@ cli_add_fileargs (cli_context_t *ctx, command_t *cmd,
 
 				cli_add_playlist_file (ctx, url, playlist, pos);
 			} else if (norecurs || !is_directory) {
-				cli_add_file (ctx, url, playlist, pos, attributes);
+				cli_add_file (ctx, pipeline, url, playlist, pos, attributes);
 			} else {
 				if (xmmsv_dict_get_size (attributes) > 0) {
 					g_printf (_("Warning: Skipping attributes together with directory.\n"));
 				}
 
-				cli_add_dir (ctx, url, playlist, pos);
+				cli_add_dir (ctx, pipeline, url, playlist, pos);
 			}
 
 			pos++; /* next insert at next pos, to keep order */
@@ -577,6 +658,8 @@ cli_add_fileargs (cli_context_t *ctx, command_t *cmd,
 		g_list_free (files);
 	}
 
+	cli_pipeline_finish (pipeline);
+
 	xmmsv_unref (attributes);
 	return ret;
 }
@@ -746,13 +829,13 @@ cli_move_positions (gint curr, void *userdata)
 		if (pack->inc >= 0) {
 			pack->inc = -1; /* start inc at -1, decrement */
 		}
-		XMMS_CALL (xmmsc_playlist_move_entry, pack->sync,
-		           pack->playlist, curr, pack->pos + pack->inc);
+		XMMS_CALL_PIPELINED (pack->pipeline, xmmsc_playlist_move_entry, pack->sync,
+		                     pack->playlist, curr, pack->pos + pack->inc);
 		pack->inc--;
 	} else {
 		/* moving backward */
-		XMMS_CALL (xmmsc_playlist_move_entry, pack->sync,
-		           pack->playlist, curr + pack->inc, pack->pos);
+		XMMS_CALL_PIPELINED (pack->pipeline, xmmsc_playlist_move_entry, pack->sync,
+		                     pack->playlist, curr + pack->inc, pack->pos);
 		pack->inc++;
 	}
 }
@@ -762,6 +845,7 @@ cli_move_entries (xmmsv_t *matching, xmmsv_t *lisval, cli_context_t *ctx,
                   const gchar *playlist, gint pos)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	cli_pipeline_t *pipeline;
 	xmmsv_list_iter_t *it;
 	gint curr, id, inc;
 	gboolean up;
@@ -769,6 +853,9 @@ cli_move_entries (xmmsv_t *matching, xmmsv_t *lisval, cli_context_t *ctx,
 	/* store matching mediaids in a tree (faster lookup) */
 	GTree *list = g_tree_new_from_xmmsv (matching);
 
+	/* the moves only depend on the positions computed here */
+	pipeline = cli_pipeline_new ();
+
 	/* move matched playlist items */
 	curr = 0;
 	inc = 0;
@@ -782,12 +869,12 @@ cli_move_entries (xmmsv_t *matching, xmmsv_t *lisval, cli_context_t *ctx,
 		if (g_tree_lookup (list, GINT_TO_POINTER (id)) != NULL) {
 			if (up) {
 				/* moving forward */
-				XMMS_CALL (xmmsc_playlist_move_entry,
-				           conn, playlist, curr - inc, pos - 1);
+				XMMS_CALL_PIPELINED (pipeline, xmmsc_playlist_move_entry,
+				                     conn, playlist, curr - inc, pos - 1);
 			} else {
 				/* moving backward */
-				XMMS_CALL (xmmsc_playlist_move_entry,
-				           conn, playlist, curr, pos + inc);
+				XMMS_CALL_PIPELINED (pipeline, xmmsc_playlist_move_entry,
+				                     conn, playlist, curr, pos + inc);
 			}
 			inc++;
 		}
@@ -796,6 +883,8 @@ cli_move_entries (xmmsv_t *matching, xmmsv_t *lisval, cli_context_t *ctx,
 		xmmsv_list_iter_next (it);
 	}
 
+	cli_pipeline_finish (pipeline);
+
 	g_tree_destroy (list);
 }
 
@@ -820,11 +909,13 @@ cli_move (cli_context_t *ctx, command_t *cmd)
 	if (command_arg_positions_get (cmd, 0, &positions, cli_context_current_position (ctx))) {
 		cli_move_positions_t udata = {
 			.sync = conn,
+			.pipeline = cli_pipeline_new (),
 			.playlist = playlist,
 			.inc = 0,
 			.pos = pos
 		};
 		playlist_positions_foreach (positions, cli_move_positions, FALSE, &udata);
+		cli_pipeline_finish (udata.pipeline);
 		playlist_positions_free (positions);
 	} else if (command_arg_pattern_get (cmd, 0, &query, TRUE)) {
 		XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_coll_query_ids, conn, query, NULL, 0, 0),
@@ -841,38 +932,39 @@ cli_remove_ids (cli_context_t *ctx, const gchar *playlist,
                 xmmsv_t *matchval, xmmsv_t *plistval)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
-	xmmsv_list_iter_t *matchit, *plistit;
-	gint plid, id, offset;
+	cli_pipeline_t *pipeline;
+	xmmsv_list_iter_t *plistit;
+	gint plid, offset;
+
+	/* store matching mediaids in a tree (faster lookup) */
+	GTree *matching = g_tree_new_from_xmmsv (matchval);
 
 	offset = 0;
+	pipeline = cli_pipeline_new ();
 
-	xmmsv_get_list_iter (matchval, &matchit);
 	xmmsv_get_list_iter (plistval, &plistit);
 
-	/* Loop on the playlist */
+	/* Loop on the playlist, removing the matched media */
 	while (xmmsv_list_iter_entry_int (plistit, &plid)) {
-		xmmsv_list_iter_first (matchit);
-
-		/* Loop on the matched media */
-		while (xmmsv_list_iter_entry_int (matchit, &id)) {
-			/* If both match, remove */
-			if (plid == id) {
-				XMMS_CALL (xmmsc_playlist_remove_entry, conn, playlist,
-				           xmmsv_list_iter_tell (plistit) - offset);
-				offset++;
-				break;
-			}
-			xmmsv_list_iter_next (matchit);
+		if (g_tree_lookup (matching, GINT_TO_POINTER (plid)) != NULL) {
+			XMMS_CALL_PIPELINED (pipeline, xmmsc_playlist_remove_entry, conn, playlist,
+			                     xmmsv_list_iter_tell (plistit) - offset);
+			offset++;
 		}
 		xmmsv_list_iter_next (plistit);
 	}
+
+	cli_pipeline_finish (pipeline);
+
+	g_tree_destroy (matching);
 }
 
 static void
 cli_remove_positions_each (gint pos, void *udata)
 {
 	cli_remove_positions_t *pack = (cli_remove_positions_t *) udata;
-	XMMS_CALL (xmmsc_playlist_remove_entry, pack->sync, pack->playlist, pos);
+	XMMS_CALL_PIPELINED (pack->pipeline, xmmsc_playlist_remove_entry,
+	                     pack->sync, pack->playlist, pos);
 }
 
 gboolean
@@ -890,9 +982,11 @@ cli_remove (cli_context_t *ctx, command_t *cmd)
 	if (command_arg_positions_get (cmd, 0, &positions, cli_context_current_position (ctx))) {
 		cli_remove_positions_t udata = {
 			.sync = conn,
+			.pipeline = cli_pipeline_new (),
 			.playlist = playlist
 		};
 		playlist_positions_foreach (positions, cli_remove_positions_each, FALSE, &udata);
+		cli_pipeline_finish (udata.pipeline);
 		playlist_positions_free (positions);
 	} else if (command_arg_pattern_get (cmd, 0, &query, TRUE)) {
 		if (!playlist) {
@@ -36,6 +36,7 @@
 
 typedef struct cli_info_print_positions_St {
 	cli_context_t *ctx;
+	cli_pipeline_t *pipeline;
 	gint inc;
 	gint pos;
 } cli_info_print_positions_t;
@@ -93,27 +94,39 @@ cli_info_print (xmmsv_t *propdict)
 	g_string_free (sb, TRUE);
 }
 
+/* Print the info of a pipelined call, udata counts the entries printed */
+static void
+cli_info_print_next (xmmsv_t *propdict, void *udata)
+{
+	gint *printed = (gint *) udata;
+
+	/* Do not prepend newline before the first entry */
+	if ((*printed)++ > 0) {
+		g_printf ("\n");
+	}
+
+	cli_info_print (propdict);
+}
+
 static void
 cli_info_print_list (cli_context_t *ctx, xmmsv_t *val)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	cli_pipeline_t *pipeline;
 	xmmsv_list_iter_t *it;
-	gboolean first = TRUE;
+	gint printed = 0;
 	gint32 id;
 
+	pipeline = cli_pipeline_new ();
+
 	xmmsv_get_list_iter (val, &it);
 	while (xmmsv_list_iter_entry_int (it, &id)) {
-		if (!first) {
-			g_printf ("\n");
-		} else {
-			first = FALSE;
-		}
-
-		XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_medialib_get_info, conn, id),
-		                 FUNC_CALL_P (cli_info_print, XMMS_PREV_VALUE));
-
+		cli_pipeline_push (pipeline, xmmsc_medialib_get_info (conn, id),
+		                   cli_info_print_next, &printed);
 		xmmsv_list_iter_next (it);
 	}
+
+	cli_pipeline_finish (pipeline);
 }
 
 static void
@@ -129,22 +142,16 @@ cli_info_print_position (gint pos, void *userdata)
 		return;
 	}
 
-	/* Do not prepend newline before the first entry */
-	if (pack->inc > 0) {
-		g_printf ("\n");
-	} else {
-		pack->inc++;
-	}
-
-	XMMS_CALL_CHAIN (XMMS_CALL_P (xmmsc_medialib_get_info, conn, id),
-	                 FUNC_CALL_P (cli_info_print, XMMS_PREV_VALUE));
+	cli_pipeline_push (pack->pipeline, xmmsc_medialib_get_info (conn, id),
+	                   cli_info_print_next, &pack->inc);
 }
 
 static void
 cli_info_print_positions (cli_context_t *ctx, playlist_positions_t *positions)
 {
-	cli_info_print_positions_t udata = { ctx, 0, 0 };
+	cli_info_print_positions_t udata = { ctx, cli_pipeline_new (), 0, 0 };
 	playlist_positions_foreach (positions, cli_info_print_position, TRUE, &udata);
+	cli_pipeline_finish (udata.pipeline);
 }
 
 /* TODO: Not really a part of the server sub-command, but in the future it
@@ -290,14 +297,19 @@ static void
 cli_server_remove_ids (cli_context_t *ctx, xmmsv_t *list)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	cli_pipeline_t *pipeline;
 	xmmsv_list_iter_t *it;
 	gint32 id;
 
+	pipeline = cli_pipeline_new ();
+
 	xmmsv_get_list_iter (list, &it);
 	while (xmmsv_list_iter_entry_int (it, &id)) {
-		XMMS_CALL (xmmsc_medialib_remove_entry, conn, id);
+		XMMS_CALL_PIPELINED (pipeline, xmmsc_medialib_remove_entry, conn, id);
 		xmmsv_list_iter_next (it);
 	}
+
+	cli_pipeline_finish (pipeline);
 }
 
 gboolean
@@ -331,14 +343,19 @@ static void
 cli_server_rehash_ids (cli_context_t *ctx, xmmsv_t *list)
 {
 	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	cli_pipeline_t *pipeline;
 	xmmsv_list_iter_t *it;
 	gint32 id;
 
+	pipeline = cli_pipeline_new ();
+
 	xmmsv_get_list_iter (list, &it);
 	while (xmmsv_list_iter_entry_int (it, &id)) {
-		XMMS_CALL (xmmsc_medialib_rehash, conn, id);
+		XMMS_CALL_PIPELINED (pipeline, xmmsc_medialib_rehash, conn, id);
 		xmmsv_list_iter_next (it);
 	}
+
+	cli_pipeline_finish (pipeline);
 }
 
 gboolean
@@ -823,6 +840,17 @@ cli_server_sync (cli_context_t *ctx, command_t *cmd)
 	return FALSE;
 }
 
+/* The loop is resumed in the disconnect callback */
+gboolean
+cli_server_restart (cli_context_t *ctx, command_t *cmd)
+{
+	xmmsc_connection_t *conn = cli_context_xmms_sync (ctx);
+	if (conn != NULL) {
+		XMMS_CALL (xmmsc_restart, conn);
+	}
+	return FALSE;
+}
+
 /* The loop is resumed in the disconnect callback */
 gboolean
 cli_server_shutdown (cli_context_t *ctx, command_t *cmd)
@@ -0,0 +1,100 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2 of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  General Public License for more details.
+ */
+
+#include <glib.h>
+#include <glib/gi18n.h>
+#include <glib/gprintf.h>
+
+#include "xmmscall.h"
+
+typedef struct cli_pipeline_call_St {
+	xmmsc_result_t *result;
+	cli_pipeline_func_t func;
+	void *udata;
+} cli_pipeline_call_t;
+
+struct cli_pipeline_St {
+	GQueue calls;
+};
+
+/** Start a pipeline, calls pushed to it are sent without waiting. */
+cli_pipeline_t *
+cli_pipeline_new (void)
+{
+	cli_pipeline_t *pipeline;
+
+	pipeline = g_new0 (cli_pipeline_t, 1);
+	g_queue_init (&pipeline->calls);
+
+	return pipeline;
+}
+
+/* Wait for the oldest call, report error or pass its value on */
+static void
+cli_pipeline_wait_one (cli_pipeline_t *pipeline)
+{
+	cli_pipeline_call_t *call;
+	const gchar *message;
+	xmmsv_t *value;
+
+	call = g_queue_pop_head (&pipeline->calls);
+
+	xmmsc_result_wait (call->result);
+	value = xmmsc_result_get_value (call->result);
+	if (xmmsv_get_error (value, &message)) {
+		g_printf (_("Server error: %s\n"), message);
+	} else if (call->func) {
+		call->func (value, call->udata);
+	}
+
+	xmmsc_result_unref (call->result);
+	g_free (call);
+}
+
+/**
+ * Add a call to the pipeline. Its value is passed to func once the
+ * calls before it have been handled, errors are reported like
+ * XMMS_CALL does. At most XMMS_PIPELINE_DEPTH calls are kept in
+ * flight, so this may wait for the oldest one.
+ */
+void
+cli_pipeline_push (cli_pipeline_t *pipeline, xmmsc_result_t *result,
+                   cli_pipeline_func_t func, void *udata)
+{
+	cli_pipeline_call_t *call;
+
+	if (g_queue_get_length (&pipeline->calls) >= XMMS_PIPELINE_DEPTH) {
+		cli_pipeline_wait_one (pipeline);
+	}
+
+	call = g_new0 (cli_pipeline_call_t, 1);
+	call->result = result;
+	call->func = func;
+	call->udata = udata;
+
+	g_queue_push_tail (&pipeline->calls, call);
+}
+
+/** Wait for all the calls in the pipeline and free it. */
+void
+cli_pipeline_finish (cli_pipeline_t *pipeline)
+{
+	while (!g_queue_is_empty (&pipeline->calls)) {
+		cli_pipeline_wait_one (pipeline);
+	}
+
+	g_free (pipeline);
+}
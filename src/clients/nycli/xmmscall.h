@@ -36,6 +36,20 @@
 		xmmsc_result_unref (__result); \
 	} while (0)
 
+/* Perform a simple IPC call on a pipeline, without waiting for the reply */
+#define XMMS_CALL_PIPELINED(pipeline, fun, ...) \
+		cli_pipeline_push (pipeline, fun (__VA_ARGS__), NULL, NULL)
+
+/* Maximum number of calls a pipeline keeps in flight */
+#define XMMS_PIPELINE_DEPTH 64
+
+typedef struct cli_pipeline_St cli_pipeline_t;
+typedef void (*cli_pipeline_func_t) (xmmsv_t *value, void *udata);
+
+cli_pipeline_t *cli_pipeline_new (void);
+void cli_pipeline_push (cli_pipeline_t *pipeline, xmmsc_result_t *result, cli_pipeline_func_t func, void *udata);
+void cli_pipeline_finish (cli_pipeline_t *pipeline);
+
 /* XMMS_CALL_CHAIN predicate */
 #define XMMS_CALL_P(func, ...) do { \
 		xmmsc_result_t *__result; \
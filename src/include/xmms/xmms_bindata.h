@@ -25,6 +25,15 @@ G_BEGIN_DECLS
 
 gchar *xmms_bindata_calculate_md5 (const guchar *data, gsize size, gchar ret[33]) XMMS_PUBLIC;
 gboolean xmms_bindata_plugin_add (const guchar *data, gsize size, gchar hash[33]) XMMS_PUBLIC;
+guchar *xmms_bindata_plugin_get (const gchar *hash, gsize *size) XMMS_PUBLIC;
+gboolean xmms_bindata_plugin_has (const gchar *hash) XMMS_PUBLIC;
+
+typedef struct xmms_bindata_writer_St xmms_bindata_writer_t;
+
+xmms_bindata_writer_t *xmms_bindata_plugin_writer_new (void) XMMS_PUBLIC;
+gboolean xmms_bindata_plugin_writer_write (xmms_bindata_writer_t *writer, const guchar *data, gsize size) XMMS_PUBLIC;
+gboolean xmms_bindata_plugin_writer_finish (xmms_bindata_writer_t *writer, gchar hash[33]) XMMS_PUBLIC;
+void xmms_bindata_plugin_writer_abort (xmms_bindata_writer_t *writer) XMMS_PUBLIC;
 
 G_END_DECLS
 
@@ -25,11 +25,18 @@
 
 #define xmms_log_debug g_debug
 
+/* the verbosity given to xmms_log_init, 2 and up logs debug messages */
+extern gint xmms_log_verbosity XMMS_PUBLIC;
+
 #define DEBUG
 
 #ifndef _MSC_VER
 #ifdef DEBUG
-#define XMMS_DBG(fmt, ...) xmms_log_debug (__FILE__ ":" XMMS_STRINGIFY(__LINE__) ": " fmt, ## __VA_ARGS__)
+/* checked before the arguments are even evaluated */
+#define XMMS_DBG(fmt, ...) G_STMT_START { \
+	if (G_UNLIKELY (xmms_log_verbosity >= 2)) \
+		xmms_log_debug (__FILE__ ":" XMMS_STRINGIFY(__LINE__) ": " fmt, ## __VA_ARGS__); \
+} G_STMT_END
 #define xmms_log_fatal(fmt, ...) g_error (__FILE__ ":" XMMS_STRINGIFY(__LINE__) ": " fmt, ## __VA_ARGS__)
 #define xmms_log_info(fmt, ...) g_message (__FILE__ ":" XMMS_STRINGIFY(__LINE__) ": " fmt, ## __VA_ARGS__)
 #define xmms_log_error(fmt, ...) g_warning (__FILE__ ":" XMMS_STRINGIFY(__LINE__) ": " fmt, ## __VA_ARGS__)
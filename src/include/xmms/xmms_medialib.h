@@ -54,6 +54,12 @@
 #define XMMS_MEDIALIB_ENTRY_PROPERTY_GAIN_ALBUM "gain_album"
 #define XMMS_MEDIALIB_ENTRY_PROPERTY_PEAK_TRACK "peak_track"
 #define XMMS_MEDIALIB_ENTRY_PROPERTY_PEAK_ALBUM "peak_album"
+/** Integrated loudness in LUFS and true peak, as measured by the server */
+#define XMMS_MEDIALIB_ENTRY_PROPERTY_LOUDNESS_TRACK "loudness_track"
+#define XMMS_MEDIALIB_ENTRY_PROPERTY_TRUEPEAK_TRACK "truepeak_track"
+/** Milliseconds of silence before the start and after the end */
+#define XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_START "silence_start"
+#define XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_END "silence_end"
 /** Indicates that this album is a compilation */
 #define XMMS_MEDIALIB_ENTRY_PROPERTY_COMPILATION "compilation"
 #define XMMS_MEDIALIB_ENTRY_PROPERTY_ALBUM_ID "album_id"
@@ -42,7 +42,11 @@ struct xmms_object_St {
 	guint32 id;
 	GMutex mutex;
 
-	GTree *signals;
+	/* handler snapshots by signal id, see xmms_object_emit */
+	gpointer *signals;
+	GList *retired;
+	gint emitting;
+
 	GTree *cmds;
 
 	gint ref;
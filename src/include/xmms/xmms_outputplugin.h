@@ -45,7 +45,7 @@ typedef struct xmms_output_St xmms_output_t;
 /**
  * The current API version.
  */
-#define XMMS_OUTPUT_API_VERSION 8
+#define XMMS_OUTPUT_API_VERSION 9
 
 struct xmms_output_plugin_St;
 typedef struct xmms_output_plugin_St xmms_output_plugin_t;
@@ -212,6 +212,40 @@ typedef struct xmms_output_methods_St {
 	 * @return the number of bytes in the soundcard buffer or 0 on failure
 	 */
 	guint (*latency_get)(xmms_output_t *);
+
+	/**
+	 * Get the preferred write size for a format.
+	 *
+	 * Called right after the format has been set. The writer thread
+	 * then hands #write as close to this many frames at a time as it
+	 * can, always a multiple of align frames. Optional, without it
+	 * the writer picks a size from the format.
+	 *
+	 * @param output an output object
+	 * @param type the stream type that was set
+	 * @param align set to the number of frames writes should be a
+	 * multiple of, defaults to 1
+	 * @return the number of frames per write, or 0 for no preference
+	 */
+	guint (*period_get)(xmms_output_t *output, const xmms_stream_type_t *type,
+	                    guint *align);
+
+	/**
+	 * Write audio data straight from the output buffer.
+	 *
+	 * Called by the writer thread instead of #write, the plugin gets
+	 * up to size bytes with #xmms_output_read directly into its own
+	 * memory, e.g. a mapped device buffer, saving a copy. Unlike the
+	 * other methods this is called without the plugin lock held, as
+	 * reading may change the format, so the plugin has to protect
+	 * its device from a concurrent #flush by itself. This function
+	 * cannot coexist with #write or #status.
+	 *
+	 * @param output an output object
+	 * @param size the number of bytes to move, a whole period
+	 * @param err an error struct
+	 */
+	void (*write_direct)(xmms_output_t *output, gint size, xmms_error_t *err);
 } xmms_output_methods_t;
 
 /**
@@ -310,6 +344,39 @@ void xmms_output_stream_type_add (xmms_output_t *output, ...) XMMS_PUBLIC;
  */
 gint xmms_output_read (xmms_output_t *output, char *buffer, gint len) XMMS_PUBLIC;
 
+/**
+ * Wait for data to read and apply any format change that is due
+ * before it. The next #xmms_output_read then gets data in the format
+ * last passed to format_set, so a plugin with a #write_direct method
+ * can map device memory for that format before reading into it.
+ * @param output an output object
+ * @return the number of bytes available, or -1 at the end of the stream
+ */
+gint xmms_output_read_prepare (xmms_output_t *output) XMMS_PUBLIC;
+
+/**
+ * Read from the output buffer without ever blocking, for plugins
+ * that are called back from a realtime audio thread, e.g. by JACK.
+ * Whatever is there is returned, the plugin has to play silence for
+ * the rest. Song changes and the end of the stream are taken care of
+ * by a thread of the output, so the plugin has to announce this way
+ * of reading with #xmms_output_pull_mode_set.
+ *
+ * @param output an output object
+ * @param buffer a buffer to store the read data in
+ * @param len the number of bytes to read
+ * @return the number of bytes read, or -1 at the end of the stream
+ */
+gint xmms_output_pull (xmms_output_t *output, char *buffer, gint len) XMMS_PUBLIC;
+
+/**
+ * Tell that the plugin reads with #xmms_output_pull. Only has an
+ * effect when called from new, the default is FALSE.
+ * @param output an output object
+ * @param pull TRUE if the plugin pulls
+ */
+void xmms_output_pull_mode_set (xmms_output_t *output, gboolean pull) XMMS_PUBLIC;
+
 /**
  * Gets Number of available bytes in the output buffer
  *
@@ -335,6 +402,23 @@ gint xmms_output_bytes_available (xmms_output_t *output) XMMS_PUBLIC;
  */
 void xmms_output_set_error (xmms_output_t *output, xmms_error_t *error) XMMS_PUBLIC;
 
+/**
+ * Tell that the volume may have changed, e.g. on a mixer event. The
+ * volume is then read with volume_get and broadcast if it differs.
+ * Can be called from any thread.
+ * @param output an output object
+ */
+void xmms_output_volume_changed (xmms_output_t *output) XMMS_PUBLIC;
+
+/**
+ * Tell whether the plugin calls #xmms_output_volume_changed on every
+ * change by itself. The volume is only polled, once a second, while
+ * this is FALSE, which is the default after new.
+ * @param output an output object
+ * @param events TRUE if the plugin reports changes
+ */
+void xmms_output_volume_events_set (xmms_output_t *output, gboolean events) XMMS_PUBLIC;
+
 /**
  * Check if an output plugin needs format updates on each track change.
  *
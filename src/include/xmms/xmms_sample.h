@@ -138,6 +138,47 @@ xmms_sample_name_get (xmms_sample_format_t fmt)
 	return "UNKNOWN";
 }
 
+/**
+ * Interleave planar float samples, as decoders like vorbis give them.
+ *
+ * @param out room for frames * channels samples
+ * @param in one array of frames samples per channel
+ * @param channels
+ * @param frames
+ */
+static inline void
+xmms_sample_interleave_float (xmms_samplefloat_t *out,
+                              xmms_samplefloat_t * const *in,
+                              gint channels, gint frames)
+{
+	gint i, c;
+
+	/* the common layouts get loops simple enough to vectorize */
+	if (channels == 1) {
+		const xmms_samplefloat_t *src = in[0];
+
+		for (i = 0; i < frames; i++) {
+			out[i] = src[i];
+		}
+	} else if (channels == 2) {
+		const xmms_samplefloat_t *left = in[0];
+		const xmms_samplefloat_t *right = in[1];
+
+		for (i = 0; i < frames; i++) {
+			out[2 * i] = left[i];
+			out[2 * i + 1] = right[i];
+		}
+	} else {
+		for (c = 0; c < channels; c++) {
+			const xmms_samplefloat_t *src = in[c];
+
+			for (i = 0; i < frames; i++) {
+				out[i * channels + c] = src[i];
+			}
+		}
+	}
+}
+
 G_END_DECLS
 
 #endif
@@ -51,7 +51,7 @@
 
 
 
-#define XMMS_XFORM_API_VERSION 7
+#define XMMS_XFORM_API_VERSION 8
 
 #include <xmms/xmms_error.h>
 #include <xmms/xmms_plugin.h>
@@ -170,6 +170,17 @@ typedef struct xmms_xform_methods_St {
 	 * This is called without init() beeing called.
 	 */
 	gboolean (*browse)(xmms_xform_t *, const gchar *, xmms_error_t *);
+
+	/**
+	 * Process method.
+	 *
+	 * Optional, for effects that transform audio/pcm in place
+	 * without changing its length. Called with a block already
+	 * read from the previous xform, which lets consecutive effects
+	 * run over the same block instead of each reading through its
+	 * own xform. The read method must still be provided.
+	 */
+	void (*process)(xmms_xform_t *, gpointer, gint);
 } xmms_xform_methods_t;
 
 #define XMMS_XFORM_METHODS_INIT(m) memset (&m, 0, sizeof (xmms_xform_methods_t))
@@ -265,6 +276,18 @@ void xmms_xform_private_data_set (xmms_xform_t *xform, gpointer data) XMMS_PUBLI
 void xmms_xform_outdata_type_add (xmms_xform_t *xform, ...) XMMS_PUBLIC;
 void xmms_xform_outdata_type_copy (xmms_xform_t *xform) XMMS_PUBLIC;
 
+/**
+ * Tell if the end of the chain takes an outdata type as it is, so a
+ * decoder that can produce several formats can pick the one that
+ * needs no converter. Takes the same arguments as
+ * #xmms_xform_outdata_type_add, which still has to be called.
+ *
+ * @param xform current xform
+ * @returns TRUE if the type matches one of the formats the chain is
+ * set up for.
+ */
+gboolean xmms_xform_outdata_type_accepted (xmms_xform_t *xform, ...) XMMS_PUBLIC;
+
 /**
  * Set numeric metadata for the media transformed by this xform.
  *
@@ -415,6 +438,109 @@ gint xmms_xform_read (xmms_xform_t *xform, gpointer buf, gint siz, xmms_error_t
 gint64 xmms_xform_seek (xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mode_t whence, xmms_error_t *err) XMMS_PUBLIC;
 gboolean xmms_xform_iseos (xmms_xform_t *xform) XMMS_PUBLIC;
 
+/**
+ * A first in, first out buffer for decoded data.
+ *
+ * Decoders that produce more data per frame than they are asked for
+ * can keep the rest here. Reading from it does not move the data that
+ * is left, and a frame can be decoded right into it with
+ * #xmms_xform_fifo_reserve and #xmms_xform_fifo_commit.
+ */
+typedef struct xmms_xform_fifo_St xmms_xform_fifo_t;
+
+xmms_xform_fifo_t *xmms_xform_fifo_new (void) XMMS_PUBLIC;
+void xmms_xform_fifo_free (xmms_xform_fifo_t *fifo) XMMS_PUBLIC;
+
+/**
+ * Get the number of bytes in the fifo.
+ */
+gsize xmms_xform_fifo_length (xmms_xform_fifo_t *fifo) XMMS_PUBLIC;
+
+/**
+ * Get room for writing to the fifo.
+ *
+ * The returned memory has room for at least len bytes, and stays
+ * valid until the next call on the fifo.
+ *
+ * @param fifo
+ * @param len the number of bytes to make room for
+ * @returns where to write the data, to be followed by #xmms_xform_fifo_commit.
+ */
+gpointer xmms_xform_fifo_reserve (xmms_xform_fifo_t *fifo, gsize len) XMMS_PUBLIC;
+
+/**
+ * Add the bytes written to the memory from #xmms_xform_fifo_reserve
+ * to the fifo.
+ */
+void xmms_xform_fifo_commit (xmms_xform_fifo_t *fifo, gsize len) XMMS_PUBLIC;
+
+/**
+ * Append a copy of len bytes to the fifo.
+ */
+void xmms_xform_fifo_write (xmms_xform_fifo_t *fifo, gconstpointer data, gsize len) XMMS_PUBLIC;
+
+/**
+ * Take up to len bytes from the front of the fifo.
+ *
+ * @returns the number of bytes copied to buf.
+ */
+gsize xmms_xform_fifo_read (xmms_xform_fifo_t *fifo, gpointer buf, gsize len) XMMS_PUBLIC;
+
+/**
+ * Drop all data in the fifo, as after a seek.
+ */
+void xmms_xform_fifo_clear (xmms_xform_fifo_t *fifo) XMMS_PUBLIC;
+
+/**
+ * Rendering ahead for synthesizing decoders.
+ *
+ * Decoders that render their output, such as module players and
+ * synthesizers, can have it rendered on a worker thread into a fifo
+ * that is kept up to a lead of bytes ahead of what is read, so that a
+ * chunk costing more than usual doesn't make the output run dry. The
+ * render function is the one the read method used to be, and is
+ * called with the chunk size given. Its output must be the same as
+ * when read with any other size.
+ */
+typedef struct xmms_xform_render_St xmms_xform_render_t;
+typedef gint (*xmms_xform_render_func_t) (xmms_xform_t *xform, gpointer buf, gint len, xmms_error_t *err);
+
+/**
+ * Set up rendering ahead for an xform.
+ *
+ * The worker is started by the first read. With a lead of 0, or when
+ * the chain is probed by the mediainfo reader, reads render directly.
+ *
+ * @param xform
+ * @param func the function rendering the output
+ * @param chunk_size the number of bytes to render at a time
+ * @param lead the number of bytes to keep rendered
+ */
+xmms_xform_render_t *xmms_xform_render_new (xmms_xform_t *xform, xmms_xform_render_func_t func, gint chunk_size, gsize lead) XMMS_PUBLIC;
+void xmms_xform_render_free (xmms_xform_render_t *render) XMMS_PUBLIC;
+
+/**
+ * Have reads wait until len bytes are rendered, at the start and after
+ * the worker fell behind, instead of returning what there is. At most
+ * the lead is waited for.
+ */
+void xmms_xform_render_prefill (xmms_xform_render_t *render, gsize len) XMMS_PUBLIC;
+
+/**
+ * Read rendered output, waiting for the worker if it has none.
+ */
+gint xmms_xform_render_read (xmms_xform_render_t *render, gpointer buf, gint len, xmms_error_t *err) XMMS_PUBLIC;
+
+/**
+ * Stop the worker and drop what it has rendered.
+ *
+ * The render function is not called again until
+ * #xmms_xform_render_start, so the state it renders from can be
+ * changed, as by a seek or a tempo change, in between.
+ */
+void xmms_xform_render_stop (xmms_xform_render_t *render) XMMS_PUBLIC;
+void xmms_xform_render_start (xmms_xform_render_t *render) XMMS_PUBLIC;
+
 gboolean xmms_magic_add (const gchar *desc, const gchar *mime, ...) XMMS_PUBLIC;
 gboolean xmms_magic_extension_add (const gchar *mime, const gchar *ext) XMMS_PUBLIC;
 
@@ -429,8 +555,52 @@ xmms_config_property_t *xmms_xform_config_lookup (xmms_xform_t *xform, const gch
  * @returns
  */
 xmms_medialib_entry_t xmms_xform_entry_get (xmms_xform_t *xform) XMMS_PUBLIC;
+
+/**
+ * Get a property stored in the medialib for the entry played by this
+ * xform, such as one set by a plugin when the entry was last read.
+ *
+ * Must not be called from the init method, the medialib is busy
+ * setting up the chain then.
+ *
+ * @param xform
+ * @param key the property
+ * @returns a copy of the value, to be freed with g_free, or NULL.
+ */
+gchar *xmms_xform_entry_property_get_str (xmms_xform_t *xform, const gchar *key) XMMS_PUBLIC;
 const gchar *xmms_xform_get_url (xmms_xform_t *xform) XMMS_PUBLIC;
 
+/**
+ * Tell if the chain is only set up to collect metadata and will never
+ * be read from. Decoders may then skip setting up the codec, as long
+ * as they still set the metadata and an outdata type with samplerate
+ * and channels.
+ *
+ * @param xform
+ * @returns TRUE if nothing will be decoded.
+ */
+gboolean xmms_xform_is_probe (xmms_xform_t *xform) XMMS_PUBLIC;
+
+/**
+ * Tell if the chain is set up in the background for this effect to
+ * analyze the stream, rather than for playback. The effect then reads
+ * as much as it needs, sets its results as metadata and ends the
+ * stream.
+ *
+ * @param xform
+ * @returns TRUE if the stream is only decoded to be analyzed.
+ */
+gboolean xmms_xform_is_analysis (xmms_xform_t *xform) XMMS_PUBLIC;
+
+/**
+ * Get the first pcm format with a channel count that the chain is set
+ * up towards, for plugins that adapt the stream to the output.
+ *
+ * @param xform
+ * @returns The format, NULL if the goal has none.
+ */
+const xmms_stream_type_t *xmms_xform_goal_pcm_get (xmms_xform_t *xform) XMMS_PUBLIC;
+
 #define XMMS_XFORM_BROWSE_FLAG_DIR (1 << 0)
 
 void xmms_xform_browse_add_entry (xmms_xform_t *xform, const gchar *path, guint32 flags) XMMS_PUBLIC;
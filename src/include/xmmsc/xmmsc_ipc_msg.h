@@ -37,13 +37,19 @@ void xmms_ipc_msg_set_cookie (xmms_ipc_msg_t *msg, uint32_t cookie);
 
 xmms_ipc_msg_t *xmms_ipc_msg_new (uint32_t object, uint32_t cmd);
 xmms_ipc_msg_t * xmms_ipc_msg_alloc (void);
+xmms_ipc_msg_t *xmms_ipc_msg_new_from_data (const unsigned char *data, uint32_t len);
 void xmms_ipc_msg_destroy (xmms_ipc_msg_t *msg);
 
 bool xmms_ipc_msg_write_transport (xmms_ipc_msg_t *msg, xmms_ipc_transport_t *transport, bool *disconnected);
+bool xmms_ipc_msg_write_transport_cookie (const xmms_ipc_msg_t *msg, uint32_t cookie, uint32_t *xfered, xmms_ipc_transport_t *transport, bool *disconnected);
+uint32_t xmms_ipc_msg_get_size (const xmms_ipc_msg_t *msg);
+int xmms_ipc_msg_get_unwritten (const xmms_ipc_msg_t *msg, bool use_cookie, uint32_t cookie, uint32_t xfered, unsigned char head[XMMS_IPC_MSG_HEAD_LEN], xmms_ipc_transport_vec_t vec[2]);
 bool xmms_ipc_msg_read_transport (xmms_ipc_msg_t *msg, xmms_ipc_transport_t *transport, bool *disconnected);
 
 uint32_t xmms_ipc_msg_put_value (xmms_ipc_msg_t *msg, xmmsv_t* v);
+uint32_t xmms_ipc_msg_put_value_compact (xmms_ipc_msg_t *msg, xmmsv_t* v);
 
 bool xmms_ipc_msg_get_value (xmms_ipc_msg_t *msg, xmmsv_t **val);
+bool xmms_ipc_msg_get_value_keep_last (xmms_ipc_msg_t *msg, bool compact, xmmsv_t **val);
 
 #endif 
@@ -0,0 +1,49 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef XMMS_IPC_SHM_H
+#define XMMS_IPC_SHM_H
+
+#include <xmmsc/xmmsc_stdint.h>
+#include <xmmsc/xmmsc_stdbool.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+/**
+ * A ring in shared memory that the server writes large messages to
+ * and a client on the same host reads them from in place. The client
+ * creates it and the server attaches to it. Only the position of each
+ * message travels over the socket.
+ */
+typedef struct xmms_ipc_shm_St xmms_ipc_shm_t;
+
+/** Default size of the data area of a ring, in bytes */
+#define XMMS_IPC_SHM_DEFAULT_SIZE (1024 * 1024)
+
+/** Messages smaller than this are not worth the detour */
+#define XMMS_IPC_SHM_MIN_MSG 4096
+
+xmms_ipc_shm_t *xmms_ipc_shm_create (uint32_t size);
+xmms_ipc_shm_t *xmms_ipc_shm_attach (int shmid, uint32_t size);
+void xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm);
+int xmms_ipc_shm_id (xmms_ipc_shm_t *shm);
+void xmms_ipc_shm_unlink (xmms_ipc_shm_t *shm);
+
+bool xmms_ipc_shm_put (xmms_ipc_shm_t *shm, xmms_ipc_transport_vec_t *vec, int n, uint32_t *pos);
+const unsigned char *xmms_ipc_shm_peek (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len);
+void xmms_ipc_shm_release (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len);
+
+#endif
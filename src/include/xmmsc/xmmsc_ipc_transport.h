@@ -19,22 +19,35 @@
 #define XMMS_IPC_TRANSPORT_H
 
 #include <xmmsc/xmmsc_stdint.h>
+#include <xmmsc/xmmsc_stdbool.h>
 #include <xmmsc/xmmsc_sockets.h>
 
 typedef struct xmms_ipc_transport_St xmms_ipc_transport_t;
 
+/** One of the buffers of a gathered write */
+typedef struct xmms_ipc_transport_vec_St {
+	char *buf;
+	int len;
+} xmms_ipc_transport_vec_t;
+
+/** Most buffers a gathered write takes at once */
+#define XMMS_IPC_TRANSPORT_MAX_VEC 32
+
 typedef int (*xmms_ipc_read_func) (xmms_ipc_transport_t *, char *, int);
 typedef int (*xmms_ipc_write_func) (xmms_ipc_transport_t *, char *, int);
+typedef int (*xmms_ipc_writev_func) (xmms_ipc_transport_t *, xmms_ipc_transport_vec_t *, int);
 typedef xmms_ipc_transport_t *(*xmms_ipc_accept_func) (xmms_ipc_transport_t *);
 typedef void (*xmms_ipc_destroy_func) (xmms_ipc_transport_t *);
 
 void xmms_ipc_transport_destroy (xmms_ipc_transport_t *ipct);
 int xmms_ipc_transport_read (xmms_ipc_transport_t *ipct, char *buffer, int len);
 int xmms_ipc_transport_write (xmms_ipc_transport_t *ipct, char *buffer, int len);
+int xmms_ipc_transport_writev (xmms_ipc_transport_t *ipct, xmms_ipc_transport_vec_t *vec, int n);
 xmms_socket_t xmms_ipc_transport_fd_get (xmms_ipc_transport_t *ipct);
 xmms_ipc_transport_t * xmms_ipc_server_accept (xmms_ipc_transport_t *ipct);
 xmms_ipc_transport_t * xmms_ipc_client_init (const char *path);
 xmms_ipc_transport_t * xmms_ipc_server_init (const char *path);
+xmms_ipc_transport_t * xmms_ipc_server_adopt (const char *path, xmms_socket_t fd);
 char * xmms_ipc_hostname (const char *path);
 
 struct xmms_ipc_transport_St {
@@ -43,11 +56,19 @@ struct xmms_ipc_transport_St {
 	xmms_socket_t fd;
 	int32_t peer;
 	int16_t peer_port;
+	/* the other end is on the same host */
+	bool local;
 
 	xmms_ipc_accept_func accept_func;
 	xmms_ipc_write_func write_func;
+	xmms_ipc_writev_func writev_func;
 	xmms_ipc_read_func read_func;
 	xmms_ipc_destroy_func destroy_func;
+
+	/* bytes read ahead of what was asked for, kept for the next read */
+	char *rbuf;
+	int rbuf_pos;
+	int rbuf_len;
 };
 
 #endif
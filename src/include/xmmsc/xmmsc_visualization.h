@@ -53,6 +53,10 @@ void tv2net (int32_t* d, struct timeval *t);
     * XXX packets to compensate the latency (TODO: find a good value) */
 #define XMMS_VISPACKET_SHMCOUNT 500
 
+/* Chunks in a shmring, a power of two so that positions wrap
+   together with the counters */
+#define XMMS_VISPACKET_RINGCOUNT 512
+
 /**
  * Package format for vis data, encapsulated by unixshm or udp transport
  */
@@ -103,6 +107,7 @@ typedef struct {
 } xmmsc_vis_udp_timing_t;
 
 char* packet_init_data (xmmsc_vis_udp_data_t *p);
+void packet_setup_data (xmmsc_vis_udp_data_t *p, char *buffer);
 char* packet_init_timing (xmmsc_vis_udp_timing_t *p);
 
 /**
@@ -112,9 +117,15 @@ char* packet_init_timing (xmmsc_vis_udp_timing_t *p);
 typedef enum {
 	VIS_PCM,
 	VIS_SPECTRUM,
-	VIS_PEAK
+	VIS_PEAK,
+	VIS_RMS,
+	VIS_BANDS,
+	VIS_BEAT
 } xmmsc_vis_data_t;
 
+/* Most log spaced bands a client can ask for */
+#define XMMSC_VISUALIZATION_MAX_BANDS 64
+
 /**
  * Properties of the delivered vis data. The client doesn't use this struct
  * to date, but perhaps could in future
@@ -135,6 +146,13 @@ typedef struct {
 	int pcm_samplecount;
 	/* pcm bitsize wanted */
 /*	TODO xmms_sample_format_t pcm_sampleformat;*/
+
+	/* number of log spaced bands, their range in Hz, and how much
+	   of the last level is kept on the way down, 0..1 per chunk */
+	int bands;
+	double bands_min;
+	double bands_max;
+	double bands_decay;
 } xmmsc_vis_properties_t;
 
 /**
@@ -144,11 +162,14 @@ typedef struct {
 typedef enum {
 	VIS_UNIXSHM,
 	VIS_UDP,
+	VIS_SHMRING,
 	VIS_NONE
 } xmmsc_vis_transport_t;
 
 typedef enum {
 	VIS_NEW,
+	VIS_TRYING_SHMRING,
+	VIS_TO_TRY_UNIXSHM,
 	VIS_TRYING_UNIXSHM,
 	VIS_TO_TRY_UDP,
 	VIS_TRYING_UDP,
@@ -167,6 +188,42 @@ typedef struct {
 	int pos, size;
 } xmmsc_vis_unixshm_t;
 
+/**
+ * Start of a shmring segment, the chunks follow. wr and rd count
+ * chunks written and read since the ring was set up. Only the server
+ * moves wr, only the client moves rd and heartbeat, so neither side
+ * needs a syscall unless the client sleeps.
+ */
+
+typedef struct {
+	uint32_t count;
+	volatile uint32_t wr;
+	uint32_t pad0[14];
+	volatile uint32_t rd;
+	/* bumped whenever the client looks for data, tells a slow
+	   client from a dead one */
+	volatile uint32_t heartbeat;
+	/* set while the client sleeps waiting for wr to move */
+	volatile int32_t waiting;
+	uint32_t pad1[13];
+} xmmsc_vis_shmring_header_t;
+
+/**
+ * data describing a shmring transport
+ */
+
+typedef struct {
+	int shmid;
+	xmmsc_vis_shmring_header_t *header;
+	xmmsc_vischunk_t *buffer;
+	uint32_t count;
+	/* our own copy of the counter we move */
+	uint32_t pos;
+	/* last heartbeat seen and when, used by the server */
+	uint32_t beat;
+	int64_t beat_time;
+} xmmsc_vis_shmring_t;
+
 /**
  * data describing a udp transport
  */
@@ -37,9 +37,12 @@ xmmsv_t *xmmsv_new_bitbuffer_ro (const unsigned char *v, int len) XMMS_PUBLIC;
 xmmsv_t *xmmsv_new_bitbuffer (void) XMMS_PUBLIC;
 int xmmsv_bitbuffer_get_bits (xmmsv_t *v, int bits, int64_t *res) XMMS_PUBLIC;
 int xmmsv_bitbuffer_get_data (xmmsv_t *v, unsigned char *b, int len) XMMS_PUBLIC;
+const unsigned char *xmmsv_bitbuffer_peek_data (xmmsv_t *v, int len) XMMS_PUBLIC;
 int xmmsv_bitbuffer_put_bits (xmmsv_t *v, int bits, int64_t d) XMMS_PUBLIC;
 int xmmsv_bitbuffer_put_bits_at (xmmsv_t *v, int bits, int64_t d, int offset) XMMS_PUBLIC;
 int xmmsv_bitbuffer_put_data (xmmsv_t *v, const unsigned char *b, int len) XMMS_PUBLIC;
+int xmmsv_bitbuffer_reserve (xmmsv_t *v, int bits) XMMS_PUBLIC;
+int xmmsv_bitbuffer_extend (xmmsv_t *v, int len) XMMS_PUBLIC;
 int xmmsv_bitbuffer_align (xmmsv_t *v) XMMS_PUBLIC;
 int xmmsv_bitbuffer_goto (xmmsv_t *v, int pos) XMMS_PUBLIC;
 int xmmsv_bitbuffer_pos (xmmsv_t *v) XMMS_PUBLIC;
@@ -49,7 +52,12 @@ int xmmsv_bitbuffer_len (xmmsv_t *v) XMMS_PUBLIC;
 const unsigned char *xmmsv_bitbuffer_buffer (xmmsv_t *v) XMMS_PUBLIC;
 int xmmsv_get_bitbuffer (const xmmsv_t *val, const unsigned char **r, unsigned int *rlen) XMMS_PUBLIC;
 int xmmsv_bitbuffer_serialize_value (xmmsv_t *bb, xmmsv_t *v);
+int xmmsv_bitbuffer_serialize_value_compact (xmmsv_t *bb, xmmsv_t *v);
+int xmmsv_bitbuffer_serialized_size (xmmsv_t *v);
+int xmmsv_bitbuffer_serialized_size_compact (xmmsv_t *v);
 int xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val);
+int xmmsv_bitbuffer_deserialize_list_keep_last (xmmsv_t *bb, int compact, xmmsv_t **val);
+xmmsv_t *xmmsv_new_serialized (const unsigned char *data, unsigned int len, int compact);
 
 /** @} */
 
@@ -37,6 +37,7 @@ int xmmsv_dict_remove (xmmsv_t *dictv, const char *key) XMMS_PUBLIC;
 int xmmsv_dict_clear (xmmsv_t *dictv) XMMS_PUBLIC;
 int xmmsv_dict_get_size (xmmsv_t *dictv) XMMS_PUBLIC;
 int xmmsv_dict_has_key (xmmsv_t *dictv, const char *key) XMMS_PUBLIC;
+const char *xmmsv_intern_string (const char *str) XMMS_PUBLIC;
 
 int xmmsv_dict_keys (xmmsv_t *dictv, xmmsv_t **keys) XMMS_PUBLIC;
 int xmmsv_dict_values (xmmsv_t *dictv, xmmsv_t **values) XMMS_PUBLIC;
@@ -40,6 +40,10 @@ int xmmsv_utf8_validate (const char *str) XMMS_PUBLIC;
 
 xmmsv_t *xmmsv_propdict_to_dict (xmmsv_t *propdict, const char **src_prefs) XMMS_PUBLIC;
 
+int xmmsv_columns_get_size (xmmsv_t *columns) XMMS_PUBLIC;
+int xmmsv_columns_get_value (xmmsv_t *columns, const char *field, int row, xmmsv_t **value) XMMS_PUBLIC;
+xmmsv_t *xmmsv_columns_to_list (xmmsv_t *columns) XMMS_PUBLIC;
+
 int xmmsv_dict_format (char *target, int len, const char *fmt, xmmsv_t *val) XMMS_PUBLIC;
 
 xmmsv_t *xmmsv_serialize (xmmsv_t *v) XMMS_PUBLIC;
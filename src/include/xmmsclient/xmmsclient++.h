@@ -33,5 +33,6 @@
 #include <xmmsclient/xmmsclient++/xform.h>
 #include <xmmsclient/xmmsclient++/coll.h>
 #include <xmmsclient/xmmsclient++/collection.h>
+#include <xmmsclient/xmmsclient++/future.h>
 
 #endif // XMMSCLIENTPP_H
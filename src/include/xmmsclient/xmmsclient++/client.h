@@ -101,6 +101,20 @@ namespace Xmms
 			QuitSignal&
 			broadcastQuit();
 
+			/** Start a batch of commands.
+			 *  Commands are queued until batchCommit is called and then
+			 *  written to the server together. Batches may nest.
+			 *
+			 *  @throw connection_error If the client isn't connected.
+			 */
+			void batchBegin();
+
+			/** Send the commands queued since batchBegin.
+			 *
+			 *  @throw connection_error If the client isn't connected.
+			 */
+			void batchCommit();
+
 			// Subsystems
 
 			const Bindata    bindata;
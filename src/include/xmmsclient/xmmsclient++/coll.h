@@ -24,6 +24,13 @@
 #include <iostream>
 #include <stdexcept>
 
+#if __cplusplus >= 201703L
+#include <string_view>
+#ifndef XMMSCLIENTPP_HAVE_STRING_VIEW
+#define XMMSCLIENTPP_HAVE_STRING_VIEW 1
+#endif
+#endif
+
 namespace Xmms
 {
 
@@ -122,6 +129,17 @@ namespace Xmms
 
 				void setAttribute( const std::string &attrname, const std::string &value );
 				std::string getAttribute( const std::string &attrname ) const;
+
+				/** Gets an attribute without copying it, the string
+				 *  is valid until the attribute is changed.
+				 */
+				const char* getAttributeCString( const char* attrname ) const;
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+				std::string_view getAttributeView( const char* attrname ) const
+				{
+					return std::string_view( getAttributeCString( attrname ) );
+				}
+#endif
 				void removeAttribute( const std::string &attrname );
 
 				virtual void addOperand( Coll& operand );
@@ -24,6 +24,14 @@
 #include <string>
 #include <list>
 #include <iterator>
+#include <utility>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#ifndef XMMSCLIENTPP_HAVE_STRING_VIEW
+#define XMMSCLIENTPP_HAVE_STRING_VIEW 1
+#endif
+#endif
 
 namespace Xmms
 {
@@ -69,6 +77,27 @@ namespace Xmms
 			 */
 			Dict& operator=( const Dict& dict );
 
+#if __cplusplus >= 201103L
+			/** Constructs a Dict taking over the reference of another.
+			 *
+			 * @param dict Dict to be moved, it is left empty
+			 */
+			Dict( Dict&& dict ) : value_( dict.value_ )
+			{
+				dict.value_ = 0;
+			}
+
+			/** Moves an existing Dict to this Dict.
+			 *
+			 *  @param dict source Dict to be moved, it is left empty
+			 */
+			Dict& operator=( Dict&& dict )
+			{
+				std::swap( value_, dict.value_ );
+				return *this;
+			}
+#endif
+
 			/** Destructs this Dict and unrefs the value.
 			 */
 			virtual ~Dict();
@@ -129,6 +158,35 @@ namespace Xmms
 			 */
 			virtual Variant operator[]( const std::string& key ) const;
 
+			/** Gets an integer value without going through a Variant.
+			 *
+			 *  @param key Key to look for
+			 *
+			 *  @throw no_such_key_error Occurs when key can't be found.
+			 *  @throw wrong_type_error If the value is not an integer.
+			 */
+			int32_t getInt( const char* key ) const;
+
+			/** Gets a string value without copying it.
+			 *
+			 *  @param key Key to look for
+			 *
+			 *  @return The string, valid for as long as the dict is.
+			 *
+			 *  @throw no_such_key_error Occurs when key can't be found.
+			 *  @throw wrong_type_error If the value is not a string.
+			 */
+			const char* getCString( const char* key ) const;
+
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+			/** Like getCString(), as a std::string_view.
+			 */
+			std::string_view getStringView( const char* key ) const
+			{
+				return std::string_view( getCString( key ) );
+			}
+#endif
+
 			typedef boost::function< void( const std::string&,
 			                               const Variant& ) > ForEachFunc;
 
@@ -184,6 +242,30 @@ namespace Xmms
 			 */
 			PropDict& operator=( const PropDict& dict );
 
+#if __cplusplus >= 201103L
+			/** Constructs a PropDict taking over the references of
+			 *  another.
+			 *
+			 * @param dict PropDict to be moved, it is left empty
+			 */
+			PropDict( PropDict&& dict )
+				: Dict( std::move( dict ) ), propdict_( dict.propdict_ )
+			{
+				dict.propdict_ = 0;
+			}
+
+			/** Moves an existing PropDict to this PropDict.
+			 *
+			 *  @param dict source PropDict to be moved, it is left empty
+			 */
+			PropDict& operator=( PropDict&& dict )
+			{
+				Dict::operator=( std::move( dict ) );
+				std::swap( propdict_, dict.propdict_ );
+				return *this;
+			}
+#endif
+
 			/** Destructs this PropDict and unrefs the value.
 			 */
 			virtual ~PropDict();
@@ -250,6 +332,11 @@ namespace Xmms
 
 			bool equal( const const_iterator& rh ) const;
 
+			/** The key of the current pair, without building the
+			 *  pair. Valid for as long as the dict is.
+			 */
+			const char* key() const;
+
 		private:
 			bool valid() const;
 			void copy( const const_iterator& rh );
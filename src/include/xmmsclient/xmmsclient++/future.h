@@ -0,0 +1,384 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef XMMSCLIENTPP_FUTURE_H
+#define XMMSCLIENTPP_FUTURE_H
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsclient/xmmsclient++/result.h>
+#include <xmmsclient/xmmsclient++/exceptions.h>
+#include <xmmsclient/xmmsclient++/helpers.h>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/optional.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+#include <deque>
+
+#if defined( __cpp_impl_coroutine ) && defined( __has_include )
+#if __has_include( <coroutine> )
+#include <coroutine>
+#define XMMSCLIENTPP_HAVE_COROUTINE 1
+#endif
+#endif
+
+namespace Xmms
+{
+
+	/** @cond INTERNAL */
+	template< typename T >
+	struct FutureValue
+	{
+		boost::optional< T > value;
+
+		void set( T& val ) { value = val; }
+		T get() const { return *value; }
+	};
+
+	template<>
+	struct FutureValue< void >
+	{
+		void get() const {}
+	};
+
+	/** The state shared by the copies of a Future and the notifier
+	 *  of its result.
+	 */
+	template< typename T >
+	struct FutureState : public FutureValue< T >
+	{
+		typedef boost::function< void() > continuation_t;
+
+		FutureState( MainloopInterface*& ml )
+			: ml( ml ), ready( false ), failed( false )
+		{
+		}
+
+		~FutureState()
+		{
+			for( std::vector< xmmsc_result_t* >::iterator it = results.begin();
+			     it != results.end(); ++it ) {
+				xmmsc_result_unref( *it );
+			}
+		}
+
+		void addResult( xmmsc_result_t* res )
+		{
+			xmmsc_result_ref( res );
+			results.push_back( res );
+		}
+
+		void finish()
+		{
+			ready = true;
+
+			// a continuation may add another one, run them off a copy
+			std::deque< continuation_t > todo;
+			todo.swap( continuations );
+			for( typename std::deque< continuation_t >::iterator it = todo.begin();
+			     it != todo.end(); ++it ) {
+				(*it)();
+			}
+		}
+
+		void fail( const std::string& err )
+		{
+			if( ready ) {
+				return;
+			}
+			failed = true;
+			error = err;
+			finish();
+		}
+
+		/** Block on the results until the state is ready. */
+		void wait()
+		{
+			check( ml );
+			for( std::vector< xmmsc_result_t* >::iterator it = results.begin();
+			     !ready && it != results.end(); ++it ) {
+				xmmsc_result_wait( *it );
+			}
+			if( !ready ) {
+				fail( "Result was disconnected" );
+			}
+		}
+
+		MainloopInterface*& ml;
+		std::vector< xmmsc_result_t* > results;
+		bool ready;
+		bool failed;
+		std::string error;
+		std::deque< continuation_t > continuations;
+	};
+
+	template< typename T >
+	inline bool
+	futureSet( boost::shared_ptr< FutureState< T > > state, T& val )
+	{
+		if( !state->ready ) {
+			state->set( val );
+			state->finish();
+		}
+		return false;
+	}
+
+	inline bool
+	futureSetVoid( boost::shared_ptr< FutureState< void > > state )
+	{
+		if( !state->ready ) {
+			state->finish();
+		}
+		return false;
+	}
+
+	template< typename T >
+	inline bool
+	futureFail( boost::shared_ptr< FutureState< T > > state,
+	            const std::string& error )
+	{
+		state->fail( error );
+		return false;
+	}
+	/** @endcond INTERNAL */
+
+	/** @class Future future.h "xmmsclient/xmmsclient++/future.h"
+	 *  @brief The value a result will have once the server replied.
+	 *
+	 *  A Future is made from any of the result adapters returned by
+	 *  the Client members, before they are converted to a value. The
+	 *  call is sent right away, so making many futures keeps that many
+	 *  requests in flight. The value can then be collected with get(),
+	 *  which waits for the reply like the sync interface does, or with
+	 *  then() or co_await when a mainloop is running.
+	 *
+	 *  Copies of a Future share the same value.
+	 *
+	 *  @note Collections are not supported, use the CollResult sync
+	 *  interface or a callback for those.
+	 */
+	template< typename T >
+	class Future
+	{
+
+		public:
+
+			typedef FutureState< T > state_t;
+			typedef boost::function< void( const Future< T >& ) > callback_t;
+
+			/** Send the call of a result and track its reply.
+			 *
+			 *  @param res Result adapter of the call.
+			 */
+			Future( AdapterBase< T > res )
+				: state_( new state_t( res.ml_ ) )
+			{
+				state_->addResult( res.res_ );
+				connectTo( res );
+				res();
+			}
+
+			/** Check if the reply has arrived.
+			 */
+			bool ready() const
+			{
+				return state_->ready;
+			}
+
+			/** Wait for the reply and get its value.
+			 *
+			 *  @throw mainloop_running_error If the reply hasn't
+			 *  arrived and a mainloop is running, it can't be waited
+			 *  for then.
+			 *  @throw result_error If the call failed.
+			 */
+			T get() const
+			{
+				if( !state_->ready ) {
+					state_->wait();
+				}
+				if( state_->failed ) {
+					throw result_error( state_->error );
+				}
+				return state_->get();
+			}
+
+			/** Call a function once the reply has arrived, or right
+			 *  away if it already has.
+			 *
+			 *  @param func Function to call with the ready Future.
+			 */
+			void then( const callback_t& func ) const
+			{
+				if( state_->ready ) {
+					func( *this );
+				}
+				else {
+					state_->continuations.push_back( boost::bind( func, *this ) );
+				}
+			}
+
+#ifdef XMMSCLIENTPP_HAVE_COROUTINE
+			/** @cond INTERNAL */
+			bool await_ready() const
+			{
+				return state_->ready;
+			}
+
+			// Without a running mainloop nothing would resume the
+			// coroutine, so wait for the reply in place instead.
+			bool await_suspend( std::coroutine_handle<> handle ) const
+			{
+				if( !( state_->ml && state_->ml->isRunning() ) ) {
+					state_->wait();
+					return false;
+				}
+				state_->continuations.push_back( handle );
+				return true;
+			}
+
+			T await_resume() const
+			{
+				return get();
+			}
+			/** @endcond INTERNAL */
+#endif
+
+		/** @cond INTERNAL */
+		private:
+
+			template< typename U >
+			friend Future< std::vector< U > >
+			whenAll( const std::vector< Future< U > >& futures );
+
+			Future( const boost::shared_ptr< state_t >& state )
+				: state_( state )
+			{
+			}
+
+			void connectTo( AdapterBase< T >& res )
+			{
+				res.connect( boost::bind( &futureSet< T >, state_, _1 ) );
+				res.connectError( boost::bind( &futureFail< T >, state_, _1 ) );
+			}
+
+			boost::shared_ptr< state_t > state_;
+		/** @endcond INTERNAL */
+
+	};
+
+	/** @cond INTERNAL */
+	template<>
+	inline void
+	Future< void >::connectTo( AdapterBase< void >& res )
+	{
+		// VoidResult already waited for the reply, it threw if it failed
+		if( !( res.ml_ && res.ml_->isRunning() ) ) {
+			state_->finish();
+		}
+		res.connect( boost::bind( &futureSetVoid, state_ ) );
+		res.connectError( boost::bind( &futureFail< void >, state_, _1 ) );
+	}
+
+	/** The values collected so far by whenAll. */
+	template< typename T >
+	struct WhenAllValues
+	{
+		WhenAllValues( size_t size ) : values( size ), pending( size ) {}
+
+		std::vector< boost::optional< T > > values;
+		size_t pending;
+	};
+
+	template< typename T >
+	inline void
+	whenAllStep( boost::shared_ptr< FutureState< std::vector< T > > > state,
+	             boost::shared_ptr< WhenAllValues< T > > collected,
+	             size_t pos, const Future< T >& future )
+	{
+		if( state->ready ) {
+			return;
+		}
+
+		try {
+			collected->values[pos] = future.get();
+		}
+		catch( result_error& e ) {
+			state->fail( e.what() );
+			return;
+		}
+
+		if( --collected->pending == 0 ) {
+			std::vector< T > values;
+			values.reserve( collected->values.size() );
+			for( size_t i = 0; i < collected->values.size(); ++i ) {
+				values.push_back( *collected->values[i] );
+			}
+			state->value = values;
+			state->finish();
+		}
+	}
+	/** @endcond INTERNAL */
+
+	/** Combine futures into one for all their values.
+	 *
+	 *  The combined Future is ready once all of them are, or fails
+	 *  with the first error, so many medialib calls can be sent at
+	 *  once and collected together.
+	 *
+	 *  @param futures The futures to combine, all on one connection.
+	 *
+	 *  @return A Future of the values, in the same order.
+	 */
+	template< typename T >
+	inline Future< std::vector< T > >
+	whenAll( const std::vector< Future< T > >& futures )
+	{
+		typedef FutureState< std::vector< T > > state_t;
+
+		static MainloopInterface* no_ml = 0;
+		MainloopInterface*& ml = futures.empty() ? no_ml
+		                                         : futures.front().state_->ml;
+
+		boost::shared_ptr< state_t > state( new state_t( ml ) );
+		boost::shared_ptr< WhenAllValues< T > >
+			collected( new WhenAllValues< T >( futures.size() ) );
+
+		for( size_t i = 0; i < futures.size(); ++i ) {
+			const std::vector< xmmsc_result_t* >& res = futures[i].state_->results;
+			for( size_t j = 0; j < res.size(); ++j ) {
+				state->addResult( res[j] );
+			}
+		}
+
+		if( futures.empty() ) {
+			state->value = std::vector< T >();
+			state->finish();
+		}
+
+		for( size_t i = 0; i < futures.size(); ++i ) {
+			futures[i].then( boost::bind( &whenAllStep< T >, state, collected, i, _1 ) );
+		}
+
+		return Future< std::vector< T > >( state );
+	}
+
+}
+
+#endif // XMMSCLIENTPP_FUTURE_H
@@ -19,6 +19,7 @@
 
 #include <xmmsclient/xmmsclient.h>
 #include <boost/any.hpp>
+#include <boost/optional.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <xmmsclient/xmmsclient++/dict.h>
@@ -48,6 +49,19 @@ namespace Xmms
 		static int (*get_func)( const xmmsv_t*, const char** );
 	};
 
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+	/** Strings backed by the list itself, valid as long as the list. */
+	template<>
+	struct type_traits< std::string_view >
+	{
+		typedef const char* type;
+		static int get_func( const xmmsv_t* val, const char** r )
+		{
+			return xmmsv_get_string( val, r );
+		}
+	};
+#endif
+
 	template<>
 	struct type_traits< Dict >
 	{
@@ -90,6 +104,14 @@ namespace Xmms
 			List_const_iterator_();
 			List_const_iterator_( const List_const_iterator_& );
 			List_const_iterator_& operator=( const List_const_iterator_& );
+#if __cplusplus >= 201103L
+			List_const_iterator_( List_const_iterator_&& rh )
+				: list_( rh.list_ ), it_( rh.it_ )
+			{
+				rh.list_ = 0;
+				rh.it_ = 0;
+			}
+#endif
 			~List_const_iterator_();
 			const value_type& operator*() const;
 			const value_type* operator->() const;
@@ -109,12 +131,16 @@ namespace Xmms
 
 			xmmsv_t* list_;
 			xmmsv_list_iter_t* it_;
+
+			// the element last dereferenced
+			mutable boost::optional< value_type > value_;
 	};
 
 	/** @class List list.h "xmmsclient/xmmsclient++/list.h"
 	 *  @brief This class acts as a wrapper for list type values.
 	 *  This is actually a virtual class and is specialized with T being
 	 *  - std::string
+	 *  - std::string_view, with C++17
 	 *  - int
 	 *  - unsigned int
 	 *  - Dict
@@ -161,16 +187,45 @@ namespace Xmms
 			 */
 			List<T>& operator=( const List<T>& list )
 			{
+				xmmsv_ref( list.value_ );
+				if( value_ ) {
+					xmmsv_unref( value_ );
+				}
 				value_ = list.value_;
-				xmmsv_ref( value_ );
 				return *this;
 			}
 
+#if __cplusplus >= 201103L
+			/** Move-constructor, takes over the reference of list.
+			 */
+			List( List<T>&& list ) :
+				value_( list.value_ )
+			{
+				list.value_ = 0;
+			}
+
+			/** Move assignment operator.
+			 */
+			List<T>& operator=( List<T>&& list )
+			{
+				if( this != &list ) {
+					if( value_ ) {
+						xmmsv_unref( value_ );
+					}
+					value_ = list.value_;
+					list.value_ = 0;
+				}
+				return *this;
+			}
+#endif
+
 			/** Destructor.
 			 */
 			~List()
 			{
-				xmmsv_unref( value_ );
+				if( value_ ) {
+					xmmsv_unref( value_ );
+				}
 			}
 
 			const_iterator begin() const
@@ -274,9 +329,8 @@ namespace Xmms
 	const typename List_const_iterator_< T >::value_type&
 	List_const_iterator_<T>::operator*() const
 	{
-		static value_type value;
-		value = construct< T >( getElement() );
-		return value;
+		value_ = construct< T >( getElement() );
+		return *value_;
 	}
 
 	template< typename T >
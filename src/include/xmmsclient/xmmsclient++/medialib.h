@@ -190,6 +190,26 @@ namespace Xmms
 			 */  
 			PropDictResult getInfo( int id ) const;
 
+			/** Cache the information returned by getInfo for up to
+			 *  @c size entries, kept up to date with the changes the
+			 *  server broadcasts.
+			 *
+			 *  @param size Number of entries to cache, 0 disables the
+			 *              cache.
+			 *
+			 *  @throw connection_error If the client isn't connected.
+			 */
+			void setCacheSize( int size ) const;
+
+			/** Get the cached information about an entry.
+			 *
+			 *  @param id ID of the entry.
+			 *
+			 *  @throw connection_error If the client isn't connected.
+			 *  @throw no_such_key_error If the entry isn't cached.
+			 */
+			PropDict getCachedInfo( int id ) const;
+
 			/** Import all files recursively from the 
 			 *  directory passed as argument.
 			 *
@@ -29,6 +29,8 @@
 namespace Xmms
 {
 
+	template< typename T > class Future;
+
 	template< typename T >
 	class AdapterBase
 	{
@@ -45,13 +47,9 @@ namespace Xmms
 			}
 
 			AdapterBase( const AdapterBase& src )
-				: res_( src.res_ ), ml_( src.ml_ )
+				: res_( src.res_ ), ml_( src.ml_ ), sig_( 0 )
 			{
 				xmmsc_result_ref( res_ );
-
-				// Does not delete the signals if it's been added to the
-				// SignalHolder because operator() sets the sig_ to 0.
-				delete sig_;
 			}
 
 			AdapterBase&
@@ -118,6 +116,8 @@ namespace Xmms
 
 		protected:
 
+			template< typename U > friend class Future;
+
 			xmmsc_result_t* res_;
 			MainloopInterface*& ml_;
 			Signal< T >* sig_;
@@ -59,9 +59,13 @@ int xmmsc_io_out_handle (xmmsc_connection_t *c) XMMS_PUBLIC;
 int xmmsc_io_in_handle (xmmsc_connection_t *c) XMMS_PUBLIC;
 int xmmsc_io_fd_get (xmmsc_connection_t *c) XMMS_PUBLIC;
 
+void xmmsc_batch_begin (xmmsc_connection_t *c) XMMS_PUBLIC;
+void xmmsc_batch_commit (xmmsc_connection_t *c) XMMS_PUBLIC;
+
 char *xmmsc_get_last_error (xmmsc_connection_t *c) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_quit(xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_restart (xmmsc_connection_t *c) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_broadcast_quit (xmmsc_connection_t *c) XMMS_PUBLIC;
 
@@ -94,6 +98,7 @@ xmmsc_result_t *xmmsc_playlist_clear (xmmsc_connection_t *c, const char *playlis
 xmmsc_result_t *xmmsc_playlist_replace (xmmsc_connection_t *c, const char *playlist, xmmsv_t *coll, xmms_playlist_position_action_t action) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playlist_remove (xmmsc_connection_t *c, const char *playlist) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playlist_list_entries (xmmsc_connection_t *c, const char *playlist) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playlist_changes_since (xmmsc_connection_t *c, const char *playlist, int epoch, int version) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playlist_sort (xmmsc_connection_t *c, const char *playlist, xmmsv_t *properties) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playlist_set_next (xmmsc_connection_t *c, int32_t) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playlist_set_next_rel (xmmsc_connection_t *c, int32_t) XMMS_PUBLIC;
@@ -114,6 +119,7 @@ xmmsc_result_t *xmmsc_playlist_rinsert_encoded (xmmsc_connection_t *c, const cha
 
 /* broadcasts */
 xmmsc_result_t *xmmsc_broadcast_playlist_changed (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_playlist_changed_filtered (xmmsc_connection_t *c, xmmsv_t *playlists) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_playlist_current_pos (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_playlist_loaded (xmmsc_connection_t *c) XMMS_PUBLIC;
 
@@ -131,6 +137,12 @@ xmmsc_result_t *xmmsc_playback_current_id (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_seek_ms (xmmsc_connection_t *c, int milliseconds, xmms_playback_seek_mode_t whence) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_seek_samples (xmmsc_connection_t *c, int samples, xmms_playback_seek_mode_t whence) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_playtime (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_playtime_stamp (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_clock (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_start_at (xmmsc_connection_t *c, int64_t clock_us) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_drift_set (xmmsc_connection_t *c, int ppm) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_chain_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_playback_health (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_status (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_volume_set (xmmsc_connection_t *c, const char *channel, int volume) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_playback_volume_get (xmmsc_connection_t *c) XMMS_PUBLIC;
@@ -139,9 +151,14 @@ xmmsc_result_t *xmmsc_playback_volume_get (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_playback_volume_changed (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_playback_status (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_playback_current_id (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_playback_health (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_playback_volume_changed_throttled (xmmsc_connection_t *c, int interval) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_playback_status_throttled (xmmsc_connection_t *c, int interval) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_playback_current_id_throttled (xmmsc_connection_t *c, int interval) XMMS_PUBLIC;
 
 /* signals */
 xmmsc_result_t *xmmsc_signal_playback_playtime (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_signal_playback_playtime_throttled (xmmsc_connection_t *c, int interval) XMMS_PUBLIC;
 
 
 /*
@@ -166,6 +183,10 @@ xmmsc_result_t *xmmsc_broadcast_config_value_changed (xmmsc_connection_t *c) XMM
 xmmsc_result_t *xmmsc_main_list_plugins (xmmsc_connection_t *c, xmms_plugin_type_t type) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_main_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_main_trace_dump (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_main_memory_stats (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_ipc_metrics (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_ipc_metrics_text (xmmsc_connection_t *c) XMMS_PUBLIC;
 
 /* broadcasts */
 xmmsc_result_t *xmmsc_broadcast_mediainfo_reader_status (xmmsc_connection_t *c) XMMS_PUBLIC;
@@ -190,6 +211,7 @@ bool xmmsc_visualization_errored (xmmsc_connection_t *c, int vv) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_visualization_property_set (xmmsc_connection_t *c, int v, const char *key, const char *value) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_visualization_properties_set (xmmsc_connection_t *c, int v, xmmsv_t *props) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_visualization_stats (xmmsc_connection_t *c, int v) XMMS_PUBLIC;
 /*
  * drawtime: expected time needed to process the data in milliseconds after collecting it
     if >= 0, the data is returned as soon as currenttime >= (playtime - drawtime);
@@ -202,6 +224,15 @@ xmmsc_result_t *xmmsc_visualization_properties_set (xmmsc_connection_t *c, int v
  * Note: the size read can be less than expected (for example, on song end). Check it!
  */
 int xmmsc_visualization_chunk_get (xmmsc_connection_t *c, int vv, short *buffer, int drawtime, unsigned int blocking) XMMS_PUBLIC;
+/*
+ * Instead of chunk_get: chunk_pump moves what arrived into a ring kept
+ * by the library, chunk_get_at takes the chunk due at display time t
+ * (seconds, gettimeofday clock) out of it. Pumping and getting may be
+ * done from two threads. fd is -1 or can be polled before pumping.
+ */
+int xmmsc_visualization_chunk_pump (xmmsc_connection_t *c, int vv, unsigned int blocking) XMMS_PUBLIC;
+int xmmsc_visualization_chunk_get_at (xmmsc_connection_t *c, int vv, short *buffer, double t) XMMS_PUBLIC;
+int xmmsc_visualization_fd (xmmsc_connection_t *c, int vv) XMMS_PUBLIC;
 void xmmsc_visualization_shutdown (xmmsc_connection_t *c, int v) XMMS_PUBLIC;
 
 
@@ -214,22 +245,36 @@ xmmsc_result_t *xmmsc_medialib_add_entry (xmmsc_connection_t *conn, const char *
 xmmsc_result_t *xmmsc_medialib_add_entry_args (xmmsc_connection_t *conn, const char *url, int numargs, const char **args) XMMS_PUBLIC XMMS_DEPRECATED;
 xmmsc_result_t *xmmsc_medialib_add_entry_full (xmmsc_connection_t *conn, const char *url, xmmsv_t *args) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_add_entry_encoded (xmmsc_connection_t *conn, const char *url) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_add_entries (xmmsc_connection_t *conn, xmmsv_t *urls) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_get_info (xmmsc_connection_t *, int) XMMS_PUBLIC;
+void xmmsc_medialib_cache_set_size (xmmsc_connection_t *c, int size) XMMS_PUBLIC;
+xmmsv_t *xmmsc_medialib_cache_get (xmmsc_connection_t *c, int id) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_path_import (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC XMMS_DEPRECATED;
 xmmsc_result_t *xmmsc_medialib_path_import_encoded (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC XMMS_DEPRECATED;
 xmmsc_result_t *xmmsc_medialib_import_path (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_import_path_encoded (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_import_status (xmmsc_connection_t *conn) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_rehash_changed (xmmsc_connection_t *conn) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_import_cancel (xmmsc_connection_t *conn, int id) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_rehash (xmmsc_connection_t *conn, int id) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_get_id (xmmsc_connection_t *conn, const char *url) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_get_id_encoded (xmmsc_connection_t *conn, const char *url) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_remove_entry (xmmsc_connection_t *conn, int entry) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_move_entry (xmmsc_connection_t *conn, int entry, const char *url) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_index_stats (xmmsc_connection_t *conn) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_compact (xmmsc_connection_t *conn) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_dump (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_restore (xmmsc_connection_t *conn, const char *path) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_complete (xmmsc_connection_t *conn, const char *key, const char *prefix, int limit) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_medialib_entry_property_set_int (xmmsc_connection_t *c, int id, const char *key, int32_t value) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_entry_property_set_int_with_source (xmmsc_connection_t *c, int id, const char *source, const char *key, int32_t value) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_medialib_entry_property_set_str (xmmsc_connection_t *c, int id, const char *key, const char *value) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_entry_property_set_str_with_source (xmmsc_connection_t *c, int id, const char *source, const char *key, const char *value) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_entry_properties_set (xmmsc_connection_t *c, int id, xmmsv_t *properties) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_entry_properties_set_with_source (xmmsc_connection_t *c, int id, const char *source, xmmsv_t *properties) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_medialib_entries_property_set_with_source (xmmsc_connection_t *c, xmmsv_t *ids, const char *source, const char *key, xmmsv_t *value) XMMS_PUBLIC;
 
 xmmsc_result_t *xmmsc_medialib_entry_property_remove (xmmsc_connection_t *c, int id, const char *key) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_medialib_entry_property_remove_with_source (xmmsc_connection_t *c, int id, const char *source, const char *key) XMMS_PUBLIC;
@@ -243,12 +288,17 @@ xmmsc_result_t *xmmsc_bindata_add (xmmsc_connection_t *c, const unsigned char *d
 xmmsc_result_t *xmmsc_bindata_retrieve (xmmsc_connection_t *c, const char *hash) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_bindata_remove (xmmsc_connection_t *c, const char *hash) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_bindata_list (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_bindata_retrieve_scaled (xmmsc_connection_t *c, const char *hash, int size, const char *format) XMMS_PUBLIC;
 
 /* broadcasts */
 xmmsc_result_t *xmmsc_broadcast_medialib_entry_changed (xmmsc_connection_t *c) XMMS_PUBLIC  XMMS_DEPRECATED;
 xmmsc_result_t *xmmsc_broadcast_medialib_entry_updated (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_medialib_entry_added (xmmsc_connection_t *c) XMMS_PUBLIC;
 xmmsc_result_t *xmmsc_broadcast_medialib_entry_removed (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_medialib_entries_changed (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_medialib_import_progress (xmmsc_connection_t *c) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_medialib_entry_updated_filtered (xmmsc_connection_t *c, xmmsv_t *ids) XMMS_PUBLIC;
+xmmsc_result_t *xmmsc_broadcast_medialib_entries_changed_filtered (xmmsc_connection_t *c, xmmsv_t *ids) XMMS_PUBLIC;
 
 
 /*
@@ -267,6 +317,9 @@ xmmsc_result_t* xmmsc_coll_sync (xmmsc_connection_t *conn) XMMS_PUBLIC;
 xmmsc_result_t* xmmsc_coll_query_ids (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *order, int limit_start, int limit_len) XMMS_PUBLIC;
 xmmsc_result_t* xmmsc_coll_query_infos (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *order, int limit_start, int limit_len, xmmsv_t *fetch, xmmsv_t *group) XMMS_PUBLIC XMMS_DEPRECATED;
 xmmsc_result_t* xmmsc_coll_query (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_cursor_open (xmmsc_connection_t *conn, xmmsv_t *coll, xmmsv_t *fetch) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_cursor_next (xmmsc_connection_t *conn, int id, int count) XMMS_PUBLIC;
+xmmsc_result_t* xmmsc_coll_query_cursor_close (xmmsc_connection_t *conn, int id) XMMS_PUBLIC;
 
 /* string-to-collection parser */
 typedef enum {
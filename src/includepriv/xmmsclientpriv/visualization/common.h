@@ -6,9 +6,19 @@
 #ifndef __VISUALIZATIONCLIENT_COMMON_H__
 #define __VISUALIZATIONCLIENT_COMMON_H__
 
+/* Chunks kept for xmmsc_visualization_chunk_get_at, a power of two */
+#define XMMSC_VIS_RING_SIZE 64
+
+typedef struct {
+	double timestamp;
+	int size;
+	short data[2 * XMMSC_VISUALIZATION_WINDOW_SIZE];
+} xmmsc_vis_slot_t;
+
 struct xmmsc_visualization_St {
 	union {
 		xmmsc_vis_unixshm_t shm;
+		xmmsc_vis_shmring_t ring;
 		xmmsc_vis_udp_t udp;
 	} transport;
 	xmmsc_vis_transport_t type;
@@ -17,6 +27,12 @@ struct xmmsc_visualization_St {
 	int32_t id;
 	/** client side array index */
 	int idx;
+	/** play time of the chunk read last */
+	double timestamp;
+	/** chunks moved by xmmsc_visualization_chunk_pump, wr is only
+	    moved by the pumping thread and rd only by the one getting */
+	xmmsc_vis_slot_t *ring;
+	volatile unsigned int ring_wr, ring_rd;
 };
 
 xmmsc_visualization_t *get_dataset(xmmsc_connection_t *c, int vv);
@@ -28,6 +44,10 @@ xmmsc_result_t *setup_shm_prepare (xmmsc_connection_t *c, int32_t vv);
 bool setup_shm_handle (xmmsc_result_t *res);
 void cleanup_shm (xmmsc_vis_unixshm_t *t);
 int read_do_shm (xmmsc_vis_unixshm_t *t, xmmsc_visualization_t *v, short *buffer, int drawtime, unsigned int blocking);
+xmmsc_result_t *setup_shmring_prepare (xmmsc_connection_t *c, int32_t vv);
+bool setup_shmring_handle (xmmsc_result_t *res);
+void cleanup_shmring (xmmsc_vis_shmring_t *t);
+int read_do_shmring (xmmsc_vis_shmring_t *t, xmmsc_visualization_t *v, short *buffer, int drawtime, unsigned int blocking);
 
 /* provided by udp.c */
 xmmsc_result_t *setup_udp_prepare (xmmsc_connection_t *c, int32_t vv);
@@ -36,6 +36,7 @@
 
 typedef struct xmmsc_sc_interface_entity_St xmmsc_sc_interface_entity_t;
 typedef struct xmmsc_visualization_St xmmsc_visualization_t;
+typedef struct xmmsc_medialib_cache_St xmmsc_medialib_cache_t;
 
 /**
  * @typedef xmmsc_connection_t
@@ -61,9 +62,15 @@ struct xmmsc_connection_St {
 	/* this client's id, assigned by the server */
 	int64_t id;
 
+	/* the server said hello, so it reads the compact encoding */
+	bool compact;
+
 	/* anonymous root namespace */
 	xmmsc_sc_interface_entity_t *sc_root;
 
+	/* medialib entries, NULL unless enabled */
+	xmmsc_medialib_cache_t *mlib_cache;
+
 	/* we need to hold the connection path to get the hostname */
 	char path[XMMS_PATH_MAX];
 };
@@ -81,7 +88,10 @@ xmmsc_result_t *xmmsc_send_msg_no_arg (xmmsc_connection_t *c, int object, int cm
 xmmsc_result_t *xmmsc_send_msg (xmmsc_connection_t *c, xmms_ipc_msg_t *msg);
 xmmsc_result_t *xmmsc_send_msg_flush (xmmsc_connection_t *c, xmms_ipc_msg_t *msg);
 xmmsc_result_t *xmmsc_send_broadcast_msg (xmmsc_connection_t *c, int signalid);
+xmmsc_result_t *xmmsc_send_broadcast_filtered_msg (xmmsc_connection_t *c, int signalid, xmmsv_t *filter);
+xmmsc_result_t *xmmsc_send_broadcast_throttled_msg (xmmsc_connection_t *c, int signalid, xmmsv_t *filter, int interval);
 xmmsc_result_t *xmmsc_send_signal_msg (xmmsc_connection_t *c, int signalid);
+xmmsc_result_t *xmmsc_send_signal_throttled_msg (xmmsc_connection_t *c, int signalid, int interval);
 uint32_t xmmsc_write_signal_msg (xmmsc_connection_t *c, int signalid);
 char *_xmmsc_medialib_encode_url_old (const char *url, int narg, const char **args);
 int _xmmsc_medialib_verify_url (const char *url);
@@ -95,5 +105,8 @@ xmmsc_connection_t *xmmsc_result_get_connection (xmmsc_result_t *res);
 
 void xmmsc_sc_interface_entity_destroy (xmmsc_sc_interface_entity_t *ifent);
 
+void xmmsc_medialib_cache_destroy (xmmsc_medialib_cache_t *cache);
+void xmmsc_medialib_cache_fill (xmmsc_connection_t *c, xmmsc_result_t *res, int id);
+
 #endif
 
@@ -21,6 +21,7 @@
 #include <xmmsc/xmmsc_stdbool.h>
 //#include <sys/time.h> Should this be in or out?
 #include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_ipc_shm.h>
 #include <xmmsc/xmmsc_stdint.h>
 #include <xmmsc/xmmsc_sockets.h>
 #include <xmmsclient/xmmsclient.h>
@@ -50,6 +51,7 @@ xmms_socket_t xmmsc_ipc_fd_get (xmmsc_ipc_t *ipc);
 void xmmsc_ipc_result_register (xmmsc_ipc_t *ipc, xmmsc_result_t *res);
 xmmsc_result_t *xmmsc_ipc_result_lookup (xmmsc_ipc_t *ipc, uint32_t cookie);
 void xmmsc_ipc_result_unregister (xmmsc_ipc_t *ipc, xmmsc_result_t *res);
+void xmmsc_ipc_result_rekey (xmmsc_ipc_t *ipc, xmmsc_result_t *res, uint32_t old_cookie);
 void xmmsc_ipc_wait_for_event (xmmsc_ipc_t *ipc, unsigned int timeout);
 
 /* FIXME: The proper place would be in a new header
@@ -59,6 +61,10 @@ void xmmsc_result_clear_weakrefs (xmmsc_result_t *result);
 int xmmsc_ipc_io_out (xmmsc_ipc_t *ipc);
 int xmmsc_ipc_io_out_callback (xmmsc_ipc_t *ipc);
 int xmmsc_ipc_io_in_callback (xmmsc_ipc_t *ipc);
+void xmmsc_ipc_batch_begin (xmmsc_ipc_t *ipc);
+void xmmsc_ipc_batch_end (xmmsc_ipc_t *ipc);
+bool xmmsc_ipc_is_local (xmmsc_ipc_t *ipc);
+void xmmsc_ipc_shm_set (xmmsc_ipc_t *ipc, xmms_ipc_shm_t *shm);
 
 #ifdef __cplusplus
 }
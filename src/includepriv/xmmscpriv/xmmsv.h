@@ -51,13 +51,45 @@ struct xmmsv_St {
 	} value;
 	xmmsv_type_t type;
 
-	int ref;  /* refcounting */
+	int ref;  /* refcounting, atomic */
+	bool frozen; /* see xmmsv_freeze */
+	bool arena; /* allocated by _xmmsv_arena_alloc */
+	unsigned char serialized; /* see xmmsv_new_serialized */
 };
 
+/* The encoding of the bytes of a value from xmmsv_new_serialized */
+#define XMMSV_SERIALIZED_PLAIN 1
+#define XMMSV_SERIALIZED_COMPACT 2
+
+/* Guards the few pieces of shared state: the iterators of frozen lists
+ * and dicts, which are registered from any thread, and the key intern
+ * table. They are only ever held for a short list or table operation. */
+static inline void
+_xmmsv_spin_lock (char *lock)
+{
+	while (__atomic_test_and_set (lock, __ATOMIC_ACQUIRE)) {
+		/* spin, the lock is only held for a list operation */
+	}
+}
+
+static inline void
+_xmmsv_spin_unlock (char *lock)
+{
+	__atomic_clear (lock, __ATOMIC_RELEASE);
+}
+
 xmmsv_t *_xmmsv_new (xmmsv_type_t type);
 
+void *_xmmsv_arena_alloc (size_t size);
+void _xmmsv_arena_free (void *ptr);
+
 void _xmmsv_list_free (xmmsv_list_internal_t *dict);
 void _xmmsv_dict_free (xmmsv_dict_internal_t *dict);
 void _xmmsv_coll_free (xmmsv_coll_internal_t *coll);
 
+void _xmmsv_list_freeze (xmmsv_list_internal_t *list);
+xmmsv_t *_xmmsv_list_copy_packed (xmmsv_t *list);
+void _xmmsv_dict_freeze (xmmsv_dict_internal_t *dict);
+void _xmmsv_coll_freeze (xmmsv_coll_internal_t *coll);
+
 #endif
@@ -20,5 +20,6 @@
 typedef struct xmms_bindata_St xmms_bindata_t;
 
 xmms_bindata_t *xmms_bindata_init (void);
+gsize xmms_bindata_memory_size (xmms_bindata_t *bindata);
 
 #endif
@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_BROWSECACHE_H__
+#define __XMMS_BROWSECACHE_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+typedef struct xmms_browse_cache_St xmms_browse_cache_t;
+
+xmms_browse_cache_t *xmms_browse_cache_new (guint max_entries, gint64 ttl);
+void xmms_browse_cache_free (xmms_browse_cache_t *cache);
+void xmms_browse_cache_configure (xmms_browse_cache_t *cache, guint max_entries, gint64 ttl);
+
+gchar *xmms_browse_cache_key (const gchar *url);
+xmmsv_t *xmms_browse_cache_lookup (xmms_browse_cache_t *cache, const gchar *key);
+void xmms_browse_cache_insert (xmms_browse_cache_t *cache, const gchar *key, xmmsv_t *list);
+void xmms_browse_cache_invalidate (xmms_browse_cache_t *cache, const gchar *key, gboolean parent);
+void xmms_browse_cache_clear (xmms_browse_cache_t *cache);
+
+void xmms_browse_cache_stats (xmms_browse_cache_t *cache, guint *hits, guint *misses, guint *entries);
+
+#endif
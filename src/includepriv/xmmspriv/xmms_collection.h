@@ -66,6 +66,9 @@ xmmsv_t * xmms_collection_get_pointer (xmms_coll_dag_t *dag, const gchar *collna
 void xmms_collection_update_pointer (xmms_coll_dag_t *dag, const gchar *name, xmms_collection_namespace_id_t nsid, xmmsv_t *newtarget);
 gchar * xmms_collection_find_alias (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, xmmsv_t *value, const gchar *key);
 xmms_medialib_entry_t xmms_collection_get_random_media (xmms_coll_dag_t *dag, xmmsv_t *source);
+guint xmms_collection_get_random_media_n (xmms_coll_dag_t *dag, xmmsv_t *source, guint n, xmms_medialib_entry_t *out);
+void xmms_collection_query_cache_stats (xmms_coll_dag_t *dag, guint *hits, guint *misses, guint *entries);
+gsize xmms_collection_memory_size (xmms_coll_dag_t *dag);
 
 xmms_collection_namespace_id_t xmms_collection_get_namespace_id (const gchar *namespace);
 const gchar *xmms_collection_get_namespace_string (xmms_collection_namespace_id_t nsid);
@@ -29,5 +29,6 @@ void xmms_config_init (const gchar *filename);
 void xmms_config_shutdown (void);
 
 gboolean xmms_config_save (void);
+void xmms_config_detach (void);
 
 #endif
@@ -24,7 +24,14 @@
 typedef struct xmms_sample_converter_St xmms_sample_converter_t;
 typedef guint (*xmms_sample_conv_func_t) (xmms_sample_converter_t *, xmms_sample_t *, guint , xmms_sample_t *);
 
-xmms_sample_converter_t *xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to);
+/** Trade-off between CPU use and aliasing when resampling */
+typedef enum {
+	XMMS_SAMPLE_RESAMPLE_FAST,
+	XMMS_SAMPLE_RESAMPLE_MEDIUM,
+	XMMS_SAMPLE_RESAMPLE_BEST
+} xmms_sample_resample_quality_t;
+
+xmms_sample_converter_t *xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to, xmms_sample_resample_quality_t quality);
 
 gint64 xmms_sample_convert_scale (xmms_sample_converter_t *conv, gint64 samples);
 gint64 xmms_sample_convert_rev_scale (xmms_sample_converter_t *conv, gint64 samples);
@@ -36,6 +43,7 @@ void xmms_sample_convert_reset (xmms_sample_converter_t *conv);
 xmms_sample_converter_t *xmms_sample_audioformats_coerce (xmms_stream_type_t *in, const GList *goal_types);
 xmms_stream_type_t *xmms_sample_converter_get_from (xmms_sample_converter_t *conv);
 xmms_stream_type_t *xmms_sample_converter_get_to (xmms_sample_converter_t *conv);
+gboolean xmms_sample_converter_is_identity (xmms_sample_converter_t *conv);
 void xmms_sample_converter_to_medialib (xmms_sample_converter_t *conv, xmms_medialib_entry_t entry);
 
 #endif
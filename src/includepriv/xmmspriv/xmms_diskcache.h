@@ -0,0 +1,26 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_DISKCACHE_H__
+#define __XMMS_DISKCACHE_H__
+
+#include <glib.h>
+
+gboolean xmms_diskcache_wanted (const gchar *transport);
+void xmms_diskcache_stats (guint *hits, guint *misses, guint *entries, gint64 *bytes);
+
+#endif
@@ -0,0 +1,42 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_PRIV_FOOTPRINT_H__
+#define __XMMS_PRIV_FOOTPRINT_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+/** What the small footprint mode puts a bound on */
+typedef enum {
+	/** Bytes of the output ring buffer */
+	XMMS_FOOTPRINT_RINGBUFFER,
+	/** Bytes an xform buffer grows to before it stops doubling */
+	XMMS_FOOTPRINT_XFORM_BUFFER,
+	/** Bytes queued for one client before broadcasts are merged or dropped */
+	XMMS_FOOTPRINT_IPC_QUEUE,
+	/** Entries in one query result */
+	XMMS_FOOTPRINT_QUERY_RESULTS,
+	XMMS_FOOTPRINT_NUM_LIMITS
+} xmms_footprint_limit_t;
+
+void xmms_footprint_init (void);
+gboolean xmms_footprint_enabled (void);
+gint xmms_footprint_limit (xmms_footprint_limit_t limit);
+void xmms_footprint_trim (void);
+xmmsv_t *xmms_footprint_get (void);
+
+#endif
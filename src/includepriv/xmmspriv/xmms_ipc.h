@@ -6,10 +6,16 @@
 
 typedef struct xmms_ipc_St xmms_ipc_t;
 
+/* The first protocol version reading the compact encoding, clients
+ * with the version before it are still accepted */
+#define XMMS_IPC_PROTOCOL_VERSION_COMPACT 29
+
 xmms_ipc_t *xmms_ipc_init (void);
 void xmms_ipc_shutdown (void);
 void on_config_ipcsocket_change (xmms_object_t *object, xmmsv_t *data, gpointer udata);
 gboolean xmms_ipc_setup_server (const gchar *path);
+void xmms_ipc_inherit (gchar **sockets);
+gchar **xmms_ipc_handoff (GArray *keep);
 
 typedef struct xmms_ipc_manager_St xmms_ipc_manager_t;
 xmms_ipc_manager_t *xmms_ipc_manager_get (void);
@@ -17,6 +23,8 @@ xmms_ipc_manager_t *xmms_ipc_manager_get (void);
 gboolean xmms_ipc_has_pending (guint signalid);
 void xmms_ipc_send_message (gint cli, xmms_ipc_msg_t *msg, xmms_error_t *err);
 void xmms_ipc_send_broadcast (guint broadcastid, gint cli, xmmsv_t *arg, xmms_error_t *err);
+void xmms_ipc_client_shm_attach (gint cli, gint shmid, gint size, xmms_error_t *err);
+void xmms_ipc_client_protocol_set (gint cli, gint version);
 GList *xmms_ipc_get_connected_clients (void);
 
 #endif
@@ -0,0 +1,41 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_LRU_H__
+#define __XMMS_LRU_H__
+
+#include <glib.h>
+
+typedef struct xmms_lru_St xmms_lru_t;
+
+xmms_lru_t *xmms_lru_new (GHashFunc hash_func, GEqualFunc key_equal_func, GDestroyNotify key_free, GDestroyNotify value_free, guint max_entries);
+void xmms_lru_free (xmms_lru_t *lru);
+void xmms_lru_set_max_entries (xmms_lru_t *lru, guint max_entries);
+guint xmms_lru_get_max_entries (xmms_lru_t *lru);
+
+gpointer xmms_lru_lookup (xmms_lru_t *lru, gconstpointer key);
+gboolean xmms_lru_contains (xmms_lru_t *lru, gconstpointer key);
+void xmms_lru_insert (xmms_lru_t *lru, gpointer key, gpointer value);
+void xmms_lru_remove (xmms_lru_t *lru, gconstpointer key);
+gpointer xmms_lru_steal (xmms_lru_t *lru, gconstpointer key);
+guint xmms_lru_foreach_remove (xmms_lru_t *lru, GHRFunc func, gpointer user_data);
+void xmms_lru_remove_all (xmms_lru_t *lru);
+
+void xmms_lru_account (xmms_lru_t *lru, gboolean hit);
+void xmms_lru_stats (xmms_lru_t *lru, guint *hits, guint *misses, guint *entries);
+
+#endif
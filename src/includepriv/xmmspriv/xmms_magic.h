@@ -0,0 +1,31 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_MAGIC_H__
+#define __XMMS_MAGIC_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+const gchar *xmms_magic_match_data (const guchar *data, guint len);
+guint xmms_magic_prefix_size (void);
+
+void xmms_magic_capture (xmmsv_t *list);
+void xmms_magic_mute (gboolean mute);
+void xmms_magic_replay (xmmsv_t *list);
+
+#endif
@@ -24,20 +24,46 @@
 
 typedef struct xmms_medialib_St xmms_medialib_t;
 typedef struct xmms_medialib_session_St xmms_medialib_session_t;
+typedef struct xmms_medialib_event_queue_St xmms_medialib_event_queue_t;
+typedef struct xmms_medialib_plan_St xmms_medialib_plan_t;
+typedef struct xmms_medialib_importer_St xmms_medialib_importer_t;
+
+typedef enum {
+	XMMS_MEDIALIB_IMPORT_FAILED,
+	XMMS_MEDIALIB_IMPORT_ADDED,
+	XMMS_MEDIALIB_IMPORT_CHANGED,
+	XMMS_MEDIALIB_IMPORT_UNCHANGED
+} xmms_medialib_import_result_t;
 
 #include <xmmspriv/xmms_collection.h>
 #include <xmmspriv/xmms_fetch_info.h>
 #include <xmmspriv/xmms_fetch_spec.h>
+#include <xmmspriv/xmms_plancache.h>
+#include <xmmspriv/xmms_tokenindex.h>
 #include <s4.h>
 
 xmms_medialib_t *xmms_medialib_init (void);
 s4_t *xmms_medialib_get_database_backend (xmms_medialib_t *medialib);
 s4_sourcepref_t *xmms_medialib_get_source_preferences (xmms_medialib_t *medialib);
+xmms_medialib_event_queue_t *xmms_medialib_get_event_queue (xmms_medialib_t *medialib);
+guint xmms_medialib_generation_get (xmms_medialib_t *medialib);
+void xmms_medialib_generation_bump (xmms_medialib_t *medialib);
+void xmms_medialib_conflict_count (xmms_medialib_t *medialib, gboolean readonly);
+void xmms_medialib_conflict_stats (xmms_medialib_t *medialib, guint *ro_conflicts, guint *rw_conflicts);
+void xmms_medialib_warmup_stats (xmms_medialib_t *medialib, gint64 *done, gint64 *size);
+void xmms_medialib_index_track_filter (xmms_medialib_t *medialib, const gchar *key);
+xmms_plan_cache_t *xmms_medialib_get_plan_cache (xmms_medialib_t *medialib);
+guint xmms_medialib_get_query_threads (xmms_medialib_t *medialib);
+gboolean xmms_medialib_is_indexed (xmms_medialib_t *medialib, const gchar *key);
+xmms_token_index_t *xmms_medialib_get_token_index (xmms_medialib_t *medialib);
+gint32 xmms_medialib_highest_id (xmms_medialib_session_t *s);
 char *xmms_medialib_uuid (xmms_medialib_t *mlib);
 s4_resultset_t *xmms_medialib_session_query (xmms_medialib_session_t *s, s4_fetchspec_t *spec, s4_condition_t *cond);
 
 guint xmms_medialib_num_not_resolved (xmms_medialib_session_t *s);
 xmms_medialib_entry_t xmms_medialib_entry_not_resolved_get (xmms_medialib_session_t *s);
+guint xmms_medialib_entry_not_resolved_get_many (xmms_medialib_session_t *s, xmms_medialib_entry_t *entries, guint max);
+void xmms_medialib_pending_update (xmms_medialib_t *medialib, GHashTable *statuses, GHashTable *removed);
 
 xmms_medialib_entry_t xmms_medialib_entry_new (xmms_medialib_session_t *s, const char *url, xmms_error_t *error);
 xmms_medialib_entry_t xmms_medialib_entry_new_encoded (xmms_medialib_session_t *s, const char *url, xmms_error_t *error);
@@ -58,8 +84,20 @@ gchar *xmms_medialib_url_encode (const gchar *path);
 gboolean xmms_medialib_decode_url (char *url);
 
 gboolean xmms_medialib_check_id (xmms_medialib_session_t *s, xmms_medialib_entry_t entry);
+GArray *xmms_medialib_entries_with_status (xmms_medialib_session_t *s, xmms_medialib_entry_status_t status);
 
 xmmsv_t *xmms_medialib_add_recursive (xmms_medialib_t *medialib, const gchar *path, xmms_error_t *error);
+xmms_medialib_import_result_t xmms_medialib_entry_import (xmms_medialib_session_t *s, const gchar *url, gint size, gint lmod, xmms_error_t *error);
+
+xmms_medialib_importer_t *xmms_medialib_importer_new (xmms_medialib_t *medialib);
+void xmms_medialib_importer_free (xmms_medialib_importer_t *importer);
+gint32 xmms_medialib_importer_start (xmms_medialib_importer_t *importer, const gchar *path, xmms_error_t *error);
+gint32 xmms_medialib_importer_rehash (xmms_medialib_importer_t *importer, xmms_error_t *error);
+xmmsv_t *xmms_medialib_importer_status (xmms_medialib_importer_t *importer);
+gboolean xmms_medialib_importer_cancel (xmms_medialib_importer_t *importer, gint32 id);
+
+gint32 xmms_medialib_dump (xmms_medialib_t *medialib, const gchar *path, xmms_error_t *err);
+gint32 xmms_medialib_restore (xmms_medialib_t *medialib, const gchar *path, xmms_error_t *err);
 
 xmms_medialib_entry_t xmms_medialib_query_random_id (xmms_medialib_session_t *s, xmmsv_t *coll);
 
@@ -67,6 +105,11 @@ xmmsv_t *xmms_medialib_query (xmms_medialib_session_t *s, xmmsv_t *coll, xmmsv_t
 s4_resultset_t *xmms_medialib_query_recurs (xmms_medialib_session_t *session, xmmsv_t *coll, xmms_fetch_info_t *fetch);
 xmmsv_t *xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec);
 
+xmms_medialib_plan_t *xmms_medialib_plan_new (xmms_medialib_session_t *s, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
+void xmms_medialib_plan_free (xmms_medialib_plan_t *plan);
+gboolean xmms_medialib_plan_get_generation (xmms_medialib_plan_t *plan, guint *generation);
+xmmsv_t *xmms_medialib_plan_run (xmms_medialib_session_t *s, xmms_medialib_plan_t *plan);
+
 
 xmms_medialib_session_t *xmms_medialib_session_begin (xmms_medialib_t *mlib);
 xmms_medialib_session_t *xmms_medialib_session_begin_ro (xmms_medialib_t *medialib);
@@ -75,6 +118,16 @@ gboolean xmms_medialib_session_commit (xmms_medialib_session_t *session);
 s4_resultset_t *xmms_medialib_session_query (xmms_medialib_session_t *session, s4_fetchspec_t *specification, s4_condition_t *condition);
 s4_sourcepref_t *xmms_medialib_session_get_source_preferences (xmms_medialib_session_t *session);
 void xmms_medialib_session_track_garbage (xmms_medialib_session_t *session, xmmsv_t *data);
+void xmms_medialib_session_track_filter (xmms_medialib_session_t *session, const gchar *key);
+gboolean xmms_medialib_session_get_generation (xmms_medialib_session_t *session, guint *generation);
+xmms_plan_cache_t *xmms_medialib_session_get_plan_cache (xmms_medialib_session_t *session);
+xmms_medialib_t *xmms_medialib_session_get_medialib (xmms_medialib_session_t *session);
+GHashTable *xmms_medialib_session_get_entry_cache (xmms_medialib_session_t *session, xmms_medialib_entry_t entry);
+void xmms_medialib_session_set_entry_cache (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, GHashTable *properties);
+
+xmms_medialib_event_queue_t *xmms_medialib_event_queue_new (xmms_medialib_t *medialib);
+void xmms_medialib_event_queue_free (xmms_medialib_event_queue_t *queue);
+void xmms_medialib_event_queue_flush (xmms_medialib_event_queue_t *queue);
 gint xmms_medialib_session_property_set (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gchar *key, const s4_val_t *value, const gchar *source);
 gint xmms_medialib_session_property_unset (xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gchar *key, const s4_val_t *value, const gchar *source);
 
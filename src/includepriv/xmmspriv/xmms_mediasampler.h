@@ -0,0 +1,41 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_MEDIASAMPLER_H__
+#define __XMMS_MEDIASAMPLER_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+#include <xmms/xmms_medialib.h>
+
+typedef struct xmms_media_sampler_St xmms_media_sampler_t;
+
+xmms_media_sampler_t *xmms_media_sampler_new (guint max_sets);
+void xmms_media_sampler_free (xmms_media_sampler_t *sampler);
+void xmms_media_sampler_clear (xmms_media_sampler_t *sampler);
+
+gboolean xmms_media_sampler_lookup (xmms_media_sampler_t *sampler, GBytes *key);
+void xmms_media_sampler_insert (xmms_media_sampler_t *sampler, GBytes *key, xmmsv_t *ids);
+xmmsv_t *xmms_media_sampler_pending_take (xmms_media_sampler_t *sampler, GBytes *key);
+void xmms_media_sampler_update (xmms_media_sampler_t *sampler, GBytes *key, xmmsv_t *checked, xmmsv_t *members);
+xmmsv_t *xmms_media_sampler_members_get (xmms_media_sampler_t *sampler, GBytes *key);
+guint xmms_media_sampler_sample (xmms_media_sampler_t *sampler, GBytes *key, guint n, xmms_medialib_entry_t *out);
+
+void xmms_media_sampler_entry_changed (xmms_media_sampler_t *sampler, xmms_medialib_entry_t entry);
+void xmms_media_sampler_entry_removed (xmms_media_sampler_t *sampler, xmms_medialib_entry_t entry);
+
+#endif
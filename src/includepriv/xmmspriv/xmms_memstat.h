@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_PRIV_MEMSTAT_H__
+#define __XMMS_PRIV_MEMSTAT_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+/** What the accounted memory is used for */
+typedef enum {
+	XMMS_MEMSTAT_MEDIALIB_RESULTS,
+	XMMS_MEMSTAT_IPC_QUEUES,
+	XMMS_MEMSTAT_XFORM_BUFFERS,
+	XMMS_MEMSTAT_RINGBUFFERS,
+	XMMS_MEMSTAT_NUM_TAGS
+} xmms_memstat_tag_t;
+
+void xmms_memstat_add (xmms_memstat_tag_t tag, gssize delta);
+#define xmms_memstat_sub(tag, size) xmms_memstat_add ((tag), -(gssize) (size))
+
+gsize xmms_memstat_value_size (xmmsv_t *value);
+xmmsv_t *xmms_memstat_get (void);
+
+#endif
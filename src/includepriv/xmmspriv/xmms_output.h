@@ -37,6 +37,13 @@ void xmms_output_flush (xmms_output_t *output);
  *                              from the latest xform in the chain will actually be played
   */
 guint32 xmms_output_latency (xmms_output_t *output);
+void xmms_output_realtime_thread_enter (void);
+guint xmms_output_filler_block_get (xmms_output_t *output);
+void xmms_output_buffer_stats_get (xmms_output_t *output, guint *size, guint *fill, guint *fill_min, guint *fill_avg);
+guint xmms_output_underruns_get (xmms_output_t *output);
+xmmsv_t *xmms_output_health_get (xmms_output_t *output);
+void xmms_output_resume_point_get (xmms_output_t *output, gint *status, guint *ms);
+void xmms_output_resume (xmms_output_t *output, gint status, guint ms);
 
 gboolean xmms_output_plugin_switch (xmms_output_t *output, xmms_output_plugin_t *new_plugin);
 
@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_PLANCACHE_H__
+#define __XMMS_PLANCACHE_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+/** Generation of plans that hold nothing read from the medialib */
+#define XMMS_PLAN_CACHE_STATIC G_MAXUINT
+
+typedef struct xmms_plan_cache_St xmms_plan_cache_t;
+
+xmms_plan_cache_t *xmms_plan_cache_new (guint max_entries, GDestroyNotify plan_free);
+void xmms_plan_cache_free (xmms_plan_cache_t *cache);
+void xmms_plan_cache_set_max_entries (xmms_plan_cache_t *cache, guint max_entries);
+
+GBytes *xmms_plan_cache_key (xmmsv_t *coll, xmmsv_t *fetch);
+gpointer xmms_plan_cache_take (xmms_plan_cache_t *cache, GBytes *key, guint generation);
+void xmms_plan_cache_put (xmms_plan_cache_t *cache, GBytes *key, guint generation, gpointer plan);
+
+void xmms_plan_cache_stats (xmms_plan_cache_t *cache, guint *hits, guint *misses, guint *entries);
+
+#endif
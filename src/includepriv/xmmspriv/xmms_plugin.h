@@ -49,6 +49,8 @@ typedef gboolean (*xmms_plugin_foreach_func_t)(xmms_plugin_t *, gpointer);
 void xmms_plugin_foreach (xmms_plugin_type_t type, xmms_plugin_foreach_func_t func, gpointer user_data);
 
 xmms_plugin_t *xmms_plugin_find (xmms_plugin_type_t type, const gchar *name);
+void xmms_plugin_load_deferred (const gchar *mime, const gchar *shortname);
+void xmms_plugin_stats_get (guint *loaded, guint *deferred);
 
 xmms_plugin_type_t xmms_plugin_type_get (const xmms_plugin_t *plugin);
 const char *xmms_plugin_name_get (const xmms_plugin_t *plugin);
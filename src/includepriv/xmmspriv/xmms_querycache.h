@@ -0,0 +1,37 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_QUERYCACHE_H__
+#define __XMMS_QUERYCACHE_H__
+
+#include <glib.h>
+#include <xmmsc/xmmsv.h>
+
+typedef struct xmms_query_cache_St xmms_query_cache_t;
+
+xmms_query_cache_t *xmms_query_cache_new (guint max_entries);
+void xmms_query_cache_free (xmms_query_cache_t *cache);
+void xmms_query_cache_set_max_entries (xmms_query_cache_t *cache, guint max_entries);
+
+GBytes *xmms_query_cache_key (xmmsv_t *coll, xmmsv_t *fetch);
+xmmsv_t *xmms_query_cache_lookup (xmms_query_cache_t *cache, GBytes *key, guint generation);
+void xmms_query_cache_insert (xmms_query_cache_t *cache, GBytes *key, guint generation, xmmsv_t *result);
+void xmms_query_cache_clear (xmms_query_cache_t *cache);
+
+void xmms_query_cache_stats (xmms_query_cache_t *cache, guint *hits, guint *misses, guint *entries);
+
+#endif
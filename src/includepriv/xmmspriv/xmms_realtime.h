@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_REALTIME_H__
+#define __XMMS_REALTIME_H__
+
+#include <glib.h>
+
+gboolean xmms_realtime_thread_enable (gint priority);
+gboolean xmms_realtime_thread_background (void);
+gboolean xmms_realtime_mem_lock (gconstpointer mem, gsize len);
+void xmms_realtime_mem_unlock (gconstpointer mem, gsize len);
+
+typedef enum {
+	XMMS_REALTIME_IO_DEFAULT,
+	XMMS_REALTIME_IO_REALTIME,
+	XMMS_REALTIME_IO_BEST_EFFORT,
+	XMMS_REALTIME_IO_IDLE
+} xmms_realtime_io_class_t;
+
+gboolean xmms_realtime_thread_affinity (const guint *cpus, guint n);
+gboolean xmms_realtime_thread_nice (gint nice);
+gboolean xmms_realtime_thread_io_priority (gint klass, gint level);
+
+#endif
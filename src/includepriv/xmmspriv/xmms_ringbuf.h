@@ -30,17 +30,28 @@ void xmms_ringbuf_clear (xmms_ringbuf_t *ringbuf);
 guint xmms_ringbuf_bytes_free (const xmms_ringbuf_t *ringbuf);
 guint xmms_ringbuf_bytes_used (const xmms_ringbuf_t *ringbuf);
 guint xmms_ringbuf_size (xmms_ringbuf_t *ringbuf);
+guint xmms_ringbuf_resize (xmms_ringbuf_t *ringbuf, guint size);
+gboolean xmms_ringbuf_set_locked (xmms_ringbuf_t *ringbuf, gboolean locked);
 
 guint xmms_ringbuf_read (xmms_ringbuf_t *ringbuf, gpointer data, guint length);
+guint xmms_ringbuf_try_read (xmms_ringbuf_t *ringbuf, gpointer data, guint length, gboolean *held);
 guint xmms_ringbuf_read_wait (xmms_ringbuf_t *ringbuf, gpointer data, guint length, GMutex *mtx);
 guint xmms_ringbuf_peek (xmms_ringbuf_t *ringbuf, gpointer data, guint length);
 guint xmms_ringbuf_peek_wait (xmms_ringbuf_t *ringbuf, gpointer data, guint length, GMutex *mtx);
+guint xmms_ringbuf_skip (xmms_ringbuf_t *ringbuf, guint length);
+void xmms_ringbuf_set_history (xmms_ringbuf_t *ringbuf, guint size);
+guint xmms_ringbuf_history (xmms_ringbuf_t *ringbuf);
+gboolean xmms_ringbuf_rewind (xmms_ringbuf_t *ringbuf, guint length);
+gboolean xmms_ringbuf_forward (xmms_ringbuf_t *ringbuf, guint length);
 void xmms_ringbuf_hotspot_set (xmms_ringbuf_t *ringbuf, gboolean (*cb) (void *), void (*destroy) (void *), void *arg);
 guint xmms_ringbuf_write (xmms_ringbuf_t *ringbuf, gconstpointer data, guint length);
 guint xmms_ringbuf_write_wait (xmms_ringbuf_t *ringbuf, gconstpointer data, guint length, GMutex *mtx);
+guint xmms_ringbuf_reserve (xmms_ringbuf_t *ringbuf, gpointer *ptr);
+guint xmms_ringbuf_commit (xmms_ringbuf_t *ringbuf, guint length);
 
 void xmms_ringbuf_wait_free (xmms_ringbuf_t *ringbuf, guint len, GMutex *mtx);
 void xmms_ringbuf_wait_used (xmms_ringbuf_t *ringbuf, guint len, GMutex *mtx);
+void xmms_ringbuf_wait_used_unlocked (xmms_ringbuf_t *ringbuf, guint len);
 
 gboolean xmms_ringbuf_iseos (const xmms_ringbuf_t *ringbuf);
 void xmms_ringbuf_set_eos (xmms_ringbuf_t *ringbuf, gboolean eos);
@@ -0,0 +1,27 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#ifndef __XMMS_SANDBOX_H__
+#define __XMMS_SANDBOX_H__
+
+#include <glib.h>
+
+void xmms_sandbox_init (const gchar *program, const gchar *conffile, const gchar *plugindir);
+gboolean xmms_sandbox_wanted (const gchar *plugin);
+gint xmms_sandbox_host_run (const gchar *path);
+
+#endif
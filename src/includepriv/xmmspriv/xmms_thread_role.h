@@ -0,0 +1,38 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_PRIV_THREAD_ROLE_H__
+#define __XMMS_PRIV_THREAD_ROLE_H__
+
+#include <glib.h>
+
+/** What a server thread does, config properties are per role */
+typedef enum {
+	/** Decoding and output, wants to be scheduled at once */
+	XMMS_THREAD_ROLE_AUDIO,
+	/** Medialib imports, probing and rehashing, can wait */
+	XMMS_THREAD_ROLE_IMPORT,
+	/** Serving clients */
+	XMMS_THREAD_ROLE_IPC,
+	/** Housekeeping such as logging and saving config */
+	XMMS_THREAD_ROLE_BACKGROUND,
+	XMMS_THREAD_ROLE_NUM
+} xmms_thread_role_t;
+
+void xmms_thread_role_init (void);
+void xmms_thread_role_enter (xmms_thread_role_t role);
+
+#endif
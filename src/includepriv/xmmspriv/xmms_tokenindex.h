@@ -0,0 +1,35 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_TOKENINDEX_H__
+#define __XMMS_TOKENINDEX_H__
+
+#include <glib.h>
+
+typedef struct xmms_token_index_St xmms_token_index_t;
+
+#include <xmmspriv/xmms_medialib.h>
+
+xmms_token_index_t *xmms_token_index_new (void);
+void xmms_token_index_free (xmms_token_index_t *index);
+void xmms_token_index_configure (xmms_token_index_t *index, const gchar *keys, gboolean fold_marks);
+
+gboolean xmms_token_index_has_key (xmms_token_index_t *index, const gchar *key);
+void xmms_token_index_touch (xmms_token_index_t *index, GHashTable *entries, guint generation);
+xmmsv_t *xmms_token_index_complete (xmms_token_index_t *index, xmms_medialib_session_t *session, const gchar *key, const gchar *prefix, gint limit);
+GHashTable *xmms_token_index_match (xmms_token_index_t *index, xmms_medialib_session_t *session, const gchar *key, const gchar *pattern, gboolean token, gboolean caseless);
+
+#endif
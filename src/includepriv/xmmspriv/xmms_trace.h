@@ -0,0 +1,47 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_PRIV_TRACE_H__
+#define __XMMS_PRIV_TRACE_H__
+
+#include <glib.h>
+#include <xmms_configuration.h>
+
+extern gint xmms_trace_enabled;
+
+/* Spans are recorded while core.trace is set, and only in builds
+ * configured with tracing; elsewhere the macros compile to nothing.
+ * name must be a string literal or live as long as the server. */
+#ifdef XMMS_TRACE
+#define XMMS_TRACE_BEGIN(name) G_STMT_START { \
+	if (G_UNLIKELY (g_atomic_int_get (&xmms_trace_enabled))) \
+		xmms_trace_event (name, 'B'); \
+} G_STMT_END
+#define XMMS_TRACE_END(name) G_STMT_START { \
+	if (G_UNLIKELY (g_atomic_int_get (&xmms_trace_enabled))) \
+		xmms_trace_event (name, 'E'); \
+} G_STMT_END
+#else
+#define XMMS_TRACE_BEGIN(name) G_STMT_START { } G_STMT_END
+#define XMMS_TRACE_END(name) G_STMT_START { } G_STMT_END
+#endif
+
+void xmms_trace_init (void);
+void xmms_trace_shutdown (void);
+void xmms_trace_event (const gchar *name, gchar phase);
+gchar *xmms_trace_dump (void);
+
+#endif
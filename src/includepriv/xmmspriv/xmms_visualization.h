@@ -28,4 +28,7 @@ typedef struct xmms_visualization_St xmms_visualization_t;
 
 xmms_visualization_t *xmms_visualization_new (xmms_output_t *output);
 
+gboolean xmms_visualization_at_output (void);
+void xmms_visualization_output_feed (const xmms_stream_type_t *format, const void *buf, gint len, gint64 play_at);
+
 #endif
@@ -36,17 +36,35 @@ xmms_xform_t *xmms_xform_chain_setup (xmms_medialib_t *medialib, xmms_medialib_e
 xmms_xform_t *xmms_xform_chain_setup_session (xmms_medialib_t *medialib, xmms_medialib_session_t *session, xmms_medialib_entry_t entry, GList *goal_fmts, gboolean rehash);
 xmms_xform_t *xmms_xform_chain_setup_url_session (xmms_medialib_t *medialib, xmms_medialib_session_t *session, xmms_medialib_entry_t entry, const gchar *url, GList *goal_fmts, gboolean rehash);
 xmms_xform_t *xmms_xform_chain_setup_url (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *url, GList *goal_formats, gboolean rehash);
+xmms_xform_t *xmms_xform_chain_setup_decoder (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *url, GList *goal_formats);
+gboolean xmms_xform_chain_analyze (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, GList *goal_formats, const gchar *name);
 
 gint64 xmms_xform_this_seek (xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mode_t whence, xmms_error_t *err);
 int xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, int siz, xmms_error_t *err);
+gint xmms_xform_this_prefill (xmms_xform_t *xform, gint siz, xmms_error_t *err);
 gboolean xmms_xform_iseos (xmms_xform_t *xform);
 
+xmmsv_t *xmms_xform_chain_stats (xmms_xform_t *last);
+xmmsv_t *xmms_xform_chain_metadata (xmms_xform_t *last);
+
+/** Add a goal of this type to have the chain set up as a probe,
+ * see #xmms_xform_is_probe */
+#define XMMS_XFORM_PROBE_MIMETYPE "application/x-xmms2-probe"
+
+/** Add a goal of this type to have an effect analyze the stream, see
+ * #xmms_xform_is_analysis and #xmms_xform_chain_analyze */
+#define XMMS_XFORM_ANALYSIS_MIMETYPE "application/x-xmms2-analysis"
+
 const GList *xmms_xform_goal_hints_get (xmms_xform_t *xform);
 xmms_stream_type_t *xmms_xform_intype_get (xmms_xform_t *xform);
 
 void xmms_xform_outdata_type_set (xmms_xform_t *xform, xmms_stream_type_t *type);
 xmmsv_t *xmms_xform_browse (const gchar *url, xmms_error_t *error);
 xmmsv_t *xmms_xform_browse_method (xmms_xform_t *xform, const gchar *url, xmms_error_t *error);
+void xmms_xform_browse_prefetch (xmmsv_t *list);
+void xmms_xform_browse_invalidate (const gchar *url, gboolean parent);
+void xmms_xform_browse_cache_init (void);
+void xmms_xform_browse_cache_shutdown (void);
 
 const char *xmms_xform_indata_find_str (xmms_xform_t *xform, xmms_stream_type_key_t key);
 
@@ -21,16 +21,21 @@ gboolean xmms_xform_plugin_can_read (const xmms_xform_plugin_t *plugin);
 gboolean xmms_xform_plugin_can_seek (const xmms_xform_plugin_t *plugin);
 gboolean xmms_xform_plugin_can_browse (const xmms_xform_plugin_t *plugin);
 gboolean xmms_xform_plugin_can_destroy (const xmms_xform_plugin_t *plugin);
+gboolean xmms_xform_plugin_can_process (const xmms_xform_plugin_t *plugin);
 
 gboolean xmms_xform_plugin_init (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform);
 gboolean xmms_xform_plugin_metadata_mapper_match (const xmms_xform_plugin_t *xform_plugin, xmms_xform_t *xform, const gchar *key, const gchar *value, gsize length);
 gint xmms_xform_plugin_read (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform, xmms_sample_t *buf, gint length, xmms_error_t *error);
+void xmms_xform_plugin_process (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform, xmms_sample_t *buf, gint length);
 gint64 xmms_xform_plugin_seek (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mode_t whence, xmms_error_t *err);
 gboolean xmms_xform_plugin_browse (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform, const gchar *url, xmms_error_t *error);
 void xmms_xform_plugin_destroy (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform);
 
 gboolean xmms_xform_plugin_supports (const xmms_xform_plugin_t *plugin, const xmms_stream_type_t *st, gint *priority);
+xmms_xform_plugin_t *xmms_xform_plugin_find_match (const xmms_stream_type_t *st);
+xmms_xform_plugin_t *xmms_xform_plugin_find_next_match (const xmms_stream_type_t *st, GList *tried);
 
 xmms_stream_type_t *xmms_xform_plugin_get_out_stream_type (xmms_xform_plugin_t *plugin);
+xmmsv_t *xmms_xform_plugin_in_mimetypes (xmms_xform_plugin_t *plugin);
 
 #endif
@@ -35,6 +35,8 @@ struct xmms_ipc_msg_St {
 	uint32_t xfered;
 };
 
+static uint32_t xmms_ipc_msg_get_length (const xmms_ipc_msg_t *msg);
+
 
 
 xmms_ipc_msg_t *
@@ -50,6 +52,38 @@ xmms_ipc_msg_alloc (void)
 	return msg;
 }
 
+/**
+ * Wrap a complete message, header included, that lives in memory
+ * owned by someone else, without copying it. data must stay valid
+ * until the message is destroyed.
+ *
+ * @returns NULL if the length in the header doesn't match len.
+ */
+xmms_ipc_msg_t *
+xmms_ipc_msg_new_from_data (const unsigned char *data, uint32_t len)
+{
+	xmms_ipc_msg_t *msg;
+
+	x_return_null_if_fail (data);
+
+	if (len < XMMS_IPC_MSG_HEAD_LEN) {
+		return NULL;
+	}
+
+	msg = x_new0 (xmms_ipc_msg_t, 1);
+	msg->bb = xmmsv_new_bitbuffer_ro (data, len);
+	msg->xfered = len;
+
+	if (xmms_ipc_msg_get_length (msg) != len - XMMS_IPC_MSG_HEAD_LEN) {
+		xmms_ipc_msg_destroy (msg);
+		return NULL;
+	}
+
+	xmmsv_bitbuffer_goto (msg->bb, XMMS_IPC_MSG_HEAD_LEN * 8);
+
+	return msg;
+}
+
 void
 xmms_ipc_msg_destroy (xmms_ipc_msg_t *msg)
 {
@@ -225,6 +259,122 @@ xmms_ipc_msg_write_transport (xmms_ipc_msg_t *msg,
 	return (len == msg->xfered);
 }
 
+/**
+ * Write a message that is shared between several receivers to
+ * transport, with the cookie in the header replaced by cookie. The
+ * message itself is left untouched, so it can be written to many
+ * transports without copying; the amount written is kept in xfered.
+ *
+ * @returns TRUE if full message was written, FALSE otherwise.
+ *               disconnected is set if transport was disconnected
+ */
+bool
+xmms_ipc_msg_write_transport_cookie (const xmms_ipc_msg_t *msg,
+                                     uint32_t cookie,
+                                     uint32_t *xfered,
+                                     xmms_ipc_transport_t *transport,
+                                     bool *disconnected)
+{
+	unsigned char head[XMMS_IPC_MSG_HEAD_LEN];
+	xmms_ipc_transport_vec_t vec[2];
+	unsigned int len;
+	int i, n, ret, wlen;
+
+	x_return_val_if_fail (msg, false);
+	x_return_val_if_fail (xfered, false);
+	x_return_val_if_fail (transport, false);
+
+	len = xmms_ipc_msg_get_size (msg);
+
+	x_return_val_if_fail (len > *xfered, true);
+
+	while (*xfered < len) {
+		n = xmms_ipc_msg_get_unwritten (msg, true, cookie, *xfered, head, vec);
+		for (i = 0, wlen = 0; i < n; i++) {
+			wlen += vec[i].len;
+		}
+
+		ret = xmms_ipc_transport_writev (transport, vec, n);
+
+		if (ret == SOCKET_ERROR) {
+			if (!xmms_socket_error_recoverable () && disconnected) {
+				*disconnected = true;
+			}
+			return false;
+		} else if (!ret) {
+			if (disconnected) {
+				*disconnected = true;
+			}
+			return false;
+		}
+
+		*xfered += ret;
+
+		if (ret < wlen) {
+			/* the transport is full, try again later */
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Get the size of a message, header included, in bytes.
+ */
+uint32_t
+xmms_ipc_msg_get_size (const xmms_ipc_msg_t *msg)
+{
+	x_return_val_if_fail (msg, 0);
+
+	return xmmsv_bitbuffer_len (msg->bb) / 8;
+}
+
+/**
+ * Describe the part of a message after the first xfered bytes as at
+ * most two buffers for #xmms_ipc_transport_writev, so many messages can
+ * be written with one syscall. If use_cookie is set the header has its
+ * cookie replaced by cookie, in head, which has to stay around as long
+ * as the buffers are used.
+ *
+ * @returns The number of buffers filled in.
+ */
+int
+xmms_ipc_msg_get_unwritten (const xmms_ipc_msg_t *msg, bool use_cookie,
+                            uint32_t cookie, uint32_t xfered,
+                            unsigned char head[XMMS_IPC_MSG_HEAD_LEN],
+                            xmms_ipc_transport_vec_t vec[2])
+{
+	const unsigned char *data;
+	uint32_t len;
+	int n = 0;
+
+	data = xmmsv_bitbuffer_buffer (msg->bb);
+	len = xmmsv_bitbuffer_len (msg->bb) / 8;
+
+	if (use_cookie && xfered < XMMS_IPC_MSG_HEAD_LEN) {
+		memcpy (head, data, XMMS_IPC_MSG_HEAD_LEN);
+		head[8] = (cookie >> 24) & 0xff;
+		head[9] = (cookie >> 16) & 0xff;
+		head[10] = (cookie >> 8) & 0xff;
+		head[11] = cookie & 0xff;
+
+		vec[n].buf = (char *) head + xfered;
+		vec[n].len = XMMS_IPC_MSG_HEAD_LEN - xfered;
+		n++;
+
+		xfered = XMMS_IPC_MSG_HEAD_LEN;
+	}
+
+	if (xfered < len) {
+		vec[n].buf = (char *) data + xfered;
+		vec[n].len = len - xfered;
+		n++;
+	}
+
+	return n;
+}
+
 /**
  * Try to read message from transport into msg.
  *
@@ -235,8 +385,8 @@ xmms_ipc_msg_read_transport (xmms_ipc_msg_t *msg,
                              xmms_ipc_transport_t *transport,
                              bool *disconnected)
 {
-	char buf[512];
-	unsigned int ret, len, rlen;
+	char *buf;
+	unsigned int ret, len, have;
 
 	x_return_val_if_fail (msg, false);
 	x_return_val_if_fail (transport, false);
@@ -250,15 +400,20 @@ xmms_ipc_msg_read_transport (xmms_ipc_msg_t *msg,
 			if (msg->xfered == len) {
 				return true;
 			}
+
+			/* make room for the whole message, and read into it */
+			have = xmmsv_bitbuffer_len (msg->bb) / 8;
+			if (have < len) {
+				if (!xmmsv_bitbuffer_extend (msg->bb, len - have)) {
+					return false;
+				}
+			}
 		}
 
 		x_return_val_if_fail (msg->xfered < len, false);
 
-		rlen = len - msg->xfered;
-		if (rlen > sizeof (buf))
-			rlen = sizeof (buf);
-
-		ret = xmms_ipc_transport_read (transport, buf, rlen);
+		buf = (char *) xmmsv_bitbuffer_buffer (msg->bb) + msg->xfered;
+		ret = xmms_ipc_transport_read (transport, buf, len - msg->xfered);
 
 		if (ret == SOCKET_ERROR) {
 			if (xmms_socket_error_recoverable ()) {
@@ -277,26 +432,70 @@ xmms_ipc_msg_read_transport (xmms_ipc_msg_t *msg,
 
 			return false;
 		} else {
-			xmmsv_bitbuffer_goto (msg->bb, msg->xfered * 8);
-			xmmsv_bitbuffer_put_data (msg->bb, (unsigned char *) buf, ret);
 			msg->xfered += ret;
 			xmmsv_bitbuffer_goto (msg->bb, XMMS_IPC_MSG_HEAD_LEN * 8);
 		}
 	}
 }
 
-uint32_t
-xmms_ipc_msg_put_value (xmms_ipc_msg_t *msg, xmmsv_t *v)
+static uint32_t
+xmms_ipc_msg_put_value_full (xmms_ipc_msg_t *msg, xmmsv_t *v, bool compact)
 {
-	if (!xmmsv_bitbuffer_serialize_value (msg->bb, v))
+	int size;
+
+	/* grow the message once, instead of doubling while writing */
+	if (compact) {
+		size = xmmsv_bitbuffer_serialized_size_compact (v);
+	} else {
+		size = xmmsv_bitbuffer_serialized_size (v);
+	}
+	if (size < 0 || !xmmsv_bitbuffer_reserve (msg->bb, size * 8))
 		return false;
+
+	if (compact) {
+		if (!xmmsv_bitbuffer_serialize_value_compact (msg->bb, v))
+			return false;
+	} else {
+		if (!xmmsv_bitbuffer_serialize_value (msg->bb, v))
+			return false;
+	}
 	xmms_ipc_msg_update_length (msg->bb);
 	return xmmsv_bitbuffer_pos (msg->bb);
 }
 
+uint32_t
+xmms_ipc_msg_put_value (xmms_ipc_msg_t *msg, xmmsv_t *v)
+{
+	return xmms_ipc_msg_put_value_full (msg, v, false);
+}
+
+/**
+ * Like #xmms_ipc_msg_put_value, in the compact encoding. Only for a
+ * peer speaking protocol version 29 or later.
+ */
+uint32_t
+xmms_ipc_msg_put_value_compact (xmms_ipc_msg_t *msg, xmmsv_t *v)
+{
+	return xmms_ipc_msg_put_value_full (msg, v, true);
+}
+
 
 bool
 xmms_ipc_msg_get_value (xmms_ipc_msg_t *msg, xmmsv_t **val)
 {
 	return xmmsv_bitbuffer_deserialize_value (msg->bb, val);
 }
+
+/**
+ * Like #xmms_ipc_msg_get_value for a list of arguments whose last one
+ * is only passed on, which is kept serialized, see
+ * #xmmsv_bitbuffer_deserialize_list_keep_last.
+ *
+ * @param compact Whether the peer may have used the compact encoding.
+ */
+bool
+xmms_ipc_msg_get_value_keep_last (xmms_ipc_msg_t *msg, bool compact,
+                                  xmmsv_t **val)
+{
+	return xmmsv_bitbuffer_deserialize_list_keep_last (msg->bb, compact, val);
+}
@@ -0,0 +1,289 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+
+#include <xmmsc/xmmsc_ipc_shm.h>
+#include <xmmscpriv/xmmsc_util.h>
+
+#define XMMS_IPC_SHM_MAGIC 0x584d5331 /* "XMS1" */
+
+/* Messages start at multiples of this in the ring */
+#define XMMS_IPC_SHM_ALIGN(len) (((len) + 7) & ~7U)
+
+/**
+ * Start of the segment. head and tail count bytes written and
+ * consumed since the ring was created, so they only ever grow (and
+ * wrap at 2^32); their difference is the space in use. Only the
+ * server moves head, only the client moves tail.
+ */
+typedef struct xmms_ipc_shm_header_St {
+	uint32_t magic;
+	uint32_t size;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+	uint32_t pad[12];
+} xmms_ipc_shm_header_t;
+
+struct xmms_ipc_shm_St {
+	int shmid;
+	uint32_t size;
+	xmms_ipc_shm_header_t *header;
+	unsigned char *data;
+	/* our own copy of the counter we move, the one in the segment
+	   may be scribbled on by the other side */
+	uint32_t pos;
+};
+
+static bool
+xmms_ipc_shm_size_is_valid (uint32_t size)
+{
+	/* a power of two, so positions wrap together with the counters */
+	return size >= XMMS_IPC_SHM_MIN_MSG && size <= (1U << 30) &&
+	       (size & (size - 1)) == 0;
+}
+
+static xmms_ipc_shm_t *
+xmms_ipc_shm_map (int shmid, uint32_t size)
+{
+	xmms_ipc_shm_t *shm;
+	void *addr;
+
+	addr = shmat (shmid, NULL, 0);
+	if (addr == (void *) -1) {
+		return NULL;
+	}
+
+	shm = x_new0 (xmms_ipc_shm_t, 1);
+	if (!shm) {
+		x_oom ();
+		shmdt (addr);
+		return NULL;
+	}
+
+	shm->shmid = shmid;
+	shm->size = size;
+	shm->header = addr;
+	shm->data = (unsigned char *) addr + sizeof (xmms_ipc_shm_header_t);
+
+	return shm;
+}
+
+/**
+ * Create a ring with size bytes of data area, to be handed to the
+ * server with #xmms_ipc_shm_id. Only the creating user may attach.
+ */
+xmms_ipc_shm_t *
+xmms_ipc_shm_create (uint32_t size)
+{
+	xmms_ipc_shm_t *shm;
+	int shmid;
+
+	x_return_null_if_fail (xmms_ipc_shm_size_is_valid (size));
+
+	shmid = shmget (IPC_PRIVATE, sizeof (xmms_ipc_shm_header_t) + size,
+	                S_IRUSR | S_IWUSR);
+	if (shmid == -1) {
+		return NULL;
+	}
+
+	shm = xmms_ipc_shm_map (shmid, size);
+	if (!shm) {
+		shmctl (shmid, IPC_RMID, NULL);
+		return NULL;
+	}
+
+	shm->header->size = size;
+	shm->header->head = 0;
+	shm->header->tail = 0;
+	shm->header->magic = XMMS_IPC_SHM_MAGIC;
+
+	return shm;
+}
+
+/**
+ * Attach to a ring created by a client.
+ */
+xmms_ipc_shm_t *
+xmms_ipc_shm_attach (int shmid, uint32_t size)
+{
+	xmms_ipc_shm_t *shm;
+	struct shmid_ds ds;
+
+	if (!xmms_ipc_shm_size_is_valid (size)) {
+		return NULL;
+	}
+
+	/* don't trust the client on how large the segment is */
+	if (shmctl (shmid, IPC_STAT, &ds) == -1 ||
+	    ds.shm_segsz < sizeof (xmms_ipc_shm_header_t) + size) {
+		return NULL;
+	}
+
+	shm = xmms_ipc_shm_map (shmid, size);
+	if (!shm) {
+		return NULL;
+	}
+
+	if (shm->header->magic != XMMS_IPC_SHM_MAGIC ||
+	    shm->header->size != size) {
+		xmms_ipc_shm_destroy (shm);
+		return NULL;
+	}
+
+	shm->pos = shm->header->head;
+
+	return shm;
+}
+
+void
+xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm)
+{
+	x_return_if_fail (shm);
+
+	shmdt (shm->header);
+	free (shm);
+}
+
+int
+xmms_ipc_shm_id (xmms_ipc_shm_t *shm)
+{
+	x_return_val_if_fail (shm, -1);
+
+	return shm->shmid;
+}
+
+/**
+ * Have the segment go away once both sides detach. Nobody else can
+ * attach after this.
+ */
+void
+xmms_ipc_shm_unlink (xmms_ipc_shm_t *shm)
+{
+	x_return_if_fail (shm);
+
+	shmctl (shm->shmid, IPC_RMID, NULL);
+}
+
+/**
+ * Copy the buffers into the ring as one message. Used by the server.
+ *
+ * @param pos Where the message starts, to be passed to the client.
+ * @returns false if there isn't room, the message then has to go over
+ * the socket.
+ */
+bool
+xmms_ipc_shm_put (xmms_ipc_shm_t *shm, xmms_ipc_transport_vec_t *vec,
+                  int n, uint32_t *pos)
+{
+	uint32_t len, reclen, used, offset, skip, tail;
+	int i;
+
+	x_return_val_if_fail (shm, false);
+	x_return_val_if_fail (pos, false);
+
+	for (i = 0, len = 0; i < n; i++) {
+		len += vec[i].len;
+	}
+
+	reclen = XMMS_IPC_SHM_ALIGN (len);
+	if (reclen > shm->size) {
+		return false;
+	}
+
+	tail = shm->header->tail;
+	used = shm->pos - tail;
+	if (used > shm->size) {
+		/* tail is garbage, stop using the ring */
+		return false;
+	}
+
+	/* a message never wraps, the end of the ring is skipped instead */
+	offset = shm->pos & (shm->size - 1);
+	skip = 0;
+	if (offset + reclen > shm->size) {
+		skip = shm->size - offset;
+		offset = 0;
+	}
+
+	if (used + skip + reclen > shm->size) {
+		return false;
+	}
+
+	*pos = shm->pos + skip;
+
+	for (i = 0; i < n; i++) {
+		memcpy (shm->data + offset, vec[i].buf, vec[i].len);
+		offset += vec[i].len;
+	}
+
+	shm->pos += skip + reclen;
+
+	/* the message must be in place before the client can see it */
+	__sync_synchronize ();
+	shm->header->head = shm->pos;
+
+	return true;
+}
+
+/**
+ * Get a message the server put at pos. Used by the client. The
+ * memory stays valid until #xmms_ipc_shm_release.
+ */
+const unsigned char *
+xmms_ipc_shm_peek (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len)
+{
+	uint32_t offset;
+
+	x_return_null_if_fail (shm);
+
+	offset = pos & (shm->size - 1);
+	if (len > shm->size || offset + len > shm->size) {
+		return NULL;
+	}
+
+	/* pairs with the barrier in xmms_ipc_shm_put */
+	__sync_synchronize ();
+
+	return shm->data + offset;
+}
+
+/**
+ * Give the space of the message at pos, and anything before it,
+ * back to the server.
+ */
+void
+xmms_ipc_shm_release (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len)
+{
+	uint32_t end;
+
+	x_return_if_fail (shm);
+
+	end = pos + XMMS_IPC_SHM_ALIGN (len);
+
+	/* messages may be released out of order when callbacks recurse
+	   into the mainloop, never move backwards */
+	if ((int32_t) (end - shm->pos) > 0) {
+		shm->pos = end;
+		__sync_synchronize ();
+		shm->header->tail = end;
+	}
+}
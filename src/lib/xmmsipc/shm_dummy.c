@@ -0,0 +1,68 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/* Platforms without System V shared memory send every message over
+ * the socket. */
+
+#include <stdlib.h>
+
+#include <xmmsc/xmmsc_ipc_shm.h>
+
+xmms_ipc_shm_t *
+xmms_ipc_shm_create (uint32_t size)
+{
+	return NULL;
+}
+
+xmms_ipc_shm_t *
+xmms_ipc_shm_attach (int shmid, uint32_t size)
+{
+	return NULL;
+}
+
+void
+xmms_ipc_shm_destroy (xmms_ipc_shm_t *shm)
+{
+}
+
+int
+xmms_ipc_shm_id (xmms_ipc_shm_t *shm)
+{
+	return -1;
+}
+
+void
+xmms_ipc_shm_unlink (xmms_ipc_shm_t *shm)
+{
+}
+
+bool
+xmms_ipc_shm_put (xmms_ipc_shm_t *shm, xmms_ipc_transport_vec_t *vec,
+                  int n, uint32_t *pos)
+{
+	return false;
+}
+
+const unsigned char *
+xmms_ipc_shm_peek (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len)
+{
+	return NULL;
+}
+
+void
+xmms_ipc_shm_release (xmms_ipc_shm_t *shm, uint32_t pos, uint32_t len)
+{
+}
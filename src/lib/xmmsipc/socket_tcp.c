@@ -30,6 +30,37 @@
 
 #include <xmmscpriv/xmmsc_util.h>
 
+/**
+ * Set the socket buffer sizes given in the query of the url, like
+ * tcp://host:port?sndbuf=4194304&rcvbuf=4194304, for links where the
+ * default buffers are too small for big replies to keep the line
+ * busy. Sockets accepted from a listening one inherit its sizes.
+ */
+static void
+xmms_ipc_tcp_set_buffers (xmms_socket_t fd, const xmms_url_t *url)
+{
+	const char *opt = url->query;
+
+	while (opt && *opt) {
+		const char *next = strchr (opt, '&');
+		int optname = -1, size = 0;
+
+		if (!strncmp (opt, "sndbuf=", 7)) {
+			optname = SO_SNDBUF;
+			size = atoi (opt + 7);
+		} else if (!strncmp (opt, "rcvbuf=", 7)) {
+			optname = SO_RCVBUF;
+			size = atoi (opt + 7);
+		}
+
+		if (optname != -1 && size > 0) {
+			setsockopt (fd, SOL_SOCKET, optname, (const char *) &size, sizeof (size));
+		}
+
+		opt = next ? next + 1 : NULL;
+	}
+}
+
 static void
 xmms_ipc_tcp_destroy (xmms_ipc_transport_t *ipct)
 {
@@ -91,7 +122,9 @@ xmms_ipc_tcp_client_init (const xmms_url_t *url, int ipv6)
 
 	for (addrinfo = addrinfos; addrinfo; addrinfo = addrinfo->ai_next) {
 		int _reuseaddr = 1;
+		int _nodelay = 1;
 		const char* reuseaddr = (const char*)&_reuseaddr;
+		const char* nodelay = (const char*)&_nodelay;
 
 		fd = socket (addrinfo->ai_family, addrinfo->ai_socktype, addrinfo->ai_protocol);
 		if (!xmms_socket_valid (fd)) {
@@ -99,6 +132,10 @@ xmms_ipc_tcp_client_init (const xmms_url_t *url, int ipv6)
 		}
 
 		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, reuseaddr, sizeof (_reuseaddr));
+		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, nodelay, sizeof (_nodelay));
+
+		/* before connecting, the window scale is settled then */
+		xmms_ipc_tcp_set_buffers (fd, url);
 
 		if (connect (fd, addrinfo->ai_addr, addrinfo->ai_addrlen) == 0) {
 			break;
@@ -206,6 +243,7 @@ xmms_ipc_tcp_server_init (const xmms_url_t *url, int ipv6)
 
 		setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, reuseaddr, sizeof (_reuseaddr));
 		setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, nodelay, sizeof (_nodelay));
+		xmms_ipc_tcp_set_buffers (fd, url);
 
 		if (bind (fd, addrinfo->ai_addr, addrinfo->ai_addrlen) != SOCKET_ERROR &&
 		    listen (fd, SOMAXCONN) != SOCKET_ERROR) {
@@ -222,8 +260,24 @@ xmms_ipc_tcp_server_init (const xmms_url_t *url, int ipv6)
 
 	assert (fd != -1);
 
-	if (!xmms_socket_set_nonblock (fd)) {
+	ipct = xmms_ipc_tcp_server_adopt (url, fd);
+	if (!ipct) {
 		close (fd);
+	}
+
+	return ipct;
+}
+
+/**
+ * Serve on a socket that is already listening, handed over by a
+ * daemon that restarted.
+ */
+xmms_ipc_transport_t *
+xmms_ipc_tcp_server_adopt (const xmms_url_t *url, xmms_socket_t fd)
+{
+	xmms_ipc_transport_t *ipct;
+
+	if (!xmms_socket_set_nonblock (fd)) {
 		return NULL;
 	}
 
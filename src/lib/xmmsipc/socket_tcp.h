@@ -23,5 +23,6 @@
 
 xmms_ipc_transport_t *xmms_ipc_tcp_server_init (const xmms_url_t *url, int ipv6);
 xmms_ipc_transport_t *xmms_ipc_tcp_client_init (const xmms_url_t *url, int ipv6);
+xmms_ipc_transport_t *xmms_ipc_tcp_server_adopt (const xmms_url_t *url, xmms_socket_t fd);
 
 #endif /* XMMS_SOCKET_TCP_H */
@@ -18,6 +18,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <sys/un.h>
 #include <errno.h>
@@ -68,6 +69,29 @@ xmms_ipc_usocket_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
 
 }
 
+static int
+xmms_ipc_usocket_writev (xmms_ipc_transport_t *ipct,
+                         xmms_ipc_transport_vec_t *vec, int n)
+{
+	struct iovec iov[XMMS_IPC_TRANSPORT_MAX_VEC];
+	struct msghdr mh;
+	int i;
+
+	x_return_val_if_fail (ipct, -1);
+	x_return_val_if_fail (vec, -1);
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = vec[i].buf;
+		iov[i].iov_len = vec[i].len;
+	}
+
+	memset (&mh, 0, sizeof (mh));
+	mh.msg_iov = iov;
+	mh.msg_iovlen = n;
+
+	return sendmsg (ipct->fd, &mh, 0);
+}
+
 xmms_ipc_transport_t *
 xmms_ipc_usocket_client_init (const xmms_url_t *url)
 {
@@ -108,8 +132,10 @@ xmms_ipc_usocket_client_init (const xmms_url_t *url)
 	ipct = x_new0 (xmms_ipc_transport_t, 1);
 	ipct->fd = fd;
 	ipct->path = strdup (url->path);
+	ipct->local = true;
 	ipct->read_func = xmms_ipc_usocket_read;
 	ipct->write_func = xmms_ipc_usocket_write;
+	ipct->writev_func = xmms_ipc_usocket_writev;
 	ipct->destroy_func = xmms_ipc_usocket_destroy;
 
 	return ipct;
@@ -149,8 +175,10 @@ xmms_ipc_usocket_accept (xmms_ipc_transport_t *transport)
 
 		ret = x_new0 (xmms_ipc_transport_t, 1);
 		ret->fd = fd;
+		ret->local = true;
 		ret->read_func = xmms_ipc_usocket_read;
 		ret->write_func = xmms_ipc_usocket_write;
+		ret->writev_func = xmms_ipc_usocket_writev;
 		ret->destroy_func = xmms_ipc_usocket_destroy;
 
 		return ret;
@@ -163,7 +191,6 @@ xmms_ipc_transport_t *
 xmms_ipc_usocket_server_init (const xmms_url_t *url)
 {
 	int fd;
-	int flags;
 	xmms_ipc_transport_t *ipct;
 	struct sockaddr_un saddr;
 
@@ -193,10 +220,30 @@ xmms_ipc_usocket_server_init (const xmms_url_t *url)
 
 	listen (fd, 5);
 
+	ipct = xmms_ipc_usocket_server_adopt (url, fd);
+	if (!ipct) {
+		close (fd);
+	}
+
+	return ipct;
+}
+
+/**
+ * Serve on a socket that is already listening, handed over by a
+ * daemon that restarted. Not accepted from until the new daemon is
+ * up, so the backlog is made as long as the system allows.
+ */
+xmms_ipc_transport_t *
+xmms_ipc_usocket_server_adopt (const xmms_url_t *url, int fd)
+{
+	int flags;
+	xmms_ipc_transport_t *ipct;
+
+	listen (fd, SOMAXCONN);
+
 	flags = fcntl (fd, F_GETFL, 0);
 
 	if (flags == -1) {
-		close (fd);
 		return NULL;
 	}
 
@@ -204,7 +251,6 @@ xmms_ipc_usocket_server_init (const xmms_url_t *url)
 
 	flags = fcntl (fd, F_SETFL, flags);
 	if (flags == -1) {
-		close (fd);
 		return NULL;
 	}
 
@@ -213,6 +259,7 @@ xmms_ipc_usocket_server_init (const xmms_url_t *url)
 	ipct->path = strdup (url->path);
 	ipct->read_func = xmms_ipc_usocket_read;
 	ipct->write_func = xmms_ipc_usocket_write;
+	ipct->writev_func = xmms_ipc_usocket_writev;
 	ipct->accept_func = xmms_ipc_usocket_accept;
 	ipct->destroy_func = xmms_ipc_usocket_destroy;
 
@@ -23,5 +23,6 @@
 
 xmms_ipc_transport_t *xmms_ipc_usocket_server_init (const xmms_url_t *url);
 xmms_ipc_transport_t *xmms_ipc_usocket_client_init (const xmms_url_t *url);
+xmms_ipc_transport_t *xmms_ipc_usocket_server_adopt (const xmms_url_t *url, int fd);
 
 #endif /* XMMS_SOCKET_UNIX_H */
@@ -25,6 +25,11 @@
 #include "socket_tcp.h"
 #include "url.h"
 
+/* Small reads, like message headers, fill a buffer of this size so
+ * several short messages take one syscall. Larger reads go straight
+ * to the caller. */
+#define XMMS_IPC_TRANSPORT_READAHEAD 16384
+
 void
 xmms_ipc_transport_destroy (xmms_ipc_transport_t *ipct)
 {
@@ -32,13 +37,44 @@ xmms_ipc_transport_destroy (xmms_ipc_transport_t *ipct)
 
 	ipct->destroy_func (ipct);
 
+	free (ipct->rbuf);
 	free (ipct);
 }
 
 int
 xmms_ipc_transport_read (xmms_ipc_transport_t *ipct, char *buffer, int len)
 {
-	return ipct->read_func (ipct, buffer, len);
+	int ret;
+
+	if (ipct->rbuf_pos < ipct->rbuf_len) {
+		ret = ipct->rbuf_len - ipct->rbuf_pos;
+		ret = ret < len ? ret : len;
+		memcpy (buffer, ipct->rbuf + ipct->rbuf_pos, ret);
+		ipct->rbuf_pos += ret;
+		return ret;
+	}
+
+	if (len >= XMMS_IPC_TRANSPORT_READAHEAD) {
+		return ipct->read_func (ipct, buffer, len);
+	}
+
+	if (!ipct->rbuf) {
+		ipct->rbuf = x_malloc (XMMS_IPC_TRANSPORT_READAHEAD);
+		if (!ipct->rbuf) {
+			return ipct->read_func (ipct, buffer, len);
+		}
+	}
+
+	ret = ipct->read_func (ipct, ipct->rbuf, XMMS_IPC_TRANSPORT_READAHEAD);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	ipct->rbuf_len = ret;
+	ipct->rbuf_pos = ret < len ? ret : len;
+	memcpy (buffer, ipct->rbuf, ipct->rbuf_pos);
+
+	return ipct->rbuf_pos;
 }
 
 int
@@ -47,6 +83,41 @@ xmms_ipc_transport_write (xmms_ipc_transport_t *ipct, char *buffer, int len)
 	return ipct->write_func (ipct, buffer, len);
 }
 
+/**
+ * Write several buffers, with one syscall where the transport supports
+ * it. At most #XMMS_IPC_TRANSPORT_MAX_VEC buffers are written.
+ *
+ * @returns The number of bytes written, or what the failing write
+ * returned if nothing was.
+ */
+int
+xmms_ipc_transport_writev (xmms_ipc_transport_t *ipct,
+                           xmms_ipc_transport_vec_t *vec, int n)
+{
+	int i, ret, total = 0;
+
+	if (n > XMMS_IPC_TRANSPORT_MAX_VEC) {
+		n = XMMS_IPC_TRANSPORT_MAX_VEC;
+	}
+
+	if (ipct->writev_func) {
+		return ipct->writev_func (ipct, vec, n);
+	}
+
+	for (i = 0; i < n; i++) {
+		ret = ipct->write_func (ipct, vec[i].buf, vec[i].len);
+		if (ret <= 0) {
+			return total ? total : ret;
+		}
+		total += ret;
+		if (ret < vec[i].len) {
+			break;
+		}
+	}
+
+	return total;
+}
+
 xmms_socket_t
 xmms_ipc_transport_fd_get (xmms_ipc_transport_t *ipct)
 {
@@ -46,3 +46,24 @@ xmms_ipc_server_init (const char *path)
 	free_url (url);
 	return transport;
 }
+
+xmms_ipc_transport_t *
+xmms_ipc_server_adopt (const char *path, xmms_socket_t fd)
+{
+	xmms_ipc_transport_t *transport = NULL;
+	xmms_url_t *url;
+
+	x_return_val_if_fail (path, NULL);
+
+	url = parse_url (path);
+	x_return_val_if_fail (url, NULL);
+
+	if (!strcasecmp (url->protocol, "") || !strcasecmp (url->protocol, "unix")) {
+		transport = xmms_ipc_usocket_server_adopt (url, fd);
+	} else if (!strcasecmp (url->protocol, "tcp")) {
+		transport = xmms_ipc_tcp_server_adopt (url, fd);
+	}
+
+	free_url (url);
+	return transport;
+}
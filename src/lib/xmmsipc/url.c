@@ -22,6 +22,7 @@ xmms_url_t *parse_url (const char *url)
 	char *username, *password;
 	char *host, *port;
 	char *path;
+	char *query;
 
 	xmms_url_t *result;
 
@@ -35,6 +36,13 @@ xmms_url_t *parse_url (const char *url)
 		tmp1 = strdup (url);
 	}
 
+	if (!strchrsplit (tmp1, '?', &tmp2, &query)) {
+		free (tmp1);
+		tmp1 = tmp2;
+	} else {
+		query = strdup ("");
+	}
+
 	if (strchrsplit (tmp1, '/', &tmp2, &path)) {
 		tmp2 = strdup (tmp1);
 		path = strdup ("");
@@ -87,6 +95,7 @@ xmms_url_t *parse_url (const char *url)
 	result->host = host;
 	result->port = port;
 	result->path = path;
+	result->query = query;
 
 	return result;
 }
@@ -99,6 +108,7 @@ void free_url (xmms_url_t *url)
 	free (url->host);
 	free (url->port);
 	free (url->path);
+	free (url->query);
 	free (url);
 }
 
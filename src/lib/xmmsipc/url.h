@@ -9,6 +9,8 @@ struct xmms_url_St {
 	char *host, *port;
 
 	char *path;
+	/* options after a '?', like sndbuf=4194304&rcvbuf=4194304 */
+	char *query;
 };
 
 typedef struct xmms_url_St xmms_url_t;
@@ -19,19 +19,34 @@
 
 #include <xmmsc/xmmsc_stdbool.h>
 #include <xmmsc/xmmsv.h>
+#include <xmmscpriv/xmmsv.h>
 #include <xmmscpriv/xmmsc_util.h>
 
+/* Flags on the type tag of a list in the compact encoding, see
+ * _internal_list_encoding. Plain type tags never get this large. */
+#define XMMSV_SERIALIZE_LIST_PACKED 0x100
+#define XMMSV_SERIALIZE_LIST_UNRESTRICTED 0x200
+#define XMMSV_SERIALIZE_LIST_TYPE_MASK 0xff
+
 static bool _internal_put_on_bb_bin (xmmsv_t *bb, const unsigned char *data, unsigned int len);
 static bool _internal_put_on_bb_error (xmmsv_t *bb, const char *errmsg);
 static bool _internal_put_on_bb_int32 (xmmsv_t *bb, int32_t v);
 static bool _internal_put_on_bb_int64 (xmmsv_t *bb, int64_t v);
 static bool _internal_put_on_bb_float (xmmsv_t *bb, float v);
 static bool _internal_put_on_bb_string (xmmsv_t *bb, const char *str);
-static bool _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll);
-static bool _internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v);
-static bool _internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v);
+static bool _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll, bool compact);
+static bool _internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v, bool compact);
+static bool _internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v, bool compact);
+
+static bool _internal_put_on_bb_value (xmmsv_t *bb, xmmsv_t *v, bool compact);
+static bool _internal_put_on_bb_serialized (xmmsv_t *bb, xmmsv_t *v, bool compact);
+static bool _internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *val, bool compact);
 
-static bool _internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *val);
+static int _internal_size_of_value_list (xmmsv_t *v, bool compact);
+static int _internal_size_of_value_dict (xmmsv_t *v, bool compact);
+static int _internal_size_of_value (xmmsv_t *v, bool compact);
+static int _internal_size_of_serialized (xmmsv_t *v, bool compact);
+static int _internal_size_of_value_of_type (xmmsv_type_t type, xmmsv_t *v, bool compact);
 
 static bool _internal_get_from_bb_bin_alloc (xmmsv_t *bb, unsigned char **buf, unsigned int *len);
 static bool _internal_get_from_bb_error_alloc (xmmsv_t *bb, char **buf, unsigned int *len);
@@ -129,7 +144,7 @@ _internal_put_on_bb_string (xmmsv_t *bb, const char *str)
 }
 
 static bool
-_internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll)
+_internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll, bool compact)
 {
 	if (!bb || !coll) {
 		return false;
@@ -141,12 +156,12 @@ _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll)
 	}
 
 	/* attributes */
-	if (!_internal_put_on_bb_value_dict (bb, xmmsv_coll_attributes_get (coll))) {
+	if (!_internal_put_on_bb_value_dict (bb, xmmsv_coll_attributes_get (coll), compact)) {
 		return false;
 	}
 
 	/* idlist */
-	if (!_internal_put_on_bb_value_list (bb, xmmsv_coll_idlist_get (coll))) {
+	if (!_internal_put_on_bb_value_list (bb, xmmsv_coll_idlist_get (coll), compact)) {
 		return false;
 	}
 
@@ -160,30 +175,174 @@ _internal_put_on_bb_collection (xmmsv_t *bb, xmmsv_t *coll)
 			return false;
 		}
 	} else {
-		if (!_internal_put_on_bb_value_list (bb, xmmsv_coll_operands_get (coll))) {
+		if (!_internal_put_on_bb_value_list (bb, xmmsv_coll_operands_get (coll), compact)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint64_t
+_internal_zigzag (int64_t v)
+{
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int
+_internal_varint_len (uint64_t v)
+{
+	int len = 1;
+
+	while (v >= 0x80) {
+		v >>= 7;
+		len++;
+	}
+
+	return len;
+}
+
+/* Bytes the entries of an integer list take in the compact encoding */
+static int
+_internal_packed_int_list_len (xmmsv_t *v)
+{
+	xmmsv_list_iter_t *it;
+	int64_t i, prev = 0;
+	int len = 0;
+
+	if (!xmmsv_get_list_iter (v, &it)) {
+		return -1;
+	}
+
+	while (xmmsv_list_iter_entry_int64 (it, &i)) {
+		len += _internal_varint_len (_internal_zigzag ((int64_t) ((uint64_t) i - (uint64_t) prev)));
+		prev = i;
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	return len;
+}
+
+/**
+ * Decide how a list is written. A restricted list has its entries
+ * written without type tags. In the compact encoding so does an
+ * unrestricted list whose entries all have the same type, flagged
+ * XMMSV_SERIALIZE_LIST_UNRESTRICTED so the reader doesn't restrict
+ * its copy. Integer entries are then flagged XMMSV_SERIALIZE_LIST_PACKED
+ * and written as zigzag varints of the difference to the previous
+ * entry when that is smaller; idlists are mostly sorted or clustered,
+ * so most ids take a byte or two instead of eight.
+ *
+ * @param tag The type tag to write.
+ * @param packed The length in bytes of the packed entries, if packed.
+ */
+static bool
+_internal_list_encoding (xmmsv_t *v, bool compact, int32_t *tag, int *packed)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_type_t type, first;
+	xmmsv_t *entry;
+	int len;
+
+	if (!xmmsv_list_get_type (v, &type)) {
+		return false;
+	}
+	*tag = type;
+
+	if (!compact) {
+		return true;
+	}
+
+	if (type == XMMSV_TYPE_NONE && xmmsv_list_get_size (v) > 0) {
+		if (!xmmsv_get_list_iter (v, &it)) {
 			return false;
 		}
+
+		xmmsv_list_iter_entry (it, &entry);
+		first = xmmsv_get_type (entry);
+		while (xmmsv_list_iter_entry (it, &entry) &&
+		       xmmsv_get_type (entry) == first) {
+			xmmsv_list_iter_next (it);
+		}
+		if (!xmmsv_list_iter_valid (it) && first != XMMSV_TYPE_NONE) {
+			type = first;
+			*tag = type | XMMSV_SERIALIZE_LIST_UNRESTRICTED;
+		}
+		xmmsv_list_iter_explicit_destroy (it);
+	}
+
+	if (type == XMMSV_TYPE_INT64) {
+		len = _internal_packed_int_list_len (v);
+		if (len >= 0 && len + 4 < xmmsv_list_get_size (v) * 8) {
+			*tag |= XMMSV_SERIALIZE_LIST_PACKED;
+			*packed = len;
+		}
 	}
 
 	return true;
 }
 
 static bool
-_internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v)
+_internal_put_on_bb_packed_int_list (xmmsv_t *bb, xmmsv_t *v, int len)
+{
+	xmmsv_list_iter_t *it;
+	unsigned char *buf, *p;
+	int64_t i, prev = 0;
+	uint64_t z;
+	bool ret;
+
+	if (!xmmsv_bitbuffer_put_bits (bb, 32, len)) {
+		return false;
+	}
+
+	if (!xmmsv_get_list_iter (v, &it)) {
+		return false;
+	}
+
+	buf = p = x_new (unsigned char, len > 0 ? len : 1);
+	if (!buf) {
+		x_oom ();
+		return false;
+	}
+
+	while (xmmsv_list_iter_entry_int64 (it, &i)) {
+		z = _internal_zigzag ((int64_t) ((uint64_t) i - (uint64_t) prev));
+		while (z >= 0x80) {
+			*p++ = (z & 0x7f) | 0x80;
+			z >>= 7;
+		}
+		*p++ = z;
+		prev = i;
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	ret = xmmsv_bitbuffer_put_data (bb, buf, len);
+	free (buf);
+
+	return ret;
+}
+
+static bool
+_internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v, bool compact)
 {
 	xmmsv_list_iter_t *it;
 	xmmsv_type_t type;
 	xmmsv_t *entry;
+	int32_t tag;
+	int packed;
 
 	if (!xmmsv_get_list_iter (v, &it)) {
 		return false;
 	}
 
-	if (!xmmsv_list_get_type (v, &type)) {
+	if (!_internal_list_encoding (v, compact, &tag, &packed)) {
 		return false;
 	}
+	type = tag & XMMSV_SERIALIZE_LIST_TYPE_MASK;
 
-	if (!xmmsv_bitbuffer_put_bits (bb, 32, type)) {
+	if (!xmmsv_bitbuffer_put_bits (bb, 32, tag)) {
 		return false;
 	}
 
@@ -192,16 +351,30 @@ _internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v)
 		return false;
 	}
 
-	if (type != XMMSV_TYPE_NONE) {
+	if (tag & XMMSV_SERIALIZE_LIST_PACKED) {
+		return _internal_put_on_bb_packed_int_list (bb, v, packed);
+	}
+
+	if (type == XMMSV_TYPE_INT64) {
+		int64_t i;
+
+		/* packed integer lists, skip boxing every entry */
+		while (xmmsv_list_iter_entry_int64 (it, &i)) {
+			if (!_internal_put_on_bb_int64 (bb, i)) {
+				return false;
+			}
+			xmmsv_list_iter_next (it);
+		}
+	} else if (type != XMMSV_TYPE_NONE) {
 		while (xmmsv_list_iter_entry (it, &entry)) {
-			if (!_internal_put_on_bb_value_of_type (bb, type, entry)) {
+			if (!_internal_put_on_bb_value_of_type (bb, type, entry, compact)) {
 				return false;
 			}
 			xmmsv_list_iter_next (it);
 		}
 	} else {
 		while (xmmsv_list_iter_entry (it, &entry)) {
-			if (!xmmsv_bitbuffer_serialize_value (bb, entry)) {
+			if (!_internal_put_on_bb_value (bb, entry, compact)) {
 				return false;
 			}
 			xmmsv_list_iter_next (it);
@@ -212,7 +385,7 @@ _internal_put_on_bb_value_list (xmmsv_t *bb, xmmsv_t *v)
 }
 
 static bool
-_internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v)
+_internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v, bool compact)
 {
 	xmmsv_dict_iter_t *it;
 	const char *key;
@@ -231,7 +404,7 @@ _internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v)
 		if (!_internal_put_on_bb_string (bb, key)) {
 			return false;
 		}
-		if (!xmmsv_bitbuffer_serialize_value (bb, entry)) {
+		if (!_internal_put_on_bb_value (bb, entry, compact)) {
 			return false;
 		}
 		xmmsv_dict_iter_next (it);
@@ -240,6 +413,161 @@ _internal_put_on_bb_value_dict (xmmsv_t *bb, xmmsv_t *v)
 	return true;
 }
 
+/* The size functions mirror the put functions above, returning the
+ * number of bytes they write or -1 for values they can't serialize.
+ */
+static int
+_internal_size_of_string (const char *str)
+{
+	return 4 + (str ? strlen (str) + 1 : 0);
+}
+
+static int
+_internal_size_of_collection (xmmsv_t *coll, bool compact)
+{
+	int attrs, idlist, operands;
+
+	attrs = _internal_size_of_value_dict (xmmsv_coll_attributes_get (coll), compact);
+	idlist = _internal_size_of_value_list (xmmsv_coll_idlist_get (coll), compact);
+
+	if (xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_REFERENCE)) {
+		operands = 8;
+	} else {
+		operands = _internal_size_of_value_list (xmmsv_coll_operands_get (coll), compact);
+	}
+
+	if (attrs < 0 || idlist < 0 || operands < 0) {
+		return -1;
+	}
+
+	return 4 + attrs + idlist + operands;
+}
+
+static int
+_internal_size_of_value_list (xmmsv_t *v, bool compact)
+{
+	xmmsv_type_t type;
+	xmmsv_t *entry;
+	int i, size, ret, packed;
+	int32_t tag;
+
+	if (!_internal_list_encoding (v, compact, &tag, &packed)) {
+		return -1;
+	}
+	type = tag & XMMSV_SERIALIZE_LIST_TYPE_MASK;
+
+	if (tag & XMMSV_SERIALIZE_LIST_PACKED) {
+		return 12 + packed;
+	}
+
+	size = xmmsv_list_get_size (v);
+	ret = 8;
+
+	if (type == XMMSV_TYPE_INT64) {
+		return ret + 8 * size;
+	}
+
+	for (i = 0; i < size; i++) {
+		int s;
+
+		if (!xmmsv_list_get (v, i, &entry)) {
+			return -1;
+		}
+		if (type != XMMSV_TYPE_NONE) {
+			s = _internal_size_of_value_of_type (type, entry, compact);
+		} else {
+			s = _internal_size_of_value (entry, compact);
+		}
+		if (s < 0) {
+			return -1;
+		}
+		ret += s;
+	}
+
+	return ret;
+}
+
+static int
+_internal_size_of_value_dict (xmmsv_t *v, bool compact)
+{
+	xmmsv_dict_iter_t *it;
+	const char *key;
+	xmmsv_t *entry;
+	int s, ret = 4;
+
+	if (!xmmsv_get_dict_iter (v, &it)) {
+		return -1;
+	}
+
+	while (xmmsv_dict_iter_pair (it, &key, &entry)) {
+		s = _internal_size_of_value (entry, compact);
+		if (s < 0) {
+			return -1;
+		}
+		ret += _internal_size_of_string (key) + s;
+		xmmsv_dict_iter_next (it);
+	}
+
+	return ret;
+}
+
+static int
+_internal_size_of_value (xmmsv_t *v, bool compact)
+{
+	int size;
+
+	if (v->serialized) {
+		return _internal_size_of_serialized (v, compact);
+	}
+
+	size = _internal_size_of_value_of_type (xmmsv_get_type (v), v, compact);
+	if (size < 0) {
+		return -1;
+	}
+
+	return 4 + size;
+}
+
+static int
+_internal_size_of_value_of_type (xmmsv_type_t type, xmmsv_t *v, bool compact)
+{
+	const char *s;
+	const unsigned char *bc;
+	unsigned int bl;
+
+	switch (type) {
+	case XMMSV_TYPE_ERROR:
+		if (!xmmsv_get_error (v, &s)) {
+			return -1;
+		}
+		return _internal_size_of_string (s);
+	case XMMSV_TYPE_INT64:
+		return 8;
+	case XMMSV_TYPE_FLOAT:
+		return 8;
+	case XMMSV_TYPE_STRING:
+		if (!xmmsv_get_string (v, &s)) {
+			return -1;
+		}
+		return _internal_size_of_string (s);
+	case XMMSV_TYPE_COLL:
+		return _internal_size_of_collection (v, compact);
+	case XMMSV_TYPE_BIN:
+		if (!xmmsv_get_bin (v, &bc, &bl)) {
+			return -1;
+		}
+		return 4 + bl;
+	case XMMSV_TYPE_LIST:
+		return _internal_size_of_value_list (v, compact);
+	case XMMSV_TYPE_DICT:
+		return _internal_size_of_value_dict (v, compact);
+	case XMMSV_TYPE_NONE:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
 static bool
 _internal_get_from_bb_data (xmmsv_t *bb, void *buf, unsigned int len)
 {
@@ -340,6 +668,48 @@ _internal_get_from_bb_string_alloc (xmmsv_t *bb, char **buf,
 	return true;
 }
 
+/**
+ * Read a string in place when it is aligned and NUL terminated in the
+ * buffer, which is how the serializer writes them. Otherwise the
+ * position is left alone, and the caller falls back to copying it out.
+ */
+static bool
+_internal_get_from_bb_string_peek (xmmsv_t *bb, const char **str)
+{
+	const unsigned char *data;
+	int pos = xmmsv_bitbuffer_pos (bb);
+	int32_t l;
+
+	if (_internal_get_from_bb_int32_positive (bb, &l) && l > 0 &&
+	    (data = xmmsv_bitbuffer_peek_data (bb, l)) && data[l - 1] == '\0') {
+		*str = (const char *) data;
+		return true;
+	}
+
+	xmmsv_bitbuffer_goto (bb, pos);
+	return false;
+}
+
+/* Like _internal_get_from_bb_string_peek, for binary data */
+static bool
+_internal_get_from_bb_bin_peek (xmmsv_t *bb, const unsigned char **buf,
+                                unsigned int *len)
+{
+	const unsigned char *data;
+	int pos = xmmsv_bitbuffer_pos (bb);
+	int32_t l;
+
+	if (_internal_get_from_bb_int32_positive (bb, &l) &&
+	    (data = xmmsv_bitbuffer_peek_data (bb, l))) {
+		*buf = data;
+		*len = l;
+		return true;
+	}
+
+	xmmsv_bitbuffer_goto (bb, pos);
+	return false;
+}
+
 static bool
 _internal_get_from_bb_bin_alloc (xmmsv_t *bb,
                                  unsigned char **buf,
@@ -424,9 +794,15 @@ _internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_t **val)
 	}
 
 	while (len--) {
+		const char *peeked;
 		xmmsv_t *v;
 
-		if (!_internal_get_from_bb_string_alloc (bb, &key, &ignore)) {
+		/* the key is copied by the dict, so use it in place if possible */
+		if (_internal_get_from_bb_string_peek (bb, &peeked)) {
+			key = NULL;
+		} else if (_internal_get_from_bb_string_alloc (bb, &key, &ignore)) {
+			peeked = key;
+		} else {
 			goto err;
 		}
 
@@ -435,7 +811,7 @@ _internal_get_from_bb_value_dict_alloc (xmmsv_t *bb, xmmsv_t **val)
 			goto err;
 		}
 
-		xmmsv_dict_set (dict, key, v);
+		xmmsv_dict_set (dict, peeked, v);
 		free (key);
 		xmmsv_unref (v);
 	}
@@ -450,11 +826,49 @@ err:
 	return false;
 }
 
+static bool
+_internal_get_from_bb_packed_int_list (xmmsv_t *bb, xmmsv_t *list, int32_t count)
+{
+	const unsigned char *p, *end;
+	int64_t i = 0;
+	uint64_t z;
+	int32_t len;
+	int shift;
+
+	if (!_internal_get_from_bb_int32_positive (bb, &len)) {
+		return false;
+	}
+
+	/* decoded straight from the message */
+	p = xmmsv_bitbuffer_peek_data (bb, len);
+	if (!p) {
+		return false;
+	}
+	end = p + len;
+
+	while (count--) {
+		z = 0;
+		shift = 0;
+		do {
+			if (p == end || shift > 63) {
+				return false;
+			}
+			z |= (uint64_t) (*p & 0x7f) << shift;
+			shift += 7;
+		} while (*p++ & 0x80);
+
+		i = (int64_t) ((uint64_t) i + ((z >> 1) ^ -(z & 1)));
+		xmmsv_list_append_int (list, i);
+	}
+
+	return p == end;
+}
+
 static bool
 _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val)
 {
 	xmmsv_t *list;
-	int32_t len, type;
+	int32_t len, type, flags;
 
 	list = xmmsv_new_list ();
 
@@ -466,10 +880,32 @@ _internal_get_from_bb_value_list_alloc (xmmsv_t *bb, xmmsv_t **val)
 		goto err;
 	}
 
-	/* If list is restricted, avoid reading type for each entry */
-	if (type != XMMSV_TYPE_NONE) {
+	flags = type & ~XMMSV_SERIALIZE_LIST_TYPE_MASK;
+	type &= XMMSV_SERIALIZE_LIST_TYPE_MASK;
+
+	if (flags & ~(XMMSV_SERIALIZE_LIST_PACKED | XMMSV_SERIALIZE_LIST_UNRESTRICTED)) {
+		goto err;
+	}
+
+	if (type != XMMSV_TYPE_NONE && !(flags & XMMSV_SERIALIZE_LIST_UNRESTRICTED)) {
 		xmmsv_list_restrict_type (list, type);
+	}
 
+	/* If all entries have the same type, avoid reading it for each entry */
+	if (flags & XMMSV_SERIALIZE_LIST_PACKED) {
+		if (type != XMMSV_TYPE_INT64 ||
+		    !_internal_get_from_bb_packed_int_list (bb, list, len)) {
+			goto err;
+		}
+	} else if (type == XMMSV_TYPE_INT64) {
+		while (len--) {
+			int64_t i;
+			if (!_internal_get_from_bb_int64 (bb, &i)) {
+				goto err;
+			}
+			xmmsv_list_append_int (list, i);
+		}
+	} else if (type != XMMSV_TYPE_NONE) {
 		while (len--) {
 			xmmsv_t *v;
 			if (!_internal_get_from_bb_value_of_type_alloc (bb, type, &v)) {
@@ -507,10 +943,16 @@ _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
 	float f;
 	uint32_t len;
 	char *s;
+	const char *cs;
 	unsigned char *d;
+	const unsigned char *cd;
 
 	switch (type) {
 		case XMMSV_TYPE_ERROR:
+			if (_internal_get_from_bb_string_peek (bb, &cs)) {
+				*val = xmmsv_new_error (cs);
+				break;
+			}
 			if (!_internal_get_from_bb_error_alloc (bb, &s, &len)) {
 				return false;
 			}
@@ -530,6 +972,11 @@ _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
 			*val = xmmsv_new_float (f);
 			break;
 		case XMMSV_TYPE_STRING:
+			/* copied once, by the new value */
+			if (_internal_get_from_bb_string_peek (bb, &cs)) {
+				*val = xmmsv_new_string (cs);
+				break;
+			}
 			if (!_internal_get_from_bb_string_alloc (bb, &s, &len)) {
 				return false;
 			}
@@ -555,6 +1002,10 @@ _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
 			break;
 
 		case XMMSV_TYPE_BIN:
+			if (_internal_get_from_bb_bin_peek (bb, &cd, &len)) {
+				*val = xmmsv_new_bin (cd, len);
+				break;
+			}
 			if (!_internal_get_from_bb_bin_alloc (bb, &d, &len)) {
 				return false;
 			}
@@ -574,7 +1025,8 @@ _internal_get_from_bb_value_of_type_alloc (xmmsv_t *bb, xmmsv_type_t type,
 }
 
 static bool
-_internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *v)
+_internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *v,
+                                   bool compact)
 {
 	bool ret = true;
 	int64_t i;
@@ -609,7 +1061,7 @@ _internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *v)
 		ret = _internal_put_on_bb_string (bb, s);
 		break;
 	case XMMSV_TYPE_COLL:
-		ret = _internal_put_on_bb_collection (bb, v);
+		ret = _internal_put_on_bb_collection (bb, v, compact);
 		break;
 	case XMMSV_TYPE_BIN:
 		if (!xmmsv_get_bin (v, &bc, &bl)) {
@@ -618,10 +1070,10 @@ _internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *v)
 		ret = _internal_put_on_bb_bin (bb, bc, bl);
 		break;
 	case XMMSV_TYPE_LIST:
-		ret = _internal_put_on_bb_value_list (bb, v);
+		ret = _internal_put_on_bb_value_list (bb, v, compact);
 		break;
 	case XMMSV_TYPE_DICT:
-		ret = _internal_put_on_bb_value_dict (bb, v);
+		ret = _internal_put_on_bb_value_dict (bb, v, compact);
 		break;
 	case XMMSV_TYPE_NONE:
 		break;
@@ -633,18 +1085,134 @@ _internal_put_on_bb_value_of_type (xmmsv_t *bb, xmmsv_type_t type, xmmsv_t *v)
 	return ret;
 }
 
-int
-xmmsv_bitbuffer_serialize_value (xmmsv_t *bb, xmmsv_t *v)
+static bool
+_internal_put_on_bb_value (xmmsv_t *bb, xmmsv_t *v, bool compact)
 {
 	int32_t type = xmmsv_get_type (v);
 
+	if (v->serialized) {
+		return _internal_put_on_bb_serialized (bb, v, compact);
+	}
+
 	if (!_internal_put_on_bb_int32 (bb, type)) {
 		return false;
 	}
 
-	return _internal_put_on_bb_value_of_type (bb, type, v);
+	return _internal_put_on_bb_value_of_type (bb, type, v, compact);
+}
+
+/* A value from xmmsv_new_serialized is written out as it is, unless it
+ * is in the compact encoding and the reader doesn't know about that. */
+static bool
+_internal_serialized_needs_decoding (xmmsv_t *v, bool compact)
+{
+	return v->serialized == XMMSV_SERIALIZED_COMPACT && !compact;
+}
+
+static int
+_internal_size_of_serialized (xmmsv_t *v, bool compact)
+{
+	xmmsv_t *decoded;
+	int size;
+
+	if (!_internal_serialized_needs_decoding (v, compact)) {
+		return v->value.bin.len;
+	}
+
+	decoded = xmmsv_deserialize (v);
+	if (!decoded) {
+		return -1;
+	}
+	size = _internal_size_of_value (decoded, compact);
+	xmmsv_unref (decoded);
+
+	return size;
+}
+
+static bool
+_internal_put_on_bb_serialized (xmmsv_t *bb, xmmsv_t *v, bool compact)
+{
+	xmmsv_t *decoded;
+	bool ret;
+
+	if (!_internal_serialized_needs_decoding (v, compact)) {
+		return xmmsv_bitbuffer_put_data (bb, v->value.bin.data,
+		                                 v->value.bin.len);
+	}
+
+	decoded = xmmsv_deserialize (v);
+	if (!decoded) {
+		return false;
+	}
+	ret = _internal_put_on_bb_value (bb, decoded, compact);
+	xmmsv_unref (decoded);
+
+	return ret;
+}
+
+/**
+ * Wrap the bytes of a serialized value, type tag included, so that
+ * serializing the wrapper writes them out again without decoding
+ * them. It reads as a bin of those bytes, which #xmmsv_deserialize
+ * turns back into the value. It is only written as it is when it is
+ * serialized on its own, in a dict or in a list of mixed types.
+ *
+ * @param data The serialized value.
+ * @param len The length of data.
+ * @param compact Whether data may use the compact encoding.
+ * @return The wrapper, or NULL on failure.
+ */
+xmmsv_t *
+xmmsv_new_serialized (const unsigned char *data, unsigned int len, int compact)
+{
+	xmmsv_t *val;
+
+	val = xmmsv_new_bin (data, len);
+	if (val) {
+		val->serialized = compact ? XMMSV_SERIALIZED_COMPACT
+		                          : XMMSV_SERIALIZED_PLAIN;
+	}
+
+	return val;
+}
+
+int
+xmmsv_bitbuffer_serialize_value (xmmsv_t *bb, xmmsv_t *v)
+{
+	return _internal_put_on_bb_value (bb, v, false);
+}
+
+/**
+ * Like #xmmsv_bitbuffer_serialize_value, but using the compact
+ * encoding for integer lists where it is smaller. Only for readers
+ * that know about it, which is any deserializer since protocol
+ * version 29.
+ */
+int
+xmmsv_bitbuffer_serialize_value_compact (xmmsv_t *bb, xmmsv_t *v)
+{
+	return _internal_put_on_bb_value (bb, v, true);
+}
+
+
+/**
+ * Compute the number of bytes #xmmsv_bitbuffer_serialize_value writes
+ * for a value, so the buffer can be allocated once up front.
+ *
+ * @return The size in bytes, or -1 if the value can't be serialized.
+ */
+int
+xmmsv_bitbuffer_serialized_size (xmmsv_t *v)
+{
+	return _internal_size_of_value (v, false);
 }
 
+/* Like xmmsv_bitbuffer_serialized_size, for the compact encoding */
+int
+xmmsv_bitbuffer_serialized_size_compact (xmmsv_t *v)
+{
+	return _internal_size_of_value (v, true);
+}
 
 int
 xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val)
@@ -658,16 +1226,80 @@ xmmsv_bitbuffer_deserialize_value (xmmsv_t *bb, xmmsv_t **val)
 	return _internal_get_from_bb_value_of_type_alloc (bb, type, val);
 }
 
+/**
+ * Like #xmmsv_bitbuffer_deserialize_value for a list that ends the
+ * buffer, but keeping its last entry serialized as
+ * #xmmsv_new_serialized does. For arguments that are only passed on
+ * to another reader, which will decode them itself.
+ *
+ * Lists restricted to a type are decoded entirely.
+ *
+ * @param compact Whether the buffer may use the compact encoding.
+ */
+int
+xmmsv_bitbuffer_deserialize_list_keep_last (xmmsv_t *bb, int compact,
+                                            xmmsv_t **val)
+{
+	xmmsv_t *list, *entry;
+	int32_t type, tag, len;
+	int start, pos;
+
+	start = xmmsv_bitbuffer_pos (bb);
+
+	if (!_internal_get_from_bb_int32 (bb, &type) || type != XMMSV_TYPE_LIST ||
+	    !_internal_get_from_bb_int32 (bb, &tag) || tag != XMMSV_TYPE_NONE ||
+	    !_internal_get_from_bb_int32_positive (bb, &len) || len < 1) {
+		xmmsv_bitbuffer_goto (bb, start);
+		return xmmsv_bitbuffer_deserialize_value (bb, val);
+	}
+
+	list = xmmsv_new_list ();
+
+	while (--len) {
+		if (!xmmsv_bitbuffer_deserialize_value (bb, &entry)) {
+			xmmsv_unref (list);
+			return false;
+		}
+		xmmsv_list_append (list, entry);
+		xmmsv_unref (entry);
+	}
+
+	/* the last entry is whatever is left, at least a type tag */
+	pos = xmmsv_bitbuffer_pos (bb);
+	if (pos % 8 || xmmsv_bitbuffer_len (bb) - pos < 32) {
+		xmmsv_unref (list);
+		return false;
+	}
+
+	entry = xmmsv_new_serialized (xmmsv_bitbuffer_buffer (bb) + pos / 8,
+	                              (xmmsv_bitbuffer_len (bb) - pos) / 8,
+	                              compact);
+	xmmsv_list_append (list, entry);
+	xmmsv_unref (entry);
+
+	xmmsv_bitbuffer_end (bb);
+
+	*val = list;
+
+	return true;
+}
+
 
 xmmsv_t *
 xmmsv_serialize (xmmsv_t *v)
 {
 	xmmsv_t *bb, *res;
+	int size;
 
 	if (!v)
 		return NULL;
 
+	size = xmmsv_bitbuffer_serialized_size (v);
+	if (size < 0)
+		return NULL;
+
 	bb = xmmsv_new_bitbuffer ();
+	xmmsv_bitbuffer_reserve (bb, size * 8);
 
 	if (!xmmsv_bitbuffer_serialize_value (bb, v)) {
 		xmmsv_unref (bb);
@@ -0,0 +1,171 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <xmmscpriv/xmmsv.h>
+#include <xmmscpriv/xmmsc_util.h>
+
+/* Values are bump allocated from chunks, each allocation is prefixed
+ * with its chunk. A chunk counts its live allocations plus one for the
+ * arena while it is still allocating from it, and is freed when that
+ * count drops to zero. Values that outlive the tree they were built in
+ * only keep their own chunk around.
+ */
+#define CHUNK_SIZE (16 * 1024)
+#define ALLOC_MAX (CHUNK_SIZE / 8)
+#define ALIGN(n) (((n) + 7) & ~((size_t) 7))
+
+typedef struct xmmsv_arena_chunk_St {
+	int live;
+	size_t used;
+	char data[];
+} xmmsv_arena_chunk_t;
+
+struct xmmsv_arena_St {
+	xmmsv_arena_chunk_t *chunk;
+};
+
+static __thread xmmsv_arena_t *current_arena;
+
+static void
+_xmmsv_arena_chunk_unref (xmmsv_arena_chunk_t *chunk)
+{
+	if (__atomic_sub_fetch (&chunk->live, 1, __ATOMIC_ACQ_REL) == 0) {
+		free (chunk);
+	}
+}
+
+/**
+ * Allocate a new arena. Values are only allocated from it while it is
+ * in use by a thread, see #xmmsv_arena_use.
+ *
+ * @return The new arena, to be released with #xmmsv_arena_release.
+ */
+xmmsv_arena_t *
+xmmsv_arena_new (void)
+{
+	xmmsv_arena_t *arena;
+
+	arena = x_new0 (xmmsv_arena_t, 1);
+	if (!arena) {
+		x_oom ();
+	}
+
+	return arena;
+}
+
+/**
+ * Allocate the values created by the calling thread from an arena,
+ * until another arena (or NULL) is used.
+ *
+ * @param arena The arena to use, or NULL to go back to malloc.
+ * @return The arena that was in use before.
+ */
+xmmsv_arena_t *
+xmmsv_arena_use (xmmsv_arena_t *arena)
+{
+	xmmsv_arena_t *prev = current_arena;
+
+	current_arena = arena;
+
+	return prev;
+}
+
+/**
+ * Get the arena the calling thread allocates values from.
+ *
+ * @return The arena in use, or NULL.
+ */
+xmmsv_arena_t *
+xmmsv_arena_current (void)
+{
+	return current_arena;
+}
+
+/**
+ * Stop allocating from an arena. The values allocated from it stay
+ * valid, and its memory is returned as they are unreferenced.
+ *
+ * @param arena The arena to release, it must not be in use.
+ */
+void
+xmmsv_arena_release (xmmsv_arena_t *arena)
+{
+	x_return_if_fail (arena);
+	x_api_error_if (arena == current_arena, "releasing an arena in use", );
+
+	if (arena->chunk) {
+		_xmmsv_arena_chunk_unref (arena->chunk);
+	}
+
+	free (arena);
+}
+
+/**
+ * Allocate memory for a value from the arena in use by this thread.
+ *
+ * @return The memory, or NULL if no arena is in use or size is too big
+ * for one, in which case the caller should use malloc.
+ */
+void *
+_xmmsv_arena_alloc (size_t size)
+{
+	xmmsv_arena_t *arena = current_arena;
+	xmmsv_arena_chunk_t *chunk;
+	xmmsv_arena_chunk_t **ret;
+
+	size = ALIGN (size + sizeof (xmmsv_arena_chunk_t *));
+
+	if (!arena || size > ALLOC_MAX) {
+		return NULL;
+	}
+
+	chunk = arena->chunk;
+	if (!chunk || chunk->used + size > CHUNK_SIZE) {
+		chunk = malloc (sizeof (xmmsv_arena_chunk_t) + CHUNK_SIZE);
+		if (!chunk) {
+			return NULL;
+		}
+		chunk->live = 1;
+		chunk->used = 0;
+
+		if (arena->chunk) {
+			_xmmsv_arena_chunk_unref (arena->chunk);
+		}
+		arena->chunk = chunk;
+	}
+
+	ret = (xmmsv_arena_chunk_t **) (chunk->data + chunk->used);
+	chunk->used += size;
+	__atomic_add_fetch (&chunk->live, 1, __ATOMIC_RELAXED);
+
+	*ret = chunk;
+
+	return ret + 1;
+}
+
+/**
+ * Return memory from #_xmmsv_arena_alloc, from any thread.
+ */
+void
+_xmmsv_arena_free (void *ptr)
+{
+	xmmsv_arena_chunk_t **chunk = ptr;
+
+	_xmmsv_arena_chunk_unref (chunk[-1]);
+}
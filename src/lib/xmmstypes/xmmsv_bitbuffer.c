@@ -75,38 +75,45 @@ xmmsv_new_bitbuffer (void)
 int
 xmmsv_bitbuffer_get_bits (xmmsv_t *v, int bits, int64_t *res)
 {
-	int64_t r, t;
-	int i;
+	const unsigned char *buf = v->value.bit.buf;
+	int pos = v->value.bit.pos;
+	uint64_t r = 0;
 
 	x_api_error_if (bits < 1, "less than one bit requested", 0);
 
-	if (bits == 1) {
-		int pos = v->value.bit.pos;
+	if (bits > v->value.bit.len - pos)
+		return 0;
 
-		if (pos >= v->value.bit.len)
-			return 0;
-		r = (v->value.bit.buf[pos / 8] >> (7-(pos % 8)) & 1);
-		v->value.bit.pos += 1;
-		*res = r;
-		return 1;
-	}
+	/* take the bits left in the current byte at a time, whole bytes
+	 * when the position is aligned */
+	while (bits > 0) {
+		int avail = 8 - (pos % 8);
+		int take = bits < avail ? bits : avail;
 
-	r = 0;
-	for (i = 0; i < bits; i++) {
-		t = 0;
-		if (!xmmsv_bitbuffer_get_bits (v, 1, &t))
-			return 0;
-		r = (r << 1) | t;
+		r = (r << take) | ((buf[pos / 8] >> (avail - take)) & ((1 << take) - 1));
+		pos += take;
+		bits -= take;
 	}
-	*res = r;
+
+	v->value.bit.pos = pos;
+	*res = (int64_t) r;
 	return 1;
 }
 
 int
 xmmsv_bitbuffer_get_data (xmmsv_t *v, unsigned char *b, int len)
 {
+	int64_t t;
+
+	if (v->value.bit.pos % 8 == 0) {
+		if (len > (v->value.bit.len - v->value.bit.pos) / 8)
+			return 0;
+		memcpy (b, v->value.bit.buf + v->value.bit.pos / 8, len);
+		v->value.bit.pos += len * 8;
+		return 1;
+	}
+
 	while (len) {
-		int64_t t;
 		if (!xmmsv_bitbuffer_get_bits (v, 8, &t))
 			return 0;
 		*b = t;
@@ -116,46 +123,113 @@ xmmsv_bitbuffer_get_data (xmmsv_t *v, unsigned char *b, int len)
 	return 1;
 }
 
+/**
+ * Read len bytes without copying them.
+ *
+ * @return A pointer into the buffer, valid until it is written to, or
+ * NULL if the position isn't byte aligned or there are too few bytes.
+ */
+const unsigned char *
+xmmsv_bitbuffer_peek_data (xmmsv_t *v, int len)
+{
+	const unsigned char *ret;
+
+	if (v->value.bit.pos % 8 != 0 || len < 0 ||
+	    len > (v->value.bit.len - v->value.bit.pos) / 8)
+		return NULL;
+
+	ret = v->value.bit.buf + v->value.bit.pos / 8;
+	v->value.bit.pos += len * 8;
+	return ret;
+}
+
+/**
+ * Make room for bits more bits at the current position, so writing
+ * them doesn't have to grow the buffer again.
+ */
+int
+xmmsv_bitbuffer_reserve (xmmsv_t *v, int bits)
+{
+	unsigned char *buf;
+	int ol, nl;
+
+	x_api_error_if (v->value.bit.ro || v->frozen, "write to readonly bitbuffer", 0);
+
+	if (v->value.bit.pos + bits <= v->value.bit.alloclen)
+		return 1;
+
+	ol = v->value.bit.alloclen;
+	nl = ol * 2;
+	nl = nl < 128 ? 128 : nl;
+	nl = nl < v->value.bit.pos + bits ? v->value.bit.pos + bits : nl;
+	nl = (nl + 7) & ~7;
+
+	buf = realloc (v->value.bit.buf, nl / 8);
+	if (!buf) {
+		x_oom ();
+		return 0;
+	}
+
+	memset (buf + ol / 8, 0, (nl - ol) / 8);
+	v->value.bit.buf = buf;
+	v->value.bit.alloclen = nl;
+	return 1;
+}
+
+/**
+ * Append len zeroed bytes to the buffer, to be filled in place through
+ * #xmmsv_bitbuffer_buffer, for example straight from a socket. The
+ * position is left at the end of the buffer.
+ */
+int
+xmmsv_bitbuffer_extend (xmmsv_t *v, int len)
+{
+	x_api_error_if (v->value.bit.ro || v->frozen, "write to readonly bitbuffer", 0);
+	x_api_error_if (len < 0, "negative length", 0);
+	x_api_error_if (v->value.bit.len % 8, "unaligned bitbuffer", 0);
+
+	/* nothing is ever written past the end, so the space is zeroed */
+	v->value.bit.pos = v->value.bit.len;
+	if (!xmmsv_bitbuffer_reserve (v, len * 8))
+		return 0;
+
+	v->value.bit.len += len * 8;
+	v->value.bit.pos = v->value.bit.len;
+	return 1;
+}
+
 int
 xmmsv_bitbuffer_put_bits (xmmsv_t *v, int bits, int64_t d)
 {
-	unsigned char t;
+	uint64_t ud = (uint64_t) d;
+	unsigned char *p;
 	int pos;
-	int i;
 
-	x_api_error_if (v->value.bit.ro, "write to readonly bitbuffer", 0);
+	x_api_error_if (v->value.bit.ro || v->frozen, "write to readonly bitbuffer", 0);
 	x_api_error_if (bits < 1, "less than one bit requested", 0);
 
-	if (bits == 1) {
-		pos = v->value.bit.pos;
-
-		if (pos >= v->value.bit.alloclen) {
-			int ol, nl;
-			nl = v->value.bit.alloclen * 2;
-			ol = v->value.bit.alloclen;
-			nl = nl < 128 ? 128 : nl;
-			nl = (nl + 7) & ~7;
-			v->value.bit.buf = realloc (v->value.bit.buf, nl / 8);
-			memset (v->value.bit.buf + ol / 8, 0, (nl - ol) / 8);
-			v->value.bit.alloclen = nl;
-		}
-		t = v->value.bit.buf[pos / 8];
-
-		t = (t & (~(1<<(7-(pos % 8))))) | (d << (7-(pos % 8)));
+	if (!xmmsv_bitbuffer_reserve (v, bits))
+		return 0;
 
-		v->value.bit.buf[pos / 8] = t;
+	pos = v->value.bit.pos;
 
-		v->value.bit.pos += 1;
-		if (v->value.bit.pos > v->value.bit.len)
-			v->value.bit.len = v->value.bit.pos;
-		return 1;
-	}
+	/* fill the rest of the current byte at a time, most significant
+	 * bits first */
+	while (bits > 0) {
+		int avail = 8 - (pos % 8);
+		int take = bits < avail ? bits : avail;
+		int shift = avail - take;
+		unsigned char mask = ((1 << take) - 1) << shift;
 
-	for (i = 0; i < bits; i++) {
-		if (!xmmsv_bitbuffer_put_bits (v, 1, !!(d & (1LL << (bits-i-1)))))
-			return 0;
+		p = v->value.bit.buf + pos / 8;
+		*p = (*p & ~mask) | (((ud >> (bits - take)) << shift) & mask);
+		pos += take;
+		bits -= take;
 	}
 
+	v->value.bit.pos = pos;
+	if (v->value.bit.pos > v->value.bit.len)
+		v->value.bit.len = v->value.bit.pos;
 	return 1;
 }
 
@@ -174,10 +248,20 @@ xmmsv_bitbuffer_put_bits_at (xmmsv_t *v, int bits, int64_t d, int offset)
 int
 xmmsv_bitbuffer_put_data (xmmsv_t *v, const unsigned char *b, int len)
 {
+	x_api_error_if (v->value.bit.ro || v->frozen, "write to readonly bitbuffer", 0);
+
+	if (v->value.bit.pos % 8 == 0) {
+		if (!xmmsv_bitbuffer_reserve (v, len * 8))
+			return 0;
+		memcpy (v->value.bit.buf + v->value.bit.pos / 8, b, len);
+		v->value.bit.pos += len * 8;
+		if (v->value.bit.pos > v->value.bit.len)
+			v->value.bit.len = v->value.bit.pos;
+		return 1;
+	}
+
 	while (len) {
-		int t;
-		t = *b;
-		if (!xmmsv_bitbuffer_put_bits (v, 8, t))
+		if (!xmmsv_bitbuffer_put_bits (v, 8, *b))
 			return 0;
 		b++;
 		len--;
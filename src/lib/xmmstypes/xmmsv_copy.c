@@ -24,8 +24,30 @@ static xmmsv_t *duplicate_dict_value (xmmsv_t *val);
 static xmmsv_t *duplicate_list_value (xmmsv_t *val);
 static xmmsv_t *duplicate_coll_value (xmmsv_t *val);
 
+/* Copy an element of a container, immutable values are shared */
+static xmmsv_t *
+copy_element (xmmsv_t *val)
+{
+	switch (xmmsv_get_type (val)) {
+		case XMMSV_TYPE_NONE:
+		case XMMSV_TYPE_ERROR:
+		case XMMSV_TYPE_INT64:
+		case XMMSV_TYPE_FLOAT:
+		case XMMSV_TYPE_STRING:
+		case XMMSV_TYPE_BIN:
+			return xmmsv_ref (val);
+		default:
+			return xmmsv_copy (val);
+	}
+}
+
 /**
- * Return a new value object which is a deep copy of the input value
+ * Return a new value object which is a copy of the input value.
+ *
+ * Lists, dicts and collections are always duplicated, so the copy can
+ * be modified without affecting the original. Values that can't be
+ * modified, like strings and integers, are shared with the original,
+ * as is the array of integer lists until one of the lists changes.
  *
  * @param val #xmmsv_t to copy.
  * @return 1 the address to the new copy of the value.
@@ -95,7 +117,7 @@ duplicate_dict_value (xmmsv_t *val)
 	x_return_val_if_fail (xmmsv_get_dict_iter (val, &it), NULL);
 	dup_val = xmmsv_new_dict ();
 	while (xmmsv_dict_iter_pair (it, &key, &v)) {
-		new_elem = xmmsv_copy (v);
+		new_elem = copy_element (v);
 		xmmsv_dict_set (dup_val, key, new_elem);
 		xmmsv_unref (new_elem);
 		xmmsv_dict_iter_next (it);
@@ -111,13 +133,35 @@ duplicate_list_value (xmmsv_t *val)
 {
 	xmmsv_t *dup_val;
 	xmmsv_list_iter_t *it;
+	xmmsv_type_t type;
 	xmmsv_t *v;
 	xmmsv_t *new_elem;
 
+	dup_val = _xmmsv_list_copy_packed (val);
+	if (dup_val) {
+		return dup_val;
+	}
+
 	x_return_val_if_fail (xmmsv_get_list_iter (val, &it), NULL);
 	dup_val = xmmsv_new_list ();
+
+	/* integer lists are copied without boxing, and stay packed */
+	if (xmmsv_list_get_type (val, &type) && type == XMMSV_TYPE_INT64) {
+		int64_t i;
+
+		xmmsv_list_restrict_type (dup_val, type);
+		while (xmmsv_list_iter_entry_int64 (it, &i)) {
+			xmmsv_list_append_int (dup_val, i);
+			xmmsv_list_iter_next (it);
+		}
+
+		xmmsv_list_iter_explicit_destroy (it);
+
+		return dup_val;
+	}
+
 	while (xmmsv_list_iter_entry (it, &v)) {
-		new_elem = xmmsv_copy (v);
+		new_elem = copy_element (v);
 		xmmsv_list_append (dup_val, new_elem);
 		xmmsv_unref (new_elem);
 		xmmsv_list_iter_next (it);
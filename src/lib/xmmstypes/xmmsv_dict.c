@@ -22,6 +22,7 @@
 
 typedef struct xmmsv_dict_data_St {
 	uint32_t hash;
+	bool interned; /* str is owned by the intern table */
 	char *str;
 	xmmsv_t *value;
 } xmmsv_dict_data_t;
@@ -32,6 +33,8 @@ struct xmmsv_dict_internal_St {
 	xmmsv_dict_data_t *data;
 
 	x_list_t *iterators;
+	char iter_lock;
+	bool frozen;
 };
 
 struct xmmsv_dict_iter_St {
@@ -44,9 +47,30 @@ static void _xmmsv_dict_iter_free (xmmsv_dict_iter_t *it);
 #define HASH_MASK(table) ((1 << (table)->size) - 1)
 #define HASH_FILL_LIM 7
 #define DELETED_STR ((char*)-1)
-#define DICT_INIT_DATA(s) {.hash = _xmmsv_dict_hash (s, strlen (s)), .str = (char*)s}
+#define DICT_INIT_DATA(s) _xmmsv_dict_data_init (s)
 #define START_SIZE 2
 
+/* Interned keys are never freed and shared by every dict using them.
+ * The table has a fixed size so that lookups don't need the lock, and
+ * a small cache maps interned pointers back to their record so that
+ * their hash doesn't have to be computed again.
+ */
+#define INTERN_SLOTS 4096
+#define INTERN_MAX (INTERN_SLOTS / 2)
+#define INTERN_MAX_LEN 64
+#define INTERN_CACHE_SLOTS 256
+#define INTERN_CACHE_POS(s) (((uintptr_t) (s) >> 3) & (INTERN_CACHE_SLOTS - 1))
+
+typedef struct xmmsv_interned_St {
+	uint32_t hash;
+	char str[];
+} xmmsv_interned_t;
+
+static xmmsv_interned_t *interned[INTERN_SLOTS];
+static xmmsv_interned_t *interned_cache[INTERN_CACHE_SLOTS];
+static int interned_count;
+static char interned_lock;
+
 /* MurmurHash2, by Austin Appleby */
 static uint32_t
 _xmmsv_dict_hash (const void *key, int len)
@@ -101,6 +125,118 @@ _xmmsv_dict_hash (const void *key, int len)
 	return h;
 }
 
+static xmmsv_interned_t *
+_xmmsv_dict_intern_find (const char *str, uint32_t hash, int *slot)
+{
+	xmmsv_interned_t *rec;
+	int pos = hash & (INTERN_SLOTS - 1);
+
+	while ((rec = __atomic_load_n (&interned[pos], __ATOMIC_ACQUIRE))) {
+		if (rec->hash == hash && strcmp (rec->str, str) == 0) {
+			return rec;
+		}
+		pos = (pos + 1) & (INTERN_SLOTS - 1);
+	}
+
+	if (slot) {
+		*slot = pos;
+	}
+
+	return NULL;
+}
+
+static xmmsv_interned_t *
+_xmmsv_dict_intern_cached (const char *str)
+{
+	xmmsv_interned_t *rec;
+
+	rec = __atomic_load_n (&interned_cache[INTERN_CACHE_POS (str)],
+	                       __ATOMIC_ACQUIRE);
+	if (rec && rec->str == str) {
+		return rec;
+	}
+
+	return NULL;
+}
+
+static xmmsv_dict_data_t
+_xmmsv_dict_data_init (const char *key)
+{
+	xmmsv_dict_data_t data = { 0 };
+	xmmsv_interned_t *rec;
+
+	rec = _xmmsv_dict_intern_cached (key);
+	if (rec) {
+		data.hash = rec->hash;
+		data.interned = true;
+	} else {
+		data.hash = _xmmsv_dict_hash (key, strlen (key));
+	}
+	data.str = (char *) key;
+
+	return data;
+}
+
+/**
+ * Intern a string for use as a dict key. Dicts store interned keys
+ * without copying them, whether they are set through the returned
+ * pointer or not, and passing the returned pointer saves hashing and
+ * comparing the key on every access.
+ *
+ * The table is bounded, so this is meant for the small set of keys
+ * that are used over and over, like property names.
+ *
+ * @param str The string to intern.
+ * @return A pointer valid for the lifetime of the process, or NULL if
+ * the string is too long or the table is full.
+ */
+const char *
+xmmsv_intern_string (const char *str)
+{
+	xmmsv_interned_t *rec;
+	uint32_t hash;
+	int len, slot;
+
+	x_return_val_if_fail (str, NULL);
+
+	rec = _xmmsv_dict_intern_cached (str);
+	if (rec) {
+		return rec->str;
+	}
+
+	len = strlen (str);
+	if (len > INTERN_MAX_LEN) {
+		return NULL;
+	}
+
+	hash = _xmmsv_dict_hash (str, len);
+	rec = _xmmsv_dict_intern_find (str, hash, NULL);
+
+	if (!rec) {
+		_xmmsv_spin_lock (&interned_lock);
+		rec = _xmmsv_dict_intern_find (str, hash, &slot);
+		if (!rec && interned_count < INTERN_MAX) {
+			rec = malloc (sizeof (xmmsv_interned_t) + len + 1);
+			if (rec) {
+				rec->hash = hash;
+				memcpy (rec->str, str, len + 1);
+				__atomic_store_n (&interned[slot], rec, __ATOMIC_RELEASE);
+				interned_count++;
+			}
+		}
+		_xmmsv_spin_unlock (&interned_lock);
+
+		if (!rec) {
+			return NULL;
+		}
+	}
+
+	__atomic_store_n (&interned_cache[INTERN_CACHE_POS (rec->str)], rec,
+	                  __ATOMIC_RELEASE);
+
+	return rec->str;
+}
+
 /* Searches the hash table for an entry matching the hash and string in data.
  * It will save the found position in pos.
  * If a deleted position was found before the key, it will be saved in deleted
@@ -123,8 +259,9 @@ _xmmsv_dict_search (xmmsv_dict_internal_t *dict, xmmsv_dict_data_t data,
 				*deleted = bucket;
 			}
 			/* If we found the entry we save it in the pos pointer */
-		} else if (dict->data[bucket].hash == data.hash
-		           && strcmp (dict->data[bucket].str, data.str) == 0) {
+		} else if (dict->data[bucket].str == data.str
+		           || (dict->data[bucket].hash == data.hash
+		               && strcmp (dict->data[bucket].str, data.str) == 0)) {
 			*pos = bucket;
 			return 1;
 		}
@@ -158,9 +295,19 @@ _xmmsv_dict_insert (xmmsv_dict_internal_t *dict, xmmsv_dict_data_t data, int all
 		xmmsv_unref (dict->data[pos].value);
 		dict->data[pos].value = data.value;
 	} else {
-		/* Otherwise we insert a new entry */
-		if (alloc)
-			data.str = strdup (data.str);
+		/* Otherwise we insert a new entry, sharing the key if it
+		 * has been interned */
+		if (alloc && !data.interned) {
+			xmmsv_interned_t *rec;
+
+			rec = _xmmsv_dict_intern_find (data.str, data.hash, NULL);
+			if (rec) {
+				data.str = rec->str;
+				data.interned = true;
+			} else {
+				data.str = strdup (data.str);
+			}
+		}
 		dict->elems++;
 		/* If we found a deleted entry before an empty one we use the free entry */
 		if (deleted != -1) {
@@ -176,8 +323,11 @@ _xmmsv_dict_insert (xmmsv_dict_internal_t *dict, xmmsv_dict_data_t data, int all
 static void
 _xmmsv_dict_remove (xmmsv_dict_internal_t *dict, int pos)
 {
-	free ((void*)dict->data[pos].str);
+	if (!dict->data[pos].interned) {
+		free (dict->data[pos].str);
+	}
 	dict->data[pos].str = DELETED_STR;
+	dict->data[pos].interned = false;
 	xmmsv_unref (dict->data[pos].value);
 	dict->data[pos].value = NULL;
 	dict->elems--;
@@ -231,6 +381,24 @@ _xmmsv_dict_new (void)
 	return dict;
 }
 
+/**
+ * Stop reads from reordering the table and freeze the elements, so the
+ * dict can be shared between threads.
+ */
+void
+_xmmsv_dict_freeze (xmmsv_dict_internal_t *dict)
+{
+	int i;
+
+	dict->frozen = true;
+
+	for (i = 0; i < (1 << dict->size); i++) {
+		if (dict->data[i].str != NULL && dict->data[i].str != DELETED_STR) {
+			xmmsv_freeze (dict->data[i].value);
+		}
+	}
+}
+
 void
 _xmmsv_dict_free (xmmsv_dict_internal_t *dict)
 {
@@ -246,7 +414,9 @@ _xmmsv_dict_free (xmmsv_dict_internal_t *dict)
 	for (i = (1 << dict->size) - 1; i >= 0; i--) {
 		if (dict->data[i].str != NULL) {
 			if (dict->data[i].str != DELETED_STR) {
-				free (dict->data[i].str);
+				if (!dict->data[i].interned) {
+					free (dict->data[i].str);
+				}
 				xmmsv_unref (dict->data[i].value);
 			}
 			dict->data[i].str = NULL;
@@ -384,7 +554,7 @@ xmmsv_dict_get (xmmsv_t *dictv, const char *key, xmmsv_t **val)
 		 * deleted slot (and thus closer to the actual bucket it
 		 * belongs to)
 		 */
-		if (deleted != -1) {
+		if (deleted != -1 && !dict->frozen) {
 			dict->data[deleted] = dict->data[pos];
 			dict->data[pos].str = DELETED_STR;
 		}
@@ -419,9 +589,12 @@ xmmsv_dict_set (xmmsv_t *dictv, const char *key, xmmsv_t *val)
 	x_return_val_if_fail (xmmsv_is_type (dictv, XMMSV_TYPE_DICT), 0);
 
 	xmmsv_dict_data_t data = DICT_INIT_DATA (key);
-	data.value = xmmsv_ref (val);
 	dict = dictv->value.dict;
 
+	x_api_error_if (dict->frozen, "modifying a frozen dict", 0);
+
+	data.value = xmmsv_ref (val);
+
 	/* Resize if fill is too high */
 	if (((dict->elems * 10) >> dict->size) > HASH_FILL_LIM) {
 		_xmmsv_dict_resize (dict);
@@ -454,6 +627,8 @@ xmmsv_dict_remove (xmmsv_t *dictv, const char *key)
 	xmmsv_dict_data_t data = DICT_INIT_DATA (key);
 	dict = dictv->value.dict;
 
+	x_api_error_if (dict->frozen, "modifying a frozen dict", 0);
+
 	/* If we find the entry we free the string and mark it as deleted */
 	if (_xmmsv_dict_search (dict, data, &pos, &deleted)) {
 		_xmmsv_dict_remove (dict, pos);
@@ -480,13 +655,18 @@ xmmsv_dict_clear (xmmsv_t *dictv)
 
 	dict = dictv->value.dict;
 
+	x_api_error_if (dict->frozen, "modifying a frozen dict", 0);
+
 	for (i = (1 << dict->size) - 1; i >= 0; i--) {
 		if (dict->data[i].str != NULL) {
 			if (dict->data[i].str != DELETED_STR) {
-				free (dict->data[i].str);
+				if (!dict->data[i].interned) {
+					free (dict->data[i].str);
+				}
 				xmmsv_unref (dict->data[i].value);
 			}
 			dict->data[i].str = NULL;
+			dict->data[i].interned = false;
 		}
 	}
 
@@ -553,8 +733,10 @@ _xmmsv_dict_iter_new (xmmsv_dict_internal_t *d)
 	it->parent = d;
 	xmmsv_dict_iter_first (it);
 
-	/* register iterator into parent */
+	/* register iterator into parent, frozen dicts may be shared */
+	_xmmsv_spin_lock (&d->iter_lock);
 	d->iterators = x_list_prepend (d->iterators, it);
+	_xmmsv_spin_unlock (&d->iter_lock);
 
 	return it;
 }
@@ -563,7 +745,9 @@ static void
 _xmmsv_dict_iter_free (xmmsv_dict_iter_t *it)
 {
 	/* unref iterator from dict and free it */
+	_xmmsv_spin_lock (&it->parent->iter_lock);
 	it->parent->iterators = x_list_remove (it->parent->iterators, it);
+	_xmmsv_spin_unlock (&it->parent->iter_lock);
 	free (it);
 }
 
@@ -732,6 +916,7 @@ xmmsv_dict_iter_set (xmmsv_dict_iter_t *it, xmmsv_t *val)
 {
 	x_return_val_if_fail (xmmsv_dict_iter_valid (it), 0);
 	x_return_val_if_fail (val, 0);
+	x_api_error_if (it->parent->frozen, "modifying a frozen dict", 0);
 
 	/* In case old value is new value, ref first. */
 	xmmsv_ref (val);
@@ -751,6 +936,7 @@ int
 xmmsv_dict_iter_remove (xmmsv_dict_iter_t *it)
 {
 	x_return_val_if_fail (xmmsv_dict_iter_valid (it), 0);
+	x_api_error_if (it->parent->frozen, "modifying a frozen dict", 0);
 
 	_xmmsv_dict_remove (it->parent, it->pos);
 	xmmsv_dict_iter_next (it);
@@ -41,18 +41,26 @@ const char *xmmsv_default_source_pref[] = {
 
 
 /**
- * Allocates new #xmmsv_t and references it.
+ * Allocate a value with extra bytes of inline data after it, from the
+ * arena in use if any.
  * @internal
  */
-xmmsv_t *
-_xmmsv_new (xmmsv_type_t type)
+static xmmsv_t *
+_xmmsv_new_with_data (xmmsv_type_t type, size_t extra)
 {
 	xmmsv_t *val;
 
-	val = x_new0 (xmmsv_t, 1);
-	if (!val) {
-		x_oom ();
-		return NULL;
+	val = _xmmsv_arena_alloc (sizeof (xmmsv_t) + extra);
+	if (val) {
+		memset (val, 0, sizeof (xmmsv_t));
+		val->arena = true;
+	} else {
+		val = malloc (sizeof (xmmsv_t) + extra);
+		if (!val) {
+			x_oom ();
+			return NULL;
+		}
+		memset (val, 0, sizeof (xmmsv_t));
 	}
 
 	val->type = type;
@@ -60,6 +68,16 @@ _xmmsv_new (xmmsv_type_t type)
 	return xmmsv_ref (val);
 }
 
+/**
+ * Allocates new #xmmsv_t and references it.
+ * @internal
+ */
+xmmsv_t *
+_xmmsv_new (xmmsv_type_t type)
+{
+	return _xmmsv_new_with_data (type, 0);
+}
+
 /**
  * Free a #xmmsv_t along with its internal data.
  * @internal
@@ -80,7 +98,7 @@ _xmmsv_free (xmmsv_t *val)
 			val->value.error = NULL;
 			break;
 		case XMMSV_TYPE_STRING :
-			free (val->value.string);
+			/* stored inline */
 			val->value.string = NULL;
 			break;
 		case XMMSV_TYPE_COLL:
@@ -107,7 +125,11 @@ _xmmsv_free (xmmsv_t *val)
 			break;
 	}
 
-	free (val);
+	if (val->arena) {
+		_xmmsv_arena_free (val);
+	} else {
+		free (val);
+	}
 }
 
 
@@ -189,13 +211,17 @@ xmmsv_t *
 xmmsv_new_string (const char *s)
 {
 	xmmsv_t *val;
+	size_t len;
 
 	x_return_val_if_fail (s, NULL);
 	x_return_val_if_fail (xmmsv_utf8_validate (s), NULL);
 
-	val = _xmmsv_new (XMMSV_TYPE_STRING);
+	len = strlen (s) + 1;
+
+	val = _xmmsv_new_with_data (XMMSV_TYPE_STRING, len);
 	if (val) {
-		val->value.string = strdup (s);
+		val->value.string = (char *) (val + 1);
+		memcpy (val->value.string, s, len);
 	}
 
 	return val;
@@ -229,7 +255,8 @@ xmmsv_new_bin (const unsigned char *data, unsigned int len)
 }
 
 /**
- * References the #xmmsv_t
+ * References the #xmmsv_t. References are counted atomically, so
+ * threads may ref and unref a value they share.
  *
  * @param val the value to reference.
  * @return val
@@ -238,7 +265,7 @@ xmmsv_t *
 xmmsv_ref (xmmsv_t *val)
 {
 	x_return_val_if_fail (val, NULL);
-	val->ref++;
+	__atomic_add_fetch (&val->ref, 1, __ATOMIC_RELAXED);
 
 	return val;
 }
@@ -253,14 +280,69 @@ void
 xmmsv_unref (xmmsv_t *val)
 {
 	x_return_if_fail (val);
-	x_api_error_if (val->ref < 1, "with a freed value",);
+	x_api_error_if (__atomic_load_n (&val->ref, __ATOMIC_RELAXED) < 1,
+	                "with a freed value",);
 
-	val->ref--;
-	if (val->ref == 0) {
+	if (__atomic_sub_fetch (&val->ref, 1, __ATOMIC_ACQ_REL) == 0) {
 		_xmmsv_free (val);
 	}
 }
 
+/**
+ * Make the value and everything in it immutable. A frozen value can
+ * be read from several threads at once, as reading it no longer
+ * changes anything inside, and any attempt to modify it fails.
+ * Bitbuffers keep a read position and are not safe to share even
+ * when frozen. Freezing can't be undone, #xmmsv_copy gives a value
+ * that can be modified again.
+ *
+ * @param val the value to freeze.
+ * @return val
+ */
+xmmsv_t *
+xmmsv_freeze (xmmsv_t *val)
+{
+	x_return_val_if_fail (val, NULL);
+
+	if (val->frozen) {
+		return val;
+	}
+
+	switch (val->type) {
+		case XMMSV_TYPE_COLL:
+			_xmmsv_coll_freeze (val->value.coll);
+			break;
+		case XMMSV_TYPE_LIST:
+			_xmmsv_list_freeze (val->value.list);
+			break;
+		case XMMSV_TYPE_DICT:
+			_xmmsv_dict_freeze (val->value.dict);
+			break;
+		default:
+			break;
+	}
+
+	/* only once what is inside is, so a reader seeing the flag
+	   sees it all frozen */
+	__atomic_store_n (&val->frozen, true, __ATOMIC_RELEASE);
+
+	return val;
+}
+
+/**
+ * Check if the value was frozen with #xmmsv_freeze.
+ *
+ * @param val a #xmmsv_t
+ * @return 1 if the value is frozen, 0 otherwise.
+ */
+int
+xmmsv_is_frozen (const xmmsv_t *val)
+{
+	x_return_val_if_fail (val, 0);
+
+	return __atomic_load_n (&val->frozen, __ATOMIC_ACQUIRE);
+}
+
 /**
  * Get the type of the value.
  *
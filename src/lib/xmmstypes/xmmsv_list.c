@@ -19,6 +19,7 @@
 
 #include <xmmscpriv/xmmsv.h>
 #include <xmmscpriv/xmms_list.h>
+#include <xmmscpriv/xmmsc_util.h>
 
 #include <xmmsc/xmmsv.h>
 
@@ -27,18 +28,40 @@ struct xmmsv_list_iter_St {
 	int position;
 };
 
+/* Lists restricted to integers are packed: the values live in the ints
+ * array, and list only holds boxed values handed out through the generic
+ * accessors. It is allocated on first use and may contain NULL entries.
+ *
+ * Copies of packed lists share the ints array until either side
+ * modifies it, ints_ref then counts the lists using it.
+ *
+ * Both arrays start offset slots into their allocations. Large lists
+ * keep free slots at the front too, so that inserting and removing in
+ * the first half only moves that half, and at the head is O(1).
+ */
 struct xmmsv_list_internal_St {
 	xmmsv_t **list;
+	int64_t *ints;
+	int *ints_ref;
+	bool packed;
 	xmmsv_t *parent_value;
 	int size;
-	int allocated;
+	int allocated; /* slots from the start of list */
+	int offset; /* free slots before the start of list */
 	bool restricted;
 	xmmsv_type_t restricttype;
 	x_list_t *iterators;
+	char iter_lock;
 };
 
 static void _xmmsv_list_iter_free (xmmsv_list_iter_t *it);
 
+/* lists smaller than this only grow and shrink at the end */
+#define LIST_FRONT_MIN 64
+
+#define LIST_BASE(l) ((l)->list ? (l)->list - (l)->offset : NULL)
+#define INTS_BASE(l) ((l)->ints ? (l)->ints - (l)->offset : NULL)
+
 static int
 _xmmsv_list_position_normalize (int *pos, int size, int allow_append)
 {
@@ -75,6 +98,64 @@ _xmmsv_list_new (void)
 	return list;
 }
 
+/**
+ * Drop this list's hold on the ints array, freeing it unless it is
+ * shared with a copy.
+ */
+static void
+_xmmsv_list_release_ints (xmmsv_list_internal_t *l)
+{
+	if (l->ints_ref != NULL) {
+		if (__atomic_sub_fetch (l->ints_ref, 1, __ATOMIC_ACQ_REL) == 0) {
+			free (l->ints_ref);
+			free (INTS_BASE (l));
+		}
+		l->ints_ref = NULL;
+	} else {
+		free (INTS_BASE (l));
+	}
+	l->ints = NULL;
+}
+
+/**
+ * Make sure the ints array isn't shared before modifying it.
+ */
+static int
+_xmmsv_list_own_ints (xmmsv_list_internal_t *l)
+{
+	int64_t *ints;
+	int total;
+
+	if (l->ints_ref == NULL) {
+		return 1;
+	}
+
+	if (__atomic_load_n (l->ints_ref, __ATOMIC_ACQUIRE) == 1) {
+		free (l->ints_ref);
+		l->ints_ref = NULL;
+		return 1;
+	}
+
+	/* nothing to copy, letting go of the shared array will do */
+	total = l->offset + l->allocated;
+	if (!l->ints || total == 0) {
+		_xmmsv_list_release_ints (l);
+		return 1;
+	}
+
+	ints = malloc (total * sizeof (int64_t));
+	if (!ints) {
+		x_oom ();
+		return 0;
+	}
+	memcpy (ints, l->ints - l->offset, total * sizeof (int64_t));
+
+	_xmmsv_list_release_ints (l);
+	l->ints = ints + l->offset;
+
+	return 1;
+}
+
 void
 _xmmsv_list_free (xmmsv_list_internal_t *l)
 {
@@ -88,11 +169,14 @@ _xmmsv_list_free (xmmsv_list_internal_t *l)
 	}
 
 	/* unref contents */
-	for (i = 0; i < l->size; i++) {
-		xmmsv_unref (l->list[i]);
+	for (i = 0; l->list != NULL && i < l->size; i++) {
+		if (l->list[i] != NULL) {
+			xmmsv_unref (l->list[i]);
+		}
 	}
 
-	free (l->list);
+	free (LIST_BASE (l));
+	_xmmsv_list_release_ints (l);
 	free (l);
 }
 
@@ -101,59 +185,243 @@ _xmmsv_list_resize (xmmsv_list_internal_t *l, int newsize)
 {
 	xmmsv_t **newmem;
 
-	newmem = realloc (l->list, newsize * sizeof (xmmsv_t *));
+	if (l->packed) {
+		int64_t *newints;
+
+		newints = realloc (INTS_BASE (l),
+		                   (l->offset + newsize) * sizeof (int64_t));
 
-	if (newsize != 0 && newmem == NULL) {
+		if (l->offset + newsize != 0 && newints == NULL) {
+			x_oom ();
+			return 0;
+		}
+
+		l->ints = newints ? newints + l->offset : NULL;
+
+		if (l->list == NULL) {
+			l->allocated = newsize;
+			return 1;
+		}
+	}
+
+	newmem = realloc (LIST_BASE (l), (l->offset + newsize) * sizeof (xmmsv_t *));
+
+	if (l->offset + newsize != 0 && newmem == NULL) {
 		x_oom ();
 		return 0;
 	}
 
+	if (newmem) {
+		newmem += l->offset;
+	}
+
+	/* no boxed values yet in the new slots */
+	if (l->packed && newsize > l->allocated) {
+		memset (newmem + l->allocated, 0,
+		        (newsize - l->allocated) * sizeof (xmmsv_t *));
+	}
+
 	l->list = newmem;
 	l->allocated = newsize;
 
 	return 1;
 }
 
+/**
+ * Move the values into new arrays of total slots, starting offset
+ * slots in.
+ */
 static int
-_xmmsv_list_insert (xmmsv_list_internal_t *l, int pos, xmmsv_t *val)
+_xmmsv_list_relayout (xmmsv_list_internal_t *l, int total, int offset)
+{
+	xmmsv_t **list = NULL;
+	int64_t *ints = NULL;
+
+	if (total > 0 && (l->list != NULL || !l->packed)) {
+		list = calloc (total, sizeof (xmmsv_t *));
+		if (!list) {
+			x_oom ();
+			return 0;
+		}
+		if (l->list != NULL) {
+			memcpy (list + offset, l->list, l->size * sizeof (xmmsv_t *));
+		}
+	}
+
+	if (total > 0 && l->packed) {
+		ints = malloc (total * sizeof (int64_t));
+		if (!ints) {
+			free (list);
+			x_oom ();
+			return 0;
+		}
+		memcpy (ints + offset, l->ints, l->size * sizeof (int64_t));
+	}
+
+	free (LIST_BASE (l));
+	_xmmsv_list_release_ints (l);
+
+	l->list = list ? list + offset : NULL;
+	l->ints = ints ? ints + offset : NULL;
+	l->offset = list || ints ? offset : 0;
+	l->allocated = list || ints ? total - offset : 0;
+
+	return 1;
+}
+
+/**
+ * Get the value at a position of the list, boxing it first if the list
+ * is packed.
+ */
+static xmmsv_t *
+_xmmsv_list_box (xmmsv_list_internal_t *l, int pos)
+{
+	if (!l->packed) {
+		return l->list[pos];
+	}
+
+	if (l->list == NULL) {
+		l->list = calloc (l->offset + l->allocated, sizeof (xmmsv_t *));
+		if (!l->list) {
+			x_oom ();
+			return NULL;
+		}
+		l->list += l->offset;
+	}
+
+	if (l->list[pos] == NULL) {
+		l->list[pos] = xmmsv_new_int (l->ints[pos]);
+	}
+
+	return l->list[pos];
+}
+
+/**
+ * Drop the boxed value at a position of a packed list, if any.
+ */
+static void
+_xmmsv_list_unbox (xmmsv_list_internal_t *l, int pos)
+{
+	if (l->list != NULL && l->list[pos] != NULL) {
+		xmmsv_unref (l->list[pos]);
+		l->list[pos] = NULL;
+	}
+}
+
+/**
+ * Switch a list of integers to the packed representation. Values that
+ * are already boxed are kept, as callers may hold borrowed references.
+ */
+static int
+_xmmsv_list_pack (xmmsv_list_internal_t *l)
+{
+	int i;
+
+	if (l->offset + l->allocated > 0) {
+		l->ints = malloc ((l->offset + l->allocated) * sizeof (int64_t));
+		if (!l->ints) {
+			x_oom ();
+			return 0;
+		}
+		l->ints += l->offset;
+	}
+
+	for (i = 0; i < l->size; i++) {
+		xmmsv_get_int64 (l->list[i], &l->ints[i]);
+	}
+
+	if (l->size == 0) {
+		free (LIST_BASE (l));
+		l->list = NULL;
+	}
+
+	l->packed = true;
+
+	return 1;
+}
+
+/**
+ * Open up an empty slot at a position of the list, which the caller
+ * then has to fill in.
+ */
+static int
+_xmmsv_list_open_slot (xmmsv_list_internal_t *l, int *pos)
 {
 	xmmsv_list_iter_t *it;
 	x_list_t *n;
+	int total, front, success;
+
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", 0);
 
-	if (!_xmmsv_list_position_normalize (&pos, l->size, 1)) {
+	if (!_xmmsv_list_position_normalize (pos, l->size, 1)) {
 		return 0;
 	}
 
-	if (l->restricted) {
-		x_return_val_if_fail (xmmsv_is_type (val, l->restricttype), 0);
+	if (!_xmmsv_list_own_ints (l)) {
+		return 0;
 	}
 
+	total = l->offset + l->allocated;
+	front = l->size >= LIST_FRONT_MIN && *pos < l->size / 2;
+
 	/* We need more memory, reallocate */
-	if (l->size == l->allocated) {
-		int success;
-		size_t double_size;
-		if (l->allocated > 0) {
-			double_size = l->allocated << 1;
+	if (front && l->offset == 0) {
+		/* split the free space between both ends */
+		if (total - l->size < total / 4) {
+			total <<= 1;
+		}
+		success = _xmmsv_list_relayout (l, total, (total - l->size) / 2);
+		x_return_val_if_fail (success, 0);
+	} else if (!front && l->size == l->allocated) {
+		if (l->offset > 0 && l->offset >= total / 4) {
+			/* used as a queue, take back space from the front */
+			success = _xmmsv_list_relayout (l, total, l->offset / 2);
 		} else {
-			double_size = 1;
+			size_t double_size;
+			if (l->allocated > 0) {
+				double_size = l->allocated << 1;
+			} else {
+				double_size = 1;
+			}
+			success = _xmmsv_list_resize (l, double_size);
 		}
-		success = _xmmsv_list_resize (l, double_size);
 		x_return_val_if_fail (success, 0);
 	}
 
-	/* move existing items out of the way */
-	if (l->size > pos) {
-		memmove (l->list + pos + 1, l->list + pos,
-		         (l->size - pos) * sizeof (xmmsv_t *));
+	if (front) {
+		/* move the head one slot to the front */
+		l->offset--;
+		l->allocated++;
+		if (l->list != NULL) {
+			l->list--;
+			memmove (l->list, l->list + 1, *pos * sizeof (xmmsv_t *));
+		}
+		if (l->packed) {
+			l->ints--;
+			memmove (l->ints, l->ints + 1, *pos * sizeof (int64_t));
+		}
+	} else if (l->size > *pos) {
+		/* move existing items out of the way */
+		if (l->list != NULL) {
+			memmove (l->list + *pos + 1, l->list + *pos,
+			         (l->size - *pos) * sizeof (xmmsv_t *));
+		}
+		if (l->packed) {
+			memmove (l->ints + *pos + 1, l->ints + *pos,
+			         (l->size - *pos) * sizeof (int64_t));
+		}
+	}
+
+	if (l->packed && l->list != NULL) {
+		l->list[*pos] = NULL;
 	}
 
-	l->list[pos] = xmmsv_ref (val);
 	l->size++;
 
 	/* update iterators pos */
 	for (n = l->iterators; n; n = n->next) {
 		it = (xmmsv_list_iter_t *) n->data;
-		if (it->position > pos) {
+		if (it->position > *pos) {
 			it->position++;
 		}
 	}
@@ -161,6 +429,50 @@ _xmmsv_list_insert (xmmsv_list_internal_t *l, int pos, xmmsv_t *val)
 	return 1;
 }
 
+static int
+_xmmsv_list_insert (xmmsv_list_internal_t *l, int pos, xmmsv_t *val)
+{
+	if (l->restricted) {
+		x_return_val_if_fail (xmmsv_is_type (val, l->restricttype), 0);
+	}
+
+	if (!_xmmsv_list_open_slot (l, &pos)) {
+		return 0;
+	}
+
+	if (l->packed) {
+		xmmsv_get_int64 (val, &l->ints[pos]);
+		if (l->list != NULL) {
+			l->list[pos] = xmmsv_ref (val);
+		}
+	} else {
+		l->list[pos] = xmmsv_ref (val);
+	}
+
+	return 1;
+}
+
+static int
+_xmmsv_list_insert_int (xmmsv_list_internal_t *l, int pos, int64_t val)
+{
+	xmmsv_t *v;
+	int ret;
+
+	if (l->packed) {
+		if (!_xmmsv_list_open_slot (l, &pos)) {
+			return 0;
+		}
+		l->ints[pos] = val;
+		return 1;
+	}
+
+	v = xmmsv_new_int (val);
+	ret = _xmmsv_list_insert (l, pos, v);
+	xmmsv_unref (v);
+
+	return ret;
+}
+
 static int
 _xmmsv_list_append (xmmsv_list_internal_t *l, xmmsv_t *val)
 {
@@ -171,29 +483,66 @@ static int
 _xmmsv_list_remove (xmmsv_list_internal_t *l, int pos)
 {
 	xmmsv_list_iter_t *it;
-	int half_size;
+	int total, front, success;
 	x_list_t *n;
 
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", 0);
+
 	/* prevent removing after the last element */
 	if (!_xmmsv_list_position_normalize (&pos, l->size, 0)) {
 		return 0;
 	}
 
-	xmmsv_unref (l->list[pos]);
+	if (!_xmmsv_list_own_ints (l)) {
+		return 0;
+	}
+
+	front = l->size >= LIST_FRONT_MIN && pos < l->size / 2;
+
+	if (l->packed) {
+		_xmmsv_list_unbox (l, pos);
+	} else {
+		xmmsv_unref (l->list[pos]);
+	}
 
 	l->size--;
 
-	/* fill the gap */
-	if (pos < l->size) {
-		memmove (l->list + pos, l->list + pos + 1,
-		         (l->size - pos) * sizeof (xmmsv_t *));
+	if (front) {
+		/* fill the gap from the head */
+		if (l->list != NULL) {
+			memmove (l->list + 1, l->list, pos * sizeof (xmmsv_t *));
+			l->list++;
+		}
+		if (l->packed) {
+			memmove (l->ints + 1, l->ints, pos * sizeof (int64_t));
+			l->ints++;
+		}
+		l->offset++;
+		l->allocated--;
+	} else if (pos < l->size) {
+		/* fill the gap */
+		if (l->list != NULL) {
+			memmove (l->list + pos, l->list + pos + 1,
+			         (l->size - pos) * sizeof (xmmsv_t *));
+		}
+		if (l->packed) {
+			memmove (l->ints + pos, l->ints + pos + 1,
+			         (l->size - pos) * sizeof (int64_t));
+		}
 	}
 
 	/* Reduce memory usage by two if possible */
-	half_size = l->allocated >> 1;
-	if (l->size <= half_size) {
-		int success;
-		success = _xmmsv_list_resize (l, half_size);
+	total = l->offset + l->allocated;
+	if (l->offset > 0) {
+		/* wait a bit longer so that the relayout doesn't come back
+		 * with the next insert */
+		if (l->size <= total >> 2) {
+			total >>= 1;
+			success = _xmmsv_list_relayout (l, total, (total - l->size) / 2);
+			x_return_val_if_fail (success, 0);
+		}
+	} else if (l->size <= l->allocated >> 1) {
+		success = _xmmsv_list_resize (l, l->allocated >> 1);
 		x_return_val_if_fail (success, 0);
 	}
 
@@ -215,19 +564,44 @@ _xmmsv_list_move (xmmsv_list_internal_t *l, int old_pos, int new_pos)
 	xmmsv_list_iter_t *it;
 	x_list_t *n;
 
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", 0);
+
 	if (!_xmmsv_list_position_normalize (&old_pos, l->size, 0)) {
 		return 0;
 	}
 	if (!_xmmsv_list_position_normalize (&new_pos, l->size, 0)) {
 		return 0;
 	}
+	if (!_xmmsv_list_own_ints (l)) {
+		return 0;
+	}
 
-	v = l->list[old_pos];
-	if (old_pos < new_pos) {
-		memmove (l->list + old_pos, l->list + old_pos + 1,
-		         (new_pos - old_pos) * sizeof (xmmsv_t *));
+	if (l->packed) {
+		int64_t i = l->ints[old_pos];
+		if (old_pos < new_pos) {
+			memmove (l->ints + old_pos, l->ints + old_pos + 1,
+			         (new_pos - old_pos) * sizeof (int64_t));
+		} else {
+			memmove (l->ints + new_pos + 1, l->ints + new_pos,
+			         (old_pos - new_pos) * sizeof (int64_t));
+		}
+		l->ints[new_pos] = i;
+	}
+
+	/* a packed list may not have any boxed values */
+	if (l->list != NULL) {
+		v = l->list[old_pos];
+		if (old_pos < new_pos) {
+			memmove (l->list + old_pos, l->list + old_pos + 1,
+			         (new_pos - old_pos) * sizeof (xmmsv_t *));
+		} else {
+			memmove (l->list + new_pos + 1, l->list + new_pos,
+			         (old_pos - new_pos) * sizeof (xmmsv_t *));
+		}
 		l->list[new_pos] = v;
+	}
 
+	if (old_pos < new_pos) {
 		/* update iterator pos */
 		for (n = l->iterators; n; n = n->next) {
 			it = (xmmsv_list_iter_t *) n->data;
@@ -240,10 +614,6 @@ _xmmsv_list_move (xmmsv_list_internal_t *l, int old_pos, int new_pos)
 			}
 		}
 	} else {
-		memmove (l->list + new_pos + 1, l->list + new_pos,
-		         (old_pos - new_pos) * sizeof (xmmsv_t *));
-		l->list[new_pos] = v;
-
 		/* update iterator pos */
 		for (n = l->iterators; n; n = n->next) {
 			it = (xmmsv_list_iter_t *) n->data;
@@ -267,17 +637,23 @@ _xmmsv_list_clear (xmmsv_list_internal_t *l)
 	x_list_t *n;
 	int i;
 
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", );
+
 	/* unref all stored values */
-	for (i = 0; i < l->size; i++) {
-		xmmsv_unref (l->list[i]);
+	for (i = 0; l->list != NULL && i < l->size; i++) {
+		if (l->list[i] != NULL) {
+			xmmsv_unref (l->list[i]);
+		}
 	}
 
 	/* free list, declare empty */
-	free (l->list);
+	free (LIST_BASE (l));
 	l->list = NULL;
+	_xmmsv_list_release_ints (l);
 
 	l->size = 0;
 	l->allocated = 0;
+	l->offset = 0;
 
 	/* reset iterator pos */
 	for (n = l->iterators; n; n = n->next) {
@@ -289,8 +665,98 @@ _xmmsv_list_clear (xmmsv_list_internal_t *l)
 static void
 _xmmsv_list_sort (xmmsv_list_internal_t *l, xmmsv_list_compare_func_t comparator)
 {
+	int i;
+
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", );
+
+	/* the comparator works on values, so box everything first */
+	for (i = 0; i < l->size; i++) {
+		if (_xmmsv_list_box (l, i) == NULL) {
+			return;
+		}
+	}
+
 	qsort (l->list, l->size, sizeof (xmmsv_t *),
 	       (int (*)(const void *, const void *)) comparator);
+
+	if (!_xmmsv_list_own_ints (l)) {
+		return;
+	}
+
+	for (i = 0; l->packed && i < l->size; i++) {
+		xmmsv_get_int64 (l->list[i], &l->ints[i]);
+	}
+}
+
+/**
+ * Prepare a list for sharing between threads: box every packed value
+ * so that readers never have to allocate, then freeze the elements.
+ */
+void
+_xmmsv_list_freeze (xmmsv_list_internal_t *l)
+{
+	int i;
+
+	for (i = 0; i < l->size; i++) {
+		if (_xmmsv_list_box (l, i) == NULL) {
+			return;
+		}
+		xmmsv_freeze (l->list[i]);
+	}
+}
+
+/**
+ * Copy a packed list, sharing its ints array until either list is
+ * modified.
+ *
+ * @return The new list, or NULL if it isn't packed.
+ */
+xmmsv_t *
+_xmmsv_list_copy_packed (xmmsv_t *listv)
+{
+	xmmsv_list_internal_t *l, *c;
+	xmmsv_t *copy;
+
+	l = listv->value.list;
+	if (!l->packed || l->ints == NULL) {
+		return NULL;
+	}
+
+	/* frozen lists may be copied from several threads at once */
+	if (__atomic_load_n (&l->ints_ref, __ATOMIC_ACQUIRE) == NULL) {
+		int *ref, *expected = NULL;
+
+		ref = malloc (sizeof (int));
+		if (!ref) {
+			x_oom ();
+			return NULL;
+		}
+		*ref = 1;
+
+		if (!__atomic_compare_exchange_n (&l->ints_ref, &expected, ref, false,
+		                                  __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			free (ref);
+		}
+	}
+
+	copy = xmmsv_new_list ();
+	if (!copy) {
+		return NULL;
+	}
+
+	c = copy->value.list;
+	c->ints = l->ints;
+	c->ints_ref = l->ints_ref;
+	c->offset = l->offset;
+	c->allocated = l->allocated;
+	c->size = l->size;
+	c->packed = true;
+	c->restricted = true;
+	c->restricttype = XMMSV_TYPE_INT64;
+
+	__atomic_add_fetch (l->ints_ref, 1, __ATOMIC_RELAXED);
+
+	return copy;
 }
 
 /**
@@ -339,7 +805,7 @@ xmmsv_list_get (xmmsv_t *listv, int pos, xmmsv_t **val)
 	}
 
 	if (val) {
-		*val = l->list[pos];
+		*val = _xmmsv_list_box (l, pos);
 	}
 
 	return 1;
@@ -366,13 +832,28 @@ xmmsv_list_set (xmmsv_t *listv, int pos, xmmsv_t *val)
 
 	l = listv->value.list;
 
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", 0);
+
 	if (!_xmmsv_list_position_normalize (&pos, l->size, 0)) {
 		return 0;
 	}
 
+	if (l->packed) {
+		int64_t i;
+
+		x_return_val_if_fail (xmmsv_get_int64 (val, &i), 0);
+		x_return_val_if_fail (_xmmsv_list_own_ints (l), 0);
+		l->ints[pos] = i;
+		if (l->list == NULL) {
+			return 1;
+		}
+	}
+
 	old_val = l->list[pos];
 	l->list[pos] = xmmsv_ref (val);
-	xmmsv_unref (old_val);
+	if (old_val != NULL) {
+		xmmsv_unref (old_val);
+	}
 
 	return 1;
 }
@@ -542,9 +1023,19 @@ xmmsv_list_restrict_type (xmmsv_t *listv, xmmsv_type_t type)
 	x_return_val_if_fail (!listv->value.list->restricted ||
 	                      listv->value.list->restricttype == type, 0);
 
+	if (listv->frozen) {
+		x_api_error_if (!listv->value.list->restricted,
+		                "modifying a frozen list", 0);
+		return 1;
+	}
+
 	listv->value.list->restricted = true;
 	listv->value.list->restricttype = type;
 
+	if (type == XMMSV_TYPE_INT64 && !listv->value.list->packed) {
+		return _xmmsv_list_pack (listv->value.list);
+	}
+
 	return 1;
 }
 
@@ -649,8 +1140,10 @@ _xmmsv_list_iter_new (xmmsv_list_internal_t *l)
 	it->parent = l;
 	it->position = 0;
 
-	/* register iterator into parent */
+	/* register iterator into parent, frozen lists may be shared */
+	_xmmsv_spin_lock (&l->iter_lock);
 	l->iterators = x_list_prepend (l->iterators, it);
+	_xmmsv_spin_unlock (&l->iter_lock);
 
 	return it;
 }
@@ -688,7 +1181,9 @@ static void
 _xmmsv_list_iter_free (xmmsv_list_iter_t *it)
 {
 	/* unref iterator from list and free it */
+	_xmmsv_spin_lock (&it->parent->iter_lock);
 	it->parent->iterators = x_list_remove (it->parent->iterators, it);
+	_xmmsv_spin_unlock (&it->parent->iter_lock);
 	free (it);
 }
 
@@ -725,9 +1220,9 @@ xmmsv_list_iter_entry (xmmsv_list_iter_t *it, xmmsv_t **val)
 	if (!xmmsv_list_iter_valid (it))
 		return 0;
 
-	*val = it->parent->list[it->position];
+	*val = _xmmsv_list_box (it->parent, it->position);
 
-	return 1;
+	return *val != NULL;
 }
 
 /**
@@ -957,10 +1452,48 @@ xmmsv_list_flatten (xmmsv_t *list, int depth)
 	}
 
 GEN_LIST_EXTRACTOR_FUNC (string, const char *)
-GEN_LIST_EXTRACTOR_FUNC (int32, int32_t)
-GEN_LIST_EXTRACTOR_FUNC (int64, int64_t)
 GEN_LIST_EXTRACTOR_FUNC (float, float)
 
+int
+xmmsv_list_get_int64 (xmmsv_t *val, int pos, int64_t *r)
+{
+	xmmsv_list_internal_t *l;
+	xmmsv_t *v;
+
+	x_return_val_if_fail (val, 0);
+	x_return_val_if_fail (xmmsv_is_type (val, XMMSV_TYPE_LIST), 0);
+
+	l = val->value.list;
+
+	if (l->packed) {
+		if (!_xmmsv_list_position_normalize (&pos, l->size, 0)) {
+			return 0;
+		}
+		*r = l->ints[pos];
+		return 1;
+	}
+
+	if (!xmmsv_list_get (val, pos, &v)) {
+		return 0;
+	}
+
+	return xmmsv_get_int64 (v, r);
+}
+
+int
+xmmsv_list_get_int32 (xmmsv_t *val, int pos, int32_t *r)
+{
+	int64_t raw_val;
+
+	if (!xmmsv_list_get_int64 (val, pos, &raw_val)) {
+		return 0;
+	}
+
+	*r = INT64_TO_INT32 (raw_val);
+
+	return 1;
+}
+
 int
 xmmsv_list_get_coll (xmmsv_t *val, int pos, xmmsv_t **r)
 {
@@ -983,9 +1516,41 @@ xmmsv_list_get_coll (xmmsv_t *val, int pos, xmmsv_t **r)
 	}
 
 GEN_LIST_SET_FUNC (string, const char *)
-GEN_LIST_SET_FUNC (int, int64_t)
 GEN_LIST_SET_FUNC (float, float)
 
+int
+xmmsv_list_set_int (xmmsv_t *list, int pos, int64_t elem)
+{
+	xmmsv_list_internal_t *l;
+	xmmsv_t *v;
+	int ret;
+
+	x_return_val_if_fail (list, 0);
+	x_return_val_if_fail (xmmsv_is_type (list, XMMSV_TYPE_LIST), 0);
+
+	l = list->value.list;
+
+	x_api_error_if (l->parent_value->frozen, "modifying a frozen list", 0);
+
+	if (l->packed) {
+		if (!_xmmsv_list_position_normalize (&pos, l->size, 0)) {
+			return 0;
+		}
+		if (!_xmmsv_list_own_ints (l)) {
+			return 0;
+		}
+		l->ints[pos] = elem;
+		_xmmsv_list_unbox (l, pos);
+		return 1;
+	}
+
+	v = xmmsv_new_int (elem);
+	ret = xmmsv_list_set (list, pos, v);
+	xmmsv_unref (v);
+
+	return ret;
+}
+
 int
 xmmsv_list_set_coll (xmmsv_t *list, int pos, xmmsv_t *elem)
 {
@@ -1008,9 +1573,17 @@ xmmsv_list_set_coll (xmmsv_t *list, int pos, xmmsv_t *elem)
 	}
 
 GEN_LIST_INSERT_FUNC (string, const char *)
-GEN_LIST_INSERT_FUNC (int, int64_t)
 GEN_LIST_INSERT_FUNC (float, float)
 
+int
+xmmsv_list_insert_int (xmmsv_t *list, int pos, int64_t elem)
+{
+	x_return_val_if_fail (list, 0);
+	x_return_val_if_fail (xmmsv_is_type (list, XMMSV_TYPE_LIST), 0);
+
+	return _xmmsv_list_insert_int (list->value.list, pos, elem);
+}
+
 int
 xmmsv_list_insert_coll (xmmsv_t *list, int pos, xmmsv_t *elem)
 {
@@ -1033,9 +1606,18 @@ xmmsv_list_insert_coll (xmmsv_t *list, int pos, xmmsv_t *elem)
 	}
 
 GEN_LIST_APPEND_FUNC (string, const char *)
-GEN_LIST_APPEND_FUNC (int, int64_t)
 GEN_LIST_APPEND_FUNC (float, float)
 
+int
+xmmsv_list_append_int (xmmsv_t *list, int64_t elem)
+{
+	x_return_val_if_fail (list, 0);
+	x_return_val_if_fail (xmmsv_is_type (list, XMMSV_TYPE_LIST), 0);
+
+	return _xmmsv_list_insert_int (list->value.list,
+	                               list->value.list->size, elem);
+}
+
 int
 xmmsv_list_append_coll (xmmsv_t *list, xmmsv_t *elem)
 {
@@ -1055,10 +1637,41 @@ xmmsv_list_append_coll (xmmsv_t *list, xmmsv_t *elem)
 	}
 
 GEN_LIST_ITER_EXTRACTOR_FUNC (string, const char *)
-GEN_LIST_ITER_EXTRACTOR_FUNC (int32, int32_t)
-GEN_LIST_ITER_EXTRACTOR_FUNC (int64, int64_t)
 GEN_LIST_ITER_EXTRACTOR_FUNC (float, float)
 
+int
+xmmsv_list_iter_entry_int64 (xmmsv_list_iter_t *it, int64_t *r)
+{
+	xmmsv_t *v;
+
+	if (!xmmsv_list_iter_valid (it)) {
+		return 0;
+	}
+
+	if (it->parent->packed) {
+		*r = it->parent->ints[it->position];
+		return 1;
+	}
+
+	v = it->parent->list[it->position];
+
+	return xmmsv_get_int64 (v, r);
+}
+
+int
+xmmsv_list_iter_entry_int32 (xmmsv_list_iter_t *it, int32_t *r)
+{
+	int64_t raw_val;
+
+	if (!xmmsv_list_iter_entry_int64 (it, &raw_val)) {
+		return 0;
+	}
+
+	*r = INT64_TO_INT32 (raw_val);
+
+	return 1;
+}
+
 int
 xmmsv_list_iter_entry_coll (xmmsv_list_iter_t *it, xmmsv_t **r)
 {
@@ -1081,9 +1694,16 @@ xmmsv_list_iter_entry_coll (xmmsv_list_iter_t *it, xmmsv_t **r)
 	}
 
 GEN_LIST_ITER_INSERT_FUNC (string, const char *)
-GEN_LIST_ITER_INSERT_FUNC (int, int64_t)
 GEN_LIST_ITER_INSERT_FUNC (float, float)
 
+int
+xmmsv_list_iter_insert_int (xmmsv_list_iter_t *it, int64_t elem)
+{
+	x_return_val_if_fail (it, 0);
+
+	return _xmmsv_list_insert_int (it->parent, it->position, elem);
+}
+
 int
 xmmsv_list_iter_insert_coll (xmmsv_list_iter_t *it, xmmsv_t *elem)
 {
@@ -473,3 +473,137 @@ xmmsv_utf8_validate (const char *str)
 		}
 	}
 }
+
+static xmmsv_t *
+_xmmsv_columns_find (xmmsv_t *columns, const char *field)
+{
+	xmmsv_t *fields, *list, *column;
+	const char *name;
+	int i;
+
+	if (strcmp (field, "id") == 0) {
+		return xmmsv_dict_get (columns, "id", &list) ? list : NULL;
+	}
+
+	if (!xmmsv_dict_get (columns, "fields", &fields) ||
+	    !xmmsv_dict_get (columns, "columns", &list)) {
+		return NULL;
+	}
+
+	for (i = 0; xmmsv_list_get_string (fields, i, &name); i++) {
+		if (strcmp (name, field) == 0) {
+			return xmmsv_list_get (list, i, &column) ? column : NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Get the number of rows in the result of a "columns" medialib query.
+ *
+ * @param columns The query result.
+ * @return The number of rows, or -1 if columns isn't such a result.
+ */
+int
+xmmsv_columns_get_size (xmmsv_t *columns)
+{
+	xmmsv_t *ids;
+
+	x_return_val_if_fail (columns, -1);
+
+	if (!xmmsv_dict_get (columns, "id", &ids)) {
+		return -1;
+	}
+
+	return xmmsv_list_get_size (ids);
+}
+
+/**
+ * Get a cell of the result of a "columns" medialib query. Columns are
+ * either lists of values, with none where a row has no value, or
+ * dictionary encoded as a dict with a "dictionary" list of strings
+ * and a "codes" list of integers indexing it (-1 for no value).
+ *
+ * @param columns The query result.
+ * @param field The field of the column, "id" for the medialib id.
+ * @param row The row.
+ * @param value Set to a borrowed reference to the value, if any.
+ * @return 1 if the row has a value for the field, 0 otherwise.
+ */
+int
+xmmsv_columns_get_value (xmmsv_t *columns, const char *field, int row,
+                         xmmsv_t **value)
+{
+	xmmsv_t *column, *dictionary, *codes, *v;
+	int64_t code;
+
+	x_return_val_if_fail (columns, 0);
+	x_return_val_if_fail (field, 0);
+
+	column = _xmmsv_columns_find (columns, field);
+	if (!column) {
+		return 0;
+	}
+
+	if (xmmsv_is_type (column, XMMSV_TYPE_DICT)) {
+		if (!xmmsv_dict_get (column, "dictionary", &dictionary) ||
+		    !xmmsv_dict_get (column, "codes", &codes) ||
+		    !xmmsv_list_get_int64 (codes, row, &code) || code < 0) {
+			return 0;
+		}
+		if (!xmmsv_list_get (dictionary, code, &v)) {
+			return 0;
+		}
+	} else if (!xmmsv_list_get (column, row, &v) ||
+	           xmmsv_is_type (v, XMMSV_TYPE_NONE)) {
+		return 0;
+	}
+
+	if (value) {
+		*value = v;
+	}
+
+	return 1;
+}
+
+/**
+ * Expand the result of a "columns" medialib query to a list with one
+ * dict per row, with the fields the row has values for and "id".
+ *
+ * @param columns The query result.
+ * @return A new list, or NULL if columns isn't such a result.
+ */
+xmmsv_t *
+xmmsv_columns_to_list (xmmsv_t *columns)
+{
+	xmmsv_t *ret, *fields, *entry, *value;
+	const char *field;
+	int i, j, rows;
+
+	rows = xmmsv_columns_get_size (columns);
+	if (rows < 0 || !xmmsv_dict_get (columns, "fields", &fields)) {
+		return NULL;
+	}
+
+	ret = xmmsv_new_list ();
+
+	for (i = 0; i < rows; i++) {
+		entry = xmmsv_new_dict ();
+
+		if (xmmsv_columns_get_value (columns, "id", i, &value)) {
+			xmmsv_dict_set (entry, "id", value);
+		}
+
+		for (j = 0; xmmsv_list_get_string (fields, j, &field); j++) {
+			if (xmmsv_columns_get_value (columns, field, i, &value)) {
+				xmmsv_dict_set (entry, field, value);
+			}
+		}
+
+		xmmsv_list_append (ret, entry);
+		xmmsv_unref (entry);
+	}
+
+	return ret;
+}
@@ -12,16 +12,24 @@ packet_init_data (xmmsc_vis_udp_data_t *p)
 	char* buffer = malloc (sz);
 	if (buffer) {
 		memset(buffer, 0, sz);
-
-		buffer[0] = 'V';
-		p->__unaligned_type = &buffer[0];
-		p->__unaligned_grace = (uint16_t*)&buffer[1];
-		p->__unaligned_data = (xmmsc_vischunk_t*)&buffer[1 + sizeof (uint16_t)];
-		p->size = sz;
+		packet_setup_data (p, buffer);
 	}
 	return buffer;
 }
 
+/* same as packet_init_data, for a buffer of
+   XMMS_VISPACKET_UDP_OFFSET + sizeof (xmmsc_vischunk_t) bytes the
+   caller already has */
+void
+packet_setup_data (xmmsc_vis_udp_data_t *p, char *buffer)
+{
+	buffer[0] = 'V';
+	p->__unaligned_type = &buffer[0];
+	p->__unaligned_grace = (uint16_t*)&buffer[1];
+	p->__unaligned_data = (xmmsc_vischunk_t*)&buffer[1 + sizeof (uint16_t)];
+	p->size = 1 + sizeof (uint16_t) + sizeof (xmmsc_vischunk_t);
+}
+
 char*
 packet_init_timing (xmmsc_vis_udp_timing_t *p)
 {
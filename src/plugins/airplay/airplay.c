@@ -46,8 +46,18 @@ typedef struct xmms_airplay_data_St {
 	gint wake_pipe[2];
 	xmms_airplay_state_t state;
 	gdouble volume;
+	/* bytes prepared but not sent, for the slowest receiver */
+	gint queued;
 } xmms_airplay_data_t;
 
+/* One AirPort all receivers get the same stream from, only used by
+ * the airplay thread. */
+typedef struct xmms_airplay_receiver_St {
+	raop_client_t *rc;
+	gchar *host;
+	gboolean failed;
+} xmms_airplay_receiver_t;
+
 /*
  * Function prototypes
  */
@@ -66,7 +76,6 @@ static void xmms_airplay_flush (xmms_output_t *output);
 static guint xmms_airplay_buffersize_get (xmms_output_t *output);
 
 static gpointer xmms_airplay_thread (gpointer arg);
-static int xmms_airplay_stream_cb (void *arg, guchar *buf, int len);
 
 /*
  * Plugin header
@@ -95,9 +104,14 @@ xmms_airplay_plugin_setup (xmms_output_plugin_t *plugin)
 
 	xmms_output_plugin_methods_set (plugin, &methods);
 
+	/* a comma separated list streams to all of them in sync */
 	xmms_output_plugin_config_property_register (plugin,
 	                                             "airport_address",
 	                                             RAOP_DEFAULT_IP, NULL, NULL);
+	/* frames encrypted ahead of the socket, ~93ms each */
+	xmms_output_plugin_config_property_register (plugin,
+	                                             "queue_packets",
+	                                             "8", NULL, NULL);
 	return TRUE;
 }
 
@@ -156,12 +170,137 @@ xmms_airplay_destroy (xmms_output_t *output)
 	g_free (data);
 }
 
-static int
-xmms_airplay_stream_cb (void *arg, guchar *buf, int len)
+static void
+xmms_airplay_receivers_free (GList *receivers)
 {
-	xmms_output_t *output = (xmms_output_t *)arg;
+	xmms_airplay_receiver_t *recv;
+	GList *n;
+
+	for (n = receivers; n; n = g_list_next (n)) {
+		recv = n->data;
+		raop_client_disconnect (recv->rc);
+		raop_client_destroy (recv->rc);
+		g_free (recv->host);
+		g_free (recv);
+	}
+
+	g_list_free (receivers);
+}
+
+/**
+ * Start the handshake with every configured receiver, the ones that
+ * can't be reached are left out.
+ */
+static GList *
+xmms_airplay_receivers_connect (xmms_output_t *output)
+{
+	xmms_config_property_t *val;
+	xmms_airplay_receiver_t *recv;
+	raop_client_t *rc;
+	GList *receivers = NULL;
+	gchar **hosts;
+	gint depth, i;
+
+	val = xmms_output_config_lookup (output, "queue_packets");
+	depth = CLAMP (xmms_config_property_get_int (val), 1, 64);
+
+	val = xmms_output_config_lookup (output, "airport_address");
+	hosts = g_strsplit_set (xmms_config_property_get_string (val), ", ", -1);
+
+	for (i = 0; hosts[i]; i++) {
+		if (!*hosts[i])
+			continue;
+
+		if (raop_client_init (&rc) != RAOP_EOK)
+			continue;
+
+		raop_client_set_queue_depth (rc, depth);
+
+		XMMS_DBG ("Connecting to %s", hosts[i]);
+		if (raop_client_connect (rc, hosts[i], RAOP_DEFAULT_PORT) != RAOP_EOK) {
+			xmms_log_error ("Couldn't connect to %s", hosts[i]);
+			raop_client_destroy (rc);
+			continue;
+		}
 
-	return xmms_output_read (output, (gchar *)buf, len);
+		recv = g_new0 (xmms_airplay_receiver_t, 1);
+		recv->rc = rc;
+		recv->host = g_strdup (hosts[i]);
+		receivers = g_list_append (receivers, recv);
+	}
+
+	g_strfreev (hosts);
+
+	return receivers;
+}
+
+/**
+ * Read and encrypt as many frames as all receivers have room for, so
+ * the socket only ever waits on ready packets. Everyone is sent the
+ * same frames, the slowest receiver paces the others.
+ */
+static void
+xmms_airplay_fill (xmms_output_t *output, xmms_airplay_data_t *data,
+                   GList *receivers)
+{
+	guchar buf[RAOP_ALAC_FRAME_SIZE * 2 * 2];
+	xmms_airplay_receiver_t *recv;
+	guint space = G_MAXUINT, queued = 0;
+	GList *n;
+	gint ret;
+
+	for (n = receivers; n; n = g_list_next (n)) {
+		recv = n->data;
+		space = MIN (space, raop_client_queue_space (recv->rc));
+	}
+
+	for (; space > 0 && space != G_MAXUINT; space--) {
+		ret = xmms_output_read (output, (gchar *) buf, sizeof (buf));
+		if (ret <= 0)
+			break;
+
+		for (n = receivers; n; n = g_list_next (n)) {
+			recv = n->data;
+			raop_client_queue_sample (recv->rc, buf, ret);
+		}
+	}
+
+	for (n = receivers; n; n = g_list_next (n)) {
+		recv = n->data;
+		queued = MAX (queued, raop_client_queued_bytes (recv->rc));
+	}
+
+	g_atomic_int_set (&data->queued, queued);
+}
+
+static void
+xmms_airplay_receiver_io (xmms_airplay_receiver_t *recv, fd_set *rfds,
+                          fd_set *wfds, fd_set *efds)
+{
+	gint rtsp_fd, stream_fd;
+
+	rtsp_fd = raop_client_rtsp_sock (recv->rc);
+	stream_fd = raop_client_stream_sock (recv->rc);
+
+	if (FD_ISSET (rtsp_fd, rfds))
+		raop_client_handle_io (recv->rc, rtsp_fd, G_IO_IN);
+	if (FD_ISSET (rtsp_fd, wfds))
+		raop_client_handle_io (recv->rc, rtsp_fd, G_IO_OUT);
+	if (FD_ISSET (rtsp_fd, efds)) {
+		raop_client_handle_io (recv->rc, rtsp_fd, G_IO_ERR);
+		recv->failed = TRUE;
+	}
+	if (stream_fd != -1) {
+		if (FD_ISSET (stream_fd, rfds))
+			raop_client_handle_io (recv->rc, stream_fd, G_IO_IN);
+		if (FD_ISSET (stream_fd, wfds) &&
+		    raop_client_handle_io (recv->rc, stream_fd, G_IO_OUT) == RAOP_EIO)
+			recv->failed = TRUE;
+		if (FD_ISSET (stream_fd, efds)) {
+			raop_client_handle_io (recv->rc, stream_fd, G_IO_ERR);
+			recv->failed = TRUE;
+		}
+	}
 }
 
 /**
@@ -173,10 +312,9 @@ static gpointer
 xmms_airplay_thread (gpointer arg)
 {
 	xmms_output_t *output = (xmms_output_t *)arg;
-	xmms_config_property_t *val;
-	const gchar *tmp;
 	xmms_airplay_data_t *data;
-	raop_client_t *rc;
+	xmms_airplay_receiver_t *recv;
+	GList *receivers = NULL, *n, *next;
 	fd_set rfds, wfds, efds;
 	struct timeval timeout;
 	int stream_fd;
@@ -189,10 +327,6 @@ xmms_airplay_thread (gpointer arg)
 	data = xmms_output_private_data_get (output);
 	wake_fd = data->wake_pipe[0];
 
-	ret = raop_client_init (&rc);
-	if (ret != RAOP_EOK)
-		return NULL;
-
 	g_mutex_lock (&data->raop_mutex);
 	while (data->state != STATE_QUIT) {
 		switch (data->state) {
@@ -209,14 +343,11 @@ xmms_airplay_thread (gpointer arg)
 			break;
 		case STATE_CONNECT:
 			g_mutex_unlock (&data->raop_mutex);
-			val = xmms_output_config_lookup (output, "airport_address");
-			tmp = xmms_config_property_get_string (val);
-			XMMS_DBG ("Connecting to %s", tmp);
-			ret = raop_client_connect (rc, tmp, RAOP_DEFAULT_PORT);
+			receivers = xmms_airplay_receivers_connect (output);
 			g_mutex_lock (&data->raop_mutex);
-			if (ret == RAOP_EOK) {
-				raop_client_set_stream_cb (rc, xmms_airplay_stream_cb, output);
-				raop_client_get_volume (rc, &data->volume);
+			if (receivers) {
+				recv = receivers->data;
+				raop_client_get_volume (recv->rc, &data->volume);
 				prev_vol = data->volume;
 				XMMS_DBG ("Connected!");
 				data->state = STATE_RUNNING;
@@ -235,14 +366,19 @@ xmms_airplay_thread (gpointer arg)
 		case STATE_FLUSH:
 			XMMS_DBG ("Flushing...");
 			g_mutex_unlock (&data->raop_mutex);
-			raop_client_flush (rc);
+			for (n = receivers; n; n = g_list_next (n)) {
+				recv = n->data;
+				raop_client_flush (recv->rc);
+			}
 			g_mutex_lock (&data->raop_mutex);
 			data->state = STATE_RUNNING;
 			break;
 		case STATE_DISCONNECT:
 			XMMS_DBG ("Disconnecting...");
 			g_mutex_unlock (&data->raop_mutex);
-			raop_client_disconnect (rc);
+			xmms_airplay_receivers_free (receivers);
+			receivers = NULL;
+			g_atomic_int_set (&data->queued, 0);
 			g_mutex_lock (&data->raop_mutex);
 			data->state = STATE_IDLE;
 			break;
@@ -255,13 +391,18 @@ xmms_airplay_thread (gpointer arg)
 
 		if (data->volume != prev_vol) {
 			XMMS_DBG ("Setting volume...");
-			raop_client_set_volume (rc, data->volume);
+			for (n = receivers; n; n = g_list_next (n)) {
+				recv = n->data;
+				raop_client_set_volume (recv->rc, data->volume);
+			}
 			prev_vol = data->volume;
 			continue;
 		}
 
 		g_mutex_unlock (&data->raop_mutex);
 
+		xmms_airplay_fill (output, data, receivers);
+
 		FD_ZERO (&rfds);
 		FD_ZERO (&wfds);
 		FD_ZERO (&efds);
@@ -269,25 +410,30 @@ xmms_airplay_thread (gpointer arg)
 		timeout.tv_usec = 0;
 
 		FD_SET (wake_fd, &rfds);
-		rtsp_fd = raop_client_rtsp_sock (rc);
-		stream_fd = raop_client_stream_sock (rc);
-		if (raop_client_can_read (rc, rtsp_fd)) {
-			FD_SET (rtsp_fd, &rfds);
-		}
-		if (raop_client_can_write (rc, rtsp_fd)) {
-			FD_SET (rtsp_fd, &wfds);
-		}
-		if (raop_client_can_read (rc, stream_fd)) {
-			FD_SET (stream_fd, &rfds);
-		}
-		if (raop_client_can_write (rc, stream_fd)) {
-			FD_SET (stream_fd, &wfds);
+		max_fd = wake_fd;
+		for (n = receivers; n; n = g_list_next (n)) {
+			recv = n->data;
+			rtsp_fd = raop_client_rtsp_sock (recv->rc);
+			stream_fd = raop_client_stream_sock (recv->rc);
+			if (raop_client_can_read (recv->rc, rtsp_fd)) {
+				FD_SET (rtsp_fd, &rfds);
+			}
+			if (raop_client_can_write (recv->rc, rtsp_fd)) {
+				FD_SET (rtsp_fd, &wfds);
+			}
+			if (raop_client_can_read (recv->rc, stream_fd)) {
+				FD_SET (stream_fd, &rfds);
+			}
+			if (raop_client_can_write (recv->rc, stream_fd)) {
+				FD_SET (stream_fd, &wfds);
+			}
+			FD_SET (rtsp_fd, &efds);
+			if (stream_fd != -1)
+				FD_SET (stream_fd, &efds);
+
+			max_fd = MAX (max_fd, MAX (rtsp_fd, stream_fd));
 		}
-		FD_SET (rtsp_fd, &efds);
-		if (stream_fd != -1)
-			FD_SET (stream_fd, &efds);
 
-		max_fd = MAX (wake_fd, MAX (rtsp_fd, stream_fd));
 		ret = select (max_fd + 1, &rfds, &wfds, &efds, &timeout);
 		if (ret <= 0) {
 			g_mutex_lock (&data->raop_mutex);
@@ -303,32 +449,27 @@ xmms_airplay_thread (gpointer arg)
 			continue;
 		}
 
-		if (FD_ISSET (rtsp_fd, &rfds))
-			raop_client_handle_io (rc, rtsp_fd, G_IO_IN);
-		if (FD_ISSET (rtsp_fd, &wfds))
-			raop_client_handle_io (rc, rtsp_fd, G_IO_OUT);
-		if (FD_ISSET (rtsp_fd, &efds)) {
-			raop_client_handle_io (rc, rtsp_fd, G_IO_ERR);
-			g_mutex_lock (&data->raop_mutex);
-			data->state = STATE_DISCONNECT;
-			g_mutex_unlock (&data->raop_mutex);
-		}
-		if (stream_fd != -1) {
-			if (FD_ISSET (stream_fd, &rfds))
-				raop_client_handle_io (rc, stream_fd, G_IO_IN);
-			if (FD_ISSET (stream_fd, &wfds))
-				raop_client_handle_io (rc, stream_fd, G_IO_OUT);
-			if (FD_ISSET (stream_fd, &efds)) {
-				raop_client_handle_io (rc, stream_fd, G_IO_ERR);
-				g_mutex_lock (&data->raop_mutex);
-				data->state = STATE_DISCONNECT;
-				g_mutex_unlock (&data->raop_mutex);
+		for (n = receivers; n; n = next) {
+			next = g_list_next (n);
+			recv = n->data;
+
+			xmms_airplay_receiver_io (recv, &rfds, &wfds, &efds);
+
+			/* the others go on without it */
+			if (recv->failed) {
+				xmms_log_error ("Lost connection to %s", recv->host);
+				receivers = g_list_remove_link (receivers, n);
+				xmms_airplay_receivers_free (n);
 			}
 		}
+
 		g_mutex_lock (&data->raop_mutex);
+		if (!receivers) {
+			data->state = STATE_DISCONNECT;
+		}
 	}
 	g_mutex_unlock (&data->raop_mutex);
-	raop_client_destroy (rc);
+	xmms_airplay_receivers_free (receivers);
 
 	XMMS_DBG ("Airplay thread exit");
 	return NULL;
@@ -440,6 +581,5 @@ xmms_airplay_buffersize_get (xmms_output_t *output)
 	data = xmms_output_private_data_get (output);
 	g_return_val_if_fail (data, 0);
 
-	/* XXX: return size of RAOP write buffer? */
-	return 0;
+	return g_atomic_int_get (&data->queued);
 }
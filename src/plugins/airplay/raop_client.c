@@ -41,6 +41,13 @@ typedef enum audio_jack_type {
 	AUDIO_JACK_DIGITAL
 } audio_jack_type_t;
 
+/* An ALAC frame, already framed and encrypted */
+typedef struct raop_packet_St {
+	guint8 data[RAOP_ALAC_FRAME_SIZE * 2  * 2 + 19]; /* 16-bit stereo */
+	guint32 size;
+	guint32 pcm_len;
+} raop_packet_t;
+
 struct raop_client_struct {
 	/* endpoint addresses */
 	gchar *apex_host;
@@ -55,7 +62,6 @@ struct raop_client_struct {
 
 	/* data stream */
 	gint stream_fd;
-	raop_client_stream_cb_t stream_cb;
 
 	/* RTSP and stream channel state */
 	gint io_state;
@@ -75,14 +81,15 @@ struct raop_client_struct {
 	guint8 challenge[16];
 	AES_KEY *aes_key;
 
-	/* audio sample */
-	guint8 sbuf[RAOP_ALAC_FRAME_SIZE * 2  * 2 + 19]; /* 16-bit stereo */
-	guint32 sbuf_size;
-	guint32 sbuf_offset;
+	/* packets waiting to be sent, the first one may be partly sent */
+	raop_packet_t *packets;
+	guint queue_depth;
+	guint queue_head;
+	guint queue_count;
+	guint32 queue_offset;
+	guint32 queued_pcm;
 };
 
-static gint raop_client_stream_sample (raop_client_t *rc, guint16 *buf, guint32 len);
-
 /* Helper Functions */
 
 /* write upto 8 bits at-a-time into a buffer */
@@ -166,25 +173,41 @@ err:
 }
 
 static void
+raop_queue_clear (raop_client_t *rc)
+{
+	rc->queue_head = 0;
+	rc->queue_count = 0;
+	rc->queue_offset = 0;
+	rc->queued_pcm = 0;
+}
+
+/* Push queued packets until the socket is full. */
+static gint
 raop_send_sample (raop_client_t *rc)
 {
+	raop_packet_t *pkt;
 	gint nwritten;
-	gint nleft = rc->sbuf_size - rc->sbuf_offset;
 
-	if (nleft == 0) {
-		guchar buf[RAOP_ALAC_FRAME_SIZE * 2 * 2];
-		gint ret;
+	while (rc->queue_count) {
+		pkt = &rc->packets[rc->queue_head];
+
+		nwritten = tcp_write (rc->stream_fd,
+		                      (char *) pkt->data + rc->queue_offset,
+		                      pkt->size - rc->queue_offset);
+		if (nwritten < 0)
+			return RAOP_EIO;
 
-		ret = rc->stream_cb.func (rc->stream_cb.data, buf, sizeof (buf));
-		if (ret > 0)
-			raop_client_stream_sample (rc, (guint16 *)buf, ret);
+		rc->queue_offset += nwritten;
+		if (rc->queue_offset < pkt->size)
+			break;
 
-		nleft = rc->sbuf_size - rc->sbuf_offset;
+		rc->queued_pcm -= pkt->pcm_len;
+		rc->queue_head = (rc->queue_head + 1) % rc->queue_depth;
+		rc->queue_count--;
+		rc->queue_offset = 0;
 	}
-	/* XXX: check for error */
-	nwritten = tcp_write (rc->stream_fd, (char *) rc->sbuf + rc->sbuf_offset,
-	                      nleft);
-	rc->sbuf_offset += nwritten;
+
+	return RAOP_EOK;
 }
 
 /* RTSP glue */
@@ -412,6 +435,8 @@ raop_client_init (raop_client_t **client)
 
 	rc->stream_fd = -1;
 	rc->io_state = RAOP_IO_UNDEFINED;
+	rc->queue_depth = RAOP_DEFAULT_QUEUE_DEPTH;
+	rc->packets = g_new (raop_packet_t, rc->queue_depth);
 	rc->jack_status = AUDIO_JACK_DISCONNECTED;
 	rc->jack_type = AUDIO_JACK_ANALOG;
 	rc->volume = RAOP_DEFAULT_VOLUME;
@@ -441,10 +466,12 @@ raop_client_connect (raop_client_t *rc, const gchar *host, gushort port)
 	int ret;
 	int rtsp_fd;
 
+	g_free (rc->apex_host);
+	g_free (rc->cli_host);
+	rc->cli_host = NULL;
 	rc->apex_host = g_strdup (host);
 	rc->rtsp_port = port;
-	rc->sbuf_size = 0;
-	rc->sbuf_offset = 0;
+	raop_queue_clear (rc);
 
 	RAND_bytes (rand_buf, sizeof (rand_buf));
 	g_snprintf (rc->session_id, 11, "%u", *((guint *) rand_buf));
@@ -523,7 +550,7 @@ raop_client_handle_io (raop_client_t *rc, int fd, GIOCondition cond)
 			rc->io_state ^= RAOP_IO_RTSP_WRITE;
 			rc->io_state |= RAOP_IO_RTSP_READ;
 		} else if (fd == rc->stream_fd) { /* stream data */
-			raop_send_sample (rc);
+			ret = raop_send_sample (rc);
 		}
 	} else if (cond == G_IO_IN) {
 		/* get RTSP replies */
@@ -563,12 +590,18 @@ raop_client_handle_io (raop_client_t *rc, int fd, GIOCondition cond)
 		/* XXX */
 	}
 
-	return RAOP_EOK;
+	return ret;
 }
 
-static gint
-raop_client_stream_sample (raop_client_t *rc, guint16 *buf, guint32 len)
+/**
+ * Frame and encrypt a block of samples and put it at the end of the
+ * send queue. At most RAOP_ALAC_FRAME_SIZE frames go in a packet.
+ */
+gint
+raop_client_queue_sample (raop_client_t *rc, const guchar *sample, guint32 len)
 {
+	const guint16 *buf = (const guint16 *) sample;
+	raop_packet_t *pkt;
 	guint8 hdr[] = {0x24, 0x00, 0x00, 0x00,
 	                0xF0, 0xFF, 0x00, 0x00,
 	                0x00, 0x00, 0x00, 0x00,
@@ -579,13 +612,20 @@ raop_client_stream_sample (raop_client_t *rc, guint16 *buf, guint32 len)
 	guint8 iv[16];
 	guint32 offset = 0;
 
+	if (rc->queue_count == rc->queue_depth)
+		return RAOP_EFAIL;
+	if (len > RAOP_ALAC_FRAME_SIZE * 2 * 2)
+		return RAOP_EINVAL;
+
+	pkt = &rc->packets[(rc->queue_head + rc->queue_count) % rc->queue_depth];
+
 	cnt = len + 3 + 12;
 	cnt = GUINT16_TO_BE (cnt);
 	memcpy (hdr + 2, (void *) &cnt, sizeof (cnt));
 
-	memset (rc->sbuf, 0, sizeof (rc->sbuf));
-	memcpy (rc->sbuf, hdr, sizeof (hdr));
-	pbuf = rc->sbuf + sizeof (hdr);
+	memset (pkt->data, 0, sizeof (pkt->data));
+	memcpy (pkt->data, hdr, sizeof (hdr));
+	pbuf = pkt->data + sizeof (hdr);
 
 	/* ALAC frame header */
 	write_bits (pbuf, 1, 3, &offset); /* # of channels */
@@ -605,8 +645,11 @@ raop_client_stream_sample (raop_client_t *rc, guint16 *buf, guint32 len)
 	                 (len + 3) / 16 * 16,
 	                 rc->aes_key, iv, TRUE);
 
-	rc->sbuf_size = len + 3 + sizeof (hdr);
-	rc->sbuf_offset = 0;
+	pkt->size = len + 3 + sizeof (hdr);
+	pkt->pcm_len = len;
+
+	rc->queue_count++;
+	rc->queued_pcm += len;
 
 	return RAOP_EOK;
 }
@@ -615,7 +658,14 @@ gint
 raop_client_flush (raop_client_t *rc)
 {
 	if (rc->rtsp_state & RAOP_RTSP_CONNECTED) {
-		memset (rc->sbuf, 0, sizeof (rc->sbuf));
+		/* a packet on its way out has to be completed, or the
+		 * receiver loses track of the framing */
+		if (rc->queue_count && rc->queue_offset) {
+			rc->queued_pcm = rc->packets[rc->queue_head].pcm_len;
+			rc->queue_count = 1;
+		} else {
+			raop_queue_clear (rc);
+		}
 		rc->rtsp_state |= RAOP_RTSP_FLUSH;
 		rc->io_state |= RAOP_IO_RTSP_WRITE;
 	}
@@ -623,14 +673,45 @@ raop_client_flush (raop_client_t *rc)
 	return RAOP_EOK;
 }
 
+/**
+ * Size the send queue in packets, drops whatever is queued.
+ */
 gint
-raop_client_set_stream_cb (raop_client_t *rc, raop_client_stream_cb_func_t func, void *data)
+raop_client_set_queue_depth (raop_client_t *rc, guint depth)
 {
-	rc->stream_cb.func = func;
-	rc->stream_cb.data = data;
+	if (depth < 1)
+		return RAOP_EINVAL;
+
+	g_free (rc->packets);
+	rc->packets = g_new (raop_packet_t, depth);
+	rc->queue_depth = depth;
+	raop_queue_clear (rc);
+
 	return RAOP_EOK;
 }
 
+/**
+ * How many packets can be queued right now. Nothing can before the
+ * stream channel is up.
+ */
+guint
+raop_client_queue_space (raop_client_t *rc)
+{
+	if (!(rc->rtsp_state & RAOP_RTSP_CONNECTED) || rc->stream_fd == -1)
+		return 0;
+
+	return rc->queue_depth - rc->queue_count;
+}
+
+/**
+ * Bytes of samples queued but not sent yet.
+ */
+guint
+raop_client_queued_bytes (raop_client_t *rc)
+{
+	return rc->queued_pcm;
+}
+
 gint
 raop_client_set_volume (raop_client_t *rc, gdouble volume)
 {
@@ -669,7 +750,8 @@ raop_client_can_write (raop_client_t *rc, gint fd)
 	if (fd == rtsp_fd) {
 		return rc->io_state & RAOP_IO_RTSP_WRITE;
 	} else if (fd == rc->stream_fd) {
-		return rc->io_state & RAOP_IO_STREAM_WRITE;
+		/* nothing to do on a writable stream until there's a packet */
+		return (rc->io_state & RAOP_IO_STREAM_WRITE) && rc->queue_count;
 	} else {
 		return FALSE;
 	}
@@ -701,6 +783,8 @@ raop_client_disconnect (raop_client_t *rc)
 	rc->io_state = RAOP_IO_UNDEFINED;
 	rc->rtsp_state = RAOP_RTSP_DISCONNECTED;
 	g_free (rc->rtsp_url);
+	rc->rtsp_url = NULL;
+	raop_queue_clear (rc);
 	return RAOP_EOK;
 }
 
@@ -710,6 +794,7 @@ raop_client_destroy (raop_client_t *rc)
 	if (!rc)
 		return RAOP_EINVAL;
 
+	g_free (rc->packets);
 	g_free (rc->aes_key);
 	g_free (rc->apex_host);
 	g_free (rc->cli_host);
@@ -15,6 +15,9 @@
 #define RAOP_ALAC_NUM_CHANNELS 2
 #define RAOP_ALAC_BITS_PER_SAMPLE 16
 
+/* packets prepared ahead of the socket, ~93ms each */
+#define RAOP_DEFAULT_QUEUE_DEPTH 8
+
 /* Return/Error codes */
 #define RAOP_EOK     0
 #define RAOP_EFAIL  -1
@@ -26,21 +29,18 @@
 
 typedef struct raop_client_struct raop_client_t;
 
-typedef int (*raop_client_stream_cb_func_t) (void *, guchar *, int);
-
-typedef struct {
-	raop_client_stream_cb_func_t func;
-	void *data;	
-} raop_client_stream_cb_t;
-
 
 gint raop_client_init(raop_client_t **rc);
 gint raop_client_connect(raop_client_t *rc, const gchar *host, gushort port);
 
 gint raop_client_handle_io(raop_client_t *rc, int fd, GIOCondition cond);
-gint raop_client_set_stream_cb(raop_client_t *rc, raop_client_stream_cb_func_t cb, void *data);
 gint raop_client_flush(raop_client_t *rc);
 
+gint raop_client_set_queue_depth(raop_client_t *rc, guint depth);
+gint raop_client_queue_sample(raop_client_t *rc, const guchar *buf, guint32 len);
+guint raop_client_queue_space(raop_client_t *rc);
+guint raop_client_queued_bytes(raop_client_t *rc);
+
 gint raop_client_disconnect(raop_client_t *rc);
 gint raop_client_destroy(raop_client_t *rc);
 
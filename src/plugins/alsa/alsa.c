@@ -22,10 +22,14 @@
 
 #include <glib.h>
 
+#include <poll.h>
+#include <unistd.h>
+
 /*
  *  Defines
  */
-#define BUFFER_TIME        500000
+#define BUFFER_TIME        "500"
+#define PERIOD_TIME        "0"
 #define MAX_CHANNELS       8
 
 /*
@@ -35,6 +39,26 @@ typedef struct xmms_alsa_data_St {
 	snd_pcm_t *pcm;
 	snd_mixer_t *mixer;
 	snd_mixer_elem_t *mixer_elem;
+	snd_pcm_uframes_t period;
+
+	/* watches the mixer for changes, the pipe wakes it up to quit */
+	GThread *mixer_thread;
+	GMutex mixer_mutex;
+	gint mixer_wakeup[2];
+
+	/* the writer doesn't hold the plugin lock, this keeps flush out
+	 * of the device calls */
+	GMutex mutex;
+	gboolean mmap;
+	guint buffer_time;
+	guint period_time;
+
+	/* set while xmms_output_read fills the mapped area */
+	gboolean mapped;
+	xmms_stream_type_t *pending_format;
+
+	gchar *buffer;
+	gint buffer_size;
 } xmms_alsa_data_t;
 
 static const struct {
@@ -81,14 +105,21 @@ static const struct {
 static gboolean xmms_alsa_plugin_setup (xmms_output_plugin_t *plugin);
 static void xmms_alsa_flush (xmms_output_t *output);
 static void xmms_alsa_close (xmms_output_t *output);
+static void xmms_alsa_write_direct (xmms_output_t *output, gint len,
+                                    xmms_error_t *err);
 static void xmms_alsa_write (xmms_output_t *output, gpointer buffer, gint len,
                              xmms_error_t *err);
 static guint xmms_alsa_buffer_bytes_get (xmms_output_t *output);
+static guint xmms_alsa_period_get (xmms_output_t *output,
+                                   const xmms_stream_type_t *format,
+                                   guint *align);
 static gboolean xmms_alsa_open (xmms_output_t *output);
 static gboolean xmms_alsa_new (xmms_output_t *output);
 static void xmms_alsa_destroy (xmms_output_t *output);
 static gboolean xmms_alsa_format_set (xmms_output_t *output,
                                       const xmms_stream_type_t *format);
+static gboolean xmms_alsa_format_apply (xmms_alsa_data_t *data,
+                                        const xmms_stream_type_t *format);
 static gboolean xmms_alsa_set_hwparams (xmms_alsa_data_t *data,
                                         const xmms_stream_type_t *format);
 static gboolean xmms_alsa_volume_set (xmms_output_t *output,
@@ -97,6 +128,9 @@ static gboolean xmms_alsa_volume_set (xmms_output_t *output,
 static gboolean xmms_alsa_volume_get (xmms_output_t *output,
                                       const gchar **names, guint *values,
                                       guint *num_channels);
+static void xmms_alsa_mixer_watch_start (xmms_output_t *output,
+                                         xmms_alsa_data_t *data);
+static void xmms_alsa_mixer_watch_stop (xmms_alsa_data_t *data);
 static gboolean xmms_alsa_mixer_setup (xmms_output_t *plugin,
                                        xmms_alsa_data_t *data);
 static gboolean xmms_alsa_probe_modes (xmms_output_t *output,
@@ -137,9 +171,10 @@ xmms_alsa_plugin_setup (xmms_output_plugin_t *plugin)
 	methods.volume_get = xmms_alsa_volume_get;
 	methods.volume_set = xmms_alsa_volume_set;
 
-	methods.write = xmms_alsa_write;
+	methods.write_direct = xmms_alsa_write_direct;
 
 	methods.latency_get = xmms_alsa_buffer_bytes_get;
+	methods.period_get = xmms_alsa_period_get;
 
 	xmms_output_plugin_methods_set (plugin, &methods);
 
@@ -155,6 +190,16 @@ xmms_alsa_plugin_setup (xmms_output_plugin_t *plugin)
 	xmms_output_plugin_config_property_register (plugin, "mixer_index", "0",
 	                                             NULL, NULL);
 
+	/* read straight into the device buffer, takes effect on open */
+	xmms_output_plugin_config_property_register (plugin, "mmap", "0",
+	                                             NULL, NULL);
+
+	/* in ms, a period time of 0 leaves it to the device */
+	xmms_output_plugin_config_property_register (plugin, "buffer_time",
+	                                             BUFFER_TIME, NULL, NULL);
+	xmms_output_plugin_config_property_register (plugin, "period_time",
+	                                             PERIOD_TIME, NULL, NULL);
+
 	return TRUE;
 }
 
@@ -189,10 +234,17 @@ xmms_alsa_new (xmms_output_t *output)
 		return FALSE;
 	}
 
+	g_mutex_init (&data->mutex);
+	g_mutex_init (&data->mixer_mutex);
+
 	xmms_alsa_mixer_setup (output, data);
 
 	xmms_output_private_data_set (output, data);
 
+	if (data->mixer) {
+		xmms_alsa_mixer_watch_start (output, data);
+	}
+
 	return TRUE;
 }
 
@@ -308,6 +360,8 @@ xmms_alsa_destroy (xmms_output_t *output)
 	data = xmms_output_private_data_get (output);
 	g_return_if_fail (data);
 
+	xmms_alsa_mixer_watch_stop (data);
+
 	if (data->mixer) {
 		err = snd_mixer_close (data->mixer);
 		if (err != 0) {
@@ -318,6 +372,13 @@ xmms_alsa_destroy (xmms_output_t *output)
 		}
 	}
 
+	if (data->pending_format) {
+		xmms_object_unref (data->pending_format);
+	}
+
+	g_mutex_clear (&data->mutex);
+	g_mutex_clear (&data->mixer_mutex);
+	g_free (data->buffer);
 	g_free (data);
 }
 
@@ -347,7 +408,16 @@ xmms_alsa_open (xmms_output_t *output)
 		dev = "default";
 	}
 
-	XMMS_DBG ("Opening device: %s", dev);
+	cv = xmms_output_config_lookup (output, "mmap");
+	data->mmap = !!xmms_config_property_get_int (cv);
+
+	cv = xmms_output_config_lookup (output, "buffer_time");
+	data->buffer_time = MAX (xmms_config_property_get_int (cv), 1) * 1000;
+
+	cv = xmms_output_config_lookup (output, "period_time");
+	data->period_time = MAX (xmms_config_property_get_int (cv), 0) * 1000;
+
+	XMMS_DBG ("Opening device: %s%s", dev, data->mmap ? " (mmap)" : "");
 
 	/* Open the device */
 	err = snd_pcm_open (&(data->pcm), dev, SND_PCM_STREAM_PLAYBACK,
@@ -401,7 +471,8 @@ xmms_alsa_set_hwparams (xmms_alsa_data_t *data,
 {
 	snd_pcm_format_t alsa_format = SND_PCM_FORMAT_UNKNOWN;
 	gint err, tmp, i, fmt;
-	guint requested_buffer_time = BUFFER_TIME;
+	guint requested_buffer_time = data->buffer_time;
+	guint requested_period_time = data->period_time;
 	snd_pcm_hw_params_t *hwparams;
 
 	g_return_val_if_fail (data, FALSE);
@@ -427,8 +498,10 @@ xmms_alsa_set_hwparams (xmms_alsa_data_t *data,
 		return FALSE;
 	}
 
-	/* Set the interleaved read/write format */
+	/* Set the interleaved read/write or mmap format */
 	err = snd_pcm_hw_params_set_access (data->pcm, hwparams,
+	                                    data->mmap ?
+	                                    SND_PCM_ACCESS_MMAP_INTERLEAVED :
 	                                    SND_PCM_ACCESS_RW_INTERLEAVED);
 	if (err < 0) {
 		xmms_log_error ("Access type not available for playback: %s",
@@ -477,6 +550,21 @@ xmms_alsa_set_hwparams (xmms_alsa_data_t *data,
 	XMMS_DBG ("Buffer time requested: %dms, got: %dms",
 	          tmp / 1000, requested_buffer_time / 1000);
 
+	if (requested_period_time) {
+		tmp = requested_period_time;
+		err = snd_pcm_hw_params_set_period_time_near (data->pcm, hwparams,
+		                                              &requested_period_time,
+		                                              NULL);
+		if (err < 0) {
+			xmms_log_error ("Unable to set period time %i for playback: %s",
+			                tmp, snd_strerror (err));
+			return FALSE;
+		}
+
+		XMMS_DBG ("Period time requested: %dms, got: %dms",
+		          tmp / 1000, requested_period_time / 1000);
+	}
+
 	/* Put the hardware parameters into good use */
 	err = snd_pcm_hw_params (data->pcm, hwparams);
 	if (err < 0) {
@@ -485,10 +573,131 @@ xmms_alsa_set_hwparams (xmms_alsa_data_t *data,
 		return FALSE;
 	}
 
+	err = snd_pcm_hw_params_get_period_size (hwparams, &data->period, NULL);
+	if (err < 0) {
+		data->period = 0;
+	}
+
 	return TRUE;
 }
 
 
+/**
+ * Write a period at a time, it's what the device wakes us up for.
+ *
+ * @param output The output struct containing alsa data.
+ * @param format The format that was just set.
+ * @param align Unused, any number of frames can be written.
+ * @return The period size in frames, 0 if unknown.
+ */
+static guint
+xmms_alsa_period_get (xmms_output_t *output, const xmms_stream_type_t *format,
+                      guint *align)
+{
+	xmms_alsa_data_t *data;
+
+	g_return_val_if_fail (output, 0);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, 0);
+
+	return data->period;
+}
+
+
+
+/**
+ * Wait for mixer events and have the server read the volume on each,
+ * so it doesn't have to poll.
+ */
+static gpointer
+xmms_alsa_mixer_watch (gpointer udata)
+{
+	xmms_output_t *output = (xmms_output_t *) udata;
+	xmms_alsa_data_t *data;
+	struct pollfd *fds;
+	unsigned short revents;
+	gint n, err;
+
+	data = xmms_output_private_data_get (output);
+
+	n = snd_mixer_poll_descriptors_count (data->mixer);
+	fds = g_new0 (struct pollfd, n + 1);
+	n = snd_mixer_poll_descriptors (data->mixer, fds, n);
+
+	fds[n].fd = data->mixer_wakeup[0];
+	fds[n].events = POLLIN;
+
+	while (TRUE) {
+		if (poll (fds, n + 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+
+		if (fds[n].revents) {
+			break;
+		}
+
+		g_mutex_lock (&data->mixer_mutex);
+		err = snd_mixer_poll_descriptors_revents (data->mixer, fds, n,
+		                                          &revents);
+		if (err >= 0 && (revents & POLLIN)) {
+			err = snd_mixer_handle_events (data->mixer);
+		}
+		g_mutex_unlock (&data->mixer_mutex);
+
+		if (err < 0 || (revents & (POLLERR | POLLNVAL))) {
+			xmms_log_error ("Lost track of mixer events, polling instead");
+			break;
+		}
+
+		xmms_output_volume_changed (output);
+	}
+
+	/* done, or broken, either way the server has to poll */
+	xmms_output_volume_events_set (output, FALSE);
+
+	g_free (fds);
+
+	return NULL;
+}
+
+static void
+xmms_alsa_mixer_watch_start (xmms_output_t *output, xmms_alsa_data_t *data)
+{
+	if (snd_mixer_poll_descriptors_count (data->mixer) <= 0) {
+		return;
+	}
+
+	if (pipe (data->mixer_wakeup) < 0) {
+		return;
+	}
+
+	xmms_output_volume_events_set (output, TRUE);
+
+	data->mixer_thread = g_thread_new ("x2 alsa mixer",
+	                                   xmms_alsa_mixer_watch, output);
+}
+
+static void
+xmms_alsa_mixer_watch_stop (xmms_alsa_data_t *data)
+{
+	if (!data->mixer_thread) {
+		return;
+	}
+
+	if (write (data->mixer_wakeup[1], "", 1) < 0) {
+		xmms_log_error ("Couldn't wake up the mixer thread");
+	}
+
+	g_thread_join (data->mixer_thread);
+	data->mixer_thread = NULL;
+
+	close (data->mixer_wakeup[0]);
+	close (data->mixer_wakeup[1]);
+}
+
 
 /**
  * Setup mixer
@@ -592,13 +801,39 @@ xmms_alsa_mixer_setup (xmms_output_t *output, xmms_alsa_data_t *data)
 static gboolean
 xmms_alsa_format_set (xmms_output_t *output, const xmms_stream_type_t *format)
 {
-	gint err = 0;
 	xmms_alsa_data_t *data;
 
 	g_return_val_if_fail (output, FALSE);
 	data = xmms_output_private_data_get (output);
 	g_return_val_if_fail (data, FALSE);
 
+	if (data->mapped) {
+		/* called from within the read into the mapped area, the
+		 * device can't be set up again until that is done */
+		if (data->pending_format) {
+			xmms_object_unref (data->pending_format);
+		}
+		data->pending_format = xmms_object_ref ((gpointer) format);
+		return TRUE;
+	}
+
+	return xmms_alsa_format_apply (data, format);
+}
+
+
+/**
+ * Get the device ready for a new format.
+ *
+ * @param data The private plugin data.
+ * @param format The new format.
+ * @return TRUE on success, FALSE on error
+ */
+static gboolean
+xmms_alsa_format_apply (xmms_alsa_data_t *data,
+                        const xmms_stream_type_t *format)
+{
+	gint err = 0;
+
 	switch (snd_pcm_state (data->pcm)) {
 		case SND_PCM_STATE_OPEN:
 		case SND_PCM_STATE_SETUP:
@@ -665,8 +900,10 @@ xmms_alsa_volume_set (xmms_output_t *output,
 		return FALSE;
 	}
 
+	g_mutex_lock (&data->mixer_mutex);
 	err = snd_mixer_selem_set_playback_volume (data->mixer_elem,
 	                                           channel, volume);
+	g_mutex_unlock (&data->mixer_mutex);
 
 	return (err >= 0);
 }
@@ -704,8 +941,11 @@ xmms_alsa_volume_get (xmms_output_t *output, const gchar **names,
 	g_return_val_if_fail (names, FALSE);
 	g_return_val_if_fail (values, FALSE);
 
+	g_mutex_lock (&data->mixer_mutex);
+
 	err = snd_mixer_handle_events (data->mixer);
 	if (err < 0) {
+		g_mutex_unlock (&data->mixer_mutex);
 		xmms_log_error ("Handling of pending mixer events failed: %s",
 		                snd_strerror (err));
 		return FALSE;
@@ -726,6 +966,8 @@ xmms_alsa_volume_get (xmms_output_t *output, const gchar **names,
 		names[i] = channel_map[i].name;
 	}
 
+	g_mutex_unlock (&data->mixer_mutex);
+
 	return TRUE;
 }
 
@@ -749,6 +991,10 @@ xmms_alsa_buffer_bytes_get (xmms_output_t *output)
 	data = xmms_output_private_data_get (output);
 	g_return_val_if_fail (data, 0);
 
+	if (!data->pcm) {
+		return 0;
+	}
+
 	ret = snd_pcm_delay (data->pcm, &avail);
 	if (ret != 0 || avail < 0) {
 		return 0;
@@ -775,10 +1021,12 @@ xmms_alsa_flush (xmms_output_t *output)
 	data = xmms_output_private_data_get (output);
 	g_return_if_fail (data);
 
+	g_mutex_lock (&data->mutex);
 	err = snd_pcm_drop (data->pcm);
 	if (err >= 0) {
 		err = snd_pcm_prepare (data->pcm);
 	}
+	g_mutex_unlock (&data->mutex);
 
 	if (err < 0) {
 		xmms_log_error ("Flush failed: %s", snd_strerror (err));
@@ -830,6 +1078,173 @@ xmms_alsa_write (xmms_output_t *output, gpointer buffer, gint len,
 	}
 }
 
+static void
+xmms_alsa_error_set (xmms_error_t *error, const gchar *what, gint err)
+{
+	gchar *message;
+
+	message = g_strdup_printf ("%s (%s)", what, snd_strerror (err));
+	xmms_error_set (error, XMMS_ERROR_GENERIC, message);
+	g_free (message);
+}
+
+/**
+ * Read a period straight into the mapped device buffer.
+ *
+ * @param output The output struct containing alsa data.
+ * @param data The private plugin data.
+ * @param len The number of bytes to move.
+ */
+static void
+xmms_alsa_write_mmap (xmms_output_t *output, xmms_alsa_data_t *data,
+                      gint len, xmms_error_t *error)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames;
+	snd_pcm_sframes_t left, avail, committed;
+	gint ret, want, err;
+	gchar *dst;
+
+	/* have a format change happen now rather than while mapped */
+	if (xmms_output_read_prepare (output) < 0) {
+		return;
+	}
+
+	left = snd_pcm_bytes_to_frames (data->pcm, len);
+
+	while (left > 0) {
+		g_mutex_lock (&data->mutex);
+
+		avail = snd_pcm_avail_update (data->pcm);
+		if (avail < 0) {
+			err = snd_pcm_recover (data->pcm, avail, 0);
+			g_mutex_unlock (&data->mutex);
+
+			if (err < 0) {
+				xmms_alsa_error_set (error, "Could not recover PCM device", err);
+				return;
+			}
+			continue;
+		}
+
+		if (avail < MIN (left, (snd_pcm_sframes_t) MAX (data->period, 1))) {
+			g_mutex_unlock (&data->mutex);
+
+			snd_pcm_wait (data->pcm, 100);
+			continue;
+		}
+
+		frames = MIN (avail, left);
+		err = snd_pcm_mmap_begin (data->pcm, &areas, &offset, &frames);
+		if (err < 0) {
+			err = snd_pcm_recover (data->pcm, err, 0);
+			g_mutex_unlock (&data->mutex);
+
+			if (err < 0) {
+				xmms_alsa_error_set (error, "Could not map PCM device", err);
+				return;
+			}
+			continue;
+		}
+		data->mapped = TRUE;
+
+		g_mutex_unlock (&data->mutex);
+
+		/* interleaved, so all channels are in the first area */
+		dst = (gchar *) areas[0].addr;
+		dst += (areas[0].first + offset * areas[0].step) / 8;
+		want = snd_pcm_frames_to_bytes (data->pcm, frames);
+
+		ret = xmms_output_read (output, dst, want);
+
+		g_mutex_lock (&data->mutex);
+		data->mapped = FALSE;
+
+		frames = 0;
+		if (ret > 0 && !data->pending_format) {
+			frames = snd_pcm_bytes_to_frames (data->pcm, ret);
+		}
+
+		committed = snd_pcm_mmap_commit (data->pcm, offset, frames);
+
+		/* a flush while reading leaves the device prepared, what was
+		 * read is to be dropped then anyway */
+		if (committed < 0 &&
+		    snd_pcm_state (data->pcm) != SND_PCM_STATE_PREPARED) {
+			err = snd_pcm_recover (data->pcm, committed, 0);
+			if (err < 0) {
+				g_mutex_unlock (&data->mutex);
+				xmms_alsa_error_set (error, "Could not recover PCM device", err);
+				return;
+			}
+		} else if (committed > 0 &&
+		           snd_pcm_state (data->pcm) == SND_PCM_STATE_PREPARED) {
+			/* unlike writes, commits don't start the device */
+			snd_pcm_start (data->pcm);
+		}
+
+		g_mutex_unlock (&data->mutex);
+
+		if (data->pending_format) {
+			/* it has to be dropped, it's in the format coming up */
+			XMMS_DBG ("Format changed while mapped, dropped %d bytes", ret);
+
+			g_mutex_lock (&data->mutex);
+			if (!xmms_alsa_format_apply (data, data->pending_format)) {
+				xmms_error_set (error, XMMS_ERROR_GENERIC,
+				                "Could not set new format");
+			}
+			g_mutex_unlock (&data->mutex);
+
+			xmms_object_unref (data->pending_format);
+			data->pending_format = NULL;
+			return;
+		}
+
+		/* end of stream or an underrun, let the writer come back */
+		if (ret < want) {
+			return;
+		}
+
+		left -= frames;
+	}
+}
+
+/**
+ * Move a period from the output buffer to the audio device.
+ *
+ * @param output The output struct containing alsa data.
+ * @param len The number of bytes to move.
+ */
+static void
+xmms_alsa_write_direct (xmms_output_t *output, gint len, xmms_error_t *error)
+{
+	xmms_alsa_data_t *data;
+	gint ret;
+
+	g_return_if_fail (output);
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+	g_return_if_fail (data->pcm);
+
+	if (data->mmap) {
+		xmms_alsa_write_mmap (output, data, len, error);
+		return;
+	}
+
+	if (data->buffer_size < len) {
+		data->buffer = g_realloc (data->buffer, len);
+		data->buffer_size = len;
+	}
+
+	ret = xmms_output_read (output, data->buffer, len);
+	if (ret > 0) {
+		g_mutex_lock (&data->mutex);
+		xmms_alsa_write (output, data->buffer, ret, error);
+		g_mutex_unlock (&data->mutex);
+	}
+}
+
 static snd_mixer_elem_t *
 xmms_alsa_find_mixer_elem (snd_mixer_t *mixer, gint index, const char *name)
 {
@@ -38,7 +38,7 @@
 
 typedef struct {
 	AVCodecContext *codecctx;
-	AVPacket packet;
+	AVPacket *packet;
 
 	guchar *buffer;
 	guint buffer_length;
@@ -58,14 +58,18 @@ typedef struct {
 	gpointer extradata;
 	gssize extradata_size;
 
-	GString *outbuf;
+	xmms_xform_fifo_t *outbuf;
 } xmms_avcodec_data_t;
 
 static gboolean xmms_avcodec_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gboolean xmms_avcodec_init (xmms_xform_t *xform);
 static void xmms_avcodec_destroy (xmms_xform_t *xform);
+static gint xmms_avcodec_internal_fill (xmms_xform_t *xform, xmms_avcodec_data_t *data, xmms_error_t *error);
+static gint xmms_avcodec_internal_next_frame (xmms_xform_t *xform, xmms_avcodec_data_t *data, xmms_error_t *error);
 static gint xmms_avcodec_internal_read_some (xmms_xform_t *xform, xmms_avcodec_data_t *data, xmms_error_t *error);
 static gint xmms_avcodec_internal_decode_some (xmms_avcodec_data_t *data);
+static gsize xmms_avcodec_internal_frame_size (xmms_avcodec_data_t *data);
+static void xmms_avcodec_internal_convert (xmms_avcodec_data_t *data, guint8 *out);
 static void xmms_avcodec_internal_append (xmms_avcodec_data_t *data);
 static gint xmms_avcodec_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                                xmms_error_t *error);
@@ -95,6 +99,10 @@ xmms_avcodec_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
+	/* decoder threads for codecs that can use them, 0 for one per core */
+	xmms_xform_plugin_config_property_register (xform_plugin, "threads",
+	                                            "0", NULL, NULL);
+
 	xmms_magic_add ("Shorten header", "audio/x-ffmpeg-shorten",
 	                "0 string ajkg", NULL);
 	xmms_magic_add ("A/52 (AC-3) header", "audio/x-ffmpeg-ac3",
@@ -133,8 +141,9 @@ xmms_avcodec_destroy (xmms_xform_t *xform)
 	avcodec_close (data->codecctx);
 	av_free (data->codecctx);
 	av_frame_free (&data->read_out_frame);
+	av_packet_free (&data->packet);
 
-	g_string_free (data->outbuf, TRUE);
+	xmms_xform_fifo_free (data->outbuf);
 	g_free (data->buffer);
 	g_free (data->extradata);
 	g_free (data);
@@ -153,12 +162,13 @@ xmms_avcodec_init (xmms_xform_t *xform)
 	g_return_val_if_fail (xform, FALSE);
 
 	data = g_new0 (xmms_avcodec_data_t, 1);
-	data->outbuf = g_string_new (NULL);
-	data->buffer = g_malloc (AVCODEC_BUFFER_SIZE);
+	data->outbuf = xmms_xform_fifo_new ();
+	data->buffer = g_malloc0 (AVCODEC_BUFFER_SIZE + AV_INPUT_BUFFER_PADDING_SIZE);
 	data->buffer_size = AVCODEC_BUFFER_SIZE;
 	data->codecctx = NULL;
-	data->packet.size = 0;
 
+	/* reused for every packet and frame */
+	data->packet = av_packet_alloc ();
 	data->read_out_frame = av_frame_alloc ();
 
 	xmms_xform_private_data_set (xform, data);
@@ -238,18 +248,40 @@ xmms_avcodec_init (xmms_xform_t *xform)
 	data->codecctx->codec_id = codec->id;
 	data->codecctx->codec_type = codec->type;
 
+	if (codec->capabilities & (AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_SLICE_THREADS)) {
+		xmms_config_property_t *cfg;
+
+		cfg = xmms_xform_config_lookup (xform, "threads");
+		data->codecctx->thread_count = cfg ? xmms_config_property_get_int (cfg) : 0;
+		data->codecctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	}
+
+	/* only the format is wanted, which the demuxer already told us */
+	if (xmms_xform_is_probe (xform) && data->samplerate > 0 &&
+	    data->channels > 0) {
+		xmms_xform_outdata_type_add (xform,
+		                             XMMS_STREAM_TYPE_MIMETYPE,
+		                             "audio/pcm",
+		                             XMMS_STREAM_TYPE_FMT_CHANNELS,
+		                             data->channels,
+		                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+		                             data->samplerate,
+		                             XMMS_STREAM_TYPE_END);
+
+		XMMS_DBG ("Probing, decoder %s not opened", codec->name);
+
+		return TRUE;
+	}
+
 	if (avcodec_open2 (data->codecctx, codec, NULL) < 0) {
 		XMMS_DBG ("Opening decoder '%s' failed", codec->name);
 		goto err;
 	} else {
-		gchar buf[42];
 		xmms_error_t error;
 
-		/* some codecs need to have something read before they set
+		/* some codecs need to have something decoded before they set
 		 * the samplerate and channels correctly, unfortunately... */
-		if ((ret = xmms_avcodec_read (xform, buf, sizeof (buf), &error)) > 0) {
-			g_string_insert_len (data->outbuf, 0, buf, ret);
-		} else {
+		if (xmms_avcodec_internal_fill (xform, data, &error) <= 0) {
 			XMMS_DBG ("First read failed, codec is not working...");
 			avcodec_close (data->codecctx);
 			goto err;
@@ -289,42 +321,89 @@ err:
 	if (data->read_out_frame) {
 		avcodec_free_frame (&data->read_out_frame);
 	}
-	g_string_free (data->outbuf, TRUE);
+	av_packet_free (&data->packet);
+	xmms_xform_fifo_free (data->outbuf);
 	g_free (data->extradata);
 	g_free (data);
 
 	return FALSE;
 }
 
+/* Read and decode until there is a new frame in read_out_frame,
+ * returns positive then, or the result of the read or decode that
+ * didn't give one. */
+static gint
+xmms_avcodec_internal_next_frame (xmms_xform_t *xform, xmms_avcodec_data_t *data,
+                                  xmms_error_t *error)
+{
+	gint res;
+
+	do {
+		if (data->no_demuxer || data->buffer_length == 0) {
+			gint bytes_read;
+
+			bytes_read = xmms_avcodec_internal_read_some (xform, data, error);
+			if (bytes_read <= 0) { return bytes_read; }
+		}
+
+		res = xmms_avcodec_internal_decode_some (data);
+	} while (res == 0);
+
+	return res;
+}
+
+/* Decode until there is some output in the fifo, returns its length,
+ * or the result of the read or decode that didn't give any. */
+static gint
+xmms_avcodec_internal_fill (xmms_xform_t *xform, xmms_avcodec_data_t *data,
+                            xmms_error_t *error)
+{
+	gsize size;
+
+	while (0 == (size = xmms_xform_fifo_length (data->outbuf))) {
+		gint res;
+
+		res = xmms_avcodec_internal_next_frame (xform, data, error);
+		if (res <= 0) { return res; }
+		xmms_avcodec_internal_append (data);
+	}
+
+	return size;
+}
+
 static gint
 xmms_avcodec_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                    xmms_error_t *error)
 {
 	xmms_avcodec_data_t *data;
-	guint size;
+	gint res;
 
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
-	while (0 == (size = MIN (data->outbuf->len, len))) {
-		gint res;
+	if (len <= 0) {
+		return 0;
+	}
 
-		if (data->no_demuxer || data->buffer_length == 0) {
-			gint bytes_read;
+	if (xmms_xform_fifo_length (data->outbuf) == 0) {
+		gsize size;
 
-			bytes_read = xmms_avcodec_internal_read_some (xform, data, error);
-			if (bytes_read <= 0) { return bytes_read; }
+		res = xmms_avcodec_internal_next_frame (xform, data, error);
+		if (res <= 0) {
+			return res;
 		}
 
-		res = xmms_avcodec_internal_decode_some (data);
-		if (res < 0) { return res; }
-		if (res > 0) { xmms_avcodec_internal_append (data); }
-	}
+		/* a frame that fits goes straight to the caller */
+		size = xmms_avcodec_internal_frame_size (data);
+		if (size <= len) {
+			xmms_avcodec_internal_convert (data, buf);
+			return size;
+		}
 
-	memcpy (buf, data->outbuf->str, size);
-	g_string_erase (data->outbuf, 0, size);
+		xmms_avcodec_internal_append (data);
+	}
 
-	return size;
+	return xmms_xform_fifo_read (data->outbuf, buf, len);
 }
 
 static gint64
@@ -361,7 +440,7 @@ xmms_avcodec_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t w
 		avcodec_flush_buffers (data->codecctx);
 
 		data->buffer_length = 0;
-		g_string_erase (data->outbuf, 0, -1);
+		xmms_xform_fifo_clear (data->outbuf);
 	}
 
 	return ret;
@@ -426,7 +505,8 @@ xmms_avcodec_internal_read_some (xmms_xform_t *xform,
 	/* If we have a demuxer plugin, make sure we read the whole packet */
 	while (read_total == data->buffer_size && !data->no_demuxer) {
 		/* multiply the buffer size and try to read again */
-		data->buffer = g_realloc (data->buffer, data->buffer_size * 2);
+		data->buffer = g_realloc (data->buffer, data->buffer_size * 2 +
+		                          AV_INPUT_BUFFER_PADDING_SIZE);
 		bytes_read = xmms_xform_read (xform,
 		                              (gchar *) data->buffer +
 		                                data->buffer_size,
@@ -444,7 +524,8 @@ xmms_avcodec_internal_read_some (xmms_xform_t *xform,
 		if (read_total < data->buffer_size) {
 			/* finally double the buffer size for performance reasons, the
 			 * hotspot handling likes to fit two frames in the buffer */
-			data->buffer = g_realloc (data->buffer, data->buffer_size * 2);
+			data->buffer = g_realloc (data->buffer, data->buffer_size * 2 +
+			                          AV_INPUT_BUFFER_PADDING_SIZE);
 			data->buffer_size *= 2;
 			XMMS_DBG ("Reallocated avcodec internal buffer to be %d bytes",
 			          data->buffer_size);
@@ -453,8 +534,9 @@ xmms_avcodec_internal_read_some (xmms_xform_t *xform,
 		}
 	}
 
-	/* Update the buffer length */
+	/* Update the buffer length, the decoder may read a bit past it */
 	data->buffer_length += read_total;
+	memset (data->buffer + data->buffer_length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
 
 	return read_total;
 }
@@ -467,20 +549,19 @@ Returns: on error: negative
          on no new data produced: zero
          otherwise: positive
 
-FIXME: data->buffer should be at least data->buffer_length +
-FF_INPUT_BUFFER_PADDING_SIZE long.
+data->buffer is always AV_INPUT_BUFFER_PADDING_SIZE longer than
+data->buffer_size, as the decoder wants.
 */
 static gint
 xmms_avcodec_internal_decode_some (xmms_avcodec_data_t *data)
 {
 	int rc = 0;
 
-	if (data->packet.size == 0) {
-		av_init_packet (&data->packet);
-		data->packet.data = data->buffer;
-		data->packet.size = data->buffer_length;
+	if (data->packet->size == 0) {
+		data->packet->data = data->buffer;
+		data->packet->size = data->buffer_length;
 
-		rc = avcodec_send_packet(data->codecctx, &data->packet);
+		rc = avcodec_send_packet(data->codecctx, data->packet);
 		if (rc == AVERROR_EOF)
 			rc = 0;
 	}
@@ -488,7 +569,7 @@ xmms_avcodec_internal_decode_some (xmms_avcodec_data_t *data)
 	if (rc == 0) {
 		rc = avcodec_receive_frame(data->codecctx, data->read_out_frame);
 		if (rc < 0) {
-			data->packet.size = 0;
+			data->packet->size = 0;
 			data->buffer_length = 0;
 			if (rc == AVERROR(EAGAIN)) rc = 0;
 			else if (rc == AVERROR_EOF) rc = 1;
@@ -498,7 +579,7 @@ xmms_avcodec_internal_decode_some (xmms_avcodec_data_t *data)
 	}
 
 	if (rc < 0) {
-		data->packet.size = 0;
+		data->packet->size = 0;
 		XMMS_DBG ("Error decoding data!");
 		return -1;
 	}
@@ -506,30 +587,52 @@ xmms_avcodec_internal_decode_some (xmms_avcodec_data_t *data)
 	return rc;
 }
 
+/* The size of read_out_frame once interleaved */
+static gsize
+xmms_avcodec_internal_frame_size (xmms_avcodec_data_t *data)
+{
+	enum AVSampleFormat fmt = (enum AVSampleFormat) data->read_out_frame->format;
+
+	return (gsize) data->read_out_frame->nb_samples *
+	       XMMS2_AVCODEC_CHANNEL_FIELD(data->codecctx) *
+	       av_get_bytes_per_sample (fmt);
+}
+
+/* Write read_out_frame to out in packed format */
 static void
-xmms_avcodec_internal_append (xmms_avcodec_data_t *data)
+xmms_avcodec_internal_convert (xmms_avcodec_data_t *data, guint8 *out)
 {
 	enum AVSampleFormat fmt = (enum AVSampleFormat) data->read_out_frame->format;
 	int samples = data->read_out_frame->nb_samples;
 	int channels = XMMS2_AVCODEC_CHANNEL_FIELD(data->codecctx);
 	int bps = av_get_bytes_per_sample (fmt);
 
-	if (av_sample_fmt_is_planar (fmt)) {
+	if (fmt == AV_SAMPLE_FMT_FLTP) {
+		/* what most of the lossy decoders give */
+		xmms_sample_interleave_float ((xmms_samplefloat_t *) out,
+		                              (xmms_samplefloat_t **) data->read_out_frame->extended_data,
+		                              channels, samples);
+	} else if (av_sample_fmt_is_planar (fmt)) {
 		/* Convert from planar to packed format */
 		gint i, j;
 
 		for (i = 0; i < samples; i++) {
 			for (j = 0; j < channels; j++) {
-				g_string_append_len (
-					data->outbuf,
-					(gchar *) (data->read_out_frame->extended_data[j] + i*bps),
-					bps
-				);
+				memcpy (out, data->read_out_frame->extended_data[j] + i*bps, bps);
+				out += bps;
 			}
 		}
 	} else {
-		g_string_append_len (data->outbuf,
-		                     (gchar *) data->read_out_frame->extended_data[0],
-		                     samples * channels * bps);
+		memcpy (out, data->read_out_frame->extended_data[0],
+		        samples * channels * bps);
 	}
 }
+
+static void
+xmms_avcodec_internal_append (xmms_avcodec_data_t *data)
+{
+	gsize len = xmms_avcodec_internal_frame_size (data);
+
+	xmms_avcodec_internal_convert (data, xmms_xform_fifo_reserve (data->outbuf, len));
+	xmms_xform_fifo_commit (data->outbuf, len);
+}
@@ -17,6 +17,7 @@
 #include <xmms/xmms_xformplugin.h>
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_util.h>
+#include <xmmsc/xmmsc_util.h>
 
 #include <cdio/cdio.h>
 #include <cdio/logging.h>
@@ -28,14 +29,33 @@
 
 #include <discid/discid.h>
 #include <glib.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #ifndef DISCID_HAVE_SPARSE_READ
 #define discid_read_sparse(disc, dev, i) discid_read(disc, dev)
 #endif
 
+/* sectors read from the drive at a time, what most drives take in
+ * one request */
+#define XMMS_CDDA_READ_SECTORS 26
+
+/* bytes of audio per millisecond */
+#define XMMS_CDDA_BYTES_PER_MS (44100 * 4 / 1000.0)
+
+/*
+ * Reads go through a render worker reading runs of sectors ahead, so
+ * the drive keeps spinning at read speed instead of following
+ * playback. With the cache on, the tracks read from start to end are
+ * kept as raw pcm in <cache dir>/cdda/<disc id>/<track>.pcm, written
+ * to a .part file and renamed once complete, and played from there
+ * when the disc is inserted again.
+ */
 typedef struct {
 	CdIo_t *cdio;
 	cdrom_drive_t *drive;
@@ -46,6 +66,17 @@ typedef struct {
 
 	gchar read_buf[CDIO_CD_FRAMESIZE_RAW];
 	gulong buf_used;
+
+	xmms_xform_render_t *render;
+
+	/* the cached track being played */
+	gint cache_fd;
+
+	/* the track being cached, up to written_lsn so far */
+	gchar *cache_path;
+	gchar *cache_tmp;
+	gint cache_wfd;
+	lsn_t written_lsn;
 } xmms_cdda_data_t;
 
 static gboolean xmms_cdda_plugin_setup (xmms_xform_plugin_t *xform_plugin);
@@ -54,11 +85,17 @@ static gboolean xmms_cdda_browse (xmms_xform_t *xform, const gchar *url,
                                   xmms_error_t *error );
 static gint xmms_cdda_read (xmms_xform_t *xform, void *buffer, gint len,
                             xmms_error_t *error);
+static gint xmms_cdda_read_sectors (xmms_xform_t *xform, gpointer buffer,
+                                    gint len, xmms_error_t *error);
 static gint64 xmms_cdda_seek (xmms_xform_t *xform, gint64 samples,
                               xmms_xform_seek_mode_t whence, xmms_error_t *err);
 static void xmms_cdda_destroy (xmms_xform_t *xform);
 
 static CdIo_t *open_cd (xmms_xform_t *xform);
+static void xmms_cdda_cache_open (xmms_cdda_data_t *data, const gchar *disc_id);
+static void xmms_cdda_cache_abandon (xmms_cdda_data_t *data);
+static void xmms_cdda_cache_write (xmms_cdda_data_t *data, lsn_t lsn,
+                                   gconstpointer buf, long sectors);
 static gboolean get_disc_ids (const gchar *device, gchar **disc_id,
                               gchar **cddb_id, track_t *tracks);
 
@@ -117,6 +154,15 @@ xmms_cdda_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin, "accessmode",
 	                                            "default", NULL, NULL);
 
+	/* milliseconds to read ahead of playback, 0 to read when needed
+	 * and -1 for the whole track */
+	xmms_xform_plugin_config_property_register (xform_plugin, "read_ahead",
+	                                            "30000", NULL, NULL);
+
+	/* keep the tracks played to the end on disk */
+	xmms_xform_plugin_config_property_register (xform_plugin, "cache",
+	                                            "0", NULL, NULL);
+
 	return TRUE;
 }
 
@@ -138,6 +184,8 @@ xmms_cdda_init (xmms_xform_t *xform)
 	const gchar *device;
 	const gchar *metakey;
 	gboolean ret = TRUE;
+	gint read_ahead;
+	gsize track_size, lead;
 
 	g_return_val_if_fail (xform, FALSE);
 	url = xmms_xform_indata_get_str (xform, XMMS_STREAM_TYPE_URL);
@@ -205,7 +253,7 @@ xmms_cdda_init (xmms_xform_t *xform)
 		goto end;
 	}
 
-	data = g_new (xmms_cdda_data_t, 1);
+	data = g_new0 (xmms_cdda_data_t, 1);
 	data->cdio = cdio;
 	data->drive = drive;
 	data->track = track;
@@ -213,6 +261,27 @@ xmms_cdda_init (xmms_xform_t *xform)
 	data->last_lsn = cdio_cddap_track_lastsector (drive, data->track);
 	data->current_lsn = first_lsn;
 	data->buf_used = CDIO_CD_FRAMESIZE_RAW;
+	data->cache_fd = -1;
+	data->cache_wfd = -1;
+
+	val = xmms_xform_config_lookup (xform, "cache");
+	if (xmms_config_property_get_int (val) && !xmms_xform_is_probe (xform)) {
+		xmms_cdda_cache_open (data, url_data[0]);
+	}
+
+	val = xmms_xform_config_lookup (xform, "read_ahead");
+	read_ahead = xmms_config_property_get_int (val);
+	track_size = (gsize) (data->last_lsn - data->first_lsn) * CDIO_CD_FRAMESIZE_RAW;
+	if (read_ahead < 0 || read_ahead * XMMS_CDDA_BYTES_PER_MS > track_size) {
+		lead = track_size;
+	} else {
+		lead = read_ahead * XMMS_CDDA_BYTES_PER_MS;
+	}
+
+	/* a cached track is read from the file as it is */
+	data->render = xmms_xform_render_new (xform, xmms_cdda_read_sectors,
+	                                      XMMS_CDDA_READ_SECTORS * CDIO_CD_FRAMESIZE_RAW,
+	                                      data->cache_fd < 0 ? lead : 0);
 
 	playtime = (data->last_lsn - data->first_lsn) *
 	           1000.0 / CDIO_CD_FRAMES_PER_SEC;
@@ -301,6 +370,17 @@ xmms_cdda_destroy (xmms_xform_t *xform)
 
 	data = xmms_xform_private_data_get (xform);
 	if (data) {
+		/* the worker may be reading */
+		if (data->render) {
+			xmms_xform_render_free (data->render);
+		}
+
+		if (data->cache_fd >= 0) {
+			close (data->cache_fd);
+		}
+		xmms_cdda_cache_abandon (data);
+		g_free (data->cache_path);
+
 		if (data->drive) {
 			cdio_cddap_close_no_free_cdio (data->drive);
 		}
@@ -327,38 +407,74 @@ xmms_cdda_read (xmms_xform_t *xform, void *buffer,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
+	if (data->cache_fd >= 0) {
+		ret = read (data->cache_fd, buffer, len);
+		if (ret < 0) {
+			xmms_error_set (error, XMMS_ERROR_GENERIC, "Reading the cached track failed");
+		}
+		return ret;
+	}
+
+	return xmms_xform_render_read (data->render, buffer, len, error);
+}
+
+/* Read from the drive, whole runs of sectors when len has room */
+static gint
+xmms_cdda_read_sectors (xmms_xform_t *xform, gpointer buffer,
+                        gint len, xmms_error_t *error)
+{
+	xmms_cdda_data_t *data;
+	gulong buf_left;
+	long sectors;
+	gint ret;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
 	if (cdio_get_media_changed (data->cdio)) {
 		xmms_error_set (error, XMMS_ERROR_GENERIC, "CD ejected");
 		return -1;
 	}
 
+	/* the rest of a sector read for a short read */
+	buf_left = CDIO_CD_FRAMESIZE_RAW - data->buf_used;
+	if (buf_left) {
+		ret = MIN (buf_left, len);
+		memcpy (buffer, data->read_buf + data->buf_used, ret);
+		data->buf_used += ret;
+		return ret;
+	}
+
 	if (data->current_lsn >= data->last_lsn) {
 		return 0;
 	}
 
-	if (data->buf_used == CDIO_CD_FRAMESIZE_RAW) {
-		cdio_cddap_read (data->drive, data->read_buf, data->current_lsn, 1);
+	sectors = MIN (len / CDIO_CD_FRAMESIZE_RAW, data->last_lsn - data->current_lsn);
+	sectors = MIN (sectors, XMMS_CDDA_READ_SECTORS);
+
+	if (!sectors) {
+		if (cdio_cddap_read (data->drive, data->read_buf, data->current_lsn, 1) != 1) {
+			xmms_error_set (error, XMMS_ERROR_GENERIC, "Reading the CD failed");
+			return -1;
+		}
+		xmms_cdda_cache_write (data, data->current_lsn, data->read_buf, 1);
 		data->current_lsn++;
-		data->buf_used = 0;
+
+		memcpy (buffer, data->read_buf, len);
+		data->buf_used = len;
+		return len;
 	}
 
-	if (len >= CDIO_CD_FRAMESIZE_RAW) {
-		ret = CDIO_CD_FRAMESIZE_RAW - data->buf_used;
-		memcpy (buffer, data->read_buf + data->buf_used, ret);
-	} else {
-		gulong buf_left = CDIO_CD_FRAMESIZE_RAW - data->buf_used;
-
-		if (buf_left < len) {
-			memcpy (buffer, data->read_buf + data->buf_used, buf_left);
-			ret = buf_left;
-		} else {
-			memcpy (buffer, data->read_buf + data->buf_used, len);
-			ret = len;
-		}
+	sectors = cdio_cddap_read (data->drive, buffer, data->current_lsn, sectors);
+	if (sectors <= 0) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, "Reading the CD failed");
+		return -1;
 	}
-	data->buf_used += ret;
 
-	return ret;
+	xmms_cdda_cache_write (data, data->current_lsn, buffer, sectors);
+	data->current_lsn += sectors;
+
+	return sectors * CDIO_CD_FRAMESIZE_RAW;
 }
 
 static gint64
@@ -383,7 +499,21 @@ xmms_cdda_seek (xmms_xform_t *xform, gint64 samples,
 		return -1;
 	}
 
+	if (data->cache_fd >= 0) {
+		off_t offset = (off_t) new_lsn * CDIO_CD_FRAMESIZE_RAW;
+
+		if (lseek (data->cache_fd, offset, SEEK_SET) != offset) {
+			xmms_error_set (err, XMMS_ERROR_GENERIC, "Seeking the cached track failed");
+			return -1;
+		}
+		return samples;
+	}
+
+	/* nothing read before the seek is handed out after it */
+	xmms_xform_render_stop (data->render);
 	data->current_lsn = data->first_lsn + new_lsn;
+	data->buf_used = CDIO_CD_FRAMESIZE_RAW;
+	xmms_xform_render_start (data->render);
 
 	return samples;
 }
@@ -391,6 +521,121 @@ xmms_cdda_seek (xmms_xform_t *xform, gint64 samples,
 /*
  * Private stuff
  */
+static gchar *
+cache_path (const gchar *disc_id, track_t track)
+{
+	gchar cachedir[XMMS_PATH_MAX];
+	gchar name[16];
+
+	if (!xmms_usercachedir_get (cachedir, XMMS_PATH_MAX)) {
+		return NULL;
+	}
+
+	g_snprintf (name, sizeof (name), "%02d.pcm", track);
+
+	return g_build_filename (cachedir, "cdda", disc_id, name, NULL);
+}
+
+/* Play the track from the cache if it is there, else start caching it */
+static void
+xmms_cdda_cache_open (xmms_cdda_data_t *data, const gchar *disc_id)
+{
+	GStatBuf st;
+	gchar *dir;
+
+	data->cache_path = cache_path (disc_id, data->track);
+	if (!data->cache_path) {
+		return;
+	}
+
+	if (g_stat (data->cache_path, &st) == 0 &&
+	    st.st_size == (gint64) (data->last_lsn - data->first_lsn) * CDIO_CD_FRAMESIZE_RAW) {
+		data->cache_fd = g_open (data->cache_path, O_RDONLY, 0);
+		if (data->cache_fd >= 0) {
+			XMMS_DBG ("Playing track %d from the cache", data->track);
+			return;
+		}
+	}
+
+	dir = g_path_get_dirname (data->cache_path);
+	g_mkdir_with_parents (dir, 0755);
+	g_free (dir);
+
+	data->cache_tmp = g_strconcat (data->cache_path, ".part", NULL);
+	data->cache_wfd = g_open (data->cache_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (data->cache_wfd < 0) {
+		xmms_log_error ("Couldn't cache the track in '%s'", data->cache_tmp);
+		g_free (data->cache_tmp);
+		data->cache_tmp = NULL;
+	}
+
+	data->written_lsn = data->first_lsn;
+}
+
+/* Stop caching a track that wasn't read from start to end */
+static void
+xmms_cdda_cache_abandon (xmms_cdda_data_t *data)
+{
+	if (data->cache_wfd < 0) {
+		return;
+	}
+
+	close (data->cache_wfd);
+	data->cache_wfd = -1;
+
+	g_unlink (data->cache_tmp);
+	g_free (data->cache_tmp);
+	data->cache_tmp = NULL;
+}
+
+/* Add sectors read at lsn to the track being cached, as long as they
+ * follow what it has */
+static void
+xmms_cdda_cache_write (xmms_cdda_data_t *data, lsn_t lsn, gconstpointer buf,
+                       long sectors)
+{
+	const gchar *pos = buf;
+	gssize left = sectors * CDIO_CD_FRAMESIZE_RAW;
+
+	if (data->cache_wfd < 0) {
+		return;
+	}
+
+	if (lsn != data->written_lsn) {
+		XMMS_DBG ("Not caching track %d, it was seeked in", data->track);
+		xmms_cdda_cache_abandon (data);
+		return;
+	}
+
+	while (left > 0) {
+		gssize ret = write (data->cache_wfd, pos, left);
+		if (ret <= 0) {
+			xmms_log_error ("Couldn't write to the cache, not caching the track");
+			xmms_cdda_cache_abandon (data);
+			return;
+		}
+		pos += ret;
+		left -= ret;
+	}
+
+	data->written_lsn += sectors;
+	if (data->written_lsn < data->last_lsn) {
+		return;
+	}
+
+	close (data->cache_wfd);
+	data->cache_wfd = -1;
+
+	if (g_rename (data->cache_tmp, data->cache_path) == 0) {
+		XMMS_DBG ("Cached track %d in '%s'", data->track, data->cache_path);
+	} else {
+		g_unlink (data->cache_tmp);
+	}
+
+	g_free (data->cache_tmp);
+	data->cache_tmp = NULL;
+}
+
 static CdIo_t *
 open_cd (xmms_xform_t *xform)
 {
@@ -0,0 +1,358 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/**
+ * @file
+ * Up and downmixing between channel counts the sample converter
+ * doesn't handle, through a standard or user given matrix.
+ */
+
+#include <xmms/xmms_xformplugin.h>
+#include <xmms/xmms_sample.h>
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channelmix_matrix.h"
+#include "../mixing_common/mixing.c"
+
+/* frames mixed at a time */
+#define XMMS_CHANNELMIX_CHUNK 512
+
+typedef struct {
+	gint in_channels;
+	gint out_channels;
+	xmms_sample_format_t in_format;
+	xmms_sample_format_t out_format;
+	gint in_frame;
+	gint out_frame;
+
+	/* out rows of in coefficients */
+	gfloat *matrix;
+
+	/* read ahead up to a chunk, with a partial frame left over */
+	guint8 *inbuf;
+	gint inlen;
+
+	gfloat *work;
+	gfloat *planes_in;
+	gfloat *planes_out;
+
+	guint8 *outbuf;
+	gint out_pos;
+	gint out_len;
+} xmms_channelmix_data_t;
+
+static gboolean xmms_channelmix_plugin_setup (xmms_xform_plugin_t *xform_plugin);
+static gboolean xmms_channelmix_init (xmms_xform_t *xform);
+static void xmms_channelmix_destroy (xmms_xform_t *xform);
+static gint xmms_channelmix_read (xmms_xform_t *xform, xmms_sample_t *buf,
+                                  gint len, xmms_error_t *err);
+static gint64 xmms_channelmix_seek (xmms_xform_t *xform, gint64 samples,
+                                    xmms_xform_seek_mode_t whence,
+                                    xmms_error_t *err);
+
+XMMS_XFORM_PLUGIN_DEFINE ("channelmix",
+                          "Channel mixer", XMMS_VERSION,
+                          "Up and downmixing of multichannel audio",
+                          xmms_channelmix_plugin_setup);
+
+static const xmms_sample_format_t formats[] = {
+	XMMS_SAMPLE_FORMAT_S16,
+	XMMS_SAMPLE_FORMAT_S32,
+	XMMS_SAMPLE_FORMAT_FLOAT,
+};
+
+static gboolean
+xmms_channelmix_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+	gint i;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+	methods.init = xmms_channelmix_init;
+	methods.destroy = xmms_channelmix_destroy;
+	methods.read = xmms_channelmix_read;
+	methods.seek = xmms_channelmix_seek;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	for (i = 0; i < G_N_ELEMENTS (formats); i++) {
+		xmms_xform_plugin_indata_add (xform_plugin,
+		                              XMMS_STREAM_TYPE_MIMETYPE,
+		                              "audio/pcm",
+		                              XMMS_STREAM_TYPE_FMT_FORMAT,
+		                              formats[i],
+		                              XMMS_STREAM_TYPE_END);
+	}
+
+	/* in:out=rows for the counts it covers, see channelmix_matrix.c */
+	xmms_xform_plugin_config_property_register (xform_plugin, "matrix", "",
+	                                            NULL, NULL);
+
+	/* how much of the LFE goes to the center when a layout lacks it */
+	xmms_xform_plugin_config_property_register (xform_plugin, "lfe_level", "0.0",
+	                                            NULL, NULL);
+
+	/* scale downmixes so they can't clip */
+	xmms_xform_plugin_config_property_register (xform_plugin, "normalize", "1",
+	                                            NULL, NULL);
+
+	return TRUE;
+}
+
+static gfloat *
+xmms_channelmix_matrix (xmms_xform_t *xform, gint in, gint out)
+{
+	xmms_config_property_t *config;
+	gfloat *matrix = NULL;
+	gfloat lfe_level = 0.0;
+	gboolean normalize = TRUE;
+
+	config = xmms_xform_config_lookup (xform, "matrix");
+	if (config) {
+		const gchar *spec = xmms_config_property_get_string (config);
+
+		matrix = xmms_channelmix_matrix_parse (spec, in, out);
+		if (!matrix && spec && *spec && strchr (spec, ':')) {
+			XMMS_DBG ("No usable %d:%d matrix in '%s'", in, out, spec);
+		}
+	}
+
+	if (matrix) {
+		return matrix;
+	}
+
+	config = xmms_xform_config_lookup (xform, "lfe_level");
+	if (config) {
+		lfe_level = xmms_config_property_get_float (config);
+	}
+
+	config = xmms_xform_config_lookup (xform, "normalize");
+	if (config) {
+		normalize = !!xmms_config_property_get_int (config);
+	}
+
+	return xmms_channelmix_matrix_standard (in, out, lfe_level, normalize);
+}
+
+static gboolean
+xmms_channelmix_init (xmms_xform_t *xform)
+{
+	xmms_channelmix_data_t *data;
+	const xmms_stream_type_t *goal;
+	gint in, out, format;
+	gfloat *matrix;
+
+	g_return_val_if_fail (xform, FALSE);
+
+	goal = xmms_xform_goal_pcm_get (xform);
+	if (!goal) {
+		return FALSE;
+	}
+
+	in = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	out = xmms_stream_type_get_int (goal, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	if (in == out) {
+		return FALSE;
+	}
+
+	matrix = xmms_channelmix_matrix (xform, in, out);
+	if (!matrix) {
+		XMMS_DBG ("Can't mix %d channels into %d", in, out);
+		return FALSE;
+	}
+
+	data = g_new0 (xmms_channelmix_data_t, 1);
+	data->matrix = matrix;
+	data->in_channels = in;
+	data->out_channels = out;
+	data->in_format = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_FORMAT);
+
+	/* what the output wants if it can be written, the converter
+	 * handles the rest */
+	format = xmms_stream_type_get_int (goal, XMMS_STREAM_TYPE_FMT_FORMAT);
+	if (format == XMMS_SAMPLE_FORMAT_S16 || format == XMMS_SAMPLE_FORMAT_S32) {
+		data->out_format = format;
+	} else {
+		data->out_format = XMMS_SAMPLE_FORMAT_FLOAT;
+	}
+
+	data->in_frame = xmms_sample_size_get (data->in_format) * in;
+	data->out_frame = xmms_sample_size_get (data->out_format) * out;
+
+	data->inbuf = g_malloc (XMMS_CHANNELMIX_CHUNK * data->in_frame);
+	data->work = g_new (gfloat, XMMS_CHANNELMIX_CHUNK * MAX (in, out));
+	data->planes_in = g_new (gfloat, XMMS_CHANNELMIX_CHUNK * in);
+	data->planes_out = g_new (gfloat, XMMS_CHANNELMIX_CHUNK * out);
+	data->outbuf = g_malloc (XMMS_CHANNELMIX_CHUNK * data->out_frame);
+
+	xmms_xform_private_data_set (xform, data);
+
+	xmms_xform_outdata_type_add (xform,
+	                             XMMS_STREAM_TYPE_MIMETYPE,
+	                             "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT,
+	                             data->out_format,
+	                             XMMS_STREAM_TYPE_FMT_CHANNELS,
+	                             out,
+	                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+	                             xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_SAMPLERATE),
+	                             XMMS_STREAM_TYPE_END);
+
+	XMMS_DBG ("Mixing %d channels into %d", in, out);
+
+	return TRUE;
+}
+
+static void
+xmms_channelmix_destroy (xmms_xform_t *xform)
+{
+	xmms_channelmix_data_t *data;
+
+	g_return_if_fail (xform);
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_if_fail (data);
+
+	g_free (data->matrix);
+	g_free (data->inbuf);
+	g_free (data->work);
+	g_free (data->planes_in);
+	g_free (data->planes_out);
+	g_free (data->outbuf);
+	g_free (data);
+}
+
+/* Mix frames whole frames of inbuf into outbuf */
+static void
+xmms_channelmix_mix (xmms_channelmix_data_t *data, gint frames)
+{
+	gint in = frames * data->in_channels;
+	gint out = frames * data->out_channels;
+	const gfloat *samples = data->work;
+	gint i;
+
+	switch (data->in_format) {
+		case XMMS_SAMPLE_FORMAT_S16:
+			xmms_mixing_s16_to_float ((const gint16 *) data->inbuf, data->work,
+			                          in, 1.0 / 32768);
+			break;
+		case XMMS_SAMPLE_FORMAT_S32:
+			for (i = 0; i < in; i++) {
+				data->work[i] = ((const gint32 *) data->inbuf)[i] / 2147483648.0;
+			}
+			break;
+		default:
+			samples = (const gfloat *) data->inbuf;
+			break;
+	}
+
+	xmms_mixing_deinterleave (samples, data->in_channels, data->planes_in, frames);
+	xmms_mixing_matrix_planar (data->planes_in, data->in_channels,
+	                           data->planes_out, data->out_channels,
+	                           data->matrix, frames);
+
+	switch (data->out_format) {
+		case XMMS_SAMPLE_FORMAT_S16:
+			xmms_mixing_interleave (data->planes_out, data->out_channels,
+			                        data->work, frames);
+			xmms_mixing_float_to_s16 (data->work, (gint16 *) data->outbuf,
+			                          out, 32768);
+			break;
+		case XMMS_SAMPLE_FORMAT_S32:
+			xmms_mixing_interleave (data->planes_out, data->out_channels,
+			                        data->work, frames);
+			for (i = 0; i < out; i++) {
+				gdouble x = data->work[i] * 2147483648.0;
+				((gint32 *) data->outbuf)[i] = CLAMP (x, XMMS_SAMPLES32_MIN,
+				                                      XMMS_SAMPLES32_MAX);
+			}
+			break;
+		default:
+			xmms_mixing_interleave (data->planes_out, data->out_channels,
+			                        (gfloat *) data->outbuf, frames);
+			break;
+	}
+
+	data->out_pos = 0;
+	data->out_len = frames * data->out_frame;
+}
+
+static gint
+xmms_channelmix_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                      xmms_error_t *err)
+{
+	xmms_channelmix_data_t *data;
+	gint ret, frames, used;
+
+	g_return_val_if_fail (xform, -1);
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	while (data->out_pos == data->out_len) {
+		ret = xmms_xform_read (xform, data->inbuf + data->inlen,
+		                       XMMS_CHANNELMIX_CHUNK * data->in_frame - data->inlen,
+		                       err);
+		if (ret <= 0) {
+			/* a partial frame at the end is dropped */
+			return ret;
+		}
+
+		data->inlen += ret;
+		frames = data->inlen / data->in_frame;
+		if (!frames) {
+			continue;
+		}
+
+		xmms_channelmix_mix (data, frames);
+
+		used = frames * data->in_frame;
+		memmove (data->inbuf, data->inbuf + used, data->inlen - used);
+		data->inlen -= used;
+	}
+
+	len = MIN (len, data->out_len - data->out_pos);
+	memcpy (buf, data->outbuf + data->out_pos, len);
+	data->out_pos += len;
+
+	return len;
+}
+
+static gint64
+xmms_channelmix_seek (xmms_xform_t *xform, gint64 samples,
+                      xmms_xform_seek_mode_t whence, xmms_error_t *err)
+{
+	xmms_channelmix_data_t *data;
+	gint64 ret;
+
+	g_return_val_if_fail (xform, -1);
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	ret = xmms_xform_seek (xform, samples, whence, err);
+	if (ret >= 0) {
+		data->inlen = 0;
+		data->out_pos = data->out_len = 0;
+	}
+
+	return ret;
+}
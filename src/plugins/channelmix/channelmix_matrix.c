@@ -0,0 +1,244 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/**
+ * @file
+ * Channel mix matrices, after the downmix of ITU-R BS.775.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "channelmix_matrix.h"
+
+#define MINUS_3DB 0.70710678f
+
+typedef enum {
+	SPEAKER_FL,
+	SPEAKER_FR,
+	SPEAKER_FC,
+	SPEAKER_LFE,
+	SPEAKER_BL,
+	SPEAKER_BR,
+	SPEAKER_SL,
+	SPEAKER_SR,
+	SPEAKER_BC,
+	SPEAKER_NONE
+} speaker_t;
+
+/* the WAVE order for each channel count, 5.0 and 5.1 take their
+ * surrounds as back channels, like the decoders do */
+static const speaker_t layouts[XMMS_CHANNELMIX_MAX_CHANNELS][XMMS_CHANNELMIX_MAX_CHANNELS] = {
+	{ SPEAKER_FC, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_FC, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_BL, SPEAKER_BR, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_FC, SPEAKER_BL, SPEAKER_BR, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_FC, SPEAKER_LFE, SPEAKER_BL, SPEAKER_BR, SPEAKER_NONE },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_FC, SPEAKER_LFE, SPEAKER_BC, SPEAKER_SL, SPEAKER_SR },
+	{ SPEAKER_FL, SPEAKER_FR, SPEAKER_FC, SPEAKER_LFE, SPEAKER_BL, SPEAKER_BR, SPEAKER_SL, SPEAKER_SR }
+};
+
+typedef struct {
+	gfloat *row[SPEAKER_NONE];
+	gfloat lfe_level;
+} mix_t;
+
+/* Add a speaker into the outputs that stand in for it if the layout
+ * lacks one: the center goes to both fronts, the fronts to the center
+ * of a mono layout, back and side to each other or to their front. */
+static void
+mix_add (mix_t *mix, gint in, speaker_t speaker, gfloat gain)
+{
+	if (mix->row[speaker]) {
+		mix->row[speaker][in] += gain;
+		return;
+	}
+
+	switch (speaker) {
+		case SPEAKER_FC:
+			mix_add (mix, in, SPEAKER_FL, gain * MINUS_3DB);
+			mix_add (mix, in, SPEAKER_FR, gain * MINUS_3DB);
+			break;
+		case SPEAKER_FL:
+		case SPEAKER_FR:
+			mix_add (mix, in, SPEAKER_FC, gain * MINUS_3DB);
+			break;
+		case SPEAKER_LFE:
+			if (mix->lfe_level > 0.0) {
+				mix_add (mix, in, SPEAKER_FC, gain * mix->lfe_level);
+			}
+			break;
+		case SPEAKER_BL:
+		case SPEAKER_SL:
+			if (mix->row[SPEAKER_BL] || mix->row[SPEAKER_SL]) {
+				mix_add (mix, in, mix->row[SPEAKER_BL] ? SPEAKER_BL : SPEAKER_SL, gain);
+			} else {
+				mix_add (mix, in, SPEAKER_FL, gain * MINUS_3DB);
+			}
+			break;
+		case SPEAKER_BR:
+		case SPEAKER_SR:
+			if (mix->row[SPEAKER_BR] || mix->row[SPEAKER_SR]) {
+				mix_add (mix, in, mix->row[SPEAKER_BR] ? SPEAKER_BR : SPEAKER_SR, gain);
+			} else {
+				mix_add (mix, in, SPEAKER_FR, gain * MINUS_3DB);
+			}
+			break;
+		case SPEAKER_BC:
+			mix_add (mix, in, SPEAKER_BL, gain * MINUS_3DB);
+			mix_add (mix, in, SPEAKER_BR, gain * MINUS_3DB);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * The standard matrix from in to out channels, NULL if either has no
+ * known layout. Channels the output has are passed on as they are,
+ * so an upmix leaves the new ones silent. The LFE is left out unless
+ * lfe_level is set. With normalize, a downmix is scaled so that no
+ * output can clip.
+ */
+gfloat *
+xmms_channelmix_matrix_standard (gint in, gint out, gfloat lfe_level,
+                                 gboolean normalize)
+{
+	mix_t mix;
+	gfloat *matrix, max = 0.0;
+	gint i, o;
+
+	if (in < 1 || in > XMMS_CHANNELMIX_MAX_CHANNELS ||
+	    out < 1 || out > XMMS_CHANNELMIX_MAX_CHANNELS) {
+		return NULL;
+	}
+
+	matrix = g_new0 (gfloat, in * out);
+
+	memset (&mix, 0, sizeof (mix));
+	mix.lfe_level = lfe_level;
+	for (o = 0; o < out; o++) {
+		mix.row[layouts[out - 1][o]] = matrix + o * in;
+	}
+
+	for (i = 0; i < in; i++) {
+		mix_add (&mix, i, layouts[in - 1][i], 1.0);
+	}
+
+	if (normalize) {
+		for (o = 0; o < out; o++) {
+			gfloat sum = 0.0;
+
+			for (i = 0; i < in; i++) {
+				sum += fabsf (matrix[o * in + i]);
+			}
+			max = MAX (max, sum);
+		}
+
+		if (max > 1.0) {
+			for (i = 0; i < in * out; i++) {
+				matrix[i] /= max;
+			}
+		}
+	}
+
+	return matrix;
+}
+
+/* Parse one row of count coefficients separated by blanks or commas */
+static gboolean
+parse_row (const gchar *str, gfloat *row, gint count)
+{
+	gchar *end;
+	gint i;
+
+	for (i = 0; i < count; i++) {
+		while (*str == ' ' || *str == ',') {
+			str++;
+		}
+		row[i] = g_ascii_strtod (str, &end);
+		if (end == str) {
+			return FALSE;
+		}
+		str = end;
+	}
+
+	while (*str == ' ') {
+		str++;
+	}
+
+	return *str == '\0';
+}
+
+/**
+ * The matrix from in to out channels in a user spec, NULL if it has
+ * none or it is broken. A spec is a list of matrices separated by
+ * semicolons, each written as in:out= and then its out rows of in
+ * coefficients, the rows separated by slashes:
+ * "6:2=1 0 0.7 0 0.7 0/0 1 0.7 0 0 0.7"
+ */
+gfloat *
+xmms_channelmix_matrix_parse (const gchar *spec, gint in, gint out)
+{
+	gchar **mappings;
+	gfloat *matrix = NULL;
+	gint m;
+
+	if (!spec || !*spec) {
+		return NULL;
+	}
+
+	mappings = g_strsplit (spec, ";", 0);
+
+	for (m = 0; mappings[m] && !matrix; m++) {
+		gchar **rows, *eq;
+		gint i, o, r;
+
+		if (sscanf (mappings[m], " %d:%d", &i, &o) != 2 || i != in || o != out) {
+			continue;
+		}
+
+		eq = strchr (mappings[m], '=');
+		if (!eq) {
+			break;
+		}
+
+		rows = g_strsplit (eq + 1, "/", 0);
+		matrix = g_new0 (gfloat, in * out);
+
+		for (r = 0; rows[r] && r < out; r++) {
+			if (!parse_row (rows[r], matrix + r * in, in)) {
+				break;
+			}
+		}
+
+		if (r != out || rows[r]) {
+			g_free (matrix);
+			matrix = NULL;
+		}
+
+		g_strfreev (rows);
+		break;
+	}
+
+	g_strfreev (mappings);
+
+	return matrix;
+}
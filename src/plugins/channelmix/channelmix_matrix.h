@@ -0,0 +1,33 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __CHANNELMIX_MATRIX_H__
+#define __CHANNELMIX_MATRIX_H__
+
+#include <glib.h>
+
+#define XMMS_CHANNELMIX_MAX_CHANNELS 8
+
+/**
+ * Mix matrices from in to out channels, out rows of in coefficients,
+ * freed with g_free. The channels are taken to be in the WAVE order,
+ * L R C LFE and then the surrounds, as the decoders hand them out.
+ */
+gfloat *xmms_channelmix_matrix_standard (gint in, gint out, gfloat lfe_level,
+                                         gboolean normalize);
+gfloat *xmms_channelmix_matrix_parse (const gchar *spec, gint in, gint out);
+
+#endif
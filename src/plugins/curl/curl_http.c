@@ -63,6 +63,13 @@ typedef struct {
 
 	gboolean broken_version;
 	gboolean accepts_ranges;
+
+	/* size of the whole resource, -1 if the server didn't tell */
+	gint64 content_length;
+
+	/* the whole resource when it was small enough to prefetch,
+	 * stream_position is then the offset into it */
+	GByteArray *memory;
 } xmms_curl_data_t;
 
 typedef void (*handler_func_t) (xmms_xform_t *xform, gchar *header);
@@ -74,6 +81,8 @@ static void header_handler_icy_genre (xmms_xform_t *xform, gchar *header);
 static void header_handler_content_type (xmms_xform_t *xform, gchar *header);
 static void header_handler_accept_ranges (xmms_xform_t *xform, gchar *header);
 static void header_handler_content_range (xmms_xform_t *xform, gchar *header);
+static void header_handler_etag (xmms_xform_t *xform, gchar *header);
+static void header_handler_last_modified (xmms_xform_t *xform, gchar *header);
 static handler_func_t header_handler_find (gchar *header);
 static void generate_headers(xmms_curl_data_t *data);
 
@@ -90,6 +99,8 @@ handler_t handlers[] = {
 	{ "content-type", header_handler_content_type },
 	{ "accept-ranges", header_handler_accept_ranges },
 	{ "content-range", header_handler_content_range },
+	{ "etag", header_handler_etag },
+	{ "last-modified", header_handler_last_modified },
 /*	{ "\r\n", header_handler_last }, */
 	{ NULL, NULL }
 };
@@ -109,6 +120,11 @@ static size_t xmms_curl_callback_header (void *ptr, size_t size, size_t nmemb, v
 
 static void xmms_curl_free_data (xmms_curl_data_t *data);
 
+/* Connections, TLS sessions and DNS lookups are shared by all streams,
+ * so the next track from the same host skips the handshakes. */
+static CURLSH *curl_share;
+static GMutex curl_share_locks[CURL_LOCK_DATA_LAST];
+
 /*
  * Plugin header
  */
@@ -118,6 +134,36 @@ XMMS_XFORM_PLUGIN_DEFINE ("curl",
                           "HTTP transport using CURL",
                           xmms_curl_plugin_setup);
 
+static void
+xmms_curl_share_lock (CURL *handle, curl_lock_data data,
+                      curl_lock_access access, void *userptr)
+{
+	g_mutex_lock (&curl_share_locks[data]);
+}
+
+static void
+xmms_curl_share_unlock (CURL *handle, curl_lock_data data, void *userptr)
+{
+	g_mutex_unlock (&curl_share_locks[data]);
+}
+
+static void
+xmms_curl_share_init (void)
+{
+	curl_share = curl_share_init ();
+	if (!curl_share) {
+		return;
+	}
+
+	curl_share_setopt (curl_share, CURLSHOPT_LOCKFUNC, xmms_curl_share_lock);
+	curl_share_setopt (curl_share, CURLSHOPT_UNLOCKFUNC, xmms_curl_share_unlock);
+	curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900
+	curl_share_setopt (curl_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+}
+
 static gboolean
 xmms_curl_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 {
@@ -157,6 +203,11 @@ xmms_curl_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	                                            "user", NULL, NULL);
 	xmms_xform_plugin_config_property_register (xform_plugin, "proxypass",
 	                                            "password", NULL, NULL);
+	/* streams up to this many bytes are downloaded whole, 0 disables */
+	xmms_xform_plugin_config_property_register (xform_plugin, "prefetch",
+	                                            "0", NULL, NULL);
+
+	xmms_curl_share_init ();
 
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE,
@@ -194,6 +245,59 @@ static void generate_headers(xmms_curl_data_t *data) {
  * Member functions
  */
 
+static gint64
+xmms_curl_content_length (xmms_curl_data_t *data)
+{
+#if LIBCURL_VERSION_NUM >= 0x073700
+	curl_off_t length = -1;
+
+	curl_easy_getinfo (data->curl_easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+	                   &length);
+#else
+	double length = -1;
+
+	curl_easy_getinfo (data->curl_easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD,
+	                   &length);
+#endif
+
+	return length >= 0 ? (gint64) length : -1;
+}
+
+/**
+ * Pull the rest of the resource into memory, reads and seeks are then
+ * served from there and the connection goes back to the cache.
+ */
+static gboolean
+xmms_curl_prefetch (xmms_xform_t *xform, xmms_curl_data_t *data,
+                    xmms_error_t *error)
+{
+	gint ret;
+
+	XMMS_DBG ("Prefetching %" G_GINT64_FORMAT " bytes", data->content_length);
+
+	data->memory = g_byte_array_sized_new (data->content_length);
+
+	do {
+		g_byte_array_append (data->memory, (guint8 *) data->buffer,
+		                     data->bufferlen);
+		data->bufferlen = 0;
+
+		ret = fill_buffer (xform, data, error);
+	} while (ret > 0);
+
+	if (ret < 0) {
+		return FALSE;
+	}
+
+	g_byte_array_append (data->memory, (guint8 *) data->buffer,
+	                     data->bufferlen);
+	data->bufferlen = 0;
+
+	curl_multi_remove_handle (data->curl_multi, data->curl_easy);
+
+	return TRUE;
+}
+
 static gboolean
 xmms_curl_init (xmms_xform_t *xform)
 {
@@ -201,6 +305,7 @@ xmms_curl_init (xmms_xform_t *xform)
 	xmms_config_property_t *val;
 	xmms_error_t error;
 	gint metaint, verbose, connecttimeout, readtimeout, useproxy, authproxy;
+	gint prefetch;
 	const gchar *proxyaddress, *proxyuser, *proxypass;
 	gchar proxyuserpass[90];
 	const gchar *url;
@@ -214,6 +319,7 @@ xmms_curl_init (xmms_xform_t *xform)
 	data->broken_version = FALSE;
 	// By default, we'll give it a go
 	data->accepts_ranges = TRUE;
+	data->content_length = -1;
 	val = xmms_xform_config_lookup (xform, "connecttimeout");
 	connecttimeout = xmms_config_property_get_int (val);
 
@@ -241,6 +347,9 @@ xmms_curl_init (xmms_xform_t *xform)
 	val = xmms_xform_config_lookup (xform, "proxypass");
 	proxypass = xmms_config_property_get_string (val);
 
+	val = xmms_xform_config_lookup (xform, "prefetch");
+	prefetch = xmms_config_property_get_int (val);
+
 	g_snprintf (proxyuserpass, sizeof (proxyuserpass), "%s:%s", proxyuser,
 	            proxypass);
 
@@ -285,6 +394,13 @@ xmms_curl_init (xmms_xform_t *xform)
 	curl_easy_setopt (data->curl_easy, CURLOPT_LOW_SPEED_TIME, readtimeout);
 	curl_easy_setopt (data->curl_easy, CURLOPT_LOW_SPEED_LIMIT, 1);
 
+	if (curl_share) {
+		curl_easy_setopt (data->curl_easy, CURLOPT_SHARE, curl_share);
+	}
+#if LIBCURL_VERSION_NUM >= 0x071900
+	curl_easy_setopt (data->curl_easy, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
+
 	if (!data->broken_version) {
 		data->http_200_aliases = curl_slist_append (data->http_200_aliases,
 		                                            "ICY 200 OK");
@@ -327,6 +443,17 @@ xmms_curl_init (xmms_xform_t *xform)
 		return FALSE;
 	}
 
+	data->content_length = xmms_curl_content_length (data);
+
+	if (data->meta_offset == 0 && data->content_length > 0 &&
+	    data->content_length <= prefetch) {
+		if (!xmms_curl_prefetch (xform, data, &error)) {
+			xmms_xform_private_data_set (xform, NULL);
+			xmms_curl_free_data (data);
+			return FALSE;
+		}
+	}
+
 	if (data->meta_offset > 0) {
 		XMMS_DBG ("icy-metadata detected");
 		xmms_xform_auxdata_set_int (xform, "meta_offset", data->meta_offset);
@@ -436,7 +563,15 @@ xmms_curl_read (xmms_xform_t *xform, void *buffer, gint len,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
-	if (data->done)
+	if (data->memory) {
+		len = MIN (len, data->memory->len - data->stream_position);
+		memcpy (buffer, data->memory->data + data->stream_position, len);
+		data->stream_position += len;
+		return len;
+	}
+
+	/* what came with the last perform is still to be read */
+	if (data->done && !data->bufferlen)
 		return 0;
 
 	while (TRUE) {
@@ -456,7 +591,7 @@ xmms_curl_read (xmms_xform_t *xform, void *buffer, gint len,
 
 		ret = fill_buffer (xform, data, error);
 
-		if (ret == 0 || ret == -1) {
+		if (ret == -1 || (ret == 0 && !data->bufferlen)) {
 			return ret;
 		}
 	}
@@ -569,6 +704,13 @@ header_handler_contentlength (xmms_xform_t *xform,
 {
 	int length;
 	const gchar *metakey;
+	xmms_curl_data_t *data;
+
+	/* after a range request this is only what is left */
+	data = xmms_xform_private_data_get (xform);
+	if (data->content_length >= 0) {
+		return;
+	}
 
 	length = strtoul (header, NULL, 10);
 
@@ -641,6 +783,25 @@ header_handler_content_range (xmms_xform_t *xform,
     }
 }
 
+/* validators, so cached copies of the stream can be told apart */
+static void
+header_handler_etag (xmms_xform_t *xform, gchar *header)
+{
+	xmms_xform_auxdata_set_str (xform, "etag", header);
+}
+
+static void
+header_handler_last_modified (xmms_xform_t *xform, gchar *header)
+{
+	time_t lmod;
+
+	lmod = curl_getdate (header, NULL);
+	if (lmod != -1) {
+		xmms_xform_metadata_set_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD,
+		                             lmod);
+	}
+}
+
 static void
 xmms_curl_free_data (xmms_curl_data_t *data)
 {
@@ -653,6 +814,9 @@ xmms_curl_free_data (xmms_curl_data_t *data)
 	curl_slist_free_all (data->http_req_headers);
 
 	g_free (data->buffer);
+	if (data->memory) {
+		g_byte_array_free (data->memory, TRUE);
+	}
 
 	g_free (data->url);
 	g_free (data);
@@ -660,46 +824,106 @@ xmms_curl_free_data (xmms_curl_data_t *data)
 
 static gint64
 xmms_curl_seek (xmms_xform_t *xform, gint64 offset,
-        xmms_xform_seek_mode_t whence, xmms_error_t *error) {
+                xmms_xform_seek_mode_t whence, xmms_error_t *error)
+{
+	xmms_curl_data_t *data;
+	gchar *range_header;
+	CURL *newhandle;
+	glong code = 0;
+	gint64 target;
 
-    xmms_curl_data_t *data;
-    data = xmms_xform_private_data_get (xform);
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
 
-    if (data->accepts_ranges && whence == XMMS_XFORM_SEEK_SET) {
-        gchar *range_header = NULL;
-        if (whence == XMMS_XFORM_SEEK_SET) {
-            range_header = g_strdup_printf("Range: bytes=%"PRIi64"-", offset);
-        }
-        // regen headers to make sure we aren't doubling up a range header or something
-        generate_headers(data);
-        if (range_header) {
-            data->http_req_headers = curl_slist_append (data->http_req_headers,
-                    range_header);
-            g_free(range_header);
-        } else {
-            xmms_log_error("Unable to allocate range header");
-            return -1;
-        }
-        curl_easy_setopt (data->curl_easy, CURLOPT_HTTPHEADER, data->http_req_headers);
-        curl_easy_pause (data->curl_easy, CURLPAUSE_RECV);
+	if (whence == XMMS_XFORM_SEEK_SET) {
+		target = offset;
+	} else if (whence == XMMS_XFORM_SEEK_CUR) {
+		target = data->stream_position + offset;
+	} else if (data->content_length >= 0) {
+		target = data->content_length + offset;
+	} else {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Unknown stream length");
+		return -1;
+	}
 
-        CURL *newhandle = curl_easy_duphandle(data->curl_easy);
+	if (target < 0 ||
+	    (data->content_length >= 0 && target > data->content_length)) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Seek out of range");
+		return -1;
+	}
 
-        curl_multi_remove_handle(data->curl_multi, data->curl_easy);
-        curl_easy_cleanup(data->curl_easy);
+	if (data->memory) {
+		if (target > data->memory->len) {
+			xmms_error_set (error, XMMS_ERROR_INVAL, "Seek out of range");
+			return -1;
+		}
+		data->stream_position = target;
+		return target;
+	}
 
-        data->curl_easy = newhandle;
-        curl_multi_add_handle (data->curl_multi, data->curl_easy);
+	/* still in what has already been received */
+	if (target >= data->stream_position &&
+	    target <= data->stream_position + data->bufferlen) {
+		guint skip = target - data->stream_position;
 
-        // "clear" the buffer
-        data->bufferlen = 0;
-        if (fill_buffer (xform, data, error) <= 0) {
-            return -1;
-        }
-        // the content-range callback should set the stream position correctly
-        return data->stream_position;
-    } else {
-        xmms_error_set (error, XMMS_ERROR_INVAL, "Couldn't seek");
-        return -1;
-    }
+		data->bufferlen -= skip;
+		memmove (data->buffer, data->buffer + skip, data->bufferlen);
+		data->stream_position = target;
+		return target;
+	}
+
+	if (!data->accepts_ranges) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Couldn't seek");
+		return -1;
+	}
+
+	data->bufferlen = 0;
+	data->stream_position = target;
+
+	/* a range starting at the end is refused, there's nothing to get */
+	if (target == data->content_length) {
+		data->done = TRUE;
+		return target;
+	}
+
+	/* regen headers to make sure we aren't doubling up a range header */
+	generate_headers (data);
+	range_header = g_strdup_printf ("Range: bytes=%" G_GINT64_FORMAT "-",
+	                                target);
+	data->http_req_headers = curl_slist_append (data->http_req_headers,
+	                                            range_header);
+	g_free (range_header);
+
+	curl_easy_setopt (data->curl_easy, CURLOPT_HTTPHEADER,
+	                  data->http_req_headers);
+	curl_easy_pause (data->curl_easy, CURLPAUSE_RECV);
+
+	/* the new transfer picks up a cached connection if there is one */
+	newhandle = curl_easy_duphandle (data->curl_easy);
+
+	curl_multi_remove_handle (data->curl_multi, data->curl_easy);
+	curl_easy_cleanup (data->curl_easy);
+
+	data->curl_easy = newhandle;
+	data->curl_code = CURLM_CALL_MULTI_PERFORM;
+	data->done = FALSE;
+	curl_multi_add_handle (data->curl_multi, data->curl_easy);
+
+	if (fill_buffer (xform, data, error) <= 0) {
+		return -1;
+	}
+
+	curl_easy_getinfo (data->curl_easy, CURLINFO_RESPONSE_CODE, &code);
+	if (code != 206 && target != 0) {
+		/* the server ignored the range and sent it all again */
+		xmms_log_info ("Server doesn't handle range requests, not seeking");
+		data->accepts_ranges = FALSE;
+		data->stream_position = 0;
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Couldn't seek");
+		return -1;
+	}
+
+	/* the content-range callback sets the stream position, if the
+	 * server sent one */
+	return data->stream_position;
 }
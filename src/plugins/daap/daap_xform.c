@@ -32,6 +32,9 @@
 
 #define DEFAULT_DAAP_PORT 3689
 
+/* how long a session is trusted for new streams before it's checked */
+#define DAAP_SESSION_REVALIDATE (60 * G_TIME_SPAN_SECOND)
+
 /*
  * Type definitions
  */
@@ -51,8 +54,18 @@ typedef struct {
 	guint session_id;
 	guint revision_id;
 	guint request_id;
+
+	/* the database of the share, and when the session was checked */
+	gint dbid;
+	gint64 validated;
+
+	/* the songs of the database as of songs_revision */
+	GSList *songs;
+	guint songs_revision;
 } xmms_daap_login_data_t;
 
+/* shared by every xform, so a track change reuses the session */
+G_LOCK_DEFINE_STATIC (login_sessions);
 static GHashTable *login_sessions = NULL;
 
 /*
@@ -200,72 +213,128 @@ daap_add_song_to_list (xmms_xform_t *xform, cc_item_record_t *song)
 
 
 /**
- * Scan a daap server for songs.
+ * Get the session of a share. A new one is logged into, a known one
+ * is used as it is until it's DAAP_SESSION_REVALIDATE old, or if
+ * revalidate is set; then the revision and the database are fetched
+ * again, logging in again if the share has dropped the session.
+ * Called with the login_sessions lock held.
  */
-static gboolean
-daap_get_urls_from_server (xmms_xform_t *xform, gchar *host, guint port,
-                           xmms_error_t *err)
+static xmms_daap_login_data_t *
+daap_session_get (gchar *host, guint port, gboolean revalidate,
+                  xmms_error_t *err)
 {
-	GSList *dbid_list = NULL;
-	GSList *song_list = NULL, *song_el;
-	cc_item_record_t *db_data;
 	xmms_daap_login_data_t *login_data;
+	GSList *dbid_list;
 	gchar *hash;
+	gint64 now;
 
+	now = g_get_monotonic_time ();
 	hash = g_strdup_printf ("%s:%u", host, port);
 
 	login_data = g_hash_table_lookup (login_sessions, hash);
+	if (login_data) {
+		g_free (hash);
 
-	if (!login_data) {
+		if (!revalidate && login_data->validated &&
+		    now - login_data->validated < DAAP_SESSION_REVALIDATE) {
+			return login_data;
+		}
+	} else {
+		XMMS_DBG ("creating login data for %s", hash);
 		login_data = g_new0 (xmms_daap_login_data_t, 1);
+		login_data->request_id = 1;
 
-		login_data->session_id = daap_command_login (host, port, 0, err);
-		if (xmms_error_iserror (err)) {
-			g_free (login_data);
-			return FALSE;
-		}
+		g_hash_table_insert (login_sessions, hash, login_data);
+	}
+
+	login_data->validated = 0;
 
+	/* an expired session gets no revision */
+	if (login_data->logged_in) {
 		login_data->revision_id = daap_command_update (host, port,
 		                                               login_data->session_id,
-		                                               0);
+		                                               login_data->request_id);
+		login_data->logged_in = login_data->revision_id != 0;
+	}
 
-		login_data->request_id = 1;
-		login_data->logged_in = TRUE;
+	if (!login_data->logged_in) {
+		login_data->session_id = daap_command_login (host, port,
+		                                             login_data->request_id,
+		                                             err);
+		if (xmms_error_iserror (err)) {
+			return NULL;
+		}
 
-		g_hash_table_insert (login_sessions, hash, login_data);
-	} else {
+		login_data->logged_in = TRUE;
 		login_data->revision_id = daap_command_update (host, port,
 		                                               login_data->session_id,
-		                                               0);
+		                                               login_data->request_id);
 	}
 
 	dbid_list = daap_command_db_list (host, port, login_data->session_id,
-	                                  login_data->revision_id, 0);
+	                                  login_data->revision_id,
+	                                  login_data->request_id);
 	if (!dbid_list) {
-		return FALSE;
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't list the databases");
+		return NULL;
 	}
 
 	/* XXX i've never seen more than one db per server out in the wild,
 	 *     let's hope that never changes *wink*
 	 *     just use the first db in the list */
-	db_data = (cc_item_record_t *) dbid_list->data;
-	song_list = daap_command_song_list (host, port, login_data->session_id,
-	                                    login_data->revision_id,
-	                                    0, db_data->dbid);
+	login_data->dbid = ((cc_item_record_t *) dbid_list->data)->dbid;
+	login_data->validated = now;
 
 	g_slist_foreach (dbid_list, (GFunc) cc_item_record_free, NULL);
 	g_slist_free (dbid_list);
 
-	if (!song_list) {
+	return login_data;
+}
+
+
+/**
+ * Scan a daap server for songs. The song list is only transferred
+ * again if the revision of the share has changed since the last scan.
+ */
+static gboolean
+daap_get_urls_from_server (xmms_xform_t *xform, gchar *host, guint port,
+                           xmms_error_t *err)
+{
+	GSList *song_list, *song_el;
+	xmms_daap_login_data_t *login_data;
+
+	G_LOCK (login_sessions);
+
+	login_data = daap_session_get (host, port, TRUE, err);
+	if (!login_data) {
+		G_UNLOCK (login_sessions);
 		return FALSE;
 	}
 
-	for (song_el = song_list; song_el; song_el = g_slist_next (song_el)) {
+	if (!login_data->songs ||
+	    login_data->songs_revision != login_data->revision_id) {
+		song_list = daap_command_song_list (host, port,
+		                                    login_data->session_id,
+		                                    login_data->revision_id,
+		                                    login_data->request_id,
+		                                    login_data->dbid);
+		if (!song_list) {
+			G_UNLOCK (login_sessions);
+			return FALSE;
+		}
+
+		g_slist_foreach (login_data->songs, (GFunc) cc_item_record_free, NULL);
+		g_slist_free (login_data->songs);
+
+		login_data->songs = song_list;
+		login_data->songs_revision = login_data->revision_id;
+	}
+
+	for (song_el = login_data->songs; song_el; song_el = g_slist_next (song_el)) {
 		daap_add_song_to_list (xform, song_el->data);
 	}
 
-	g_slist_foreach (song_list, (GFunc) cc_item_record_free, NULL);
-	g_slist_free (song_list);
+	G_UNLOCK (login_sessions);
 
 	return TRUE;
 }
@@ -278,14 +347,12 @@ daap_get_urls_from_server (xmms_xform_t *xform, gchar *host, guint port,
 static gboolean
 xmms_daap_init (xmms_xform_t *xform)
 {
-	gint dbid;
-	GSList *dbid_list = NULL;
 	xmms_daap_data_t *data;
 	xmms_daap_login_data_t *login_data;
 	xmms_error_t err;
 	const gchar *url;
 	const gchar *metakey;
-	gchar *command, *hash;
+	gchar *command = NULL;
 	guint filesize;
 
 	g_return_val_if_fail (xform, FALSE);
@@ -302,51 +369,42 @@ xmms_daap_init (xmms_xform_t *xform)
 		goto init_error;
 	}
 
-	hash = g_strdup_printf ("%s:%u", data->host, data->port);
-
-	login_data = g_hash_table_lookup (login_sessions, hash);
-	if (!login_data) {
-		XMMS_DBG ("creating login data for %s", hash);
-		login_data = g_new0 (xmms_daap_login_data_t, 1);
-
-		login_data->request_id = 1;
-		login_data->logged_in = TRUE;
-
-		login_data->session_id = daap_command_login (data->host, data->port,
-		                                             login_data->request_id,
-		                                             &err);
-		if (xmms_error_iserror (&err)) {
-			g_free (login_data);
-			goto init_error;
+	G_LOCK (login_sessions);
+
+	login_data = daap_session_get (data->host, data->port, FALSE, &err);
+	if (login_data) {
+		/* want to request a stream, but don't read the data yet */
+		data->conn = daap_command_init_stream (data->host, data->port,
+		                                       login_data->session_id,
+		                                       login_data->revision_id,
+		                                       login_data->request_id,
+		                                       login_data->dbid,
+		                                       command, &filesize);
+
+		/* the share may have dropped the session since it was checked */
+		if (!data->conn) {
+			login_data = daap_session_get (data->host, data->port, TRUE, &err);
 		}
 
-		g_hash_table_insert (login_sessions, hash, login_data);
-	}
+		if (!data->conn && login_data) {
+			data->conn = daap_command_init_stream (data->host, data->port,
+			                                       login_data->session_id,
+			                                       login_data->revision_id,
+			                                       login_data->request_id,
+			                                       login_data->dbid,
+			                                       command, &filesize);
+		}
 
-	login_data->revision_id = daap_command_update (data->host, data->port,
-	                                               login_data->session_id,
-	                                               login_data->request_id);
-	dbid_list = daap_command_db_list (data->host, data->port,
-	                                  login_data->session_id,
-	                                  login_data->revision_id,
-	                                  login_data->request_id);
-	if (!dbid_list) {
-		goto init_error;
+		if (data->conn) {
+			login_data->request_id++;
+		}
 	}
 
-	/* XXX: see XXX in the browse function above */
-	dbid = ((cc_item_record_t *) dbid_list->data)->dbid;
-	/* want to request a stream, but don't read the data yet */
-	data->conn = daap_command_init_stream (data->host, data->port,
-	                                       login_data->session_id,
-	                                       login_data->revision_id,
-	                                       login_data->request_id, dbid,
-	                                       command, &filesize);
+	G_UNLOCK (login_sessions);
 
-	if (! data->conn) {
+	if (!data->conn) {
 		goto init_error;
 	}
-	login_data->request_id++;
 
 	metakey = XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE;
 	xmms_xform_metadata_set_int (xform, metakey, filesize);
@@ -358,13 +416,12 @@ xmms_daap_init (xmms_xform_t *xform)
 	                             "application/octet-stream",
 	                             XMMS_STREAM_TYPE_END);
 
-	g_slist_foreach (dbid_list, (GFunc) cc_item_record_free, NULL);
-	g_slist_free (dbid_list);
 	g_free (command);
 
 	return TRUE;
 
 init_error:
+	g_free (command);
 	if (data) {
 		if (data->host)
 			g_free (data->host);
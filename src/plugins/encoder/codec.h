@@ -0,0 +1,55 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __XMMS_ENCODER_CODEC_H__
+#define __XMMS_ENCODER_CODEC_H__
+
+#include <glib.h>
+#include <xmms/xmms_sample.h>
+
+typedef struct xmms_encoder_params_St {
+	gint rate;
+	gint channels;
+	/* bits per second, for the lossy codecs */
+	gint bitrate;
+	/* 0-8, for flac */
+	gint compression;
+} xmms_encoder_params_t;
+
+/**
+ * An encoder writing one file. All functions are called on the
+ * encoder worker thread.
+ */
+typedef struct xmms_encoder_codec_St {
+	const gchar *name;
+	const gchar *extension;
+	gpointer (*open) (const gchar *path, const xmms_encoder_params_t *params);
+	/** Encode frames of interleaved samples. */
+	gboolean (*write) (gpointer state, const xmms_samplefloat_t *buf,
+	                   gint frames);
+	/** Flush the encoder, finish the file and free state. */
+	void (*close) (gpointer state);
+} xmms_encoder_codec_t;
+
+extern const xmms_encoder_codec_t xmms_encoder_codec_vorbis;
+#ifdef HAVE_OPUSENC
+extern const xmms_encoder_codec_t xmms_encoder_codec_opus;
+#endif
+#ifdef HAVE_FLAC
+extern const xmms_encoder_codec_t xmms_encoder_codec_flac;
+#endif
+
+#endif
@@ -0,0 +1,486 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file Output plugin encoding each entry to a file.
+ *
+ * Like diskwrite, but compressed. The encoding runs on a worker of
+ * its own, so it can also be used as an output.tee sink without
+ * holding up the card.
+ */
+
+#include <xmms/xmms_outputplugin.h>
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+#include "codec.h"
+
+#include "../encoder_common/worker.c"
+
+enum {
+	ENCODER_CMD_TRACK = 1,
+	ENCODER_CMD_FORMAT,
+	ENCODER_CMD_CLOSE,
+};
+
+/* Where and how the next file is written, built on the writer side
+ * so the worker never looks at the config. */
+typedef struct {
+	gchar *base;
+	const xmms_encoder_codec_t *codec;
+	gint bitrate;
+	gint compression;
+} xmms_encoder_target_t;
+
+typedef struct {
+	xmms_encode_worker_t *worker;
+
+	/* only touched by the worker */
+	gchar *base;
+	guint part;
+	const xmms_encoder_codec_t *codec;
+	xmms_encoder_params_t params;
+	gpointer state;
+} xmms_encoder_data_t;
+
+static const xmms_encoder_codec_t *codecs[] = {
+	&xmms_encoder_codec_vorbis,
+#ifdef HAVE_OPUSENC
+	&xmms_encoder_codec_opus,
+#endif
+#ifdef HAVE_FLAC
+	&xmms_encoder_codec_flac,
+#endif
+	NULL
+};
+
+static const gint rates[] = { 44100, 48000, 0 };
+
+/*
+ * Function prototypes
+ */
+
+static gboolean xmms_encoder_plugin_setup (xmms_output_plugin_t *plugin);
+static gboolean xmms_encoder_new (xmms_output_t *output);
+static void xmms_encoder_destroy (xmms_output_t *output);
+static gboolean xmms_encoder_open (xmms_output_t *output);
+static void xmms_encoder_close (xmms_output_t *output);
+static void xmms_encoder_flush (xmms_output_t *output);
+static gboolean xmms_encoder_format_set (xmms_output_t *output,
+                                         const xmms_stream_type_t *format);
+static void xmms_encoder_write (xmms_output_t *output, gpointer buffer,
+                                gint len, xmms_error_t *err);
+static guint xmms_encoder_latency_get (xmms_output_t *output);
+
+static gboolean xmms_encoder_target_push (xmms_output_t *output,
+                                          xmms_encoder_data_t *data,
+                                          gint32 id);
+static void on_playlist_entry_changed (xmms_object_t *object, xmmsv_t *arg,
+                                       gpointer udata);
+
+/*
+ * Plugin header
+ */
+
+XMMS_OUTPUT_PLUGIN_DEFINE ("encoder", "Encoder Output", XMMS_VERSION,
+                           "Encodes audio to Vorbis, Opus or FLAC files",
+                           xmms_encoder_plugin_setup);
+
+static gboolean
+xmms_encoder_plugin_setup (xmms_output_plugin_t *plugin)
+{
+	xmms_output_methods_t methods;
+
+	XMMS_OUTPUT_METHODS_INIT (methods);
+
+	methods.new = xmms_encoder_new;
+	methods.destroy = xmms_encoder_destroy;
+
+	methods.open = xmms_encoder_open;
+	methods.close = xmms_encoder_close;
+
+	methods.flush = xmms_encoder_flush;
+	methods.format_set = xmms_encoder_format_set;
+	methods.write = xmms_encoder_write;
+	methods.latency_get = xmms_encoder_latency_get;
+
+	xmms_output_plugin_methods_set (plugin, &methods);
+
+	xmms_output_plugin_config_property_register (plugin,
+	                                             "destination_directory",
+	                                             "/tmp", NULL, NULL);
+	xmms_output_plugin_config_property_register (plugin, "codec",
+	                                             "vorbis", NULL, NULL);
+	xmms_output_plugin_config_property_register (plugin, "bitrate",
+	                                             "128000", NULL, NULL);
+	xmms_output_plugin_config_property_register (plugin, "flac_compression",
+	                                             "5", NULL, NULL);
+	/* how far the encoder may fall behind before writes block */
+	xmms_output_plugin_config_property_register (plugin, "max_backlog_ms",
+	                                             "5000", NULL, NULL);
+
+	return TRUE;
+}
+
+/*
+ * Worker side
+ */
+
+static void
+xmms_encoder_file_close (xmms_encoder_data_t *data)
+{
+	if (data->state) {
+		data->codec->close (data->state);
+		data->state = NULL;
+	}
+}
+
+static gboolean
+xmms_encoder_encode (gpointer udata, gpointer buf, gint len, gchar **msg)
+{
+	xmms_encoder_data_t *data = udata;
+	gchar *path;
+	gint frames;
+
+	if (!data->base || !data->params.channels) {
+		*msg = g_strdup ("no format set");
+		return FALSE;
+	}
+
+	if (!data->state) {
+		if (data->part) {
+			path = g_strdup_printf ("%s-%u.%s", data->base, data->part,
+			                        data->codec->extension);
+		} else {
+			path = g_strdup_printf ("%s.%s", data->base,
+			                        data->codec->extension);
+		}
+
+		data->state = data->codec->open (path, &data->params);
+		if (!data->state) {
+			*msg = g_strdup_printf ("couldn't open %s", path);
+			g_free (path);
+			return FALSE;
+		}
+
+		XMMS_DBG ("Encoding %s to %s", data->codec->name, path);
+		g_free (path);
+	}
+
+	frames = len / (sizeof (xmms_samplefloat_t) * data->params.channels);
+	if (!data->codec->write (data->state, buf, frames)) {
+		*msg = g_strdup_printf ("%s encoder failed", data->codec->name);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void
+xmms_encoder_control (gpointer udata, gint cmd, gpointer arg)
+{
+	xmms_encoder_data_t *data = udata;
+	xmms_encoder_target_t *target;
+	xmms_encoder_params_t *params;
+
+	switch (cmd) {
+		case ENCODER_CMD_TRACK:
+			target = arg;
+			/* both open and the id signal announce the first entry */
+			if (data->base && !strcmp (data->base, target->base) &&
+			    data->codec == target->codec) {
+				break;
+			}
+			xmms_encoder_file_close (data);
+			g_free (data->base);
+			data->base = g_strdup (target->base);
+			data->part = 0;
+			data->codec = target->codec;
+			data->params.bitrate = target->bitrate;
+			data->params.compression = target->compression;
+			break;
+		case ENCODER_CMD_FORMAT:
+			params = arg;
+			if (params->rate == data->params.rate &&
+			    params->channels == data->params.channels) {
+				break;
+			}
+			/* an open file keeps its format, go on in a new one */
+			if (data->state) {
+				xmms_encoder_file_close (data);
+				data->part++;
+			}
+			data->params.rate = params->rate;
+			data->params.channels = params->channels;
+			break;
+		case ENCODER_CMD_CLOSE:
+			xmms_encoder_file_close (data);
+			g_free (data->base);
+			data->base = NULL;
+			break;
+	}
+}
+
+static void
+xmms_encoder_target_free (gpointer p)
+{
+	xmms_encoder_target_t *target = p;
+
+	g_free (target->base);
+	g_free (target);
+}
+
+/*
+ * Member functions
+ */
+
+static gboolean
+xmms_encoder_new (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+	gint i, ch;
+
+	g_return_val_if_fail (output, FALSE);
+
+	data = g_new0 (xmms_encoder_data_t, 1);
+
+	for (i = 0; rates[i]; i++) {
+		for (ch = 1; ch <= 2; ch++) {
+			xmms_output_format_add (output, XMMS_SAMPLE_FORMAT_FLOAT, ch,
+			                        rates[i]);
+		}
+	}
+
+	data->worker = xmms_encode_worker_new ("x2 encoder", xmms_encoder_encode,
+	                                       xmms_encoder_control, data,
+	                                       G_MAXSIZE);
+
+	xmms_output_private_data_set (output, data);
+
+	xmms_object_connect (XMMS_OBJECT (output),
+	                     XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID,
+	                     on_playlist_entry_changed,
+	                     output);
+
+	return TRUE;
+}
+
+static void
+xmms_encoder_destroy (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+
+	g_return_if_fail (output);
+
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_object_disconnect (XMMS_OBJECT (output),
+	                        XMMS_IPC_SIGNAL_PLAYBACK_CURRENT_ID,
+	                        on_playlist_entry_changed,
+	                        output);
+
+	xmms_encode_worker_control (data->worker, ENCODER_CMD_CLOSE, NULL, NULL);
+	xmms_encode_worker_free (data->worker);
+
+	g_free (data->base);
+	g_free (data);
+}
+
+static gboolean
+xmms_encoder_open (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+	xmms_config_property_t *val;
+	const gchar *destdir;
+	gint ret;
+
+	g_return_val_if_fail (output, FALSE);
+
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+
+	val = xmms_output_config_lookup (output, "destination_directory");
+	destdir = xmms_config_property_get_string (val);
+
+	/* create the destination directory if it doesn't exist yet */
+	if (!g_file_test (destdir, G_FILE_TEST_IS_DIR)) {
+		ret = g_mkdir_with_parents (destdir, 0755);
+	} else {
+		ret = access (destdir, W_OK);
+	}
+
+	if (ret == -1) {
+		xmms_log_error ("errno (%d) %s", errno, strerror (errno));
+		return FALSE;
+	}
+
+	return xmms_encoder_target_push (output, data,
+	                                 xmms_output_current_id (output));
+}
+
+static void
+xmms_encoder_close (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+
+	g_return_if_fail (output);
+
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_encode_worker_control (data->worker, ENCODER_CMD_CLOSE, NULL, NULL);
+	xmms_encode_worker_drain (data->worker);
+}
+
+static void
+xmms_encoder_flush (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+
+	g_return_if_fail (output);
+
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_encode_worker_discard (data->worker);
+}
+
+static gboolean
+xmms_encoder_format_set (xmms_output_t *output,
+                         const xmms_stream_type_t *format)
+{
+	xmms_encoder_data_t *data;
+	xmms_encoder_params_t *params;
+	xmms_config_property_t *val;
+	gint64 limit;
+
+	g_return_val_if_fail (output, FALSE);
+
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+
+	params = g_new0 (xmms_encoder_params_t, 1);
+	params->rate = xmms_stream_type_get_int (format,
+	                                         XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	params->channels = xmms_stream_type_get_int (format,
+	                                             XMMS_STREAM_TYPE_FMT_CHANNELS);
+
+	XMMS_DBG ("Setting format to rate: %i, channels: %i",
+	          params->rate, params->channels);
+
+	xmms_encode_worker_control (data->worker, ENCODER_CMD_FORMAT,
+	                            params, g_free);
+
+	val = xmms_output_config_lookup (output, "max_backlog_ms");
+	limit = xmms_sample_ms_to_bytes (format,
+	                                 MAX (xmms_config_property_get_int (val), 0));
+	xmms_encode_worker_limit_set (data->worker, limit);
+
+	return TRUE;
+}
+
+static void
+xmms_encoder_write (xmms_output_t *output, gpointer buffer, gint len,
+                    xmms_error_t *err)
+{
+	xmms_encoder_data_t *data;
+
+	g_return_if_fail (output);
+	g_return_if_fail (buffer);
+
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_encode_worker_write (data->worker, buffer, len, err);
+}
+
+/* Audio written but not encoded yet counts as buffered, so the
+ * reported playtime tells how far the files have got. */
+static guint
+xmms_encoder_latency_get (xmms_output_t *output)
+{
+	xmms_encoder_data_t *data;
+
+	g_return_val_if_fail (output, 0);
+
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, 0);
+
+	return xmms_encode_worker_backlog (data->worker);
+}
+
+static gboolean
+xmms_encoder_target_push (xmms_output_t *output, xmms_encoder_data_t *data,
+                          gint32 id)
+{
+	xmms_encoder_target_t *target;
+	xmms_config_property_t *val;
+	const gchar *name;
+	gint i;
+
+	val = xmms_output_config_lookup (output, "codec");
+	name = xmms_config_property_get_string (val);
+
+	for (i = 0; codecs[i]; i++) {
+		if (!g_ascii_strcasecmp (codecs[i]->name, name)) {
+			break;
+		}
+	}
+
+	if (!codecs[i]) {
+		xmms_log_error ("Codec '%s' not supported by this build", name);
+		return FALSE;
+	}
+
+	target = g_new0 (xmms_encoder_target_t, 1);
+	target->codec = codecs[i];
+
+	val = xmms_output_config_lookup (output, "bitrate");
+	target->bitrate = xmms_config_property_get_int (val);
+	val = xmms_output_config_lookup (output, "flac_compression");
+	target->compression = xmms_config_property_get_int (val);
+
+	val = xmms_output_config_lookup (output, "destination_directory");
+	target->base = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%03u",
+	                                xmms_config_property_get_string (val), id);
+
+	xmms_encode_worker_control (data->worker, ENCODER_CMD_TRACK,
+	                            target, xmms_encoder_target_free);
+
+	return TRUE;
+}
+
+static void
+on_playlist_entry_changed (xmms_object_t *object, xmmsv_t *arg, gpointer udata)
+{
+	xmms_output_t *output = udata;
+	xmms_encoder_data_t *data;
+	gint32 id;
+
+	if (!xmmsv_get_int (arg, &id)) {
+		return;
+	}
+
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_encoder_target_push (output, data, id);
+}
@@ -0,0 +1,106 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+
+#include <FLAC/stream_encoder.h>
+
+#include "codec.h"
+
+/* Floats in are scaled to 24 bit, as much as anything decodes to */
+#define FLAC_BITS 24
+#define FLAC_SCALE 8388607.0f
+
+typedef struct {
+	FLAC__StreamEncoder *enc;
+	gint channels;
+	FLAC__int32 *pcm;
+	gint pcm_len;
+} xmms_encoder_flac_t;
+
+static gpointer
+xmms_encoder_flac_open (const gchar *path, const xmms_encoder_params_t *params)
+{
+	xmms_encoder_flac_t *s;
+	FLAC__StreamEncoderInitStatus ret;
+
+	s = g_new0 (xmms_encoder_flac_t, 1);
+	s->channels = params->channels;
+
+	s->enc = FLAC__stream_encoder_new ();
+	if (!s->enc) {
+		g_free (s);
+		return NULL;
+	}
+
+	FLAC__stream_encoder_set_channels (s->enc, params->channels);
+	FLAC__stream_encoder_set_bits_per_sample (s->enc, FLAC_BITS);
+	FLAC__stream_encoder_set_sample_rate (s->enc, params->rate);
+	FLAC__stream_encoder_set_compression_level (s->enc,
+	                                            CLAMP (params->compression, 0, 8));
+
+	ret = FLAC__stream_encoder_init_file (s->enc, path, NULL, NULL);
+	if (ret != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+		xmms_log_error ("Couldn't start FLAC encoder: %s",
+		                FLAC__StreamEncoderInitStatusString[ret]);
+		FLAC__stream_encoder_delete (s->enc);
+		g_free (s);
+		return NULL;
+	}
+
+	return s;
+}
+
+static gboolean
+xmms_encoder_flac_write (gpointer state, const xmms_samplefloat_t *buf,
+                         gint frames)
+{
+	xmms_encoder_flac_t *s = state;
+	gint i, n;
+
+	n = frames * s->channels;
+	if (n > s->pcm_len) {
+		s->pcm = g_renew (FLAC__int32, s->pcm, n);
+		s->pcm_len = n;
+	}
+
+	for (i = 0; i < n; i++) {
+		s->pcm[i] = (FLAC__int32) (CLAMP (buf[i], -1.0f, 1.0f) * FLAC_SCALE);
+	}
+
+	return FLAC__stream_encoder_process_interleaved (s->enc, s->pcm, frames);
+}
+
+static void
+xmms_encoder_flac_close (gpointer state)
+{
+	xmms_encoder_flac_t *s = state;
+
+	FLAC__stream_encoder_finish (s->enc);
+	FLAC__stream_encoder_delete (s->enc);
+
+	g_free (s->pcm);
+	g_free (s);
+}
+
+const xmms_encoder_codec_t xmms_encoder_codec_flac = {
+	"flac", "flac",
+	xmms_encoder_flac_open,
+	xmms_encoder_flac_write,
+	xmms_encoder_flac_close
+};
@@ -0,0 +1,84 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+
+#include <opusenc.h>
+
+#include "codec.h"
+
+typedef struct {
+	OggOpusComments *comments;
+	OggOpusEnc *enc;
+} xmms_encoder_opus_t;
+
+static gpointer
+xmms_encoder_opus_open (const gchar *path, const xmms_encoder_params_t *params)
+{
+	xmms_encoder_opus_t *s;
+	int err;
+
+	s = g_new0 (xmms_encoder_opus_t, 1);
+
+	s->comments = ope_comments_create ();
+	ope_comments_add (s->comments, "ENCODER", "XMMS2 " XMMS_VERSION);
+
+	/* libopusenc resamples anything that isn't 48kHz itself */
+	s->enc = ope_encoder_create_file (path, s->comments, params->rate,
+	                                  params->channels,
+	                                  params->channels > 2 ? 1 : 0, &err);
+	if (!s->enc) {
+		xmms_log_error ("Couldn't start Opus encoder: %s",
+		                ope_strerror (err));
+		ope_comments_destroy (s->comments);
+		g_free (s);
+		return NULL;
+	}
+
+	ope_encoder_ctl (s->enc, OPUS_SET_BITRATE (params->bitrate));
+
+	return s;
+}
+
+static gboolean
+xmms_encoder_opus_write (gpointer state, const xmms_samplefloat_t *buf,
+                         gint frames)
+{
+	xmms_encoder_opus_t *s = state;
+
+	return ope_encoder_write_float (s->enc, buf, frames) == OPE_OK;
+}
+
+static void
+xmms_encoder_opus_close (gpointer state)
+{
+	xmms_encoder_opus_t *s = state;
+
+	ope_encoder_drain (s->enc);
+	ope_encoder_destroy (s->enc);
+	ope_comments_destroy (s->comments);
+
+	g_free (s);
+}
+
+const xmms_encoder_codec_t xmms_encoder_codec_opus = {
+	"opus", "opus",
+	xmms_encoder_opus_open,
+	xmms_encoder_opus_write,
+	xmms_encoder_opus_close
+};
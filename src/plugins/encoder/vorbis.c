@@ -0,0 +1,165 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+#include <stdio.h>
+
+#include <ogg/ogg.h>
+#include <vorbis/codec.h>
+#include <vorbis/vorbisenc.h>
+
+#include "codec.h"
+
+typedef struct {
+	FILE *fp;
+	ogg_stream_state os;
+	vorbis_info vi;
+	vorbis_comment vc;
+	vorbis_dsp_state vd;
+	vorbis_block vb;
+} xmms_encoder_vorbis_t;
+
+static gboolean
+xmms_encoder_vorbis_pages (xmms_encoder_vorbis_t *s, gboolean flush)
+{
+	ogg_page og;
+	gint ret;
+
+	for (;;) {
+		if (flush) {
+			ret = ogg_stream_flush (&s->os, &og);
+		} else {
+			ret = ogg_stream_pageout (&s->os, &og);
+		}
+		if (!ret) {
+			return TRUE;
+		}
+
+		if (fwrite (og.header, 1, og.header_len, s->fp) != (size_t) og.header_len ||
+		    fwrite (og.body, 1, og.body_len, s->fp) != (size_t) og.body_len) {
+			return FALSE;
+		}
+	}
+}
+
+static gboolean
+xmms_encoder_vorbis_blocks (xmms_encoder_vorbis_t *s)
+{
+	ogg_packet op;
+
+	while (vorbis_analysis_blockout (&s->vd, &s->vb) == 1) {
+		vorbis_analysis (&s->vb, NULL);
+		vorbis_bitrate_addblock (&s->vb);
+		while (vorbis_bitrate_flushpacket (&s->vd, &op)) {
+			ogg_stream_packetin (&s->os, &op);
+		}
+	}
+
+	return xmms_encoder_vorbis_pages (s, FALSE);
+}
+
+static gpointer
+xmms_encoder_vorbis_open (const gchar *path,
+                          const xmms_encoder_params_t *params)
+{
+	xmms_encoder_vorbis_t *s;
+	ogg_packet header, header_comm, header_code;
+
+	s = g_new0 (xmms_encoder_vorbis_t, 1);
+
+	vorbis_info_init (&s->vi);
+	if (vorbis_encode_init (&s->vi, params->channels, params->rate,
+	                        -1, params->bitrate, -1) != 0) {
+		xmms_log_error ("Vorbis can't encode %d channels at %d Hz, %d bps",
+		                params->channels, params->rate, params->bitrate);
+		vorbis_info_clear (&s->vi);
+		g_free (s);
+		return NULL;
+	}
+
+	s->fp = fopen (path, "wb");
+	if (!s->fp) {
+		vorbis_info_clear (&s->vi);
+		g_free (s);
+		return NULL;
+	}
+
+	vorbis_comment_init (&s->vc);
+	vorbis_comment_add_tag (&s->vc, "ENCODER", "XMMS2 " XMMS_VERSION);
+
+	vorbis_analysis_init (&s->vd, &s->vi);
+	vorbis_block_init (&s->vd, &s->vb);
+	ogg_stream_init (&s->os, g_random_int ());
+
+	vorbis_analysis_headerout (&s->vd, &s->vc,
+	                           &header, &header_comm, &header_code);
+	ogg_stream_packetin (&s->os, &header);
+	ogg_stream_packetin (&s->os, &header_comm);
+	ogg_stream_packetin (&s->os, &header_code);
+
+	/* the headers get pages of their own */
+	xmms_encoder_vorbis_pages (s, TRUE);
+
+	return s;
+}
+
+static gboolean
+xmms_encoder_vorbis_write (gpointer state, const xmms_samplefloat_t *buf,
+                           gint frames)
+{
+	xmms_encoder_vorbis_t *s = state;
+	gfloat **buffer;
+	gint i, j;
+
+	buffer = vorbis_analysis_buffer (&s->vd, frames);
+	for (i = 0; i < frames; i++) {
+		for (j = 0; j < s->vi.channels; j++) {
+			buffer[j][i] = buf[i * s->vi.channels + j];
+		}
+	}
+	vorbis_analysis_wrote (&s->vd, frames);
+
+	return xmms_encoder_vorbis_blocks (s);
+}
+
+static void
+xmms_encoder_vorbis_close (gpointer state)
+{
+	xmms_encoder_vorbis_t *s = state;
+
+	vorbis_analysis_wrote (&s->vd, 0);
+	xmms_encoder_vorbis_blocks (s);
+	xmms_encoder_vorbis_pages (s, TRUE);
+
+	fclose (s->fp);
+
+	ogg_stream_clear (&s->os);
+	vorbis_block_clear (&s->vb);
+	vorbis_dsp_clear (&s->vd);
+	vorbis_comment_clear (&s->vc);
+	vorbis_info_clear (&s->vi);
+
+	g_free (s);
+}
+
+const xmms_encoder_codec_t xmms_encoder_codec_vorbis = {
+	"vorbis", "ogg",
+	xmms_encoder_vorbis_open,
+	xmms_encoder_vorbis_write,
+	xmms_encoder_vorbis_close
+};
@@ -0,0 +1,312 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file Encoder worker shared by the encoding output plugins.
+ *
+ * The output writer only copies samples into a queue, a thread of
+ * its own runs the encoder and whatever sends the result away. So a
+ * slow encoder or a stalling network only shows up as backlog instead
+ * of stopping the writer in the middle of a write. Control commands
+ * (new track, new format, end of stream) go through the same queue so
+ * they reach the encoder in order with the audio around them.
+ */
+
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+#include <string.h>
+
+/**
+ * Called on the worker thread for each block of audio. Returning
+ * FALSE with msg set fails the writes until the next control.
+ */
+typedef gboolean (*xmms_encode_worker_data_func_t) (gpointer udata,
+                                                    gpointer buf, gint len,
+                                                    gchar **msg);
+/** Called on the worker thread for each control command. */
+typedef void (*xmms_encode_worker_control_func_t) (gpointer udata, gint cmd,
+                                                   gpointer arg);
+
+typedef struct xmms_encode_job_St {
+	gint cmd; /* 0 for audio */
+	gpointer data;
+	gint len;
+	GDestroyNotify notify;
+} xmms_encode_job_t;
+
+typedef struct xmms_encode_worker_St {
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+	GQueue jobs;
+
+	/* bytes of audio queued or being encoded */
+	gsize backlog;
+	gsize limit;
+	gboolean busy;
+	gboolean running;
+
+	gchar *error;
+	gboolean waiting;
+	guint stalls;
+
+	xmms_encode_worker_data_func_t data_func;
+	xmms_encode_worker_control_func_t control_func;
+	gpointer udata;
+} xmms_encode_worker_t;
+
+static void
+xmms_encode_job_free (xmms_encode_job_t *job)
+{
+	if (job->notify && job->data) {
+		job->notify (job->data);
+	}
+	g_free (job);
+}
+
+static gpointer
+xmms_encode_worker_thread (gpointer udata)
+{
+	xmms_encode_worker_t *w = udata;
+	xmms_encode_job_t *job;
+	gchar *msg;
+
+	g_mutex_lock (&w->mutex);
+	for (;;) {
+		while (w->running && g_queue_is_empty (&w->jobs)) {
+			g_cond_wait (&w->cond, &w->mutex);
+		}
+
+		job = g_queue_pop_head (&w->jobs);
+		if (!job) {
+			break;
+		}
+
+		w->busy = TRUE;
+
+		if (job->cmd) {
+			g_free (w->error);
+			w->error = NULL;
+			g_mutex_unlock (&w->mutex);
+
+			w->control_func (w->udata, job->cmd, job->data);
+
+			g_mutex_lock (&w->mutex);
+		} else if (!w->error) {
+			g_mutex_unlock (&w->mutex);
+
+			msg = NULL;
+			if (!w->data_func (w->udata, job->data, job->len, &msg)) {
+				xmms_log_error ("Encoding failed: %s", msg ? msg : "unknown error");
+				g_mutex_lock (&w->mutex);
+				w->error = msg ? msg : g_strdup ("encoding failed");
+			} else {
+				g_mutex_lock (&w->mutex);
+			}
+		}
+
+		if (!job->cmd) {
+			w->backlog -= job->len;
+		}
+		w->busy = FALSE;
+		g_cond_broadcast (&w->cond);
+
+		g_mutex_unlock (&w->mutex);
+		xmms_encode_job_free (job);
+		g_mutex_lock (&w->mutex);
+	}
+	g_mutex_unlock (&w->mutex);
+
+	return NULL;
+}
+
+/**
+ * Start a worker.
+ *
+ * @param limit how many bytes of audio may be queued before
+ * #xmms_encode_worker_write blocks.
+ */
+static xmms_encode_worker_t *
+xmms_encode_worker_new (const gchar *name,
+                        xmms_encode_worker_data_func_t data_func,
+                        xmms_encode_worker_control_func_t control_func,
+                        gpointer udata, gsize limit)
+{
+	xmms_encode_worker_t *w;
+
+	w = g_new0 (xmms_encode_worker_t, 1);
+	g_mutex_init (&w->mutex);
+	g_cond_init (&w->cond);
+	g_queue_init (&w->jobs);
+	w->limit = limit;
+	w->running = TRUE;
+	w->data_func = data_func;
+	w->control_func = control_func;
+	w->udata = udata;
+
+	w->thread = g_thread_new (name, xmms_encode_worker_thread, w);
+
+	return w;
+}
+
+/**
+ * Encode everything still queued and stop the worker.
+ */
+static void
+xmms_encode_worker_free (xmms_encode_worker_t *w)
+{
+	g_mutex_lock (&w->mutex);
+	w->running = FALSE;
+	g_cond_broadcast (&w->cond);
+	g_mutex_unlock (&w->mutex);
+
+	g_thread_join (w->thread);
+
+	if (w->stalls) {
+		XMMS_DBG ("Encoder fell behind %u times", w->stalls);
+	}
+
+	g_queue_clear (&w->jobs);
+	g_cond_clear (&w->cond);
+	g_mutex_clear (&w->mutex);
+	g_free (w->error);
+	g_free (w);
+}
+
+static void
+xmms_encode_worker_limit_set (xmms_encode_worker_t *w, gsize limit)
+{
+	g_mutex_lock (&w->mutex);
+	w->limit = limit;
+	g_cond_broadcast (&w->cond);
+	g_mutex_unlock (&w->mutex);
+}
+
+/**
+ * Queue a copy of the samples. Only waits when the backlog is over
+ * the limit.
+ */
+static void
+xmms_encode_worker_write (xmms_encode_worker_t *w, gpointer buf, gint len,
+                          xmms_error_t *err)
+{
+	xmms_encode_job_t *job;
+
+	g_mutex_lock (&w->mutex);
+
+	while (!w->error && w->backlog > 0 && w->backlog + len > w->limit) {
+		if (!w->waiting) {
+			w->waiting = TRUE;
+			w->stalls++;
+			XMMS_DBG ("Encoder backlog full at %" G_GSIZE_FORMAT " bytes",
+			          w->backlog);
+		}
+		g_cond_wait (&w->cond, &w->mutex);
+	}
+	w->waiting = FALSE;
+
+	if (w->error) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, w->error);
+		g_mutex_unlock (&w->mutex);
+		return;
+	}
+
+	job = g_new0 (xmms_encode_job_t, 1);
+	job->data = g_memdup (buf, len);
+	job->len = len;
+	job->notify = g_free;
+
+	w->backlog += len;
+	g_queue_push_tail (&w->jobs, job);
+	g_cond_broadcast (&w->cond);
+
+	g_mutex_unlock (&w->mutex);
+}
+
+/**
+ * Queue a control command, arg is freed with notify once it has run.
+ */
+static void
+xmms_encode_worker_control (xmms_encode_worker_t *w, gint cmd, gpointer arg,
+                            GDestroyNotify notify)
+{
+	xmms_encode_job_t *job;
+
+	g_return_if_fail (cmd != 0);
+
+	job = g_new0 (xmms_encode_job_t, 1);
+	job->cmd = cmd;
+	job->data = arg;
+	job->notify = notify;
+
+	g_mutex_lock (&w->mutex);
+	g_queue_push_tail (&w->jobs, job);
+	g_cond_broadcast (&w->cond);
+	g_mutex_unlock (&w->mutex);
+}
+
+/**
+ * Wait until everything queued so far has been handled.
+ */
+static void
+xmms_encode_worker_drain (xmms_encode_worker_t *w)
+{
+	g_mutex_lock (&w->mutex);
+	while (w->busy || !g_queue_is_empty (&w->jobs)) {
+		g_cond_wait (&w->cond, &w->mutex);
+	}
+	g_mutex_unlock (&w->mutex);
+}
+
+/**
+ * Drop the queued audio, controls still run.
+ */
+static void
+xmms_encode_worker_discard (xmms_encode_worker_t *w)
+{
+	xmms_encode_job_t *job;
+	GList *n, *next;
+
+	g_mutex_lock (&w->mutex);
+	for (n = w->jobs.head; n; n = next) {
+		next = n->next;
+		job = n->data;
+		if (job->cmd) {
+			continue;
+		}
+		w->backlog -= job->len;
+		g_queue_delete_link (&w->jobs, n);
+		xmms_encode_job_free (job);
+	}
+	g_cond_broadcast (&w->cond);
+	g_mutex_unlock (&w->mutex);
+}
+
+/**
+ * Bytes of audio handed to the worker but not encoded yet.
+ */
+static guint
+xmms_encode_worker_backlog (xmms_encode_worker_t *w)
+{
+	gsize ret;
+
+	g_mutex_lock (&w->mutex);
+	ret = w->backlog;
+	g_mutex_unlock (&w->mutex);
+
+	return ret;
+}
@@ -31,6 +31,7 @@ static gboolean xmms_eq_init (xmms_xform_t *xform);
 static void xmms_eq_destroy (xmms_xform_t *xform);
 static gint xmms_eq_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                           xmms_error_t *error);
+static void xmms_eq_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len);
 static gint64 xmms_eq_seek (xmms_xform_t *xform, gint64 offset,
                             xmms_xform_seek_mode_t whence, xmms_error_t *err);
 static void xmms_eq_gain_changed (xmms_object_t *object, xmmsv_t *_data,
@@ -45,8 +46,13 @@ typedef struct xmms_equalizer_priv_St {
 	xmms_config_property_t *gain[EQ_MAX_BANDS];
 	xmms_config_property_t *legacy[EQ_BANDS_LEGACY];
 	gboolean enabled;
+	gboolean is_float;
+	iir_state_t *iir;
 } xmms_equalizer_data_t;
 
+/* the rates there are filter coefficients for */
+static const gint rates[] = { 48000, 44100, 22050, 11025 };
+
 XMMS_XFORM_PLUGIN_DEFINE ("equalizer",
                           "Equalizer effect",
                           XMMS_VERSION,
@@ -65,10 +71,13 @@ xmms_eq_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	methods.init = xmms_eq_init;
 	methods.destroy = xmms_eq_destroy;
 	methods.read = xmms_eq_read;
+	methods.process = xmms_eq_process;
 	methods.seek = xmms_eq_seek;
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
+	init_iir ();
+
 	xmms_xform_plugin_config_property_register (xform_plugin, "bands", "15",
 	                                            NULL, NULL);
 	xmms_xform_plugin_config_property_register (xform_plugin,
@@ -89,41 +98,25 @@ xmms_eq_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 		                                            NULL, NULL);
 	}
 
-	xmms_xform_plugin_indata_add (xform_plugin,
-	                              XMMS_STREAM_TYPE_MIMETYPE,
-	                              "audio/pcm",
-	                              XMMS_STREAM_TYPE_FMT_FORMAT,
-	                              XMMS_SAMPLE_FORMAT_S16,
-	                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
-	                              48000,
-	                              XMMS_STREAM_TYPE_END);
-
-	xmms_xform_plugin_indata_add (xform_plugin,
-	                              XMMS_STREAM_TYPE_MIMETYPE,
-	                              "audio/pcm",
-	                              XMMS_STREAM_TYPE_FMT_FORMAT,
-	                              XMMS_SAMPLE_FORMAT_S16,
-	                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
-	                              44100,
-	                              XMMS_STREAM_TYPE_END);
-
-	xmms_xform_plugin_indata_add (xform_plugin,
-	                              XMMS_STREAM_TYPE_MIMETYPE,
-	                              "audio/pcm",
-	                              XMMS_STREAM_TYPE_FMT_FORMAT,
-	                              XMMS_SAMPLE_FORMAT_S16,
-	                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
-	                              22050,
-	                              XMMS_STREAM_TYPE_END);
-
-	xmms_xform_plugin_indata_add (xform_plugin,
-	                              XMMS_STREAM_TYPE_MIMETYPE,
-	                              "audio/pcm",
-	                              XMMS_STREAM_TYPE_FMT_FORMAT,
-	                              XMMS_SAMPLE_FORMAT_S16,
-	                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
-	                              11025,
-	                              XMMS_STREAM_TYPE_END);
+	for (i = 0; i < G_N_ELEMENTS (rates); i++) {
+		xmms_xform_plugin_indata_add (xform_plugin,
+		                              XMMS_STREAM_TYPE_MIMETYPE,
+		                              "audio/pcm",
+		                              XMMS_STREAM_TYPE_FMT_FORMAT,
+		                              XMMS_SAMPLE_FORMAT_S16,
+		                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+		                              rates[i],
+		                              XMMS_STREAM_TYPE_END);
+
+		xmms_xform_plugin_indata_add (xform_plugin,
+		                              XMMS_STREAM_TYPE_MIMETYPE,
+		                              "audio/pcm",
+		                              XMMS_STREAM_TYPE_FMT_FORMAT,
+		                              XMMS_SAMPLE_FORMAT_FLOAT,
+		                              XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+		                              rates[i],
+		                              XMMS_STREAM_TYPE_END);
+	}
 
 	return TRUE;
 }
@@ -141,6 +134,9 @@ xmms_eq_init (xmms_xform_t *xform)
 	priv = g_new0 (xmms_equalizer_data_t, 1);
 	g_return_val_if_fail (priv, FALSE);
 
+	priv->iir = iir_new ();
+	g_return_val_if_fail (priv->iir, FALSE);
+
 	xmms_xform_private_data_set (xform, priv);
 
 	config = xmms_xform_config_lookup (xform, "enabled");
@@ -169,7 +165,7 @@ xmms_eq_init (xmms_xform_t *xform)
 	gain = xmms_config_property_get_float (config);
 
 	for (i=0; i<EQ_CHANNELS; i++) {
-		set_preamp (i, xmms_eq_gain_scale (gain, TRUE));
+		set_preamp (priv->iir, i, xmms_eq_gain_scale (gain, TRUE));
 	}
 
 	for (i=0; i<EQ_BANDS_LEGACY; i++) {
@@ -185,7 +181,7 @@ xmms_eq_init (xmms_xform_t *xform)
 		gain = xmms_config_property_get_float (config);
 		if (priv->use_legacy) {
 			for (j = 0; j < EQ_CHANNELS; j++) {
-				set_gain (i, j, xmms_eq_gain_scale (gain, FALSE));
+				set_gain (priv->iir, i, j, xmms_eq_gain_scale (gain, FALSE));
 			}
 		}
 	}
@@ -203,22 +199,23 @@ xmms_eq_init (xmms_xform_t *xform)
 		gain = xmms_config_property_get_float (config);
 		if (!priv->use_legacy) {
 			for (j = 0; j < EQ_CHANNELS; j++) {
-				set_gain (i, j, xmms_eq_gain_scale (gain, FALSE));
+				set_gain (priv->iir, i, j, xmms_eq_gain_scale (gain, FALSE));
 			}
 		}
 	}
 
-	init_iir ();
 	srate = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	priv->is_float = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_FORMAT) == XMMS_SAMPLE_FORMAT_FLOAT;
 	if (priv->use_legacy) {
-		config_iir (srate, EQ_BANDS_LEGACY, 1);
+		config_iir (priv->iir, srate, EQ_BANDS_LEGACY, 1);
 	} else {
-		config_iir (srate, priv->bands, 0);
+		config_iir (priv->iir, srate, priv->bands, 0);
 	}
 
 	xmms_xform_outdata_type_copy (xform);
 
-	XMMS_DBG ("Equalizer initialized successfully!");
+	XMMS_DBG ("Equalizer initialized successfully, using %s filter!",
+	          iir_engine_name ());
 
 	return TRUE;
 }
@@ -227,7 +224,7 @@ static void
 xmms_eq_destroy (xmms_xform_t *xform)
 {
 	xmms_config_property_t *config;
-	gpointer priv;
+	xmms_equalizer_data_t *priv;
 	gchar buf[16];
 	gint i;
 
@@ -262,6 +259,7 @@ xmms_eq_destroy (xmms_xform_t *xform)
 		xmms_config_property_callback_remove (config, xmms_eq_gain_changed, priv);
 	}
 
+	iir_free (priv->iir);
 	g_free (priv);
 }
 
@@ -269,21 +267,37 @@ static gint
 xmms_eq_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
               xmms_error_t *error)
 {
-	xmms_equalizer_data_t *priv;
-	gint read, chan;
+	gint read;
 
 	g_return_val_if_fail (xform, -1);
 
+	read = xmms_xform_read (xform, buf, len, error);
+	if (read > 0) {
+		xmms_eq_process (xform, buf, read);
+	}
+
+	return read;
+}
+
+static void
+xmms_eq_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len)
+{
+	xmms_equalizer_data_t *priv;
+	gint chan;
+
 	priv = xmms_xform_private_data_get (xform);
-	g_return_val_if_fail (priv, -1);
+	g_return_if_fail (priv);
 
-	read = xmms_xform_read (xform, buf, len, error);
 	chan = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
-	if (read > 0 && priv->enabled) {
-		iir (buf, read, chan, priv->extra_filtering);
+	if (!priv->enabled) {
+		return;
 	}
 
-	return read;
+	if (priv->is_float) {
+		iir_float (priv->iir, buf, len, chan, priv->extra_filtering);
+	} else {
+		iir (priv->iir, buf, len, chan, priv->extra_filtering);
+	}
 }
 
 static gint64
@@ -332,7 +346,7 @@ xmms_eq_gain_changed (xmms_object_t *object, xmmsv_t *_data,
 	if (!strcmp (name, "preamp")) {
 		/* scale the -20.0 - 20.0 value to correct one */
 		for (i=0; i<EQ_CHANNELS; i++) {
-			set_preamp (i, xmms_eq_gain_scale (gain, TRUE));
+			set_preamp (priv->iir, i, xmms_eq_gain_scale (gain, TRUE));
 		}
 	} else {
 		gint band = -1;
@@ -346,7 +360,7 @@ xmms_eq_gain_changed (xmms_object_t *object, xmmsv_t *_data,
 		if (band >= 0) {
 			/* scale the -20.0 - 20.0 value to correct one */
 			for (i=0; i<EQ_CHANNELS; i++) {
-				set_gain (band, i, xmms_eq_gain_scale (gain, FALSE));
+				set_gain (priv->iir, band, i, xmms_eq_gain_scale (gain, FALSE));
 			}
 		}
 	}
@@ -389,14 +403,14 @@ xmms_eq_config_changed (xmms_object_t * object, xmmsv_t *_data, gpointer userdat
 			for (i=0; i<EQ_BANDS_LEGACY; i++) {
 				gain = xmms_config_property_get_float (priv->legacy[i]);
 				for (j=0; j<EQ_CHANNELS; j++) {
-					set_gain (j, i, xmms_eq_gain_scale (gain, FALSE));
+					set_gain (priv->iir, i, j, xmms_eq_gain_scale (gain, FALSE));
 				}
 			}
 		} else {
 			for (i=0; i<priv->bands; i++) {
 				gain = xmms_config_property_get_float (priv->gain[i]);
 				for (j=0; j<EQ_CHANNELS; j++) {
-					set_gain (j, i, xmms_eq_gain_scale (gain, FALSE));
+					set_gain (priv->iir, i, j, xmms_eq_gain_scale (gain, FALSE));
 				}
 			}
 		}
@@ -413,7 +427,7 @@ xmms_eq_config_changed (xmms_object_t * object, xmmsv_t *_data, gpointer userdat
 				xmms_config_property_set_data (priv->gain[i], "0.0");
 				if (!priv->use_legacy) {
 					for (j=0; j<EQ_CHANNELS; j++) {
-						set_gain (j, i, xmms_eq_gain_scale (0.0, FALSE));
+						set_gain (priv->iir, i, j, xmms_eq_gain_scale (0.0, FALSE));
 					}
 				}
 			}
@@ -20,16 +20,10 @@
  *   $Id: iir.c,v 1.16 2006/01/15 00:26:32 liebremx Exp $
  */
 
+#include <stdlib.h>
 #include "iir.h"
-
-/* Coefficients */
-sIIRCoefficients *iir_cf;
-
-/* Volume gain
- * values should be between 0.0 and 1.0
- * Use the preamp from XMMS for now
- * */
-float preamp[EQ_CHANNELS];
+#include "iir_fpu.h"
+#include "iir_simd.h"
 
 #ifdef BENCHMARK
 #include "benchmark.h"
@@ -39,26 +33,97 @@ unsigned int blength = 0;
 #endif
 
 /*
- * Global vars
+ * The filter engine new states use, picked by init_iir on what the
+ * CPU supports
  */
-int band_count;
+static const iir_engine_t *default_engine = &iir_fpu_engine;
 
-void set_preamp(int chn, float val)
+/* Init the coefficient tables and pick the engine, once for all states */
+void init_iir(void)
 {
-  preamp[chn] = val;
+  const iir_engine_t *simd;
+
+  calc_coeffs();
+
+  simd = iir_simd_init();
+  if (simd)
+    default_engine = simd;
 }
 
-/* Init the filters */
-void init_iir(void)
+const char *iir_engine_name(void)
 {
-  calc_coeffs();
+  return default_engine->name;
+}
+
+iir_state_t *iir_new(void)
+{
+  return iir_new_with_engine(default_engine);
+}
+
+iir_state_t *iir_new_with_engine(const iir_engine_t *engine)
+{
+  iir_state_t *st;
+
+  st = calloc(1, sizeof(iir_state_t));
+  if (!st)
+    return NULL;
+
+  st->engine = engine;
+  st->history = engine->history_new();
+  if (!st->history) {
+    free(st);
+    return NULL;
+  }
+
+  return st;
+}
+
+void iir_free(iir_state_t *st)
+{
+  st->engine->history_free(st->history);
+  free(st);
+}
+
+void set_preamp(iir_state_t *st, int chn, float val)
+{
+  st->preamp[chn] = val;
+}
+
+void set_gain(iir_state_t *st, int index, int chn, float val)
+{
+  st->gain[index][chn] = val;
+}
+
+void clean_history(iir_state_t *st)
+{
+  unsigned int seed = 1;
+  int n;
+
+  /* rand() is not reentrant, so use a simple generator of our own */
+  for (n = 0; n < EQ_DITHER_SIZE; n++) {
+      seed = seed * 1103515245 + 12345;
+      st->dither[n] = ((seed >> 16) % 4) - 2.0;
+  }
+  st->dither_index = 0;
+
+  st->engine->clean_history(st);
+}
+
+void config_iir(iir_state_t *st, int srate, int bands, int original)
+{
+  st->band_count = bands;
+  st->cf = get_coeffs(&st->band_count, srate, original);
+  clean_history(st);
+}
+
+int iir(iir_state_t *st, void *d, int length, int nch, int extra_filtering)
+{
+  return st->engine->filter(st, d, length, nch, extra_filtering);
 }
 
-void config_iir(int srate, int bands, int original)
+int iir_float(iir_state_t *st, float *d, int length, int nch, int extra_filtering)
 {
-  band_count = bands;
-  iir_cf = get_coeffs(&band_count, srate, original);
-  clean_history();
+  return st->engine->filter_float(st, d, length, nch, extra_filtering);
 }
 
 #ifdef ARCH_X86
@@ -47,17 +47,67 @@
 #define FTZ_OFF
 #endif
 
+#define EQ_CHANNELS 2
+#define EQ_MAX_BANDS 31
+#define EQ_DITHER_SIZE 256
+
+typedef struct iir_state_St iir_state_t;
+
+/*
+ * A filter implementation. The history it keeps between calls is
+ * allocated per filter state by history_new.
+ */
+typedef struct
+{
+  const char *name;
+  void *(*history_new)(void);
+  void (*history_free)(void *history);
+  void (*clean_history)(iir_state_t *st);
+  int (*filter)(iir_state_t *st, void *d, int length, int nch, int extra_filtering);
+  /* the same on floats in [-1, 1], without dither or limiting */
+  int (*filter_float)(iir_state_t *st, float *d, int length, int nch, int extra_filtering);
+} iir_engine_t;
+
+/*
+ * Everything one equalizer instance needs, so that several streams can
+ * be filtered at the same time
+ */
+struct iir_state_St
+{
+  const iir_engine_t *engine;
+  void *history;
+
+  sIIRCoefficients *cf;
+  int band_count;
+
+  /* Volume gain
+   * values should be between 0.0 and 1.0 */
+  float preamp[EQ_CHANNELS];
+  /* Gain for each band */
+  float gain[EQ_MAX_BANDS][EQ_CHANNELS];
+
+  /* random noise */
+  double dither[EQ_DITHER_SIZE];
+  int dither_index;
+};
+
 /*
  * Function prototypes
  */
 void init_iir(void);
-void config_iir(int srate, int bands, int original);
-void clean_history(void);
-void set_gain(int index, int chn, float val);
-void set_preamp(int chn, float val);
+const char *iir_engine_name(void);
+
+iir_state_t *iir_new(void);
+iir_state_t *iir_new_with_engine(const iir_engine_t *engine);
+void iir_free(iir_state_t *st);
 
+void config_iir(iir_state_t *st, int srate, int bands, int original);
+void clean_history(iir_state_t *st);
+void set_gain(iir_state_t *st, int index, int chn, float val);
+void set_preamp(iir_state_t *st, int chn, float val);
 
-int iir(void *d, int length, int nch, int extra_filtering);
+int iir(iir_state_t *st, void *d, int length, int nch, int extra_filtering);
+int iir_float(iir_state_t *st, float *d, int length, int nch, int extra_filtering);
 
 #ifdef ARCH_X86
 int round_trick(float floatvalue_to_round);
@@ -66,14 +116,6 @@ int round_trick(float floatvalue_to_round);
 int round_ppc(float x);
 #endif
 
-#define EQ_CHANNELS 2
-#define EQ_MAX_BANDS 31
-
-extern float preamp[EQ_CHANNELS];
-extern sIIRCoefficients *iir_cf;
-extern int rate;
-extern int band_count;
-
 #ifdef BENCHMARK
 extern double timex;
 extern int count;
@@ -29,43 +29,55 @@
 #include "benchmark.h"
 #endif /* BENCHMARK */
 
-static sXYData data_history[EQ_MAX_BANDS][EQ_CHANNELS] __attribute__((aligned));
-static sXYData data_history2[EQ_MAX_BANDS][EQ_CHANNELS] __attribute__((aligned));
-static float gain[EQ_MAX_BANDS][EQ_CHANNELS] __attribute__((aligned));
-/* random noise */
-static sample_t dither[256];
-static int di;
-
-void set_gain(int index, int chn, float val)
+/* Filter history of one state */
+typedef struct
 {
-  gain[index][chn] = val;
+  sXYData data_history[EQ_MAX_BANDS][EQ_CHANNELS];
+  sXYData data_history2[EQ_MAX_BANDS][EQ_CHANNELS];
+  /* Indexes for the history arrays
+   * These have to be kept between calls to the filter function */
+  int i, j, k;
+} sFpuHistory;
+
+static void *fpu_history_new(void)
+{
+  return calloc(1, sizeof(sFpuHistory));
 }
 
-void clean_history(void)
+static void fpu_history_free(void *history)
 {
-  int n;
+  free(history);
+}
+
+static void fpu_clean_history(iir_state_t *st)
+{
+  sFpuHistory *h = st->history;
+
   /* Zero the history arrays */
-  memset(data_history, 0, sizeof(sXYData) * EQ_MAX_BANDS * EQ_CHANNELS);
-  memset(data_history2, 0, sizeof(sXYData) * EQ_MAX_BANDS * EQ_CHANNELS);
-  /* this is only needed if we use fpu code and there's no other place for
-  the moment to init the dither array*/
-  for (n = 0; n < 256; n++) {
-      dither[n] = (rand() % 4) - 2;
-  }
-  di = 0;
+  memset(h->data_history, 0, sizeof(h->data_history));
+  memset(h->data_history2, 0, sizeof(h->data_history2));
+  h->i = 2;
+  h->j = 1;
+  h->k = 0;
 }
 
-int iir(void *d, int length, int nch, int extra_filtering)
+/*
+ * Filters 16 bit samples with dither, or floats in [-1, 1] scaled to
+ * the same range without any.
+ */
+static inline int fpu_filter_any(iir_state_t *st, void *d, int length, int nch, int extra_filtering, int is_float)
 {
 /*  FTZ_ON; */
   short *data = d;
-  /* Indexes for the history arrays
-   * These have to be kept between calls to this function
-   * hence they are static */
-  static int i = 2, j = 1, k = 0;	
+  float *fdata = d;
+  sFpuHistory *h = st->history;
+  sXYData (*data_history)[EQ_CHANNELS] = h->data_history;
+  sXYData (*data_history2)[EQ_CHANNELS] = h->data_history2;
+  sIIRCoefficients *iir_cf = st->cf;
+  int i = h->i, j = h->j, k = h->k;
 
   int index, band, channel;
-  int tempint, halflength;
+  int tempint, samples;
   sample_t out[EQ_CHANNELS], pcm[EQ_CHANNELS];
 
 #ifdef BENCHMARK
@@ -82,25 +94,27 @@ int iir(void *d, int length, int nch, int extra_filtering)
    * This algorithm cascades two filters to get nice filtering
    * at the expense of extra CPU cycles
    */
-  /* 16bit, 2 bytes per sample, so divide by two the length of
-   * the buffer (length is in bytes)
-   */
-  halflength = (length >> 1);
-  for (index = 0; index < halflength; index+=nch)
+  /* length is in bytes */
+  samples = length / (is_float ? sizeof(float) : sizeof(short));
+  for (index = 0; index < samples; index+=nch)
   {
     /* For each channel */
     for (channel = 0; channel < nch; channel++)
     {
-      pcm[channel] = data[index+channel];
+      if (is_float)
+        pcm[channel] = fdata[index+channel] * 32768.0;
+      else
+        pcm[channel] = data[index+channel];
       /* Preamp gain */
-      pcm[channel] *= preamp[channel];
+      pcm[channel] *= st->preamp[channel];
 
       /* add random noise */
-      pcm[channel] += dither[di];
+      if (!is_float)
+        pcm[channel] += st->dither[st->dither_index];
 
       out[channel] = 0.;
       /* For each band */
-      for (band = 0; band < band_count; band++)
+      for (band = 0; band < st->band_count; band++)
       {
         /* Store Xi(n) */
         data_history[band][channel].x[i] = pcm[channel];
@@ -119,13 +133,13 @@ int iir(void *d, int length, int nch, int extra_filtering)
          * The multiplication by 2.0 was 'moved' into the coefficients to save
          * CPU cycles here */
         /* Apply the gain  */
-        out[channel] +=  data_history[band][channel].y[i]*gain[band][channel]; /* * 2.0; */
+        out[channel] +=  data_history[band][channel].y[i]*st->gain[band][channel]; /* * 2.0; */
       } /* For each band */
 
       if (extra_filtering)
       {
         /* Filter the sample again */
-        for (band = 0; band < band_count; band++)
+        for (band = 0; band < st->band_count; band++)
         {
           /* Store Xi(n) */
           data_history2[band][channel].x[i] = out[channel];
@@ -141,7 +155,7 @@ int iir(void *d, int length, int nch, int extra_filtering)
              - iir_cf[band].beta * data_history2[band][channel].y[k]
             );
           /* Apply the gain */
-          out[channel] +=  data_history2[band][channel].y[i]*gain[band][channel];
+          out[channel] +=  data_history2[band][channel].y[i]*st->gain[band][channel];
         } /* For each band */
       }
 
@@ -153,8 +167,15 @@ int iir(void *d, int length, int nch, int extra_filtering)
          */
       out[channel] += pcm[channel]*0.25;
 
+      if (is_float)
+      {
+        /* no rounding or limiting, that is left to the final conversion */
+        fdata[index+channel] = out[channel] / 32768.0;
+        continue;
+      }
+
       /* remove random noise */
-      out[channel] -= dither[di]*0.25;
+      out[channel] -= st->dither[st->dither_index]*0.25;
 
       /* Round and convert to integer */
 #ifdef ARCH_PPC
@@ -181,10 +202,14 @@ int iir(void *d, int length, int nch, int extra_filtering)
     j = (j+1)%3;
     k = (k+1)%3;
     /* random noise index */
-    di = (di + 1) % 256;
+    st->dither_index = (st->dither_index + 1) % EQ_DITHER_SIZE;
 
   }/* For each pair of samples */
 
+  h->i = i;
+  h->j = j;
+  h->k = k;
+
 #ifdef BENCHMARK
   timex += get_counter();
   blength += length;
@@ -200,3 +225,23 @@ int iir(void *d, int length, int nch, int extra_filtering)
 /*  FTZ_OFF; */
   return length;
 }
+
+static int fpu_filter(iir_state_t *st, void *d, int length, int nch, int extra_filtering)
+{
+  return fpu_filter_any(st, d, length, nch, extra_filtering, 0);
+}
+
+static int fpu_filter_float(iir_state_t *st, float *d, int length, int nch, int extra_filtering)
+{
+  return fpu_filter_any(st, d, length, nch, extra_filtering, 1);
+}
+
+const iir_engine_t iir_fpu_engine =
+{
+  "fpu",
+  fpu_history_new,
+  fpu_history_free,
+  fpu_clean_history,
+  fpu_filter,
+  fpu_filter_float
+};
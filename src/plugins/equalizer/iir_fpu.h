@@ -22,6 +22,8 @@
 #ifndef IIR_FPU_H
 #define IIR_FPU_H
 
+#include "iir.h"
+
 #define sample_t double
 
 /*
@@ -36,4 +38,6 @@ typedef struct
     sample_t dummy2;
 }sXYData;
 
+extern const iir_engine_t iir_fpu_engine;
+
 #endif
@@ -0,0 +1,326 @@
+/*
+ *   PCM time-domain equalizer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "iir.h"
+#include "iir_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__ARM_NEON))
+#define HAVE_SIMD_KERNEL 1
+#endif
+
+#ifdef HAVE_SIMD_KERNEL
+
+/*
+ * Four bands per vector. The history is kept in double precision like
+ * the FPU code, so both give the same output save for the order in
+ * which the bands are summed.
+ */
+typedef double v4df __attribute__ ((vector_size (32)));
+
+#define SIMD_LANES 4
+#define SIMD_VECTORS ((EQ_MAX_BANDS + SIMD_LANES - 1) / SIMD_LANES)
+
+/* Filter history of one state */
+typedef struct
+{
+  /* Coefficients and gains, padded with zeroes past band_count */
+  v4df alpha[SIMD_VECTORS];
+  v4df beta[SIMD_VECTORS];
+  v4df gamma[SIMD_VECTORS];
+  v4df gain[SIMD_VECTORS][EQ_CHANNELS];
+
+  /* y[n], y[n-1], y[n-2] of each band, rotated through hi, hj and hk */
+  v4df y[3][SIMD_VECTORS][EQ_CHANNELS];
+  v4df y2[3][SIMD_VECTORS][EQ_CHANNELS];
+  /* x is the same for all bands of the first stage */
+  double x[3][EQ_CHANNELS];
+  v4df x2[3][SIMD_VECTORS][EQ_CHANNELS];
+
+  int vectors;
+  int hi, hj, hk;
+
+  /* the block the history was carved from, see simd_history_new */
+  void *block;
+} sSimdHistory;
+
+#define SIMD_ALIGN 32
+
+static void *simd_history_new(void)
+{
+  sSimdHistory *h;
+  void *block;
+
+  /* malloc only guarantees the alignment of the widest scalar type */
+  block = calloc(1, sizeof(sSimdHistory) + SIMD_ALIGN);
+  if (!block)
+    return NULL;
+
+  h = (sSimdHistory *) (((uintptr_t) block + SIMD_ALIGN - 1) & ~(uintptr_t) (SIMD_ALIGN - 1));
+  h->block = block;
+
+  return h;
+}
+
+static void simd_history_free(void *history)
+{
+  sSimdHistory *h = history;
+
+  free(h->block);
+}
+
+static void load_coeffs(iir_state_t *st, sSimdHistory *h)
+{
+  int band, channel;
+
+  memset(h->alpha, 0, sizeof(h->alpha));
+  memset(h->beta, 0, sizeof(h->beta));
+  memset(h->gamma, 0, sizeof(h->gamma));
+
+  for (band = 0; band < st->band_count; band++)
+  {
+    h->alpha[band / SIMD_LANES][band % SIMD_LANES] = st->cf[band].alpha;
+    h->beta[band / SIMD_LANES][band % SIMD_LANES] = st->cf[band].beta;
+    h->gamma[band / SIMD_LANES][band % SIMD_LANES] = st->cf[band].gamma;
+  }
+
+  memset(h->gain, 0, sizeof(h->gain));
+  for (band = 0; band < st->band_count; band++)
+    for (channel = 0; channel < EQ_CHANNELS; channel++)
+      h->gain[band / SIMD_LANES][channel][band % SIMD_LANES] = st->gain[band][channel];
+
+  h->vectors = (st->band_count + SIMD_LANES - 1) / SIMD_LANES;
+}
+
+/*
+ * First filter stage for one channel: all bands are fed the same x[n],
+ * their outputs are weighted by the band gains and summed.
+ */
+static inline double __attribute__ ((always_inline))
+filter_stage(sSimdHistory *h, int channel, double in)
+{
+  v4df acc = { 0., 0., 0., 0. };
+  v4df dx;
+  double d;
+  int v;
+
+  h->x[h->hi][channel] = in;
+  d = in - h->x[h->hk][channel];
+  dx = (v4df) { d, d, d, d };
+
+  for (v = 0; v < h->vectors; v++)
+  {
+    /* y(n) = alpha * [x(n)-x(n-2)] + gamma * y(n-1) - beta * y(n-2) */
+    h->y[h->hi][v][channel] = h->alpha[v] * dx
+                            + h->gamma[v] * h->y[h->hj][v][channel]
+                            - h->beta[v] * h->y[h->hk][v][channel];
+    acc += h->y[h->hi][v][channel] * h->gain[v][channel];
+  }
+
+  return acc[0] + acc[1] + acc[2] + acc[3];
+}
+
+/*
+ * Second filter stage. As in the FPU code each band is fed the output
+ * accumulated over the bands before it, so only the history terms can
+ * be computed four bands at a time; the rest is a running sum.
+ */
+static inline double __attribute__ ((always_inline))
+filter_stage2(sSimdHistory *h, int band_count, int channel, double out)
+{
+  v4df rest[SIMD_VECTORS];
+  double y;
+  int band, v, l;
+
+  for (v = 0; v < h->vectors; v++)
+  {
+    /* gamma * y(n-1) - beta * y(n-2) - alpha * x(n-2) */
+    rest[v] = h->gamma[v] * h->y2[h->hj][v][channel]
+            - h->beta[v] * h->y2[h->hk][v][channel]
+            - h->alpha[v] * h->x2[h->hk][v][channel];
+  }
+
+  for (band = 0; band < band_count; band++)
+  {
+    v = band / SIMD_LANES;
+    l = band % SIMD_LANES;
+
+    h->x2[h->hi][v][channel][l] = out;
+    y = h->alpha[v][l] * out + rest[v][l];
+    h->y2[h->hi][v][channel][l] = y;
+    out += y * h->gain[v][channel][l];
+  }
+
+  return out;
+}
+
+/* 16 bit samples, or floats without dither, as in iir_fpu.c */
+static inline int __attribute__ ((always_inline))
+filter(iir_state_t *st, void *d, int length, int nch, int extra_filtering, int is_float)
+{
+  sSimdHistory *h = st->history;
+  short *data = d;
+  float *fdata = d;
+  int index, channel, samples, tempint;
+  double pcm, out;
+
+  load_coeffs(st, h);
+
+  samples = length / (is_float ? sizeof(float) : sizeof(short));
+  for (index = 0; index < samples; index += nch)
+  {
+    for (channel = 0; channel < nch; channel++)
+    {
+      if (is_float)
+        pcm = fdata[index+channel] * 32768.0;
+      else
+        pcm = data[index+channel];
+      pcm *= st->preamp[channel];
+      if (!is_float)
+        pcm += st->dither[st->dither_index];
+
+      out = filter_stage(h, channel, pcm);
+      if (extra_filtering)
+        out = filter_stage2(h, st->band_count, channel, out);
+
+      /* Mix in the scaled down original sample, see iir_fpu.c */
+      out += pcm*0.25;
+
+      if (is_float)
+      {
+        fdata[index+channel] = out / 32768.0;
+        continue;
+      }
+
+      out -= st->dither[st->dither_index]*0.25;
+
+      tempint = (int)out;
+      if (tempint < -32768)
+        data[index+channel] = -32768;
+      else if (tempint > 32767)
+        data[index+channel] = 32767;
+      else
+        data[index+channel] = tempint;
+    }
+
+    h->hi = (h->hi+1)%3;
+    h->hj = (h->hj+1)%3;
+    h->hk = (h->hk+1)%3;
+    st->dither_index = (st->dither_index + 1) % EQ_DITHER_SIZE;
+  }
+
+  return length;
+}
+
+static void simd_clean_history(iir_state_t *st)
+{
+  sSimdHistory *h = st->history;
+
+  memset(h->y, 0, sizeof(h->y));
+  memset(h->y2, 0, sizeof(h->y2));
+  memset(h->x, 0, sizeof(h->x));
+  memset(h->x2, 0, sizeof(h->x2));
+  h->hi = 2;
+  h->hj = 1;
+  h->hk = 0;
+}
+
+/*
+ * The same kernel compiled for each instruction set worth having.
+ * The vector code is lowered to the widest registers the target has:
+ * one AVX or two SSE2/NEON operations per vector.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+static int __attribute__ ((target ("sse2")))
+filter_sse2(iir_state_t *st, void *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 0);
+}
+
+static int __attribute__ ((target ("sse2")))
+filter_float_sse2(iir_state_t *st, float *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 1);
+}
+
+static int __attribute__ ((target ("avx")))
+filter_avx(iir_state_t *st, void *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 0);
+}
+
+static int __attribute__ ((target ("avx")))
+filter_float_avx(iir_state_t *st, float *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 1);
+}
+
+static const iir_engine_t sse2_engine =
+{
+  "sse2", simd_history_new, simd_history_free, simd_clean_history,
+  filter_sse2, filter_float_sse2
+};
+
+static const iir_engine_t avx_engine =
+{
+  "avx", simd_history_new, simd_history_free, simd_clean_history,
+  filter_avx, filter_float_avx
+};
+#else
+static int filter_neon(iir_state_t *st, void *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 0);
+}
+
+static int filter_float_neon(iir_state_t *st, float *d, int length, int nch, int extra_filtering)
+{
+  return filter(st, d, length, nch, extra_filtering, 1);
+}
+
+static const iir_engine_t neon_engine =
+{
+  "neon", simd_history_new, simd_history_free, simd_clean_history,
+  filter_neon, filter_float_neon
+};
+#endif
+
+const iir_engine_t *iir_simd_init(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx"))
+    return &avx_engine;
+  if (__builtin_cpu_supports("sse2"))
+    return &sse2_engine;
+  return NULL;
+#else
+  /* NEON is part of the baseline on aarch64, and on arm when the
+   * compiler was told it may use it */
+  return &neon_engine;
+#endif
+}
+
+#else /* !HAVE_SIMD_KERNEL */
+
+const iir_engine_t *iir_simd_init(void)
+{
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,31 @@
+/*
+ *   PCM time-domain equalizer
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+#ifndef IIR_SIMD_H
+#define IIR_SIMD_H
+
+#include "iir.h"
+
+/*
+ * Vector implementation, filtering four bands at a time.
+ *
+ * iir_simd_init returns the engine built for the running CPU, or NULL
+ * if there is none and the FPU code should be used.
+ */
+const iir_engine_t *iir_simd_init(void);
+
+#endif
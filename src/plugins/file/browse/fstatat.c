@@ -70,6 +70,8 @@ xmms_file_browse (xmms_xform_t *xform,
 		if (!S_ISDIR (st.st_mode)) {
 			xmms_xform_browse_add_entry_property_int (xform, "size",
 			                                          st.st_size);
+			xmms_xform_browse_add_entry_property_int (xform, "lmod",
+			                                          st.st_mtime);
 		}
 	}
 
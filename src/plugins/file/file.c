@@ -14,11 +14,15 @@
  *  Lesser General Public License for more details.
  */
 
+#include <xmms_configuration.h>
 #include <xmms/xmms_xformplugin.h>
 #include <xmms/xmms_log.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -31,12 +35,33 @@
 #if !defined(O_BINARY)
 # define O_BINARY 0
 #endif
+/* How far ahead of the read position the kernel is asked to read */
+#define XMMS_FILE_READAHEAD (1024 * 1024)
+
 /*
  * Type definitions
  */
 
+/** How the file is read, from the "file.mode" config property */
+typedef enum {
+	/** read() as the decoder asks */
+	XMMS_FILE_MODE_READ,
+	/** read(), telling the kernel to read ahead of the position */
+	XMMS_FILE_MODE_READAHEAD,
+	/** copy out of a mapping of the whole file, seeks cost nothing */
+	XMMS_FILE_MODE_MMAP
+} xmms_file_mode_t;
+
 typedef struct {
 	gint fd;
+	xmms_file_mode_t mode;
+	/** Current position, kept for readahead and mmap modes */
+	gint64 pos;
+	/** End of the range the kernel was last asked to read ahead */
+	gint64 advised;
+	/** The mapping and its size in mmap mode */
+	const guchar *map;
+	gint64 size;
 } xmms_file_data_t;
 
 /*
@@ -72,6 +97,10 @@ xmms_file_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
+	/* "read", "readahead" or "mmap" */
+	xmms_xform_plugin_config_property_register (xform_plugin, "mode",
+	                                            "readahead", NULL, NULL);
+
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE,
 	                              "application/x-url",
@@ -85,6 +114,77 @@ xmms_file_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 /*
  * Member functions
  */
+static xmms_file_mode_t
+xmms_file_mode_get (xmms_xform_t *xform)
+{
+	xmms_config_property_t *val;
+	const gchar *mode;
+
+	val = xmms_xform_config_lookup (xform, "mode");
+	mode = val ? xmms_config_property_get_string (val) : NULL;
+
+	if (!mode || strcmp (mode, "readahead") == 0) {
+		return XMMS_FILE_MODE_READAHEAD;
+	} else if (strcmp (mode, "mmap") == 0) {
+		return XMMS_FILE_MODE_MMAP;
+	} else if (strcmp (mode, "read") == 0) {
+		return XMMS_FILE_MODE_READ;
+	}
+
+	xmms_log_error ("Unknown file.mode '%s', using readahead", mode);
+	return XMMS_FILE_MODE_READAHEAD;
+}
+
+/**
+ * Map the whole file. The descriptor is not needed after that.
+ */
+static gboolean
+xmms_file_map (xmms_file_data_t *data, gint64 size)
+{
+#ifdef HAVE_SYS_MMAN_H
+	void *map;
+
+	if (size <= 0 || size > G_MAXSSIZE) {
+		return FALSE;
+	}
+
+	map = mmap (NULL, size, PROT_READ, MAP_PRIVATE, data->fd, 0);
+	if (map == MAP_FAILED) {
+		XMMS_DBG ("Couldn't map file: %s", strerror (errno));
+		return FALSE;
+	}
+
+	madvise (map, size, MADV_SEQUENTIAL);
+
+	data->map = map;
+	data->size = size;
+
+	close (data->fd);
+	data->fd = -1;
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Ask the kernel to read the next stretch of the file before the
+ * decoder gets there, instead of one small read at a time.
+ */
+static void
+xmms_file_readahead (xmms_file_data_t *data)
+{
+#ifdef HAVE_POSIX_FADVISE
+	if (data->pos + XMMS_FILE_READAHEAD / 2 < data->advised) {
+		return;
+	}
+
+	posix_fadvise (data->fd, data->pos, XMMS_FILE_READAHEAD, POSIX_FADV_WILLNEED);
+	data->advised = data->pos + XMMS_FILE_READAHEAD;
+#endif
+}
+
 static gboolean
 xmms_file_init (xmms_xform_t *xform)
 {
@@ -119,6 +219,18 @@ xmms_file_init (xmms_xform_t *xform)
 
 	data = g_new0 (xmms_file_data_t, 1);
 	data->fd = fd;
+	data->mode = xmms_file_mode_get (xform);
+
+	if (data->mode == XMMS_FILE_MODE_MMAP && !xmms_file_map (data, st.st_size)) {
+		data->mode = XMMS_FILE_MODE_READAHEAD;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	if (data->mode == XMMS_FILE_MODE_READAHEAD) {
+		posix_fadvise (fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#endif
+
 	xmms_xform_private_data_set (xform, data);
 
 	xmms_xform_outdata_type_add (xform,
@@ -148,6 +260,11 @@ xmms_file_destroy (xmms_xform_t *xform)
 	if (data->fd != -1)
 		close (data->fd);
 
+#ifdef HAVE_SYS_MMAN_H
+	if (data->map)
+		munmap ((void *) data->map, data->size);
+#endif
+
 	g_free (data);
 }
 
@@ -164,11 +281,27 @@ xmms_file_read (xmms_xform_t *xform, void *buffer, gint len, xmms_error_t *error
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
+	if (data->mode == XMMS_FILE_MODE_MMAP) {
+		if (data->pos >= data->size) {
+			return 0;
+		}
+		ret = MIN (len, data->size - data->pos);
+		memcpy (buffer, data->map + data->pos, ret);
+		data->pos += ret;
+		return ret;
+	}
+
+	if (data->mode == XMMS_FILE_MODE_READAHEAD) {
+		xmms_file_readahead (data);
+	}
+
 	ret = read (data->fd, buffer, len);
 
 	if (ret == -1) {
 		xmms_log_error ("errno(%d) %s", errno, strerror (errno));
 		xmms_error_set (error, XMMS_ERROR_GENERIC, strerror (errno));
+	} else {
+		data->pos += ret;
 	}
 
 	return ret;
@@ -185,6 +318,22 @@ xmms_file_seek (xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mode_t whenc
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
+	if (data->mode == XMMS_FILE_MODE_MMAP) {
+		gint64 pos = offset;
+
+		if (whence == XMMS_XFORM_SEEK_CUR) {
+			pos += data->pos;
+		} else if (whence == XMMS_XFORM_SEEK_END) {
+			pos += data->size;
+		}
+		if (pos < 0) {
+			xmms_error_set (error, XMMS_ERROR_INVAL, "Couldn't seek");
+			return -1;
+		}
+		data->pos = pos;
+		return pos;
+	}
+
 	switch (whence) {
 		case XMMS_XFORM_SEEK_SET:
 			w = SEEK_SET;
@@ -202,5 +351,9 @@ xmms_file_seek (xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mode_t whenc
 		xmms_error_set (error, XMMS_ERROR_INVAL, "Couldn't seek");
 		return -1;
 	}
+
+	/* read ahead from the new position on the next read */
+	data->pos = data->advised = res;
+
 	return res;
 }
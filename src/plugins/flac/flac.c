@@ -35,9 +35,24 @@ typedef struct xmms_flac_data_St {
 	guint bits_per_sample;
 	guint64 total_samples;
 
-	GString *buffer;
+	xmms_xform_fifo_t *buffer;
+
+	/* frames seen while decoding, about one per second, so seeking
+	 * back to them doesn't need libFLAC's search through the file */
+	GArray *seek_index;
+	/* the first sample to output after seeking to an indexed frame */
+	guint64 seek_target;
 } xmms_flac_data_t;
 
+typedef struct xmms_flac_seekpoint_St {
+	guint64 sample;
+	guint64 offset;
+} xmms_flac_seekpoint_t;
+
+/* How far before the wanted sample an indexed frame may be, in
+ * seconds, for decoding from it to be quicker than a search. */
+#define XMMS_FLAC_SEEK_INDEX_REACH 2
+
 /*
  * Function prototypes
  */
@@ -158,6 +173,62 @@ flac_callback_read (const FLAC__StreamDecoder *flacdecoder, FLAC__byte buffer[],
 	}
 }
 
+/* Remember where the frame starting at sample is, the decoder has just
+ * read up to it. */
+static void
+xmms_flac_seek_index_add (xmms_flac_data_t *data, guint64 sample)
+{
+	xmms_flac_seekpoint_t point, *last = NULL;
+	FLAC__uint64 offset;
+
+	if (data->seek_index->len > 0) {
+		last = &g_array_index (data->seek_index, xmms_flac_seekpoint_t,
+		                       data->seek_index->len - 1);
+	}
+
+	if (last && sample < last->sample + data->sample_rate) {
+		return;
+	}
+
+	if (!FLAC__stream_decoder_get_decode_position (data->flacdecoder, &offset)) {
+		return;
+	}
+
+	point.sample = sample;
+	point.offset = offset;
+	g_array_append_val (data->seek_index, point);
+}
+
+/* Find the last indexed frame up to sample, if it is close enough. */
+static xmms_flac_seekpoint_t *
+xmms_flac_seek_index_find (xmms_flac_data_t *data, guint64 sample)
+{
+	xmms_flac_seekpoint_t *point;
+	guint lo = 0, hi = data->seek_index->len;
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+
+		point = &g_array_index (data->seek_index, xmms_flac_seekpoint_t, mid);
+		if (point->sample <= sample) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	if (lo == 0) {
+		return NULL;
+	}
+
+	point = &g_array_index (data->seek_index, xmms_flac_seekpoint_t, lo - 1);
+	if (sample - point->sample > (guint64) data->sample_rate * XMMS_FLAC_SEEK_INDEX_REACH) {
+		return NULL;
+	}
+
+	return point;
+}
+
 static FLAC__StreamDecoderWriteStatus
 flac_callback_write (const FLAC__StreamDecoder *flacdecoder,
                      const FLAC__Frame *frame,
@@ -166,36 +237,73 @@ flac_callback_write (const FLAC__StreamDecoder *flacdecoder,
 {
 	xmms_xform_t *xform = (xmms_xform_t *)client_data;
 	xmms_flac_data_t *data;
-	guint sample, channel;
-	guint8 packed;
-	guint16 packed16;
-	guint32 packed32;
+	guint sample, channel, width, len, first;
+	guint64 start;
+	guint8 *packed;
+	guint16 *packed16;
+	guint32 *packed32;
 
 	data = xmms_xform_private_data_get (xform);
 
-	for (sample = 0; sample < frame->header.blocksize; sample++) {
+	switch (data->bits_per_sample) {
+		case 8:
+			width = 1;
+			break;
+		case 16:
+			width = 2;
+			break;
+		case 24:
+		case 32:
+			width = 4;
+			break;
+		default:
+			return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+	}
+
+	start = frame->header.number.sample_number;
+	if (frame->header.number_type == FLAC__FRAME_NUMBER_TYPE_FRAME_NUMBER) {
+		start = (guint64) frame->header.number.frame_number * frame->header.blocksize;
+	}
+
+	xmms_flac_seek_index_add (data, start + frame->header.blocksize);
+
+	/* skip what comes before the sample seeked to */
+	first = 0;
+	if (data->seek_target > start) {
+		first = MIN (data->seek_target - start, frame->header.blocksize);
+		if (first == frame->header.blocksize) {
+			return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+		}
+	}
+	data->seek_target = 0;
+
+	/* decode the rest of the frame right into the fifo */
+	len = (frame->header.blocksize - first) * frame->header.channels * width;
+	packed = xmms_xform_fifo_reserve (data->buffer, len);
+	packed16 = (guint16 *) packed;
+	packed32 = (guint32 *) packed;
+
+	for (sample = first; sample < frame->header.blocksize; sample++) {
 		for (channel = 0; channel < frame->header.channels; channel++) {
 			switch (data->bits_per_sample) {
 				case 8:
-					packed = (guint8)buffer[channel][sample];
-					g_string_append_len (data->buffer, (gchar *) &packed, 1);
+					*packed++ = (guint8)buffer[channel][sample];
 					break;
 				case 16:
-					packed16 = (guint16)buffer[channel][sample];
-					g_string_append_len (data->buffer, (gchar *) &packed16, 2);
+					*packed16++ = (guint16)buffer[channel][sample];
 					break;
 				case 24:
-					packed32 = ((guint32)(buffer[channel][sample]) << 8);
-					g_string_append_len (data->buffer, (gchar *) &packed32, 4);
+					*packed32++ = ((guint32)(buffer[channel][sample]) << 8);
 					break;
 				case 32:
-					packed32 = ((guint32)buffer[channel][sample]);
-					g_string_append_len (data->buffer, (gchar *) &packed32, 4);
+					*packed32++ = ((guint32)buffer[channel][sample]);
 					break;
 			}
 		}
 	}
 
+	xmms_xform_fifo_commit (data->buffer, len);
+
 
 	return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
@@ -465,7 +573,8 @@ xmms_flac_init (xmms_xform_t *xform)
 	                             data->sample_rate,
 	                             XMMS_STREAM_TYPE_END);
 
-	data->buffer = g_string_new (NULL);
+	data->buffer = xmms_xform_fifo_new ();
+	data->seek_index = g_array_new (FALSE, FALSE, sizeof (xmms_flac_seekpoint_t));
 
 	return TRUE;
 
@@ -493,7 +602,7 @@ xmms_flac_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, FALSE);
 
-	size = MIN (data->buffer->len, len);
+	size = MIN (xmms_xform_fifo_length (data->buffer), len);
 
 	if (size <= 0) {
 		if (!FLAC__stream_decoder_process_single (data->flacdecoder)) {
@@ -512,12 +621,7 @@ xmms_flac_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
 		return 0;
 	}
 
-	size = MIN (data->buffer->len, len);
-
-	memcpy (buf, data->buffer->str, size);
-	g_string_erase (data->buffer, 0, size);
-
-	return size;
+	return xmms_xform_fifo_read (data->buffer, buf, len);
 }
 
 static gint64
@@ -525,6 +629,8 @@ xmms_flac_seek (xmms_xform_t *xform, gint64 samples,
                 xmms_xform_seek_mode_t whence, xmms_error_t *err)
 {
 	xmms_flac_data_t *data;
+	xmms_flac_seekpoint_t *point;
+	xmms_error_t error;
 	FLAC__bool res;
 
 	g_return_val_if_fail (xform, -1);
@@ -538,6 +644,36 @@ xmms_flac_seek (xmms_xform_t *xform, gint64 samples,
 		return -1;
 	}
 
+	/* the decoder writes the frame it seeked to */
+	xmms_xform_fifo_clear (data->buffer);
+
+	point = xmms_flac_seek_index_find (data, samples);
+	if (point) {
+		xmms_error_reset (&error);
+
+		if (FLAC__stream_decoder_flush (data->flacdecoder) &&
+		    xmms_xform_seek (xform, point->offset, XMMS_XFORM_SEEK_SET, &error) >= 0) {
+			/* decode up to the frame with the wanted sample */
+			data->seek_target = samples;
+			while (!xmms_xform_fifo_length (data->buffer)) {
+				if (!FLAC__stream_decoder_process_single (data->flacdecoder) ||
+				    FLAC__stream_decoder_get_state (data->flacdecoder) ==
+				    FLAC__STREAM_DECODER_END_OF_STREAM) {
+					break;
+				}
+			}
+			data->seek_target = 0;
+
+			if (xmms_xform_fifo_length (data->buffer)) {
+				return samples;
+			}
+		}
+
+		/* let libFLAC find it then */
+		FLAC__stream_decoder_flush (data->flacdecoder);
+		xmms_xform_fifo_clear (data->buffer);
+	}
+
 	res = FLAC__stream_decoder_seek_absolute (data->flacdecoder,
 	                                          (FLAC__uint64) samples);
 
@@ -558,7 +694,8 @@ xmms_flac_destroy (xmms_xform_t *xform)
 		FLAC__metadata_object_delete (data->vorbiscomment);
 	}
 
-	g_string_free (data->buffer, TRUE);
+	xmms_xform_fifo_free (data->buffer);
+	g_array_free (data->seek_index, TRUE);
 
 	FLAC__stream_decoder_finish (data->flacdecoder);
 	FLAC__stream_decoder_delete (data->flacdecoder);
@@ -49,6 +49,9 @@
 /* Fill up the buffer with MIDI events every 500 milliseconds */
 #define CALLBACK_FREQ 500
 
+/* Bytes rendered at a time when rendering ahead */
+#define RENDER_CHUNK 4096
+
 /* FluidSynth uses floating point samples internally.  Uncomment this to pass
  * those samples to XMMS2 unchanged.  Comment it out to have FluidSynth convert
  * the samples to signed 16-bit before passing them to XMMS2.
@@ -79,6 +82,15 @@ typedef struct xmms_fluidsynth_data_St {
 	gulong delay;   /* Current time (in MIDI delta ticks) until next event */
 
 	guchar prev_event; /* Last command (for MIDI "running status") */
+
+	xmms_xform_render_t *render;
+	gint frame_size;
+
+	/* Metadata found while rendering, set on the xform by the next read
+	 * since the rendering may be done on another thread.
+	 */
+	GMutex metadata_lock;
+	GHashTable *metadata;
 } xmms_fluidsynth_data_t;
 
 /*
@@ -88,6 +100,7 @@ static gboolean xmms_fluidsynth_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 static gboolean xmms_fluidsynth_init (xmms_xform_t *xform);
 static void xmms_fluidsynth_destroy (xmms_xform_t *xform);
 static gint xmms_fluidsynth_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
+static gint xmms_fluidsynth_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
 static void xmms_fluidsynth_sf_config_changed (xmms_object_t *obj, xmmsv_t *_value, gpointer udata);
 static void xmms_fluidsynth_config_changed (xmms_object_t *obj, xmmsv_t *_value, gpointer udata);
 static void xmms_fluidsynth_skip_bytes (xmms_xform_t *xform, guint count);
@@ -147,6 +160,12 @@ xmms_fluidsynth_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 		                                            NULL, NULL);
 	}
 
+	/* Milliseconds to render ahead of playback, 0 to render when read.
+	 * Big SoundFonts make the time a chunk takes vary a lot.
+	 */
+	xmms_xform_plugin_config_property_register (xform_plugin, "render_ahead",
+	                                            "1000", NULL, NULL);
+
 	/* Set up the soundfont.0 config option and the function to call when its
 	 * value is changed.
 	 */
@@ -291,6 +310,21 @@ xmms_fluidsynth_init (xmms_xform_t *xform)
 	data->now = fluid_sequencer_get_tick (data->sequencer);
 	xmms_fluidsynth_sched_callback (data, data->now);
 
+#ifdef FLUIDSYNTH_USE_FLOAT
+	data->frame_size = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_FLOAT) * 2;
+#else
+	data->frame_size = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_S16) * 2;
+#endif
+
+	g_mutex_init (&data->metadata_lock);
+	data->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+
+	cfgv = xmms_xform_config_lookup (xform, "render_ahead");
+	data->render = xmms_xform_render_new (xform, xmms_fluidsynth_render,
+	                                      RENDER_CHUNK,
+	                                      (gsize) MAX (0, xmms_config_property_get_int (cfgv)) *
+	                                      (gint) samplerate / 1000 * data->frame_size);
+
 	return TRUE;
 }
 
@@ -306,6 +340,12 @@ xmms_fluidsynth_destroy (xmms_xform_t *xform)
 	data = xmms_xform_private_data_get (xform);
 	g_return_if_fail (data);
 
+	if (data->render) {
+		xmms_xform_render_free (data->render);
+		g_hash_table_destroy (data->metadata);
+		g_mutex_clear (&data->metadata_lock);
+	}
+
 	for (i = data->soundfont_id->len; i > 0; i--) {
 		fluid_synth_sfunload (data->synth,
 		                      g_array_index (data->soundfont_id, int, i - 1),
@@ -337,18 +377,37 @@ xmms_fluidsynth_destroy (xmms_xform_t *xform)
 
 static gint
 xmms_fluidsynth_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err)
+{
+	xmms_fluidsynth_data_t *data;
+	GHashTableIter iter;
+	gpointer key, value;
+	gint ret;
+
+	data = xmms_xform_private_data_get (xform);
+
+	ret = xmms_xform_render_read (data->render, buf, len, err);
+
+	g_mutex_lock (&data->metadata_lock);
+	g_hash_table_iter_init (&iter, data->metadata);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		xmms_xform_metadata_set_str (xform, key, value);
+		g_hash_table_iter_remove (&iter);
+	}
+	g_mutex_unlock (&data->metadata_lock);
+
+	return ret;
+}
+
+static gint
+xmms_fluidsynth_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err)
 {
 	xmms_fluidsynth_data_t *data;
 	gint status;
 	gint sample_size;
 
-#ifdef FLUIDSYNTH_USE_FLOAT
-	sample_size = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_FLOAT) * 2;
-#else
-	sample_size = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_U16) * 2;
-#endif
-
 	data = xmms_xform_private_data_get (xform);
+	sample_size = data->frame_size;
+
 	if (data->end_of_song) {
 		/* The song is ended, but don't stop too abruptly! */
 		if (data->trailing_samples == 0) return 0;
@@ -747,6 +806,7 @@ static void
 xmms_fluidsynth_set_metadata (xmms_xform_t *xform, const gchar *metakey,
                               const gchar *text, guint len)
 {
+	xmms_fluidsynth_data_t *data;
 	gsize readsize,writsize;
 	GError *err = NULL;
 	gchar *tmp;
@@ -774,9 +834,13 @@ xmms_fluidsynth_set_metadata (xmms_xform_t *xform, const gchar *metakey,
 	if (tmp) {
 		g_strstrip (tmp);
 		if (tmp[0] != '\0') {
-			xmms_xform_metadata_set_str (xform, metakey, tmp);
+			data = xmms_xform_private_data_get (xform);
+			g_mutex_lock (&data->metadata_lock);
+			g_hash_table_replace (data->metadata, (gpointer) metakey, tmp);
+			g_mutex_unlock (&data->metadata_lock);
+		} else {
+			g_free (tmp);
 		}
-		g_free (tmp);
 	}
 
 	return;
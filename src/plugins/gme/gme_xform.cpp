@@ -32,6 +32,8 @@
 #define GME_DEFAULT_SONG_LENGTH 300
 #define GME_DEFAULT_SONG_LOOPS 2
 #define GME_DEFAULT_STEREO_DEPTH -1.0
+#define GME_DEFAULT_RENDER_AHEAD 500
+#define GME_RENDER_CHUNK 4096
 
 extern "C" {
 
@@ -42,6 +44,7 @@ extern "C" {
 typedef struct xmms_gme_data_St {
 	Music_Emu *emu; /* An emulation instance for the GME library */
 	int samplerate; /* The sample rate, set by the user */
+	xmms_xform_render_t *render; /* Renders ahead of playback */
 } xmms_gme_data_t;
 
 /*
@@ -50,6 +53,7 @@ typedef struct xmms_gme_data_St {
 
 static gboolean xmms_gme_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gint xmms_gme_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
+static gint xmms_gme_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
 static gboolean xmms_gme_init (xmms_xform_t *decoder);
 static void xmms_gme_destroy (xmms_xform_t *decoder);
 static gint64 xmms_gme_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t whence, xmms_error_t *err);
@@ -80,6 +84,7 @@ xmms_gme_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin, "maxlength", G_STRINGIFY (GME_DEFAULT_SONG_LENGTH), NULL, NULL);
 	xmms_xform_plugin_config_property_register (xform_plugin, "samplerate", G_STRINGIFY (GME_DEFAULT_SAMPLE_RATE), NULL, NULL);
 	xmms_xform_plugin_config_property_register (xform_plugin, "stereodepth", G_STRINGIFY (GME_DEFAULT_STEREO_DEPTH), NULL, NULL);
+	xmms_xform_plugin_config_property_register (xform_plugin, "render_ahead", G_STRINGIFY (GME_DEFAULT_RENDER_AHEAD), NULL, NULL);
 
 	/* todo: add other mime types */
 	xmms_xform_plugin_indata_add (xform_plugin,
@@ -318,6 +323,12 @@ xmms_gme_init (xmms_xform_t *xform)
 		gme_set_fade (data->emu, fadelen);
 	}
 
+	/* milliseconds of 16 bit stereo */
+	val = xmms_xform_config_lookup (xform, "render_ahead");
+	data->render = xmms_xform_render_new (xform, xmms_gme_render, GME_RENDER_CHUNK,
+	                                      (gsize) MAX (0, xmms_config_property_get_int (val)) *
+	                                      samplerate / 1000 * 4);
+
 	gme_free_info (metadata);
 	return TRUE;
 }
@@ -332,6 +343,9 @@ xmms_gme_destroy (xmms_xform_t *xform)
 	data = (xmms_gme_data_t *)xmms_xform_private_data_get (xform);
 	g_return_if_fail (data);
 
+	if (data->render)
+		xmms_xform_render_free (data->render);
+
 	if (data->emu)
 		gme_delete (data->emu);
 
@@ -342,6 +356,20 @@ xmms_gme_destroy (xmms_xform_t *xform)
 /* Read some data */
 static gint
 xmms_gme_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err)
+{
+	xmms_gme_data_t *data;
+
+	g_return_val_if_fail (xform, -1);
+
+	data = (xmms_gme_data_t *)xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	return xmms_xform_render_read (data->render, buf, len, err);
+}
+
+/* Render some data, from the render-ahead worker unless it's off */
+static gint
+xmms_gme_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err)
 {
 	xmms_gme_data_t *data;
 	gme_err_t play_error;
@@ -369,7 +397,7 @@ xmms_gme_seek (xmms_xform_t *xform, gint64 samples,
                xmms_xform_seek_mode_t whence, xmms_error_t *err)
 {
 	xmms_gme_data_t *data;
-	gint64 target_time;
+	gint64 target_time, res;
 	gint duration;
 	int samplerate;
 
@@ -396,9 +424,12 @@ xmms_gme_seek (xmms_xform_t *xform, gint64 samples,
 		return -1;
 	}
 
+	xmms_xform_render_stop (data->render);
 	gme_seek (data->emu, target_time);
+	res = (gme_tell (data->emu) / 1000) * samplerate;
+	xmms_xform_render_start (data->render);
 
-	return (gme_tell (data->emu) / 1000) * samplerate;
+	return res;
 }
 
 }
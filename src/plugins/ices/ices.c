@@ -29,8 +29,28 @@
 
 #include "encode.h"
 
+#include "../encoder_common/worker.c"
+
+enum {
+	ICES_CMD_FORMAT = 1,
+	ICES_CMD_TRACK,
+	ICES_CMD_CLOSE,
+};
+
+typedef struct xmms_ices_format_St {
+	xmms_medialib_entry_t entry;
+	gint rate;
+	gint channels;
+	gint minbr;
+	gint nombr;
+	gint maxbr;
+} xmms_ices_format_t;
+
 typedef struct xmms_ices_data_St {
 	shout_t *shout;
+	xmms_encode_worker_t *worker;
+
+	/* only touched by the worker */
 	vorbis_comment vc;
 	encoder_state *encoder;
 	gint rate;
@@ -46,6 +66,7 @@ static void xmms_ices_destroy (xmms_output_t *output);
 static gboolean xmms_ices_open (xmms_output_t *output);
 static void xmms_ices_close (xmms_output_t *output);
 static void xmms_ices_flush (xmms_output_t *output);
+static guint xmms_ices_latency_get (xmms_output_t *output);
 static gboolean xmms_ices_format_set (xmms_output_t *output,
                                       const xmms_stream_type_t *format);
 static void xmms_ices_write (xmms_output_t *output, gpointer buffer,
@@ -58,26 +79,26 @@ static void on_playlist_entry_changed (xmms_object_t *object, xmmsv_t *arg,
 /*
  * Internal helper functions.
  */
-static void
-xmms_ices_send_shout (xmms_ices_data_t *data, xmms_error_t *err)
+static gboolean
+xmms_ices_send_shout (xmms_ices_data_t *data, gchar **msg)
 {
 	ogg_page og;
 
 	while (xmms_ices_encoder_output (data->encoder, &og) == TRUE) {
 		if (shout_send (data->shout, og.header, og.header_len) < 0) {
-			if (err)
-				xmms_error_set (err, XMMS_ERROR_GENERIC,
-				                "Disconnected or something.");
-			return;
+			if (msg)
+				*msg = g_strdup ("Disconnected or something.");
+			return FALSE;
 		} else if (shout_send (data->shout, og.body, og.body_len) < 0) {
-			if (err)
-				xmms_error_set (err, XMMS_ERROR_GENERIC,
-				                "Error when sending data to icecast server");
-			return;
+			if (msg)
+				*msg = g_strdup ("Error when sending data to icecast server");
+			return FALSE;
 		}
 
 		shout_sync (data->shout);
 	}
+
+	return TRUE;
 }
 
 static void
@@ -88,6 +109,84 @@ xmms_ices_flush_internal (xmms_ices_data_t *data)
 	xmms_ices_send_shout (data, NULL);
 }
 
+/*
+ * Encoder worker callbacks, all the encoding and sending happens on
+ * the worker so a slow server doesn't stall the output writer.
+ */
+static gboolean
+xmms_ices_encode (gpointer udata, gpointer buf, gint len, gchar **msg)
+{
+	xmms_ices_data_t *data = udata;
+
+	if (!data->encoder) {
+		*msg = g_strdup ("encoding is not initialized");
+		return FALSE;
+	}
+
+	xmms_ices_encoder_input (data->encoder, buf, len);
+
+	return xmms_ices_send_shout (data, msg);
+}
+
+static void
+xmms_ices_control (gpointer udata, gint cmd, gpointer arg)
+{
+	xmms_ices_data_t *data = udata;
+	xmms_ices_format_t *fmt;
+	xmms_medialib_entry_t *entry;
+
+	switch (cmd) {
+		case ICES_CMD_FORMAT:
+			fmt = arg;
+
+			if (data->encoder)
+				xmms_ices_flush_internal (data);
+
+			/* Set the Vorbis comment to the current track metadata. */
+			xmms_ices_update_comment (fmt->entry, &data->vc);
+
+			/* If there is no encoder around, we need to build one. */
+			if (!data->encoder) {
+				data->encoder = xmms_ices_encoder_init (fmt->minbr,
+				                                        fmt->nombr,
+				                                        fmt->maxbr);
+				if (!data->encoder)
+					return;
+			}
+
+			data->rate = fmt->rate;
+			data->channels = fmt->channels;
+
+			xmms_ices_encoder_stream_change (data->encoder, data->rate,
+			                                 data->channels, &data->vc);
+			break;
+		case ICES_CMD_TRACK:
+			entry = arg;
+
+			xmms_ices_update_comment (*entry, &data->vc);
+
+			if (!data->encoder)
+				break;
+
+			xmms_ices_flush_internal (data);
+
+			XMMS_DBG ("Updating comment");
+
+			xmms_ices_encoder_stream_change (data->encoder, data->rate,
+			                                 data->channels, &data->vc);
+			break;
+		case ICES_CMD_CLOSE:
+			if (!data->encoder)
+				break;
+
+			xmms_ices_flush_internal (data);
+
+			xmms_ices_encoder_fini (data->encoder);
+			data->encoder = NULL;
+			break;
+	}
+}
+
 /*
  * Main plugin definition and handler functions.
  */
@@ -120,6 +219,8 @@ xmms_ices_plugin_setup (xmms_output_plugin_t *plugin)
 		{ "streamdescription", "" },
 		{ "streamgenre", "" },
 		{ "streamurl", "" },
+		/* how far the encoder may fall behind before writes block */
+		{ "max_backlog_ms", "2000" },
 		{ NULL, NULL },
 	};
 
@@ -133,6 +234,7 @@ xmms_ices_plugin_setup (xmms_output_plugin_t *plugin)
 	methods.flush = xmms_ices_flush;
 	methods.format_set = xmms_ices_format_set;
 	methods.write = xmms_ices_write;
+	methods.latency_get = xmms_ices_latency_get;
 
 	xmms_output_plugin_methods_set (plugin, &methods);
 
@@ -190,6 +292,12 @@ xmms_ices_new (xmms_output_t *output)
 	val = xmms_output_config_lookup (output, "streamurl");
 	shout_set_url (data->shout, xmms_config_property_get_string (val));
 
+	vorbis_comment_init (&data->vc);
+
+	data->worker = xmms_encode_worker_new ("x2 ices", xmms_ices_encode,
+	                                       xmms_ices_control, data,
+	                                       G_MAXSIZE);
+
 	xmms_output_private_data_set (output, data);
 	xmms_output_format_add (output, XMMS_SAMPLE_FORMAT_FLOAT, 2, 44100);
 
@@ -214,6 +322,8 @@ xmms_ices_destroy (xmms_output_t *output)
 	                        on_playlist_entry_changed,
 	                        data);
 
+	xmms_encode_worker_free (data->worker);
+
 	if (data->encoder)
 		xmms_ices_encoder_fini (data->encoder);
 
@@ -256,73 +366,72 @@ xmms_ices_close (xmms_output_t *output)
 	data = xmms_output_private_data_get (output);
 	g_return_if_fail (data);
 
-	if (!data->encoder) {
-		shout_close (data->shout);
-		return;
-	}
-
-	xmms_ices_flush_internal (data);
+	xmms_encode_worker_control (data->worker, ICES_CMD_CLOSE, NULL, NULL);
+	xmms_encode_worker_drain (data->worker);
 
 	shout_close (data->shout);
-
-	xmms_ices_encoder_fini (data->encoder);
-	data->encoder = NULL;
 }
 
 static void
 xmms_ices_flush (xmms_output_t *output)
 {
+	xmms_ices_data_t *data;
+	g_return_if_fail (output);
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	xmms_encode_worker_discard (data->worker);
+}
+
+/* What is queued for the encoder hasn't reached the listeners yet. */
+static guint
+xmms_ices_latency_get (xmms_output_t *output)
+{
+	xmms_ices_data_t *data;
+	g_return_val_if_fail (output, 0);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, 0);
+
+	return xmms_encode_worker_backlog (data->worker);
 }
 
 static gboolean
 xmms_ices_format_set (xmms_output_t *output, const xmms_stream_type_t *format)
 {
 	xmms_ices_data_t *data;
+	xmms_ices_format_t *fmt;
 	xmms_config_property_t *val;
-	xmms_medialib_entry_t entry;
+	gint64 limit;
 
 	g_return_val_if_fail (output, FALSE);
 	data = xmms_output_private_data_get (output);
 	g_return_val_if_fail (data, FALSE);
 
-	if (data->encoder)
-		xmms_ices_flush_internal (data);
-
-	/* Set the Vorbis comment to the current track metadata. */
-	vorbis_comment_clear (&data->vc);
-	vorbis_comment_init (&data->vc);
+	fmt = g_new0 (xmms_ices_format_t, 1);
+	fmt->entry = xmms_output_current_id (output);
 
-	entry = xmms_output_current_id (output);
-	xmms_ices_update_comment (entry, &data->vc);
-
-	/* If there is no encoder around, we need to build one. */
-	if (!data->encoder) {
-		int minbr, nombr, maxbr;
-
-		val = xmms_output_config_lookup (output, "encodingnombr");
-		nombr = xmms_config_property_get_int (val);
-		val = xmms_output_config_lookup (output, "encodingminbr");
-		minbr = xmms_config_property_get_int (val);
-		val = xmms_output_config_lookup (output, "encodingmaxbr");
-		maxbr = xmms_config_property_get_int (val);
-
-		data->encoder = xmms_ices_encoder_init (minbr, nombr, maxbr);
-		if (!data->encoder)
-			return FALSE;
-	}
+	val = xmms_output_config_lookup (output, "encodingnombr");
+	fmt->nombr = xmms_config_property_get_int (val);
+	val = xmms_output_config_lookup (output, "encodingminbr");
+	fmt->minbr = xmms_config_property_get_int (val);
+	val = xmms_output_config_lookup (output, "encodingmaxbr");
+	fmt->maxbr = xmms_config_property_get_int (val);
 
 	/* Get this stream's data and fire up the encoder. */
-	data->rate = xmms_stream_type_get_int (format,
-	                                       XMMS_STREAM_TYPE_FMT_SAMPLERATE);
-	data->channels = xmms_stream_type_get_int (format,
-	                                           XMMS_STREAM_TYPE_FMT_CHANNELS);
+	fmt->rate = xmms_stream_type_get_int (format,
+	                                      XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	fmt->channels = xmms_stream_type_get_int (format,
+	                                          XMMS_STREAM_TYPE_FMT_CHANNELS);
 
 	XMMS_DBG ("Setting format to rate: %i, channels: %i",
-	          data->rate,
-	          data->channels);
+	          fmt->rate, fmt->channels);
 
-	xmms_ices_encoder_stream_change (data->encoder, data->rate, data->channels,
-	                                 &data->vc);
+	xmms_encode_worker_control (data->worker, ICES_CMD_FORMAT, fmt, g_free);
+
+	val = xmms_output_config_lookup (output, "max_backlog_ms");
+	limit = xmms_sample_ms_to_bytes (format,
+	                                 MAX (xmms_config_property_get_int (val), 0));
+	xmms_encode_worker_limit_set (data->worker, limit);
 
 	return TRUE;
 }
@@ -336,14 +445,7 @@ xmms_ices_write (xmms_output_t *output, gpointer buffer,
 	data = xmms_output_private_data_get (output);
 	g_return_if_fail (data);
 
-	if (!data->encoder) {
-		xmms_error_set (err, XMMS_ERROR_GENERIC, "encoding is not initialized");
-		return;
-	}
-
-	xmms_ices_encoder_input (data->encoder, buffer, len);
-
-	xmms_ices_send_shout (data, err);
+	xmms_encode_worker_write (data->worker, buffer, len, err);
 }
 
 static void
@@ -379,22 +481,13 @@ static void
 on_playlist_entry_changed (xmms_object_t *object, xmmsv_t *arg, gpointer udata)
 {
 	xmms_ices_data_t * data = udata;
-	xmms_medialib_entry_t entry;
+	xmms_medialib_entry_t *entry;
 
-	if (!xmmsv_get_int (arg, &entry))
+	entry = g_new (xmms_medialib_entry_t, 1);
+	if (!xmmsv_get_int (arg, entry)) {
+		g_free (entry);
 		return;
+	}
 
-	if (data->encoder)
-		xmms_ices_flush_internal (data);
-
-	vorbis_comment_clear (&data->vc);
-	vorbis_comment_init (&data->vc);
-
-	xmms_ices_update_comment (entry, &data->vc);
-
-	XMMS_DBG ("Updating comment");
-
-	xmms_ices_encoder_stream_change (data->encoder, data->rate, data->channels,
-	                                 &data->vc);
-
+	xmms_encode_worker_control (data->worker, ICES_CMD_TRACK, entry, g_free);
 }
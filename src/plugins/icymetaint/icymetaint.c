@@ -29,6 +29,18 @@
  * Type definitions
  */
 
+/* Radio streams can be read through a jitter buffer, filled by a
+ * worker before playback starts and again whenever it ran dry. The
+ * titles found by the worker are then ahead of what is played, they
+ * are queued with the stream position they start at and set when the
+ * reader gets there. Titles passed within one read are coalesced into
+ * the last of them.
+ */
+typedef struct {
+	guint64 pos;
+	gchar *title;
+} xmms_icymetaint_title_t;
+
 typedef struct {
 
 	guint bytes_since_meta, meta_offset;
@@ -38,6 +50,14 @@ typedef struct {
 
 	gint found_mp3_stream;
 
+	xmms_xform_render_t *render;
+	/** bytes rendered and read */
+	guint64 rendered, played;
+
+	/** guards titles, which the worker pushes and the reader pops */
+	GMutex mutex;
+	GQueue titles;
+
 	xmms_error_t status;
 } xmms_icymetaint_data_t;
 
@@ -48,8 +68,9 @@ typedef struct {
 static gboolean xmms_icymetaint_init (xmms_xform_t *xform);
 static void xmms_icymetaint_destroy (xmms_xform_t *xform);
 static gint xmms_icymetaint_read (xmms_xform_t *xform, void *buffer, gint len, xmms_error_t *error);
+static gint xmms_icymetaint_render (xmms_xform_t *xform, void *buffer, gint len, xmms_error_t *error);
 static gboolean xmms_icymetaint_plugin_setup (xmms_xform_plugin_t *xform_plugin);
-static void handle_shoutcast_metadata (xmms_xform_t *xform, gchar *metadata);
+static void handle_shoutcast_metadata (xmms_xform_t *xform, gchar *metadata, guint64 pos);
 
 /*
  * Plugin header
@@ -72,6 +93,10 @@ xmms_icymetaint_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
+	/* KiB of the stream buffered ahead, 0 reads it as it arrives */
+	xmms_xform_plugin_config_property_register (xform_plugin, "radio_buffer",
+	                                            "0", NULL, NULL);
+
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE,
 	                              "application/x-icy-stream",
@@ -88,7 +113,9 @@ static gboolean
 xmms_icymetaint_init (xmms_xform_t *xform)
 {
 	xmms_icymetaint_data_t *data;
+	xmms_config_property_t *cfg;
 	gint32 meta_offset;
+	gsize buffer = 0;
 	gboolean res;
 
 	g_return_val_if_fail (xform, FALSE);
@@ -103,6 +130,18 @@ xmms_icymetaint_init (xmms_xform_t *xform)
 	data->metabuffer = g_malloc (256 * 16);
 	data->meta_offset = meta_offset;
 
+	g_mutex_init (&data->mutex);
+	g_queue_init (&data->titles);
+
+	cfg = xmms_xform_config_lookup (xform, "radio_buffer");
+	if (cfg && xmms_config_property_get_int (cfg) > 0) {
+		buffer = (gsize) xmms_config_property_get_int (cfg) * 1024;
+	}
+
+	data->render = xmms_xform_render_new (xform, xmms_icymetaint_render,
+	                                      4096, buffer);
+	xmms_xform_render_prefill (data->render, buffer);
+
 	xmms_xform_outdata_type_add (xform,
 	                             XMMS_STREAM_TYPE_MIMETYPE,
 	                             "application/octet-stream",
@@ -123,13 +162,62 @@ xmms_icymetaint_destroy (xmms_xform_t *xform)
 	data = xmms_xform_private_data_get (xform);
 	g_return_if_fail (data);
 
+	/* stops the worker, nothing pushes titles after it */
+	xmms_xform_render_free (data->render);
+
+	while (!g_queue_is_empty (&data->titles)) {
+		xmms_icymetaint_title_t *title = g_queue_pop_head (&data->titles);
+		g_free (title->title);
+		g_free (title);
+	}
+	g_mutex_clear (&data->mutex);
+
 	g_free (data->metabuffer);
 
 	g_free (data);
 }
 
 static gint
-xmms_icymetaint_read (xmms_xform_t *xform, void *orig_ptr, gint orig_len, xmms_error_t *error)
+xmms_icymetaint_read (xmms_xform_t *xform, void *buffer, gint len, xmms_error_t *error)
+{
+	xmms_icymetaint_data_t *data;
+	gchar *current = NULL;
+	gint ret;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	ret = xmms_xform_render_read (data->render, buffer, len, error);
+	if (ret <= 0) {
+		return ret;
+	}
+
+	data->played += ret;
+
+	g_mutex_lock (&data->mutex);
+	while (!g_queue_is_empty (&data->titles)) {
+		xmms_icymetaint_title_t *title = g_queue_peek_head (&data->titles);
+		if (title->pos > data->played) {
+			break;
+		}
+		g_queue_pop_head (&data->titles);
+		g_free (current);
+		current = title->title;
+		g_free (title);
+	}
+	g_mutex_unlock (&data->mutex);
+
+	if (current) {
+		xmms_xform_metadata_set_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE,
+		                             current);
+		g_free (current);
+	}
+
+	return ret;
+}
+
+static gint
+xmms_icymetaint_render (xmms_xform_t *xform, void *orig_ptr, gint orig_len, xmms_error_t *error)
 {
 	xmms_icymetaint_data_t *data;
 	int bufferlen;
@@ -165,7 +253,8 @@ xmms_icymetaint_read (xmms_xform_t *xform, void *orig_ptr, gint orig_len, xmms_e
 				data->metabufferleft -= tlen;
 				data->metabufferpos += tlen;
 				if (!data->metabufferleft) {
-					handle_shoutcast_metadata (xform, data->metabuffer);
+					handle_shoutcast_metadata (xform, data->metabuffer,
+					                           data->rendered + bufferlen);
 					data->bytes_since_meta = 0;
 				}
 				len -= tlen;
@@ -221,31 +310,41 @@ xmms_icymetaint_read (xmms_xform_t *xform, void *orig_ptr, gint orig_len, xmms_e
 		   which would falsely indicate end-of-file */
 	} while (bufferlen == 0);
 
+	data->rendered += bufferlen;
+
 	return bufferlen;
 }
 
 static void
-handle_shoutcast_metadata (xmms_xform_t *xform, gchar *metadata)
+handle_shoutcast_metadata (xmms_xform_t *xform, gchar *metadata, guint64 pos)
 {
+	xmms_icymetaint_data_t *data;
 	gchar **tags;
 	guint i = 0;
 
 	g_return_if_fail (xform);
 	g_return_if_fail (metadata);
 
+	data = xmms_xform_private_data_get (xform);
+
 	XMMS_DBG ("metadata: %s", metadata);
 
 	tags = g_strsplit (metadata, ";", 0);
 	while (tags[i] != NULL && tags[i][0] != '\0') {
 		if (g_ascii_strncasecmp (tags[i], "StreamTitle=", 12) == 0) {
-			const gchar *metakey;
+			xmms_icymetaint_title_t *title;
 			gchar *raw;
 
 			raw = tags[i] + 13;
 			raw[strlen (raw) - 1] = '\0';
 
-			metakey = XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE;
-			xmms_xform_metadata_set_str (xform, metakey, raw);
+			title = g_new0 (xmms_icymetaint_title_t, 1);
+			title->pos = pos;
+			title->title = g_strdup (raw);
+
+			g_mutex_lock (&data->mutex);
+			g_queue_push_tail (&data->titles, title);
+			g_mutex_unlock (&data->mutex);
 		} else {
 			XMMS_DBG("Unhandled metadata tag: %s", tags[i]);
 		}
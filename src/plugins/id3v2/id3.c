@@ -53,6 +53,15 @@
 
 #define quad2long(a,b,c,d) ((a << 24) | (b << 16) | (c << 8) | (d))
 
+/* Tags are read from the stream in chunks of this size */
+#define ID3v2_STREAM_CHUNK 8192
+
+/* An APIC frame is skipped if the picture doesn't start within this */
+#define ID3v2_APIC_HEAD_MAX 1024
+
+/* Number of stored pictures remembered, see id3_picture_known */
+#define ID3v2_PICTURE_CACHE_MAX 1024
+
 
 /*
  * There are some different string-types.
@@ -530,6 +539,227 @@ handle_id3v2_apic (xmms_xform_t *xform, xmms_id3v2_header_t *head,
 	}
 }
 
+/*
+ * The hashes of pictures stored from APIC frames, keyed by the url,
+ * size and modification time of the file and the position of the
+ * frame, so a tag that hasn't changed doesn't need its picture read
+ * again on every chain setup.
+ */
+G_LOCK_DEFINE_STATIC (id3_pictures);
+static GHashTable *id3_pictures = NULL;
+
+/* An APIC frame read piece by piece, the picture is hashed and, when
+ * probing, stored as it is read. */
+typedef struct id3_picture_St {
+	xmms_xform_t *xform;
+	gchar *key;
+	GByteArray *head;
+	gboolean started;
+	gboolean done;
+	gchar *mime;
+	xmms_bindata_writer_t *writer;
+	GChecksum *md5;
+} id3_picture_t;
+
+static gchar *
+id3_picture_key (xmms_xform_t *xform, guint32 pos, guint32 size)
+{
+	const gchar *url;
+	gint filesize = -1, lmod;
+
+	/* without a modification time a changed file can't be told apart */
+	url = xmms_xform_get_url (xform);
+	if (!url || !xmms_xform_metadata_get_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD, &lmod)) {
+		return NULL;
+	}
+
+	xmms_xform_metadata_get_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, &filesize);
+
+	return g_strdup_printf ("%s:%d:%d:%u:%u", url, filesize, lmod, pos, size);
+}
+
+/* The hash of the stored picture of a frame, if it was read before */
+static gboolean
+id3_picture_known (const gchar *key, gchar hash[33])
+{
+	const gchar *val = NULL;
+
+	if (!key) {
+		return FALSE;
+	}
+
+	G_LOCK (id3_pictures);
+	if (id3_pictures) {
+		val = g_hash_table_lookup (id3_pictures, key);
+		if (val) {
+			g_strlcpy (hash, val, 33);
+		}
+	}
+	G_UNLOCK (id3_pictures);
+
+	return val && xmms_bindata_plugin_has (hash);
+}
+
+static void
+id3_picture_remember (const gchar *key, const gchar *hash)
+{
+	if (!key) {
+		return;
+	}
+
+	G_LOCK (id3_pictures);
+	if (!id3_pictures) {
+		id3_pictures = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                      g_free, g_free);
+	} else if (g_hash_table_size (id3_pictures) >= ID3v2_PICTURE_CACHE_MAX) {
+		g_hash_table_remove_all (id3_pictures);
+	}
+	g_hash_table_replace (id3_pictures, g_strdup (key), g_strdup (hash));
+	G_UNLOCK (id3_pictures);
+}
+
+/* Where the picture starts in the first len bytes of an APIC frame,
+ * 0 if more of it is needed and -1 if it can't be used */
+static gint
+id3_picture_offset (const guchar *buf, gsize len)
+{
+	const guchar *end = buf + len, *mime_end, *desc, *desc_end;
+
+	/* skip encoding */
+	if (len < 2) {
+		return 0;
+	}
+
+	mime_end = memchr (buf + 1, '\0', len - 1);
+	if (!mime_end || mime_end + 1 >= end) {
+		return 0;
+	}
+
+	if (mime_end[1] != 0x00 && mime_end[1] != 0x03) {
+		XMMS_DBG ("Picture type %02x not handled", mime_end[1]);
+		return -1;
+	}
+
+	/* XXX desc might be UCS2 and memchr will not do what we want */
+	desc = mime_end + 2;
+	desc_end = desc < end ? memchr (desc, '\0', end - desc) : NULL;
+	if (!desc_end || desc_end + 1 >= end) {
+		return 0;
+	}
+
+	return desc_end + 1 - buf;
+}
+
+static id3_picture_t *
+id3_picture_new (xmms_xform_t *xform, guint32 pos, guint32 size)
+{
+	id3_picture_t *pic;
+
+	pic = g_new0 (id3_picture_t, 1);
+	pic->xform = xform;
+	pic->key = id3_picture_key (xform, pos, size);
+	pic->head = g_byte_array_new ();
+
+	return pic;
+}
+
+static void
+id3_picture_set (id3_picture_t *pic, const gchar *hash)
+{
+	const gchar *metakey;
+
+	metakey = XMMS_MEDIALIB_ENTRY_PROPERTY_PICTURE_FRONT;
+	xmms_xform_metadata_set_str (pic->xform, metakey, hash);
+
+	metakey = XMMS_MEDIALIB_ENTRY_PROPERTY_PICTURE_FRONT_MIME;
+	xmms_xform_metadata_set_str (pic->xform, metakey, pic->mime);
+}
+
+/* Take the next bytes of the frame */
+static void
+id3_picture_feed (id3_picture_t *pic, const guchar *data, gsize len)
+{
+	if (pic->done) {
+		return;
+	}
+
+	if (!pic->started) {
+		gchar hash[33];
+		gint offset;
+
+		g_byte_array_append (pic->head, data, len);
+
+		offset = id3_picture_offset (pic->head->data, pic->head->len);
+		if (offset == 0 && pic->head->len > ID3v2_APIC_HEAD_MAX) {
+			XMMS_DBG ("Unable to read APIC frame, malformed tag?");
+			offset = -1;
+		}
+		if (offset <= 0) {
+			pic->done = offset < 0;
+			return;
+		}
+
+		pic->started = TRUE;
+		pic->mime = g_strdup ((const gchar *) pic->head->data + 1);
+
+		if (id3_picture_known (pic->key, hash)) {
+			XMMS_DBG ("Picture %s is already stored, skipping it", hash);
+			id3_picture_set (pic, hash);
+			pic->done = TRUE;
+			return;
+		}
+
+		/* only keep the picture when probing, else just look it up */
+		if (xmms_xform_is_probe (pic->xform)) {
+			pic->writer = xmms_bindata_plugin_writer_new ();
+		}
+		if (!pic->writer) {
+			pic->md5 = g_checksum_new (G_CHECKSUM_MD5);
+		}
+
+		data = pic->head->data + offset;
+		len = pic->head->len - offset;
+	}
+
+	if (pic->writer) {
+		xmms_bindata_plugin_writer_write (pic->writer, data, len);
+	} else {
+		g_checksum_update (pic->md5, data, len);
+	}
+}
+
+/* The frame has been read, complete is FALSE if it was cut short */
+static void
+id3_picture_free (id3_picture_t *pic, gboolean complete)
+{
+	gchar hash[33];
+	gboolean ok = FALSE;
+
+	if (pic->writer && !complete) {
+		xmms_bindata_plugin_writer_abort (pic->writer);
+	} else if (pic->writer) {
+		ok = xmms_bindata_plugin_writer_finish (pic->writer, hash);
+	} else if (pic->md5 && complete) {
+		g_strlcpy (hash, g_checksum_get_string (pic->md5), sizeof (hash));
+		ok = xmms_bindata_plugin_has (hash);
+	} else if (complete && !pic->started && !pic->done) {
+		XMMS_DBG ("Unable to read APIC frame, malformed tag?");
+	}
+
+	if (ok) {
+		id3_picture_set (pic, hash);
+		id3_picture_remember (pic->key, hash);
+	}
+
+	if (pic->md5) {
+		g_checksum_free (pic->md5);
+	}
+	g_byte_array_free (pic->head, TRUE);
+	g_free (pic->mime);
+	g_free (pic->key);
+	g_free (pic);
+}
+
 static void
 handle_id3v2_comm (xmms_xform_t *xform, xmms_id3v2_header_t *head,
                    const gchar *key, gchar *buf, gsize len)
@@ -836,3 +1066,238 @@ xmms_id3v2_parse (xmms_xform_t *xform,
 
 	return TRUE;
 }
+
+/* The part of a tag that is left to read from the xform */
+typedef struct xmms_id3v2_stream_St {
+	xmms_xform_t *xform;
+	guint32 pos;
+	guint32 left;
+} xmms_id3v2_stream_t;
+
+static gboolean
+id3_stream_read (xmms_id3v2_stream_t *s, guchar *buf, guint32 len)
+{
+	xmms_error_t err;
+	guint32 done = 0;
+
+	g_return_val_if_fail (len <= s->left, FALSE);
+
+	xmms_error_reset (&err);
+
+	while (done < len) {
+		gint ret = xmms_xform_read (s->xform, buf + done, len - done, &err);
+		if (ret <= 0) {
+			XMMS_DBG ("Couldn't read %u bytes of id3-data (%u)", len, done);
+			return FALSE;
+		}
+		done += ret;
+	}
+
+	s->pos += len;
+	s->left -= len;
+
+	return TRUE;
+}
+
+/* Seek past len bytes, or read them if the xform can't seek */
+static gboolean
+id3_stream_skip (xmms_id3v2_stream_t *s, guint32 len)
+{
+	guchar buf[ID3v2_STREAM_CHUNK];
+	xmms_error_t err;
+
+	g_return_val_if_fail (len <= s->left, FALSE);
+
+	xmms_error_reset (&err);
+
+	if (len > ID3v2_STREAM_CHUNK &&
+	    xmms_xform_seek (s->xform, len, XMMS_XFORM_SEEK_CUR, &err) != -1) {
+		s->pos += len;
+		s->left -= len;
+		return TRUE;
+	}
+
+	while (len > 0) {
+		guint32 n = MIN (len, ID3v2_STREAM_CHUNK);
+		if (!id3_stream_read (s, buf, n)) {
+			return FALSE;
+		}
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/* Read len bytes of a frame into body or pic, skip them if neither
+ * wants them */
+static gboolean
+id3_stream_copy (xmms_id3v2_stream_t *s, guint32 len, GByteArray *body,
+                 id3_picture_t *pic)
+{
+	guchar buf[ID3v2_STREAM_CHUNK];
+
+	while (len > 0) {
+		guint32 n;
+
+		if (!body && (!pic || pic->done)) {
+			return id3_stream_skip (s, len);
+		}
+
+		/* give a picture a chance to be skipped early */
+		n = MIN (len, pic && !pic->started ? ID3v2_APIC_HEAD_MAX : ID3v2_STREAM_CHUNK);
+		if (!id3_stream_read (s, buf, n)) {
+			return FALSE;
+		}
+
+		if (body) {
+			g_byte_array_append (body, buf, n);
+		} else {
+			id3_picture_feed (pic, buf, n);
+		}
+
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Parse an ID3v2 tag frame by frame while reading it from the xform,
+ * picking up at the end of the header. Frames that aren't handled are
+ * skipped, and APIC pictures are hashed and stored as they are read,
+ * so no more than one text frame is held in memory.
+ *
+ * Tags with the unsynchronisation flag are read whole and passed to
+ * #xmms_id3v2_parse, it has to be undone before they can be parsed.
+ *
+ * @returns FALSE if the tag couldn't be read, a broken tag is skipped.
+ */
+gboolean
+xmms_id3v2_parse_stream (xmms_xform_t *xform, xmms_id3v2_header_t *head)
+{
+	xmms_id3v2_stream_t s;
+	gboolean broken_version4_frame_size_hack = FALSE;
+	guint32 hlen = head->ver == 2 ? 6 : 10;
+
+	s.xform = xform;
+	s.pos = 0;
+	s.left = head->len;
+
+	if ((head->flags & ~ID3v2_HEADER_SUPPORTED_FLAGS) != 0) {
+		XMMS_DBG ("ID3v2 contain unsupported flags, skipping tag");
+		return id3_stream_skip (&s, s.left);
+	}
+
+	/* an unsynchronised tag has to be undone as a whole */
+	if (head->flags & ID3v2_HEADER_FLAGS_UNSYNC) {
+		guchar *buf = g_malloc (head->len);
+
+		if (!id3_stream_read (&s, buf, head->len)) {
+			g_free (buf);
+			return FALSE;
+		}
+
+		xmms_id3v2_parse (xform, buf, head);
+		g_free (buf);
+
+		return TRUE;
+	}
+
+	while (s.left > 0) {
+		guchar buf[10];
+		guint32 type, size, pos = s.pos;
+		guint flags;
+		GByteArray *body = NULL;
+		id3_picture_t *pic = NULL;
+		gboolean ok, broken = FALSE;
+
+		if (s.left < hlen) {
+			XMMS_DBG ("B0rken frame in ID3v2tag (len=%u)", s.left);
+			break;
+		}
+
+		if (!id3_stream_read (&s, buf, hlen)) {
+			return FALSE;
+		}
+
+		if (buf[0] == 0) { /* padding */
+			break;
+		}
+
+		if (head->ver == 2) {
+			type = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8);
+			size = (buf[3]<<16) | (buf[4]<<8) | buf[5];
+		} else {
+			type = (buf[0]<<24) | (buf[1]<<16) | (buf[2]<<8) | (buf[3]);
+			if (head->ver == 4 && !broken_version4_frame_size_hack) {
+				size = (buf[4]<<21) | (buf[5]<<14) | (buf[6]<<7) | (buf[7]);
+			} else {
+				size = (buf[4]<<24) | (buf[5]<<16) | (buf[6]<<8) | (buf[7]);
+			}
+		}
+
+		if (size > s.left) {
+			XMMS_DBG ("B0rken frame in ID3v2tag (size=%u,len=%u)", size, s.left + hlen);
+			break;
+		}
+
+		if (type == quad2long ('A','P','I','C')) {
+			pic = id3_picture_new (xform, pos, size);
+		} else if (buf[0] == 'T' || buf[0] == 'U' || buf[0] == 'C' ||
+		           (buf[0] == 'A' && head->ver != 2)) {
+			body = g_byte_array_sized_new (size);
+		}
+
+		ok = id3_stream_copy (&s, size, body, pic);
+
+		/* See xmms_id3v2_parse, the synchsafe size is tried first and
+		 * the plain one used from then on if the next frame doesn't
+		 * seem to fit. The plain size is never smaller, so the rest
+		 * of the frame just follows. */
+		if (ok && head->ver == 4 && !broken_version4_frame_size_hack && s.left >= 8) {
+			xmms_error_t err;
+			guchar next[8];
+			guint32 next_size, plain;
+
+			xmms_error_reset (&err);
+			if (xmms_xform_peek (xform, next, 8, &err) == 8) {
+				next_size = (next[4]<<21) | (next[5]<<14) | (next[6]<<7) | (next[7]);
+				if (next_size > s.left) {
+					XMMS_DBG ("Uho, seems like someone isn't using synchsafe integers here...");
+					broken_version4_frame_size_hack = TRUE;
+
+					plain = (buf[4]<<24) | (buf[5]<<16) | (buf[6]<<8) | (buf[7]);
+					if (plain - size > s.left) {
+						XMMS_DBG ("B0rken frame in ID3v2tag (size=%u,len=%u)", plain, s.left + size + hlen);
+						broken = TRUE;
+					} else {
+						ok = id3_stream_copy (&s, plain - size, body, pic);
+						size = plain;
+					}
+				}
+			}
+		}
+
+		if (body) {
+			if (ok && !broken) {
+				flags = head->ver == 2 ? 0 : buf[8] | buf[9];
+				handle_id3v2_text (xform, head, type, (gchar *) body->data, flags, size);
+			}
+			g_byte_array_free (body, TRUE);
+		}
+
+		if (pic) {
+			id3_picture_free (pic, ok && !broken);
+		}
+
+		if (!ok) {
+			return FALSE;
+		}
+
+		if (broken) {
+			break;
+		}
+	}
+
+	return id3_stream_skip (&s, s.left);
+}
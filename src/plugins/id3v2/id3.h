@@ -21,5 +21,6 @@ typedef struct xmms_id3v2_header_St {
 
 gboolean xmms_id3v2_is_header (guchar *, xmms_id3v2_header_t *);
 gboolean xmms_id3v2_parse (xmms_xform_t *xform, guchar *buf, xmms_id3v2_header_t *head);
+gboolean xmms_id3v2_parse_stream (xmms_xform_t *xform, xmms_id3v2_header_t *head);
 
 #endif
@@ -106,8 +106,6 @@ xmms_id3v2_init (xmms_xform_t *xform)
 	xmms_error_t err;
 	guchar hbuf[20];
 	gint filesize;
-	guchar *buf;
-	gint res;
 	const gchar *metakey;
 
 	xmms_error_reset (&err);
@@ -134,19 +132,10 @@ xmms_id3v2_init (xmms_xform_t *xform)
 		xmms_xform_metadata_set_int (xform, metakey, filesize - head.len);
 	}
 
-
-	buf = g_malloc (head.len);
-
-	res = xmms_xform_read (xform, buf, head.len, &err);
-	if (res != head.len) {
-		XMMS_DBG ("Couldn't read id3v2 %d bytes of id3-data data (%d)", head.len, res);
+	if (!xmms_id3v2_parse_stream (xform, &head)) {
 		return FALSE;
 	}
 
-	xmms_id3v2_parse (xform, buf, &head);
-
-	g_free (buf);
-
 	xmms_xform_outdata_type_add (xform,
 	                             XMMS_STREAM_TYPE_MIMETYPE,
 	                             "application/octet-stream",
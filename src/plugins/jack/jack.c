@@ -62,6 +62,7 @@ static gboolean xmms_jack_status (xmms_output_t *output, xmms_playback_status_t
 static void xmms_jack_flush (xmms_output_t *output);
 static gboolean xmms_jack_volume_set (xmms_output_t *output, const gchar *channel, guint volume);
 static gboolean xmms_jack_volume_get (xmms_output_t *output, const gchar **names, guint *values, guint *num_channels);
+static guint xmms_jack_latency_get (xmms_output_t *output);
 static int xmms_jack_process (jack_nframes_t frames, void *arg);
 static void xmms_jack_shutdown (void *arg);
 static void xmms_jack_error (const gchar *desc);
@@ -90,6 +91,7 @@ xmms_jack_plugin_setup (xmms_output_plugin_t *plugin)
 	methods.flush = xmms_jack_flush;
 	methods.volume_get = xmms_jack_volume_get;
 	methods.volume_set = xmms_jack_volume_set;
+	methods.latency_get = xmms_jack_latency_get;
 
 	xmms_output_plugin_methods_set (plugin, &methods);
 
@@ -197,6 +199,9 @@ xmms_jack_new (xmms_output_t *output)
 
 	xmms_output_private_data_set (output, data);
 
+	/* the process callback must not wait for the server */
+	xmms_output_pull_mode_set (output, TRUE);
+
 	if (!xmms_jack_connect (output)) {
 		g_mutex_clear (&data->volume_change);
 		g_free (data);
@@ -350,36 +355,28 @@ xmms_jack_process (jack_nframes_t frames, void *arg)
 
 	if (data->running) {
 		while (toread) {
-			gint t, avail;
+			gint t, got, off;
 
 			t = MIN (toread * CHANNELS * sizeof (xmms_samplefloat_t),
 			         sizeof (tbuf));
+			off = frames - toread;
 
-			avail = xmms_output_bytes_available (output);
-
-			if (avail < t) {
+			/* this runs in jack's realtime thread, so no waiting
+			 * and no logging; whatever is missing is silence */
+			got = xmms_output_pull (output, (gchar *)tbuf, t);
+			if (got < t) {
 				data->underruns++;
-				XMMS_DBG ("jack output underun number %d! Not enough bytes available. Wanted: %d Available: %d", data->underruns, t, avail);
-				break;
 			}
 
-			res = xmms_output_read (output, (gchar *)tbuf, t);
-
+			res = MAX (got, 0) / (CHANNELS * sizeof (xmms_samplefloat_t));
 			if (res <= 0) {
-				XMMS_DBG ("Output read returned %d unexpectedly", res);
 				break;
 			}
 
-			if (res < t) {
-				XMMS_DBG ("Less bytes read than expected. (Probably a ringbuffer hotspot)");
-			}
-
-			res /= CHANNELS * sizeof (xmms_samplefloat_t);
-
 			for (j = 0; j < CHANNELS; j++) {
 				if (data->new_volume_actual[j] == data->volume_actual[j]) {
 					for (i = 0; i < res; i++) {
-						buf[j][i] = (tbuf[i * CHANNELS + j] * data->volume_actual[j]);
+						buf[j][off + i] = (tbuf[i * CHANNELS + j] * data->volume_actual[j]);
 					}
 				} else {
 
@@ -413,7 +410,7 @@ xmms_jack_process (jack_nframes_t frames, void *arg)
 							}
 						}
 
-						buf[j][i] = (tbuf[i * CHANNELS + j] * data->volume_actual[j]);
+						buf[j][off + i] = (tbuf[i * CHANNELS + j] * data->volume_actual[j]);
 
 					}
 
@@ -424,14 +421,14 @@ xmms_jack_process (jack_nframes_t frames, void *arg)
 			}
 
 			toread -= res;
+			if (got < t) {
+				break;
+			}
 		}
 	}
 
 	if ((!data->running) || ((frames - toread) != frames)) {
 		/* fill rest of buffer with silence */
-		if (data->running) {
-			XMMS_DBG ("Silence for %d frames", toread);
-		}
 		for (j = 0; j < CHANNELS; j++) {
 			if (data->new_volume_actual[j] != data->volume_actual[j]) {
 				data->volume_actual[j] = data->new_volume_actual[j];
@@ -523,6 +520,28 @@ xmms_jack_volume_get (xmms_output_t *output, const gchar **names,
 }
 
 
+/* what has been pulled but not been heard yet */
+static guint
+xmms_jack_latency_get (xmms_output_t *output)
+{
+	xmms_jack_data_t *data;
+	jack_latency_range_t range;
+
+	g_return_val_if_fail (output, 0);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, 0);
+
+	if (!data->jack || data->error) {
+		return 0;
+	}
+
+	jack_port_get_latency_range (data->ports[0], JackPlaybackLatency, &range);
+
+	return (range.max + jack_get_buffer_size (data->jack)) *
+	       CHANNELS * sizeof (xmms_samplefloat_t);
+}
+
+
 static void
 xmms_jack_shutdown (void *arg)
 {
@@ -25,8 +25,10 @@
 #include <math.h>
 #include <glib.h>
 
-/* Macro to saturate signal */
-#define SAT(x) (short) (x>32767?32767:(x<-32768?-32768:x));
+#include "../mixing_common/mixing.c"
+
+/* frames mixed at a time */
+#define XMMS_KARAOKE_CHUNK 1024
 
 typedef struct {
 	gboolean enabled;
@@ -34,6 +36,7 @@ typedef struct {
 	/* samplerate and channels */
 	gint srate;
 	gint channels;
+	gboolean is_float;
 
 	/* effect level */
 	gint level;
@@ -45,6 +48,10 @@ typedef struct {
 	gdouble a, b, c;
 	/* saved filter values */
 	gdouble y1, y2;
+
+	/* a chunk of 16 bit input as floats, and its filtered mid */
+	gfloat *work;
+	gfloat *mid;
 } xmms_karaoke_data_t;
 
 static gboolean xmms_karaoke_plugin_setup (xmms_xform_plugin_t *xform_plugin);
@@ -53,6 +60,7 @@ static void xmms_karaoke_destroy (xmms_xform_t *xform);
 static void xmms_karaoke_config_changed (xmms_object_t *object, xmmsv_t *d, gpointer userdata);
 static gint xmms_karaoke_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                                xmms_error_t *err);
+static void xmms_karaoke_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len);
 static gint64 xmms_karaoke_seek (xmms_xform_t *xform, gint64 offset,
                                  xmms_xform_seek_mode_t whence,
                                  xmms_error_t *err);
@@ -76,6 +84,7 @@ xmms_karaoke_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	methods.init = xmms_karaoke_init;
 	methods.destroy = xmms_karaoke_destroy;
 	methods.read = xmms_karaoke_read;
+	methods.process = xmms_karaoke_process;
 	methods.seek = xmms_karaoke_seek;
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
@@ -99,6 +108,13 @@ xmms_karaoke_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	                              XMMS_SAMPLE_FORMAT_S16,
 	                              XMMS_STREAM_TYPE_END);
 
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE,
+	                              "audio/pcm",
+	                              XMMS_STREAM_TYPE_FMT_FORMAT,
+	                              XMMS_SAMPLE_FORMAT_FLOAT,
+	                              XMMS_STREAM_TYPE_END);
+
 	return TRUE;
 }
 
@@ -140,6 +156,11 @@ xmms_karaoke_init (xmms_xform_t *xform)
 
 	priv->srate = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
 	priv->channels = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	priv->is_float = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_FORMAT) == XMMS_SAMPLE_FORMAT_FLOAT;
+
+	/* allocated up front, nothing is on the audio thread */
+	priv->work = g_new (gfloat, XMMS_KARAOKE_CHUNK * priv->channels);
+	priv->mid = g_new (gfloat, XMMS_KARAOKE_CHUNK);
 
 	xmms_karaoke_update_coeffs (priv);
 	xmms_xform_outdata_type_copy (xform);
@@ -173,6 +194,8 @@ xmms_karaoke_destroy (xmms_xform_t *xform)
 	config = xmms_xform_config_lookup (xform, "width");
 	xmms_config_property_callback_remove (config, xmms_karaoke_config_changed, data);
 
+	g_free (data->work);
+	g_free (data->mid);
 	g_free (data);
 }
 
@@ -219,51 +242,92 @@ static gint
 xmms_karaoke_read (xmms_xform_t *xform, xmms_sample_t *buffer, gint len,
                    xmms_error_t *error)
 {
-	xmms_karaoke_data_t *data;
-	gint16 *buf = buffer;
-	gint l, r, nl, nr, out, tmp;
-	gdouble y;
-	gint i, ret;
+	gint ret;
 
 	g_return_val_if_fail (xform, -1);
 
-	data = xmms_xform_private_data_get (xform);
-	g_return_val_if_fail (data, -1);
-
 	ret = xmms_xform_read (xform, buffer, len, error);
-
-	if (!data->enabled || data->channels < 2 || ret <= 0) {
-		return ret;
+	if (ret > 0) {
+		xmms_karaoke_process (xform, buffer, ret);
 	}
 
-	for (i=0; i<(ret/2); i+=data->channels) {
-		/* get left and right inputs */
-		l = buf[i];
-		r = buf[i+1];
+	return ret;
+}
+
+/* The band filter of the mid signal, in 16 bit units whatever the
+ * format is. It feeds back, so it goes one sample at a time.
+ */
+static void
+xmms_karaoke_filter (xmms_karaoke_data_t *data, gfloat *mid, gint frames,
+                     gdouble unit)
+{
+	gdouble out, y;
+	gint i;
 
-		/* Do filtering */
-		tmp = (l+r) >> 1;
-		y = (data->a*tmp - data->b*data->y1) - data->c*data->y2;
+	for (i = 0; i < frames; i++) {
+		y = (data->a * mid[i] * unit - data->b * data->y1) - data->c * data->y2;
 		data->y2 = data->y1;
 		data->y1 = y;
 
 		/* filter mono signal */
-		out = (int) (y * (data->mono_level/10.0));
-		out = SAT (out);
-		out = (out*data->level) >> 5;
+		out = CLAMP (y * (data->mono_level / 10.0), -32768.0, 32767.0);
+		mid[i] = out * data->level / 32.0 / unit;
+	}
+}
+
+/* Cut the center of frames float frames: each channel less the other
+ * one by level, plus the filtered mid, mixed a chunk at a time.
+ */
+static void
+xmms_karaoke_cut (xmms_karaoke_data_t *data, gfloat *buf, gint frames,
+                  gdouble unit)
+{
+	gfloat k = data->level / 32.0;
+	const gfloat matrix[4] = { 1.0, -k, -k, 1.0 };
 
-		/* now cut the center! */
-		nl = l - ((r*data->level) >> 5) + out;
-		nr = r - ((l*data->level) >> 5) + out;
+	xmms_mixing_mid_side (buf, data->channels, data->mid, NULL, frames);
+	xmms_karaoke_filter (data, data->mid, frames, unit);
+	xmms_mixing_stereo_matrix (buf, data->channels, frames, matrix, data->mid);
+}
 
-		/* output filtered signal */
-		buf[i]   = SAT (nl);
-		buf[i+1] = SAT (nr);
+static void
+xmms_karaoke_process (xmms_xform_t *xform, xmms_sample_t *buffer, gint len)
+{
+	xmms_karaoke_data_t *data;
+	gint frames, done, n;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_if_fail (data);
+
+	if (!data->enabled || data->channels < 2) {
+		return;
 	}
 
-	return ret;
+	if (data->is_float) {
+		gfloat *buf = buffer;
+
+		/* without limiting the output */
+		frames = len / (sizeof (gfloat) * data->channels);
+		for (done = 0; done < frames; done += n) {
+			n = MIN (frames - done, XMMS_KARAOKE_CHUNK);
+			xmms_karaoke_cut (data, buf + done * data->channels, n, 32768.0);
+		}
+	} else {
+		gint16 *buf = buffer;
+
+		frames = len / (sizeof (gint16) * data->channels);
+		for (done = 0; done < frames; done += n) {
+			gint16 *chunk = buf + done * data->channels;
+
+			n = MIN (frames - done, XMMS_KARAOKE_CHUNK);
+			xmms_mixing_s16_to_float (chunk, data->work, n * data->channels, 1.0);
+			xmms_karaoke_cut (data, data->work, n, 1.0);
+			xmms_mixing_float_to_s16 (data->work, chunk, n * data->channels, 1.0);
+		}
+	}
 }
 
+
 static gint64
 xmms_karaoke_seek (xmms_xform_t *xform, gint64 offset,
                    xmms_xform_seek_mode_t whence, xmms_error_t *err)
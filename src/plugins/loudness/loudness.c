@@ -0,0 +1,201 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * Loudness, true peak and silence of whole tracks
+ */
+
+#include <xmms/xmms_xformplugin.h>
+#include <xmms/xmms_log.h>
+
+#include <glib.h>
+
+#include "loudness_meter.h"
+
+/* Like ofa this only runs in the mediainfo reader, which decodes
+ * resolved entries for it in the background, once. The replaygain
+ * plugin and the crossfade of the output use what it stores.
+ */
+
+typedef struct xmms_loudness_data_St {
+	xmms_loudness_meter_t *meter;
+	gint channels;
+	gint rate;
+	gboolean checked;
+	gboolean done;
+} xmms_loudness_data_t;
+
+static gboolean xmms_loudness_plugin_setup (xmms_xform_plugin_t *xform_plugin);
+static gboolean xmms_loudness_init (xmms_xform_t *xform);
+static void xmms_loudness_destroy (xmms_xform_t *xform);
+static gint xmms_loudness_read (xmms_xform_t *xform, xmms_sample_t *buf,
+                                gint len, xmms_error_t *error);
+
+/*
+ * Plugin header
+ */
+
+XMMS_XFORM_PLUGIN_DEFINE ("loudness",
+                          "Loudness analysis",
+                          XMMS_VERSION,
+                          "EBU R128 loudness, true peak and silence",
+                          xmms_loudness_plugin_setup);
+
+static gboolean
+xmms_loudness_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+
+	methods.init = xmms_loudness_init;
+	methods.destroy = xmms_loudness_destroy;
+	methods.read = xmms_loudness_read;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE,
+	                              "audio/pcm",
+	                              XMMS_STREAM_TYPE_FMT_FORMAT,
+	                              XMMS_SAMPLE_FORMAT_S16,
+	                              XMMS_STREAM_TYPE_END);
+
+	/* what is quieter than this at either end counts as silence */
+	xmms_xform_plugin_config_property_register (xform_plugin, "silence_db",
+	                                            "-60", NULL, NULL);
+
+	return TRUE;
+}
+
+static gboolean
+xmms_loudness_init (xmms_xform_t *xform)
+{
+	xmms_config_property_t *cfg;
+	xmms_loudness_data_t *data;
+	gint silence_db = -60;
+
+	g_return_val_if_fail (xform, FALSE);
+
+	if (!xmms_xform_is_analysis (xform)) {
+		XMMS_DBG ("Loudness is analyzed in the background, not in playback");
+		return FALSE;
+	}
+
+	cfg = xmms_xform_config_lookup (xform, "silence_db");
+	if (cfg) {
+		silence_db = CLAMP (xmms_config_property_get_int (cfg), -120, 0);
+	}
+
+	data = g_new0 (xmms_loudness_data_t, 1);
+	data->channels = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	data->rate = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	data->meter = xmms_loudness_meter_new (data->channels, data->rate, silence_db);
+	if (!data->meter) {
+		g_free (data);
+		return FALSE;
+	}
+
+	xmms_xform_private_data_set (xform, data);
+
+	xmms_xform_outdata_type_copy (xform);
+
+	return TRUE;
+}
+
+static void
+xmms_loudness_destroy (xmms_xform_t *xform)
+{
+	xmms_loudness_data_t *data;
+
+	g_return_if_fail (xform);
+
+	data = xmms_xform_private_data_get (xform);
+
+	xmms_loudness_meter_free (data->meter);
+	g_free (data);
+}
+
+static void
+xmms_loudness_store (xmms_xform_t *xform, xmms_loudness_data_t *data)
+{
+	gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+	guint64 lead, trail;
+	gdouble lufs;
+
+	data->done = TRUE;
+
+	if (xmms_loudness_meter_integrated (data->meter, &lufs)) {
+		XMMS_DBG ("Integrated loudness %.2f LUFS", lufs);
+		g_ascii_formatd (buf, sizeof (buf), "%.2f", lufs);
+		xmms_xform_metadata_set_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LOUDNESS_TRACK, buf);
+		g_ascii_formatd (buf, sizeof (buf), "%f",
+		                 xmms_loudness_meter_true_peak (data->meter));
+		xmms_xform_metadata_set_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_TRUEPEAK_TRACK, buf);
+	}
+
+	if (xmms_loudness_meter_silence (data->meter, &lead, &trail)) {
+		xmms_xform_metadata_set_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_START,
+		                             lead * 1000 / data->rate);
+		xmms_xform_metadata_set_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_END,
+		                             trail * 1000 / data->rate);
+	}
+}
+
+/**
+ * Measure the whole stream and store the results at its end, or end
+ * it right away if the entry was measured already.
+ */
+static gint
+xmms_loudness_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                    xmms_error_t *error)
+{
+	xmms_loudness_data_t *data;
+	gint read;
+
+	g_return_val_if_fail (xform, -1);
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	if (!data->checked) {
+		gchar *lufs;
+
+		data->checked = TRUE;
+
+		lufs = xmms_xform_entry_property_get_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LOUDNESS_TRACK);
+		if (lufs) {
+			XMMS_DBG ("Entry already has its loudness, not measuring again");
+			g_free (lufs);
+			return 0;
+		}
+	} else if (data->done) {
+		return 0;
+	}
+
+	read = xmms_xform_read (xform, buf, len, error);
+
+	if (read > 0) {
+		/* the chain hands out whole frames */
+		xmms_loudness_meter_feed (data->meter, (const gint16 *) buf,
+		                          read / (2 * data->channels));
+	} else if (read == 0) {
+		xmms_loudness_store (xform, data);
+	}
+
+	return read;
+}
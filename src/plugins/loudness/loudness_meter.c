@@ -0,0 +1,322 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "loudness_meter.h"
+
+/* The samples are K-weighted, a high shelf followed by a high pass,
+ * and their energy summed over 100ms parts. Every four parts in a row
+ * make a 400ms gating block, so the blocks overlap by 75%. The true
+ * peak is the largest of the samples upsampled four times.
+ */
+
+#define BLOCK_PARTS 4
+#define GATE_ABSOLUTE -70.0
+#define GATE_RELATIVE -10.0
+
+#define TP_PHASES 4
+#define TP_TAPS 12
+
+typedef struct {
+	gdouble b0, b1, b2, a1, a2;
+} xmms_loudness_biquad_t;
+
+struct xmms_loudness_meter_St {
+	gint channels;
+
+	xmms_loudness_biquad_t shelf;
+	xmms_loudness_biquad_t highpass;
+	/** Two delays for each filter and channel */
+	gdouble *state;
+	gdouble *weights;
+
+	guint part_len;
+	guint part_pos;
+	gdouble part;
+	gdouble parts[BLOCK_PARTS];
+	guint nparts;
+	/** The mean energy of each gating block */
+	GArray *blocks;
+
+	gfloat taps[TP_PHASES][TP_TAPS];
+	/** The last TP_TAPS samples of each channel, twice over so they
+	    are always in a row in front of hist_pos */
+	gfloat *hist;
+	guint hist_pos;
+	gdouble peak;
+
+	gdouble threshold;
+	guint64 frames;
+	guint64 first;
+	guint64 last;
+	gboolean audible;
+};
+
+static gdouble
+sinc (gdouble x)
+{
+	return x == 0.0 ? 1.0 : sin (M_PI * x) / (M_PI * x);
+}
+
+xmms_loudness_meter_t *
+xmms_loudness_meter_new (gint channels, gint rate, gdouble silence_db)
+{
+	xmms_loudness_meter_t *meter;
+	gdouble f0, q, k, vh, vb, a0;
+	gint c, p, j;
+
+	g_return_val_if_fail (channels > 0, NULL);
+	g_return_val_if_fail (rate > 0, NULL);
+
+	meter = g_new0 (xmms_loudness_meter_t, 1);
+	meter->channels = channels;
+
+	/* the filters of ITU-R BS.1770, for any rate */
+	f0 = 1681.974450955533;
+	q = 0.7071752369554196;
+	k = tan (M_PI * f0 / rate);
+	vh = pow (10.0, 3.999843853973347 / 20.0);
+	vb = pow (vh, 0.4996667741545416);
+	a0 = 1.0 + k / q + k * k;
+	meter->shelf.b0 = (vh + vb * k / q + k * k) / a0;
+	meter->shelf.b1 = 2.0 * (k * k - vh) / a0;
+	meter->shelf.b2 = (vh - vb * k / q + k * k) / a0;
+	meter->shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+	meter->shelf.a2 = (1.0 - k / q + k * k) / a0;
+
+	f0 = 38.13547087602444;
+	q = 0.5003270373238773;
+	k = tan (M_PI * f0 / rate);
+	a0 = 1.0 + k / q + k * k;
+	meter->highpass.b0 = 1.0;
+	meter->highpass.b1 = -2.0;
+	meter->highpass.b2 = 1.0;
+	meter->highpass.a1 = 2.0 * (k * k - 1.0) / a0;
+	meter->highpass.a2 = (1.0 - k / q + k * k) / a0;
+
+	meter->state = g_new0 (gdouble, channels * 4);
+
+	/* front channels count once, surround ones more and the LFE of
+	 * a 5.1 stream not at all */
+	meter->weights = g_new (gdouble, channels);
+	for (c = 0; c < channels; c++) {
+		if (c < 3) {
+			meter->weights[c] = 1.0;
+		} else if (c == 3 && channels == 6) {
+			meter->weights[c] = 0.0;
+		} else {
+			meter->weights[c] = 1.41;
+		}
+	}
+
+	meter->part_len = MAX (rate / 10, 1);
+	meter->blocks = g_array_new (FALSE, FALSE, sizeof (gdouble));
+
+	/* a windowed sinc, phase 0 is the input sample itself */
+	for (p = 0; p < TP_PHASES; p++) {
+		for (j = 0; j < TP_TAPS; j++) {
+			gdouble t = TP_TAPS / 2 - j - (gdouble) p / TP_PHASES;
+			gdouble w = 0.5 * (1.0 + cos (M_PI * t / (TP_TAPS / 2 + 1)));
+			meter->taps[p][j] = sinc (t) * w;
+		}
+	}
+	meter->hist = g_new0 (gfloat, channels * TP_TAPS * 2);
+
+	meter->threshold = pow (10.0, silence_db / 20.0);
+
+	return meter;
+}
+
+void
+xmms_loudness_meter_free (xmms_loudness_meter_t *meter)
+{
+	g_return_if_fail (meter);
+
+	g_array_free (meter->blocks, TRUE);
+	g_free (meter->state);
+	g_free (meter->weights);
+	g_free (meter->hist);
+	g_free (meter);
+}
+
+static inline gdouble
+biquad_run (const xmms_loudness_biquad_t *f, gdouble *z, gdouble x)
+{
+	gdouble y = f->b0 * x + z[0];
+
+	z[0] = f->b1 * x - f->a1 * y + z[1];
+	z[1] = f->b2 * x - f->a2 * y;
+
+	return y;
+}
+
+static void
+xmms_loudness_meter_part_done (xmms_loudness_meter_t *meter)
+{
+	gdouble sum = 0.0;
+	gint i;
+
+	meter->parts[meter->nparts % BLOCK_PARTS] = meter->part;
+	meter->nparts++;
+	meter->part = 0.0;
+	meter->part_pos = 0;
+
+	if (meter->nparts < BLOCK_PARTS) {
+		return;
+	}
+
+	for (i = 0; i < BLOCK_PARTS; i++) {
+		sum += meter->parts[i];
+	}
+	sum /= BLOCK_PARTS * meter->part_len;
+	g_array_append_val (meter->blocks, sum);
+}
+
+static gdouble
+xmms_loudness_meter_peak (xmms_loudness_meter_t *meter, gint c, gfloat x)
+{
+	gfloat *hist = meter->hist + c * TP_TAPS * 2;
+	gdouble peak = 0.0;
+	gint p, j;
+
+	/* newest first */
+	hist[meter->hist_pos] = hist[meter->hist_pos + TP_TAPS] = x;
+
+	for (p = 0; p < TP_PHASES; p++) {
+		gfloat y = 0.0;
+		for (j = 0; j < TP_TAPS; j++) {
+			y += meter->taps[p][j] * hist[meter->hist_pos + j];
+		}
+		peak = MAX (peak, fabs (y));
+	}
+
+	return peak;
+}
+
+void
+xmms_loudness_meter_feed (xmms_loudness_meter_t *meter, const gint16 *buf,
+                          gint frames)
+{
+	gint i, c;
+
+	g_return_if_fail (meter);
+
+	for (i = 0; i < frames; i++) {
+		gboolean audible = FALSE;
+
+		meter->hist_pos = (meter->hist_pos + TP_TAPS - 1) % TP_TAPS;
+
+		for (c = 0; c < meter->channels; c++) {
+			gdouble x = *buf++ / 32768.0;
+			gdouble y;
+
+			meter->peak = MAX (meter->peak, xmms_loudness_meter_peak (meter, c, x));
+			audible |= fabs (x) > meter->threshold;
+
+			y = biquad_run (&meter->shelf, meter->state + c * 4, x);
+			y = biquad_run (&meter->highpass, meter->state + c * 4 + 2, y);
+			meter->part += meter->weights[c] * y * y;
+		}
+
+		if (audible) {
+			if (!meter->audible) {
+				meter->first = meter->frames;
+				meter->audible = TRUE;
+			}
+			meter->last = meter->frames;
+		}
+		meter->frames++;
+
+		if (++meter->part_pos == meter->part_len) {
+			xmms_loudness_meter_part_done (meter);
+		}
+	}
+}
+
+/**
+ * The loudness of what was fed so far in LUFS, gated. FALSE if it was
+ * too short or too quiet to tell.
+ */
+gboolean
+xmms_loudness_meter_integrated (xmms_loudness_meter_t *meter, gdouble *lufs)
+{
+	gdouble gate, sum;
+	guint i, n;
+
+	g_return_val_if_fail (meter, FALSE);
+
+	gate = pow (10.0, (GATE_ABSOLUTE + 0.691) / 10.0);
+	for (i = 0, n = 0, sum = 0.0; i < meter->blocks->len; i++) {
+		gdouble z = g_array_index (meter->blocks, gdouble, i);
+		if (z > gate) {
+			sum += z;
+			n++;
+		}
+	}
+	if (!n) {
+		return FALSE;
+	}
+
+	gate = MAX (gate, sum / n * pow (10.0, GATE_RELATIVE / 10.0));
+	for (i = 0, n = 0, sum = 0.0; i < meter->blocks->len; i++) {
+		gdouble z = g_array_index (meter->blocks, gdouble, i);
+		if (z > gate) {
+			sum += z;
+			n++;
+		}
+	}
+	if (!n) {
+		return FALSE;
+	}
+
+	*lufs = -0.691 + 10.0 * log10 (sum / n);
+
+	return TRUE;
+}
+
+/**
+ * The largest sample value of what was fed so far, between the
+ * samples too, where 1.0 is full scale.
+ */
+gdouble
+xmms_loudness_meter_true_peak (xmms_loudness_meter_t *meter)
+{
+	g_return_val_if_fail (meter, 0.0);
+
+	return meter->peak;
+}
+
+/**
+ * Frames of silence before the first and after the last sample above
+ * the threshold. FALSE if nothing was.
+ */
+gboolean
+xmms_loudness_meter_silence (xmms_loudness_meter_t *meter, guint64 *lead,
+                             guint64 *trail)
+{
+	g_return_val_if_fail (meter, FALSE);
+
+	if (!meter->audible) {
+		return FALSE;
+	}
+
+	*lead = meter->first;
+	*trail = meter->frames - meter->last - 1;
+
+	return TRUE;
+}
@@ -0,0 +1,35 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __LOUDNESS_METER_H__
+#define __LOUDNESS_METER_H__
+
+#include <glib.h>
+
+/**
+ * Integrated loudness as of EBU R128, true peak and the silence at
+ * both ends of a stream of 16 bit samples.
+ */
+typedef struct xmms_loudness_meter_St xmms_loudness_meter_t;
+
+xmms_loudness_meter_t *xmms_loudness_meter_new (gint channels, gint rate, gdouble silence_db);
+void xmms_loudness_meter_free (xmms_loudness_meter_t *meter);
+void xmms_loudness_meter_feed (xmms_loudness_meter_t *meter, const gint16 *buf, gint frames);
+gboolean xmms_loudness_meter_integrated (xmms_loudness_meter_t *meter, gdouble *lufs);
+gdouble xmms_loudness_meter_true_peak (xmms_loudness_meter_t *meter);
+gboolean xmms_loudness_meter_silence (xmms_loudness_meter_t *meter, guint64 *lead, guint64 *trail);
+
+#endif
@@ -39,6 +39,7 @@
 #include <ctype.h>
 
 #include "../mp3_common/id3v1.c"
+#include "../mp3_common/seekindex.c"
 
 /*
  * Type definitions
@@ -61,7 +62,14 @@ typedef struct xmms_mad_data_St {
 	gint64 samples_to_play;
 	gint frames_to_skip;
 
+	/* what the lame header told, for seeking */
+	gint start_delay;
+	gint64 total_samples;
+
 	xmms_xing_t *xing;
+
+	xmms_mp3_seekindex_t *seekindex;
+	gboolean seekindex_loaded;
 } xmms_mad_data_t;
 
 
@@ -110,6 +118,9 @@ xmms_mad_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin, "id3v1_enable",
 	                                            "1", NULL, NULL);
 
+	xmms_xform_plugin_config_property_register (xform_plugin, "seek_index",
+	                                            "0", NULL, NULL);
+
 	/* xmms_xform_indata_constraint_add */
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE,
@@ -145,10 +156,59 @@ xmms_mad_destroy (xmms_xform_t *xform)
 		xmms_xing_free (data->xing);
 	}
 
+	g_free (data->seekindex);
 	g_free (data);
 
 }
 
+/* Seek to the exact sample with the stored frame index */
+static gboolean
+xmms_mad_seek_indexed (xmms_xform_t *xform, xmms_mad_data_t *data,
+                       gint64 samples, xmms_error_t *err)
+{
+	xmms_mp3_seekindex_t *index = data->seekindex;
+	guint64 decoded, frame, first, start, offset, shift;
+
+	/* without a lame header the info frame is decoded as audio */
+	shift = (index->has_info_frame && data->total_samples < 0) ? 1 : 0;
+
+	decoded = samples + data->start_delay;
+	frame = decoded / index->samples_per_frame;
+	if (frame < shift) {
+		return FALSE;
+	}
+
+	/* start a few frames early, for the bit reservoir to fill up */
+	first = frame - shift;
+	first = first > 2 ? first - 2 : 0;
+
+	xmms_mp3_seekindex_lookup (index, first, &start, &offset);
+
+	XMMS_DBG ("Seek %" G_GINT64_FORMAT " samples -> frame %" G_GUINT64_FORMAT
+	          " at %" G_GUINT64_FORMAT " bytes", samples, start, offset);
+
+	if (xmms_xform_seek (xform, offset, XMMS_XFORM_SEEK_SET, err) == -1) {
+		return FALSE;
+	}
+
+	/* forget what was buffered from before */
+	mad_stream_finish (&data->stream);
+	mad_stream_init (&data->stream);
+	data->buffer_length = 0;
+	mad_stream_buffer (&data->stream, data->buffer, 0);
+	data->synthpos = 0x7fffffff;
+
+	data->frames_to_skip = frame - shift - start;
+	data->samples_to_skip = decoded - frame * index->samples_per_frame;
+	if (data->total_samples >= 0) {
+		data->samples_to_play = MAX (0, data->total_samples - samples);
+	} else {
+		data->samples_to_play = -1;
+	}
+
+	return TRUE;
+}
+
 static gint64
 xmms_mad_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t whence, xmms_error_t *err)
 {
@@ -161,6 +221,15 @@ xmms_mad_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t whenc
 
 	data = xmms_xform_private_data_get (xform);
 
+	if (!data->seekindex_loaded) {
+		data->seekindex = xmms_mp3_seekindex_load (xform);
+		data->seekindex_loaded = TRUE;
+	}
+
+	if (data->seekindex && xmms_mad_seek_indexed (xform, data, samples, err)) {
+		return samples;
+	}
+
 	if (data->xing &&
 	    xmms_xing_has_flag (data->xing, XMMS_XING_FRAMES) &&
 	    xmms_xing_has_flag (data->xing, XMMS_XING_TOC)) {
@@ -241,6 +310,7 @@ xmms_mad_init (xmms_xform_t *xform)
 	}
 
 	data->samples_to_play = -1;
+	data->total_samples = -1;
 
 	data->xing = xmms_xing_parse (stream.anc_ptr);
 	if (data->xing) {
@@ -280,6 +350,8 @@ xmms_mad_init (xmms_xform_t *xform)
 			data->samples_to_skip = lame->start_delay;
 			data->samples_to_play = ((guint64) xmms_xing_get_frames (data->xing) * 1152ULL) -
 			                        lame->start_delay - lame->end_padding;
+			data->start_delay = lame->start_delay;
+			data->total_samples = data->samples_to_play;
 			XMMS_DBG ("Samples to skip in the beginning: %d, total: %" G_GINT64_FORMAT,
 			          data->samples_to_skip, data->samples_to_play);
 			/*
@@ -342,6 +414,8 @@ xmms_mad_init (xmms_xform_t *xform)
 	mad_frame_finish (&frame);
 	mad_stream_finish (&stream);
 
+	xmms_mp3_seekindex_build (xform);
+
 	return TRUE;
 }
 
@@ -418,6 +492,11 @@ xmms_mad_read (xmms_xform_t *xform, gpointer buf, gint len, xmms_error_t *err)
 			continue;
 		}
 
+		/* after seeking the first frames may lack their bit reservoir,
+		 * they still count as skipped */
+		if (data->stream.error == MAD_ERROR_BADDATAPTR && data->frames_to_skip) {
+			data->frames_to_skip--;
+		}
 
 		/* if there is no frame to decode stream more data */
 		if (data->stream.next_frame) {
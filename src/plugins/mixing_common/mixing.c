@@ -0,0 +1,348 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ *  Sample loops shared by the effects that mix channels or change
+ *  gain: conversion between 16 bit and float samples, mid and side of
+ *  stereo, channel matrices and gain ramps.
+ *
+ *  Included by the plugins using it, so everything is static. Where
+ *  the compiler has vector extensions, interleaved stereo and plain
+ *  sample runs go eight samples at a time, everything else and the
+ *  tails through the plain loops. Buffers don't have to be aligned.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <xmms/xmms_sample.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__ARM_NEON))
+#define HAVE_VECTOR_MIXING 1
+#endif
+
+#ifdef HAVE_VECTOR_MIXING
+
+typedef gint16 v8hi __attribute__ ((vector_size (16)));
+typedef gint32 v8si __attribute__ ((vector_size (32)));
+typedef gint64 v8di __attribute__ ((vector_size (64)));
+typedef gfloat v8sf __attribute__ ((vector_size (32)));
+typedef gdouble v8df __attribute__ ((vector_size (64)));
+
+#define VECTOR_LANES 8
+#define SPLAT(x) { x, x, x, x, x, x, x, x }
+
+/* the lanes of a where mask is set, and b elsewhere */
+#define SELECT(mask, a, b) (((a) & (mask)) | ((b) & ~(mask)))
+
+/* left and right swapped in four interleaved stereo frames */
+#if defined(__clang__) || __GNUC__ >= 12
+#define SWAP_PAIRS(x) __builtin_shufflevector (x, x, 1, 0, 3, 2, 5, 4, 7, 6)
+#else
+#define SWAP_PAIRS(x) __builtin_shuffle (x, (v8si) { 1, 0, 3, 2, 5, 4, 7, 6 })
+#endif
+
+#endif
+
+/**
+ * Convert len 16 bit samples to floats, multiplied by scale.
+ */
+static inline void
+xmms_mixing_s16_to_float (const gint16 *in, gfloat *out, gint len, gfloat scale)
+{
+	gint i = 0;
+
+#ifdef HAVE_VECTOR_MIXING
+	for (; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8hi x;
+		v8sf y;
+
+		memcpy (&x, &in[i], sizeof (x));
+		y = __builtin_convertvector (x, v8sf) * scale;
+		memcpy (&out[i], &y, sizeof (y));
+	}
+#endif
+
+	for (; i < len; i++) {
+		out[i] = in[i] * scale;
+	}
+}
+
+/**
+ * Convert len floats multiplied by scale to 16 bit samples, clipping
+ * to their range.
+ */
+static inline void
+xmms_mixing_float_to_s16 (const gfloat *in, gint16 *out, gint len, gfloat scale)
+{
+	gint i = 0;
+
+#ifdef HAVE_VECTOR_MIXING
+	const v8sf lo = SPLAT (XMMS_SAMPLES16_MIN);
+	const v8sf hi = SPLAT (XMMS_SAMPLES16_MAX);
+
+	for (; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8sf x;
+		v8si bits;
+		v8hi y;
+
+		memcpy (&x, &in[i], sizeof (x));
+		x *= scale;
+
+		/* clip on the bit patterns, the masks are not floats */
+		bits = SELECT (x < lo, (v8si) lo, (v8si) x);
+		x = (v8sf) bits;
+		bits = SELECT (x > hi, (v8si) hi, (v8si) x);
+
+		y = __builtin_convertvector ((v8sf) bits, v8hi);
+		memcpy (&out[i], &y, sizeof (y));
+	}
+#endif
+
+	for (; i < len; i++) {
+		gfloat x = in[i] * scale;
+		out[i] = CLAMP (x, XMMS_SAMPLES16_MIN, XMMS_SAMPLES16_MAX);
+	}
+}
+
+/**
+ * The mid, (L + R) / 2, and side, (L - R) / 2, of the first two of
+ * channels interleaved float channels. Either output may be NULL.
+ */
+static inline void
+xmms_mixing_mid_side (const gfloat *in, gint channels, gfloat *mid,
+                      gfloat *side, gint frames)
+{
+	gint i;
+
+	for (i = 0; i < frames; i++, in += channels) {
+		if (mid) {
+			mid[i] = (in[0] + in[1]) * 0.5f;
+		}
+		if (side) {
+			side[i] = (in[0] - in[1]) * 0.5f;
+		}
+	}
+}
+
+/**
+ * Mix the first two of channels interleaved float channels through a
+ * 2x2 matrix, L' = m[0] L + m[1] R and R' = m[2] L + m[3] R, adding
+ * add[frame] to both if add isn't NULL.
+ */
+static inline void
+xmms_mixing_stereo_matrix (gfloat *buf, gint channels, gint frames,
+                           const gfloat m[4], const gfloat *add)
+{
+	gint i = 0;
+
+#ifdef HAVE_VECTOR_MIXING
+	if (channels == 2) {
+		const v8sf same = { m[0], m[3], m[0], m[3], m[0], m[3], m[0], m[3] };
+		const v8sf cross = { m[1], m[2], m[1], m[2], m[1], m[2], m[1], m[2] };
+		const gint step = VECTOR_LANES / 2;
+
+		for (; i + step <= frames; i += step) {
+			v8sf x, y;
+
+			memcpy (&x, &buf[i * 2], sizeof (x));
+			y = x * same + SWAP_PAIRS (x) * cross;
+			if (add) {
+				const v8sf a = {
+					add[i], add[i], add[i + 1], add[i + 1],
+					add[i + 2], add[i + 2], add[i + 3], add[i + 3]
+				};
+				y += a;
+			}
+			memcpy (&buf[i * 2], &y, sizeof (y));
+		}
+	}
+#endif
+
+	for (buf += i * channels; i < frames; i++, buf += channels) {
+		gfloat l = buf[0], r = buf[1], a = add ? add[i] : 0.0f;
+
+		buf[0] = m[0] * l + m[1] * r + a;
+		buf[1] = m[2] * l + m[3] * r + a;
+	}
+}
+
+/**
+ * Mix interleaved float frames into another channel count, for up and
+ * downmixing. Output channel o is the sum of input channel i times
+ * matrix[o * in_channels + i]. in and out must not overlap.
+ */
+static inline void
+xmms_mixing_matrix (const gfloat *in, gint in_channels, gfloat *out,
+                    gint out_channels, const gfloat *matrix, gint frames)
+{
+	gint f, o, i;
+
+	for (f = 0; f < frames; f++, in += in_channels, out += out_channels) {
+		for (o = 0; o < out_channels; o++) {
+			const gfloat *row = matrix + o * in_channels;
+			gfloat sum = 0.0f;
+
+			for (i = 0; i < in_channels; i++) {
+				sum += row[i] * in[i];
+			}
+			out[o] = sum;
+		}
+	}
+}
+
+/**
+ * Split interleaved float frames into one plane of frames samples
+ * per channel, one after the other.
+ */
+static inline void
+xmms_mixing_deinterleave (const gfloat *in, gint channels, gfloat *planes,
+                          gint frames)
+{
+	gint f, c;
+
+	for (c = 0; c < channels; c++) {
+		gfloat *plane = planes + c * frames;
+
+		for (f = 0; f < frames; f++) {
+			plane[f] = in[f * channels + c];
+		}
+	}
+}
+
+/**
+ * Put planes of frames samples back together into interleaved frames.
+ */
+static inline void
+xmms_mixing_interleave (const gfloat *planes, gint channels, gfloat *out,
+                        gint frames)
+{
+	gint f, c;
+
+	for (c = 0; c < channels; c++) {
+		const gfloat *plane = planes + c * frames;
+
+		for (f = 0; f < frames; f++) {
+			out[f * channels + c] = plane[f];
+		}
+	}
+}
+
+/* dst = src * gain, or dst += src * gain with add */
+static inline void
+xmms_mixing_scale_add (gfloat *dst, const gfloat *src, gint len,
+                       gfloat gain, gboolean add)
+{
+	gint i = 0;
+
+#ifdef HAVE_VECTOR_MIXING
+	for (; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8sf x, y = SPLAT (0.0f);
+
+		memcpy (&x, &src[i], sizeof (x));
+		if (add) {
+			memcpy (&y, &dst[i], sizeof (y));
+		}
+		y += x * gain;
+		memcpy (&dst[i], &y, sizeof (y));
+	}
+#endif
+
+	for (; i < len; i++) {
+		dst[i] = (add ? dst[i] : 0.0f) + src[i] * gain;
+	}
+}
+
+/**
+ * The same mix as xmms_mixing_matrix on planar channels, as split by
+ * xmms_mixing_deinterleave. Each output is a run of whole planes
+ * scaled and added, skipping the coefficients that are zero, which
+ * is most of them in the usual matrices.
+ */
+static inline void
+xmms_mixing_matrix_planar (const gfloat *in, gint in_channels, gfloat *out,
+                           gint out_channels, const gfloat *matrix,
+                           gint frames)
+{
+	gint o, i;
+
+	for (o = 0; o < out_channels; o++) {
+		gfloat *dst = out + o * frames;
+		gboolean add = FALSE;
+
+		for (i = 0; i < in_channels; i++) {
+			gfloat gain = matrix[o * in_channels + i];
+
+			if (gain != 0.0f) {
+				xmms_mixing_scale_add (dst, in + i * frames, frames, gain, add);
+				add = TRUE;
+			}
+		}
+
+		if (!add) {
+			memset (dst, 0, frames * sizeof (gfloat));
+		}
+	}
+}
+
+/**
+ * Multiply interleaved float frames by a gain going linearly from
+ * from to to, reaching to at the last frame. Smooths gain changes.
+ */
+static inline void
+xmms_mixing_gain_ramp (gfloat *buf, gint channels, gint frames,
+                       gfloat from, gfloat to)
+{
+	gfloat step;
+	gint i, c;
+
+	if (frames <= 0) {
+		return;
+	}
+
+	step = (to - from) / frames;
+	for (i = 0; i < frames; i++, buf += channels) {
+		gfloat gain = from + step * (i + 1);
+
+		for (c = 0; c < channels; c++) {
+			buf[c] *= gain;
+		}
+	}
+}
+
+/**
+ * The same ramp for 16 bit frames, clipping to their range.
+ */
+static inline void
+xmms_mixing_gain_ramp_s16 (gint16 *buf, gint channels, gint frames,
+                           gfloat from, gfloat to)
+{
+	gfloat step;
+	gint i, c;
+
+	if (frames <= 0) {
+		return;
+	}
+
+	step = (to - from) / frames;
+	for (i = 0; i < frames; i++, buf += channels) {
+		gfloat gain = from + step * (i + 1);
+
+		for (c = 0; c < channels; c++) {
+			gfloat x = buf[c] * gain;
+			buf[c] = CLAMP (x, XMMS_SAMPLES16_MIN, XMMS_SAMPLES16_MAX);
+		}
+	}
+}
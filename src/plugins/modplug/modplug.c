@@ -45,14 +45,19 @@ typedef struct xmms_modplug_data_St {
 	ModPlug_Settings settings;
 	ModPlugFile *mod;
 	GString *buffer;
+	xmms_xform_render_t *render;
 } xmms_modplug_data_t;
 
+/* bytes rendered at a time when rendering ahead */
+#define MODPLUG_RENDER_CHUNK 4096
+
 /*
  * Function prototypes
  */
 
 static gboolean xmms_modplug_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gint xmms_modplug_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
+static gint xmms_modplug_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
 static void xmms_modplug_destroy (xmms_xform_t *xform);
 static gboolean xmms_modplug_init (xmms_xform_t *xform);
 static gint64 xmms_modplug_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t whence, xmms_error_t *error);
@@ -162,6 +167,10 @@ xmms_modplug_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 		                                            NULL, NULL);
 	}
 
+	/* milliseconds to render ahead of playback, 0 to render when read */
+	xmms_xform_plugin_config_property_register (xform_plugin, "render_ahead",
+	                                            "500", NULL, NULL);
+
 	return TRUE;
 }
 
@@ -177,6 +186,9 @@ xmms_modplug_destroy (xmms_xform_t *xform)
 	data = xmms_xform_private_data_get (xform);
 	g_return_if_fail (data);
 
+	if (data->render)
+		xmms_xform_render_free (data->render);
+
 	if (data->buffer)
 		g_string_free (data->buffer, TRUE);
 
@@ -207,7 +219,9 @@ xmms_modplug_seek (xmms_xform_t *xform, gint64 samples,
 
 	data = xmms_xform_private_data_get (xform);
 
+	xmms_xform_render_stop (data->render);
 	ModPlug_Seek (data->mod, (int) ((gdouble)1000 * samples / 44100));
+	xmms_xform_render_start (data->render);
 
 	return samples;
 }
@@ -286,6 +300,12 @@ xmms_modplug_init (xmms_xform_t *xform)
 	metakey = XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE;
 	xmms_xform_metadata_set_str (xform, metakey, ModPlug_GetName (data->mod));
 
+	cfgv = xmms_xform_config_lookup (xform, "render_ahead");
+	data->render = xmms_xform_render_new (xform, xmms_modplug_render,
+	                                      MODPLUG_RENDER_CHUNK,
+	                                      (gsize) MAX (0, xmms_config_property_get_int (cfgv)) *
+	                                      data->settings.mFrequency / 1000 * 4);
+
 	return TRUE;
 }
 
@@ -297,6 +317,16 @@ xmms_modplug_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error
 
 	data = xmms_xform_private_data_get (xform);
 
+	return xmms_xform_render_read (data->render, buf, len, err);
+}
+
+static gint
+xmms_modplug_render (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err)
+{
+	xmms_modplug_data_t *data;
+
+	data = xmms_xform_private_data_get (xform);
+
 	return ModPlug_Read (data->mod, buf, len);
 }
 
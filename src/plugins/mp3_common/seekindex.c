@@ -0,0 +1,340 @@
+/*  XMMS2 - X Music Multiplexer System
+ *
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+/**
+ *  Frame index of an MPEG audio stream
+ *
+ *  The offset of every XMMS_MP3_SEEKINDEX_STEP:th audio frame, so a
+ *  decoder can seek to an exact frame instead of guessing from the
+ *  bitrate or the Xing TOC. A leading Xing/Info frame is not counted
+ *  as an audio frame. The index is built by reading the whole stream
+ *  when the mediainfo reader probes a file, if the seek_index config
+ *  property of the plugin is set, and kept in bindata with its hash
+ *  in the XMMS_MP3_SEEKINDEX_KEY property of the entry.
+ */
+
+#include <glib.h>
+#include <string.h>
+#include <xmms/xmms_xformplugin.h>
+#include <xmms/xmms_bindata.h>
+#include <xmms/xmms_log.h>
+
+#define XMMS_MP3_SEEKINDEX_KEY "seekindex"
+#define XMMS_MP3_SEEKINDEX_MAGIC 0x58444953
+#define XMMS_MP3_SEEKINDEX_STEP 8
+#define XMMS_MP3_SEEKINDEX_BUFSIZE 65536
+
+/* longest frame is a 160kbit layer II frame at 8kHz */
+#define XMMS_MP3_MAX_FRAME 2881
+
+typedef struct xmms_mp3_seekindex_St {
+	guint32 magic;
+	guint32 samples_per_frame;
+	guint32 step;
+	guint32 has_info_frame;
+	guint64 frames;
+	guint64 count;
+	guint64 offsets[];
+} xmms_mp3_seekindex_t;
+
+typedef struct xmms_mp3_frame_St {
+	guint length;
+	guint samples;
+	guint samplerate;
+	guint side_info;
+} xmms_mp3_frame_t;
+
+static const guint16 mp3_bitrates[5][15] = {
+	/* MPEG 1 layer I, II, III */
+	{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+	{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+	/* MPEG 2 and 2.5 layer I, II and III */
+	{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+	{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+};
+
+static const guint mp3_samplerates[3] = { 44100, 48000, 32000 };
+
+/* Parse a frame header, FALSE if h doesn't start a frame */
+static gboolean
+xmms_mp3_frame_parse (const guchar *h, xmms_mp3_frame_t *frame)
+{
+	guint version, layer, bitrate, rate, padding, mono, table, mpeg1;
+
+	if (h[0] != 0xff || (h[1] & 0xe0) != 0xe0) {
+		return FALSE;
+	}
+
+	version = (h[1] >> 3) & 3;
+	layer = 4 - ((h[1] >> 1) & 3);
+	bitrate = h[2] >> 4;
+	rate = (h[2] >> 2) & 3;
+	padding = (h[2] >> 1) & 1;
+	mono = (h[3] >> 6) == 3;
+
+	if (version == 1 || layer == 4 || bitrate == 0 || bitrate == 15 || rate == 3) {
+		return FALSE;
+	}
+
+	mpeg1 = version == 3;
+	table = mpeg1 ? layer - 1 : (layer == 1 ? 3 : 4);
+
+	/* MPEG 2 halves the rates, MPEG 2.5 halves them again */
+	frame->samplerate = mp3_samplerates[rate] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+	bitrate = mp3_bitrates[table][bitrate] * 1000;
+
+	if (layer == 1) {
+		frame->samples = 384;
+		frame->length = (12 * bitrate / frame->samplerate + padding) * 4;
+	} else if (layer == 2 || mpeg1) {
+		frame->samples = 1152;
+		frame->length = 144 * bitrate / frame->samplerate + padding;
+	} else {
+		frame->samples = 576;
+		frame->length = 72 * bitrate / frame->samplerate + padding;
+	}
+
+	frame->side_info = 0;
+	if (layer == 3) {
+		frame->side_info = mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+		/* protected by a crc */
+		if (!(h[1] & 1)) {
+			frame->side_info += 2;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+xmms_mp3_frame_is_info (const guchar *h, const xmms_mp3_frame_t *frame)
+{
+	const guchar *tag = h + 4 + frame->side_info;
+
+	if (!frame->side_info || 4 + frame->side_info + 4 > frame->length) {
+		return FALSE;
+	}
+
+	return memcmp (tag, "Xing", 4) == 0 || memcmp (tag, "Info", 4) == 0;
+}
+
+/* Read the whole stream from the xform and index its frames */
+static xmms_mp3_seekindex_t *
+xmms_mp3_seekindex_scan (xmms_xform_t *xform)
+{
+	xmms_mp3_seekindex_t *index;
+	xmms_mp3_frame_t frame, next;
+	GArray *offsets;
+	guchar *buf;
+	guint64 base = 0, expect = 0, frames = 0;
+	guint32 samples = 0;
+	gboolean eos = FALSE, synced = FALSE, first = TRUE, info = FALSE;
+	gsize len = 0, pos = 0;
+
+	offsets = g_array_new (FALSE, FALSE, sizeof (guint64));
+	buf = g_malloc (XMMS_MP3_SEEKINDEX_BUFSIZE);
+
+	for (;;) {
+		/* keep room to look at the next frame too */
+		if (!eos && len - pos < 2 * XMMS_MP3_MAX_FRAME + 8) {
+			xmms_error_t err;
+			gint ret;
+
+			memmove (buf, buf + pos, len - pos);
+			base += pos;
+			len -= pos;
+			pos = 0;
+
+			xmms_error_reset (&err);
+			ret = xmms_xform_read (xform, buf + len,
+			                       XMMS_MP3_SEEKINDEX_BUFSIZE - len, &err);
+			if (ret < 0) {
+				goto err;
+			}
+			eos = ret == 0;
+			len += ret;
+		}
+
+		if (len - pos < 4) {
+			break;
+		}
+
+		if (!xmms_mp3_frame_parse (buf + pos, &frame) ||
+		    (synced && base + pos != expect)) {
+			synced = FALSE;
+			pos++;
+			continue;
+		}
+
+		/* a header out of sync only counts if the next one follows */
+		if (!synced && pos + frame.length + 4 <= len &&
+		    (!xmms_mp3_frame_parse (buf + pos + frame.length, &next) ||
+		     next.samplerate != frame.samplerate)) {
+			pos++;
+			continue;
+		}
+
+		if (pos + frame.length > len) {
+			break;
+		}
+
+		if (first) {
+			first = FALSE;
+			samples = frame.samples;
+			if (xmms_mp3_frame_is_info (buf + pos, &frame)) {
+				info = TRUE;
+				synced = TRUE;
+				expect = base + pos + frame.length;
+				pos += frame.length;
+				continue;
+			}
+		}
+
+		if (frame.samples != samples) {
+			XMMS_DBG ("Frame size changes, not indexing");
+			goto err;
+		}
+
+		if (frames % XMMS_MP3_SEEKINDEX_STEP == 0) {
+			guint64 offset = base + pos;
+			g_array_append_val (offsets, offset);
+		}
+
+		frames++;
+		synced = TRUE;
+		expect = base + pos + frame.length;
+		pos += frame.length;
+	}
+
+	g_free (buf);
+
+	if (!offsets->len) {
+		g_array_free (offsets, TRUE);
+		return NULL;
+	}
+
+	index = g_malloc (sizeof (xmms_mp3_seekindex_t) + offsets->len * sizeof (guint64));
+	index->magic = XMMS_MP3_SEEKINDEX_MAGIC;
+	index->samples_per_frame = samples;
+	index->step = XMMS_MP3_SEEKINDEX_STEP;
+	index->has_info_frame = info;
+	index->frames = frames;
+	index->count = offsets->len;
+	memcpy (index->offsets, offsets->data, offsets->len * sizeof (guint64));
+
+	g_array_free (offsets, TRUE);
+
+	return index;
+
+err:
+	g_free (buf);
+	g_array_free (offsets, TRUE);
+	return NULL;
+}
+
+static gsize
+xmms_mp3_seekindex_size (const xmms_mp3_seekindex_t *index)
+{
+	return sizeof (xmms_mp3_seekindex_t) + index->count * sizeof (guint64);
+}
+
+/**
+ * Index the stream and store the index for the entry, if enabled by
+ * the seek_index config property. Reads the whole stream, so it is
+ * only done when the chain is probed.
+ */
+static void
+xmms_mp3_seekindex_build (xmms_xform_t *xform)
+{
+	xmms_config_property_t *cfg;
+	xmms_mp3_seekindex_t *index;
+	xmms_error_t err;
+	gchar hash[33];
+	gint size;
+
+	cfg = xmms_xform_config_lookup (xform, "seek_index");
+	if (!cfg || !xmms_config_property_get_int (cfg)) {
+		return;
+	}
+
+	/* only files, not streams that never end */
+	if (!xmms_xform_is_probe (xform) ||
+	    !xmms_xform_metadata_get_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, &size) ||
+	    size <= 0) {
+		return;
+	}
+
+	/* the decoder may have read some already */
+	xmms_error_reset (&err);
+	if (xmms_xform_seek (xform, 0, XMMS_XFORM_SEEK_SET, &err) != 0) {
+		return;
+	}
+
+	index = xmms_mp3_seekindex_scan (xform);
+	if (!index) {
+		return;
+	}
+
+	if (xmms_bindata_plugin_add ((const guchar *) index,
+	                             xmms_mp3_seekindex_size (index), hash)) {
+		xmms_xform_metadata_set_str (xform, XMMS_MP3_SEEKINDEX_KEY, hash);
+	}
+
+	g_free (index);
+}
+
+/**
+ * Get the stored index of the entry, NULL if there is none.
+ */
+static xmms_mp3_seekindex_t *
+xmms_mp3_seekindex_load (xmms_xform_t *xform)
+{
+	xmms_mp3_seekindex_t *index;
+	gchar *hash;
+	gsize len = 0;
+
+	hash = xmms_xform_entry_property_get_str (xform, XMMS_MP3_SEEKINDEX_KEY);
+	if (!hash) {
+		return NULL;
+	}
+
+	index = (xmms_mp3_seekindex_t *) xmms_bindata_plugin_get (hash, &len);
+	g_free (hash);
+
+	if (index && (len < sizeof (xmms_mp3_seekindex_t) ||
+	              index->magic != XMMS_MP3_SEEKINDEX_MAGIC ||
+	              index->step == 0 || index->count == 0 ||
+	              len != xmms_mp3_seekindex_size (index))) {
+		XMMS_DBG ("Ignoring broken seek index");
+		g_free (index);
+		index = NULL;
+	}
+
+	return index;
+}
+
+/**
+ * Find the last indexed audio frame up to frame, and its offset.
+ */
+static void
+xmms_mp3_seekindex_lookup (const xmms_mp3_seekindex_t *index, guint64 frame,
+                           guint64 *start, guint64 *offset)
+{
+	guint64 i = MIN (frame / index->step, index->count - 1);
+
+	*start = i * index->step;
+	*offset = index->offsets[i];
+}
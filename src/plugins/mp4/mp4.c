@@ -38,7 +38,11 @@ typedef struct {
 	glong sampleid;
 	glong numsamples;
 
+	/* only the metadata has been parsed, see xmms_mp4_reopen */
+	gboolean meta_only;
+
 	guchar buffer[MP4_BUFFER_SIZE];
+	guint buffer_pos;
 	guint buffer_length;
 	guint buffer_size;
 
@@ -62,6 +66,7 @@ static gboolean xmms_mp4_gapless_try (xmms_xform_t *xform);
 static uint32_t xmms_mp4_read_callback (void *user_data, void *buffer, uint32_t length);
 static uint32_t xmms_mp4_seek_callback (void *user_data, uint64_t position);
 static int xmms_mp4_get_track (xmms_xform_t *xform, mp4ff_t *infile);
+static gboolean xmms_mp4_reopen (xmms_xform_t *xform);
 
 static const xmms_xform_metadata_basic_mapping_t basic_mappings[] = {
 	{ "album",                       XMMS_MEDIALIB_ENTRY_PROPERTY_ALBUM             },
@@ -225,7 +230,15 @@ xmms_mp4_init (xmms_xform_t *xform)
 	data->mp4ff_cb->seek = xmms_mp4_seek_callback;
 	data->mp4ff_cb->user_data = xform;
 
-	data->mp4ff = mp4ff_open_read (data->mp4ff_cb);
+	/* The mediainfo reader only wants the tags, skip the sample tables
+	 * and whatever else isn't needed for them until a sample is read.
+	 */
+	data->meta_only = xmms_xform_is_probe (xform);
+	if (data->meta_only) {
+		data->mp4ff = mp4ff_open_read_metaonly (data->mp4ff_cb);
+	} else {
+		data->mp4ff = mp4ff_open_read (data->mp4ff_cb);
+	}
 	if (!data->mp4ff) {
 		XMMS_DBG ("Error opening mp4 demuxer\n");
 		goto err;;
@@ -279,6 +292,11 @@ xmms_mp4_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *
 			return 0;
 		}
 
+		if (data->meta_only && !xmms_mp4_reopen (xform)) {
+			xmms_error_set (err, XMMS_ERROR_GENERIC, "Could not reopen MP4 file");
+			return -1;
+		}
+
 		bytes_read = mp4ff_read_sample (data->mp4ff, data->track,
 		                                data->sampleid, &tmpbuf,
 		                                &tmpbuflen);
@@ -320,6 +338,7 @@ xmms_mp4_seek (xmms_xform_t *xform, gint64 samples, xmms_xform_seek_mode_t whenc
 	}
 
 	data->sampleid = sampleid_candidate;
+	data->buffer_pos = 0;
 	data->buffer_length = 0;
 
 	g_string_erase (data->outbuf, 0, -1);
@@ -536,12 +555,13 @@ xmms_mp4_read_callback (void *user_data, void *buffer, uint32_t length)
 			return bytes_read;
 		}
 
+		data->buffer_pos = 0;
 		data->buffer_length += bytes_read;
 	}
 
 	ret = MIN (length, data->buffer_length);
-	memmove (buffer, data->buffer, ret);
-	memmove (data->buffer, data->buffer + ret, data->buffer_length - ret);
+	memcpy (buffer, data->buffer + data->buffer_pos, ret);
+	data->buffer_pos += ret;
 	data->buffer_length -= ret;
 
 	return ret;
@@ -565,12 +585,43 @@ xmms_mp4_seek_callback (void *user_data, uint64_t position)
 
 	/* If seeking was successfull, flush the internal buffer */
 	if (ret >= 0) {
+		data->buffer_pos = 0;
 		data->buffer_length = 0;
 	}
 
 	return ret;
 }
 
+/**
+ * Parse the whole file, once samples are read from a chain that was
+ * set up for the mediainfo reader. The track is found the same way,
+ * so the one already chosen is kept.
+ */
+static gboolean
+xmms_mp4_reopen (xmms_xform_t *xform)
+{
+	xmms_mp4_data_t *data;
+	mp4ff_t *mp4ff;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, FALSE);
+
+	if (xmms_mp4_seek_callback (xform, 0) != 0) {
+		return FALSE;
+	}
+
+	mp4ff = mp4ff_open_read (data->mp4ff_cb);
+	if (!mp4ff) {
+		return FALSE;
+	}
+
+	mp4ff_close (data->mp4ff);
+	data->mp4ff = mp4ff;
+	data->meta_only = FALSE;
+
+	return TRUE;
+}
+
 static int
 xmms_mp4_get_track (xmms_xform_t *xform, mp4ff_t *infile)
 {
@@ -265,17 +265,8 @@ int32_t mp4ff_read_stsz(mp4ff_t *f)
     f->track[f->total_tracks - 1]->stsz_sample_size = mp4ff_read_int32(f);
     f->track[f->total_tracks - 1]->stsz_sample_count = mp4ff_read_int32(f);
 
-    if (f->track[f->total_tracks - 1]->stsz_sample_size == 0)
-    {
-        int32_t i;
-        f->track[f->total_tracks - 1]->stsz_table =
-            (int32_t*)malloc(f->track[f->total_tracks - 1]->stsz_sample_count*sizeof(int32_t));
-
-        for (i = 0; i < f->track[f->total_tracks - 1]->stsz_sample_count; i++)
-        {
-            f->track[f->total_tracks - 1]->stsz_table[i] = mp4ff_read_int32(f);
-        }
-    }
+    /* the table is read when it is used */
+    f->track[f->total_tracks - 1]->stsz_table.offset = mp4ff_position(f);
 
     return 0;
 }
@@ -482,19 +473,12 @@ int32_t mp4ff_read_stsc(mp4ff_t *f)
 
 int32_t mp4ff_read_stco(mp4ff_t *f)
 {
-    int32_t i;
-
     mp4ff_read_char(f); /* version */
     mp4ff_read_int24(f); /* flags */
     f->track[f->total_tracks - 1]->stco_entry_count = mp4ff_read_int32(f);
 
-    f->track[f->total_tracks - 1]->stco_chunk_offset =
-        (int32_t*)malloc(f->track[f->total_tracks - 1]->stco_entry_count*sizeof(int32_t));
-
-    for (i = 0; i < f->track[f->total_tracks - 1]->stco_entry_count; i++)
-    {
-        f->track[f->total_tracks - 1]->stco_chunk_offset[i] = mp4ff_read_int32(f);
-    }
+    /* the table is read when it is used */
+    f->track[f->total_tracks - 1]->stco_chunk_offset.offset = mp4ff_position(f);
 
     return 0;
 }
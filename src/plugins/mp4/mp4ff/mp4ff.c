@@ -68,8 +68,7 @@ void mp4ff_close(mp4ff_t *ff)
     {
         if (ff->track[i])
         {
-            if (ff->track[i]->stsz_table)
-                free(ff->track[i]->stsz_table);
+            mp4ff_table_free(&ff->track[i]->stsz_table);
             if (ff->track[i]->stts_sample_count)
                 free(ff->track[i]->stts_sample_count);
             if (ff->track[i]->stts_sample_delta)
@@ -80,8 +79,7 @@ void mp4ff_close(mp4ff_t *ff)
                 free(ff->track[i]->stsc_samples_per_chunk);
             if (ff->track[i]->stsc_sample_desc_index)
                 free(ff->track[i]->stsc_sample_desc_index);
-            if (ff->track[i]->stco_chunk_offset)
-                free(ff->track[i]->stco_chunk_offset);
+            mp4ff_table_free(&ff->track[i]->stco_chunk_offset);
             if (ff->track[i]->decoderConfig)
                 free(ff->track[i]->decoderConfig);
 			if (ff->track[i]->ctts_sample_count)
@@ -124,7 +122,7 @@ static int need_parse_when_meta_only(uint8_t atom_type)
 	case ATOM_SCHI:
 //	case ATOM_STBL:
 //	case ATOM_STSD:
-	case ATOM_STTS:
+//	case ATOM_STTS:
 	case ATOM_STSZ:
 	case ATOM_STZ2:
 	case ATOM_STCO:
@@ -47,6 +47,9 @@ extern "C" {
 
 #define SUBATOMIC 128
 
+/* entries of a sample table read at a time */
+#define MP4FF_TABLE_CACHE 1024
+
 /* atoms without subatoms */
 #define ATOM_FTYP 129
 #define ATOM_MDAT 130
@@ -165,6 +168,16 @@ typedef struct
 } mp4ff_metadata_t;
 
 
+/* sample table read from the file when it is used, a block of
+ * MP4FF_TABLE_CACHE entries at a time */
+typedef struct
+{
+    int64_t offset;
+    int32_t first;
+    int32_t cached;
+    int32_t *cache;
+} mp4ff_table_t;
+
 typedef struct
 {
     int32_t type;
@@ -179,7 +192,7 @@ typedef struct
     /* stsz */
     int32_t stsz_sample_size;
     int32_t stsz_sample_count;
-    int32_t *stsz_table;
+    mp4ff_table_t stsz_table;
 
     /* stts */
     int32_t stts_entry_count;
@@ -194,7 +207,7 @@ typedef struct
 
     /* stsc */
     int32_t stco_entry_count;
-    int32_t *stco_chunk_offset;
+    mp4ff_table_t stco_chunk_offset;
 
     /* ctts */
     int32_t ctts_entry_count;
@@ -257,6 +270,8 @@ int64_t mp4ff_position(const mp4ff_t *f);
 int32_t mp4ff_set_position(mp4ff_t *f, const int64_t position);
 int32_t mp4ff_truncate(mp4ff_t * f);
 char * mp4ff_read_string(mp4ff_t * f,uint32_t length);
+int32_t mp4ff_table_get(mp4ff_t *f, mp4ff_table_t *table, const int32_t count, const int32_t index);
+void mp4ff_table_free(mp4ff_table_t *table);
 
 /* mp4atom.c */
 int32_t mp4ff_atom_get_size(const uint8_t *data);
@@ -279,11 +294,11 @@ int32_t mp4ff_atom_read(mp4ff_t *f, const int32_t size, const uint8_t atom_type)
 /* mp4sample.c */
 int32_t mp4ff_chunk_of_sample(const mp4ff_t *f, const int32_t track, const int32_t sample,
                               int32_t *chunk_sample, int32_t *chunk);
-int32_t mp4ff_chunk_to_offset(const mp4ff_t *f, const int32_t track, const int32_t chunk);
-int32_t mp4ff_sample_range_size(const mp4ff_t *f, const int32_t track,
+int32_t mp4ff_chunk_to_offset(mp4ff_t *f, const int32_t track, const int32_t chunk);
+int32_t mp4ff_sample_range_size(mp4ff_t *f, const int32_t track,
                                 const int32_t chunk_sample, const int32_t sample);
-int32_t mp4ff_sample_to_offset(const mp4ff_t *f, const int32_t track, const int32_t sample);
-int32_t mp4ff_audio_frame_size(const mp4ff_t *f, const int32_t track, const int32_t sample);
+int32_t mp4ff_sample_to_offset(mp4ff_t *f, const int32_t track, const int32_t sample);
+int32_t mp4ff_audio_frame_size(mp4ff_t *f, const int32_t track, const int32_t sample);
 int32_t mp4ff_set_sample_position(mp4ff_t *f, const int32_t track, const int32_t sample);
 
 #ifdef USE_TAGGING
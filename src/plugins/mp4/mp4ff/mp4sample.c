@@ -78,15 +78,17 @@ int32_t mp4ff_chunk_of_sample(const mp4ff_t *f, const int32_t track, const int32
     return 0;
 }
 
-int32_t mp4ff_chunk_to_offset(const mp4ff_t *f, const int32_t track, const int32_t chunk)
+int32_t mp4ff_chunk_to_offset(mp4ff_t *f, const int32_t track, const int32_t chunk)
 {
-    const mp4ff_track_t * p_track = f->track[track];
+    mp4ff_track_t * p_track = f->track[track];
 
     if (p_track->stco_entry_count && (chunk > p_track->stco_entry_count))
     {
-        return p_track->stco_chunk_offset[p_track->stco_entry_count - 1];
+        return mp4ff_table_get(f, &p_track->stco_chunk_offset, p_track->stco_entry_count,
+                               p_track->stco_entry_count - 1);
     } else if (p_track->stco_entry_count) {
-        return p_track->stco_chunk_offset[chunk - 1];
+        return mp4ff_table_get(f, &p_track->stco_chunk_offset, p_track->stco_entry_count,
+                               chunk - 1);
     } else {
         return 8;
     }
@@ -94,11 +96,11 @@ int32_t mp4ff_chunk_to_offset(const mp4ff_t *f, const int32_t track, const int32
     return 0;
 }
 
-int32_t mp4ff_sample_range_size(const mp4ff_t *f, const int32_t track,
+int32_t mp4ff_sample_range_size(mp4ff_t *f, const int32_t track,
                                 const int32_t chunk_sample, const int32_t sample)
 {
     int32_t i, total;
-    const mp4ff_track_t * p_track = f->track[track];
+    mp4ff_track_t * p_track = f->track[track];
 
     if (p_track->stsz_sample_size)
     {
@@ -110,14 +112,14 @@ int32_t mp4ff_sample_range_size(const mp4ff_t *f, const int32_t track,
 
         for(i = chunk_sample, total = 0; i < sample; i++)
         {
-            total += p_track->stsz_table[i];
+            total += mp4ff_table_get(f, &p_track->stsz_table, p_track->stsz_sample_count, i);
         }
     }
 
     return total;
 }
 
-int32_t mp4ff_sample_to_offset(const mp4ff_t *f, const int32_t track, const int32_t sample)
+int32_t mp4ff_sample_to_offset(mp4ff_t *f, const int32_t track, const int32_t sample)
 {
     int32_t chunk, chunk_sample, chunk_offset1, chunk_offset2;
 
@@ -129,16 +131,16 @@ int32_t mp4ff_sample_to_offset(const mp4ff_t *f, const int32_t track, const int3
     return chunk_offset2;
 }
 
-int32_t mp4ff_audio_frame_size(const mp4ff_t *f, const int32_t track, const int32_t sample)
+int32_t mp4ff_audio_frame_size(mp4ff_t *f, const int32_t track, const int32_t sample)
 {
     int32_t bytes;
-    const mp4ff_track_t * p_track = f->track[track];
+    mp4ff_track_t * p_track = f->track[track];
 
     if (p_track->stsz_sample_size)
     {
         bytes = p_track->stsz_sample_size;
     } else {
-        bytes = p_track->stsz_table[sample];
+        bytes = mp4ff_table_get(f, &p_track->stsz_table, p_track->stsz_sample_count, sample);
     }
 
     return bytes;
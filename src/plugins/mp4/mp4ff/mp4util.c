@@ -49,6 +49,59 @@ int32_t mp4ff_read_data(mp4ff_t *f, uint8_t *data, uint32_t size)
     return read;
 }
 
+/* entry index of a sample table, the block it is in is read first if
+ * it isn't the one cached, returns 0 if it can't be read */
+int32_t mp4ff_table_get(mp4ff_t *f, mp4ff_table_t *table, const int32_t count, const int32_t index)
+{
+    if (index < 0 || index >= count)
+        return 0;
+
+    if (index < table->first || index >= table->first + table->cached)
+    {
+        int64_t position = mp4ff_position(f);
+        uint8_t *data;
+        int32_t i, n;
+
+        if (!table->cache)
+        {
+            table->cache = (int32_t*)malloc(MP4FF_TABLE_CACHE*sizeof(int32_t));
+            if (!table->cache)
+                return 0;
+        }
+
+        table->first = index - index % MP4FF_TABLE_CACHE;
+        n = count - table->first;
+        if (n > MP4FF_TABLE_CACHE)
+            n = MP4FF_TABLE_CACHE;
+
+        mp4ff_set_position(f, table->offset + (int64_t)table->first*4);
+        n = mp4ff_read_data(f, (uint8_t*)table->cache, n*4) / 4;
+        mp4ff_set_position(f, position);
+
+        /* in place, each entry is converted after it is read */
+        data = (uint8_t*)table->cache;
+        for (i = 0; i < n; i++)
+        {
+            table->cache[i] = (data[4*i] << 24) | (data[4*i+1] << 16) |
+                              (data[4*i+2] << 8) | data[4*i+3];
+        }
+        table->cached = n;
+
+        if (index >= table->first + table->cached)
+            return 0;
+    }
+
+    return table->cache[index - table->first];
+}
+
+void mp4ff_table_free(mp4ff_table_t *table)
+{
+    if (table->cache)
+        free(table->cache);
+    table->cache = NULL;
+    table->cached = 0;
+}
+
 int32_t mp4ff_truncate(mp4ff_t * f)
 {
 	return f->stream->truncate(f->stream->user_data);
@@ -44,6 +44,7 @@
 #include <mpg123.h>
 
 #include "../mp3_common/id3v1.c"
+#include "../mp3_common/seekindex.c"
 
 #define BUFSIZE 4096
 
@@ -56,6 +57,9 @@ typedef struct xmms_mpg123_data_St {
 	gboolean eof_found;
 	gint filesize;
 
+	/* the stored frame index is handed to mpg123 on the first seek */
+	gboolean seekindex_loaded;
+
 	/* input data buffer */
 	guint8 buf[BUFSIZE];
 } xmms_mpg123_data_t;
@@ -108,6 +112,9 @@ xmms_mpg123_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin, "id3v1_enable",
 	                                            "1", NULL, NULL);
 
+	xmms_xform_plugin_config_property_register (xform_plugin, "seek_index",
+	                                            "0", NULL, NULL);
+
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE,
 	                              "audio/mpeg",
@@ -272,6 +279,9 @@ xmms_mpg123_init (xmms_xform_t *xform)
 	                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
 	                             (gint) data->samplerate,
 	                             XMMS_STREAM_TYPE_END);
+
+	xmms_mp3_seekindex_build (xform);
+
 	return TRUE;
 
 mpg123_bad:
@@ -358,6 +368,37 @@ xmms_mpg123_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
 	return (gint) read;
 }
 
+/* Give mpg123 the stored frame index, so it knows where every frame
+ * is without having read up to it. */
+static void
+xmms_mpg123_seekindex_set (xmms_xform_t *xform, xmms_mpg123_data_t *data)
+{
+#if MPG123_API_VERSION >= 29
+	xmms_mp3_seekindex_t *index;
+	off_t *offsets;
+	guint64 i;
+
+	index = xmms_mp3_seekindex_load (xform);
+	if (!index) {
+		return;
+	}
+
+	offsets = g_new (off_t, index->count);
+	for (i = 0; i < index->count; i++) {
+		offsets[i] = index->offsets[i];
+	}
+
+	if (mpg123_set_index (data->decoder, offsets, index->step,
+	                      index->count) != MPG123_OK) {
+		XMMS_DBG ("Couldn't set seek index: %s",
+		          mpg123_strerror (data->decoder));
+	}
+
+	g_free (offsets);
+	g_free (index);
+#endif
+}
+
 static gint64
 xmms_mpg123_seek (xmms_xform_t *xform, gint64 samples,
                   xmms_xform_seek_mode_t whence,
@@ -379,6 +420,11 @@ xmms_mpg123_seek (xmms_xform_t *xform, gint64 samples,
 		mwhence = SEEK_END;
 	}
 
+	if (!data->seekindex_loaded) {
+		xmms_mpg123_seekindex_set (xform, data);
+		data->seekindex_loaded = TRUE;
+	}
+
 	/* Get needed input position and possibly reached sample offset
 	 * from mpg123.
 	 */
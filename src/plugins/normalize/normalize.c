@@ -53,6 +53,8 @@ static gboolean xmms_normalize_init (xmms_xform_t *xform);
 static void xmms_normalize_destroy (xmms_xform_t *xform);
 static gint xmms_normalize_read (xmms_xform_t *xform, xmms_sample_t *buf,
                                  gint len, xmms_error_t *error);
+static void xmms_normalize_process (xmms_xform_t *xform, xmms_sample_t *buf,
+                                    gint len);
 static void xmms_normalize_config_changed (xmms_object_t *obj, xmmsv_t *value, gpointer udata);
 
 XMMS_XFORM_PLUGIN_DEFINE ("normalize",
@@ -72,6 +74,7 @@ xmms_normalize_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	methods.init = xmms_normalize_init;
 	methods.destroy = xmms_normalize_destroy;
 	methods.read = xmms_normalize_read;
+	methods.process = xmms_normalize_process;
 	methods.seek = xmms_xform_seek; /* we're not using this */
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
@@ -159,32 +162,39 @@ static gint
 xmms_normalize_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                      xmms_error_t *error)
 {
-	xmms_normalize_data_t *data;
 	gint read;
 
 	g_return_val_if_fail (xform, -1);
 
-	data = xmms_xform_private_data_get (xform);
-
 	read = xmms_xform_read (xform, buf, len, error);
 
 	if (read > 0) {
-		if (data->dirty) {
-			compress_reconfigure (data->compress,
-			                      data->use_anticlip,
-			                      data->target,
-			                      data->max_gain,
-			                      data->smooth,
-			                      data->buckets);
-			data->dirty = FALSE;
-		}
-
-		compress_do (data->compress, buf, read);
+		xmms_normalize_process (xform, buf, read);
 	}
 
 	return read;
 }
 
+static void
+xmms_normalize_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len)
+{
+	xmms_normalize_data_t *data;
+
+	data = xmms_xform_private_data_get (xform);
+
+	if (data->dirty) {
+		compress_reconfigure (data->compress,
+		                      data->use_anticlip,
+		                      data->target,
+		                      data->max_gain,
+		                      data->smooth,
+		                      data->buckets);
+		data->dirty = FALSE;
+	}
+
+	compress_do (data->compress, buf, len);
+}
+
 static void
 xmms_normalize_config_changed (xmms_object_t *obj, xmmsv_t *_value, gpointer udata)
 {
@@ -23,30 +23,21 @@
 #include <xmms/xmms_log.h>
 
 #include <glib.h>
+#include <string.h>
 
 #include "ofa1/ofa.h"
 
-typedef enum xmms_ofa_thread_state_E {
-	XMMS_OFA_WAIT = 0,
-	XMMS_OFA_CALCULATE,
-	XMMS_OFA_DONE,
-	XMMS_OFA_ABORT,
-} xmms_ofa_thread_state_t;
+/* Fingerprints are made by the mediainfo reader, which decodes the
+ * start of resolved entries for this plugin in the background. In a
+ * playback chain the plugin refuses to initialize, so it's skipped.
+ */
 
 typedef struct xmms_ofa_data_St {
 	unsigned char *buf;
 	int bytes_to_read;
 	int pos;
 
-	gboolean run_ofa;
-	gboolean done;
-
-	GMutex mutex;
-	GCond cond;
-	GThread *thread;
-	xmms_ofa_thread_state_t thread_state;
-
-	char *fp;
+	gboolean checked;
 } xmms_ofa_data_t;
 
 static gboolean xmms_ofa_plugin_setup (xmms_xform_plugin_t *xform_plugin);
@@ -54,11 +45,6 @@ static gboolean xmms_ofa_init (xmms_xform_t *xform);
 static void xmms_ofa_destroy (xmms_xform_t *xform);
 static gint xmms_ofa_read (xmms_xform_t *xform, xmms_sample_t *buf,
                                   gint len, xmms_error_t *error);
-static gint64 xmms_ofa_seek (xmms_xform_t *xform, gint64 samples,
-                                    xmms_xform_seek_mode_t whence,
-                                    xmms_error_t *error);
-
-static gpointer xmms_ofa_thread (gpointer arg);
 
 /*
  * Plugin header
@@ -80,7 +66,6 @@ xmms_ofa_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	methods.init = xmms_ofa_init;
 	methods.destroy = xmms_ofa_destroy;
 	methods.read = xmms_ofa_read;
-	methods.seek = xmms_ofa_seek;
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
@@ -95,46 +80,36 @@ xmms_ofa_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	                              44100,
 	                              XMMS_STREAM_TYPE_END);
 
+	/* how much of the start of a track the fingerprint is made of */
+	xmms_xform_plugin_config_property_register (xform_plugin, "seconds",
+	                                            "135", NULL, NULL);
+
 	return TRUE;
 }
 
 static gboolean
 xmms_ofa_init (xmms_xform_t *xform)
 {
+	xmms_config_property_t *cfg;
 	xmms_ofa_data_t *data;
-	char *fp;
+	gint seconds = 135;
 
 	g_return_val_if_fail (xform, FALSE);
 
-	data = g_new0 (xmms_ofa_data_t, 1);
-	g_return_val_if_fail (data, FALSE);
-
-	data->thread = g_thread_new ("x2 ofa calc", xmms_ofa_thread, data);
-	if (!data->thread) {
-		g_free (data);
+	if (!xmms_xform_is_analysis (xform)) {
+		XMMS_DBG ("Fingerprints are made in the background, not in playback");
 		return FALSE;
 	}
 
-	g_mutex_init (&data->mutex);
-	g_cond_init (&data->cond);
+	cfg = xmms_xform_config_lookup (xform, "seconds");
+	if (cfg) {
+		seconds = CLAMP (xmms_config_property_get_int (cfg), 10, 600);
+	}
 
-	data->bytes_to_read = 44100 * 135 * 4;
+	data = g_new0 (xmms_ofa_data_t, 1);
+	data->bytes_to_read = 44100 * seconds * 4;
 	data->buf = g_malloc (data->bytes_to_read);
 
-	/* TODO: #2482
-	entry = xmms_xform_entry_get (xform);
-	fp = xmms_medialib_entry_property_get_str (entry, "ofa_fingerprint");
-	*/
-	fp = NULL;
-	if (fp) {
-		XMMS_DBG ("Entry already has ofa_fingerprint, not recalculating");
-		/* keep it! */
-		xmms_xform_metadata_set_str (xform, "ofa_fingerprint", fp);
-		g_free (fp);
-	} else {
-		data->run_ofa = TRUE;
-	}
-
 	xmms_xform_private_data_set (xform, data);
 
 	xmms_xform_outdata_type_copy (xform);
@@ -150,21 +125,37 @@ xmms_ofa_destroy (xmms_xform_t *xform)
 
 	data = xmms_xform_private_data_get (xform);
 
-	g_mutex_lock (&data->mutex);
-	data->thread_state = XMMS_OFA_ABORT;
-	g_cond_signal (&data->cond);
-	g_mutex_unlock (&data->mutex);
-
-	g_thread_join (data->thread);
-	g_cond_clear (&data->cond);
-	g_mutex_clear (&data->mutex);
-
-	if (data->fp)
-		g_free (data->fp);
 	g_free (data->buf);
 	g_free (data);
 }
 
+static void
+xmms_ofa_calculate (xmms_xform_t *xform, xmms_ofa_data_t *data)
+{
+	const char *fp;
+
+	XMMS_DBG ("Calculating fingerprint... (will consume CPU)");
+
+	fp = ofa_create_print (data->buf,
+#if G_BYTE_ORDER == G_BIG_ENDIAN
+	                       OFA_BIG_ENDIAN,
+#else
+	                       OFA_LITTLE_ENDIAN,
+#endif
+	                       data->pos / 2,
+	                       44100,
+	                       1);
+
+	if (fp) {
+		XMMS_DBG ("Fingerprint calculated: %s", fp);
+		xmms_xform_metadata_set_str (xform, "ofa_fingerprint", fp);
+	}
+}
+
+/**
+ * Collect the start of the stream, and end it once there's enough of
+ * it for the fingerprint, or right away if the entry already has one.
+ */
 static gint
 xmms_ofa_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                       xmms_error_t *error)
@@ -177,83 +168,34 @@ xmms_ofa_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
-	read = xmms_xform_read (xform, buf, len, error);
+	if (!data->checked) {
+		gchar *fp;
 
-	if (data->run_ofa && read > 0 && data->pos < data->bytes_to_read) {
-		int l = MIN (data->bytes_to_read - data->pos, read);
-		memcpy (data->buf + data->pos, buf, l);
-		data->pos += l;
-		if (data->pos == data->bytes_to_read) {
-			g_mutex_lock (&data->mutex);
-			data->thread_state = XMMS_OFA_CALCULATE;
-			g_cond_signal (&data->cond);
-			g_mutex_unlock (&data->mutex);
-			data->run_ofa = FALSE;
-		}
-	} else if (data->pos == data->bytes_to_read){
-		if (!data->done) {
-			g_mutex_lock (&data->mutex);
-			if (data->thread_state == XMMS_OFA_DONE) {
-				xmms_xform_metadata_set_str (xform,
-				                             "ofa_fingerprint",
-				                             data->fp);
-				data->done = TRUE;
-			}
-			g_mutex_unlock (&data->mutex);
-		}
-	}
-
-	return read;
-}
+		data->checked = TRUE;
 
-static gint64
-xmms_ofa_seek (xmms_xform_t *xform, gint64 samples,
-                      xmms_xform_seek_mode_t whence, xmms_error_t *error)
-{
-	xmms_ofa_data_t *data;
-
-	data = xmms_xform_private_data_get (xform);
-
-	if (data->run_ofa) {
-		xmms_log_info ("Seeking requested, disabling ofa calculation!");
-		data->run_ofa = FALSE;
+		fp = xmms_xform_entry_property_get_str (xform, "ofa_fingerprint");
+		if (fp) {
+			XMMS_DBG ("Entry already has ofa_fingerprint, not recalculating");
+			g_free (fp);
+			return 0;
+		}
+	} else if (data->pos == data->bytes_to_read) {
+		return 0;
 	}
-	return xmms_xform_seek (xform, samples, whence, error);
-}
 
-static gpointer
-xmms_ofa_thread (gpointer arg)
-{
-	xmms_ofa_data_t *data = (xmms_ofa_data_t *)arg;
-	const char *fp;
+	read = xmms_xform_read (xform, buf, MIN (len, data->bytes_to_read - data->pos),
+	                        error);
 
-	g_mutex_lock (&data->mutex);
-	while (data->thread_state == XMMS_OFA_WAIT) {
-		g_cond_wait (&data->cond, &data->mutex);
-	}
-	if (data->thread_state == XMMS_OFA_ABORT) {
-		g_mutex_unlock (&data->mutex);
-		return NULL;
+	if (read > 0) {
+		memcpy (data->buf + data->pos, buf, read);
+		data->pos += read;
+		if (data->pos == data->bytes_to_read) {
+			xmms_ofa_calculate (xform, data);
+		}
+	} else if (read == 0 && data->pos > 0) {
+		/* shorter than the fingerprint is usually made of */
+		xmms_ofa_calculate (xform, data);
 	}
-	g_mutex_unlock (&data->mutex);
 
-	XMMS_DBG ("Calculating fingerprint... (will consume CPU)");
-
-	fp = ofa_create_print (data->buf,
-#if G_BYTE_ORDER == G_BIG_ENDIAN
-	                       OFA_BIG_ENDIAN,
-#else
-	                       OFA_LITTLE_ENDIAN,
-#endif
-	                       data->bytes_to_read/2,
-	                       44100,
-	                       1);
-
-	g_mutex_lock (&data->mutex);
-	data->thread_state = XMMS_OFA_DONE;
-	data->fp = g_strdup (fp);
-	g_mutex_unlock (&data->mutex);
-
-	XMMS_DBG ("Fingerprint calculated: %s", fp);
-	return NULL;
+	return read;
 }
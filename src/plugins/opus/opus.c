@@ -48,6 +48,7 @@ typedef struct xmms_opus_data_St {
 	const OpusTags *opustags;
 	gint current;
 	int channels;
+	gboolean is_float;
 } xmms_opus_data_t;
 
 /*
@@ -55,9 +56,8 @@ typedef struct xmms_opus_data_St {
  */
 
 static void xmms_opus_set_duration (xmms_xform_t *xform, guint dur);
-static gulong xmms_opus_op_read (OggOpusFile *of, gchar *buf, gint len,
-                                   gint bigendian, gint sampsize, gint signd,
-                                   gint *outbuf);
+static glong xmms_opus_op_read (OggOpusFile *of, gchar *buf, gint len,
+                                 gboolean is_float, gint *outbuf);
 static gboolean xmms_opus_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gint xmms_opus_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
 static gboolean xmms_opus_init (xmms_xform_t *decoder);
@@ -262,24 +262,24 @@ xmms_opus_init (xmms_xform_t *xform)
 
 	xmms_opus_read_metadata (xform, data);
 
-	/*
-	xmms_xform_outdata_type_add (xform,
-	                             XMMS_STREAM_TYPE_MIMETYPE,
-	                             "audio/pcm",
-	                             XMMS_STREAM_TYPE_FMT_FORMAT,
-	                             XMMS_SAMPLE_FORMAT_FLOAT,
-	                             XMMS_STREAM_TYPE_FMT_CHANNELS,
-	                             data->channels,
-	                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
-	                             48000,
-	                             XMMS_STREAM_TYPE_END);
-	*/
+	/* the decoder works in float, hand that on if nothing converts it */
+	data->is_float = xmms_xform_outdata_type_accepted (xform,
+	                                                   XMMS_STREAM_TYPE_MIMETYPE,
+	                                                   "audio/pcm",
+	                                                   XMMS_STREAM_TYPE_FMT_FORMAT,
+	                                                   XMMS_SAMPLE_FORMAT_FLOAT,
+	                                                   XMMS_STREAM_TYPE_FMT_CHANNELS,
+	                                                   data->channels,
+	                                                   XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+	                                                   48000,
+	                                                   XMMS_STREAM_TYPE_END);
 
 	xmms_xform_outdata_type_add (xform,
 	                             XMMS_STREAM_TYPE_MIMETYPE,
 	                             "audio/pcm",
 	                             XMMS_STREAM_TYPE_FMT_FORMAT,
-	                             XMMS_SAMPLE_FORMAT_S16,
+	                             data->is_float ? XMMS_SAMPLE_FORMAT_FLOAT
+	                                            : XMMS_SAMPLE_FORMAT_S16,
 	                             XMMS_STREAM_TYPE_FMT_CHANNELS,
 	                             data->channels,
 	                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
@@ -303,9 +303,7 @@ xmms_opus_read (xmms_xform_t *xform, gpointer buf, gint len,
 	g_return_val_if_fail (data, -1);
 
 	ret = xmms_opus_op_read (data->opusfile, (gchar *) buf, len,
-	                           G_BYTE_ORDER == G_BIG_ENDIAN,
-	                           xmms_sample_size_get (XMMS_SAMPLE_FORMAT_S16),
-	                           1, &c);
+	                         data->is_float, &c);
 
 	if (ret < 0) {
 		return -1;
@@ -348,23 +346,32 @@ xmms_opus_set_duration (xmms_xform_t *xform, guint dur)
 	                             dur * 1000);
 }
 
-static gulong
-xmms_opus_op_read (OggOpusFile *of, gchar *buf, gint len, gint bigendian,
-                     gint sampsize, gint signd, gint *outbuf)
+/* Read interleaved samples into buf, returning bytes */
+static glong
+xmms_opus_op_read (OggOpusFile *of, gchar *buf, gint len, gboolean is_float,
+                   gint *outbuf)
 {
-	gulong ret;
-	int channels;
+	gint sampsize;
+	glong ret;
 
-	channels = op_channel_count (of, -1);
+	if (is_float) {
+		sampsize = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_FLOAT);
+	} else {
+		sampsize = xmms_sample_size_get (XMMS_SAMPLE_FORMAT_S16);
+	}
 
-	do {								 /* FIXME buffer len / sample size */
-		//ret = op_read_float (of, (float *)buf, len / sizeof(float), outbuf);
-		ret = op_read (of, (opus_int16 *)buf, len / 2, outbuf);
+	/* the sizes are in samples of all channels, the result per channel */
+	do {
+		if (is_float) {
+			ret = op_read_float (of, (float *) buf, len / sampsize, outbuf);
+		} else {
+			ret = op_read (of, (opus_int16 *) buf, len / sampsize, outbuf);
+		}
 	} while (ret == OP_HOLE);
 
-	/* FIXME bytes from samples_read * channels * sample size */
-	//ret = ret * channels * sizeof(float);
-	ret = ret * channels * 2;
+	if (ret <= 0) {
+		return ret;
+	}
 
-	return ret;
+	return ret * op_channel_count (of, -1) * sampsize;
 }
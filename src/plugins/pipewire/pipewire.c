@@ -0,0 +1,554 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmms/xmms_outputplugin.h>
+#include <xmms/xmms_log.h>
+
+#include <math.h>
+#include <string.h>
+
+#include <glib.h>
+#include <pipewire/pipewire.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/props.h>
+
+/*
+ * Type definitions
+ */
+
+typedef struct xmms_pipewire_data_St {
+	struct pw_thread_loop *loop;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	gboolean connected;
+
+	/* read by the process callback */
+	gint running;
+	gint frame_size;
+	gint rate;
+
+	gint channels;
+	guint volume;
+} xmms_pipewire_data_t;
+
+
+/*
+ * Function prototypes
+ */
+
+static gboolean xmms_pipewire_plugin_setup (xmms_output_plugin_t *plugin);
+static gboolean xmms_pipewire_new (xmms_output_t *output);
+static void xmms_pipewire_destroy (xmms_output_t *output);
+static gboolean xmms_pipewire_status (xmms_output_t *output, xmms_playback_status_t status);
+static void xmms_pipewire_flush (xmms_output_t *output);
+static gboolean xmms_pipewire_format_set (xmms_output_t *output, const xmms_stream_type_t *format);
+static guint xmms_pipewire_latency_get (xmms_output_t *output);
+static gboolean xmms_pipewire_volume_set (xmms_output_t *output, const gchar *channel, guint volume);
+static gboolean xmms_pipewire_volume_get (xmms_output_t *output, const gchar **names, guint *values, guint *num_channels);
+static void xmms_pipewire_process (void *udata);
+static void xmms_pipewire_state_changed (void *udata, enum pw_stream_state old, enum pw_stream_state state, const char *error);
+static void xmms_pipewire_control_info (void *udata, uint32_t id, const struct pw_stream_control *control);
+
+static const struct pw_stream_events stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = xmms_pipewire_state_changed,
+	.control_info = xmms_pipewire_control_info,
+	.process = xmms_pipewire_process,
+};
+
+
+/*
+ * Plugin header
+ */
+
+XMMS_OUTPUT_PLUGIN_DEFINE ("pipewire", "PipeWire Output", XMMS_VERSION,
+                           "PipeWire output plugin",
+                           xmms_pipewire_plugin_setup);
+
+static gboolean
+xmms_pipewire_plugin_setup (xmms_output_plugin_t *plugin)
+{
+	xmms_output_methods_t methods;
+
+	XMMS_OUTPUT_METHODS_INIT (methods);
+
+	methods.new = xmms_pipewire_new;
+	methods.destroy = xmms_pipewire_destroy;
+	methods.status = xmms_pipewire_status;
+	methods.flush = xmms_pipewire_flush;
+	methods.format_set = xmms_pipewire_format_set;
+	methods.latency_get = xmms_pipewire_latency_get;
+	methods.volume_set = xmms_pipewire_volume_set;
+	methods.volume_get = xmms_pipewire_volume_get;
+
+	xmms_output_plugin_methods_set (plugin, &methods);
+
+	xmms_output_plugin_config_property_register (plugin, "name", "XMMS2",
+	                                             NULL, NULL);
+	xmms_output_plugin_config_property_register (plugin, "target", "",
+	                                             NULL, NULL);
+	/* the quantum asked for, PipeWire may pick another one */
+	xmms_output_plugin_config_property_register (plugin, "latency_ms", "10",
+	                                             NULL, NULL);
+
+	return TRUE;
+}
+
+
+/*
+ * Member functions
+ */
+
+static gboolean
+xmms_pipewire_new (xmms_output_t *output)
+{
+	xmms_pipewire_data_t *data;
+	const xmms_config_property_t *cv;
+	const gchar *name;
+
+	g_return_val_if_fail (output, FALSE);
+
+	pw_init (NULL, NULL);
+
+	data = g_new0 (xmms_pipewire_data_t, 1);
+	data->volume = 100;
+
+	data->loop = pw_thread_loop_new ("x2 pipewire", NULL);
+	if (!data->loop) {
+		xmms_log_error ("Couldn't create PipeWire thread");
+		g_free (data);
+		pw_deinit ();
+		return FALSE;
+	}
+
+	cv = xmms_output_config_lookup (output, "name");
+	name = xmms_config_property_get_string (cv);
+
+	data->stream = pw_stream_new_simple (pw_thread_loop_get_loop (data->loop),
+	                                     name,
+	                                     pw_properties_new (PW_KEY_MEDIA_TYPE, "Audio",
+	                                                        PW_KEY_MEDIA_CATEGORY, "Playback",
+	                                                        PW_KEY_MEDIA_ROLE, "Music",
+	                                                        PW_KEY_APP_NAME, name,
+	                                                        NULL),
+	                                     &stream_events, output);
+	if (!data->stream) {
+		xmms_log_error ("Couldn't create PipeWire stream");
+		pw_thread_loop_destroy (data->loop);
+		g_free (data);
+		pw_deinit ();
+		return FALSE;
+	}
+
+	xmms_output_private_data_set (output, data);
+
+	/* buffers are filled from PipeWire's realtime thread */
+	xmms_output_pull_mode_set (output, TRUE);
+	xmms_output_volume_events_set (output, TRUE);
+
+	if (pw_thread_loop_start (data->loop) < 0) {
+		xmms_log_error ("Couldn't start PipeWire thread");
+		pw_stream_destroy (data->stream);
+		pw_thread_loop_destroy (data->loop);
+		g_free (data);
+		pw_deinit ();
+		return FALSE;
+	}
+
+	/* PipeWire converts anything else itself */
+	xmms_output_stream_type_add (output,
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_FLOAT,
+	                             XMMS_STREAM_TYPE_END);
+	xmms_output_stream_type_add (output,
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S32,
+	                             XMMS_STREAM_TYPE_END);
+	xmms_output_stream_type_add (output,
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                             XMMS_STREAM_TYPE_END);
+	xmms_output_stream_type_add (output,
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_U8,
+	                             XMMS_STREAM_TYPE_END);
+
+	return TRUE;
+}
+
+
+static void
+xmms_pipewire_destroy (xmms_output_t *output)
+{
+	xmms_pipewire_data_t *data;
+
+	g_return_if_fail (output);
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	pw_thread_loop_lock (data->loop);
+	pw_stream_destroy (data->stream);
+	pw_thread_loop_unlock (data->loop);
+
+	pw_thread_loop_stop (data->loop);
+	pw_thread_loop_destroy (data->loop);
+
+	g_free (data);
+
+	pw_deinit ();
+}
+
+
+static gboolean
+xmms_pipewire_status (xmms_output_t *output, xmms_playback_status_t status)
+{
+	xmms_pipewire_data_t *data;
+	gboolean running;
+
+	g_return_val_if_fail (output, FALSE);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+
+	running = status == XMMS_PLAYBACK_STATUS_PLAY;
+	g_atomic_int_set (&data->running, running);
+
+	pw_thread_loop_lock (data->loop);
+	if (data->connected) {
+		pw_stream_set_active (data->stream, running);
+	}
+	pw_thread_loop_unlock (data->loop);
+
+	return TRUE;
+}
+
+
+static void
+xmms_pipewire_flush (xmms_output_t *output)
+{
+	xmms_pipewire_data_t *data;
+
+	g_return_if_fail (output);
+	data = xmms_output_private_data_get (output);
+	g_return_if_fail (data);
+
+	pw_thread_loop_lock (data->loop);
+	if (data->connected) {
+		pw_stream_flush (data->stream, false);
+	}
+	pw_thread_loop_unlock (data->loop);
+}
+
+
+static enum spa_audio_format
+xmms_pipewire_format_get (xmms_sample_format_t format)
+{
+	switch (format) {
+		case XMMS_SAMPLE_FORMAT_U8:
+			return SPA_AUDIO_FORMAT_U8;
+		case XMMS_SAMPLE_FORMAT_S16:
+			return SPA_AUDIO_FORMAT_S16;
+		case XMMS_SAMPLE_FORMAT_S32:
+			return SPA_AUDIO_FORMAT_S32;
+		case XMMS_SAMPLE_FORMAT_FLOAT:
+			return SPA_AUDIO_FORMAT_F32;
+		default:
+			return SPA_AUDIO_FORMAT_UNKNOWN;
+	}
+}
+
+
+static gboolean
+xmms_pipewire_format_set (xmms_output_t *output, const xmms_stream_type_t *format)
+{
+	xmms_pipewire_data_t *data;
+	const xmms_config_property_t *cv;
+	struct spa_audio_info_raw info;
+	struct spa_pod_builder builder;
+	const struct spa_pod *params[1];
+	enum pw_stream_flags flags;
+	guint8 buffer[1024];
+	const gchar *target;
+	gchar latency[32];
+	gint ms, ret;
+
+	g_return_val_if_fail (output, FALSE);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+
+	memset (&info, 0, sizeof (info));
+	info.format = xmms_pipewire_format_get (xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_FORMAT));
+	info.channels = xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	info.rate = xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+
+	g_return_val_if_fail (info.format != SPA_AUDIO_FORMAT_UNKNOWN, FALSE);
+	g_return_val_if_fail (info.channels > 0 && info.channels <= SPA_AUDIO_MAX_CHANNELS, FALSE);
+
+	if (info.channels == 1) {
+		info.position[0] = SPA_AUDIO_CHANNEL_MONO;
+	} else if (info.channels == 2) {
+		info.position[0] = SPA_AUDIO_CHANNEL_FL;
+		info.position[1] = SPA_AUDIO_CHANNEL_FR;
+	} else {
+		info.flags = SPA_AUDIO_FLAG_UNPOSITIONED;
+	}
+
+	cv = xmms_output_config_lookup (output, "latency_ms");
+	ms = CLAMP (xmms_config_property_get_int (cv), 1, 1000);
+	g_snprintf (latency, sizeof (latency), "%u/%u", info.rate * ms / 1000, info.rate);
+
+	cv = xmms_output_config_lookup (output, "target");
+	target = xmms_config_property_get_string (cv);
+
+	builder = SPA_POD_BUILDER_INIT (buffer, sizeof (buffer));
+	params[0] = spa_format_audio_raw_build (&builder, SPA_PARAM_EnumFormat, &info);
+
+	flags = PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS |
+	        PW_STREAM_FLAG_RT_PROCESS;
+	if (!g_atomic_int_get (&data->running)) {
+		flags |= PW_STREAM_FLAG_INACTIVE;
+	}
+
+	pw_thread_loop_lock (data->loop);
+
+	if (data->connected) {
+		pw_stream_disconnect (data->stream);
+		data->connected = FALSE;
+	}
+
+	g_atomic_int_set (&data->frame_size,
+	                  xmms_sample_frame_size_get (format));
+	g_atomic_int_set (&data->rate, info.rate);
+	data->channels = info.channels;
+
+	{
+		struct spa_dict_item items[2];
+		guint n = 0;
+
+		items[n++] = SPA_DICT_ITEM_INIT (PW_KEY_NODE_LATENCY, latency);
+		if (target && *target) {
+#ifdef PW_KEY_TARGET_OBJECT
+			items[n++] = SPA_DICT_ITEM_INIT (PW_KEY_TARGET_OBJECT, target);
+#else
+			items[n++] = SPA_DICT_ITEM_INIT (PW_KEY_NODE_TARGET, target);
+#endif
+		}
+		pw_stream_update_properties (data->stream, &SPA_DICT_INIT (items, n));
+	}
+
+	ret = pw_stream_connect (data->stream, PW_DIRECTION_OUTPUT, PW_ID_ANY,
+	                         flags, params, 1);
+	data->connected = ret >= 0;
+
+	pw_thread_loop_unlock (data->loop);
+
+	if (ret < 0) {
+		xmms_log_error ("Couldn't connect PipeWire stream: %s", spa_strerror (ret));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+
+static guint
+xmms_pipewire_latency_get (xmms_output_t *output)
+{
+	xmms_pipewire_data_t *data;
+	struct pw_time time;
+	gint64 frames;
+	gint rate;
+
+	g_return_val_if_fail (output, 0);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, 0);
+
+	rate = g_atomic_int_get (&data->rate);
+	if (!data->connected || !rate) {
+		return 0;
+	}
+
+	/* safe to call from any thread */
+#if PW_CHECK_VERSION(0, 3, 50)
+	if (pw_stream_get_time_n (data->stream, &time, sizeof (time)) < 0) {
+		return 0;
+	}
+#else
+	if (pw_stream_get_time (data->stream, &time) < 0) {
+		return 0;
+	}
+#endif
+
+	if (!time.rate.denom) {
+		return 0;
+	}
+
+	/* the delay is counted in graph ticks */
+	frames = time.delay * rate * time.rate.num / time.rate.denom;
+#if PW_CHECK_VERSION(0, 3, 50)
+	frames += time.buffered;
+#endif
+
+	return MAX (frames, 0) * g_atomic_int_get (&data->frame_size) + time.queued;
+}
+
+
+static gboolean
+xmms_pipewire_volume_set (xmms_output_t *output,
+                          const gchar *channel, guint volume)
+{
+	xmms_pipewire_data_t *data;
+	gfloat values[SPA_AUDIO_MAX_CHANNELS];
+	gfloat linear;
+	gint i;
+
+	g_return_val_if_fail (output, FALSE);
+	g_return_val_if_fail (channel, FALSE);
+	g_return_val_if_fail (volume <= 100, FALSE);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+
+	/* the same cubic mapping as the PulseAudio volume sliders */
+	linear = volume / 100.0f;
+	linear = linear * linear * linear;
+
+	for (i = 0; i < SPA_AUDIO_MAX_CHANNELS; i++) {
+		values[i] = linear;
+	}
+
+	pw_thread_loop_lock (data->loop);
+	data->volume = volume;
+	pw_stream_set_control (data->stream, SPA_PROP_channelVolumes,
+	                       MAX (data->channels, 1), values, 0);
+	pw_thread_loop_unlock (data->loop);
+
+	return TRUE;
+}
+
+
+static gboolean
+xmms_pipewire_volume_get (xmms_output_t *output, const gchar **names,
+                          guint *values, guint *num_channels)
+{
+	xmms_pipewire_data_t *data;
+
+	g_return_val_if_fail (output, FALSE);
+	data = xmms_output_private_data_get (output);
+	g_return_val_if_fail (data, FALSE);
+	g_return_val_if_fail (num_channels, FALSE);
+
+	if (!*num_channels) {
+		*num_channels = 1;
+		return TRUE;
+	}
+
+	g_return_val_if_fail (*num_channels == 1, FALSE);
+	g_return_val_if_fail (names, FALSE);
+	g_return_val_if_fail (values, FALSE);
+
+	names[0] = "master";
+
+	pw_thread_loop_lock (data->loop);
+	values[0] = data->volume;
+	pw_thread_loop_unlock (data->loop);
+
+	return TRUE;
+}
+
+
+/* runs in PipeWire's realtime thread, must not block */
+static void
+xmms_pipewire_process (void *udata)
+{
+	xmms_output_t *output = udata;
+	xmms_pipewire_data_t *data;
+	struct pw_buffer *b;
+	struct spa_data *d;
+	gint frame_size, len, got = 0;
+
+	data = xmms_output_private_data_get (output);
+
+	b = pw_stream_dequeue_buffer (data->stream);
+	if (!b) {
+		return;
+	}
+
+	d = &b->buffer->datas[0];
+	frame_size = g_atomic_int_get (&data->frame_size);
+	if (!d->data || !frame_size) {
+		pw_stream_queue_buffer (data->stream, b);
+		return;
+	}
+
+	len = d->maxsize / frame_size * frame_size;
+#if PW_CHECK_VERSION(0, 3, 49)
+	if (b->requested) {
+		len = MIN (len, b->requested * frame_size);
+	}
+#endif
+
+	if (g_atomic_int_get (&data->running)) {
+		got = xmms_output_pull (output, d->data, len);
+		got = MAX (got, 0) / frame_size * frame_size;
+	}
+
+	/* keep the graph going with silence for what's missing */
+	if (got < len) {
+		memset ((guint8 *) d->data + got, 0, len - got);
+	}
+
+	d->chunk->offset = 0;
+	d->chunk->stride = frame_size;
+	d->chunk->size = len;
+
+	pw_stream_queue_buffer (data->stream, b);
+}
+
+
+static void
+xmms_pipewire_state_changed (void *udata, enum pw_stream_state old,
+                             enum pw_stream_state state, const char *error)
+{
+	if (state == PW_STREAM_STATE_ERROR) {
+		xmms_log_error ("PipeWire stream error: %s", error ? error : "unknown");
+	} else {
+		XMMS_DBG ("PipeWire stream %s", pw_stream_state_as_string (state));
+	}
+}
+
+
+/* e.g. the volume set by a mixer, runs in the loop thread */
+static void
+xmms_pipewire_control_info (void *udata, uint32_t id,
+                            const struct pw_stream_control *control)
+{
+	xmms_output_t *output = udata;
+	xmms_pipewire_data_t *data;
+	guint volume;
+
+	if (id != SPA_PROP_channelVolumes || !control->n_values) {
+		return;
+	}
+
+	data = xmms_output_private_data_get (output);
+
+	volume = (guint) (cbrtf (control->values[0]) * 100.0f + 0.5f);
+	volume = MIN (volume, 100);
+
+	if (volume != data->volume) {
+		data->volume = volume;
+		xmms_output_volume_changed (output);
+	}
+}
@@ -53,6 +53,8 @@ struct xmms_pulse {
 	pa_channel_map channel_map;
 	int operation_success;
 	int volume;
+	xmms_pulse_volume_cb volume_cb;
+	void *volume_udata;
 };
 
 static gboolean check_pulse_health (xmms_pulse *p, int *rerror)
@@ -127,6 +129,22 @@ static void stream_request_cb (pa_stream *s, size_t length, void *userdata)
 	signal_mainloop (userdata);
 }
 
+static void subscribe_cb (pa_context *c, pa_subscription_event_type_t t,
+                          uint32_t idx, void *userdata)
+{
+	xmms_pulse *p = userdata;
+	assert (p);
+
+	if ((t & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != PA_SUBSCRIPTION_EVENT_SINK_INPUT ||
+	    (t & PA_SUBSCRIPTION_EVENT_TYPE_MASK) != PA_SUBSCRIPTION_EVENT_CHANGE) {
+		return;
+	}
+
+	if (p->stream && pa_stream_get_index (p->stream) == idx && p->volume_cb) {
+		p->volume_cb (p->volume_udata);
+	}
+}
+
 static void drain_result_cb (pa_stream *s, int success, void *userdata)
 {
 	xmms_pulse *p = userdata;
@@ -143,8 +161,10 @@ static void drain_result_cb (pa_stream *s, int success, void *userdata)
  */
 xmms_pulse *
 xmms_pulse_backend_new (const char *server, const char *name,
+                        xmms_pulse_volume_cb volume_cb, void *udata,
                         int *rerror)
 {
+	pa_operation *o;
 	xmms_pulse *p;
 	int error = PA_ERR_INTERNAL;
 
@@ -159,6 +179,8 @@ xmms_pulse_backend_new (const char *server, const char *name,
 		return NULL;
 
 	p->volume = 100;
+	p->volume_cb = volume_cb;
+	p->volume_udata = udata;
 
 	p->mainloop = pa_threaded_mainloop_new ();
 	if (!p->mainloop)
@@ -188,6 +210,16 @@ xmms_pulse_backend_new (const char *server, const char *name,
 		goto unlock_and_fail;
 	}
 
+	/* tell about volume changes of our stream, done by anyone */
+	if (volume_cb) {
+		pa_context_set_subscribe_callback (p->context, subscribe_cb, p);
+		o = pa_context_subscribe (p->context, PA_SUBSCRIPTION_MASK_SINK_INPUT,
+		                          NULL, NULL);
+		if (o) {
+			pa_operation_unref (o);
+		}
+	}
+
 	pa_threaded_mainloop_unlock (p->mainloop);
 	return p;
 
@@ -2,9 +2,11 @@
 #define __PULSE_BACKEND_H__
 
 typedef struct xmms_pulse xmms_pulse;
+typedef void (*xmms_pulse_volume_cb)(void *udata);
 
 xmms_pulse* xmms_pulse_backend_new(const char *server, const char *name,
-                                   int *rerror);
+                                   xmms_pulse_volume_cb volume_cb,
+                                   void *udata, int *rerror);
 void xmms_pulse_backend_free(xmms_pulse *s);
 gboolean xmms_pulse_backend_set_stream(xmms_pulse *p,
                                        const char *stream_name,
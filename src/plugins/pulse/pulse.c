@@ -51,6 +51,7 @@ static gboolean xmms_pulse_volume_get (xmms_output_t *output,
                                        const gchar **names,
                                        guint *values,
                                        guint *num_channels);
+static void xmms_pulse_volume_changed (void *udata);
 
 
 /*
@@ -101,6 +102,10 @@ xmms_pulse_new (xmms_output_t *output)
 
 	xmms_output_private_data_set (output, data);
 
+	/* changes to our stream are subscribed to, and there is no
+	 * volume without one */
+	xmms_output_volume_events_set (output, TRUE);
+
 	xmms_output_stream_type_add (output,
 	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
 	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_U8,
@@ -156,7 +161,9 @@ xmms_pulse_open (xmms_output_t *output)
 	if (!name || *name == '\0')
 		name = XMMS_PULSE_DEFAULT_NAME;
 
-	data->pulse = xmms_pulse_backend_new (server, name, NULL);
+	data->pulse = xmms_pulse_backend_new (server, name,
+	                                      xmms_pulse_volume_changed,
+	                                      output, NULL);
 	if (!data->pulse)
 		return FALSE;
 
@@ -177,6 +184,9 @@ xmms_pulse_close (xmms_output_t *output)
 		xmms_pulse_backend_free (data->pulse);
 		data->pulse = NULL;
 	}
+
+	/* the volume is gone with the stream */
+	xmms_output_volume_changed (output);
 }
 
 
@@ -215,6 +225,9 @@ xmms_pulse_format_set (xmms_output_t *output, const xmms_stream_type_t *format)
 	                                    samplerate, channels, NULL))
 		return FALSE;
 
+	/* a new stream starts out with a volume of its own */
+	xmms_output_volume_changed (output);
+
 	return TRUE;
 }
 
@@ -251,6 +264,13 @@ xmms_pulse_volume_set (xmms_output_t *output,
 }
 
 
+static void
+xmms_pulse_volume_changed (void *udata)
+{
+	xmms_output_volume_changed ((xmms_output_t *) udata);
+}
+
+
 static gboolean
 xmms_pulse_volume_get (xmms_output_t *output, const gchar **names,
                        guint *values, guint *num_channels)
@@ -28,8 +28,11 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef void (*xmms_replaygain_apply_func_t)
-	(void *buf, gint len, gfloat gain);
+#include "replaygain_apply.h"
+
+/* what the loudness measured by the server is brought to, the same
+ * as ReplayGain 2.0 aims for */
+#define XMMS_REPLAYGAIN_REFERENCE_LUFS -18.0
 
 /**
  * Replaygain modes.
@@ -45,6 +48,8 @@ typedef struct xmms_replaygain_data_St {
 	gboolean use_anticlip;
 	gfloat preamp;
 	gfloat gain;
+	gfloat applied;
+	gint channels;
 	gboolean has_replaygain;
 	gboolean enabled;
 	xmms_replaygain_apply_func_t apply;
@@ -66,6 +71,8 @@ static gboolean xmms_replaygain_init (xmms_xform_t *xform);
 static void xmms_replaygain_destroy (xmms_xform_t *xform);
 static gint xmms_replaygain_read (xmms_xform_t *xform, xmms_sample_t *buf,
                                   gint len, xmms_error_t *error);
+static void xmms_replaygain_process (xmms_xform_t *xform, xmms_sample_t *buf,
+                                     gint len);
 static gint64 xmms_replaygain_seek (xmms_xform_t *xform, gint64 samples,
                                     xmms_xform_seek_mode_t whence,
                                     xmms_error_t *error);
@@ -74,15 +81,6 @@ static void xmms_replaygain_config_changed (xmms_object_t *obj, xmmsv_t *_val, g
 static void compute_gain (xmms_xform_t *xform, xmms_replaygain_data_t *data);
 static xmms_replaygain_mode_t parse_mode (const char *s);
 
-static void apply_s8 (void *buf, gint len, gfloat gain);
-static void apply_u8 (void *buf, gint len, gfloat gain);
-static void apply_s16 (void *buf, gint len, gfloat gain);
-static void apply_u16 (void *buf, gint len, gfloat gain);
-static void apply_s32 (void *buf, gint len, gfloat gain);
-static void apply_u32 (void *buf, gint len, gfloat gain);
-static void apply_float (void *buf, gint len, gfloat gain);
-static void apply_double (void *buf, gint len, gfloat gain);
-
 /*
  * Plugin header
  */
@@ -104,6 +102,7 @@ xmms_replaygain_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	methods.init = xmms_replaygain_init;
 	methods.destroy = xmms_replaygain_destroy;
 	methods.read = xmms_replaygain_read;
+	methods.process = xmms_replaygain_process;
 	methods.seek = xmms_replaygain_seek;
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
@@ -128,6 +127,8 @@ xmms_replaygain_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	                                            "preamp", "6.0",
 	                                            NULL, NULL);
 
+	XMMS_DBG ("Using %s replaygain loops", xmms_replaygain_apply_name ());
+
 	return TRUE;
 }
 
@@ -179,38 +180,14 @@ xmms_replaygain_init (xmms_xform_t *xform)
 
 	fmt = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_FORMAT);
 
-	switch (fmt) {
-		case XMMS_SAMPLE_FORMAT_S8:
-			data->apply = apply_s8;
-			break;
-		case XMMS_SAMPLE_FORMAT_U8:
-			data->apply = apply_u8;
-			break;
-		case XMMS_SAMPLE_FORMAT_S16:
-			data->apply = apply_s16;
-			break;
-		case XMMS_SAMPLE_FORMAT_U16:
-			data->apply = apply_u16;
-			break;
-		case XMMS_SAMPLE_FORMAT_S32:
-			data->apply = apply_s32;
-			break;
-		case XMMS_SAMPLE_FORMAT_U32:
-			data->apply = apply_u32;
-			break;
-		case XMMS_SAMPLE_FORMAT_FLOAT:
-			data->apply = apply_float;
-			break;
-		case XMMS_SAMPLE_FORMAT_DOUBLE:
-			data->apply = apply_double;
-			break;
-		default:
-			/* we shouldn't ever get here, since we told the daemon
-			 * earlier about this list of supported formats.
-			 */
-			g_assert_not_reached ();
-			break;
-	}
+	data->apply = xmms_replaygain_apply_get (fmt);
+	data->channels = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	data->applied = data->has_replaygain && data->enabled ? data->gain : 1.0;
+
+	/* we shouldn't ever get NULL, since we told the daemon
+	 * earlier about this list of supported formats.
+	 */
+	g_assert (data->apply);
 
 	return TRUE;
 }
@@ -245,27 +222,49 @@ static gint
 xmms_replaygain_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
                       xmms_error_t *error)
 {
-	xmms_replaygain_data_t *data;
-	xmms_sample_format_t fmt;
 	gint read;
 
 	g_return_val_if_fail (xform, -1);
 
-	data = xmms_xform_private_data_get (xform);
-	g_return_val_if_fail (data, -1);
-
 	read = xmms_xform_read (xform, buf, len, error);
 
-	if (!data->has_replaygain || !data->enabled) {
-		return read;
+	/* only what was read, not the whole buffer */
+	if (read > 0) {
+		xmms_replaygain_process (xform, buf, read);
 	}
 
+	return read;
+}
+
+static void
+xmms_replaygain_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len)
+{
+	xmms_replaygain_data_t *data;
+	xmms_sample_format_t fmt;
+	gfloat gain, from;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_if_fail (data);
+
 	fmt = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_FORMAT);
 	len /= xmms_sample_size_get (fmt);
 
-	data->apply (buf, len, data->gain);
+	/* a changed setting fades over the buffer instead of jumping */
+	gain = data->has_replaygain && data->enabled ? data->gain : 1.0;
+	if (gain != data->applied) {
+		from = data->applied;
+		data->applied = gain;
+		if (xmms_replaygain_apply_ramp (fmt, buf, len / data->channels,
+		                                data->channels, from, gain)) {
+			return;
+		}
+	}
 
-	return read;
+	if (!data->has_replaygain || !data->enabled) {
+		return;
+	}
+
+	data->apply (buf, len, gain);
 }
 
 static gint64
@@ -310,11 +309,37 @@ xmms_replaygain_config_changed (xmms_object_t *obj, xmmsv_t *_val, gpointer udat
 	}
 }
 
+/**
+ * Gain and peak from the loudness the server measured, for entries
+ * without replaygain tags.
+ */
+static gboolean
+loudness_gain (xmms_xform_t *xform, gfloat *s, gfloat *p)
+{
+	gchar *tmp;
+
+	tmp = xmms_xform_entry_property_get_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LOUDNESS_TRACK);
+	if (!tmp) {
+		return FALSE;
+	}
+	*s = pow (10.0, (XMMS_REPLAYGAIN_REFERENCE_LUFS - g_ascii_strtod (tmp, NULL)) / 20.0);
+	g_free (tmp);
+
+	tmp = xmms_xform_entry_property_get_str (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_TRUEPEAK_TRACK);
+	if (tmp) {
+		*p = g_ascii_strtod (tmp, NULL);
+		g_free (tmp);
+	}
+
+	return TRUE;
+}
+
 static void
 compute_gain (xmms_xform_t *xform, xmms_replaygain_data_t *data)
 {
 	gfloat s, p;
 	const gchar *key_s, *key_p, *tmp;
+	gboolean measured = FALSE;
 
 	if (data->mode == XMMS_REPLAYGAIN_MODE_TRACK) {
 		key_s = XMMS_MEDIALIB_ENTRY_PROPERTY_GAIN_TRACK;
@@ -325,16 +350,18 @@ compute_gain (xmms_xform_t *xform, xmms_replaygain_data_t *data)
 	}
 
 	/** @todo should this be ints instead? */
+	p = 1.0;
 	if (xmms_xform_metadata_get_str (xform, key_s, &tmp)) {
 		s = atof (tmp);
+	} else if (loudness_gain (xform, &s, &p)) {
+		/* only tracks are measured, so album mode gets those too */
+		measured = TRUE;
 	} else {
 		s = 1.0;
 	}
 
-	if (xmms_xform_metadata_get_str (xform, key_p, &tmp)) {
+	if (!measured && xmms_xform_metadata_get_str (xform, key_p, &tmp)) {
 		p = atof (tmp);
-	} else {
-		p = 1.0;
 	}
 
 	s *= data->preamp;
@@ -362,100 +389,3 @@ parse_mode (const char *s)
 		return XMMS_REPLAYGAIN_MODE_TRACK;
 	}
 }
-
-static void
-apply_s8 (void *buf, gint len, gfloat gain)
-{
-	xmms_samples8_t *samples = (xmms_samples8_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gfloat sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, XMMS_SAMPLES8_MIN,
-		                    XMMS_SAMPLES8_MAX);
-	}
-}
-
-static void
-apply_u8 (void *buf, gint len, gfloat gain)
-{
-	xmms_sampleu8_t *samples = (xmms_sampleu8_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gfloat sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU8_MAX);
-	}
-}
-
-static void
-apply_s16 (void *buf, gint len, gfloat gain)
-{
-	xmms_samples16_t *samples = (xmms_samples16_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gfloat sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, XMMS_SAMPLES16_MIN,
-		                    XMMS_SAMPLES16_MAX);
-	}
-}
-
-static void
-apply_u16 (void *buf, gint len, gfloat gain)
-{
-	xmms_sampleu16_t *samples = (xmms_sampleu16_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gfloat sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU16_MAX);
-	}
-}
-
-static void
-apply_s32 (void *buf, gint len, gfloat gain)
-{
-	xmms_samples32_t *samples = (xmms_samples32_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gdouble sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, XMMS_SAMPLES32_MIN,
-		                    XMMS_SAMPLES32_MAX);
-	}
-}
-
-static void
-apply_u32 (void *buf, gint len, gfloat gain)
-{
-	xmms_sampleu32_t *samples = (xmms_sampleu32_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		gdouble sample = samples[i] * gain;
-		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU32_MAX);
-	}
-}
-
-static void
-apply_float (void *buf, gint len, gfloat gain)
-{
-	xmms_samplefloat_t *samples = (xmms_samplefloat_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		samples[i] *= gain;
-	}
-}
-
-static void
-apply_double (void *buf, gint len, gfloat gain)
-{
-	xmms_sampledouble_t *samples = (xmms_sampledouble_t *) buf;
-	gint i;
-
-	for (i = 0; i < len; i++) {
-		samples[i] *= gain;
-	}
-}
@@ -0,0 +1,352 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * Replaygain sample loops, with vector versions of the common formats
+ * picked for the running CPU.
+ */
+
+#include <string.h>
+
+#include "replaygain_apply.h"
+#include "../mixing_common/mixing.c"
+
+static void
+apply_s8 (void *buf, gint len, gfloat gain)
+{
+	xmms_samples8_t *samples = (xmms_samples8_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gfloat sample = samples[i] * gain;
+		samples[i] = CLAMP (sample, XMMS_SAMPLES8_MIN,
+		                    XMMS_SAMPLES8_MAX);
+	}
+}
+
+static void
+apply_u8 (void *buf, gint len, gfloat gain)
+{
+	xmms_sampleu8_t *samples = (xmms_sampleu8_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gfloat sample = samples[i] * gain;
+		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU8_MAX);
+	}
+}
+
+static void
+apply_s16 (void *buf, gint len, gfloat gain)
+{
+	xmms_samples16_t *samples = (xmms_samples16_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gfloat sample = samples[i] * gain;
+		samples[i] = CLAMP (sample, XMMS_SAMPLES16_MIN,
+		                    XMMS_SAMPLES16_MAX);
+	}
+}
+
+static void
+apply_u16 (void *buf, gint len, gfloat gain)
+{
+	xmms_sampleu16_t *samples = (xmms_sampleu16_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gfloat sample = samples[i] * gain;
+		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU16_MAX);
+	}
+}
+
+static void
+apply_s32 (void *buf, gint len, gfloat gain)
+{
+	xmms_samples32_t *samples = (xmms_samples32_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gdouble sample = (gdouble) samples[i] * gain;
+		samples[i] = CLAMP (sample, XMMS_SAMPLES32_MIN,
+		                    XMMS_SAMPLES32_MAX);
+	}
+}
+
+static void
+apply_u32 (void *buf, gint len, gfloat gain)
+{
+	xmms_sampleu32_t *samples = (xmms_sampleu32_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		gdouble sample = (gdouble) samples[i] * gain;
+		samples[i] = CLAMP (sample, 0, XMMS_SAMPLEU32_MAX);
+	}
+}
+
+static void
+apply_float (void *buf, gint len, gfloat gain)
+{
+	xmms_samplefloat_t *samples = (xmms_samplefloat_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		samples[i] *= gain;
+	}
+}
+
+static void
+apply_double (void *buf, gint len, gfloat gain)
+{
+	xmms_sampledouble_t *samples = (xmms_sampledouble_t *) buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		samples[i] *= gain;
+	}
+}
+
+#ifdef HAVE_VECTOR_MIXING
+
+/*
+ * Eight samples at a time. The results are the same as the loops
+ * above: truncating and then clipping to an integer range is the same
+ * as clipping first, and s32 still goes through doubles.
+ */
+static inline void
+vector_apply_s16 (void *buf, gint len, gfloat gain)
+{
+	xmms_samples16_t *samples = (xmms_samples16_t *) buf;
+	const v8si lo = SPLAT (XMMS_SAMPLES16_MIN);
+	const v8si hi = SPLAT (XMMS_SAMPLES16_MAX);
+	gint i;
+
+	/* |sample * gain| stays well inside gint32, gain is at most 15 */
+	for (i = 0; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8hi x;
+		v8si s;
+
+		memcpy (&x, &samples[i], sizeof (x));
+		s = __builtin_convertvector (__builtin_convertvector (x, v8sf) * gain, v8si);
+		s = SELECT (s < lo, lo, s);
+		s = SELECT (s > hi, hi, s);
+		x = __builtin_convertvector (s, v8hi);
+		memcpy (&samples[i], &x, sizeof (x));
+	}
+
+	apply_s16 (&samples[i], len - i, gain);
+}
+
+static inline void
+vector_apply_s32 (void *buf, gint len, gfloat gain)
+{
+	xmms_samples32_t *samples = (xmms_samples32_t *) buf;
+	const v8df lo = SPLAT (XMMS_SAMPLES32_MIN);
+	const v8df hi = SPLAT (XMMS_SAMPLES32_MAX);
+	gint i;
+
+	for (i = 0; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8si x;
+		v8df s;
+		v8di bits;
+
+		memcpy (&x, &samples[i], sizeof (x));
+		s = __builtin_convertvector (x, v8df) * (gdouble) gain;
+
+		/* clip on the bit patterns, the masks are not doubles */
+		bits = SELECT (s < lo, (v8di) lo, (v8di) s);
+		s = (v8df) bits;
+		bits = SELECT (s > hi, (v8di) hi, (v8di) s);
+
+		x = __builtin_convertvector ((v8df) bits, v8si);
+		memcpy (&samples[i], &x, sizeof (x));
+	}
+
+	apply_s32 (&samples[i], len - i, gain);
+}
+
+static inline void
+vector_apply_float (void *buf, gint len, gfloat gain)
+{
+	xmms_samplefloat_t *samples = (xmms_samplefloat_t *) buf;
+	gint i;
+
+	for (i = 0; i + VECTOR_LANES <= len; i += VECTOR_LANES) {
+		v8sf x;
+
+		memcpy (&x, &samples[i], sizeof (x));
+		x *= gain;
+		memcpy (&samples[i], &x, sizeof (x));
+	}
+
+	apply_float (&samples[i], len - i, gain);
+}
+
+/*
+ * The same loops compiled for each instruction set worth having.
+ */
+#define VECTOR_APPLY_VARIANT(name, isa, fmt) \
+static void __attribute__ ((target (isa))) \
+apply_##fmt##_##name (void *buf, gint len, gfloat gain) \
+{ \
+	vector_apply_##fmt (buf, len, gain); \
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+VECTOR_APPLY_VARIANT (sse4_1, "sse4.1", s16)
+VECTOR_APPLY_VARIANT (sse4_1, "sse4.1", s32)
+VECTOR_APPLY_VARIANT (sse4_1, "sse4.1", float)
+VECTOR_APPLY_VARIANT (avx2, "avx2", s16)
+VECTOR_APPLY_VARIANT (avx2, "avx2", s32)
+VECTOR_APPLY_VARIANT (avx2, "avx2", float)
+#else
+/* NEON is part of the baseline on aarch64, and on arm when the
+ * compiler was told it may use it */
+#define apply_s16_neon vector_apply_s16
+#define apply_s32_neon vector_apply_s32
+#define apply_float_neon vector_apply_float
+#endif
+
+typedef struct {
+	const gchar *name;
+	xmms_replaygain_apply_func_t s16, s32, fl;
+} vector_apply_t;
+
+static const vector_apply_t *
+vector_apply_get (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	static const vector_apply_t sse41 = {
+		"sse4.1", apply_s16_sse4_1, apply_s32_sse4_1, apply_float_sse4_1
+	};
+	static const vector_apply_t avx2 = {
+		"avx2", apply_s16_avx2, apply_s32_avx2, apply_float_avx2
+	};
+
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2")) {
+		return &avx2;
+	}
+	if (__builtin_cpu_supports ("sse4.1")) {
+		return &sse41;
+	}
+	return NULL;
+#else
+	static const vector_apply_t neon = {
+		"neon", apply_s16_neon, apply_s32_neon, apply_float_neon
+	};
+
+	return &neon;
+#endif
+}
+
+#else /* !HAVE_VECTOR_MIXING */
+
+typedef struct {
+	const gchar *name;
+	xmms_replaygain_apply_func_t s16, s32, fl;
+} vector_apply_t;
+
+static const vector_apply_t *
+vector_apply_get (void)
+{
+	return NULL;
+}
+
+#endif
+
+/**
+ * The plain loop for a sample format, NULL if it isn't supported.
+ */
+xmms_replaygain_apply_func_t
+xmms_replaygain_apply_get_generic (xmms_sample_format_t fmt)
+{
+	switch (fmt) {
+		case XMMS_SAMPLE_FORMAT_S8:
+			return apply_s8;
+		case XMMS_SAMPLE_FORMAT_U8:
+			return apply_u8;
+		case XMMS_SAMPLE_FORMAT_S16:
+			return apply_s16;
+		case XMMS_SAMPLE_FORMAT_U16:
+			return apply_u16;
+		case XMMS_SAMPLE_FORMAT_S32:
+			return apply_s32;
+		case XMMS_SAMPLE_FORMAT_U32:
+			return apply_u32;
+		case XMMS_SAMPLE_FORMAT_FLOAT:
+			return apply_float;
+		case XMMS_SAMPLE_FORMAT_DOUBLE:
+			return apply_double;
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * The fastest loop for a sample format on this CPU, NULL if the
+ * format isn't supported.
+ */
+xmms_replaygain_apply_func_t
+xmms_replaygain_apply_get (xmms_sample_format_t fmt)
+{
+	const vector_apply_t *vector = vector_apply_get ();
+
+	if (vector) {
+		switch (fmt) {
+			case XMMS_SAMPLE_FORMAT_S16:
+				return vector->s16;
+			case XMMS_SAMPLE_FORMAT_S32:
+				return vector->s32;
+			case XMMS_SAMPLE_FORMAT_FLOAT:
+				return vector->fl;
+			default:
+				break;
+		}
+	}
+
+	return xmms_replaygain_apply_get_generic (fmt);
+}
+
+/**
+ * Name of the instruction set the vector loops use, "generic" if none.
+ */
+const gchar *
+xmms_replaygain_apply_name (void)
+{
+	const vector_apply_t *vector = vector_apply_get ();
+
+	return vector ? vector->name : "generic";
+}
+
+gboolean
+xmms_replaygain_apply_ramp (xmms_sample_format_t fmt, void *buf, gint frames,
+                            gint channels, gfloat from, gfloat to)
+{
+	switch (fmt) {
+		case XMMS_SAMPLE_FORMAT_S16:
+			xmms_mixing_gain_ramp_s16 (buf, channels, frames, from, to);
+			return TRUE;
+		case XMMS_SAMPLE_FORMAT_FLOAT:
+			xmms_mixing_gain_ramp (buf, channels, frames, from, to);
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
@@ -0,0 +1,43 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#ifndef __REPLAYGAIN_APPLY_H__
+#define __REPLAYGAIN_APPLY_H__
+
+#include <glib.h>
+#include <xmms/xmms_sample.h>
+
+/**
+ * Multiply len samples in buf by gain, clipping to the range of the
+ * format.
+ */
+typedef void (*xmms_replaygain_apply_func_t)
+	(void *buf, gint len, gfloat gain);
+
+xmms_replaygain_apply_func_t xmms_replaygain_apply_get (xmms_sample_format_t fmt);
+xmms_replaygain_apply_func_t xmms_replaygain_apply_get_generic (xmms_sample_format_t fmt);
+const gchar *xmms_replaygain_apply_name (void);
+
+/**
+ * Multiply frames interleaved frames by a gain going linearly from
+ * from to to, so a gain change doesn't click. FALSE if the format
+ * can't be ramped and nothing was done.
+ */
+gboolean xmms_replaygain_apply_ramp (xmms_sample_format_t fmt, void *buf,
+                                     gint frames, gint channels,
+                                     gfloat from, gfloat to);
+
+#endif
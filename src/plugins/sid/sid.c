@@ -35,8 +35,12 @@
 typedef struct xmms_sid_data_St {
 	struct sidplay_wrapper *wrapper;
 	GString *buffer;
+	xmms_xform_render_t *render;
 } xmms_sid_data_t;
 
+/* bytes rendered at a time when rendering ahead */
+#define SID_RENDER_CHUNK 4096
+
 /*
  * Function prototypes
  */
@@ -44,6 +48,7 @@ static gboolean xmms_sid_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gboolean xmms_sid_init (xmms_xform_t *xform);
 static void xmms_sid_destroy (xmms_xform_t *xform);
 static gint xmms_sid_read (xmms_xform_t *xform, void *out, gint outlen, xmms_error_t *error);
+static gint xmms_sid_render (xmms_xform_t *xform, void *out, gint outlen, xmms_error_t *error);
 static void xmms_sid_get_media_info (xmms_xform_t *xform);
 static void xmms_sid_get_songlength (xmms_xform_t *xform);
 
@@ -97,6 +102,10 @@ xmms_sid_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin, "songlength_path",
 	                                            "", NULL, NULL);
 
+	/* milliseconds to render ahead of playback, 0 to render when read */
+	xmms_xform_plugin_config_property_register (xform_plugin, "render_ahead",
+	                                            "500", NULL, NULL);
+
 	return TRUE;
 }
 
@@ -104,6 +113,7 @@ static gboolean
 xmms_sid_init (xmms_xform_t *xform)
 {
 	xmms_sid_data_t *data;
+	xmms_config_property_t *cfgv;
 	const char *subtune;
 	gint ret;
 
@@ -162,6 +172,11 @@ xmms_sid_init (xmms_xform_t *xform)
 	                             44100,
 	                             XMMS_STREAM_TYPE_END);
 
+	cfgv = xmms_xform_config_lookup (xform, "render_ahead");
+	data->render = xmms_xform_render_new (xform, xmms_sid_render, SID_RENDER_CHUNK,
+	                                      (gsize) MAX (0, xmms_config_property_get_int (cfgv)) *
+	                                      44100 / 1000 * 4);
+
 	return TRUE;
 }
 
@@ -173,6 +188,9 @@ xmms_sid_destroy (xmms_xform_t *xform)
 	data = xmms_xform_private_data_get (xform);
 	g_return_if_fail (data);
 
+	if (data->render)
+		xmms_xform_render_free (data->render);
+
 	sidplay_wrapper_destroy (data->wrapper);
 
 	if (data->buffer)
@@ -305,6 +323,17 @@ done:
 
 static gint
 xmms_sid_read (xmms_xform_t *xform, void *out, gint outlen, xmms_error_t *error)
+{
+	xmms_sid_data_t *data;
+
+	data = xmms_xform_private_data_get (xform);
+	g_return_val_if_fail (data, -1);
+
+	return xmms_xform_render_read (data->render, out, outlen, error);
+}
+
+static gint
+xmms_sid_render (xmms_xform_t *xform, void *out, gint outlen, xmms_error_t *error)
 {
 	xmms_sid_data_t *data;
 	gint ret;
@@ -27,6 +27,7 @@
 #include <samplerate.h>
 
 #include "pvocoder.h"
+#include "../mixing_common/mixing.c"
 
 typedef struct {
 	pvocoder_t *pvoc;
@@ -36,10 +37,14 @@ typedef struct {
 	gint channels;
 	gint bufsize;
 
+	/* the input of the vocoder, then its resampled output, which is
+	 * read from out_pos up to out_len before more is made */
 	xmms_sample_t *iobuf;
+	gint out_pos;
+	gint out_len;
+
 	pvocoder_sample_t *procbuf;
 	gfloat *resbuf;
-	GString *outbuf;
 
 	gfloat speed;
 	gfloat pitch;
@@ -115,7 +120,6 @@ xmms_vocoder_init (xmms_xform_t *xform)
 	priv->iobuf = g_malloc (priv->bufsize * sizeof (gint16));
 	priv->procbuf = g_malloc (priv->bufsize * sizeof (pvocoder_sample_t));
 	priv->resbuf = g_malloc (priv->bufsize * sizeof (gfloat));
-	priv->outbuf = g_string_new (NULL);
 
 	priv->pvoc = pvocoder_init (priv->winsize, priv->channels);
 	g_return_val_if_fail (priv->pvoc, FALSE);
@@ -186,7 +190,6 @@ xmms_vocoder_destroy (xmms_xform_t *xform)
 	pvocoder_close (data->pvoc);
 	src_delete (data->resampler);
 
-	g_string_free (data->outbuf, TRUE);
 	g_free (data->resbuf);
 	g_free (data->procbuf);
 	g_free (data->iobuf);
@@ -244,9 +247,9 @@ xmms_vocoder_read (xmms_xform_t *xform, xmms_sample_t *buffer, gint len,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
-	size = MIN (data->outbuf->len, len);
+	size = MIN (data->out_len - data->out_pos, len);
 	while (size == 0) {
-		int i, dpos;
+		int dpos;
 		gint16 *samples = (gint16 *) data->iobuf;
 
 		if (!data->enabled) {
@@ -278,9 +281,8 @@ xmms_vocoder_read (xmms_xform_t *xform, xmms_sample_t *buffer, gint len,
 					read += ret;
 				}
 
-				for (i=0; i<data->bufsize; i++) {
-					data->procbuf[i] = (pvocoder_sample_t) samples[i] / 32767;
-				}
+				xmms_mixing_s16_to_float (samples, data->procbuf,
+				                          data->bufsize, 1.0 / 32767);
 				pvocoder_add_chunk (data->pvoc, data->procbuf);
 				dpos = pvocoder_get_chunk (data->pvoc, data->procbuf);
 			}
@@ -291,18 +293,18 @@ xmms_vocoder_read (xmms_xform_t *xform, xmms_sample_t *buffer, gint len,
 		data->resdata.data_in += data->resdata.input_frames_used * data->channels;
 		data->resdata.input_frames -= data->resdata.input_frames_used;
 
-		for (i=0; i<data->resdata.output_frames_gen * data->channels; i++) {
-			samples[i] = data->resbuf[i] * 32767;
-		}
-		g_string_append_len (data->outbuf, data->iobuf,
-		                     data->resdata.output_frames_gen *
-		                     data->channels *
-		                     sizeof (gint16));
-		size = MIN (data->outbuf->len, len);
+		/* at most a window, which iobuf holds */
+		xmms_mixing_float_to_s16 (data->resbuf, samples,
+		                          data->resdata.output_frames_gen *
+		                          data->channels, 32767);
+		data->out_pos = 0;
+		data->out_len = data->resdata.output_frames_gen *
+		                data->channels * sizeof (gint16);
+		size = MIN (data->out_len, len);
 	}
 
-	memcpy (buffer, data->outbuf->str, size);
-	g_string_erase (data->outbuf, 0, size);
+	memcpy (buffer, (gchar *) data->iobuf + data->out_pos, size);
+	data->out_pos += size;
 
 	return size;
 }
@@ -20,6 +20,9 @@
 
 #include <xmms/xmms_xformplugin.h>
 
+/* libvorbis can hand out the samples as float */
+#define XMMS_VORBIS_FLOAT 1
+
 #include "../vorbis_common/common.c"
 
 XMMS_XFORM_PLUGIN_DEFINE ("vorbis",
@@ -46,3 +49,31 @@ xmms_vorbis_ov_read (OggVorbis_File *vf, gchar *buf, gint len, gint bigendian,
 
 	return ret;
 }
+
+/* Interleave what ov_read_float decoded into buf, returning bytes */
+static glong
+xmms_vorbis_ov_read_float (OggVorbis_File *vf, gfloat *buf, gint len,
+                           gint channels, gint *outbuf)
+{
+	gint frame_size = channels * sizeof (gfloat);
+	gfloat **pcm;
+	glong ret;
+
+	do {
+		ret = ov_read_float (vf, &pcm, len / frame_size, outbuf);
+	} while (ret == OV_HOLE);
+
+	if (ret <= 0) {
+		return ret;
+	}
+
+	/* a chained stream may switch layouts, the outdata type can't */
+	if (ov_info (vf, -1)->channels != channels) {
+		xmms_log_error ("Channel count changed in stream");
+		return -1;
+	}
+
+	xmms_sample_interleave_float (buf, pcm, channels, ret);
+
+	return ret * frame_size;
+}
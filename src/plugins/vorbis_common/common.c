@@ -41,6 +41,8 @@ typedef struct xmms_vorbis_data_St {
 	OggVorbis_File vorbisfile;
 	ov_callbacks callbacks;
 	gint current;
+	gint channels;
+	gboolean is_float;
 } xmms_vorbis_data_t;
 
 /*
@@ -51,6 +53,10 @@ static void xmms_vorbis_set_duration (xmms_xform_t *xform, guint dur);
 static gulong xmms_vorbis_ov_read (OggVorbis_File *vf, gchar *buf, gint len,
                                    gint bigendian, gint sampsize, gint signd,
                                    gint *outbuf);
+#ifdef XMMS_VORBIS_FLOAT
+static glong xmms_vorbis_ov_read_float (OggVorbis_File *vf, gfloat *buf, gint len,
+                                        gint channels, gint *outbuf);
+#endif
 static gboolean xmms_vorbis_plugin_setup (xmms_xform_plugin_t *xform_plugin);
 static gint xmms_vorbis_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len, xmms_error_t *err);
 static gboolean xmms_vorbis_init (xmms_xform_t *decoder);
@@ -259,11 +265,28 @@ xmms_vorbis_init (xmms_xform_t *xform)
 
 	xmms_vorbis_read_metadata (xform, data);
 
+	data->channels = vi->channels;
+
+#ifdef XMMS_VORBIS_FLOAT
+	/* the decoder works in float, hand that on if nothing converts it */
+	data->is_float = xmms_xform_outdata_type_accepted (xform,
+	                                                   XMMS_STREAM_TYPE_MIMETYPE,
+	                                                   "audio/pcm",
+	                                                   XMMS_STREAM_TYPE_FMT_FORMAT,
+	                                                   XMMS_SAMPLE_FORMAT_FLOAT,
+	                                                   XMMS_STREAM_TYPE_FMT_CHANNELS,
+	                                                   vi->channels,
+	                                                   XMMS_STREAM_TYPE_FMT_SAMPLERATE,
+	                                                   vi->rate,
+	                                                   XMMS_STREAM_TYPE_END);
+#endif
+
 	xmms_xform_outdata_type_add (xform,
 	                             XMMS_STREAM_TYPE_MIMETYPE,
 	                             "audio/pcm",
 	                             XMMS_STREAM_TYPE_FMT_FORMAT,
-	                             XMMS_SAMPLE_FORMAT_S16,
+	                             data->is_float ? XMMS_SAMPLE_FORMAT_FLOAT
+	                                            : XMMS_SAMPLE_FORMAT_S16,
 	                             XMMS_STREAM_TYPE_FMT_CHANNELS,
 	                             vi->channels,
 	                             XMMS_STREAM_TYPE_FMT_SAMPLERATE,
@@ -287,6 +310,12 @@ xmms_vorbis_read (xmms_xform_t *xform, gpointer buf, gint len,
 	data = xmms_xform_private_data_get (xform);
 	g_return_val_if_fail (data, -1);
 
+#ifdef XMMS_VORBIS_FLOAT
+	if (data->is_float) {
+		ret = xmms_vorbis_ov_read_float (&data->vorbisfile, buf, len,
+		                                 data->channels, &c);
+	} else
+#endif
 	ret = xmms_vorbis_ov_read (&data->vorbisfile, (gchar *) buf, len,
 	                           G_BYTE_ORDER == G_BIG_ENDIAN,
 	                           xmms_sample_size_get (XMMS_SAMPLE_FORMAT_S16),
@@ -82,13 +82,72 @@ static int source_callback (void *u, int argc, char *argv[], char *col[])
 	return 0;
 }
 
+/* Rows of the Media table added in one s4 transaction */
+#define BATCH_ROWS 20000
+
+typedef struct {
+	s4_val_t *id;
+	char *key;
+	s4_val_t *val;
+	const char *src;
+} media_row_t;
+
+typedef struct {
+	GTree *sources;
+	media_row_t rows[BATCH_ROWS];
+	int count;
+	int done;
+	int total;
+} media_batch_t;
+
+/**
+ * Add the rows of the batch in one transaction, and start over with
+ * the whole batch if it fails to commit.
+ */
+static void media_batch_flush (media_batch_t *batch)
+{
+	s4_transaction_t *trans;
+	int i;
+
+	if (batch->count == 0)
+		return;
+
+	do {
+		trans = s4_begin (s4, 0);
+		for (i = 0; i < batch->count; i++) {
+			media_row_t *row = &batch->rows[i];
+			s4_add (trans, "song_id", row->id, row->key, row->val, row->src);
+		}
+	} while (!s4_commit (trans));
+
+	for (i = 0; i < batch->count; i++) {
+		s4_val_free (batch->rows[i].id);
+		s4_val_free (batch->rows[i].val);
+		free (batch->rows[i].key);
+	}
+
+	batch->done += batch->count;
+	batch->count = 0;
+
+	fprintf (stderr, "\rConverted %d of %d properties", batch->done, batch->total);
+}
+
+static int count_callback (void *u, int argc, char *argv[], char *col[])
+{
+	int *count = u;
+
+	if (argc > 0 && argv[0] != NULL)
+		*count = atoi (argv[0]);
+
+	return 0;
+}
+
 static int media_callback (void *u, int argc, char *argv[], char *col[])
 {
-	GTree *sources = u;
+	media_batch_t *batch = u;
+	media_row_t *row;
 	int id = 0, src_id = 0, i, intval;
-	char *key = NULL, *val = NULL, *intrepr = NULL, *src;
-	s4_val_t *id_val, *val_val;
-	s4_transaction_t *trans;
+	char *key = NULL, *val = NULL, *intrepr = NULL;
 
 	intrepr = val = NULL;
 
@@ -106,23 +165,19 @@ static int media_callback (void *u, int argc, char *argv[], char *col[])
 		}
 	}
 
-	src = g_tree_lookup (sources, &src_id);
-
-	id_val = s4_val_new_int (id);
+	row = &batch->rows[batch->count++];
+	row->src = g_tree_lookup (batch->sources, &src_id);
+	row->key = strdup (key);
+	row->id = s4_val_new_int (id);
 
 	if (xmms_is_int (intrepr, &intval)) {
-		val_val = s4_val_new_int (intval);
+		row->val = s4_val_new_int (intval);
 	} else {
-		val_val = s4_val_new_string (val);
+		row->val = s4_val_new_string (val);
 	}
 
-	do {
-		trans = s4_begin (s4, 0);
-		s4_add (trans, "song_id", id_val, key, val_val, src);
-	} while (!s4_commit (trans));
-
-	s4_val_free (val_val);
-	s4_val_free (id_val);
+	if (batch->count == BATCH_ROWS)
+		media_batch_flush (batch);
 
 	return 0;
 }
@@ -133,6 +188,7 @@ int main (int argc, char *argv[])
 	char *coll_path, *foo, *bar, *uuid, *errmsg = NULL;
 	int ret, i, uuid_len;
 	GTree *sources = g_tree_new (tree_cmp);
+	media_batch_t *batch;
 	GHashTable **ht;
 
 	if (argc != 4) {
@@ -166,8 +222,19 @@ int main (int argc, char *argv[])
 	ret = sqlite3_exec (db, "select id,source from Sources;",
 			source_callback, sources, &errmsg);
 
-	ret = sqlite3_exec (db, "select id,key,value,intval,source from Media;",
-			media_callback, sources, &errmsg);
+	batch = calloc (1, sizeof (media_batch_t));
+	batch->sources = sources;
+
+	ret = sqlite3_exec (db, "select count(*) from Media;",
+			count_callback, &batch->total, &errmsg);
+
+	/* Sorted by entry, so a batch only touches few entries. The indices
+	 * are built by s4 when the database is opened again, after this. */
+	ret = sqlite3_exec (db, "select id,key,value,intval,source from Media order by id;",
+			media_callback, batch, &errmsg);
+	media_batch_flush (batch);
+	fprintf (stderr, "\n");
+	free (batch);
 
 
 	ht = malloc (sizeof (GHashTable*) * XMMS_COLLECTION_NUM_NAMESPACES);
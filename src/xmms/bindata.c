@@ -19,7 +19,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <sys/time.h>
 #include <errno.h>
 
 #include <xmmsc/xmmsc_idnumbers.h>
@@ -36,38 +35,73 @@
 #include <xmmspriv/xmms_config.h>
 #include <xmmspriv/xmms_bindata.h>
 #include <xmmspriv/xmms_utils.h>
+#include <xmmspriv/xmms_thread_role.h>
+
+#include <xmms_configuration.h>
+
+#ifdef HAVE_GDK_PIXBUF
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#endif
 
 struct xmms_bindata_St {
 	xmms_object_t obj;
 	const gchar *bindir;
-};
 
-static xmms_bindata_t *global_bindata;
+	/** Hashes of the stored files, guarded by mutex */
+	GHashTable *hashes;
+	GMutex mutex;
 
-static void xmms_bindata_destroy (xmms_object_t *obj);
+	/** Makes the scaled images that aren't stored yet, one at a time so
+	 * a burst of requests for the same one makes it only once */
+	GThreadPool *scaler;
+};
 
-typedef unsigned char md5_byte_t; /* 8-bit byte */
-typedef unsigned int md5_word_t; /* 32-bit word */
+/* Scaled images are stored under a key derived from the original, its
+ * size and format, so they are found without keeping an index. They
+ * stay when the original is removed. */
+typedef struct xmms_bindata_scale_job_St {
+	gchar *hash;
+	gint32 size;
+	gchar *format;
+	gchar key[33];
+	gint32 client;
+	uint32_t cookie;
+} xmms_bindata_scale_job_t;
+
+#define XMMS_BINDATA_SCALED_MIN 16
+#define XMMS_BINDATA_SCALED_MAX 1024
+
+/* Files are spread over subdirectories named by the first characters of
+ * their hash, so no directory has to hold all of them. */
+#define XMMS_BINDATA_SHARD_LEN 2
+#define XMMS_BINDATA_HASH_LEN 32
+
+/* Files being written by a plugin, renamed to their hash when done */
+#define XMMS_BINDATA_TMP_PREFIX ".tmp-"
+
+struct xmms_bindata_writer_St {
+	GChecksum *md5;
+	gchar *path;
+	gint fd;
+	gboolean failed;
+};
 
-/* Define the state of the MD5 Algorithm. */
-typedef struct md5_state_s {
-    md5_word_t count[2]; /* message length in bits, lsw first */
-    md5_word_t abcd[4];  /* digest buffer */
-    md5_byte_t buf[64];  /* accumulate block */
-} md5_state_t;
+static xmms_bindata_t *global_bindata;
 
-/* Initialize the algorithm. */
-static void md5_init (md5_state_t *pms);
-static void md5_append (md5_state_t *pms, const md5_byte_t *data, int nbytes);
-static void md5_finish (md5_state_t *pms, md5_byte_t digest[16]);
+static void xmms_bindata_destroy (xmms_object_t *obj);
 
+static void xmms_bindata_index_load (xmms_bindata_t *bindata);
+static gboolean xmms_bindata_hash_is_valid (const gchar *hash);
 static gchar *xmms_bindata_build_path (xmms_bindata_t *bindata, const gchar *hash);
+static gboolean xmms_bindata_shard_create (const gchar *path);
 
 static gchar *xmms_bindata_client_add (xmms_bindata_t *bindata, GString *data, xmms_error_t *err);
 static xmmsv_t *xmms_bindata_client_retrieve (xmms_bindata_t *bindata, const gchar *hash, xmms_error_t *err);
 static void xmms_bindata_client_remove (xmms_bindata_t *bindata, const gchar *hash, xmms_error_t *);
 static xmmsv_t *xmms_bindata_client_list (xmms_bindata_t *bindata, xmms_error_t *err);
+static void xmms_bindata_client_retrieve_scaled (xmms_bindata_t *bindata, const gchar *hash, gint32 size, const gchar *format, gint32 client, uint32_t cookie, xmms_error_t *err);
 static gboolean _xmms_bindata_add (xmms_bindata_t *bindata, const guchar *data, gsize len, gchar hash[33], xmms_error_t *err);
+static void xmms_bindata_scale_worker (gpointer data, gpointer udata);
 
 #include "bindata_ipc.c"
 
@@ -94,6 +128,13 @@ xmms_bindata_init ()
 		}
 	}
 
+	g_mutex_init (&obj->mutex);
+	obj->hashes = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	xmms_bindata_index_load (obj);
+
+	obj->scaler = g_thread_pool_new (xmms_bindata_scale_worker, obj, 1,
+	                                 FALSE, NULL);
+
 	global_bindata = obj;
 
 	return obj;
@@ -102,38 +143,134 @@ xmms_bindata_init ()
 static void
 xmms_bindata_destroy (xmms_object_t *obj)
 {
+	xmms_bindata_t *bindata = (xmms_bindata_t *) obj;
+
 	XMMS_DBG ("Deactivating bindata object.");
 
 	xmms_bindata_unregister_ipc_commands ();
+
+	/* the queued requests are still answered */
+	g_thread_pool_free (bindata->scaler, FALSE, TRUE);
+
+	g_hash_table_destroy (bindata->hashes);
+	g_mutex_clear (&bindata->mutex);
 }
 
 gchar *
 xmms_bindata_calculate_md5 (const guchar *data, gsize size, gchar ret[33])
 {
-	md5_state_t state;
-	md5_byte_t digest[16];
-	int di;
-	static gchar hex[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
-	};
-
-	md5_init (&state);
-	md5_append (&state, (const md5_byte_t *)data, size);
-	md5_finish (&state, digest);
-
-	for (di = 0; di < 16; ++di) {
-		ret[di * 2] = hex[digest[di] >> 4];
-		ret[di * 2 + 1] = hex[digest[di] & 0x0f];
-	}
-	ret[32] = 0;
+	gchar *digest;
+
+	digest = g_compute_checksum_for_data (G_CHECKSUM_MD5, data, size);
+	g_strlcpy (ret, digest, XMMS_BINDATA_HASH_LEN + 1);
+	g_free (digest);
+
 	return ret;
 }
 
+/** A hash is 32 lowercase hex digits, anything else is not a file of ours. */
+static gboolean
+xmms_bindata_hash_is_valid (const gchar *hash)
+{
+	gint i;
+
+	for (i = 0; i < XMMS_BINDATA_HASH_LEN; i++) {
+		if (!g_ascii_isxdigit (hash[i]) || g_ascii_isupper (hash[i])) {
+			return FALSE;
+		}
+	}
+
+	return hash[i] == '\0';
+}
+
 static gchar *
 xmms_bindata_build_path (xmms_bindata_t *bindata, const gchar *hash)
 {
-	return g_build_path (G_DIR_SEPARATOR_S, bindata->bindir, hash, NULL);
+	gchar shard[XMMS_BINDATA_SHARD_LEN + 1];
+
+	g_strlcpy (shard, hash, sizeof (shard));
+
+	return g_build_path (G_DIR_SEPARATOR_S, bindata->bindir, shard, hash, NULL);
+}
+
+/** Create the subdirectory a file of the bindata dir goes in. */
+static gboolean
+xmms_bindata_shard_create (const gchar *path)
+{
+	gchar *dirname;
+	gint ret;
+
+	dirname = g_path_get_dirname (path);
+	ret = g_mkdir_with_parents (dirname, 0755);
+	g_free (dirname);
+
+	return ret == 0;
+}
+
+/**
+ * Read the hashes of the stored files into the index. Files left in the
+ * top directory by older versions are moved to their subdirectory.
+ */
+static void
+xmms_bindata_index_load (xmms_bindata_t *bindata)
+{
+	const gchar *name, *file;
+	gchar *path, *dest;
+	GDir *dir, *shard;
+
+	dir = g_dir_open (bindata->bindir, 0, NULL);
+	if (!dir) {
+		return;
+	}
+
+	while ((name = g_dir_read_name (dir))) {
+		path = g_build_path (G_DIR_SEPARATOR_S, bindata->bindir, name, NULL);
+
+		if (g_str_has_prefix (name, XMMS_BINDATA_TMP_PREFIX)) {
+			/* left by a writer that never finished */
+			unlink (path);
+		} else if (xmms_bindata_hash_is_valid (name)) {
+			dest = xmms_bindata_build_path (bindata, name);
+			if (xmms_bindata_shard_create (dest) && rename (path, dest) == 0) {
+				g_hash_table_add (bindata->hashes, g_strdup (name));
+			} else {
+				xmms_log_error ("Couldn't move %s to %s", path, dest);
+			}
+			g_free (dest);
+		} else if (strlen (name) == XMMS_BINDATA_SHARD_LEN &&
+		           (shard = g_dir_open (path, 0, NULL))) {
+			while ((file = g_dir_read_name (shard))) {
+				if (xmms_bindata_hash_is_valid (file) &&
+				    strncmp (file, name, XMMS_BINDATA_SHARD_LEN) == 0) {
+					g_hash_table_add (bindata->hashes, g_strdup (file));
+				}
+			}
+			g_dir_close (shard);
+		}
+
+		g_free (path);
+	}
+
+	g_dir_close (dir);
+
+	XMMS_DBG ("%u files in bindata dir", g_hash_table_size (bindata->hashes));
+}
+
+/**
+ * Estimate the memory held by the index of stored hashes, the data
+ * itself stays on disk.
+ */
+gsize
+xmms_bindata_memory_size (xmms_bindata_t *bindata)
+{
+	gsize size;
+
+	g_mutex_lock (&bindata->mutex);
+	size = g_hash_table_size (bindata->hashes) *
+	       (XMMS_BINDATA_HASH_LEN + 1 + 3 * sizeof (gpointer));
+	g_mutex_unlock (&bindata->mutex);
+
+	return size;
 }
 
 /** Add binary data from a plugin */
@@ -144,59 +281,246 @@ xmms_bindata_plugin_add (const guchar *data, gsize size, gchar hash[33])
 	return _xmms_bindata_add (global_bindata, data, size, hash, &err);
 }
 
-static gboolean
-_xmms_bindata_add (xmms_bindata_t *bindata, const guchar *data, gsize len, gchar hash[33], xmms_error_t *err)
+/**
+ * Get a copy of binary data for a plugin, to be freed with g_free.
+ * Returns NULL if there is no data with that hash.
+ */
+guchar *
+xmms_bindata_plugin_get (const gchar *hash, gsize *size)
 {
-	const guchar *ptr;
-	gsize left;
+	xmms_error_t err;
+	xmmsv_t *val;
+	const guchar *data;
+	guchar *ret = NULL;
+	guint len;
+
+	g_return_val_if_fail (hash, NULL);
+	g_return_val_if_fail (size, NULL);
+
+	if (!xmms_bindata_hash_is_valid (hash)) {
+		return NULL;
+	}
+
+	xmms_error_reset (&err);
+
+	val = xmms_bindata_client_retrieve (global_bindata, hash, &err);
+	if (!val) {
+		return NULL;
+	}
+
+	if (xmmsv_get_bin (val, &data, &len)) {
+		ret = g_memdup (data, len);
+		*size = len;
+	}
+
+	xmmsv_unref (val);
+
+	return ret;
+}
+
+/**
+ * Check if there is binary data with a hash.
+ */
+gboolean
+xmms_bindata_plugin_has (const gchar *hash)
+{
+	gboolean exists;
+
+	g_return_val_if_fail (hash, FALSE);
+
+	g_mutex_lock (&global_bindata->mutex);
+	exists = g_hash_table_contains (global_bindata->hashes, hash);
+	g_mutex_unlock (&global_bindata->mutex);
+
+	return exists;
+}
+
+/**
+ * Start adding binary data from a plugin piece by piece, so it never
+ * has to be held in memory. The data goes to a temporary file and is
+ * hashed as it is written.
+ *
+ * @return A writer to pass to #xmms_bindata_plugin_writer_finish or
+ * #xmms_bindata_plugin_writer_abort, NULL if no file could be created.
+ */
+xmms_bindata_writer_t *
+xmms_bindata_plugin_writer_new (void)
+{
+	xmms_bindata_writer_t *writer;
+
+	writer = g_new0 (xmms_bindata_writer_t, 1);
+	writer->path = g_build_path (G_DIR_SEPARATOR_S, global_bindata->bindir,
+	                             XMMS_BINDATA_TMP_PREFIX "XXXXXX", NULL);
+
+	writer->fd = g_mkstemp (writer->path);
+	if (writer->fd == -1) {
+		xmms_log_error ("Couldn't create %s: %s", writer->path, g_strerror (errno));
+		g_free (writer->path);
+		g_free (writer);
+		return NULL;
+	}
+
+	writer->md5 = g_checksum_new (G_CHECKSUM_MD5);
+
+	return writer;
+}
+
+/**
+ * Append data to a writer. Errors are remembered and reported by
+ * #xmms_bindata_plugin_writer_finish.
+ */
+gboolean
+xmms_bindata_plugin_writer_write (xmms_bindata_writer_t *writer,
+                                  const guchar *data, gsize size)
+{
+	g_return_val_if_fail (writer, FALSE);
+
+	if (writer->failed) {
+		return FALSE;
+	}
+
+	g_checksum_update (writer->md5, data, size);
+
+	while (size > 0) {
+		gssize ret = write (writer->fd, data, size);
+		if (ret == -1 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			xmms_log_error ("Couldn't write %s: %s", writer->path, g_strerror (errno));
+			writer->failed = TRUE;
+			return FALSE;
+		}
+		data += ret;
+		size -= ret;
+	}
+
+	return TRUE;
+}
+
+static void
+xmms_bindata_writer_free (xmms_bindata_writer_t *writer)
+{
+	if (writer->fd != -1) {
+		close (writer->fd);
+	}
+	g_checksum_free (writer->md5);
+	g_free (writer->path);
+	g_free (writer);
+}
+
+/**
+ * Drop the data of a writer and free it.
+ */
+void
+xmms_bindata_plugin_writer_abort (xmms_bindata_writer_t *writer)
+{
+	g_return_if_fail (writer);
+
+	unlink (writer->path);
+	xmms_bindata_writer_free (writer);
+}
+
+/**
+ * Store the data of a writer under its hash and free the writer.
+ *
+ * @param writer The writer.
+ * @param hash Filled in with the hash of the data.
+ * @return TRUE if the data was stored, or already was.
+ */
+gboolean
+xmms_bindata_plugin_writer_finish (xmms_bindata_writer_t *writer, gchar hash[33])
+{
+	xmms_bindata_t *bindata = global_bindata;
+	gboolean exists;
 	gchar *path;
-	FILE *fp;
 
-	xmms_bindata_calculate_md5 (data, len, hash);
+	g_return_val_if_fail (writer, FALSE);
 
-	path = xmms_bindata_build_path (bindata, hash);
+	if (close (writer->fd) == -1) {
+		xmms_log_error ("Couldn't write %s: %s", writer->path, g_strerror (errno));
+		writer->failed = TRUE;
+	}
+	writer->fd = -1;
 
-	if (g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+	if (writer->failed) {
+		xmms_bindata_plugin_writer_abort (writer);
+		return FALSE;
+	}
+
+	g_strlcpy (hash, g_checksum_get_string (writer->md5), XMMS_BINDATA_HASH_LEN + 1);
+
+	g_mutex_lock (&bindata->mutex);
+	exists = g_hash_table_contains (bindata->hashes, hash);
+	g_mutex_unlock (&bindata->mutex);
+
+	if (exists) {
 		XMMS_DBG ("file %s is already in bindata dir", hash);
-		g_free (path);
+		xmms_bindata_plugin_writer_abort (writer);
 		return TRUE;
 	}
 
+	path = xmms_bindata_build_path (bindata, hash);
+
 	XMMS_DBG ("Creating %s", path);
-	fp = fopen (path, "wb");
-	if (!fp) {
-		xmms_log_error ("Couldn't create %s", path);
-		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't create file on server!");
+	if (!xmms_bindata_shard_create (path) || rename (writer->path, path) == -1) {
+		xmms_log_error ("Couldn't create %s: %s", path, g_strerror (errno));
+		xmms_bindata_plugin_writer_abort (writer);
 		g_free (path);
 		return FALSE;
 	}
 
-	/* write the data to the file */
-	ptr = data;
-	left = len;
+	g_free (path);
+	xmms_bindata_writer_free (writer);
 
-	while (left > 0) {
-		size_t w;
+	g_mutex_lock (&bindata->mutex);
+	g_hash_table_add (bindata->hashes, g_strdup (hash));
+	g_mutex_unlock (&bindata->mutex);
 
-		w = fwrite (ptr, 1, left, fp);
-		if (!w && ferror (fp)) {
-			fclose (fp);
-			unlink (path);
+	return TRUE;
+}
 
-			xmms_log_error ("Couldn't write data");
-			xmms_error_set (err, XMMS_ERROR_GENERIC,
-			                "Couldn't write data!");
-			g_free (path);
-			return FALSE;
-		}
+static gboolean
+_xmms_bindata_add (xmms_bindata_t *bindata, const guchar *data, gsize len, gchar hash[33], xmms_error_t *err)
+{
+	GError *error = NULL;
+	gboolean exists;
+	gchar *path;
+
+	xmms_bindata_calculate_md5 (data, len, hash);
+
+	g_mutex_lock (&bindata->mutex);
+	exists = g_hash_table_contains (bindata->hashes, hash);
+	g_mutex_unlock (&bindata->mutex);
+
+	if (exists) {
+		XMMS_DBG ("file %s is already in bindata dir", hash);
+		return TRUE;
+	}
+
+	path = xmms_bindata_build_path (bindata, hash);
 
-		left -= w;
-		ptr += w;
+	/* written to a temporary file and renamed, so a file with a hash
+	 * as its name is always complete */
+	XMMS_DBG ("Creating %s", path);
+	if (!xmms_bindata_shard_create (path) ||
+	    !g_file_set_contents (path, (const gchar *) data, len, &error)) {
+		xmms_log_error ("Couldn't create %s: %s", path,
+		                error ? error->message : g_strerror (errno));
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't create file on server!");
+		if (error) {
+			g_error_free (error);
+		}
+		g_free (path);
+		return FALSE;
 	}
 
-	fclose (fp);
 	g_free (path);
 
+	g_mutex_lock (&bindata->mutex);
+	g_hash_table_add (bindata->hashes, g_strdup (hash));
+	g_mutex_unlock (&bindata->mutex);
+
 	return TRUE;
 }
 
@@ -213,44 +537,38 @@ static xmmsv_t *
 xmms_bindata_client_retrieve (xmms_bindata_t *bindata, const gchar *hash,
                               xmms_error_t *err)
 {
+	GMappedFile *mapped;
+	GError *error = NULL;
+	gboolean exists;
 	xmmsv_t *res;
 	gchar *path;
-	GString *str;
-	FILE *fp;
 
-	path = xmms_bindata_build_path (bindata, hash);
+	g_mutex_lock (&bindata->mutex);
+	exists = g_hash_table_contains (bindata->hashes, hash);
+	g_mutex_unlock (&bindata->mutex);
 
-	fp = fopen (path, "rb");
-	if (!fp) {
+	if (!exists) {
 		xmms_log_error ("Requesting '%s' which is not on the server", hash);
 		xmms_error_set (err, XMMS_ERROR_NOENT, "File not found!");
-		g_free (path);
 		return NULL;
 	}
 
+	path = xmms_bindata_build_path (bindata, hash);
+	mapped = g_mapped_file_new (path, FALSE, &error);
 	g_free (path);
 
-	str = g_string_new (NULL);
-	while (!feof (fp)) {
-		gchar buf[1024];
-		gint l;
-
-		l = fread (buf, 1, 1024, fp);
-		if (ferror (fp)) {
-			g_string_free (str, TRUE);
-			xmms_log_error ("Error reading bindata '%s'", hash);
-			xmms_error_set (err, XMMS_ERROR_GENERIC, "Error reading file");
-			fclose (fp);
-			return NULL;
-		}
-		g_string_append_len (str, buf, l);
+	if (!mapped) {
+		xmms_log_error ("Error reading bindata '%s': %s", hash, error->message);
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Error reading file");
+		g_error_free (error);
+		return NULL;
 	}
 
-	fclose (fp);
+	/* copied once, straight from the page cache */
+	res = xmmsv_new_bin ((const unsigned char *) g_mapped_file_get_contents (mapped),
+	                     g_mapped_file_get_length (mapped));
 
-	res = xmmsv_new_bin ((unsigned char *)str->str, str->len);
-
-	g_string_free (str, TRUE);
+	g_mapped_file_unref (mapped);
 
 	return res;
 }
@@ -260,428 +578,284 @@ xmms_bindata_client_remove (xmms_bindata_t *bindata, const gchar *hash,
                             xmms_error_t *err)
 {
 	gchar *path;
+
+	g_mutex_lock (&bindata->mutex);
+
+	if (!g_hash_table_contains (bindata->hashes, hash)) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "File not found!");
+		g_mutex_unlock (&bindata->mutex);
+		return;
+	}
+
 	path = xmms_bindata_build_path (bindata, hash);
 	if (unlink (path) == -1) {
 		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't remove file");
+	} else {
+		g_hash_table_remove (bindata->hashes, hash);
 	}
 	g_free (path);
-	return;
+
+	g_mutex_unlock (&bindata->mutex);
 }
 
 static xmmsv_t *
 xmms_bindata_client_list (xmms_bindata_t *bindata, xmms_error_t *err)
 {
+	GHashTableIter iter;
 	xmmsv_t *entries;
-	gchar *path;
-	const gchar *file;
-	GDir *dir;
+	gpointer hash;
 
-	path = xmms_bindata_build_path (bindata, NULL);
-	dir = g_dir_open (path, 0, NULL);
-	g_free (path);
+	entries = xmmsv_new_list ();
 
-	if (!dir) {
-		xmms_error_set (err, XMMS_ERROR_GENERIC,
-		                "Couldn't open bindata directory");
-		return NULL;
+	g_mutex_lock (&bindata->mutex);
+
+	g_hash_table_iter_init (&iter, bindata->hashes);
+	while (g_hash_table_iter_next (&iter, &hash, NULL)) {
+		xmmsv_list_append_string (entries, hash);
 	}
 
-	entries = xmmsv_new_list ();
+	g_mutex_unlock (&bindata->mutex);
+
+	return entries;
+}
 
-	while ((file = g_dir_read_name (dir))) {
-		xmmsv_list_append_string (entries, file);
+static void
+xmms_bindata_scale_job_free (xmms_bindata_scale_job_t *job)
+{
+	g_free (job->hash);
+	g_free (job->format);
+	g_free (job);
+}
+
+/** Send the reply to a request whose reply was deferred. */
+static void
+xmms_bindata_reply (gint32 client, uint32_t cookie, xmmsv_t *val,
+                    xmms_error_t *err)
+{
+	xmms_ipc_msg_t *msg;
+	xmms_error_t senderr;
+
+	if (xmms_error_isok (err)) {
+		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_BINDATA, XMMS_IPC_COMMAND_REPLY);
+		xmms_ipc_msg_put_value (msg, val);
+	} else {
+		xmmsv_t *error = xmmsv_new_error (xmms_error_message_get (err));
+		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_BINDATA, XMMS_IPC_COMMAND_ERROR);
+		xmms_ipc_msg_put_value (msg, error);
+		xmmsv_unref (error);
 	}
 
-	g_dir_close (dir);
+	xmms_ipc_msg_set_cookie (msg, cookie);
 
-	return entries;
+	/* fails if the client went away meanwhile */
+	xmms_error_reset (&senderr);
+	xmms_ipc_send_message (client, msg, &senderr);
 }
 
-/*
-  Copyright (C) 1999, 2000, 2002 Aladdin Enterprises.  All rights reserved.
+static void
+xmms_bindata_scaled_key (const gchar *hash, gint32 size, const gchar *format,
+                         gchar key[33])
+{
+	gchar *name;
 
-  This software is provided 'as-is', without any express or implied
-  warranty.  In no event will the authors be held liable for any damages
-  arising from the use of this software.
+	name = g_strdup_printf ("scaled:%s:%d:%s", hash, size, format);
+	xmms_bindata_calculate_md5 ((const guchar *) name, strlen (name), key);
+	g_free (name);
+}
 
-  Permission is granted to anyone to use this software for any purpose,
-  including commercial applications, and to alter it and redistribute it
-  freely, subject to the following restrictions:
+#ifdef HAVE_GDK_PIXBUF
+/** Decode an image and encode it again scaled down to fit size x size. */
+static gboolean
+xmms_bindata_scale (const guchar *data, gsize len, gint32 size,
+                    const gchar *format, gchar **out, gsize *outlen,
+                    xmms_error_t *err)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf *pixbuf, *scaled;
+	GError *error = NULL;
+	gint width, height;
+	gboolean ret;
+
+	loader = gdk_pixbuf_loader_new ();
+	if (!gdk_pixbuf_loader_write (loader, data, len, &error) ||
+	    !gdk_pixbuf_loader_close (loader, &error)) {
+		xmms_log_error ("Couldn't decode image: %s", error->message);
+		xmms_error_set (err, XMMS_ERROR_INVAL, "Not an image");
+		g_error_free (error);
+		g_object_unref (loader);
+		return FALSE;
+	}
 
-  1. The origin of this software must not be misrepresented; you must not
-     claim that you wrote the original software. If you use this software
-     in a product, an acknowledgment in the product documentation would be
-     appreciated but is not required.
-  2. Altered source versions must be plainly marked as such, and must not be
-     misrepresented as being the original software.
-  3. This notice may not be removed or altered from any source distribution.
+	pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+	width = gdk_pixbuf_get_width (pixbuf);
+	height = gdk_pixbuf_get_height (pixbuf);
 
-  L. Peter Deutsch
-  ghost@aladdin.com
+	/* never scaled up, smaller ones are only converted */
+	if (width > size || height > size) {
+		if (width >= height) {
+			height = MAX (1, (gint64) height * size / width);
+			width = size;
+		} else {
+			width = MAX (1, (gint64) width * size / height);
+			height = size;
+		}
+	}
 
- */
-/* $Id: md5.c,v 1.6 2002/04/13 19:20:28 lpd Exp $ */
-/*
-  Independent implementation of MD5 (RFC 1321).
-
-  This code implements the MD5 Algorithm defined in RFC 1321, whose
-  text is available at
-	http://www.ietf.org/rfc/rfc1321.txt
-  The code is derived from the text of the RFC, including the test suite
-  (section A.5) but excluding the rest of Appendix A.  It does not include
-  any code or documentation that is identified in the RFC as being
-  copyrighted.
-
-  The original and principal author of md5.c is L. Peter Deutsch
-  <ghost@aladdin.com>.  Other authors are noted in the change history
-  that follows (in reverse chronological order):
-
-  2002-04-13 lpd Clarified derivation from RFC 1321; now handles byte order
-	either statically or dynamically; added missing #include <string.h>
-	in library.
-  2002-03-11 lpd Corrected argument list for main(), and added int return
-	type, in test program and T value program.
-  2002-02-21 lpd Added missing #include <stdio.h> in test program.
-  2000-07-03 lpd Patched to eliminate warnings about "constant is
-	unsigned in ANSI C, signed in traditional"; made test program
-	self-checking.
-  1999-11-04 lpd Edited comments slightly for automatic TOC extraction.
-  1999-10-18 lpd Fixed typo in header comment (ansi2knr rather than md5).
-  1999-05-03 lpd Original version.
- */
+	scaled = gdk_pixbuf_scale_simple (pixbuf, width, height, GDK_INTERP_BILINEAR);
+	g_object_unref (loader);
 
-/*
- * This package supports both compile-time and run-time determination of CPU
- * byte order.  If ARCH_IS_BIG_ENDIAN is defined as 0, the code will be
- * compiled to run only on little-endian CPUs; if ARCH_IS_BIG_ENDIAN is
- * defined as non-zero, the code will be compiled to run only on big-endian
- * CPUs; if ARCH_IS_BIG_ENDIAN is not defined, the code will be compiled to
- * run on either big- or little-endian CPUs, but will run slightly less
- * efficiently on either one than if ARCH_IS_BIG_ENDIAN is defined.
- */
+	/* jpeg has no alpha channel */
+	if (strcmp (format, "jpeg") == 0 && gdk_pixbuf_get_has_alpha (scaled)) {
+		GdkPixbuf *opaque;
 
-#undef BYTE_ORDER /* 1 = big-endian, -1 = little-endian, 0 = unknown */
-#ifdef ARCH_IS_BIG_ENDIAN
-#  define BYTE_ORDER (ARCH_IS_BIG_ENDIAN ? 1 : -1)
-#else
-#  define BYTE_ORDER 0
+		opaque = gdk_pixbuf_composite_color_simple (scaled, width, height,
+		                                            GDK_INTERP_NEAREST, 255,
+		                                            8, 0xffffff, 0xffffff);
+		g_object_unref (scaled);
+		scaled = opaque;
+	}
+
+	ret = gdk_pixbuf_save_to_buffer (scaled, out, outlen, format, &error, NULL);
+	if (!ret) {
+		xmms_log_error ("Couldn't encode image: %s", error->message);
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't encode image");
+		g_error_free (error);
+	}
+
+	g_object_unref (scaled);
+
+	return ret;
+}
 #endif
 
-#define T_MASK ((md5_word_t)~0)
-#define T1 /* 0xd76aa478 */ (T_MASK ^ 0x28955b87)
-#define T2 /* 0xe8c7b756 */ (T_MASK ^ 0x173848a9)
-#define T3    0x242070db
-#define T4 /* 0xc1bdceee */ (T_MASK ^ 0x3e423111)
-#define T5 /* 0xf57c0faf */ (T_MASK ^ 0x0a83f050)
-#define T6    0x4787c62a
-#define T7 /* 0xa8304613 */ (T_MASK ^ 0x57cfb9ec)
-#define T8 /* 0xfd469501 */ (T_MASK ^ 0x02b96afe)
-#define T9    0x698098d8
-#define T10 /* 0x8b44f7af */ (T_MASK ^ 0x74bb0850)
-#define T11 /* 0xffff5bb1 */ (T_MASK ^ 0x0000a44e)
-#define T12 /* 0x895cd7be */ (T_MASK ^ 0x76a32841)
-#define T13    0x6b901122
-#define T14 /* 0xfd987193 */ (T_MASK ^ 0x02678e6c)
-#define T15 /* 0xa679438e */ (T_MASK ^ 0x5986bc71)
-#define T16    0x49b40821
-#define T17 /* 0xf61e2562 */ (T_MASK ^ 0x09e1da9d)
-#define T18 /* 0xc040b340 */ (T_MASK ^ 0x3fbf4cbf)
-#define T19    0x265e5a51
-#define T20 /* 0xe9b6c7aa */ (T_MASK ^ 0x16493855)
-#define T21 /* 0xd62f105d */ (T_MASK ^ 0x29d0efa2)
-#define T22    0x02441453
-#define T23 /* 0xd8a1e681 */ (T_MASK ^ 0x275e197e)
-#define T24 /* 0xe7d3fbc8 */ (T_MASK ^ 0x182c0437)
-#define T25    0x21e1cde6
-#define T26 /* 0xc33707d6 */ (T_MASK ^ 0x3cc8f829)
-#define T27 /* 0xf4d50d87 */ (T_MASK ^ 0x0b2af278)
-#define T28    0x455a14ed
-#define T29 /* 0xa9e3e905 */ (T_MASK ^ 0x561c16fa)
-#define T30 /* 0xfcefa3f8 */ (T_MASK ^ 0x03105c07)
-#define T31    0x676f02d9
-#define T32 /* 0x8d2a4c8a */ (T_MASK ^ 0x72d5b375)
-#define T33 /* 0xfffa3942 */ (T_MASK ^ 0x0005c6bd)
-#define T34 /* 0x8771f681 */ (T_MASK ^ 0x788e097e)
-#define T35    0x6d9d6122
-#define T36 /* 0xfde5380c */ (T_MASK ^ 0x021ac7f3)
-#define T37 /* 0xa4beea44 */ (T_MASK ^ 0x5b4115bb)
-#define T38    0x4bdecfa9
-#define T39 /* 0xf6bb4b60 */ (T_MASK ^ 0x0944b49f)
-#define T40 /* 0xbebfbc70 */ (T_MASK ^ 0x4140438f)
-#define T41    0x289b7ec6
-#define T42 /* 0xeaa127fa */ (T_MASK ^ 0x155ed805)
-#define T43 /* 0xd4ef3085 */ (T_MASK ^ 0x2b10cf7a)
-#define T44    0x04881d05
-#define T45 /* 0xd9d4d039 */ (T_MASK ^ 0x262b2fc6)
-#define T46 /* 0xe6db99e5 */ (T_MASK ^ 0x1924661a)
-#define T47    0x1fa27cf8
-#define T48 /* 0xc4ac5665 */ (T_MASK ^ 0x3b53a99a)
-#define T49 /* 0xf4292244 */ (T_MASK ^ 0x0bd6ddbb)
-#define T50    0x432aff97
-#define T51 /* 0xab9423a7 */ (T_MASK ^ 0x546bdc58)
-#define T52 /* 0xfc93a039 */ (T_MASK ^ 0x036c5fc6)
-#define T53    0x655b59c3
-#define T54 /* 0x8f0ccc92 */ (T_MASK ^ 0x70f3336d)
-#define T55 /* 0xffeff47d */ (T_MASK ^ 0x00100b82)
-#define T56 /* 0x85845dd1 */ (T_MASK ^ 0x7a7ba22e)
-#define T57    0x6fa87e4f
-#define T58 /* 0xfe2ce6e0 */ (T_MASK ^ 0x01d3191f)
-#define T59 /* 0xa3014314 */ (T_MASK ^ 0x5cfebceb)
-#define T60    0x4e0811a1
-#define T61 /* 0xf7537e82 */ (T_MASK ^ 0x08ac817d)
-#define T62 /* 0xbd3af235 */ (T_MASK ^ 0x42c50dca)
-#define T63    0x2ad7d2bb
-#define T64 /* 0xeb86d391 */ (T_MASK ^ 0x14792c6e)
+/** Store data under a key that isn't its hash. */
+static gboolean
+xmms_bindata_store (xmms_bindata_t *bindata, const gchar *key,
+                    const gchar *data, gsize len, xmms_error_t *err)
+{
+	GError *error = NULL;
+	gchar *path;
+
+	path = xmms_bindata_build_path (bindata, key);
+
+	if (!xmms_bindata_shard_create (path) ||
+	    !g_file_set_contents (path, data, len, &error)) {
+		xmms_log_error ("Couldn't create %s: %s", path,
+		                error ? error->message : g_strerror (errno));
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Couldn't create file on server!");
+		if (error) {
+			g_error_free (error);
+		}
+		g_free (path);
+		return FALSE;
+	}
+
+	g_free (path);
 
+	g_mutex_lock (&bindata->mutex);
+	g_hash_table_add (bindata->hashes, g_strdup (key));
+	g_mutex_unlock (&bindata->mutex);
+
+	return TRUE;
+}
 
 static void
-md5_process (md5_state_t *pms, const md5_byte_t *data /*[64]*/)
+xmms_bindata_scale_worker (gpointer data, gpointer udata)
 {
-	md5_word_t
-	a = pms->abcd[0], b = pms->abcd[1],
-	c = pms->abcd[2], d = pms->abcd[3];
-	md5_word_t t;
-#if BYTE_ORDER > 0
-	/* Define storage only for big-endian CPUs. */
-	md5_word_t X[16];
-#else
-	/* Define storage for little-endian or both types of CPUs. */
-	md5_word_t xbuf[16];
-	const md5_word_t *X;
-#endif
+	xmms_bindata_scale_job_t *job = data;
+	xmms_bindata_t *bindata = udata;
+	xmmsv_t *val = NULL;
+	xmms_error_t err;
 
-	{
-#if BYTE_ORDER == 0
-	/*
-	 * Determine dynamically whether this is a big-endian or
-	 * little-endian machine, since we can use a more efficient
-	 * algorithm on the latter.
-	 */
-	static const int w = 1;
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	xmms_error_reset (&err);
+
+	/* an earlier job may have made it */
+	if (!xmms_bindata_plugin_has (job->key)) {
+#ifdef HAVE_GDK_PIXBUF
+		xmmsv_t *orig;
+		const guchar *bin;
+		gchar *out = NULL;
+		gsize outlen;
+		guint len;
+
+		orig = xmms_bindata_client_retrieve (bindata, job->hash, &err);
+		if (orig && xmmsv_get_bin (orig, &bin, &len) &&
+		    xmms_bindata_scale (bin, len, job->size, job->format,
+		                        &out, &outlen, &err)) {
+			XMMS_DBG ("Scaled %s to %d pixels as %s", job->hash,
+			          job->size, job->format);
+			xmms_bindata_store (bindata, job->key, out, outlen, &err);
+		}
 
-	if (*((const md5_byte_t *)&w)) /* dynamic little-endian */
-#endif
-#if BYTE_ORDER <= 0 /* little-endian */
-	{
-		/*
-		 * On little-endian machines, we can process properly aligned
-		 * data without copying it.
-		 */
-		if (!((data - (const md5_byte_t *)0) & 3)) {
-			/* data are properly aligned */
-			X = (const md5_word_t *)data;
-		} else {
-			/* not aligned */
-			memcpy (xbuf, data, 64);
-			X = xbuf;
+		if (orig) {
+			xmmsv_unref (orig);
 		}
-	}
-#endif
-#if BYTE_ORDER == 0
-	else /* dynamic big-endian */
+		g_free (out);
+#else
+		xmms_error_set (&err, XMMS_ERROR_NOENT,
+		                "Server was built without image scaling");
 #endif
-#if BYTE_ORDER >= 0 /* big-endian */
-	{
-		/*
-		 * On big-endian machines, we must arrange the bytes in the
-		 * right order.
-		 */
-		const md5_byte_t *xp = data;
-		int i;
-
-#  if BYTE_ORDER == 0
-		X = xbuf;/* (dynamic only) */
-#  else
-#    define xbuf X /* (static only) */
-#  endif
-		for (i = 0; i < 16; ++i, xp += 4)
-		xbuf[i] = xp[0] + (xp[1] << 8) + (xp[2] << 16) + (xp[3] << 24);
 	}
-#endif
+
+	if (xmms_error_isok (&err)) {
+		val = xmms_bindata_client_retrieve (bindata, job->key, &err);
 	}
 
-#define ROTATE_LEFT(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
-
-	/* Round 1. */
-	/* Let [abcd k s i] denote the operation
-	   a = b + ((a + F(b,c,d) + X[k] + T[i]) <<< s). */
-#define F(x, y, z) (((x) & (y)) | (~(x) & (z)))
-#define SET(a, b, c, d, k, s, Ti)\
-  t = a + F (b,c,d) + X[k] + Ti;\
-  a = ROTATE_LEFT (t, s) + b
-    /* Do the following 16 operations. */
-	SET (a, b, c, d,  0,  7,  T1);
-	SET (d, a, b, c,  1, 12,  T2);
-	SET (c, d, a, b,  2, 17,  T3);
-	SET (b, c, d, a,  3, 22,  T4);
-	SET (a, b, c, d,  4,  7,  T5);
-	SET (d, a, b, c,  5, 12,  T6);
-	SET (c, d, a, b,  6, 17,  T7);
-	SET (b, c, d, a,  7, 22,  T8);
-	SET (a, b, c, d,  8,  7,  T9);
-	SET (d, a, b, c,  9, 12, T10);
-	SET (c, d, a, b, 10, 17, T11);
-	SET (b, c, d, a, 11, 22, T12);
-	SET (a, b, c, d, 12,  7, T13);
-	SET (d, a, b, c, 13, 12, T14);
-	SET (c, d, a, b, 14, 17, T15);
-	SET (b, c, d, a, 15, 22, T16);
-#undef SET
-
-	/* Round 2. */
-	/* Let [abcd k s i] denote the operation
-	   a = b + ((a + G(b,c,d) + X[k] + T[i]) <<< s). */
-#define G(x, y, z) (((x) & (z)) | ((y) & ~(z)))
-#define SET(a, b, c, d, k, s, Ti)\
-  t = a + G (b,c,d) + X[k] + Ti;\
-  a = ROTATE_LEFT (t, s) + b
-     /* Do the following 16 operations. */
-	SET (a, b, c, d,  1,  5, T17);
-	SET (d, a, b, c,  6,  9, T18);
-	SET (c, d, a, b, 11, 14, T19);
-	SET (b, c, d, a,  0, 20, T20);
-	SET (a, b, c, d,  5,  5, T21);
-	SET (d, a, b, c, 10,  9, T22);
-	SET (c, d, a, b, 15, 14, T23);
-	SET (b, c, d, a,  4, 20, T24);
-	SET (a, b, c, d,  9,  5, T25);
-	SET (d, a, b, c, 14,  9, T26);
-	SET (c, d, a, b,  3, 14, T27);
-	SET (b, c, d, a,  8, 20, T28);
-	SET (a, b, c, d, 13,  5, T29);
-	SET (d, a, b, c,  2,  9, T30);
-	SET (c, d, a, b,  7, 14, T31);
-	SET (b, c, d, a, 12, 20, T32);
-#undef SET
-
-	/* Round 3. */
-	/* Let [abcd k s t] denote the operation
-	   a = b + ((a + H(b,c,d) + X[k] + T[i]) <<< s). */
-#define H(x, y, z) ((x) ^ (y) ^ (z))
-#define SET(a, b, c, d, k, s, Ti)\
-  t = a + H (b,c,d) + X[k] + Ti;\
-  a = ROTATE_LEFT (t, s) + b
-     /* Do the following 16 operations. */
-	SET (a, b, c, d,  5,  4, T33);
-	SET (d, a, b, c,  8, 11, T34);
-	SET (c, d, a, b, 11, 16, T35);
-	SET (b, c, d, a, 14, 23, T36);
-	SET (a, b, c, d,  1,  4, T37);
-	SET (d, a, b, c,  4, 11, T38);
-	SET (c, d, a, b,  7, 16, T39);
-	SET (b, c, d, a, 10, 23, T40);
-	SET (a, b, c, d, 13,  4, T41);
-	SET (d, a, b, c,  0, 11, T42);
-	SET (c, d, a, b,  3, 16, T43);
-	SET (b, c, d, a,  6, 23, T44);
-	SET (a, b, c, d,  9,  4, T45);
-	SET (d, a, b, c, 12, 11, T46);
-	SET (c, d, a, b, 15, 16, T47);
-	SET (b, c, d, a,  2, 23, T48);
-#undef SET
-
-	/* Round 4. */
-	/* Let [abcd k s t] denote the operation
-	   a = b + ((a + I(b,c,d) + X[k] + T[i]) <<< s). */
-#define I(x, y, z) ((y) ^ ((x) | ~(z)))
-#define SET(a, b, c, d, k, s, Ti)\
-  t = a + I (b,c,d) + X[k] + Ti;\
-  a = ROTATE_LEFT (t, s) + b
-     /* Do the following 16 operations. */
-	SET (a, b, c, d,  0,  6, T49);
-	SET (d, a, b, c,  7, 10, T50);
-	SET (c, d, a, b, 14, 15, T51);
-	SET (b, c, d, a,  5, 21, T52);
-	SET (a, b, c, d, 12,  6, T53);
-	SET (d, a, b, c,  3, 10, T54);
-	SET (c, d, a, b, 10, 15, T55);
-	SET (b, c, d, a,  1, 21, T56);
-	SET (a, b, c, d,  8,  6, T57);
-	SET (d, a, b, c, 15, 10, T58);
-	SET (c, d, a, b,  6, 15, T59);
-	SET (b, c, d, a, 13, 21, T60);
-	SET (a, b, c, d,  4,  6, T61);
-	SET (d, a, b, c, 11, 10, T62);
-	SET (c, d, a, b,  2, 15, T63);
-	SET (b, c, d, a,  9, 21, T64);
-#undef SET
-
-	/* Then perform the following additions. (That is increment each
-	    of the four registers by the value it had before this block
-	    was started.) */
-	pms->abcd[0] += a;
-	pms->abcd[1] += b;
-	pms->abcd[2] += c;
-	pms->abcd[3] += d;
-}
+	xmms_bindata_reply (job->client, job->cookie, val, &err);
 
-static void
-md5_init (md5_state_t *pms)
-{
-	pms->count[0] = pms->count[1] = 0;
-	pms->abcd[0] = 0x67452301;
-	pms->abcd[1] = /*0xefcdab89*/ T_MASK ^ 0x10325476;
-	pms->abcd[2] = /*0x98badcfe*/ T_MASK ^ 0x67452301;
-	pms->abcd[3] = 0x10325476;
+	if (val) {
+		xmmsv_unref (val);
+	}
+
+	xmms_bindata_scale_job_free (job);
 }
 
 static void
-md5_append (md5_state_t *pms, const md5_byte_t *data, int nbytes)
+xmms_bindata_client_retrieve_scaled (xmms_bindata_t *bindata, const gchar *hash,
+                                     gint32 size, const gchar *format,
+                                     gint32 client, uint32_t cookie,
+                                     xmms_error_t *err)
 {
-	const md5_byte_t *p = data;
-	int left = nbytes;
-	int offset = (pms->count[0] >> 3) & 63;
-	md5_word_t nbits = (md5_word_t)(nbytes << 3);
+	xmms_bindata_scale_job_t *job;
+	gchar key[33];
+	xmmsv_t *val;
 
-	if (nbytes <= 0)
+	if (!xmms_bindata_hash_is_valid (hash) || !xmms_bindata_plugin_has (hash)) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "File not found!");
 		return;
+	}
 
-	/* Update the message length. */
-	pms->count[1] += nbytes >> 29;
-	pms->count[0] += nbits;
-	if (pms->count[0] < nbits)
-		pms->count[1]++;
-
-	/* Process an initial partial block. */
-	if (offset) {
-		int copy = (offset + nbytes > 64 ? 64 - offset : nbytes);
+	if (size < XMMS_BINDATA_SCALED_MIN || size > XMMS_BINDATA_SCALED_MAX) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "Size out of range");
+		return;
+	}
 
-		memcpy (pms->buf + offset, p, copy);
-		if (offset + copy < 64)
-			return;
-		p += copy;
-		left -= copy;
-		md5_process (pms, pms->buf);
+	if (strcmp (format, "png") != 0 && strcmp (format, "jpeg") != 0) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "Unsupported image format");
+		return;
 	}
 
-	/* Process full blocks. */
-	for (; left >= 64; p += 64, left -= 64)
-		md5_process (pms, p);
+	xmms_bindata_scaled_key (hash, size, format, key);
 
-	/* Process a final partial block. */
-	if (left)
-		memcpy (pms->buf, p, left);
-}
+	/* made before, served like any other file */
+	if (xmms_bindata_plugin_has (key)) {
+		val = xmms_bindata_client_retrieve (bindata, key, err);
+		if (val) {
+			xmms_bindata_reply (client, cookie, val, err);
+			xmmsv_unref (val);
+		}
+		return;
+	}
 
-static void
-md5_finish (md5_state_t *pms, md5_byte_t digest[16])
-{
-	static const md5_byte_t pad[64] = {
-	    0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-	    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-	};
-	md5_byte_t data[8];
-	int i;
-
-	/* Save the length before padding. */
-	for (i = 0; i < 8; ++i)
-		data[i] = (md5_byte_t)(pms->count[i >> 2] >> ((i & 3) << 3));
-	/* Pad to 56 bytes mod 64. */
-	md5_append (pms, pad, ((55 - (pms->count[0] >> 3)) & 63) + 1);
-	/* Append the length. */
-	md5_append (pms, data, 8);
-	for (i = 0; i < 16; ++i)
-		digest[i] = (md5_byte_t)(pms->abcd[i >> 2] >> ((i & 3) << 3));
+	job = g_new0 (xmms_bindata_scale_job_t, 1);
+	job->hash = g_strdup (hash);
+	job->size = size;
+	job->format = g_strdup (format);
+	g_strlcpy (job->key, key, sizeof (job->key));
+	job->client = client;
+	job->cookie = cookie;
+
+	g_thread_pool_push (bindata->scaler, job, NULL);
 }
@@ -0,0 +1,314 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ *  A LRU cache of directory listings, keyed by their decoded url.
+ *
+ *  Listings are served for a time to live after they were made. Local
+ *  directories also remember their modification time and are only
+ *  served while it stays the same, so changes show up at once.
+ */
+
+#include <xmmspriv/xmms_browsecache.h>
+#include <xmmspriv/xmms_lru.h>
+#include <xmms/xmms_log.h>
+
+#include <glib/gstdio.h>
+#include <string.h>
+
+typedef struct xmms_browse_cache_entry_St {
+	/** When it was listed, in monotonic microseconds */
+	gint64 time;
+	/** Modification time of a local directory, -1 for others */
+	gint64 mtime;
+	/** The listing as serialized by xmmsv_serialize */
+	xmmsv_t *list;
+} xmms_browse_cache_entry_t;
+
+struct xmms_browse_cache_St {
+	GMutex mutex;
+	xmms_lru_t *lru;
+	/** In microseconds */
+	gint64 ttl;
+};
+
+static void
+xmms_browse_cache_entry_free (gpointer data)
+{
+	xmms_browse_cache_entry_t *entry = data;
+
+	xmmsv_unref (entry->list);
+	g_free (entry);
+}
+
+static gint64
+xmms_browse_cache_mtime (const gchar *key)
+{
+	GStatBuf st;
+
+	if (!g_str_has_prefix (key, "file://")) {
+		return -1;
+	}
+
+	if (g_stat (key + 7, &st) != 0) {
+		return -1;
+	}
+
+	return st.st_mtime;
+}
+
+/**
+ * Find an entry still within its time to live, should hold the cache
+ * mutex.
+ */
+static xmms_browse_cache_entry_t *
+xmms_browse_cache_find (xmms_browse_cache_t *cache, const gchar *key)
+{
+	xmms_browse_cache_entry_t *entry;
+
+	entry = xmms_lru_lookup (cache->lru, key);
+	if (entry && g_get_monotonic_time () - entry->time > cache->ttl) {
+		xmms_lru_remove (cache->lru, key);
+		entry = NULL;
+	}
+
+	return entry;
+}
+
+/**
+ * Create a cache.
+ *
+ * @param max_entries the number of listings to keep
+ * @param ttl how long a listing is served, in milliseconds
+ */
+xmms_browse_cache_t *
+xmms_browse_cache_new (guint max_entries, gint64 ttl)
+{
+	xmms_browse_cache_t *cache;
+
+	cache = g_new0 (xmms_browse_cache_t, 1);
+	g_mutex_init (&cache->mutex);
+	cache->lru = xmms_lru_new (g_str_hash, g_str_equal, g_free,
+	                           xmms_browse_cache_entry_free, max_entries);
+	cache->ttl = ttl * 1000;
+
+	return cache;
+}
+
+void
+xmms_browse_cache_free (xmms_browse_cache_t *cache)
+{
+	g_return_if_fail (cache);
+
+	xmms_lru_free (cache->lru);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+void
+xmms_browse_cache_configure (xmms_browse_cache_t *cache, guint max_entries,
+                             gint64 ttl)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_set_max_entries (cache->lru, max_entries);
+	cache->ttl = ttl * 1000;
+	g_mutex_unlock (&cache->mutex);
+}
+
+/**
+ * Get the key of a decoded url, the same with or without a trailing
+ * slash.
+ */
+gchar *
+xmms_browse_cache_key (const gchar *url)
+{
+	const gchar *root;
+	gsize len;
+
+	g_return_val_if_fail (url, NULL);
+
+	len = strlen (url);
+
+	/* keep the slash of file:/// */
+	root = strstr (url, "://");
+	root = root ? root + 4 : url + 1;
+
+	while (len > 0 && url + len > root && url[len - 1] == '/') {
+		len--;
+	}
+
+	return g_strndup (url, len);
+}
+
+/**
+ * Look up the listing of a directory.
+ *
+ * @returns A new listing owned by the caller, or NULL on a miss.
+ */
+xmmsv_t *
+xmms_browse_cache_lookup (xmms_browse_cache_t *cache, const gchar *key)
+{
+	xmms_browse_cache_entry_t *entry;
+	xmmsv_t *ret = NULL;
+
+	g_return_val_if_fail (cache, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	g_mutex_lock (&cache->mutex);
+
+	entry = xmms_browse_cache_find (cache, key);
+	if (entry && g_str_has_prefix (key, "file://")) {
+		gint64 mtime;
+
+		/* not under the lock, it may be a slow mount */
+		g_mutex_unlock (&cache->mutex);
+		mtime = xmms_browse_cache_mtime (key);
+		g_mutex_lock (&cache->mutex);
+
+		/* it may have been replaced or dropped meanwhile */
+		entry = xmms_browse_cache_find (cache, key);
+		if (entry && entry->mtime != mtime) {
+			xmms_lru_remove (cache->lru, key);
+			entry = NULL;
+		}
+	}
+
+	if (entry) {
+		ret = xmmsv_deserialize (entry->list);
+	}
+
+	xmms_lru_account (cache->lru, ret != NULL);
+
+	g_mutex_unlock (&cache->mutex);
+
+	return ret;
+}
+
+/**
+ * Remember the listing of a directory. The listing isn't kept, a
+ * serialized copy is.
+ */
+void
+xmms_browse_cache_insert (xmms_browse_cache_t *cache, const gchar *key,
+                          xmmsv_t *list)
+{
+	xmms_browse_cache_entry_t *entry;
+	xmmsv_t *serialized;
+	gint64 mtime;
+
+	g_return_if_fail (cache);
+	g_return_if_fail (key);
+	g_return_if_fail (list);
+
+	if (!xmms_lru_get_max_entries (cache->lru) || cache->ttl <= 0) {
+		return;
+	}
+
+	/* taken before the lock, it may be a slow mount */
+	mtime = xmms_browse_cache_mtime (key);
+
+	serialized = xmmsv_serialize (list);
+	if (!serialized) {
+		return;
+	}
+
+	entry = g_new0 (xmms_browse_cache_entry_t, 1);
+	entry->time = g_get_monotonic_time ();
+	entry->mtime = mtime;
+	entry->list = serialized;
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_insert (cache->lru, g_strdup (key), entry);
+	g_mutex_unlock (&cache->mutex);
+}
+
+typedef struct {
+	const gchar *key;
+	gsize len;
+	gchar *dir;
+} xmms_browse_cache_invalidation_t;
+
+static gboolean
+xmms_browse_cache_invalidated (gpointer key, gpointer value, gpointer udata)
+{
+	xmms_browse_cache_invalidation_t *inv = udata;
+	const gchar *k = key;
+
+	/* a key only ends in a slash at the root */
+	return (strncmp (k, inv->key, inv->len) == 0 &&
+	        (k[inv->len] == '\0' || k[inv->len] == '/' ||
+	         (inv->len && inv->key[inv->len - 1] == '/'))) ||
+	       (inv->dir && strcmp (k, inv->dir) == 0);
+}
+
+/**
+ * Forget the listings of a directory and of all below it, and if
+ * parent is set, of the directory it is in, for when something was
+ * added or removed there.
+ */
+void
+xmms_browse_cache_invalidate (xmms_browse_cache_t *cache, const gchar *key,
+                              gboolean parent)
+{
+	xmms_browse_cache_invalidation_t inv = { key, 0, NULL };
+	const gchar *slash;
+
+	g_return_if_fail (cache);
+	g_return_if_fail (key);
+
+	inv.len = strlen (key);
+
+	slash = strrchr (key, '/');
+	if (parent && slash) {
+		gchar *t = g_strndup (key, slash - key + 1);
+		inv.dir = xmms_browse_cache_key (t);
+		g_free (t);
+	}
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_foreach_remove (cache->lru, xmms_browse_cache_invalidated, &inv);
+	g_mutex_unlock (&cache->mutex);
+
+	g_free (inv.dir);
+}
+
+/**
+ * Forget all listings.
+ */
+void
+xmms_browse_cache_clear (xmms_browse_cache_t *cache)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_remove_all (cache->lru);
+	g_mutex_unlock (&cache->mutex);
+}
+
+void
+xmms_browse_cache_stats (xmms_browse_cache_t *cache, guint *hits,
+                         guint *misses, guint *entries)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_stats (cache->lru, hits, misses, entries);
+	g_mutex_unlock (&cache->mutex);
+}
@@ -30,9 +30,21 @@
 #include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_streamtype.h>
 #include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_querycache.h>
+#include <xmmspriv/xmms_memstat.h>
+#include <xmmspriv/xmms_footprint.h>
+#include <xmmspriv/xmms_mediasampler.h>
 #include <xmms/xmms_ipc.h>
+#include <xmms/xmms_config.h>
 #include <xmms/xmms_log.h>
 
+/** Number of party shuffle sources to keep id sets for */
+#define XMMS_COLLECTION_SAMPLER_SETS 4
+
+/** Number of materialized collections to keep id sets for */
+#define XMMS_COLLECTION_MATERIALIZED_SETS 16
+#define XMMS_COLLECTION_BOUND_KEYS 64
+
 
 /* Internal helper structures */
 
@@ -66,11 +78,25 @@ typedef struct {
 	xmmsv_t *value;
 } coll_table_pair_t;
 
-typedef enum {
-	XMMS_COLLECTION_FIND_STATE_UNCHECKED,
-	XMMS_COLLECTION_FIND_STATE_MATCH,
-	XMMS_COLLECTION_FIND_STATE_NOMATCH,
-} coll_find_state_t;
+/** A query result kept on the server and handed out in pages. */
+typedef struct {
+	xmmsv_t *ids;
+	xmmsv_t *fetch;
+	gint pos;
+	gint64 last_used;
+	/** Accounted to the medialib results while it is kept */
+	gsize size;
+} coll_query_cursor_t;
+
+/** The query key of a bound source, valid while no collection changed */
+typedef struct {
+	gint generation;
+	GBytes *key;
+} coll_bound_key_t;
+
+/* Cursors are not tied to a client, so unused ones expire. */
+#define XMMS_COLLECTION_CURSOR_MAX 32
+#define XMMS_COLLECTION_CURSOR_IDLE (300 * G_TIME_SPAN_SECOND)
 
 typedef struct add_metadata_from_tree_user_data_St {
 	xmms_medialib_entry_t entry;
@@ -87,6 +113,10 @@ static gboolean xmms_collection_validate (xmms_coll_dag_t *dag, xmmsv_t *coll, c
 static gboolean xmms_collection_validate_recurs (xmms_coll_dag_t *dag, xmmsv_t *coll, const gchar *save_name, const gchar *save_namespace, const gchar **err);
 static gboolean xmms_collection_unreference (xmms_coll_dag_t *dag, const gchar *name, xmms_collection_namespace_id_t nsid);
 
+static xmmsv_t *xmms_collection_load_deferred (xmms_coll_dag_t *dag, const gchar *collname, xmms_collection_namespace_id_t nsid);
+static void xmms_collection_load_all (xmms_coll_dag_t *dag);
+static void xmms_collection_foreach_name_in_namespace (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, GHFunc f, void *udata);
+
 static gboolean xmms_collection_has_reference_to (xmms_coll_dag_t *dag, xmmsv_t *coll, const gchar *tg_name, const gchar *tg_ns);
 
 static void xmms_collection_apply_to_collection_recurs (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, FuncApplyToColl f, void *udata);
@@ -101,27 +131,92 @@ static void strip_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *pare
 static void check_for_reference (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
 static void bind_all_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
 static void unbind_all_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
+static void materialize_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata);
 
 static void coll_unref (void *coll);
+static void coll_query_cursor_free (gpointer data);
+static void coll_bound_key_free (gpointer data);
+static GBytes *xmms_collection_bound_key (xmms_coll_dag_t *dag, xmmsv_t *source, xmmsv_t *spec);
+static xmmsv_t *xmms_collection_bound_from_key (GBytes *key);
 
-static void build_match_table (gpointer key, gpointer value, gpointer udata);
-static gboolean find_unchecked (gpointer name, gpointer value, gpointer udata);
-static void build_list_matches (gpointer key, gpointer value, gpointer udata);
 
 static xmmsv_t * xmms_collection_client_get (xmms_coll_dag_t *dag, const gchar *collname, const gchar *namespace, xmms_error_t *error);
 static xmmsv_t * xmms_collection_client_list (xmms_coll_dag_t *dag, const gchar *namespace, xmms_error_t *error);
 static void xmms_collection_client_save (xmms_coll_dag_t *dag, const gchar *name, const gchar *namespace, xmmsv_t *coll, xmms_error_t *error);
 static void xmms_collection_client_remove (xmms_coll_dag_t *dag, const gchar *collname, const gchar *namespace, xmms_error_t *error);
+static void xmms_collection_members_clear (xmms_coll_dag_t *dag);
+static void xmms_collection_members_find (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t nsid, xmms_medialib_entry_t entry, xmmsv_t *list);
+static void collect_dynamic (gpointer key, gpointer value, gpointer udata);
 static xmmsv_t * xmms_collection_client_find (xmms_coll_dag_t *dag, gint32 mid, const gchar *namespace, xmms_error_t *error);
 static void xmms_collection_client_rename (xmms_coll_dag_t *dag, const gchar *from_name, const gchar *to_name, const gchar *namespace, xmms_error_t *error);
 
 static xmmsv_t * xmms_collection_client_query_infos (xmms_coll_dag_t *dag, xmmsv_t *coll, int limit_start, int limit_len, xmmsv_t *fetch, xmmsv_t *group, xmms_error_t *err);
 static xmmsv_t * xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
+static xmmsv_t *xmms_collection_query_unbounded (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
 static xmmsv_t *xmms_collection_client_idlist_from_playlist (xmms_coll_dag_t *dag, const gchar *mediainfo, xmms_error_t *err);
+static gint32 xmms_collection_client_query_cursor_open (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *fetch, xmms_error_t *err);
+static xmmsv_t *xmms_collection_client_query_cursor_next (xmms_coll_dag_t *dag, gint32 id, gint32 count, xmms_error_t *err);
+static void xmms_collection_client_query_cursor_close (xmms_coll_dag_t *dag, gint32 id, xmms_error_t *err);
 
 
 #include "collection_ipc.c"
 
+
+
+/** @defgroup Collection Collection
+  * @ingroup XMMSServer
+  * @brief This is the collection manager.
+  *
+  * The set of collections is stored as a DAG of collection operators.
+  * Each collection namespace contains a list of saved collections,
+  * with a pointer to the node in the graph.
+  *
+  * A saved collection with the "materialized" attribute set to "1" has
+  * its ids kept in a set that follows the medialib, and references to
+  * it are queried as that set instead of evaluating the collection.
+  * @{
+  */
+
+/** Collection DAG structure */
+
+struct xmms_coll_dag_St {
+	xmms_object_t object;
+
+	GHashTable *collrefs[XMMS_COLLECTION_NUM_NAMESPACES];
+
+	/** Restored collections still in serialized form, by name */
+	GHashTable *deferred[XMMS_COLLECTION_NUM_NAMESPACES];
+
+	GMutex mutex;
+
+	xmms_medialib_t *medialib;
+
+	xmms_query_cache_t *query_cache;
+
+	/** Id sets of party shuffle sources */
+	xmms_media_sampler_t *sampler;
+
+	/** Id sets of materialized collections, keyed by their content so
+	 *  changing one or what it references makes a new set */
+	xmms_media_sampler_t *materialized;
+
+	/** Names of the idlists holding each entry, per namespace, built
+	 *  when first needed and dropped when a collection changes */
+	GHashTable *members[XMMS_COLLECTION_NUM_NAMESPACES];
+	GMutex members_mutex;
+
+	/** Bumped whenever a collection changes */
+	gint generation;
+
+	/** Query keys of bound sources by the source, for the sources
+	 *  random media are picked from again and again */
+	GHashTable *bound_keys;
+
+	GMutex cursor_mutex;
+	GHashTable *cursors;
+	gint32 next_cursor_id;
+};
+
 xmmsv_t *
 xmms_collection_changed_msg_new (xmms_collection_changed_action_t type,
                                  const gchar *plname, const gchar *namespace)
@@ -138,6 +233,12 @@ xmms_collection_changed_msg_send (xmms_coll_dag_t *colldag, xmmsv_t *dict)
 	g_return_if_fail (colldag);
 	g_return_if_fail (dict);
 
+	/* cached results may depend on the changed collection */
+	g_atomic_int_inc (&colldag->generation);
+	xmms_query_cache_clear (colldag->query_cache);
+	xmms_media_sampler_clear (colldag->sampler);
+	xmms_collection_members_clear (colldag);
+
 	xmms_object_emit (XMMS_OBJECT (colldag),
 	                  XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
 	                  dict);
@@ -145,28 +246,41 @@ xmms_collection_changed_msg_send (xmms_coll_dag_t *colldag, xmmsv_t *dict)
 
 #define XMMS_COLLECTION_CHANGED_MSG(type, name, namespace) xmms_collection_changed_msg_send (dag, xmms_collection_changed_msg_new (type, name, namespace))
 
+static void
+on_medialib_entry_changed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
+	gint32 entry;
 
-/** @defgroup Collection Collection
-  * @ingroup XMMSServer
-  * @brief This is the collection manager.
-  *
-  * The set of collections is stored as a DAG of collection operators.
-  * Each collection namespace contains a list of saved collections,
-  * with a pointer to the node in the graph.
-  * @{
-  */
-
-/** Collection DAG structure */
+	if (xmmsv_get_int32 (val, &entry)) {
+		xmms_media_sampler_entry_changed (dag->sampler, entry);
+		xmms_media_sampler_entry_changed (dag->materialized, entry);
+	}
+}
 
-struct xmms_coll_dag_St {
-	xmms_object_t object;
+static void
+on_medialib_entry_removed (xmms_object_t *object, xmmsv_t *val, gpointer udata)
+{
+	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
+	gint32 entry;
 
-	GHashTable *collrefs[XMMS_COLLECTION_NUM_NAMESPACES];
+	if (xmmsv_get_int32 (val, &entry)) {
+		xmms_media_sampler_entry_removed (dag->sampler, entry);
+		xmms_media_sampler_entry_removed (dag->materialized, entry);
+	}
+}
 
-	GMutex mutex;
+static void
+xmms_collection_query_cache_size_changed (xmms_object_t *object,
+                                          xmmsv_t *data,
+                                          gpointer udata)
+{
+	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
+	gint size;
 
-	xmms_medialib_t *medialib;
-};
+	size = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	xmms_query_cache_set_max_entries (dag->query_cache, MAX (size, 0));
+}
 
 /** Initializes a new xmms_coll_dag_t.
  *
@@ -176,6 +290,7 @@ xmms_coll_dag_t *
 xmms_collection_init (xmms_medialib_t *medialib)
 {
 	xmms_coll_dag_t *ret;
+	xmms_config_property_t *cfg;
 	gint i;
 
 	ret = xmms_object_new (xmms_coll_dag_t, xmms_collection_destroy);
@@ -184,9 +299,37 @@ xmms_collection_init (xmms_medialib_t *medialib)
 	xmms_object_ref (medialib);
 	ret->medialib = medialib;
 
+	/* 0 disables the query cache */
+	cfg = xmms_config_property_register ("collection.query_cache_size", "128",
+	                                     xmms_collection_query_cache_size_changed,
+	                                     ret);
+	ret->query_cache = xmms_query_cache_new (MAX (xmms_config_property_get_int (cfg), 0));
+
+	ret->sampler = xmms_media_sampler_new (XMMS_COLLECTION_SAMPLER_SETS);
+	ret->materialized = xmms_media_sampler_new (XMMS_COLLECTION_MATERIALIZED_SETS);
+	ret->bound_keys = g_hash_table_new_full (NULL, NULL, coll_unref,
+	                                         coll_bound_key_free);
+	g_mutex_init (&ret->members_mutex);
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_ADDED,
+	                     on_medialib_entry_changed, ret);
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                     on_medialib_entry_changed, ret);
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
+	                     on_medialib_entry_removed, ret);
+
+	g_mutex_init (&ret->cursor_mutex);
+	ret->cursors = g_hash_table_new_full (NULL, NULL, NULL,
+	                                      coll_query_cursor_free);
+	ret->next_cursor_id = 1;
+
 	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
 		ret->collrefs[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
 		                                          g_free, coll_unref);
+		ret->deferred[i] = g_hash_table_new_full (g_str_hash, g_str_equal,
+		                                          g_free, coll_unref);
 	}
 
 	xmms_collection_register_ipc_commands (XMMS_OBJECT (ret));
@@ -499,8 +642,10 @@ xmms_collection_client_list (xmms_coll_dag_t *dag, const gchar *namespace,
 
 	g_mutex_lock (&dag->mutex);
 
-	/* Get the list of collections in the given namespace */
-	xmms_collection_foreach_in_namespace (dag, nsid, prepend_key_string, result);
+	/* Get the list of collections in the given namespace, without loading
+	 * the ones that are still deferred.
+	 */
+	xmms_collection_foreach_name_in_namespace (dag, nsid, prepend_key_string, result);
 
 	g_mutex_unlock (&dag->mutex);
 
@@ -521,11 +666,10 @@ xmms_collection_client_find (xmms_coll_dag_t *dag, gint32 mid, const gchar *name
                              xmms_error_t *err)
 {
 	xmms_collection_namespace_id_t nsid;
-	xmmsv_t *result;
-	gchar *open_name;
-	GHashTable *match_table;
-	xmmsv_t *coll, *filter_coll;
-	xmmsv_t *idlist;
+	xmmsv_t *result, *dynamic, *filter_coll;
+	xmmsv_dict_iter_t *it;
+	const gchar *name;
+	xmmsv_t *coll;
 
 	/* Verify namespace */
 	nsid = xmms_collection_get_namespace_id (namespace);
@@ -538,40 +682,46 @@ xmms_collection_client_find (xmms_coll_dag_t *dag, gint32 mid, const gchar *name
 		return NULL;
 	}
 
-	/* Prepare the match table of all collections for the given namespace */
-	match_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
-	xmms_collection_foreach_in_namespace (dag, nsid, build_match_table, match_table);
+	result = xmmsv_new_list ();
+	dynamic = xmmsv_new_dict ();
 
+	g_mutex_lock (&dag->mutex);
+
+	/* idlists are looked up, the others are queried below */
+	xmms_collection_load_all (dag);
+	xmms_collection_members_find (dag, nsid, mid, result);
+	g_hash_table_foreach (dag->collrefs[nsid], collect_dynamic, dynamic);
+
+	g_mutex_unlock (&dag->mutex);
+
+	/* only match the entry, not all of the collection */
 	filter_coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
 	xmmsv_coll_attribute_set_string (filter_coll, "type", "id");
 	xmms_collection_set_int_attr (filter_coll, "value", mid);
 
-	/* While not all collections have been checked, check next */
-	while (g_hash_table_find (match_table, find_unchecked, &open_name) != NULL) {
-		coll_find_state_t *match = g_new (coll_find_state_t, 1);
-		coll = xmms_collection_get_pointer (dag, open_name, nsid);
+	xmmsv_get_dict_iter (dynamic, &it);
+	for (; xmmsv_dict_iter_pair (it, &name, &coll); xmmsv_dict_iter_next (it)) {
+		xmmsv_t *idlist;
 
 		xmmsv_coll_add_operand (filter_coll, coll);
-		idlist = xmms_collection_query_ids (dag, coll, err);
+		idlist = xmms_collection_query_ids (dag, filter_coll, err);
+		xmmsv_coll_remove_operand (filter_coll, coll);
+
+		if (!idlist) {
+			xmmsv_unref (result);
+			result = NULL;
+			break;
+		}
 
 		if (xmmsv_list_get_size (idlist) > 0) {
-			*match = XMMS_COLLECTION_FIND_STATE_MATCH;
-		} else {
-			*match = XMMS_COLLECTION_FIND_STATE_NOMATCH;
+			xmmsv_list_append_string (result, name);
 		}
 
 		xmmsv_unref (idlist);
-		xmmsv_coll_remove_operand (filter_coll, coll);
-		g_hash_table_replace (match_table, g_strdup (open_name), match);
 	}
 
 	xmmsv_unref (filter_coll);
-
-	result = xmmsv_new_list ();
-
-	/* List matching collections */
-	g_hash_table_foreach (match_table, build_list_matches, result);
-	g_hash_table_destroy (match_table);
+	xmmsv_unref (dynamic);
 
 	return result;
 }
@@ -605,6 +755,9 @@ xmms_collection_client_rename (xmms_coll_dag_t *dag, const gchar *from_name,
 
 	g_mutex_lock (&dag->mutex);
 
+	/* References to the old name may hide in collections not loaded yet. */
+	xmms_collection_load_all (dag);
+
 	from_coll = xmms_collection_get_pointer (dag, from_name, nsid);
 	to_coll   = xmms_collection_get_pointer (dag, to_name, nsid);
 
@@ -638,6 +791,26 @@ xmms_collection_client_rename (xmms_coll_dag_t *dag, const gchar *from_name,
 
 }
 
+/** The fetch spec for a list of the ids in a collection. */
+static xmmsv_t *
+xmms_collection_ids_spec (void)
+{
+	xmmsv_t *metadata, *get;
+
+	get = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("id"),
+	                        XMMSV_LIST_END);
+
+	metadata = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "metadata"),
+	                             XMMSV_DICT_ENTRY_STR ("aggregate", "first"),
+	                             XMMSV_DICT_ENTRY ("get", get),
+	                             XMMSV_DICT_END);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "cluster-list"),
+	                         XMMSV_DICT_ENTRY_STR ("cluster-by", "position"),
+	                         XMMSV_DICT_ENTRY ("data", metadata),
+	                         XMMSV_DICT_END);
+}
+
 /** Find the ids of the media matched by a collection.
  *
  * @param dag  The collection DAG.
@@ -652,22 +825,10 @@ xmmsv_t *
 xmms_collection_query_ids (xmms_coll_dag_t *dag, xmmsv_t *coll,
                            xmms_error_t *err)
 {
-	xmmsv_t *ret, *spec, *metadata, *get;
+	xmmsv_t *ret, *spec;
 
-	get = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("id"),
-	                        XMMSV_LIST_END);
-
-	metadata = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "metadata"),
-	                             XMMSV_DICT_ENTRY_STR ("aggregate", "first"),
-	                             XMMSV_DICT_ENTRY ("get", get),
-	                             XMMSV_DICT_END);
-
-	spec = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("type", "cluster-list"),
-	                         XMMSV_DICT_ENTRY_STR ("cluster-by", "position"),
-	                         XMMSV_DICT_ENTRY ("data", metadata),
-	                         XMMSV_DICT_END);
-
-	ret = xmms_collection_client_query (dag, coll, spec, err);
+	spec = xmms_collection_ids_spec ();
+	ret = xmms_collection_query_unbounded (dag, coll, spec, err);
 	xmmsv_unref (spec);
 
 	return ret;
@@ -792,7 +953,7 @@ xmms_collection_client_query_infos (xmms_coll_dag_t *dag, xmmsv_t *coll,
 	xmmsv_unref (limited);
 	xmmsv_unref (spec);
 
-	if (xmmsv_list_get_size (group) > 0) {
+	if (unflattened && xmmsv_list_get_size (group) > 0) {
 		ret = xmmsv_list_flatten (unflattened, xmmsv_list_get_size (group) - 1);
 		xmmsv_unref (unflattened);
 	} else {
@@ -804,14 +965,43 @@ xmms_collection_client_query_infos (xmms_coll_dag_t *dag, xmmsv_t *coll,
 	return ret;
 }
 
-xmmsv_t *
-xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
-                              xmmsv_t *fetch, xmms_error_t *err)
+/**
+ * Bind the references of coll and return a deep copy of it, so the
+ * medialib can be queried without holding the dag mutex while other
+ * threads keep changing the DAG. References to materialized
+ * collections are bound to their id sets in the copy, materialized is
+ * set if there were any.
+ */
+static xmmsv_t *
+xmms_collection_bind_copy (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                           gboolean *materialized)
+{
+	xmmsv_t *ret;
+
+	g_mutex_lock (&dag->mutex);
+	xmms_collection_apply_to_collection (dag, coll, bind_all_references, NULL);
+	ret = xmmsv_copy (coll);
+	g_mutex_unlock (&dag->mutex);
+
+	xmms_collection_apply_to_collection (dag, ret, materialize_references,
+	                                     materialized);
+
+	return ret;
+}
+
+/**
+ * Query the medialib for the media matched by coll, however many.
+ */
+static xmmsv_t *
+xmms_collection_query_unbounded (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                                 xmmsv_t *fetch, xmms_error_t *err)
 {
 	const gchar *valerr = "Invalid collection: unknown reason. This is "
 	                      "probably a bug in xmms2d.";
 	xmms_medialib_session_t *session;
-	xmmsv_t *ret;
+	xmmsv_t *bound, *ret = NULL;
+	GBytes *key;
+	guint generation;
 
 	/* validate the collection to query */
 	if (!xmms_collection_validate (dag, coll, NULL, NULL, &valerr)) {
@@ -821,18 +1011,260 @@ xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
 		return NULL;
 	}
 
+	bound = xmms_collection_bind_copy (dag, coll, NULL);
+
+	/* taken before querying, so a write committed meanwhile makes
+	 * the stored result stale right away */
+	generation = xmms_medialib_generation_get (dag->medialib);
+
+	key = xmms_query_cache_key (bound, fetch);
+	if (key) {
+		ret = xmms_query_cache_lookup (dag->query_cache, key, generation);
+	}
+
+	if (!ret) {
+		do {
+			session = xmms_medialib_session_begin_ro (dag->medialib);
+			ret = xmms_medialib_query (session, bound, fetch, err);
+		} while (!xmms_medialib_session_commit (session));
+
+		if (ret && key) {
+			xmms_query_cache_insert (dag->query_cache, key, generation, ret);
+		}
+	}
+
+	if (key) {
+		g_bytes_unref (key);
+	}
+
+	xmmsv_unref (bound);
+
+	return ret;
+}
+
+/**
+ * Query the medialib for a client. In the small footprint mode lists
+ * longer than core.small_footprint_query_results are refused, the
+ * client has to page through them.
+ */
+static xmmsv_t *
+xmms_collection_client_query (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                              xmmsv_t *fetch, xmms_error_t *err)
+{
+	xmmsv_t *ret;
+	gint max;
+
+	ret = xmms_collection_query_unbounded (dag, coll, fetch, err);
+
+	max = xmms_footprint_limit (XMMS_FOOTPRINT_QUERY_RESULTS);
+	if (ret && max && xmmsv_is_type (ret, XMMSV_TYPE_LIST) &&
+	    xmmsv_list_get_size (ret) > max) {
+		xmms_error_set (err, XMMS_ERROR_INVAL,
+		                "Too many results, use a limit or a query cursor");
+		xmmsv_unref (ret);
+		ret = NULL;
+	}
+
+	return ret;
+}
+
+static void
+coll_query_cursor_free (gpointer data)
+{
+	coll_query_cursor_t *cursor = (coll_query_cursor_t *) data;
+
+	xmms_memstat_sub (XMMS_MEMSTAT_MEDIALIB_RESULTS, cursor->size);
+	xmmsv_unref (cursor->ids);
+	xmmsv_unref (cursor->fetch);
+	g_free (cursor);
+}
+
+/**
+ * Drop idle cursors, and the least recently used one if there is still
+ * no room for another. Must be called with cursor_mutex held.
+ */
+static void
+xmms_collection_cursors_expire (xmms_coll_dag_t *dag, gint64 now)
+{
+	coll_query_cursor_t *cursor;
+	GHashTableIter iter;
+	gpointer key, value, oldest = NULL;
+	gint64 oldest_used = G_MAXINT64;
+
+	g_hash_table_iter_init (&iter, dag->cursors);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		cursor = (coll_query_cursor_t *) value;
+		if (now - cursor->last_used > XMMS_COLLECTION_CURSOR_IDLE) {
+			g_hash_table_iter_remove (&iter);
+		} else if (cursor->last_used < oldest_used) {
+			oldest_used = cursor->last_used;
+			oldest = key;
+		}
+	}
+
+	if (oldest && g_hash_table_size (dag->cursors) >= XMMS_COLLECTION_CURSOR_MAX) {
+		XMMS_DBG ("Too many query cursors, dropping cursor %d",
+		          GPOINTER_TO_INT (oldest));
+		g_hash_table_remove (dag->cursors, oldest);
+	}
+}
+
+/**
+ * Resolve the ordered ids matched by a collection and keep them, so
+ * that the fetch can later be applied to one page at a time.
+ *
+ * @returns The id of the cursor to pass to query_cursor_next.
+ */
+static gint32
+xmms_collection_client_query_cursor_open (xmms_coll_dag_t *dag, xmmsv_t *coll,
+                                          xmmsv_t *fetch, xmms_error_t *err)
+{
+	coll_query_cursor_t *cursor;
+	xmmsv_t *ids;
+	gint32 id;
+
+	ids = xmms_collection_query_ids (dag, coll, err);
+	if (!ids) {
+		return 0;
+	}
+
+	cursor = g_new0 (coll_query_cursor_t, 1);
+	cursor->ids = ids;
+	cursor->fetch = xmmsv_ref (fetch);
+	cursor->last_used = g_get_monotonic_time ();
+	cursor->size = sizeof (*cursor) + xmms_memstat_value_size (ids);
+	xmms_memstat_add (XMMS_MEMSTAT_MEDIALIB_RESULTS, cursor->size);
+
+	g_mutex_lock (&dag->cursor_mutex);
+
+	xmms_collection_cursors_expire (dag, cursor->last_used);
+
+	id = dag->next_cursor_id++;
+	if (dag->next_cursor_id <= 0) {
+		dag->next_cursor_id = 1;
+	}
+	g_hash_table_insert (dag->cursors, GINT_TO_POINTER (id), cursor);
+
+	g_mutex_unlock (&dag->cursor_mutex);
+
+	return id;
+}
+
+/**
+ * Apply the fetch of a cursor to its next count media.
+ */
+static xmmsv_t *
+xmms_collection_client_query_cursor_next (xmms_coll_dag_t *dag, gint32 id,
+                                          gint32 count, xmms_error_t *err)
+{
+	coll_query_cursor_t *cursor;
+	xmmsv_t *page, *fetch, *ret;
+	gint32 mid;
+	gint i;
+
+	if (count <= 0) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "count must be positive");
+		return NULL;
+	}
+
+	g_mutex_lock (&dag->cursor_mutex);
+
+	cursor = g_hash_table_lookup (dag->cursors, GINT_TO_POINTER (id));
+	if (!cursor) {
+		g_mutex_unlock (&dag->cursor_mutex);
+		xmms_error_set (err, XMMS_ERROR_NOENT, "No such query cursor");
+		return NULL;
+	}
+
+	cursor->last_used = g_get_monotonic_time ();
+
+	if (cursor->pos >= xmmsv_list_get_size (cursor->ids)) {
+		g_mutex_unlock (&dag->cursor_mutex);
+		return xmmsv_new_list ();
+	}
+
+	page = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	for (i = 0; i < count && xmmsv_list_get_int (cursor->ids, cursor->pos, &mid); i++) {
+		xmmsv_coll_idlist_append (page, mid);
+		cursor->pos++;
+	}
+
+	fetch = xmmsv_ref (cursor->fetch);
+
+	g_mutex_unlock (&dag->cursor_mutex);
+
+	/* the idlist keeps the order the ids were resolved in */
+	ret = xmms_collection_client_query (dag, page, fetch, err);
+
+	xmmsv_unref (fetch);
+	xmmsv_unref (page);
+
+	return ret;
+}
+
+static void
+xmms_collection_client_query_cursor_close (xmms_coll_dag_t *dag, gint32 id,
+                                           xmms_error_t *err)
+{
+	gboolean found;
+
+	g_mutex_lock (&dag->cursor_mutex);
+	found = g_hash_table_remove (dag->cursors, GINT_TO_POINTER (id));
+	g_mutex_unlock (&dag->cursor_mutex);
+
+	if (!found) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "No such query cursor");
+	}
+}
+
+/**
+ * Get the hit and miss counts of the query result cache.
+ */
+void
+xmms_collection_query_cache_stats (xmms_coll_dag_t *dag, guint *hits,
+                                   guint *misses, guint *entries)
+{
+	xmms_query_cache_stats (dag->query_cache, hits, misses, entries);
+}
+
+/**
+ * Estimate the memory held by the saved collections, counting each
+ * collection once however many names it is saved under.
+ */
+gsize
+xmms_collection_memory_size (xmms_coll_dag_t *dag)
+{
+	GHashTable *seen;
+	GHashTableIter iter;
+	gpointer key, value;
+	gsize size = 0;
+	gint i;
+
+	seen = g_hash_table_new (NULL, NULL);
+
 	g_mutex_lock (&dag->mutex);
 
-	xmms_collection_apply_to_collection (dag, coll, bind_all_references, NULL);
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
+		g_hash_table_iter_init (&iter, dag->collrefs[i]);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			size += strlen (key) + 1;
+			if (!g_hash_table_contains (seen, value)) {
+				g_hash_table_add (seen, value);
+				size += xmms_memstat_value_size (value);
+			}
+		}
 
-	do {
-		session = xmms_medialib_session_begin_ro (dag->medialib);
-		ret = xmms_medialib_query (session, coll, fetch, err);
-	} while (!xmms_medialib_session_commit (session));
+		g_hash_table_iter_init (&iter, dag->deferred[i]);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			size += strlen (key) + 1 + xmms_memstat_value_size (value);
+		}
+	}
 
 	g_mutex_unlock (&dag->mutex);
 
-	return ret;
+	g_hash_table_destroy (seen);
+
+	return size;
 }
 
 /**
@@ -847,10 +1279,83 @@ void
 xmms_collection_update_pointer (xmms_coll_dag_t *dag, const gchar *name,
                                 xmms_collection_namespace_id_t nsid, xmmsv_t *newtarget)
 {
+	g_atomic_int_inc (&dag->generation);
+	xmms_query_cache_clear (dag->query_cache);
+	xmms_media_sampler_clear (dag->sampler);
+	xmms_collection_members_clear (dag);
+	g_hash_table_remove (dag->deferred[nsid], name);
 	g_hash_table_replace (dag->collrefs[nsid], g_strdup (name), newtarget);
 	xmmsv_ref (newtarget);
 }
 
+/**
+ * Deserialize a deferred collection and bind its references, which may in
+ * turn load the collections it refers to.
+ *
+ * @return The loaded collection, or NULL if there was no such deferred
+ * collection or it could not be read.
+ */
+static xmmsv_t *
+xmms_collection_load_deferred (xmms_coll_dag_t *dag, const gchar *collname,
+                               xmms_collection_namespace_id_t nsid)
+{
+	xmmsv_t *serialized, *coll;
+	gchar *name;
+
+	if (!g_hash_table_lookup_extended (dag->deferred[nsid], collname,
+	                                   (gpointer *) &name, (gpointer *) &serialized)) {
+		return NULL;
+	}
+
+	g_hash_table_steal (dag->deferred[nsid], collname);
+
+	coll = xmmsv_deserialize (serialized);
+	xmmsv_unref (serialized);
+
+	if (coll != NULL && (!xmmsv_is_type (coll, XMMSV_TYPE_COLL) ||
+	    (nsid == XMMS_COLLECTION_NSID_PLAYLISTS &&
+	     !xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_IDLIST)))) {
+		xmmsv_unref (coll);
+		coll = NULL;
+	}
+
+	if (coll == NULL) {
+		xmms_log_error ("Dropping unreadable collection '%s'.", name);
+		g_free (name);
+		return NULL;
+	}
+
+	/* Insert before binding so a reference back to it finds it loaded. */
+	g_hash_table_replace (dag->collrefs[nsid], name, coll);
+	xmms_collection_apply_to_collection (dag, coll, bind_all_references, NULL);
+
+	return coll;
+}
+
+/**
+ * Load every deferred collection, for operations that need to inspect all
+ * of them.
+ */
+static void
+xmms_collection_load_all (xmms_coll_dag_t *dag)
+{
+	GHashTableIter iter;
+	const gchar *name;
+	gchar *key;
+	gint i;
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
+		while (g_hash_table_size (dag->deferred[i]) > 0) {
+			g_hash_table_iter_init (&iter, dag->deferred[i]);
+			g_hash_table_iter_next (&iter, (gpointer *) &name, NULL);
+
+			key = g_strdup (name);
+			xmms_collection_load_deferred (dag, key, i);
+			g_free (key);
+		}
+	}
+}
+
 /** Find the collection structure corresponding to the given name in the given namespace.
  *
  * @param dag  The collection DAG.
@@ -868,9 +1373,13 @@ xmms_collection_get_pointer (xmms_coll_dag_t *dag, const gchar *collname,
 	if (nsid == XMMS_COLLECTION_NSID_ALL) {
 		for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES && coll == NULL; ++i) {
 			coll = g_hash_table_lookup (dag->collrefs[i], collname);
+			if (coll == NULL)
+				coll = xmms_collection_load_deferred (dag, collname, i);
 		}
 	} else {
 		coll = g_hash_table_lookup (dag->collrefs[nsid], collname);
+		if (coll == NULL)
+			coll = xmms_collection_load_deferred (dag, collname, nsid);
 	}
 
 	return coll;
@@ -967,20 +1476,268 @@ xmms_collection_find_alias (xmms_coll_dag_t *dag, xmms_collection_namespace_id_t
  */
 xmms_medialib_entry_t
 xmms_collection_get_random_media (xmms_coll_dag_t *dag, xmmsv_t *source)
+{
+	xmms_medialib_entry_t ret = 0;
+
+	xmms_collection_get_random_media_n (dag, source, 1, &ret);
+
+	return ret;
+}
+
+/**
+ * Recheck the entries added or changed since the set of source was
+ * built, source should already be bound. If source is NULL it is taken
+ * from the key, only when there is something to recheck.
+ */
+static void
+xmms_collection_sampler_refresh (xmms_coll_dag_t *dag,
+                                 xmms_media_sampler_t *sampler,
+                                 xmmsv_t *source, GBytes *key, xmmsv_t *spec)
 {
 	xmms_medialib_session_t *session;
-	xmms_medialib_entry_t ret;
+	xmmsv_t *pending, *idlist, *coll, *members;
+	xmmsv_list_iter_t *it;
+	xmms_error_t err;
+	gint32 entry;
 
-	g_mutex_lock (&dag->mutex);
-	xmms_collection_apply_to_collection (dag, source, bind_all_references, NULL);
+	pending = xmms_media_sampler_pending_take (sampler, key);
+	if (!pending) {
+		return;
+	}
+
+	if (!source) {
+		source = xmms_collection_bound_from_key (key);
+	} else {
+		xmmsv_ref (source);
+	}
+
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	xmmsv_get_list_iter (pending, &it);
+	while (xmmsv_list_iter_entry_int32 (it, &entry)) {
+		xmmsv_coll_idlist_append (idlist, entry);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
 
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_INTERSECTION);
+	xmmsv_coll_add_operand (coll, source);
+	xmmsv_coll_add_operand (coll, idlist);
+	xmmsv_unref (idlist);
+
+	xmms_error_reset (&err);
 	do {
 		session = xmms_medialib_session_begin_ro (dag->medialib);
-		ret = xmms_medialib_query_random_id (session, source);
+		members = xmms_medialib_query (session, coll, spec, &err);
 	} while (!xmms_medialib_session_commit (session));
 
+	xmms_media_sampler_update (sampler, key, pending, members);
+
+	if (members) {
+		xmmsv_unref (members);
+	}
+	xmmsv_unref (coll);
+	xmmsv_unref (source);
+	xmmsv_unref (pending);
+}
+
+/**
+ * Get the ids of a materialized collection, which should already be
+ * bound, from its set. The set is made by one query the first time,
+ * after that only entries changed since are checked again.
+ *
+ * @returns A new idlist, NULL if the collection can't be kept as a set.
+ */
+static xmmsv_t *
+xmms_collection_materialized_get (xmms_coll_dag_t *dag, xmmsv_t *coll)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_t *spec, *ids, *ret = NULL;
+	xmms_error_t err;
+	GBytes *key;
+
+	spec = xmms_collection_ids_spec ();
+	key = xmms_query_cache_key (coll, spec);
+
+	/* it changes without notice */
+	if (!key) {
+		xmmsv_unref (spec);
+		return NULL;
+	}
+
+	if (xmms_media_sampler_lookup (dag->materialized, key)) {
+		xmms_collection_sampler_refresh (dag, dag->materialized, coll, key, spec);
+	} else {
+		xmms_error_reset (&err);
+		do {
+			session = xmms_medialib_session_begin_ro (dag->medialib);
+			ids = xmms_medialib_query (session, coll, spec, &err);
+		} while (!xmms_medialib_session_commit (session));
+
+		if (ids) {
+			xmms_media_sampler_insert (dag->materialized, key, ids);
+			xmmsv_unref (ids);
+		}
+	}
+
+	ret = xmms_media_sampler_members_get (dag->materialized, key);
+
+	g_bytes_unref (key);
+	xmmsv_unref (spec);
+
+	return ret;
+}
+
+static void
+coll_bound_key_free (gpointer data)
+{
+	coll_bound_key_t *bound = (coll_bound_key_t *) data;
+
+	if (bound->key) {
+		g_bytes_unref (bound->key);
+	}
+	g_free (bound);
+}
+
+/**
+ * Get the query key of source bound and queried with spec. The key of
+ * a source is kept until some collection changes, so a source used
+ * again and again isn't bound, copied and serialized every time.
+ * Sources referencing materialized collections are not kept, their
+ * bound form changes with the medialib.
+ *
+ * @returns A new key, NULL if the query can't be cached.
+ */
+static GBytes *
+xmms_collection_bound_key (xmms_coll_dag_t *dag, xmmsv_t *source, xmmsv_t *spec)
+{
+	coll_bound_key_t *bound;
+	gboolean materialized = FALSE;
+	xmmsv_t *copy;
+	GBytes *key = NULL;
+	gint generation;
+
+	generation = g_atomic_int_get (&dag->generation);
+
+	g_mutex_lock (&dag->mutex);
+	bound = g_hash_table_lookup (dag->bound_keys, source);
+	if (bound && bound->generation == generation) {
+		key = bound->key ? g_bytes_ref (bound->key) : NULL;
+		g_mutex_unlock (&dag->mutex);
+		return key;
+	}
 	g_mutex_unlock (&dag->mutex);
 
+	copy = xmms_collection_bind_copy (dag, source, &materialized);
+	key = xmms_query_cache_key (copy, spec);
+	xmmsv_unref (copy);
+
+	if (materialized) {
+		return key;
+	}
+
+	bound = g_new0 (coll_bound_key_t, 1);
+	bound->generation = generation;
+	bound->key = key ? g_bytes_ref (key) : NULL;
+
+	g_mutex_lock (&dag->mutex);
+	/* the sources of removed playlists would pile up otherwise */
+	if (g_hash_table_size (dag->bound_keys) >= XMMS_COLLECTION_BOUND_KEYS) {
+		g_hash_table_remove_all (dag->bound_keys);
+	}
+	g_hash_table_replace (dag->bound_keys, xmmsv_ref (source), bound);
+	g_mutex_unlock (&dag->mutex);
+
+	return key;
+}
+
+/**
+ * Get the bound collection back from its query key.
+ *
+ * @returns A new reference to the collection.
+ */
+static xmmsv_t *
+xmms_collection_bound_from_key (GBytes *key)
+{
+	xmmsv_t *serialized, *pair, *coll = NULL;
+	gconstpointer data;
+	gsize len;
+
+	data = g_bytes_get_data (key, &len);
+	serialized = xmmsv_new_bin (data, len);
+
+	pair = xmmsv_deserialize (serialized);
+	xmmsv_unref (serialized);
+
+	if (pair) {
+		xmmsv_list_get (pair, 0, &coll);
+		xmmsv_ref (coll);
+		xmmsv_unref (pair);
+	}
+
+	return coll;
+}
+
+/**
+ * Pick n random media from source, from a cached set of its ids that
+ * follows the medialib, so this takes one query only the first time.
+ *
+ * @returns The number of entries written to out.
+ */
+guint
+xmms_collection_get_random_media_n (xmms_coll_dag_t *dag, xmmsv_t *source,
+                                    guint n, xmms_medialib_entry_t *out)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_t *spec, *ids;
+	xmms_error_t err;
+	GBytes *key;
+	guint ret = 0;
+
+	spec = xmms_collection_ids_spec ();
+	key = xmms_collection_bound_key (dag, source, spec);
+
+	if (!key) {
+		source = xmms_collection_bind_copy (dag, source, NULL);
+
+		/* the source changes without notice, query every time */
+		for (ret = 0; ret < n; ret++) {
+			do {
+				session = xmms_medialib_session_begin_ro (dag->medialib);
+				out[ret] = xmms_medialib_query_random_id (session, source);
+			} while (!xmms_medialib_session_commit (session));
+
+			if (out[ret] <= 0) {
+				break;
+			}
+		}
+
+		xmmsv_unref (source);
+	} else {
+		if (xmms_media_sampler_lookup (dag->sampler, key)) {
+			xmms_collection_sampler_refresh (dag, dag->sampler, NULL, key, spec);
+		} else {
+			source = xmms_collection_bound_from_key (key);
+
+			xmms_error_reset (&err);
+			do {
+				session = xmms_medialib_session_begin_ro (dag->medialib);
+				ids = xmms_medialib_query (session, source, spec, &err);
+			} while (!xmms_medialib_session_commit (session));
+
+			if (ids) {
+				xmms_media_sampler_insert (dag->sampler, key, ids);
+				xmmsv_unref (ids);
+			}
+
+			xmmsv_unref (source);
+		}
+
+		ret = xmms_media_sampler_sample (dag->sampler, key, n, out);
+		g_bytes_unref (key);
+	}
+
+	xmmsv_unref (spec);
+
 	return ret;
 }
 
@@ -996,17 +1753,42 @@ static void
 xmms_collection_destroy (xmms_object_t *object)
 {
 	xmms_coll_dag_t *dag = (xmms_coll_dag_t *)object;
+	xmms_config_property_t *cfg;
 	gint i;
 
 	XMMS_DBG ("Deactivating collection object.");
 
 	g_return_if_fail (dag);
 
+	cfg = xmms_config_lookup ("collection.query_cache_size");
+	xmms_config_property_callback_remove (cfg, xmms_collection_query_cache_size_changed, dag);
+	xmms_query_cache_free (dag->query_cache);
+
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_ADDED,
+	                        on_medialib_entry_changed, dag);
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                        on_medialib_entry_changed, dag);
+	xmms_object_disconnect (XMMS_OBJECT (dag->medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_REMOVED,
+	                        on_medialib_entry_removed, dag);
+	xmms_media_sampler_free (dag->sampler);
+	xmms_media_sampler_free (dag->materialized);
+	g_hash_table_destroy (dag->bound_keys);
+
+	xmms_collection_members_clear (dag);
+	g_mutex_clear (&dag->members_mutex);
+
+	g_hash_table_destroy (dag->cursors);
+	g_mutex_clear (&dag->cursor_mutex);
+
 	xmms_object_unref (dag->medialib);
 	g_mutex_clear (&dag->mutex);
 
 	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
 		g_hash_table_destroy (dag->collrefs[i]);  /* dag is freed here */
+		g_hash_table_destroy (dag->deferred[i]);
 	}
 
 	xmms_collection_unregister_ipc_commands ();
@@ -1253,6 +2035,15 @@ xmms_collection_validate_recurs (xmms_coll_dag_t *dag, xmmsv_t *coll,
 			return FALSE;
 		}
 
+		if (xmmsv_coll_attribute_get_string (coll, "collation", &attr)
+		    && strcmp (attr, "NOCASE") != 0
+		    && strcmp (attr, "BINARY") != 0
+		    && strcmp (attr, "NATCOLL") != 0) {
+			*err = "Invalid collection: ORDER with invalid \"collation\"-"
+			       "attribute.";
+			return FALSE;
+		}
+
 		if (!xmmsv_coll_attribute_get_string (coll, "type", &attr)) {
 			attr = "value";
 		}
@@ -1353,7 +2144,7 @@ xmms_collection_unreference (xmms_coll_dag_t *dag, const gchar *name,
 	xmmsv_t *existing, *active_pl;
 	gboolean retval = FALSE;
 
-	existing  = g_hash_table_lookup (dag->collrefs[nsid], name);
+	existing  = xmms_collection_get_pointer (dag, name, nsid);
 	active_pl = g_hash_table_lookup (dag->collrefs[XMMS_COLLECTION_NSID_PLAYLISTS],
 	                                 XMMS_ACTIVE_PLAYLIST);
 
@@ -1363,6 +2154,9 @@ xmms_collection_unreference (xmms_coll_dag_t *dag, const gchar *name,
 		coll_rebind_infos_t infos = { name, nsname, existing, NULL };
 		gchar *matchkey;
 
+		/* References to it may hide in collections not loaded yet. */
+		xmms_collection_load_all (dag);
+
 		/* FIXME: if reference pointed to by a label, we should update
 		 * the label to point to the ref'd operator instead ! */
 
@@ -1475,6 +2269,8 @@ xmms_collection_foreach_in_namespace (xmms_coll_dag_t *dag,
 {
 	gint i;
 
+	xmms_collection_load_all (dag);
+
 	if (nsid == XMMS_COLLECTION_NSID_ALL) {
 		for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
 			g_hash_table_foreach (dag->collrefs[i], f, udata);
@@ -1484,6 +2280,31 @@ xmms_collection_foreach_in_namespace (xmms_coll_dag_t *dag,
 	}
 }
 
+/** Apply a function to the names of all the collections in a given namespace.
+ *
+ * Unlike #xmms_collection_foreach_in_namespace this doesn't load deferred
+ * collections, the value passed to the function must not be used.
+ *
+ * @param dag  The collection DAG.
+ * @param nsid  The namespace id.
+ * @param f  The function to apply to all the collection names.
+ * @param udata  Additional user data parameter passed to the function.
+ */
+static void
+xmms_collection_foreach_name_in_namespace (xmms_coll_dag_t *dag,
+                                           xmms_collection_namespace_id_t nsid,
+                                           GHFunc f, void *udata)
+{
+	gint i;
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; ++i) {
+		if (nsid == XMMS_COLLECTION_NSID_ALL || nsid == i) {
+			g_hash_table_foreach (dag->collrefs[i], f, udata);
+			g_hash_table_foreach (dag->deferred[i], f, udata);
+		}
+	}
+}
+
 /** Apply a function of type #FuncApplyToColl to all the collections in all namespaces.
  *
  * @param dag  The collection DAG.
@@ -1620,6 +2441,12 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 		xmmsv_unref (copy);
 	}
 
+	/* Deferred collections are passed on still serialized. */
+	g_hash_table_iter_init (&iter, dag->deferred[XMMS_COLLECTION_NSID_COLLECTIONS]);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &coll)) {
+		xmmsv_dict_set (collections, name, coll);
+	}
+
 	active_playlist = xmms_collection_get_pointer (dag, XMMS_ACTIVE_PLAYLIST,
 	                                               XMMS_COLLECTION_NSID_PLAYLISTS);
 
@@ -1632,6 +2459,11 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 		}
 	}
 
+	g_hash_table_iter_init (&iter, dag->deferred[XMMS_COLLECTION_NSID_PLAYLISTS]);
+	while (g_hash_table_iter_next (&iter, (gpointer *) &name, (gpointer *) &coll)) {
+		xmmsv_dict_set (playlists, name, coll);
+	}
+
 	name = xmms_collection_find_alias (dag, XMMS_COLLECTION_NSID_PLAYLISTS,
 	                                   active_playlist, XMMS_ACTIVE_PLAYLIST);
 	xmmsv_dict_set_string (result, "active-playlist", name);
@@ -1644,24 +2476,39 @@ xmms_collection_snapshot (xmms_coll_dag_t *dag)
 	return result;
 }
 
+static void
+xmms_collection_restore_one (xmms_coll_dag_t *dag, const gchar *name,
+                             xmms_collection_namespace_id_t nsid, xmmsv_t *coll)
+{
+	if (xmmsv_is_type (coll, XMMSV_TYPE_BIN)) {
+		g_hash_table_remove (dag->collrefs[nsid], name);
+		g_hash_table_replace (dag->deferred[nsid], g_strdup (name), xmmsv_ref (coll));
+	} else {
+		xmms_collection_update_pointer (dag, name, nsid, coll);
+	}
+}
+
 static void
 xmms_collection_restore_collection (const gchar *name, xmmsv_t *coll, void *udata)
 {
 	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
-	xmms_collection_update_pointer (dag, name, XMMS_COLLECTION_NSID_COLLECTIONS, coll);
+	xmms_collection_restore_one (dag, name, XMMS_COLLECTION_NSID_COLLECTIONS, coll);
 }
 
 static void
 xmms_collection_restore_playlist (const gchar *name, xmmsv_t *coll, void *udata)
 {
 	xmms_coll_dag_t *dag = (xmms_coll_dag_t *) udata;
-	xmms_collection_update_pointer (dag, name, XMMS_COLLECTION_NSID_PLAYLISTS, coll);
+	xmms_collection_restore_one (dag, name, XMMS_COLLECTION_NSID_PLAYLISTS, coll);
 }
 
+/* Serialized (binary) collections are only checked once they are loaded. */
 static void
 xmms_collection_restore_check_collection (const gchar *name, xmmsv_t *coll, void *udata)
 {
 	gboolean *error = (gboolean *) udata;
+	if (xmmsv_is_type (coll, XMMSV_TYPE_BIN))
+		return;
 	if (!xmmsv_is_type (coll, XMMSV_TYPE_COLL))
 		*error = TRUE;
 }
@@ -1670,12 +2517,18 @@ static void
 xmms_collection_restore_check_playlist (const gchar *name, xmmsv_t *coll, void *udata)
 {
 	gboolean *error = (gboolean *) udata;
+	if (xmmsv_is_type (coll, XMMSV_TYPE_BIN))
+		return;
 	if (!xmmsv_is_type (coll, XMMSV_TYPE_COLL))
 		*error = TRUE;
 	else if (!xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_IDLIST))
 		*error = TRUE;
 }
 
+/**
+ * Restore the DAG from a snapshot. Collections given in serialized (binary)
+ * form are kept that way until they are first looked up.
+ */
 void
 xmms_collection_restore (xmms_coll_dag_t *dag, xmmsv_t *snapshot)
 {
@@ -1784,6 +2637,47 @@ unbind_all_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, voi
 	}
 }
 
+/**
+ * If a bound reference to a materialized collection, bind it to the id
+ * set of the collection instead, as an unordered mediaset like the
+ * collection itself.
+ */
+static void
+materialize_references (xmms_coll_dag_t *dag, xmmsv_t *coll, xmmsv_t *parent, void *udata)
+{
+	xmmsv_t *operands, *target, *ids, *set;
+	const gchar *materialized;
+
+	if (!xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_REFERENCE)) {
+		return;
+	}
+
+	operands = xmmsv_coll_operands_get (coll);
+	if (!xmmsv_list_get (operands, 0, &target) ||
+	    xmmsv_coll_is_type (target, XMMS_COLLECTION_TYPE_IDLIST) ||
+	    !xmmsv_coll_attribute_get_string (target, "materialized", &materialized) ||
+	    strcmp (materialized, "1") != 0) {
+		return;
+	}
+
+	ids = xmms_collection_materialized_get (dag, target);
+	if (!ids) {
+		return;
+	}
+
+	set = xmmsv_new_coll (XMMS_COLLECTION_TYPE_MEDIASET);
+	xmmsv_coll_add_operand (set, ids);
+	xmmsv_unref (ids);
+
+	xmmsv_list_clear (operands);
+	xmmsv_coll_add_operand (coll, set);
+	xmmsv_unref (set);
+
+	if (udata) {
+		*(gboolean *) udata = TRUE;
+	}
+}
+
 /**
  * If a reference, rebind the given operator to the new operator
  * representing the referenced collection (pointers and so are in the
@@ -1926,38 +2820,98 @@ coll_unref (void *coll)
 
 /* ============  FIND / COLLECTION MATCH FUNCTIONS ============ */
 
-/* Generate a build_match hashtable, states initialized to UNCHECKED. */
+/* Add the name of an idlist to the names of each entry it holds. */
+static void
+members_add (gpointer key, gpointer value, gpointer udata)
+{
+	GHashTable *members = udata;
+	xmmsv_t *coll = value;
+	gint64 id;
+	gint i;
+
+	if (!xmmsv_coll_is_type (coll, XMMS_COLLECTION_TYPE_IDLIST)) {
+		return;
+	}
+
+	for (i = 0; xmmsv_coll_idlist_get_index_int64 (coll, i, &id); i++) {
+		GPtrArray *names;
+
+		names = g_hash_table_lookup (members, GINT_TO_POINTER ((gint32) id));
+		if (!names) {
+			names = g_ptr_array_new_with_free_func (g_free);
+			g_hash_table_insert (members, GINT_TO_POINTER ((gint32) id), names);
+		}
+
+		/* an idlist is added all at once, skip repeated entries */
+		if (!names->len ||
+		    strcmp (g_ptr_array_index (names, names->len - 1), key) != 0) {
+			g_ptr_array_add (names, g_strdup (key));
+		}
+	}
+}
+
 static void
-build_match_table (gpointer key, gpointer value, gpointer udata)
+members_names_free (gpointer data)
 {
-	GHashTable *match_table = udata;
-	coll_find_state_t *match = g_new (coll_find_state_t, 1);
-	*match = XMMS_COLLECTION_FIND_STATE_UNCHECKED;
-	g_hash_table_replace (match_table, g_strdup (key), match);
+	g_ptr_array_free (data, TRUE);
 }
 
-/* Return the first unchecked element from the match_table, set the
- * udata pointer to contain the key of that element.
- */
-static gboolean
-find_unchecked (gpointer name, gpointer value, gpointer udata)
+/* Drop the indexes, the idlists may have changed. */
+static void
+xmms_collection_members_clear (xmms_coll_dag_t *dag)
 {
-	coll_find_state_t *match = value;
-	gchar **open = udata;
-	*open = name;
-	return (*match == XMMS_COLLECTION_FIND_STATE_UNCHECKED);
+	gint i;
+
+	g_mutex_lock (&dag->members_mutex);
+
+	for (i = 0; i < XMMS_COLLECTION_NUM_NAMESPACES; i++) {
+		if (dag->members[i]) {
+			g_hash_table_destroy (dag->members[i]);
+			dag->members[i] = NULL;
+		}
+	}
+
+	g_mutex_unlock (&dag->members_mutex);
 }
 
-/* Build a list of all matched entries of the match_table in the udata
- * pointer.
+/* Append the names of the idlists in a namespace holding an entry to
+ * list, indexing them first if needed. Called with the dag locked and
+ * all collections loaded.
  */
 static void
-build_list_matches (gpointer key, gpointer value, gpointer udata)
+xmms_collection_members_find (xmms_coll_dag_t *dag,
+                              xmms_collection_namespace_id_t nsid,
+                              xmms_medialib_entry_t entry, xmmsv_t *list)
 {
-	coll_find_state_t *state = value;
-	xmmsv_t *list = (xmmsv_t *) udata;
-	gchar *coll_name = key;
-	if (*state == XMMS_COLLECTION_FIND_STATE_MATCH) {
-		xmmsv_list_insert_string (list, 0, coll_name);
+	GPtrArray *names;
+	guint i;
+
+	/* playlists change their idlists without the dag lock and clear
+	 * the index after, which waits for one being built to drop it */
+	g_mutex_lock (&dag->members_mutex);
+
+	if (!dag->members[nsid]) {
+		dag->members[nsid] = g_hash_table_new_full (NULL, NULL, NULL,
+		                                            members_names_free);
+		g_hash_table_foreach (dag->collrefs[nsid], members_add,
+		                      dag->members[nsid]);
+	}
+
+	names = g_hash_table_lookup (dag->members[nsid], GINT_TO_POINTER (entry));
+	for (i = 0; names && i < names->len; i++) {
+		xmmsv_list_append_string (list, g_ptr_array_index (names, i));
+	}
+
+	g_mutex_unlock (&dag->members_mutex);
+}
+
+/* Collect the collections that aren't idlists, by name. */
+static void
+collect_dynamic (gpointer key, gpointer value, gpointer udata)
+{
+	xmmsv_t *dict = udata;
+
+	if (!xmmsv_coll_is_type (value, XMMS_COLLECTION_TYPE_IDLIST)) {
+		xmmsv_dict_set (dict, key, value);
 	}
 }
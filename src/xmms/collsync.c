@@ -18,16 +18,27 @@
 /** @file
  *  Manages the synchronization of collections to the database at 10 seconds
  *  after the last collections-change.
+ *
+ *  The database is a full snapshot plus a journal of change records written
+ *  next to it. Small edits are appended to the journal, which is folded back
+ *  into a new snapshot once it has grown as large as the snapshot itself.
+ *
+ *  The snapshot starts with an index of where each serialized collection is
+ *  stored, so that restoring only has to map the file and copy the pieces
+ *  out. Collections are deserialized by the DAG when first looked up.
  */
 
 #include <xmmspriv/xmms_collsync.h>
 #include <xmmspriv/xmms_utils.h>
+#include <xmmspriv/xmms_trace.h>
+#include <xmmspriv/xmms_thread_role.h>
 
 #include <xmms/xmms_config.h>
 #include <xmms/xmms_ipc.h>
 #include <xmms/xmms_log.h>
 
 #include <errno.h>
+#include <string.h>
 
 #include <glib.h>
 #include <glib/gstdio.h>
@@ -35,6 +46,13 @@
 
 #define XMMS_COLL_SYNC_DELAY 10 * G_TIME_SPAN_SECOND
 
+/* Never compact a journal smaller than this, even if the snapshot is tiny. */
+#define XMMS_COLL_SYNC_JOURNAL_MIN (256 * 1024)
+
+/* Leads an indexed snapshot, followed by the 32 bit big endian index size. */
+#define XMMS_COLL_SYNC_MAGIC "XMMS2CDB"
+#define XMMS_COLL_SYNC_MAGIC_LEN 8
+
 static void xmms_coll_sync_schedule_sync (xmms_object_t *object, xmmsv_t *val, gpointer udata);
 static gpointer xmms_coll_sync_loop (gpointer udata);
 static void xmms_coll_sync_destroy (xmms_object_t *object);
@@ -68,6 +86,15 @@ struct xmms_coll_sync_St {
 	GCond cond;
 
 	xmms_coll_sync_state_t state;
+
+	/* What the snapshot and journal on disk add up to, owned by the sync
+	 * thread once it is running.
+	 */
+	xmmsv_t *saved;
+	gchar *saved_path;
+	gint64 generation;
+	gsize base_size;
+	gsize journal_size;
 };
 
 #include "collsync_ipc.c"
@@ -166,6 +193,10 @@ xmms_coll_sync_destroy (xmms_object_t *object)
 	xmms_object_unref (sync->playlist);
 	xmms_object_unref (sync->dag);
 
+	if (sync->saved != NULL)
+		xmmsv_unref (sync->saved);
+	g_free (sync->saved_path);
+
 	g_mutex_clear (&sync->mutex);
 	g_cond_clear (&sync->cond);
 	g_free (sync->uuid);
@@ -399,6 +430,746 @@ xmms_coll_sync_client_sync (xmms_coll_sync_t *sync, xmms_error_t *err)
 	xmms_coll_sync_set_state (sync, XMMS_COLL_SYNC_STATE_IMMEDIATE);
 }
 
+static gchar *
+xmms_coll_sync_get_journal_path (const gchar *path)
+{
+	return g_strconcat (path, ".journal", NULL);
+}
+
+static gboolean
+xmms_coll_sync_value_equal (xmmsv_t *a, xmmsv_t *b)
+{
+	xmmsv_t *sa, *sb;
+	const guchar *da, *db;
+	guint la, lb;
+	gboolean equal;
+
+	if (a == b)
+		return TRUE;
+	if (a == NULL || b == NULL)
+		return FALSE;
+
+	sa = xmmsv_serialize (a);
+	sb = xmmsv_serialize (b);
+
+	xmmsv_get_bin (sa, &da, &la);
+	xmmsv_get_bin (sb, &db, &lb);
+
+	equal = la == lb && memcmp (da, db, la) == 0;
+
+	xmmsv_unref (sa);
+	xmmsv_unref (sb);
+
+	return equal;
+}
+
+/**
+ * Get a collection that may still be in its serialized on-disk form.
+ *
+ * @return A new reference to the collection, or NULL if it can't be read.
+ */
+static xmmsv_t *
+xmms_coll_sync_coll_get (xmmsv_t *value)
+{
+	xmmsv_t *coll;
+
+	if (!xmmsv_is_type (value, XMMSV_TYPE_BIN))
+		return xmmsv_ref (value);
+
+	coll = xmmsv_deserialize (value);
+	if (coll != NULL && !xmmsv_is_type (coll, XMMSV_TYPE_COLL)) {
+		xmmsv_unref (coll);
+		coll = NULL;
+	}
+
+	return coll;
+}
+
+/**
+ * Copy a snapshot, sharing the collections that are still serialized.
+ */
+static xmmsv_t *
+xmms_coll_sync_snapshot_copy (xmmsv_t *snapshot)
+{
+	xmmsv_dict_iter_t *it, *cit;
+	xmmsv_t *result, *value, *colls, *coll;
+	const gchar *key, *name;
+
+	result = xmmsv_new_dict ();
+
+	xmmsv_get_dict_iter (snapshot, &it);
+	while (xmmsv_dict_iter_pair (it, &key, &value)) {
+		if (!xmmsv_is_type (value, XMMSV_TYPE_DICT)) {
+			xmmsv_dict_set (result, key, value);
+			xmmsv_dict_iter_next (it);
+			continue;
+		}
+
+		colls = xmmsv_new_dict ();
+
+		xmmsv_get_dict_iter (value, &cit);
+		while (xmmsv_dict_iter_pair (cit, &name, &coll)) {
+			if (xmmsv_is_type (coll, XMMSV_TYPE_BIN)) {
+				xmmsv_dict_set (colls, name, coll);
+			} else {
+				xmmsv_t *copy = xmmsv_copy (coll);
+				xmmsv_dict_set (colls, name, copy);
+				xmmsv_unref (copy);
+			}
+			xmmsv_dict_iter_next (cit);
+		}
+
+		xmmsv_dict_set (result, key, colls);
+		xmmsv_unref (colls);
+
+		xmmsv_dict_iter_next (it);
+	}
+
+	return result;
+}
+
+/**
+ * Describe how a collection changed since it was last saved.
+ *
+ * Collections that only grew at the end of their idlist or got new
+ * attributes, like a playlist being enqueued to or played through, are
+ * recorded as an update, anything else is recorded in full.
+ *
+ * @return A change record, or NULL if the collection is unchanged.
+ */
+static xmmsv_t *
+xmms_coll_sync_diff_collection (const gchar *namespace, const gchar *name,
+                                xmmsv_t *old, xmmsv_t *coll)
+{
+	xmmsv_t *record, *attributes, *ids;
+	gint old_size, size, i;
+
+	if (old == NULL ||
+	    xmmsv_coll_get_type (old) != xmmsv_coll_get_type (coll) ||
+	    !xmms_coll_sync_value_equal (xmmsv_coll_operands_get (old),
+	                                 xmmsv_coll_operands_get (coll))) {
+		return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "set"),
+		                         XMMSV_DICT_ENTRY_STR ("namespace", namespace),
+		                         XMMSV_DICT_ENTRY_STR ("name", name),
+		                         XMMSV_DICT_ENTRY ("coll", xmmsv_ref (coll)),
+		                         XMMSV_DICT_END);
+	}
+
+	old_size = xmmsv_coll_idlist_get_size (old);
+	size = xmmsv_coll_idlist_get_size (coll);
+
+	for (i = 0; i < old_size; i++) {
+		int64_t a, b;
+
+		if (i >= size ||
+		    !xmmsv_coll_idlist_get_index_int64 (old, i, &a) ||
+		    !xmmsv_coll_idlist_get_index_int64 (coll, i, &b) ||
+		    a != b) {
+			return xmms_coll_sync_diff_collection (namespace, name, NULL, coll);
+		}
+	}
+
+	attributes = xmmsv_coll_attributes_get (coll);
+	if (xmms_coll_sync_value_equal (xmmsv_coll_attributes_get (old), attributes))
+		attributes = NULL;
+
+	if (attributes == NULL && old_size == size)
+		return NULL;
+
+	record = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "update"),
+	                           XMMSV_DICT_ENTRY_STR ("namespace", namespace),
+	                           XMMSV_DICT_ENTRY_STR ("name", name),
+	                           XMMSV_DICT_END);
+
+	if (attributes != NULL)
+		xmmsv_dict_set (record, "attributes", attributes);
+
+	if (size > old_size) {
+		ids = xmmsv_new_list ();
+		for (i = old_size; i < size; i++) {
+			int64_t id;
+			xmmsv_coll_idlist_get_index_int64 (coll, i, &id);
+			xmmsv_list_append_int (ids, id);
+		}
+		xmmsv_dict_set (record, "ids", ids);
+		xmmsv_unref (ids);
+	}
+
+	return record;
+}
+
+static void
+xmms_coll_sync_diff_namespace (xmmsv_t *records, const gchar *namespace,
+                               xmmsv_t *saved, xmmsv_t *snapshot)
+{
+	xmmsv_dict_iter_t *it;
+	xmmsv_t *old_colls, *colls, *coll, *old, *record;
+	const gchar *name;
+
+	if (!xmmsv_dict_get (saved, namespace, &old_colls))
+		old_colls = NULL;
+	if (!xmmsv_dict_get (snapshot, namespace, &colls))
+		return;
+
+	xmmsv_get_dict_iter (colls, &it);
+	while (xmmsv_dict_iter_pair (it, &name, &coll)) {
+		if (old_colls == NULL || !xmmsv_dict_get (old_colls, name, &old))
+			old = NULL;
+
+		/* Collections never loaded since the restore are shared as is. */
+		if (old != coll) {
+			xmmsv_t *a, *b;
+
+			a = old != NULL ? xmms_coll_sync_coll_get (old) : NULL;
+			b = xmms_coll_sync_coll_get (coll);
+
+			record = b != NULL ? xmms_coll_sync_diff_collection (namespace, name, a, b) : NULL;
+			if (record != NULL) {
+				xmmsv_list_append (records, record);
+				xmmsv_unref (record);
+			}
+
+			if (a != NULL)
+				xmmsv_unref (a);
+			if (b != NULL)
+				xmmsv_unref (b);
+		}
+
+		xmmsv_dict_iter_next (it);
+	}
+
+	if (old_colls == NULL)
+		return;
+
+	xmmsv_get_dict_iter (old_colls, &it);
+	while (xmmsv_dict_iter_pair (it, &name, NULL)) {
+		if (!xmmsv_dict_has_key (colls, name)) {
+			record = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "remove"),
+			                           XMMSV_DICT_ENTRY_STR ("namespace", namespace),
+			                           XMMSV_DICT_ENTRY_STR ("name", name),
+			                           XMMSV_DICT_END);
+			xmmsv_list_append (records, record);
+			xmmsv_unref (record);
+		}
+		xmmsv_dict_iter_next (it);
+	}
+}
+
+/**
+ * Build the list of change records that turn the saved state into the
+ * snapshot.
+ */
+static xmmsv_t *
+xmms_coll_sync_diff (xmmsv_t *saved, xmmsv_t *snapshot)
+{
+	xmmsv_t *records;
+	const gchar *old_active, *active;
+
+	records = xmmsv_new_list ();
+
+	xmms_coll_sync_diff_namespace (records, "collections", saved, snapshot);
+	xmms_coll_sync_diff_namespace (records, "playlists", saved, snapshot);
+
+	if (!xmmsv_dict_entry_get_string (saved, "active-playlist", &old_active))
+		old_active = NULL;
+
+	if (xmmsv_dict_entry_get_string (snapshot, "active-playlist", &active) &&
+	    g_strcmp0 (old_active, active) != 0) {
+		xmmsv_t *record;
+
+		record = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("op", "active"),
+		                           XMMSV_DICT_ENTRY_STR ("name", active),
+		                           XMMSV_DICT_END);
+		xmmsv_list_append (records, record);
+		xmmsv_unref (record);
+	}
+
+	return records;
+}
+
+/**
+ * Apply a change record read back from the journal onto a snapshot.
+ */
+static gboolean
+xmms_coll_sync_apply_record (xmmsv_t *snapshot, xmmsv_t *record)
+{
+	xmmsv_t *colls, *coll, *value;
+	const gchar *op, *namespace, *name;
+
+	if (!xmmsv_dict_entry_get_string (record, "op", &op) ||
+	    !xmmsv_dict_entry_get_string (record, "name", &name))
+		return FALSE;
+
+	if (strcmp (op, "active") == 0) {
+		xmmsv_dict_set_string (snapshot, "active-playlist", name);
+		return TRUE;
+	}
+
+	if (!xmmsv_dict_entry_get_string (record, "namespace", &namespace) ||
+	    !xmmsv_dict_get (snapshot, namespace, &colls) ||
+	    !xmmsv_is_type (colls, XMMSV_TYPE_DICT))
+		return FALSE;
+
+	if (strcmp (op, "set") == 0) {
+		if (!xmmsv_dict_get (record, "coll", &coll) ||
+		    !xmmsv_is_type (coll, XMMSV_TYPE_COLL))
+			return FALSE;
+		xmmsv_dict_set (colls, name, coll);
+		return TRUE;
+	}
+
+	if (strcmp (op, "remove") == 0) {
+		xmmsv_dict_remove (colls, name);
+		return TRUE;
+	}
+
+	if (strcmp (op, "update") != 0 ||
+	    !xmmsv_dict_get (colls, name, &value) ||
+	    (coll = xmms_coll_sync_coll_get (value)) == NULL)
+		return FALSE;
+
+	xmmsv_dict_set (colls, name, coll);
+	xmmsv_unref (coll);
+
+	if (xmmsv_dict_get (record, "attributes", &value) &&
+	    xmmsv_is_type (value, XMMSV_TYPE_DICT)) {
+		xmmsv_coll_attributes_set (coll, value);
+	}
+
+	if (xmmsv_dict_get (record, "ids", &value)) {
+		xmmsv_list_iter_t *it;
+		int64_t id;
+
+		xmmsv_get_list_iter (value, &it);
+		while (xmmsv_list_iter_entry_int64 (it, &id)) {
+			xmmsv_coll_idlist_append (coll, id);
+			xmmsv_list_iter_next (it);
+		}
+	}
+
+	return TRUE;
+}
+
+/**
+ * Append a length prefixed, serialized record to a journal buffer.
+ */
+static void
+xmms_coll_sync_journal_frame (GByteArray *buffer, xmmsv_t *record)
+{
+	xmmsv_t *serialized;
+	const guchar *data;
+	guint32 prefix;
+	guint length;
+
+	serialized = xmmsv_serialize (record);
+	xmmsv_get_bin (serialized, &data, &length);
+
+	prefix = GUINT32_TO_BE (length);
+	g_byte_array_append (buffer, (const guint8 *) &prefix, sizeof (prefix));
+	g_byte_array_append (buffer, data, length);
+
+	xmmsv_unref (serialized);
+}
+
+/**
+ * Append the changes since the last save to the journal.
+ *
+ * @return FALSE if the journal can't be used and a full snapshot has to be
+ *         written instead.
+ */
+static gboolean
+xmms_coll_sync_save_journal (xmms_coll_sync_t *sync, const gchar *path,
+                             xmmsv_t *snapshot, GError **error)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *records, *record;
+	GByteArray *buffer;
+	gchar *journal;
+	gboolean success;
+	FILE *fp;
+
+	if (sync->saved == NULL || g_strcmp0 (sync->saved_path, path) != 0)
+		return FALSE;
+
+	if (sync->journal_size > MAX (XMMS_COLL_SYNC_JOURNAL_MIN, sync->base_size))
+		return FALSE;
+
+	records = xmms_coll_sync_diff (sync->saved, snapshot);
+
+	buffer = g_byte_array_new ();
+
+	xmmsv_get_list_iter (records, &it);
+	while (xmmsv_list_iter_entry (it, &record)) {
+		xmms_coll_sync_journal_frame (buffer, record);
+		xmmsv_list_iter_next (it);
+	}
+
+	xmmsv_unref (records);
+
+	if (buffer->len == 0) {
+		g_byte_array_free (buffer, TRUE);
+		return TRUE;
+	}
+
+	journal = xmms_coll_sync_get_journal_path (path);
+
+	fp = g_fopen (journal, "ab");
+	success = fp != NULL;
+
+	if (success) {
+		success = fwrite (buffer->data, 1, buffer->len, fp) == buffer->len;
+		success = fclose (fp) == 0 && success;
+	}
+
+	if (success) {
+		XMMS_DBG ("Appended %u bytes to '%s'.", buffer->len, journal);
+		sync->journal_size += buffer->len;
+	} else {
+		g_set_error (error, G_FILE_ERROR,
+		             g_file_error_from_errno (errno),
+		             "%s", g_strerror (errno));
+	}
+
+	g_byte_array_free (buffer, TRUE);
+	g_free (journal);
+
+	return success;
+}
+
+/**
+ * Add the collections of a namespace to the snapshot index, with their
+ * serialized form appended to the data section.
+ */
+static void
+xmms_coll_sync_index_namespace (xmmsv_t *index, GByteArray *data,
+                                xmmsv_t *snapshot, const gchar *namespace)
+{
+	xmmsv_dict_iter_t *it;
+	xmmsv_t *colls, *entries, *coll;
+	const gchar *name;
+
+	entries = xmmsv_new_dict ();
+	xmmsv_dict_set (index, namespace, entries);
+	xmmsv_unref (entries);
+
+	if (!xmmsv_dict_get (snapshot, namespace, &colls))
+		return;
+
+	xmmsv_get_dict_iter (colls, &it);
+	while (xmmsv_dict_iter_pair (it, &name, &coll)) {
+		xmmsv_t *serialized, *entry;
+		const guchar *buffer;
+		guint length;
+
+		if (xmmsv_is_type (coll, XMMSV_TYPE_BIN))
+			serialized = xmmsv_ref (coll);
+		else
+			serialized = xmmsv_serialize (coll);
+
+		xmmsv_get_bin (serialized, &buffer, &length);
+
+		entry = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (data->len),
+		                          XMMSV_LIST_ENTRY_INT (length),
+		                          XMMSV_LIST_END);
+		xmmsv_dict_set (entries, name, entry);
+		xmmsv_unref (entry);
+
+		g_byte_array_append (data, buffer, length);
+		xmmsv_unref (serialized);
+
+		xmmsv_dict_iter_next (it);
+	}
+}
+
+/**
+ * Write a full snapshot and start a new, empty journal for it.
+ *
+ * The snapshot is tagged with a generation that the journal header has to
+ * match, so a journal left over from an older snapshot is never replayed.
+ */
+static gboolean
+xmms_coll_sync_save_snapshot (xmms_coll_sync_t *sync, const gchar *path,
+                              xmmsv_t *snapshot, GError **error)
+{
+	xmmsv_t *index, *serialized, *header;
+	const guchar *data;
+	GByteArray *buffer, *contents;
+	const gchar *active;
+	gchar *journal;
+	gint64 generation;
+	guint32 prefix;
+	guint length;
+	gboolean success;
+
+	if (sync->saved != NULL) {
+		xmmsv_unref (sync->saved);
+		sync->saved = NULL;
+	}
+
+	generation = MAX (g_get_real_time (), sync->generation + 1);
+	xmmsv_dict_set_int (snapshot, "journal", generation);
+
+	index = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("journal", generation),
+	                          XMMSV_DICT_END);
+
+	if (xmmsv_dict_entry_get_string (snapshot, "active-playlist", &active))
+		xmmsv_dict_set_string (index, "active-playlist", active);
+
+	contents = g_byte_array_new ();
+
+	xmms_coll_sync_index_namespace (index, contents, snapshot, "collections");
+	xmms_coll_sync_index_namespace (index, contents, snapshot, "playlists");
+
+	serialized = xmmsv_serialize (index);
+	xmmsv_unref (index);
+
+	xmmsv_get_bin (serialized, &data, &length);
+
+	buffer = g_byte_array_sized_new (XMMS_COLL_SYNC_MAGIC_LEN + sizeof (prefix) +
+	                                 length + contents->len);
+
+	prefix = GUINT32_TO_BE (length);
+	g_byte_array_append (buffer, (const guint8 *) XMMS_COLL_SYNC_MAGIC,
+	                     XMMS_COLL_SYNC_MAGIC_LEN);
+	g_byte_array_append (buffer, (const guint8 *) &prefix, sizeof (prefix));
+	g_byte_array_append (buffer, data, length);
+	g_byte_array_append (buffer, contents->data, contents->len);
+
+	xmmsv_unref (serialized);
+	g_byte_array_free (contents, TRUE);
+
+	success = g_file_set_contents (path, (const gchar *) buffer->data,
+	                               (gssize) buffer->len, error);
+
+	length = buffer->len;
+	g_byte_array_free (buffer, TRUE);
+
+	if (!success)
+		return FALSE;
+
+	sync->generation = generation;
+	sync->base_size = length;
+
+	header = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("generation", generation),
+	                           XMMSV_DICT_END);
+
+	buffer = g_byte_array_new ();
+	xmms_coll_sync_journal_frame (buffer, header);
+	xmmsv_unref (header);
+
+	journal = xmms_coll_sync_get_journal_path (path);
+
+	/* The snapshot is complete on its own, so a failure here only means
+	 * the next save has to be a full one as well.
+	 */
+	if (g_file_set_contents (journal, (const gchar *) buffer->data,
+	                         (gssize) buffer->len, error)) {
+		sync->saved = xmmsv_ref (snapshot);
+		sync->journal_size = buffer->len;
+		g_free (sync->saved_path);
+		sync->saved_path = g_strdup (path);
+	}
+
+	g_byte_array_free (buffer, TRUE);
+	g_free (journal);
+
+	return TRUE;
+}
+
+/**
+ * Read an indexed snapshot, leaving every collection serialized.
+ */
+static xmmsv_t *
+xmms_coll_sync_load_indexed (const guchar *buffer, gsize length)
+{
+	static const gchar *namespaces[] = { "collections", "playlists" };
+	xmmsv_t *serialized, *index, *snapshot, *value;
+	const guchar *data;
+	gsize data_length;
+	guint32 size;
+	guint i;
+
+	buffer += XMMS_COLL_SYNC_MAGIC_LEN;
+	length -= XMMS_COLL_SYNC_MAGIC_LEN;
+
+	if (length < sizeof (size))
+		return NULL;
+
+	memcpy (&size, buffer, sizeof (size));
+	size = GUINT32_FROM_BE (size);
+
+	buffer += sizeof (size);
+	length -= sizeof (size);
+
+	if (size > length)
+		return NULL;
+
+	serialized = xmmsv_new_bin (buffer, size);
+	index = xmmsv_deserialize (serialized);
+	xmmsv_unref (serialized);
+
+	if (index == NULL)
+		return NULL;
+
+	if (!xmmsv_is_type (index, XMMSV_TYPE_DICT)) {
+		xmmsv_unref (index);
+		return NULL;
+	}
+
+	data = buffer + size;
+	data_length = length - size;
+
+	snapshot = xmmsv_new_dict ();
+
+	if (xmmsv_dict_get (index, "journal", &value))
+		xmmsv_dict_set (snapshot, "journal", value);
+	if (xmmsv_dict_get (index, "active-playlist", &value))
+		xmmsv_dict_set (snapshot, "active-playlist", value);
+
+	for (i = 0; i < G_N_ELEMENTS (namespaces); i++) {
+		xmmsv_dict_iter_t *it;
+		xmmsv_t *entries, *colls, *entry;
+		const gchar *name;
+
+		colls = xmmsv_new_dict ();
+		xmmsv_dict_set (snapshot, namespaces[i], colls);
+		xmmsv_unref (colls);
+
+		if (!xmmsv_dict_get (index, namespaces[i], &entries) ||
+		    !xmmsv_get_dict_iter (entries, &it))
+			continue;
+
+		while (xmmsv_dict_iter_pair (it, &name, &entry)) {
+			int64_t start, count;
+
+			if (xmmsv_list_get_int64 (entry, 0, &start) &&
+			    xmmsv_list_get_int64 (entry, 1, &count) &&
+			    start >= 0 && count >= 0 && start + count <= data_length) {
+				serialized = xmmsv_new_bin (data + start, (guint) count);
+				xmmsv_dict_set (colls, name, serialized);
+				xmmsv_unref (serialized);
+			} else {
+				xmms_log_error ("Dropping collection '%s', out of bounds.", name);
+			}
+
+			xmmsv_dict_iter_next (it);
+		}
+	}
+
+	xmmsv_unref (index);
+
+	return snapshot;
+}
+
+/**
+ * Read a snapshot in either the indexed or the older fully serialized form.
+ */
+static xmmsv_t *
+xmms_coll_sync_load (const guchar *buffer, gsize length)
+{
+	xmmsv_t *serialized, *snapshot;
+
+	if (length >= XMMS_COLL_SYNC_MAGIC_LEN &&
+	    memcmp (buffer, XMMS_COLL_SYNC_MAGIC, XMMS_COLL_SYNC_MAGIC_LEN) == 0) {
+		return xmms_coll_sync_load_indexed (buffer, length);
+	}
+
+	serialized = xmmsv_new_bin (buffer, (guint) length);
+	snapshot = xmmsv_deserialize (serialized);
+	xmmsv_unref (serialized);
+
+	return snapshot;
+}
+
+/**
+ * Replay the journal belonging to a freshly read snapshot.
+ *
+ * If the journal is intact the result is remembered as the saved state so
+ * that later saves can append to it, otherwise the next save compacts.
+ */
+static void
+xmms_coll_sync_replay_journal (xmms_coll_sync_t *sync, const gchar *path,
+                               xmmsv_t *snapshot, gsize base_size)
+{
+	GError *error = NULL;
+	gchar *journal, *buffer;
+	gint64 generation, header_generation;
+	gsize length, offset;
+	guint records = 0;
+	gboolean header = TRUE, intact = FALSE;
+
+	sync->base_size = base_size;
+
+	if (!xmmsv_dict_entry_get_int64 (snapshot, "journal", &generation))
+		return;
+
+	sync->generation = generation;
+
+	journal = xmms_coll_sync_get_journal_path (path);
+
+	if (!g_file_get_contents (journal, &buffer, &length, &error)) {
+		XMMS_DBG ("%s", error->message);
+		g_error_free (error);
+		g_free (journal);
+		return;
+	}
+
+	offset = 0;
+
+	while (offset + sizeof (guint32) <= length) {
+		xmmsv_t *serialized, *record;
+		guint32 size;
+
+		memcpy (&size, buffer + offset, sizeof (size));
+		size = GUINT32_FROM_BE (size);
+
+		if (size > length - offset - sizeof (guint32))
+			break;
+
+		offset += sizeof (guint32);
+		serialized = xmmsv_new_bin ((const guchar *) buffer + offset, size);
+		offset += size;
+
+		record = xmmsv_deserialize (serialized);
+		xmmsv_unref (serialized);
+
+		if (record == NULL)
+			break;
+
+		if (header) {
+			intact = xmmsv_dict_entry_get_int64 (record, "generation", &header_generation) &&
+			         header_generation == generation;
+			header = FALSE;
+		} else if (xmms_coll_sync_apply_record (snapshot, record)) {
+			records++;
+		} else {
+			intact = FALSE;
+		}
+
+		xmmsv_unref (record);
+
+		if (!intact)
+			break;
+	}
+
+	if (offset != length)
+		intact = FALSE;
+
+	if (records > 0)
+		XMMS_DBG ("Replayed %u collection changes from '%s'.", records, journal);
+
+	if (intact) {
+		sync->saved = xmms_coll_sync_snapshot_copy (snapshot);
+		sync->saved_path = g_strdup (path);
+		sync->journal_size = length;
+	} else {
+		xmms_log_info ("Ignoring the rest of '%s', collections will be compacted.", journal);
+	}
+
+	g_free (buffer);
+	g_free (journal);
+}
+
 static void
 xmms_coll_sync_save (xmms_coll_sync_t *sync)
 {
@@ -406,25 +1177,30 @@ xmms_coll_sync_save (xmms_coll_sync_t *sync)
 
 	gchar *path = xmms_coll_sync_get_path (sync);
 
-	XMMS_DBG ("Syncing collections to '%s'.", path);
+	XMMS_TRACE_BEGIN ("collsync.save");
 
 	if (xmms_coll_sync_prepare_path (path, &error)) {
-		xmmsv_t *snapshot, *serialized;
-		const guchar *buffer;
-		guint length;
+		xmmsv_t *snapshot;
 
 		snapshot = xmms_collection_snapshot (sync->dag);
 
-		serialized = xmmsv_serialize (snapshot);
-		xmmsv_unref (snapshot);
+		if (xmms_coll_sync_save_journal (sync, path, snapshot, &error)) {
+			xmmsv_unref (sync->saved);
+			sync->saved = xmmsv_ref (snapshot);
+		} else {
+			if (error != NULL) {
+				XMMS_DBG ("%s", error->message);
+				g_clear_error (&error);
+			}
 
-		xmmsv_get_bin (serialized, &buffer, &length);
+			XMMS_DBG ("Syncing collections to '%s'.", path);
 
-		if (!g_file_set_contents (path, (const gchar *) buffer, (gssize) length, &error)) {
-			xmms_log_error ("Could not save collections to disk.");
+			if (!xmms_coll_sync_save_snapshot (sync, path, snapshot, &error)) {
+				xmms_log_error ("Could not save collections to disk.");
+			}
 		}
 
-		xmmsv_unref (serialized);
+		xmmsv_unref (snapshot);
 	}
 
 	if (error != NULL) {
@@ -432,6 +1208,8 @@ xmms_coll_sync_save (xmms_coll_sync_t *sync)
 		g_error_free (error);
 	}
 
+	XMMS_TRACE_END ("collsync.save");
+
 	g_free (path);
 }
 
@@ -439,8 +1217,8 @@ static void
 xmms_coll_sync_restore (xmms_coll_sync_t *sync, gboolean sad_hack)
 {
 	xmmsv_t *snapshot = NULL;
+	GMappedFile *mapped;
 	GError *error = NULL;
-	gchar *buffer;
 	gsize length;
 
 	gchar *path = xmms_coll_sync_get_path (sync);
@@ -448,14 +1226,14 @@ xmms_coll_sync_restore (xmms_coll_sync_t *sync, gboolean sad_hack)
 	XMMS_DBG ("Restoring collections from '%s'.", path);
 
 	if (xmms_coll_sync_prepare_path (path, &error)) {
-		if (g_file_get_contents (path, &buffer, &length, &error)) {
-			xmmsv_t *serialized;
-
-			serialized = xmmsv_new_bin ((const guchar *) buffer, (guint) length);
-			g_free (buffer);
-
-			snapshot = xmmsv_deserialize (serialized);
-			xmmsv_unref (serialized);
+		mapped = g_mapped_file_new (path, FALSE, &error);
+		if (mapped != NULL) {
+			length = g_mapped_file_get_length (mapped);
+			if (length > 0) {
+				snapshot = xmms_coll_sync_load ((const guchar *) g_mapped_file_get_contents (mapped),
+				                                length);
+			}
+			g_mapped_file_unref (mapped);
 
 			/* TODO: Remove me, nasty hack because the new serialization
 			 * got merged a bit too early and now is not the time to add
@@ -471,6 +1249,9 @@ xmms_coll_sync_restore (xmms_coll_sync_t *sync, gboolean sad_hack)
 				xmms_coll_sync_restore (sync, TRUE);
 				return;
 			}
+
+			if (snapshot != NULL)
+				xmms_coll_sync_replay_journal (sync, path, snapshot, length);
 		}
 	}
 
@@ -499,6 +1280,8 @@ xmms_coll_sync_loop (gpointer udata)
 {
 	xmms_coll_sync_t *sync = (xmms_coll_sync_t *) udata;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
 	g_mutex_lock (&sync->mutex);
 
 	while (sync->state != XMMS_COLL_SYNC_STATE_SHUTDOWN) {
@@ -0,0 +1,64 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/** @file
+ * Dummy used when real-time scheduling is not available.
+ */
+
+
+#include <xmmspriv/xmms_realtime.h>
+
+gboolean
+xmms_realtime_thread_enable (gint priority)
+{
+	return FALSE;
+}
+
+gboolean
+xmms_realtime_thread_background (void)
+{
+	return FALSE;
+}
+
+gboolean
+xmms_realtime_mem_lock (gconstpointer mem, gsize len)
+{
+	return FALSE;
+}
+
+void
+xmms_realtime_mem_unlock (gconstpointer mem, gsize len)
+{
+}
+
+gboolean
+xmms_realtime_thread_affinity (const guint *cpus, guint n)
+{
+	return FALSE;
+}
+
+gboolean
+xmms_realtime_thread_nice (gint nice)
+{
+	return FALSE;
+}
+
+gboolean
+xmms_realtime_thread_io_priority (gint klass, gint level)
+{
+	return FALSE;
+}
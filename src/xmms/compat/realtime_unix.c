@@ -0,0 +1,204 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+/** @file
+ * Real-time scheduling and memory locking for the playback threads.
+ */
+
+
+#define _GNU_SOURCE
+#include <xmmspriv/xmms_realtime.h>
+#include <xmms/xmms_log.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+/** Stack touched and locked when a thread goes real-time */
+#define XMMS_REALTIME_STACK (64 * 1024)
+
+static G_GNUC_NOINLINE void
+xmms_realtime_stack_prefault (void)
+{
+	volatile guint8 stack[XMMS_REALTIME_STACK];
+	gint i;
+
+	for (i = 0; i < XMMS_REALTIME_STACK; i += 1024) {
+		stack[i] = 0;
+	}
+
+	/* pages below the current frame stay mapped once touched */
+	mlock ((const void *) stack, sizeof (stack));
+}
+
+/**
+ * Switch the calling thread to SCHED_FIFO at the given priority,
+ * and fault in and lock the top of its stack.
+ */
+gboolean
+xmms_realtime_thread_enable (gint priority)
+{
+	struct sched_param param;
+	gint min, max, err;
+
+	min = sched_get_priority_min (SCHED_FIFO);
+	max = sched_get_priority_max (SCHED_FIFO);
+
+	memset (&param, 0, sizeof (param));
+	param.sched_priority = CLAMP (priority, min, max);
+
+	err = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+	if (err != 0) {
+		xmms_log_info ("Couldn't get real-time priority %d: %s",
+		               param.sched_priority, strerror (err));
+		return FALSE;
+	}
+
+	xmms_realtime_stack_prefault ();
+
+	return TRUE;
+}
+
+/**
+ * Keep the pages of a buffer in memory.
+ */
+/**
+ * Only let the calling thread run when nothing else wants the CPU.
+ */
+gboolean
+xmms_realtime_thread_background (void)
+{
+#ifdef SCHED_IDLE
+	struct sched_param param;
+	gint err;
+
+	memset (&param, 0, sizeof (param));
+
+	err = pthread_setschedparam (pthread_self (), SCHED_IDLE, &param);
+	if (err != 0) {
+		xmms_log_info ("Couldn't get idle priority: %s", strerror (err));
+		return FALSE;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+gboolean
+xmms_realtime_mem_lock (gconstpointer mem, gsize len)
+{
+	if (mlock (mem, len) == -1) {
+		xmms_log_info ("Couldn't lock %" G_GSIZE_FORMAT " bytes: %s",
+		               len, strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void
+xmms_realtime_mem_unlock (gconstpointer mem, gsize len)
+{
+	munlock (mem, len);
+}
+
+/**
+ * Only let the calling thread run on the given CPUs, or on all of
+ * them if there are none.
+ */
+gboolean
+xmms_realtime_thread_affinity (const guint *cpus, guint n)
+{
+#ifdef CPU_SET
+	cpu_set_t set;
+	guint i;
+
+	CPU_ZERO (&set);
+
+	if (!n) {
+		for (i = 0; i < CPU_SETSIZE; i++) {
+			CPU_SET (i, &set);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		if (cpus[i] < CPU_SETSIZE) {
+			CPU_SET (cpus[i], &set);
+		}
+	}
+
+	/* 0 is the calling thread, not the whole process */
+	if (sched_setaffinity (0, sizeof (set), &set) == -1) {
+		xmms_log_info ("Couldn't set CPU affinity: %s", strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Set the nice value of the calling thread. Only Linux schedules
+ * threads by their own nice value.
+ */
+gboolean
+xmms_realtime_thread_nice (gint nice)
+{
+#if defined(__linux__) && defined(SYS_gettid)
+	pid_t tid = syscall (SYS_gettid);
+
+	if (setpriority (PRIO_PROCESS, tid, nice) == -1) {
+		xmms_log_info ("Couldn't set nice value %d: %s", nice, strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+/**
+ * Set the I/O scheduling class and level of the calling thread, class
+ * 0 being the default of following its nice value.
+ */
+gboolean
+xmms_realtime_thread_io_priority (gint klass, gint level)
+{
+#if defined(__linux__) && defined(SYS_ioprio_set)
+	/* IOPRIO_WHO_PROCESS with tid 0 is the calling thread */
+	if (syscall (SYS_ioprio_set, 1, 0, (klass << 13) | CLAMP (level, 0, 7)) == -1) {
+		xmms_log_info ("Couldn't set I/O priority: %s", strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
@@ -0,0 +1,36 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ * Dummy used when the daemon can't replace itself keeping its sockets.
+ */
+
+
+#include <xmmspriv/xmms_restart.h>
+
+gboolean
+xmms_restart_supported (void)
+{
+	return FALSE;
+}
+
+gboolean
+xmms_restart_exec (gchar **argv, const gint *keep, gint n)
+{
+	return FALSE;
+}
@@ -0,0 +1,84 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ * Replaces the daemon by a new image of itself, which inherits the
+ * listening sockets and nothing else.
+ */
+
+
+#include <xmmspriv/xmms_restart.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+
+gboolean
+xmms_restart_supported (void)
+{
+	return TRUE;
+}
+
+static void
+xmms_restart_cloexec (gint fd, gboolean set)
+{
+	fcntl (fd, F_SETFD, set ? FD_CLOEXEC : 0);
+}
+
+/**
+ * Replace this process by argv, only returns if that failed. Of the
+ * descriptors past stderr only those in keep stay open. The signals
+ * blocked by xmms_signal_block stay blocked, the new daemon blocks
+ * them as well.
+ */
+gboolean
+xmms_restart_exec (gchar **argv, const gint *keep, gint n)
+{
+	const gchar *name;
+	GDir *dir;
+	gint fd, i;
+
+	g_return_val_if_fail (argv && argv[0], FALSE);
+
+	/* client connections, the sound device, open files... */
+	dir = g_dir_open ("/proc/self/fd", 0, NULL);
+	if (dir) {
+		while ((name = g_dir_read_name (dir))) {
+			fd = atoi (name);
+			if (fd > 2) {
+				xmms_restart_cloexec (fd, TRUE);
+			}
+		}
+		g_dir_close (dir);
+	} else {
+		gint max = sysconf (_SC_OPEN_MAX);
+
+		for (fd = 3; fd < max; fd++) {
+			xmms_restart_cloexec (fd, TRUE);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		xmms_restart_cloexec (keep[i], FALSE);
+	}
+
+	execvp (argv[0], argv);
+
+	return FALSE;
+}
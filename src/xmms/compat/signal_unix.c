@@ -24,6 +24,7 @@
 
 #include <xmmspriv/xmms_signal.h>
 #include <xmmspriv/xmms_thread_name.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_object.h>
 
@@ -44,6 +45,8 @@ sigwaiter (gpointer data)
 	sigset_t signals;
 	int caught;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
 	sigemptyset(&signals);
 	sigaddset (&signals, SIGINT);
 	sigaddset (&signals, SIGTERM);
@@ -16,6 +16,7 @@
  */
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,6 +29,7 @@
 #include <xmmsc/xmmsc_idnumbers.h>
 #include <xmmspriv/xmms_config.h>
 #include <xmmspriv/xmms_utils.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmms/xmms_ipc.h>
 #include <xmms/xmms_log.h>
 
@@ -48,6 +50,14 @@ typedef enum {
 	XMMS_CONFIG_STATE_PROPERTY
 } xmms_configparser_state_t;
 
+/** @internal */
+typedef enum {
+	XMMS_CONFIG_SAVE_IDLE,
+	XMMS_CONFIG_SAVE_DELAYED,
+	XMMS_CONFIG_SAVE_PENDING,
+	XMMS_CONFIG_SAVE_SHUTDOWN
+} xmms_config_save_state_t;
+
 typedef struct dump_tree_data_St {
 	FILE *fp;
 	xmms_configparser_state_t state;
@@ -63,6 +73,7 @@ static xmms_config_property_t *xmms_config_property_new (const gchar *name);
 static gchar *xmms_config_client_get_value (xmms_config_t *conf, const gchar *key, xmms_error_t *err);
 static gchar *xmms_config_client_register_value (xmms_config_t *config, const gchar *name, const gchar *def_value, xmms_error_t *error);
 static gint compare_key (gconstpointer a, gconstpointer b, gpointer user_data);
+static void xmms_config_save_schedule (void);
 static void xmms_config_client_set_value (xmms_config_t *conf, const gchar *key, const gchar *value, xmms_error_t *err);
 
 #include "config_ipc.c"
@@ -97,6 +108,13 @@ struct xmms_config_St {
 	GQueue *sections;
 	gchar *value_name;
 	guint version;
+
+	/* saving, once nothing has changed for a while */
+	GThread *save_thread;
+	GMutex save_mutex;
+	GCond save_cond;
+	xmms_config_save_state_t save_state;
+	gboolean save_dirty;
 };
 
 /**
@@ -109,8 +127,18 @@ struct xmms_config_property_St {
 	const gchar *name;
 	/** The data */
 	gchar *value;
+	/** The data before the last change, for readers racing it */
+	gchar *old_value;
+	/** The data as an int and as the bits of a float */
+	gint int_value;
+	gint float_value;
 };
 
+typedef union {
+	gfloat f;
+	gint i;
+} xmms_config_float_bits_t;
+
 /**
  * Global config
  * Since there can only be one configuration per server
@@ -124,6 +152,11 @@ static xmms_config_t *global_config;
  */
 #define XMMS_CONFIG_VERSION 2
 
+/**
+ * How long the config has to stay unchanged before it is saved
+ */
+#define XMMS_CONFIG_SAVE_DELAY 10 * G_TIME_SPAN_SECOND
+
 /**
  * @}
  * @addtogroup Config
@@ -163,6 +196,11 @@ xmms_config_property_lookup_get_string (xmms_config_t *conf, const gchar *key,
 
 /**
  * Look up a config key from the global config
+ *
+ * Properties live as long as the config, so code that reads one
+ * often should look it up once and keep the property, its values
+ * are read without locking.
+ *
  * @param path A configuration path. Could be core.myconfig or
  * effect.foo.myconfig
  * @return An #xmms_config_property_t
@@ -201,6 +239,9 @@ xmms_config_property_get_name (const xmms_config_property_t *prop)
 void
 xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 {
+	xmms_config_float_bits_t bits;
+	gchar *value;
+
 	g_return_if_fail (prop);
 	g_return_if_fail (data);
 
@@ -208,8 +249,16 @@ xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 	if (prop->value && !strcmp (prop->value, data))
 		return;
 
-	g_free (prop->value);
-	prop->value = g_strdup (data);
+	value = g_strdup (data);
+	bits.f = atof (value);
+
+	g_atomic_int_set (&prop->int_value, atoi (value));
+	g_atomic_int_set (&prop->float_value, bits.i);
+
+	/* a string read before this change stays valid until the next */
+	g_free (prop->old_value);
+	prop->old_value = prop->value;
+	g_atomic_pointer_set (&prop->value, value);
 
 	xmms_object_emit (XMMS_OBJECT (prop),
 	                  XMMS_IPC_SIGNAL_CONFIG_VALUE_CHANGED,
@@ -221,9 +270,10 @@ xmms_config_property_set_data (xmms_config_property_t *prop, const gchar *data)
 	                                    XMMSV_DICT_END));
 
 	/* save the database to disk, so we don't lose any data
-	 * if the daemon crashes
+	 * if the daemon crashes. wait for the changes to settle,
+	 * a slider may be dragged across a value.
 	 */
-	xmms_config_save ();
+	xmms_config_save_schedule ();
 }
 
 /**
@@ -235,7 +285,7 @@ const gchar *
 xmms_config_property_get_string (const xmms_config_property_t *prop)
 {
 	g_return_val_if_fail (prop, NULL);
-	return prop->value;
+	return g_atomic_pointer_get (&((xmms_config_property_t *) prop)->value);
 }
 
 /**
@@ -247,10 +297,7 @@ gint
 xmms_config_property_get_int (const xmms_config_property_t *prop)
 {
 	g_return_val_if_fail (prop, 0);
-	if (prop->value)
-		return atoi (prop->value);
-
-	return 0;
+	return g_atomic_int_get (&prop->int_value);
 }
 
 /**
@@ -261,11 +308,12 @@ xmms_config_property_get_int (const xmms_config_property_t *prop)
 gfloat
 xmms_config_property_get_float (const xmms_config_property_t *prop)
 {
+	xmms_config_float_bits_t bits;
+
 	g_return_val_if_fail (prop, 0.0);
-	if (prop->value)
-		return atof (prop->value);
 
-	return 0.0;
+	bits.i = g_atomic_int_get (&prop->float_value);
+	return bits.f;
 }
 
 /**
@@ -640,6 +688,8 @@ xmms_config_destroy (xmms_object_t *object)
 	XMMS_DBG ("Deactivating config object.");
 
 	g_mutex_clear (&config->mutex);
+	g_mutex_clear (&config->save_mutex);
+	g_cond_clear (&config->save_cond);
 
 	g_tree_destroy (config->properties);
 
@@ -680,8 +730,9 @@ load_config (xmms_config_t *config, const gchar *filename)
 {
 	GMarkupParser pars;
 	GMarkupParseContext *ctx;
-	int fd = -1;
-	gboolean parserr = FALSE, eof = FALSE;
+	GError *error = NULL;
+	gchar *contents = NULL;
+	gsize length = 0;
 
 	memset (&pars, 0, sizeof (pars));
 
@@ -694,11 +745,9 @@ load_config (xmms_config_t *config, const gchar *filename)
 		return;
 	}
 
-	if (g_file_test (filename, G_FILE_TEST_EXISTS)) {
-		fd = open (filename, O_RDONLY);
-	}
-
-	if (fd < 0) {
+	/* parsed in one go, rather than a read and a parse call for
+	 * every kilobyte of the file */
+	if (!g_file_get_contents (filename, &contents, &length, NULL)) {
 		xmms_log_info ("No configfile specified, using default values.");
 		return;
 	}
@@ -709,43 +758,20 @@ load_config (xmms_config_t *config, const gchar *filename)
 
 	ctx = g_markup_parse_context_new (&pars, 0, config, NULL);
 
-	while ((!eof) && (!parserr)) {
-		GError *error = NULL;
-		gchar buffer[1024];
-		gint ret;
-
-		ret = read (fd, buffer, 1024);
-		if (ret < 1) {
-			g_markup_parse_context_end_parse (ctx, &error);
-			if (error) {
-				xmms_log_error ("Cannot parse config file: %s",
-				                error->message);
-				g_error_free (error);
-				error = NULL;
-				parserr = TRUE;
-			}
-			eof = TRUE;
-		}
+	if (!g_markup_parse_context_parse (ctx, contents, length, &error) ||
+	    !g_markup_parse_context_end_parse (ctx, &error)) {
+		xmms_log_error ("Cannot parse config file: %s", error->message);
+		g_error_free (error);
 
-		g_markup_parse_context_parse (ctx, buffer, ret, &error);
-		if (error) {
-			xmms_log_error ("Cannot parse config file: %s",
-			                error->message);
-			g_error_free (error);
-			error = NULL;
-			parserr = TRUE;
-		}
-		/* check config file version, assumes that g_markup_context_parse
-		 * above managed to parse the <xmms> element during the first
-		 * iteration of this loop */
-		if (XMMS_CONFIG_VERSION > config->version) {
-			clear_config (config);
-			break;
-		}
+		xmms_log_info ("The config file could not be parsed, reverting to default configuration..");
+		clear_config (config);
+	} else if (XMMS_CONFIG_VERSION > config->version) {
+		/* check config file version */
+		clear_config (config);
 	}
 
-	close (fd);
 	g_markup_parse_context_free (ctx);
+	g_free (contents);
 
 	while (!g_queue_is_empty (config->sections)) {
 		g_free (g_queue_pop_head (config->sections));
@@ -755,11 +781,6 @@ load_config (xmms_config_t *config, const gchar *filename)
 	g_queue_free (config->sections);
 
 	config->is_parsing = FALSE;
-
-	if (parserr) {
-		xmms_log_info ("The config file could not be parsed, reverting to default configuration..");
-		clear_config (config);
-	}
 }
 
 
@@ -775,6 +796,8 @@ xmms_config_init (const gchar *filename)
 
 	config = xmms_object_new (xmms_config_t, xmms_config_destroy);
 	g_mutex_init (&config->mutex);
+	g_mutex_init (&config->save_mutex);
+	g_cond_init (&config->save_cond);
 	config->filename = filename;
 
 	config->properties = create_tree ();
@@ -794,10 +817,106 @@ xmms_config_init (const gchar *filename)
 void
 xmms_config_shutdown ()
 {
+	gboolean dirty;
+
+	g_mutex_lock (&global_config->save_mutex);
+	global_config->save_state = XMMS_CONFIG_SAVE_SHUTDOWN;
+	g_cond_signal (&global_config->save_cond);
+	g_mutex_unlock (&global_config->save_mutex);
+
+	if (global_config->save_thread) {
+		g_thread_join (global_config->save_thread);
+		global_config->save_thread = NULL;
+	}
+
+	g_mutex_lock (&global_config->save_mutex);
+	dirty = global_config->save_dirty;
+	g_mutex_unlock (&global_config->save_mutex);
+
+	/* don't lose what changed since the last save */
+	if (dirty) {
+		xmms_config_save ();
+	}
+
 	xmms_object_unref (global_config);
 
 }
 
+/**
+ * @internal Wait until the config hasn't changed for
+ * XMMS_CONFIG_SAVE_DELAY, then save it.
+ */
+static gpointer
+xmms_config_save_loop (gpointer udata)
+{
+	xmms_config_t *config = (xmms_config_t *) udata;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
+	g_mutex_lock (&config->save_mutex);
+
+	while (config->save_state != XMMS_CONFIG_SAVE_SHUTDOWN) {
+		if (config->save_state == XMMS_CONFIG_SAVE_IDLE) {
+			g_cond_wait (&config->save_cond, &config->save_mutex);
+			continue;
+		}
+
+		/* every change while waiting starts the wait over */
+		while (config->save_state == XMMS_CONFIG_SAVE_DELAYED) {
+			gint64 end_time;
+
+			config->save_state = XMMS_CONFIG_SAVE_PENDING;
+
+			end_time = g_get_monotonic_time () + XMMS_CONFIG_SAVE_DELAY;
+			while (config->save_state == XMMS_CONFIG_SAVE_PENDING &&
+			       g_cond_wait_until (&config->save_cond, &config->save_mutex, end_time));
+		}
+
+		if (config->save_state == XMMS_CONFIG_SAVE_PENDING) {
+			config->save_state = XMMS_CONFIG_SAVE_IDLE;
+
+			g_mutex_unlock (&config->save_mutex);
+			xmms_config_save ();
+			g_mutex_lock (&config->save_mutex);
+		}
+	}
+
+	g_mutex_unlock (&config->save_mutex);
+
+	return NULL;
+}
+
+/**
+ * @internal Save the config once it has stopped changing.
+ */
+static void
+xmms_config_save_schedule (void)
+{
+	xmms_config_t *config = global_config;
+
+	/* nothing to save while it's being read */
+	if (!config || config->is_parsing ||
+	    g_strcmp0 (config->filename, "memory://") == 0) {
+		return;
+	}
+
+	g_mutex_lock (&config->save_mutex);
+
+	if (config->save_state != XMMS_CONFIG_SAVE_SHUTDOWN) {
+		if (!config->save_thread) {
+			config->save_thread = g_thread_new ("x2 config save",
+			                                    xmms_config_save_loop,
+			                                    config);
+		}
+
+		config->save_dirty = TRUE;
+		config->save_state = XMMS_CONFIG_SAVE_DELAYED;
+		g_cond_signal (&config->save_cond);
+	}
+
+	g_mutex_unlock (&config->save_mutex);
+}
+
 static gboolean
 dump_tree (gchar *current_key, xmms_config_property_t *prop,
            dump_tree_data_t *data)
@@ -881,9 +1000,24 @@ dump_tree (gchar *current_key, xmms_config_property_t *prop,
 	return FALSE; /* keep going */
 }
 
+/**
+ * @internal Keep any changes to the configuration from now on in
+ * memory only, the file is left as it was loaded.
+ */
+void
+xmms_config_detach (void)
+{
+	g_return_if_fail (global_config);
+
+	global_config->filename = "memory://";
+}
+
 /**
  * @internal Save the global configuration to disk.
- * @param file Absolute path to configfile. This will be overwritten.
+ *
+ * The file is written next to the config file and renamed over it,
+ * so a crash while saving leaves the previous config in place.
+ *
  * @return TRUE on success.
  */
 gboolean
@@ -891,6 +1025,8 @@ xmms_config_save (void)
 {
 	FILE *fp = NULL;
 	dump_tree_data_t data;
+	gchar *tmp;
+	gboolean ret = TRUE;
 
 	g_return_val_if_fail (global_config, FALSE);
 
@@ -902,9 +1038,20 @@ xmms_config_save (void)
 	if (global_config->is_parsing)
 		return FALSE;
 
-	if (!(fp = fopen (global_config->filename, "w"))) {
-		xmms_log_error ("Couldn't open %s for writing.",
-		                global_config->filename);
+	g_mutex_lock (&global_config->save_mutex);
+	global_config->save_dirty = FALSE;
+	g_mutex_unlock (&global_config->save_mutex);
+
+	/* keeps the tree still, and the save thread and the final save
+	 * at shutdown from writing the same file */
+	g_mutex_lock (&global_config->mutex);
+
+	tmp = g_strconcat (global_config->filename, ".tmp", NULL);
+
+	if (!(fp = fopen (tmp, "w"))) {
+		xmms_log_error ("Couldn't open %s for writing.", tmp);
+		g_mutex_unlock (&global_config->mutex);
+		g_free (tmp);
 		return FALSE;
 	}
 
@@ -933,9 +1080,26 @@ xmms_config_save (void)
 	}
 
 	fprintf (fp, "</xmms>\n");
-	fclose (fp);
 
-	return TRUE;
+	if (fflush (fp) != 0 || fsync (fileno (fp)) != 0) {
+		ret = FALSE;
+	}
+
+	if (fclose (fp) != 0 || !ret) {
+		xmms_log_error ("Couldn't write %s.", tmp);
+		unlink (tmp);
+		ret = FALSE;
+	} else if (g_rename (tmp, global_config->filename) != 0) {
+		xmms_log_error ("Couldn't rename %s to %s.", tmp,
+		                global_config->filename);
+		unlink (tmp);
+		ret = FALSE;
+	}
+
+	g_mutex_unlock (&global_config->mutex);
+	g_free (tmp);
+
+	return ret;
 }
 
 /*
@@ -955,6 +1119,7 @@ xmms_config_property_destroy (xmms_object_t *object)
 	 * xmms_config_destroy()
 	 */
 	g_free (prop->value);
+	g_free (prop->old_value);
 }
 
 /**
@@ -17,6 +17,7 @@
 
 #include <glib.h>
 #include <math.h>
+#include <string.h>
 #include <xmmspriv/xmms_converter.h>
 #include <xmms/xmms_medialib.h>
 #include <xmms/xmms_object.h>
@@ -29,6 +30,47 @@
   * @{
   */
 
+/** Above this interpolation ratio the filter banks get too large and
+ *  linear interpolation is used instead */
+#define XMMS_RESAMPLER_MAX_PHASES 1024
+/** Number of unused filter banks to keep around */
+#define XMMS_RESAMPLER_CACHE_SIZE 8
+
+typedef enum {
+	XMMS_SAMPLE_CONV_DIRECT,
+	XMMS_SAMPLE_CONV_LINEAR,
+	XMMS_SAMPLE_CONV_POLYPHASE
+} xmms_sample_conv_mode_t;
+
+/** Filter design of each resampling quality */
+static const struct {
+	guint taps;      /* per phase, a multiple of 4 */
+	gdouble beta;    /* of the Kaiser window */
+	gdouble cutoff;  /* relative to the lower Nyquist frequency */
+} resampler_presets[] = {
+	[XMMS_SAMPLE_RESAMPLE_FAST]   = {  8, 5.0, 0.85 },
+	[XMMS_SAMPLE_RESAMPLE_MEDIUM] = { 24, 7.0, 0.90 },
+	[XMMS_SAMPLE_RESAMPLE_BEST]   = { 64, 9.0, 0.95 },
+};
+
+/**
+ * The coefficients of a polyphase filter for one rate pair, shared by
+ * all converters resampling between the same rates.
+ */
+typedef struct {
+	gint ref;
+	guint interpolator_ratio;
+	guint decimator_ratio;
+	xmms_sample_resample_quality_t quality;
+	guint taps;
+	/* interpolator_ratio phases of taps coefficients, each phase in
+	 * reverse order so it can be applied to the input going forward */
+	gfloat *coeffs;
+} xmms_resampler_bank_t;
+
+static GMutex resampler_banks_lock;
+static GList *resampler_banks;
+
 /**
  * The converter module
  */
@@ -50,17 +92,27 @@ struct xmms_sample_converter_St {
 
 	guint offset;
 
+	/* the last input frame, for linear interpolation */
 	xmms_sample_t *state;
 
+	/* polyphase filtering */
+	xmms_resampler_bank_t *bank;
+	/* the last taps - 1 input frames of each channel */
+	gfloat *history;
+	/* planar copy of the history and the input being resampled */
+	gfloat *work;
+	guint worksiz;
+
 	xmms_sample_conv_func_t func;
 
 };
 
-static void recalculate_resampler (xmms_sample_converter_t *conv, guint from, guint to);
+static void recalculate_resampler (xmms_sample_converter_t *conv, guint from, guint to, xmms_sample_resample_quality_t quality);
+static void xmms_resampler_bank_unref (xmms_resampler_bank_t *bank);
 static xmms_sample_conv_func_t
 xmms_sample_conv_get (guint inchannels, xmms_sample_format_t intype,
                       guint outchannels, xmms_sample_format_t outtype,
-                      gboolean resample);
+                      xmms_sample_conv_mode_t mode);
 
 
 
@@ -71,14 +123,27 @@ xmms_sample_converter_destroy (xmms_object_t *obj)
 
 	g_free (conv->buf);
 	g_free (conv->state);
+	g_free (conv->history);
+	g_free (conv->work);
+
+	if (conv->bank) {
+		xmms_resampler_bank_unref (conv->bank);
+	}
 }
 
+/**
+ * Create a converter between two audio formats.
+ *
+ * @param quality The filter to use if the sample rates differ.
+ */
 xmms_sample_converter_t *
-xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to)
+xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to,
+                            xmms_sample_resample_quality_t quality)
 {
 	xmms_sample_converter_t *conv = xmms_object_new (xmms_sample_converter_t, xmms_sample_converter_destroy);
 	gint fformat, fsamplerate, fchannels;
 	gint tformat, tsamplerate, tchannels;
+	xmms_sample_conv_mode_t mode = XMMS_SAMPLE_CONV_DIRECT;
 
 	fformat = xmms_stream_type_get_int (from, XMMS_STREAM_TYPE_FMT_FORMAT);
 	fsamplerate = xmms_stream_type_get_int (from, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
@@ -96,9 +161,20 @@ xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to)
 
 	conv->resample = fsamplerate != tsamplerate;
 
+	/* nothing to do, the input is handed out as it is */
+	conv->same = !conv->resample && fformat == tformat && fchannels == tchannels;
+	if (conv->same) {
+		return conv;
+	}
+
+	if (conv->resample) {
+		recalculate_resampler (conv, fsamplerate, tsamplerate, quality);
+		mode = conv->bank ? XMMS_SAMPLE_CONV_POLYPHASE : XMMS_SAMPLE_CONV_LINEAR;
+	}
+
 	conv->func = xmms_sample_conv_get (fchannels, fformat,
 	                                   tchannels, tformat,
-	                                   conv->resample);
+	                                   mode);
 
 	if (!conv->func) {
 		xmms_object_unref (conv);
@@ -108,12 +184,20 @@ xmms_sample_converter_init (xmms_stream_type_t *from, xmms_stream_type_t *to)
 		return NULL;
 	}
 
-	if (conv->resample)
-		recalculate_resampler (conv, fsamplerate, tsamplerate);
-
 	return conv;
 }
 
+/**
+ * Whether the converter hands out its input as it is.
+ */
+gboolean
+xmms_sample_converter_is_identity (xmms_sample_converter_t *conv)
+{
+	g_return_val_if_fail (conv, FALSE);
+
+	return conv->same;
+}
+
 /**
  * Return the audio format used by the converter as source
  */
@@ -170,8 +254,211 @@ xmms_sample_converter_to_medialib (xmms_sample_converter_t *conv, xmms_medialib_
 }
 
 
+/* zeroth order modified Bessel function of the first kind */
+static gdouble
+bessel_i0 (gdouble x)
+{
+	gdouble sum = 1.0, term = 1.0;
+	gint k;
+
+	for (k = 1; k < 32; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/**
+ * Fill in a Kaiser windowed sinc lowpass for every phase of a filter
+ * bank, each phase normalized to unity gain.
+ */
 static void
-recalculate_resampler (xmms_sample_converter_t *conv, guint from, guint to)
+xmms_resampler_bank_calculate (xmms_resampler_bank_t *bank)
+{
+	guint phases = bank->interpolator_ratio;
+	guint taps = bank->taps;
+	gdouble beta, cutoff;
+	gfloat *coeffs;
+	guint p, k;
+
+	beta = resampler_presets[bank->quality].beta;
+	cutoff = resampler_presets[bank->quality].cutoff *
+	         MIN (1.0, (gdouble) bank->interpolator_ratio / bank->decimator_ratio);
+
+	bank->coeffs = g_new (gfloat, phases * taps);
+
+	for (p = 0; p < phases; p++) {
+		gdouble sum = 0.0;
+
+		coeffs = &bank->coeffs[p * taps];
+
+		for (k = 0; k < taps; k++) {
+			/* distance of tap k from the output frame, in input frames */
+			gdouble d = taps / 2.0 - k - (gdouble) p / phases;
+			gdouble x = cutoff * d;
+			gdouble r = 2.0 * d / taps;
+			gdouble w;
+
+			w = ABS (r) >= 1.0 ? 0.0 : bessel_i0 (beta * sqrt (1.0 - r * r)) / bessel_i0 (beta);
+
+			w *= x == 0.0 ? 1.0 : sin (M_PI * x) / (M_PI * x);
+			sum += w;
+
+			/* tap k applies to the frame k before the newest one */
+			coeffs[taps - 1 - k] = w;
+		}
+
+		for (k = 0; k < taps; k++) {
+			coeffs[k] /= sum;
+		}
+	}
+}
+
+/**
+ * Get the filter bank for a rate pair, computing it if no converter
+ * has used it lately.
+ */
+static xmms_resampler_bank_t *
+xmms_resampler_bank_get (guint interpolator_ratio, guint decimator_ratio,
+                         xmms_sample_resample_quality_t quality)
+{
+	xmms_resampler_bank_t *bank;
+	GList *n, *next;
+	guint unused = 0;
+
+	g_mutex_lock (&resampler_banks_lock);
+
+	for (n = resampler_banks; n; n = g_list_next (n)) {
+		bank = n->data;
+		if (bank->interpolator_ratio == interpolator_ratio &&
+		    bank->decimator_ratio == decimator_ratio &&
+		    bank->quality == quality) {
+			/* most recently used first */
+			resampler_banks = g_list_remove_link (resampler_banks, n);
+			resampler_banks = g_list_concat (n, resampler_banks);
+			bank->ref++;
+			g_mutex_unlock (&resampler_banks_lock);
+			return bank;
+		}
+	}
+
+	bank = g_new0 (xmms_resampler_bank_t, 1);
+	bank->ref = 2; /* the cache holds one */
+	bank->interpolator_ratio = interpolator_ratio;
+	bank->decimator_ratio = decimator_ratio;
+	bank->quality = quality;
+	bank->taps = resampler_presets[quality].taps;
+	xmms_resampler_bank_calculate (bank);
+
+	resampler_banks = g_list_prepend (resampler_banks, bank);
+
+	/* drop the least recently used banks nobody else holds */
+	for (n = resampler_banks; n; n = next) {
+		xmms_resampler_bank_t *b = n->data;
+
+		next = g_list_next (n);
+		if (b->ref == 1 && ++unused > XMMS_RESAMPLER_CACHE_SIZE) {
+			resampler_banks = g_list_delete_link (resampler_banks, n);
+			g_free (b->coeffs);
+			g_free (b);
+		}
+	}
+
+	g_mutex_unlock (&resampler_banks_lock);
+
+	return bank;
+}
+
+static void
+xmms_resampler_bank_unref (xmms_resampler_bank_t *bank)
+{
+	g_mutex_lock (&resampler_banks_lock);
+	bank->ref--;
+	g_mutex_unlock (&resampler_banks_lock);
+}
+
+/**
+ * Make room for len frames of planar input after the history.
+ *
+ * @returns The work buffer, channel after channel with a stride of
+ * taps - 1 + len. The history is copied in front of each channel.
+ */
+static gfloat *
+xmms_resampler_work_get (xmms_sample_converter_t *conv, guint channels, guint len)
+{
+	guint hist = conv->bank->taps - 1;
+	guint stride = hist + len;
+	guint i;
+
+	if (channels * stride > conv->worksiz) {
+		conv->worksiz = channels * stride;
+		conv->work = g_realloc (conv->work, conv->worksiz * sizeof (gfloat));
+	}
+
+	for (i = 0; i < channels; i++) {
+		memcpy (&conv->work[i * stride], &conv->history[i * hist],
+		        hist * sizeof (gfloat));
+	}
+
+	return conv->work;
+}
+
+/**
+ * Keep the last taps - 1 frames of the work buffer for the next call.
+ */
+static void
+xmms_resampler_work_done (xmms_sample_converter_t *conv, guint channels, guint len)
+{
+	guint hist = conv->bank->taps - 1;
+	guint stride = hist + len;
+	guint i;
+
+	for (i = 0; i < channels; i++) {
+		memcpy (&conv->history[i * hist], &conv->work[i * stride + len],
+		        hist * sizeof (gfloat));
+	}
+}
+
+#if defined(__GNUC__)
+typedef gfloat xmms_resampler_v4sf __attribute__ ((vector_size (16)));
+#endif
+
+/**
+ * Apply one phase of the filter to the input starting at x.
+ */
+static inline gfloat
+xmms_resampler_dot (const gfloat *coeffs, const gfloat *x, guint taps)
+{
+#if defined(__GNUC__)
+	xmms_resampler_v4sf acc = { 0.0, 0.0, 0.0, 0.0 };
+	xmms_resampler_v4sf c, v;
+	guint k;
+
+	/* taps is a multiple of 4; the loads go through memcpy since
+	 * neither pointer is aligned */
+	for (k = 0; k < taps; k += 4) {
+		memcpy (&c, &coeffs[k], sizeof (c));
+		memcpy (&v, &x[k], sizeof (v));
+		acc += c * v;
+	}
+
+	return acc[0] + acc[1] + acc[2] + acc[3];
+#else
+	gfloat acc = 0.0;
+	guint k;
+
+	for (k = 0; k < taps; k++) {
+		acc += coeffs[k] * x[k];
+	}
+
+	return acc;
+#endif
+}
+
+static void
+recalculate_resampler (xmms_sample_converter_t *conv, guint from, guint to,
+                       xmms_sample_resample_quality_t quality)
 {
 	guint a,b;
 
@@ -196,15 +483,15 @@ recalculate_resampler (xmms_sample_converter_t *conv, guint from, guint to)
 	conv->interpolator_ratio = to/a;
 	conv->decimator_ratio = from/a;
 
-	conv->state = g_malloc0 (xmms_sample_frame_size_get (conv->from));
-
-	/*
-	 * calculate filter here
-	 *
-	 * We don't use no stinkning filter. Maybe we should,
-	 * but I'm deaf anyway, I wont hear any difference.
-	 */
-
+	if (conv->interpolator_ratio <= XMMS_RESAMPLER_MAX_PHASES) {
+		conv->bank = xmms_resampler_bank_get (conv->interpolator_ratio,
+		                                      conv->decimator_ratio,
+		                                      quality);
+		conv->history = g_new0 (gfloat, (conv->bank->taps - 1) *
+		                        xmms_stream_type_get_int (conv->from, XMMS_STREAM_TYPE_FMT_CHANNELS));
+	} else {
+		conv->state = g_malloc0 (xmms_sample_frame_size_get (conv->from));
+	}
 }
 
 
@@ -277,7 +564,12 @@ xmms_sample_convert_reset (xmms_sample_converter_t *conv)
 {
 	if (conv->resample) {
 		conv->offset = 0;
-		memset (conv->state, 0, xmms_sample_frame_size_get (conv->from));
+		if (conv->bank) {
+			memset (conv->history, 0, (conv->bank->taps - 1) * sizeof (gfloat) *
+			        xmms_stream_type_get_int (conv->from, XMMS_STREAM_TYPE_FMT_CHANNELS));
+		} else {
+			memset (conv->state, 0, xmms_sample_frame_size_get (conv->from));
+		}
 	}
 }
 
@@ -21,6 +21,7 @@
 #include <xmmspriv/xmms_converter.h>
 #include <xmmspriv/xmms_xform.h>
 #include <xmms/xmms_medialib.h>
+#include <xmms/xmms_log.h>
 
 #include <string.h>
 
@@ -32,6 +33,26 @@ typedef struct xmms_conv_xform_data_St {
 
 static xmms_xform_plugin_t *converter_plugin;
 
+static xmms_sample_resample_quality_t
+xmms_converter_plugin_quality_get (xmms_xform_t *xform)
+{
+	xmms_config_property_t *config;
+	const gchar *value;
+
+	config = xmms_xform_config_lookup (xform, "resample_quality");
+	value = config ? xmms_config_property_get_string (config) : NULL;
+
+	if (value && strcmp (value, "fast") == 0) {
+		return XMMS_SAMPLE_RESAMPLE_FAST;
+	} else if (value && strcmp (value, "best") == 0) {
+		return XMMS_SAMPLE_RESAMPLE_BEST;
+	} else if (value && strcmp (value, "medium") != 0) {
+		xmms_log_error ("Unknown resample_quality '%s', using 'medium'", value);
+	}
+
+	return XMMS_SAMPLE_RESAMPLE_MEDIUM;
+}
+
 static gboolean
 xmms_converter_plugin_init (xmms_xform_t *xform)
 {
@@ -49,7 +70,8 @@ xmms_converter_plugin_init (xmms_xform_t *xform)
 		return FALSE;
 	}
 
-	conv = xmms_sample_converter_init (intype, to);
+	conv = xmms_sample_converter_init (intype, to,
+	                                   xmms_converter_plugin_quality_get (xform));
 	if (!conv) {
 		return FALSE;
 	}
@@ -89,6 +111,11 @@ xmms_converter_plugin_read (xmms_xform_t *xform, void *buffer, gint len, xmms_er
 
 	data = xmms_xform_private_data_get (xform);
 
+	/* no copy through the bounce buffer when there is nothing to do */
+	if (xmms_sample_converter_is_identity (data->conv)) {
+		return xmms_xform_read (xform, buffer, len, error);
+	}
+
 	if (!data->outlen) {
 		int r = xmms_xform_read (xform, buf, sizeof (buf), error);
 		if (r <= 0) {
@@ -145,6 +172,11 @@ xmms_converter_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 
 	xmms_xform_plugin_methods_set (xform_plugin, &methods);
 
+	/* fast, medium or best, used when the sample rate changes */
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "resample_quality", "medium",
+	                                            NULL, NULL);
+
 	/*
 	 * Handle any pcm data...
 	 * Well, we don't really..
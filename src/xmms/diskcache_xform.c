@@ -0,0 +1,578 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Disk cache for remote media.
+ *
+ * Sits right after a remote transport and keeps a copy of every stream
+ * read from start to end on disk. The next time the same URL is opened
+ * and the transport reports the same validator (size, last modification
+ * time and ETag, whatever it knows), reads and seeks are served from
+ * the copy instead. The cache is bounded by diskcache.size, the least
+ * recently used streams are dropped first.
+ *
+ * Each stream is stored as <sha1 of url> with its url and validator in
+ * <sha1 of url>.info, streams are written to a temporary file and only
+ * renamed into place once complete.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <xmmsc/xmmsc_util.h>
+#include <xmms/xmms_log.h>
+#include <xmms/xmms_medialib.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmmspriv/xmms_diskcache.h>
+#include <xmmspriv/xmms_xform.h>
+
+#define XMMS_DISKCACHE_GROUP "diskcache"
+
+typedef struct xmms_diskcache_priv_St {
+	gchar *path;
+	gint32 size;
+	/** Serving from the cache, otherwise passing through */
+	gboolean hit;
+	gint fd;
+	gint64 pos;
+
+	/* while passing through, the stream is copied to tmppath, as long
+	 * as it is read from the start without gaps */
+	gchar *tmppath;
+	gchar *url;
+	gchar *validator;
+	gint wfd;
+	gint64 written;
+} xmms_diskcache_priv_t;
+
+typedef struct xmms_diskcache_file_St {
+	gchar *name;
+	gint64 size;
+	time_t mtime;
+} xmms_diskcache_file_t;
+
+static gint diskcache_hits;
+static gint diskcache_misses;
+
+/* what is on disk, as of the last scan */
+G_LOCK_DEFINE_STATIC (diskcache);
+static guint diskcache_entries;
+static gint64 diskcache_bytes;
+
+static gchar *
+xmms_diskcache_dir (void)
+{
+	gchar cachedir[XMMS_PATH_MAX];
+
+	if (!xmms_usercachedir_get (cachedir, XMMS_PATH_MAX)) {
+		return NULL;
+	}
+
+	return g_build_filename (cachedir, "media", NULL);
+}
+
+static gint64
+xmms_diskcache_max_size (void)
+{
+	xmms_config_property_t *cfg;
+
+	cfg = xmms_config_lookup ("diskcache.size");
+	if (!cfg) {
+		return 0;
+	}
+
+	return xmms_config_property_get_int (cfg) * G_GINT64_CONSTANT (1048576);
+}
+
+static gint
+xmms_diskcache_file_cmp (gconstpointer a, gconstpointer b)
+{
+	const xmms_diskcache_file_t *fa = *(xmms_diskcache_file_t **) a;
+	const xmms_diskcache_file_t *fb = *(xmms_diskcache_file_t **) b;
+
+	if (fa->mtime != fb->mtime) {
+		return fa->mtime < fb->mtime ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Walk the cache directory, dropping the least recently used streams
+ * until it fits in limit bytes. With clean_tmp set, files of unfinished
+ * streams are removed too, only safe when no stream is being cached.
+ */
+static void
+xmms_diskcache_trim (const gchar *dir, gint64 limit, gboolean clean_tmp)
+{
+	GPtrArray *files;
+	const gchar *name;
+	GDir *d;
+	gint64 total = 0;
+	guint i;
+
+	d = g_dir_open (dir, 0, NULL);
+	if (!d) {
+		return;
+	}
+
+	files = g_ptr_array_new ();
+
+	while ((name = g_dir_read_name (d))) {
+		xmms_diskcache_file_t *file;
+		struct stat st;
+		gchar *path;
+
+		path = g_build_filename (dir, name, NULL);
+
+		if (strchr (name, '.')) {
+			/* info files go with their streams */
+			if (clean_tmp && !g_str_has_suffix (name, ".info")) {
+				g_unlink (path);
+			}
+			g_free (path);
+			continue;
+		}
+
+		if (g_stat (path, &st) == 0) {
+			file = g_new0 (xmms_diskcache_file_t, 1);
+			file->name = g_strdup (name);
+			file->size = st.st_size;
+			file->mtime = st.st_mtime;
+			g_ptr_array_add (files, file);
+			total += st.st_size;
+		}
+
+		g_free (path);
+	}
+	g_dir_close (d);
+
+	g_ptr_array_sort (files, (GCompareFunc) xmms_diskcache_file_cmp);
+
+	for (i = 0; i < files->len; i++) {
+		xmms_diskcache_file_t *file = g_ptr_array_index (files, i);
+
+		if (total > limit) {
+			gchar *path, *info;
+
+			path = g_build_filename (dir, file->name, NULL);
+			info = g_strconcat (path, ".info", NULL);
+
+			XMMS_DBG ("Dropping %s from the disk cache", file->name);
+			g_unlink (info);
+			if (g_unlink (path) == 0) {
+				total -= file->size;
+				file->size = -1;
+			}
+
+			g_free (info);
+			g_free (path);
+		}
+	}
+
+	G_LOCK (diskcache);
+	diskcache_entries = 0;
+	for (i = 0; i < files->len; i++) {
+		xmms_diskcache_file_t *file = g_ptr_array_index (files, i);
+		if (file->size >= 0) {
+			diskcache_entries++;
+		}
+		g_free (file->name);
+		g_free (file);
+	}
+	diskcache_bytes = total;
+	G_UNLOCK (diskcache);
+
+	g_ptr_array_free (files, TRUE);
+}
+
+/**
+ * Whether streams from the transport should go through the cache.
+ */
+gboolean
+xmms_diskcache_wanted (const gchar *transport)
+{
+	xmms_config_property_t *cfg;
+	const gchar *list;
+	gchar **names;
+	gboolean ret = FALSE;
+	gint i;
+
+	if (xmms_diskcache_max_size () <= 0) {
+		return FALSE;
+	}
+
+	cfg = xmms_config_lookup ("diskcache.transports");
+	if (!cfg || !(list = xmms_config_property_get_string (cfg))) {
+		return FALSE;
+	}
+
+	names = g_strsplit (list, ",", 0);
+	for (i = 0; names[i] && !ret; i++) {
+		ret = strcmp (g_strstrip (names[i]), transport) == 0;
+	}
+	g_strfreev (names);
+
+	return ret;
+}
+
+void
+xmms_diskcache_stats (guint *hits, guint *misses, guint *entries,
+                      gint64 *bytes)
+{
+	*hits = g_atomic_int_get (&diskcache_hits);
+	*misses = g_atomic_int_get (&diskcache_misses);
+
+	G_LOCK (diskcache);
+	*entries = diskcache_entries;
+	*bytes = diskcache_bytes;
+	G_UNLOCK (diskcache);
+}
+
+static gchar *
+xmms_diskcache_validator (xmms_xform_t *xform, gint32 size)
+{
+	const gchar *etag = "";
+	gint32 lmod = 0;
+
+	xmms_xform_metadata_get_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD,
+	                             &lmod);
+	xmms_xform_auxdata_get_str (xform, "etag", &etag);
+
+	return g_strdup_printf ("%d:%d:%s", size, lmod, etag);
+}
+
+static gboolean
+xmms_diskcache_lookup (xmms_diskcache_priv_t *priv)
+{
+	GKeyFile *keyfile;
+	gchar *info, *url, *validator;
+	gboolean ok = FALSE;
+	struct stat st;
+
+	keyfile = g_key_file_new ();
+	info = g_strconcat (priv->path, ".info", NULL);
+
+	if (g_key_file_load_from_file (keyfile, info, G_KEY_FILE_NONE, NULL)) {
+		url = g_key_file_get_string (keyfile, XMMS_DISKCACHE_GROUP, "url", NULL);
+		validator = g_key_file_get_string (keyfile, XMMS_DISKCACHE_GROUP,
+		                                   "validator", NULL);
+
+		ok = url && validator &&
+		     strcmp (url, priv->url) == 0 &&
+		     strcmp (validator, priv->validator) == 0;
+
+		g_free (url);
+		g_free (validator);
+	}
+
+	g_key_file_free (keyfile);
+	g_free (info);
+
+	if (!ok) {
+		return FALSE;
+	}
+
+	priv->fd = g_open (priv->path, O_RDONLY, 0);
+	if (priv->fd == -1) {
+		return FALSE;
+	}
+
+	if (fstat (priv->fd, &st) == -1 || st.st_size != priv->size) {
+		close (priv->fd);
+		priv->fd = -1;
+		return FALSE;
+	}
+
+	/* the modification time orders the streams for dropping */
+	g_utime (priv->path, NULL);
+
+	return TRUE;
+}
+
+static gboolean
+xmms_diskcache_plugin_init (xmms_xform_t *xform)
+{
+	xmms_diskcache_priv_t *priv;
+	gchar *dir, *hash;
+	gint32 size = 0;
+	const gchar *url;
+
+	url = xmms_xform_get_url (xform);
+
+	/* without a size there is no telling the copy is complete */
+	if (!url ||
+	    !xmms_xform_metadata_get_int (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE,
+	                                  &size) || size <= 0 ||
+	    size > xmms_diskcache_max_size ()) {
+		return FALSE;
+	}
+
+	dir = xmms_diskcache_dir ();
+	if (!dir || g_mkdir_with_parents (dir, 0700) == -1) {
+		g_free (dir);
+		return FALSE;
+	}
+
+	priv = g_new0 (xmms_diskcache_priv_t, 1);
+	priv->fd = -1;
+	priv->wfd = -1;
+	priv->size = size;
+	priv->url = g_strdup (url);
+	priv->validator = xmms_diskcache_validator (xform, size);
+
+	hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, url, -1);
+	priv->path = g_build_filename (dir, hash, NULL);
+	g_free (hash);
+
+	priv->hit = xmms_diskcache_lookup (priv);
+	if (priv->hit) {
+		XMMS_DBG ("Disk cache hit for %s", url);
+		g_atomic_int_inc (&diskcache_hits);
+	} else {
+		g_atomic_int_inc (&diskcache_misses);
+
+		priv->tmppath = g_strconcat (priv->path, ".XXXXXX", NULL);
+		priv->wfd = g_mkstemp (priv->tmppath);
+		if (priv->wfd == -1) {
+			xmms_log_error ("Couldn't create disk cache file: %s",
+			                g_strerror (errno));
+			g_free (priv->tmppath);
+			priv->tmppath = NULL;
+		}
+	}
+
+	g_free (dir);
+
+	xmms_xform_private_data_set (xform, priv);
+	xmms_xform_outdata_type_copy (xform);
+
+	return TRUE;
+}
+
+/**
+ * Stop copying the stream, what was written is of no use.
+ */
+static void
+xmms_diskcache_abandon (xmms_diskcache_priv_t *priv)
+{
+	if (priv->wfd == -1) {
+		return;
+	}
+
+	close (priv->wfd);
+	priv->wfd = -1;
+	g_unlink (priv->tmppath);
+}
+
+static void
+xmms_diskcache_commit (xmms_diskcache_priv_t *priv)
+{
+	GKeyFile *keyfile;
+	gchar *info, *contents, *dir;
+	gsize len;
+	gboolean ok;
+
+	if (close (priv->wfd) == -1) {
+		priv->wfd = -1;
+		g_unlink (priv->tmppath);
+		return;
+	}
+	priv->wfd = -1;
+
+	keyfile = g_key_file_new ();
+	g_key_file_set_string (keyfile, XMMS_DISKCACHE_GROUP, "url", priv->url);
+	g_key_file_set_string (keyfile, XMMS_DISKCACHE_GROUP, "validator",
+	                       priv->validator);
+	contents = g_key_file_to_data (keyfile, &len, NULL);
+	g_key_file_free (keyfile);
+
+	/* the info is written last, a stream without one is never used */
+	info = g_strconcat (priv->path, ".info", NULL);
+	g_unlink (info);
+	ok = g_rename (priv->tmppath, priv->path) == 0 &&
+	     g_file_set_contents (info, contents, len, NULL);
+	if (!ok) {
+		g_unlink (priv->tmppath);
+		g_unlink (priv->path);
+	} else {
+		XMMS_DBG ("Stored %s in the disk cache", priv->url);
+	}
+
+	g_free (contents);
+	g_free (info);
+
+	dir = g_path_get_dirname (priv->path);
+	xmms_diskcache_trim (dir, xmms_diskcache_max_size (), FALSE);
+	g_free (dir);
+}
+
+static void
+xmms_diskcache_plugin_destroy (xmms_xform_t *xform)
+{
+	xmms_diskcache_priv_t *priv;
+
+	priv = xmms_xform_private_data_get (xform);
+
+	if (priv->fd != -1) {
+		close (priv->fd);
+	}
+	xmms_diskcache_abandon (priv);
+
+	g_free (priv->tmppath);
+	g_free (priv->path);
+	g_free (priv->url);
+	g_free (priv->validator);
+	g_free (priv);
+}
+
+static gint
+xmms_diskcache_plugin_read (xmms_xform_t *xform, void *buffer, gint len,
+                            xmms_error_t *error)
+{
+	xmms_diskcache_priv_t *priv;
+	gint res;
+
+	priv = xmms_xform_private_data_get (xform);
+
+	if (priv->hit) {
+		do {
+			res = read (priv->fd, buffer, len);
+		} while (res == -1 && errno == EINTR);
+
+		if (res == -1) {
+			xmms_error_set (error, XMMS_ERROR_GENERIC, g_strerror (errno));
+			return -1;
+		}
+
+		priv->pos += res;
+		return res;
+	}
+
+	res = xmms_xform_read (xform, buffer, len, error);
+
+	if (res > 0 && priv->wfd != -1 && priv->pos <= priv->written) {
+		/* rereads after a seek back overwrite what is already there */
+		if (pwrite (priv->wfd, buffer, res, priv->pos) != res) {
+			xmms_log_error ("Couldn't write to disk cache: %s",
+			                g_strerror (errno));
+			xmms_diskcache_abandon (priv);
+		} else {
+			priv->written = MAX (priv->written, priv->pos + res);
+		}
+	}
+
+	if (res > 0) {
+		priv->pos += res;
+	} else if (res == 0 && priv->wfd != -1) {
+		if (priv->written == priv->size && priv->pos == priv->size) {
+			xmms_diskcache_commit (priv);
+		} else {
+			xmms_diskcache_abandon (priv);
+		}
+	}
+
+	return res;
+}
+
+static gint64
+xmms_diskcache_plugin_seek (xmms_xform_t *xform, gint64 offset,
+                            xmms_xform_seek_mode_t whence, xmms_error_t *error)
+{
+	xmms_diskcache_priv_t *priv;
+	gint64 res;
+
+	priv = xmms_xform_private_data_get (xform);
+
+	if (!priv->hit) {
+		res = xmms_xform_seek (xform, offset, whence, error);
+		if (res >= 0) {
+			priv->pos = res;
+		}
+		return res;
+	}
+
+	if (whence == XMMS_XFORM_SEEK_CUR) {
+		offset += priv->pos;
+	} else if (whence == XMMS_XFORM_SEEK_END) {
+		offset += priv->size;
+	}
+
+	if (offset < 0 || offset > priv->size) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Seek out of range");
+		return -1;
+	}
+
+	res = lseek (priv->fd, offset, SEEK_SET);
+	if (res == -1) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, g_strerror (errno));
+		return -1;
+	}
+
+	priv->pos = res;
+
+	return res;
+}
+
+static gboolean
+xmms_diskcache_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+	gchar *dir;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+	methods.init = xmms_diskcache_plugin_init;
+	methods.destroy = xmms_diskcache_plugin_destroy;
+	methods.read = xmms_diskcache_plugin_read;
+	methods.seek = xmms_diskcache_plugin_seek;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	/* in MiB, 0 disables the cache */
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "size", "256",
+	                                            NULL, NULL);
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "transports",
+	                                            "curl,daap,samba,gvfs",
+	                                            NULL, NULL);
+
+	/* only ever added to a chain by xmms_xform_chain_setup */
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE,
+	                              "application/x-diskcache",
+	                              XMMS_STREAM_TYPE_END);
+
+	/* nothing is being cached yet, clear out what was left unfinished */
+	dir = xmms_diskcache_dir ();
+	if (dir) {
+		xmms_diskcache_trim (dir, xmms_diskcache_max_size (), TRUE);
+		g_free (dir);
+	}
+
+	return TRUE;
+}
+
+XMMS_XFORM_BUILTIN_DEFINE (diskcache,
+                           "Disk cache",
+                           XMMS_VERSION,
+                           "Disk cache for remote media",
+                           xmms_diskcache_plugin_setup);
@@ -176,6 +176,48 @@ normalize_metadata_fields (xmmsv_t *fetch, xmms_error_t *err)
 }
 
 
+/* Source preference lists of fetch specs, joined by newlines -> the
+ * compiled preferences. s4 remembers the priority of every source it
+ * ranked against a preference, so sharing them keeps sources from
+ * being matched against the patterns again by every query. */
+#define XMMS_FETCH_SPEC_SOURCEPREF_CACHE_SIZE 32
+
+G_LOCK_DEFINE_STATIC (sourcepref_cache);
+static GHashTable *sourcepref_cache;
+
+static s4_sourcepref_t *
+sourcepref_cache_get (const char **strv)
+{
+	s4_sourcepref_t *sp;
+	gchar *key;
+
+	key = g_strjoinv ("\n", (gchar **) strv);
+
+	G_LOCK (sourcepref_cache);
+
+	if (!sourcepref_cache) {
+		sourcepref_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+		                                          (GDestroyNotify) s4_sourcepref_unref);
+	}
+
+	sp = g_hash_table_lookup (sourcepref_cache, key);
+	if (sp == NULL) {
+		if (g_hash_table_size (sourcepref_cache) >= XMMS_FETCH_SPEC_SOURCEPREF_CACHE_SIZE) {
+			g_hash_table_remove_all (sourcepref_cache);
+		}
+		sp = s4_sourcepref_create (strv);
+		g_hash_table_insert (sourcepref_cache, key, sp);
+	} else {
+		g_free (key);
+	}
+
+	sp = s4_sourcepref_ref (sp);
+
+	G_UNLOCK (sourcepref_cache);
+
+	return sp;
+}
+
 static s4_sourcepref_t *
 normalize_source_preferences (xmmsv_t *fetch, s4_sourcepref_t *prefs, xmms_error_t *err)
 {
@@ -219,7 +261,7 @@ normalize_source_preferences (xmmsv_t *fetch, s4_sourcepref_t *prefs, xmms_error
 		xmmsv_list_iter_next (it);
 	}
 
-	sp = s4_sourcepref_create (strv);
+	sp = sourcepref_cache_get (strv);
 	g_free (strv);
 
 	return sp;
@@ -528,6 +570,48 @@ xmms_fetch_spec_new_count (xmmsv_t *fetch, xmms_fetch_info_t *info,
 }
 
 
+static xmms_fetch_spec_t *
+xmms_fetch_spec_new_columns (xmmsv_t *fetch, xmms_fetch_info_t *info,
+                             s4_sourcepref_t *prefs, xmms_error_t *err)
+{
+	xmms_fetch_spec_t *ret;
+	s4_sourcepref_t *sp;
+	const gchar *key;
+	xmmsv_t *fields;
+	gint i, size;
+
+	fields = normalize_metadata_fields (fetch, err);
+	if (xmms_error_iserror (err)) {
+		return NULL;
+	}
+
+	if (fields == NULL) {
+		const gchar *message = "'fields' must be set for columns.";
+		xmms_error_set (err, XMMS_ERROR_INVAL, message);
+		return NULL;
+	}
+
+	sp = normalize_source_preferences (fetch, prefs, err);
+	if (xmms_error_iserror (err)) {
+		return NULL;
+	}
+
+	ret = g_new0 (xmms_fetch_spec_t, 1);
+	ret->type = FETCH_COLUMNS;
+
+	size = xmmsv_list_get_size (fields);
+	ret->data.columns.count = size;
+	ret->data.columns.keys = g_new (const gchar *, size);
+	ret->data.columns.cols = g_new (gint32, size);
+	for (i = 0; xmmsv_list_get_string (fields, i, &key); i++) {
+		ret->data.columns.keys[i] = key;
+		ret->data.columns.cols[i] = xmms_fetch_info_add_key (info, fetch, key, sp);
+	}
+
+	s4_sourcepref_unref (sp);
+
+	return ret;
+}
 
 /**
  * Converts a fetch specification in xmmsv_t form into a
@@ -563,6 +647,8 @@ xmms_fetch_spec_new (xmmsv_t *fetch, xmms_fetch_info_t *info,
 		return xmms_fetch_spec_new_organize (fetch, info, prefs, err);
 	} else if (strcmp (type, "count") == 0) {
 		return xmms_fetch_spec_new_count (fetch, info, prefs, err);
+	} else if (strcmp (type, "columns") == 0) {
+		return xmms_fetch_spec_new_columns (fetch, info, prefs, err);
 	}
 
 	xmms_error_set (err, XMMS_ERROR_INVAL, "Unknown fetch type.");
@@ -594,6 +680,10 @@ xmms_fetch_spec_free (xmms_fetch_spec_t *spec)
 			g_free (spec->data.organize.keys);
 			g_free (spec->data.organize.data);
 			break;
+		case FETCH_COLUMNS:
+			g_free (spec->data.columns.keys);
+			g_free (spec->data.columns.cols);
+			break;
 		case FETCH_COUNT: /* Nothing to free */
 			break;
 		default:
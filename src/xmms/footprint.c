@@ -0,0 +1,153 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * The small footprint mode, for devices with little memory. When
+ * core.small_footprint is set the buffers that otherwise grow with
+ * the load are held to the core.small_footprint_* limits, the
+ * visualization only runs while a client wants it, and the unused
+ * heap is given back to the system whenever playback stops.
+ */
+
+#include <xmmspriv/xmms_footprint.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmms/xmms_log.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static const struct {
+	const gchar *name;
+	const gchar *config;
+	const gchar *value;
+} footprint_limits[XMMS_FOOTPRINT_NUM_LIMITS] = {
+	{ "ringbuffer", "core.small_footprint_ringbuffer", "65536" },
+	{ "xform_buffer", "core.small_footprint_xform_buffer", "65536" },
+	{ "ipc_queue", "core.small_footprint_ipc_queue", "262144" },
+	{ "query_results", "core.small_footprint_query_results", "1000" }
+};
+
+/* read where the memory is allocated, so kept as atomics rather
+   than looked up in the config each time */
+static gint footprint_enabled;
+static gint footprint_limit[XMMS_FOOTPRINT_NUM_LIMITS];
+
+static void
+on_enabled_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	gint value;
+
+	value = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_atomic_int_set (&footprint_enabled, !!value);
+}
+
+static void
+on_limit_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	gint value;
+
+	value = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_atomic_int_set (&footprint_limit[GPOINTER_TO_INT (udata)], MAX (value, 0));
+}
+
+/**
+ * Register the config properties of the mode. Should be called
+ * before the objects whose memory it bounds are made.
+ */
+void
+xmms_footprint_init (void)
+{
+	xmms_config_property_t *cfg;
+	gint i;
+
+	cfg = xmms_config_property_register ("core.small_footprint", "0",
+	                                     on_enabled_changed, NULL);
+	on_enabled_changed (XMMS_OBJECT (cfg), NULL, NULL);
+
+	for (i = 0; i < XMMS_FOOTPRINT_NUM_LIMITS; i++) {
+		cfg = xmms_config_property_register (footprint_limits[i].config,
+		                                     footprint_limits[i].value,
+		                                     on_limit_changed,
+		                                     GINT_TO_POINTER (i));
+		on_limit_changed (XMMS_OBJECT (cfg), NULL, GINT_TO_POINTER (i));
+	}
+
+	if (xmms_footprint_enabled ()) {
+		xmms_log_info ("Running with a small footprint");
+	}
+}
+
+gboolean
+xmms_footprint_enabled (void)
+{
+	return g_atomic_int_get (&footprint_enabled);
+}
+
+/**
+ * Get a limit of the mode.
+ *
+ * @returns The limit, 0 if there is none, as when the mode is off.
+ */
+gint
+xmms_footprint_limit (xmms_footprint_limit_t limit)
+{
+	g_return_val_if_fail (limit < XMMS_FOOTPRINT_NUM_LIMITS, 0);
+
+	if (!xmms_footprint_enabled ()) {
+		return 0;
+	}
+
+	return g_atomic_int_get (&footprint_limit[limit]);
+}
+
+/**
+ * Give the free memory at the top of the heaps back to the system,
+ * when in the mode. Takes a while on a fragmented heap, so only for
+ * when nothing is playing.
+ */
+void
+xmms_footprint_trim (void)
+{
+	if (!xmms_footprint_enabled ()) {
+		return;
+	}
+
+#ifdef __GLIBC__
+	malloc_trim (0);
+#endif
+}
+
+/**
+ * Whether the mode is on and the limits it applies, a dict of name
+ * to the limit, 0 if there is none.
+ */
+xmmsv_t *
+xmms_footprint_get (void)
+{
+	xmmsv_t *ret;
+	gint i;
+
+	ret = xmmsv_new_dict ();
+	xmmsv_dict_set_int (ret, "enabled", xmms_footprint_enabled ());
+
+	for (i = 0; i < XMMS_FOOTPRINT_NUM_LIMITS; i++) {
+		xmmsv_dict_set_int (ret, footprint_limits[i].name,
+		                    xmms_footprint_limit (i));
+	}
+
+	return ret;
+}
@@ -20,7 +20,13 @@
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_config.h>
 #include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_trace.h>
+#include <xmmspriv/xmms_memstat.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_footprint.h>
 #include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_sockets.h>
+#include <xmmsc/xmmsc_ipc_shm.h>
 
 
 /**
@@ -30,6 +36,26 @@
   * @{
   */
 
+/**
+ * Number of queued messages gathered into one write to a client.
+ */
+#define XMMS_IPC_WRITE_BATCH 16
+
+/**
+ * Longest interval in milliseconds a registration may ask to be
+ * throttled to.
+ */
+#define XMMS_IPC_THROTTLE_MAX 60000
+
+/**
+ * Buckets of the command latency histograms, each ten times wider
+ * than the one before, the last one open ended.
+ */
+#define XMMS_IPC_LATENCY_BUCKETS 7
+static const gint64 ipc_latency_bounds[XMMS_IPC_LATENCY_BUCKETS - 1] = {
+	10, 100, 1000, 10000, 100000, 1000000
+};
+
 /**
  * Manages client connection/disconnection signals.
  */
@@ -51,6 +77,8 @@ typedef struct xmms_ipc_object_pool_t {
  * The server IPC object
  */
 struct xmms_ipc_St {
+	/** The url listened to */
+	gchar *path;
 	xmms_ipc_transport_t *transport;
 	GList *clients;
 	GIOChannel *chan;
@@ -61,12 +89,79 @@ struct xmms_ipc_St {
 };
 
 
+/**
+ * A serialized message shared by all receivers of a broadcast or
+ * signal. Never modified once created.
+ */
+typedef struct xmms_ipc_shared_msg_St {
+	gint ref;
+	xmms_ipc_msg_t *msg;
+} xmms_ipc_shared_msg_t;
+
+/**
+ * An entry in the queue of messages waiting to be written to a client,
+ * either a message of its own or a shared one with the cookie to use.
+ */
+typedef struct xmms_ipc_out_msg_St {
+	xmms_ipc_msg_t *msg;
+	xmms_ipc_shared_msg_t *shared;
+	guint32 cookie;
+	guint32 xfered;
+	/** For broadcasts, the broadcast id + 1 and the value, so
+	    a later one can be merged into it while it waits */
+	guint broadcast;
+	xmmsv_t *value;
+	/** The size accounted to the queues while it is in one */
+	guint32 queued;
+} xmms_ipc_out_msg_t;
+
+/**
+ * Limits a broadcast registration to some medialib ids and playlist
+ * or collection names. A kind of value the filter says nothing about
+ * always passes.
+ */
+typedef struct xmms_ipc_broadcast_filter_St {
+	GHashTable *ids;
+	GHashTable *names;
+} xmms_ipc_broadcast_filter_t;
+
+/**
+ * Holds a broadcast or signal registration to one reply per interval.
+ * What comes in between is coalesced into pending, the newest state
+ * winning, and sent once the interval is over.
+ */
+typedef struct xmms_ipc_throttle_St {
+	struct xmms_ipc_client_St *client;
+	/** The broadcast or signal id */
+	guint id;
+	gboolean signal;
+	guint32 cookie;
+	/** In monotonic microseconds */
+	gint64 interval;
+	gint64 last;
+	xmmsv_t *pending;
+	GSource *timer;
+} xmms_ipc_throttle_t;
+
+/**
+ * A shared I/O loop that serves many clients. Used instead of one
+ * thread per client when "core.ipc_io_threads" is non-zero.
+ */
+typedef struct xmms_ipc_io_loop_St {
+	GMainLoop *ml;
+	GThread *thread;
+	/** The clients it serves, so they can be let go at shutdown */
+	GMutex lock;
+	GList *clients;
+} xmms_ipc_io_loop_t;
+
 /**
  * A IPC client representation.
  */
 typedef struct xmms_ipc_client_St {
 	GMainLoop *ml;
 	GIOChannel *iochan;
+	GSource *write_source;
 
 	xmms_ipc_transport_t *transport;
 	xmms_ipc_msg_t *read_msg;
@@ -79,9 +174,41 @@ typedef struct xmms_ipc_client_St {
 
 	/** Messages waiting to be written */
 	GQueue *out_msg;
+	/** Their size in bytes */
+	gsize out_bytes;
+
+	/** Kept while core.ipc_metrics is set: the longest out_msg has
+	    been and the bytes read from and written to the client */
+	guint out_msg_max;
+	guint64 bytes_in;
+	guint64 bytes_out;
+
+	/** Ring that large messages are written to instead, if the
+	    client set one up */
+	xmms_ipc_shm_t *shm;
+
+	/** The client reads the compact encoding, either 0 or 1 */
+	gboolean compact;
 
 	guint pendingsignals[XMMS_IPC_SIGNAL_END];
 	GList *broadcasts[XMMS_IPC_SIGNAL_END];
+	/** Broadcast cookie -> xmms_ipc_broadcast_filter_t, created
+	    when the first filtered broadcast is registered */
+	GHashTable *broadcast_filters;
+	/** Broadcast cookie -> xmms_ipc_throttle_t, likewise */
+	GHashTable *broadcast_throttles;
+	xmms_ipc_throttle_t *signal_throttles[XMMS_IPC_SIGNAL_END];
+
+	/** The following are only used when served by a shared I/O loop */
+	gboolean shared;
+	xmms_ipc_io_loop_t *loop;
+	gboolean disconnected;
+	gint ref;
+	/** Messages waiting to be processed by the worker pool */
+	GQueue *in_msg;
+	/** A worker is processing in_msg, keeps the commands of one
+	    client in order */
+	gboolean dispatching;
 
 	gint32 id;
 } xmms_ipc_client_t;
@@ -92,27 +219,91 @@ static gint32 next_client_id = 1;
 static GMutex ipc_servers_lock;
 static GList *ipc_servers = NULL;
 
+/** url -> listening socket handed over by the daemon this one replaced */
+static GHashTable *ipc_inherited = NULL;
+
 static xmms_ipc_manager_t *ipc_manager = NULL;
 
 static GMutex ipc_object_pool_lock;
 static struct xmms_ipc_object_pool_t *ipc_object_pool = NULL;
 
+static xmms_config_property_t *ipc_shm_config = NULL;
+static xmms_config_property_t *ipc_courier_passthrough_config = NULL;
+static xmms_config_property_t *ipc_max_queued_config = NULL;
+static xmms_config_property_t *ipc_queue_overflow_config = NULL;
+
+/**
+ * How many messages, or in the small footprint mode bytes, may wait
+ * for a client before broadcasts to it are merged or dropped, from
+ * "core.ipc_max_queued", "core.small_footprint_ipc_queue" and
+ * "core.ipc_queue_overflow".
+ */
+typedef struct xmms_ipc_queue_limits_St {
+	gint max_queued;
+	gint max_bytes;
+	gboolean drop;
+} xmms_ipc_queue_limits_t;
+
+/**
+ * What is kept for each (object, command) while core.ipc_metrics is
+ * set, times in µs.
+ */
+typedef struct xmms_ipc_command_stats_St {
+	guint32 objid;
+	guint32 cmdid;
+	guint64 calls;
+	guint64 errors;
+	gint64 time;
+	gint64 max;
+	guint64 hist[XMMS_IPC_LATENCY_BUCKETS];
+} xmms_ipc_command_stats_t;
+
+static gint ipc_metrics = 0;
+static GMutex ipc_metrics_lock;
+/** (objid << 16 | cmdid) -> xmms_ipc_command_stats_t */
+static GHashTable *ipc_metrics_commands = NULL;
+
+static xmms_ipc_io_loop_t *ipc_io_loops = NULL;
+static guint ipc_num_io_loops = 0;
+static guint ipc_next_io_loop = 0;
+static GThreadPool *ipc_workers = NULL;
+
 static void xmms_ipc_close (void);
 static void xmms_ipc_client_destroy (xmms_ipc_client_t *client);
+static void xmms_ipc_client_unref (xmms_ipc_client_t *client);
+static void xmms_ipc_client_disconnect (xmms_ipc_client_t *client);
+static void xmms_ipc_client_dispatch (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg);
 
 static xmms_ipc_client_t *xmms_ipc_lookup_client (gint32 clientid);
 
 static void xmms_ipc_register_signal (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, xmmsv_t *arguments);
 static void xmms_ipc_register_broadcast (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg, xmmsv_t *arguments);
 static gboolean xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg);
+static gboolean xmms_ipc_client_shared_write (xmms_ipc_client_t *client, xmms_ipc_shared_msg_t *shared, guint32 cookie);
+static void xmms_ipc_out_msg_free (xmms_ipc_out_msg_t *out);
 static gboolean xmms_ipc_client_broadcast_write (guint broadcastid, xmms_ipc_client_t *cli, xmmsv_t *arg);
+static void xmms_ipc_broadcast_filter_free (xmms_ipc_broadcast_filter_t *filter);
+static xmms_ipc_throttle_t *xmms_ipc_throttle_new (xmms_ipc_client_t *client, guint id, gboolean signal, guint32 cookie, gint32 interval);
+static void xmms_ipc_throttle_free (xmms_ipc_throttle_t *throttle);
+static void xmms_ipc_client_throttles_clear (xmms_ipc_client_t *client);
+
+static xmmsv_t *xmms_ipc_manager_client_metrics (xmms_ipc_manager_t *manager, xmms_error_t *err);
+static gchar *xmms_ipc_manager_client_metrics_text (xmms_ipc_manager_t *manager, xmms_error_t *err);
 
 #include "ipc_manager_ipc.c"
 
 static void
-xmms_ipc_handle_cmd_value (xmms_ipc_msg_t *msg, xmmsv_t *val)
+xmms_ipc_handle_cmd_value (xmms_ipc_msg_t *msg, xmmsv_t *val, gboolean compact)
 {
-	if (xmms_ipc_msg_put_value (msg, val) == (uint32_t) -1) {
+	uint32_t ret;
+
+	if (compact) {
+		ret = xmms_ipc_msg_put_value_compact (msg, val);
+	} else {
+		ret = xmms_ipc_msg_put_value (msg, val);
+	}
+
+	if (ret == (uint32_t) -1) {
 		xmms_log_error ("Failed to serialize the return value into the IPC message!");
 	}
 }
@@ -122,7 +313,7 @@ xmms_ipc_register_signal (xmms_ipc_client_t *client,
                           xmms_ipc_msg_t *msg, xmmsv_t *arguments)
 {
 	xmmsv_t *arg;
-	gint32 signalid;
+	gint32 signalid, interval;
 	int r;
 
 	if (!arguments || !xmmsv_list_get (arguments, 0, &arg)) {
@@ -144,15 +335,157 @@ xmms_ipc_register_signal (xmms_ipc_client_t *client,
 
 	g_mutex_lock (&client->lock);
 	client->pendingsignals[signalid] = xmms_ipc_msg_get_cookie (msg);
+
+	/* an interval sticks to the signal until another one is given,
+	   the client library restarts signals without it. The throttle
+	   is kept rather than replaced, its timer may be running */
+	if (xmmsv_list_get (arguments, 1, &arg) && xmmsv_get_int32 (arg, &interval)) {
+		if (client->signal_throttles[signalid]) {
+			client->signal_throttles[signalid]->interval =
+				CLAMP (interval, 0, XMMS_IPC_THROTTLE_MAX) * (gint64) 1000;
+		} else {
+			client->signal_throttles[signalid] =
+				xmms_ipc_throttle_new (client, signalid, TRUE, 0, interval);
+		}
+	}
+
 	g_mutex_unlock (&client->lock);
 }
 
+static void
+xmms_ipc_broadcast_filter_free (xmms_ipc_broadcast_filter_t *filter)
+{
+	if (filter->ids) {
+		g_hash_table_destroy (filter->ids);
+	}
+	if (filter->names) {
+		g_hash_table_destroy (filter->names);
+	}
+	g_free (filter);
+}
+
+/**
+ * Build a filter from the list of ids and names a client sent along
+ * with a broadcast registration.
+ */
+static xmms_ipc_broadcast_filter_t *
+xmms_ipc_broadcast_filter_new (xmmsv_t *list)
+{
+	xmms_ipc_broadcast_filter_t *filter;
+	xmmsv_list_iter_t *it;
+	xmmsv_t *entry;
+	const gchar *name;
+	gint32 id;
+
+	if (!xmmsv_get_list_iter (list, &it)) {
+		xmms_log_error ("Broadcast filter is not a list, ignoring it");
+		return NULL;
+	}
+
+	filter = g_new0 (xmms_ipc_broadcast_filter_t, 1);
+
+	for (; xmmsv_list_iter_entry (it, &entry); xmmsv_list_iter_next (it)) {
+		if (xmmsv_get_int32 (entry, &id)) {
+			if (!filter->ids) {
+				filter->ids = g_hash_table_new (NULL, NULL);
+			}
+			g_hash_table_add (filter->ids, GINT_TO_POINTER (id));
+		} else if (xmmsv_get_string (entry, &name)) {
+			if (!filter->names) {
+				filter->names = g_hash_table_new_full (g_str_hash, g_str_equal,
+				                                       g_free, NULL);
+			}
+			g_hash_table_add (filter->names, g_strdup (name));
+		}
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	return filter;
+}
+
+static gboolean
+xmms_ipc_broadcast_filter_id (xmms_ipc_broadcast_filter_t *filter, gint32 id)
+{
+	return !filter->ids || g_hash_table_contains (filter->ids, GINT_TO_POINTER (id));
+}
+
+static gboolean
+xmms_ipc_broadcast_filter_name (xmms_ipc_broadcast_filter_t *filter,
+                                const gchar *name)
+{
+	return !filter->names || g_hash_table_contains (filter->names, name);
+}
+
+/**
+ * Check a broadcast value against a filter. A list of ids is narrowed
+ * down to the ones the filter lets through, returned in filtered.
+ *
+ * @returns FALSE if nothing of the value passes.
+ */
+static gboolean
+xmms_ipc_broadcast_filter_apply (xmms_ipc_broadcast_filter_t *filter,
+                                 xmmsv_t *arg, xmmsv_t **filtered)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *entry;
+	const gchar *name;
+	gint32 id;
+	gint size;
+
+	*filtered = NULL;
+
+	switch (xmmsv_get_type (arg)) {
+		case XMMSV_TYPE_INT64:
+			return !xmmsv_get_int32 (arg, &id) ||
+			       xmms_ipc_broadcast_filter_id (filter, id);
+		case XMMSV_TYPE_STRING:
+			xmmsv_get_string (arg, &name);
+			return xmms_ipc_broadcast_filter_name (filter, name);
+		case XMMSV_TYPE_DICT:
+			/* playlist and collection changes */
+			return !xmmsv_dict_entry_get_string (arg, "name", &name) ||
+			       xmms_ipc_broadcast_filter_name (filter, name);
+		case XMMSV_TYPE_LIST:
+			if (!filter->ids) {
+				return TRUE;
+			}
+			size = xmmsv_list_get_size (arg);
+			*filtered = xmmsv_new_list ();
+			xmmsv_get_list_iter (arg, &it);
+			for (; xmmsv_list_iter_entry (it, &entry); xmmsv_list_iter_next (it)) {
+				if (!xmmsv_get_int32 (entry, &id) ||
+				    xmms_ipc_broadcast_filter_id (filter, id)) {
+					xmmsv_list_append (*filtered, entry);
+				}
+			}
+			xmmsv_list_iter_explicit_destroy (it);
+
+			if (xmmsv_list_get_size (*filtered) == size) {
+				/* all of it passed, the shared message will do */
+				xmmsv_unref (*filtered);
+				*filtered = NULL;
+				return TRUE;
+			}
+			if (xmmsv_list_get_size (*filtered) == 0) {
+				xmmsv_unref (*filtered);
+				*filtered = NULL;
+				return FALSE;
+			}
+			return TRUE;
+		default:
+			return TRUE;
+	}
+}
+
 static void
 xmms_ipc_register_broadcast (xmms_ipc_client_t *client,
                              xmms_ipc_msg_t *msg, xmmsv_t *arguments)
 {
+	xmms_ipc_broadcast_filter_t *filter;
+	xmms_ipc_throttle_t *throttle;
 	xmmsv_t *arg;
-	gint32 broadcastid;
+	gint32 broadcastid, interval;
+	guint32 cookie;
 	int r;
 
 	if (!arguments || !xmmsv_list_get (arguments, 0, &arg)) {
@@ -172,14 +505,109 @@ xmms_ipc_register_broadcast (xmms_ipc_client_t *client,
 		return;
 	}
 
+	/* none stands in for no filter when only an interval is given */
+	filter = NULL;
+	if (xmmsv_list_get (arguments, 1, &arg) &&
+	    !xmmsv_is_type (arg, XMMSV_TYPE_NONE)) {
+		filter = xmms_ipc_broadcast_filter_new (arg);
+	}
+
+	cookie = xmms_ipc_msg_get_cookie (msg);
+
+	throttle = NULL;
+	if (xmmsv_list_get (arguments, 2, &arg) && xmmsv_get_int32 (arg, &interval)) {
+		throttle = xmms_ipc_throttle_new (client, broadcastid, FALSE, cookie, interval);
+	}
+
 	g_mutex_lock (&client->lock);
 	client->broadcasts[broadcastid] =
 		g_list_append (client->broadcasts[broadcastid],
-		               GUINT_TO_POINTER (xmms_ipc_msg_get_cookie (msg)));
+		               GUINT_TO_POINTER (cookie));
+
+	if (filter) {
+		if (!client->broadcast_filters) {
+			client->broadcast_filters =
+				g_hash_table_new_full (NULL, NULL, NULL,
+				                       (GDestroyNotify) xmms_ipc_broadcast_filter_free);
+		}
+		g_hash_table_insert (client->broadcast_filters,
+		                     GUINT_TO_POINTER (cookie), filter);
+	}
+
+	if (throttle) {
+		if (!client->broadcast_throttles) {
+			client->broadcast_throttles =
+				g_hash_table_new_full (NULL, NULL, NULL,
+				                       (GDestroyNotify) xmms_ipc_throttle_free);
+		}
+		g_hash_table_insert (client->broadcast_throttles,
+		                     GUINT_TO_POINTER (cookie), throttle);
+	}
 
 	g_mutex_unlock (&client->lock);
 }
 
+/**
+ * Account a command call that took us µs.
+ */
+static void
+xmms_ipc_metrics_command (guint32 objid, guint32 cmdid, gint64 us,
+                          gboolean failed)
+{
+	xmms_ipc_command_stats_t *stats;
+	gpointer key;
+	guint i;
+
+	key = GUINT_TO_POINTER ((objid << 16) | cmdid);
+
+	g_mutex_lock (&ipc_metrics_lock);
+	stats = g_hash_table_lookup (ipc_metrics_commands, key);
+	if (!stats) {
+		stats = g_new0 (xmms_ipc_command_stats_t, 1);
+		stats->objid = objid;
+		stats->cmdid = cmdid;
+		g_hash_table_insert (ipc_metrics_commands, key, stats);
+	}
+
+	for (i = 0; i < XMMS_IPC_LATENCY_BUCKETS - 1; i++) {
+		if (us <= ipc_latency_bounds[i]) {
+			break;
+		}
+	}
+
+	stats->calls++;
+	stats->errors += failed;
+	stats->time += us;
+	stats->max = MAX (stats->max, us);
+	stats->hist[i]++;
+	g_mutex_unlock (&ipc_metrics_lock);
+}
+
+/**
+ * Read the arguments of a command. The payload of a client-to-client
+ * message is only relayed, so it is kept in the encoding it came in
+ * and written out to the destination as it is.
+ */
+static gboolean
+xmms_ipc_msg_get_arguments (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg,
+                            xmmsv_t **arguments)
+{
+	uint32_t objid, cmdid;
+
+	objid = xmms_ipc_msg_get_object (msg);
+	cmdid = xmms_ipc_msg_get_cmd (msg);
+
+	if (objid == XMMS_IPC_OBJECT_COURIER &&
+	    (cmdid == XMMS_IPC_COMMAND_COURIER_SEND_MESSAGE ||
+	     cmdid == XMMS_IPC_COMMAND_COURIER_REPLY) &&
+	    xmms_config_property_get_int (ipc_courier_passthrough_config)) {
+		return xmms_ipc_msg_get_value_keep_last (msg, client->compact,
+		                                         arguments);
+	}
+
+	return xmms_ipc_msg_get_value (msg, arguments);
+}
+
 static void
 process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 {
@@ -188,13 +616,14 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 	xmms_ipc_msg_t *retmsg;
 	xmmsv_t *error, *arguments;
 	uint32_t objid, cmdid;
+	gint64 started = 0;
 
 	g_return_if_fail (msg);
 
 	objid = xmms_ipc_msg_get_object (msg);
 	cmdid = xmms_ipc_msg_get_cmd (msg);
 
-	if (!xmms_ipc_msg_get_value (msg, &arguments)) {
+	if (!xmms_ipc_msg_get_arguments (client, msg, &arguments)) {
 		xmms_log_error ("Cannot read command arguments. "
 		                "Ignoring command.");
 
@@ -236,7 +665,19 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 	arg.client = client->id;
 	arg.cookie = xmms_ipc_msg_get_cookie (msg);
 
+	if (g_atomic_int_get (&ipc_metrics)) {
+		started = g_get_monotonic_time ();
+	}
+
+	XMMS_TRACE_BEGIN ("ipc.command");
 	xmms_object_cmd_call (object, cmdid, &arg);
+	XMMS_TRACE_END ("ipc.command");
+
+	if (started) {
+		xmms_ipc_metrics_command (objid, cmdid,
+		                          g_get_monotonic_time () - started,
+		                          !xmms_error_isok (&arg.error));
+	}
 	if (xmms_error_isok (&arg.error)) {
 		if (!arg.retval) {
 			/* Skip reply if method is a noreply and didn't fail */
@@ -244,7 +685,7 @@ process_msg (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 		}
 
 		retmsg = xmms_ipc_msg_new (objid, XMMS_IPC_COMMAND_REPLY);
-		xmms_ipc_handle_cmd_value (retmsg, arg.retval);
+		xmms_ipc_handle_cmd_value (retmsg, arg.retval, client->compact);
 	} else {
 		/* FIXME: or we could omit setting the command to _CMD_ERROR
 		 * and let the client check whether the value it got is an
@@ -291,8 +732,17 @@ xmms_ipc_client_read_cb (GIOChannel *iochan,
 			if (xmms_ipc_msg_read_transport (client->read_msg, client->transport, &disconnect)) {
 				xmms_ipc_msg_t *msg = client->read_msg;
 				client->read_msg = NULL;
-				process_msg (client, msg);
-				xmms_ipc_msg_destroy (msg);
+				if (g_atomic_int_get (&ipc_metrics)) {
+					g_mutex_lock (&client->lock);
+					client->bytes_in += xmms_ipc_msg_get_size (msg);
+					g_mutex_unlock (&client->lock);
+				}
+				if (client->shared) {
+					xmms_ipc_client_dispatch (client, msg);
+				} else {
+					process_msg (client, msg);
+					xmms_ipc_msg_destroy (msg);
+				}
 			} else {
 				break;
 			}
@@ -305,13 +755,13 @@ xmms_ipc_client_read_cb (GIOChannel *iochan,
 			client->read_msg = NULL;
 		}
 		XMMS_DBG ("disconnect was true!");
-		g_main_loop_quit (client->ml);
+		xmms_ipc_client_disconnect (client);
 		return FALSE;
 	}
 
 	if (cond & G_IO_ERR) {
 		xmms_log_error ("Client got error, maybe connection died?");
-		g_main_loop_quit (client->ml);
+		xmms_ipc_client_disconnect (client);
 		return FALSE;
 	}
 
@@ -324,36 +774,94 @@ xmms_ipc_client_write_cb (GIOChannel *iochan,
                           gpointer data)
 {
 	xmms_ipc_client_t *client = data;
-	bool disconnect = FALSE;
+	xmms_ipc_out_msg_t *outs[XMMS_IPC_WRITE_BATCH];
+	unsigned char heads[XMMS_IPC_WRITE_BATCH][XMMS_IPC_MSG_HEAD_LEN];
+	xmms_ipc_transport_vec_t vec[XMMS_IPC_WRITE_BATCH * 2];
+	gint i, n, nvec, ret, wlen;
 
 	g_return_val_if_fail (client, FALSE);
 
 	while (TRUE) {
-		xmms_ipc_msg_t *msg;
-
+		/* only this callback pops the queue, so the entries stay
+		 * around while the lock is released */
 		g_mutex_lock (&client->lock);
-		msg = g_queue_peek_head (client->out_msg);
+		for (n = 0; n < XMMS_IPC_WRITE_BATCH; n++) {
+			outs[n] = g_queue_peek_nth (client->out_msg, n);
+			if (!outs[n])
+				break;
+		}
+		if (!n) {
+			client->write_source = NULL;
+		}
 		g_mutex_unlock (&client->lock);
 
-		if (!msg)
+		if (!n)
 			break;
 
-		if (!xmms_ipc_msg_write_transport (msg,
-		                                   client->transport,
-		                                   &disconnect)) {
-			if (disconnect) {
-				break;
+		/* gather the queued messages into one write */
+		for (i = 0, nvec = 0; i < n; i++) {
+			xmms_ipc_out_msg_t *out = outs[i];
+
+			if (out->shared) {
+				nvec += xmms_ipc_msg_get_unwritten (out->shared->msg, TRUE,
+				                                    out->cookie, out->xfered,
+				                                    heads[i], vec + nvec);
 			} else {
-				/* try sending again later */
-				return TRUE;
+				nvec += xmms_ipc_msg_get_unwritten (out->msg, FALSE, 0,
+				                                    out->xfered, heads[i],
+				                                    vec + nvec);
 			}
 		}
 
-		g_mutex_lock (&client->lock);
-		g_queue_pop_head (client->out_msg);
-		g_mutex_unlock (&client->lock);
+		for (i = 0, wlen = 0; i < nvec; i++) {
+			wlen += vec[i].len;
+		}
 
-		xmms_ipc_msg_destroy (msg);
+		ret = xmms_ipc_transport_writev (client->transport, vec, nvec);
+
+		if (ret == SOCKET_ERROR && xmms_socket_error_recoverable ()) {
+			/* try sending again later */
+			return TRUE;
+		} else if (ret <= 0) {
+			g_mutex_lock (&client->lock);
+			client->write_source = NULL;
+			g_mutex_unlock (&client->lock);
+			break;
+		}
+
+		if (g_atomic_int_get (&ipc_metrics)) {
+			g_mutex_lock (&client->lock);
+			client->bytes_out += ret;
+			g_mutex_unlock (&client->lock);
+		}
+
+		/* hand the bytes written out to the messages, in order */
+		for (i = 0; i < n && ret > 0; i++) {
+			xmms_ipc_out_msg_t *out = outs[i];
+			guint32 size, left;
+
+			size = xmms_ipc_msg_get_size (out->shared ? out->shared->msg : out->msg);
+			left = size - out->xfered;
+
+			if ((guint32) ret < left) {
+				out->xfered += ret;
+				break;
+			}
+
+			ret -= left;
+
+			g_mutex_lock (&client->lock);
+			g_queue_pop_head (client->out_msg);
+			client->out_bytes -= out->queued;
+			g_mutex_unlock (&client->lock);
+
+			xmms_ipc_out_msg_free (out);
+		}
+
+		if (ret < wlen && i < n) {
+			/* the transport is full */
+			return TRUE;
+		}
 	}
 
 	return FALSE;
@@ -365,6 +873,8 @@ xmms_ipc_client_thread (gpointer data)
 	xmms_ipc_client_t *client = data;
 	GSource *source;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IPC);
+
 	source = g_io_create_watch (client->iochan, G_IO_IN | G_IO_ERR | G_IO_HUP);
 	g_source_set_callback (source,
 	                       (GSourceFunc) xmms_ipc_client_read_cb,
@@ -388,207 +898,1055 @@ xmms_ipc_client_thread (gpointer data)
 	return NULL;
 }
 
-static xmms_ipc_client_t *
-xmms_ipc_client_new (xmms_ipc_t *ipc, xmms_ipc_transport_t *transport)
+/**
+ * Start serving a client from one of the shared I/O loops.
+ */
+static void
+xmms_ipc_client_start_shared (xmms_ipc_client_t *client)
 {
-	xmms_ipc_client_t *client;
-	GMainContext *context;
-	int fd;
-
-	g_return_val_if_fail (transport, NULL);
-
-	client = g_new0 (xmms_ipc_client_t, 1);
-
-	context = g_main_context_new ();
-	client->ml = g_main_loop_new (context, FALSE);
-	g_main_context_unref (context);
-
-	fd = xmms_ipc_transport_fd_get (transport);
-	client->iochan = g_io_channel_unix_new (fd);
-	g_return_val_if_fail (client->iochan, NULL);
-
-	/* We don't set the close_on_unref flag here, because
-	 * the transport will close the fd for us. No need to close it twice.
-	 */
-	g_io_channel_set_encoding (client->iochan, NULL, NULL);
-	g_io_channel_set_buffered (client->iochan, FALSE);
+	GSource *source;
 
-	client->transport = transport;
-	client->ipc = ipc;
-	client->out_msg = g_queue_new ();
-	g_mutex_init (&client->lock);
-	client->id = next_client_id++;
+	xmms_object_emit (XMMS_OBJECT (ipc_manager),
+	                  XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_CONNECTED,
+	                  xmmsv_new_int(client->id));
 
-	return client;
+	source = g_io_create_watch (client->iochan, G_IO_IN | G_IO_ERR | G_IO_HUP);
+	g_source_set_callback (source,
+	                       (GSourceFunc) xmms_ipc_client_read_cb,
+	                       (gpointer) client,
+	                       NULL);
+	g_source_attach (source, g_main_loop_get_context (client->ml));
+	g_source_unref (source);
 }
 
+/**
+ * Take a client served by a shared I/O loop off its server and loop,
+ * and drop what it has waiting in the loop. Runs in the I/O loop, or
+ * once it has stopped.
+ */
 static void
-xmms_ipc_client_destroy (xmms_ipc_client_t *client)
+xmms_ipc_client_detach (xmms_ipc_client_t *client)
 {
-	guint i;
-
-	XMMS_DBG ("Destroying client!");
-
 	if (client->ipc) {
 		g_mutex_lock (&client->ipc->mutex_lock);
 		client->ipc->clients = g_list_remove (client->ipc->clients, client);
 		g_mutex_unlock (&client->ipc->mutex_lock);
 	}
 
-	g_main_loop_unref (client->ml);
-	g_io_channel_unref (client->iochan);
-
-	xmms_ipc_transport_destroy (client->transport);
+	if (client->loop) {
+		g_mutex_lock (&client->loop->lock);
+		client->loop->clients = g_list_remove (client->loop->clients, client);
+		g_mutex_unlock (&client->loop->lock);
+		client->loop = NULL;
+	}
 
 	g_mutex_lock (&client->lock);
-	while (!g_queue_is_empty (client->out_msg)) {
-		xmms_ipc_msg_t *msg = g_queue_pop_head (client->out_msg);
-		xmms_ipc_msg_destroy (msg);
+	client->disconnected = TRUE;
+	if (client->write_source) {
+		g_source_destroy (client->write_source);
+		client->write_source = NULL;
 	}
+	xmms_ipc_client_throttles_clear (client);
+	g_mutex_unlock (&client->lock);
+}
 
-	g_queue_free (client->out_msg);
-
-	for (i = 0; i < XMMS_IPC_SIGNAL_END; i++) {
-		g_list_free (client->broadcasts[i]);
+/**
+ * Called from the I/O loop when the client went away.
+ */
+static void
+xmms_ipc_client_disconnect (xmms_ipc_client_t *client)
+{
+	if (!client->shared) {
+		g_main_loop_quit (client->ml);
+		return;
 	}
 
-	g_mutex_unlock (&client->lock);
-	g_mutex_clear (&client->lock);
-	g_free (client);
+	xmms_ipc_client_detach (client);
+
+	xmms_object_emit (XMMS_OBJECT (ipc_manager),
+	                  XMMS_IPC_SIGNAL_IPC_MANAGER_CLIENT_DISCONNECTED,
+	                  xmmsv_new_int(client->id));
+
+	/* drop the reference held by the I/O loop, workers may still
+	 * hold on to the client for a while */
+	xmms_ipc_client_unref (client);
 }
 
 /**
- * Gets called when the config property "core.ipcsocket" has changed.
+ * Queue a received message for the worker pool. Only one worker at a
+ * time processes the messages of a client, so replies keep their order.
  */
-void
-on_config_ipcsocket_change (xmms_object_t *object, xmmsv_t *_data, gpointer udata)
+static void
+xmms_ipc_client_dispatch (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
 {
-	const gchar *value;
+	gboolean schedule = FALSE;
 
-	XMMS_DBG ("Shutting down ipc server threads through config property \"core.ipcsocket\" change.");
+	xmms_memstat_add (XMMS_MEMSTAT_IPC_QUEUES, xmms_ipc_msg_get_size (msg));
+
+	g_mutex_lock (&client->lock);
+	g_queue_push_tail (client->in_msg, msg);
+	if (!client->dispatching) {
+		client->dispatching = TRUE;
+		schedule = TRUE;
+	}
+	g_mutex_unlock (&client->lock);
+
+	if (schedule) {
+		g_atomic_int_inc (&client->ref);
+		g_thread_pool_push (ipc_workers, client, NULL);
+	}
+}
+
+static void
+xmms_ipc_worker (gpointer data, gpointer udata)
+{
+	xmms_ipc_client_t *client = data;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IPC);
+
+	while (TRUE) {
+		xmms_ipc_msg_t *msg;
+
+		g_mutex_lock (&client->lock);
+		msg = g_queue_pop_head (client->in_msg);
+		if (!msg) {
+			client->dispatching = FALSE;
+		}
+		g_mutex_unlock (&client->lock);
+
+		if (!msg)
+			break;
+
+		xmms_memstat_sub (XMMS_MEMSTAT_IPC_QUEUES, xmms_ipc_msg_get_size (msg));
+		process_msg (client, msg);
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	xmms_ipc_client_unref (client);
+}
+
+static gpointer
+xmms_ipc_io_loop_thread (gpointer data)
+{
+	xmms_ipc_io_loop_t *loop = data;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IPC);
+
+	g_main_loop_run (loop->ml);
+
+	return NULL;
+}
+
+/**
+ * Start the shared I/O loops and the worker pool if configured.
+ */
+static void
+xmms_ipc_io_loops_start (void)
+{
+	xmms_config_property_t *cv;
+	gint threads, workers;
+	guint i;
+
+	if (ipc_io_loops) {
+		return;
+	}
+
+	cv = xmms_config_property_register ("core.ipc_io_threads", "0", NULL, NULL);
+	threads = xmms_config_property_get_int (cv);
+
+	cv = xmms_config_property_register ("core.ipc_workers", "4", NULL, NULL);
+	workers = xmms_config_property_get_int (cv);
+
+	if (threads <= 0) {
+		/* one thread per client */
+		return;
+	}
+
+	ipc_workers = g_thread_pool_new (xmms_ipc_worker, NULL, MAX (workers, 1),
+	                                 FALSE, NULL);
+
+	ipc_num_io_loops = threads;
+	ipc_io_loops = g_new0 (xmms_ipc_io_loop_t, ipc_num_io_loops);
+
+	for (i = 0; i < ipc_num_io_loops; i++) {
+		GMainContext *context = g_main_context_new ();
+		ipc_io_loops[i].ml = g_main_loop_new (context, FALSE);
+		g_main_context_unref (context);
+		g_mutex_init (&ipc_io_loops[i].lock);
+		ipc_io_loops[i].thread = g_thread_new ("x2 ipc io",
+		                                       xmms_ipc_io_loop_thread,
+		                                       &ipc_io_loops[i]);
+	}
+
+	xmms_log_info ("Serving clients from %d I/O thread(s) with %d worker(s)",
+	               threads, MAX (workers, 1));
+}
+
+static void
+xmms_ipc_io_loops_stop (void)
+{
+	guint i;
+
+	if (!ipc_io_loops) {
+		return;
+	}
+
+	for (i = 0; i < ipc_num_io_loops; i++) {
+		g_main_loop_quit (ipc_io_loops[i].ml);
+		g_thread_join (ipc_io_loops[i].thread);
+	}
+
+	/* after this only the loops hold on to the clients */
+	g_thread_pool_free (ipc_workers, FALSE, TRUE);
+	ipc_workers = NULL;
+
+	for (i = 0; i < ipc_num_io_loops; i++) {
+		xmms_ipc_io_loop_t *loop = &ipc_io_loops[i];
+
+		/* the clients still connected, without telling anyone as the
+		 * ipc manager is gone already */
+		while (loop->clients) {
+			xmms_ipc_client_t *client = loop->clients->data;
+			xmms_ipc_client_detach (client);
+			xmms_ipc_client_unref (client);
+		}
+
+		g_main_loop_unref (loop->ml);
+		g_mutex_clear (&loop->lock);
+	}
+
+	g_free (ipc_io_loops);
+	ipc_io_loops = NULL;
+	ipc_num_io_loops = 0;
+}
+
+static xmms_ipc_client_t *
+xmms_ipc_client_new (xmms_ipc_t *ipc, xmms_ipc_transport_t *transport)
+{
+	xmms_ipc_client_t *client;
+	GMainContext *context;
+	int fd;
+
+	g_return_val_if_fail (transport, NULL);
+
+	client = g_new0 (xmms_ipc_client_t, 1);
+
+	if (ipc_io_loops) {
+		/* spread the clients over the shared loops */
+		xmms_ipc_io_loop_t *loop = &ipc_io_loops[ipc_next_io_loop++ % ipc_num_io_loops];
+		client->ml = g_main_loop_ref (loop->ml);
+		client->shared = TRUE;
+		client->ref = 1;
+		client->in_msg = g_queue_new ();
+		client->loop = loop;
+
+		g_mutex_lock (&loop->lock);
+		loop->clients = g_list_prepend (loop->clients, client);
+		g_mutex_unlock (&loop->lock);
+	} else {
+		context = g_main_context_new ();
+		client->ml = g_main_loop_new (context, FALSE);
+		g_main_context_unref (context);
+	}
+
+	fd = xmms_ipc_transport_fd_get (transport);
+	client->iochan = g_io_channel_unix_new (fd);
+	g_return_val_if_fail (client->iochan, NULL);
+
+	/* We don't set the close_on_unref flag here, because
+	 * the transport will close the fd for us. No need to close it twice.
+	 */
+	g_io_channel_set_encoding (client->iochan, NULL, NULL);
+	g_io_channel_set_buffered (client->iochan, FALSE);
+
+	client->transport = transport;
+	client->ipc = ipc;
+	client->out_msg = g_queue_new ();
+	g_mutex_init (&client->lock);
+	client->id = next_client_id++;
+
+	return client;
+}
+
+static void
+xmms_ipc_client_unref (xmms_ipc_client_t *client)
+{
+	if (g_atomic_int_dec_and_test (&client->ref)) {
+		xmms_ipc_client_destroy (client);
+	}
+}
+
+static void
+xmms_ipc_client_destroy (xmms_ipc_client_t *client)
+{
+	guint i;
+
+	XMMS_DBG ("Destroying client!");
+
+	if (client->ipc) {
+		g_mutex_lock (&client->ipc->mutex_lock);
+		client->ipc->clients = g_list_remove (client->ipc->clients, client);
+		g_mutex_unlock (&client->ipc->mutex_lock);
+	}
+
+	if (client->loop) {
+		g_mutex_lock (&client->loop->lock);
+		client->loop->clients = g_list_remove (client->loop->clients, client);
+		g_mutex_unlock (&client->loop->lock);
+	}
+
+	/* their timers go with the context of the loop */
+	g_mutex_lock (&client->lock);
+	xmms_ipc_client_throttles_clear (client);
+	g_mutex_unlock (&client->lock);
+
+	g_main_loop_unref (client->ml);
+	g_io_channel_unref (client->iochan);
+
+	xmms_ipc_transport_destroy (client->transport);
+
+	g_mutex_lock (&client->lock);
+	while (!g_queue_is_empty (client->out_msg)) {
+		xmms_ipc_out_msg_t *out = g_queue_pop_head (client->out_msg);
+		xmms_ipc_out_msg_free (out);
+	}
+
+	g_queue_free (client->out_msg);
+
+	if (client->shm) {
+		xmms_ipc_shm_destroy (client->shm);
+	}
+
+	if (client->in_msg) {
+		while (!g_queue_is_empty (client->in_msg)) {
+			xmms_ipc_msg_t *msg = g_queue_pop_head (client->in_msg);
+			xmms_memstat_sub (XMMS_MEMSTAT_IPC_QUEUES, xmms_ipc_msg_get_size (msg));
+			xmms_ipc_msg_destroy (msg);
+		}
+		g_queue_free (client->in_msg);
+	}
+
+	for (i = 0; i < XMMS_IPC_SIGNAL_END; i++) {
+		g_list_free (client->broadcasts[i]);
+	}
+
+	if (client->broadcast_filters) {
+		g_hash_table_destroy (client->broadcast_filters);
+	}
+
+	g_mutex_unlock (&client->lock);
+	g_mutex_clear (&client->lock);
+	g_free (client);
+}
+
+/**
+ * Gets called when the config property "core.ipcsocket" has changed.
+ */
+void
+on_config_ipcsocket_change (xmms_object_t *object, xmmsv_t *_data, gpointer udata)
+{
+	const gchar *value;
+
+	XMMS_DBG ("Shutting down ipc server threads through config property \"core.ipcsocket\" change.");
+
+	xmms_ipc_close ();
+	value = xmms_config_property_get_string ((xmms_config_property_t *) object);
+	xmms_ipc_setup_server (value);
+}
+
+/**
+ * Format and send a broadcast to a single client.
+ */
+void
+xmms_ipc_send_broadcast (guint broadcastid, gint32 clientid, xmmsv_t *arg,
+                         xmms_error_t *err)
+{
+	gboolean ret;
+	xmms_ipc_client_t *cli;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
+		return;
+	}
+
+	g_mutex_lock (&cli->lock);
+	ret = xmms_ipc_client_broadcast_write (broadcastid, cli, arg);
+	g_mutex_unlock (&cli->lock);
+
+	if (!ret) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "failed to write broadcast");
+	}
+
+	return;
+}
+
+/**
+ * Send an ipc message to a client.
+ */
+void
+xmms_ipc_send_message (gint32 clientid, xmms_ipc_msg_t *msg, xmms_error_t *err)
+{
+	gboolean ret;
+	xmms_ipc_client_t *cli;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
+		return;
+	}
+
+	g_mutex_lock (&cli->lock);
+	ret = xmms_ipc_client_msg_write (cli, msg);
+	g_mutex_unlock (&cli->lock);
+
+	if (!ret) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "failed to write message");
+	}
+
+	return;
+}
+
+/**
+ * Start writing large messages for a client to the shared memory ring
+ * it created. Only clients on the same host can do this.
+ */
+void
+xmms_ipc_client_shm_attach (gint32 clientid, gint shmid, gint size,
+                            xmms_error_t *err)
+{
+	xmms_ipc_client_t *cli;
+	xmms_ipc_shm_t *shm;
+
+	if (!xmms_config_property_get_int (ipc_shm_config)) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "shared memory is disabled");
+		return;
+	}
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (cli == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
+		return;
+	}
+
+	if (!cli->transport->local) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "client is not local");
+		return;
+	}
+
+	shm = xmms_ipc_shm_attach (shmid, size);
+	if (!shm) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "couldn't attach to shared memory");
+		return;
+	}
+
+	g_mutex_lock (&cli->lock);
+	if (cli->shm) {
+		xmms_ipc_shm_destroy (cli->shm);
+	}
+	cli->shm = shm;
+	g_mutex_unlock (&cli->lock);
+
+	XMMS_DBG ("Client %d uses a %d byte shared memory ring", clientid, size);
+}
+
+/**
+ * Remember the protocol version a client said hello with, to use the
+ * compact encoding when it reads it.
+ */
+void
+xmms_ipc_client_protocol_set (gint32 clientid, gint version)
+{
+	xmms_ipc_client_t *cli;
+
+	cli = xmms_ipc_lookup_client (clientid);
+	if (!cli) {
+		return;
+	}
+
+	g_mutex_lock (&cli->lock);
+	cli->compact = version >= XMMS_IPC_PROTOCOL_VERSION_COMPACT;
+	g_mutex_unlock (&cli->lock);
+}
+
+/**
+ * Look up a client based on its id.
+ */
+static xmms_ipc_client_t *
+xmms_ipc_lookup_client (gint32 id)
+{
+	GList *c, *s;
+	xmms_ipc_t *ipc;
+	xmms_ipc_client_t *cli;
+
+	g_mutex_lock (&ipc_servers_lock);
+	for (s = ipc_servers; s && s->data; s = g_list_next (s)) {
+		ipc = s->data;
+
+		g_mutex_lock (&ipc->mutex_lock);
+		for (c = ipc->clients; c; c = g_list_next (c)) {
+			cli = c->data;
+
+			if (cli->id == id) {
+				g_mutex_unlock (&ipc->mutex_lock);
+				g_mutex_unlock (&ipc_servers_lock);
+				return cli;
+			}
+		}
+		g_mutex_unlock (&ipc->mutex_lock);
+	}
+	g_mutex_unlock (&ipc_servers_lock);
+
+	return NULL;
+}
+
+/**
+ * Serialize a broadcast or signal once for all of its receivers.
+ */
+static xmms_ipc_shared_msg_t *
+xmms_ipc_shared_msg_new (guint32 cmd, xmmsv_t *arg, gboolean compact)
+{
+	xmms_ipc_shared_msg_t *shared;
+
+	shared = g_new0 (xmms_ipc_shared_msg_t, 1);
+	shared->ref = 1;
+	shared->msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, cmd);
+	xmms_ipc_handle_cmd_value (shared->msg, arg, compact);
+
+	return shared;
+}
+
+static void
+xmms_ipc_shared_msg_unref (xmms_ipc_shared_msg_t *shared)
+{
+	if (shared && g_atomic_int_dec_and_test (&shared->ref)) {
+		xmms_ipc_msg_destroy (shared->msg);
+		g_free (shared);
+	}
+}
+
+static void
+xmms_ipc_out_msg_free (xmms_ipc_out_msg_t *out)
+{
+	if (out->queued) {
+		xmms_memstat_sub (XMMS_MEMSTAT_IPC_QUEUES, out->queued);
+	}
+	if (out->shared) {
+		xmms_ipc_shared_msg_unref (out->shared);
+	} else {
+		xmms_ipc_msg_destroy (out->msg);
+	}
+	if (out->value) {
+		xmmsv_unref (out->value);
+	}
+	g_free (out);
+}
+
+/**
+ * Move a large message to the client's shared memory ring, leaving
+ * only a notice with its position to go over the socket. The message
+ * is sent as is when the ring is full.
+ * Should hold client->lock.
+ */
+static xmms_ipc_out_msg_t *
+xmms_ipc_client_shm_divert (xmms_ipc_client_t *client, xmms_ipc_out_msg_t *out)
+{
+	unsigned char head[XMMS_IPC_MSG_HEAD_LEN];
+	xmms_ipc_transport_vec_t vec[2];
+	xmms_ipc_out_msg_t *notice;
+	xmms_ipc_msg_t *msg;
+	xmmsv_t *pos;
+	guint32 size, start;
+	gint n;
+
+	msg = out->shared ? out->shared->msg : out->msg;
+	size = xmms_ipc_msg_get_size (msg);
+
+	if (size < XMMS_IPC_SHM_MIN_MSG) {
+		return out;
+	}
+
+	n = xmms_ipc_msg_get_unwritten (msg, out->shared != NULL, out->cookie,
+	                                0, head, vec);
+	if (!xmms_ipc_shm_put (client->shm, vec, n, &start)) {
+		return out;
+	}
+
+	notice = g_new0 (xmms_ipc_out_msg_t, 1);
+	notice->msg = xmms_ipc_msg_new (xmms_ipc_msg_get_object (msg),
+	                                XMMS_IPC_COMMAND_SHM);
+	xmms_ipc_msg_set_cookie (notice->msg, out->shared ? out->cookie
+	                                                  : xmms_ipc_msg_get_cookie (msg));
+
+	pos = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (start),
+	                        XMMSV_LIST_ENTRY_INT (size),
+	                        XMMSV_LIST_END);
+	xmms_ipc_msg_put_value (notice->msg, pos);
+	xmmsv_unref (pos);
+
+	xmms_ipc_out_msg_free (out);
+
+	return notice;
+}
+
+/**
+ * Put an entry in the queue awaiting to be sent to the client.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_queue (xmms_ipc_client_t *client, xmms_ipc_out_msg_t *out)
+{
+	gboolean queue_empty;
+
+	if (client->disconnected) {
+		/* nobody left to read it */
+		xmms_ipc_out_msg_free (out);
+		return TRUE;
+	}
+
+	if (client->shm) {
+		out = xmms_ipc_client_shm_divert (client, out);
+	}
+
+	/* shared messages are counted once for every queue they wait in */
+	out->queued = xmms_ipc_msg_get_size (out->shared ? out->shared->msg : out->msg);
+	xmms_memstat_add (XMMS_MEMSTAT_IPC_QUEUES, out->queued);
+	client->out_bytes += out->queued;
+
+	queue_empty = g_queue_is_empty (client->out_msg);
+	g_queue_push_tail (client->out_msg, out);
+
+	if (g_atomic_int_get (&ipc_metrics)) {
+		client->out_msg_max = MAX (client->out_msg_max,
+		                           g_queue_get_length (client->out_msg));
+	}
+
+	/* If there's no write in progress, add a new callback */
+	if (queue_empty) {
+		GMainContext *context = g_main_loop_get_context (client->ml);
+		GSource *source = g_io_create_watch (client->iochan, G_IO_OUT);
+
+		g_source_set_callback (source,
+		                       (GSourceFunc) xmms_ipc_client_write_cb,
+		                       (gpointer) client,
+		                       NULL);
+		g_source_attach (source, context);
+		client->write_source = source;
+		g_source_unref (source);
+
+		g_main_context_wakeup (context);
+	}
+
+	return TRUE;
+}
+
+/**
+ * Put a message in the queue awaiting to be sent to the client.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
+{
+	xmms_ipc_out_msg_t *out;
+
+	g_return_val_if_fail (client, FALSE);
+	g_return_val_if_fail (msg, FALSE);
+
+	out = g_new0 (xmms_ipc_out_msg_t, 1);
+	out->msg = msg;
+
+	return xmms_ipc_client_queue (client, out);
+}
+
+/**
+ * Queue a shared message for the client, to be sent with cookie.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_shared_write (xmms_ipc_client_t *client,
+                              xmms_ipc_shared_msg_t *shared,
+                              guint32 cookie)
+{
+	xmms_ipc_out_msg_t *out;
+
+	g_return_val_if_fail (client, FALSE);
+	g_return_val_if_fail (shared, FALSE);
+
+	g_atomic_int_inc (&shared->ref);
+
+	out = g_new0 (xmms_ipc_out_msg_t, 1);
+	out->shared = shared;
+	out->cookie = cookie;
+
+	return xmms_ipc_client_queue (client, out);
+}
+
+/**
+ * Read the queue limits once per broadcast rather than once per
+ * receiver.
+ */
+static void
+xmms_ipc_queue_limits_get (xmms_ipc_queue_limits_t *limits)
+{
+	const gchar *policy;
+
+	limits->max_queued = xmms_config_property_get_int (ipc_max_queued_config);
+	limits->max_bytes = xmms_footprint_limit (XMMS_FOOTPRINT_IPC_QUEUE);
+	policy = xmms_config_property_get_string (ipc_queue_overflow_config);
+	limits->drop = policy && strcmp (policy, "drop") == 0;
+}
+
+static gint
+xmms_ipc_id_compare (xmmsv_t **a, xmmsv_t **b)
+{
+	gint32 ia = 0, ib = 0;
+
+	xmmsv_get_int32 (*a, &ia);
+	xmmsv_get_int32 (*b, &ib);
+
+	return (ia > ib) - (ia < ib);
+}
+
+/**
+ * Combine a broadcast value with a newer one of the same broadcast.
+ * Lists of ids, as in entries_changed, are joined. For anything else
+ * the newer value is the current state and replaces the old one.
+ */
+static xmmsv_t *
+xmms_ipc_broadcast_merge (xmmsv_t *old, xmmsv_t *arg)
+{
+	GHashTable *seen;
+	xmmsv_list_iter_t *it;
+	xmmsv_t *merged, *entry;
+	gint32 id;
+	gint i;
+
+	if (!xmmsv_is_type (old, XMMSV_TYPE_LIST) ||
+	    !xmmsv_is_type (arg, XMMSV_TYPE_LIST)) {
+		return xmmsv_ref (arg);
+	}
+
+	seen = g_hash_table_new (NULL, NULL);
+	merged = xmmsv_new_list ();
+
+	for (i = 0; i < 2; i++) {
+		xmmsv_get_list_iter (i == 0 ? old : arg, &it);
+		for (; xmmsv_list_iter_entry (it, &entry); xmmsv_list_iter_next (it)) {
+			if (!xmmsv_get_int32 (entry, &id)) {
+				xmmsv_list_iter_explicit_destroy (it);
+				g_hash_table_destroy (seen);
+				xmmsv_unref (merged);
+				return xmmsv_ref (arg);
+			}
+			if (!g_hash_table_contains (seen, GINT_TO_POINTER (id))) {
+				g_hash_table_add (seen, GINT_TO_POINTER (id));
+				xmmsv_list_append (merged, entry);
+			}
+		}
+		xmmsv_list_iter_explicit_destroy (it);
+	}
+
+	g_hash_table_destroy (seen);
+	xmmsv_list_sort (merged, xmms_ipc_id_compare);
+
+	return merged;
+}
+
+/**
+ * Fold a broadcast into one of the same kind that is still waiting in
+ * the queue untouched.
+ * Should hold client->lock.
+ *
+ * @returns FALSE if there was none.
+ */
+static gboolean
+xmms_ipc_client_broadcast_merge (xmms_ipc_client_t *client, guint broadcastid,
+                                 guint32 cookie, xmmsv_t *arg)
+{
+	xmms_ipc_out_msg_t *out;
+	xmmsv_t *merged;
+	GList *l;
+
+	for (l = g_queue_peek_tail_link (client->out_msg); l; l = l->prev) {
+		out = l->data;
+		if (out->broadcast == broadcastid + 1 && out->cookie == cookie &&
+		    out->xfered == 0) {
+			break;
+		}
+	}
+	if (!l) {
+		return FALSE;
+	}
+
+	merged = xmms_ipc_broadcast_merge (out->value, arg);
+
+	if (out->shared) {
+		xmms_ipc_shared_msg_unref (out->shared);
+		out->shared = NULL;
+	} else {
+		xmms_ipc_msg_destroy (out->msg);
+	}
+	xmmsv_unref (out->value);
+
+	out->msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
+	xmms_ipc_handle_cmd_value (out->msg, merged, client->compact);
+	xmms_ipc_msg_set_cookie (out->msg, cookie);
+	out->value = merged;
+
+	xmms_memstat_sub (XMMS_MEMSTAT_IPC_QUEUES, out->queued);
+	client->out_bytes -= out->queued;
+	out->queued = xmms_ipc_msg_get_size (out->msg);
+	xmms_memstat_add (XMMS_MEMSTAT_IPC_QUEUES, out->queued);
+	client->out_bytes += out->queued;
+
+	return TRUE;
+}
+
+/**
+ * Queue a broadcast for one registration of a client, within the
+ * queue limits. Takes over filtered, sent as a message of its own if
+ * set, while arg is serialized into shared on first use.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_broadcast_enqueue (xmms_ipc_client_t *client,
+                                   guint broadcastid, guint32 cookie,
+                                   xmmsv_t *arg, xmmsv_t *filtered,
+                                   xmms_ipc_shared_msg_t **shared,
+                                   const xmms_ipc_queue_limits_t *limits)
+{
+	xmms_ipc_out_msg_t *out;
+
+	if ((limits->max_queued > 0 &&
+	     (gint) g_queue_get_length (client->out_msg) >= limits->max_queued) ||
+	    (limits->max_bytes > 0 && client->out_bytes >= (gsize) limits->max_bytes)) {
+		if (limits->drop) {
+			XMMS_DBG ("Client %d is too slow, dropping broadcast %d",
+			          client->id, broadcastid);
+			if (filtered) {
+				xmmsv_unref (filtered);
+			}
+			return TRUE;
+		}
+		if (xmms_ipc_client_broadcast_merge (client, broadcastid, cookie,
+		                                     filtered ? filtered : arg)) {
+			if (filtered) {
+				xmmsv_unref (filtered);
+			}
+			return TRUE;
+		}
+	}
+
+	out = g_new0 (xmms_ipc_out_msg_t, 1);
+	out->broadcast = broadcastid + 1;
+	out->cookie = cookie;
+
+	if (filtered) {
+		out->msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
+		xmms_ipc_handle_cmd_value (out->msg, filtered, client->compact);
+		xmms_ipc_msg_set_cookie (out->msg, cookie);
+		out->value = filtered;
+	} else {
+		if (!*shared) {
+			/* serialized once, shared by every receiver reading
+			   the same encoding */
+			*shared = xmms_ipc_shared_msg_new (XMMS_IPC_COMMAND_BROADCAST, arg,
+			                                   client->compact);
+		}
+		g_atomic_int_inc (&(*shared)->ref);
+		out->shared = *shared;
+		out->value = xmmsv_ref (arg);
+	}
 
-	xmms_ipc_close ();
-	value = xmms_config_property_get_string ((xmms_config_property_t *) object);
-	xmms_ipc_setup_server (value);
+	return xmms_ipc_client_queue (client, out);
 }
 
 /**
- * Format and send a broadcast to a single client.
+ * Make a throttle holding a registration to one reply per interval
+ * milliseconds, NULL if the interval doesn't hold anything back.
  */
-void
-xmms_ipc_send_broadcast (guint broadcastid, gint32 clientid, xmmsv_t *arg,
-                         xmms_error_t *err)
+static xmms_ipc_throttle_t *
+xmms_ipc_throttle_new (xmms_ipc_client_t *client, guint id, gboolean signal,
+                       guint32 cookie, gint32 interval)
 {
-	gboolean ret;
-	xmms_ipc_client_t *cli;
+	xmms_ipc_throttle_t *throttle;
 
-	cli = xmms_ipc_lookup_client (clientid);
-	if (cli == NULL) {
-		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
-		return;
+	if (interval <= 0) {
+		return NULL;
 	}
 
-	g_mutex_lock (&cli->lock);
-	ret = xmms_ipc_client_broadcast_write (broadcastid, cli, arg);
-	g_mutex_unlock (&cli->lock);
+	throttle = g_new0 (xmms_ipc_throttle_t, 1);
+	throttle->client = client;
+	throttle->id = id;
+	throttle->signal = signal;
+	throttle->cookie = cookie;
+	throttle->interval = MIN (interval, XMMS_IPC_THROTTLE_MAX) * (gint64) 1000;
 
-	if (!ret) {
-		xmms_error_set (err, XMMS_ERROR_GENERIC, "failed to write broadcast");
-	}
+	return throttle;
+}
 
-	return;
+static void
+xmms_ipc_throttle_free (xmms_ipc_throttle_t *throttle)
+{
+	if (throttle->timer) {
+		g_source_destroy (throttle->timer);
+	}
+	if (throttle->pending) {
+		xmmsv_unref (throttle->pending);
+	}
+	g_free (throttle);
 }
 
 /**
- * Send an ipc message to a client.
+ * Drop the throttles of a client along with their timers.
+ * Should hold client->lock.
  */
-void
-xmms_ipc_send_message (gint32 clientid, xmms_ipc_msg_t *msg, xmms_error_t *err)
+static void
+xmms_ipc_client_throttles_clear (xmms_ipc_client_t *client)
 {
-	gboolean ret;
-	xmms_ipc_client_t *cli;
+	guint i;
 
-	cli = xmms_ipc_lookup_client (clientid);
-	if (cli == NULL) {
-		xmms_error_set (err, XMMS_ERROR_NOENT, "client not found");
-		return;
+	if (client->broadcast_throttles) {
+		g_hash_table_destroy (client->broadcast_throttles);
+		client->broadcast_throttles = NULL;
 	}
 
-	g_mutex_lock (&cli->lock);
-	ret = xmms_ipc_client_msg_write (cli, msg);
-	g_mutex_unlock (&cli->lock);
-
-	if (!ret) {
-		xmms_error_set (err, XMMS_ERROR_GENERIC, "failed to write message");
+	for (i = 0; i < XMMS_IPC_SIGNAL_END; i++) {
+		if (client->signal_throttles[i]) {
+			xmms_ipc_throttle_free (client->signal_throttles[i]);
+			client->signal_throttles[i] = NULL;
+		}
 	}
-
-	return;
 }
 
 /**
- * Look up a client based on its id.
+ * Send what a throttle held back once its interval is over. Runs in
+ * the I/O loop of the client.
  */
-static xmms_ipc_client_t *
-xmms_ipc_lookup_client (gint32 id)
+static gboolean
+xmms_ipc_throttle_flush (gpointer udata)
 {
-	GList *c, *s;
-	xmms_ipc_t *ipc;
-	xmms_ipc_client_t *cli;
+	xmms_ipc_throttle_t *throttle = udata;
+	xmms_ipc_client_t *client = throttle->client;
+	xmms_ipc_shared_msg_t *shared = NULL;
+	xmms_ipc_queue_limits_t limits;
+	xmmsv_t *value;
 
-	g_mutex_lock (&ipc_servers_lock);
-	for (s = ipc_servers; s && s->data; s = g_list_next (s)) {
-		ipc = s->data;
+	xmms_ipc_queue_limits_get (&limits);
 
-		g_mutex_lock (&ipc->mutex_lock);
-		for (c = ipc->clients; c; c = g_list_next (c)) {
-			cli = c->data;
+	g_mutex_lock (&client->lock);
 
-			if (cli->id == id) {
-				g_mutex_unlock (&ipc->mutex_lock);
-				g_mutex_unlock (&ipc_servers_lock);
-				return cli;
-			}
-		}
-		g_mutex_unlock (&ipc->mutex_lock);
+	throttle->timer = NULL;
+	value = throttle->pending;
+	throttle->pending = NULL;
+	throttle->last = g_get_monotonic_time ();
+
+	if (!throttle->signal) {
+		xmms_ipc_client_broadcast_enqueue (client, throttle->id, throttle->cookie,
+		                                   value, value, &shared, &limits);
+	} else if (client->pendingsignals[throttle->id]) {
+		shared = xmms_ipc_shared_msg_new (XMMS_IPC_COMMAND_SIGNAL, value,
+		                                  client->compact);
+		xmms_ipc_client_shared_write (client, shared,
+		                              client->pendingsignals[throttle->id]);
+		client->pendingsignals[throttle->id] = 0;
+		xmmsv_unref (value);
+	} else {
+		xmmsv_unref (value);
 	}
-	g_mutex_unlock (&ipc_servers_lock);
 
-	return NULL;
+	g_mutex_unlock (&client->lock);
+
+	xmms_ipc_shared_msg_unref (shared);
+
+	return FALSE;
 }
 
 /**
- * Put a message in the queue awaiting to be sent to the client.
+ * Hold a reply back if the last one went out less than an interval
+ * ago, folding it into what is already held back. The newest value
+ * wins, except for lists of ids which are joined.
  * Should hold client->lock.
+ *
+ * @returns FALSE if it may be sent right away.
  */
 static gboolean
-xmms_ipc_client_msg_write (xmms_ipc_client_t *client, xmms_ipc_msg_t *msg)
+xmms_ipc_throttle_hold (xmms_ipc_throttle_t *throttle, xmmsv_t *value)
 {
-	gboolean queue_empty;
+	xmms_ipc_client_t *client = throttle->client;
+	gint64 now = g_get_monotonic_time ();
+	xmmsv_t *merged;
+	GSource *source;
 
-	g_return_val_if_fail (client, FALSE);
-	g_return_val_if_fail (msg, FALSE);
+	if (client->disconnected) {
+		return FALSE;
+	}
 
-	queue_empty = g_queue_is_empty (client->out_msg);
-	g_queue_push_tail (client->out_msg, msg);
+	if (!throttle->pending && now - throttle->last >= throttle->interval) {
+		throttle->last = now;
+		return FALSE;
+	}
 
-	/* If there's no write in progress, add a new callback */
-	if (queue_empty) {
-		GMainContext *context = g_main_loop_get_context (client->ml);
-		GSource *source = g_io_create_watch (client->iochan, G_IO_OUT);
+	if (throttle->pending) {
+		merged = xmms_ipc_broadcast_merge (throttle->pending, value);
+		xmmsv_unref (throttle->pending);
+		throttle->pending = merged;
+	} else {
+		throttle->pending = xmmsv_ref (value);
+	}
 
-		g_source_set_callback (source,
-		                       (GSourceFunc) xmms_ipc_client_write_cb,
-		                       (gpointer) client,
-		                       NULL);
-		g_source_attach (source, context);
+	if (!throttle->timer) {
+		source = g_timeout_source_new ((throttle->last + throttle->interval - now) / 1000 + 1);
+		g_source_set_callback (source, xmms_ipc_throttle_flush, throttle, NULL);
+		g_source_attach (source, g_main_loop_get_context (client->ml));
+		throttle->timer = source;
 		g_source_unref (source);
-
-		g_main_context_wakeup (context);
 	}
 
 	return TRUE;
 }
 
+/**
+ * Hand one broadcast to one registration of a client, applying its
+ * filter, its interval and the queue limits. The message is
+ * serialized into shared on first use unless a filter narrows the
+ * value down.
+ * Should hold client->lock.
+ */
+static gboolean
+xmms_ipc_client_broadcast_deliver (xmms_ipc_client_t *client,
+                                   guint broadcastid, guint32 cookie,
+                                   xmmsv_t *arg,
+                                   xmms_ipc_shared_msg_t **shared,
+                                   const xmms_ipc_queue_limits_t *limits)
+{
+	xmms_ipc_broadcast_filter_t *filter = NULL;
+	xmms_ipc_throttle_t *throttle = NULL;
+	xmmsv_t *filtered = NULL;
+
+	if (client->broadcast_filters) {
+		filter = g_hash_table_lookup (client->broadcast_filters,
+		                              GUINT_TO_POINTER (cookie));
+	}
+	if (filter && !xmms_ipc_broadcast_filter_apply (filter, arg, &filtered)) {
+		return TRUE;
+	}
+
+	if (client->broadcast_throttles) {
+		throttle = g_hash_table_lookup (client->broadcast_throttles,
+		                                GUINT_TO_POINTER (cookie));
+	}
+	if (throttle && xmms_ipc_throttle_hold (throttle, filtered ? filtered : arg)) {
+		if (filtered) {
+			xmmsv_unref (filtered);
+		}
+		return TRUE;
+	}
+
+	return xmms_ipc_client_broadcast_enqueue (client, broadcastid, cookie,
+	                                          arg, filtered, shared, limits);
+}
+
 /**
  * Write a broadcast to a single client.
  * Should hold client->lock.
@@ -598,18 +1956,21 @@ xmms_ipc_client_broadcast_write (guint broadcastid, xmms_ipc_client_t *cli,
                                  xmmsv_t *arg)
 {
 	GList *l;
-	xmms_ipc_msg_t *msg;
+	xmms_ipc_shared_msg_t *shared = NULL;
+	xmms_ipc_queue_limits_t limits;
+	gboolean ret = TRUE;
 
-	for (l = cli->broadcasts[broadcastid]; l; l = g_list_next (l)) {
-		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
-		xmms_ipc_msg_set_cookie (msg, GPOINTER_TO_UINT (l->data));
-		xmms_ipc_handle_cmd_value (msg, arg);
-		if (!xmms_ipc_client_msg_write (cli, msg)) {
-			return FALSE;
-		}
+	xmms_ipc_queue_limits_get (&limits);
+
+	for (l = cli->broadcasts[broadcastid]; l && ret; l = g_list_next (l)) {
+		ret = xmms_ipc_client_broadcast_deliver (cli, broadcastid,
+		                                         GPOINTER_TO_UINT (l->data),
+		                                         arg, &shared, &limits);
 	}
 
-	return TRUE;
+	xmms_ipc_shared_msg_unref (shared);
+
+	return ret;
 }
 
 
@@ -643,6 +2004,11 @@ xmms_ipc_source_accept (GIOChannel *chan, GIOCondition cond, gpointer data)
 	ipc->clients = g_list_append (ipc->clients, client);
 	g_mutex_unlock (&ipc->mutex_lock);
 
+	if (client->shared) {
+		xmms_ipc_client_start_shared (client);
+		return TRUE;
+	}
+
 	/* Now that the client has been registered in the ipc->clients list
 	 * we may safely start its thread.
 	 */
@@ -710,7 +2076,8 @@ xmms_ipc_signal_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 	GList *c, *s;
 	guint signalid = GPOINTER_TO_UINT (userdata);
 	xmms_ipc_t *ipc;
-	xmms_ipc_msg_t *msg;
+	/* serialized once for each encoding in use */
+	xmms_ipc_shared_msg_t *shared[2] = { NULL, NULL };
 
 	g_mutex_lock (&ipc_servers_lock);
 
@@ -720,11 +2087,15 @@ xmms_ipc_signal_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 		for (c = ipc->clients; c; c = g_list_next (c)) {
 			xmms_ipc_client_t *cli = c->data;
 			g_mutex_lock (&cli->lock);
-			if (cli->pendingsignals[signalid]) {
-				msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_SIGNAL);
-				xmms_ipc_msg_set_cookie (msg, cli->pendingsignals[signalid]);
-				xmms_ipc_handle_cmd_value (msg, arg);
-				xmms_ipc_client_msg_write (cli, msg);
+			if (cli->pendingsignals[signalid] &&
+			    !(cli->signal_throttles[signalid] &&
+			      xmms_ipc_throttle_hold (cli->signal_throttles[signalid], arg))) {
+				if (!shared[cli->compact]) {
+					shared[cli->compact] = xmms_ipc_shared_msg_new (XMMS_IPC_COMMAND_SIGNAL,
+					                                                arg, cli->compact);
+				}
+				xmms_ipc_client_shared_write (cli, shared[cli->compact],
+				                              cli->pendingsignals[signalid]);
 				cli->pendingsignals[signalid] = 0;
 			}
 			g_mutex_unlock (&cli->lock);
@@ -734,6 +2105,8 @@ xmms_ipc_signal_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 
 	g_mutex_unlock (&ipc_servers_lock);
 
+	xmms_ipc_shared_msg_unref (shared[0]);
+	xmms_ipc_shared_msg_unref (shared[1]);
 }
 
 static void
@@ -742,9 +2115,13 @@ xmms_ipc_broadcast_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 	GList *c, *s;
 	guint broadcastid = GPOINTER_TO_UINT (userdata);
 	xmms_ipc_t *ipc;
-	xmms_ipc_msg_t *msg = NULL;
+	/* serialized once for each encoding in use */
+	xmms_ipc_shared_msg_t *shared[2] = { NULL, NULL };
+	xmms_ipc_queue_limits_t limits;
 	GList *l;
 
+	xmms_ipc_queue_limits_get (&limits);
+
 	g_mutex_lock (&ipc_servers_lock);
 
 	for (s = ipc_servers; s && s->data; s = g_list_next (s)) {
@@ -755,16 +2132,222 @@ xmms_ipc_broadcast_cb (xmms_object_t *object, xmmsv_t *arg, gpointer userdata)
 
 			g_mutex_lock (&cli->lock);
 			for (l = cli->broadcasts[broadcastid]; l; l = g_list_next (l)) {
-				msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_SIGNAL, XMMS_IPC_COMMAND_BROADCAST);
-				xmms_ipc_msg_set_cookie (msg, GPOINTER_TO_UINT (l->data));
-				xmms_ipc_handle_cmd_value (msg, arg);
-				xmms_ipc_client_msg_write (cli, msg);
+				xmms_ipc_client_broadcast_deliver (cli, broadcastid,
+				                                   GPOINTER_TO_UINT (l->data),
+				                                   arg, &shared[cli->compact],
+				                                   &limits);
 			}
 			g_mutex_unlock (&cli->lock);
 		}
 		g_mutex_unlock (&ipc->mutex_lock);
 	}
 	g_mutex_unlock (&ipc_servers_lock);
+
+	xmms_ipc_shared_msg_unref (shared[0]);
+	xmms_ipc_shared_msg_unref (shared[1]);
+}
+
+static void
+on_config_ipc_metrics_change (xmms_object_t *object, xmmsv_t *_data,
+                              gpointer udata)
+{
+	gint enabled;
+
+	enabled = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_atomic_int_set (&ipc_metrics, !!enabled);
+}
+
+static xmmsv_t *
+xmms_ipc_metrics_clients (void)
+{
+	xmms_ipc_client_t *cli;
+	xmmsv_t *list, *dict;
+	GList *s, *c;
+	xmms_ipc_t *ipc;
+
+	list = xmmsv_new_list ();
+
+	g_mutex_lock (&ipc_servers_lock);
+	for (s = ipc_servers; s && s->data; s = g_list_next (s)) {
+		ipc = s->data;
+
+		g_mutex_lock (&ipc->mutex_lock);
+		for (c = ipc->clients; c; c = g_list_next (c)) {
+			cli = c->data;
+
+			g_mutex_lock (&cli->lock);
+			dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", cli->id),
+			                         XMMSV_DICT_ENTRY_INT ("queued", g_queue_get_length (cli->out_msg)),
+			                         XMMSV_DICT_ENTRY_INT ("queued_max", cli->out_msg_max),
+			                         XMMSV_DICT_ENTRY_INT ("queued_bytes", cli->out_bytes),
+			                         XMMSV_DICT_ENTRY_INT ("bytes_in", cli->bytes_in),
+			                         XMMSV_DICT_ENTRY_INT ("bytes_out", cli->bytes_out),
+			                         XMMSV_DICT_END);
+			g_mutex_unlock (&cli->lock);
+
+			xmmsv_list_append (list, dict);
+			xmmsv_unref (dict);
+		}
+		g_mutex_unlock (&ipc->mutex_lock);
+	}
+	g_mutex_unlock (&ipc_servers_lock);
+
+	return list;
+}
+
+static xmmsv_t *
+xmms_ipc_metrics_commands_get (void)
+{
+	xmms_ipc_command_stats_t *stats;
+	xmmsv_t *list, *dict, *hist;
+	GHashTableIter iter;
+	guint i;
+
+	list = xmmsv_new_list ();
+
+	g_mutex_lock (&ipc_metrics_lock);
+	g_hash_table_iter_init (&iter, ipc_metrics_commands);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &stats)) {
+		hist = xmmsv_new_list ();
+		for (i = 0; i < XMMS_IPC_LATENCY_BUCKETS; i++) {
+			xmmsv_list_append_int (hist, stats->hist[i]);
+		}
+
+		dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("object", stats->objid),
+		                         XMMSV_DICT_ENTRY_INT ("command", stats->cmdid),
+		                         XMMSV_DICT_ENTRY_INT ("calls", stats->calls),
+		                         XMMSV_DICT_ENTRY_INT ("errors", stats->errors),
+		                         XMMSV_DICT_ENTRY_INT ("time", stats->time),
+		                         XMMSV_DICT_ENTRY_INT ("max", stats->max),
+		                         XMMSV_DICT_ENTRY ("histogram", hist),
+		                         XMMSV_DICT_END);
+		xmmsv_list_append (list, dict);
+		xmmsv_unref (dict);
+	}
+	g_mutex_unlock (&ipc_metrics_lock);
+
+	return list;
+}
+
+/**
+ * The counters kept while core.ipc_metrics is set: per (object,
+ * command) calls, errors, total and longest time in µs and a
+ * histogram of the times with buckets up to 10µs, 100µs and so on to
+ * 1s and beyond, and per connected client its queued messages now and
+ * at most, and bytes read and written.
+ */
+static xmmsv_t *
+xmms_ipc_manager_client_metrics (xmms_ipc_manager_t *manager,
+                                 xmms_error_t *err)
+{
+	xmmsv_t *clients;
+
+	clients = xmms_ipc_metrics_clients ();
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("enabled", g_atomic_int_get (&ipc_metrics)),
+	                         XMMSV_DICT_ENTRY_INT ("client_count", xmmsv_list_get_size (clients)),
+	                         XMMSV_DICT_ENTRY ("clients", clients),
+	                         XMMSV_DICT_ENTRY ("commands", xmms_ipc_metrics_commands_get ()),
+	                         XMMSV_DICT_END);
+}
+
+static void
+xmms_ipc_metrics_text_command (GString *out, xmmsv_t *dict)
+{
+	gint64 objid, cmdid, count, value;
+	xmmsv_t *hist;
+	gint i;
+
+	xmmsv_dict_entry_get_int64 (dict, "object", &objid);
+	xmmsv_dict_entry_get_int64 (dict, "command", &cmdid);
+	xmmsv_dict_get (dict, "histogram", &hist);
+
+	for (i = 0, count = 0; i < XMMS_IPC_LATENCY_BUCKETS; i++) {
+		xmmsv_list_get_int64 (hist, i, &value);
+		count += value;
+		if (i < XMMS_IPC_LATENCY_BUCKETS - 1) {
+			g_string_append_printf (out, "xmms2_ipc_command_seconds_bucket{object=\"%" G_GINT64_FORMAT "\",command=\"%" G_GINT64_FORMAT "\",le=\"%g\"} %" G_GINT64_FORMAT "\n",
+			                        objid, cmdid, ipc_latency_bounds[i] / 1e6, count);
+		} else {
+			g_string_append_printf (out, "xmms2_ipc_command_seconds_bucket{object=\"%" G_GINT64_FORMAT "\",command=\"%" G_GINT64_FORMAT "\",le=\"+Inf\"} %" G_GINT64_FORMAT "\n",
+			                        objid, cmdid, count);
+		}
+	}
+
+	xmmsv_dict_entry_get_int64 (dict, "time", &value);
+	g_string_append_printf (out, "xmms2_ipc_command_seconds_sum{object=\"%" G_GINT64_FORMAT "\",command=\"%" G_GINT64_FORMAT "\"} %g\n",
+	                        objid, cmdid, value / 1e6);
+	g_string_append_printf (out, "xmms2_ipc_command_seconds_count{object=\"%" G_GINT64_FORMAT "\",command=\"%" G_GINT64_FORMAT "\"} %" G_GINT64_FORMAT "\n",
+	                        objid, cmdid, count);
+	xmmsv_dict_entry_get_int64 (dict, "errors", &value);
+	g_string_append_printf (out, "xmms2_ipc_command_errors_total{object=\"%" G_GINT64_FORMAT "\",command=\"%" G_GINT64_FORMAT "\"} %" G_GINT64_FORMAT "\n",
+	                        objid, cmdid, value);
+}
+
+static void
+xmms_ipc_metrics_text_client (GString *out, xmmsv_t *dict)
+{
+	static const gchar *keys[][2] = {
+		{ "queued", "xmms2_ipc_client_queued" },
+		{ "queued_max", "xmms2_ipc_client_queued_max" },
+		{ "queued_bytes", "xmms2_ipc_client_queued_bytes" },
+		{ "bytes_in", "xmms2_ipc_client_received_bytes_total" },
+		{ "bytes_out", "xmms2_ipc_client_sent_bytes_total" }
+	};
+	gint64 id, value;
+	guint i;
+
+	xmmsv_dict_entry_get_int64 (dict, "id", &id);
+
+	for (i = 0; i < G_N_ELEMENTS (keys); i++) {
+		xmmsv_dict_entry_get_int64 (dict, keys[i][0], &value);
+		g_string_append_printf (out, "%s{client=\"%" G_GINT64_FORMAT "\"} %" G_GINT64_FORMAT "\n",
+		                        keys[i][1], id, value);
+	}
+}
+
+/**
+ * The same as xmms_ipc_manager_client_metrics in the Prometheus text
+ * exposition format, for a client to serve over HTTP.
+ */
+static gchar *
+xmms_ipc_manager_client_metrics_text (xmms_ipc_manager_t *manager,
+                                      xmms_error_t *err)
+{
+	xmmsv_t *metrics, *list, *item;
+	xmmsv_list_iter_t *it;
+	gint64 count;
+	GString *out;
+
+	metrics = xmms_ipc_manager_client_metrics (manager, err);
+	out = g_string_new (NULL);
+
+	xmmsv_dict_entry_get_int64 (metrics, "client_count", &count);
+	g_string_append (out, "# TYPE xmms2_ipc_clients gauge\n");
+	g_string_append_printf (out, "xmms2_ipc_clients %" G_GINT64_FORMAT "\n", count);
+
+	g_string_append (out, "# TYPE xmms2_ipc_command_seconds histogram\n");
+	g_string_append (out, "# TYPE xmms2_ipc_command_errors_total counter\n");
+	xmmsv_dict_get (metrics, "commands", &list);
+	xmmsv_get_list_iter (list, &it);
+	for (; xmmsv_list_iter_entry (it, &item); xmmsv_list_iter_next (it)) {
+		xmms_ipc_metrics_text_command (out, item);
+	}
+
+	g_string_append (out, "# TYPE xmms2_ipc_client_queued gauge\n");
+	g_string_append (out, "# TYPE xmms2_ipc_client_queued_max gauge\n");
+	g_string_append (out, "# TYPE xmms2_ipc_client_queued_bytes gauge\n");
+	g_string_append (out, "# TYPE xmms2_ipc_client_received_bytes_total counter\n");
+	g_string_append (out, "# TYPE xmms2_ipc_client_sent_bytes_total counter\n");
+	xmmsv_dict_get (metrics, "clients", &list);
+	xmmsv_get_list_iter (list, &it);
+	for (; xmmsv_list_iter_entry (it, &item); xmmsv_list_iter_next (it)) {
+		xmms_ipc_metrics_text_client (out, item);
+	}
+
+	xmmsv_unref (metrics);
+
+	return g_string_free (out, FALSE);
 }
 
 /**
@@ -868,13 +2451,38 @@ xmms_ipc_object_unregister (xmms_ipc_object_t objectid)
 xmms_ipc_t *
 xmms_ipc_init (void)
 {
+	xmms_config_property_t *cv;
+
 	g_mutex_init (&ipc_servers_lock);
 	g_mutex_init (&ipc_object_pool_lock);
 	ipc_object_pool = g_new0 (xmms_ipc_object_pool_t, 1);
 
+	g_mutex_init (&ipc_metrics_lock);
+	ipc_metrics_commands = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+
 	ipc_manager = xmms_object_new (xmms_ipc_manager_t, NULL);
 	xmms_ipc_manager_register_ipc_commands (XMMS_OBJECT (ipc_manager));
 
+	ipc_shm_config = xmms_config_property_register ("core.ipc_shm", "1",
+	                                                NULL, NULL);
+
+	/* relay c2c payloads without decoding them */
+	ipc_courier_passthrough_config =
+		xmms_config_property_register ("core.ipc_courier_passthrough", "1",
+		                               NULL, NULL);
+
+	/* 0 lets the queue grow without limit */
+	ipc_max_queued_config = xmms_config_property_register ("core.ipc_max_queued",
+	                                                       "1024", NULL, NULL);
+	/* "merge" or "drop" */
+	ipc_queue_overflow_config = xmms_config_property_register ("core.ipc_queue_overflow",
+	                                                           "merge", NULL, NULL);
+
+	/* per command and per client accounting, off by default */
+	cv = xmms_config_property_register ("core.ipc_metrics", "0",
+	                                    on_config_ipc_metrics_change, NULL);
+	on_config_ipc_metrics_change (XMMS_OBJECT (cv), NULL, NULL);
+
 	return NULL;
 }
 
@@ -892,6 +2500,7 @@ xmms_ipc_shutdown_server (xmms_ipc_t *ipc)
 	g_source_remove_by_user_data (ipc);
 	g_io_channel_unref (ipc->chan);
 	xmms_ipc_transport_destroy (ipc->transport);
+	g_free (ipc->path);
 
 	for (c = ipc->clients; c; c = g_list_next (c)) {
 		co = c->data;
@@ -917,10 +2526,14 @@ xmms_ipc_shutdown (void)
 	xmms_object_unref (ipc_manager);
 
 	xmms_ipc_close ();
+	xmms_ipc_io_loops_stop ();
 	g_mutex_clear (&ipc_servers_lock);
 	g_mutex_clear (&ipc_object_pool_lock);
 	g_free (ipc_object_pool);
 	ipc_object_pool = NULL;
+	g_hash_table_destroy (ipc_metrics_commands);
+	ipc_metrics_commands = NULL;
+	g_mutex_clear (&ipc_metrics_lock);
 }
 
 /**
@@ -942,6 +2555,100 @@ xmms_ipc_close (void)
 	g_mutex_unlock (&ipc_servers_lock);
 }
 
+/**
+ * Listen on url, taking over the socket the old daemon listened to it
+ * on, if there is one.
+ */
+static xmms_ipc_transport_t *
+xmms_ipc_setup_transport (const gchar *url)
+{
+	xmms_ipc_transport_t *transport;
+	gpointer fd;
+
+	if (ipc_inherited && g_hash_table_lookup_extended (ipc_inherited, url, NULL, &fd)) {
+		g_hash_table_remove (ipc_inherited, url);
+
+		transport = xmms_ipc_server_adopt (url, GPOINTER_TO_INT (fd));
+		if (transport) {
+			XMMS_DBG ("Took over the socket listening on '%s'.", url);
+			return transport;
+		}
+		xmms_socket_close (GPOINTER_TO_INT (fd));
+	}
+
+	return xmms_ipc_server_init (url);
+}
+
+/**
+ * Take over the listening sockets of the daemon this one replaced,
+ * as fd:url, used by xmms_ipc_setup_server instead of listening anew.
+ */
+void
+xmms_ipc_inherit (gchar **sockets)
+{
+	gint i;
+
+	g_return_if_fail (sockets);
+
+	if (!ipc_inherited) {
+		ipc_inherited = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+
+	for (i = 0; sockets[i]; i++) {
+		gchar *end;
+		gint64 fd;
+
+		fd = g_ascii_strtoll (sockets[i], &end, 10);
+		if (end == sockets[i] || *end != ':' || fd < 0 || fd > G_MAXINT) {
+			xmms_log_error ("Ignoring inherited socket '%s'.", sockets[i]);
+			continue;
+		}
+
+		g_hash_table_insert (ipc_inherited, g_strdup (end + 1), GINT_TO_POINTER (fd));
+	}
+}
+
+/**
+ * Stop accepting clients and keep the listening sockets open for a
+ * daemon replacing this one. Their fds are appended to keep, connects
+ * wait in the backlog until the new daemon accepts.
+ *
+ * @returns The sockets as fd:url, for the new daemon to
+ * #xmms_ipc_inherit.
+ */
+gchar **
+xmms_ipc_handoff (GArray *keep)
+{
+	GPtrArray *ret;
+	GList *s;
+
+	g_return_val_if_fail (keep, NULL);
+
+	ret = g_ptr_array_new ();
+
+	g_mutex_lock (&ipc_servers_lock);
+	for (s = ipc_servers; s; s = g_list_next (s)) {
+		xmms_ipc_t *ipc = s->data;
+		gint fd;
+
+		g_mutex_lock (&ipc->mutex_lock);
+		fd = xmms_ipc_transport_fd_get (ipc->transport);
+		g_source_remove_by_user_data (ipc);
+		/* closed by the new daemon */
+		g_io_channel_set_close_on_unref (ipc->chan, FALSE);
+		ipc->transport->fd = -1;
+		g_mutex_unlock (&ipc->mutex_lock);
+
+		g_array_append_val (keep, fd);
+		g_ptr_array_add (ret, g_strdup_printf ("%d:%s", fd, ipc->path));
+	}
+	g_mutex_unlock (&ipc_servers_lock);
+
+	g_ptr_array_add (ret, NULL);
+
+	return (gchar **) g_ptr_array_free (ret, FALSE);
+}
+
 /**
  * Start the server
  */
@@ -954,6 +2661,8 @@ xmms_ipc_setup_server (const gchar *path)
 	gint i = 0, num_init = 0;
 	g_return_val_if_fail (path, FALSE);
 
+	xmms_ipc_io_loops_start ();
+
 	split = g_strsplit (path, ";", 0);
 
 	for (i = 0; split && split[i]; i++) {
@@ -963,7 +2672,7 @@ xmms_ipc_setup_server (const gchar *path)
 			continue;
 		}
 
-		transport = xmms_ipc_server_init (split[i]);
+		transport = xmms_ipc_setup_transport (split[i]);
 		if (!transport) {
 			g_free (ipc);
 			xmms_log_error ("Couldn't setup IPC listening on '%s'.", split[i]);
@@ -972,6 +2681,7 @@ xmms_ipc_setup_server (const gchar *path)
 
 
 		g_mutex_init (&ipc->mutex_lock);
+		ipc->path = g_strdup (split[i]);
 		ipc->transport = transport;
 		ipc->signals = ipc_object_pool->signals;
 		ipc->broadcasts = ipc_object_pool->broadcasts;
@@ -989,6 +2699,20 @@ xmms_ipc_setup_server (const gchar *path)
 
 	g_strfreev (split);
 
+	/* what the old daemon listened to but this one doesn't */
+	if (ipc_inherited) {
+		GHashTableIter iter;
+		gpointer key, value;
+
+		g_hash_table_iter_init (&iter, ipc_inherited);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			xmms_log_info ("Not listening on '%s' anymore.", (gchar *) key);
+			xmms_socket_close (GPOINTER_TO_INT (value));
+		}
+		g_hash_table_destroy (ipc_inherited);
+		ipc_inherited = NULL;
+	}
+
 
 	/* If there is less than one socket, there is sth. wrong. */
 	if (num_init < 1)
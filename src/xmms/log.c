@@ -17,6 +17,10 @@
 /** @file
  * Logging functions.
  *
+ * Messages are formatted by the thread that logs them and written by
+ * a writer thread, so a slow stdout never holds up the threads that
+ * feed the sound card. If the writer falls too far behind, messages
+ * are dropped and the number of them is logged once it catches up.
  */
 
 #include <time.h>
@@ -26,12 +30,66 @@
 #include <glib.h>
 #include <xmmspriv/xmms_log.h>
 #include <xmmspriv/xmms_localtime.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmmsc/xmmsc_log.h>
 #include <xmmsc/xmmsc-glib.h>
 
+/* most messages waiting for the writer before they are dropped */
+#define XMMS_LOG_QUEUE_MAX 1024
+
+gint xmms_log_verbosity = 0;
+
 static gchar *logts_format = NULL;
+static GAsyncQueue *log_queue = NULL;
+static GThread *log_thread = NULL;
+static gint log_queued = 0;
+static gint log_dropped = 0;
+
+/* pushed by xmms_log_shutdown to stop the writer */
+static gchar log_quit[] = "";
+
 static void xmms_log_handler (const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer user_data);
 
+static void
+xmms_log_write (const gchar *line)
+{
+	gint dropped;
+
+	do {
+		dropped = g_atomic_int_get (&log_dropped);
+	} while (dropped && !g_atomic_int_compare_and_exchange (&log_dropped, dropped, 0));
+
+	if (dropped) {
+		printf ("%d log messages dropped\n", dropped);
+	}
+
+	fputs (line, stdout);
+}
+
+static gpointer
+xmms_log_writer (gpointer udata)
+{
+	gchar *line;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
+	while ((line = g_async_queue_pop (log_queue)) != log_quit) {
+		g_atomic_int_add (&log_queued, -1);
+
+		xmms_log_write (line);
+		g_free (line);
+
+		/* one flush for everything that piled up meanwhile */
+		if (!g_atomic_int_get (&log_queued)) {
+			fflush (stdout);
+		}
+	}
+
+	fflush (stdout);
+
+	return NULL;
+}
+
 
 void
 xmms_log_set_format (const gchar *format)
@@ -45,6 +103,13 @@ xmms_log_set_format (const gchar *format)
 void
 xmms_log_init (gint verbosity)
 {
+	xmms_log_verbosity = verbosity;
+
+	if (!log_queue) {
+		log_queue = g_async_queue_new ();
+	}
+	log_thread = g_thread_new ("x2 log", xmms_log_writer, NULL);
+
 	xmmsc_log_handler_set (xmmsc_log_glib_handler, NULL);
 	g_log_set_default_handler (xmms_log_handler, GINT_TO_POINTER (verbosity));
 	xmms_log_info ("Initialized logging system :)");
@@ -53,7 +118,20 @@ xmms_log_init (gint verbosity)
 void
 xmms_log_shutdown ()
 {
+	GThread *thread;
+
 	xmms_log_info ("Logging says bye bye :)");
+
+	/* anything logged from now on is written right away, the queue
+	 * is kept for whoever saw the writer running a moment ago */
+	thread = g_atomic_pointer_get (&log_thread);
+	g_atomic_pointer_set (&log_thread, NULL);
+
+	if (thread) {
+		g_async_queue_push (log_queue, log_quit);
+		g_thread_join (thread);
+	}
+
 	g_free (logts_format);
 	logts_format = NULL;
 }
@@ -62,7 +140,7 @@ xmms_log_shutdown ()
 static void
 xmms_log_handler (const gchar *log_domain, GLogLevelFlags log_level, const gchar *message, gpointer user_data)
 {
-	gchar logts_buf[256];
+	gchar logts_buf[256], *line;
 	time_t tv = 0;
 	struct tm st;
 	const char *level = "??";
@@ -103,12 +181,23 @@ xmms_log_handler (const gchar *log_domain, GLogLevelFlags log_level, const gchar
 #endif
 
 	if (log_domain && log_domain[0]) {
-		printf ("%s%s in %s: %s\n", logts_buf, level, log_domain, message);
+		line = g_strdup_printf ("%s%s in %s: %s\n", logts_buf, level, log_domain, message);
 	} else {
-		printf ("%s%s: %s\n", logts_buf, level, message);
+		line = g_strdup_printf ("%s%s: %s\n", logts_buf, level, message);
 	}
 
-	fflush (stdout);
+	/* the process is about to die, don't leave it in the queue */
+	if (!g_atomic_pointer_get (&log_thread) || (log_level & G_LOG_LEVEL_ERROR)) {
+		xmms_log_write (line);
+		fflush (stdout);
+		g_free (line);
+	} else if (g_atomic_int_add (&log_queued, 1) < XMMS_LOG_QUEUE_MAX) {
+		g_async_queue_push (log_queue, line);
+	} else {
+		g_atomic_int_add (&log_queued, -1);
+		g_atomic_int_inc (&log_dropped);
+		g_free (line);
+	}
 
 	if (log_level & G_LOG_LEVEL_ERROR) {
 		exit (EXIT_FAILURE);
@@ -0,0 +1,279 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ *  The bookkeeping shared by the LRU caches of the server.
+ *
+ *  Entries are kept in a hash table and in a queue ordered by use,
+ *  the least recently used ones are evicted when there are too many.
+ *  An lru has no lock of its own, its cache should hold one around
+ *  every call.
+ */
+
+#include <xmmspriv/xmms_lru.h>
+
+typedef struct xmms_lru_node_St {
+	xmms_lru_t *lru;
+	gpointer key;
+	gpointer value;
+	GList link;
+} xmms_lru_node_t;
+
+struct xmms_lru_St {
+	/** Maps keys to their node */
+	GHashTable *nodes;
+	/** Most recently used first */
+	GQueue order;
+	guint max_entries;
+	GDestroyNotify key_free;
+	GDestroyNotify value_free;
+	guint hits;
+	guint misses;
+};
+
+/** Called by the hash table for every node it drops. */
+static void
+xmms_lru_node_free (gpointer data)
+{
+	xmms_lru_node_t *node = data;
+	xmms_lru_t *lru = node->lru;
+
+	g_queue_unlink (&lru->order, &node->link);
+
+	if (lru->key_free) {
+		lru->key_free (node->key);
+	}
+	if (lru->value_free && node->value) {
+		lru->value_free (node->value);
+	}
+	g_free (node);
+}
+
+/** Evict the least recently used entries. */
+static void
+xmms_lru_trim (xmms_lru_t *lru)
+{
+	while (g_queue_get_length (&lru->order) > lru->max_entries) {
+		xmms_lru_node_t *node = g_queue_peek_tail (&lru->order);
+		g_hash_table_remove (lru->nodes, node->key);
+	}
+}
+
+/**
+ * Create an lru.
+ *
+ * @param key_free frees the keys, or NULL
+ * @param value_free frees the values, or NULL
+ * @param max_entries the number of entries to keep
+ */
+xmms_lru_t *
+xmms_lru_new (GHashFunc hash_func, GEqualFunc key_equal_func,
+              GDestroyNotify key_free, GDestroyNotify value_free,
+              guint max_entries)
+{
+	xmms_lru_t *lru;
+
+	lru = g_new0 (xmms_lru_t, 1);
+	lru->nodes = g_hash_table_new_full (hash_func, key_equal_func,
+	                                    NULL, xmms_lru_node_free);
+	g_queue_init (&lru->order);
+	lru->key_free = key_free;
+	lru->value_free = value_free;
+	lru->max_entries = max_entries;
+
+	return lru;
+}
+
+void
+xmms_lru_free (xmms_lru_t *lru)
+{
+	g_return_if_fail (lru);
+
+	g_hash_table_destroy (lru->nodes);
+	g_free (lru);
+}
+
+void
+xmms_lru_set_max_entries (xmms_lru_t *lru, guint max_entries)
+{
+	g_return_if_fail (lru);
+
+	lru->max_entries = max_entries;
+	xmms_lru_trim (lru);
+}
+
+guint
+xmms_lru_get_max_entries (xmms_lru_t *lru)
+{
+	g_return_val_if_fail (lru, 0);
+
+	return lru->max_entries;
+}
+
+/**
+ * Look up the value stored under key and mark it as the most recently
+ * used.
+ *
+ * @returns The value, still owned by the lru, or NULL.
+ */
+gpointer
+xmms_lru_lookup (xmms_lru_t *lru, gconstpointer key)
+{
+	xmms_lru_node_t *node;
+
+	g_return_val_if_fail (lru, NULL);
+
+	node = g_hash_table_lookup (lru->nodes, key);
+	if (!node) {
+		return NULL;
+	}
+
+	g_queue_unlink (&lru->order, &node->link);
+	g_queue_push_head_link (&lru->order, &node->link);
+
+	return node->value;
+}
+
+gboolean
+xmms_lru_contains (xmms_lru_t *lru, gconstpointer key)
+{
+	g_return_val_if_fail (lru, FALSE);
+
+	return g_hash_table_contains (lru->nodes, key);
+}
+
+/**
+ * Store a value as the most recently used, replacing the one stored
+ * under the same key. The lru takes ownership of both key and value.
+ */
+void
+xmms_lru_insert (xmms_lru_t *lru, gpointer key, gpointer value)
+{
+	xmms_lru_node_t *node;
+
+	g_return_if_fail (lru);
+
+	g_hash_table_remove (lru->nodes, key);
+
+	node = g_new0 (xmms_lru_node_t, 1);
+	node->lru = lru;
+	node->key = key;
+	node->value = value;
+	node->link.data = node;
+
+	g_hash_table_insert (lru->nodes, node->key, node);
+	g_queue_push_head_link (&lru->order, &node->link);
+
+	xmms_lru_trim (lru);
+}
+
+void
+xmms_lru_remove (xmms_lru_t *lru, gconstpointer key)
+{
+	g_return_if_fail (lru);
+
+	g_hash_table_remove (lru->nodes, key);
+}
+
+/**
+ * Remove the value stored under key without freeing it.
+ *
+ * @returns The value, now owned by the caller, or NULL.
+ */
+gpointer
+xmms_lru_steal (xmms_lru_t *lru, gconstpointer key)
+{
+	xmms_lru_node_t *node;
+	gpointer value;
+
+	g_return_val_if_fail (lru, NULL);
+
+	node = g_hash_table_lookup (lru->nodes, key);
+	if (!node) {
+		return NULL;
+	}
+
+	value = node->value;
+	node->value = NULL;
+	g_hash_table_remove (lru->nodes, key);
+
+	return value;
+}
+
+typedef struct {
+	GHRFunc func;
+	gpointer user_data;
+} xmms_lru_foreach_data_t;
+
+static gboolean
+xmms_lru_foreach_remove_node (gpointer key, gpointer value, gpointer udata)
+{
+	xmms_lru_foreach_data_t *data = udata;
+	xmms_lru_node_t *node = value;
+
+	return data->func (node->key, node->value, data->user_data);
+}
+
+/**
+ * Remove the entries func returns TRUE for, it is called with the key,
+ * the value and user_data.
+ *
+ * @returns The number of entries removed.
+ */
+guint
+xmms_lru_foreach_remove (xmms_lru_t *lru, GHRFunc func, gpointer user_data)
+{
+	xmms_lru_foreach_data_t data = { func, user_data };
+
+	g_return_val_if_fail (lru, 0);
+	g_return_val_if_fail (func, 0);
+
+	return g_hash_table_foreach_remove (lru->nodes,
+	                                    xmms_lru_foreach_remove_node, &data);
+}
+
+void
+xmms_lru_remove_all (xmms_lru_t *lru)
+{
+	g_return_if_fail (lru);
+
+	g_hash_table_remove_all (lru->nodes);
+}
+
+/** Count a lookup of the cache as a hit or a miss. */
+void
+xmms_lru_account (xmms_lru_t *lru, gboolean hit)
+{
+	g_return_if_fail (lru);
+
+	if (hit) {
+		lru->hits++;
+	} else {
+		lru->misses++;
+	}
+}
+
+void
+xmms_lru_stats (xmms_lru_t *lru, guint *hits, guint *misses, guint *entries)
+{
+	g_return_if_fail (lru);
+
+	*hits = lru->hits;
+	*misses = lru->misses;
+	*entries = g_hash_table_size (lru->nodes);
+}
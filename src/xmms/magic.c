@@ -22,9 +22,17 @@
 
 #include <xmms/xmms_log.h>
 #include <xmmspriv/xmms_xform.h>
+#include <xmmspriv/xmms_magic.h>
+
+/* Rules needing more than this are checked by peeking further, only
+ * when everything before them matched */
+#define XMMS_MAGIC_MAX_PREFIX 65536
 
 static GList *magic_list, *ext_list;
 
+/* bytes needed to check every rule in magic_list */
+static guint magic_prefix;
+
 #define SWAP16(v, endian) \
 	if (endian == G_LITTLE_ENDIAN) { \
 		v = GUINT16_TO_LE (v); \
@@ -90,12 +98,31 @@ typedef struct xmms_magic_entry_St {
 	} value;
 } xmms_magic_entry_t;
 
+/**
+ * A rule of a compiled set. The rules are stored in the order of a
+ * pre-order walk of the magic tree, so the children of a rule are the
+ * rules following it up to end, which is also where its next sibling
+ * is.
+ */
+typedef struct xmms_magic_rule_St {
+	xmms_magic_entry_t entry;
+	guint end;
+} xmms_magic_rule_t;
+
+typedef struct xmms_magic_set_St {
+	gchar *desc;
+	gchar *mime;
+	guint complexity;
+	guint n_rules;
+	xmms_magic_rule_t *rules;
+} xmms_magic_set_t;
+
 typedef struct xmms_magic_checker_St {
 	xmms_xform_t *xform;
 	gchar *buf;
 	guint alloc;
 	guint read;
-	guint offset;
+	gboolean eos;
 	gint dumpcount;
 } xmms_magic_checker_t;
 
@@ -107,7 +134,6 @@ typedef struct xmms_magic_ext_data_St {
 static void xmms_magic_tree_free (GNode *tree);
 
 static gchar *xmms_magic_match (xmms_magic_checker_t *c, const gchar *u);
-static guint xmms_magic_complexity (GNode *tree);
 
 static void
 xmms_magic_entry_free (xmms_magic_entry_t *e)
@@ -348,6 +374,10 @@ read_data (xmms_magic_checker_t *c, guint needed)
 {
 	xmms_error_t e;
 
+	if (!c->xform) {
+		return -1;
+	}
+
 	if (needed > c->alloc) {
 		c->alloc = needed;
 		c->buf = g_realloc (c->buf, c->alloc);
@@ -359,33 +389,38 @@ read_data (xmms_magic_checker_t *c, guint needed)
 }
 
 static gboolean
-node_match (xmms_magic_checker_t *c, GNode *node)
+entry_match (xmms_magic_checker_t *c, const xmms_magic_entry_t *entry)
 {
-	xmms_magic_entry_t *entry = node->data;
-	guint needed = c->offset + entry->offset + entry->len;
+	guint needed = entry->offset + entry->len;
 	guint8 i8;
 	guint16 i16;
 	guint32 i32;
 	gint tmp;
 	gchar *ptr;
 
-	/* do we have enough data ready for this check?
-	 * if not, read some more
+	/* the first peek normally covers all rules, more is only read
+	 * for rules beyond XMMS_MAGIC_MAX_PREFIX
 	 */
 	if (c->read < needed) {
+		if (c->eos) {
+			return FALSE;
+		}
+
 		tmp = read_data (c, needed);
 		if (tmp == -1) {
+			c->eos = TRUE;
 			return FALSE;
 		}
 
 		c->read = tmp;
 		if (c->read < needed) {
 			/* couldn't read enough data */
+			c->eos = TRUE;
 			return FALSE;
 		}
 	}
 
-	ptr = &c->buf[c->offset + entry->offset];
+	ptr = &c->buf[entry->offset];
 
 	switch (entry->type) {
 		case XMMS_MAGIC_ENTRY_TYPE_BYTE:
@@ -408,18 +443,22 @@ node_match (xmms_magic_checker_t *c, GNode *node)
 	}
 }
 
+/* Match the sibling rules from start to end: one of them and all of
+ * its children have to match. */
 static gboolean
-tree_match (xmms_magic_checker_t *c, GNode *tree)
+rules_match (xmms_magic_checker_t *c, const xmms_magic_rule_t *rules,
+             guint start, guint end)
 {
-	GNode *n;
+	guint i;
 
 	/* empty subtrees match anything */
-	if (!tree->children) {
+	if (start == end) {
 		return TRUE;
 	}
 
-	for (n = tree->children; n; n = n->next) {
-		if (node_match (c, n) && tree_match (c, n)) {
+	for (i = start; i < end; i = rules[i].end) {
+		if (entry_match (c, &rules[i].entry) &&
+		    rules_match (c, rules, i + 1, rules[i].end)) {
 			return TRUE;
 		}
 	}
@@ -427,6 +466,23 @@ tree_match (xmms_magic_checker_t *c, GNode *tree)
 	return FALSE;
 }
 
+static const xmms_magic_set_t *
+xmms_magic_match_sets (xmms_magic_checker_t *c)
+{
+	const GList *l;
+
+	/* only one of the contained sets has to match */
+	for (l = magic_list; l; l = g_list_next (l)) {
+		const xmms_magic_set_t *set = l->data;
+
+		if (rules_match (c, set->rules, 0, set->n_rules)) {
+			return set;
+		}
+	}
+
+	return NULL;
+}
+
 static gchar *
 xmms_magic_match (xmms_magic_checker_t *c, const gchar *uri)
 {
@@ -434,18 +490,14 @@ xmms_magic_match (xmms_magic_checker_t *c, const gchar *uri)
 	gchar *u, *dump;
 	int i;
 
-	g_return_val_if_fail (c, NULL);
+	const xmms_magic_set_t *set;
 
-	/* only one of the contained sets has to match */
-	for (l = magic_list; l; l = g_list_next (l)) {
-		GNode *tree = l->data;
+	g_return_val_if_fail (c, NULL);
 
-		if (tree_match (c, tree)) {
-			gpointer *data = tree->data;
-			XMMS_DBG ("magic plugin detected '%s' (%s)",
-			          (char *)data[1], (char *)data[0]);
-			return (char *) (data[1]);
-		}
+	set = xmms_magic_match_sets (c);
+	if (set) {
+		XMMS_DBG ("magic plugin detected '%s' (%s)", set->mime, set->desc);
+		return set->mime;
 	}
 
 	if (!uri)
@@ -479,19 +531,86 @@ xmms_magic_match (xmms_magic_checker_t *c, const gchar *uri)
 	return NULL;
 }
 
-static guint
-xmms_magic_complexity (GNode *tree)
+/**
+ * Get the mimetype of data from the magic rules alone.
+ */
+const gchar *
+xmms_magic_match_data (const guchar *data, guint len)
+{
+	xmms_magic_checker_t c;
+	const xmms_magic_set_t *set;
+
+	memset (&c, 0, sizeof (c));
+	c.buf = (gchar *) data;
+	c.read = len;
+	c.eos = TRUE;
+
+	set = xmms_magic_match_sets (&c);
+
+	return set ? set->mime : NULL;
+}
+
+/**
+ * The number of bytes from the start of a stream needed to check
+ * every magic rule.
+ */
+guint
+xmms_magic_prefix_size (void)
 {
-	return g_node_n_nodes (tree, G_TRAVERSE_ALL);
+	return magic_prefix;
+}
+
+static void
+xmms_magic_compile_node (GNode *node, GArray *rules)
+{
+	GNode *n;
+
+	for (n = node->children; n; n = n->next) {
+		xmms_magic_rule_t rule = { *(xmms_magic_entry_t *) n->data, 0 };
+		guint i = rules->len;
+
+		g_array_append_val (rules, rule);
+		xmms_magic_compile_node (n, rules);
+		g_array_index (rules, xmms_magic_rule_t, i).end = rules->len;
+	}
+}
+
+/* Flatten a parsed tree, taking over the description and mimetype. */
+static xmms_magic_set_t *
+xmms_magic_compile (GNode *tree)
+{
+	xmms_magic_set_t *set;
+	gpointer *data = tree->data;
+	GArray *rules;
+	guint i;
+
+	rules = g_array_new (FALSE, FALSE, sizeof (xmms_magic_rule_t));
+	xmms_magic_compile_node (tree, rules);
+
+	set = g_new0 (xmms_magic_set_t, 1);
+	set->desc = data[0];
+	set->mime = data[1];
+	set->complexity = g_node_n_nodes (tree, G_TRAVERSE_ALL);
+	set->n_rules = rules->len;
+	set->rules = (xmms_magic_rule_t *) g_array_free (rules, FALSE);
+
+	data[0] = data[1] = NULL;
+
+	for (i = 0; i < set->n_rules; i++) {
+		xmms_magic_entry_t *entry = &set->rules[i].entry;
+		magic_prefix = MAX (magic_prefix, entry->offset + entry->len);
+	}
+
+	return set;
 }
 
 static gint
-cb_sort_magic_list (GNode *a, GNode *b)
+cb_sort_magic_list (const xmms_magic_set_t *a, const xmms_magic_set_t *b)
 {
 	guint n1, n2;
 
-	n1 = xmms_magic_complexity (a);
-	n2 = xmms_magic_complexity (b);
+	n1 = a->complexity;
+	n2 = b->complexity;
 
 	if (n1 > n2) {
 		return -1;
@@ -503,14 +622,20 @@ cb_sort_magic_list (GNode *a, GNode *b)
 }
 
 
-gboolean
-xmms_magic_extension_add (const gchar *mime, const gchar *ext)
+/**
+ * While set, every magic and extension added is also appended to
+ * this list, so a plugin manifest can add them again without loading
+ * the plugin.
+ */
+static xmmsv_t *magic_capture;
+/** Adds are dropped, for plugins whose magic came from a manifest */
+static gboolean magic_muted;
+
+static gboolean
+xmms_magic_extension_add_real (const gchar *mime, const gchar *ext)
 {
 	xmms_magic_ext_data_t *e;
 
-	g_return_val_if_fail (mime, FALSE);
-	g_return_val_if_fail (ext, FALSE);
-
 	e = g_new0 (xmms_magic_ext_data_t, 1);
 	e->pattern = g_strdup (ext);
 	e->type = g_strdup (mime);
@@ -521,23 +646,38 @@ xmms_magic_extension_add (const gchar *mime, const gchar *ext)
 }
 
 gboolean
-xmms_magic_add (const gchar *desc, const gchar *mime, ...)
+xmms_magic_extension_add (const gchar *mime, const gchar *ext)
+{
+	g_return_val_if_fail (mime, FALSE);
+	g_return_val_if_fail (ext, FALSE);
+
+	if (magic_capture) {
+		xmmsv_t *record = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("extension"),
+		                                    XMMSV_LIST_ENTRY_STR (mime),
+		                                    XMMSV_LIST_ENTRY_STR (ext),
+		                                    XMMSV_LIST_END);
+		xmmsv_list_append (magic_capture, record);
+		xmmsv_unref (record);
+	}
+
+	if (magic_muted) {
+		return TRUE;
+	}
+
+	return xmms_magic_extension_add_real (mime, ext);
+}
+
+static gboolean
+xmms_magic_add_real (const gchar *desc, const gchar *mime,
+                     const gchar **specs)
 {
 	GNode *tree, *node = NULL;
-	va_list ap;
 	gchar *s;
 	gpointer *root_props;
 	gboolean ret = TRUE;
+	gint i;
 
-	g_return_val_if_fail (desc, FALSE);
-	g_return_val_if_fail (mime, FALSE);
-
-	/* now process the magic specs in the argument list */
-	va_start (ap, mime);
-
-	s = va_arg (ap, gchar *);
-	if (!s) { /* no magic specs passed -> failure */
-		va_end (ap);
+	if (!specs[0]) { /* no magic specs passed -> failure */
 		return FALSE;
 	}
 
@@ -547,14 +687,14 @@ xmms_magic_add (const gchar *desc, const gchar *mime, ...)
 	root_props[1] = g_strdup (mime);
 	tree = g_node_new (root_props);
 
-	do {
-		if (!*s) {
+	for (i = 0; specs[i]; i++) {
+		if (!*specs[i]) {
 			ret = FALSE;
-			xmms_log_error ("invalid magic spec: '%s'", s);
+			xmms_log_error ("invalid magic spec: '%s'", specs[i]);
 			break;
 		}
 
-		s = g_strdup (s); /* we need our own copy */
+		s = g_strdup (specs[i]); /* we need our own copy */
 		node = xmms_magic_add_node (tree, s, node);
 
 		if (!node) {
@@ -565,22 +705,118 @@ xmms_magic_add (const gchar *desc, const gchar *mime, ...)
 			break;
 		}
 		g_free (s);
-	} while ((s = va_arg (ap, gchar *)));
-
-	va_end (ap);
+	}
 
 	/* only add this tree to the list if all spec chunks are valid */
 	if (ret) {
 		magic_list =
-			g_list_insert_sorted (magic_list, tree,
+			g_list_insert_sorted (magic_list, xmms_magic_compile (tree),
 			                      (GCompareFunc) cb_sort_magic_list);
+	}
+
+	xmms_magic_tree_free (tree);
+
+	return ret;
+}
+
+gboolean
+xmms_magic_add (const gchar *desc, const gchar *mime, ...)
+{
+	GPtrArray *specs;
+	va_list ap;
+	gchar *s;
+	gboolean ret;
+	guint i;
+
+	g_return_val_if_fail (desc, FALSE);
+	g_return_val_if_fail (mime, FALSE);
+
+	/* now process the magic specs in the argument list */
+	specs = g_ptr_array_new ();
+	va_start (ap, mime);
+	while ((s = va_arg (ap, gchar *))) {
+		g_ptr_array_add (specs, s);
+	}
+	va_end (ap);
+	g_ptr_array_add (specs, NULL);
+
+	if (magic_capture) {
+		xmmsv_t *record = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("magic"),
+		                                    XMMSV_LIST_ENTRY_STR (desc),
+		                                    XMMSV_LIST_ENTRY_STR (mime),
+		                                    XMMSV_LIST_END);
+		for (i = 0; i + 1 < specs->len; i++) {
+			xmmsv_list_append_string (record, g_ptr_array_index (specs, i));
+		}
+		xmmsv_list_append (magic_capture, record);
+		xmmsv_unref (record);
+	}
+
+	if (magic_muted) {
+		ret = TRUE;
 	} else {
-		xmms_magic_tree_free (tree);
+		ret = xmms_magic_add_real (desc, mime, (const gchar **) specs->pdata);
 	}
 
+	g_ptr_array_free (specs, TRUE);
+
 	return ret;
 }
 
+/**
+ * Append the magic and extensions added from now on to list, or stop
+ * if it is NULL.
+ */
+void
+xmms_magic_capture (xmmsv_t *list)
+{
+	magic_capture = list;
+}
+
+/**
+ * Drop the magic and extensions added from now on, or stop.
+ */
+void
+xmms_magic_mute (gboolean mute)
+{
+	magic_muted = mute;
+}
+
+/**
+ * Add the magic and extensions in a list #xmms_magic_capture filled.
+ */
+void
+xmms_magic_replay (xmmsv_t *list)
+{
+	xmmsv_list_iter_t *it;
+	const gchar *kind, *a, *b, **specs;
+	xmmsv_t *record;
+	gint i, n;
+
+	xmmsv_get_list_iter (list, &it);
+	for (; xmmsv_list_iter_entry (it, &record); xmmsv_list_iter_next (it)) {
+		n = xmmsv_list_get_size (record);
+		if (n < 3 ||
+		    !xmmsv_list_get_string (record, 0, &kind) ||
+		    !xmmsv_list_get_string (record, 1, &a) ||
+		    !xmmsv_list_get_string (record, 2, &b)) {
+			continue;
+		}
+
+		if (strcmp (kind, "extension") == 0) {
+			xmms_magic_extension_add_real (a, b);
+			continue;
+		}
+
+		specs = g_new0 (const gchar *, n - 2);
+		for (i = 3; i < n; i++) {
+			xmmsv_list_get_string (record, i, &specs[i - 3]);
+		}
+		xmms_magic_add_real (a, b, specs);
+		g_free (specs);
+	}
+}
+
 static gboolean
 xmms_magic_plugin_init (xmms_xform_t *xform)
 {
@@ -590,10 +826,16 @@ xmms_magic_plugin_init (xmms_xform_t *xform)
 	xmms_config_property_t *cv;
 
 	c.xform = xform;
-	c.read = c.offset = 0;
-	c.alloc = 128; /* start with a 128 bytes buffer */
+	c.read = 0;
+	c.eos = FALSE;
+
+	/* peek once for all of the rules */
+	c.alloc = CLAMP (magic_prefix, 128, XMMS_MAGIC_MAX_PREFIX);
 	c.buf = g_malloc (c.alloc);
 
+	c.read = MAX (read_data (&c, c.alloc), 0);
+	c.eos = c.read < c.alloc;
+
 	cv = xmms_xform_config_lookup (xform, "dumpcount");
 	c.dumpcount = xmms_config_property_get_int (cv);
 
@@ -39,18 +39,27 @@
 #include <xmmspriv/xmms_symlink.h>
 #include <xmmspriv/xmms_checkroot.h>
 #include <xmmspriv/xmms_thread_name.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_sandbox.h>
+#include <xmmspriv/xmms_restart.h>
+#include <xmmspriv/xmms_trace.h>
+#include <xmmspriv/xmms_memstat.h>
+#include <xmmspriv/xmms_footprint.h>
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_mediainfo.h>
 #include <xmmspriv/xmms_output.h>
 #include <xmmspriv/xmms_ipc.h>
 #include <xmmspriv/xmms_log.h>
 #include <xmmspriv/xmms_xform_object.h>
+#include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_bindata.h>
 #include <xmmspriv/xmms_utils.h>
 #include <xmmspriv/xmms_visualization.h>
+#include <xmmspriv/xmms_diskcache.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <string.h>
 #include <unistd.h>
 #include <signal.h>
@@ -61,9 +70,13 @@
  * Forward declarations of the methods in the main object
  */
 static void xmms_main_client_quit (xmms_object_t *object, xmms_error_t *error);
+static void xmms_main_client_restart (xmms_object_t *object, xmms_error_t *error);
 static xmmsv_t *xmms_main_client_stats (xmms_object_t *object, xmms_error_t *error);
+static gchar *xmms_main_client_trace_dump (xmms_object_t *object, xmms_error_t *error);
+static xmmsv_t *xmms_main_client_memory_stats (xmms_object_t *object, xmms_error_t *error);
 static xmmsv_t *xmms_main_client_list_plugins (xmms_object_t *main, gint32 type, xmms_error_t *err);
 static gint64 xmms_main_client_hello (xmms_object_t *object, gint protocolver, const gchar *client, gint64 id, xmms_error_t *error);
+static void xmms_main_client_shm_attach (xmms_object_t *object, gint shmid, gint size, gint64 id, xmms_error_t *error);
 static void install_scripts (const gchar *into_dir);
 static void spawn_script_setup (gpointer data);
 
@@ -110,6 +123,17 @@ static GMainLoop *mainloop;
 /** The path of the configfile */
 static gchar *conffile = NULL;
 
+/** The arguments the daemon was started with, to restart it with */
+static gchar **restart_argv = NULL;
+
+/** How long each phase of startup took, in microseconds */
+static struct {
+	gint64 config;
+	gint64 plugins;
+	gint64 medialib;
+	gint64 collections;
+} startup_us;
+
 static void
 query_total_size_duration (xmms_main_t *mainobj, xmms_error_t *error,
                                       int64_t *size, int64_t *duration)
@@ -217,17 +241,71 @@ xmms_main_client_stats (xmms_object_t *object, xmms_error_t *error)
 	xmms_main_t *mainobj = (xmms_main_t *) object;
 	gint uptime = time (NULL) - mainobj->starttime;
 	int64_t size, duration, playtime;
+	guint hits, misses, entries, filler_block;
+	guint plan_hits, plan_misses, plan_entries;
+	guint buffer_size, buffer_fill, buffer_fill_min, buffer_fill_avg, underruns;
+	guint disk_hits, disk_misses, disk_entries;
+	gint64 disk_bytes;
+	guint plugins_loaded, plugins_deferred;
+	guint ro_conflicts, rw_conflicts;
+	gint64 warmup_done, warmup_size;
 
 	size = duration = playtime = 0;
 
 	query_total_playtime (mainobj, error, &playtime);
 	query_total_size_duration (mainobj, error, &size, &duration);
 
+	xmms_collection_query_cache_stats (mainobj->colldag_object,
+	                                   &hits, &misses, &entries);
+
+	xmms_plan_cache_stats (xmms_medialib_get_plan_cache (mainobj->medialib_object),
+	                       &plan_hits, &plan_misses, &plan_entries);
+
+	xmms_medialib_conflict_stats (mainobj->medialib_object,
+	                              &ro_conflicts, &rw_conflicts);
+	xmms_medialib_warmup_stats (mainobj->medialib_object,
+	                            &warmup_done, &warmup_size);
+
+	filler_block = xmms_output_filler_block_get (mainobj->output_object);
+	xmms_output_buffer_stats_get (mainobj->output_object, &buffer_size,
+	                              &buffer_fill, &buffer_fill_min,
+	                              &buffer_fill_avg);
+	underruns = xmms_output_underruns_get (mainobj->output_object);
+
+	xmms_diskcache_stats (&disk_hits, &disk_misses, &disk_entries,
+	                      &disk_bytes);
+
 	return xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("version", XMMS_VERSION),
 	                         XMMSV_DICT_ENTRY_INT ("uptime", uptime),
 	                         XMMSV_DICT_ENTRY_INT ("size", size),
 	                         XMMSV_DICT_ENTRY_INT ("duration", duration),
 	                         XMMSV_DICT_ENTRY_INT ("playtime", playtime),
+	                         XMMSV_DICT_ENTRY_INT ("query_cache_hits", hits),
+	                         XMMSV_DICT_ENTRY_INT ("query_cache_misses", misses),
+	                         XMMSV_DICT_ENTRY_INT ("query_cache_entries", entries),
+	                         XMMSV_DICT_ENTRY_INT ("plan_cache_hits", plan_hits),
+	                         XMMSV_DICT_ENTRY_INT ("plan_cache_misses", plan_misses),
+	                         XMMSV_DICT_ENTRY_INT ("plan_cache_entries", plan_entries),
+	                         XMMSV_DICT_ENTRY_INT ("medialib_ro_retries", ro_conflicts),
+	                         XMMSV_DICT_ENTRY_INT ("medialib_rw_retries", rw_conflicts),
+	                         XMMSV_DICT_ENTRY_INT ("medialib_warmup_done", warmup_done),
+	                         XMMSV_DICT_ENTRY_INT ("medialib_warmup_size", warmup_size),
+	                         XMMSV_DICT_ENTRY_INT ("output_filler_block", filler_block),
+	                         XMMSV_DICT_ENTRY_INT ("output_buffer_size", buffer_size),
+	                         XMMSV_DICT_ENTRY_INT ("output_buffer_fill", buffer_fill),
+	                         XMMSV_DICT_ENTRY_INT ("output_buffer_fill_min", buffer_fill_min),
+	                         XMMSV_DICT_ENTRY_INT ("output_buffer_fill_avg", buffer_fill_avg),
+	                         XMMSV_DICT_ENTRY_INT ("output_underruns", underruns),
+	                         XMMSV_DICT_ENTRY_INT ("disk_cache_hits", disk_hits),
+	                         XMMSV_DICT_ENTRY_INT ("disk_cache_misses", disk_misses),
+	                         XMMSV_DICT_ENTRY_INT ("disk_cache_entries", disk_entries),
+	                         XMMSV_DICT_ENTRY_INT ("disk_cache_size", disk_bytes),
+	                         XMMSV_DICT_ENTRY_INT ("startup_config_us", startup_us.config),
+	                         XMMSV_DICT_ENTRY_INT ("startup_plugins_us", startup_us.plugins),
+	                         XMMSV_DICT_ENTRY_INT ("startup_medialib_us", startup_us.medialib),
+	                         XMMSV_DICT_ENTRY_INT ("startup_collections_us", startup_us.collections),
+	                         XMMSV_DICT_ENTRY_INT ("plugins_loaded", plugins_loaded),
+	                         XMMSV_DICT_ENTRY_INT ("plugins_deferred", plugins_deferred),
 	                         XMMSV_DICT_END);
 }
 
@@ -256,6 +334,8 @@ static xmmsv_t *
 xmms_main_client_list_plugins (xmms_object_t *main, gint32 type, xmms_error_t *err)
 {
 	xmmsv_t *list = xmmsv_new_list ();
+	/* a client listing them wants the ones left for later too */
+	xmms_plugin_load_deferred (NULL, NULL);
 	xmms_plugin_foreach (type, xmms_main_client_list_foreach, list);
 	return list;
 }
@@ -406,25 +486,82 @@ xmms_main_destroy (xmms_object_t *object)
 
 	xmms_ipc_shutdown ();
 
+	xmms_trace_shutdown ();
+
 	xmms_log_shutdown ();
 }
 
+/**
+ * @internal The spans traced while core.trace was set, as a Chrome
+ * trace / Perfetto JSON document.
+ */
+static gchar *
+xmms_main_client_trace_dump (xmms_object_t *object, xmms_error_t *error)
+{
+	return xmms_trace_dump ();
+}
+
+/**
+ * @internal The accounted memory, with the estimates of what is
+ * measured by walking it rather than counted, and the limits of the
+ * small footprint mode.
+ */
+static xmmsv_t *
+xmms_main_client_memory_stats (xmms_object_t *object, xmms_error_t *error)
+{
+	xmms_main_t *mainobj = (xmms_main_t *) object;
+	xmmsv_t *ret, *size;
+
+	ret = xmms_memstat_get ();
+
+	size = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("current",
+	                                               xmms_collection_memory_size (mainobj->colldag_object)),
+	                         XMMSV_DICT_END);
+	xmmsv_dict_set (ret, "collections", size);
+	xmmsv_unref (size);
+
+	size = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("current",
+	                                               xmms_bindata_memory_size (mainobj->bindata_object)),
+	                         XMMSV_DICT_END);
+	xmmsv_dict_set (ret, "bindata", size);
+	xmmsv_unref (size);
+
+	size = xmms_footprint_get ();
+	xmmsv_dict_set (ret, "limits", size);
+	xmmsv_unref (size);
+
+	return ret;
+}
+
 /**
  * @internal Function to respond to the 'hello' sent from clients on connect
  */
 static gint64
 xmms_main_client_hello (xmms_object_t *object, gint protocolver, const gchar *client, gint64 id, xmms_error_t *error)
 {
-	if (protocolver != XMMS_IPC_PROTOCOL_VERSION) {
+	/* the version before only lacks the compact encoding */
+	if (protocolver != XMMS_IPC_PROTOCOL_VERSION &&
+	    protocolver != XMMS_IPC_PROTOCOL_VERSION_COMPACT - 1) {
 		xmms_log_info ("Client '%s' with bad protocol version (%d, not %d) connected", client, protocolver, XMMS_IPC_PROTOCOL_VERSION);
 		xmms_error_set (error, XMMS_ERROR_INVAL, "Bad protocol version");
 	} else {
 		XMMS_DBG ("Client '%s' connected", client);
+		xmms_ipc_client_protocol_set (id, protocolver);
 	}
 
 	return id;
 }
 
+/**
+ * @internal Function to respond to the 'shm_attach' sent from local
+ * clients that want large messages through shared memory
+ */
+static void
+xmms_main_client_shm_attach (xmms_object_t *object, gint shmid, gint size, gint64 id, xmms_error_t *error)
+{
+	xmms_ipc_client_shm_attach (id, shmid, size, error);
+}
+
 static gboolean
 kill_server (gpointer object) {
 	xmms_main_t *mainobj = (xmms_main_t *) object;
@@ -454,6 +591,68 @@ xmms_main_client_quit (xmms_object_t *object, xmms_error_t *error)
 	g_timeout_add (1, kill_server, object);
 }
 
+/**
+ * @internal Shut down like quit, then run the daemon again with the
+ * same arguments, handing it the listening sockets and where playback
+ * is. No quit broadcast, the daemon is back in a moment.
+ */
+static gboolean
+restart_server (gpointer object)
+{
+	xmms_main_t *mainobj = (xmms_main_t *) object;
+	GPtrArray *args;
+	GArray *keep;
+	gchar **sockets;
+	guint ms;
+	gint i, status;
+
+	xmms_output_resume_point_get (mainobj->output_object, &status, &ms);
+
+	keep = g_array_new (FALSE, FALSE, sizeof (gint));
+	sockets = xmms_ipc_handoff (keep);
+
+	args = g_ptr_array_new ();
+	for (i = 0; restart_argv[i]; i++) {
+		/* those of the restart before this one */
+		if (g_str_has_prefix (restart_argv[i], "--inherit-ipc=") ||
+		    g_str_has_prefix (restart_argv[i], "--resume=")) {
+			continue;
+		}
+		g_ptr_array_add (args, g_strdup (restart_argv[i]));
+	}
+	for (i = 0; sockets[i]; i++) {
+		g_ptr_array_add (args, g_strdup_printf ("--inherit-ipc=%s", sockets[i]));
+	}
+	g_ptr_array_add (args, g_strdup_printf ("--resume=%d:%u", status, ms));
+	g_ptr_array_add (args, NULL);
+	g_strfreev (sockets);
+
+	xmms_log_info ("Restarting");
+
+	xmms_object_unref (object);
+
+	xmms_restart_exec ((gchar **) args->pdata, (gint *) keep->data, keep->len);
+
+	g_printerr ("Couldn't restart %s: %s\n", restart_argv[0], g_strerror (errno));
+	exit (EXIT_FAILURE);
+}
+
+/**
+ * @internal Function to respond to the 'restart' command sent from a
+ * client, replies before restarting just like quit.
+ */
+static void
+xmms_main_client_restart (xmms_object_t *object, xmms_error_t *error)
+{
+	if (!xmms_restart_supported ()) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "restarting in place isn't supported here");
+		return;
+	}
+
+	g_timeout_add (1, restart_server, object);
+}
+
 static void
 install_scripts (const gchar *into_dir)
 {
@@ -514,6 +713,114 @@ print_version (void)
 	exit (EXIT_SUCCESS);
 }
 
+/**
+ * @internal Set up the chain for url with the configured effects and
+ * read it as fast as it goes, then tell how long each part took.
+ */
+static gint
+benchmark_chain (const gchar *url)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	xmms_medialib_t *medialib;
+	xmms_xform_t *xform;
+	xmmsv_list_iter_t *it;
+	xmms_error_t err;
+	xmmsv_t *stats, *dict;
+	GList *goal_formats;
+	gchar buffer[4096], *path = NULL;
+	gint64 start, elapsed, bytes = 0;
+	gdouble played;
+	gint ret;
+
+	xmms_error_reset (&err);
+
+	if (!strstr (url, "://")) {
+		gchar *cwd, *abs, *tmp;
+
+		cwd = g_get_current_dir ();
+		abs = g_path_is_absolute (url) ? g_strdup (url)
+		      : g_build_filename (cwd, url, NULL);
+		tmp = g_strconcat ("file://", abs, NULL);
+		path = xmms_medialib_url_encode (tmp);
+		g_free (tmp);
+		g_free (abs);
+		g_free (cwd);
+		url = path;
+	}
+
+	medialib = xmms_medialib_init ();
+
+	session = xmms_medialib_session_begin (medialib);
+	entry = xmms_medialib_entry_new (session, url, &err);
+	xmms_medialib_session_commit (session);
+	if (!entry) {
+		g_printerr ("Couldn't add %s: %s\n", url, xmms_error_message_get (&err));
+		return EXIT_FAILURE;
+	}
+
+	/* what an output would get by default */
+	goal_formats = g_list_prepend (NULL,
+	                               _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                                                      XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                                                      XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                                                      XMMS_STREAM_TYPE_FMT_CHANNELS, 2,
+	                                                      XMMS_STREAM_TYPE_FMT_SAMPLERATE, 44100,
+	                                                      XMMS_STREAM_TYPE_END));
+
+	xform = xmms_xform_chain_setup (medialib, entry, goal_formats, FALSE);
+	if (!xform) {
+		g_printerr ("Couldn't set up a chain for %s\n", url);
+		return EXIT_FAILURE;
+	}
+
+	/* the way the output filler reads it */
+	start = g_get_monotonic_time ();
+	while ((ret = xmms_xform_this_read (xform, buffer, sizeof (buffer), &err)) > 0) {
+		bytes += ret;
+	}
+	elapsed = MAX (g_get_monotonic_time () - start, 1);
+
+	if (ret < 0) {
+		g_printerr ("Reading %s failed: %s\n", url, xmms_error_message_get (&err));
+	}
+
+	played = xmms_sample_bytes_to_ms (xmms_xform_outtype_get (xform), bytes) / 1000.0;
+
+	g_print ("%s\n", url);
+	g_print ("%.1fs of audio in %.3fs, %.1fx real time\n", played,
+	         elapsed / (gdouble) G_USEC_PER_SEC,
+	         played * G_USEC_PER_SEC / elapsed);
+	g_print ("%-20s %12s %12s %10s %14s %14s\n", "xform", "time (ms)",
+	         "max (ms)", "reads", "bytes out", "bytes copied");
+
+	stats = xmms_xform_chain_stats (xform);
+	xmmsv_get_list_iter (stats, &it);
+	while (xmmsv_list_iter_entry (it, &dict)) {
+		const gchar *name;
+		gint64 time, max, calls, out, copied;
+
+		xmmsv_dict_entry_get_string (dict, "name", &name);
+		xmmsv_dict_entry_get_int64 (dict, "time", &time);
+		xmmsv_dict_entry_get_int64 (dict, "max", &max);
+		xmmsv_dict_entry_get_int64 (dict, "calls", &calls);
+		xmmsv_dict_entry_get_int64 (dict, "bytes", &out);
+		xmmsv_dict_entry_get_int64 (dict, "copied", &copied);
+
+		g_print ("%-20s %12.3f %12.3f %10" G_GINT64_FORMAT " %14" G_GINT64_FORMAT
+		         " %14" G_GINT64_FORMAT "\n", name, time / 1000.0, max / 1000.0,
+		         calls, out, copied);
+
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_unref (stats);
+
+	xmms_object_unref (xform);
+	g_free (path);
+
+	return ret < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
 /**
  * The xmms2 daemon main initialisation function
  */
@@ -532,10 +839,15 @@ main (int argc, char **argv)
 	gboolean showhelp = FALSE;
 	const gchar *outname = NULL;
 	const gchar *ipcpath = NULL;
+	const gchar *benchmark = NULL;
+	const gchar *decoder_host = NULL;
+	const gchar *resume = NULL;
+	gchar **inherit_ipc = NULL;
 	gchar *uuid, *ppath = NULL;
 	int status_fd = -1;
 	GOptionContext *context = NULL;
 	GError *error = NULL;
+	gint64 phase;
 
 	setlocale (LC_ALL, "");
 
@@ -551,6 +863,10 @@ main (int argc, char **argv)
 		{"plugindir", 'p', 0, G_OPTION_ARG_FILENAME, &ppath, "Search for plugins in directory 'foo'", "<foo>"},
 		{"conf", 'c', 0, G_OPTION_ARG_FILENAME, &conffile, "Specify alternate configuration file", "<file>"},
 		{"status-fd", 's', 0, G_OPTION_ARG_INT, &status_fd, "Specify a filedescriptor to write to when started", "fd"},
+		{"benchmark-chain", 0, 0, G_OPTION_ARG_STRING, &benchmark, "Decode 'url' with the configured effects as fast as possible and exit", "<url>"},
+		{"decoder-host", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_FILENAME, &decoder_host, "Decode for a daemon into the ring buffer 'path'", "<path>"},
+		{"inherit-ipc", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING_ARRAY, &inherit_ipc, "Accept on the socket 'fd' listening to 'url' of the daemon restarted", "<fd:url>"},
+		{"resume", 0, G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_STRING, &resume, "Continue the playback of the daemon restarted", "<status:ms>"},
 		{"yes-run-as-root", 0, 0, G_OPTION_ARG_NONE, &runasroot, "Give me enough rope to shoot myself in the foot", NULL},
 		{"show-help", 'h', G_OPTION_FLAG_HIDDEN, G_OPTION_ARG_NONE, &showhelp, "Use --help or -? instead", NULL},
 		{NULL}
@@ -569,6 +885,9 @@ main (int argc, char **argv)
 
 	xmms_signal_block ();
 
+	/* before the options are parsed out of it */
+	restart_argv = g_strdupv (argv);
+
 	context = g_option_context_new ("- XMMS2 Daemon");
 	g_option_context_add_main_entries (context, opts, NULL);
 	if (!g_option_context_parse (context, &argc, &argv, &error) || error) {
@@ -618,7 +937,12 @@ main (int argc, char **argv)
 	xmms_log_init (loglevel);
 	xmms_ipc_init ();
 
+	phase = g_get_monotonic_time ();
 	load_config ();
+	startup_us.config = g_get_monotonic_time () - phase;
+	xmms_trace_init ();
+	xmms_thread_role_init ();
+	xmms_footprint_init ();
 
 	cv = xmms_config_property_register ("core.logtsfmt",
 	                                    "%H:%M:%S ",
@@ -626,6 +950,37 @@ main (int argc, char **argv)
 
 	xmms_log_set_format (xmms_config_property_get_string (cv));
 
+	if (benchmark) {
+		/* the configured effects, but neither the config file nor the
+		   medialib of a daemon that may be running are touched */
+		xmms_config_detach ();
+		cv = xmms_config_property_register ("medialib.path", "memory://",
+		                                    NULL, NULL);
+		xmms_config_property_set_data (cv, "memory://");
+
+		if (!xmms_plugin_init (ppath)) {
+			exit (EXIT_FAILURE);
+		}
+
+		exit (benchmark_chain (benchmark));
+	}
+
+	if (decoder_host) {
+		/* like the benchmark, but for a chain the daemon sets up */
+		xmms_config_detach ();
+		cv = xmms_config_property_register ("medialib.path", "memory://",
+		                                    NULL, NULL);
+		xmms_config_property_set_data (cv, "memory://");
+
+		if (!xmms_plugin_init (ppath)) {
+			exit (EXIT_FAILURE);
+		}
+
+		exit (xmms_sandbox_host_run (decoder_host));
+	}
+
+	xmms_sandbox_init (argv[0], conffile, ppath);
+
 	xmms_fallback_ipcpath_get (default_path, sizeof (default_path));
 
 	cv = xmms_config_property_register ("core.ipcsocket",
@@ -641,27 +996,42 @@ main (int argc, char **argv)
 		ipcpath = xmms_config_property_get_string (cv);
 	}
 
+	/* clients connecting while starting wait in their backlog */
+	if (inherit_ipc) {
+		xmms_ipc_inherit (inherit_ipc);
+		g_strfreev (inherit_ipc);
+	}
+
 	if (!xmms_ipc_setup_server (ipcpath)) {
 		xmms_ipc_shutdown ();
 		xmms_log_fatal ("IPC failed to init!");
 	}
 
+	phase = g_get_monotonic_time ();
 	if (!xmms_plugin_init (ppath)) {
 		exit (EXIT_FAILURE);
 	}
+	startup_us.plugins = g_get_monotonic_time () - phase;
 
 	mainobj = xmms_object_new (xmms_main_t, xmms_main_destroy);
 
+	phase = g_get_monotonic_time ();
 	mainobj->medialib_object = xmms_medialib_init ();
+	startup_us.medialib = g_get_monotonic_time () - phase;
+
+	phase = g_get_monotonic_time ();
 	mainobj->colldag_object = xmms_collection_init (mainobj->medialib_object);
+	startup_us.collections = g_get_monotonic_time () - phase;
 	mainobj->mediainfo_object = xmms_mediainfo_reader_start (mainobj->medialib_object);
 	mainobj->playlist_object = xmms_playlist_init (mainobj->medialib_object,
 	                                               mainobj->colldag_object);
 
 	uuid = xmms_medialib_uuid (mainobj->medialib_object);
+	phase = g_get_monotonic_time ();
 	mainobj->collsync_object = xmms_coll_sync_init (uuid,
 	                                                mainobj->colldag_object,
 	                                                mainobj->playlist_object);
+	startup_us.collections += g_get_monotonic_time () - phase;
 	g_free (uuid);
 	mainobj->plsupdater_object = xmms_playlist_updater_init (mainobj->playlist_object);
 
@@ -706,6 +1076,23 @@ main (int argc, char **argv)
 	/* Save the time we started in order to count uptime */
 	mainobj->starttime = time (NULL);
 
+	xmms_log_info ("Started in %" G_GINT64_FORMAT " ms: config %" G_GINT64_FORMAT
+	               " ms, plugins %" G_GINT64_FORMAT " ms, medialib %" G_GINT64_FORMAT
+	               " ms, collections %" G_GINT64_FORMAT " ms",
+	               (startup_us.config + startup_us.plugins +
+	                startup_us.medialib + startup_us.collections) / 1000,
+	               startup_us.config / 1000, startup_us.plugins / 1000,
+	               startup_us.medialib / 1000, startup_us.collections / 1000);
+
+	if (resume) {
+		gint status;
+		guint ms;
+
+		if (sscanf (resume, "%d:%u", &status, &ms) == 2) {
+			xmms_output_resume (mainobj->output_object, status, ms);
+		}
+	}
+
 	/* Dirty hack to tell XMMS_PATH a valid path */
 	g_strlcpy (default_path, ipcpath, sizeof (default_path));
 
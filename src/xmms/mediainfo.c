@@ -18,7 +18,7 @@
 
 
 /** @file
- * This file controls the mediainfo reader thread.
+ * This file controls the mediainfo reader threads.
  *
  */
 
@@ -26,9 +26,11 @@
 
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_ipc.h>
+#include <xmms/xmms_config.h>
 #include <xmmspriv/xmms_mediainfo.h>
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_xform.h>
+#include <xmmspriv/xmms_thread_role.h>
 
 
 #include <glib.h>
@@ -40,23 +42,58 @@
   * When a item is added to the playlist the mediainfo reader will
   * start extracting the information from this entry and update it
   * if additional information is found.
+  *
+  * A configurable number of worker threads resolve entries in parallel,
+  * each worker claims a batch of unresolved entries and commits the
+  * results of the whole batch in one medialib session.
+  *
+  * Once resolved, entries are queued for the effects listed in the
+  * mediainfo.analysis config property, such as ofa for fingerprints
+  * and loudness for loudness and silence. One more thread decodes them
+  * for each of those in turn, only while the workers have nothing to
+  * resolve, so playback chains don't have to carry them.
   * @{
   */
 
+#define XMMS_MEDIAINFO_MAX_WORKERS 32
+#define XMMS_MEDIAINFO_MAX_BATCH 256
+
 struct xmms_mediainfo_reader_St {
 	xmms_object_t object;
 
-	GThread *thread;
+	GThread **threads;
+	guint num_threads;
+
 	GMutex mutex;
 	GCond cond;
 
 	gboolean running;
 
+	/** entries currently being resolved by some worker */
+	GHashTable *claimed;
+	/** workers not waiting for new entries */
+	guint active;
+	guint batch_size;
+	guint unindexed_countdown;
+	/** bumped on every wakeup, so workers don't sleep through one */
+	guint wakeups;
+	/** only collect metadata, don't set up decoders that aren't needed */
+	gboolean probe;
+
+	/** the effects resolved entries are decoded for, or NULL */
+	gchar **analysis;
+	GThread *analysis_thread;
+	/** resolved entries waiting to be analyzed, and the set of them */
+	GQueue analysis_queue;
+	GHashTable *analysis_queued;
+
 	xmms_medialib_t *medialib;
 };
 
 static void xmms_mediainfo_reader_stop (xmms_object_t *o);
 static gpointer xmms_mediainfo_reader_thread (gpointer data);
+static gpointer xmms_mediainfo_analysis_thread (gpointer data);
+static gchar **xmms_mediainfo_analysis_effects (const gchar *list);
 
 #include "mediainfo_ipc.c"
 
@@ -67,13 +104,27 @@ on_medialib_entry_added (xmms_object_t *object, xmmsv_t *val, gpointer udata)
 	xmms_mediainfo_reader_wakeup (mrt);
 }
 
+static guint
+config_get_clamped (const gchar *name, const gchar *def, guint max)
+{
+	xmms_config_property_t *cv;
+	gint value;
+
+	cv = xmms_config_property_register (name, def, NULL, NULL);
+	value = xmms_config_property_get_int (cv);
+
+	return CLAMP (value, 1, max);
+}
+
 /**
- * Start the mediainfo reader thread
+ * Start the mediainfo reader threads
  */
 xmms_mediainfo_reader_t *
 xmms_mediainfo_reader_start (xmms_medialib_t *medialib)
 {
 	xmms_mediainfo_reader_t *mrt;
+	xmms_config_property_t *cv;
+	guint i;
 
 	mrt = xmms_object_new (xmms_mediainfo_reader_t,
 	                       xmms_mediainfo_reader_stop);
@@ -83,11 +134,46 @@ xmms_mediainfo_reader_start (xmms_medialib_t *medialib)
 	g_mutex_init (&mrt->mutex);
 	g_cond_init (&mrt->cond);
 	mrt->running = TRUE;
+	mrt->claimed = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	mrt->num_threads = config_get_clamped ("mediainfo.workers", "1",
+	                                       XMMS_MEDIAINFO_MAX_WORKERS);
+	mrt->batch_size = config_get_clamped ("mediainfo.batch_size", "8",
+	                                      XMMS_MEDIAINFO_MAX_BATCH);
+
+	cv = xmms_config_property_register ("mediainfo.probe", "1", NULL, NULL);
+	mrt->probe = !!xmms_config_property_get_int (cv);
+
+	cv = xmms_config_property_register ("mediainfo.analysis", "ofa,loudness", NULL, NULL);
+	mrt->analysis = xmms_mediainfo_analysis_effects (xmms_config_property_get_string (cv));
+
+	g_queue_init (&mrt->analysis_queue);
+	mrt->analysis_queued = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	XMMS_DBG ("Starting %d mediainfo reader(s), batch size %d",
+	          mrt->num_threads, mrt->batch_size);
 
 	xmms_object_ref (medialib);
 	mrt->medialib = medialib;
-	mrt->thread = g_thread_new ("x2 media info", xmms_mediainfo_reader_thread, mrt);
 
+	mrt->active = mrt->num_threads;
+	mrt->threads = g_new0 (GThread *, mrt->num_threads);
+	for (i = 0; i < mrt->num_threads; i++) {
+		mrt->threads[i] = g_thread_new ("x2 media info",
+		                                xmms_mediainfo_reader_thread, mrt);
+	}
+
+	if (mrt->analysis) {
+		XMMS_DBG ("Analyzing resolved entries with %d effect(s)",
+		          g_strv_length (mrt->analysis));
+		mrt->analysis_thread = g_thread_new ("x2 analysis",
+		                                     xmms_mediainfo_analysis_thread,
+		                                     mrt);
+	}
+
+	xmms_object_emit (XMMS_OBJECT (mrt),
+	                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+	                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
 
 	xmms_object_connect (XMMS_OBJECT (mrt->medialib),
 	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_ADDED,
@@ -101,24 +187,36 @@ xmms_mediainfo_reader_start (xmms_medialib_t *medialib)
 }
 
 /**
-  * Kill the mediainfo reader thread
+  * Kill the mediainfo reader threads
   */
 static void
 xmms_mediainfo_reader_stop (xmms_object_t *o)
 {
 	xmms_mediainfo_reader_t *mir = (xmms_mediainfo_reader_t *) o;
+	guint i;
 
 	XMMS_DBG ("Deactivating mediainfo object.");
 
 	g_mutex_lock (&mir->mutex);
 	mir->running = FALSE;
-	g_cond_signal (&mir->cond);
+	g_cond_broadcast (&mir->cond);
 	g_mutex_unlock (&mir->mutex);
 
 	xmms_mediainfo_reader_unregister_ipc_commands ();
 
-	g_thread_join (mir->thread);
+	for (i = 0; i < mir->num_threads; i++) {
+		g_thread_join (mir->threads[i]);
+	}
+	g_free (mir->threads);
+
+	if (mir->analysis_thread) {
+		g_thread_join (mir->analysis_thread);
+	}
+	g_strfreev (mir->analysis);
+	g_queue_clear (&mir->analysis_queue);
+	g_hash_table_destroy (mir->analysis_queued);
 
+	g_hash_table_destroy (mir->claimed);
 	g_cond_clear (&mir->cond);
 	g_mutex_clear (&mir->mutex);
 
@@ -134,7 +232,7 @@ xmms_mediainfo_reader_stop (xmms_object_t *o)
 }
 
 /**
- * Wake the reader thread and start process the entries.
+ * Wake the reader threads and start process the entries.
  */
 
 void
@@ -143,25 +241,124 @@ xmms_mediainfo_reader_wakeup (xmms_mediainfo_reader_t *mr)
 	g_return_if_fail (mr);
 
 	g_mutex_lock (&mr->mutex);
-	g_cond_signal (&mr->cond);
+	mr->wakeups++;
+	g_cond_broadcast (&mr->cond);
 	g_mutex_unlock (&mr->mutex);
 }
 
 /** @} */
 
-static gpointer
-xmms_mediainfo_reader_thread (gpointer data)
+/**
+ * Claim up to batch_size of the candidates not already claimed by
+ * another worker. Must be called with mrt->mutex held.
+ */
+static guint
+xmms_mediainfo_reader_claim (xmms_mediainfo_reader_t *mrt,
+                             xmms_medialib_entry_t *candidates,
+                             guint num_candidates,
+                             xmms_medialib_entry_t *entries)
 {
-	GList *goal_format;
+	guint i, count = 0;
+
+	for (i = 0; i < num_candidates && count < mrt->batch_size; i++) {
+		gpointer key = GINT_TO_POINTER (candidates[i]);
+		if (!g_hash_table_contains (mrt->claimed, key)) {
+			g_hash_table_add (mrt->claimed, key);
+			entries[count++] = candidates[i];
+		}
+	}
+
+	return count;
+}
+
+static void
+xmms_mediainfo_reader_release (xmms_mediainfo_reader_t *mrt,
+                               xmms_medialib_entry_t *entries, guint count)
+{
+	guint i;
+
+	g_mutex_lock (&mrt->mutex);
+	for (i = 0; i < count; i++) {
+		g_hash_table_remove (mrt->claimed, GINT_TO_POINTER (entries[i]));
+	}
+	g_mutex_unlock (&mrt->mutex);
+}
+
+/**
+ * Queue resolved entries for the analysis thread, if there is one.
+ */
+static void
+xmms_mediainfo_reader_queue_analysis (xmms_mediainfo_reader_t *mrt,
+                                      xmms_medialib_entry_t *entries,
+                                      guint count)
+{
+	guint i;
+
+	if (!mrt->analysis) {
+		return;
+	}
+
+	g_mutex_lock (&mrt->mutex);
+	for (i = 0; i < count; i++) {
+		gpointer key = GINT_TO_POINTER (entries[i]);
+		if (!g_hash_table_contains (mrt->analysis_queued, key)) {
+			g_hash_table_add (mrt->analysis_queued, key);
+			g_queue_push_tail (&mrt->analysis_queue, key);
+		}
+	}
+	g_mutex_unlock (&mrt->mutex);
+}
+
+static void
+xmms_mediainfo_reader_resolve (xmms_mediainfo_reader_t *mrt,
+                               xmms_medialib_session_t *session,
+                               xmms_medialib_entry_t entry,
+                               GList *goal_format)
+{
+	xmmsc_medialib_entry_status_t prev_status;
 	GTimeVal timeval;
-	xmms_stream_type_t *f;
-	guint num = 0;
+	xmms_xform_t *xform;
+
+	XMMS_DBG ("Got unresolved entry, %d", entry);
+
+	prev_status = xmms_medialib_entry_property_get_int (session, entry,
+	                                                    XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
 
+	xform = xmms_xform_chain_setup_session (mrt->medialib, session, entry,
+	                                        goal_format, TRUE);
+
+	XMMS_DBG ("xform is %sset. medialib entry status = %d",
+	          ((!!xform)?"":"NOT "),
+	          prev_status);
+	if (!xform) {
+		if (prev_status == XMMS_MEDIALIB_ENTRY_STATUS_NEW) {
+			XMMS_DBG ("Removing entry");
+			xmms_medialib_entry_remove (session, entry);
+		} else {
+			XMMS_DBG ("Setting status as not available");
+			xmms_medialib_entry_status_set (session, entry,
+			                                XMMS_MEDIALIB_ENTRY_STATUS_NOT_AVAILABLE);
+		}
+	} else {
+		xmms_object_unref (xform);
+		g_get_current_time (&timeval);
+
+		xmms_medialib_entry_property_set_int (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ADDED,
+		                                      timeval.tv_sec);
+	}
+}
+
+static gpointer
+xmms_mediainfo_reader_thread (gpointer data)
+{
 	xmms_mediainfo_reader_t *mrt = (xmms_mediainfo_reader_t *) data;
+	xmms_medialib_entry_t *entries, *candidates;
+	guint max_candidates;
+	GList *goal_format;
+	xmms_stream_type_t *f, *probe = NULL;
 
-	xmms_object_emit (XMMS_OBJECT (mrt),
-	                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-	                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
 
 	f = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
 	                           XMMS_STREAM_TYPE_MIMETYPE,
@@ -169,74 +366,216 @@ xmms_mediainfo_reader_thread (gpointer data)
 	                           XMMS_STREAM_TYPE_END);
 	goal_format = g_list_prepend (NULL, f);
 
+	if (mrt->probe) {
+		probe = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+		                               XMMS_STREAM_TYPE_MIMETYPE,
+		                               XMMS_XFORM_PROBE_MIMETYPE,
+		                               XMMS_STREAM_TYPE_END);
+		goal_format = g_list_append (goal_format, probe);
+	}
+
+	/* other workers hold at most batch_size entries each, so this many
+	 * candidates always leaves a full batch for us if there is one */
+	max_candidates = mrt->batch_size * mrt->num_threads;
+	candidates = g_new (xmms_medialib_entry_t, max_candidates);
+	entries = g_new (xmms_medialib_entry_t, mrt->batch_size);
+
+	g_mutex_lock (&mrt->mutex);
+
 	while (mrt->running) {
-		xmmsc_medialib_entry_status_t prev_status;
-		xmms_medialib_entry_t entry;
 		xmms_medialib_session_t *session;
-		xmms_xform_t *xform;
+		gboolean report = FALSE;
+		guint i, count, wakeups;
+
+		wakeups = mrt->wakeups;
 
+		/* don't hold the mutex while waiting for the medialib, a
+		 * worker finishing its batch needs it to release its claims */
+		g_mutex_unlock (&mrt->mutex);
 		session = xmms_medialib_session_begin (mrt->medialib);
-		entry = xmms_medialib_entry_not_resolved_get (session);
-		XMMS_DBG ("Got unresolved entry, %d", entry);
+		count = xmms_medialib_entry_not_resolved_get_many (session, candidates,
+		                                                   max_candidates);
+		g_mutex_lock (&mrt->mutex);
 
-		if (!entry) {
-			xmms_medialib_session_abort (session);
-			xmms_object_emit (XMMS_OBJECT (mrt),
-			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-			                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_IDLE));
+		count = xmms_mediainfo_reader_claim (mrt, candidates, count, entries);
 
-			g_mutex_lock (&mrt->mutex);
-			g_cond_wait (&mrt->cond, &mrt->mutex);
+		if (!count) {
 			g_mutex_unlock (&mrt->mutex);
+			xmms_medialib_session_abort (session);
+			g_mutex_lock (&mrt->mutex);
 
-			num = 0;
+			if (--mrt->active == 0) {
+				/* let the analysis thread have a go */
+				g_cond_broadcast (&mrt->cond);
+				g_mutex_unlock (&mrt->mutex);
+				xmms_object_emit (XMMS_OBJECT (mrt),
+				                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+				                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_IDLE));
+				g_mutex_lock (&mrt->mutex);
+			}
 
-			xmms_object_emit (XMMS_OBJECT (mrt),
-			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
-			                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
+			while (mrt->running && wakeups == mrt->wakeups) {
+				g_cond_wait (&mrt->cond, &mrt->mutex);
+			}
+
+			mrt->unindexed_countdown = 0;
+
+			if (mrt->active++ == 0) {
+				g_mutex_unlock (&mrt->mutex);
+				xmms_object_emit (XMMS_OBJECT (mrt),
+				                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_STATUS,
+				                  xmmsv_new_int (XMMS_MEDIAINFO_READER_STATUS_RUNNING));
+				g_mutex_lock (&mrt->mutex);
+			}
 			continue;
 		}
 
-		prev_status = xmms_medialib_entry_property_get_int (session, entry,
-		                                                    XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
+		if (mrt->unindexed_countdown <= count) {
+			mrt->unindexed_countdown = 10;
+			report = TRUE;
+		} else {
+			mrt->unindexed_countdown -= count;
+		}
+
+		g_mutex_unlock (&mrt->mutex);
 
-		if (num == 0) {
+		if (report) {
 			xmms_object_emit (XMMS_OBJECT (mrt),
 			                  XMMS_IPC_SIGNAL_MEDIAINFO_READER_UNINDEXED,
 			                  xmmsv_new_int (xmms_medialib_num_not_resolved (session)));
-			num = 10;
+		}
+
+		for (i = 0; i < count; i++) {
+			xmms_mediainfo_reader_resolve (mrt, session, entries[i], goal_format);
+		}
+
+		if (xmms_medialib_session_commit (session)) {
+			xmms_mediainfo_reader_queue_analysis (mrt, entries, count);
 		} else {
-			num--;
+			XMMS_DBG ("Couldn't commit batch of %d entries, will retry", count);
 		}
 
-		xform = xmms_xform_chain_setup_session (mrt->medialib, session, entry,
-		                                        goal_format, TRUE);
-
-        XMMS_DBG ("xform is %sset. medialib entry status = %d",
-                ((!!xform)?"":"NOT "),
-                prev_status);
-		if (!xform) {
-			if (prev_status == XMMS_MEDIALIB_ENTRY_STATUS_NEW) {
-                XMMS_DBG ("Removing entry");
-				xmms_medialib_entry_remove (session, entry);
-			} else {
-                XMMS_DBG ("Setting status as not available");
-				xmms_medialib_entry_status_set (session, entry,
-				                                XMMS_MEDIALIB_ENTRY_STATUS_NOT_AVAILABLE);
-			}
+		xmms_mediainfo_reader_release (mrt, entries, count);
+
+		g_mutex_lock (&mrt->mutex);
+	}
+
+	g_mutex_unlock (&mrt->mutex);
+
+	g_free (entries);
+	g_free (candidates);
+	g_list_free (goal_format);
+	xmms_object_unref (f);
+	if (probe) {
+		xmms_object_unref (probe);
+	}
+
+	return NULL;
+}
+
+/**
+ * The effects of a comma separated list that there are plugins for,
+ * NULL if none.
+ */
+static gchar **
+xmms_mediainfo_analysis_effects (const gchar *list)
+{
+	GPtrArray *found;
+	gchar **names;
+	gint i;
+
+	found = g_ptr_array_new ();
+	names = g_strsplit (list, ",", 0);
+
+	for (i = 0; names[i]; i++) {
+		xmms_plugin_t *plugin;
+
+		g_strstrip (names[i]);
+		if (!names[i][0]) {
+			continue;
+		}
+
+		plugin = xmms_plugin_find (XMMS_PLUGIN_TYPE_XFORM, names[i]);
+		if (plugin) {
+			xmms_object_unref (plugin);
+			g_ptr_array_add (found, g_strdup (names[i]));
 		} else {
-			xmms_object_unref (xform);
-			g_get_current_time (&timeval);
+			XMMS_DBG ("No '%s' plugin to analyze entries with", names[i]);
+		}
+	}
+
+	g_strfreev (names);
+
+	if (!found->len) {
+		g_ptr_array_free (found, TRUE);
+		return NULL;
+	}
 
-			xmms_medialib_entry_property_set_int (session, entry,
-			                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ADDED,
-			                                      timeval.tv_sec);
+	g_ptr_array_add (found, NULL);
+
+	return (gchar **) g_ptr_array_free (found, FALSE);
+}
+
+/**
+ * Decode the queued entries for the analysis effects, one at a time
+ * and only while no worker is resolving entries.
+ */
+static gpointer
+xmms_mediainfo_analysis_thread (gpointer data)
+{
+	xmms_mediainfo_reader_t *mrt = (xmms_mediainfo_reader_t *) data;
+	xmms_stream_type_t *f, *hint;
+	GList *goal_format;
+	gint i;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	/* what the analyzing effects take, 16 bit stereo at 44.1kHz */
+	f = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                           XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                           XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                           XMMS_STREAM_TYPE_FMT_CHANNELS, 2,
+	                           XMMS_STREAM_TYPE_FMT_SAMPLERATE, 44100,
+	                           XMMS_STREAM_TYPE_END);
+	hint = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                              XMMS_STREAM_TYPE_MIMETYPE,
+	                              XMMS_XFORM_ANALYSIS_MIMETYPE,
+	                              XMMS_STREAM_TYPE_END);
+	goal_format = g_list_append (NULL, f);
+	goal_format = g_list_append (goal_format, hint);
+
+	g_mutex_lock (&mrt->mutex);
+
+	while (mrt->running) {
+		xmms_medialib_entry_t entry;
+
+		if (mrt->active || g_queue_is_empty (&mrt->analysis_queue)) {
+			g_cond_wait (&mrt->cond, &mrt->mutex);
+			continue;
 		}
-		xmms_medialib_session_commit (session);
+
+		entry = GPOINTER_TO_INT (g_queue_pop_head (&mrt->analysis_queue));
+		g_hash_table_remove (mrt->analysis_queued, GINT_TO_POINTER (entry));
+
+		g_mutex_unlock (&mrt->mutex);
+
+		/* one effect at a time, ofa for one doesn't need all of it */
+		for (i = 0; mrt->analysis[i]; i++) {
+			if (!xmms_xform_chain_analyze (mrt->medialib, entry, goal_format,
+			                               mrt->analysis[i])) {
+				XMMS_DBG ("Couldn't analyze entry %d with '%s'",
+				          entry, mrt->analysis[i]);
+			}
+		}
+
+		g_mutex_lock (&mrt->mutex);
 	}
 
+	g_mutex_unlock (&mrt->mutex);
+
 	g_list_free (goal_format);
 	xmms_object_unref (f);
+	xmms_object_unref (hint);
 
 	return NULL;
 }
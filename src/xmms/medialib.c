@@ -18,6 +18,7 @@
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_utils.h>
+#include <xmmspriv/xmms_trace.h>
 #include <xmms/xmms_error.h>
 #include <xmms/xmms_config.h>
 #include <xmms/xmms_object.h>
@@ -36,6 +37,9 @@
 
 #include <xmmspriv/xmms_fetch_info.h>
 #include <xmmspriv/xmms_fetch_spec.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_ipc.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
 #include "s4.h"
 
 
@@ -50,16 +54,33 @@ gchar *xmms_medialib_url_encode (const gchar *path);
 
 static void xmms_medialib_client_add_entry (xmms_medialib_t *, const gchar *, xmms_error_t *);
 static void xmms_medialib_client_move_entry (xmms_medialib_t *, gint32 entry, const gchar *, xmms_error_t *);
-static void xmms_medialib_client_import_path (xmms_medialib_t *medialib, const gchar *path, xmms_error_t *error);
+static gint32 xmms_medialib_client_import_path (xmms_medialib_t *medialib, const gchar *path, xmms_error_t *error);
+static xmmsv_t *xmms_medialib_client_import_status (xmms_medialib_t *medialib, xmms_error_t *error);
+static void xmms_medialib_client_import_cancel (xmms_medialib_t *medialib, gint32 id, xmms_error_t *error);
+static gint32 xmms_medialib_client_rehash_changed (xmms_medialib_t *medialib, xmms_error_t *error);
 static void xmms_medialib_client_rehash (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, xmms_error_t *error);
 static void xmms_medialib_client_set_property_string (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *source, const gchar *key, const gchar *value, xmms_error_t *error);
 static void xmms_medialib_client_set_property_int (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *source, const gchar *key, gint32 value, xmms_error_t *error);
 static void xmms_medialib_client_remove_property (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *source, const gchar *key, xmms_error_t *error);
 static xmmsv_t *xmms_medialib_client_get_info (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, xmms_error_t *err);
 static gint32 xmms_medialib_client_get_id (xmms_medialib_t *medialib, const gchar *url, xmms_error_t *error);
+static void xmms_medialib_client_set_properties (xmms_medialib_t *medialib, xmms_medialib_entry_t entry, const gchar *source, xmmsv_t *properties, xmms_error_t *error);
+static void xmms_medialib_client_set_property_entries (xmms_medialib_t *medialib, xmmsv_t *ids, const gchar *source, const gchar *key, xmmsv_t *value, xmms_error_t *error);
+static xmmsv_t *xmms_medialib_client_add_entries (xmms_medialib_t *medialib, xmmsv_t *urls, xmms_error_t *error);
+static xmmsv_t *xmms_medialib_client_index_stats (xmms_medialib_t *medialib, xmms_error_t *error);
+static xmmsv_t *xmms_medialib_client_complete (xmms_medialib_t *medialib, const gchar *key, const gchar *prefix, gint32 limit, xmms_error_t *error);
+static xmmsv_t *xmms_medialib_client_compact (xmms_medialib_t *medialib, xmms_error_t *error);
+static void xmms_medialib_client_dump (xmms_medialib_t *medialib, const gchar *path, gint32 client, uint32_t cookie, xmms_error_t *error);
+static void xmms_medialib_client_restore (xmms_medialib_t *medialib, const gchar *path, gint32 client, uint32_t cookie, xmms_error_t *error);
+static void xmms_medialib_dump_worker (gpointer data, gpointer udata);
 
 static s4_t *xmms_medialib_database_open (const gchar *config_path, const gchar *indices[]);
+static void xmms_medialib_plan_cache_size_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata);
+static void xmms_medialib_query_threads_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata);
+static void xmms_medialib_token_index_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata);
 static xmms_medialib_entry_t xmms_medialib_entry_new_insert (xmms_medialib_session_t *session, guint32 id, const gchar *url, xmms_error_t *error);
+static void xmms_medialib_pending_scan (xmms_medialib_t *medialib);
+static gint64 xmms_medialib_database_size (void);
 
 #include "medialib_ipc.c"
 
@@ -81,23 +102,307 @@ struct xmms_medialib_St {
 	xmms_object_t object;
 	s4_t *s4;
 	s4_sourcepref_t *default_sp;
+	xmms_medialib_event_queue_t *events;
+	/** Bumped by every committed write */
+	gint generation;
+	/** Sessions that failed to commit, and were retried by most callers */
+	gint ro_conflicts;
+	gint rw_conflicts;
+
+	/** Keys the database keeps an index on */
+	GHashTable *indices;
+	/** Number of filters run per key, guarded by index_mutex */
+	GHashTable *index_usage;
+	GMutex index_mutex;
+
+	xmms_plan_cache_t *plan_cache;
+
+	/** Threads scanning queries are split over, 1 disables it */
+	gint query_threads;
+
+	/** Words of some properties, for match and token filters */
+	xmms_token_index_t *token_index;
+
+	/** Runs import_path jobs */
+	xmms_medialib_importer_t *importer;
+
+	/** Runs dump and restore jobs, one at a time */
+	GThreadPool *dumper;
+
+	/** The id the next new entry gets, 0 until the highest id in the
+	 *  database was looked up */
+	gint next_id;
+
+	/** Entries with status new or rehash, in the order they got it,
+	 *  as of the last commit. Guarded by pending_mutex */
+	GQueue pending;
+	/** The link in pending of each of its entries */
+	GHashTable *pending_links;
+	GMutex pending_mutex;
+
+	/** Reads the database files into the page cache after startup */
+	GThread *warmup_thread;
+	gint warmup_quit;
+	/** Bytes read by the warm-up, and the size of the files */
+	gsize warmup_done;
+	gint64 warmup_size;
 };
 
 static void
 xmms_medialib_destroy (xmms_object_t *object)
 {
 	xmms_medialib_t *mlib = (xmms_medialib_t *) object;
+	xmms_config_property_t *cfg;
 
 	XMMS_DBG ("Deactivating medialib object.");
 
+	/* waits for running imports, which need the database */
+	xmms_medialib_importer_free (mlib->importer);
+	g_thread_pool_free (mlib->dumper, FALSE, TRUE);
+
+	if (mlib->warmup_thread) {
+		g_atomic_int_set (&mlib->warmup_quit, 1);
+		g_thread_join (mlib->warmup_thread);
+	}
+
+	xmms_medialib_event_queue_free (mlib->events);
 	s4_sourcepref_unref (mlib->default_sp);
 	s4_close (mlib->s4);
 
+	cfg = xmms_config_lookup ("medialib.query_threads");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_query_threads_changed, mlib);
+
+	cfg = xmms_config_lookup ("medialib.token_index_keys");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_token_index_changed, mlib);
+	cfg = xmms_config_lookup ("medialib.token_index_fold_diacritics");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_token_index_changed, mlib);
+	xmms_token_index_free (mlib->token_index);
+
+	cfg = xmms_config_lookup ("medialib.plan_cache_size");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_plan_cache_size_changed, mlib);
+	xmms_plan_cache_free (mlib->plan_cache);
+
+	g_hash_table_destroy (mlib->indices);
+	g_hash_table_destroy (mlib->index_usage);
+	g_mutex_clear (&mlib->index_mutex);
+
+	g_hash_table_destroy (mlib->pending_links);
+	g_queue_clear (&mlib->pending);
+	g_mutex_clear (&mlib->pending_mutex);
+
 	xmms_medialib_unregister_ipc_commands ();
 }
 
 #define XMMS_MEDIALIB_SOURCE_SERVER "server"
 
+/** Indexed on top of url and status, the keys browsing filters on most */
+#define XMMS_MEDIALIB_DEFAULT_INDICES "artist,album,genre"
+
+/** Most values a completion returns */
+#define XMMS_MEDIALIB_COMPLETE_MAX 1000
+
+/** Entries added by a recursive add in one medialib session */
+#define XMMS_MEDIALIB_ADD_BATCH 512
+
+static void
+xmms_medialib_indices_changed (xmms_object_t *object, xmmsv_t *data,
+                               gpointer udata)
+{
+	/* s4 builds its indices while loading the database */
+	xmms_log_info ("The new medialib indices are used after a restart.");
+}
+
+/**
+ * Fill the index set from the comma separated keys in config, always
+ * including url and status which the server itself looks up.
+ *
+ * @returns A NULL terminated array of the keys, to be freed with g_free.
+ * The strings are owned by the index set.
+ */
+static const gchar **
+xmms_medialib_indices_init (xmms_medialib_t *medialib, const gchar *config)
+{
+	GHashTableIter iter;
+	gpointer key;
+	const gchar **ret;
+	gchar **keys;
+	gint i;
+
+	medialib->indices = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                           g_free, NULL);
+
+	g_hash_table_add (medialib->indices,
+	                  g_strdup (XMMS_MEDIALIB_ENTRY_PROPERTY_URL));
+	g_hash_table_add (medialib->indices,
+	                  g_strdup (XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS));
+
+	keys = g_strsplit (config, ",", -1);
+	for (i = 0; keys[i] != NULL; i++) {
+		g_strstrip (keys[i]);
+		if (*keys[i] != '\0') {
+			g_hash_table_add (medialib->indices, g_strdup (keys[i]));
+		}
+	}
+	g_strfreev (keys);
+
+	ret = g_new0 (const gchar *, g_hash_table_size (medialib->indices) + 1);
+
+	i = 0;
+	g_hash_table_iter_init (&iter, medialib->indices);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		ret[i++] = key;
+	}
+
+	return ret;
+}
+
+static void
+xmms_medialib_plan_cache_size_changed (xmms_object_t *object, xmmsv_t *data,
+                                       gpointer udata)
+{
+	xmms_medialib_t *medialib = (xmms_medialib_t *) udata;
+	gint size;
+
+	size = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	xmms_plan_cache_set_max_entries (medialib->plan_cache, MAX (size, 0));
+}
+
+xmms_plan_cache_t *
+xmms_medialib_get_plan_cache (xmms_medialib_t *medialib)
+{
+	return medialib->plan_cache;
+}
+
+static void
+xmms_medialib_query_threads_changed (xmms_object_t *object, xmmsv_t *data,
+                                     gpointer udata)
+{
+	xmms_medialib_t *medialib = (xmms_medialib_t *) udata;
+	gint threads;
+
+	threads = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_atomic_int_set (&medialib->query_threads, CLAMP (threads, 1, 64));
+}
+
+guint
+xmms_medialib_get_query_threads (xmms_medialib_t *medialib)
+{
+	return g_atomic_int_get (&medialib->query_threads);
+}
+
+static void
+xmms_medialib_token_index_configure (xmms_medialib_t *medialib)
+{
+	xmms_config_property_t *cfg;
+	const gchar *keys;
+	gboolean fold_marks;
+
+	cfg = xmms_config_lookup ("medialib.token_index_keys");
+	keys = xmms_config_property_get_string (cfg);
+	cfg = xmms_config_lookup ("medialib.token_index_fold_diacritics");
+	fold_marks = xmms_config_property_get_int (cfg) != 0;
+
+	xmms_token_index_configure (medialib->token_index, keys, fold_marks);
+}
+
+static void
+xmms_medialib_token_index_changed (xmms_object_t *object, xmmsv_t *data,
+                                   gpointer udata)
+{
+	xmms_medialib_token_index_configure ((xmms_medialib_t *) udata);
+}
+
+xmms_token_index_t *
+xmms_medialib_get_token_index (xmms_medialib_t *medialib)
+{
+	return medialib->token_index;
+}
+
+/**
+ * Tell if the medialib was opened with an index on key.
+ */
+gboolean
+xmms_medialib_is_indexed (xmms_medialib_t *medialib, const gchar *key)
+{
+	return g_hash_table_contains (medialib->indices, key);
+}
+
+/**
+ * Count a filter on key, for the index usage statistics.
+ */
+void
+xmms_medialib_index_track_filter (xmms_medialib_t *medialib, const gchar *key)
+{
+	gpointer count;
+
+	g_mutex_lock (&medialib->index_mutex);
+
+	count = g_hash_table_lookup (medialib->index_usage, key);
+	g_hash_table_replace (medialib->index_usage, g_strdup (key),
+	                      GUINT_TO_POINTER (GPOINTER_TO_UINT (count) + 1));
+
+	g_mutex_unlock (&medialib->index_mutex);
+}
+
+/** Read at a time by the warm-up, pausing in between to leave the disk
+ *  to other readers */
+#define XMMS_MEDIALIB_WARMUP_CHUNK (256 * 1024)
+#define XMMS_MEDIALIB_WARMUP_PAUSE_US 2000
+
+static void
+xmms_medialib_warmup_file (xmms_medialib_t *medialib, const gchar *path,
+                           guchar *buf)
+{
+	FILE *fp;
+	size_t len;
+
+	fp = g_fopen (path, "rb");
+	if (fp == NULL) {
+		return;
+	}
+
+	while (!g_atomic_int_get (&medialib->warmup_quit) &&
+	       (len = fread (buf, 1, XMMS_MEDIALIB_WARMUP_CHUNK, fp)) > 0) {
+		g_atomic_pointer_add (&medialib->warmup_done, len);
+		g_usleep (XMMS_MEDIALIB_WARMUP_PAUSE_US);
+	}
+
+	fclose (fp);
+}
+
+/**
+ * Read the database and its log once, so the queries after startup
+ * don't wait for them to be paged in.
+ */
+static gpointer
+xmms_medialib_warmup_thread (gpointer udata)
+{
+	xmms_medialib_t *medialib = (xmms_medialib_t *) udata;
+	xmms_config_property_t *cfg;
+	const gchar *path;
+	gchar *log_path;
+	guchar *buf;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	cfg = xmms_config_lookup ("medialib.path");
+	path = xmms_config_property_get_string (cfg);
+	log_path = g_strconcat (path, ".log", NULL);
+
+	buf = g_malloc (XMMS_MEDIALIB_WARMUP_CHUNK);
+
+	xmms_medialib_warmup_file (medialib, path, buf);
+	xmms_medialib_warmup_file (medialib, log_path, buf);
+
+	g_free (buf);
+	g_free (log_path);
+
+	XMMS_DBG ("Medialib warm-up read %" G_GINT64_FORMAT " bytes",
+	          (gint64) g_atomic_pointer_get (&medialib->warmup_done));
+
+	return NULL;
+}
+
 /**
  * Initialize the medialib and open the database file.
  *
@@ -110,14 +415,9 @@ xmms_medialib_init (void)
 	xmms_config_property_t *cfg;
 	xmms_medialib_t *medialib;
 	const gchar *medialib_path;
+	const gchar **indices;
 	gchar *path;
 
-	const gchar *indices[] = {
-		XMMS_MEDIALIB_ENTRY_PROPERTY_URL,
-		XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS,
-		NULL
-	};
-
 	medialib = xmms_object_new (xmms_medialib_t, xmms_medialib_destroy);
 
 	xmms_medialib_register_ipc_commands (XMMS_OBJECT (medialib));
@@ -132,13 +432,119 @@ xmms_medialib_init (void)
 
 	xmms_config_property_register ("sqlite2s4.path", "sqlite2s4", NULL, NULL);
 
+	cfg = xmms_config_property_register ("medialib.indices",
+	                                     XMMS_MEDIALIB_DEFAULT_INDICES,
+	                                     xmms_medialib_indices_changed, NULL);
+	indices = xmms_medialib_indices_init (medialib,
+	                                      xmms_config_property_get_string (cfg));
+
+	g_mutex_init (&medialib->index_mutex);
+	medialib->index_usage = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                               g_free, NULL);
+
+	/* 0 disables the plan cache */
+	cfg = xmms_config_property_register ("medialib.plan_cache_size", "32",
+	                                     xmms_medialib_plan_cache_size_changed,
+	                                     medialib);
+	medialib->plan_cache = xmms_plan_cache_new (MAX (xmms_config_property_get_int (cfg), 0),
+	                                            (GDestroyNotify) xmms_medialib_plan_free);
+
+	cfg = xmms_config_property_register ("medialib.query_threads", "1",
+	                                     xmms_medialib_query_threads_changed,
+	                                     medialib);
+	medialib->query_threads = CLAMP (xmms_config_property_get_int (cfg), 1, 64);
+
+	/* an empty list of keys disables the token index */
+	xmms_config_property_register ("medialib.token_index_keys",
+	                               "artist,album,title",
+	                               xmms_medialib_token_index_changed,
+	                               medialib);
+	xmms_config_property_register ("medialib.token_index_fold_diacritics", "0",
+	                               xmms_medialib_token_index_changed,
+	                               medialib);
+	medialib->token_index = xmms_token_index_new ();
+	xmms_medialib_token_index_configure (medialib);
+
+	cfg = xmms_config_lookup ("medialib.path");
 	medialib_path = xmms_config_property_get_string (cfg);
 	medialib->s4 = xmms_medialib_database_open (medialib_path, indices);
+	g_free (indices);
+
 	medialib->default_sp = s4_sourcepref_create (xmmsv_default_source_pref);
+	medialib->events = xmms_medialib_event_queue_new (medialib);
+
+	g_mutex_init (&medialib->pending_mutex);
+	g_queue_init (&medialib->pending);
+	medialib->pending_links = g_hash_table_new (g_direct_hash, g_direct_equal);
+	xmms_medialib_pending_scan (medialib);
+
+	medialib->importer = xmms_medialib_importer_new (medialib);
+	medialib->dumper = g_thread_pool_new (xmms_medialib_dump_worker, medialib,
+	                                      1, FALSE, NULL);
+
+	/* for devices where the first queries would page in from slow storage */
+	cfg = xmms_config_property_register ("medialib.warmup", "0", NULL, NULL);
+	if (xmms_config_property_get_int (cfg)) {
+		medialib->warmup_size = xmms_medialib_database_size ();
+		medialib->warmup_thread = g_thread_new ("x2 mlib warmup",
+		                                        xmms_medialib_warmup_thread,
+		                                        medialib);
+	}
 
 	return medialib;
 }
 
+/**
+ * Get how far the warm-up got, both 0 if it is disabled.
+ */
+void
+xmms_medialib_warmup_stats (xmms_medialib_t *medialib,
+                            gint64 *done, gint64 *size)
+{
+	*done = g_atomic_pointer_get (&medialib->warmup_done);
+	*size = medialib->warmup_size;
+}
+
+xmms_medialib_event_queue_t *
+xmms_medialib_get_event_queue (xmms_medialib_t *medialib)
+{
+	return medialib->events;
+}
+
+/**
+ * A counter that changes whenever a session that may have modified the
+ * medialib is committed. Used to tell if cached query results are stale.
+ */
+guint
+xmms_medialib_generation_get (xmms_medialib_t *medialib)
+{
+	return g_atomic_int_get (&medialib->generation);
+}
+
+void
+xmms_medialib_generation_bump (xmms_medialib_t *medialib)
+{
+	g_atomic_int_inc (&medialib->generation);
+}
+
+/**
+ * Count a session that failed to commit, because it conflicted with
+ * another one.
+ */
+void
+xmms_medialib_conflict_count (xmms_medialib_t *medialib, gboolean readonly)
+{
+	g_atomic_int_inc (readonly ? &medialib->ro_conflicts : &medialib->rw_conflicts);
+}
+
+void
+xmms_medialib_conflict_stats (xmms_medialib_t *medialib,
+                              guint *ro_conflicts, guint *rw_conflicts)
+{
+	*ro_conflicts = g_atomic_int_get (&medialib->ro_conflicts);
+	*rw_conflicts = g_atomic_int_get (&medialib->rw_conflicts);
+}
+
 s4_sourcepref_t *
 xmms_medialib_get_source_preferences (xmms_medialib_t *medialib)
 {
@@ -293,42 +699,98 @@ xmms_medialib_filter (xmms_medialib_session_t *session,
 	return ret;
 }
 
-static s4_val_t *
-xmms_medialib_entry_property_get (xmms_medialib_session_t *session,
-                                  xmms_medialib_entry_t entry,
-                                  const gchar *property)
+typedef struct xmms_medialib_property_St {
+	gint priority;
+	s4_val_t *value;
+} xmms_medialib_property_t;
+
+static void
+xmms_medialib_property_free (xmms_medialib_property_t *prop)
+{
+	s4_val_free (prop->value);
+	g_free (prop);
+}
+
+/**
+ * Fetch all properties of an entry, the value of each from the source
+ * preferred. Kept by the session, so reading several properties of an
+ * entry only queries it once.
+ *
+ * @returns A table of the properties owned by the session
+ */
+static GHashTable *
+xmms_medialib_entry_properties (xmms_medialib_session_t *session,
+                                xmms_medialib_entry_t entry)
 {
 	s4_sourcepref_t *sourcepref;
 	const s4_result_t *res;
 	s4_resultset_t *set;
-	s4_val_t *ret = NULL;
+	GHashTable *props;
 	s4_val_t *song_id;
 
-	g_return_val_if_fail (property, NULL);
-
-	song_id = s4_val_new_int (entry);
-
-	if (strcmp (property, XMMS_MEDIALIB_ENTRY_PROPERTY_ID) == 0) {
-		/* only resolving attributes other than 'id' */
-		return song_id;
+	props = xmms_medialib_session_get_entry_cache (session, entry);
+	if (props != NULL) {
+		return props;
 	}
 
+	props = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                               (GDestroyNotify) xmms_medialib_property_free);
+
+	song_id = s4_val_new_int (entry);
 	sourcepref = xmms_medialib_session_get_source_preferences (session);
 
 	set = xmms_medialib_filter (session, "song_id", song_id, S4_COND_PARENT,
-	                            sourcepref, property, S4_FETCH_DATA);
+	                            sourcepref, NULL, S4_FETCH_DATA);
+
+	for (res = s4_resultset_get_result (set, 0, 0); res != NULL; res = s4_result_next (res)) {
+		xmms_medialib_property_t *prop;
+		gint priority;
+
+		priority = s4_sourcepref_get_priority (sourcepref, s4_result_get_src (res));
+
+		prop = g_hash_table_lookup (props, s4_result_get_key (res));
+		if (prop == NULL) {
+			prop = g_new (xmms_medialib_property_t, 1);
+			prop->priority = priority;
+			prop->value = s4_val_copy (s4_result_get_val (res));
+			g_hash_table_insert (props, g_strdup (s4_result_get_key (res)), prop);
+		} else if (priority < prop->priority) {
+			s4_val_free (prop->value);
+			prop->priority = priority;
+			prop->value = s4_val_copy (s4_result_get_val (res));
+		}
+	}
 
+	s4_resultset_free (set);
 	s4_sourcepref_unref (sourcepref);
+	s4_val_free (song_id);
 
-	res = s4_resultset_get_result (set, 0, 0);
-	if (res != NULL) {
-		ret = s4_val_copy (s4_result_get_val (res));
+	xmms_medialib_session_set_entry_cache (session, entry, props);
+
+	return props;
+}
+
+static s4_val_t *
+xmms_medialib_entry_property_get (xmms_medialib_session_t *session,
+                                  xmms_medialib_entry_t entry,
+                                  const gchar *property)
+{
+	xmms_medialib_property_t *prop;
+
+	g_return_val_if_fail (property, NULL);
+
+	if (strcmp (property, XMMS_MEDIALIB_ENTRY_PROPERTY_ID) == 0) {
+		/* only resolving attributes other than 'id' */
+		return s4_val_new_int (entry);
 	}
 
-	s4_resultset_free (set);
-	s4_val_free (song_id);
+	prop = g_hash_table_lookup (xmms_medialib_entry_properties (session, entry),
+	                            property);
+	if (prop == NULL) {
+		return NULL;
+	}
 
-	return ret;
+	return s4_val_copy (prop->value);
 }
 
 
@@ -525,13 +987,8 @@ highest_id_filter (const s4_val_t *value, s4_condition_t *cond)
 	return -1;
 }
 
-/**
- * Return a fresh unused medialib id.
- *
- * The first id starts at 1 as 0 is considered reserved for other use.
- */
-static int32_t
-xmms_medialib_get_new_id (xmms_medialib_session_t *session)
+static gint32
+xmms_medialib_highest_id_scan (xmms_medialib_session_t *session)
 {
 	gint32 highest = 0;
 	s4_fetchspec_t *fs;
@@ -551,7 +1008,53 @@ xmms_medialib_get_new_id (xmms_medialib_session_t *session)
 	s4_cond_free (cond);
 	s4_fetchspec_free (fs);
 
-	return highest + 1;
+	return highest;
+}
+
+/**
+ * Return the highest medialib id handed out, or 0 if there is none.
+ * No entry has a higher id, but the entry of the id may be removed.
+ *
+ * The database is only scanned for it the first time.
+ */
+gint32
+xmms_medialib_highest_id (xmms_medialib_session_t *session)
+{
+	xmms_medialib_t *medialib;
+	gint next;
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	next = g_atomic_int_get (&medialib->next_id);
+	if (!next) {
+		next = xmms_medialib_highest_id_scan (session) + 1;
+		/* another thread may have scanned and handed out ids meanwhile */
+		if (!g_atomic_int_compare_and_exchange (&medialib->next_id, 0, next)) {
+			next = g_atomic_int_get (&medialib->next_id);
+		}
+	}
+
+	return next - 1;
+}
+
+/**
+ * Return a fresh unused medialib id.
+ *
+ * The first id starts at 1 as 0 is considered reserved for other use.
+ * Ids are never handed out twice, not even when the session fails to
+ * commit, so sessions adding entries at once don't conflict over them.
+ */
+static int32_t
+xmms_medialib_get_new_id (xmms_medialib_session_t *session)
+{
+	xmms_medialib_t *medialib;
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	/* makes sure the counter starts past the ids in the database */
+	xmms_medialib_highest_id (session);
+
+	return g_atomic_int_add (&medialib->next_id, 1);
 }
 
 
@@ -561,15 +1064,26 @@ xmms_medialib_client_remove_entry (xmms_medialib_t *medialib,
                                    xmms_error_t *error)
 {
 	xmms_medialib_session_t *session;
+	gchar *url = NULL;
 
 	do {
+		g_free (url);
+		url = NULL;
+
 		session = xmms_medialib_session_begin (medialib);
 		if (xmms_medialib_check_id (session, entry)) {
+			url = xmms_medialib_entry_property_get_str (session, entry,
+			                                            XMMS_MEDIALIB_ENTRY_PROPERTY_URL);
 			xmms_medialib_entry_remove (session, entry);
 		} else {
 			xmms_error_set (error, XMMS_ERROR_NOENT, "No such entry");
 		}
 	} while (!xmms_medialib_session_commit (session));
+
+	if (url) {
+		xmms_xform_browse_invalidate (url, TRUE);
+		g_free (url);
+	}
 }
 
 /**
@@ -677,6 +1191,47 @@ xmms_medialib_entry_cleanup (xmms_medialib_session_t *session,
 	s4_val_free (song_id);
 }
 
+/**
+ * Get the ids of all entries with a status.
+ *
+ * @returns an array of #xmms_medialib_entry_t, to be freed by the caller.
+ */
+GArray *
+xmms_medialib_entries_with_status (xmms_medialib_session_t *session,
+                                   xmms_medialib_entry_status_t status)
+{
+	s4_sourcepref_t *sourcepref;
+	s4_resultset_t *set;
+	s4_val_t *value;
+	GArray *ret;
+	gint i;
+
+	ret = g_array_new (FALSE, FALSE, sizeof (xmms_medialib_entry_t));
+
+	sourcepref = xmms_medialib_session_get_source_preferences (session);
+
+	value = s4_val_new_int (status);
+	set = xmms_medialib_filter (session, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS,
+	                            value, 0, sourcepref, "song_id", S4_FETCH_PARENT);
+	s4_val_free (value);
+	s4_sourcepref_unref (sourcepref);
+
+	for (i = 0; i < s4_resultset_get_rowcount (set); i++) {
+		const s4_result_t *res;
+
+		res = s4_resultset_get_result (set, i, 0);
+		for (; res != NULL; res = s4_result_next (res)) {
+			xmms_medialib_entry_t item;
+			s4_val_get_int (s4_result_get_val (res), &item);
+			g_array_append_val (ret, item);
+		}
+	}
+
+	s4_resultset_free (set);
+
+	return ret;
+}
+
 static void
 xmms_medialib_client_rehash (xmms_medialib_t *medialib,
                              xmms_medialib_entry_t entry,
@@ -689,31 +1244,15 @@ xmms_medialib_client_rehash (xmms_medialib_t *medialib,
 		if (xmms_medialib_check_id (session, entry)) {
 			xmms_medialib_entry_status_set (session, entry, XMMS_MEDIALIB_ENTRY_STATUS_REHASH);
 		} else if (entry == 0) {
-			s4_sourcepref_t *sourcepref;
-			s4_resultset_t *set;
-			s4_val_t *status;
-			gint i;
-
-			sourcepref = xmms_medialib_session_get_source_preferences (session);
-
-			status = s4_val_new_int (XMMS_MEDIALIB_ENTRY_STATUS_OK);
-			set = xmms_medialib_filter (session, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS,
-			                            status, 0, sourcepref, "song_id", S4_FETCH_PARENT);
-			s4_val_free (status);
-			s4_sourcepref_unref (sourcepref);
-
-			for (i = 0; i < s4_resultset_get_rowcount (set); i++) {
-				const s4_result_t *res;
-
-				res = s4_resultset_get_result (set, i, 0);
-				for (; res != NULL; res = s4_result_next (res)) {
-					xmms_medialib_entry_t item;
-					s4_val_get_int (s4_result_get_val (res), &item);
-					xmms_medialib_entry_status_set (session, item, XMMS_MEDIALIB_ENTRY_STATUS_REHASH);
-				}
-			}
+			GArray *entries;
+			guint i;
 
-			s4_resultset_free (set);
+			entries = xmms_medialib_entries_with_status (session, XMMS_MEDIALIB_ENTRY_STATUS_OK);
+			for (i = 0; i < entries->len; i++) {
+				xmms_medialib_entry_t item = g_array_index (entries, xmms_medialib_entry_t, i);
+				xmms_medialib_entry_status_set (session, item, XMMS_MEDIALIB_ENTRY_STATUS_REHASH);
+			}
+			g_array_free (entries, TRUE);
 		} else {
 			xmms_error_set (error, XMMS_ERROR_NOENT, "No such entry");
 		}
@@ -721,25 +1260,67 @@ xmms_medialib_client_rehash (xmms_medialib_t *medialib,
 }
 
 /**
- * Recursively scan a directory for media files.
- *
- * @return a reverse sorted list of encoded urls
+ * Add the files of a browse listing to the media library, in sessions
+ * of up to XMMS_MEDIALIB_ADD_BATCH entries so that a large playlist
+ * file doesn't commit once for every entry.
  */
-static gboolean
+static void
+process_files (xmms_medialib_t *medialib, xmmsv_t *entries,
+               GPtrArray *urls, xmms_error_t *error)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	GArray *ids;
+	guint i, j, n;
+
+	ids = g_array_sized_new (FALSE, FALSE, sizeof (xmms_medialib_entry_t),
+	                         MIN (urls->len, XMMS_MEDIALIB_ADD_BATCH));
+
+	for (i = 0; i < urls->len; i += n) {
+		n = MIN (urls->len - i, XMMS_MEDIALIB_ADD_BATCH);
+
+		do {
+			g_array_set_size (ids, 0);
+			session = xmms_medialib_session_begin (medialib);
+			for (j = i; j < i + n; j++) {
+				entry = xmms_medialib_entry_new_encoded (session, g_ptr_array_index (urls, j), error);
+				if (entry) {
+					g_array_append_val (ids, entry);
+				}
+			}
+		} while (!xmms_medialib_session_commit (session));
+
+		for (j = 0; j < ids->len; j++) {
+			xmmsv_coll_idlist_append (entries, g_array_index (ids, xmms_medialib_entry_t, j));
+		}
+	}
+
+	g_array_free (ids, TRUE);
+	g_ptr_array_set_size (urls, 0);
+}
+
+/**
+ * Recursively scan a directory for media files.
+ *
+ * @return a reverse sorted list of encoded urls
+ */
+static gboolean
 process_dir (xmms_medialib_t *medialib, xmmsv_t *entries,
              const gchar *directory, xmms_error_t *error)
 {
-	xmmsv_list_iter_t *it;
 	xmmsv_t *list, *val;
+	GPtrArray *urls;
+	gint i;
 
 	list = xmms_xform_browse (directory, error);
 	if (!list) {
 		return FALSE;
 	}
 
-	xmmsv_get_list_iter (list, &it);
+	/* the files between two directories are added together */
+	urls = g_ptr_array_new ();
 
-	while (xmmsv_list_iter_entry (it, &val)) {
+	for (i = 0; xmmsv_list_get (list, i, &val); i++) {
 		const gchar *str;
 		gint isdir;
 
@@ -747,24 +1328,16 @@ process_dir (xmms_medialib_t *medialib, xmmsv_t *entries,
 		xmmsv_dict_entry_get_int (val, "isdir", &isdir);
 
 		if (isdir == 1) {
+			process_files (medialib, entries, urls, error);
 			process_dir (medialib, entries, str, error);
 		} else {
-			xmms_medialib_session_t *session;
-			xmms_medialib_entry_t entry;
-
-			do {
-				session = xmms_medialib_session_begin (medialib);
-				entry = xmms_medialib_entry_new_encoded (session, str, error);
-			} while (!xmms_medialib_session_commit (session));
-
-			if (entry) {
-				xmmsv_coll_idlist_append (entries, entry);
-			}
+			g_ptr_array_add (urls, (gpointer) str);
 		}
-
-		xmmsv_list_iter_remove (it);
 	}
 
+	process_files (medialib, entries, urls, error);
+
+	g_ptr_array_free (urls, TRUE);
 	xmmsv_unref (list);
 
 	return TRUE;
@@ -795,11 +1368,47 @@ xmms_medialib_add_recursive (xmms_medialib_t *medialib, const gchar *path,
 	return entries;
 }
 
-static void
+/**
+ * Start importing a directory in the background.
+ *
+ * @returns the id of the import job
+ */
+static gint32
 xmms_medialib_client_import_path (xmms_medialib_t *medialib, const gchar *path,
                                   xmms_error_t *error)
 {
-	xmmsv_unref (xmms_medialib_add_recursive (medialib, path, error));
+	/* the updater imports what its file monitors saw appear */
+	xmms_xform_browse_invalidate (path, TRUE);
+
+	return xmms_medialib_importer_start (medialib->importer, path, error);
+}
+
+static xmmsv_t *
+xmms_medialib_client_import_status (xmms_medialib_t *medialib,
+                                    xmms_error_t *error)
+{
+	return xmms_medialib_importer_status (medialib->importer);
+}
+
+/**
+ * Start looking for entries whose files changed in the background.
+ *
+ * @returns the id of the job
+ */
+static gint32
+xmms_medialib_client_rehash_changed (xmms_medialib_t *medialib,
+                                     xmms_error_t *error)
+{
+	return xmms_medialib_importer_rehash (medialib->importer, error);
+}
+
+static void
+xmms_medialib_client_import_cancel (xmms_medialib_t *medialib, gint32 id,
+                                    xmms_error_t *error)
+{
+	if (!xmms_medialib_importer_cancel (medialib->importer, id)) {
+		xmms_error_set (error, XMMS_ERROR_NOENT, "No such import job running");
+	}
 }
 
 static gboolean
@@ -847,6 +1456,52 @@ xmms_medialib_get_id (xmms_medialib_session_t *session, const char *url, xmms_er
 	return id;
 }
 
+/**
+ * Add an url found by an import. If the entry is already there but
+ * the size or modification time found differs from what was read
+ * from the file, the entry is marked for rehashing instead.
+ *
+ * @param size The size of the file, -1 if not known.
+ * @param lmod The modification time of the file, -1 if not known.
+ */
+xmms_medialib_import_result_t
+xmms_medialib_entry_import (xmms_medialib_session_t *session, const gchar *url,
+                            gint size, gint lmod, xmms_error_t *error)
+{
+	xmms_medialib_entry_t entry;
+	gint old_size, old_lmod;
+
+	g_return_val_if_fail (url, XMMS_MEDIALIB_IMPORT_FAILED);
+
+	entry = xmms_medialib_get_id (session, url, error);
+	if (!entry) {
+		entry = xmms_medialib_entry_new_encoded (session, url, error);
+		return entry ? XMMS_MEDIALIB_IMPORT_ADDED : XMMS_MEDIALIB_IMPORT_FAILED;
+	}
+
+	if (size < 0 || lmod < 0) {
+		return XMMS_MEDIALIB_IMPORT_UNCHANGED;
+	}
+
+	old_size = xmms_medialib_entry_property_get_int (session, entry,
+	                                                 XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE);
+	old_lmod = xmms_medialib_entry_property_get_int (session, entry,
+	                                                 XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD);
+
+	/* not read yet, mediainfo will get to it */
+	if (old_size < 0 || old_lmod < 0) {
+		return XMMS_MEDIALIB_IMPORT_UNCHANGED;
+	}
+
+	if (old_size == size && old_lmod == lmod) {
+		return XMMS_MEDIALIB_IMPORT_UNCHANGED;
+	}
+
+	xmms_medialib_entry_status_set (session, entry, XMMS_MEDIALIB_ENTRY_STATUS_REHASH);
+
+	return XMMS_MEDIALIB_IMPORT_CHANGED;
+}
+
 xmms_medialib_entry_t
 xmms_medialib_entry_new_encoded (xmms_medialib_session_t *session,
                                  const gchar *url, xmms_error_t *error)
@@ -1047,6 +1702,8 @@ xmms_medialib_client_add_entry (xmms_medialib_t *medialib, const gchar *url,
 		session = xmms_medialib_session_begin (medialib);
 		xmms_medialib_entry_new_encoded (session, url, error);
 	} while (!xmms_medialib_session_commit (session));
+
+	xmms_xform_browse_invalidate (url, TRUE);
 }
 
 /**
@@ -1123,6 +1780,167 @@ xmms_medialib_client_set_property_int (xmms_medialib_t *medialib,
 	} while (!xmms_medialib_session_commit (session));
 }
 
+/**
+ * Check that a client supplied property value is a string or an
+ * integer, the only types the medialib stores.
+ */
+static gboolean
+xmms_medialib_property_value_is_valid (xmmsv_t *value)
+{
+	return xmmsv_is_type (value, XMMSV_TYPE_STRING) ||
+	       xmmsv_is_type (value, XMMSV_TYPE_INT64);
+}
+
+static void
+xmms_medialib_property_set_value (xmms_medialib_session_t *session,
+                                  xmms_medialib_entry_t entry,
+                                  const gchar *source, const gchar *key,
+                                  xmmsv_t *value)
+{
+	const gchar *str;
+	gint32 i;
+
+	if (xmmsv_get_string (value, &str)) {
+		xmms_medialib_entry_property_set_str_source (session, entry, key,
+		                                             str, source);
+	} else if (xmmsv_get_int (value, &i)) {
+		xmms_medialib_entry_property_set_int_source (session, entry, key,
+		                                             i, source);
+	}
+}
+
+/**
+ * Set many properties of one entry in one transaction, so only one
+ * change is broadcast for the entry.
+ */
+static void
+xmms_medialib_client_set_properties (xmms_medialib_t *medialib,
+                                     xmms_medialib_entry_t entry,
+                                     const gchar *source, xmmsv_t *properties,
+                                     xmms_error_t *error)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_dict_iter_t *it;
+	const gchar *key;
+	xmmsv_t *value;
+
+	if (g_ascii_strcasecmp (source, "server") == 0) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, "Can't write to source server!");
+		return;
+	}
+
+	xmmsv_get_dict_iter (properties, &it);
+	while (xmmsv_dict_iter_pair (it, &key, &value)) {
+		if (!xmms_medialib_property_value_is_valid (value)) {
+			xmms_error_set (error, XMMS_ERROR_INVAL,
+			                "Property values must be strings or integers");
+			return;
+		}
+		xmmsv_dict_iter_next (it);
+	}
+
+	do {
+		session = xmms_medialib_session_begin (medialib);
+
+		if (!xmms_medialib_check_id (session, entry)) {
+			xmms_error_set (error, XMMS_ERROR_NOENT, "No such entry");
+			xmms_medialib_session_abort (session);
+			return;
+		}
+
+		xmmsv_dict_iter_first (it);
+		while (xmmsv_dict_iter_pair (it, &key, &value)) {
+			xmms_medialib_property_set_value (session, entry, source, key, value);
+			xmmsv_dict_iter_next (it);
+		}
+	} while (!xmms_medialib_session_commit (session));
+}
+
+/**
+ * Set one property on many entries in one transaction. Either all of
+ * the entries are changed or, if one of them does not exist, none.
+ */
+static void
+xmms_medialib_client_set_property_entries (xmms_medialib_t *medialib,
+                                           xmmsv_t *ids, const gchar *source,
+                                           const gchar *key, xmmsv_t *value,
+                                           xmms_error_t *error)
+{
+	xmms_medialib_session_t *session;
+	gint32 entry;
+	gint i;
+
+	if (g_ascii_strcasecmp (source, "server") == 0) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, "Can't write to source server!");
+		return;
+	}
+
+	if (!xmms_medialib_property_value_is_valid (value)) {
+		xmms_error_set (error, XMMS_ERROR_INVAL,
+		                "Property values must be strings or integers");
+		return;
+	}
+
+	do {
+		session = xmms_medialib_session_begin (medialib);
+
+		for (i = 0; xmmsv_list_get_int (ids, i, &entry); i++) {
+			if (!xmms_medialib_check_id (session, entry)) {
+				xmms_error_set (error, XMMS_ERROR_NOENT, "No such entry");
+				xmms_medialib_session_abort (session);
+				return;
+			}
+			xmms_medialib_property_set_value (session, entry, source, key, value);
+		}
+	} while (!xmms_medialib_session_commit (session));
+}
+
+/**
+ * Add many URLs to the medialib in one transaction. Either all of
+ * them are added or, if one of them is rejected, none.
+ *
+ * @returns The ids of the entries, in the order of the urls.
+ */
+static xmmsv_t *
+xmms_medialib_client_add_entries (xmms_medialib_t *medialib, xmmsv_t *urls,
+                                  xmms_error_t *error)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	const gchar *url;
+	xmmsv_t *ret;
+	gint i;
+
+	do {
+		session = xmms_medialib_session_begin (medialib);
+		ret = xmmsv_new_list ();
+
+		for (i = 0; xmmsv_list_get_string (urls, i, &url); i++) {
+			entry = xmms_medialib_entry_new_encoded (session, url, error);
+			if (!entry) {
+				if (!xmms_error_iserror (error)) {
+					xmms_error_set (error, XMMS_ERROR_INVAL, "Invalid url");
+				}
+				xmms_medialib_session_abort (session);
+				xmmsv_unref (ret);
+				return NULL;
+			}
+			xmmsv_list_append_int (ret, entry);
+		}
+
+		if (!xmms_medialib_session_commit (session)) {
+			xmmsv_unref (ret);
+			ret = NULL;
+		}
+	} while (ret == NULL);
+
+	for (i = 0; xmmsv_list_get_string (urls, i, &url); i++) {
+		xmms_xform_browse_invalidate (url, TRUE);
+	}
+
+	return ret;
+}
+
 static void
 xmms_medialib_property_remove (xmms_medialib_session_t *session,
                                xmms_medialib_entry_t entry,
@@ -1173,6 +1991,229 @@ xmms_medialib_client_remove_property (xmms_medialib_t *medialib,
 	} while (!xmms_medialib_session_commit (session));
 }
 
+/**
+ * Tell which keys are indexed and how many filters ran on each, so
+ * the keys worth adding to medialib.indices stand out.
+ *
+ * @returns A dict from key to a dict with "indexed" and "filters".
+ */
+static xmmsv_t *
+xmms_medialib_client_index_stats (xmms_medialib_t *medialib,
+                                  xmms_error_t *error)
+{
+	GHashTableIter iter;
+	gpointer key, count;
+	xmmsv_t *ret, *usage;
+
+	ret = xmmsv_new_dict ();
+
+	g_mutex_lock (&medialib->index_mutex);
+
+	g_hash_table_iter_init (&iter, medialib->indices);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		count = g_hash_table_lookup (medialib->index_usage, key);
+		usage = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("indexed", 1),
+		                          XMMSV_DICT_ENTRY_INT ("filters", GPOINTER_TO_UINT (count)),
+		                          XMMSV_DICT_END);
+		xmmsv_dict_set (ret, key, usage);
+		xmmsv_unref (usage);
+	}
+
+	g_hash_table_iter_init (&iter, medialib->index_usage);
+	while (g_hash_table_iter_next (&iter, &key, &count)) {
+		if (g_hash_table_contains (medialib->indices, key)) {
+			continue;
+		}
+		usage = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("indexed", 0),
+		                          XMMSV_DICT_ENTRY_INT ("filters", GPOINTER_TO_UINT (count)),
+		                          XMMSV_DICT_END);
+		xmmsv_dict_set (ret, key, usage);
+		xmmsv_unref (usage);
+	}
+
+	g_mutex_unlock (&medialib->index_mutex);
+
+	return ret;
+}
+
+/**
+ * Complete a prefix of a value of key from the token index.
+ */
+static xmmsv_t *
+xmms_medialib_client_complete (xmms_medialib_t *medialib, const gchar *key,
+                               const gchar *prefix, gint32 limit,
+                               xmms_error_t *error)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_t *ret;
+
+	if (!xmms_token_index_has_key (medialib->token_index, key)) {
+		xmms_error_set (error, XMMS_ERROR_INVAL,
+		                "key isn't in medialib.token_index_keys");
+		return NULL;
+	}
+
+	if (limit <= 0) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "limit must be positive");
+		return NULL;
+	}
+
+	/* only fails on a change committed while the session began */
+	do {
+		session = xmms_medialib_session_begin_ro (medialib);
+		ret = xmms_token_index_complete (medialib->token_index, session, key, prefix,
+		                                 MIN (limit, XMMS_MEDIALIB_COMPLETE_MAX));
+		if (!ret) {
+			xmms_medialib_session_abort (session);
+		}
+	} while (!ret || !xmms_medialib_session_commit (session));
+
+	return ret;
+}
+
+/**
+ * Size of the database file and the log of changes kept next to it.
+ */
+static gint64
+xmms_medialib_database_size (void)
+{
+	xmms_config_property_t *cfg;
+	const gchar *path;
+	gchar *log_path;
+	struct stat st;
+	gint64 size = 0;
+
+	cfg = xmms_config_lookup ("medialib.path");
+	path = xmms_config_property_get_string (cfg);
+
+	if (g_stat (path, &st) == 0) {
+		size += st.st_size;
+	}
+
+	log_path = g_strconcat (path, ".log", NULL);
+	if (g_stat (log_path, &st) == 0) {
+		size += st.st_size;
+	}
+	g_free (log_path);
+
+	return size;
+}
+
+/**
+ * Rewrite the database from what it holds now, which leaves out data
+ * removed since it was written last and truncates the log.
+ */
+static xmmsv_t *
+xmms_medialib_client_compact (xmms_medialib_t *medialib, xmms_error_t *error)
+{
+	gint64 before, after;
+
+	before = xmms_medialib_database_size ();
+
+	XMMS_TRACE_BEGIN ("medialib.compact");
+	s4_sync (medialib->s4);
+	XMMS_TRACE_END ("medialib.compact");
+
+	after = xmms_medialib_database_size ();
+
+	xmms_log_info ("Compacted the medialib from %" G_GINT64_FORMAT
+	               " to %" G_GINT64_FORMAT " bytes.", before, after);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("before", before),
+	                         XMMSV_DICT_ENTRY_INT ("after", after),
+	                         XMMSV_DICT_END);
+}
+
+typedef struct xmms_medialib_dump_job_St {
+	gchar *path;
+	gboolean restore;
+	gint32 client;
+	uint32_t cookie;
+} xmms_medialib_dump_job_t;
+
+static void
+xmms_medialib_dump_worker (gpointer data, gpointer udata)
+{
+	xmms_medialib_dump_job_t *job = data;
+	xmms_medialib_t *medialib = udata;
+	xmms_ipc_msg_t *msg;
+	xmms_error_t err, senderr;
+	xmmsv_t *val;
+	gint32 count;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	xmms_error_reset (&err);
+
+	if (job->restore) {
+		count = xmms_medialib_restore (medialib, job->path, &err);
+	} else {
+		count = xmms_medialib_dump (medialib, job->path, &err);
+	}
+
+	if (xmms_error_isok (&err)) {
+		val = xmmsv_new_int (count);
+		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MEDIALIB, XMMS_IPC_COMMAND_REPLY);
+	} else {
+		val = xmmsv_new_error (xmms_error_message_get (&err));
+		msg = xmms_ipc_msg_new (XMMS_IPC_OBJECT_MEDIALIB, XMMS_IPC_COMMAND_ERROR);
+	}
+	xmms_ipc_msg_put_value (msg, val);
+	xmmsv_unref (val);
+
+	xmms_ipc_msg_set_cookie (msg, job->cookie);
+
+	/* fails if the client went away meanwhile */
+	xmms_error_reset (&senderr);
+	xmms_ipc_send_message (job->client, msg, &senderr);
+
+	g_free (job->path);
+	g_free (job);
+}
+
+static void
+xmms_medialib_dump_push (xmms_medialib_t *medialib, const gchar *path,
+                         gboolean restore, gint32 client, uint32_t cookie,
+                         xmms_error_t *error)
+{
+	xmms_medialib_dump_job_t *job;
+
+	if (!g_path_is_absolute (path)) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Path must be absolute");
+		return;
+	}
+
+	job = g_new0 (xmms_medialib_dump_job_t, 1);
+	job->path = g_strdup (path);
+	job->restore = restore;
+	job->client = client;
+	job->cookie = cookie;
+
+	g_thread_pool_push (medialib->dumper, job, NULL);
+}
+
+/**
+ * Dump the medialib to a file from a thread of its own, replying when
+ * it is written.
+ */
+static void
+xmms_medialib_client_dump (xmms_medialib_t *medialib, const gchar *path,
+                           gint32 client, uint32_t cookie, xmms_error_t *error)
+{
+	xmms_medialib_dump_push (medialib, path, FALSE, client, cookie, error);
+}
+
+/**
+ * Add the entries of a dump from a thread of its own, replying when
+ * they are in.
+ */
+static void
+xmms_medialib_client_restore (xmms_medialib_t *medialib, const gchar *path,
+                              gint32 client, uint32_t cookie, xmms_error_t *error)
+{
+	xmms_medialib_dump_push (medialib, path, TRUE, client, cookie, error);
+}
+
 /** @} */
 
 /**
@@ -1227,11 +2268,6 @@ xmms_medialib_query_random_id (xmms_medialib_session_t *session,
 	return ret;
 }
 
-/**
- * @internal
- * Get the next unresolved entry. Used by the mediainfo reader..
- */
-
 static s4_resultset_t *
 not_resolved_set (xmms_medialib_session_t *session)
 {
@@ -1274,34 +2310,165 @@ not_resolved_set (xmms_medialib_session_t *session)
 	return ret;
 }
 
-xmms_medialib_entry_t
-xmms_medialib_entry_not_resolved_get (xmms_medialib_session_t *session)
+static void
+xmms_medialib_pending_add (xmms_medialib_t *medialib, xmms_medialib_entry_t entry)
 {
+	if (g_hash_table_lookup (medialib->pending_links, GINT_TO_POINTER (entry))) {
+		return;
+	}
+
+	g_queue_push_tail (&medialib->pending, GINT_TO_POINTER (entry));
+	g_hash_table_insert (medialib->pending_links, GINT_TO_POINTER (entry),
+	                     g_queue_peek_tail_link (&medialib->pending));
+}
+
+static void
+xmms_medialib_pending_remove (xmms_medialib_t *medialib, xmms_medialib_entry_t entry)
+{
+	GList *link;
+
+	link = g_hash_table_lookup (medialib->pending_links, GINT_TO_POINTER (entry));
+	if (link) {
+		g_queue_delete_link (&medialib->pending, link);
+		g_hash_table_remove (medialib->pending_links, GINT_TO_POINTER (entry));
+	}
+}
+
+/**
+ * @internal
+ * Fill the unresolved entries from the database, the only time it is
+ * queried for them. Later changes come from committed sessions.
+ */
+static void
+xmms_medialib_pending_scan (xmms_medialib_t *medialib)
+{
+	xmms_medialib_session_t *session;
 	const s4_result_t *res;
 	s4_resultset_t *set;
-	gint32 ret = 0;
+	gint row, rows;
+
+	session = xmms_medialib_session_begin_ro (medialib);
 
 	set = not_resolved_set (session);
-	res = s4_resultset_get_result (set, 0, 0);
+	rows = s4_resultset_get_rowcount (set);
 
-	if (res != NULL) {
-		s4_val_get_int (s4_result_get_val (res), &ret);
+	g_mutex_lock (&medialib->pending_mutex);
+	for (row = 0; row < rows; row++) {
+		gint32 id;
+
+		res = s4_resultset_get_result (set, row, 0);
+		if (res != NULL && s4_val_get_int (s4_result_get_val (res), &id)) {
+			xmms_medialib_pending_add (medialib, id);
+		}
 	}
+	g_mutex_unlock (&medialib->pending_mutex);
 
 	s4_resultset_free (set);
+	xmms_medialib_session_abort (session);
+}
+
+/**
+ * @internal
+ * Apply the status changes of a committed session to the unresolved
+ * entries.
+ *
+ * @param statuses The new status of each entry it was set for
+ * @param removed The entries removed, or NULL
+ */
+void
+xmms_medialib_pending_update (xmms_medialib_t *medialib,
+                              GHashTable *statuses, GHashTable *removed)
+{
+	GHashTableIter iter;
+	gpointer key, value;
+
+	g_mutex_lock (&medialib->pending_mutex);
+
+	if (statuses != NULL) {
+		g_hash_table_iter_init (&iter, statuses);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			gint status = GPOINTER_TO_INT (value);
+
+			if (status == XMMS_MEDIALIB_ENTRY_STATUS_NEW ||
+			    status == XMMS_MEDIALIB_ENTRY_STATUS_REHASH) {
+				xmms_medialib_pending_add (medialib, GPOINTER_TO_INT (key));
+			} else {
+				xmms_medialib_pending_remove (medialib, GPOINTER_TO_INT (key));
+			}
+		}
+	}
+
+	if (removed != NULL) {
+		g_hash_table_iter_init (&iter, removed);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			xmms_medialib_pending_remove (medialib, GPOINTER_TO_INT (key));
+		}
+	}
+
+	g_mutex_unlock (&medialib->pending_mutex);
+}
+
+/**
+ * @internal
+ * Get the next unresolved entry. Used by the mediainfo reader..
+ */
+xmms_medialib_entry_t
+xmms_medialib_entry_not_resolved_get (xmms_medialib_session_t *session)
+{
+	xmms_medialib_t *medialib;
+	xmms_medialib_entry_t ret;
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	g_mutex_lock (&medialib->pending_mutex);
+	ret = GPOINTER_TO_INT (g_queue_peek_head (&medialib->pending));
+	g_mutex_unlock (&medialib->pending_mutex);
 
 	return ret;
 }
 
+/**
+ * Fetch up to max entries that need to be resolved, the ones waiting
+ * the longest first. They stay unresolved until a session setting
+ * their status commits.
+ *
+ * @param session The medialib session to query in
+ * @param entries Array of at least max elements to store the ids in
+ * @param max Number of entries to fetch at most
+ * @returns the number of entries stored
+ */
+guint
+xmms_medialib_entry_not_resolved_get_many (xmms_medialib_session_t *session,
+                                           xmms_medialib_entry_t *entries,
+                                           guint max)
+{
+	xmms_medialib_t *medialib;
+	GList *link;
+	guint count = 0;
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	g_mutex_lock (&medialib->pending_mutex);
+	for (link = g_queue_peek_head_link (&medialib->pending);
+	     link != NULL && count < max; link = link->next) {
+		entries[count++] = GPOINTER_TO_INT (link->data);
+	}
+	g_mutex_unlock (&medialib->pending_mutex);
+
+	return count;
+}
+
 guint
 xmms_medialib_num_not_resolved (xmms_medialib_session_t *session)
 {
-	s4_resultset_t *set;
-	gint ret = 0;
+	xmms_medialib_t *medialib;
+	guint ret;
 
-	set = not_resolved_set (session);
-	ret = s4_resultset_get_rowcount (set);
-	s4_resultset_free (set);
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	g_mutex_lock (&medialib->pending_mutex);
+	ret = g_queue_get_length (&medialib->pending);
+	g_mutex_unlock (&medialib->pending_mutex);
 
 	return ret;
 }
@@ -1397,33 +2564,48 @@ xmmsv_t *
 xmms_medialib_query (xmms_medialib_session_t *session, xmmsv_t *coll,
                      xmmsv_t *fetch, xmms_error_t *err)
 {
-	s4_sourcepref_t *sourcepref;
-	s4_resultset_t *set;
+	xmms_plan_cache_t *cache;
+	xmms_medialib_plan_t *plan = NULL;
 	xmmsv_t *ret;
-	xmms_fetch_info_t *info;
-	xmms_fetch_spec_t *spec;
+	GBytes *key;
+	guint generation;
 
 	xmms_error_reset (err);
 
-	sourcepref = xmms_medialib_session_get_source_preferences (session);
+	cache = xmms_medialib_session_get_plan_cache (session);
 
-	info = xmms_fetch_info_new (sourcepref);
-	spec = xmms_fetch_spec_new (fetch, info, sourcepref, err);
+	/* a writing session only gets the plans that don't depend on data */
+	if (!xmms_medialib_session_get_generation (session, &generation)) {
+		generation = XMMS_PLAN_CACHE_STATIC;
+	}
 
-	s4_sourcepref_unref (sourcepref);
+	key = xmms_plan_cache_key (coll, fetch);
+	if (key) {
+		plan = xmms_plan_cache_take (cache, key, generation);
+	}
+
+	if (!plan) {
+		plan = xmms_medialib_plan_new (session, coll, fetch, err);
+	}
 
-	if (spec == NULL) {
-		xmms_fetch_spec_free (spec);
-		xmms_fetch_info_free (info);
+	if (!plan) {
+		if (key) {
+			g_bytes_unref (key);
+		}
 		return NULL;
 	}
 
-	set = xmms_medialib_query_recurs (session, coll, info);
-	ret = xmms_medialib_query_to_xmmsv (set, spec);
-	s4_resultset_free (set);
+	ret = xmms_medialib_plan_run (session, plan);
 
-	xmms_fetch_spec_free (spec);
-	xmms_fetch_info_free (info);
+	if (key && xmms_medialib_plan_get_generation (plan, &generation)) {
+		xmms_plan_cache_put (cache, key, generation, plan);
+	} else {
+		xmms_medialib_plan_free (plan);
+	}
+
+	if (key) {
+		g_bytes_unref (key);
+	}
 
 	if (ret == NULL) {
 		if (err) {
@@ -0,0 +1,522 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmmspriv/xmms_medialib.h>
+#include <xmms/xmms_log.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+/**
+ * @file
+ * Dumping the medialib to a file and restoring it, online.
+ *
+ * The dump is a line of text per property of an entry, the lines of
+ * an entry following each other:
+ *
+ *   <id> TAB <key> TAB <source> TAB i|s TAB <value>
+ *
+ * after a header line, with tabs, newlines and backslashes in keys,
+ * sources and values escaped by a backslash. Entries are read in
+ * ranges of ids, each in a read-only session of its own, so neither
+ * the dump nor the restore holds the database for long. Restoring
+ * keeps the ids of entries whose url is known and adds the others
+ * with new ids.
+ */
+
+#define XMMS_MEDIALIB_DUMP_HEADER "# xmms2 medialib dump 1"
+
+/* Ids read per session while dumping */
+#define XMMS_MEDIALIB_DUMP_BATCH 512
+
+/* Entries written per session while restoring */
+#define XMMS_MEDIALIB_RESTORE_BATCH 128
+
+typedef struct xmms_medialib_dump_range_St {
+	gint32 first;
+	gint32 last;
+} xmms_medialib_dump_range_t;
+
+typedef struct xmms_medialib_dump_prop_St {
+	gchar *key;
+	gchar *source;
+	gboolean is_int;
+	gint32 ival;
+	gchar *sval;
+} xmms_medialib_dump_prop_t;
+
+typedef struct xmms_medialib_dump_entry_St {
+	gchar *url;
+	GPtrArray *props;
+} xmms_medialib_dump_entry_t;
+
+static gint
+xmms_medialib_dump_range_filter (const s4_val_t *value, s4_condition_t *cond)
+{
+	xmms_medialib_dump_range_t *range;
+	gint32 ival;
+
+	if (!s4_val_get_int (value, &ival)) {
+		return 1;
+	}
+
+	range = s4_cond_get_funcdata (cond);
+
+	if (ival < range->first) {
+		return -1;
+	}
+	if (ival > range->last) {
+		return 1;
+	}
+	return 0;
+}
+
+static void
+xmms_medialib_dump_escape (GString *out, const gchar *str)
+{
+	for (; *str; str++) {
+		switch (*str) {
+			case '\t':
+				g_string_append (out, "\\t");
+				break;
+			case '\n':
+				g_string_append (out, "\\n");
+				break;
+			case '\r':
+				g_string_append (out, "\\r");
+				break;
+			case '\\':
+				g_string_append (out, "\\\\");
+				break;
+			default:
+				g_string_append_c (out, *str);
+				break;
+		}
+	}
+}
+
+/** Undo #xmms_medialib_dump_escape in place. */
+static void
+xmms_medialib_dump_unescape (gchar *str)
+{
+	gchar *out = str;
+
+	for (; *str; str++) {
+		if (*str == '\\' && str[1]) {
+			str++;
+			switch (*str) {
+				case 't':
+					*out++ = '\t';
+					break;
+				case 'n':
+					*out++ = '\n';
+					break;
+				case 'r':
+					*out++ = '\r';
+					break;
+				default:
+					*out++ = *str;
+					break;
+			}
+		} else {
+			*out++ = *str;
+		}
+	}
+
+	*out = '\0';
+}
+
+/** Append the lines of the entries of a range of ids. */
+static gint
+xmms_medialib_dump_range (xmms_medialib_session_t *session,
+                          xmms_medialib_dump_range_t *range, GString *out)
+{
+	s4_sourcepref_t *sourcepref;
+	s4_condition_t *cond;
+	s4_fetchspec_t *spec;
+	s4_resultset_t *set;
+	const s4_resultrow_t *row;
+	gint i, count = 0;
+
+	sourcepref = xmms_medialib_session_get_source_preferences (session);
+	cond = s4_cond_new_custom_filter (xmms_medialib_dump_range_filter, range,
+	                                  NULL, "song_id", sourcepref, 0, 1,
+	                                  S4_COND_PARENT);
+	spec = s4_fetchspec_create ();
+	s4_fetchspec_add (spec, NULL, sourcepref, S4_FETCH_PARENT | S4_FETCH_DATA);
+	s4_sourcepref_unref (sourcepref);
+
+	set = xmms_medialib_session_query (session, spec, cond);
+
+	s4_cond_free (cond);
+	s4_fetchspec_free (spec);
+
+	for (i = 0; s4_resultset_get_row (set, i, &row); i++) {
+		const s4_result_t *res, *first;
+		gint32 id = 0;
+
+		if (!s4_resultrow_get_col (row, 0, &res)) {
+			continue;
+		}
+
+		/* the parent is the id, it has no source */
+		for (first = res; res; res = s4_result_next (res)) {
+			if (!s4_result_get_src (res)) {
+				s4_val_get_int (s4_result_get_val (res), &id);
+			}
+		}
+
+		for (res = first; res; res = s4_result_next (res)) {
+			const s4_val_t *val = s4_result_get_val (res);
+			const gchar *key, *src, *s;
+			gint32 ival;
+
+			key = s4_result_get_key (res);
+			src = s4_result_get_src (res);
+
+			if (!src) {
+				continue;
+			}
+
+			g_string_append_printf (out, "%d\t", id);
+			xmms_medialib_dump_escape (out, key);
+			g_string_append_c (out, '\t');
+			xmms_medialib_dump_escape (out, src);
+
+			if (s4_val_get_int (val, &ival)) {
+				g_string_append_printf (out, "\ti\t%d\n", ival);
+			} else if (s4_val_get_str (val, &s)) {
+				g_string_append (out, "\ts\t");
+				xmms_medialib_dump_escape (out, s);
+				g_string_append_c (out, '\n');
+			}
+		}
+
+		count++;
+	}
+
+	s4_resultset_free (set);
+
+	return count;
+}
+
+/**
+ * Write all entries and their properties to a file. Other sessions go
+ * on meanwhile, an entry is dumped as it was at some point during the
+ * dump. The file is only replaced once the dump is complete.
+ *
+ * @returns The number of entries dumped, -1 on error.
+ */
+gint32
+xmms_medialib_dump (xmms_medialib_t *medialib, const gchar *path,
+                    xmms_error_t *err)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_dump_range_t range;
+	gint32 highest = 0, count = 0;
+	GString *out;
+	gchar *tmp;
+	FILE *fp;
+
+	g_return_val_if_fail (path, -1);
+
+	tmp = g_strconcat (path, ".tmp", NULL);
+	fp = g_fopen (tmp, "w");
+	if (!fp) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, g_strerror (errno));
+		g_free (tmp);
+		return -1;
+	}
+
+	do {
+		session = xmms_medialib_session_begin_ro (medialib);
+		highest = xmms_medialib_highest_id (session);
+	} while (!xmms_medialib_session_commit (session));
+
+	out = g_string_new (XMMS_MEDIALIB_DUMP_HEADER "\n");
+
+	for (range.first = 1; range.first <= highest;
+	     range.first += XMMS_MEDIALIB_DUMP_BATCH) {
+		gint n;
+
+		range.last = range.first + XMMS_MEDIALIB_DUMP_BATCH - 1;
+
+		do {
+			g_string_truncate (out, 0);
+			session = xmms_medialib_session_begin_ro (medialib);
+			n = xmms_medialib_dump_range (session, &range, out);
+		} while (!xmms_medialib_session_commit (session));
+
+		if (fwrite (out->str, 1, out->len, fp) != out->len) {
+			break;
+		}
+
+		count += n;
+	}
+
+	g_string_free (out, TRUE);
+
+	if (range.first <= highest || fclose (fp) != 0) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, g_strerror (errno));
+		if (range.first <= highest) {
+			fclose (fp);
+		}
+		g_unlink (tmp);
+		g_free (tmp);
+		return -1;
+	}
+
+	if (g_rename (tmp, path) != 0) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, g_strerror (errno));
+		g_unlink (tmp);
+		g_free (tmp);
+		return -1;
+	}
+
+	g_free (tmp);
+
+	xmms_log_info ("Dumped %d medialib entries to %s", count, path);
+
+	return count;
+}
+
+static void
+xmms_medialib_dump_prop_free (gpointer data)
+{
+	xmms_medialib_dump_prop_t *prop = data;
+
+	g_free (prop->key);
+	g_free (prop->source);
+	g_free (prop->sval);
+	g_free (prop);
+}
+
+static void
+xmms_medialib_dump_entry_free (gpointer data)
+{
+	xmms_medialib_dump_entry_t *entry = data;
+
+	g_ptr_array_free (entry->props, TRUE);
+	g_free (entry);
+}
+
+/**
+ * Parse a line of a dump.
+ *
+ * @returns The property, NULL if the line is broken.
+ */
+static xmms_medialib_dump_prop_t *
+xmms_medialib_dump_parse (gchar *line, gint32 *id)
+{
+	xmms_medialib_dump_prop_t *prop;
+	gchar **fields;
+	gchar *end;
+
+	fields = g_strsplit (line, "\t", 5);
+	if (g_strv_length (fields) != 5 || strlen (fields[3]) != 1 ||
+	    (fields[3][0] != 'i' && fields[3][0] != 's')) {
+		g_strfreev (fields);
+		return NULL;
+	}
+
+	*id = strtol (fields[0], &end, 10);
+	if (*end || *id <= 0) {
+		g_strfreev (fields);
+		return NULL;
+	}
+
+	prop = g_new0 (xmms_medialib_dump_prop_t, 1);
+	xmms_medialib_dump_unescape (fields[1]);
+	xmms_medialib_dump_unescape (fields[2]);
+	prop->key = g_strdup (fields[1]);
+	prop->source = g_strdup (fields[2]);
+
+	if (fields[3][0] == 'i') {
+		prop->is_int = TRUE;
+		prop->ival = strtol (fields[4], NULL, 10);
+	} else {
+		xmms_medialib_dump_unescape (fields[4]);
+		prop->sval = g_strdup (fields[4]);
+	}
+
+	g_strfreev (fields);
+
+	return prop;
+}
+
+/** Write a batch of entries, retried as a whole on conflicts. */
+static void
+xmms_medialib_restore_batch (xmms_medialib_t *medialib, GPtrArray *batch)
+{
+	xmms_medialib_session_t *session;
+	xmms_error_t err;
+	guint i, j;
+
+	do {
+		session = xmms_medialib_session_begin (medialib);
+
+		for (i = 0; i < batch->len; i++) {
+			xmms_medialib_dump_entry_t *dumped = g_ptr_array_index (batch, i);
+			xmms_medialib_entry_t entry;
+
+			xmms_error_reset (&err);
+			entry = xmms_medialib_entry_new_encoded (session, dumped->url, &err);
+			if (!entry) {
+				continue;
+			}
+
+			for (j = 0; j < dumped->props->len; j++) {
+				xmms_medialib_dump_prop_t *prop = g_ptr_array_index (dumped->props, j);
+
+				if (prop->is_int) {
+					xmms_medialib_entry_property_set_int_source (session, entry,
+					                                             prop->key, prop->ival,
+					                                             prop->source);
+				} else {
+					xmms_medialib_entry_property_set_str_source (session, entry,
+					                                             prop->key, prop->sval,
+					                                             prop->source);
+				}
+			}
+		}
+	} while (!xmms_medialib_session_commit (session));
+
+	g_ptr_array_set_size (batch, 0);
+}
+
+/** Queue an entry read from the dump, dropped if it has no url. */
+static gint
+xmms_medialib_restore_add (xmms_medialib_t *medialib, GPtrArray *batch,
+                           xmms_medialib_dump_entry_t *entry)
+{
+	if (!entry->url) {
+		xmms_medialib_dump_entry_free (entry);
+		return 0;
+	}
+
+	g_ptr_array_add (batch, entry);
+
+	if (batch->len >= XMMS_MEDIALIB_RESTORE_BATCH) {
+		xmms_medialib_restore_batch (medialib, batch);
+	}
+
+	return 1;
+}
+
+/**
+ * Add the entries of a dump made by #xmms_medialib_dump. Entries
+ * already in the medialib get the properties of the dump on top of
+ * their own.
+ *
+ * @returns The number of entries restored, -1 on error.
+ */
+gint32
+xmms_medialib_restore (xmms_medialib_t *medialib, const gchar *path,
+                       xmms_error_t *err)
+{
+	xmms_medialib_dump_entry_t *entry = NULL;
+	GIOChannel *chan;
+	GPtrArray *batch;
+	GError *error = NULL;
+	GString *line;
+	GIOStatus status;
+	gint32 id, last_id = 0, count = 0;
+	gboolean header = TRUE;
+
+	g_return_val_if_fail (path, -1);
+
+	chan = g_io_channel_new_file (path, "r", &error);
+	if (!chan) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, error->message);
+		g_error_free (error);
+		return -1;
+	}
+	/* the values are whatever was stored */
+	g_io_channel_set_encoding (chan, NULL, NULL);
+
+	batch = g_ptr_array_new_with_free_func (xmms_medialib_dump_entry_free);
+	line = g_string_new (NULL);
+
+	while ((status = g_io_channel_read_line_string (chan, line, NULL, &error)) == G_IO_STATUS_NORMAL) {
+		xmms_medialib_dump_prop_t *prop;
+
+		if (line->len && line->str[line->len - 1] == '\n') {
+			g_string_truncate (line, line->len - 1);
+		}
+
+		if (header) {
+			header = FALSE;
+			if (strcmp (line->str, XMMS_MEDIALIB_DUMP_HEADER) != 0) {
+				xmms_error_set (err, XMMS_ERROR_INVAL, "Not a medialib dump");
+				break;
+			}
+			continue;
+		}
+
+		prop = xmms_medialib_dump_parse (line->str, &id);
+		if (!prop) {
+			XMMS_DBG ("Skipping broken line in %s", path);
+			continue;
+		}
+
+		if (!entry || id != last_id) {
+			if (entry) {
+				count += xmms_medialib_restore_add (medialib, batch, entry);
+			}
+			entry = g_new0 (xmms_medialib_dump_entry_t, 1);
+			entry->props = g_ptr_array_new_with_free_func (xmms_medialib_dump_prop_free);
+			last_id = id;
+		}
+
+		/* the entry is made with it */
+		if (!prop->is_int && strcmp (prop->key, XMMS_MEDIALIB_ENTRY_PROPERTY_URL) == 0) {
+			g_free (entry->url);
+			entry->url = g_strdup (prop->sval);
+			xmms_medialib_dump_prop_free (prop);
+		} else {
+			g_ptr_array_add (entry->props, prop);
+		}
+	}
+
+	if (status == G_IO_STATUS_ERROR) {
+		xmms_error_set (err, XMMS_ERROR_GENERIC, error->message);
+		g_error_free (error);
+	}
+
+	if (entry) {
+		count += xmms_medialib_restore_add (medialib, batch, entry);
+	}
+
+	/* what was read before an error still goes in */
+	xmms_medialib_restore_batch (medialib, batch);
+
+	g_ptr_array_free (batch, TRUE);
+	g_string_free (line, TRUE);
+	g_io_channel_unref (chan);
+
+	if (xmms_error_iserror (err)) {
+		return -1;
+	}
+
+	xmms_log_info ("Restored %d medialib entries from %s", count, path);
+
+	return count;
+}
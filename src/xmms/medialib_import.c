@@ -0,0 +1,834 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_xform.h>
+#include <xmmspriv/xmms_realtime.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmms/xmms_object.h>
+#include <xmms/xmms_config.h>
+#include <xmms/xmms_ipc.h>
+#include <xmms/xmms_log.h>
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+/**
+ * @file
+ * Background jobs for medialib import_path.
+ *
+ * Directories of a job are browsed by a pool of worker threads, each
+ * subdirectory found being queued as a new task. Files are collected
+ * and added to the medialib in batches, one session per batch. Files
+ * already in the medialib are only marked for rehashing when the size
+ * or modification time reported by the browse differs.
+ *
+ * A rehash job does the same check for every entry in the medialib,
+ * stat'ing the files itself, in a thread of its own that only runs
+ * when the CPU is otherwise idle.
+ */
+
+/* Files added per medialib session */
+#define XMMS_IMPORT_BATCH_SIZE 256
+
+/* Finished jobs still reported by import_status */
+#define XMMS_IMPORT_KEEP_FINISHED 16
+
+/* Least time between two import_progress broadcasts of a job */
+#define XMMS_IMPORT_PROGRESS_INTERVAL G_USEC_PER_SEC
+
+/* Pause of a rehash job after each batch, to leave the disk to playback */
+#define XMMS_REHASH_YIELD (20 * 1000)
+
+/* Bytes hashed at the start and at the end of a file */
+#define XMMS_REHASH_HASH_SPAN (64 * 1024)
+
+#define XMMS_REHASH_HASH_PROPERTY "content_hash"
+
+typedef enum {
+	XMMS_IMPORT_STATE_RUNNING,
+	XMMS_IMPORT_STATE_DONE,
+	XMMS_IMPORT_STATE_CANCELLED,
+	XMMS_IMPORT_STATE_FAILED
+} xmms_import_state_t;
+
+static const gchar *state_names[] = {
+	"running", "done", "cancelled", "failed"
+};
+
+typedef struct xmms_import_job_St {
+	xmms_medialib_importer_t *importer;
+	gint32 id;
+	/** NULL for rehash jobs */
+	gchar *path;
+
+	/** Directories queued or being browsed */
+	gint pending;
+	gint cancelled;
+
+	GMutex mutex;
+	/** Files waiting for the next batch */
+	xmmsv_t *batch;
+	xmms_import_state_t state;
+	gchar *error;
+	gint64 last_progress;
+	gint64 started;
+	gint64 finished;
+
+	gint dirs;
+	gint files;
+	gint added;
+	gint changed;
+	gint unchanged;
+	gint errors;
+} xmms_import_job_t;
+
+typedef struct xmms_import_task_St {
+	xmms_import_job_t *job;
+	gchar *path;
+} xmms_import_task_t;
+
+struct xmms_medialib_importer_St {
+	xmms_medialib_t *medialib;
+	GThreadPool *pool;
+
+	/** Guards jobs and next_id */
+	GMutex mutex;
+	/** Newest job first */
+	GList *jobs;
+	gint32 next_id;
+
+	/** The last rehash job started and its thread */
+	xmms_import_job_t *rehash_job;
+	GThread *rehash_thread;
+};
+
+static void xmms_import_worker (gpointer data, gpointer udata);
+
+static void
+xmms_import_job_free (xmms_import_job_t *job)
+{
+	g_mutex_clear (&job->mutex);
+	xmmsv_unref (job->batch);
+	g_free (job->error);
+	g_free (job->path);
+	g_free (job);
+}
+
+static void
+xmms_import_threads_changed (xmms_object_t *object, xmmsv_t *data,
+                             gpointer udata)
+{
+	xmms_medialib_importer_t *importer = udata;
+	gint threads;
+
+	threads = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_thread_pool_set_max_threads (importer->pool, CLAMP (threads, 1, 64), NULL);
+}
+
+xmms_medialib_importer_t *
+xmms_medialib_importer_new (xmms_medialib_t *medialib)
+{
+	xmms_medialib_importer_t *importer;
+	xmms_config_property_t *cfg;
+
+	importer = g_new0 (xmms_medialib_importer_t, 1);
+	importer->medialib = medialib;
+	importer->next_id = 1;
+	g_mutex_init (&importer->mutex);
+
+	cfg = xmms_config_property_register ("medialib.import_threads", "4",
+	                                     xmms_import_threads_changed,
+	                                     importer);
+
+	/* also compare a hash of the start and end of files in rehash jobs */
+	xmms_config_property_register ("medialib.rehash_content_hash", "0",
+	                               NULL, NULL);
+
+	importer->pool = g_thread_pool_new (xmms_import_worker, importer,
+	                                    CLAMP (xmms_config_property_get_int (cfg), 1, 64),
+	                                    FALSE, NULL);
+
+	return importer;
+}
+
+/**
+ * Cancel all jobs and wait for the workers to stop.
+ */
+void
+xmms_medialib_importer_free (xmms_medialib_importer_t *importer)
+{
+	xmms_config_property_t *cfg;
+	GList *n;
+
+	g_return_if_fail (importer);
+
+	cfg = xmms_config_lookup ("medialib.import_threads");
+	xmms_config_property_callback_remove (cfg, xmms_import_threads_changed,
+	                                      importer);
+
+	g_mutex_lock (&importer->mutex);
+	for (n = importer->jobs; n; n = g_list_next (n)) {
+		xmms_import_job_t *job = n->data;
+		g_atomic_int_set (&job->cancelled, 1);
+	}
+	g_mutex_unlock (&importer->mutex);
+
+	/* the queued tasks see the jobs are cancelled and return at once */
+	g_thread_pool_free (importer->pool, FALSE, TRUE);
+
+	if (importer->rehash_thread) {
+		g_thread_join (importer->rehash_thread);
+	}
+
+	g_list_free_full (importer->jobs, (GDestroyNotify) xmms_import_job_free);
+	g_mutex_clear (&importer->mutex);
+	g_free (importer);
+}
+
+static xmmsv_t *
+xmms_import_job_status (xmms_import_job_t *job)
+{
+	xmmsv_t *ret;
+	gint64 end;
+
+	g_mutex_lock (&job->mutex);
+
+	end = job->finished ? job->finished : g_get_monotonic_time ();
+
+	ret = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("id", job->id),
+	                        XMMSV_DICT_ENTRY_STR ("type", job->path ? "import" : "rehash"),
+	                        XMMSV_DICT_ENTRY_STR ("state", state_names[job->state]),
+	                        XMMSV_DICT_ENTRY_INT ("directories", g_atomic_int_get (&job->dirs)),
+	                        XMMSV_DICT_ENTRY_INT ("files", g_atomic_int_get (&job->files)),
+	                        XMMSV_DICT_ENTRY_INT ("added", job->added),
+	                        XMMSV_DICT_ENTRY_INT ("changed", job->changed),
+	                        XMMSV_DICT_ENTRY_INT ("unchanged", job->unchanged),
+	                        XMMSV_DICT_ENTRY_INT ("errors", g_atomic_int_get (&job->errors)),
+	                        XMMSV_DICT_ENTRY_INT ("elapsed", (end - job->started) / 1000),
+	                        XMMSV_DICT_END);
+
+	if (job->path) {
+		xmmsv_dict_set_string (ret, "path", job->path);
+	}
+
+	if (job->error) {
+		xmmsv_dict_set_string (ret, "error", job->error);
+	}
+
+	g_mutex_unlock (&job->mutex);
+
+	return ret;
+}
+
+static void
+xmms_import_job_progress (xmms_import_job_t *job, gboolean force)
+{
+	gint64 now = g_get_monotonic_time ();
+
+	g_mutex_lock (&job->mutex);
+	if (!force && now - job->last_progress < XMMS_IMPORT_PROGRESS_INTERVAL) {
+		g_mutex_unlock (&job->mutex);
+		return;
+	}
+	job->last_progress = now;
+	g_mutex_unlock (&job->mutex);
+
+	xmms_object_emit (XMMS_OBJECT (job->importer->medialib),
+	                  XMMS_IPC_SIGNAL_MEDIALIB_IMPORT_PROGRESS,
+	                  xmms_import_job_status (job));
+}
+
+/* Add the files of a batch in one session. */
+static void
+xmms_import_batch_insert (xmms_import_job_t *job, xmmsv_t *batch)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_list_iter_t *it;
+	xmmsv_t *file;
+	gint added, changed, unchanged, failed;
+
+	do {
+		added = changed = unchanged = failed = 0;
+
+		session = xmms_medialib_session_begin (job->importer->medialib);
+
+		xmmsv_get_list_iter (batch, &it);
+		while (xmmsv_list_iter_entry (it, &file)) {
+			const gchar *url;
+			gint size = -1, lmod = -1;
+			xmms_error_t err;
+
+			xmms_error_reset (&err);
+
+			xmmsv_dict_entry_get_string (file, "path", &url);
+			xmmsv_dict_entry_get_int (file, "size", &size);
+			xmmsv_dict_entry_get_int (file, "lmod", &lmod);
+
+			switch (xmms_medialib_entry_import (session, url, size, lmod, &err)) {
+				case XMMS_MEDIALIB_IMPORT_ADDED:
+					added++;
+					break;
+				case XMMS_MEDIALIB_IMPORT_CHANGED:
+					changed++;
+					break;
+				case XMMS_MEDIALIB_IMPORT_UNCHANGED:
+					unchanged++;
+					break;
+				default:
+					failed++;
+					break;
+			}
+
+			xmmsv_list_iter_next (it);
+		}
+	} while (!xmms_medialib_session_commit (session));
+
+	g_mutex_lock (&job->mutex);
+	job->added += added;
+	job->changed += changed;
+	job->unchanged += unchanged;
+	g_mutex_unlock (&job->mutex);
+
+	g_atomic_int_add (&job->errors, failed);
+}
+
+static void
+xmms_import_job_finish (xmms_import_job_t *job)
+{
+	xmms_medialib_importer_t *importer = job->importer;
+	xmmsv_t *batch;
+
+	g_mutex_lock (&job->mutex);
+	batch = job->batch;
+	job->batch = NULL;
+	g_mutex_unlock (&job->mutex);
+
+	if (!g_atomic_int_get (&job->cancelled) && xmmsv_list_get_size (batch)) {
+		xmms_import_batch_insert (job, batch);
+	}
+	xmmsv_unref (batch);
+
+	g_mutex_lock (&job->mutex);
+	if (g_atomic_int_get (&job->cancelled)) {
+		job->state = XMMS_IMPORT_STATE_CANCELLED;
+	} else if (job->error) {
+		job->state = XMMS_IMPORT_STATE_FAILED;
+	} else {
+		job->state = XMMS_IMPORT_STATE_DONE;
+	}
+	job->finished = g_get_monotonic_time ();
+	g_mutex_unlock (&job->mutex);
+
+	XMMS_DBG ("Import %d %s: %d added, %d changed, %d unchanged",
+	          job->id, state_names[job->state],
+	          job->added, job->changed, job->unchanged);
+
+	xmms_import_job_progress (job, TRUE);
+
+	/* the job may be freed once it's no longer running */
+	g_mutex_lock (&importer->mutex);
+	g_atomic_int_set (&job->pending, -1);
+	g_mutex_unlock (&importer->mutex);
+}
+
+static void
+xmms_import_job_push (xmms_import_job_t *job, const gchar *path)
+{
+	xmms_import_task_t *task;
+
+	task = g_new0 (xmms_import_task_t, 1);
+	task->job = job;
+	task->path = g_strdup (path);
+
+	g_atomic_int_inc (&job->pending);
+	g_thread_pool_push (job->importer->pool, task, NULL);
+}
+
+static void
+xmms_import_browse (xmms_import_job_t *job, const gchar *path)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *list, *val, *batch = NULL;
+	xmms_error_t err;
+
+	xmms_error_reset (&err);
+
+	list = xmms_xform_browse (path, &err);
+	if (!list) {
+		g_atomic_int_inc (&job->errors);
+
+		/* nothing to import if the top directory can't be read */
+		if (g_strcmp0 (path, job->path) == 0) {
+			g_mutex_lock (&job->mutex);
+			job->error = g_strdup (xmms_error_message_get (&err));
+			g_mutex_unlock (&job->mutex);
+		}
+		return;
+	}
+
+	g_atomic_int_inc (&job->dirs);
+
+	xmmsv_get_list_iter (list, &it);
+	while (xmmsv_list_iter_entry (it, &val)) {
+		const gchar *str;
+		gint isdir = 0;
+
+		xmmsv_list_iter_next (it);
+
+		if (!xmmsv_dict_entry_get_string (val, "path", &str)) {
+			continue;
+		}
+
+		xmmsv_dict_entry_get_int (val, "isdir", &isdir);
+
+		if (isdir == 1) {
+			xmms_import_job_push (job, str);
+			continue;
+		}
+
+		g_atomic_int_inc (&job->files);
+
+		g_mutex_lock (&job->mutex);
+		xmmsv_list_append (job->batch, val);
+		if (xmmsv_list_get_size (job->batch) >= XMMS_IMPORT_BATCH_SIZE) {
+			batch = job->batch;
+			job->batch = xmmsv_new_list ();
+		}
+		g_mutex_unlock (&job->mutex);
+
+		if (batch) {
+			xmms_import_batch_insert (job, batch);
+			xmmsv_unref (batch);
+			batch = NULL;
+
+			if (g_atomic_int_get (&job->cancelled)) {
+				break;
+			}
+		}
+	}
+
+	xmmsv_unref (list);
+}
+
+static void
+xmms_import_worker (gpointer data, gpointer udata)
+{
+	xmms_import_task_t *task = data;
+	xmms_import_job_t *job = task->job;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	if (!g_atomic_int_get (&job->cancelled)) {
+		xmms_import_browse (job, task->path);
+		xmms_import_job_progress (job, FALSE);
+	}
+
+	if (g_atomic_int_dec_and_test (&job->pending)) {
+		xmms_import_job_finish (job);
+	}
+
+	g_free (task->path);
+	g_free (task);
+}
+
+/**
+ * Hash the start and the end of a file, which is where tags live.
+ */
+static gchar *
+xmms_rehash_content_hash (const gchar *path, gint64 size)
+{
+	GChecksum *sum;
+	guchar *buf;
+	gchar *ret = NULL;
+	gssize len;
+	gint fd;
+
+	fd = g_open (path, O_RDONLY, 0);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	buf = g_malloc (XMMS_REHASH_HASH_SPAN);
+	sum = g_checksum_new (G_CHECKSUM_MD5);
+
+	len = read (fd, buf, XMMS_REHASH_HASH_SPAN);
+	if (len < 0) {
+		goto out;
+	}
+	g_checksum_update (sum, buf, len);
+
+	if (size > 2 * XMMS_REHASH_HASH_SPAN) {
+		if (lseek (fd, -XMMS_REHASH_HASH_SPAN, SEEK_END) == -1) {
+			goto out;
+		}
+		len = read (fd, buf, XMMS_REHASH_HASH_SPAN);
+		if (len < 0) {
+			goto out;
+		}
+		g_checksum_update (sum, buf, len);
+	}
+
+	ret = g_strdup (g_checksum_get_string (sum));
+
+out:
+	g_checksum_free (sum);
+	g_free (buf);
+	close (fd);
+
+	return ret;
+}
+
+typedef struct xmms_rehash_item_St {
+	xmms_medialib_entry_t entry;
+	gchar *url;
+	gint size;
+	gint lmod;
+	gchar *hash;
+	gboolean changed;
+	gboolean store_hash;
+} xmms_rehash_item_t;
+
+/* Compare what's stored about an entry with its file. */
+static void
+xmms_rehash_check (xmms_import_job_t *job, xmms_rehash_item_t *item,
+                   gboolean use_hash)
+{
+	GStatBuf st;
+	gchar *path, *args;
+	gchar *hash;
+
+	if (!item->url) {
+		return;
+	}
+
+	path = g_strdup (item->url);
+	args = strchr (path, '?');
+	if (args) {
+		*args = '\0';
+	}
+
+	/* other transports would need the whole file, leave them out */
+	if (!g_str_has_prefix (path, "file://") || !xmms_medialib_decode_url (path)) {
+		g_free (path);
+		return;
+	}
+
+	if (g_stat (path + 7, &st) == -1) {
+		/* let mediainfo mark it as not available */
+		g_atomic_int_inc (&job->errors);
+		item->changed = TRUE;
+		g_free (path);
+		return;
+	}
+
+	/* entries never read have neither, mediainfo gets to those anyway */
+	if (item->size >= 0 && item->lmod >= 0 &&
+	    (item->size != (gint) st.st_size || item->lmod != (gint) st.st_mtime)) {
+		item->changed = TRUE;
+	}
+
+	if (use_hash && !item->changed) {
+		hash = xmms_rehash_content_hash (path + 7, st.st_size);
+		if (hash && item->hash && strcmp (hash, item->hash) != 0) {
+			item->changed = TRUE;
+		}
+		if (hash && g_strcmp0 (hash, item->hash) != 0) {
+			g_free (item->hash);
+			item->hash = hash;
+			item->store_hash = TRUE;
+		} else {
+			g_free (hash);
+		}
+	}
+
+	g_free (path);
+}
+
+static void
+xmms_rehash_batch (xmms_import_job_t *job, const xmms_medialib_entry_t *entries,
+                   guint n, gboolean use_hash)
+{
+	xmms_medialib_t *medialib = job->importer->medialib;
+	xmms_medialib_session_t *session;
+	xmms_rehash_item_t *items;
+	gint changed = 0;
+	guint i;
+
+	items = g_new0 (xmms_rehash_item_t, n);
+
+	session = xmms_medialib_session_begin_ro (medialib);
+	for (i = 0; i < n; i++) {
+		items[i].entry = entries[i];
+		items[i].url = xmms_medialib_entry_property_get_str (session, entries[i],
+		                                                     XMMS_MEDIALIB_ENTRY_PROPERTY_URL);
+		items[i].size = xmms_medialib_entry_property_get_int (session, entries[i],
+		                                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE);
+		items[i].lmod = xmms_medialib_entry_property_get_int (session, entries[i],
+		                                                      XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD);
+		if (use_hash) {
+			items[i].hash = xmms_medialib_entry_property_get_str (session, entries[i],
+			                                                      XMMS_REHASH_HASH_PROPERTY);
+		}
+	}
+	xmms_medialib_session_abort (session);
+
+	/* the files are looked at outside of any session */
+	for (i = 0; i < n && !g_atomic_int_get (&job->cancelled); i++) {
+		xmms_rehash_check (job, &items[i], use_hash);
+		if (items[i].changed) {
+			changed++;
+		}
+	}
+
+	if (n > 0) {
+		do {
+			session = xmms_medialib_session_begin (medialib);
+			for (i = 0; i < n; i++) {
+				if (items[i].store_hash) {
+					xmms_medialib_entry_property_set_str (session, items[i].entry,
+					                                      XMMS_REHASH_HASH_PROPERTY,
+					                                      items[i].hash);
+				}
+				if (items[i].changed) {
+					xmms_medialib_entry_status_set (session, items[i].entry,
+					                                XMMS_MEDIALIB_ENTRY_STATUS_REHASH);
+				}
+			}
+		} while (!xmms_medialib_session_commit (session));
+	}
+
+	g_mutex_lock (&job->mutex);
+	job->changed += changed;
+	job->unchanged += n - changed;
+	g_mutex_unlock (&job->mutex);
+
+	g_atomic_int_add (&job->files, n);
+
+	for (i = 0; i < n; i++) {
+		g_free (items[i].url);
+		g_free (items[i].hash);
+	}
+	g_free (items);
+}
+
+static gpointer
+xmms_rehash_thread (gpointer udata)
+{
+	xmms_import_job_t *job = udata;
+	xmms_medialib_session_t *session;
+	xmms_config_property_t *cfg;
+	gboolean use_hash;
+	GArray *entries;
+	guint i, n;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	xmms_realtime_thread_background ();
+
+	cfg = xmms_config_lookup ("medialib.rehash_content_hash");
+	use_hash = cfg && xmms_config_property_get_int (cfg);
+
+	session = xmms_medialib_session_begin_ro (job->importer->medialib);
+	entries = xmms_medialib_entries_with_status (session, XMMS_MEDIALIB_ENTRY_STATUS_OK);
+	xmms_medialib_session_abort (session);
+
+	for (i = 0; i < entries->len && !g_atomic_int_get (&job->cancelled); i += n) {
+		n = MIN (entries->len - i, XMMS_IMPORT_BATCH_SIZE);
+
+		xmms_rehash_batch (job, &g_array_index (entries, xmms_medialib_entry_t, i),
+		                   n, use_hash);
+		xmms_import_job_progress (job, FALSE);
+
+		g_usleep (XMMS_REHASH_YIELD);
+	}
+
+	g_array_free (entries, TRUE);
+
+	if (g_atomic_int_dec_and_test (&job->pending)) {
+		xmms_import_job_finish (job);
+	}
+
+	return NULL;
+}
+
+static xmms_import_job_t *
+xmms_import_job_new (xmms_medialib_importer_t *importer, const gchar *path)
+{
+	xmms_import_job_t *job;
+
+	job = g_new0 (xmms_import_job_t, 1);
+	job->importer = importer;
+	job->path = g_strdup (path);
+	job->batch = xmmsv_new_list ();
+	job->state = XMMS_IMPORT_STATE_RUNNING;
+	job->started = g_get_monotonic_time ();
+	g_mutex_init (&job->mutex);
+
+	return job;
+}
+
+/* Drop the oldest finished jobs, called with the importer mutex held. */
+static void
+xmms_import_jobs_trim (xmms_medialib_importer_t *importer)
+{
+	GList *n, *next;
+	gint finished = 0;
+
+	for (n = importer->jobs; n; n = next) {
+		xmms_import_job_t *job = n->data;
+
+		next = g_list_next (n);
+
+		if (g_atomic_int_get (&job->pending) != -1 ||
+		    job == importer->rehash_job) {
+			continue;
+		}
+
+		if (++finished > XMMS_IMPORT_KEEP_FINISHED) {
+			importer->jobs = g_list_delete_link (importer->jobs, n);
+			xmms_import_job_free (job);
+		}
+	}
+}
+
+/**
+ * Start importing a directory recursively.
+ *
+ * @returns the id of the new job
+ */
+gint32
+xmms_medialib_importer_start (xmms_medialib_importer_t *importer,
+                              const gchar *path, xmms_error_t *error)
+{
+	xmms_import_job_t *job;
+
+	g_return_val_if_fail (importer, 0);
+	g_return_val_if_fail (path, 0);
+
+	job = xmms_import_job_new (importer, path);
+
+	g_mutex_lock (&importer->mutex);
+	job->id = importer->next_id++;
+	xmms_import_jobs_trim (importer);
+	importer->jobs = g_list_prepend (importer->jobs, job);
+	g_mutex_unlock (&importer->mutex);
+
+	XMMS_DBG ("Starting import %d of %s", job->id, path);
+
+	xmms_import_job_push (job, path);
+
+	return job->id;
+}
+
+/**
+ * Start checking all entries for changed files, rehashing the ones
+ * that changed. Only one such job runs at a time.
+ *
+ * @returns the id of the job, or of the one already running
+ */
+gint32
+xmms_medialib_importer_rehash (xmms_medialib_importer_t *importer,
+                               xmms_error_t *error)
+{
+	xmms_import_job_t *job;
+	gint32 id;
+
+	g_return_val_if_fail (importer, 0);
+
+	g_mutex_lock (&importer->mutex);
+
+	job = importer->rehash_job;
+	if (job && g_atomic_int_get (&job->pending) != -1) {
+		id = job->id;
+		g_mutex_unlock (&importer->mutex);
+		return id;
+	}
+
+	if (importer->rehash_thread) {
+		g_thread_join (importer->rehash_thread);
+	}
+
+	job = xmms_import_job_new (importer, NULL);
+	job->id = importer->next_id++;
+	job->pending = 1;
+	xmms_import_jobs_trim (importer);
+	importer->jobs = g_list_prepend (importer->jobs, job);
+
+	importer->rehash_job = job;
+	importer->rehash_thread = g_thread_new ("x2 rehash", xmms_rehash_thread, job);
+
+	id = job->id;
+
+	g_mutex_unlock (&importer->mutex);
+
+	XMMS_DBG ("Starting rehash %d", id);
+
+	return id;
+}
+
+/**
+ * @returns a list with a dict describing each running job and the
+ * last few finished ones, newest first.
+ */
+xmmsv_t *
+xmms_medialib_importer_status (xmms_medialib_importer_t *importer)
+{
+	xmmsv_t *ret, *status;
+	GList *n;
+
+	ret = xmmsv_new_list ();
+
+	g_mutex_lock (&importer->mutex);
+	for (n = importer->jobs; n; n = g_list_next (n)) {
+		status = xmms_import_job_status (n->data);
+		xmmsv_list_append (ret, status);
+		xmmsv_unref (status);
+	}
+	g_mutex_unlock (&importer->mutex);
+
+	return ret;
+}
+
+/**
+ * Stop a running job. Entries already added stay in the medialib.
+ *
+ * @returns FALSE if there is no such job running.
+ */
+gboolean
+xmms_medialib_importer_cancel (xmms_medialib_importer_t *importer, gint32 id)
+{
+	gboolean ret = FALSE;
+	GList *n;
+
+	g_mutex_lock (&importer->mutex);
+	for (n = importer->jobs; n; n = g_list_next (n)) {
+		xmms_import_job_t *job = n->data;
+
+		if (job->id == id && g_atomic_int_get (&job->pending) != -1) {
+			g_atomic_int_set (&job->cancelled, 1);
+			ret = TRUE;
+			break;
+		}
+	}
+	g_mutex_unlock (&importer->mutex);
+
+	return ret;
+}
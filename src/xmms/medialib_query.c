@@ -35,9 +35,47 @@
 
 #include <xmmspriv/xmms_fetch_info.h>
 #include <xmmspriv/xmms_fetch_spec.h>
+#include <xmmspriv/xmms_plancache.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include "s4.h"
 
 static s4_condition_t *collection_to_condition (xmms_medialib_session_t *s, xmmsv_t *coll, xmms_fetch_info_t *fetch, xmmsv_t *order);
+static s4_resultset_t *xmms_medialib_query_recurs_limited (xmms_medialib_session_t *session, xmmsv_t *coll, xmms_fetch_info_t *fetch, gint limit);
+
+/**
+ * Everything prepared to run a query, so it can be run again without
+ * walking the collection.
+ */
+struct xmms_medialib_plan_St {
+	/* private copies, the fetch info and spec point into them */
+	xmmsv_t *coll;
+	xmmsv_t *fetch;
+	xmms_fetch_info_t *info;
+	xmms_fetch_spec_t *spec;
+	s4_condition_t *cond;
+	xmmsv_t *order;
+	/** Medialib generation its subquery results were read at */
+	guint generation;
+	gboolean reusable;
+	/** Scans entries, and is worth splitting over threads */
+	gboolean parallel;
+};
+
+/* Don't split queries into parts smaller than this many ids */
+#define XMMS_MEDIALIB_PARALLEL_MIN_IDS 4096
+
+/** A range of ids queried by its own thread and session */
+typedef struct xmms_medialib_partition_St {
+	xmms_medialib_t *medialib;
+	xmms_medialib_session_t *session;
+	/* private copies, xmmsv values are not thread safe */
+	xmmsv_t *coll;
+	xmmsv_t *fetch;
+	gint32 first;
+	gint32 last;
+	s4_resultset_t *set;
+	GThread *thread;
+} xmms_medialib_partition_t;
 
 typedef enum xmms_sort_type_St {
 	SORT_TYPE_COLUMN,
@@ -52,6 +90,30 @@ universe_filter (void)
 	return 0;
 }
 
+/* A filter for a range of ids. It compares the value to the range, so
+ * s4 can look it up in the sorted ids instead of checking each one.
+ */
+static gint
+id_range_filter (const s4_val_t *value, s4_condition_t *cond)
+{
+	xmms_medialib_partition_t *part;
+	gint32 ival;
+
+	if (!s4_val_get_int (value, &ival)) {
+		return 1;
+	}
+
+	part = s4_cond_get_funcdata (cond);
+
+	if (ival < part->first) {
+		return -1;
+	}
+	if (ival > part->last) {
+		return 1;
+	}
+	return 0;
+}
+
 /* A filter for idlists. Checks if the value given (id number)
  * is in the hash table
  */
@@ -110,6 +172,238 @@ xmms_medialib_result_sort_idlist (s4_resultset_t *set, xmmsv_t *idlist)
 	return ret;
 }
 
+/** The sort key of a row for one column */
+typedef struct {
+	gint32 ival;
+	/* collation key, NULL for integers */
+	gchar *str;
+	gboolean present;
+} xmms_medialib_sort_key_t;
+
+typedef struct {
+	const s4_resultrow_t *row;
+	xmms_medialib_sort_key_t *keys;
+	/* position in the unsorted set, ties keep it */
+	gint index;
+} xmms_medialib_sort_row_t;
+
+typedef struct {
+	gint count;
+	gint *directions;
+} xmms_medialib_sort_columns_t;
+
+/* Get the key a string is sorted by. It is computed once per row, so
+ * comparisons are plain strcmps instead of folding both strings each
+ * time.
+ */
+static gchar *
+xmms_medialib_sort_key (const gchar *str, s4_cmp_mode_t mode,
+                        gboolean strip_article)
+{
+	gchar *folded, *ret;
+
+	if (strip_article && g_ascii_strncasecmp (str, "the ", 4) == 0) {
+		str += 4;
+	}
+
+	if (mode == S4_CMP_BINARY) {
+		return g_strdup (str);
+	}
+
+	folded = g_utf8_casefold (str, -1);
+	if (mode == S4_CMP_CASELESS) {
+		return folded;
+	}
+
+	/* natural collation: digits compare by their numeric value */
+	ret = g_utf8_collate_key_for_filename (folded, -1);
+	g_free (folded);
+
+	return ret;
+}
+
+static gint
+xmms_medialib_sort_key_compare (const xmms_medialib_sort_key_t *a,
+                                const xmms_medialib_sort_key_t *b)
+{
+	/* rows without a value go last, string values after integers */
+	if (!a->present || !b->present) {
+		return b->present - a->present;
+	}
+	if (a->str == NULL && b->str == NULL) {
+		return (a->ival > b->ival) - (a->ival < b->ival);
+	}
+	if (a->str == NULL || b->str == NULL) {
+		return a->str == NULL ? -1 : 1;
+	}
+	return strcmp (a->str, b->str);
+}
+
+static gint
+xmms_medialib_sort_row_compare (gconstpointer a, gconstpointer b,
+                                gpointer udata)
+{
+	const xmms_medialib_sort_row_t *ra = a, *rb = b;
+	xmms_medialib_sort_columns_t *columns = udata;
+	gint i, cmp;
+
+	for (i = 0; i < columns->count; i++) {
+		cmp = xmms_medialib_sort_key_compare (ra->keys + i, rb->keys + i);
+		if (cmp != 0) {
+			return columns->directions[i] == S4_ORDER_DESCENDING ? -cmp : cmp;
+		}
+	}
+
+	return (ra->index > rb->index) - (ra->index < rb->index);
+}
+
+static void
+xmms_medialib_sort_heap_down (xmms_medialib_sort_row_t *heap, gint size,
+                              gint i, xmms_medialib_sort_columns_t *columns)
+{
+	xmms_medialib_sort_row_t tmp;
+	gint child;
+
+	while ((child = 2 * i + 1) < size) {
+		if (child + 1 < size &&
+		    xmms_medialib_sort_row_compare (heap + child + 1, heap + child, columns) > 0) {
+			child++;
+		}
+		if (xmms_medialib_sort_row_compare (heap + child, heap + i, columns) <= 0) {
+			break;
+		}
+		tmp = heap[i];
+		heap[i] = heap[child];
+		heap[child] = tmp;
+		i = child;
+	}
+}
+
+/**
+ * Move the first limit rows in order to the front of rows, keeping
+ * the limit rows sorted first so far in a heap with the last of them
+ * on top.
+ *
+ * @returns The number of rows moved, at most limit
+ */
+static gint
+xmms_medialib_sort_top (xmms_medialib_sort_row_t *rows, gint nrows, gint limit,
+                        xmms_medialib_sort_columns_t *columns)
+{
+	gint i;
+
+	for (i = limit / 2 - 1; i >= 0; i--) {
+		xmms_medialib_sort_heap_down (rows, limit, i, columns);
+	}
+
+	for (i = limit; i < nrows; i++) {
+		if (xmms_medialib_sort_row_compare (rows + i, rows, columns) < 0) {
+			rows[0] = rows[i];
+			xmms_medialib_sort_heap_down (rows, limit, 0, columns);
+		}
+	}
+
+	return limit;
+}
+
+/**
+ * Sorts a resultset by its columns, with the sort keys of each row
+ * computed up front.
+ *
+ * @param set The resultset to sort. It will be freed by this function
+ * @param order The orderings, all of type SORT_TYPE_COLUMN
+ * @param count The number of orderings to sort by
+ * @param limit The number of rows wanted, -1 for all of them
+ * @return A new, sorted resultset
+ */
+static s4_resultset_t *
+xmms_medialib_result_sort_keys (s4_resultset_t *set, xmmsv_t *order, gint count,
+                                gint limit)
+{
+	xmms_medialib_sort_columns_t columns;
+	xmms_medialib_sort_key_t *keys;
+	xmms_medialib_sort_row_t *rows;
+	s4_resultset_t *ret;
+	gint i, j, k, nrows, sorted;
+
+	nrows = s4_resultset_get_rowcount (set);
+
+	columns.count = count;
+	columns.directions = g_new (gint, count);
+	keys = g_new0 (xmms_medialib_sort_key_t, (gsize) nrows * count);
+	rows = g_new (xmms_medialib_sort_row_t, nrows);
+
+	for (i = 0; i < nrows; i++) {
+		s4_resultset_get_row (set, i, &rows[i].row);
+		rows[i].keys = keys + (gsize) i * count;
+		rows[i].index = i;
+	}
+
+	for (j = 0; j < count; j++) {
+		gint id, collation, direction, strip_article;
+		xmmsv_t *val, *ids;
+
+		xmmsv_list_get (order, j, &val);
+		xmmsv_dict_get (val, "field", &ids);
+
+		if (!xmmsv_dict_entry_get_int (val, "direction", &direction))
+			direction = S4_ORDER_ASCENDING;
+		if (!xmmsv_dict_entry_get_int (val, "collation", &collation))
+			collation = S4_CMP_COLLATE;
+		if (!xmmsv_dict_entry_get_int (val, "strip-article", &strip_article))
+			strip_article = 0;
+
+		columns.directions[j] = direction;
+
+		for (i = 0; i < nrows; i++) {
+			xmms_medialib_sort_key_t *key = rows[i].keys + j;
+			const s4_result_t *result = NULL;
+			const gchar *str;
+
+			/* the first of the fields the row has a value for */
+			for (k = 0; result == NULL && xmmsv_list_get_int (ids, k, &id); k++) {
+				s4_resultrow_get_col (rows[i].row, id, &result);
+			}
+
+			if (result == NULL) {
+				continue;
+			}
+
+			key->present = TRUE;
+			if (s4_val_get_str (s4_result_get_val (result), &str)) {
+				key->str = xmms_medialib_sort_key (str, collation, strip_article);
+			} else {
+				s4_val_get_int (s4_result_get_val (result), &key->ival);
+			}
+		}
+	}
+
+	/* a page of a large set only needs its rows sorted */
+	sorted = nrows;
+	if (limit >= 0 && limit < nrows) {
+		sorted = limit > 0 ? xmms_medialib_sort_top (rows, nrows, limit, &columns) : 0;
+	}
+
+	g_qsort_with_data (rows, sorted, sizeof (xmms_medialib_sort_row_t),
+	                   xmms_medialib_sort_row_compare, &columns);
+
+	ret = s4_resultset_create (s4_resultset_get_colcount (set));
+	for (i = 0; i < sorted; i++) {
+		s4_resultset_add_row (ret, rows[i].row);
+	}
+
+	for (i = 0; i < nrows * count; i++) {
+		g_free (keys[i].str);
+	}
+
+	g_free (keys);
+	g_free (rows);
+	g_free (columns.directions);
+	s4_resultset_free (set);
+
+	return ret;
+}
+
 /**
  * Sorts a resultset
  *
@@ -118,10 +412,13 @@ xmms_medialib_result_sort_idlist (s4_resultset_t *set, xmmsv_t *idlist)
  * @param order A list with orderings. An ordering can be a string
  * telling which column to sort by (prefixed by '-' to sort ascending)
  * or a list of integers (an idlist).
+ * @param limit The number of rows wanted first, -1 for all of them.
+ * Rows after them may be left out.
  * @return The set (or a new set) with the correct ordering
  */
 static s4_resultset_t *
-xmms_medialib_result_sort (s4_resultset_t *set, xmms_fetch_info_t *fetch_info, xmmsv_t *order)
+xmms_medialib_result_sort (s4_resultset_t *set, xmms_fetch_info_t *fetch_info,
+                           xmmsv_t *order, gint limit)
 {
 	gint i, stop, type;
 	s4_order_t *s4_order;
@@ -141,6 +438,18 @@ xmms_medialib_result_sort (s4_resultset_t *set, xmms_fetch_info_t *fetch_info, x
 	/* We willorder by the operands before the idlist */
 	stop = i;
 
+	/* Without random orderings, sort by precomputed keys */
+	for (i = 0; i < stop && xmmsv_list_get (order, i, &val); i++) {
+		xmmsv_dict_entry_get_int (val, "type", &type);
+		if (type == SORT_TYPE_RANDOM) {
+			break;
+		}
+	}
+
+	if (i == stop) {
+		return stop > 0 ? xmms_medialib_result_sort_keys (set, order, stop, limit) : set;
+	}
+
 	s4_order = s4_order_create ();
 
 	for (i = 0; i < stop && xmmsv_list_get (order, i, &val); i++) {
@@ -322,6 +631,22 @@ filter_type_from_collection (xmmsv_t *coll)
 	}
 }
 
+static gboolean
+compare_mode_from_string (const gchar *value, s4_cmp_mode_t *cmp_mode)
+{
+	if (strcmp (value, "NOCASE") == 0) {
+		*cmp_mode = S4_CMP_CASELESS;
+	} else if (strcmp (value, "BINARY") == 0) {
+		*cmp_mode = S4_CMP_BINARY;
+	} else if (strcmp (value, "NATCOLL") == 0) {
+		*cmp_mode = S4_CMP_COLLATE;
+	} else {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static void
 get_filter_type_and_compare_mode (xmmsv_t *coll,
                                   s4_filter_type_t *type,
@@ -345,13 +670,7 @@ get_filter_type_and_compare_mode (xmmsv_t *coll,
 			default:
 				*cmp_mode = S4_CMP_CASELESS;
 		}
-	} else if (strcmp (value, "NOCASE") == 0) {
-		*cmp_mode = S4_CMP_CASELESS;
-	} else if (strcmp (value, "BINARY") == 0) {
-		*cmp_mode = S4_CMP_BINARY;
-	} else if (strcmp (value, "NATCOLL") == 0) {
-		*cmp_mode = S4_CMP_COLLATE;
-	} else {
+	} else if (!compare_mode_from_string (value, cmp_mode)) {
 		/* Programming error, too weak validation. */
 		g_assert_not_reached ();
 	}
@@ -366,7 +685,7 @@ filter_condition (xmms_medialib_session_t *session,
 	s4_filter_type_t type;
 	s4_cmp_mode_t cmp_mode;
 	gint32 ival, flags = 0;
-	const gchar *filter_type, *key, *val;
+	const gchar *filter_type, *key, *val, *pref;
 	xmmsv_t *operands, *operand;
 	s4_condition_t *cond;
 	s4_val_t *value = NULL;
@@ -403,7 +722,26 @@ filter_condition (xmms_medialib_session_t *session,
 
 	get_filter_type_and_compare_mode (coll, &type, &cmp_mode);
 
-	cond = s4_cond_new_filter (type, key, value, sp, cmp_mode, flags);
+	cond = NULL;
+	if ((type == S4_FILTER_MATCH || type == S4_FILTER_TOKEN) &&
+	    cmp_mode != S4_CMP_COLLATE && key != NULL && value != NULL &&
+	    s4_val_get_str (value, &val) &&
+	    !xmmsv_coll_attribute_get_string (coll, "source-preference", &pref)) {
+		xmms_token_index_t *index;
+		GHashTable *ids;
+
+		index = xmms_medialib_get_token_index (xmms_medialib_session_get_medialib (session));
+		ids = xmms_token_index_match (index, session, key, val,
+		                              type == S4_FILTER_TOKEN,
+		                              cmp_mode == S4_CMP_CASELESS);
+		if (ids != NULL) {
+			cond = create_idlist_filter (session, ids);
+		}
+	}
+
+	if (cond == NULL) {
+		cond = s4_cond_new_filter (type, key, value, sp, cmp_mode, flags);
+	}
 
 	s4_val_free (value);
 	s4_sourcepref_unref (sp);
@@ -657,7 +995,13 @@ limit_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
 	id_list = xmmsv_new_list ();
 	id_table = g_hash_table_new (g_direct_hash, g_direct_equal);
 
-	set = xmms_medialib_query_recurs (session, operand, fetch);
+	if (strcmp ("value", type) == 0 || strcmp ("id", type) == 0) {
+		set = xmms_medialib_query_recurs (session, operand, fetch);
+	} else {
+		/* only the rows up to the end of the window are looked at */
+		set = xmms_medialib_query_recurs_limited (session, operand, fetch,
+		                                          MIN ((gint64) start + length, G_MAXINT32));
+	}
 
 	if (strcmp ("value", type) == 0 && limit_condition_fields (session, fields, fetch, &indices)) {
 		limit_condition_by_value (set, id_list, id_table, start, length, indices);
@@ -751,7 +1095,8 @@ order_condition_by_value (xmmsv_t *entry,
 
 /**
  * Add a dict to the sort list:
- * { "type": (ID|VALUE|RANDOM|LIST), "field": ..., "direction": ... }
+ * { "type": (ID|VALUE|RANDOM|LIST), "field": ..., "direction": ...,
+ *   "collation": ..., "strip-article": ... }
  */
 static s4_condition_t *
 order_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
@@ -760,6 +1105,7 @@ order_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
 	s4_sourcepref_t *sourcepref;
 	xmmsv_t *operands, *operand, *entry;
 	const gchar *key;
+	gint strip_article;
 
 	entry = xmmsv_new_dict ();
 
@@ -782,6 +1128,15 @@ order_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
 
 	s4_sourcepref_unref (sourcepref);
 
+	if (xmmsv_coll_attribute_get_string (coll, "collation", &key)) {
+		s4_cmp_mode_t cmp_mode;
+		if (compare_mode_from_string (key, &cmp_mode))
+			xmmsv_dict_set_int (entry, "collation", cmp_mode);
+	}
+
+	if (xmms_collection_get_int_attr (coll, "strip-article", &strip_article))
+		xmmsv_dict_set_int (entry, "strip-article", strip_article);
+
 	if (!xmmsv_coll_attribute_get_string (coll, "direction", &key)) {
 		xmmsv_dict_set_int (entry, "direction", S4_ORDER_ASCENDING);
 	} else if (strcmp (key, "ASC") == 0) {
@@ -965,9 +1320,10 @@ collection_to_condition (xmms_medialib_session_t *session, xmmsv_t *coll,
  * medialib matching the collection.
  * Must be free with s4_resultset_free
  */
-s4_resultset_t *
-xmms_medialib_query_recurs (xmms_medialib_session_t *session,
-                            xmmsv_t *coll, xmms_fetch_info_t *fetch)
+static s4_resultset_t *
+xmms_medialib_query_recurs_limited (xmms_medialib_session_t *session,
+                                    xmmsv_t *coll, xmms_fetch_info_t *fetch,
+                                    gint limit)
 {
 	s4_condition_t *cond;
 	s4_resultset_t *ret;
@@ -979,9 +1335,393 @@ xmms_medialib_query_recurs (xmms_medialib_session_t *session,
 	ret = xmms_medialib_session_query (session, fetch->fs, cond);
 	s4_cond_free (cond);
 
-	ret = xmms_medialib_result_sort (ret, fetch, order);
+	ret = xmms_medialib_result_sort (ret, fetch, order, limit);
+
+	xmmsv_unref (order);
+
+	return ret;
+}
+
+s4_resultset_t *
+xmms_medialib_query_recurs (xmms_medialib_session_t *session,
+                            xmmsv_t *coll, xmms_fetch_info_t *fetch)
+{
+	return xmms_medialib_query_recurs_limited (session, coll, fetch, -1);
+}
+
+/* Returns TRUE if building the condition queries the medialib */
+static gboolean
+needs_subquery (xmms_medialib_t *medialib, xmmsv_t *coll)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *operand;
+	const gchar *key;
+	gboolean ret = FALSE;
+
+	switch (xmmsv_coll_get_type (coll)) {
+		case XMMS_COLLECTION_TYPE_LIMIT:
+			return TRUE;
+		case XMMS_COLLECTION_TYPE_UNION:
+			if (has_order (coll)) {
+				return TRUE;
+			}
+			break;
+		case XMMS_COLLECTION_TYPE_MATCH:
+		case XMMS_COLLECTION_TYPE_TOKEN:
+			/* answered from the token index, as a list of ids */
+			if (xmmsv_coll_attribute_get_string (coll, "field", &key) &&
+			    xmms_token_index_has_key (xmms_medialib_get_token_index (medialib), key)) {
+				return TRUE;
+			}
+			break;
+		default:
+			break;
+	}
+
+	xmmsv_get_list_iter (xmmsv_coll_operands_get (coll), &it);
+	while (!ret && xmmsv_list_iter_entry (it, &operand)) {
+		ret = needs_subquery (medialib, operand);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	return ret;
+}
+
+/* Count the keys filtered on, for the index usage statistics */
+static void
+track_filters (xmms_medialib_session_t *session, xmmsv_t *coll)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *operand;
+	const gchar *type, *key;
+
+	switch (xmmsv_coll_get_type (coll)) {
+		case XMMS_COLLECTION_TYPE_HAS:
+		case XMMS_COLLECTION_TYPE_MATCH:
+		case XMMS_COLLECTION_TYPE_TOKEN:
+		case XMMS_COLLECTION_TYPE_EQUALS:
+		case XMMS_COLLECTION_TYPE_NOTEQUAL:
+		case XMMS_COLLECTION_TYPE_SMALLER:
+		case XMMS_COLLECTION_TYPE_SMALLEREQ:
+		case XMMS_COLLECTION_TYPE_GREATER:
+		case XMMS_COLLECTION_TYPE_GREATEREQ:
+			/* the same key as filter_condition, id filters need no index */
+			if ((!xmmsv_coll_attribute_get_string (coll, "type", &type) ||
+			     strcmp (type, "value") == 0) &&
+			    xmmsv_coll_attribute_get_string (coll, "field", &key)) {
+				xmms_medialib_session_track_filter (session, key);
+			}
+			break;
+		default:
+			break;
+	}
+
+	xmmsv_get_list_iter (xmmsv_coll_operands_get (coll), &it);
+	while (xmmsv_list_iter_entry (it, &operand)) {
+		track_filters (session, operand);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+}
 
+/* Returns TRUE if coll has a filter s4 can't answer from an index */
+static gboolean
+needs_scan (xmms_medialib_t *medialib, xmmsv_t *coll)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *operand;
+	const gchar *type, *key;
+	gboolean ret = FALSE;
+
+	switch (xmmsv_coll_get_type (coll)) {
+		case XMMS_COLLECTION_TYPE_MATCH:
+		case XMMS_COLLECTION_TYPE_TOKEN:
+			return TRUE;
+		case XMMS_COLLECTION_TYPE_HAS:
+		case XMMS_COLLECTION_TYPE_EQUALS:
+		case XMMS_COLLECTION_TYPE_NOTEQUAL:
+		case XMMS_COLLECTION_TYPE_SMALLER:
+		case XMMS_COLLECTION_TYPE_SMALLEREQ:
+		case XMMS_COLLECTION_TYPE_GREATER:
+		case XMMS_COLLECTION_TYPE_GREATEREQ:
+			if (!xmmsv_coll_attribute_get_string (coll, "type", &type) ||
+			    strcmp (type, "value") == 0) {
+				/* without a field every key is matched */
+				if (!xmmsv_coll_attribute_get_string (coll, "field", &key) ||
+				    !xmms_medialib_is_indexed (medialib, key)) {
+					return TRUE;
+				}
+			}
+			break;
+		default:
+			break;
+	}
+
+	xmmsv_get_list_iter (xmmsv_coll_operands_get (coll), &it);
+	while (!ret && xmmsv_list_iter_entry (it, &operand)) {
+		ret = needs_scan (medialib, operand);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	return ret;
+}
+
+/**
+ * Prepare a query of coll with fetch.
+ *
+ * @returns A new plan, or NULL if fetch is invalid.
+ */
+xmms_medialib_plan_t *
+xmms_medialib_plan_new (xmms_medialib_session_t *session, xmmsv_t *coll,
+                        xmmsv_t *fetch, xmms_error_t *err)
+{
+	xmms_medialib_plan_t *plan;
+	s4_sourcepref_t *sourcepref;
+	xmms_medialib_t *medialib;
+
+	plan = g_new0 (xmms_medialib_plan_t, 1);
+	plan->coll = xmmsv_copy (coll);
+	plan->fetch = xmmsv_copy (fetch);
+
+	sourcepref = xmms_medialib_session_get_source_preferences (session);
+	plan->info = xmms_fetch_info_new (sourcepref);
+	plan->spec = xmms_fetch_spec_new (plan->fetch, plan->info, sourcepref, err);
+	s4_sourcepref_unref (sourcepref);
+
+	if (plan->spec == NULL) {
+		xmms_medialib_plan_free (plan);
+		return NULL;
+	}
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	if (!needs_subquery (medialib, plan->coll)) {
+		plan->generation = XMMS_PLAN_CACHE_STATIC;
+		plan->reusable = TRUE;
+		plan->parallel = needs_scan (medialib, plan->coll);
+	} else {
+		/* a writing session sees its own uncommitted changes */
+		plan->reusable = xmms_medialib_session_get_generation (session,
+		                                                       &plan->generation);
+	}
+
+	plan->order = xmmsv_new_list ();
+	plan->cond = collection_to_condition (session, plan->coll, plan->info,
+	                                      plan->order);
+
+	/* building the condition normalized both, from now on they are
+	 * only read and can be shared with the partition threads */
+	xmmsv_freeze (plan->coll);
+	xmmsv_freeze (plan->fetch);
+
+	return plan;
+}
+
+void
+xmms_medialib_plan_free (xmms_medialib_plan_t *plan)
+{
+	if (plan->cond) {
+		s4_cond_free (plan->cond);
+	}
+	if (plan->order) {
+		xmmsv_unref (plan->order);
+	}
+	if (plan->spec) {
+		xmms_fetch_spec_free (plan->spec);
+	}
+	xmms_fetch_info_free (plan->info);
+	xmmsv_unref (plan->fetch);
+	xmmsv_unref (plan->coll);
+	g_free (plan);
+}
+
+/**
+ * Tell the medialib generation the plan may be reused at, which is
+ * #XMMS_PLAN_CACHE_STATIC if it may be reused at any.
+ *
+ * @returns FALSE if the plan must not be reused at all.
+ */
+gboolean
+xmms_medialib_plan_get_generation (xmms_medialib_plan_t *plan,
+                                   guint *generation)
+{
+	*generation = plan->generation;
+
+	return plan->reusable;
+}
+
+/**
+ * Query the ids of one partition in a session of its own. The session
+ * is left open as the result set is read after the thread is done.
+ */
+static gpointer
+xmms_medialib_partition_run (gpointer data)
+{
+	xmms_medialib_partition_t *part = (xmms_medialib_partition_t *) data;
+	s4_sourcepref_t *sourcepref;
+	s4_condition_t *cond, *range, *op_cond;
+	xmms_fetch_info_t *info;
+	xmms_fetch_spec_t *spec;
+	xmms_error_t err;
+	xmmsv_t *order;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IPC);
+
+	part->session = xmms_medialib_session_begin_ro (part->medialib);
+
+	/* built in the same order as the plan, so the columns match */
+	sourcepref = xmms_medialib_session_get_source_preferences (part->session);
+	info = xmms_fetch_info_new (sourcepref);
+	xmms_error_reset (&err);
+	spec = xmms_fetch_spec_new (part->fetch, info, sourcepref, &err);
+
+	order = xmmsv_new_list ();
+	op_cond = collection_to_condition (part->session, part->coll, info, order);
 	xmmsv_unref (order);
 
+	range = s4_cond_new_custom_filter (id_range_filter, part, NULL,
+	                                   "song_id", sourcepref, 0, 1,
+	                                   S4_COND_PARENT);
+	s4_sourcepref_unref (sourcepref);
+
+	cond = s4_cond_new_combiner (S4_COMBINE_AND);
+	s4_cond_add_operand (cond, range);
+	s4_cond_unref (range);
+	s4_cond_add_operand (cond, op_cond);
+	s4_cond_unref (op_cond);
+
+	part->set = xmms_medialib_session_query (part->session, info->fs, cond);
+
+	s4_cond_free (cond);
+	if (spec) {
+		xmms_fetch_spec_free (spec);
+	}
+	xmms_fetch_info_free (info);
+
+	return NULL;
+}
+
+/**
+ * Split a scanning query into ranges of ids queried by their own
+ * threads, and concatenate their rows in id order.
+ *
+ * @returns The result, or NULL if the query should be run serially.
+ */
+static xmmsv_t *
+xmms_medialib_plan_run_parallel (xmms_medialib_session_t *session,
+                                 xmms_medialib_plan_t *plan, guint threads,
+                                 guint generation)
+{
+	xmms_medialib_partition_t *parts;
+	xmms_medialib_t *medialib;
+	const s4_resultrow_t *row;
+	s4_resultset_t *set;
+	gboolean consistent = TRUE;
+	xmmsv_t *ret;
+	gint32 highest, step;
+	guint i, n;
+	gint j;
+
+	medialib = xmms_medialib_session_get_medialib (session);
+
+	highest = xmms_medialib_highest_id (session);
+	n = MIN (threads, highest / XMMS_MEDIALIB_PARALLEL_MIN_IDS);
+	if (n < 2) {
+		return NULL;
+	}
+
+	step = (highest + n - 1) / n;
+
+	parts = g_new0 (xmms_medialib_partition_t, n);
+	for (i = 0; i < n; i++) {
+		parts[i].medialib = medialib;
+		parts[i].coll = xmmsv_ref (plan->coll);
+		parts[i].fetch = xmmsv_ref (plan->fetch);
+		parts[i].first = 1 + i * step;
+		parts[i].last = (i == n - 1) ? highest : (i + 1) * step;
+		parts[i].thread = g_thread_new ("x2 query part",
+		                                xmms_medialib_partition_run,
+		                                &parts[i]);
+	}
+
+	for (i = 0; i < n; i++) {
+		g_thread_join (parts[i].thread);
+	}
+
+	set = s4_resultset_create (s4_fetchspec_size (plan->info->fs));
+	for (i = 0; i < n; i++) {
+		if (parts[i].set == NULL) {
+			consistent = FALSE;
+			continue;
+		}
+		for (j = 0; s4_resultset_get_row (parts[i].set, j, &row); j++) {
+			s4_resultset_add_row (set, row);
+		}
+		s4_resultset_free (parts[i].set);
+	}
+
+	set = xmms_medialib_result_sort (set, plan->info, plan->order, -1);
+	ret = xmms_medialib_query_to_xmmsv (set, plan->spec);
+	s4_resultset_free (set);
+
+	for (i = 0; i < n; i++) {
+		if (!xmms_medialib_session_commit (parts[i].session)) {
+			consistent = FALSE;
+		}
+		xmmsv_unref (parts[i].fetch);
+		xmmsv_unref (parts[i].coll);
+	}
+	g_free (parts);
+
+	/* the parts ran in separate transactions, a write committed in
+	 * between could have been seen by some of them only */
+	if (generation != xmms_medialib_generation_get (medialib)) {
+		consistent = FALSE;
+	}
+
+	if (!consistent && ret) {
+		xmmsv_unref (ret);
+		ret = NULL;
+	}
+
+	return ret;
+}
+
+/**
+ * Run a prepared query, the plan is left as it was.
+ *
+ * @returns The result as requested by the fetch specification.
+ */
+xmmsv_t *
+xmms_medialib_plan_run (xmms_medialib_session_t *session,
+                        xmms_medialib_plan_t *plan)
+{
+	s4_resultset_t *set;
+	xmmsv_t *ret;
+	guint threads, generation;
+
+	track_filters (session, plan->coll);
+
+	threads = xmms_medialib_get_query_threads (xmms_medialib_session_get_medialib (session));
+
+	/* only read-only sessions, a writing one sees changes the parts
+	 * can't see */
+	if (threads > 1 && plan->parallel &&
+	    xmms_medialib_session_get_generation (session, &generation)) {
+		ret = xmms_medialib_plan_run_parallel (session, plan, threads,
+		                                       generation);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	set = xmms_medialib_session_query (session, plan->info->fs, plan->cond);
+	set = xmms_medialib_result_sort (set, plan->info, plan->order, -1);
+
+	ret = xmms_medialib_query_to_xmmsv (set, plan->spec);
+	s4_resultset_free (set);
+
 	return ret;
 }
@@ -21,7 +21,7 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 
-xmmsv_t *xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec);
+static xmmsv_t *query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec);
 
 typedef struct {
 	gint64 sum;
@@ -38,6 +38,11 @@ typedef struct {
 	xmmsv_t *list;
 } set_data_t;
 
+/* sum, min and max, only made into a value once all rows are in */
+typedef struct {
+	gint64 value;
+} number_data_t;
+
 static xmmsv_t *
 aggregate_first (xmmsv_t *current, gint int_value, const gchar *str_value)
 {
@@ -106,42 +111,55 @@ aggregate_set (xmmsv_t *current, gint int_value, const gchar *str_value)
 	return current;
 }
 
+static number_data_t *
+number_data_get (xmmsv_t **current, gint int_value, gboolean *created)
+{
+	number_data_t *data;
+	guint length;
+
+	*created = *current == NULL;
+	if (*created) {
+		number_data_t init = { int_value };
+		*current = xmmsv_new_bin ((guchar *) &init, sizeof (number_data_t));
+	}
+
+	xmmsv_get_bin (*current, (const guchar **) &data, &length);
+
+	return data;
+}
+
 static xmmsv_t *
 aggregate_sum (xmmsv_t *current, gint int_value, const gchar *str_value)
 {
-	int64_t old_value = 0;
+	number_data_t *data;
+	gboolean created;
 
 	if (str_value != NULL) {
 		/* 'sum' only applies to numbers */
 		return current;
 	}
 
-	if (current != NULL) {
-		xmmsv_get_int64 (current, &old_value);
+	data = number_data_get (&current, int_value, &created);
+	if (!created) {
+		data->value += int_value;
 	}
 
-	return xmmsv_new_int (old_value + int_value);
+	return current;
 }
 
 static xmmsv_t *
 aggregate_min (xmmsv_t *current, gint int_value, const gchar *str_value)
 {
-	gint old_value;
+	number_data_t *data;
+	gboolean created;
 
 	if (str_value != NULL) {
 		/* 'min' only applies to numbers */
 		return current;
 	}
 
-	if (current == NULL) {
-		return xmmsv_new_int (int_value);
-	}
-
-	xmmsv_get_int (current, &old_value);
-
-	if (old_value > int_value) {
-		return xmmsv_new_int (int_value);
-	}
+	data = number_data_get (&current, int_value, &created);
+	data->value = MIN (data->value, int_value);
 
 	return current;
 }
@@ -149,22 +167,16 @@ aggregate_min (xmmsv_t *current, gint int_value, const gchar *str_value)
 static xmmsv_t *
 aggregate_max (xmmsv_t *current, gint int_value, const gchar *str_value)
 {
-	gint old_value;
+	number_data_t *data;
+	gboolean created;
 
 	if (str_value != NULL) {
 		/* 'max' only applies to numbers */
 		return current;
 	}
 
-	if (current == NULL) {
-		return xmmsv_new_int (int_value);
-	}
-
-	xmmsv_get_int (current, &old_value);
-
-	if (old_value < int_value) {
-		return xmmsv_new_int (int_value);
-	}
+	data = number_data_get (&current, int_value, &created);
+	data->value = MAX (data->value, int_value);
 
 	return current;
 }
@@ -220,10 +232,34 @@ aggregate_average (xmmsv_t *current, gint int_value, const gchar *str_value)
 	return current;
 }
 
+/* Property names make up most of the dict keys in a result. s4 shares
+ * the key string between results, so the interned copy is found by
+ * pointer and every name is hashed once per result set. */
+#define INTERN_KEYS_MAX 1024
+
+static const gchar *
+intern_key (GHashTable *keys, const gchar *key)
+{
+	const gchar *ret;
+
+	ret = g_hash_table_lookup (keys, key);
+	if (ret == NULL) {
+		ret = xmmsv_intern_string (key);
+		if (ret == NULL) {
+			ret = key;
+		}
+		if (g_hash_table_size (keys) < INTERN_KEYS_MAX) {
+			g_hash_table_insert (keys, (gpointer) key, (gpointer) ret);
+		}
+	}
+
+	return ret;
+}
+
 /* Converts an S4 result (a column) into an xmmsv values */
 static void *
 result_to_xmmsv (xmmsv_t *ret, gint32 id, const s4_result_t *res,
-                 xmms_fetch_spec_t *spec)
+                 xmms_fetch_spec_t *spec, GHashTable *keys)
 {
 	static xmmsv_t * (*aggregate_functions[AGGREGATE_END])(xmmsv_t *c, gint i, const gchar *s) = {
 		aggregate_first,
@@ -261,7 +297,7 @@ result_to_xmmsv (xmmsv_t *ret, gint32 id, const s4_result_t *res,
 			 */
 			switch (spec->data.metadata.get[i]) {
 				case METADATA_KEY:
-					str_value = s4_result_get_key (res);
+					str_value = intern_key (keys, s4_result_get_key (res));
 					break;
 				case METADATA_SOURCE:
 					str_value = s4_result_get_src (res);
@@ -344,6 +380,7 @@ static xmmsv_t *
 aggregate_data (xmmsv_t *value, aggregate_function_t aggr_func)
 {
 	const random_data_t *random_data;
+	const number_data_t *number_data;
 	const avg_data_t *avg_data;
 	const set_data_t *set_data;
 	gconstpointer data;
@@ -358,11 +395,18 @@ aggregate_data (xmmsv_t *value, aggregate_function_t aggr_func)
 
 	switch (aggr_func) {
 		case AGGREGATE_FIRST:
+			if (value != NULL) {
+				ret = xmmsv_ref (value);
+			} else {
+				ret = xmmsv_new_none ();
+			}
+			break;
 		case AGGREGATE_MIN:
 		case AGGREGATE_MAX:
 		case AGGREGATE_SUM:
-			if (value != NULL) {
-				ret = xmmsv_ref (value);
+			number_data = data;
+			if (number_data != NULL) {
+				ret = xmmsv_new_int (number_data->value);
 			} else {
 				ret = xmmsv_new_none ();
 			}
@@ -449,8 +493,11 @@ metadata_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 {
 	const s4_resultrow_t *row;
 	xmmsv_t *ret = NULL;
+	GHashTable *keys;
 	gint i;
 
+	keys = g_hash_table_new (NULL, NULL);
+
 	/* Loop over the rows in the resultset */
 	for (i = 0; s4_resultset_get_row (set, i, &row); i++) {
 		gint32 id, j;
@@ -460,72 +507,304 @@ metadata_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 			const s4_result_t *res;
 
 			if (s4_resultrow_get_col (row, spec->data.metadata.cols[j], &res)) {
-				ret = result_to_xmmsv (ret, id, res, spec);
+				ret = result_to_xmmsv (ret, id, res, spec, keys);
 			}
 		}
 	}
 
+	g_hash_table_destroy (keys);
+
 	return aggregate_result (ret, spec->data.metadata.get_size - 1,
 	                         spec->data.metadata.aggr_func);
 }
 
 
+/* A cell of a column, the string belongs to the resultset */
+typedef struct {
+	const gchar *str;
+	gint32 num;
+	gboolean present;
+} column_cell_t;
+
+/* Strings are dictionary encoded when they repeat this often */
+#define COLUMNS_DICTIONARY_RATIO 2
+
+/* Builds the most compact form of a column: a packed list of integers,
+ * a dictionary of strings with a packed list of codes (-1 for missing
+ * values), or a plain list of values with none for the missing ones.
+ */
+static xmmsv_t *
+column_to_xmmsv (column_cell_t *cells, gint rows)
+{
+	gboolean all_int = TRUE, all_str = TRUE;
+	xmmsv_t *ret, *dictionary, *codes;
+	GHashTable *table;
+	GPtrArray *strings;
+	gint i;
+
+	for (i = 0; i < rows; i++) {
+		if (!cells[i].present || cells[i].str != NULL) {
+			all_int = FALSE;
+		}
+		if (cells[i].present && cells[i].str == NULL) {
+			all_str = FALSE;
+		}
+	}
+
+	if (all_int) {
+		ret = xmmsv_new_list ();
+		xmmsv_list_restrict_type (ret, XMMSV_TYPE_INT64);
+		for (i = 0; i < rows; i++) {
+			xmmsv_list_append_int (ret, cells[i].num);
+		}
+		return ret;
+	}
+
+	if (all_str) {
+		table = g_hash_table_new (g_str_hash, g_str_equal);
+		strings = g_ptr_array_new ();
+		codes = xmmsv_new_list ();
+		xmmsv_list_restrict_type (codes, XMMSV_TYPE_INT64);
+
+		for (i = 0; i < rows; i++) {
+			gpointer code;
+
+			if (!cells[i].present) {
+				xmmsv_list_append_int (codes, -1);
+				continue;
+			}
+
+			if (!g_hash_table_lookup_extended (table, cells[i].str, NULL, &code)) {
+				code = GINT_TO_POINTER (strings->len);
+				g_hash_table_insert (table, (gpointer) cells[i].str, code);
+				g_ptr_array_add (strings, (gpointer) cells[i].str);
+			}
+			xmmsv_list_append_int (codes, GPOINTER_TO_INT (code));
+		}
+
+		dictionary = NULL;
+		if ((gint) strings->len * COLUMNS_DICTIONARY_RATIO <= rows) {
+			dictionary = xmmsv_new_list ();
+			for (i = 0; i < (gint) strings->len; i++) {
+				xmmsv_list_append_string (dictionary, g_ptr_array_index (strings, i));
+			}
+		}
+
+		g_ptr_array_free (strings, TRUE);
+		g_hash_table_destroy (table);
+
+		if (dictionary != NULL) {
+			return xmmsv_build_dict (XMMSV_DICT_ENTRY ("dictionary", dictionary),
+			                         XMMSV_DICT_ENTRY ("codes", codes),
+			                         XMMSV_DICT_END);
+		}
+
+		xmmsv_unref (codes);
+	}
+
+	ret = xmmsv_new_list ();
+	for (i = 0; i < rows; i++) {
+		xmmsv_t *value;
+
+		if (!cells[i].present) {
+			value = xmmsv_new_none ();
+		} else if (cells[i].str != NULL) {
+			value = xmmsv_new_string (cells[i].str);
+		} else {
+			value = xmmsv_new_int (cells[i].num);
+		}
+		xmmsv_list_append (ret, value);
+		xmmsv_unref (value);
+	}
+
+	return ret;
+}
+
+/* Converts an S4 resultset to columns, see xmmsv_columns_get_value */
+static xmmsv_t *
+columns_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
+{
+	const s4_resultrow_t *row;
+	column_cell_t *cells;
+	xmmsv_t *ids, *fields, *columns;
+	gint i, j, rows, count;
+
+	rows = s4_resultset_get_rowcount (set);
+	count = spec->data.columns.count;
+	cells = g_new0 (column_cell_t, rows * count);
+
+	ids = xmmsv_new_list ();
+	xmmsv_list_restrict_type (ids, XMMSV_TYPE_INT64);
+
+	for (i = 0; s4_resultset_get_row (set, i, &row); i++) {
+		gint32 id;
+
+		s4_val_get_int (s4_result_get_val (s4_resultset_get_result (set, i, 0)), &id);
+		xmmsv_list_append_int (ids, id);
+
+		for (j = 0; j < count; j++) {
+			column_cell_t *cell = &cells[j * rows + i];
+			const s4_result_t *res;
+			const s4_val_t *val;
+
+			/* the preferred source comes first */
+			if (!s4_resultrow_get_col (row, spec->data.columns.cols[j], &res) ||
+			    res == NULL) {
+				continue;
+			}
+
+			val = s4_result_get_val (res);
+			if (s4_val_get_int (val, &cell->num) || s4_val_get_str (val, &cell->str)) {
+				cell->present = TRUE;
+			}
+		}
+	}
+
+	fields = xmmsv_new_list ();
+	columns = xmmsv_new_list ();
+	for (j = 0; j < count; j++) {
+		xmmsv_t *column;
+
+		xmmsv_list_append_string (fields, spec->data.columns.keys[j]);
+
+		column = column_to_xmmsv (&cells[j * rows], rows);
+		xmmsv_list_append (columns, column);
+		xmmsv_unref (column);
+	}
+
+	g_free (cells);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY ("id", ids),
+	                         XMMSV_DICT_ENTRY ("fields", fields),
+	                         XMMSV_DICT_ENTRY ("columns", columns),
+	                         XMMSV_DICT_END);
+}
+
+/* The cluster of an integer value, looked up by its string in table so
+ * 5 and "5" still end up in one cluster */
+static s4_resultset_t *
+cluster_by_int (GHashTable *table, GHashTable *ints, gint32 value)
+{
+	s4_resultset_t *cluster;
+	gchar buf[12];
+
+	cluster = g_hash_table_lookup (ints, GINT_TO_POINTER (value));
+	if (cluster == NULL) {
+		g_snprintf (buf, sizeof (buf), "%i", value);
+		cluster = g_hash_table_lookup (table, buf);
+		if (cluster != NULL) {
+			g_hash_table_insert (ints, GINT_TO_POINTER (value), cluster);
+		}
+	}
+
+	return cluster;
+}
+
+/* s4 hands out the same string for equal values, so strings are looked
+ * up by pointer before they are hashed */
+static s4_resultset_t *
+cluster_by_str (GHashTable *table, GHashTable *strs, const gchar *value)
+{
+	s4_resultset_t *cluster;
+
+	cluster = g_hash_table_lookup (strs, value);
+	if (cluster == NULL) {
+		cluster = g_hash_table_lookup (table, value);
+		if (cluster != NULL) {
+			g_hash_table_insert (strs, (gpointer) value, cluster);
+		}
+	}
+
+	return cluster;
+}
+
 /* Divides an S4 set into a list of smaller sets with
- * the same values for the cluster attributes
+ * the same values for the cluster attributes. The table is only
+ * filled if there is one, clustering a list by position doesn't
+ * need it.
  */
 static void
 cluster_set (s4_resultset_t *set, xmms_fetch_spec_t *spec,
              GHashTable *table, GList **list)
 {
 	const s4_resultrow_t *row;
+	GHashTable *ints, *strs;
 	gint position;
 
+	ints = g_hash_table_new (NULL, NULL);
+	strs = g_hash_table_new (NULL, NULL);
+
 	/* Run through all the rows in the result set.
 	 * Uses a hash table to find the correct cluster to put the row in
 	 */
 	for (position = 0; s4_resultset_get_row (set, position, &row); position++) {
-		s4_resultset_t *cluster;
+		s4_resultset_t *cluster = NULL;
 		const s4_result_t *res;
-		const gchar *value = spec->data.cluster.fallback;
+		const gchar *value = NULL;
+		gboolean is_int = FALSE;
+		gint32 ival = 0;
 		gchar buf[12];
 
 		if (spec->data.cluster.type == CLUSTER_BY_POSITION) {
-			g_snprintf (buf, sizeof (buf), "%i", position);
-			value = buf;
+			/* every row is a cluster of its own */
+			ival = position;
+			is_int = TRUE;
 		} else if (s4_resultrow_get_col (row, spec->data.cluster.column, &res)) {
 			const s4_val_t *val = s4_result_get_val (res);
-			if (!s4_val_get_str (val, &value)) {
-				gint32 ival;
+			if (s4_val_get_str (val, &value)) {
+				cluster = cluster_by_str (table, strs, value);
+			} else {
 				s4_val_get_int (val, &ival);
-				g_snprintf (buf, sizeof (buf), "%i", ival);
-				value = buf;
+				is_int = TRUE;
+				cluster = cluster_by_int (table, ints, ival);
 			}
+		} else {
+			value = spec->data.cluster.fallback;
+			if (value == NULL) {
+				/* value not found, and no fallback provided */
+				continue;
+			}
+			cluster = g_hash_table_lookup (table, value);
 		}
 
-		if (value == NULL) {
-			/* value not found, and no fallback provided */
-			continue;
-		}
-
-		cluster = g_hash_table_lookup (table, value);
 		if (cluster == NULL) {
 			cluster = s4_resultset_create (s4_resultset_get_colcount (set));
-			g_hash_table_insert (table, g_strdup (value), cluster);
 			*list = g_list_prepend (*list, cluster);
+
+			if (spec->data.cluster.type != CLUSTER_BY_POSITION) {
+				if (is_int) {
+					g_snprintf (buf, sizeof (buf), "%i", ival);
+					value = buf;
+					g_hash_table_insert (ints, GINT_TO_POINTER (ival), cluster);
+				}
+				g_hash_table_insert (table, g_strdup (value), cluster);
+			} else if (table != NULL) {
+				g_snprintf (buf, sizeof (buf), "%i", ival);
+				g_hash_table_insert (table, g_strdup (buf), cluster);
+			}
 		}
 		s4_resultset_add_row (cluster, row);
 	}
+
+	g_hash_table_destroy (strs);
+	g_hash_table_destroy (ints);
 }
 
 static GList *
 cluster_list (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 {
-	GHashTable *table;
+	GHashTable *table = NULL;
 	GList *list = NULL;
 
-	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	if (spec->data.cluster.type != CLUSTER_BY_POSITION) {
+		table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	}
+
 	cluster_set (set, spec, table, &list);
-	g_hash_table_destroy (table);
+
+	if (table != NULL) {
+		g_hash_table_destroy (table);
+	}
 
 	return g_list_reverse (list);
 }
@@ -564,7 +843,7 @@ convert_ghashtable_to_xmmsv (GHashTable *table, xmms_fetch_spec_t *spec)
 			continue;
 		}
 
-		converted = xmms_medialib_query_to_xmmsv (value, spec);
+		converted = query_to_xmmsv (value, spec);
 		xmmsv_dict_set (ret, key, converted);
 		xmmsv_unref (converted);
 	}
@@ -577,9 +856,8 @@ convert_ghashtable_to_xmmsv (GHashTable *table, xmms_fetch_spec_t *spec)
 	return ret;
 }
 
-/* Converts an S4 resultset into an xmmsv_t, based on the fetch specification */
-xmmsv_t *
-xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
+static xmmsv_t *
+query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 {
 	GHashTable *set_table;
 	GList *sets;
@@ -590,6 +868,9 @@ xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 		case FETCH_COUNT:
 			ret = xmmsv_new_int (s4_resultset_get_rowcount (set));
 			break;
+		case FETCH_COLUMNS:
+			ret = columns_to_xmmsv (set, spec);
+			break;
 		case FETCH_METADATA:
 			ret = metadata_to_xmmsv (set, spec);
 			break;
@@ -597,7 +878,7 @@ xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 			ret = xmmsv_new_dict ();
 
 			for (i = 0; i < spec->data.organize.count; i++) {
-				val = xmms_medialib_query_to_xmmsv (set, spec->data.organize.data[i]);
+				val = query_to_xmmsv (set, spec->data.organize.data[i]);
 				if (val != NULL) {
 					xmmsv_dict_set (ret, spec->data.organize.keys[i], val);
 					xmmsv_unref (val);
@@ -610,7 +891,7 @@ xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 			for (; sets != NULL; sets = g_list_delete_link (sets, sets)) {
 				set = sets->data;
 
-				val = xmms_medialib_query_to_xmmsv (set, spec->data.cluster.data);
+				val = query_to_xmmsv (set, spec->data.cluster.data);
 				if (val != NULL) {
 					xmmsv_list_append (ret, val);
 					xmmsv_unref (val);
@@ -630,3 +911,26 @@ xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
 
 	return ret;
 }
+
+/**
+ * Converts an S4 resultset into an xmmsv_t, based on the fetch specification.
+ *
+ * The values are allocated from an arena, results are usually freed as a
+ * whole once the reply has been sent.
+ */
+xmmsv_t *
+xmms_medialib_query_to_xmmsv (s4_resultset_t *set, xmms_fetch_spec_t *spec)
+{
+	xmmsv_arena_t *arena, *prev;
+	xmmsv_t *ret;
+
+	arena = xmmsv_arena_new ();
+	prev = xmmsv_arena_use (arena);
+
+	ret = query_to_xmmsv (set, spec);
+
+	xmmsv_arena_use (prev);
+	xmmsv_arena_release (arena);
+
+	return ret;
+}
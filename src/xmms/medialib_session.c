@@ -15,19 +15,52 @@
  */
 
 #include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_trace.h>
 #include <xmms/xmms_object.h>
+#include <xmms/xmms_config.h>
 #include <xmms/xmms_log.h>
 #include <string.h>
 
 struct xmms_medialib_session_St {
 	xmms_medialib_t *medialib;
 	s4_transaction_t *trans;
+	gboolean readonly;
+	/** Medialib generation when the session began */
+	guint generation;
 	GHashTable *added;
 	GHashTable *updated;
 	GHashTable *removed;
+	/** The last status set for each entry */
+	GHashTable *statuses;
+	/** The properties of entries read, until they are set */
+	GHashTable *entries;
 	xmmsv_t *vals;
 };
 
+/**
+ * Entries changed by committed sessions but not yet broadcasted.
+ *
+ * When coalescing is enabled the events of several commits are merged
+ * (so an entry touched by many commits is only announced once) and
+ * flushed when enough entries are pending or the window has expired.
+ *
+ * Only the broadcasts are grouped, every session still commits its own
+ * s4 transaction: a conflict must only fail the writes of the session
+ * that caused it, as its caller is the one retrying them. The mediainfo
+ * readers already resolve a batch of entries per session, which is where
+ * an import spends its commits.
+ */
+struct xmms_medialib_event_queue_St {
+	xmms_medialib_t *medialib;
+	GMutex mutex;
+	GHashTable *added;
+	GHashTable *updated;
+	GHashTable *removed;
+	guint timeout_id;
+	gint max_entries;
+	gint max_ms;
+};
+
 static void xmms_medialib_session_free (xmms_medialib_session_t *session);
 static void xmms_medialib_session_free_full (xmms_medialib_session_t *session);
 
@@ -46,8 +79,13 @@ xmms_medialib_session_begin_internal (xmms_medialib_t *medialib,
 	xmms_object_ref (medialib);
 	ret->medialib = medialib;
 
+	/* read before the transaction starts, so the session never sees
+	 * data older than its generation */
+	ret->generation = xmms_medialib_generation_get (medialib);
+
 	s4_t *s4 = xmms_medialib_get_database_backend (medialib);
 	ret->trans = s4_begin (s4, flags);
+	ret->readonly = (flags & S4_TRANS_READONLY) != 0;
 
 	return ret;
 }
@@ -71,52 +109,264 @@ xmms_medialib_session_abort (xmms_medialib_session_t *session)
 	xmms_medialib_session_free_full (session);
 }
 
-gboolean
-xmms_medialib_session_commit (xmms_medialib_session_t *session)
+static void
+xmms_medialib_event_merge (GHashTable **dst, GHashTable *src)
 {
 	GHashTableIter iter;
 	gpointer key;
 
-	if (s4_commit (session->trans) == 0) {
-        XMMS_DBG ("Transaction failed: %s", s4_strerror());
-		xmms_medialib_session_free_full (session);
-		return FALSE;
+	if (src == NULL)
+		return;
+
+	xmms_medialib_session_get_table (dst);
+
+	g_hash_table_iter_init (&iter, src);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		g_hash_table_insert (*dst, key, key);
 	}
+}
+
+static gsize
+xmms_medialib_event_count (GHashTable *table)
+{
+	return table != NULL ? g_hash_table_size (table) : 0;
+}
+
+static gint
+xmms_medialib_event_id_compare (xmmsv_t **a, xmmsv_t **b)
+{
+	gint32 ia, ib;
+
+	xmmsv_get_int (*a, &ia);
+	xmmsv_get_int (*b, &ib);
+
+	return (ia > ib) - (ia < ib);
+}
 
-	if (session->added != NULL) {
-		g_hash_table_iter_init (&iter, session->added);
+static void
+xmms_medialib_events_send (xmms_medialib_t *medialib, GHashTable *added,
+                           GHashTable *updated, GHashTable *removed)
+{
+	GHashTableIter iter;
+	gpointer key;
+
+	if (added != NULL) {
+		g_hash_table_iter_init (&iter, added);
 
 		while (g_hash_table_iter_next (&iter, &key, NULL)) {
-			xmms_medialib_entry_send_added (session->medialib,
-			                                GPOINTER_TO_INT (key));
-			if (session->updated != NULL)
-				g_hash_table_remove (session->updated, key);
+			xmms_medialib_entry_send_added (medialib, GPOINTER_TO_INT (key));
+			if (updated != NULL)
+				g_hash_table_remove (updated, key);
 		}
 	}
 
-	if (session->removed != NULL) {
-		g_hash_table_iter_init (&iter, session->removed);
+	if (removed != NULL) {
+		g_hash_table_iter_init (&iter, removed);
 
 		while (g_hash_table_iter_next (&iter, &key, NULL)) {
-			xmms_medialib_entry_send_removed (session->medialib,
-			                                  GPOINTER_TO_INT (key));
-			if (session->updated != NULL)
-				g_hash_table_remove (session->updated, key);
+			xmms_medialib_entry_send_removed (medialib, GPOINTER_TO_INT (key));
+			if (updated != NULL)
+				g_hash_table_remove (updated, key);
 		}
 	}
 
+	if (updated != NULL && g_hash_table_size (updated) > 0) {
+		xmmsv_t *ids = xmmsv_new_list ();
 
-	if (session->updated != NULL) {
-		g_hash_table_iter_init (&iter, session->updated);
+		g_hash_table_iter_init (&iter, updated);
 
 		while (g_hash_table_iter_next (&iter, &key, NULL)) {
-			xmms_medialib_entry_send_update (session->medialib,
-			                                 GPOINTER_TO_INT (key));
+			xmms_medialib_entry_send_update (medialib, GPOINTER_TO_INT (key));
+			xmmsv_list_append_int (ids, GPOINTER_TO_INT (key));
 		}
+
+		/* one broadcast for everything changed together */
+		xmmsv_list_sort (ids, xmms_medialib_event_id_compare);
+		xmms_object_emit (XMMS_OBJECT (medialib),
+		                  XMMS_IPC_SIGNAL_MEDIALIB_ENTRIES_CHANGED,
+		                  ids);
+	}
+}
+
+/**
+ * Broadcast all pending events of the queue.
+ */
+void
+xmms_medialib_event_queue_flush (xmms_medialib_event_queue_t *queue)
+{
+	GHashTable *added, *updated, *removed;
+
+	g_mutex_lock (&queue->mutex);
+	added = queue->added;
+	updated = queue->updated;
+	removed = queue->removed;
+	queue->added = queue->updated = queue->removed = NULL;
+	if (queue->timeout_id) {
+		g_source_remove (queue->timeout_id);
+		queue->timeout_id = 0;
 	}
+	g_mutex_unlock (&queue->mutex);
+
+	xmms_medialib_events_send (queue->medialib, added, updated, removed);
+
+	if (added != NULL)
+		g_hash_table_unref (added);
+	if (updated != NULL)
+		g_hash_table_unref (updated);
+	if (removed != NULL)
+		g_hash_table_unref (removed);
+}
+
+static gboolean
+xmms_medialib_event_queue_timeout (gpointer udata)
+{
+	xmms_medialib_event_queue_t *queue = (xmms_medialib_event_queue_t *) udata;
+
+	g_mutex_lock (&queue->mutex);
+	queue->timeout_id = 0;
+	g_mutex_unlock (&queue->mutex);
+
+	xmms_medialib_event_queue_flush (queue);
+
+	return FALSE;
+}
+
+static void
+xmms_medialib_event_queue_push (xmms_medialib_event_queue_t *queue,
+                                xmms_medialib_session_t *session)
+{
+	gboolean flush;
+	gsize pending;
+
+	g_mutex_lock (&queue->mutex);
+
+	if (queue->max_ms <= 0) {
+		g_mutex_unlock (&queue->mutex);
+		xmms_medialib_events_send (session->medialib, session->added,
+		                           session->updated, session->removed);
+		return;
+	}
+
+	xmms_medialib_event_merge (&queue->added, session->added);
+	xmms_medialib_event_merge (&queue->updated, session->updated);
+	xmms_medialib_event_merge (&queue->removed, session->removed);
+
+	pending = xmms_medialib_event_count (queue->added) +
+	          xmms_medialib_event_count (queue->updated) +
+	          xmms_medialib_event_count (queue->removed);
+
+	flush = queue->max_entries > 0 && pending >= queue->max_entries;
+
+	if (!flush && pending > 0 && !queue->timeout_id) {
+		queue->timeout_id = g_timeout_add (queue->max_ms,
+		                                   xmms_medialib_event_queue_timeout,
+		                                   queue);
+	}
+
+	g_mutex_unlock (&queue->mutex);
+
+	if (flush) {
+		xmms_medialib_event_queue_flush (queue);
+	}
+}
+
+static void
+xmms_medialib_event_queue_config_changed (xmms_object_t *object,
+                                          xmmsv_t *data, gpointer udata)
+{
+	xmms_medialib_event_queue_t *queue = (xmms_medialib_event_queue_t *) udata;
+	xmms_config_property_t *cfg;
+
+	g_mutex_lock (&queue->mutex);
+
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_entries");
+	queue->max_entries = xmms_config_property_get_int (cfg);
+
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_ms");
+	queue->max_ms = xmms_config_property_get_int (cfg);
+
+	g_mutex_unlock (&queue->mutex);
+
+	/* don't hold back anything queued with the old settings */
+	xmms_medialib_event_queue_flush (queue);
+}
+
+xmms_medialib_event_queue_t *
+xmms_medialib_event_queue_new (xmms_medialib_t *medialib)
+{
+	xmms_medialib_event_queue_t *queue;
+
+	queue = g_new0 (xmms_medialib_event_queue_t, 1);
+	queue->medialib = medialib;
+	g_mutex_init (&queue->mutex);
+
+	/* 0 ms means every commit is broadcasted right away */
+	xmms_config_property_register ("medialib.notify_coalesce_entries", "256",
+	                               xmms_medialib_event_queue_config_changed,
+	                               queue);
+	xmms_config_property_register ("medialib.notify_coalesce_ms", "0",
+	                               xmms_medialib_event_queue_config_changed,
+	                               queue);
+
+	xmms_medialib_event_queue_config_changed (NULL, NULL, queue);
+
+	return queue;
+}
+
+void
+xmms_medialib_event_queue_free (xmms_medialib_event_queue_t *queue)
+{
+	xmms_config_property_t *cfg;
+
+	xmms_medialib_event_queue_flush (queue);
+
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_entries");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_event_queue_config_changed, queue);
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_ms");
+	xmms_config_property_callback_remove (cfg, xmms_medialib_event_queue_config_changed, queue);
+
+	g_mutex_clear (&queue->mutex);
+	g_free (queue);
+}
+
+gboolean
+xmms_medialib_session_commit (xmms_medialib_session_t *session)
+{
+	XMMS_TRACE_BEGIN ("medialib.commit");
+
+	if (s4_commit (session->trans) == 0) {
+        XMMS_DBG ("Transaction failed: %s", s4_strerror());
+		xmms_medialib_conflict_count (session->medialib, session->readonly);
+		xmms_medialib_session_free_full (session);
+		XMMS_TRACE_END ("medialib.commit");
+		return FALSE;
+	}
+
+	if (!session->readonly) {
+		xmms_token_index_t *index;
+		guint generation;
+
+		/* sessions reading the generation after this began after the
+		 * commit, and see the changes */
+		index = xmms_medialib_get_token_index (session->medialib);
+		generation = xmms_medialib_generation_get (session->medialib) + 1;
+		xmms_token_index_touch (index, session->added, generation);
+		xmms_token_index_touch (index, session->updated, generation);
+		xmms_token_index_touch (index, session->removed, generation);
+
+		xmms_medialib_generation_bump (session->medialib);
+
+		xmms_medialib_pending_update (session->medialib, session->statuses,
+		                              session->removed);
+	}
+
+	xmms_medialib_event_queue_push (xmms_medialib_get_event_queue (session->medialib),
+	                                session);
 
 	xmms_medialib_session_free (session);
 
+	XMMS_TRACE_END ("medialib.commit");
+
 	return TRUE;
 }
 
@@ -126,6 +376,40 @@ xmms_medialib_session_get_source_preferences (xmms_medialib_session_t *session)
 	return xmms_medialib_get_source_preferences (session->medialib);
 }
 
+void
+xmms_medialib_session_track_filter (xmms_medialib_session_t *session,
+                                    const gchar *key)
+{
+	xmms_medialib_index_track_filter (session->medialib, key);
+}
+
+/**
+ * Tell which medialib generation a read-only session sees.
+ *
+ * @returns FALSE for sessions that may write, those also see their own
+ * uncommitted changes.
+ */
+gboolean
+xmms_medialib_session_get_generation (xmms_medialib_session_t *session,
+                                      guint *generation)
+{
+	*generation = session->generation;
+
+	return session->readonly;
+}
+
+xmms_plan_cache_t *
+xmms_medialib_session_get_plan_cache (xmms_medialib_session_t *session)
+{
+	return xmms_medialib_get_plan_cache (session->medialib);
+}
+
+xmms_medialib_t *
+xmms_medialib_session_get_medialib (xmms_medialib_session_t *session)
+{
+	return session->medialib;
+}
+
 s4_resultset_t *
 xmms_medialib_session_query (xmms_medialib_session_t *session,
                              s4_fetchspec_t *specification,
@@ -134,6 +418,45 @@ xmms_medialib_session_query (xmms_medialib_session_t *session,
 	return s4_query (session->trans, specification, condition);
 }
 
+/**
+ * Get the properties of an entry read before in the session.
+ *
+ * @returns The table stored with xmms_medialib_session_set_entry_cache,
+ * or NULL if there is none or a property of the entry changed since.
+ */
+GHashTable *
+xmms_medialib_session_get_entry_cache (xmms_medialib_session_t *session,
+                                       xmms_medialib_entry_t entry)
+{
+	if (session->entries == NULL)
+		return NULL;
+	return g_hash_table_lookup (session->entries, GINT_TO_POINTER (entry));
+}
+
+/**
+ * Keep the properties of an entry for the rest of the session. The
+ * session takes over the table.
+ */
+void
+xmms_medialib_session_set_entry_cache (xmms_medialib_session_t *session,
+                                       xmms_medialib_entry_t entry,
+                                       GHashTable *properties)
+{
+	if (session->entries == NULL) {
+		session->entries = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+		                                          NULL, (GDestroyNotify) g_hash_table_unref);
+	}
+	g_hash_table_replace (session->entries, GINT_TO_POINTER (entry), properties);
+}
+
+static void
+xmms_medialib_session_entry_changed (xmms_medialib_session_t *session,
+                                     xmms_medialib_entry_t entry)
+{
+	if (session->entries != NULL)
+		g_hash_table_remove (session->entries, GINT_TO_POINTER (entry));
+}
+
 gint
 xmms_medialib_session_property_set (xmms_medialib_session_t *session,
                                     xmms_medialib_entry_t entry,
@@ -180,6 +503,8 @@ xmms_medialib_session_property_set (xmms_medialib_session_t *session,
 
 	s4_val_free (song_id);
 
+	xmms_medialib_session_entry_changed (session, entry);
+
 	if (strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_URL) == 0) {
 		events = xmms_medialib_session_get_table (&session->added);
 	} else {
@@ -190,6 +515,17 @@ xmms_medialib_session_property_set (xmms_medialib_session_t *session,
 	                     GINT_TO_POINTER (entry),
 	                     GINT_TO_POINTER (entry));
 
+	/* the mediainfo reader works off the statuses committed */
+	if (strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS) == 0) {
+		gint32 status;
+
+		if (s4_val_get_int (value, &status)) {
+			g_hash_table_insert (xmms_medialib_session_get_table (&session->statuses),
+			                     GINT_TO_POINTER (entry),
+			                     GINT_TO_POINTER (status));
+		}
+	}
+
 	return result;
 }
 
@@ -209,6 +545,8 @@ xmms_medialib_session_property_unset (xmms_medialib_session_t *session,
 	                 key, value, source);
 	s4_val_free (song_id);
 
+	xmms_medialib_session_entry_changed (session, entry);
+
 	if (strcmp (key, XMMS_MEDIALIB_ENTRY_PROPERTY_URL) == 0) {
 		events = xmms_medialib_session_get_table (&session->removed);
 	} else {
@@ -256,6 +594,10 @@ xmms_medialib_session_free (xmms_medialib_session_t *session)
 		g_hash_table_unref (session->updated);
 	if (session->removed != NULL)
 		g_hash_table_unref (session->removed);
+	if (session->statuses != NULL)
+		g_hash_table_unref (session->statuses);
+	if (session->entries != NULL)
+		g_hash_table_unref (session->entries);
 	if (session->vals != NULL)
 		xmmsv_unref (session->vals);
 
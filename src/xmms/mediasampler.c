@@ -0,0 +1,412 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ *  Id sets of source collections, for picking random media without
+ *  querying the medialib every time.
+ *
+ *  Each set is filled by one query, and kept up to date from the
+ *  medialib signals: removed entries are dropped right away, added and
+ *  changed ones are queued until the owner rechecks them against the
+ *  collection.
+ */
+
+#include <xmmspriv/xmms_mediasampler.h>
+#include <xmms/xmms_log.h>
+
+typedef struct xmms_media_sample_set_St {
+	GBytes *key;
+	/** The members, in no particular order */
+	GArray *ids;
+	/** Member id to its position in ids plus one */
+	GHashTable *index;
+	/** Ids to check for membership again */
+	GHashTable *pending;
+	GList link;
+} xmms_media_sample_set_t;
+
+struct xmms_media_sampler_St {
+	GMutex mutex;
+	GHashTable *sets;
+	/** Most recently used first */
+	GQueue lru;
+	guint max_sets;
+	GRand *rand;
+};
+
+static void
+xmms_media_sample_set_free (gpointer data)
+{
+	xmms_media_sample_set_t *set = data;
+
+	g_bytes_unref (set->key);
+	g_array_free (set->ids, TRUE);
+	g_hash_table_destroy (set->index);
+	g_hash_table_destroy (set->pending);
+	g_free (set);
+}
+
+static void
+xmms_media_sample_set_add (xmms_media_sample_set_t *set,
+                           xmms_medialib_entry_t entry)
+{
+	if (g_hash_table_lookup (set->index, GINT_TO_POINTER (entry))) {
+		return;
+	}
+
+	g_array_append_val (set->ids, entry);
+	g_hash_table_insert (set->index, GINT_TO_POINTER (entry),
+	                     GUINT_TO_POINTER (set->ids->len));
+}
+
+/** Move the last member into the hole to keep this O(1). */
+static void
+xmms_media_sample_set_remove (xmms_media_sample_set_t *set,
+                              xmms_medialib_entry_t entry)
+{
+	xmms_medialib_entry_t last;
+	guint pos;
+
+	pos = GPOINTER_TO_UINT (g_hash_table_lookup (set->index,
+	                                             GINT_TO_POINTER (entry)));
+	if (!pos) {
+		return;
+	}
+
+	g_hash_table_remove (set->index, GINT_TO_POINTER (entry));
+
+	last = g_array_index (set->ids, xmms_medialib_entry_t, set->ids->len - 1);
+	if (last != entry) {
+		g_array_index (set->ids, xmms_medialib_entry_t, pos - 1) = last;
+		g_hash_table_insert (set->index, GINT_TO_POINTER (last),
+		                     GUINT_TO_POINTER (pos));
+	}
+	g_array_set_size (set->ids, set->ids->len - 1);
+}
+
+/** Find a set and mark it used, should hold the sampler mutex. */
+static xmms_media_sample_set_t *
+xmms_media_sampler_find (xmms_media_sampler_t *sampler, GBytes *key)
+{
+	xmms_media_sample_set_t *set;
+
+	set = g_hash_table_lookup (sampler->sets, key);
+	if (set) {
+		g_queue_unlink (&sampler->lru, &set->link);
+		g_queue_push_head_link (&sampler->lru, &set->link);
+	}
+
+	return set;
+}
+
+xmms_media_sampler_t *
+xmms_media_sampler_new (guint max_sets)
+{
+	xmms_media_sampler_t *sampler;
+
+	sampler = g_new0 (xmms_media_sampler_t, 1);
+	g_mutex_init (&sampler->mutex);
+	g_queue_init (&sampler->lru);
+	sampler->sets = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+	                                       NULL, xmms_media_sample_set_free);
+	sampler->max_sets = MAX (max_sets, 1);
+	sampler->rand = g_rand_new ();
+
+	return sampler;
+}
+
+void
+xmms_media_sampler_free (xmms_media_sampler_t *sampler)
+{
+	g_return_if_fail (sampler);
+
+	g_queue_init (&sampler->lru);
+	g_hash_table_destroy (sampler->sets);
+	g_rand_free (sampler->rand);
+	g_mutex_clear (&sampler->mutex);
+	g_free (sampler);
+}
+
+/**
+ * Forget all sets, for when collections change.
+ */
+void
+xmms_media_sampler_clear (xmms_media_sampler_t *sampler)
+{
+	g_return_if_fail (sampler);
+
+	g_mutex_lock (&sampler->mutex);
+	g_queue_init (&sampler->lru);
+	g_hash_table_remove_all (sampler->sets);
+	g_mutex_unlock (&sampler->mutex);
+}
+
+/**
+ * @returns TRUE if there is a set for the key.
+ */
+gboolean
+xmms_media_sampler_lookup (xmms_media_sampler_t *sampler, GBytes *key)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (sampler, FALSE);
+	g_return_val_if_fail (key, FALSE);
+
+	g_mutex_lock (&sampler->mutex);
+	ret = xmms_media_sampler_find (sampler, key) != NULL;
+	g_mutex_unlock (&sampler->mutex);
+
+	return ret;
+}
+
+/**
+ * Create the set for a key from a list of ids, replacing any old one.
+ */
+void
+xmms_media_sampler_insert (xmms_media_sampler_t *sampler, GBytes *key,
+                           xmmsv_t *ids)
+{
+	xmms_media_sample_set_t *set, *old;
+	xmmsv_list_iter_t *it;
+	gint32 entry;
+
+	g_return_if_fail (sampler);
+	g_return_if_fail (key);
+	g_return_if_fail (ids);
+
+	set = g_new0 (xmms_media_sample_set_t, 1);
+	set->key = g_bytes_ref (key);
+	set->ids = g_array_sized_new (FALSE, FALSE, sizeof (xmms_medialib_entry_t),
+	                              xmmsv_list_get_size (ids));
+	set->index = g_hash_table_new (NULL, NULL);
+	set->pending = g_hash_table_new (NULL, NULL);
+	set->link.data = set;
+
+	xmmsv_get_list_iter (ids, &it);
+	while (xmmsv_list_iter_entry_int32 (it, &entry)) {
+		xmms_media_sample_set_add (set, entry);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	g_mutex_lock (&sampler->mutex);
+
+	old = g_hash_table_lookup (sampler->sets, key);
+	if (old) {
+		g_queue_unlink (&sampler->lru, &old->link);
+		g_hash_table_remove (sampler->sets, key);
+	}
+
+	g_hash_table_insert (sampler->sets, set->key, set);
+	g_queue_push_head_link (&sampler->lru, &set->link);
+
+	while (g_queue_get_length (&sampler->lru) > sampler->max_sets) {
+		old = g_queue_peek_tail (&sampler->lru);
+		g_queue_unlink (&sampler->lru, &old->link);
+		g_hash_table_remove (sampler->sets, old->key);
+	}
+
+	g_mutex_unlock (&sampler->mutex);
+}
+
+/**
+ * Take the ids that have to be checked for membership again.
+ *
+ * @returns A list of ids, or NULL if there are none.
+ */
+xmmsv_t *
+xmms_media_sampler_pending_take (xmms_media_sampler_t *sampler, GBytes *key)
+{
+	xmms_media_sample_set_t *set;
+	GHashTableIter iter;
+	gpointer entry;
+	xmmsv_t *ret = NULL;
+
+	g_return_val_if_fail (sampler, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	g_mutex_lock (&sampler->mutex);
+
+	set = xmms_media_sampler_find (sampler, key);
+	if (set && g_hash_table_size (set->pending)) {
+		ret = xmmsv_new_list ();
+
+		g_hash_table_iter_init (&iter, set->pending);
+		while (g_hash_table_iter_next (&iter, &entry, NULL)) {
+			xmmsv_list_append_int (ret, GPOINTER_TO_INT (entry));
+		}
+		g_hash_table_remove_all (set->pending);
+	}
+
+	g_mutex_unlock (&sampler->mutex);
+
+	return ret;
+}
+
+/**
+ * Apply the result of a recheck: of the checked ids, those listed in
+ * members belong to the set and all others don't.
+ */
+void
+xmms_media_sampler_update (xmms_media_sampler_t *sampler, GBytes *key,
+                           xmmsv_t *checked, xmmsv_t *members)
+{
+	xmms_media_sample_set_t *set;
+	GHashTable *found;
+	xmmsv_list_iter_t *it;
+	gint32 entry;
+
+	g_return_if_fail (sampler);
+	g_return_if_fail (key);
+	g_return_if_fail (checked);
+
+	found = g_hash_table_new (NULL, NULL);
+
+	if (members) {
+		xmmsv_get_list_iter (members, &it);
+		while (xmmsv_list_iter_entry_int32 (it, &entry)) {
+			g_hash_table_add (found, GINT_TO_POINTER (entry));
+			xmmsv_list_iter_next (it);
+		}
+		xmmsv_list_iter_explicit_destroy (it);
+	}
+
+	g_mutex_lock (&sampler->mutex);
+
+	set = xmms_media_sampler_find (sampler, key);
+	if (set) {
+		xmmsv_get_list_iter (checked, &it);
+		while (xmmsv_list_iter_entry_int32 (it, &entry)) {
+			if (g_hash_table_contains (found, GINT_TO_POINTER (entry))) {
+				xmms_media_sample_set_add (set, entry);
+			} else {
+				xmms_media_sample_set_remove (set, entry);
+			}
+			xmmsv_list_iter_next (it);
+		}
+		xmmsv_list_iter_explicit_destroy (it);
+	}
+
+	g_mutex_unlock (&sampler->mutex);
+
+	g_hash_table_destroy (found);
+}
+
+/**
+ * Get the members of the set for a key, in no particular order.
+ *
+ * @returns A new idlist collection, NULL if the set is missing.
+ */
+xmmsv_t *
+xmms_media_sampler_members_get (xmms_media_sampler_t *sampler, GBytes *key)
+{
+	xmms_media_sample_set_t *set;
+	xmmsv_t *ret = NULL;
+	guint i;
+
+	g_return_val_if_fail (sampler, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	g_mutex_lock (&sampler->mutex);
+
+	set = xmms_media_sampler_find (sampler, key);
+	if (set) {
+		ret = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+		for (i = 0; i < set->ids->len; i++) {
+			xmmsv_coll_idlist_append (ret, g_array_index (set->ids,
+			                                              xmms_medialib_entry_t, i));
+		}
+	}
+
+	g_mutex_unlock (&sampler->mutex);
+
+	return ret;
+}
+
+/**
+ * Pick n members uniformly at random, with replacement.
+ *
+ * @returns The number of ids written to out, 0 if the set is missing
+ * or empty.
+ */
+guint
+xmms_media_sampler_sample (xmms_media_sampler_t *sampler, GBytes *key,
+                           guint n, xmms_medialib_entry_t *out)
+{
+	xmms_media_sample_set_t *set;
+	guint i = 0;
+
+	g_return_val_if_fail (sampler, 0);
+	g_return_val_if_fail (key, 0);
+
+	g_mutex_lock (&sampler->mutex);
+
+	set = xmms_media_sampler_find (sampler, key);
+	if (set && set->ids->len) {
+		for (i = 0; i < n; i++) {
+			out[i] = g_array_index (set->ids, xmms_medialib_entry_t,
+			                        g_rand_int_range (sampler->rand, 0,
+			                                          set->ids->len));
+		}
+	}
+
+	g_mutex_unlock (&sampler->mutex);
+
+	return i;
+}
+
+/**
+ * Queue an added or changed entry for a membership check in every set.
+ */
+void
+xmms_media_sampler_entry_changed (xmms_media_sampler_t *sampler,
+                                  xmms_medialib_entry_t entry)
+{
+	xmms_media_sample_set_t *set;
+	GList *n;
+
+	g_return_if_fail (sampler);
+
+	g_mutex_lock (&sampler->mutex);
+	for (n = sampler->lru.head; n; n = g_list_next (n)) {
+		set = n->data;
+		g_hash_table_add (set->pending, GINT_TO_POINTER (entry));
+	}
+	g_mutex_unlock (&sampler->mutex);
+}
+
+/**
+ * Drop a removed entry from every set.
+ */
+void
+xmms_media_sampler_entry_removed (xmms_media_sampler_t *sampler,
+                                  xmms_medialib_entry_t entry)
+{
+	xmms_media_sample_set_t *set;
+	GList *n;
+
+	g_return_if_fail (sampler);
+
+	g_mutex_lock (&sampler->mutex);
+	for (n = sampler->lru.head; n; n = g_list_next (n)) {
+		set = n->data;
+		g_hash_table_remove (set->pending, GINT_TO_POINTER (entry));
+		xmms_media_sample_set_remove (set, entry);
+	}
+	g_mutex_unlock (&sampler->mutex);
+}
@@ -0,0 +1,138 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Accounting of the memory the larger consumers hold. Each tag is a
+ * byte count the owners of the memory add to and take from as they
+ * allocate and free it, plus the highest it has been. It is cheap
+ * enough to be always on: one atomic add per buffer, not per byte.
+ */
+
+#include <string.h>
+
+#include <xmmspriv/xmms_memstat.h>
+
+/** Rough cost of an xmmsv_t and of a container slot, the struct
+    itself being private to the library */
+#define XMMS_MEMSTAT_VALUE_SIZE 48
+#define XMMS_MEMSTAT_SLOT_SIZE (2 * sizeof (gpointer))
+
+static const gchar *memstat_names[XMMS_MEMSTAT_NUM_TAGS] = {
+	"medialib_results",
+	"ipc_queues",
+	"xform_buffers",
+	"ringbuffers"
+};
+
+/* in bytes, a gint is plenty for what a daemon holds */
+static gint memstat_current[XMMS_MEMSTAT_NUM_TAGS];
+static gint memstat_peak[XMMS_MEMSTAT_NUM_TAGS];
+
+/**
+ * Account delta more bytes (or less if negative) to tag.
+ */
+void
+xmms_memstat_add (xmms_memstat_tag_t tag, gssize delta)
+{
+	gint now, peak;
+
+	g_return_if_fail (tag < XMMS_MEMSTAT_NUM_TAGS);
+
+	now = g_atomic_int_add (&memstat_current[tag], (gint) delta) + (gint) delta;
+
+	peak = g_atomic_int_get (&memstat_peak[tag]);
+	while (now > peak &&
+	       !g_atomic_int_compare_and_exchange (&memstat_peak[tag], peak, now)) {
+		peak = g_atomic_int_get (&memstat_peak[tag]);
+	}
+}
+
+/**
+ * Estimate the memory held by a value and everything in it.
+ */
+gsize
+xmms_memstat_value_size (xmmsv_t *value)
+{
+	xmmsv_list_iter_t *lit;
+	xmmsv_dict_iter_t *dit;
+	const unsigned char *bin;
+	const gchar *str;
+	unsigned int len;
+	xmmsv_t *child;
+	gsize size;
+
+	size = XMMS_MEMSTAT_VALUE_SIZE;
+
+	switch (xmmsv_get_type (value)) {
+		case XMMSV_TYPE_STRING:
+			xmmsv_get_string (value, &str);
+			size += strlen (str) + 1;
+			break;
+		case XMMSV_TYPE_BIN:
+			xmmsv_get_bin (value, &bin, &len);
+			size += len;
+			break;
+		case XMMSV_TYPE_LIST:
+			xmmsv_get_list_iter (value, &lit);
+			while (xmmsv_list_iter_entry (lit, &child)) {
+				size += sizeof (gpointer) + xmms_memstat_value_size (child);
+				xmmsv_list_iter_next (lit);
+			}
+			xmmsv_list_iter_explicit_destroy (lit);
+			break;
+		case XMMSV_TYPE_DICT:
+			xmmsv_get_dict_iter (value, &dit);
+			while (xmmsv_dict_iter_pair (dit, &str, &child)) {
+				size += XMMS_MEMSTAT_SLOT_SIZE + strlen (str) + 1 +
+				        xmms_memstat_value_size (child);
+				xmmsv_dict_iter_next (dit);
+			}
+			xmmsv_dict_iter_explicit_destroy (dit);
+			break;
+		case XMMSV_TYPE_COLL:
+			size += xmms_memstat_value_size (xmmsv_coll_attributes_get (value));
+			size += xmms_memstat_value_size (xmmsv_coll_operands_get (value));
+			size += xmms_memstat_value_size (xmmsv_coll_idlist_get (value));
+			break;
+		default:
+			break;
+	}
+
+	return size;
+}
+
+/**
+ * The accounted tags as a dict of name to a dict of the bytes held
+ * now and the most ever held.
+ */
+xmmsv_t *
+xmms_memstat_get (void)
+{
+	xmmsv_t *ret, *tag;
+	gint i;
+
+	ret = xmmsv_new_dict ();
+
+	for (i = 0; i < XMMS_MEMSTAT_NUM_TAGS; i++) {
+		tag = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("current", g_atomic_int_get (&memstat_current[i])),
+		                        XMMSV_DICT_ENTRY_INT ("peak", g_atomic_int_get (&memstat_peak[i])),
+		                        XMMSV_DICT_END);
+		xmmsv_dict_set (ret, memstat_names[i], tag);
+		xmmsv_unref (tag);
+	}
+
+	return ret;
+}
@@ -37,17 +37,53 @@ typedef struct {
 	gpointer userdata;
 } xmms_object_handler_entry_t;
 
-static gboolean
-cleanup_signal_list (gpointer key, gpointer value, gpointer data)
+/**
+ * The handlers of a signal in the order they were connected. A
+ * snapshot never changes once it is published, connecting and
+ * disconnecting publish a new one instead.
+ */
+typedef struct {
+	guint count;
+	xmms_object_handler_entry_t entries[];
+} xmms_object_handlers_t;
+
+static xmms_object_handlers_t *
+xmms_object_handlers_new (guint count)
+{
+	xmms_object_handlers_t *handlers;
+
+	handlers = g_malloc (sizeof (xmms_object_handlers_t) +
+	                     count * sizeof (xmms_object_handler_entry_t));
+	handlers->count = count;
+
+	return handlers;
+}
+
+/**
+ * Publish the new handlers of a signal, NULL if there are none.
+ *
+ * Emitters count themselves in object->emitting before they pick up
+ * a snapshot, so the replaced ones are kept on the retired list until
+ * a change is made while no emit is running. Called with the mutex
+ * held.
+ */
+static void
+xmms_object_handlers_publish (xmms_object_t *object, guint32 signalid,
+                              xmms_object_handlers_t *handlers)
 {
-	GList *list = value;
+	xmms_object_handlers_t *old;
+
+	old = object->signals[signalid];
+	g_atomic_pointer_set (&object->signals[signalid], handlers);
 
-	while (list) {
-		g_free (list->data);
-		list = g_list_delete_link (list, list);
+	if (old) {
+		object->retired = g_list_prepend (object->retired, old);
 	}
 
-	return FALSE; /* keep going */
+	if (!g_atomic_int_get (&object->emitting)) {
+		g_list_free_full (object->retired, g_free);
+		object->retired = NULL;
+	}
 }
 
 /**
@@ -56,19 +92,20 @@ cleanup_signal_list (gpointer key, gpointer value, gpointer data)
 void
 xmms_object_cleanup (xmms_object_t *object)
 {
+	gint i;
+
 	g_return_if_fail (object);
 	g_return_if_fail (XMMS_IS_OBJECT (object));
 
 	if (object->signals) {
-		/* destroy the tree manually (ie not via a value_destroy_func
-		 * callback since we're often "replacing" values when we're
-		 * adding new elements to the signal lists. and we don't want
-		 * the value to be destroyed in those cases :)
-		 */
-		g_tree_foreach (object->signals, cleanup_signal_list, NULL);
-		g_tree_destroy (object->signals);
+		for (i = 0; i < XMMS_IPC_SIGNAL_END; i++) {
+			g_free (object->signals[i]);
+		}
+		g_free (object->signals);
 	}
 
+	g_list_free_full (object->retired, g_free);
+
 	if (object->cmds) {
 		/* We don't need to free the commands themselves -- they are
 		 * stored in read-only memory.
@@ -79,20 +116,6 @@ xmms_object_cleanup (xmms_object_t *object)
 	g_mutex_clear (&object->mutex);
 }
 
-static gint
-compare_signal_key (gconstpointer a, gconstpointer b)
-{
-	gint aa = GPOINTER_TO_INT (a);
-	gint bb = GPOINTER_TO_INT (b);
-
-	if (aa < bb)
-		return -1;
-	else if (aa > bb)
-		return 1;
-	else
-		return 0;
-}
-
 /**
   * Connect to a signal that is emitted by this object.
   * You can connect many handlers to the same signal as long as
@@ -110,27 +133,38 @@ void
 xmms_object_connect (xmms_object_t *object, guint32 signalid,
                      xmms_object_handler_t handler, gpointer userdata)
 {
-	GList *list = NULL;
-	xmms_object_handler_entry_t *entry;
+	xmms_object_handlers_t *old, *handlers;
+	guint count = 0;
 
 	g_return_if_fail (object);
 	g_return_if_fail (XMMS_IS_OBJECT (object));
+	g_return_if_fail (signalid < XMMS_IPC_SIGNAL_END);
 	g_return_if_fail (handler);
 
-	entry = g_new0 (xmms_object_handler_entry_t, 1);
-	entry->handler = handler;
-	entry->userdata = userdata;
+	g_mutex_lock (&object->mutex);
 
-	if (!object->signals)
-		object->signals = g_tree_new (compare_signal_key);
-	else
-		list = g_tree_lookup (object->signals,
-		                      GINT_TO_POINTER (signalid));
+	/* only freed with the object, emit may look at it any time */
+	if (!object->signals) {
+		g_atomic_pointer_set (&object->signals,
+		                      g_new0 (gpointer, XMMS_IPC_SIGNAL_END));
+	}
+
+	old = object->signals[signalid];
+	if (old) {
+		count = old->count;
+	}
 
-	list = g_list_prepend (list, entry);
+	handlers = xmms_object_handlers_new (count + 1);
+	if (old) {
+		memcpy (handlers->entries, old->entries,
+		        count * sizeof (xmms_object_handler_entry_t));
+	}
+	handlers->entries[count].handler = handler;
+	handlers->entries[count].userdata = userdata;
+
+	xmms_object_handlers_publish (object, signalid, handlers);
 
-	/* store the list's new head in the tree */
-	g_tree_insert (object->signals, GINT_TO_POINTER (signalid), list);
+	g_mutex_unlock (&object->mutex);
 }
 
 /**
@@ -141,46 +175,53 @@ void
 xmms_object_disconnect (xmms_object_t *object, guint32 signalid,
                         xmms_object_handler_t handler, gpointer userdata)
 {
-	GList *list, *node = NULL;
-	xmms_object_handler_entry_t *entry;
+	xmms_object_handlers_t *old = NULL, *handlers = NULL;
+	gint i = -1;
 
 	g_return_if_fail (object);
 	g_return_if_fail (XMMS_IS_OBJECT (object));
+	g_return_if_fail (signalid < XMMS_IPC_SIGNAL_END);
 	g_return_if_fail (handler);
 
 	g_mutex_lock (&object->mutex);
 
 	if (object->signals) {
-		list = g_tree_lookup (object->signals,
-		                      GINT_TO_POINTER (signalid));
-
-		for (node = list; node; node = g_list_next (node)) {
-			entry = node->data;
+		old = object->signals[signalid];
+	}
 
-			if (entry->handler == handler && entry->userdata == userdata)
+	/* the last one connected goes first */
+	if (old) {
+		for (i = old->count - 1; i >= 0; i--) {
+			if (old->entries[i].handler == handler &&
+			    old->entries[i].userdata == userdata)
 				break;
 		}
+	}
 
-		if (node) {
-			list = g_list_remove_link (list, node);
-
-			/* store the list's new head in the tree */
-			g_tree_insert (object->signals,
-			               GINT_TO_POINTER (signalid), list);
+	if (i >= 0) {
+		if (old->count > 1) {
+			handlers = xmms_object_handlers_new (old->count - 1);
+			memcpy (handlers->entries, old->entries,
+			        i * sizeof (xmms_object_handler_entry_t));
+			memcpy (handlers->entries + i, old->entries + i + 1,
+			        (old->count - i - 1) * sizeof (xmms_object_handler_entry_t));
 		}
+
+		xmms_object_handlers_publish (object, signalid, handlers);
 	}
 
 	g_mutex_unlock (&object->mutex);
 
-	g_return_if_fail (node);
-
-	g_free (node->data);
-	g_list_free_1 (node);
+	g_return_if_fail (i >= 0);
 }
 
 /**
   * Emit a signal and thus call all the handlers that are connected.
   *
+  * Neither locks nor allocates, the handlers are called straight off
+  * the snapshot published for the signal. A handler connected or
+  * disconnected meanwhile takes effect at the next emit.
+  *
   * @param object the object to signal on.
   * @param signalid the signalid to emit
   * @param data the data that should be sent to the handler.
@@ -189,39 +230,31 @@ xmms_object_disconnect (xmms_object_t *object, guint32 signalid,
 void
 xmms_object_emit (xmms_object_t *object, guint32 signalid, xmmsv_t *data)
 {
-	GList *list, *node, *list2 = NULL;
-	xmms_object_handler_entry_t *entry;
+	xmms_object_handlers_t *handlers = NULL;
+	gpointer *signals;
+	guint i;
 
 	g_return_if_fail (object);
 	g_return_if_fail (XMMS_IS_OBJECT (object));
 
-	g_mutex_lock (&object->mutex);
-
-	if (object->signals) {
-		list = g_tree_lookup (object->signals,
-		                      GINT_TO_POINTER (signalid));
-
-		for (node = list; node; node = g_list_next (node)) {
-			entry = node->data;
+	/* must be counted before the snapshot is picked up */
+	g_atomic_int_inc (&object->emitting);
 
-			list2 = g_list_prepend (list2, entry);
-		}
+	signals = g_atomic_pointer_get (&object->signals);
+	if (signals && signalid < XMMS_IPC_SIGNAL_END) {
+		handlers = g_atomic_pointer_get (&signals[signalid]);
 	}
 
-	g_mutex_unlock (&object->mutex);
-
-	while (list2) {
-		entry = list2->data;
+	for (i = 0; handlers && i < handlers->count; i++) {
+		/* NULL handlers may never be connected. */
+		g_assert (handlers->entries[i].handler);
 
-		/* NULL entries may never be added to the trees. */
-		g_assert (entry);
-		g_assert (entry->handler);
-
-		entry->handler (object, data, entry->userdata);
-
-		list2 = g_list_delete_link (list2, list2);
+		handlers->entries[i].handler (object, data,
+		                              handlers->entries[i].userdata);
 	}
 
+	g_atomic_int_add (&object->emitting, -1);
+
 	xmmsv_unref (data);
 }
 
@@ -368,7 +401,7 @@ __int_xmms_object_new (gint size, xmms_object_destroy_func_t destfunc)
 
 	g_mutex_init (&ret->mutex);
 
-	/* don't create the trees for the signals and the commands yet.
+	/* don't create the signal table and the command tree yet.
 	 * instead we instantiate those when we need them the first
 	 * time.
 	 */
@@ -29,6 +29,12 @@
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_outputplugin.h>
 #include <xmmspriv/xmms_thread_name.h>
+#include <xmmspriv/xmms_realtime.h>
+#include <xmmspriv/xmms_converter.h>
+#include <xmmspriv/xmms_visualization.h>
+#include <xmmspriv/xmms_footprint.h>
+#include <xmmspriv/xmms_trace.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmms/xmms_sample.h>
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_ipc.h>
@@ -37,6 +43,29 @@
 
 #define VOLUME_MAX_CHANNELS 128
 
+/** The filler reads at least a period of this many ms per block */
+#define FILLER_PERIOD_MS 20
+#define FILLER_BLOCK_MIN 4096
+
+/** How often the writer asks the plugin for its latency */
+#define LATENCY_INTERVAL_MS 50
+
+/** How long the pull thread may miss a wakeup from xmms_output_pull,
+    also how often it updates the playtime */
+#define PULL_INTERVAL_MS 20
+
+/** Buckets of the fill level histogram, and how many underruns
+    to remember the time of */
+#define OUTPUT_FILL_BUCKETS 10
+#define OUTPUT_UNDERRUN_TIMES 16
+
+/* How often a scheduled start looks at the clock while it waits */
+#define START_POLL_US 5000
+/* Drift correction is for clocks running apart, not for pitching */
+#define DRIFT_MAX_PPM 2000
+/* Longest crossfade, what is held back for it is kept in memory */
+#define CROSSFADE_MAX_MS 10000
+
 typedef struct xmms_volume_map_St {
 	const gchar **names;
 	guint *values;
@@ -46,6 +75,8 @@ typedef struct xmms_volume_map_St {
 
 static gboolean xmms_output_format_set (xmms_output_t *output, xmms_stream_type_t *fmt);
 static gpointer xmms_output_monitor_volume_thread (gpointer data);
+static void xmms_output_monitor_volume_stop (xmms_output_t *output);
+static gpointer xmms_output_preload_thread (gpointer data);
 
 static void xmms_playback_client_start (xmms_output_t *output, xmms_error_t *err);
 static void xmms_playback_client_stop (xmms_output_t *output, xmms_error_t *err);
@@ -56,6 +87,12 @@ static void xmms_playback_client_seek_samples (xmms_output_t *output, gint32 sam
 static gint32 xmms_playback_client_status (xmms_output_t *output, xmms_error_t *error);
 static gint xmms_playback_client_current_id (xmms_output_t *output, xmms_error_t *error);
 static gint32 xmms_playback_client_playtime (xmms_output_t *output, xmms_error_t *err);
+static xmmsv_t *xmms_playback_client_playtime_stamp (xmms_output_t *output, xmms_error_t *err);
+static gint64 xmms_playback_client_clock (xmms_output_t *output, xmms_error_t *err);
+static void xmms_playback_client_start_at (xmms_output_t *output, gint32 sec, gint32 usec, xmms_error_t *err);
+static void xmms_playback_client_drift_set (xmms_output_t *output, gint32 ppm, xmms_error_t *err);
+static xmmsv_t *xmms_playback_client_chain_stats (xmms_output_t *output, xmms_error_t *err);
+static xmmsv_t *xmms_playback_client_health (xmms_output_t *output, xmms_error_t *err);
 
 typedef enum xmms_output_filler_state_E {
 	FILLER_STOP,
@@ -78,6 +115,17 @@ static gboolean xmms_output_status_set (xmms_output_t *output, gint status);
 static gboolean set_plugin (xmms_output_t *output, xmms_output_plugin_t *plugin);
 
 static void xmms_output_format_list_free_elem (gpointer data, gpointer user_data);
+static void xmms_output_sinks_rebuild (xmms_output_t *output);
+static void xmms_output_sinks_clear (xmms_output_t *output);
+static gboolean xmms_output_sinks_uses (xmms_output_t *output, xmms_output_plugin_t *plugin);
+static gboolean xmms_output_hot_swap (xmms_output_t *output, xmms_output_plugin_t *new_plugin, gboolean *ret);
+static void xmms_output_format_pending_clear (xmms_output_t *output);
+static void xmms_output_sinks_feed (xmms_output_t *output, gchar *buffer, gint len);
+static void xmms_output_sinks_format_set (xmms_output_t *output, xmms_stream_type_t *type);
+static void xmms_output_sinks_status_set (xmms_output_t *output, gint status);
+static void xmms_output_sinks_flush (xmms_output_t *output);
+static gpointer xmms_output_pull_thread (gpointer data);
+static void xmms_output_pull_stop (xmms_output_t *output);
 static void xmms_output_format_list_clear (xmms_output_t *output);
 xmms_medialib_entry_t xmms_output_current_id (xmms_output_t *output);
 
@@ -98,7 +146,12 @@ xmms_medialib_entry_t xmms_output_current_id (xmms_output_t *output);
  *
  * locking order: status_mutex > write_mutex
  *                filler_mutex
- *                playtime_mutex is leaflock.
+ *                preload_mutex is leaflock.
+ *                status_mutex > sinks_mutex > sink status_mutex >
+ *                  sink filler_mutex
+ *
+ * played, played_time and played_stamp are atomics, toskip belongs
+ * to the filler_mutex.
  */
 
 struct xmms_output_St {
@@ -108,12 +161,27 @@ struct xmms_output_St {
 	gpointer plugin_data;
 
 	/* */
-	GMutex playtime_mutex;
 	guint played;
 	guint played_time;
+	/** When played_time was last set, in monotonic ms */
+	guint played_stamp;
 	xmms_medialib_entry_t current_entry;
 	guint toskip;
 
+	/** Plugin latency as last asked for, by the writer */
+	guint latency;
+	gint64 latency_stamp;
+
+	/** Monotonic time in us the first read waits for, valid while
+	    start_pending is set */
+	gint64 start_at;
+	gint start_pending;
+	/** Frames to drop (positive) or repeat per million played, and
+	    the writer's running remainder */
+	gint drift_ppm;
+	gint64 drift_acc;
+	gint drift_frames;
+
 	/* */
 	GThread *filler_thread;
 	GMutex filler_mutex;
@@ -124,6 +192,50 @@ struct xmms_output_St {
 	xmms_ringbuf_t *filler_buffer;
 	guint32 filler_seek;
 	gint filler_skip;
+	/** A seek was asked for and its seek_done hasn't run yet, the
+	    position is then filler_seek rather than what was played */
+	gboolean seek_pending;
+	/** When the last seek was asked for */
+	gint64 seek_stamp;
+	/** Where the next chain starts, in ms, set when resuming the
+	    playback of a daemon this one replaced */
+	guint resume_ms;
+
+	/** Size of the blocks read from the chain, grown between base
+	    and max while the chain keeps up easily */
+	gint filler_block;
+	guint filler_block_base;
+	guint filler_block_max;
+	guint filler_bytes_per_sec;
+	gchar *filler_buf;
+	guint filler_buf_size;
+	/** Whether the buffers are locked into memory */
+	gboolean realtime;
+
+	/** Crossfading, only touched by the filler: the last xfade_bytes
+	    a chain gives are held back in xfade_tail. When it ends they
+	    move to xfade_out, in xfade_format, and are mixed into the
+	    first xfade_total bytes of the next chain */
+	gint xfade_bytes;
+	gboolean xfade_trim;
+	gboolean xfade_lead;
+	xmms_xform_fifo_t *xfade_tail;
+	xmms_xform_fifo_t *xfade_out;
+	xmms_stream_type_t *xfade_format;
+	gsize xfade_total;
+	gsize xfade_done;
+	gchar *xfade_buf;
+	gsize xfade_buf_size;
+
+	/** Bytes to wait for before playback starts, and before it
+	    resumes after an underrun */
+	gint prefill;
+	gint prefill_pending;
+
+	/** Fill level of the ringbuffer as seen by the writer: lowest
+	    since the last query and a running average */
+	gint fill_min;
+	gint fill_avg;
 
 	/** Internal status, tells which state the
 	    output really is in */
@@ -137,6 +249,9 @@ struct xmms_output_St {
 	GList *format_list;
 	/** Active format */
 	xmms_stream_type_t *format;
+	/** Format for the reader to set before it reads on, after the
+	    plugin was switched while playing */
+	xmms_stream_type_t *format_pending;
 
 	/**
 	 * Number of bytes totally written to output driver,
@@ -149,8 +264,76 @@ struct xmms_output_St {
 	 */
 	gint32 buffer_underruns;
 
+	/** How playback holds up over time, for xmms_output_health_get,
+	    under health_mutex */
+	GMutex health_mutex;
+	guint fill_hist[OUTPUT_FILL_BUCKETS];
+	gint64 underrun_times[OUTPUT_UNDERRUN_TIMES];
+	guint underrun_pos;
+	/** When the writer last came for data and when it should have
+	    come back, in µs on the monotonic clock */
+	gint64 write_last;
+	gint64 write_expect;
+	gint64 jitter_avg;
+	gint64 jitter_max;
+	/** Plugin latency in ms each time update_playtime asks for it */
+	gint sink_latency_avg;
+	gint sink_latency_max;
+	/** Time from the end of one chain to the first data of the next */
+	gint64 gap_last;
+	gint64 gap_max;
+	guint health_timeout;
+
 	GThread *monitor_volume_thread;
 	gboolean monitor_volume_running;
+	/** Wakes up the volume monitor, which only polls when the
+	    plugin doesn't tell about changes by itself */
+	GMutex monitor_volume_mutex;
+	GCond monitor_volume_cond;
+	gboolean volume_events;
+	gboolean volume_changed;
+
+	/** Look-ahead chain for the next entry, built while the
+	    current one is still playing */
+	GThread *preload_thread;
+	GMutex preload_mutex;
+	GCond preload_cond;
+	gboolean preload_enabled;
+	gboolean preload_armed;
+	gboolean preload_running;
+	gboolean preload_wanted;
+	guint preload_generation;
+	xmms_xform_t *preload_chain;
+	xmms_medialib_entry_t preload_entry;
+
+	/** the chain the filler reads, for chain_stats, under filler_mutex */
+	xmms_xform_t *filler_chain;
+
+	/** Extra outputs playing a copy of what this one reads, set
+	    up from output.tee */
+	GMutex sinks_mutex;
+	GList *sinks;
+
+	/** When this is such a sink: the output feeding it. Sinks have
+	    no filler, filler_buffer is written by the parent's writer
+	    and filler_mutex is its writer lock */
+	xmms_output_t *tee_parent;
+	/** Conversion from the parent's format, only touched by the
+	    parent's writer. The converter borrows tee_from and tee_to */
+	xmms_sample_converter_t *tee_conv;
+	xmms_stream_type_t *tee_from;
+	xmms_stream_type_t *tee_to;
+	gboolean tee_active;
+	guint tee_dropped;
+
+	/** The plugin reads with xmms_output_pull from a callback that
+	    must not block, the pull thread runs what it can't */
+	gboolean pull_mode;
+	GThread *pull_thread;
+	GMutex pull_mutex;
+	GCond pull_cond;
+	gboolean pull_running;
+	gint pull_pending;
 };
 
 /** @} */
@@ -218,37 +401,124 @@ xmms_output_format_list_clear(xmms_output_t *output)
 	output->format_list = NULL;
 }
 
+/**
+ * @internal Note the sink latency update_playtime just asked for.
+ */
 static void
-update_playtime (xmms_output_t *output, int advance)
+xmms_output_health_latency (xmms_output_t *output)
 {
-	guint buffersize = 0;
+	gint ms;
+
+	if (!output->format) {
+		return;
+	}
+
+	ms = xmms_sample_bytes_to_ms (output->format, output->latency);
+
+	g_mutex_lock (&output->health_mutex);
+	output->sink_latency_avg += (ms - output->sink_latency_avg) / 16;
+	output->sink_latency_max = MAX (output->sink_latency_max, ms);
+	g_mutex_unlock (&output->health_mutex);
+}
+
+/**
+ * @internal Note how the ringbuffer looked when the writer came for
+ * want bytes and got got of them, and how far off the time it came
+ * was from when the audio it took last time ran out. From the pull
+ * callback the sample is dropped rather than waiting for the lock.
+ */
+static void
+xmms_output_health_update (xmms_output_t *output, gint got, gint want,
+                           gboolean wait)
+{
+	guint size, bucket;
+	gint64 now, off;
+	gint rate;
+
+	if (!output->format) {
+		return;
+	}
+
+	if (wait) {
+		g_mutex_lock (&output->health_mutex);
+	} else if (!g_mutex_trylock (&output->health_mutex)) {
+		return;
+	}
+
+	now = g_get_monotonic_time ();
+
+	size = xmms_ringbuf_size (output->filler_buffer);
+	bucket = (guint64) xmms_ringbuf_bytes_used (output->filler_buffer) *
+	         OUTPUT_FILL_BUCKETS / (size + 1);
+	output->fill_hist[bucket]++;
 
-	g_mutex_lock (&output->playtime_mutex);
-	output->played += advance;
-	g_mutex_unlock (&output->playtime_mutex);
+	if (got < want) {
+		output->underrun_times[output->underrun_pos++ % OUTPUT_UNDERRUN_TIMES] =
+			g_get_real_time ();
+	}
+
+	if (output->write_last) {
+		off = ABS (now - output->write_last - output->write_expect);
+		output->jitter_avg += (off - output->jitter_avg) / 16;
+		output->jitter_max = MAX (output->jitter_max, off);
+	}
+
+	rate = xmms_stream_type_get_int (output->format, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	output->write_last = now;
+	output->write_expect = xmms_sample_bytes_to_samples_inexact (output->format, want) *
+	                       G_USEC_PER_SEC / MAX (rate, 1);
+
+	g_mutex_unlock (&output->health_mutex);
+}
+
+/**
+ * @internal Note how long the filler took from the end of one chain
+ * to the first data of the next.
+ */
+static void
+xmms_output_health_gap (xmms_output_t *output, gint64 gap)
+{
+	g_mutex_lock (&output->health_mutex);
+	output->gap_last = gap;
+	output->gap_max = MAX (output->gap_max, gap);
+	g_mutex_unlock (&output->health_mutex);
+}
+
+/**
+ * Account for advance bytes handed to the plugin. Only called by the
+ * writer, the plugin is asked for its latency at most every
+ * LATENCY_INTERVAL_MS as that usually means asking the driver.
+ */
+static void
+update_playtime (xmms_output_t *output, int advance)
+{
+	guint played, buffersize, ms, old;
+	gint64 now;
 
-	buffersize = xmms_output_plugin_method_latency_get (output->plugin, output);
+	played = (guint) g_atomic_int_add (&output->played, advance) + advance;
 
-	if (output->played < buffersize) {
-		buffersize = output->played;
+	now = g_get_monotonic_time ();
+	if (now - output->latency_stamp >= LATENCY_INTERVAL_MS * 1000) {
+		output->latency = xmms_output_plugin_method_latency_get (output->plugin, output);
+		output->latency_stamp = now;
+		xmms_output_health_latency (output);
 	}
 
-	g_mutex_lock (&output->playtime_mutex);
+	buffersize = MIN (output->latency, played);
 
 	if (output->format) {
-		guint ms = xmms_sample_bytes_to_ms (output->format,
-		                                    output->played - buffersize);
-		if ((ms / 100) != (output->played_time / 100)) {
+		ms = xmms_sample_bytes_to_ms (output->format, played - buffersize);
+
+		old = g_atomic_int_get (&output->played_time);
+		g_atomic_int_set (&output->played_time, ms);
+		g_atomic_int_set (&output->played_stamp, (guint) (now / 1000));
+
+		if ((ms / 100) != (old / 100)) {
 			xmms_object_emit (XMMS_OBJECT (output),
 			                  XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME,
 			                  xmmsv_new_int (ms));
 		}
-		output->played_time = ms;
-
 	}
-
-	g_mutex_unlock (&output->playtime_mutex);
-
 }
 
 void
@@ -291,7 +561,8 @@ song_changed (void *data)
 
 	XMMS_DBG ("Running hotspot! Song changed!! %d", entry);
 
-	arg->output->played = 0;
+	g_atomic_int_set (&arg->output->played, 0);
+	arg->output->latency_stamp = 0;
 	arg->output->current_entry = entry;
 
 	type = xmms_xform_outtype_get (arg->chain);
@@ -306,11 +577,15 @@ song_changed (void *data)
 		XMMS_DBG ("Couldn't set format %s/%d/%d, stopping filler..",
 		          xmms_sample_name_get (fmt), rate, chn);
 
+		g_mutex_lock (&arg->output->filler_mutex);
 		xmms_output_filler_state_nolock (arg->output, FILLER_STOP);
 		xmms_ringbuf_set_eos (arg->output->filler_buffer, TRUE);
+		g_mutex_unlock (&arg->output->filler_mutex);
 		return FALSE;
 	}
 
+	xmms_output_sinks_format_set (arg->output, type);
+
 	if (arg->flush)
 		xmms_output_flush (arg->output);
 
@@ -326,10 +601,19 @@ seek_done (void *data)
 {
 	xmms_output_t *output = (xmms_output_t *)data;
 
-	g_mutex_lock (&output->playtime_mutex);
-	output->played = output->filler_seek * xmms_sample_frame_size_get (output->format);
+	/* toskip is consumed by the filler */
+	g_mutex_lock (&output->filler_mutex);
+	g_atomic_int_set (&output->played,
+	                  output->filler_seek * xmms_sample_frame_size_get (output->format));
 	output->toskip = output->filler_skip * xmms_sample_frame_size_get (output->format);
-	g_mutex_unlock (&output->playtime_mutex);
+	/* a later seek is still to be done by the filler */
+	if (output->filler_state != FILLER_SEEK) {
+		output->seek_pending = FALSE;
+	}
+	g_mutex_unlock (&output->filler_mutex);
+
+	/* the plugin is flushed below, ask it again */
+	output->latency_stamp = 0;
 
 	xmms_output_flush (output);
 	return TRUE;
@@ -342,6 +626,7 @@ xmms_output_filler_state_nolock (xmms_output_t *output, xmms_output_filler_state
 	g_cond_signal (&output->filler_state_cond);
 	if (state == FILLER_QUIT || state == FILLER_STOP || state == FILLER_KILL) {
 		xmms_ringbuf_clear (output->filler_buffer);
+		output->seek_pending = FALSE;
 	}
 	if (state != FILLER_STOP) {
 		xmms_ringbuf_set_eos (output->filler_buffer, FALSE);
@@ -355,577 +640,2687 @@ xmms_output_filler_state (xmms_output_t *output, xmms_output_filler_state_t stat
 	xmms_output_filler_state_nolock (output, state);
 	g_mutex_unlock (&output->filler_mutex);
 }
+/**
+ * Seek within what is buffered by moving the read index of the
+ * ringbuffer, without flushing it or seeking the chain. Back only as
+ * far as the history kept, and never past a hotspot or into the song
+ * before. Should hold filler_mutex, the filler doesn't write then.
+ */
+static gboolean
+xmms_output_buffered_seek (xmms_output_t *output, guint32 samples)
+{
+	gint64 delta;
+	guint frame;
+	gint played;
+	gboolean ret;
+
+	if (output->filler_state != FILLER_RUN || output->seek_pending ||
+	    !output->format) {
+		return FALSE;
+	}
+
+	frame = xmms_sample_frame_size_get (output->format);
+	played = g_atomic_int_get (&output->played);
+	played -= played % frame;
+	delta = (gint64) samples * frame - played;
+
+	if (delta > G_MAXINT || -delta > played) {
+		return FALSE;
+	}
+
+	if (delta >= 0) {
+		ret = xmms_ringbuf_forward (output->filler_buffer, delta);
+	} else {
+		ret = xmms_ringbuf_rewind (output->filler_buffer, -delta);
+	}
+	if (!ret) {
+		return FALSE;
+	}
+
+	XMMS_DBG ("Seeked %" G_GINT64_FORMAT " bytes in the buffer", delta);
+
+	/* relative, the reader may add what it read before the move */
+	g_atomic_int_add (&output->played, (gint) delta);
+	output->latency_stamp = 0;
+	xmms_output_flush (output);
+
+	return TRUE;
+}
+
 static void
 xmms_output_filler_seek_state (xmms_output_t *output, guint32 samples)
 {
 	g_mutex_lock (&output->filler_mutex);
-	output->filler_state = FILLER_SEEK;
-	output->filler_seek = samples;
-	g_cond_signal (&output->filler_state_cond);
+	if (!xmms_output_buffered_seek (output, samples)) {
+		output->filler_state = FILLER_SEEK;
+		output->filler_seek = samples;
+		output->seek_pending = TRUE;
+		output->seek_stamp = g_get_monotonic_time ();
+		g_cond_signal (&output->filler_state_cond);
+	}
 	g_mutex_unlock (&output->filler_mutex);
 }
 
-static void *
-xmms_output_filler (void *arg)
+/**
+ * Where a relative seek starts from, in samples. A pending seek
+ * counts as done, so fast relative seeks add up.
+ */
+static gboolean
+xmms_output_seek_pending_get (xmms_output_t *output, guint32 *samples)
 {
-	xmms_output_t *output = (xmms_output_t *)arg;
-	xmms_xform_t *chain = NULL;
-	gboolean last_was_kill = FALSE;
-	char buf[4096];
-	xmms_error_t err;
-	gint ret;
-
-	xmms_error_reset (&err);
+	gboolean ret;
 
 	g_mutex_lock (&output->filler_mutex);
-	while (output->filler_state != FILLER_QUIT) {
-		if (output->filler_state == FILLER_STOP) {
-			if (chain) {
-                XMMS_DBG("Got FILTER_STOP. Cleaning up the chain, %p", chain);
-				xmms_object_unref (chain);
-				chain = NULL;
-			}
-			xmms_ringbuf_set_eos (output->filler_buffer, TRUE);
-			g_cond_wait (&output->filler_state_cond, &output->filler_mutex);
-			last_was_kill = FALSE;
-			continue;
-		}
-		if (output->filler_state == FILLER_KILL) {
-			if (chain) {
-				xmms_object_unref (chain);
-				chain = NULL;
-				output->filler_state = FILLER_RUN;
-				last_was_kill = TRUE;
-			} else {
-				output->filler_state = FILLER_STOP;
-			}
-			continue;
-		}
-		if (output->filler_state == FILLER_SEEK) {
-			if (!chain) {
-				XMMS_DBG ("Seek without chain, ignoring..");
-				output->filler_state = FILLER_STOP;
-				continue;
-			}
+	ret = output->seek_pending;
+	*samples = output->filler_seek;
+	g_mutex_unlock (&output->filler_mutex);
 
-			ret = xmms_xform_this_seek (chain, output->filler_seek, XMMS_XFORM_SEEK_SET, &err);
-			if (ret == -1) {
-				xmms_log_info ("Seeking failed: %s", xmms_error_message_get (&err));
-				xmms_error_reset (&err);
-			} else {
-				XMMS_DBG ("Seek ok! %d", ret);
+	return ret;
+}
 
-				output->filler_skip = output->filler_seek - ret;
-				if (output->filler_skip < 0) {
-					XMMS_DBG ("Seeked %d samples too far! Updating position...",
-					          -output->filler_skip);
+/**
+ * Drop the prepared chain. If rearm is set the preload thread is
+ * asked to prepare the entry following the one just started.
+ */
+static void
+xmms_output_preload_invalidate (xmms_output_t *output, gboolean rearm)
+{
+	xmms_xform_t *chain;
 
-					output->filler_skip = 0;
-					output->filler_seek = ret;
-				}
+	g_mutex_lock (&output->preload_mutex);
+	chain = output->preload_chain;
+	output->preload_chain = NULL;
+	output->preload_entry = 0;
+	output->preload_generation++;
+	output->preload_armed = rearm;
+	output->preload_wanted = rearm && output->preload_enabled;
+	g_cond_signal (&output->preload_cond);
+	g_mutex_unlock (&output->preload_mutex);
+
+	if (chain) {
+		xmms_object_unref (chain);
+	}
+}
 
-				xmms_ringbuf_clear (output->filler_buffer);
-				xmms_ringbuf_hotspot_set (output->filler_buffer, seek_done, NULL, output);
-			}
-			output->filler_state = FILLER_RUN;
-		}
+/**
+ * Hand over the prepared chain if it was built for entry,
+ * otherwise throw it away.
+ */
+static xmms_xform_t *
+xmms_output_preload_take (xmms_output_t *output, xmms_medialib_entry_t entry)
+{
+	xmms_xform_t *chain;
 
-		if (!chain) {
-			xmms_medialib_entry_t entry;
-			xmms_output_song_changed_arg_t *hsarg;
+	g_mutex_lock (&output->preload_mutex);
+	chain = output->preload_chain;
+	if (chain && output->preload_entry != entry) {
+		XMMS_DBG ("Prepared chain is for %d, wanted %d. Discarding.",
+		          output->preload_entry, entry);
+		chain = NULL;
+	}
+	g_mutex_unlock (&output->preload_mutex);
 
-			g_mutex_unlock (&output->filler_mutex);
+	if (!chain) {
+		xmms_output_preload_invalidate (output, FALSE);
+		return NULL;
+	}
 
-			entry = xmms_playlist_current_entry (output->playlist);
-			if (!entry) {
-				XMMS_DBG ("No entry from playlist!");
-				output->filler_state = FILLER_STOP;
-				g_mutex_lock (&output->filler_mutex);
-				continue;
-			}
+	g_mutex_lock (&output->preload_mutex);
+	output->preload_chain = NULL;
+	output->preload_entry = 0;
+	g_mutex_unlock (&output->preload_mutex);
 
-			chain = xmms_xform_chain_setup (output->medialib, entry, output->format_list, FALSE);
-			if (!chain) {
-				xmms_medialib_session_t *session;
+	return chain;
+}
 
-				do {
-					session = xmms_medialib_session_begin (output->medialib);
-					if (xmms_medialib_entry_property_get_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS) == XMMS_MEDIALIB_ENTRY_STATUS_NEW) {
-						xmms_medialib_entry_remove (session, entry);
-					} else {
-						xmms_medialib_entry_status_set (session, entry, XMMS_MEDIALIB_ENTRY_STATUS_NOT_AVAILABLE);
-					}
-				} while (!xmms_medialib_session_commit (session));
+/* May be called with the playlist locked, so we can't look at the
+ * playlist here. Just let the preload thread re-check what comes next,
+ * the prepared chain is kept until then if it's still usable.
+ */
+static void
+on_playlist_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	xmms_output_t *output = (xmms_output_t *) udata;
 
-				if (!xmms_playlist_advance (output->playlist)) {
-					XMMS_DBG ("End of playlist");
-					output->filler_state = FILLER_STOP;
-				}
-				g_mutex_lock (&output->filler_mutex);
-				continue;
-			}
+	g_mutex_lock (&output->preload_mutex);
+	if (output->preload_armed && output->preload_enabled) {
+		output->preload_generation++;
+		output->preload_wanted = TRUE;
+		g_cond_signal (&output->preload_cond);
+	}
+	g_mutex_unlock (&output->preload_mutex);
+}
 
-			hsarg = g_new0 (xmms_output_song_changed_arg_t, 1);
-			hsarg->output = output;
-			hsarg->chain = chain;
-			hsarg->flush = last_was_kill;
-			xmms_object_ref (chain);
+/**
+ * Start the preload thread unless it runs already, it is only started
+ * once preloading is turned on.
+ */
+static void
+xmms_output_preload_start (xmms_output_t *output)
+{
+	g_mutex_lock (&output->preload_mutex);
+	if (!output->preload_thread) {
+		output->preload_running = TRUE;
+		output->preload_thread = g_thread_new ("x2 out preload",
+		                                       xmms_output_preload_thread,
+		                                       output);
+	}
+	g_mutex_unlock (&output->preload_mutex);
+}
 
-			last_was_kill = FALSE;
+static void
+on_preload_enabled_changed (xmms_object_t *object, xmmsv_t *data,
+                            gpointer udata)
+{
+	xmms_output_t *output = (xmms_output_t *) udata;
+	gboolean armed;
+	gint value;
 
-			g_mutex_lock (&output->filler_mutex);
-			xmms_ringbuf_hotspot_set (output->filler_buffer, song_changed, song_changed_arg_free, hsarg);
-		}
+	value = xmms_config_property_get_int ((xmms_config_property_t *) object);
 
-		xmms_ringbuf_wait_free (output->filler_buffer, sizeof (buf), &output->filler_mutex);
+	if (value) {
+		xmms_output_preload_start (output);
+	}
 
-		if (output->filler_state != FILLER_RUN) {
-			XMMS_DBG ("State changed while waiting...");
+	g_mutex_lock (&output->preload_mutex);
+	output->preload_enabled = !!value;
+	armed = output->preload_armed;
+	g_mutex_unlock (&output->preload_mutex);
+
+	xmms_output_preload_invalidate (output, armed);
+}
+
+static gpointer
+xmms_output_preload_thread (gpointer data)
+{
+	xmms_output_t *output = (xmms_output_t *) data;
+	xmms_medialib_entry_t entry, current;
+	xmms_xform_t *chain, *old;
+	xmms_error_t err;
+	guint generation;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
+	g_mutex_lock (&output->preload_mutex);
+	while (output->preload_running) {
+		if (!output->preload_wanted) {
+			g_cond_wait (&output->preload_cond, &output->preload_mutex);
 			continue;
 		}
-		g_mutex_unlock (&output->filler_mutex);
 
-		ret = xmms_xform_this_read (chain, buf, sizeof (buf), &err);
+		output->preload_wanted = FALSE;
+		generation = output->preload_generation;
+		g_mutex_unlock (&output->preload_mutex);
 
-		g_mutex_lock (&output->filler_mutex);
+		entry = xmms_playlist_next_entry (output->playlist);
+		current = xmms_playlist_current_entry (output->playlist);
 
-		if (ret > 0) {
-			gint skip = MIN (ret, output->toskip);
+		g_mutex_lock (&output->preload_mutex);
+		if (output->preload_chain &&
+		    (output->preload_entry == entry ||
+		     output->preload_entry == current)) {
+			/* still the next one, or it is about to be picked up */
+			continue;
+		}
+		g_mutex_unlock (&output->preload_mutex);
 
-			output->toskip -= skip;
-			if (ret > skip) {
-				xmms_ringbuf_write_wait (output->filler_buffer,
-				                         buf + skip,
-				                         ret - skip,
-				                         &output->filler_mutex);
+		chain = NULL;
+
+		if (entry) {
+			XMMS_DBG ("Preparing chain for next entry %d", entry);
+			chain = xmms_xform_chain_setup (output->medialib, entry,
+			                                output->format_list, FALSE);
+		}
+
+		if (chain) {
+			/* decode the first block so the filler can start writing
+			 * to the ringbuffer as soon as the current entry ends */
+			xmms_error_reset (&err);
+			if (xmms_xform_this_prefill (chain, 4096, &err) == -1) {
+				xmms_log_error ("Couldn't prepare next entry %d: %s", entry,
+				                xmms_error_message_get (&err));
+				xmms_object_unref (chain);
+				chain = NULL;
 			}
+		}
+
+		old = NULL;
+
+		g_mutex_lock (&output->preload_mutex);
+		if (generation == output->preload_generation && output->preload_running) {
+			old = output->preload_chain;
+			output->preload_chain = chain;
+			output->preload_entry = chain ? entry : 0;
 		} else {
-			if (ret == -1) {
-				/* print error */
-                xmms_log_error("xform read error: %s", xmms_error_message_get (&err));
-				xmms_error_reset (&err);
-			}
-			xmms_object_unref (chain);
-			chain = NULL;
-			if (!xmms_playlist_advance (output->playlist)) {
-				XMMS_DBG ("End of playlist");
-				output->filler_state = FILLER_STOP;
-			}
+			/* playlist changed while we were busy */
+			old = chain;
 		}
 
+		if (old) {
+			g_mutex_unlock (&output->preload_mutex);
+			xmms_object_unref (old);
+			g_mutex_lock (&output->preload_mutex);
+		}
 	}
-
-	if (chain)
-		xmms_object_unref (chain);
-
-	g_mutex_unlock (&output->filler_mutex);
+	g_mutex_unlock (&output->preload_mutex);
 
 	return NULL;
 }
 
-gint
-xmms_output_read (xmms_output_t *output, char *buffer, gint len)
+/**
+ * Resize the ringbuffer to hold output.buffer_ms of the format the
+ * chain delivers, less what the output plugin buffers by itself, and
+ * work out the prefill threshold for it.
+ * Should hold filler_mutex.
+ */
+static void
+xmms_output_buffer_policy_apply (xmms_output_t *output, xmms_xform_t *chain)
 {
-	gint ret;
-	xmms_error_t err;
-
-	xmms_error_reset (&err);
+	xmms_config_property_t *prop;
+	xmms_stream_type_t *type;
+	gint ms, prefill_ms, min, max, cap;
+	guint frame, bytes_per_sec, size, latency;
+	gint64 bytes;
+
+	type = xmms_xform_outtype_get (chain);
+	frame = xmms_sample_frame_size_get (type);
+	bytes_per_sec = frame * xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+
+	prop = xmms_config_lookup ("output.buffer_ms");
+	ms = xmms_config_property_get_int (prop);
+	prop = xmms_config_lookup ("output.buffer_min");
+	min = MAX (xmms_config_property_get_int (prop), FILLER_BLOCK_MIN * 2);
+	prop = xmms_config_lookup ("output.buffer_max");
+	max = MAX (xmms_config_property_get_int (prop), min);
+	cap = xmms_footprint_limit (XMMS_FOOTPRINT_RINGBUFFER);
+	if (cap) {
+		max = MAX (MIN (max, cap), FILLER_BLOCK_MIN * 2);
+		min = MIN (min, max);
+	}
+	prop = xmms_config_lookup ("output.prefill_ms");
+	prefill_ms = xmms_config_property_get_int (prop);
+
+	if (ms > 0) {
+		/* output->format belongs to the writer, assume the plugin
+		 * latency was measured in the format that is coming up */
+		if (output->plugin) {
+			latency = xmms_output_plugin_method_latency_get (output->plugin, output);
+			ms -= xmms_sample_bytes_to_ms (type, latency);
+		}
+		ms = MAX (ms, FILLER_PERIOD_MS * 2);
 
-	g_return_val_if_fail (output, -1);
-	g_return_val_if_fail (buffer, -1);
+		bytes = (gint64) bytes_per_sec * ms / 1000;
+		size = CLAMP (bytes, min, max);
+		size -= size % frame;
 
-	g_mutex_lock (&output->filler_mutex);
-	xmms_ringbuf_wait_used (output->filler_buffer, len, &output->filler_mutex);
-	ret = xmms_ringbuf_read (output->filler_buffer, buffer, len);
-	if (ret == 0 && xmms_ringbuf_iseos (output->filler_buffer)) {
-		xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
-		g_mutex_unlock (&output->filler_mutex);
-		return -1;
+		size = xmms_ringbuf_resize (output->filler_buffer, size);
+		XMMS_DBG ("Buffering %d ms in %u bytes", ms, size);
 	}
-	g_mutex_unlock (&output->filler_mutex);
 
-	update_playtime (output, ret);
+	/* the filler must still be able to put in a block */
+	bytes = (gint64) bytes_per_sec * MAX (prefill_ms, 0) / 1000;
+	size = MIN (bytes, xmms_ringbuf_size (output->filler_buffer) / 2);
+	size -= size % frame;
+	g_atomic_int_set (&output->prefill, size);
+
+	/* what the device held is played again from here after a
+	 * plugin switch */
+	prop = xmms_config_lookup ("output.swap_history_ms");
+	bytes = (gint64) bytes_per_sec * MAX (xmms_config_property_get_int (prop), 0) / 1000;
+	size = MIN (bytes, xmms_ringbuf_size (output->filler_buffer) / 4);
+	size -= size % frame;
+	xmms_ringbuf_set_history (output->filler_buffer, size);
+}
 
-	if (ret < len) {
-		XMMS_DBG ("Underrun %d of %d (%d)", ret, len, xmms_sample_frame_size_get (output->format));
+/**
+ * How many times the writer found less in the ringbuffer than it
+ * wanted.
+ */
+guint
+xmms_output_underruns_get (xmms_output_t *output)
+{
+	g_return_val_if_fail (output, 0);
 
-		if ((ret % xmms_sample_frame_size_get (output->format)) != 0) {
-			xmms_log_error ("***********************************");
-			xmms_log_error ("* Read non-multiple of sample size,");
-			xmms_log_error ("*  you probably hear noise now :)");
-			xmms_log_error ("***********************************");
-		}
-		output->buffer_underruns++;
-	}
+	return g_atomic_int_get (&output->buffer_underruns);
+}
 
-	output->bytes_written += ret;
+/**
+ * Everything noted about keeping the sink fed since the output was
+ * set up: how full the ringbuffer was each time the writer came,
+ * from empty to full in OUTPUT_FILL_BUCKETS steps, underruns and the
+ * last OUTPUT_UNDERRUN_TIMES of them in µs since the epoch, how far
+ * off the writer came from when it should have in µs, the sink
+ * latency in ms and the gap between chains in µs.
+ */
+xmmsv_t *
+xmms_output_health_get (xmms_output_t *output)
+{
+	xmmsv_t *hist, *times;
+	gint64 gap_last, gap_max, jitter_avg, jitter_max;
+	gint latency_avg, latency_max;
+	guint i, n;
 
-	return ret;
+	g_return_val_if_fail (output, NULL);
+
+	hist = xmmsv_new_list ();
+	times = xmmsv_new_list ();
+
+	g_mutex_lock (&output->health_mutex);
+	for (i = 0; i < OUTPUT_FILL_BUCKETS; i++) {
+		xmmsv_list_append_int (hist, output->fill_hist[i]);
+	}
+	n = MIN (output->underrun_pos, OUTPUT_UNDERRUN_TIMES);
+	for (i = output->underrun_pos - n; i < output->underrun_pos; i++) {
+		xmmsv_list_append_int (times, output->underrun_times[i % OUTPUT_UNDERRUN_TIMES]);
+	}
+	jitter_avg = output->jitter_avg;
+	jitter_max = output->jitter_max;
+	latency_avg = output->sink_latency_avg;
+	latency_max = output->sink_latency_max;
+	gap_last = output->gap_last;
+	gap_max = output->gap_max;
+	g_mutex_unlock (&output->health_mutex);
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("buffer_size", xmms_ringbuf_size (output->filler_buffer)),
+	                         XMMSV_DICT_ENTRY ("fill_histogram", hist),
+	                         XMMSV_DICT_ENTRY_INT ("underruns", g_atomic_int_get (&output->buffer_underruns)),
+	                         XMMSV_DICT_ENTRY ("underrun_times", times),
+	                         XMMSV_DICT_ENTRY_INT ("bytes_written", output->bytes_written),
+	                         XMMSV_DICT_ENTRY_INT ("jitter_avg", jitter_avg),
+	                         XMMSV_DICT_ENTRY_INT ("jitter_max", jitter_max),
+	                         XMMSV_DICT_ENTRY_INT ("latency_avg", latency_avg),
+	                         XMMSV_DICT_ENTRY_INT ("latency_max", latency_max),
+	                         XMMSV_DICT_ENTRY_INT ("gap_last", gap_last),
+	                         XMMSV_DICT_ENTRY_INT ("gap_max", gap_max),
+	                         XMMSV_DICT_END);
 }
 
-gint
-xmms_output_bytes_available (xmms_output_t *output)
+static gboolean
+xmms_output_health_emit (gpointer data)
 {
-	return xmms_ringbuf_bytes_used (output->filler_buffer);
+	xmms_output_t *output = data;
+
+	if (output->status == XMMS_PLAYBACK_STATUS_PLAY) {
+		xmms_object_emit (XMMS_OBJECT (output),
+		                  XMMS_IPC_SIGNAL_PLAYBACK_HEALTH,
+		                  xmms_output_health_get (output));
+	}
+
+	return TRUE;
 }
 
-xmms_config_property_t *
-xmms_output_config_property_register (xmms_output_t *output, const gchar *name, const gchar *default_value, xmms_object_handler_t cb, gpointer userdata)
+static void
+on_health_interval_changed (xmms_object_t *object, xmmsv_t *_data,
+                            gpointer udata)
 {
-	g_return_val_if_fail (output->plugin, NULL);
-	return xmms_plugin_config_property_register ((xmms_plugin_t *)output->plugin, name, default_value, cb, userdata);
+	xmms_output_t *output = udata;
+	gint secs;
+
+	secs = xmms_config_property_get_int ((xmms_config_property_t *) object);
+
+	if (output->health_timeout) {
+		g_source_remove (output->health_timeout);
+		output->health_timeout = 0;
+	}
+	if (secs > 0) {
+		output->health_timeout = g_timeout_add_seconds (secs, xmms_output_health_emit,
+		                                                output);
+	}
 }
 
-xmms_config_property_t *
-xmms_output_config_lookup (xmms_output_t *output, const gchar *path)
+/**
+ * Lowest fill level since the last call, and the average one.
+ */
+void
+xmms_output_buffer_stats_get (xmms_output_t *output, guint *size,
+                              guint *fill, guint *fill_min, guint *fill_avg)
 {
-	g_return_val_if_fail (output->plugin, NULL);
-	return xmms_plugin_config_lookup ((xmms_plugin_t *)output->plugin, path);
+	g_return_if_fail (output);
+
+	*size = xmms_ringbuf_size (output->filler_buffer);
+	*fill = xmms_ringbuf_bytes_used (output->filler_buffer);
+	*fill_min = MIN ((guint) g_atomic_int_get (&output->fill_min), *size);
+	*fill_avg = g_atomic_int_get (&output->fill_avg);
+
+	g_atomic_int_set (&output->fill_min, G_MAXINT);
 }
 
-xmms_medialib_entry_t
-xmms_output_current_id (xmms_output_t *output)
+/**
+ * Size the filler blocks after the format the chain delivers, so
+ * that every read covers about the same amount of time.
+ */
+static void
+xmms_output_filler_block_init (xmms_output_t *output, xmms_xform_t *chain)
 {
-	g_return_val_if_fail (output, 0);
-	return output->current_entry;
-}
+	xmms_stream_type_t *type;
+	guint frame, rate, base, max, ringsize;
 
+	type = xmms_xform_outtype_get (chain);
+	frame = xmms_sample_frame_size_get (type);
+	rate = xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	ringsize = xmms_ringbuf_size (output->filler_buffer);
 
-/** @addtogroup Output
- * @{
+	base = frame * (rate * FILLER_PERIOD_MS / 1000);
+	base = CLAMP (base, FILLER_BLOCK_MIN, MAX (ringsize / 4, FILLER_BLOCK_MIN));
+	base -= base % frame;
+
+	/* leave the other half of the ringbuffer for the writer */
+	max = MAX (ringsize / 2, base);
+	max -= max % frame;
+
+	if (max > output->filler_buf_size) {
+		if (output->realtime) {
+			xmms_realtime_mem_unlock (output->filler_buf, output->filler_buf_size);
+		}
+		output->filler_buf = g_realloc (output->filler_buf, max);
+		output->filler_buf_size = max;
+		if (output->realtime) {
+			xmms_realtime_mem_lock (output->filler_buf, max);
+		}
+	}
+
+	output->filler_block_base = base;
+	output->filler_block_max = max;
+	output->filler_bytes_per_sec = frame * rate;
+	g_atomic_int_set (&output->filler_block, base);
+
+	XMMS_DBG ("Filler blocks of %u bytes, up to %u", base, max);
+}
+
+/**
+ * Double the block size while reading a block takes less than a
+ * quarter of its playback time, halve it again once it takes more
+ * than half.
  */
-/** Methods */
 static void
-xmms_playback_client_tickle (xmms_output_t *output, xmms_error_t *error)
+xmms_output_filler_block_adapt (xmms_output_t *output, gint requested,
+                                gint ret, gint64 elapsed)
 {
-	xmms_output_filler_state (output, FILLER_KILL);
+	guint block = g_atomic_int_get (&output->filler_block);
+	gint64 duration;
+
+	if (!output->filler_bytes_per_sec || ret < requested) {
+		return;
+	}
+
+	duration = (gint64) ret * G_USEC_PER_SEC / output->filler_bytes_per_sec;
+
+	if (elapsed * 4 < duration && block < output->filler_block_max) {
+		block = MIN (block * 2, output->filler_block_max);
+	} else if (elapsed * 2 > duration && block > output->filler_block_base) {
+		block = MAX (block / 2, output->filler_block_base);
+	} else {
+		return;
+	}
+
+	g_atomic_int_set (&output->filler_block, block);
 }
 
+/**
+ * @internal Keep track of the chain the filler reads, filler_mutex
+ * held.
+ */
 static void
-xmms_playback_client_seek_ms (xmms_output_t *output, gint32 ms, gint32 whence, xmms_error_t *error)
+xmms_output_filler_chain_set (xmms_output_t *output, xmms_xform_t *chain)
 {
-	guint samples;
-
-	g_return_if_fail (output);
+	if (output->filler_chain) {
+		xmms_object_unref (output->filler_chain);
+	}
+	if (chain) {
+		xmms_object_ref (chain);
+	}
+	output->filler_chain = chain;
+}
 
-	if (whence == XMMS_PLAYBACK_SEEK_CUR) {
-		g_mutex_lock (&output->playtime_mutex);
-		ms += output->played_time;
-		if (ms < 0) {
-			ms = 0;
-		}
-		g_mutex_unlock (&output->playtime_mutex);
+static gboolean
+xmms_output_crossfade_mixable (xmms_stream_type_t *type)
+{
+	switch (xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_FORMAT)) {
+		case XMMS_SAMPLE_FORMAT_S16:
+		case XMMS_SAMPLE_FORMAT_S32:
+		case XMMS_SAMPLE_FORMAT_FLOAT:
+			return TRUE;
+		default:
+			return FALSE;
 	}
+}
 
-	if (output->format) {
-		samples = xmms_sample_ms_to_samples (output->format, ms);
+static gboolean
+xmms_output_crossfade_same_format (xmms_stream_type_t *a, xmms_stream_type_t *b)
+{
+	return xmms_stream_type_get_int (a, XMMS_STREAM_TYPE_FMT_FORMAT) ==
+	       xmms_stream_type_get_int (b, XMMS_STREAM_TYPE_FMT_FORMAT) &&
+	       xmms_stream_type_get_int (a, XMMS_STREAM_TYPE_FMT_CHANNELS) ==
+	       xmms_stream_type_get_int (b, XMMS_STREAM_TYPE_FMT_CHANNELS) &&
+	       xmms_stream_type_get_int (a, XMMS_STREAM_TYPE_FMT_SAMPLERATE) ==
+	       xmms_stream_type_get_int (b, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+}
 
-		xmms_playback_client_seek_samples (output, samples,
-		                                   XMMS_PLAYBACK_SEEK_SET, error);
+static gchar *
+xmms_output_crossfade_buf (xmms_output_t *output, gsize len)
+{
+	if (len > output->xfade_buf_size) {
+		output->xfade_buf = g_realloc (output->xfade_buf, len);
+		output->xfade_buf_size = len;
 	}
+	return output->xfade_buf;
 }
 
-static void
-xmms_playback_client_seek_samples (xmms_output_t *output, gint32 samples, gint32 whence, xmms_error_t *error)
+/**
+ * Size of the digital silence, whole frames of zero bytes, at the
+ * start or the end of data, as the nulstripper does for files.
+ */
+static gsize
+xmms_output_silence_len (const gchar *data, gsize len, guint frame,
+                         gboolean at_end)
 {
-	if (whence == XMMS_PLAYBACK_SEEK_CUR) {
-		g_mutex_lock (&output->playtime_mutex);
-		samples += output->played / xmms_sample_frame_size_get (output->format);
-		if (samples < 0) {
-			samples = 0;
+	gsize n = 0;
+
+	len -= len % frame;
+
+	while (n < len) {
+		const gchar *p = at_end ? data + len - n - frame : data + n;
+		guint i;
+
+		for (i = 0; i < frame; i++) {
+			if (p[i]) {
+				return n;
+			}
 		}
-		g_mutex_unlock (&output->playtime_mutex);
+		n += frame;
 	}
 
-	/* "just" tell filler */
-	xmms_output_filler_seek_state (output, samples);
+	return n;
 }
 
-static void
-xmms_playback_client_start (xmms_output_t *output, xmms_error_t *err)
+/**
+ * Bytes of silence the loudness analysis found at one end of the
+ * entry of a chain, 0 if it wasn't analyzed.
+ */
+static guint
+xmms_output_crossfade_silence (xmms_output_t *output, xmms_xform_t *chain,
+                               const gchar *key)
 {
-	g_return_if_fail (output);
+	xmms_medialib_session_t *session;
+	xmms_stream_type_t *type;
+	gint64 bytes;
+	guint frame;
+	gint ms;
 
-	xmms_output_filler_state (output, FILLER_RUN);
-	if (!xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_PLAY)) {
-		xmms_output_filler_state (output, FILLER_STOP);
-		xmms_error_set (err, XMMS_ERROR_GENERIC, "Could not start playback");
+	session = xmms_medialib_session_begin (output->medialib);
+	ms = xmms_medialib_entry_property_get_int (session, xmms_xform_entry_get (chain), key);
+	xmms_medialib_session_abort (session);
+
+	if (ms <= 0) {
+		return 0;
 	}
 
+	type = xmms_xform_outtype_get (chain);
+	frame = xmms_sample_frame_size_get (type);
+	bytes = (gint64) xmms_sample_ms_to_samples (type, ms) * frame;
+
+	return MIN (bytes, G_MAXINT);
 }
 
+/**
+ * Write all that is in a crossfade fifo to the ringbuffer as it is.
+ * Should hold filler_mutex.
+ */
 static void
-xmms_playback_client_stop (xmms_output_t *output, xmms_error_t *err)
+xmms_output_crossfade_write_raw (xmms_output_t *output, xmms_xform_fifo_t *fifo)
 {
-	g_return_if_fail (output);
-
-	xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
+	gsize len;
 
-	xmms_output_filler_state (output, FILLER_STOP);
+	while ((len = xmms_xform_fifo_read (fifo, output->filler_buf,
+	                                    output->filler_buf_size)) > 0) {
+		xmms_ringbuf_write_wait (output->filler_buffer, output->filler_buf,
+		                         len, &output->filler_mutex);
+	}
 }
 
+/**
+ * Drop what was held back for crossfading, on seeks and stops.
+ */
 static void
-xmms_playback_client_pause (xmms_output_t *output, xmms_error_t *err)
+xmms_output_crossfade_clear (xmms_output_t *output)
 {
-	g_return_if_fail (output);
+	xmms_xform_fifo_clear (output->xfade_tail);
+	xmms_xform_fifo_clear (output->xfade_out);
+	output->xfade_lead = FALSE;
 
-	xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_PAUSE);
+	if (output->xfade_format) {
+		xmms_object_unref (output->xfade_format);
+		output->xfade_format = NULL;
+	}
 }
 
-
-static gint32
-xmms_playback_client_status (xmms_output_t *output, xmms_error_t *error)
+/**
+ * Write out what was held back for crossfading once nothing follows.
+ * Should hold filler_mutex.
+ */
+static void
+xmms_output_crossfade_flush (xmms_output_t *output)
 {
-	gint32 ret;
-	g_return_val_if_fail (output, XMMS_PLAYBACK_STATUS_STOP);
+	/* stopped meanwhile, the ringbuffer was cleared */
+	if (output->filler_state == FILLER_RUN) {
+		xmms_output_crossfade_write_raw (output, output->xfade_tail);
+		xmms_output_crossfade_write_raw (output, output->xfade_out);
+	}
 
-	g_mutex_lock (&output->status_mutex);
-	ret = output->status;
-	g_mutex_unlock (&output->status_mutex);
-	return ret;
+	xmms_output_crossfade_clear (output);
 }
 
-static gint
-xmms_playback_client_current_id (xmms_output_t *output, xmms_error_t *error)
+/**
+ * Set up crossfading into a new chain, before its song change is put
+ * in the ringbuffer. The end of the chain before is mixed into it if
+ * both are in the same format and it is one that can be mixed,
+ * otherwise it is written as it is.
+ * Should hold filler_mutex.
+ */
+static void
+xmms_output_crossfade_start (xmms_output_t *output, xmms_xform_t *chain)
 {
-	return output->current_entry;
+	xmms_config_property_t *prop;
+	xmms_stream_type_t *type;
+	gint64 bytes;
+	guint frame;
+	gint ms, rate;
+
+	type = xmms_xform_outtype_get (chain);
+	frame = xmms_sample_frame_size_get (type);
+	rate = xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+
+	prop = xmms_config_lookup ("output.crossfade_ms");
+	ms = CLAMP (xmms_config_property_get_int (prop), 0, CROSSFADE_MAX_MS);
+	prop = xmms_config_lookup ("output.crossfade_trim");
+	output->xfade_trim = !!xmms_config_property_get_int (prop);
+
+	output->xfade_bytes = 0;
+	if (ms > 0 && rate > 0 && xmms_output_crossfade_mixable (type)) {
+		bytes = (gint64) frame * rate * ms / 1000;
+		output->xfade_bytes = bytes - bytes % frame;
+	}
+
+	if (output->xfade_format &&
+	    (!output->xfade_bytes ||
+	     !xmms_output_crossfade_same_format (output->xfade_format, type))) {
+		xmms_output_crossfade_write_raw (output, output->xfade_out);
+		xmms_object_unref (output->xfade_format);
+		output->xfade_format = NULL;
+	}
+
+	output->xfade_total = xmms_xform_fifo_length (output->xfade_out);
+	output->xfade_done = 0;
+	output->xfade_lead = output->xfade_bytes && output->xfade_trim;
+
+	/* what was measured beforehand doesn't have to be looked for */
+	if (output->xfade_lead) {
+		guint lead;
+
+		lead = xmms_output_crossfade_silence (output, chain,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_START);
+		if (lead) {
+			output->toskip = lead;
+			output->xfade_lead = FALSE;
+		}
+	}
 }
 
+/**
+ * Hold back the end of a chain that has ended for mixing into the
+ * next one. Should hold filler_mutex.
+ */
 static void
-xmms_playback_client_volume_set (xmms_output_t *output, const gchar *channel,
-                                 gint32 volume, xmms_error_t *error)
+xmms_output_crossfade_end (xmms_output_t *output, xmms_xform_t *chain)
 {
+	xmms_stream_type_t *type;
+	gchar *buf;
+	gsize len;
 
-	if (!output->plugin) {
-		xmms_error_set (error, XMMS_ERROR_GENERIC,
-		                "couldn't set volume, output plugin not loaded");
+	len = xmms_xform_fifo_length (output->xfade_tail);
+	if (!len) {
 		return;
 	}
 
-	if (!xmms_output_plugin_method_volume_set_available (output->plugin)) {
-		xmms_error_set (error, XMMS_ERROR_GENERIC,
-		                "operation not supported");
+	/* it was shorter than the crossfade into it, let the rest of the
+	 * one before play out after it instead */
+	if (xmms_xform_fifo_length (output->xfade_out)) {
+		xmms_output_crossfade_write_raw (output, output->xfade_tail);
+		xmms_output_crossfade_write_raw (output, output->xfade_out);
+		xmms_object_unref (output->xfade_format);
+		output->xfade_format = NULL;
 		return;
 	}
 
-	if (volume > 100 || volume < 0) {
-		xmms_error_set (error, XMMS_ERROR_INVAL, "volume out of range");
-		return;
+	type = xmms_xform_outtype_get (chain);
+	buf = xmms_output_crossfade_buf (output, len);
+	xmms_xform_fifo_read (output->xfade_tail, buf, len);
+
+	if (output->xfade_trim) {
+		len -= MIN (len, xmms_output_crossfade_silence (output, chain,
+		                                                XMMS_MEDIALIB_ENTRY_PROPERTY_SILENCE_END));
+		len -= xmms_output_silence_len (buf, len,
+		                                xmms_sample_frame_size_get (type),
+		                                TRUE);
 	}
+	xmms_xform_fifo_write (output->xfade_out, buf, len);
 
-	if (!xmms_output_plugin_methods_volume_set (output->plugin, output, channel, volume)) {
-		xmms_error_set (error, XMMS_ERROR_GENERIC,
-		                "couldn't set volume");
+	if (output->xfade_format) {
+		xmms_object_unref (output->xfade_format);
 	}
+	output->xfade_format = xmms_object_ref (type);
 }
 
-static xmmsv_t *
-xmms_playback_client_volume_get (xmms_output_t *output, xmms_error_t *error)
-{
-	xmmsv_t *ret;
-	xmms_volume_map_t map;
+#define CROSSFADE_MIX(type, acc) G_STMT_START { \
+	type *in = (type *) data, *out = (type *) output->xfade_buf; \
+	for (i = 0; i < frames; i++) { \
+		acc gain = (acc) (pos + i) / total; \
+		for (c = 0; c < channels; c++, in++, out++) { \
+			*in = (type) (*out + (*in - (acc) *out) * gain); \
+		} \
+	} \
+} G_STMT_END
 
-	if (!output->plugin) {
-		xmms_error_set (error, XMMS_ERROR_GENERIC,
-		                "couldn't get volume, output plugin not loaded");
-		return NULL;
+/**
+ * Mix what is left of the chain before into data from the new one,
+ * with its gain ramping down as that of the new one ramps up.
+ */
+static void
+xmms_output_crossfade_mix (xmms_output_t *output, gchar *data, gsize len)
+{
+	xmms_stream_type_t *type = output->xfade_format;
+	gsize frames, total, pos, i;
+	guint frame, c, channels;
+
+	frame = xmms_sample_frame_size_get (type);
+	channels = xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_CHANNELS);
+
+	len = MIN (len, xmms_xform_fifo_length (output->xfade_out));
+	len -= len % frame;
+	xmms_xform_fifo_read (output->xfade_out,
+	                      xmms_output_crossfade_buf (output, len), len);
+
+	frames = len / frame;
+	total = MAX (output->xfade_total / frame, 1);
+	pos = output->xfade_done / frame;
+
+	switch (xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_FORMAT)) {
+		case XMMS_SAMPLE_FORMAT_S16:
+			CROSSFADE_MIX (gint16, gfloat);
+			break;
+		case XMMS_SAMPLE_FORMAT_S32:
+			CROSSFADE_MIX (gint32, gdouble);
+			break;
+		case XMMS_SAMPLE_FORMAT_FLOAT:
+			CROSSFADE_MIX (gfloat, gfloat);
+			break;
 	}
 
-	if (!xmms_output_plugin_method_volume_get_available (output->plugin)) {
-		xmms_error_set (error, XMMS_ERROR_GENERIC,
-		                "operation not supported");
-		return NULL;
+	output->xfade_done += len;
+
+	if (!xmms_xform_fifo_length (output->xfade_out)) {
+		xmms_object_unref (output->xfade_format);
+		output->xfade_format = NULL;
 	}
+}
 
-	xmms_error_set (error, XMMS_ERROR_GENERIC,
-	                "couldn't get volume");
+/**
+ * Put what the chain gave in the ringbuffer, through the crossfade
+ * if there is one. Should hold filler_mutex.
+ */
+static void
+xmms_output_filler_write (xmms_output_t *output, gchar *data, gsize len)
+{
+	gsize excess;
 
-	xmms_volume_map_init (&map);
+	if (!output->xfade_bytes && !xmms_xform_fifo_length (output->xfade_tail)) {
+		xmms_ringbuf_write_wait (output->filler_buffer, data, len,
+		                         &output->filler_mutex);
+		return;
+	}
 
-	/* ask the plugin how much channels it would like to set */
-	if (!xmms_output_plugin_method_volume_get (output->plugin, output,
-	                                           NULL, NULL, &map.num_channels)) {
-		return NULL;
+	if (output->xfade_lead) {
+		xmms_stream_type_t *type;
+		gsize silent;
+
+		type = xmms_xform_outtype_get (output->filler_chain);
+		silent = xmms_output_silence_len (data, len,
+		                                  xmms_sample_frame_size_get (type),
+		                                  FALSE);
+		data += silent;
+		len -= silent;
+		if (!len) {
+			return;
+		}
+		output->xfade_lead = FALSE;
 	}
 
-	/* check for sane values */
+	if (output->xfade_format) {
+		xmms_output_crossfade_mix (output, data, len);
+	}
+
+	xmms_xform_fifo_write (output->xfade_tail, data, len);
+
+	/* data may be in filler_buf, it was copied to the tail already */
+	excess = xmms_xform_fifo_length (output->xfade_tail);
+	excess -= MIN (excess, (gsize) output->xfade_bytes);
+	while (excess > 0) {
+		gsize n;
+
+		n = xmms_xform_fifo_read (output->xfade_tail, output->filler_buf,
+		                          MIN (excess, output->filler_buf_size));
+		xmms_ringbuf_write_wait (output->filler_buffer, output->filler_buf,
+		                         n, &output->filler_mutex);
+		excess -= n;
+	}
+}
+
+/**
+ * Seek the chain just set up to resume_ms, like a seek of the filler
+ * but nothing is buffered yet. Should hold filler_mutex.
+ */
+static void
+xmms_output_filler_resume (xmms_output_t *output, xmms_xform_t *chain)
+{
+	xmms_error_t err;
+	guint32 samples;
+	gint ret;
+
+	samples = xmms_sample_ms_to_samples (xmms_xform_outtype_get (chain),
+	                                     output->resume_ms);
+	output->resume_ms = 0;
+
+	xmms_error_reset (&err);
+	ret = xmms_xform_this_seek (chain, samples, XMMS_XFORM_SEEK_SET, &err);
+	if (ret == -1) {
+		xmms_log_info ("Resuming at %u samples failed: %s", samples,
+		               xmms_error_message_get (&err));
+		return;
+	}
+
+	output->filler_seek = samples;
+	output->filler_skip = samples - ret;
+	if (output->filler_skip < 0) {
+		output->filler_skip = 0;
+		output->filler_seek = ret;
+	}
+
+	output->seek_pending = TRUE;
+	xmms_ringbuf_hotspot_set (output->filler_buffer, seek_done, NULL, output);
+}
+
+static void *
+xmms_output_filler (void *arg)
+{
+	xmms_output_t *output = (xmms_output_t *)arg;
+	xmms_xform_t *chain = NULL;
+	gboolean last_was_kill = FALSE;
+	gpointer dest = NULL;
+	guint avail, block;
+	gint64 started, chain_end = 0;
+	xmms_error_t err;
+	gint ret;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
+	xmms_error_reset (&err);
+
+	xmms_output_realtime_thread_enter ();
+
+	g_mutex_lock (&output->filler_mutex);
+	while (output->filler_state != FILLER_QUIT) {
+		if (output->filler_state == FILLER_STOP) {
+			if (chain) {
+                XMMS_DBG("Got FILTER_STOP. Cleaning up the chain, %p", chain);
+				xmms_object_unref (chain);
+				chain = NULL;
+				xmms_output_filler_chain_set (output, NULL);
+				xmms_output_preload_invalidate (output, FALSE);
+			}
+			xmms_output_crossfade_clear (output);
+			chain_end = 0;
+			xmms_ringbuf_set_eos (output->filler_buffer, TRUE);
+			g_cond_wait (&output->filler_state_cond, &output->filler_mutex);
+			last_was_kill = FALSE;
+			continue;
+		}
+		if (output->filler_state == FILLER_KILL) {
+			xmms_output_crossfade_clear (output);
+			if (chain) {
+				xmms_object_unref (chain);
+				chain = NULL;
+				xmms_output_filler_chain_set (output, NULL);
+				output->filler_state = FILLER_RUN;
+				last_was_kill = TRUE;
+				chain_end = 0;
+			} else {
+				output->filler_state = FILLER_STOP;
+			}
+			continue;
+		}
+		if (output->filler_state == FILLER_SEEK) {
+			xmms_config_property_t *prop;
+			gint64 scrub;
+
+			if (!chain) {
+				XMMS_DBG ("Seek without chain, ignoring..");
+				output->seek_pending = FALSE;
+				output->filler_state = FILLER_STOP;
+				continue;
+			}
+
+			/* while scrubbing only the last of the seeks coming in
+			 * quick succession is done */
+			prop = xmms_config_lookup ("output.scrub_ms");
+			scrub = CLAMP (xmms_config_property_get_int (prop), 0, 1000) * G_TIME_SPAN_MILLISECOND;
+			if (scrub && output->seek_stamp + scrub > g_get_monotonic_time ()) {
+				g_cond_wait_until (&output->filler_state_cond, &output->filler_mutex,
+				                   output->seek_stamp + scrub);
+				continue;
+			}
+
+			ret = xmms_xform_this_seek (chain, output->filler_seek, XMMS_XFORM_SEEK_SET, &err);
+			if (ret == -1) {
+				xmms_log_info ("Seeking failed: %s", xmms_error_message_get (&err));
+				xmms_error_reset (&err);
+				output->seek_pending = FALSE;
+			} else {
+				XMMS_DBG ("Seek ok! %d", ret);
+
+				output->filler_skip = output->filler_seek - ret;
+				if (output->filler_skip < 0) {
+					XMMS_DBG ("Seeked %d samples too far! Updating position...",
+					          -output->filler_skip);
+
+					output->filler_skip = 0;
+					output->filler_seek = ret;
+				}
+
+				xmms_ringbuf_clear (output->filler_buffer);
+				xmms_output_crossfade_clear (output);
+				xmms_ringbuf_hotspot_set (output->filler_buffer, seek_done, NULL, output);
+			}
+			output->filler_state = FILLER_RUN;
+		}
+
+		if (!chain) {
+			xmms_medialib_entry_t entry;
+			xmms_output_song_changed_arg_t *hsarg;
+
+			g_mutex_unlock (&output->filler_mutex);
+
+			entry = xmms_playlist_current_entry (output->playlist);
+			if (!entry) {
+				XMMS_DBG ("No entry from playlist!");
+				g_mutex_lock (&output->filler_mutex);
+				xmms_output_crossfade_flush (output);
+				output->filler_state = FILLER_STOP;
+				continue;
+			}
+
+			chain = xmms_output_preload_take (output, entry);
+			if (chain) {
+				XMMS_DBG ("Using prepared chain for %d", entry);
+			} else {
+				chain = xmms_xform_chain_setup (output->medialib, entry, output->format_list, FALSE);
+			}
+			if (!chain) {
+				xmms_medialib_session_t *session;
+
+				do {
+					session = xmms_medialib_session_begin (output->medialib);
+					if (xmms_medialib_entry_property_get_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS) == XMMS_MEDIALIB_ENTRY_STATUS_NEW) {
+						xmms_medialib_entry_remove (session, entry);
+					} else {
+						xmms_medialib_entry_status_set (session, entry, XMMS_MEDIALIB_ENTRY_STATUS_NOT_AVAILABLE);
+					}
+				} while (!xmms_medialib_session_commit (session));
+
+				if (!xmms_playlist_advance (output->playlist)) {
+					XMMS_DBG ("End of playlist");
+					g_mutex_lock (&output->filler_mutex);
+					xmms_output_crossfade_flush (output);
+					output->filler_state = FILLER_STOP;
+					continue;
+				}
+				g_mutex_lock (&output->filler_mutex);
+				continue;
+			}
+
+			hsarg = g_new0 (xmms_output_song_changed_arg_t, 1);
+			hsarg->output = output;
+			hsarg->chain = chain;
+			hsarg->flush = last_was_kill;
+			xmms_object_ref (chain);
+
+			last_was_kill = FALSE;
+
+			xmms_output_preload_invalidate (output, TRUE);
+
+			g_mutex_lock (&output->filler_mutex);
+			xmms_output_filler_chain_set (output, chain);
+			xmms_output_buffer_policy_apply (output, chain);
+			xmms_output_filler_block_init (output, chain);
+			xmms_output_crossfade_start (output, chain);
+			xmms_ringbuf_hotspot_set (output->filler_buffer, song_changed, song_changed_arg_free, hsarg);
+
+			if (output->resume_ms) {
+				xmms_output_filler_resume (output, chain);
+			}
+		}
+
+		block = g_atomic_int_get (&output->filler_block);
+		xmms_ringbuf_wait_free (output->filler_buffer, block, &output->filler_mutex);
+
+		if (output->filler_state != FILLER_RUN) {
+			XMMS_DBG ("State changed while waiting...");
+			continue;
+		}
+
+		avail = 0;
+		if (!output->toskip && !output->xfade_bytes) {
+			/* nothing to drop or hold back, let the chain write
+			 * straight into the ringbuffer instead of going through buf */
+			avail = xmms_ringbuf_reserve (output->filler_buffer, &dest);
+
+			/* a short tail before the wrap point would ask the chain
+			 * for a tiny read that may split a frame, it takes the
+			 * copy through filler_buf instead */
+			if (avail < block) {
+				avail = 0;
+			}
+		}
+
+		g_mutex_unlock (&output->filler_mutex);
+
+		XMMS_TRACE_BEGIN ("output.filler_read");
+		started = g_get_monotonic_time ();
+		if (avail) {
+			ret = xmms_xform_this_read (chain, dest, block, &err);
+		} else {
+			ret = xmms_xform_this_read (chain, output->filler_buf, block, &err);
+		}
+		XMMS_TRACE_END ("output.filler_read");
+		xmms_output_filler_block_adapt (output, block, ret,
+		                                g_get_monotonic_time () - started);
+
+		g_mutex_lock (&output->filler_mutex);
+
+		if (ret > 0) {
+			gint skip = MIN (ret, output->toskip);
+
+			if (chain_end) {
+				xmms_output_health_gap (output, g_get_monotonic_time () - chain_end);
+				chain_end = 0;
+			}
+
+			output->toskip -= skip;
+			if (avail) {
+				/* a seek may have finished while reading */
+				if (skip && ret > skip) {
+					memmove (dest, (gchar *) dest + skip, ret - skip);
+				}
+				/* dropped if the buffer was cleared meanwhile */
+				if (ret > skip) {
+					xmms_ringbuf_commit (output->filler_buffer, ret - skip);
+				}
+			} else if (ret > skip) {
+				xmms_output_filler_write (output, output->filler_buf + skip,
+				                          ret - skip);
+			}
+		} else {
+			if (ret == -1) {
+				/* print error */
+                xmms_log_error("xform read error: %s", xmms_error_message_get (&err));
+				xmms_error_reset (&err);
+			}
+			xmms_output_crossfade_end (output, chain);
+			xmms_object_unref (chain);
+			chain = NULL;
+			xmms_output_filler_chain_set (output, NULL);
+			chain_end = g_get_monotonic_time ();
+			if (!xmms_playlist_advance (output->playlist)) {
+				XMMS_DBG ("End of playlist");
+				xmms_output_crossfade_flush (output);
+				output->filler_state = FILLER_STOP;
+			}
+		}
+
+	}
+
+	if (chain)
+		xmms_object_unref (chain);
+	xmms_output_filler_chain_set (output, NULL);
+
+	g_mutex_unlock (&output->filler_mutex);
+
+	return NULL;
+}
+
+static void
+xmms_output_fill_stats_update (xmms_output_t *output)
+{
+	gint used, avg;
+
+	used = xmms_ringbuf_bytes_used (output->filler_buffer);
+	if (used < g_atomic_int_get (&output->fill_min)) {
+		g_atomic_int_set (&output->fill_min, used);
+	}
+	avg = g_atomic_int_get (&output->fill_avg);
+	g_atomic_int_set (&output->fill_avg, avg + (used - avg) / 16);
+}
+
+static void
+xmms_output_format_pending_clear (xmms_output_t *output)
+{
+	xmms_stream_type_t *fmt;
+
+	fmt = g_atomic_pointer_get (&output->format_pending);
+	if (fmt && g_atomic_pointer_compare_and_exchange (&output->format_pending, fmt, NULL)) {
+		xmms_object_unref (fmt);
+	}
+}
+
+/**
+ * @internal Give a plugin switched to while playing the format of
+ * what is buffered, in the reader like a song change would.
+ */
+static void
+xmms_output_format_pending_apply (xmms_output_t *output)
+{
+	xmms_stream_type_t *fmt;
+
+	fmt = g_atomic_pointer_get (&output->format_pending);
+	if (!fmt || !g_atomic_pointer_compare_and_exchange (&output->format_pending, fmt, NULL)) {
+		return;
+	}
+
+	if (!xmms_output_format_set (output, fmt)) {
+		XMMS_DBG ("New output plugin refused the format, stopping filler..");
+
+		g_mutex_lock (&output->filler_mutex);
+		xmms_output_filler_state_nolock (output, FILLER_STOP);
+		xmms_ringbuf_set_eos (output->filler_buffer, TRUE);
+		g_mutex_unlock (&output->filler_mutex);
+	}
+
+	xmms_object_unref (fmt);
+}
+
+/**
+ * @internal Hold the writer until a scheduled start is due. The
+ * buffer is prefilled by then, so the first frame goes out on time.
+ */
+static void
+xmms_output_start_wait (xmms_output_t *output)
+{
+	gint64 left;
+
+	while (g_atomic_int_get (&output->start_pending)) {
+		left = output->start_at - g_get_monotonic_time ();
+		if (left <= 0) {
+			g_atomic_int_set (&output->start_pending, 0);
+			XMMS_DBG ("Scheduled start, %" G_GINT64_FORMAT " us late", -left);
+			break;
+		}
+
+		/* stopping clears start_pending, so don't sleep it all */
+		g_usleep (MIN (left, START_POLL_US));
+	}
+}
+
+/**
+ * @internal The pull mode version, a realtime callback can't wait.
+ * Fills what comes before the start time with silence.
+ *
+ * @returns the number of bytes of silence put in buffer.
+ */
+static gint
+xmms_output_start_silence (xmms_output_t *output, char *buffer, gint len)
+{
+	gint64 left, frames;
+	gint fs, rate;
+
+	if (!g_atomic_int_get (&output->start_pending) || !output->format) {
+		return 0;
+	}
+
+	left = output->start_at - g_get_monotonic_time ();
+	if (left <= 0) {
+		g_atomic_int_set (&output->start_pending, 0);
+		return 0;
+	}
+
+	fs = xmms_sample_frame_size_get (output->format);
+	rate = xmms_stream_type_get_int (output->format,
+	                                 XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+
+	frames = MIN (left * rate / G_USEC_PER_SEC, len / fs);
+	memset (buffer, 0, frames * fs);
+
+	return frames * fs;
+}
+
+/**
+ * @internal How much to read for len bytes of output, with a frame
+ * left out or repeated now and then to follow drift_ppm.
+ */
+static gint
+xmms_output_drift_len (xmms_output_t *output, gint len)
+{
+	gint ppm, fs, frames;
+
+	output->drift_frames = 0;
+
+	ppm = g_atomic_int_get (&output->drift_ppm);
+	if (!ppm || !output->format) {
+		output->drift_acc = 0;
+		return len;
+	}
+
+	fs = xmms_sample_frame_size_get (output->format);
+	frames = len / fs;
+
+	output->drift_acc += (gint64) frames * ppm;
+	output->drift_frames = output->drift_acc / 1000000;
+	output->drift_acc -= (gint64) output->drift_frames * 1000000;
+
+	/* repeated frames need room in the buffer */
+	if (output->drift_frames < 0) {
+		output->drift_frames = MAX (output->drift_frames, 1 - frames);
+		return len + output->drift_frames * fs;
+	}
+
+	return len;
+}
+
+/**
+ * @internal Drop or repeat the frames xmms_output_drift_len asked for,
+ * at the end of the block. A jump of a frame or two can't be heard.
+ *
+ * @returns the number of bytes now in buffer.
+ */
+static gint
+xmms_output_drift_apply (xmms_output_t *output, char *buffer, gint ret,
+                         gint len)
+{
+	gint fs, n = output->drift_frames;
+	gchar *last;
+
+	if (!n || ret <= 0) {
+		return ret;
+	}
+
+	fs = xmms_sample_frame_size_get (output->format);
+
+	if (n > 0) {
+		if (n * fs < ret) {
+			ret -= n * fs;
+		}
+	} else {
+		last = buffer + ret - fs;
+		for (; n < 0 && ret + fs <= len; n++) {
+			memcpy (buffer + ret, last, fs);
+			ret += fs;
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * @internal Hand what is about to be written to the sink to the
+ * visualization, if it wants it from here.
+ */
+static void
+xmms_output_vis_feed (xmms_output_t *output, const gchar *buffer, gint len)
+{
+	gint64 play_at;
+	guint queued;
+
+	/* tee children play the same thing again */
+	if (len <= 0 || output->tee_parent || !xmms_visualization_at_output ()) {
+		return;
+	}
+
+	/* only the soundcard is ahead of it now */
+	queued = xmms_output_plugin_method_latency_get (output->plugin, output);
+	play_at = g_get_monotonic_time () +
+	          xmms_sample_bytes_to_ms (output->format, queued) * 1000;
+
+	xmms_visualization_output_feed (output->format, buffer, len, play_at);
+}
+
+gint
+xmms_output_read (xmms_output_t *output, char *buffer, gint len)
+{
+	gint ret, want, prefill;
+	xmms_error_t err;
+
+	xmms_error_reset (&err);
+
+	g_return_val_if_fail (output, -1);
+	g_return_val_if_fail (buffer, -1);
+
+	xmms_output_format_pending_apply (output);
+
+	want = xmms_output_drift_len (output, len);
+
+	/* the ringbuffer has a single reader, so there's no need to
+	 * take the filler mutex, which the decoder may hold for long */
+	prefill = g_atomic_int_get (&output->prefill_pending);
+	if (prefill) {
+		g_atomic_int_set (&output->prefill_pending, 0);
+		prefill = MIN (prefill, xmms_ringbuf_size (output->filler_buffer));
+		xmms_ringbuf_wait_used_unlocked (output->filler_buffer, MAX (prefill, want));
+	}
+
+	xmms_output_start_wait (output);
+
+	xmms_ringbuf_wait_used_unlocked (output->filler_buffer, want);
+	ret = xmms_ringbuf_read (output->filler_buffer, buffer, want);
+	if (ret == 0 && xmms_ringbuf_iseos (output->filler_buffer)) {
+		xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
+		return -1;
+	}
+
+	xmms_output_fill_stats_update (output);
+	xmms_output_health_update (output, ret, want, TRUE);
+
+	/* sinks follow the playtime of the output feeding them */
+	if (!output->tee_parent) {
+		update_playtime (output, ret);
+		xmms_output_sinks_feed (output, buffer, ret);
+	}
+
+	if (ret < want) {
+		XMMS_DBG ("Underrun %d of %d (%d)", ret, want, xmms_sample_frame_size_get (output->format));
+
+		if ((ret % xmms_sample_frame_size_get (output->format)) != 0) {
+			xmms_log_error ("***********************************");
+			xmms_log_error ("* Read non-multiple of sample size,");
+			xmms_log_error ("*  you probably hear noise now :)");
+			xmms_log_error ("***********************************");
+		}
+		output->buffer_underruns++;
+		g_atomic_int_set (&output->prefill_pending,
+		                  g_atomic_int_get (&output->prefill));
+	}
+
+	ret = xmms_output_drift_apply (output, buffer, ret, len);
+
+	xmms_output_vis_feed (output, buffer, ret);
+
+	output->bytes_written += ret;
+
+	return ret;
+}
+
+static void
+xmms_output_pull_wake (xmms_output_t *output)
+{
+	g_atomic_int_set (&output->pull_pending, 1);
+
+	/* if the pull thread holds the lock it may be just about to
+	 * wait, then it notices after PULL_INTERVAL_MS */
+	if (g_mutex_trylock (&output->pull_mutex)) {
+		g_cond_signal (&output->pull_cond);
+		g_mutex_unlock (&output->pull_mutex);
+	}
+}
+
+gint
+xmms_output_pull (xmms_output_t *output, char *buffer, gint len)
+{
+	gboolean held = FALSE;
+	gint ret, want, prefill, silence;
+
+	g_return_val_if_fail (output, -1);
+	g_return_val_if_fail (buffer, -1);
+
+	if (g_atomic_pointer_get (&output->format_pending)) {
+		xmms_output_pull_wake (output);
+		return 0;
+	}
+
+	prefill = g_atomic_int_get (&output->prefill_pending);
+	if (prefill) {
+		prefill = MIN (MAX (prefill, len), xmms_ringbuf_size (output->filler_buffer));
+		if (xmms_ringbuf_bytes_used (output->filler_buffer) < prefill &&
+		    !xmms_ringbuf_iseos (output->filler_buffer)) {
+			return 0;
+		}
+		g_atomic_int_set (&output->prefill_pending, 0);
+	}
+
+	silence = xmms_output_start_silence (output, buffer, len);
+	if (silence == len) {
+		return len;
+	}
+	buffer += silence;
+	len -= silence;
+
+	want = xmms_output_drift_len (output, len);
+
+	ret = xmms_ringbuf_try_read (output->filler_buffer, buffer, want, &held);
+	if (held) {
+		/* a song change or the like, for the pull thread to run */
+		xmms_output_pull_wake (output);
+		return silence + ret;
+	}
+	if (ret == 0 && xmms_ringbuf_iseos (output->filler_buffer)) {
+		xmms_output_pull_wake (output);
+		return silence ? silence : -1;
+	}
+
+	xmms_output_fill_stats_update (output);
+	xmms_output_health_update (output, ret, want, FALSE);
+
+	/* the pull thread turns this into playtime */
+	g_atomic_int_add (&output->played, ret);
+
+	if (ret < want) {
+		g_atomic_int_inc (&output->buffer_underruns);
+		g_atomic_int_set (&output->prefill_pending,
+		                  g_atomic_int_get (&output->prefill));
+	}
+
+	ret = xmms_output_drift_apply (output, buffer, ret, len);
+	xmms_output_vis_feed (output, buffer, ret);
+	output->bytes_written += ret;
+
+	return silence + ret;
+}
+
+void
+xmms_output_pull_mode_set (xmms_output_t *output, gboolean pull)
+{
+	g_return_if_fail (output);
+
+	output->pull_mode = pull;
+}
+
+/**
+ * @internal Do the part of reading that xmms_output_pull leaves out:
+ * run hotspots, stop at the end of the stream and keep the playtime.
+ */
+static gpointer
+xmms_output_pull_thread (gpointer data)
+{
+	xmms_output_t *output = data;
+	guint8 dummy;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
+	g_mutex_lock (&output->pull_mutex);
+
+	while (output->pull_running) {
+		if (!g_atomic_int_get (&output->pull_pending)) {
+			g_cond_wait_until (&output->pull_cond, &output->pull_mutex,
+			                   g_get_monotonic_time () +
+			                   PULL_INTERVAL_MS * G_TIME_SPAN_MILLISECOND);
+		}
+		g_mutex_unlock (&output->pull_mutex);
+
+		if (g_atomic_int_compare_and_exchange (&output->pull_pending, 1, 0)) {
+			xmms_output_format_pending_apply (output);
+
+			/* peeking runs the hotspot the reader stopped at */
+			if (!xmms_ringbuf_peek (output->filler_buffer, &dummy, 1) &&
+			    xmms_ringbuf_iseos (output->filler_buffer) &&
+			    g_atomic_int_get (&output->status) != XMMS_PLAYBACK_STATUS_STOP) {
+				xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
+			}
+		}
+
+		if (!output->tee_parent &&
+		    g_atomic_int_get (&output->status) == XMMS_PLAYBACK_STATUS_PLAY) {
+			update_playtime (output, 0);
+		}
+
+		g_mutex_lock (&output->pull_mutex);
+	}
+
+	g_mutex_unlock (&output->pull_mutex);
+
+	return NULL;
+}
+
+static void
+xmms_output_pull_stop (xmms_output_t *output)
+{
+	g_mutex_lock (&output->pull_mutex);
+	output->pull_running = FALSE;
+	g_cond_signal (&output->pull_cond);
+	g_mutex_unlock (&output->pull_mutex);
+
+	if (output->pull_thread) {
+		g_thread_join (output->pull_thread);
+		output->pull_thread = NULL;
+	}
+}
+
+gint
+xmms_output_read_prepare (xmms_output_t *output)
+{
+	guint8 dummy;
+
+	g_return_val_if_fail (output, -1);
+
+	xmms_output_format_pending_apply (output);
+
+	/* once there is data, any hotspot before it is in place too, and
+	 * peeking runs it without taking anything from the buffer */
+	xmms_ringbuf_wait_used_unlocked (output->filler_buffer, 1);
+	if (!xmms_ringbuf_peek (output->filler_buffer, &dummy, 1) &&
+	    xmms_ringbuf_iseos (output->filler_buffer)) {
+		xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
+		return -1;
+	}
+
+	return xmms_ringbuf_bytes_used (output->filler_buffer);
+}
+
+gint
+xmms_output_bytes_available (xmms_output_t *output)
+{
+	return xmms_ringbuf_bytes_used (output->filler_buffer);
+}
+
+xmms_config_property_t *
+xmms_output_config_property_register (xmms_output_t *output, const gchar *name, const gchar *default_value, xmms_object_handler_t cb, gpointer userdata)
+{
+	g_return_val_if_fail (output->plugin, NULL);
+	return xmms_plugin_config_property_register ((xmms_plugin_t *)output->plugin, name, default_value, cb, userdata);
+}
+
+xmms_config_property_t *
+xmms_output_config_lookup (xmms_output_t *output, const gchar *path)
+{
+	g_return_val_if_fail (output->plugin, NULL);
+	return xmms_plugin_config_lookup ((xmms_plugin_t *)output->plugin, path);
+}
+
+xmms_medialib_entry_t
+xmms_output_current_id (xmms_output_t *output)
+{
+	g_return_val_if_fail (output, 0);
+	return output->current_entry;
+}
+
+/**
+ * Get the status and playtime, for a daemon replacing this one to
+ * #xmms_output_resume.
+ */
+void
+xmms_output_resume_point_get (xmms_output_t *output, gint *status, guint *ms)
+{
+	g_return_if_fail (output);
+
+	*status = xmms_playback_client_status (output, NULL);
+	*ms = g_atomic_int_get (&output->played_time);
+}
+
+/**
+ * Continue the playback of a daemon this one replaced: the current
+ * entry from ms on, playing or paused as status says.
+ */
+void
+xmms_output_resume (xmms_output_t *output, gint status, guint ms)
+{
+	xmms_error_t err;
+
+	g_return_if_fail (output);
+
+	if (status != XMMS_PLAYBACK_STATUS_PLAY &&
+	    status != XMMS_PLAYBACK_STATUS_PAUSE) {
+		return;
+	}
+
+	g_mutex_lock (&output->filler_mutex);
+	output->resume_ms = ms;
+	g_mutex_unlock (&output->filler_mutex);
+
+	xmms_error_reset (&err);
+	xmms_playback_client_start (output, &err);
+	if (xmms_error_iserror (&err)) {
+		xmms_log_error ("Couldn't resume playback: %s",
+		                xmms_error_message_get (&err));
+		return;
+	}
+
+	if (status == XMMS_PLAYBACK_STATUS_PAUSE) {
+		xmms_playback_client_pause (output, &err);
+	}
+
+	xmms_log_info ("Resumed playback at %u ms", ms);
+}
+
+
+/** @addtogroup Output
+ * @{
+ */
+/** Methods */
+static void
+xmms_playback_client_tickle (xmms_output_t *output, xmms_error_t *error)
+{
+	xmms_output_filler_state (output, FILLER_KILL);
+}
+
+static void
+xmms_playback_client_seek_ms (xmms_output_t *output, gint32 ms, gint32 whence, xmms_error_t *error)
+{
+	guint samples;
+
+	g_return_if_fail (output);
+
+	if (whence == XMMS_PLAYBACK_SEEK_CUR && output->format) {
+		guint32 pending;
+
+		if (xmms_output_seek_pending_get (output, &pending)) {
+			ms += (gint) xmms_sample_samples_to_ms (output->format, pending);
+		} else {
+			ms += (gint) g_atomic_int_get (&output->played_time);
+		}
+		if (ms < 0) {
+			ms = 0;
+		}
+	}
+
+	if (output->format) {
+		samples = xmms_sample_ms_to_samples (output->format, ms);
+
+		xmms_playback_client_seek_samples (output, samples,
+		                                   XMMS_PLAYBACK_SEEK_SET, error);
+	}
+}
+
+static void
+xmms_playback_client_seek_samples (xmms_output_t *output, gint32 samples, gint32 whence, xmms_error_t *error)
+{
+	if (whence == XMMS_PLAYBACK_SEEK_CUR) {
+		guint32 pending;
+
+		if (xmms_output_seek_pending_get (output, &pending)) {
+			samples += pending;
+		} else {
+			samples += (guint) g_atomic_int_get (&output->played) / xmms_sample_frame_size_get (output->format);
+		}
+		if (samples < 0) {
+			samples = 0;
+		}
+	}
+
+	/* "just" tell filler */
+	xmms_output_filler_seek_state (output, samples);
+}
+
+static void
+xmms_playback_client_start (xmms_output_t *output, xmms_error_t *err)
+{
+	g_return_if_fail (output);
+
+	xmms_output_filler_state (output, FILLER_RUN);
+	if (!xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_PLAY)) {
+		xmms_output_filler_state (output, FILLER_STOP);
+		xmms_error_set (err, XMMS_ERROR_GENERIC, "Could not start playback");
+	}
+
+}
+
+static void
+xmms_playback_client_stop (xmms_output_t *output, xmms_error_t *err)
+{
+	g_return_if_fail (output);
+
+	xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_STOP);
+
+	xmms_output_filler_state (output, FILLER_STOP);
+}
+
+static void
+xmms_playback_client_pause (xmms_output_t *output, xmms_error_t *err)
+{
+	g_return_if_fail (output);
+
+	xmms_output_status_set (output, XMMS_PLAYBACK_STATUS_PAUSE);
+}
+
+
+static gint32
+xmms_playback_client_status (xmms_output_t *output, xmms_error_t *error)
+{
+	gint32 ret;
+	g_return_val_if_fail (output, XMMS_PLAYBACK_STATUS_STOP);
+
+	g_mutex_lock (&output->status_mutex);
+	ret = output->status;
+	g_mutex_unlock (&output->status_mutex);
+	return ret;
+}
+
+static gint
+xmms_playback_client_current_id (xmms_output_t *output, xmms_error_t *error)
+{
+	return output->current_entry;
+}
+
+static void
+xmms_playback_client_volume_set (xmms_output_t *output, const gchar *channel,
+                                 gint32 volume, xmms_error_t *error)
+{
+
+	if (!output->plugin) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "couldn't set volume, output plugin not loaded");
+		return;
+	}
+
+	if (!xmms_output_plugin_method_volume_set_available (output->plugin)) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "operation not supported");
+		return;
+	}
+
+	if (volume > 100 || volume < 0) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "volume out of range");
+		return;
+	}
+
+	if (!xmms_output_plugin_methods_volume_set (output->plugin, output, channel, volume)) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "couldn't set volume");
+	} else {
+		/* have the broadcast go out now rather than on the next poll */
+		xmms_output_volume_changed (output);
+	}
+}
+
+static xmmsv_t *
+xmms_playback_client_volume_get (xmms_output_t *output, xmms_error_t *error)
+{
+	xmmsv_t *ret;
+	xmms_volume_map_t map;
+
+	if (!output->plugin) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "couldn't get volume, output plugin not loaded");
+		return NULL;
+	}
+
+	if (!xmms_output_plugin_method_volume_get_available (output->plugin)) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC,
+		                "operation not supported");
+		return NULL;
+	}
+
+	xmms_error_set (error, XMMS_ERROR_GENERIC,
+	                "couldn't get volume");
+
+	xmms_volume_map_init (&map);
+
+	/* ask the plugin how much channels it would like to set */
+	if (!xmms_output_plugin_method_volume_get (output->plugin, output,
+	                                           NULL, NULL, &map.num_channels)) {
+		return NULL;
+	}
+
+	/* check for sane values */
 	g_return_val_if_fail (map.num_channels > 0, NULL);
 	g_return_val_if_fail (map.num_channels <= VOLUME_MAX_CHANNELS, NULL);
 
-	map.names = g_new (const gchar *, map.num_channels);
-	map.values = g_new (guint, map.num_channels);
+	map.names = g_new (const gchar *, map.num_channels);
+	map.values = g_new (guint, map.num_channels);
+
+	map.status = xmms_output_plugin_method_volume_get (output->plugin, output,
+	                                                   map.names, map.values,
+	                                                   &map.num_channels);
+
+	if (!map.status || !map.num_channels) {
+		return NULL; /* error is set (-> no leak) */
+	}
+
+	ret = xmms_volume_map_to_dict (&map);
+
+	/* success! */
+	xmms_error_reset (error);
+
+	return ret;
+}
+
+/**
+ * Get the current playtime in milliseconds.
+ */
+static gint32
+xmms_playback_client_playtime (xmms_output_t *output, xmms_error_t *error)
+{
+	g_return_val_if_fail (output, 0);
+
+	return g_atomic_int_get (&output->played_time);
+}
+
+/**
+ * Get the playtime extrapolated to now, and whether it keeps going.
+ */
+static xmmsv_t *
+xmms_playback_client_playtime_stamp (xmms_output_t *output, xmms_error_t *error)
+{
+	guint ms, stamp, now;
+	gboolean playing;
+
+	g_return_val_if_fail (output, NULL);
 
-	map.status = xmms_output_plugin_method_volume_get (output->plugin, output,
-	                                                   map.names, map.values,
-	                                                   &map.num_channels);
+	g_mutex_lock (&output->status_mutex);
+	playing = output->status == XMMS_PLAYBACK_STATUS_PLAY;
+	g_mutex_unlock (&output->status_mutex);
 
-	if (!map.status || !map.num_channels) {
-		return NULL; /* error is set (-> no leak) */
+	ms = g_atomic_int_get (&output->played_time);
+	stamp = g_atomic_int_get (&output->played_stamp);
+
+	if (playing) {
+		/* at most a write behind, don't run off on a stalled writer */
+		now = (guint) (g_get_monotonic_time () / 1000);
+		ms += MIN (now - stamp, LATENCY_INTERVAL_MS * 10);
+	}
+
+	return xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("playtime", ms),
+	                         XMMSV_DICT_ENTRY_INT ("playing", playing),
+	                         XMMSV_DICT_ENTRY_INT ("clock", g_get_monotonic_time ()),
+	                         XMMSV_DICT_END);
+}
+
+/**
+ * The clock scheduled starts are given in, monotonic microseconds.
+ * An NTP style exchange gives its offset to another host's clock.
+ */
+static gint64
+xmms_playback_client_clock (xmms_output_t *output, xmms_error_t *error)
+{
+	return g_get_monotonic_time ();
+}
+
+/**
+ * Start playback when the clock reaches sec * 10^6 + usec. The
+ * filler starts right away, so the buffer is full by then.
+ */
+static void
+xmms_playback_client_start_at (xmms_output_t *output, gint32 sec, gint32 usec,
+                               xmms_error_t *error)
+{
+	gint64 at;
+
+	g_return_if_fail (output);
+
+	at = (gint64) sec * G_USEC_PER_SEC + usec;
+	if (at <= g_get_monotonic_time ()) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Start time has passed");
+		return;
+	}
+
+	g_mutex_lock (&output->status_mutex);
+	if (output->status == XMMS_PLAYBACK_STATUS_PLAY) {
+		g_mutex_unlock (&output->status_mutex);
+		xmms_error_set (error, XMMS_ERROR_GENERIC, "Already playing");
+		return;
+	}
+	output->start_at = at;
+	g_atomic_int_set (&output->start_pending, 1);
+	g_mutex_unlock (&output->status_mutex);
+
+	xmms_playback_client_start (output, error);
+	if (xmms_error_iserror (error)) {
+		g_atomic_int_set (&output->start_pending, 0);
+	}
+}
+
+/**
+ * Play faster (positive) or slower by ppm parts per million, so that
+ * the playtime keeps up with a clock other than the soundcard's.
+ */
+static void
+xmms_playback_client_drift_set (xmms_output_t *output, gint32 ppm,
+                                xmms_error_t *error)
+{
+	g_return_if_fail (output);
+
+	if (ppm < -DRIFT_MAX_PPM || ppm > DRIFT_MAX_PPM) {
+		xmms_error_set (error, XMMS_ERROR_INVAL, "Drift out of range");
+		return;
+	}
+
+	g_atomic_int_set (&output->drift_ppm, ppm);
+}
+
+static xmmsv_t *
+xmms_playback_client_health (xmms_output_t *output, xmms_error_t *error)
+{
+	return xmms_output_health_get (output);
+}
+
+/**
+ * How each xform of the chain being decoded has been doing, see
+ * #xmms_xform_chain_stats.
+ */
+static xmmsv_t *
+xmms_playback_client_chain_stats (xmms_output_t *output, xmms_error_t *error)
+{
+	xmms_xform_t *chain;
+	xmmsv_t *ret;
+
+	g_return_val_if_fail (output, NULL);
+
+	g_mutex_lock (&output->filler_mutex);
+	chain = output->filler_chain;
+	if (chain) {
+		xmms_object_ref (chain);
+	}
+	g_mutex_unlock (&output->filler_mutex);
+
+	if (!chain) {
+		return xmmsv_new_list ();
+	}
+
+	ret = xmms_xform_chain_stats (chain);
+	xmms_object_unref (chain);
+
+	return ret;
+}
+
+/* returns the current latency: time left in ms until the data currently read
+ *                              from the latest xform in the chain will actually be played
+ */
+guint32
+xmms_output_latency (xmms_output_t *output)
+{
+	guint ret = 0;
+	guint buffersize = 0;
+
+	if (output->format) {
+		/* data already waiting in the ringbuffer */
+		buffersize += xmms_ringbuf_bytes_used (output->filler_buffer);
+
+		/* latency of the soundcard */
+		buffersize += xmms_output_plugin_method_latency_get (output->plugin, output);
+
+		ret = xmms_sample_bytes_to_ms (output->format, buffersize);
+	}
+
+	return ret;
+}
+
+/**
+ * @internal
+ */
+
+static gboolean
+xmms_output_status_set (xmms_output_t *output, gint status)
+{
+	gboolean ret = TRUE;
+
+	if (!output->plugin) {
+		XMMS_DBG ("No plugin to set status on..");
+		return FALSE;
+	}
+
+	g_mutex_lock (&output->status_mutex);
+
+	if (output->tee_parent && output->status != status) {
+		/* new data only comes after the next song change, and a
+		 * writer blocked on an empty buffer has to notice the stop */
+		g_mutex_lock (&output->filler_mutex);
+		if (status == XMMS_PLAYBACK_STATUS_STOP) {
+			xmms_ringbuf_clear (output->filler_buffer);
+		}
+		xmms_ringbuf_set_eos (output->filler_buffer,
+		                      status == XMMS_PLAYBACK_STATUS_STOP);
+		g_mutex_unlock (&output->filler_mutex);
+	}
+
+	if (output->status != status) {
+		if (status == XMMS_PLAYBACK_STATUS_PAUSE &&
+		    output->status != XMMS_PLAYBACK_STATUS_PLAY) {
+			XMMS_DBG ("Can only pause from play.");
+			ret = FALSE;
+		} else {
+			if (status == XMMS_PLAYBACK_STATUS_PLAY &&
+			    output->status == XMMS_PLAYBACK_STATUS_STOP) {
+				g_atomic_int_set (&output->prefill_pending,
+				                  g_atomic_int_get (&output->prefill));
+			}
+
+			output->status = status;
+
+			/* the writer stays away while not playing */
+			g_mutex_lock (&output->health_mutex);
+			output->write_last = 0;
+			g_mutex_unlock (&output->health_mutex);
+
+			/* stopping or pausing calls off a scheduled start */
+			if (status != XMMS_PLAYBACK_STATUS_PLAY) {
+				g_atomic_int_set (&output->start_pending, 0);
+			}
+
+			if (status == XMMS_PLAYBACK_STATUS_STOP) {
+				xmms_object_unref (output->format);
+				output->format = NULL;
+				xmms_output_format_pending_clear (output);
+			}
+			if (!xmms_output_plugin_method_status (output->plugin, output, status)) {
+				xmms_log_error ("Status method returned an error!");
+				output->status = XMMS_PLAYBACK_STATUS_STOP;
+				ret = FALSE;
+			}
+
+			if (!output->tee_parent) {
+				xmms_output_sinks_status_set (output, output->status);
+				xmms_object_emit (XMMS_OBJECT (output),
+				                  XMMS_IPC_SIGNAL_PLAYBACK_STATUS,
+				                  xmmsv_new_int (output->status));
+			}
+		}
+	}
+
+	g_mutex_unlock (&output->status_mutex);
+
+	/* nothing is decoded until playback goes on */
+	if (ret && status != XMMS_PLAYBACK_STATUS_PLAY && !output->tee_parent) {
+		xmms_footprint_trim ();
+	}
+
+	return ret;
+}
+
+static void
+xmms_output_destroy (xmms_object_t *object)
+{
+	xmms_output_t *output = (xmms_output_t *)object;
+
+	XMMS_DBG ("Deactivating output object.");
+
+	if (output->health_timeout) {
+		g_source_remove (output->health_timeout);
+	}
+	xmms_config_property_callback_remove (xmms_config_lookup ("output.health_interval"),
+	                                      on_health_interval_changed, output);
+
+	xmms_output_sinks_clear (output);
+	xmms_output_monitor_volume_stop (output);
+	xmms_output_pull_stop (output);
+
+	xmms_output_filler_state (output, FILLER_QUIT);
+	g_thread_join (output->filler_thread);
+
+	xmms_object_disconnect (XMMS_OBJECT (output->playlist),
+	                        XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
+	                        on_playlist_changed, output);
+	xmms_object_disconnect (XMMS_OBJECT (output->playlist),
+	                        XMMS_IPC_SIGNAL_PLAYLIST_CURRENT_POS,
+	                        on_playlist_changed, output);
+
+	g_mutex_lock (&output->preload_mutex);
+	output->preload_running = FALSE;
+	g_cond_signal (&output->preload_cond);
+	g_mutex_unlock (&output->preload_mutex);
+	if (output->preload_thread) {
+		g_thread_join (output->preload_thread);
+	}
+	xmms_output_preload_invalidate (output, FALSE);
+
+	if (output->plugin) {
+		xmms_output_plugin_method_destroy (output->plugin, output);
+		xmms_object_unref (output->plugin);
+	}
+	xmms_output_format_list_clear (output);
+	xmms_output_format_pending_clear (output);
+
+	xmms_object_unref (output->playlist);
+	xmms_object_unref (output->medialib);
+
+	g_mutex_clear (&output->status_mutex);
+	g_mutex_clear (&output->monitor_volume_mutex);
+	g_cond_clear (&output->monitor_volume_cond);
+	g_mutex_clear (&output->filler_mutex);
+	g_cond_clear (&output->filler_state_cond);
+	g_mutex_clear (&output->preload_mutex);
+	g_cond_clear (&output->preload_cond);
+	g_mutex_clear (&output->sinks_mutex);
+	g_mutex_clear (&output->health_mutex);
+	g_mutex_clear (&output->pull_mutex);
+	g_cond_clear (&output->pull_cond);
+	xmms_ringbuf_destroy (output->filler_buffer);
+	if (output->realtime) {
+		xmms_realtime_mem_unlock (output->filler_buf, output->filler_buf_size);
+	}
+	g_free (output->filler_buf);
+	xmms_output_crossfade_clear (output);
+	xmms_xform_fifo_free (output->xfade_tail);
+	xmms_xform_fifo_free (output->xfade_out);
+	g_free (output->xfade_buf);
+
+	xmms_playback_unregister_ipc_commands ();
+}
+
+/**
+ * @internal Switch plugins without stopping playback. The chain and
+ * the buffer are kept, and what the old device held but didn't play
+ * yet is played again by the new one from the buffer's history.
+ *
+ * @param ret set to whether the new plugin is in use
+ * @returns FALSE if nothing is playing, the plugin has not been
+ * switched then
+ */
+static gboolean
+xmms_output_hot_swap (xmms_output_t *output, xmms_output_plugin_t *new_plugin,
+                      gboolean *ret)
+{
+	xmms_output_plugin_t *old_plugin;
+	xmms_stream_type_t *fmt, *to;
+	guint played, latency, rewind, frame;
+	gboolean supported;
+	gint64 started;
+
+	g_mutex_lock (&output->status_mutex);
+
+	fmt = output->format;
+	if (output->status == XMMS_PLAYBACK_STATUS_STOP || !fmt || !output->plugin) {
+		g_mutex_unlock (&output->status_mutex);
+		return FALSE;
+	}
+
+	started = g_get_monotonic_time ();
+	xmms_object_ref (fmt);
+	old_plugin = output->plugin;
+
+	/* drop what the device holds instead of waiting for it to drain */
+	played = g_atomic_int_get (&output->played);
+	latency = xmms_output_plugin_method_latency_get (old_plugin, output);
+	xmms_output_plugin_method_status (old_plugin, output, XMMS_PLAYBACK_STATUS_STOP);
+	xmms_output_plugin_method_flush (old_plugin, output);
+
+	*ret = set_plugin (output, new_plugin);
+	if (*ret) {
+		xmms_object_unref (old_plugin);
+	} else {
+		XMMS_DBG ("cannot switch plugin, going back to old one");
+		set_plugin (output, old_plugin);
+	}
+
+	/* the writer is gone now. Whatever it read since the latency was
+	 * asked for didn't make it out either, but nothing from before
+	 * the current song may be played again */
+	frame = xmms_sample_frame_size_get (fmt);
+	rewind = latency + (g_atomic_int_get (&output->played) - played);
+	rewind = MIN (rewind, g_atomic_int_get (&output->played));
+	rewind = MIN (rewind, xmms_ringbuf_history (output->filler_buffer));
+	rewind -= rewind % frame;
+	if (rewind && xmms_ringbuf_rewind (output->filler_buffer, rewind)) {
+		g_atomic_int_add (&output->played, -(gint) rewind);
+	}
+	output->latency_stamp = 0;
+
+	to = xmms_stream_type_coerce (fmt, output->format_list);
+	supported = output->plugin && to && xmms_stream_type_match (fmt, to);
+	if (to) {
+		xmms_object_unref (to);
+	}
+
+	xmms_object_unref (output->format);
+	output->format = NULL;
+
+	if (!supported) {
+		/* the chain has to be set up for the new formats */
+		xmms_log_info ("Output plugin can't play the current format, stopping playback");
+		xmms_object_unref (fmt);
+		g_mutex_unlock (&output->status_mutex);
+		xmms_playback_client_stop (output, NULL);
+		return TRUE;
+	}
+
+	/* the reader sets it before going on */
+	xmms_output_format_pending_clear (output);
+	g_atomic_pointer_set (&output->format_pending, fmt);
+
+	if (output->status == XMMS_PLAYBACK_STATUS_PLAY &&
+	    !xmms_output_plugin_method_status (output->plugin, output,
+	                                       XMMS_PLAYBACK_STATUS_PLAY)) {
+		xmms_log_error ("Status method returned an error!");
+	}
+
+	XMMS_DBG ("Switched output plugin in %" G_GINT64_FORMAT " ms, %u bytes again",
+	          (g_get_monotonic_time () - started) / 1000, rewind);
+
+	g_mutex_unlock (&output->status_mutex);
+
+	return TRUE;
+}
+
+/**
+ * Switch to another output plugin.
+ * @param output output pointer
+ * @param new_plugin the new #xmms_plugin_t to use as output.
+ * @returns TRUE on success and FALSE on failure
+ */
+gboolean
+xmms_output_plugin_switch (xmms_output_t *output, xmms_output_plugin_t *new_plugin)
+{
+	xmms_output_plugin_t *old_plugin;
+	xmms_config_property_t *prop;
+	gboolean ret, resinks;
+
+	g_return_val_if_fail (output, FALSE);
+	g_return_val_if_fail (new_plugin, FALSE);
+
+	/* the plugin can drive only one of them */
+	resinks = xmms_output_sinks_uses (output, new_plugin);
+	if (resinks) {
+		xmms_output_sinks_clear (output);
+	}
+
+	prop = xmms_config_lookup ("output.hot_swap");
+	if (xmms_config_property_get_int (prop) &&
+	    xmms_output_hot_swap (output, new_plugin, &ret)) {
+		if (resinks) {
+			xmms_output_sinks_rebuild (output);
+		}
+		return ret;
+	}
+
+	xmms_playback_client_stop (output, NULL);
+
+	g_mutex_lock (&output->status_mutex);
+
+	old_plugin = output->plugin;
+
+	ret = set_plugin (output, new_plugin);
+
+	/* if the switch succeeded, release the reference to the old plugin
+	 * now.
+	 * if we couldn't switch to the new plugin, but we had a working
+	 * plugin before, switch back to the old plugin.
+	 */
+	if (ret) {
+		xmms_object_unref (old_plugin);
+	} else if (old_plugin) {
+		XMMS_DBG ("cannot switch plugin, going back to old one");
+		set_plugin (output, old_plugin);
 	}
 
-	ret = xmms_volume_map_to_dict (&map);
+	g_mutex_unlock (&output->status_mutex);
 
-	/* success! */
-	xmms_error_reset (error);
+	if (resinks) {
+		xmms_output_sinks_rebuild (output);
+	}
 
 	return ret;
 }
 
 /**
- * Get the current playtime in milliseconds.
+ * @internal Change of the format a sink gets from its parent, runs
+ * in the sink's writer.
  */
-static gint32
-xmms_playback_client_playtime (xmms_output_t *output, xmms_error_t *error)
+typedef struct {
+	xmms_output_t *sink;
+	xmms_stream_type_t *type;
+} xmms_output_sink_format_arg_t;
+
+static void
+sink_format_arg_free (void *data)
 {
-	guint32 ret;
-	g_return_val_if_fail (output, 0);
+	xmms_output_sink_format_arg_t *arg = data;
 
-	g_mutex_lock (&output->playtime_mutex);
-	ret = output->played_time;
-	g_mutex_unlock (&output->playtime_mutex);
+	xmms_object_unref (arg->type);
+	g_free (arg);
+}
 
-	return ret;
+static gboolean
+sink_format_changed (void *data)
+{
+	xmms_output_sink_format_arg_t *arg = data;
+
+	if (!xmms_output_format_set (arg->sink, arg->type)) {
+		xmms_log_error ("Output plugin %s refused the format, not teeing to it",
+		                xmms_plugin_shortname_get ((xmms_plugin_t *) arg->sink->plugin));
+		g_atomic_int_set (&arg->sink->tee_active, FALSE);
+		xmms_ringbuf_set_eos (arg->sink->filler_buffer, TRUE);
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
-/* returns the current latency: time left in ms until the data currently read
- *                              from the latest xform in the chain will actually be played
+/* called with the sink's filler_mutex */
+static void
+xmms_output_sink_format_hotspot (xmms_output_t *sink)
+{
+	xmms_output_sink_format_arg_t *arg;
+
+	arg = g_new0 (xmms_output_sink_format_arg_t, 1);
+	arg->sink = sink;
+	arg->type = sink->tee_to;
+	xmms_object_ref (arg->type);
+
+	xmms_ringbuf_hotspot_set (sink->filler_buffer, sink_format_changed,
+	                          sink_format_arg_free, arg);
+}
+
+static void
+xmms_output_sink_conv_clear (xmms_output_t *sink)
+{
+	if (sink->tee_conv) {
+		xmms_object_unref (sink->tee_conv);
+		sink->tee_conv = NULL;
+	}
+	if (sink->tee_from) {
+		xmms_object_unref (sink->tee_from);
+		sink->tee_from = NULL;
+	}
+	if (sink->tee_to) {
+		xmms_object_unref (sink->tee_to);
+		sink->tee_to = NULL;
+	}
+}
+
+/**
+ * @internal Prepare a sink for the stream type its parent is about
+ * to play, converting to something the sink's plugin supports.
  */
-guint32
-xmms_output_latency (xmms_output_t *output)
+static void
+xmms_output_sink_format_set (xmms_output_t *sink, xmms_stream_type_t *type)
 {
-	guint ret = 0;
-	guint buffersize = 0;
+	xmms_stream_type_t *to;
 
-	if (output->format) {
-		/* data already waiting in the ringbuffer */
-		buffersize += xmms_ringbuf_bytes_used (output->filler_buffer);
+	if (sink->tee_from && xmms_stream_type_match (sink->tee_from, type)) {
+		if (sink->tee_conv) {
+			xmms_sample_convert_reset (sink->tee_conv);
+		}
+	} else {
+		g_atomic_int_set (&sink->tee_active, FALSE);
+		xmms_output_sink_conv_clear (sink);
+
+		to = xmms_stream_type_coerce (type, sink->format_list);
+		if (!to) {
+			xmms_log_error ("Output plugin %s can't play the current format",
+			                xmms_plugin_shortname_get ((xmms_plugin_t *) sink->plugin));
+			return;
+		}
 
-		/* latency of the soundcard */
-		buffersize += xmms_output_plugin_method_latency_get (output->plugin, output);
+		if (!xmms_stream_type_match (type, to)) {
+			sink->tee_conv = xmms_sample_converter_init (type, to,
+			                                             XMMS_SAMPLE_RESAMPLE_MEDIUM);
+			if (!sink->tee_conv) {
+				xmms_object_unref (to);
+				return;
+			}
+		}
 
-		ret = xmms_sample_bytes_to_ms (output->format, buffersize);
+		xmms_object_ref (type);
+		sink->tee_from = type;
+		sink->tee_to = to;
 	}
 
-	return ret;
+	/* the sink's own format is set again even when unchanged, it
+	 * forgets it when stopped */
+	g_mutex_lock (&sink->filler_mutex);
+	xmms_output_sink_format_hotspot (sink);
+	g_mutex_unlock (&sink->filler_mutex);
+
+	g_atomic_int_set (&sink->tee_active, TRUE);
+}
+
+static void
+xmms_output_sinks_format_set (xmms_output_t *output, xmms_stream_type_t *type)
+{
+	GList *n;
+
+	g_mutex_lock (&output->sinks_mutex);
+	for (n = output->sinks; n; n = g_list_next (n)) {
+		xmms_output_sink_format_set (n->data, type);
+	}
+	g_mutex_unlock (&output->sinks_mutex);
 }
 
 /**
- * @internal
+ * @internal Hand what the writer just read on to the sinks. A sink
+ * that can't keep up loses data instead of holding up the others.
  */
-
-static gboolean
-xmms_output_status_set (xmms_output_t *output, gint status)
+static void
+xmms_output_sinks_feed (xmms_output_t *output, gchar *buffer, gint len)
 {
-	gboolean ret = TRUE;
+	xmms_output_t *sink;
+	xmms_sample_t *data;
+	guint size;
+	GList *n;
 
-	if (!output->plugin) {
-		XMMS_DBG ("No plugin to set status on..");
-		return FALSE;
+	if (len <= 0) {
+		return;
 	}
 
-	g_mutex_lock (&output->status_mutex);
+	g_mutex_lock (&output->sinks_mutex);
+	for (n = output->sinks; n; n = g_list_next (n)) {
+		sink = n->data;
 
-	if (output->status != status) {
-		if (status == XMMS_PLAYBACK_STATUS_PAUSE &&
-		    output->status != XMMS_PLAYBACK_STATUS_PLAY) {
-			XMMS_DBG ("Can only pause from play.");
-			ret = FALSE;
-		} else {
-			output->status = status;
+		if (!g_atomic_int_get (&sink->tee_active)) {
+			continue;
+		}
 
-			if (status == XMMS_PLAYBACK_STATUS_STOP) {
-				xmms_object_unref (output->format);
-				output->format = NULL;
-			}
-			if (!xmms_output_plugin_method_status (output->plugin, output, status)) {
-				xmms_log_error ("Status method returned an error!");
-				output->status = XMMS_PLAYBACK_STATUS_STOP;
-				ret = FALSE;
-			}
+		data = buffer;
+		size = len;
+		if (sink->tee_conv) {
+			xmms_sample_convert (sink->tee_conv, buffer, len, &data, &size);
+		}
+		if (!size) {
+			continue;
+		}
 
-			xmms_object_emit (XMMS_OBJECT (output),
-			                  XMMS_IPC_SIGNAL_PLAYBACK_STATUS,
-			                  xmmsv_new_int (output->status));
+		g_mutex_lock (&sink->filler_mutex);
+		if (xmms_ringbuf_bytes_free (sink->filler_buffer) < size) {
+			if (!(sink->tee_dropped++ % 100)) {
+				XMMS_DBG ("Output %s is falling behind, dropped %u blocks",
+				          xmms_plugin_shortname_get ((xmms_plugin_t *) sink->plugin),
+				          sink->tee_dropped);
+			}
+		} else {
+			xmms_ringbuf_write (sink->filler_buffer, data, size);
 		}
+		g_mutex_unlock (&sink->filler_mutex);
 	}
+	g_mutex_unlock (&output->sinks_mutex);
+}
 
-	g_mutex_unlock (&output->status_mutex);
+/* called with the parent's status_mutex */
+static void
+xmms_output_sinks_status_set (xmms_output_t *output, gint status)
+{
+	GList *n;
 
-	return ret;
+	g_mutex_lock (&output->sinks_mutex);
+	for (n = output->sinks; n; n = g_list_next (n)) {
+		xmms_output_status_set (n->data, status);
+	}
+	g_mutex_unlock (&output->sinks_mutex);
 }
 
+/* runs in the parent's writer, like the feeding */
 static void
-xmms_output_destroy (xmms_object_t *object)
+xmms_output_sinks_flush (xmms_output_t *output)
 {
-	xmms_output_t *output = (xmms_output_t *)object;
+	xmms_output_t *sink;
+	GList *n;
+
+	g_mutex_lock (&output->sinks_mutex);
+	for (n = output->sinks; n; n = g_list_next (n)) {
+		sink = n->data;
+
+		g_mutex_lock (&sink->filler_mutex);
+		xmms_ringbuf_clear (sink->filler_buffer);
+		/* clearing also dropped a pending format change */
+		if (sink->tee_to) {
+			xmms_output_sink_format_hotspot (sink);
+		}
+		g_mutex_unlock (&sink->filler_mutex);
 
-	XMMS_DBG ("Deactivating output object.");
+		xmms_output_plugin_method_flush (sink->plugin, sink);
+	}
+	g_mutex_unlock (&output->sinks_mutex);
+}
 
-	output->monitor_volume_running = FALSE;
-	if (output->monitor_volume_thread) {
-		g_thread_join (output->monitor_volume_thread);
-		output->monitor_volume_thread = NULL;
+static void
+xmms_output_sink_destroy (xmms_object_t *object)
+{
+	xmms_output_t *sink = (xmms_output_t *) object;
+
+	if (sink->plugin) {
+		xmms_output_status_set (sink, XMMS_PLAYBACK_STATUS_STOP);
+		xmms_output_pull_stop (sink);
+		xmms_output_plugin_method_destroy (sink->plugin, sink);
+		xmms_object_unref (sink->plugin);
 	}
+	xmms_output_format_list_clear (sink);
+	xmms_output_sink_conv_clear (sink);
+
+	g_mutex_clear (&sink->status_mutex);
+	g_mutex_clear (&sink->monitor_volume_mutex);
+	g_cond_clear (&sink->monitor_volume_cond);
+	g_mutex_clear (&sink->pull_mutex);
+	g_cond_clear (&sink->pull_cond);
+	g_mutex_clear (&sink->filler_mutex);
+	g_mutex_clear (&sink->health_mutex);
+	xmms_ringbuf_destroy (sink->filler_buffer);
+}
 
-	xmms_output_filler_state (output, FILLER_QUIT);
-	g_thread_join (output->filler_thread);
+/**
+ * @internal Create an output playing what output plays, through
+ * plugin. Takes over the reference to plugin.
+ */
+static xmms_output_t *
+xmms_output_sink_new (xmms_output_t *output, xmms_output_plugin_t *plugin)
+{
+	xmms_output_t *sink;
+
+	sink = xmms_object_new (xmms_output_t, xmms_output_sink_destroy);
+	sink->tee_parent = output;
+
+	g_mutex_init (&sink->status_mutex);
+	g_mutex_init (&sink->monitor_volume_mutex);
+	g_cond_init (&sink->monitor_volume_cond);
+	g_mutex_init (&sink->pull_mutex);
+	g_cond_init (&sink->pull_cond);
+	g_mutex_init (&sink->filler_mutex);
+	g_mutex_init (&sink->health_mutex);
+
+	sink->filler_buffer = xmms_ringbuf_new (xmms_ringbuf_size (output->filler_buffer));
+	xmms_ringbuf_set_eos (sink->filler_buffer, TRUE);
+	sink->status = XMMS_PLAYBACK_STATUS_STOP;
+
+	if (!set_plugin (sink, plugin)) {
+		xmms_log_error ("Could not initialize output plugin %s for teeing",
+		                xmms_plugin_shortname_get ((xmms_plugin_t *) plugin));
+		xmms_object_unref (plugin);
+		xmms_object_unref (sink);
+		return NULL;
+	}
 
-	if (output->plugin) {
-		xmms_output_plugin_method_destroy (output->plugin, output);
-		xmms_object_unref (output->plugin);
+	return sink;
+}
+
+static gboolean
+xmms_output_sinks_uses (xmms_output_t *output, xmms_output_plugin_t *plugin)
+{
+	gboolean ret = FALSE;
+	GList *n;
+
+	g_mutex_lock (&output->sinks_mutex);
+	for (n = output->sinks; n && !ret; n = g_list_next (n)) {
+		ret = ((xmms_output_t *) n->data)->plugin == plugin;
 	}
-	xmms_output_format_list_clear (output);
+	g_mutex_unlock (&output->sinks_mutex);
 
-	xmms_object_unref (output->playlist);
-	xmms_object_unref (output->medialib);
+	return ret;
+}
 
-	g_mutex_clear (&output->status_mutex);
-	g_mutex_clear (&output->playtime_mutex);
-	g_mutex_clear (&output->filler_mutex);
-	g_cond_clear (&output->filler_state_cond);
-	xmms_ringbuf_destroy (output->filler_buffer);
+static void
+xmms_output_sinks_clear (xmms_output_t *output)
+{
+	GList *sinks, *n;
 
-	xmms_playback_unregister_ipc_commands ();
+	g_mutex_lock (&output->sinks_mutex);
+	sinks = output->sinks;
+	output->sinks = NULL;
+	g_mutex_unlock (&output->sinks_mutex);
+
+	for (n = sinks; n; n = g_list_next (n)) {
+		xmms_object_unref (n->data);
+	}
+	g_list_free (sinks);
 }
 
 /**
- * Switch to another output plugin.
- * @param output output pointer
- * @param new_plugin the new #xmms_plugin_t to use as output.
- * @returns TRUE on success and FALSE on failure
+ * @internal Set up the sinks listed in output.tee. They start
+ * playing with the next song.
  */
-gboolean
-xmms_output_plugin_switch (xmms_output_t *output, xmms_output_plugin_t *new_plugin)
+static void
+xmms_output_sinks_rebuild (xmms_output_t *output)
 {
-	xmms_output_plugin_t *old_plugin;
-	gboolean ret;
+	xmms_config_property_t *prop;
+	xmms_output_plugin_t *plugin;
+	xmms_output_t *sink;
+	GList *sinks = NULL, *n;
+	gchar **names;
+	gint i;
 
-	g_return_val_if_fail (output, FALSE);
-	g_return_val_if_fail (new_plugin, FALSE);
+	/* a plugin keeps the state of one writer, the old sinks have
+	 * to let go of theirs before they can be reused */
+	xmms_output_sinks_clear (output);
 
-	xmms_playback_client_stop (output, NULL);
+	prop = xmms_config_lookup ("output.tee");
+	names = g_strsplit (xmms_config_property_get_string (prop), ",", 0);
 
-	g_mutex_lock (&output->status_mutex);
+	for (i = 0; names[i]; i++) {
+		g_strstrip (names[i]);
+		if (!*names[i]) {
+			continue;
+		}
 
-	old_plugin = output->plugin;
+		plugin = (xmms_output_plugin_t *) xmms_plugin_find (XMMS_PLUGIN_TYPE_OUTPUT, names[i]);
+		if (!plugin) {
+			xmms_log_error ("No output plugin named '%s' to tee to", names[i]);
+			continue;
+		}
 
-	ret = set_plugin (output, new_plugin);
+		for (n = sinks; n; n = g_list_next (n)) {
+			if (((xmms_output_t *) n->data)->plugin == plugin) {
+				break;
+			}
+		}
+		if (plugin == output->plugin || n) {
+			xmms_log_error ("Output plugin %s is already in use, not teeing to it",
+			                names[i]);
+			xmms_object_unref (plugin);
+			continue;
+		}
 
-	/* if the switch succeeded, release the reference to the old plugin
-	 * now.
-	 * if we couldn't switch to the new plugin, but we had a working
-	 * plugin before, switch back to the old plugin.
-	 */
-	if (ret) {
-		xmms_object_unref (old_plugin);
-	} else if (old_plugin) {
-		XMMS_DBG ("cannot switch plugin, going back to old one");
-		set_plugin (output, old_plugin);
+		sink = xmms_output_sink_new (output, plugin);
+		if (sink) {
+			XMMS_DBG ("Teeing output to %s", names[i]);
+			sinks = g_list_append (sinks, sink);
+		}
 	}
 
+	g_strfreev (names);
+
+	/* join in if already playing, the data follows the next song */
+	g_mutex_lock (&output->status_mutex);
+	g_mutex_lock (&output->sinks_mutex);
+	output->sinks = sinks;
+	g_mutex_unlock (&output->sinks_mutex);
+	xmms_output_sinks_status_set (output, output->status);
 	g_mutex_unlock (&output->status_mutex);
+}
 
-	return ret;
+static void
+on_tee_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	xmms_output_sinks_rebuild ((xmms_output_t *) udata);
 }
 
 /**
@@ -936,7 +3331,7 @@ xmms_output_new (xmms_output_plugin_t *plugin, xmms_playlist_t *playlist, xmms_m
 {
 	xmms_output_t *output;
 	xmms_config_property_t *prop;
-	gint size;
+	gint size, cap;
 
 	g_return_val_if_fail (playlist, NULL);
 
@@ -951,20 +3346,83 @@ xmms_output_new (xmms_output_plugin_t *plugin, xmms_playlist_t *playlist, xmms_m
 	output->medialib = medialib;
 
 	g_mutex_init (&output->status_mutex);
-	g_mutex_init (&output->playtime_mutex);
+	g_mutex_init (&output->monitor_volume_mutex);
+	g_cond_init (&output->monitor_volume_cond);
+	g_mutex_init (&output->pull_mutex);
+	g_cond_init (&output->pull_cond);
 
 	prop = xmms_config_property_register ("output.buffersize", "32768", NULL, NULL);
 	size = xmms_config_property_get_int (prop);
+	cap = xmms_footprint_limit (XMMS_FOOTPRINT_RINGBUFFER);
+	if (cap) {
+		size = MAX (MIN (size, cap), FILLER_BLOCK_MIN * 2);
+	}
 	XMMS_DBG ("Using buffersize %d", size);
 
+	/* if buffer_ms is set it takes precedence over buffersize, the
+	 * buffer is then resized to match each new stream format */
+	xmms_config_property_register ("output.buffer_ms", "0", NULL, NULL);
+	xmms_config_property_register ("output.buffer_min", "16384", NULL, NULL);
+	xmms_config_property_register ("output.buffer_max", "4194304", NULL, NULL);
+	xmms_config_property_register ("output.prefill_ms", "0", NULL, NULL);
+	xmms_config_property_register ("output.hot_swap", "1", NULL, NULL);
+	xmms_config_property_register ("output.swap_history_ms", "250", NULL, NULL);
+
+	/* mix the end of each entry into the start of the next, and
+	 * drop the silence around them first, as far as the loudness
+	 * analysis measured it or else the digital silence */
+	xmms_config_property_register ("output.crossfade_ms", "0", NULL, NULL);
+	xmms_config_property_register ("output.crossfade_trim", "0", NULL, NULL);
+
+	/* seeks closer together than this are merged into the last one */
+	xmms_config_property_register ("output.scrub_ms", "0", NULL, NULL);
+
+	/* only read when the playback threads start */
+	prop = xmms_config_property_register ("output.realtime", "0", NULL, NULL);
+	output->realtime = !!xmms_config_property_get_int (prop);
+	xmms_config_property_register ("output.realtime_priority", "10", NULL, NULL);
+
+	g_mutex_init (&output->preload_mutex);
+	g_cond_init (&output->preload_cond);
+	prop = xmms_config_property_register ("output.preload_next", "0",
+	                                      on_preload_enabled_changed, output);
+	output->preload_enabled = !!xmms_config_property_get_int (prop);
+	if (output->preload_enabled) {
+		xmms_output_preload_start (output);
+	}
+
+	xmms_object_connect (XMMS_OBJECT (playlist),
+	                     XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
+	                     on_playlist_changed, output);
+	xmms_object_connect (XMMS_OBJECT (playlist),
+	                     XMMS_IPC_SIGNAL_PLAYLIST_CURRENT_POS,
+	                     on_playlist_changed, output);
+
 	g_mutex_init (&output->filler_mutex);
 	output->filler_state = FILLER_STOP;
 	g_cond_init (&output->filler_state_cond);
 	output->filler_buffer = xmms_ringbuf_new (size);
+	if (output->realtime) {
+		output->realtime = xmms_ringbuf_set_locked (output->filler_buffer, TRUE);
+	}
+	output->filler_block = FILLER_BLOCK_MIN;
+	output->filler_block_base = FILLER_BLOCK_MIN;
+	output->filler_block_max = FILLER_BLOCK_MIN;
+	output->filler_buf = g_malloc (FILLER_BLOCK_MIN);
+	output->filler_buf_size = FILLER_BLOCK_MIN;
+	output->xfade_tail = xmms_xform_fifo_new ();
+	output->xfade_out = xmms_xform_fifo_new ();
+	output->fill_min = G_MAXINT;
+	g_mutex_init (&output->health_mutex);
 	output->filler_thread = g_thread_new ("x2 out filler", xmms_output_filler, output);
 
 	xmms_config_property_register ("output.flush_on_pause", "1", NULL, NULL);
 
+	/* seconds between health broadcasts while playing, 0 for none */
+	prop = xmms_config_property_register ("output.health_interval", "10",
+	                                      on_health_interval_changed, output);
+	on_health_interval_changed (XMMS_OBJECT (prop), NULL, output);
+
 	xmms_playback_register_ipc_commands (XMMS_OBJECT (output));
 
 	output->status = XMMS_PLAYBACK_STATUS_STOP;
@@ -977,11 +3435,50 @@ xmms_output_new (xmms_output_plugin_t *plugin, xmms_playlist_t *playlist, xmms_m
 		xmms_log_error ("initialized output without a plugin, please fix!");
 	}
 
+	/* comma separated output plugins to play through as well */
+	g_mutex_init (&output->sinks_mutex);
+	xmms_config_property_register ("output.tee", "", on_tee_changed, output);
+	xmms_output_sinks_rebuild (output);
 
 
 	return output;
 }
 
+/**
+ * Give the calling playback thread real-time priority if
+ * output.realtime is set, so medialib and collection work can't
+ * starve it.
+ */
+void
+xmms_output_realtime_thread_enter (void)
+{
+	xmms_config_property_t *prop;
+	gint priority;
+
+	prop = xmms_config_lookup ("output.realtime");
+	if (!prop || !xmms_config_property_get_int (prop)) {
+		return;
+	}
+
+	prop = xmms_config_lookup ("output.realtime_priority");
+	priority = xmms_config_property_get_int (prop);
+
+	if (xmms_realtime_thread_enable (priority)) {
+		XMMS_DBG ("Running with real-time priority %d", priority);
+	}
+}
+
+/**
+ * The size of the blocks the filler currently reads from the chain.
+ */
+guint
+xmms_output_filler_block_get (xmms_output_t *output)
+{
+	g_return_val_if_fail (output, 0);
+
+	return g_atomic_int_get (&output->filler_block);
+}
+
 /**
  * Flush the buffers in soundcard.
  */
@@ -991,6 +3488,7 @@ xmms_output_flush (xmms_output_t *output)
 	g_return_if_fail (output);
 
 	xmms_output_plugin_method_flush (output->plugin, output);
+	xmms_output_sinks_flush (output);
 }
 
 /**
@@ -1044,11 +3542,8 @@ set_plugin (xmms_output_t *output, xmms_output_plugin_t *plugin)
 	g_assert (output);
 	g_assert (plugin);
 
-	output->monitor_volume_running = FALSE;
-	if (output->monitor_volume_thread) {
-		g_thread_join (output->monitor_volume_thread);
-		output->monitor_volume_thread = NULL;
-	}
+	xmms_output_monitor_volume_stop (output);
+	xmms_output_pull_stop (output);
 
 	if (output->plugin) {
 		xmms_output_plugin_method_destroy (output->plugin, output);
@@ -1060,11 +3555,20 @@ set_plugin (xmms_output_t *output, xmms_output_plugin_t *plugin)
 	 * NEW method
 	 */
 	output->plugin = plugin;
+	output->volume_events = FALSE;
+	output->pull_mode = FALSE;
 	ret = xmms_output_plugin_method_new (output->plugin, output);
 
+	if (ret && output->pull_mode) {
+		output->pull_running = TRUE;
+		output->pull_thread = g_thread_new ("x2 out pull",
+		                                    xmms_output_pull_thread,
+		                                    output);
+	}
+
 	if (!ret) {
 		output->plugin = NULL;
-	} else if (!output->monitor_volume_thread) {
+	} else if (!output->monitor_volume_thread && !output->tee_parent) {
 		output->monitor_volume_running = TRUE;
 		output->monitor_volume_thread = g_thread_new ("x2 volume mon",
 		                                              xmms_output_monitor_volume_thread,
@@ -1169,12 +3673,51 @@ xmms_volume_map_to_dict (xmms_volume_map_t *vl)
 	return ret;
 }
 
+static void
+xmms_output_monitor_volume_stop (xmms_output_t *output)
+{
+	g_mutex_lock (&output->monitor_volume_mutex);
+	output->monitor_volume_running = FALSE;
+	g_cond_signal (&output->monitor_volume_cond);
+	g_mutex_unlock (&output->monitor_volume_mutex);
+
+	if (output->monitor_volume_thread) {
+		g_thread_join (output->monitor_volume_thread);
+		output->monitor_volume_thread = NULL;
+	}
+}
+
+void
+xmms_output_volume_changed (xmms_output_t *output)
+{
+	g_return_if_fail (output);
+
+	g_mutex_lock (&output->monitor_volume_mutex);
+	output->volume_changed = TRUE;
+	g_cond_signal (&output->monitor_volume_cond);
+	g_mutex_unlock (&output->monitor_volume_mutex);
+}
+
+void
+xmms_output_volume_events_set (xmms_output_t *output, gboolean events)
+{
+	g_return_if_fail (output);
+
+	g_mutex_lock (&output->monitor_volume_mutex);
+	output->volume_events = events;
+	/* going back to polling, start right away */
+	g_cond_signal (&output->monitor_volume_cond);
+	g_mutex_unlock (&output->monitor_volume_mutex);
+}
+
 static gpointer
 xmms_output_monitor_volume_thread (gpointer data)
 {
 	xmms_output_t *output = data;
 	xmms_volume_map_t old, cur;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
 	if (!xmms_output_plugin_method_volume_get_available (output->plugin)) {
 		return NULL;
 	}
@@ -1182,7 +3725,12 @@ xmms_output_monitor_volume_thread (gpointer data)
 	xmms_volume_map_init (&old);
 	xmms_volume_map_init (&cur);
 
+	g_mutex_lock (&output->monitor_volume_mutex);
+
 	while (output->monitor_volume_running) {
+		output->volume_changed = FALSE;
+		g_mutex_unlock (&output->monitor_volume_mutex);
+
 		cur.num_channels = 0;
 		cur.status = xmms_output_plugin_method_volume_get (output->plugin,
 		                                                   output, NULL, NULL,
@@ -1229,9 +3777,22 @@ xmms_output_monitor_volume_thread (gpointer data)
 
 		xmms_volume_map_copy (&cur, &old);
 
-		g_usleep (G_USEC_PER_SEC);
+		g_mutex_lock (&output->monitor_volume_mutex);
+
+		if (output->monitor_volume_running && !output->volume_changed) {
+			if (output->volume_events) {
+				g_cond_wait (&output->monitor_volume_cond,
+				             &output->monitor_volume_mutex);
+			} else {
+				g_cond_wait_until (&output->monitor_volume_cond,
+				                   &output->monitor_volume_mutex,
+				                   g_get_monotonic_time () + G_USEC_PER_SEC);
+			}
+		}
 	}
 
+	g_mutex_unlock (&output->monitor_volume_mutex);
+
 	xmms_volume_map_free (&old);
 	xmms_volume_map_free (&cur);
 
@@ -15,10 +15,18 @@
  */
 
 #include <xmmspriv/xmms_outputplugin.h>
+#include <xmmspriv/xmms_output.h>
 #include <xmmspriv/xmms_plugin.h>
 #include <xmmspriv/xmms_thread_name.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmms/xmms_log.h>
 
+/* how much the writer thread moves at a time if the plugin has no
+   preference, never less than the min, and never more than the max */
+#define XMMS_OUTPUT_WRITER_PERIOD_MS 20
+#define XMMS_OUTPUT_WRITER_MIN 4096
+#define XMMS_OUTPUT_WRITER_MAX (256 * 1024)
+
 struct xmms_output_plugin_St {
 	xmms_plugin_t plugin;
 
@@ -39,6 +47,10 @@ struct xmms_output_plugin_St {
 	xmms_playback_status_t status;
 
 	xmms_output_t *write_output;
+	/* bytes per write, whole frames of the current format */
+	gint period_bytes;
+
+	xmms_config_property_t *flush_on_pause;
 };
 
 static gboolean xmms_output_plugin_writer_status (xmms_output_plugin_t *plugin,
@@ -79,6 +91,8 @@ xmms_output_plugin_new (void)
 	g_cond_init (&res->status_cond);
 	g_mutex_init (&res->status_mutex);
 
+	res->period_bytes = XMMS_OUTPUT_WRITER_MIN;
+
 	return (xmms_plugin_t *) res;
 }
 
@@ -101,7 +115,7 @@ gboolean
 xmms_output_plugin_verify (xmms_plugin_t *_plugin)
 {
 	xmms_output_plugin_t *plugin = (xmms_output_plugin_t *)_plugin;
-	gboolean w, s, o, c;
+	gboolean w, s, o, c, d;
 
 	g_return_val_if_fail (plugin, FALSE);
 	g_return_val_if_fail (_plugin->type == XMMS_PLUGIN_TYPE_OUTPUT, FALSE);
@@ -114,8 +128,16 @@ xmms_output_plugin_verify (xmms_plugin_t *_plugin)
 	}
 
 	w = !!plugin->methods.write;
+	d = !!plugin->methods.write_direct;
 	s = !!plugin->methods.status;
 
+	if (w && d) {
+		XMMS_DBG ("Plugin can't provide both write and write_direct.");
+		return FALSE;
+	}
+
+	w = w || d;
+
 	if (w == s) {
 		XMMS_DBG ("Plugin needs to provide either write or status.");
 		return FALSE;
@@ -170,6 +192,7 @@ xmms_output_plugin_method_new (xmms_output_plugin_t *plugin,
 	}
 
 	if (ret && !plugin->methods.status) {
+		plugin->flush_on_pause = xmms_config_lookup ("output.flush_on_pause");
 		plugin->write_running = TRUE;
 		plugin->write_thread = g_thread_new ("x2 out writer", xmms_output_plugin_writer, plugin);
 		plugin->wanted_status = XMMS_PLAYBACK_STATUS_STOP;
@@ -233,6 +256,42 @@ xmms_output_plugin_format_set_always (xmms_output_plugin_t *plugin)
 }
 
 
+/**
+ * Work out how much the writer thread hands the plugin at a time
+ * for a format. Should hold api_mutex.
+ */
+static void
+xmms_output_plugin_period_update (xmms_output_plugin_t *plugin,
+                                  xmms_output_t *output,
+                                  const xmms_stream_type_t *st)
+{
+	guint frame, rate, period = 0, align = 1, bytes;
+
+	frame = xmms_sample_frame_size_get (st);
+	if (!frame) {
+		return;
+	}
+
+	if (plugin->methods.period_get) {
+		period = plugin->methods.period_get (output, st, &align);
+	}
+
+	if (!period) {
+		rate = xmms_stream_type_get_int (st, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+		period = MAX (rate * XMMS_OUTPUT_WRITER_PERIOD_MS / 1000,
+		              XMMS_OUTPUT_WRITER_MIN / frame);
+	}
+
+	align = MAX (align, 1) * frame;
+	bytes = CLAMP (period * frame, align, MAX (XMMS_OUTPUT_WRITER_MAX, align));
+	bytes -= bytes % align;
+
+	XMMS_DBG ("Writing %u bytes at a time", bytes);
+
+	g_atomic_int_set (&plugin->period_bytes, bytes);
+}
+
+
 gboolean
 xmms_output_plugin_method_format_set (xmms_output_plugin_t *plugin,
                                       xmms_output_t *output,
@@ -246,10 +305,20 @@ xmms_output_plugin_method_format_set (xmms_output_plugin_t *plugin,
 	if (plugin->methods.format_set) {
 		g_mutex_lock (&plugin->api_mutex);
 		res = plugin->methods.format_set (output, st);
+		if (res) {
+			xmms_output_plugin_period_update (plugin, output, st);
+		}
 		g_mutex_unlock (&plugin->api_mutex);
 	} else if (plugin->methods.format_set_always) {
 		g_mutex_lock (&plugin->api_mutex);
 		res = plugin->methods.format_set_always (output, st);
+		if (res) {
+			xmms_output_plugin_period_update (plugin, output, st);
+		}
+		g_mutex_unlock (&plugin->api_mutex);
+	} else {
+		g_mutex_lock (&plugin->api_mutex);
+		xmms_output_plugin_period_update (plugin, output, st);
 		g_mutex_unlock (&plugin->api_mutex);
 	}
 
@@ -382,13 +451,32 @@ xmms_output_plugin_writer_status_wait (xmms_output_plugin_t *plugin,
 }
 
 
+static void
+xmms_output_plugin_writer_error (xmms_output_plugin_t *plugin,
+                                 xmms_output_t *output, xmms_error_t *err)
+{
+	if (xmms_error_iserror (err)) {
+		XMMS_DBG ("Write method set error bit");
+
+		g_mutex_lock (&plugin->write_mutex);
+		plugin->wanted_status = XMMS_PLAYBACK_STATUS_STOP;
+		g_mutex_unlock (&plugin->write_mutex);
+
+		xmms_output_set_error (output, err);
+	}
+}
+
 static gpointer
 xmms_output_plugin_writer (gpointer data)
 {
 	xmms_output_plugin_t *plugin = (xmms_output_plugin_t *) data;
 	xmms_output_t *output = NULL;
-	gchar buffer[4096];
-	gint ret;
+	gchar *buffer = NULL;
+	gint ret, size = 0, period;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
+	xmms_output_realtime_thread_enter ();
 
 	g_mutex_lock (&plugin->write_mutex);
 
@@ -410,10 +498,8 @@ xmms_output_plugin_writer (gpointer data)
 
 			g_cond_wait (&plugin->write_cond, &plugin->write_mutex);
 		} else if (plugin->wanted_status == XMMS_PLAYBACK_STATUS_PAUSE) {
-			xmms_config_property_t *p;
-
-			p = xmms_config_lookup ("output.flush_on_pause");
-			if (xmms_config_property_get_int (p)) {
+			if (plugin->flush_on_pause &&
+			    xmms_config_property_get_int (plugin->flush_on_pause)) {
 				g_mutex_lock (&plugin->api_mutex);
 				plugin->methods.flush (output);
 				g_mutex_unlock (&plugin->api_mutex);
@@ -450,7 +536,29 @@ xmms_output_plugin_writer (gpointer data)
 
 			g_mutex_unlock (&plugin->write_mutex);
 
-			ret = xmms_output_read (output, buffer, 4096);
+			period = g_atomic_int_get (&plugin->period_bytes);
+
+			if (plugin->methods.write_direct) {
+				xmms_error_t err;
+
+				xmms_error_reset (&err);
+
+				/* the plugin reads by itself, which may set the
+				 * format and take api_mutex */
+				plugin->methods.write_direct (output, period, &err);
+
+				xmms_output_plugin_writer_error (plugin, output, &err);
+
+				g_mutex_lock (&plugin->write_mutex);
+				continue;
+			}
+
+			if (period != size) {
+				buffer = g_realloc (buffer, period);
+				size = period;
+			}
+
+			ret = xmms_output_read (output, buffer, size);
 			if (ret > 0) {
 				xmms_error_t err;
 
@@ -460,15 +568,7 @@ xmms_output_plugin_writer (gpointer data)
 				plugin->methods.write (output, buffer, ret, &err);
 				g_mutex_unlock (&plugin->api_mutex);
 
-				if (xmms_error_iserror (&err)) {
-					XMMS_DBG ("Write method set error bit");
-
-					g_mutex_lock (&plugin->write_mutex);
-					plugin->wanted_status = XMMS_PLAYBACK_STATUS_STOP;
-					g_mutex_unlock (&plugin->write_mutex);
-
-					xmms_output_set_error (output, &err);
-				}
+				xmms_output_plugin_writer_error (plugin, output, &err);
 			}
 			g_mutex_lock (&plugin->write_mutex);
 		}
@@ -478,6 +578,8 @@ xmms_output_plugin_writer (gpointer data)
 
 	g_mutex_unlock (&plugin->write_mutex);
 
+	g_free (buffer);
+
 	XMMS_DBG ("Output driving thread exiting!");
 
 	return NULL;
@@ -0,0 +1,194 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ *  A LRU cache of prepared medialib query plans.
+ *
+ *  A plan is handed out to one query at a time: taking it removes it
+ *  from the cache and the query puts it back when done. Plans holding
+ *  results of subqueries are remembered with the medialib generation
+ *  they were built at and only served while it stays the same.
+ */
+
+#include <xmmspriv/xmms_plancache.h>
+#include <xmmspriv/xmms_lru.h>
+
+typedef struct xmms_plan_cache_entry_St {
+	guint generation;
+	gpointer plan;
+	GDestroyNotify plan_free;
+} xmms_plan_cache_entry_t;
+
+struct xmms_plan_cache_St {
+	GMutex mutex;
+	xmms_lru_t *lru;
+	GDestroyNotify plan_free;
+};
+
+static void
+xmms_plan_cache_entry_free (gpointer data)
+{
+	xmms_plan_cache_entry_t *entry = data;
+
+	entry->plan_free (entry->plan);
+	g_free (entry);
+}
+
+xmms_plan_cache_t *
+xmms_plan_cache_new (guint max_entries, GDestroyNotify plan_free)
+{
+	xmms_plan_cache_t *cache;
+
+	g_return_val_if_fail (plan_free, NULL);
+
+	cache = g_new0 (xmms_plan_cache_t, 1);
+	g_mutex_init (&cache->mutex);
+	cache->lru = xmms_lru_new (g_bytes_hash, g_bytes_equal,
+	                           (GDestroyNotify) g_bytes_unref,
+	                           xmms_plan_cache_entry_free, max_entries);
+	cache->plan_free = plan_free;
+
+	return cache;
+}
+
+void
+xmms_plan_cache_free (xmms_plan_cache_t *cache)
+{
+	g_return_if_fail (cache);
+
+	xmms_lru_free (cache->lru);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+void
+xmms_plan_cache_set_max_entries (xmms_plan_cache_t *cache, guint max_entries)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_set_max_entries (cache->lru, max_entries);
+	g_mutex_unlock (&cache->mutex);
+}
+
+/**
+ * Build the cache key for querying coll with fetch. Bound references
+ * are part of the key, so a plan is not found again once a collection
+ * it refers to has changed.
+ */
+GBytes *
+xmms_plan_cache_key (xmmsv_t *coll, xmmsv_t *fetch)
+{
+	const unsigned char *data;
+	unsigned int len;
+	xmmsv_t *pair, *serialized;
+	GBytes *key = NULL;
+
+	pair = xmmsv_build_list (xmmsv_ref (coll), xmmsv_ref (fetch), XMMSV_LIST_END);
+	serialized = xmmsv_serialize (pair);
+	xmmsv_unref (pair);
+
+	if (serialized && xmmsv_get_bin (serialized, &data, &len)) {
+		key = g_bytes_new (data, len);
+	}
+
+	if (serialized) {
+		xmmsv_unref (serialized);
+	}
+
+	return key;
+}
+
+/**
+ * Take the plan stored under key out of the cache. Plans built at
+ * another generation than the given one are dropped, unless they are
+ * #XMMS_PLAN_CACHE_STATIC.
+ *
+ * @returns The plan, now owned by the caller, or NULL on a miss.
+ */
+gpointer
+xmms_plan_cache_take (xmms_plan_cache_t *cache, GBytes *key, guint generation)
+{
+	xmms_plan_cache_entry_t *entry;
+	gpointer ret = NULL;
+
+	g_return_val_if_fail (cache, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	g_mutex_lock (&cache->mutex);
+
+	entry = xmms_lru_steal (cache->lru, key);
+	if (entry && entry->generation != XMMS_PLAN_CACHE_STATIC &&
+	    entry->generation != generation) {
+		xmms_plan_cache_entry_free (entry);
+		entry = NULL;
+	}
+
+	if (entry) {
+		ret = entry->plan;
+		g_free (entry);
+	}
+
+	xmms_lru_account (cache->lru, ret != NULL);
+
+	g_mutex_unlock (&cache->mutex);
+
+	return ret;
+}
+
+/**
+ * Store a plan under key, the cache takes ownership of it. A plan
+ * already stored under the same key is kept instead.
+ */
+void
+xmms_plan_cache_put (xmms_plan_cache_t *cache, GBytes *key,
+                     guint generation, gpointer plan)
+{
+	xmms_plan_cache_entry_t *entry;
+
+	g_return_if_fail (cache);
+	g_return_if_fail (key);
+	g_return_if_fail (plan);
+
+	g_mutex_lock (&cache->mutex);
+
+	if (!xmms_lru_get_max_entries (cache->lru) ||
+	    xmms_lru_contains (cache->lru, key)) {
+		g_mutex_unlock (&cache->mutex);
+		cache->plan_free (plan);
+		return;
+	}
+
+	entry = g_new0 (xmms_plan_cache_entry_t, 1);
+	entry->generation = generation;
+	entry->plan = plan;
+	entry->plan_free = cache->plan_free;
+
+	xmms_lru_insert (cache->lru, g_bytes_ref (key), entry);
+
+	g_mutex_unlock (&cache->mutex);
+}
+
+void
+xmms_plan_cache_stats (xmms_plan_cache_t *cache, guint *hits,
+                       guint *misses, guint *entries)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_stats (cache->lru, hits, misses, entries);
+	g_mutex_unlock (&cache->mutex);
+}
@@ -35,6 +35,13 @@
 #include <xmmspriv/xmms_collection.h>
 #include <xmmspriv/xmms_playlist.h>
 
+/** Adding more entries at once is announced as a replace, clients
+ *  list the playlist again faster than they take one add at a time. */
+#define XMMS_PLAYLIST_ADD_MSG_MAX 256
+
+/** Changes kept per playlist for clients catching up */
+#define XMMS_PLAYLIST_CHANGELOG_SIZE 256
+
 static void xmms_playlist_destroy (xmms_object_t *object);
 static void xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll, xmms_playlist_position_action_t action, xmms_error_t *err);
 static xmmsv_t * xmms_playlist_client_list_entries (xmms_playlist_t *playlist, const gchar *plname, xmms_error_t *err);
@@ -47,6 +54,7 @@ static xmmsv_t * xmms_playlist_client_current_pos (xmms_playlist_t *playlist, co
 static gint xmms_playlist_client_set_next (xmms_playlist_t *playlist, gint32 pos, xmms_error_t *error);
 static void xmms_playlist_client_remove_entry (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, xmms_error_t *err);
 static gboolean xmms_playlist_remove_unlocked (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *plcoll, gint pos, xmms_error_t *err);
+static void xmms_playlist_trim_history_unlocked (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *plcoll, gint history);
 static void xmms_playlist_client_move_entry (xmms_playlist_t *playlist, const gchar *plname, gint32 pos, gint32 newpos, xmms_error_t *err);
 static gint xmms_playlist_client_set_next_rel (xmms_playlist_t *playlist, gint32 pos, xmms_error_t *error);
 static gint xmms_playlist_set_current_position_do (xmms_playlist_t *playlist, gint32 pos, xmms_error_t *err);
@@ -63,9 +71,10 @@ static gchar *xmms_playlist_canonical_name (xmms_playlist_t *playlist, const gch
 static gint xmms_playlist_coll_get_currpos (xmmsv_t *plcoll);
 static gint xmms_playlist_coll_get_size (xmmsv_t *plcoll);
 
-static void xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname);
+static guint xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t **src);
 static void xmms_playlist_update_queue (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll);
-static void xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll);
+static guint xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist, const gchar *plname, xmmsv_t *coll, xmmsv_t **src);
+static void xmms_playlist_fill_partyshuffle (xmms_playlist_t *playlist, const gchar *plname, xmms_medialib_entry_t *entries, guint n);
 
 static void xmms_playlist_register_ipc_commands (xmms_object_t *playlist_object);
 
@@ -73,6 +82,10 @@ static void xmms_playlist_current_pos_msg_send (xmms_playlist_t *playlist, xmmsv
 static xmmsv_t *xmms_playlist_current_pos_msg_new (xmms_playlist_t *playlist, gint32 pos, const gchar *plname);
 
 static void xmms_playlist_changed_msg_send (xmms_playlist_t *playlist, xmmsv_t *dict);
+static void xmms_playlist_changelog_add (xmms_playlist_t *playlist, xmmsv_t *dict);
+static void xmms_playlist_changelog_free (gpointer data);
+static gint32 xmms_playlist_changelog_version (xmms_playlist_t *playlist, const gchar *plname);
+static xmmsv_t *xmms_playlist_client_changes_since (xmms_playlist_t *playlist, const gchar *plname, gint32 epoch, gint32 version, xmms_error_t *err);
 static xmmsv_t *xmms_playlist_changed_msg_new (xmms_playlist_t *playlist, xmms_playlist_changed_action_t type, xmms_medialib_entry_t id, const gchar *plname);
 
 #define XMMS_PLAYLIST_CHANGED_MSG(type, id, name) xmms_playlist_changed_msg_send (playlist, xmms_playlist_changed_msg_new (playlist, type, id, name))
@@ -88,6 +101,16 @@ static xmmsv_t *xmms_playlist_changed_msg_new (xmms_playlist_t *playlist, xmms_p
   * @{
   */
 
+/** The last changes of a playlist, numbered by version */
+typedef struct {
+	gint32 version;
+	/** The changed messages of up to version, oldest first */
+	GQueue changes;
+	/** The playlist they were made to, saving another collection
+	 *  under its name makes them useless */
+	xmmsv_t *coll;
+} xmms_playlist_changelog_t;
+
 /** Playlist structure */
 struct xmms_playlist_St {
 	xmms_object_t object;
@@ -101,6 +124,12 @@ struct xmms_playlist_St {
 	GMutex mutex;
 
 	xmms_medialib_t *medialib;
+
+	/** Changelogs by playlist name, versions are only good for
+	 *  this epoch, picked when the server starts */
+	GMutex changelog_mutex;
+	GHashTable *changelogs;
+	gint32 epoch;
 };
 
 #include "playlist_ipc.c"
@@ -134,8 +163,12 @@ on_playlist_r_one_changed (xmms_object_t *object, xmmsv_t *_data,
 }
 
 
-static void
-xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname)
+/* Returns the number of entries a party shuffle playlist is missing,
+ * with a reference to its source in src, or 0 if nothing is missing.
+ */
+static guint
+xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname,
+                               xmmsv_t **src)
 {
 	xmmsv_t *plcoll;
 	const gchar *type = NULL;
@@ -146,16 +179,18 @@ xmms_playlist_update_unlocked (xmms_playlist_t *playlist, const gchar *plname)
 		if (g_strcmp0 (type, "queue") == 0) {
 			xmms_playlist_update_queue (playlist, plname, plcoll);
 		} else if (g_strcmp0 (type, "pshuffle") == 0) {
-			xmms_playlist_update_partyshuffle (playlist, plname, plcoll);
+			return xmms_playlist_update_partyshuffle (playlist, plname, plcoll, src);
 		}
 	}
+
+	return 0;
 }
 
 static void
 xmms_playlist_update_queue (xmms_playlist_t *playlist, const gchar *plname,
                             xmmsv_t *coll)
 {
-	gint history, currpos;
+	gint history;
 
 	XMMS_DBG ("PLAYLIST: update queue.");
 
@@ -163,20 +198,31 @@ xmms_playlist_update_queue (xmms_playlist_t *playlist, const gchar *plname,
 		history = 0;
 	}
 
-	currpos = xmms_playlist_coll_get_currpos (coll);
-	while (currpos > history) {
-		/* Removing entries is fast enough to be processed at once. */
-		xmms_playlist_remove_unlocked (playlist, plname, coll, 0, NULL);
-		currpos = xmms_playlist_coll_get_currpos (coll);
+	xmms_playlist_trim_history_unlocked (playlist, plname, coll, history);
+}
+
+static guint
+xmms_playlist_partyshuffle_missing (xmmsv_t *coll)
+{
+	gint upcoming, currpos, size;
+
+	if (!xmms_collection_get_int_attr (coll, "upcoming", &upcoming)) {
+		upcoming = XMMS_DEFAULT_PARTYSHUFFLE_UPCOMING;
 	}
+
+	currpos = xmms_playlist_coll_get_currpos (coll);
+	size = xmms_playlist_coll_get_size (coll);
+
+	return MAX (currpos + 1 + upcoming - size, 0);
 }
 
-static void
+static guint
 xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
-                                   const gchar *plname, xmmsv_t *coll)
+                                   const gchar *plname, xmmsv_t *coll,
+                                   xmmsv_t **src)
 {
-	gint history, upcoming, currpos, size;
-	xmmsv_t *src;
+	gint history;
+	guint missing;
 
 	XMMS_DBG ("PLAYLIST: Update partyshuffle.");
 
@@ -184,29 +230,43 @@ xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
 		history = 0;
 	}
 
-	if (!xmms_collection_get_int_attr (coll, "upcoming", &upcoming)) {
-		upcoming = XMMS_DEFAULT_PARTYSHUFFLE_UPCOMING;
+	xmms_playlist_trim_history_unlocked (playlist, plname, coll, history);
+
+	g_return_val_if_fail (xmmsv_list_get (xmmsv_coll_operands_get (coll), 0, src), 0);
+
+	missing = xmms_playlist_partyshuffle_missing (coll);
+	if (missing) {
+		xmmsv_ref (*src);
 	}
 
-	currpos = xmms_playlist_coll_get_currpos (coll);
-	while (currpos > history) {
-		/* Removing entries is fast enough to be processed at once. */
-		xmms_playlist_remove_unlocked (playlist, plname, coll, 0, NULL);
-		currpos = xmms_playlist_coll_get_currpos (coll);
+	return missing;
+}
+
+/* Add the sampled entries the playlist is still missing, it may have
+ * changed while they were picked.
+ */
+static void
+xmms_playlist_fill_partyshuffle (xmms_playlist_t *playlist, const gchar *plname,
+                                 xmms_medialib_entry_t *entries, guint n)
+{
+	xmmsv_t *plcoll;
+	const gchar *type = NULL;
+	guint i;
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, NULL);
+	if (!plcoll) {
+		return;
 	}
 
-	g_return_if_fail(xmmsv_list_get (xmmsv_coll_operands_get (coll), 0, &src));
+	xmmsv_coll_attribute_get_string (plcoll, "type", &type);
+	if (g_strcmp0 (type, "pshuffle") != 0) {
+		return;
+	}
 
-	/* Since getting random media can be slow on huge medialibs, we refill only
-	 * one entry at a time. This let other threads a chance to get the lock on
-	 * the playlist object as soon as possible. */
-	size = xmms_playlist_coll_get_size (coll);
-	if (size < currpos + 1 + upcoming) {
-		xmms_medialib_entry_t randentry;
-		randentry = xmms_collection_get_random_media (playlist->colldag, src);
-		if (randentry > 0) {
-			xmms_playlist_add_entry_unlocked (playlist, plname, coll, randentry, NULL);
-		}
+	n = MIN (n, xmms_playlist_partyshuffle_missing (plcoll));
+	for (i = 0; i < n; i++) {
+		xmms_playlist_add_entry_unlocked (playlist, plname, plcoll,
+		                                  entries[i], NULL);
 	}
 }
 
@@ -216,13 +276,39 @@ xmms_playlist_update_partyshuffle (xmms_playlist_t *playlist,
  *  The function will emit at least one signal
  *  (playlist/collection/current_position changed) when something is updated.
  *  No more signal means everything is up to date.
+ *
+ *  Random media for party shuffle are picked without holding the
+ *  playlist lock, so several playlists can be updated at once.
  */
 void
 xmms_playlist_update (xmms_playlist_t *playlist, const gchar *plname)
 {
+	xmms_medialib_entry_t *entries;
+	xmmsv_t *src = NULL;
+	guint missing, got;
+
 	g_mutex_lock (&playlist->mutex);
-	xmms_playlist_update_unlocked (playlist, plname);
+	missing = xmms_playlist_update_unlocked (playlist, plname, &src);
 	g_mutex_unlock (&playlist->mutex);
+
+	if (!missing) {
+		return;
+	}
+
+	/* Random media come from a cached id set of the source, so all the
+	 * missing upcoming entries can be picked at once. */
+	entries = g_new (xmms_medialib_entry_t, missing);
+	got = xmms_collection_get_random_media_n (playlist->colldag, src,
+	                                          missing, entries);
+	xmmsv_unref (src);
+
+	if (got) {
+		g_mutex_lock (&playlist->mutex);
+		xmms_playlist_fill_partyshuffle (playlist, plname, entries, got);
+		g_mutex_unlock (&playlist->mutex);
+	}
+
+	g_free (entries);
 }
 
 
@@ -304,6 +390,11 @@ xmms_playlist_init (xmms_medialib_t *medialib, xmms_coll_dag_t *colldag)
 	ret = xmms_object_new (xmms_playlist_t, xmms_playlist_destroy);
 	g_mutex_init (&ret->mutex);
 
+	g_mutex_init (&ret->changelog_mutex);
+	ret->changelogs = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+	                                         xmms_playlist_changelog_free);
+	ret->epoch = g_random_int_range (1, G_MAXINT32);
+
 	xmms_playlist_register_ipc_commands (XMMS_OBJECT (ret));
 
 	val = xmms_config_property_register ("playlist.repeat_one", "0",
@@ -450,6 +541,53 @@ xmms_playlist_current_entry (xmms_playlist_t *playlist)
 }
 
 
+/**
+ * Peek at the xmms_medialib_entry_t that #xmms_playlist_advance would
+ * make current, without touching the playlist position.
+ *
+ * Jumplists are not followed since loading them modifies the playlist,
+ * 0 is returned if the active playlist would jump or end.
+ *
+ * @sa xmms_playlist_advance
+ */
+xmms_medialib_entry_t
+xmms_playlist_next_entry (xmms_playlist_t *playlist)
+{
+	gint size, currpos;
+	xmmsv_t *plcoll;
+	xmms_medialib_entry_t ent = 0;
+
+	g_return_val_if_fail (playlist, 0);
+
+	g_mutex_lock (&playlist->mutex);
+
+	plcoll = xmms_playlist_get_coll (playlist, XMMS_ACTIVE_PLAYLIST, NULL);
+	if (plcoll == NULL) {
+		g_mutex_unlock (&playlist->mutex);
+		return 0;
+	}
+
+	size = xmms_playlist_coll_get_size (plcoll);
+	currpos = xmms_playlist_coll_get_currpos (plcoll);
+
+	/* the same step as xmms_playlist_advance_do, -1 goes to 0 */
+	if (!playlist->repeat_one) {
+		currpos++;
+		if (currpos == size && playlist->repeat_all) {
+			currpos = 0;
+		}
+	}
+
+	if (currpos >= 0 && currpos < size) {
+		xmmsv_coll_idlist_get_index (plcoll, currpos, &ent);
+	}
+
+	g_mutex_unlock (&playlist->mutex);
+
+	return ent;
+}
+
+
 /**
  * Retrieve the position of the currently active xmms_medialib_entry_t
  *
@@ -583,6 +721,46 @@ xmms_playlist_remove_unlocked (xmms_playlist_t *playlist, const gchar *plname,
 	return TRUE;
 }
 
+/**
+ * Remove the entries before the current one but the last history ones,
+ * all at once. The idlist drops entries off its head without moving the
+ * rest, and clients get one message for all of them.
+ */
+static void
+xmms_playlist_trim_history_unlocked (xmms_playlist_t *playlist,
+                                     const gchar *plname, xmmsv_t *plcoll,
+                                     gint history)
+{
+	gint currpos, count, i;
+	xmmsv_t *dict;
+
+	currpos = xmms_playlist_coll_get_currpos (plcoll);
+	count = currpos - MAX (history, 0);
+	if (count <= 0) {
+		return;
+	}
+
+	if (count == 1) {
+		xmms_playlist_remove_unlocked (playlist, plname, plcoll, 0, NULL);
+		return;
+	}
+
+	for (i = 0; i < count; i++) {
+		xmmsv_coll_idlist_remove (plcoll, 0);
+	}
+
+	currpos -= count;
+	xmms_collection_set_int_attr (plcoll, "position", currpos);
+
+	/* clients list the playlist again on a replace without permutation */
+	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_REPLACE,
+	                                      0, plname);
+	xmmsv_dict_set_int (dict, "size", xmms_playlist_coll_get_size (plcoll));
+	xmms_playlist_changed_msg_send (playlist, dict);
+
+	XMMS_PLAYLIST_CURRPOS_MSG (currpos, plname);
+}
+
 /**
  * Remove an entry from playlist.
  *
@@ -880,19 +1058,10 @@ static void
 xmms_playlist_client_radd (xmms_playlist_t *playlist, const gchar *plname,
                            const gchar *path, xmms_error_t *err)
 {
-	xmms_medialib_entry_t entry;
 	xmmsv_t *idlist;
-	xmmsv_list_iter_t *it;
-	xmmsv_t *list;
 
 	idlist = xmms_medialib_add_recursive (playlist->medialib, path, err);
-	list = xmmsv_coll_idlist_get (idlist);
-
-	xmmsv_get_list_iter (list, &it);
-	while (xmmsv_list_iter_entry_int (it, &entry)) {
-		xmms_playlist_add_entry (playlist, plname, entry, err);
-		xmmsv_list_iter_next (it);
-	}
+	xmms_playlist_add_entries (playlist, plname, xmmsv_coll_idlist_get (idlist), err);
 
 	xmmsv_unref (idlist);
 }
@@ -902,16 +1071,12 @@ xmms_playlist_client_add_collection (xmms_playlist_t *playlist, const gchar *pln
                                      xmmsv_t *coll, xmms_error_t *err)
 {
 	xmmsv_t *res;
-	int32_t id;
-	int i;
 
 	res = xmms_collection_query_ids (playlist->colldag, coll, err);
-
-	for (i = 0; xmmsv_list_get_int (res, i, &id); i++) {
-		xmms_playlist_add_entry (playlist, plname, id, err);
+	if (res) {
+		xmms_playlist_add_entries (playlist, plname, res, err);
+		xmmsv_unref (res);
 	}
-
-	xmmsv_unref (res);
 }
 
 /**
@@ -936,6 +1101,74 @@ xmms_playlist_add_entry (xmms_playlist_t *playlist, const gchar *plname,
 
 }
 
+/**
+ * Add a list of entries to the playlist without validating them.
+ *
+ * The playlist is locked once for all of them, and the collection
+ * changed signal is sent once at the end instead of for every entry.
+ * Clients get an add message for each, or for more than
+ * #XMMS_PLAYLIST_ADD_MSG_MAX at once a single replace message with
+ * the new size, on which they list the playlist again.
+ *
+ * @internal
+ */
+void
+xmms_playlist_add_entries (xmms_playlist_t *playlist, const gchar *plname,
+                           xmmsv_t *ids, xmms_error_t *err)
+{
+	xmmsv_t *plcoll, *dict;
+	gchar *cannonical_name;
+	gint32 id;
+	gint i, size;
+
+	g_mutex_lock (&playlist->mutex);
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, err);
+	if (plcoll == NULL || !xmmsv_list_get_int (ids, 0, &id)) {
+		g_mutex_unlock (&playlist->mutex);
+		return;
+	}
+
+	cannonical_name = xmms_playlist_canonical_name (playlist, plname);
+	size = xmms_playlist_coll_get_size (plcoll);
+
+	if (xmmsv_list_get_size (ids) > XMMS_PLAYLIST_ADD_MSG_MAX) {
+		for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+			xmmsv_coll_idlist_append (plcoll, id);
+		}
+
+		dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_REPLACE,
+		                                      0, cannonical_name);
+		xmmsv_dict_set_int (dict, "size", size + i);
+		xmms_playlist_changed_msg_send (playlist, dict);
+
+		g_free (cannonical_name);
+
+		g_mutex_unlock (&playlist->mutex);
+		return;
+	}
+
+	for (i = 0; xmmsv_list_get_int (ids, i, &id); i++) {
+		xmmsv_coll_idlist_append (plcoll, id);
+
+		dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("type", XMMS_PLAYLIST_CHANGED_ADD),
+		                         XMMSV_DICT_ENTRY_STR ("name", cannonical_name),
+		                         XMMSV_DICT_ENTRY_INT ("id", id),
+		                         XMMSV_DICT_ENTRY_INT ("position", size + i),
+		                         XMMSV_DICT_END);
+		xmms_playlist_changelog_add (playlist, dict);
+		xmms_object_emit (XMMS_OBJECT (playlist),
+		                  XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
+		                  dict);
+	}
+
+	XMMS_COLLECTION_PLAYLIST_CHANGED_MSG (playlist->colldag, cannonical_name);
+
+	g_free (cannonical_name);
+
+	g_mutex_unlock (&playlist->mutex);
+}
+
 /**
  * Add an entry to the playlist without locking the mutex.
  */
@@ -1074,6 +1307,85 @@ xmms_playlist_client_set_next_rel (xmms_playlist_t *playlist, gint32 pos,
 }
 
 
+typedef struct {
+	xmms_medialib_entry_t id;
+	gint pos;
+} xmms_playlist_replace_entry_t;
+
+static gint
+xmms_playlist_replace_entry_compare (gconstpointer a, gconstpointer b)
+{
+	const xmms_playlist_replace_entry_t *ea = a, *eb = b;
+
+	if (ea->id != eb->id) {
+		return ea->id < eb->id ? -1 : 1;
+	}
+
+	return ea->pos - eb->pos;
+}
+
+static GArray *
+xmms_playlist_replace_entries (xmmsv_t *plcoll)
+{
+	xmms_playlist_replace_entry_t entry;
+	GArray *entries;
+	gint size;
+
+	size = xmms_playlist_coll_get_size (plcoll);
+	entries = g_array_sized_new (FALSE, FALSE, sizeof (entry), size);
+
+	for (entry.pos = 0; entry.pos < size; entry.pos++) {
+		xmmsv_coll_idlist_get_index (plcoll, entry.pos, &entry.id);
+		g_array_append_val (entries, entry);
+	}
+
+	return entries;
+}
+
+/**
+ * Describe a replaced playlist as a permutation of the old one, so
+ * clients can reorder their copy instead of listing it again.
+ *
+ * @return The old position of each new entry as big endian 32 bit
+ * integers, or NULL if the entries are not the same as before.
+ */
+static xmmsv_t *
+xmms_playlist_replace_permutation (GArray *before, GArray *after)
+{
+	xmms_playlist_replace_entry_t *b, *a;
+	xmmsv_t *permutation;
+	guint32 *positions;
+	guint i;
+
+	if (before->len != after->len || before->len == 0) {
+		return NULL;
+	}
+
+	/* entries with the same id keep their relative order */
+	g_array_sort (before, xmms_playlist_replace_entry_compare);
+	g_array_sort (after, xmms_playlist_replace_entry_compare);
+
+	positions = g_new (guint32, after->len);
+
+	for (i = 0; i < after->len; i++) {
+		b = &g_array_index (before, xmms_playlist_replace_entry_t, i);
+		a = &g_array_index (after, xmms_playlist_replace_entry_t, i);
+
+		if (a->id != b->id) {
+			g_free (positions);
+			return NULL;
+		}
+
+		positions[a->pos] = GUINT32_TO_BE (b->pos);
+	}
+
+	permutation = xmmsv_new_bin ((const guchar *) positions,
+	                             after->len * sizeof (guint32));
+	g_free (positions);
+
+	return permutation;
+}
+
 /** Sorts the playlist by properties.
  *
  *  This will sort the list.
@@ -1089,9 +1401,11 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
                               xmms_error_t *err)
 {
 	xmms_medialib_entry_t id, current_id;
-	xmmsv_t *plcoll;
-	xmmsv_t *result;
+	xmmsv_t *plcoll, *queried;
+	xmmsv_t *result, *dict, *permutation;
+	GArray *before, *after;
 	gint current_position, i;
+	gint32 version;
 
 	g_return_if_fail (playlist);
 	g_return_if_fail (coll);
@@ -1105,25 +1419,61 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
 		return;
 	}
 
-	current_position = xmms_playlist_coll_get_currpos (plcoll);
-	xmmsv_coll_idlist_get_index (plcoll, current_position, &current_id);
+	queried = xmmsv_ref (plcoll);
+	version = xmms_playlist_changelog_version (playlist, plname);
 
+	g_mutex_unlock (&playlist->mutex);
+
+	/* Sorting a large playlist takes a while, and the query doesn't
+	 * need the playlist lock, so other clients can go on meanwhile. */
 	result = xmms_collection_query_ids (playlist->colldag, coll, err);
 	if (result == NULL) {
+		xmmsv_unref (queried);
+		return;
+	}
+
+	g_mutex_lock (&playlist->mutex);
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, err);
+	if (plcoll == NULL) {
+		xmms_error_set (err, XMMS_ERROR_NOENT, "no such playlist!");
 		g_mutex_unlock (&playlist->mutex);
+		xmmsv_unref (queried);
+		xmmsv_unref (result);
 		return;
 	}
 
-	xmmsv_coll_idlist_clear (plcoll);
+	/* The result may be made from the playlist itself, as when sorting
+	 * it. If it changed meanwhile the query is run again under the
+	 * lock, so those changes aren't lost. */
+	if (plcoll != queried ||
+	    version != xmms_playlist_changelog_version (playlist, plname)) {
+		xmmsv_unref (result);
+		result = xmms_collection_query_ids (playlist->colldag, coll, err);
+		if (result == NULL) {
+			g_mutex_unlock (&playlist->mutex);
+			xmmsv_unref (queried);
+			return;
+		}
+	}
+
+	xmmsv_unref (queried);
+
+	current_position = xmms_playlist_coll_get_currpos (plcoll);
+	xmmsv_coll_idlist_get_index (plcoll, current_position, &current_id);
+
+	before = xmms_playlist_replace_entries (plcoll);
 
 	current_position = -1;
 
 	for (i = 0; xmmsv_list_get_int (result, i, &id); i++) {
 		if (id == current_id)
 			current_position = i;
-		xmmsv_coll_idlist_append (plcoll, id);
 	}
 
+	/* the result is a list of our own, it becomes the idlist as is */
+	xmmsv_coll_idlist_set (plcoll, result);
+
 	switch (action) {
 		case XMMS_PLAYLIST_CURRENT_ID_FORGET:
 			current_position = -1;
@@ -1142,8 +1492,24 @@ xmms_playlist_client_replace (xmms_playlist_t *playlist, const gchar *plname,
 
 	xmms_collection_set_int_attr (plcoll, "position", current_position);
 
-	XMMS_PLAYLIST_CHANGED_MSG (XMMS_PLAYLIST_CHANGED_REPLACE,
-	                           (current_position < 0) ? 0 : current_id, plname);
+	after = xmms_playlist_replace_entries (plcoll);
+
+	dict = xmms_playlist_changed_msg_new (playlist, XMMS_PLAYLIST_CHANGED_REPLACE,
+	                                      (current_position < 0) ? 0 : current_id,
+	                                      plname);
+	xmmsv_dict_set_int (dict, "size", after->len);
+
+	/* shuffling and sorting only reorder the entries */
+	permutation = xmms_playlist_replace_permutation (before, after);
+	if (permutation) {
+		xmmsv_dict_set (dict, "permutation", permutation);
+		xmmsv_unref (permutation);
+	}
+
+	g_array_free (before, TRUE);
+	g_array_free (after, TRUE);
+
+	xmms_playlist_changed_msg_send (playlist, dict);
 	XMMS_PLAYLIST_CURRPOS_MSG (current_position, plname);
 
 	g_mutex_unlock (&playlist->mutex);
@@ -1221,6 +1587,9 @@ xmms_playlist_destroy (xmms_object_t *object)
 	xmms_object_unref (playlist->colldag);
 	xmms_object_unref (playlist->medialib);
 
+	g_hash_table_destroy (playlist->changelogs);
+	g_mutex_clear (&playlist->changelog_mutex);
+
 	g_mutex_clear (&playlist->mutex);
 
 	xmms_playlist_unregister_ipc_commands ();
@@ -1345,11 +1714,213 @@ xmms_playlist_changed_msg_send (xmms_playlist_t *playlist, xmmsv_t *dict)
 		XMMS_COLLECTION_PLAYLIST_CHANGED_MSG (playlist->colldag, plname);
 	}
 
+	xmms_playlist_changelog_add (playlist, dict);
 	xmms_object_emit (XMMS_OBJECT (playlist),
 	                  XMMS_IPC_SIGNAL_PLAYLIST_CHANGED,
 	                  dict);
 }
 
+/**
+ * Number a changed message with the next version of its playlist, and
+ * keep it for clients asking what changed since an earlier version.
+ */
+static void
+xmms_playlist_changelog_add (xmms_playlist_t *playlist, xmmsv_t *dict)
+{
+	xmms_playlist_changelog_t *log;
+	const gchar *plname;
+	xmmsv_t *plcoll;
+	gint type;
+
+	/* updates don't change the entries, they only wake the updater */
+	if (!xmmsv_dict_entry_get_string (dict, "name", &plname) ||
+	    !xmmsv_dict_entry_get_int (dict, "type", &type) ||
+	    type == XMMS_PLAYLIST_CHANGED_UPDATE) {
+		return;
+	}
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, NULL);
+
+	g_mutex_lock (&playlist->changelog_mutex);
+
+	log = g_hash_table_lookup (playlist->changelogs, plname);
+	if (!log) {
+		log = g_new0 (xmms_playlist_changelog_t, 1);
+		g_queue_init (&log->changes);
+		g_hash_table_insert (playlist->changelogs, g_strdup (plname), log);
+	}
+
+	if (log->coll != plcoll) {
+		g_queue_foreach (&log->changes, (GFunc) xmmsv_unref, NULL);
+		g_queue_clear (&log->changes);
+		if (log->coll) {
+			xmmsv_unref (log->coll);
+		}
+		log->coll = plcoll ? xmmsv_ref (plcoll) : NULL;
+	}
+
+	log->version++;
+	xmmsv_dict_set_int (dict, "version", log->version);
+
+	g_queue_push_tail (&log->changes, xmmsv_ref (dict));
+	if (g_queue_get_length (&log->changes) > XMMS_PLAYLIST_CHANGELOG_SIZE) {
+		xmmsv_unref (g_queue_pop_head (&log->changes));
+	}
+
+	g_mutex_unlock (&playlist->changelog_mutex);
+}
+
+static void
+xmms_playlist_changelog_free (gpointer data)
+{
+	xmms_playlist_changelog_t *log = (xmms_playlist_changelog_t *) data;
+
+	g_queue_foreach (&log->changes, (GFunc) xmmsv_unref, NULL);
+	g_queue_clear (&log->changes);
+	if (log->coll) {
+		xmmsv_unref (log->coll);
+	}
+	g_free (log);
+}
+
+/* The version of the last change to a playlist, should hold the
+ * playlist mutex so it can't change meanwhile. */
+static gint32
+xmms_playlist_changelog_version (xmms_playlist_t *playlist, const gchar *plname)
+{
+	xmms_playlist_changelog_t *log;
+	gchar *cannonical_name;
+	gint32 version = 0;
+
+	cannonical_name = xmms_playlist_canonical_name (playlist, plname);
+	if (!cannonical_name) {
+		return 0;
+	}
+
+	g_mutex_lock (&playlist->changelog_mutex);
+	log = g_hash_table_lookup (playlist->changelogs, cannonical_name);
+	if (log) {
+		version = log->version;
+	}
+	g_mutex_unlock (&playlist->changelog_mutex);
+
+	g_free (cannonical_name);
+
+	return version;
+}
+
+/* Take the changes after version, NULL if they are not all kept or if
+ * a client can't apply one of them to its copy. */
+static xmmsv_t *
+xmms_playlist_changelog_since (xmms_playlist_changelog_t *log, gint32 version)
+{
+	xmmsv_t *changes, *dict;
+	GList *it;
+	gint32 oldest, type;
+
+	oldest = log->version - g_queue_get_length (&log->changes);
+	if (version < oldest || version > log->version) {
+		return NULL;
+	}
+
+	changes = xmmsv_new_list ();
+
+	for (it = g_queue_peek_nth_link (&log->changes, version - oldest);
+	     it; it = g_list_next (it)) {
+		dict = (xmmsv_t *) it->data;
+
+		xmmsv_dict_entry_get_int (dict, "type", &type);
+		switch (type) {
+			case XMMS_PLAYLIST_CHANGED_ADD:
+			case XMMS_PLAYLIST_CHANGED_INSERT:
+			case XMMS_PLAYLIST_CHANGED_REMOVE:
+			case XMMS_PLAYLIST_CHANGED_MOVE:
+				break;
+			case XMMS_PLAYLIST_CHANGED_REPLACE:
+				if (xmmsv_dict_has_key (dict, "permutation")) {
+					break;
+				}
+				/* fall through */
+			default:
+				xmmsv_unref (changes);
+				return NULL;
+		}
+
+		xmmsv_list_append (changes, dict);
+	}
+
+	return changes;
+}
+
+/**
+ * Get what changed in a playlist since the given version. The reply
+ * holds the current "epoch" and "version", and the "changes" since
+ * the version as they were broadcast. If those are not all known, for
+ * example because the version is from an earlier run of the server,
+ * it holds all the "entries" of the playlist instead.
+ */
+static xmmsv_t *
+xmms_playlist_client_changes_since (xmms_playlist_t *playlist,
+                                    const gchar *plname, gint32 epoch,
+                                    gint32 version, xmms_error_t *err)
+{
+	xmms_playlist_changelog_t *log;
+	xmmsv_t *plcoll, *ret, *changes = NULL;
+	gchar *cannonical_name;
+	gint32 current = 0;
+
+	g_return_val_if_fail (playlist, NULL);
+
+	g_mutex_lock (&playlist->mutex);
+
+	plcoll = xmms_playlist_get_coll (playlist, plname, err);
+	if (plcoll == NULL) {
+		g_mutex_unlock (&playlist->mutex);
+		return NULL;
+	}
+
+	cannonical_name = xmms_playlist_canonical_name (playlist, plname);
+
+	g_mutex_lock (&playlist->changelog_mutex);
+
+	log = g_hash_table_lookup (playlist->changelogs, cannonical_name);
+	if (log) {
+		current = log->version;
+	}
+
+	if (epoch == playlist->epoch && (!log || log->coll == plcoll)) {
+		if (version == current) {
+			changes = xmmsv_new_list ();
+		} else if (log) {
+			changes = xmms_playlist_changelog_since (log, version);
+		}
+	}
+
+	g_mutex_unlock (&playlist->changelog_mutex);
+
+	ret = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("epoch", playlist->epoch),
+	                        XMMSV_DICT_ENTRY_INT ("version", current),
+	                        XMMSV_DICT_ENTRY_INT ("position",
+	                                              xmms_playlist_coll_get_currpos (plcoll)),
+	                        XMMSV_DICT_END);
+
+	if (changes) {
+		xmmsv_dict_set (ret, "changes", changes);
+		xmmsv_unref (changes);
+	} else {
+		/* a copy, the playlist keeps changing after the reply */
+		changes = xmmsv_copy (xmmsv_coll_idlist_get (plcoll));
+		xmmsv_dict_set (ret, "entries", changes);
+		xmmsv_unref (changes);
+	}
+
+	g_free (cannonical_name);
+
+	g_mutex_unlock (&playlist->mutex);
+
+	return ret;
+}
+
 static void
 xmms_playlist_current_pos_msg_send (xmms_playlist_t *playlist,
                                     xmmsv_t *dict)
@@ -22,30 +22,39 @@
 
 #include <xmmspriv/xmms_playlist_updater.h>
 #include <xmmspriv/xmms_thread_name.h>
+#include <xmmspriv/xmms_thread_role.h>
 #include <xmms/xmms_log.h>
 #include <glib.h>
 
+/** Playlists are independent, so a few can be updated at once. */
+#define XMMS_PLAYLIST_UPDATER_THREADS 4
+
 static void xmms_playlist_updater_destroy (xmms_object_t *object);
 static void xmms_playlist_updater_start (xmms_playlist_updater_t *updater);
 static void xmms_playlist_updater_stop (xmms_playlist_updater_t *updater);
 static gpointer xmms_playlist_updater_loop (xmms_playlist_updater_t *updater);
 static void xmms_playlist_updater_need_update (xmms_object_t *object, xmmsv_t *val, gpointer udata);
 static gchar *xmms_playlist_updater_pop (xmms_playlist_updater_t *updater);
+static void xmms_playlist_updater_done (xmms_playlist_updater_t *updater, gchar *plname);
 
 struct xmms_playlist_updater_St {
 	xmms_object_t object;
 
 	xmms_playlist_t *playlist;
 
-	GThread *thread;
+	GThread *threads[XMMS_PLAYLIST_UPDATER_THREADS];
 	GMutex mutex;
 	GCond cond;
 
 	gboolean keep_running;
 
-	const gchar *updating;
-	gboolean need_update;
-	GList *stack;
+	/** Names waiting for an update, oldest first, and the same names
+	 *  as a set */
+	GQueue pending;
+	GHashTable *queued;
+
+	/** Names being updated, no other thread takes those meanwhile */
+	GHashTable *updating;
 };
 
 xmms_playlist_updater_t *
@@ -62,8 +71,9 @@ xmms_playlist_updater_init (xmms_playlist_t *playlist)
 	xmms_object_ref (playlist);
 	updater->playlist = playlist;
 
-	updater->updating = NULL;
-	updater->stack = NULL;
+	g_queue_init (&updater->pending);
+	updater->queued = g_hash_table_new (g_str_hash, g_str_equal);
+	updater->updating = g_hash_table_new (g_str_hash, g_str_equal);
 
 	xmms_object_connect (XMMS_OBJECT (playlist),
 	                     XMMS_IPC_SIGNAL_COLLECTION_CHANGED,
@@ -85,7 +95,6 @@ xmms_playlist_updater_init (xmms_playlist_t *playlist)
 static void
 xmms_playlist_updater_destroy (xmms_object_t *object)
 {
-	GList *it;
 	xmms_playlist_updater_t *updater = (xmms_playlist_updater_t *) object;
 
 	g_return_if_fail (updater != NULL);
@@ -108,51 +117,56 @@ xmms_playlist_updater_destroy (xmms_object_t *object)
 
 	xmms_object_unref (updater->playlist);
 
-	for (it = updater->stack; it; it = g_list_next (it)) {
-		gchar *plname;
-		plname = (gchar *) it->data;
-		g_free (plname);
-	}
-	g_list_free (updater->stack);
+	g_hash_table_destroy (updater->queued);
+	g_hash_table_destroy (updater->updating);
+	g_queue_foreach (&updater->pending, (GFunc) g_free, NULL);
+	g_queue_clear (&updater->pending);
 
 	g_mutex_clear (&updater->mutex);
 	g_cond_clear (&updater->cond);
 }
 
 /**
- * Start the updater thread.
+ * Start the updater threads.
  */
 static void
 xmms_playlist_updater_start (xmms_playlist_updater_t *updater)
 {
+	gint i;
+
 	g_return_if_fail (updater != NULL);
-	g_return_if_fail (updater->thread == NULL);
+	g_return_if_fail (updater->threads[0] == NULL);
 
 	updater->keep_running = TRUE;
-	updater->thread = g_thread_new ("x2 pls updater",
-	                                (GThreadFunc) xmms_playlist_updater_loop,
-	                                updater);
+	for (i = 0; i < XMMS_PLAYLIST_UPDATER_THREADS; i++) {
+		updater->threads[i] = g_thread_new ("x2 pls updater",
+		                                    (GThreadFunc) xmms_playlist_updater_loop,
+		                                    updater);
+	}
 }
 
 /**
- * Signal the updater loop to exit and join the updater thread.
+ * Signal the updater loops to exit and join the updater threads.
  */
 static void
 xmms_playlist_updater_stop (xmms_playlist_updater_t *updater)
 {
+	gint i;
+
 	g_return_if_fail (updater != NULL);
-	g_return_if_fail (updater->thread != NULL);
+	g_return_if_fail (updater->threads[0] != NULL);
 
 	g_mutex_lock (&updater->mutex);
 
 	updater->keep_running = FALSE;
-	g_cond_signal (&updater->cond);
+	g_cond_broadcast (&updater->cond);
 
 	g_mutex_unlock (&updater->mutex);
 
-	g_thread_join (updater->thread);
-
-	updater->thread = NULL;
+	for (i = 0; i < XMMS_PLAYLIST_UPDATER_THREADS; i++) {
+		g_thread_join (updater->threads[i]);
+		updater->threads[i] = NULL;
+	}
 }
 
 /**
@@ -164,17 +178,19 @@ xmms_playlist_updater_loop (xmms_playlist_updater_t *updater)
 {
 	gchar *plname;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
 	g_mutex_lock (&updater->mutex);
 
 	while (updater->keep_running) {
-		if (!updater->stack) {
+		plname = xmms_playlist_updater_pop (updater);
+		if (!plname) {
 			g_cond_wait (&updater->cond, &updater->mutex);
 		} else {
-			plname = xmms_playlist_updater_pop (updater);
 			g_mutex_unlock (&updater->mutex);
 			xmms_playlist_update (updater->playlist, plname);
 			g_mutex_lock (&updater->mutex);
-			g_free (plname);
+			xmms_playlist_updater_done (updater, plname);
 		}
 	}
 
@@ -206,17 +222,42 @@ xmms_playlist_updater_need_update (xmms_object_t *object, xmmsv_t *val,
 	xmms_playlist_updater_push (updater, plname);
 }
 
+/**
+ * Take the oldest pending playlist that isn't being updated already,
+ * NULL if there is none.
+ */
 static gchar *
 xmms_playlist_updater_pop (xmms_playlist_updater_t *updater)
 {
-	GList *head;
+	GList *it;
 	gchar *plname;
 
-	head = updater->stack;
-	plname = (gchar *) head->data;
-	updater->stack = g_list_delete_link (updater->stack, head);
+	for (it = updater->pending.head; it; it = g_list_next (it)) {
+		plname = (gchar *) it->data;
+		if (!g_hash_table_contains (updater->updating, plname)) {
+			g_queue_delete_link (&updater->pending, it);
+			g_hash_table_remove (updater->queued, plname);
+			g_hash_table_add (updater->updating, plname);
+			return plname;
+		}
+	}
 
-	return plname;
+	return NULL;
+}
+
+/**
+ * Let the other threads take the playlist again, it may have been
+ * queued while it was updated.
+ */
+static void
+xmms_playlist_updater_done (xmms_playlist_updater_t *updater, gchar *plname)
+{
+	g_hash_table_remove (updater->updating, plname);
+	g_free (plname);
+
+	if (!g_queue_is_empty (&updater->pending)) {
+		g_cond_broadcast (&updater->cond);
+	}
 }
 
 /**
@@ -232,8 +273,11 @@ xmms_playlist_updater_push (xmms_playlist_updater_t *updater,
 	g_mutex_lock (&updater->mutex);
 
 	/* don't schedule the playlist if it's already scheduled */
-	if (!g_list_find_custom (updater->stack, plname, (GCompareFunc) g_strcmp0)) {
-		updater->stack = g_list_prepend (updater->stack, g_strdup (plname));
+	if (!g_hash_table_contains (updater->queued, plname)) {
+		gchar *name = g_strdup (plname);
+
+		g_queue_push_tail (&updater->pending, name);
+		g_hash_table_add (updater->queued, name);
 		g_cond_signal (&updater->cond);
 	}
 
@@ -23,8 +23,13 @@
 #include <xmmspriv/xmms_playlist.h>
 #include <xmmspriv/xmms_outputplugin.h>
 #include <xmmspriv/xmms_xform.h>
+#include <xmmspriv/xmms_xform_plugin.h>
+#include <xmmspriv/xmms_magic.h>
+#include <xmmsc/xmmsc_util.h>
+#include <xmmsc/xmmsv_util.h>
 
 #include <gmodule.h>
+#include <glib/gstdio.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -46,11 +51,26 @@ extern xmms_plugin_desc_t *xmms_builtin_plugins[];
  */
 static GList *xmms_plugin_list;
 
+/**
+ * A plugin the manifest said takes only exact mimetypes, left unopened
+ * until a stream of one of them (or the plugin by name) is asked for.
+ */
+typedef struct {
+	gchar *path;
+	gchar *shortname;
+	xmmsv_t *mimetypes;
+} xmms_plugin_deferred_t;
+
+/* The plugin list and the deferred plugins, recursive as loading a
+ * deferred plugin adds to the list. */
+static GRecMutex xmms_plugin_lock;
+static GList *xmms_plugin_deferred;
+
 /*
  * Function prototypes
  */
 static gboolean xmms_plugin_setup (xmms_plugin_t *plugin, const xmms_plugin_desc_t *desc);
-static gboolean xmms_plugin_scan_directory (const gchar *dir);
+static gboolean xmms_plugin_scan_directory (const gchar *dir, gboolean lazy);
 
 /*
  * Public functions
@@ -204,6 +224,8 @@ xmms_plugin_add_builtin_plugins (void)
 	extern const xmms_plugin_desc_t xmms_builtin_nibbler;
 	extern const xmms_plugin_desc_t xmms_builtin_visualization;
 	extern const xmms_plugin_desc_t xmms_builtin_ringbuf;
+	extern const xmms_plugin_desc_t xmms_builtin_diskcache;
+	extern const xmms_plugin_desc_t xmms_builtin_sandbox;
 
 	xmms_plugin_load (&xmms_builtin_magic, NULL);
 	xmms_plugin_load (&xmms_builtin_converter, NULL);
@@ -211,6 +233,8 @@ xmms_plugin_add_builtin_plugins (void)
 	xmms_plugin_load (&xmms_builtin_nibbler, NULL);
 	xmms_plugin_load (&xmms_builtin_visualization, NULL);
 	xmms_plugin_load (&xmms_builtin_ringbuf, NULL);
+	xmms_plugin_load (&xmms_builtin_diskcache, NULL);
+	xmms_plugin_load (&xmms_builtin_sandbox, NULL);
 
 	/* load static plugins */
 	for (i = 0; xmms_builtin_plugins[i]; i++)
@@ -226,10 +250,15 @@ xmms_plugin_add_builtin_plugins (void)
 gboolean
 xmms_plugin_init (const gchar *path)
 {
+	xmms_config_property_t *cv;
+
 	if (!path)
 		path = PKGLIBDIR;
 
-	xmms_plugin_scan_directory (path);
+	cv = xmms_config_property_register ("core.plugin_lazy", "0", NULL, NULL);
+
+	xmms_plugin_scan_directory (path,
+	                            xmms_config_property_get_int (cv) != 0);
 
 	xmms_plugin_add_builtin_plugins ();
 	return TRUE;
@@ -270,6 +299,18 @@ xmms_plugin_shutdown ()
 		xmms_plugin_list = g_list_delete_link (xmms_plugin_list,
 		                                       xmms_plugin_list);
 	}
+
+	while (xmms_plugin_deferred) {
+		xmms_plugin_deferred_t *d = xmms_plugin_deferred->data;
+
+		g_free (d->path);
+		g_free (d->shortname);
+		xmmsv_unref (d->mimetypes);
+		g_free (d);
+
+		xmms_plugin_deferred = g_list_delete_link (xmms_plugin_deferred,
+		                                           xmms_plugin_deferred);
+	}
 }
 
 /**
@@ -336,25 +377,268 @@ xmms_plugin_load (const xmms_plugin_desc_t *desc, GModule *module)
 
 	plugin->module = module;
 
+	g_rec_mutex_lock (&xmms_plugin_lock);
 	xmms_plugin_list = g_list_prepend (xmms_plugin_list, plugin);
+	g_rec_mutex_unlock (&xmms_plugin_lock);
+	return TRUE;
+}
+
+/**
+ * @internal Open a plugin file and load the plugin in it.
+ * @param[in] path Absolute path to the plugin file
+ * @return TRUE if the plugin was loaded
+ */
+static gboolean
+xmms_plugin_load_file (const gchar *path)
+{
+	GModule *module;
+	gpointer sym;
+
+	XMMS_DBG ("Trying to load file: %s", path);
+	module = g_module_open (path, G_MODULE_BIND_LOCAL);
+	if (!module) {
+		xmms_log_error ("Failed to open plugin %s: %s",
+		                path, g_module_error ());
+		return FALSE;
+	}
+
+	if (!g_module_symbol (module, "XMMS_PLUGIN_DESC", &sym)) {
+		xmms_log_error ("Failed to find plugin header in %s", path);
+		g_module_close (module);
+		return FALSE;
+	}
+
+	if (!xmms_plugin_load ((const xmms_plugin_desc_t *) sym, module)) {
+		g_module_close (module);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gchar *
+xmms_plugin_manifest_path (void)
+{
+	gchar cachedir[XMMS_PATH_MAX];
+
+	if (!xmms_usercachedir_get (cachedir, XMMS_PATH_MAX)) {
+		return NULL;
+	}
+
+	return g_build_filename (cachedir, "plugins.manifest", NULL);
+}
+
+/**
+ * @internal Read the manifest of the last scan, a dict from file name
+ * to a dict of mtime, size, shortname, mimetypes and magic.
+ */
+static xmmsv_t *
+xmms_plugin_manifest_read (const gchar *path)
+{
+	xmmsv_t *bin, *manifest;
+	gchar *data;
+	gsize len;
+
+	if (!path || !g_file_get_contents (path, &data, &len, NULL)) {
+		return xmmsv_new_dict ();
+	}
+
+	bin = xmmsv_new_bin ((const guchar *) data, len);
+	manifest = xmmsv_deserialize (bin);
+	xmmsv_unref (bin);
+	g_free (data);
+
+	if (!manifest || !xmmsv_is_type (manifest, XMMSV_TYPE_DICT)) {
+		if (manifest) {
+			xmmsv_unref (manifest);
+		}
+		return xmmsv_new_dict ();
+	}
+
+	return manifest;
+}
+
+static void
+xmms_plugin_manifest_write (const gchar *path, xmmsv_t *manifest)
+{
+	const guchar *data, *old_data;
+	xmmsv_t *bin;
+	gchar *old;
+	gsize old_len;
+	guint len;
+
+	bin = xmmsv_serialize (manifest);
+	if (!bin || !xmmsv_get_bin (bin, &data, &len)) {
+		if (bin) {
+			xmmsv_unref (bin);
+		}
+		return;
+	}
+
+	/* most startups find nothing changed */
+	if (g_file_get_contents (path, &old, &old_len, NULL)) {
+		old_data = (const guchar *) old;
+		if (old_len == len && memcmp (old_data, data, len) == 0) {
+			g_free (old);
+			xmmsv_unref (bin);
+			return;
+		}
+		g_free (old);
+	}
+
+	if (!g_file_set_contents (path, (const gchar *) data, len, NULL)) {
+		xmms_log_error ("Couldn't write plugin manifest %s", path);
+	}
+
+	xmmsv_unref (bin);
+}
+
+/**
+ * @internal Whether a manifest entry still describes the file and
+ * the plugin can be left unopened.
+ */
+static gboolean
+xmms_plugin_manifest_valid (xmmsv_t *entry, GStatBuf *st)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *mimetypes;
+	const gchar *mime;
+	gint64 mtime, size;
+
+	if (!entry ||
+	    !xmmsv_dict_entry_get_int64 (entry, "mtime", &mtime) ||
+	    !xmmsv_dict_entry_get_int64 (entry, "size", &size) ||
+	    !xmmsv_dict_get (entry, "mimetypes", &mimetypes)) {
+		return FALSE;
+	}
+
+	if (mtime != (gint64) st->st_mtime || size != (gint64) st->st_size) {
+		return FALSE;
+	}
+
+	/* a plugin with patterns could be asked for any stream */
+	if (xmmsv_list_get_size (mimetypes) == 0) {
+		return FALSE;
+	}
+	xmmsv_get_list_iter (mimetypes, &it);
+	for (; xmmsv_list_iter_entry_string (it, &mime); xmmsv_list_iter_next (it)) {
+		if (strchr (mime, '*') || strchr (mime, '?')) {
+			return FALSE;
+		}
+	}
+
 	return TRUE;
 }
 
+/**
+ * @internal What the manifest keeps of a plugin just loaded from a file.
+ */
+static xmmsv_t *
+xmms_plugin_manifest_entry (GStatBuf *st, xmmsv_t *magic)
+{
+	xmms_plugin_t *plugin;
+	xmmsv_t *entry, *mimetypes;
+
+	plugin = xmms_plugin_list->data;
+	if (plugin->type != XMMS_PLUGIN_TYPE_XFORM) {
+		return NULL;
+	}
+
+	mimetypes = xmms_xform_plugin_in_mimetypes ((xmms_xform_plugin_t *) plugin);
+	entry = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("mtime", st->st_mtime),
+	                          XMMSV_DICT_ENTRY_INT ("size", st->st_size),
+	                          XMMSV_DICT_ENTRY_STR ("shortname", plugin->shortname),
+	                          XMMSV_DICT_ENTRY ("mimetypes", mimetypes),
+	                          XMMSV_DICT_ENTRY ("magic", xmmsv_ref (magic)),
+	                          XMMSV_DICT_END);
+
+	return entry;
+}
+
+/**
+ * @internal Load the deferred plugins that take mime or are called
+ * shortname, or all of them if both are NULL.
+ */
+void
+xmms_plugin_load_deferred (const gchar *mime, const gchar *shortname)
+{
+	xmms_plugin_deferred_t *d;
+	GList *n, *next;
+	const gchar *m;
+	gboolean load;
+	gint i;
+
+	if (!g_atomic_pointer_get (&xmms_plugin_deferred)) {
+		return;
+	}
+
+	g_rec_mutex_lock (&xmms_plugin_lock);
+
+	/* their magic is in from the manifest already */
+	xmms_magic_mute (TRUE);
+
+	for (n = xmms_plugin_deferred; n; n = next) {
+		next = g_list_next (n);
+		d = n->data;
+
+		load = !mime && !shortname;
+		if (shortname && !g_ascii_strcasecmp (shortname, d->shortname)) {
+			load = TRUE;
+		}
+		for (i = 0; mime && !load &&
+		     xmmsv_list_get_string (d->mimetypes, i, &m); i++) {
+			load = strcmp (m, mime) == 0;
+		}
+		if (!load) {
+			continue;
+		}
+
+		XMMS_DBG ("Loading deferred plugin '%s'", d->shortname);
+		xmms_plugin_load_file (d->path);
+
+		g_atomic_pointer_set (&xmms_plugin_deferred,
+		                      g_list_delete_link (xmms_plugin_deferred, n));
+		g_free (d->path);
+		g_free (d->shortname);
+		xmmsv_unref (d->mimetypes);
+		g_free (d);
+	}
+
+	xmms_magic_mute (FALSE);
+
+	g_rec_mutex_unlock (&xmms_plugin_lock);
+}
+
+/**
+ * @internal The number of plugins loaded and the ones still deferred.
+ */
+void
+xmms_plugin_stats_get (guint *loaded, guint *deferred)
+{
+	g_rec_mutex_lock (&xmms_plugin_lock);
+	*loaded = g_list_length (xmms_plugin_list);
+	*deferred = g_list_length (xmms_plugin_deferred);
+	g_rec_mutex_unlock (&xmms_plugin_lock);
+}
+
 /**
  * @internal Scan a particular directory for plugins to load
  * @param[in] dir Absolute path to plugins directory
+ * @param[in] lazy Leave the xforms the manifest knows unopened
  * @return TRUE if directory successfully scanned for plugins
  */
 static gboolean
-xmms_plugin_scan_directory (const gchar *dir)
+xmms_plugin_scan_directory (const gchar *dir, gboolean lazy)
 {
 	GDir *d;
 	const char *name;
 	gchar *path;
 	gchar *temp;
 	gchar *pattern;
-	GModule *module;
-	gpointer sym;
+	gchar *manifest_path = NULL;
+	xmmsv_t *manifest = NULL, *updated = NULL;
+	xmmsv_t *entry, *magic;
+	GStatBuf st;
 
 	temp = get_module_ext (dir);
 
@@ -367,45 +651,84 @@ xmms_plugin_scan_directory (const gchar *dir)
 	d = g_dir_open (dir, 0, NULL);
 	if (!d) {
 		xmms_log_error ("Failed to open plugin directory (%s)", dir);
+		g_free (pattern);
 		return FALSE;
 	}
 
+	if (lazy) {
+		manifest_path = xmms_plugin_manifest_path ();
+		manifest = xmms_plugin_manifest_read (manifest_path);
+		updated = xmmsv_new_dict ();
+	}
+
 	while ((name = g_dir_read_name (d))) {
 
 		if (!g_pattern_match_simple (pattern, name))
 			continue;
 
 		path = g_build_filename (dir, name, NULL);
-		if (!g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+		if (g_stat (path, &st) != 0 || !S_ISREG (st.st_mode)) {
 			g_free (path);
 			continue;
 		}
 
-		XMMS_DBG ("Trying to load file: %s", path);
-		module = g_module_open (path, G_MODULE_BIND_LOCAL);
-		if (!module) {
-			xmms_log_error ("Failed to open plugin %s: %s",
-			                path, g_module_error ());
+		if (!lazy) {
+			xmms_plugin_load_file (path);
 			g_free (path);
 			continue;
 		}
 
-		if (!g_module_symbol (module, "XMMS_PLUGIN_DESC", &sym)) {
-			xmms_log_error ("Failed to find plugin header in %s", path);
-			g_module_close (module);
-			g_free (path);
+		entry = NULL;
+		xmmsv_dict_get (manifest, name, &entry);
+
+		if (xmms_plugin_manifest_valid (entry, &st)) {
+			xmms_plugin_deferred_t *deferred;
+			const gchar *shortname = NULL;
+
+			deferred = g_new0 (xmms_plugin_deferred_t, 1);
+			deferred->path = path;
+			xmmsv_dict_entry_get_string (entry, "shortname", &shortname);
+			deferred->shortname = g_strdup (shortname ? shortname : name);
+			xmmsv_dict_get (entry, "mimetypes", &deferred->mimetypes);
+			xmmsv_ref (deferred->mimetypes);
+
+			if (xmmsv_dict_get (entry, "magic", &magic)) {
+				xmms_magic_replay (magic);
+			}
+
+			xmms_plugin_deferred = g_list_prepend (xmms_plugin_deferred,
+			                                       deferred);
+			xmmsv_dict_set (updated, name, entry);
 			continue;
 		}
-		g_free (path);
 
-		if (!xmms_plugin_load ((const xmms_plugin_desc_t *) sym, module)) {
-			g_module_close (module);
+		magic = xmmsv_new_list ();
+		xmms_magic_capture (magic);
+		if (xmms_plugin_load_file (path)) {
+			entry = xmms_plugin_manifest_entry (&st, magic);
+			if (entry) {
+				xmmsv_dict_set (updated, name, entry);
+				xmmsv_unref (entry);
+			}
 		}
+		xmms_magic_capture (NULL);
+		xmmsv_unref (magic);
+		g_free (path);
 	}
 
 	g_dir_close (d);
 	g_free (pattern);
 
+	if (lazy) {
+		XMMS_DBG ("%d plugins deferred", g_list_length (xmms_plugin_deferred));
+		if (manifest_path) {
+			xmms_plugin_manifest_write (manifest_path, updated);
+		}
+		xmmsv_unref (manifest);
+		xmmsv_unref (updated);
+		g_free (manifest_path);
+	}
+
 	return TRUE;
 }
 
@@ -420,6 +743,7 @@ xmms_plugin_foreach (xmms_plugin_type_t type, xmms_plugin_foreach_func_t func, g
 {
 	GList *node;
 
+	g_rec_mutex_lock (&xmms_plugin_lock);
 	for (node = xmms_plugin_list; node; node = g_list_next (node)) {
 		xmms_plugin_t *plugin = node->data;
 
@@ -428,6 +752,7 @@ xmms_plugin_foreach (xmms_plugin_type_t type, xmms_plugin_foreach_func_t func, g
 				break;
 		}
 	}
+	g_rec_mutex_unlock (&xmms_plugin_lock);
 }
 
 typedef struct {
@@ -459,6 +784,10 @@ xmms_plugin_find (xmms_plugin_type_t type, const gchar *name)
 {
 	xmms_plugin_find_foreach_data_t data = {name, NULL};
 	xmms_plugin_foreach (type, xmms_plugin_find_foreach, &data);
+	if (!data.plugin && g_atomic_pointer_get (&xmms_plugin_deferred)) {
+		xmms_plugin_load_deferred (NULL, name);
+		xmms_plugin_foreach (type, xmms_plugin_find_foreach, &data);
+	}
 	return data.plugin;
 }
 
@@ -0,0 +1,289 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ *  A LRU cache of serialized collection query results.
+ *
+ *  Results are remembered together with the medialib generation they
+ *  were computed at, and are only served while it stays the same.
+ */
+
+#include <xmmspriv/xmms_querycache.h>
+#include <xmmspriv/xmms_lru.h>
+#include <xmmspriv/xmms_memstat.h>
+#include <xmms/xmms_log.h>
+
+#include <string.h>
+
+typedef struct xmms_query_cache_entry_St {
+	guint generation;
+	/** The result as serialized by xmmsv_serialize */
+	xmmsv_t *result;
+	/** Bytes of key and result, for the memory accounting */
+	gsize size;
+} xmms_query_cache_entry_t;
+
+struct xmms_query_cache_St {
+	GMutex mutex;
+	xmms_lru_t *lru;
+};
+
+static void
+xmms_query_cache_entry_free (gpointer data)
+{
+	xmms_query_cache_entry_t *entry = data;
+
+	xmms_memstat_sub (XMMS_MEMSTAT_MEDIALIB_RESULTS, entry->size);
+	xmmsv_unref (entry->result);
+	g_free (entry);
+}
+
+xmms_query_cache_t *
+xmms_query_cache_new (guint max_entries)
+{
+	xmms_query_cache_t *cache;
+
+	cache = g_new0 (xmms_query_cache_t, 1);
+	g_mutex_init (&cache->mutex);
+	cache->lru = xmms_lru_new (g_bytes_hash, g_bytes_equal,
+	                           (GDestroyNotify) g_bytes_unref,
+	                           xmms_query_cache_entry_free, max_entries);
+
+	return cache;
+}
+
+void
+xmms_query_cache_free (xmms_query_cache_t *cache)
+{
+	g_return_if_fail (cache);
+
+	xmms_lru_free (cache->lru);
+	g_mutex_clear (&cache->mutex);
+	g_free (cache);
+}
+
+void
+xmms_query_cache_set_max_entries (xmms_query_cache_t *cache, guint max_entries)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_set_max_entries (cache->lru, max_entries);
+	g_mutex_unlock (&cache->mutex);
+}
+
+static gboolean
+xmms_query_cache_coll_cacheable (xmmsv_t *coll)
+{
+	xmmsv_list_iter_t *it;
+	xmmsv_t *operand, *seed;
+	const gchar *type;
+	gboolean ret = TRUE;
+
+	switch (xmmsv_coll_get_type (coll)) {
+		case XMMS_COLLECTION_TYPE_IDLIST:
+		case XMMS_COLLECTION_TYPE_QUEUE:
+		case XMMS_COLLECTION_TYPE_PARTYSHUFFLE:
+			/* playlists are changed in place, without notice */
+			return FALSE;
+		case XMMS_COLLECTION_TYPE_ORDER:
+			if (xmmsv_coll_attribute_get_string (coll, "type", &type) &&
+			    strcmp (type, "random") == 0 &&
+			    !xmmsv_coll_attribute_get_value (coll, "seed", &seed)) {
+				return FALSE;
+			}
+			break;
+		default:
+			break;
+	}
+
+	xmmsv_get_list_iter (xmmsv_coll_operands_get (coll), &it);
+	while (ret && xmmsv_list_iter_entry (it, &operand)) {
+		ret = xmms_query_cache_coll_cacheable (operand);
+		xmmsv_list_iter_next (it);
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+
+	return ret;
+}
+
+static gboolean
+xmms_query_cache_fetch_cacheable (xmmsv_t *fetch)
+{
+	xmmsv_list_iter_t *lit;
+	xmmsv_dict_iter_t *dit;
+	const gchar *str;
+	xmmsv_t *value;
+	gboolean ret = TRUE;
+
+	switch (xmmsv_get_type (fetch)) {
+		case XMMSV_TYPE_STRING:
+			/* the random aggregate differs on every run */
+			xmmsv_get_string (fetch, &str);
+			ret = strcmp (str, "random") != 0;
+			break;
+		case XMMSV_TYPE_LIST:
+			xmmsv_get_list_iter (fetch, &lit);
+			while (ret && xmmsv_list_iter_entry (lit, &value)) {
+				ret = xmms_query_cache_fetch_cacheable (value);
+				xmmsv_list_iter_next (lit);
+			}
+			xmmsv_list_iter_explicit_destroy (lit);
+			break;
+		case XMMSV_TYPE_DICT:
+			xmmsv_get_dict_iter (fetch, &dit);
+			while (ret && xmmsv_dict_iter_pair (dit, NULL, &value)) {
+				ret = xmms_query_cache_fetch_cacheable (value);
+				xmmsv_dict_iter_next (dit);
+			}
+			xmmsv_dict_iter_explicit_destroy (dit);
+			break;
+		default:
+			break;
+	}
+
+	return ret;
+}
+
+/**
+ * Build the cache key for querying coll with fetch, coll should have
+ * its references bound.
+ *
+ * @returns The key, or NULL if the result can't be cached.
+ */
+GBytes *
+xmms_query_cache_key (xmmsv_t *coll, xmmsv_t *fetch)
+{
+	const unsigned char *data;
+	unsigned int len;
+	xmmsv_t *pair, *serialized;
+	GBytes *key = NULL;
+
+	if (!xmms_query_cache_coll_cacheable (coll) ||
+	    !xmms_query_cache_fetch_cacheable (fetch)) {
+		return NULL;
+	}
+
+	pair = xmmsv_build_list (xmmsv_ref (coll), xmmsv_ref (fetch), XMMSV_LIST_END);
+	serialized = xmmsv_serialize (pair);
+	xmmsv_unref (pair);
+
+	if (serialized && xmmsv_get_bin (serialized, &data, &len)) {
+		key = g_bytes_new (data, len);
+	}
+
+	if (serialized) {
+		xmmsv_unref (serialized);
+	}
+
+	return key;
+}
+
+/**
+ * Look up a result computed at the given medialib generation.
+ *
+ * @returns A new result owned by the caller, or NULL on a miss.
+ */
+xmmsv_t *
+xmms_query_cache_lookup (xmms_query_cache_t *cache, GBytes *key,
+                         guint generation)
+{
+	xmms_query_cache_entry_t *entry;
+	xmmsv_t *ret = NULL;
+
+	g_return_val_if_fail (cache, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	g_mutex_lock (&cache->mutex);
+
+	entry = xmms_lru_lookup (cache->lru, key);
+	if (entry && entry->generation != generation) {
+		xmms_lru_remove (cache->lru, key);
+		entry = NULL;
+	}
+
+	if (entry) {
+		ret = xmmsv_deserialize (entry->result);
+	}
+
+	xmms_lru_account (cache->lru, ret != NULL);
+
+	g_mutex_unlock (&cache->mutex);
+
+	return ret;
+}
+
+/**
+ * Remember the result of a query. The result isn't kept, a serialized
+ * copy is.
+ */
+void
+xmms_query_cache_insert (xmms_query_cache_t *cache, GBytes *key,
+                         guint generation, xmmsv_t *result)
+{
+	xmms_query_cache_entry_t *entry;
+	xmmsv_t *serialized;
+
+	g_return_if_fail (cache);
+	g_return_if_fail (key);
+	g_return_if_fail (result);
+
+	if (!xmms_lru_get_max_entries (cache->lru)) {
+		return;
+	}
+
+	serialized = xmmsv_serialize (result);
+	if (!serialized) {
+		return;
+	}
+
+	entry = g_new0 (xmms_query_cache_entry_t, 1);
+	entry->generation = generation;
+	entry->result = serialized;
+	entry->size = sizeof (*entry) + g_bytes_get_size (key) +
+	              xmms_memstat_value_size (serialized);
+	xmms_memstat_add (XMMS_MEMSTAT_MEDIALIB_RESULTS, entry->size);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_insert (cache->lru, g_bytes_ref (key), entry);
+	g_mutex_unlock (&cache->mutex);
+}
+
+/**
+ * Forget all results, for when collections change.
+ */
+void
+xmms_query_cache_clear (xmms_query_cache_t *cache)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_remove_all (cache->lru);
+	g_mutex_unlock (&cache->mutex);
+}
+
+void
+xmms_query_cache_stats (xmms_query_cache_t *cache, guint *hits,
+                        guint *misses, guint *entries)
+{
+	g_return_if_fail (cache);
+
+	g_mutex_lock (&cache->mutex);
+	xmms_lru_stats (cache->lru, hits, misses, entries);
+	g_mutex_unlock (&cache->mutex);
+}
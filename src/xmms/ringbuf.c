@@ -18,14 +18,35 @@
 
 
 #include <xmmspriv/xmms_ringbuf.h>
+#include <xmmspriv/xmms_realtime.h>
+#include <xmmspriv/xmms_memstat.h>
 #include <string.h>
 
 /** @defgroup Ringbuffer Ringbuffer
   * @ingroup XMMSServer
   * @brief Ringbuffer primitive.
+  *
+  * The buffer is safe for one writer and one reader running at the
+  * same time. The writer side is serialized by the mutex passed to the
+  * waiting functions, the reader may use #xmms_ringbuf_wait_used_unlocked
+  * and #xmms_ringbuf_read without holding that mutex at all.
   * @{
   */
 
+#define XMMS_RINGBUF_CACHELINE 64
+
+/* The reader wakes the writer without holding the writer's mutex, so
+ * a wakeup may be missed; bound how long the writer sleeps. */
+#define XMMS_RINGBUF_WRITER_WAIT (10 * G_TIME_SPAN_MILLISECOND)
+
+typedef struct xmms_ringbuf_hotspot_St {
+	guint pos;
+	gboolean (*callback) (void *);
+	void (*destroy) (void *);
+	void *arg;
+	struct xmms_ringbuf_hotspot_St *next;
+} xmms_ringbuf_hotspot_t;
+
 /**
  * A ringbuffer
  */
@@ -36,23 +57,50 @@ struct xmms_ringbuf_St {
 	guint buffer_size;
 	/** Actually usable number of bytes */
 	guint buffer_size_usable;
-	/** Read and write index */
-	guint rd_index, wr_index;
-	gboolean eos;
-
-	GQueue *hotspots;
+	/** Whether #buffer is locked into memory */
+	gboolean locked;
+
+	/** Read index, only advanced by the reader */
+	gint rd_index;
+	guint8 rd_pad[XMMS_RINGBUF_CACHELINE - sizeof (gint)];
+	/** Write index, only advanced by the writer */
+	gint wr_index;
+	guint8 wr_pad[XMMS_RINGBUF_CACHELINE - sizeof (gint)];
+
+	gint eos;
+
+	/** Bytes behind the read index the writer leaves alone, so the
+	 * reader can go back with #xmms_ringbuf_rewind */
+	guint history_size;
+	/** How much of that is valid data, reader only */
+	guint history;
+
+	/** Space handed out by #xmms_ringbuf_reserve, writer only */
+	guint reserved_pos;
+	guint reserved_len;
+
+	/** Hotspots, a single producer single consumer list. The head
+	 * is a dummy node owned by the reader, the tail is owned by the
+	 * writer. */
+	xmms_ringbuf_hotspot_t *hs_head;
+	xmms_ringbuf_hotspot_t *hs_tail;
+	/** A hotspot callback is running, #xmms_ringbuf_try_read must
+	 * not get past it meanwhile. Protected by read_lock */
+	gboolean hs_running;
+
+	/** Held by the reader while copying data, and by
+	 * #xmms_ringbuf_clear, never while running hotspots. */
+	GMutex read_lock;
 
 	GCond free_cond;
 	GCond used_cond;
 	GCond eos_cond;
-};
 
-typedef struct xmms_ringbuf_hotspot_St {
-	guint pos;
-	gboolean (*callback) (void *);
-	void (*destroy) (void *);
-	void *arg;
-} xmms_ringbuf_hotspot_t;
+	/** Wakeups for a reader that doesn't hold the writer's mutex */
+	GMutex reader_lock;
+	GCond reader_cond;
+	gint reader_waiting;
+};
 
 
 /**
@@ -78,7 +126,7 @@ xmms_ringbuf_new (guint size)
 	xmms_ringbuf_t *ringbuf = g_new0 (xmms_ringbuf_t, 1);
 
 	g_return_val_if_fail (size > 0, NULL);
-	g_return_val_if_fail (size < G_MAXUINT, NULL);
+	g_return_val_if_fail (size < G_MAXINT, NULL);
 
 	/* we need to allocate one byte more than requested, cause the
 	 * final byte cannot be used.
@@ -89,16 +137,38 @@ xmms_ringbuf_new (guint size)
 	ringbuf->buffer_size_usable = size;
 	ringbuf->buffer_size = size + 1;
 	ringbuf->buffer = g_malloc (ringbuf->buffer_size);
+	xmms_memstat_add (XMMS_MEMSTAT_RINGBUFFERS, ringbuf->buffer_size);
 
+	g_mutex_init (&ringbuf->read_lock);
 	g_cond_init (&ringbuf->free_cond);
 	g_cond_init (&ringbuf->used_cond);
 	g_cond_init (&ringbuf->eos_cond);
+	g_mutex_init (&ringbuf->reader_lock);
+	g_cond_init (&ringbuf->reader_cond);
 
-	ringbuf->hotspots = g_queue_new ();
+	ringbuf->hs_head = g_new0 (xmms_ringbuf_hotspot_t, 1);
+	ringbuf->hs_tail = ringbuf->hs_head;
 
 	return ringbuf;
 }
 
+/**
+ * Drop all hotspots without running them.
+ * Should hold read_lock.
+ */
+static void
+xmms_ringbuf_hotspots_clear (xmms_ringbuf_t *ringbuf)
+{
+	xmms_ringbuf_hotspot_t *hs;
+
+	while ((hs = g_atomic_pointer_get (&ringbuf->hs_head->next))) {
+		if (hs->destroy)
+			hs->destroy (hs->arg);
+		g_free (ringbuf->hs_head);
+		ringbuf->hs_head = hs;
+	}
+}
+
 /**
  * Free all memory used by the ringbuffer
  */
@@ -107,15 +177,63 @@ xmms_ringbuf_destroy (xmms_ringbuf_t *ringbuf)
 {
 	g_return_if_fail (ringbuf);
 
+	xmms_ringbuf_hotspots_clear (ringbuf);
+	g_free (ringbuf->hs_head);
+
+	g_cond_clear (&ringbuf->reader_cond);
+	g_mutex_clear (&ringbuf->reader_lock);
 	g_cond_clear (&ringbuf->eos_cond);
 	g_cond_clear (&ringbuf->used_cond);
 	g_cond_clear (&ringbuf->free_cond);
+	g_mutex_clear (&ringbuf->read_lock);
 
-	g_queue_free (ringbuf->hotspots);
+	if (ringbuf->locked) {
+		xmms_realtime_mem_unlock (ringbuf->buffer, ringbuf->buffer_size);
+	}
+
+	xmms_memstat_sub (XMMS_MEMSTAT_RINGBUFFERS, ringbuf->buffer_size);
 	g_free (ringbuf->buffer);
 	g_free (ringbuf);
 }
 
+/**
+ * Keep the buffer data in memory, also across #xmms_ringbuf_resize,
+ * so the reader never has to wait for it to be paged in.
+ *
+ * @returns TRUE if the buffer could be locked.
+ */
+gboolean
+xmms_ringbuf_set_locked (xmms_ringbuf_t *ringbuf, gboolean locked)
+{
+	g_return_val_if_fail (ringbuf, FALSE);
+
+	g_mutex_lock (&ringbuf->read_lock);
+	if (locked && !ringbuf->locked) {
+		ringbuf->locked = xmms_realtime_mem_lock (ringbuf->buffer,
+		                                          ringbuf->buffer_size);
+	} else if (!locked && ringbuf->locked) {
+		xmms_realtime_mem_unlock (ringbuf->buffer, ringbuf->buffer_size);
+		ringbuf->locked = FALSE;
+	}
+	locked = ringbuf->locked == locked;
+	g_mutex_unlock (&ringbuf->read_lock);
+
+	return locked;
+}
+
+/**
+ * Wake a reader blocked in #xmms_ringbuf_wait_used_unlocked.
+ */
+static void
+xmms_ringbuf_wake_reader (xmms_ringbuf_t *ringbuf)
+{
+	if (g_atomic_int_get (&ringbuf->reader_waiting)) {
+		g_mutex_lock (&ringbuf->reader_lock);
+		g_cond_broadcast (&ringbuf->reader_cond);
+		g_mutex_unlock (&ringbuf->reader_lock);
+	}
+}
+
 /**
  * Clear the ringbuffers data
  */
@@ -124,17 +242,26 @@ xmms_ringbuf_clear (xmms_ringbuf_t *ringbuf)
 {
 	g_return_if_fail (ringbuf);
 
-	ringbuf->rd_index = 0;
-	ringbuf->wr_index = 0;
+	g_mutex_lock (&ringbuf->read_lock);
+	g_atomic_int_set (&ringbuf->rd_index, 0);
+	g_atomic_int_set (&ringbuf->wr_index, 0);
+	ringbuf->reserved_len = 0;
+	ringbuf->history = 0;
+	xmms_ringbuf_hotspots_clear (ringbuf);
+	g_mutex_unlock (&ringbuf->read_lock);
 
-	while (!g_queue_is_empty (ringbuf->hotspots)) {
-		xmms_ringbuf_hotspot_t *hs;
-		hs = g_queue_pop_head (ringbuf->hotspots);
-		if (hs->destroy)
-			hs->destroy (hs->arg);
-		g_free (hs);
-	}
 	g_cond_signal (&ringbuf->free_cond);
+	xmms_ringbuf_wake_reader (ringbuf);
+}
+
+static guint
+bytes_used (const xmms_ringbuf_t *ringbuf, guint rd, guint wr)
+{
+	if (wr >= rd) {
+		return wr - rd;
+	}
+
+	return ringbuf->buffer_size - (rd - wr);
 }
 
 /**
@@ -143,10 +270,17 @@ xmms_ringbuf_clear (xmms_ringbuf_t *ringbuf)
 guint
 xmms_ringbuf_bytes_free (const xmms_ringbuf_t *ringbuf)
 {
+	guint taken;
+
 	g_return_val_if_fail (ringbuf, 0);
 
-	return ringbuf->buffer_size_usable -
-	       xmms_ringbuf_bytes_used (ringbuf);
+	/* after a rewind the history overlaps the used space for a while */
+	taken = xmms_ringbuf_bytes_used (ringbuf) + ringbuf->history_size;
+	if (taken >= ringbuf->buffer_size_usable) {
+		return 0;
+	}
+
+	return ringbuf->buffer_size_usable - taken;
 }
 
 /**
@@ -157,38 +291,137 @@ xmms_ringbuf_bytes_used (const xmms_ringbuf_t *ringbuf)
 {
 	g_return_val_if_fail (ringbuf, 0);
 
-	if (ringbuf->wr_index >= ringbuf->rd_index) {
-		return ringbuf->wr_index - ringbuf->rd_index;
+	return bytes_used (ringbuf,
+	                   g_atomic_int_get (&ringbuf->rd_index),
+	                   g_atomic_int_get (&ringbuf->wr_index));
+}
+
+/**
+ * Change the usable size of the ringbuffer, keeping the data and the
+ * hotspots in it. The buffer never shrinks below what is queued.
+ * Should hold the writer's mutex.
+ *
+ * @returns The new usable size.
+ */
+guint
+xmms_ringbuf_resize (xmms_ringbuf_t *ringbuf, guint size)
+{
+	xmms_ringbuf_hotspot_t *hs;
+	guint8 *buffer;
+	guint rd, used, cnt;
+
+	g_return_val_if_fail (ringbuf, 0);
+	g_return_val_if_fail (size > 0, 0);
+	g_return_val_if_fail (size < G_MAXINT, 0);
+
+	g_mutex_lock (&ringbuf->read_lock);
+
+	rd = g_atomic_int_get (&ringbuf->rd_index);
+	used = bytes_used (ringbuf, rd, g_atomic_int_get (&ringbuf->wr_index));
+	size = MAX (size, used + ringbuf->history_size);
+
+	if (size == ringbuf->buffer_size_usable) {
+		g_mutex_unlock (&ringbuf->read_lock);
+		return size;
 	}
 
-	return ringbuf->buffer_size - (ringbuf->rd_index - ringbuf->wr_index);
+	/* unwrap the queued data to the start of the new buffer */
+	buffer = g_malloc (size + 1);
+	cnt = MIN (used, ringbuf->buffer_size - rd);
+	memcpy (buffer, ringbuf->buffer + rd, cnt);
+	memcpy (buffer + cnt, ringbuf->buffer, used - cnt);
+
+	for (hs = ringbuf->hs_head->next; hs; hs = hs->next) {
+		hs->pos = (hs->pos - rd + ringbuf->buffer_size) % ringbuf->buffer_size;
+	}
+
+	if (ringbuf->locked) {
+		xmms_realtime_mem_unlock (ringbuf->buffer, ringbuf->buffer_size);
+		ringbuf->locked = xmms_realtime_mem_lock (buffer, size + 1);
+	}
+
+	xmms_memstat_add (XMMS_MEMSTAT_RINGBUFFERS,
+	                  (gssize) (size + 1) - ringbuf->buffer_size);
+	g_free (ringbuf->buffer);
+	ringbuf->buffer = buffer;
+	ringbuf->buffer_size_usable = size;
+	ringbuf->buffer_size = size + 1;
+	ringbuf->reserved_len = 0;
+	/* only the queued data was copied */
+	ringbuf->history = 0;
+
+	g_atomic_int_set (&ringbuf->rd_index, 0);
+	g_atomic_int_set (&ringbuf->wr_index, used);
+
+	g_mutex_unlock (&ringbuf->read_lock);
+
+	g_cond_broadcast (&ringbuf->free_cond);
+
+	return size;
 }
 
+/* with held set, hotspots are left alone and reading stops there */
 static guint
-read_bytes (xmms_ringbuf_t *ringbuf, guint8 *data, guint len)
+read_bytes (xmms_ringbuf_t *ringbuf, guint8 *data, guint len, gboolean advance,
+            gboolean *held)
 {
-	guint to_read, r = 0, cnt, tmp;
+	guint to_read, r = 0, cnt, rd, tmp;
 	gboolean ok;
 
-	to_read = MIN (len, xmms_ringbuf_bytes_used (ringbuf));
+	if (!held) {
+		g_mutex_lock (&ringbuf->read_lock);
+	} else if (!g_mutex_trylock (&ringbuf->read_lock)) {
+		return 0;
+	} else if (ringbuf->hs_running) {
+		*held = TRUE;
+		g_mutex_unlock (&ringbuf->read_lock);
+		return 0;
+	}
+
+	while (TRUE) {
+		xmms_ringbuf_hotspot_t *hs, spot;
+
+		rd = g_atomic_int_get (&ringbuf->rd_index);
+		to_read = MIN (len, bytes_used (ringbuf, rd,
+		                                g_atomic_int_get (&ringbuf->wr_index)));
 
-	while (!g_queue_is_empty (ringbuf->hotspots)) {
-		xmms_ringbuf_hotspot_t *hs = g_queue_peek_head (ringbuf->hotspots);
-		if (hs->pos != ringbuf->rd_index) {
+		hs = g_atomic_pointer_get (&ringbuf->hs_head->next);
+		if (!hs) {
+			break;
+		}
+
+		if (hs->pos != rd) {
 			/* make sure we don't cross a hotspot */
 			to_read = MIN (to_read,
-			               (hs->pos - ringbuf->rd_index + ringbuf->buffer_size)
+			               (hs->pos - rd + ringbuf->buffer_size)
 			               % ringbuf->buffer_size);
 			break;
 		}
 
-		(void) g_queue_pop_head (ringbuf->hotspots);
-		ok = hs->callback (hs->arg);
-		if (hs->destroy)
-			hs->destroy (hs->arg);
-		g_free (hs);
+		if (held) {
+			*held = TRUE;
+			g_mutex_unlock (&ringbuf->read_lock);
+			return 0;
+		}
+
+		spot = *hs;
+		g_free (ringbuf->hs_head);
+		ringbuf->hs_head = hs;
+		ringbuf->hs_running = TRUE;
+
+		/* the hotspot may take locks of its own, and even clear
+		 * the buffer, so run it unlocked */
+		g_mutex_unlock (&ringbuf->read_lock);
+
+		ok = spot.callback (spot.arg);
+		if (spot.destroy)
+			spot.destroy (spot.arg);
+
+		g_mutex_lock (&ringbuf->read_lock);
+		ringbuf->hs_running = FALSE;
 
 		if (!ok) {
+			g_mutex_unlock (&ringbuf->read_lock);
 			return 0;
 		}
 
@@ -196,17 +429,26 @@ read_bytes (xmms_ringbuf_t *ringbuf, guint8 *data, guint len)
 		   hotspots in same position */
 	}
 
-	tmp = ringbuf->rd_index;
+	tmp = rd;
 
 	while (to_read > 0) {
 		cnt = MIN (to_read, ringbuf->buffer_size - tmp);
-		memcpy (data, ringbuf->buffer + tmp, cnt);
+		if (data) {
+			memcpy (data, ringbuf->buffer + tmp, cnt);
+			data += cnt;
+		}
 		tmp = (tmp + cnt) % ringbuf->buffer_size;
 		to_read -= cnt;
 		r += cnt;
-		data += cnt;
 	}
 
+	if (advance && r) {
+		ringbuf->history = MIN (ringbuf->history_size, ringbuf->history + r);
+		g_atomic_int_set (&ringbuf->rd_index, tmp);
+	}
+
+	g_mutex_unlock (&ringbuf->read_lock);
+
 	return r;
 }
 
@@ -229,10 +471,39 @@ xmms_ringbuf_read (xmms_ringbuf_t *ringbuf, gpointer data, guint len)
 	g_return_val_if_fail (data, 0);
 	g_return_val_if_fail (len > 0, 0);
 
-	r = read_bytes (ringbuf, (guint8 *) data, len);
+	r = read_bytes (ringbuf, (guint8 *) data, len, TRUE, NULL);
 
-	ringbuf->rd_index += r;
-	ringbuf->rd_index %= ringbuf->buffer_size;
+	if (r) {
+		g_cond_broadcast (&ringbuf->free_cond);
+	}
+
+	return r;
+}
+
+/**
+ * Like #xmms_ringbuf_read, but for a reader that must not block,
+ * e.g. in a realtime audio callback. Nothing is read while another
+ * thread holds the buffer, and hotspots are not run: reading stops
+ * in front of them, and held is set when one is due. It is then up
+ * to another thread to read past it, which this reader must not get
+ * ahead of.
+ *
+ * @param held set to TRUE when a hotspot is in the way, untouched
+ * otherwise
+ * @returns number of bytes that actually was read.
+ */
+guint
+xmms_ringbuf_try_read (xmms_ringbuf_t *ringbuf, gpointer data, guint len,
+                       gboolean *held)
+{
+	guint r;
+
+	g_return_val_if_fail (ringbuf, 0);
+	g_return_val_if_fail (data, 0);
+	g_return_val_if_fail (len > 0, 0);
+	g_return_val_if_fail (held, 0);
+
+	r = read_bytes (ringbuf, (guint8 *) data, len, TRUE, held);
 
 	if (r) {
 		g_cond_broadcast (&ringbuf->free_cond);
@@ -255,7 +526,136 @@ xmms_ringbuf_peek (xmms_ringbuf_t *ringbuf, gpointer data, guint len)
 	g_return_val_if_fail (len > 0, 0);
 	g_return_val_if_fail (len <= ringbuf->buffer_size_usable, 0);
 
-	return read_bytes (ringbuf, (guint8 *) data, len);
+	return read_bytes (ringbuf, (guint8 *) data, len, FALSE, NULL);
+}
+
+/**
+ * Drop up to len bytes from the ringbuffer as if they were read. Like
+ * #xmms_ringbuf_read this stops at hotspots.
+ *
+ * @returns number of bytes skipped.
+ */
+guint
+xmms_ringbuf_skip (xmms_ringbuf_t *ringbuf, guint len)
+{
+	guint r;
+
+	g_return_val_if_fail (ringbuf, 0);
+
+	if (!len) {
+		return 0;
+	}
+
+	r = read_bytes (ringbuf, NULL, len, TRUE, NULL);
+
+	if (r) {
+		g_cond_broadcast (&ringbuf->free_cond);
+	}
+
+	return r;
+}
+
+/**
+ * Keep the last size bytes read in the buffer so the reader can step
+ * back into them with #xmms_ringbuf_rewind. The space comes out of
+ * what the writer may fill.
+ */
+void
+xmms_ringbuf_set_history (xmms_ringbuf_t *ringbuf, guint size)
+{
+	g_return_if_fail (ringbuf);
+	g_return_if_fail (size < ringbuf->buffer_size_usable);
+
+	g_mutex_lock (&ringbuf->read_lock);
+	ringbuf->history_size = size;
+	ringbuf->history = MIN (ringbuf->history, size);
+	g_mutex_unlock (&ringbuf->read_lock);
+}
+
+/**
+ * Number of already read bytes that can be rewound over.
+ * Only to be used by the reader.
+ */
+guint
+xmms_ringbuf_history (xmms_ringbuf_t *ringbuf)
+{
+	g_return_val_if_fail (ringbuf, 0);
+
+	return ringbuf->history;
+}
+
+/**
+ * Move the read index back len bytes, making already read data
+ * available again. Hotspots already run are not run again.
+ *
+ * @returns FALSE if less than len bytes of history are kept.
+ */
+gboolean
+xmms_ringbuf_rewind (xmms_ringbuf_t *ringbuf, guint len)
+{
+	guint rd;
+
+	g_return_val_if_fail (ringbuf, FALSE);
+
+	g_mutex_lock (&ringbuf->read_lock);
+	if (len > ringbuf->history) {
+		g_mutex_unlock (&ringbuf->read_lock);
+		return FALSE;
+	}
+
+	/* the writer stays history_size behind the old read index, and
+	 * so clear of the bytes in front of the new one */
+	rd = g_atomic_int_get (&ringbuf->rd_index);
+	rd = (rd + ringbuf->buffer_size - len) % ringbuf->buffer_size;
+	ringbuf->history -= len;
+	g_atomic_int_set (&ringbuf->rd_index, rd);
+	g_mutex_unlock (&ringbuf->read_lock);
+
+	return TRUE;
+}
+
+/**
+ * Move the read index forward len bytes without reading them, as if
+ * they were read. Unlike #xmms_ringbuf_skip this is all or nothing,
+ * and it never runs or passes a hotspot.
+ *
+ * @returns FALSE if less than len bytes are buffered before the next
+ * hotspot.
+ */
+gboolean
+xmms_ringbuf_forward (xmms_ringbuf_t *ringbuf, guint len)
+{
+	xmms_ringbuf_hotspot_t *hs;
+	guint rd;
+
+	g_return_val_if_fail (ringbuf, FALSE);
+
+	g_mutex_lock (&ringbuf->read_lock);
+
+	rd = g_atomic_int_get (&ringbuf->rd_index);
+	if (len > bytes_used (ringbuf, rd, g_atomic_int_get (&ringbuf->wr_index))) {
+		g_mutex_unlock (&ringbuf->read_lock);
+		return FALSE;
+	}
+
+	/* one right at the new index is run by the next read */
+	for (hs = g_atomic_pointer_get (&ringbuf->hs_head->next); hs;
+	     hs = g_atomic_pointer_get (&hs->next)) {
+		if ((hs->pos - rd + ringbuf->buffer_size) % ringbuf->buffer_size < len) {
+			g_mutex_unlock (&ringbuf->read_lock);
+			return FALSE;
+		}
+	}
+
+	ringbuf->history = MIN (ringbuf->history_size, ringbuf->history + len);
+	g_atomic_int_set (&ringbuf->rd_index, (rd + len) % ringbuf->buffer_size);
+	g_mutex_unlock (&ringbuf->read_lock);
+
+	if (len) {
+		g_cond_broadcast (&ringbuf->free_cond);
+	}
+
+	return TRUE;
 }
 
 /**
@@ -278,7 +678,7 @@ xmms_ringbuf_read_wait (xmms_ringbuf_t *ringbuf, gpointer data,
 	while (r < len) {
 		res = xmms_ringbuf_read (ringbuf, dest + r, len - r);
 		r += res;
-		if (r == len || ringbuf->eos) {
+		if (r == len || g_atomic_int_get (&ringbuf->eos)) {
 			break;
 		}
 		if (!res)
@@ -323,7 +723,7 @@ guint
 xmms_ringbuf_write (xmms_ringbuf_t *ringbuf, gconstpointer data,
                     guint len)
 {
-	guint to_write, w = 0, cnt;
+	guint to_write, w = 0, cnt, wr;
 	const guint8 *src = data;
 
 	g_return_val_if_fail (ringbuf, 0);
@@ -331,22 +731,88 @@ xmms_ringbuf_write (xmms_ringbuf_t *ringbuf, gconstpointer data,
 	g_return_val_if_fail (len > 0, 0);
 
 	to_write = MIN (len, xmms_ringbuf_bytes_free (ringbuf));
+	wr = g_atomic_int_get (&ringbuf->wr_index);
 
 	while (to_write > 0) {
-		cnt = MIN (to_write, ringbuf->buffer_size - ringbuf->wr_index);
-		memcpy (ringbuf->buffer + ringbuf->wr_index, src + w, cnt);
-		ringbuf->wr_index = (ringbuf->wr_index + cnt) % ringbuf->buffer_size;
+		cnt = MIN (to_write, ringbuf->buffer_size - wr);
+		memcpy (ringbuf->buffer + wr, src + w, cnt);
+		wr = (wr + cnt) % ringbuf->buffer_size;
 		to_write -= cnt;
 		w += cnt;
 	}
 
 	if (w) {
+		/* publish the data only after it has been copied */
+		g_atomic_int_set (&ringbuf->wr_index, wr);
 		g_cond_broadcast (&ringbuf->used_cond);
+		xmms_ringbuf_wake_reader (ringbuf);
 	}
 
 	return w;
 }
 
+/**
+ * Hand out the contiguous free space at the write position, so the
+ * writer can produce data directly into the buffer. The data becomes
+ * visible to the reader with #xmms_ringbuf_commit. Clearing the buffer
+ * in between cancels the reservation.
+ * Should hold the writer's mutex.
+ *
+ * @param ringbuf Ringbuffer to reserve space in.
+ * @param ptr Where to put the pointer to the reserved space.
+ * @returns Number of bytes available at ptr.
+ */
+guint
+xmms_ringbuf_reserve (xmms_ringbuf_t *ringbuf, gpointer *ptr)
+{
+	guint wr;
+
+	g_return_val_if_fail (ringbuf, 0);
+	g_return_val_if_fail (ptr, 0);
+
+	wr = g_atomic_int_get (&ringbuf->wr_index);
+
+	ringbuf->reserved_pos = wr;
+	ringbuf->reserved_len = MIN (xmms_ringbuf_bytes_free (ringbuf),
+	                             ringbuf->buffer_size - wr);
+
+	*ptr = ringbuf->buffer + wr;
+
+	return ringbuf->reserved_len;
+}
+
+/**
+ * Publish len bytes written into the space from #xmms_ringbuf_reserve.
+ * Should hold the writer's mutex.
+ *
+ * @returns Number of bytes committed, 0 if the reservation was lost.
+ */
+guint
+xmms_ringbuf_commit (xmms_ringbuf_t *ringbuf, guint len)
+{
+	guint wr;
+
+	g_return_val_if_fail (ringbuf, 0);
+
+	wr = g_atomic_int_get (&ringbuf->wr_index);
+
+	if (!ringbuf->reserved_len || ringbuf->reserved_pos != wr) {
+		ringbuf->reserved_len = 0;
+		return 0;
+	}
+
+	len = MIN (len, ringbuf->reserved_len);
+	ringbuf->reserved_len = 0;
+
+	if (len) {
+		g_atomic_int_set (&ringbuf->wr_index, (wr + len) % ringbuf->buffer_size);
+		g_cond_broadcast (&ringbuf->used_cond);
+		xmms_ringbuf_wake_reader (ringbuf);
+	}
+
+	return len;
+}
+
 /**
  * Same as #xmms_ringbuf_write but blocks until there is enough free space.
  */
@@ -365,11 +831,12 @@ xmms_ringbuf_write_wait (xmms_ringbuf_t *ringbuf, gconstpointer data,
 
 	while (w < len) {
 		w += xmms_ringbuf_write (ringbuf, src + w, len - w);
-		if (w == len || ringbuf->eos) {
+		if (w == len || g_atomic_int_get (&ringbuf->eos)) {
 			break;
 		}
 
-		g_cond_wait (&ringbuf->free_cond, mtx);
+		g_cond_wait_until (&ringbuf->free_cond, mtx,
+		                   g_get_monotonic_time () + XMMS_RINGBUF_WRITER_WAIT);
 	}
 
 	return w;
@@ -386,8 +853,10 @@ xmms_ringbuf_wait_free (xmms_ringbuf_t *ringbuf, guint len, GMutex *mtx)
 	g_return_if_fail (len <= ringbuf->buffer_size_usable);
 	g_return_if_fail (mtx);
 
-	while ((xmms_ringbuf_bytes_free (ringbuf) < len) && !ringbuf->eos) {
-		g_cond_wait (&ringbuf->free_cond, mtx);
+	while ((xmms_ringbuf_bytes_free (ringbuf) < len) &&
+	       !g_atomic_int_get (&ringbuf->eos)) {
+		g_cond_wait_until (&ringbuf->free_cond, mtx,
+		                   g_get_monotonic_time () + XMMS_RINGBUF_WRITER_WAIT);
 	}
 }
 
@@ -403,11 +872,39 @@ xmms_ringbuf_wait_used (xmms_ringbuf_t *ringbuf, guint len, GMutex *mtx)
 	g_return_if_fail (len <= ringbuf->buffer_size_usable);
 	g_return_if_fail (mtx);
 
-	while ((xmms_ringbuf_bytes_used (ringbuf) < len) && !ringbuf->eos) {
+	while ((xmms_ringbuf_bytes_used (ringbuf) < len) &&
+	       !g_atomic_int_get (&ringbuf->eos)) {
 		g_cond_wait (&ringbuf->used_cond, mtx);
 	}
 }
 
+/**
+ * Same as #xmms_ringbuf_wait_used, but for a reader that does not
+ * hold the writer's mutex.
+ */
+void
+xmms_ringbuf_wait_used_unlocked (xmms_ringbuf_t *ringbuf, guint len)
+{
+	g_return_if_fail (ringbuf);
+	g_return_if_fail (len > 0);
+	g_return_if_fail (len <= ringbuf->buffer_size_usable);
+
+	if (xmms_ringbuf_bytes_used (ringbuf) >= len) {
+		return;
+	}
+
+	g_mutex_lock (&ringbuf->reader_lock);
+	/* announce ourselves before checking again, the writer checks
+	 * the flag after publishing, so one of us sees the other */
+	g_atomic_int_set (&ringbuf->reader_waiting, 1);
+	while ((xmms_ringbuf_bytes_used (ringbuf) < len) &&
+	       !g_atomic_int_get (&ringbuf->eos)) {
+		g_cond_wait (&ringbuf->reader_cond, &ringbuf->reader_lock);
+	}
+	g_atomic_int_set (&ringbuf->reader_waiting, 0);
+	g_mutex_unlock (&ringbuf->reader_lock);
+}
+
 /**
  * Tell if the ringbuffer is EOS
  *
@@ -419,7 +916,8 @@ xmms_ringbuf_iseos (const xmms_ringbuf_t *ringbuf)
 {
 	g_return_val_if_fail (ringbuf, TRUE);
 
-	return !xmms_ringbuf_bytes_used (ringbuf) && ringbuf->eos;
+	return !xmms_ringbuf_bytes_used (ringbuf) &&
+	       g_atomic_int_get (&ringbuf->eos);
 }
 
 /**
@@ -430,12 +928,13 @@ xmms_ringbuf_set_eos (xmms_ringbuf_t *ringbuf, gboolean eos)
 {
 	g_return_if_fail (ringbuf);
 
-	ringbuf->eos = eos;
+	g_atomic_int_set (&ringbuf->eos, eos);
 
 	if (eos) {
 		g_cond_broadcast (&ringbuf->eos_cond);
 		g_cond_broadcast (&ringbuf->used_cond);
 		g_cond_broadcast (&ringbuf->free_cond);
+		xmms_ringbuf_wake_reader (ringbuf);
 	}
 }
 
@@ -467,10 +966,12 @@ xmms_ringbuf_hotspot_set (xmms_ringbuf_t *ringbuf, gboolean (*cb) (void *), void
 	g_return_if_fail (ringbuf);
 
 	hs = g_new0 (xmms_ringbuf_hotspot_t, 1);
-	hs->pos = ringbuf->wr_index;
+	hs->pos = g_atomic_int_get (&ringbuf->wr_index);
 	hs->callback = cb;
 	hs->destroy = destroy;
 	hs->arg = arg;
 
-	g_queue_push_tail (ringbuf->hotspots, hs);
+	/* hs is complete before the reader can see it */
+	g_atomic_pointer_set (&ringbuf->hs_tail->next, hs);
+	ringbuf->hs_tail = hs;
 }
@@ -3,10 +3,12 @@
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_ringbuf.h>
 #include <xmmspriv/xmms_xform.h>
+#include <xmmspriv/xmms_thread_role.h>
 
 /*
    - producer:
      want_buffer -> buffering
+     buffering -> idle (on eos or error)
      want_seek -> seeked
      want_stop -> stopped
 
@@ -22,12 +24,18 @@
 typedef enum xmms_buffer_state_E {
 	STATE_WANT_BUFFER,
 	STATE_BUFFERING,
+	STATE_IDLE,
 	STATE_WANT_SEEK,
 	STATE_SEEK_DONE,
 	STATE_WANT_STOP,
 	STATE_IS_STOPPED
 } xmms_buffer_state_t;
 
+/* Upstream reads grow from the first to the last size while the
+ * source keeps handing out full chunks. */
+#define XMMS_RINGBUF_CHUNK_MIN 4096
+#define XMMS_RINGBUF_CHUNK_MAX 65536
+
 typedef struct xmms_ringbuf_priv_St {
 	GThread *thread;
 
@@ -41,6 +49,13 @@ typedef struct xmms_ringbuf_priv_St {
 	gint64 seek_offset;
 	xmms_xform_seek_mode_t seek_whence;
 	gint64 seek_res;
+
+	/** Stream offset of the next byte the consumer reads */
+	gint64 read_pos;
+
+	/** Producer only */
+	guint8 *chunk;
+	guint chunk_size;
 } xmms_ringbuf_priv_t;
 
 static xmms_xform_plugin_t *ringbuf_plugin;
@@ -52,21 +67,29 @@ xmms_ringbuf_plugin_init (xmms_xform_t *xform)
 {
 	xmms_config_property_t *config;
 	xmms_ringbuf_priv_t *priv;
-	gint buffer_size;
+	gint buffer_size, history;
 
 	priv = g_new0 (xmms_ringbuf_priv_t, 1);
 
 	xmms_xform_private_data_set (xform, priv);
 
 	config = xmms_xform_config_lookup (xform, "buffersize");
-	buffer_size = xmms_config_property_get_int (config);
+	buffer_size = MAX (4096, xmms_config_property_get_int (config));
+
+	config = xmms_xform_config_lookup (xform, "history");
+	history = CLAMP (xmms_config_property_get_int (config), 0, G_MAXINT / 2);
 
 	g_cond_init (&priv->state_cond);
 	g_mutex_init (&priv->state_lock);
 	g_mutex_init (&priv->buffer_lock);
 
 	priv->state = STATE_WANT_BUFFER;
-	priv->buffer = xmms_ringbuf_new (MAX (4096, buffer_size));
+	/* the history comes on top of the read-ahead */
+	priv->buffer = xmms_ringbuf_new (buffer_size + history);
+	xmms_ringbuf_set_history (priv->buffer, history);
+
+	priv->chunk = g_malloc (XMMS_RINGBUF_CHUNK_MAX);
+	priv->chunk_size = XMMS_RINGBUF_CHUNK_MIN;
 
 	priv->thread = g_thread_new ("x2 ringbuf", xmms_ringbuf_xform_thread, xform);
 
@@ -85,12 +108,20 @@ xmms_ringbuf_plugin_destroy (xmms_xform_t *xform)
 	xmms_ringbuf_clear (priv->buffer);
 	while (priv->state != STATE_IS_STOPPED) {
 		priv->state = STATE_WANT_STOP;
+		g_cond_broadcast (&priv->state_cond);
 		g_cond_wait (&priv->state_cond, &priv->state_lock);
 	}
 	g_mutex_unlock (&priv->state_lock);
 
 	g_thread_join (priv->thread);
 
+	xmms_ringbuf_destroy (priv->buffer);
+	g_mutex_clear (&priv->buffer_lock);
+	g_mutex_clear (&priv->state_lock);
+	g_cond_clear (&priv->state_cond);
+	g_free (priv->chunk);
+	g_free (priv);
+
 	XMMS_DBG ("Ringbuf destroyed!");
 }
 
@@ -98,9 +129,51 @@ static gint
 xmms_ringbuf_plugin_read (xmms_xform_t *xform, void *buffer, gint len, xmms_error_t *error)
 {
 	xmms_ringbuf_priv_t *priv;
+	gint res;
+
 	priv = xmms_xform_private_data_get (xform);
 
-	return xmms_ringbuf_read_wait (priv->buffer, buffer, len, &priv->buffer_lock);
+	g_mutex_lock (&priv->buffer_lock);
+	res = xmms_ringbuf_read_wait (priv->buffer, buffer, len, &priv->buffer_lock);
+	g_mutex_unlock (&priv->buffer_lock);
+
+	priv->read_pos += res;
+
+	return res;
+}
+
+/**
+ * Serve a seek from the data already in the buffer: back into the
+ * history that is kept, or forward into what has been read ahead.
+ */
+static gboolean
+xmms_ringbuf_plugin_seek_local (xmms_ringbuf_priv_t *priv, gint64 target)
+{
+	gint64 lo, hi;
+
+	lo = priv->read_pos - xmms_ringbuf_history (priv->buffer);
+	hi = priv->read_pos + xmms_ringbuf_bytes_used (priv->buffer);
+
+	if (target < lo || target > hi) {
+		return FALSE;
+	}
+
+	if (target < priv->read_pos) {
+		if (!xmms_ringbuf_rewind (priv->buffer, priv->read_pos - target)) {
+			return FALSE;
+		}
+	} else if (target > priv->read_pos) {
+		/* a hotspot may stop us early, account for what was skipped */
+		priv->read_pos += xmms_ringbuf_skip (priv->buffer,
+		                                     target - priv->read_pos);
+		if (priv->read_pos != target) {
+			return FALSE;
+		}
+	}
+
+	priv->read_pos = target;
+
+	return TRUE;
 }
 
 static gint64
@@ -111,18 +184,37 @@ xmms_ringbuf_plugin_seek (xmms_xform_t *xform, gint64 offset, xmms_xform_seek_mo
 
 	priv = xmms_xform_private_data_get (xform);
 
+	/* the end of the stream is only known upstream */
+	if (whence == XMMS_XFORM_SEEK_SET &&
+	    xmms_ringbuf_plugin_seek_local (priv, offset)) {
+		return priv->read_pos;
+	} else if (whence == XMMS_XFORM_SEEK_CUR &&
+	           xmms_ringbuf_plugin_seek_local (priv, priv->read_pos + offset)) {
+		return priv->read_pos;
+	}
+
+	/* upstream sees a relative seek from where the producer is */
+	if (whence == XMMS_XFORM_SEEK_CUR) {
+		offset += priv->read_pos;
+		whence = XMMS_XFORM_SEEK_SET;
+	}
+
 	g_mutex_lock (&priv->state_lock);
-	if (priv->state == STATE_BUFFERING) {
+	if (priv->state == STATE_BUFFERING || priv->state == STATE_IDLE) {
 		priv->state = STATE_WANT_SEEK;
 		priv->seek_offset = offset;
 		priv->seek_whence = whence;
 		xmms_ringbuf_set_eos (priv->buffer, TRUE);
+		g_cond_broadcast (&priv->state_cond);
 		while (priv->state == STATE_WANT_SEEK) {
 			g_cond_wait (&priv->state_cond, &priv->state_lock);
 		}
 		xmms_ringbuf_set_eos (priv->buffer, FALSE);
 		if (priv->state == STATE_SEEK_DONE) {
 			res = priv->seek_res;
+			if (res >= 0) {
+				priv->read_pos = res;
+			}
 			priv->state = STATE_WANT_BUFFER;
 		}
 	}
@@ -148,6 +240,9 @@ xmms_ringbuf_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	xmms_xform_plugin_config_property_register (xform_plugin,
 	                                            "buffersize", "1048576",
 	                                            NULL, NULL);
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "history", "262144",
+	                                            NULL, NULL);
 
 	xmms_xform_plugin_indata_add (xform_plugin,
 	                              XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
@@ -158,24 +253,38 @@ xmms_ringbuf_plugin_setup (xmms_xform_plugin_t *xform_plugin)
 	return TRUE;
 }
 
-static void
+/**
+ * Read the next chunk from upstream.
+ *
+ * @returns FALSE on end of stream or error.
+ */
+static gboolean
 fill (xmms_xform_t *xform, xmms_ringbuf_priv_t *priv)
 {
 	xmms_error_t err;
-	char buf[4096];
 	int res;
 
-	res = xmms_xform_read (xform, buf, sizeof (buf), &err);
-	if (res > 0) {
-		xmms_ringbuf_write_wait (priv->buffer, buf, res, &priv->buffer_lock);
-	} else if (res == -1) {
+	xmms_error_reset (&err);
+
+	res = xmms_xform_read (xform, priv->chunk, priv->chunk_size, &err);
+	if (res <= 0) {
 		/* XXX copy error */
-		g_mutex_lock (&priv->state_lock);
-		priv->state = STATE_WANT_STOP;
-	} else {
 		xmms_ringbuf_set_eos (priv->buffer, TRUE);
-		priv->state = STATE_WANT_STOP;
+		return FALSE;
+	}
+
+	/* full chunks mean the source has more ready than we ask for */
+	if (res == priv->chunk_size) {
+		priv->chunk_size = MIN (priv->chunk_size * 2, XMMS_RINGBUF_CHUNK_MAX);
+	} else if (res < priv->chunk_size / 2) {
+		priv->chunk_size = MAX (priv->chunk_size / 2, XMMS_RINGBUF_CHUNK_MIN);
 	}
+
+	g_mutex_lock (&priv->buffer_lock);
+	xmms_ringbuf_write_wait (priv->buffer, priv->chunk, res, &priv->buffer_lock);
+	g_mutex_unlock (&priv->buffer_lock);
+
+	return TRUE;
 }
 
 static void
@@ -184,9 +293,12 @@ seek (xmms_xform_t *xform, xmms_ringbuf_priv_t *priv)
 	xmms_error_t err;
 	gint64 res;
 
+	xmms_error_reset (&err);
+
 	res = xmms_xform_seek (xform, priv->seek_offset, priv->seek_whence, &err);
-	if (res > 0) {
+	if (res >= 0) {
 		xmms_ringbuf_clear (priv->buffer);
+		priv->chunk_size = XMMS_RINGBUF_CHUNK_MIN;
 	}
 
 	priv->seek_res = res;
@@ -198,6 +310,8 @@ xmms_ringbuf_xform_thread (gpointer data)
 	xmms_xform_t *xform = (xmms_xform_t *)data;
 	xmms_ringbuf_priv_t *priv;
 
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
 	priv = xmms_xform_private_data_get (xform);
 
 	g_mutex_lock (&priv->state_lock);
@@ -206,10 +320,19 @@ xmms_ringbuf_xform_thread (gpointer data)
 			priv->state = STATE_BUFFERING;
 			g_cond_signal (&priv->state_cond);
 			while (priv->state == STATE_BUFFERING) {
+				gboolean more;
+
 				g_mutex_unlock (&priv->state_lock);
-				fill (xform, priv);
+				more = fill (xform, priv);
 				g_mutex_lock (&priv->state_lock);
+
+				/* stay around, a seek may need the source again */
+				if (!more && priv->state == STATE_BUFFERING) {
+					priv->state = STATE_IDLE;
+				}
 			}
+		} else if (priv->state == STATE_IDLE) {
+			g_cond_wait (&priv->state_cond, &priv->state_lock);
 		} else if (priv->state == STATE_WANT_SEEK) {
 			seek (xform, priv);
 			priv->state = STATE_SEEK_DONE;
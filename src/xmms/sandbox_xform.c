@@ -0,0 +1,910 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Decoders run in a process of their own.
+ *
+ * Decoders named in sandbox.plugins are never set up in the daemon.
+ * Instead the sandbox xform starts xmms2d --decoder-host, which sets up
+ * the chain for the url up to the decoded stream and hands over the
+ * audio through a ring buffer in shared memory. Commands and replies
+ * go over the stdin and stdout of the host as lines of text, along
+ * with a wake-up whenever one side waits for the other. A host that
+ * crashes or stops answering for sandbox.timeout seconds is killed
+ * and the track ends with an error, so the next one is played.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <xmms/xmms_log.h>
+#include <xmms/xmms_medialib.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmmspriv/xmms_medialib.h>
+#include <xmmspriv/xmms_sandbox.h>
+#include <xmmspriv/xmms_xform.h>
+
+#define XMMS_SANDBOX_MAGIC 0x58534258
+#define XMMS_SANDBOX_LINE_MAX 1024
+#define XMMS_SANDBOX_CHUNK 4096
+
+/** The shared memory, written by the host and read by the daemon */
+typedef struct xmms_sandbox_ring_St {
+	guint32 magic;
+	guint32 size;
+	/** Bytes ever written and read, wrapping around */
+	gint wpos;
+	gint rpos;
+	/** Set by a side before it waits for the other */
+	gint reader_waiting;
+	gint writer_waiting;
+	guint8 data[];
+} xmms_sandbox_ring_t;
+
+/** Lines read from the other side */
+typedef struct xmms_sandbox_channel_St {
+	gint fd;
+	gchar buf[XMMS_SANDBOX_LINE_MAX];
+	gsize len;
+} xmms_sandbox_channel_t;
+
+typedef struct xmms_sandbox_priv_St {
+	GPid pid;
+	/** Commands to the host */
+	gint in;
+	/** Replies of the host */
+	xmms_sandbox_channel_t out;
+	/** Until the host has opened it */
+	gchar *path;
+	xmms_sandbox_ring_t *ring;
+	gsize maplen;
+	/** In milliseconds, -1 to wait forever */
+	gint timeout;
+	gboolean eos;
+	/** Why the stream ended, if not at its end */
+	gchar *error;
+} xmms_sandbox_priv_t;
+
+static gchar *sandbox_program;
+static gchar *sandbox_conffile;
+static gchar *sandbox_plugindir;
+
+static gboolean
+xmms_sandbox_write (gint fd, gconstpointer data, gsize len)
+{
+	const gchar *p = data;
+
+	while (len) {
+		gssize ret = write (fd, p, len);
+
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+
+		p += ret;
+		len -= ret;
+	}
+
+	return TRUE;
+}
+
+static gboolean G_GNUC_PRINTF (2, 3)
+xmms_sandbox_send (gint fd, const gchar *fmt, ...)
+{
+	gboolean ret;
+	gchar *msg;
+	va_list ap;
+
+	va_start (ap, fmt);
+	msg = g_strdup_vprintf (fmt, ap);
+	va_end (ap);
+
+	ret = xmms_sandbox_write (fd, msg, strlen (msg));
+	g_free (msg);
+
+	return ret;
+}
+
+/**
+ * Wait up to timeout milliseconds for more to read.
+ *
+ * @returns 1 when something was read, 0 on timeout and -1 when the
+ * other side is gone.
+ */
+static gint
+xmms_sandbox_fill (xmms_sandbox_channel_t *ch, gint timeout)
+{
+	struct pollfd pfd;
+	gssize len;
+	gint ret;
+
+	/* a line that doesn't fit is garbage */
+	if (ch->len == sizeof (ch->buf)) {
+		return -1;
+	}
+
+	pfd.fd = ch->fd;
+	pfd.events = POLLIN;
+
+	do {
+		ret = poll (&pfd, 1, timeout);
+	} while (ret == -1 && errno == EINTR);
+
+	if (ret <= 0) {
+		return ret;
+	}
+
+	do {
+		len = read (ch->fd, ch->buf + ch->len, sizeof (ch->buf) - ch->len);
+	} while (len == -1 && errno == EINTR);
+
+	if (len <= 0) {
+		return -1;
+	}
+
+	ch->len += len;
+
+	return 1;
+}
+
+/** Read a line without its newline, returns as #xmms_sandbox_fill */
+static gint
+xmms_sandbox_line (xmms_sandbox_channel_t *ch, gchar *line, gint timeout)
+{
+	gchar *nl;
+	gsize len;
+	gint ret;
+
+	while (!(nl = memchr (ch->buf, '\n', ch->len))) {
+		ret = xmms_sandbox_fill (ch, timeout);
+		if (ret <= 0) {
+			return ret;
+		}
+	}
+
+	len = nl - ch->buf;
+	memcpy (line, ch->buf, len);
+	line[len] = '\0';
+
+	ch->len -= len + 1;
+	memmove (ch->buf, nl + 1, ch->len);
+
+	return 1;
+}
+
+/** Read len bytes, returns as #xmms_sandbox_fill */
+static gint
+xmms_sandbox_bytes (xmms_sandbox_channel_t *ch, guchar *data, gsize len,
+                    gint timeout)
+{
+	while (len) {
+		gsize n;
+		gint ret;
+
+		if (!ch->len) {
+			ret = xmms_sandbox_fill (ch, timeout);
+			if (ret <= 0) {
+				return ret;
+			}
+		}
+
+		n = MIN (len, ch->len);
+		memcpy (data, ch->buf, n);
+		ch->len -= n;
+		memmove (ch->buf, ch->buf + n, ch->len);
+
+		data += n;
+		len -= n;
+	}
+
+	return 1;
+}
+
+/**
+ * Remember how the daemon was started, so hosts read the same config
+ * and plugins. Without it nothing is sandboxed.
+ */
+void
+xmms_sandbox_init (const gchar *program, const gchar *conffile,
+                   const gchar *plugindir)
+{
+	g_free (sandbox_program);
+	g_free (sandbox_conffile);
+	g_free (sandbox_plugindir);
+
+	sandbox_program = g_file_read_link ("/proc/self/exe", NULL);
+	if (!sandbox_program && program) {
+		sandbox_program = strchr (program, G_DIR_SEPARATOR)
+		                  ? g_strdup (program)
+		                  : g_find_program_in_path (program);
+	}
+
+	sandbox_conffile = g_strdup (conffile);
+	sandbox_plugindir = g_strdup (plugindir);
+}
+
+/**
+ * If the decoder plugin is to be run in a host process.
+ */
+gboolean
+xmms_sandbox_wanted (const gchar *plugin)
+{
+	xmms_config_property_t *cfg;
+	gboolean ret = FALSE;
+	gchar **names;
+	gint i;
+
+	if (!sandbox_program) {
+		return FALSE;
+	}
+
+	cfg = xmms_config_lookup ("sandbox.plugins");
+	if (!cfg) {
+		return FALSE;
+	}
+
+	names = g_strsplit (xmms_config_property_get_string (cfg), ",", 0);
+	for (i = 0; names[i] && !ret; i++) {
+		ret = strcmp (g_strstrip (names[i]), plugin) == 0;
+	}
+	g_strfreev (names);
+
+	return ret;
+}
+
+static void
+xmms_sandbox_free (xmms_sandbox_priv_t *priv)
+{
+	if (priv->pid) {
+		kill (priv->pid, SIGKILL);
+		waitpid (priv->pid, NULL, 0);
+		g_spawn_close_pid (priv->pid);
+	}
+
+	if (priv->in != -1) {
+		close (priv->in);
+	}
+	if (priv->out.fd != -1) {
+		close (priv->out.fd);
+	}
+
+	if (priv->ring) {
+		munmap (priv->ring, priv->maplen);
+	}
+
+	if (priv->path) {
+		g_unlink (priv->path);
+		g_free (priv->path);
+	}
+
+	g_free (priv->error);
+	g_free (priv);
+}
+
+/** Give up on a host that died or hangs, it is killed on destroy. */
+static void
+xmms_sandbox_lost (xmms_sandbox_priv_t *priv, gint ret)
+{
+	if (!priv->error) {
+		priv->error = g_strdup (ret ? "Decoder host died"
+		                        : "Decoder host stopped responding");
+		xmms_log_error ("%s", priv->error);
+	}
+
+	priv->eos = TRUE;
+
+	if (priv->pid) {
+		kill (priv->pid, SIGKILL);
+	}
+}
+
+static void
+xmms_sandbox_metadata_set (const gchar *key, xmmsv_t *value, void *udata)
+{
+	xmms_xform_t *xform = udata;
+	const gchar *s;
+	gint i;
+
+	if (xmmsv_get_string (value, &s)) {
+		xmms_xform_metadata_set_str (xform, key, s);
+	} else if (xmmsv_get_int (value, &i)) {
+		xmms_xform_metadata_set_int (xform, key, i);
+	}
+}
+
+/** Take the metadata the host collected, sent as a serialized dict. */
+static gboolean
+xmms_sandbox_metadata_read (xmms_xform_t *xform, xmms_sandbox_priv_t *priv,
+                            gsize len)
+{
+	xmmsv_t *bin, *dict;
+	guchar *data;
+	gint ret;
+
+	data = g_malloc (len);
+	ret = xmms_sandbox_bytes (&priv->out, data, len, priv->timeout);
+	if (ret <= 0) {
+		g_free (data);
+		xmms_sandbox_lost (priv, ret);
+		return FALSE;
+	}
+
+	bin = xmmsv_new_bin (data, len);
+	dict = xmmsv_deserialize (bin);
+	xmmsv_unref (bin);
+	g_free (data);
+
+	if (dict) {
+		xmmsv_dict_foreach (dict, xmms_sandbox_metadata_set, xform);
+		xmmsv_unref (dict);
+	}
+
+	return TRUE;
+}
+
+static gboolean
+xmms_sandbox_spawn (xmms_sandbox_priv_t *priv)
+{
+	GPtrArray *argv;
+	GError *error = NULL;
+	gboolean ret;
+
+	argv = g_ptr_array_new ();
+	g_ptr_array_add (argv, sandbox_program);
+	g_ptr_array_add (argv, (gpointer) "--decoder-host");
+	g_ptr_array_add (argv, priv->path);
+	/* it runs as whoever the daemon runs as, it was allowed to */
+	g_ptr_array_add (argv, (gpointer) "--yes-run-as-root");
+	if (sandbox_conffile) {
+		g_ptr_array_add (argv, (gpointer) "--conf");
+		g_ptr_array_add (argv, sandbox_conffile);
+	}
+	if (sandbox_plugindir) {
+		g_ptr_array_add (argv, (gpointer) "--plugindir");
+		g_ptr_array_add (argv, sandbox_plugindir);
+	}
+	g_ptr_array_add (argv, NULL);
+
+	ret = g_spawn_async_with_pipes (NULL, (gchar **) argv->pdata, NULL,
+	                                G_SPAWN_DO_NOT_REAP_CHILD, NULL, NULL,
+	                                &priv->pid, &priv->in, &priv->out.fd,
+	                                NULL, &error);
+	g_ptr_array_free (argv, TRUE);
+
+	if (!ret) {
+		xmms_log_error ("Couldn't start decoder host: %s", error->message);
+		g_error_free (error);
+		priv->pid = 0;
+	}
+
+	return ret;
+}
+
+static gboolean
+xmms_sandbox_plugin_init (xmms_xform_t *xform)
+{
+	xmms_config_property_t *cfg;
+	xmms_sandbox_priv_t *priv;
+	const gchar *dir, *url;
+	gchar line[XMMS_SANDBOX_LINE_MAX];
+	gchar *eurl;
+	gpointer map;
+	gsize size;
+	gint fd, ret;
+
+	url = xmms_xform_get_url (xform);
+	if (!url) {
+		return FALSE;
+	}
+
+	priv = g_new0 (xmms_sandbox_priv_t, 1);
+	priv->in = -1;
+	priv->out.fd = -1;
+
+	cfg = xmms_xform_config_lookup (xform, "timeout");
+	priv->timeout = xmms_config_property_get_int (cfg) * 1000;
+	if (priv->timeout <= 0) {
+		priv->timeout = -1;
+	}
+
+	cfg = xmms_xform_config_lookup (xform, "buffer");
+	size = CLAMP (xmms_config_property_get_int (cfg), 16, 65536) * 1024;
+
+	/* memory backed where there is such a place */
+	if (g_file_test ("/dev/shm", G_FILE_TEST_IS_DIR)) {
+		dir = "/dev/shm";
+	} else {
+		dir = g_get_tmp_dir ();
+	}
+
+	priv->path = g_build_filename (dir, "xmms2-decoder-XXXXXX", NULL);
+	fd = g_mkstemp (priv->path);
+	if (fd == -1) {
+		xmms_log_error ("Couldn't create %s: %s", priv->path, g_strerror (errno));
+		goto err;
+	}
+
+	priv->maplen = sizeof (xmms_sandbox_ring_t) + size;
+	if (ftruncate (fd, priv->maplen) == -1) {
+		xmms_log_error ("Couldn't size %s: %s", priv->path, g_strerror (errno));
+		close (fd);
+		goto err;
+	}
+
+	map = mmap (NULL, priv->maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED) {
+		xmms_log_error ("Couldn't map %s: %s", priv->path, g_strerror (errno));
+		goto err;
+	}
+
+	priv->ring = map;
+	priv->ring->magic = XMMS_SANDBOX_MAGIC;
+	priv->ring->size = size;
+
+	if (!xmms_sandbox_spawn (priv)) {
+		goto err;
+	}
+
+	eurl = xmms_medialib_url_encode (url);
+	ret = xmms_sandbox_send (priv->in, "open %d %s\n",
+	                         xmms_xform_is_probe (xform), eurl);
+	g_free (eurl);
+	if (!ret) {
+		xmms_sandbox_lost (priv, -1);
+		goto err;
+	}
+
+	for (;;) {
+		gchar mime[64];
+		gint format, channels, rate;
+		guint len;
+
+		ret = xmms_sandbox_line (&priv->out, line, priv->timeout);
+		if (ret <= 0) {
+			xmms_sandbox_lost (priv, ret);
+			goto err;
+		}
+
+		if (sscanf (line, "format %63s %d %d %d", mime, &format,
+		            &channels, &rate) == 4) {
+			xmms_xform_outdata_type_add (xform,
+			                             XMMS_STREAM_TYPE_MIMETYPE, mime,
+			                             XMMS_STREAM_TYPE_FMT_FORMAT, format,
+			                             XMMS_STREAM_TYPE_FMT_CHANNELS, channels,
+			                             XMMS_STREAM_TYPE_FMT_SAMPLERATE, rate,
+			                             XMMS_STREAM_TYPE_END);
+		} else if (sscanf (line, "meta %u", &len) == 1) {
+			if (!xmms_sandbox_metadata_read (xform, priv, len)) {
+				goto err;
+			}
+		} else if (strcmp (line, "ready") == 0) {
+			break;
+		} else if (g_str_has_prefix (line, "error ")) {
+			xmms_log_error ("Decoder host: %s", line + 6);
+			goto err;
+		}
+	}
+
+	/* the host has it open */
+	g_unlink (priv->path);
+	g_free (priv->path);
+	priv->path = NULL;
+
+	xmms_xform_private_data_set (xform, priv);
+
+	return TRUE;
+
+err:
+	xmms_sandbox_free (priv);
+	return FALSE;
+}
+
+static void
+xmms_sandbox_plugin_destroy (xmms_xform_t *xform)
+{
+	xmms_sandbox_free (xmms_xform_private_data_get (xform));
+}
+
+/**
+ * Handle a reply that isn't waited for: a wake-up, or the end of the
+ * stream with the error that ended it after a 1.
+ */
+static void
+xmms_sandbox_reply (xmms_sandbox_priv_t *priv, const gchar *line)
+{
+	if (g_str_has_prefix (line, "eos ")) {
+		priv->eos = TRUE;
+		if (line[4] == '1' && !priv->error) {
+			priv->error = g_strdup (line[5] ? line + 6 : "Decoding failed");
+		}
+	}
+}
+
+static gint
+xmms_sandbox_plugin_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                          xmms_error_t *error)
+{
+	xmms_sandbox_priv_t *priv;
+	xmms_sandbox_ring_t *ring;
+	gchar line[XMMS_SANDBOX_LINE_MAX];
+	guint rpos, avail, off, n;
+	gint ret;
+
+	priv = xmms_xform_private_data_get (xform);
+	ring = priv->ring;
+	rpos = ring->rpos;
+
+	for (;;) {
+		avail = (guint) g_atomic_int_get (&ring->wpos) - rpos;
+		if (avail) {
+			break;
+		}
+
+		if (priv->eos) {
+			if (priv->error) {
+				xmms_error_set (error, XMMS_ERROR_GENERIC, priv->error);
+				return -1;
+			}
+			return 0;
+		}
+
+		/* checked again, it may have written before seeing the flag */
+		g_atomic_int_set (&ring->reader_waiting, 1);
+		if ((guint) g_atomic_int_get (&ring->wpos) != rpos) {
+			continue;
+		}
+
+		ret = xmms_sandbox_line (&priv->out, line, priv->timeout);
+		if (ret <= 0) {
+			xmms_sandbox_lost (priv, ret);
+		} else {
+			xmms_sandbox_reply (priv, line);
+		}
+	}
+
+	n = MIN (avail, (guint) len);
+	off = rpos % ring->size;
+
+	if (off + n > ring->size) {
+		memcpy (buf, ring->data + off, ring->size - off);
+		memcpy ((guint8 *) buf + ring->size - off, ring->data, n - (ring->size - off));
+	} else {
+		memcpy (buf, ring->data + off, n);
+	}
+
+	g_atomic_int_set (&ring->rpos, rpos + n);
+
+	if (g_atomic_int_compare_and_exchange (&ring->writer_waiting, 1, 0)) {
+		xmms_sandbox_send (priv->in, "more\n");
+	}
+
+	return n;
+}
+
+static gint64
+xmms_sandbox_plugin_seek (xmms_xform_t *xform, gint64 samples,
+                          xmms_xform_seek_mode_t whence, xmms_error_t *error)
+{
+	xmms_sandbox_priv_t *priv;
+	gchar line[XMMS_SANDBOX_LINE_MAX];
+	gint64 res;
+	gint wpos, ret;
+
+	priv = xmms_xform_private_data_get (xform);
+
+	/* lost hosts stay lost */
+	if (priv->eos && priv->error) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, priv->error);
+		return -1;
+	}
+
+	if (!xmms_sandbox_send (priv->in, "seek %" G_GINT64_FORMAT " %d\n",
+	                        samples, whence)) {
+		xmms_sandbox_lost (priv, -1);
+		xmms_error_set (error, XMMS_ERROR_GENERIC, priv->error);
+		return -1;
+	}
+
+	for (;;) {
+		ret = xmms_sandbox_line (&priv->out, line, priv->timeout);
+		if (ret <= 0) {
+			xmms_sandbox_lost (priv, ret);
+			xmms_error_set (error, XMMS_ERROR_GENERIC, priv->error);
+			return -1;
+		}
+
+		if (sscanf (line, "seeked %" G_GINT64_FORMAT " %d", &res, &wpos) == 2) {
+			break;
+		}
+
+		/* what came before the seek is dropped along with its end */
+	}
+
+	if (res < 0) {
+		xmms_error_set (error, XMMS_ERROR_GENERIC, "Couldn't seek");
+		return -1;
+	}
+
+	/* what is written from here on is after the seek */
+	priv->eos = FALSE;
+	g_free (priv->error);
+	priv->error = NULL;
+	g_atomic_int_set (&priv->ring->rpos, wpos);
+
+	if (g_atomic_int_compare_and_exchange (&priv->ring->writer_waiting, 1, 0)) {
+		xmms_sandbox_send (priv->in, "more\n");
+	}
+
+	return res;
+}
+
+/** Copy decoded audio into the ring, which has room for it. */
+static void
+xmms_sandbox_host_write (xmms_sandbox_ring_t *ring, const guint8 *data,
+                         guint len)
+{
+	guint wpos, off;
+
+	wpos = ring->wpos;
+	off = wpos % ring->size;
+
+	if (off + len > ring->size) {
+		memcpy (ring->data + off, data, ring->size - off);
+		memcpy (ring->data, data + ring->size - off, len - (ring->size - off));
+	} else {
+		memcpy (ring->data + off, data, len);
+	}
+
+	g_atomic_int_set (&ring->wpos, wpos + len);
+}
+
+/** Tell what the chain decodes to and the metadata it found. */
+static void
+xmms_sandbox_host_ready (gint reply, xmms_xform_t *chain)
+{
+	xmms_stream_type_t *type;
+	xmmsv_t *meta, *bin;
+	const guchar *data;
+	guint len;
+
+	type = xmms_xform_outtype_get (chain);
+	xmms_sandbox_send (reply, "format %s %d %d %d\n",
+	                   xmms_stream_type_get_str (type, XMMS_STREAM_TYPE_MIMETYPE),
+	                   xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_FORMAT),
+	                   xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_CHANNELS),
+	                   xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_SAMPLERATE));
+
+	meta = xmms_xform_chain_metadata (chain);
+	bin = xmmsv_serialize (meta);
+	xmmsv_unref (meta);
+
+	if (bin && xmmsv_get_bin (bin, &data, &len)) {
+		xmms_sandbox_send (reply, "meta %u\n", len);
+		xmms_sandbox_write (reply, data, len);
+	}
+	if (bin) {
+		xmmsv_unref (bin);
+	}
+
+	xmms_sandbox_send (reply, "ready\n");
+}
+
+/**
+ * Run as the decoder host of a sandbox, for --decoder-host. Sets up
+ * the chain for the url it is sent and decodes it into the ring at
+ * path until the daemon is done with it.
+ */
+gint
+xmms_sandbox_host_run (const gchar *path)
+{
+	xmms_sandbox_channel_t cmd;
+	xmms_sandbox_ring_t *ring;
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry = 0;
+	xmms_medialib_t *medialib;
+	xmms_xform_t *chain = NULL;
+	xmms_error_t err;
+	GList *goals;
+	gchar line[XMMS_SANDBOX_LINE_MAX];
+	guint8 buf[XMMS_SANDBOX_CHUNK];
+	gboolean eos = FALSE;
+	gchar *url, *msg;
+	struct stat st;
+	gpointer map;
+	gint fd, reply, probe;
+
+#ifdef __linux__
+	/* nobody reads what it decodes once the daemon is gone */
+	prctl (PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+	/* only replies go to the daemon, whatever else is printed to stderr */
+	reply = dup (STDOUT_FILENO);
+	dup2 (STDERR_FILENO, STDOUT_FILENO);
+
+	fd = g_open (path, O_RDWR, 0);
+	if (fd == -1 || fstat (fd, &st) == -1 ||
+	    st.st_size < (off_t) sizeof (xmms_sandbox_ring_t)) {
+		xmms_sandbox_send (reply, "error Couldn't open %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	map = mmap (NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+
+	ring = map;
+	if (map == MAP_FAILED || ring->magic != XMMS_SANDBOX_MAGIC ||
+	    sizeof (xmms_sandbox_ring_t) + ring->size > (gsize) st.st_size) {
+		xmms_sandbox_send (reply, "error Bad ring buffer %s\n", path);
+		return EXIT_FAILURE;
+	}
+
+	cmd.fd = STDIN_FILENO;
+	cmd.len = 0;
+
+	if (xmms_sandbox_line (&cmd, line, -1) <= 0 ||
+	    sscanf (line, "open %d", &probe) != 1 || !strchr (line + 5, ' ')) {
+		return EXIT_FAILURE;
+	}
+	url = g_strdup (strchr (line + 5, ' ') + 1);
+
+	xmms_error_reset (&err);
+
+	medialib = xmms_medialib_init ();
+	session = xmms_medialib_session_begin (medialib);
+	entry = xmms_medialib_entry_new (session, url, &err);
+	xmms_medialib_session_commit (session);
+
+	/* whatever it decodes to, the daemon converts it */
+	goals = g_list_prepend (NULL,
+	                        _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                                               XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                                               XMMS_STREAM_TYPE_END));
+	if (probe) {
+		goals = g_list_append (goals,
+		                       _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+		                                              XMMS_STREAM_TYPE_MIMETYPE,
+		                                              XMMS_XFORM_PROBE_MIMETYPE,
+		                                              XMMS_STREAM_TYPE_END));
+	}
+
+	if (entry) {
+		chain = xmms_xform_chain_setup_decoder (medialib, entry, url, goals);
+	}
+	if (!chain) {
+		xmms_sandbox_send (reply, "error Couldn't set up chain for %s\n", url);
+		return EXIT_FAILURE;
+	}
+
+	xmms_sandbox_host_ready (reply, chain);
+
+	for (;;) {
+		gint64 samples;
+		guint space;
+		gint ret, whence;
+
+		space = ring->size - ((guint) ring->wpos - (guint) g_atomic_int_get (&ring->rpos));
+
+		if (!eos && !space) {
+			g_atomic_int_set (&ring->writer_waiting, 1);
+			/* checked again, it may have read before seeing the flag */
+			if ((guint) g_atomic_int_get (&ring->rpos) + ring->size != (guint) ring->wpos) {
+				continue;
+			}
+		}
+
+		/* commands come first, decoding goes on while there are none */
+		ret = xmms_sandbox_line (&cmd, line, (eos || !space) ? -1 : 0);
+		if (ret < 0) {
+			break;
+		}
+
+		if (ret > 0) {
+			if (sscanf (line, "seek %" G_GINT64_FORMAT " %d", &samples, &whence) == 2) {
+				xmms_error_reset (&err);
+				samples = xmms_xform_this_seek (chain, samples, whence, &err);
+				if (samples >= 0) {
+					eos = FALSE;
+				}
+				xmms_sandbox_send (reply, "seeked %" G_GINT64_FORMAT " %d\n",
+				                   samples, ring->wpos);
+			}
+			continue;
+		}
+
+		xmms_error_reset (&err);
+		ret = xmms_xform_this_read (chain, buf, MIN (space, sizeof (buf)), &err);
+		if (ret > 0) {
+			xmms_sandbox_host_write (ring, buf, ret);
+			if (g_atomic_int_compare_and_exchange (&ring->reader_waiting, 1, 0)) {
+				xmms_sandbox_send (reply, "data\n");
+			}
+		} else if (ret < 0) {
+			eos = TRUE;
+			msg = g_strdup (xmms_error_message_get (&err));
+			xmms_sandbox_send (reply, "eos 1 %s\n", g_strdelimit (msg, "\n", ' '));
+			g_free (msg);
+		} else {
+			eos = TRUE;
+			xmms_sandbox_send (reply, "eos 0\n");
+		}
+	}
+
+	xmms_object_unref (chain);
+	g_free (url);
+
+	return EXIT_SUCCESS;
+}
+
+static gboolean
+xmms_sandbox_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+	methods.init = xmms_sandbox_plugin_init;
+	methods.destroy = xmms_sandbox_plugin_destroy;
+	methods.read = xmms_sandbox_plugin_read;
+	methods.seek = xmms_sandbox_plugin_seek;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	/* decoders to run in a host, such as "gme,sid,modplug,mac" */
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "plugins", "",
+	                                            NULL, NULL);
+	/* in KiB of decoded audio */
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "buffer", "256",
+	                                            NULL, NULL);
+	/* seconds a host may take to answer, 0 waits forever */
+	xmms_xform_plugin_config_property_register (xform_plugin,
+	                                            "timeout", "10",
+	                                            NULL, NULL);
+
+	/* only ever added to a chain by xmms_xform_chain_setup */
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE,
+	                              "application/x-sandbox",
+	                              XMMS_STREAM_TYPE_END);
+
+	return TRUE;
+}
+
+XMMS_XFORM_BUILTIN_DEFINE (sandbox,
+                           "Decoder sandbox",
+                           XMMS_VERSION,
+                           "Runs decoders in a process of their own",
+                           xmms_sandbox_plugin_setup);
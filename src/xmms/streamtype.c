@@ -20,51 +20,53 @@
  */
 
 #include <glib.h>
+#include <string.h>
 
 #include <xmmspriv/xmms_xform.h>
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_object.h>
 
 
+/* The values are kept in a slot per key, the mimetype interned, so
+ * matching is mostly comparing integers and pointers. Only strings
+ * holding a wildcard need a pattern match.
+ */
+#define XMMS_STREAM_TYPE_SLOTS (XMMS_STREAM_TYPE_FMT_SAMPLERATE + 1)
+#define XMMS_STREAM_TYPE_BIT(key) (1U << (key))
+#define XMMS_STREAM_TYPE_STRINGS (XMMS_STREAM_TYPE_BIT (XMMS_STREAM_TYPE_MIMETYPE) | \
+                                  XMMS_STREAM_TYPE_BIT (XMMS_STREAM_TYPE_URL))
+
 struct xmms_stream_type_St {
 	xmms_object_t obj;
 	gint priority;
 	gchar *name;
-	GList *list;
-};
-
-typedef enum xmms_stream_type_val_type_E {
-	STRING,
-	INT,
-} xmms_stream_type_val_type_t;
 
-typedef struct xmms_stream_type_val_St {
-	xmms_stream_type_key_t key;
-	xmms_stream_type_val_type_t type;
+	/* a bit per key with a value, and per string with a wildcard */
+	guint set;
+	guint patterns;
 	union {
-		char *string;
-		int num;
-	} d;
-} xmms_stream_type_val_t;
+		const gchar *string;
+		gint num;
+	} slots[XMMS_STREAM_TYPE_SLOTS];
+};
 
+static gboolean
+xmms_stream_type_is_string (xmms_stream_type_key_t key)
+{
+	return !!(XMMS_STREAM_TYPE_STRINGS & XMMS_STREAM_TYPE_BIT (key));
+}
 
 static void
 xmms_stream_type_destroy (xmms_object_t *obj)
 {
 	xmms_stream_type_t *st = (xmms_stream_type_t *)obj;
-	GList *n;
 
 	g_free (st->name);
 
-	for (n = st->list; n; n = g_list_next (n)) {
-		xmms_stream_type_val_t *val = n->data;
-		if (val->type == STRING) {
-			g_free (val->d.string);
-		}
-		g_free (val);
+	/* the mimetype is interned, urls are different for every entry */
+	if (st->set & XMMS_STREAM_TYPE_BIT (XMMS_STREAM_TYPE_URL)) {
+		g_free ((gchar *) st->slots[XMMS_STREAM_TYPE_URL].string);
 	}
-
-	g_list_free (st->list);
 }
 
 xmms_stream_type_t *
@@ -81,8 +83,9 @@ xmms_stream_type_parse (va_list ap)
 	res->name = NULL;
 
 	for (;;) {
-		xmms_stream_type_val_t *val;
 		xmms_stream_type_key_t key;
+		const gchar *str;
+		gint num;
 
 		key = va_arg (ap, int);
 		if (key == XMMS_STREAM_TYPE_END)
@@ -98,28 +101,42 @@ xmms_stream_type_parse (va_list ap)
 			continue;
 		}
 
-		val = g_new0 (xmms_stream_type_val_t, 1);
-		val->key = key;
-
-		switch (val->key) {
+		switch (key) {
 		case XMMS_STREAM_TYPE_MIMETYPE:
 		case XMMS_STREAM_TYPE_URL:
-			val->type = STRING;
-			val->d.string = g_strdup (va_arg (ap, char *));
+			str = va_arg (ap, char *);
+
+			/* the first one given is the one that counts */
+			if (res->set & XMMS_STREAM_TYPE_BIT (key)) {
+				break;
+			}
+
+			if (key == XMMS_STREAM_TYPE_MIMETYPE) {
+				res->slots[key].string = g_intern_string (str);
+			} else {
+				res->slots[key].string = g_strdup (str);
+			}
+
+			if (strpbrk (str, "*?")) {
+				res->patterns |= XMMS_STREAM_TYPE_BIT (key);
+			}
+			res->set |= XMMS_STREAM_TYPE_BIT (key);
 			break;
 		case XMMS_STREAM_TYPE_FMT_FORMAT:
 		case XMMS_STREAM_TYPE_FMT_CHANNELS:
 		case XMMS_STREAM_TYPE_FMT_SAMPLERATE:
-			val->type = INT;
-			val->d.num = va_arg (ap, int);
+			num = va_arg (ap, int);
+
+			if (!(res->set & XMMS_STREAM_TYPE_BIT (key))) {
+				res->slots[key].num = num;
+				res->set |= XMMS_STREAM_TYPE_BIT (key);
+			}
 			break;
 		default:
 			XMMS_DBG ("UNKNOWN TYPE!!");
-			g_free (val);
 			xmms_object_unref (res);
 			return NULL;
 		}
-		res->list = g_list_append (res->list, val);
 	}
 
 	if (!res->name) {
@@ -147,86 +164,106 @@ xmms_stream_type_parse (va_list ap)
 const char *
 xmms_stream_type_get_str (const xmms_stream_type_t *st, xmms_stream_type_key_t key)
 {
-	GList *n;
-
 	if (key == XMMS_STREAM_TYPE_NAME) {
 		return st->name;
 	}
 
-	for (n = st->list; n; n = g_list_next (n)) {
-		xmms_stream_type_val_t *val = n->data;
-		if (val->key == key) {
-			if (val->type != STRING) {
-				XMMS_DBG ("Key passed to get_str is not string");
-				return NULL;
-			}
-			return val->d.string;
-		}
+	if (key >= XMMS_STREAM_TYPE_SLOTS || !(st->set & XMMS_STREAM_TYPE_BIT (key))) {
+		return NULL;
+	}
+
+	if (!xmms_stream_type_is_string (key)) {
+		XMMS_DBG ("Key passed to get_str is not string");
+		return NULL;
 	}
-	return NULL;
+
+	return st->slots[key].string;
 }
 
 
 gint
 xmms_stream_type_get_int (const xmms_stream_type_t *st, xmms_stream_type_key_t key)
 {
-	GList *n;
-
 	if (key == XMMS_STREAM_TYPE_PRIORITY) {
 		return st->priority;
 	}
 
-	for (n = st->list; n; n = g_list_next (n)) {
-		xmms_stream_type_val_t *val = n->data;
-		if (val->key == key) {
-			if (val->type != INT) {
-				XMMS_DBG ("Key passed to get_int is not int");
-				return -1;
-			}
-			return val->d.num;
-		}
+	if (key >= XMMS_STREAM_TYPE_SLOTS || !(st->set & XMMS_STREAM_TYPE_BIT (key))) {
+		return -1;
 	}
-	return -1;
-}
 
+	if (xmms_stream_type_is_string (key)) {
+		XMMS_DBG ("Key passed to get_int is not int");
+		return -1;
+	}
 
+	return st->slots[key].num;
+}
 
 
-static gboolean
-match_val (xmms_stream_type_val_t *vin, xmms_stream_type_val_t *vout)
+/**
+ * Build a string that is the same for stream types holding the same
+ * values, to be used as a hash key.
+ */
+gchar *
+xmms_stream_type_key (const xmms_stream_type_t *st)
 {
-	if (vin->type != vout->type)
-		return FALSE;
-	switch (vin->type) {
-	case STRING:
-        XMMS_DBG ("Matching %s to %s", vin->d.string, vout->d.string);
-		return g_pattern_match_simple (vin->d.string, vout->d.string);
-	case INT:
-		return vin->d.num == vout->d.num;
+	GString *key;
+	gint i;
+
+	key = g_string_new (NULL);
+
+	for (i = XMMS_STREAM_TYPE_MIMETYPE; i < XMMS_STREAM_TYPE_SLOTS; i++) {
+		if (!(st->set & XMMS_STREAM_TYPE_BIT (i))) {
+			continue;
+		}
+
+		if (xmms_stream_type_is_string (i)) {
+			g_string_append_printf (key, "%d=%s\n", i, st->slots[i].string);
+		} else {
+			g_string_append_printf (key, "%d=%d\n", i, st->slots[i].num);
+		}
 	}
-	return FALSE;
+
+	return g_string_free (key, FALSE);
 }
 
+
 gboolean
 xmms_stream_type_match (const xmms_stream_type_t *in_type, const xmms_stream_type_t *out_type)
 {
-	GList *in;
+	gint i;
 
-	for (in = in_type->list; in; in = g_list_next (in)) {
-		xmms_stream_type_val_t *inval = in->data;
-		GList *n;
+	/* something didn't exist in out */
+	if (in_type->set & ~out_type->set) {
+		return FALSE;
+	}
 
-		for (n = out_type->list; n; n = g_list_next (n)) {
-			xmms_stream_type_val_t *outval = n->data;
-			if (inval->key == outval->key) {
-				if (!match_val (inval, outval))
-					return FALSE;
-				break;
-			}
+	for (i = XMMS_STREAM_TYPE_MIMETYPE; i < XMMS_STREAM_TYPE_SLOTS; i++) {
+		const gchar *in, *out;
 
+		if (!(in_type->set & XMMS_STREAM_TYPE_BIT (i))) {
+			continue;
 		}
-		if (!n) {
-			/* didn't exist in out */
+
+		if (!xmms_stream_type_is_string (i)) {
+			if (in_type->slots[i].num != out_type->slots[i].num)
+				return FALSE;
+			continue;
+		}
+
+		in = in_type->slots[i].string;
+		out = out_type->slots[i].string;
+
+		if (in == out) {
+			continue;
+		}
+
+		if (in_type->patterns & XMMS_STREAM_TYPE_BIT (i)) {
+			if (!g_pattern_match_simple (in, out))
+				return FALSE;
+		} else if (i == XMMS_STREAM_TYPE_MIMETYPE || strcmp (in, out) != 0) {
+			/* interned, a different pointer is another mimetype */
 			return FALSE;
 		}
 	}
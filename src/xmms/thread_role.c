@@ -0,0 +1,294 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+
+/** @file
+ *  CPU affinity, nice value and I/O priority of server threads by
+ *  their role.
+ *
+ *  Every thread enters its role when it starts, and pool workers do
+ *  so for every job, as a pool thread may be shared with other pools.
+ *  The settings of a role are the thread.<role>.cpus, .nice and
+ *  .io_priority config properties, and are applied when a thread
+ *  enters a role it isn't in or after they changed. A thread only
+ *  touches its scheduling once anything was configured.
+ */
+
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_realtime.h>
+#include <xmmspriv/xmms_config.h>
+#include <xmms/xmms_log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct xmms_thread_role_settings_St {
+	guint *cpus;
+	guint ncpus;
+	gint nice;
+	gint io_class;
+	gint io_level;
+} xmms_thread_role_settings_t;
+
+/** The role a thread is in, and the settings it applied */
+typedef struct xmms_thread_role_state_St {
+	xmms_thread_role_t role;
+	guint generation;
+} xmms_thread_role_state_t;
+
+static const gchar *role_names[XMMS_THREAD_ROLE_NUM] = {
+	"audio", "import", "ipc", "background"
+};
+
+G_LOCK_DEFINE_STATIC (settings);
+static xmms_thread_role_settings_t settings[XMMS_THREAD_ROLE_NUM];
+/** Bumped whenever the settings change, 0 while nothing is set */
+static guint generation;
+static gboolean configured;
+
+static GPrivate thread_state = G_PRIVATE_INIT (g_free);
+
+/**
+ * Parse a list of CPUs such as "0-3,6", NULL for an empty or broken
+ * list.
+ */
+static guint *
+xmms_thread_role_parse_cpus (const gchar *str, guint *n)
+{
+	GArray *cpus;
+	gchar **ranges;
+	gint i;
+
+	*n = 0;
+
+	if (!str || !*str) {
+		return NULL;
+	}
+
+	cpus = g_array_new (FALSE, FALSE, sizeof (guint));
+	ranges = g_strsplit (str, ",", 0);
+
+	for (i = 0; ranges[i]; i++) {
+		gchar *end;
+		guint64 first, last, cpu;
+
+		first = last = g_ascii_strtoull (ranges[i], &end, 10);
+		if (end == ranges[i]) {
+			goto broken;
+		}
+
+		if (*end == '-') {
+			gchar *start = end + 1;
+			last = g_ascii_strtoull (start, &end, 10);
+			if (end == start || last < first) {
+				goto broken;
+			}
+		}
+
+		if (*g_strstrip (end) || last >= 1024) {
+			goto broken;
+		}
+
+		for (cpu = first; cpu <= last; cpu++) {
+			guint c = cpu;
+			g_array_append_val (cpus, c);
+		}
+	}
+
+	g_strfreev (ranges);
+
+	*n = cpus->len;
+	return (guint *) g_array_free (cpus, FALSE);
+
+broken:
+	xmms_log_error ("Bad CPU list '%s', using all CPUs", str);
+	g_strfreev (ranges);
+	g_array_free (cpus, TRUE);
+	return NULL;
+}
+
+/**
+ * Parse an I/O priority, one of "idle", "best-effort:N" and
+ * "realtime:N", or empty for the default.
+ */
+static void
+xmms_thread_role_parse_io (const gchar *str, gint *klass, gint *level)
+{
+	const gchar *colon;
+	gsize len;
+
+	*klass = XMMS_REALTIME_IO_DEFAULT;
+	*level = 4;
+
+	if (!str || !*str) {
+		return;
+	}
+
+	colon = strchr (str, ':');
+	len = colon ? colon - str : strlen (str);
+
+	if (len == 4 && strncmp (str, "idle", len) == 0) {
+		*klass = XMMS_REALTIME_IO_IDLE;
+		*level = 7;
+		return;
+	} else if (len == 11 && strncmp (str, "best-effort", len) == 0) {
+		*klass = XMMS_REALTIME_IO_BEST_EFFORT;
+	} else if (len == 8 && strncmp (str, "realtime", len) == 0) {
+		*klass = XMMS_REALTIME_IO_REALTIME;
+	} else {
+		xmms_log_error ("Bad I/O priority '%s', using the default", str);
+		return;
+	}
+
+	if (colon) {
+		*level = CLAMP (atoi (colon + 1), 0, 7);
+	}
+}
+
+static xmms_config_property_t *
+xmms_thread_role_config_lookup (xmms_thread_role_t role, const gchar *key)
+{
+	xmms_config_property_t *prop;
+	gchar *name;
+
+	name = g_strdup_printf ("thread.%s.%s", role_names[role], key);
+	prop = xmms_config_lookup (name);
+	g_free (name);
+
+	return prop;
+}
+
+/** Read the settings of all roles from the config. */
+static void
+xmms_thread_role_load (void)
+{
+	gint i;
+
+	G_LOCK (settings);
+
+	configured = FALSE;
+
+	for (i = 0; i < XMMS_THREAD_ROLE_NUM; i++) {
+		xmms_thread_role_settings_t *s = &settings[i];
+		xmms_config_property_t *prop;
+
+		g_free (s->cpus);
+
+		prop = xmms_thread_role_config_lookup (i, "cpus");
+		s->cpus = xmms_thread_role_parse_cpus (xmms_config_property_get_string (prop),
+		                                       &s->ncpus);
+
+		prop = xmms_thread_role_config_lookup (i, "nice");
+		s->nice = CLAMP (xmms_config_property_get_int (prop), -20, 19);
+
+		prop = xmms_thread_role_config_lookup (i, "io_priority");
+		xmms_thread_role_parse_io (xmms_config_property_get_string (prop),
+		                           &s->io_class, &s->io_level);
+
+		if (s->ncpus || s->nice || s->io_class != XMMS_REALTIME_IO_DEFAULT) {
+			configured = TRUE;
+		}
+	}
+
+	/* threads that applied something reset it with the new settings */
+	if (configured || generation) {
+		generation++;
+	}
+
+	G_UNLOCK (settings);
+}
+
+static void
+xmms_thread_role_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	xmms_thread_role_load ();
+}
+
+/**
+ * Register the config properties of the roles. Threads started before
+ * this are left alone until they enter a role again.
+ */
+void
+xmms_thread_role_init (void)
+{
+	gint i;
+
+	for (i = 0; i < XMMS_THREAD_ROLE_NUM; i++) {
+		gchar *name;
+
+		/* such as "0-3,6", empty for all */
+		name = g_strdup_printf ("thread.%s.cpus", role_names[i]);
+		xmms_config_property_register (name, "", xmms_thread_role_changed, NULL);
+		g_free (name);
+
+		name = g_strdup_printf ("thread.%s.nice", role_names[i]);
+		xmms_config_property_register (name, "0", xmms_thread_role_changed, NULL);
+		g_free (name);
+
+		/* idle, best-effort:N or realtime:N, empty for the default */
+		name = g_strdup_printf ("thread.%s.io_priority", role_names[i]);
+		xmms_config_property_register (name, "", xmms_thread_role_changed, NULL);
+		g_free (name);
+	}
+
+	xmms_thread_role_load ();
+}
+
+/**
+ * Apply the settings of a role to the calling thread, cheap when it
+ * already is in it.
+ */
+void
+xmms_thread_role_enter (xmms_thread_role_t role)
+{
+	xmms_thread_role_state_t *state;
+	xmms_thread_role_settings_t s;
+	guint *cpus = NULL;
+
+	g_return_if_fail (role < XMMS_THREAD_ROLE_NUM);
+
+	state = g_private_get (&thread_state);
+
+	G_LOCK (settings);
+
+	if ((!state && !configured) ||
+	    (state && state->role == role && state->generation == generation)) {
+		G_UNLOCK (settings);
+		return;
+	}
+
+	s = settings[role];
+	if (s.ncpus) {
+		cpus = g_memdup (s.cpus, s.ncpus * sizeof (guint));
+	}
+
+	if (!state) {
+		state = g_new0 (xmms_thread_role_state_t, 1);
+		g_private_set (&thread_state, state);
+	}
+	state->role = role;
+	state->generation = generation;
+
+	G_UNLOCK (settings);
+
+	/* everything is set, so nothing of a previous role is kept */
+	xmms_realtime_thread_affinity (cpus, s.ncpus);
+	xmms_realtime_thread_nice (s.nice);
+	xmms_realtime_thread_io_priority (s.io_class, s.io_level);
+
+	g_free (cpus);
+}
@@ -0,0 +1,758 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ *  An inverted index of the words in some string properties, used to
+ *  answer match and token filters without a scan of every entry, and
+ *  the distinct values of those properties sorted for completing a
+ *  prefix.
+ *
+ *  The index is built from the medialib the first time it is used.
+ *  Committed writes mark their entries dirty with the generation a
+ *  session has to begin at to see them, and a read-only session rereads
+ *  the dirty entries it can see before a lookup.
+ */
+
+#include <xmmspriv/xmms_tokenindex.h>
+#include <xmms/xmms_log.h>
+
+#include <string.h>
+
+/** A distinct value of a key, by its folded form */
+typedef struct xmms_token_index_value_St {
+	gchar *folded;
+	/** As first seen of those folding the same */
+	gchar *value;
+	/** Number of entries with the value */
+	guint count;
+} xmms_token_index_value_t;
+
+struct xmms_token_index_St {
+	GMutex mutex;
+
+	gchar **keys;
+	gint nkeys;
+	/** Ignore diacritics, as well as case */
+	gboolean fold_marks;
+
+	gboolean built;
+	/** Highest generation a dirty mark was given while not built */
+	guint unbuilt_mark;
+
+	/** id -> array of nkeys values, empty when unset */
+	GHashTable *entries;
+	/** One per key: folded word -> set of ids */
+	GHashTable **words;
+	/** One per key: folded value -> xmms_token_index_value_t */
+	GHashTable **distinct;
+	/** One per key: the distinct values sorted by folded */
+	GPtrArray **sorted;
+	/** Loading all entries, the sorted values are sorted once after */
+	gboolean loading;
+	/** id -> generation a session must have begun at to see the change */
+	GHashTable *dirty;
+};
+
+static gint
+xmms_token_index_all_filter (void)
+{
+	return 0;
+}
+
+static gint
+xmms_token_index_ids_filter (const s4_val_t *value, s4_condition_t *cond)
+{
+	GHashTable *ids;
+	gint32 ival;
+
+	if (!s4_val_get_int (value, &ival)) {
+		return 1;
+	}
+
+	ids = s4_cond_get_funcdata (cond);
+
+	return !g_hash_table_contains (ids, GINT_TO_POINTER (ival));
+}
+
+static void
+xmms_token_index_values_free (gpointer data)
+{
+	g_strfreev ((gchar **) data);
+}
+
+/** Casefold str, and drop its combining marks if so configured. */
+static gchar *
+xmms_token_index_fold (xmms_token_index_t *index, const gchar *str)
+{
+	gchar *folded, *decomposed, *in, *out;
+	gunichar c;
+
+	folded = g_utf8_casefold (str, -1);
+	if (!index->fold_marks) {
+		return folded;
+	}
+
+	decomposed = g_utf8_normalize (folded, -1, G_NORMALIZE_NFD);
+	if (decomposed == NULL) {
+		return folded;
+	}
+	g_free (folded);
+
+	for (in = out = decomposed; *in != '\0'; in = g_utf8_next_char (in)) {
+		c = g_utf8_get_char (in);
+		if (!g_unichar_ismark (c)) {
+			out += g_unichar_to_utf8 (c, out);
+		}
+	}
+	*out = '\0';
+
+	return decomposed;
+}
+
+/**
+ * Split folded into its words, the runs of letters and digits.
+ *
+ * @returns A NULL terminated array, free with g_strfreev.
+ */
+static gchar **
+xmms_token_index_split (const gchar *folded)
+{
+	GPtrArray *words;
+	const gchar *p, *start = NULL;
+
+	words = g_ptr_array_new ();
+
+	for (p = folded; ; p = g_utf8_next_char (p)) {
+		gboolean word = *p != '\0' && g_unichar_isalnum (g_utf8_get_char (p));
+
+		if (word && start == NULL) {
+			start = p;
+		} else if (!word && start != NULL) {
+			g_ptr_array_add (words, g_strndup (start, p - start));
+			start = NULL;
+		}
+
+		if (*p == '\0') {
+			break;
+		}
+	}
+
+	g_ptr_array_add (words, NULL);
+
+	return (gchar **) g_ptr_array_free (words, FALSE);
+}
+
+static void
+xmms_token_index_value_free (gpointer data)
+{
+	xmms_token_index_value_t *value = data;
+
+	g_free (value->folded);
+	g_free (value->value);
+	g_free (value);
+}
+
+static gint
+xmms_token_index_value_compare (gconstpointer a, gconstpointer b)
+{
+	const xmms_token_index_value_t *va = *(xmms_token_index_value_t **) a;
+	const xmms_token_index_value_t *vb = *(xmms_token_index_value_t **) b;
+
+	return strcmp (va->folded, vb->folded);
+}
+
+/** Position of the first of the sorted values not before folded. */
+static guint
+xmms_token_index_lower_bound (GPtrArray *sorted, const gchar *folded)
+{
+	xmms_token_index_value_t *value;
+	guint lo = 0, hi = sorted->len, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		value = g_ptr_array_index (sorted, mid);
+		if (strcmp (value->folded, folded) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/** Count an entry with a value of key k in or out, should hold the mutex. */
+static void
+xmms_token_index_update_distinct (xmms_token_index_t *index, gint k,
+                                  const gchar *str, const gchar *folded,
+                                  gboolean add)
+{
+	xmms_token_index_value_t *value;
+	GPtrArray *sorted = index->sorted[k];
+	guint pos;
+
+	value = g_hash_table_lookup (index->distinct[k], folded);
+
+	if (add && value != NULL) {
+		value->count++;
+	} else if (add) {
+		value = g_new0 (xmms_token_index_value_t, 1);
+		value->folded = g_strdup (folded);
+		value->value = g_strdup (str);
+		value->count = 1;
+		g_hash_table_insert (index->distinct[k], value->folded, value);
+
+		pos = index->loading ? sorted->len : xmms_token_index_lower_bound (sorted, folded);
+		g_ptr_array_add (sorted, value);
+		memmove (sorted->pdata + pos + 1, sorted->pdata + pos,
+		         (sorted->len - 1 - pos) * sizeof (gpointer));
+		g_ptr_array_index (sorted, pos) = value;
+	} else if (value != NULL && --value->count == 0) {
+		pos = xmms_token_index_lower_bound (sorted, folded);
+		g_ptr_array_remove_index (sorted, pos);
+		g_hash_table_remove (index->distinct[k], folded);
+	}
+}
+
+/** Add or remove the words and values of an entry, should hold the mutex. */
+static void
+xmms_token_index_update_words (xmms_token_index_t *index, gint32 id,
+                               gchar **values, gboolean add)
+{
+	GHashTable *ids;
+	gchar **words, *folded;
+	gint i, j;
+
+	for (i = 0; i < index->nkeys; i++) {
+		if (values[i] == NULL) {
+			continue;
+		}
+
+		folded = xmms_token_index_fold (index, values[i]);
+		words = xmms_token_index_split (folded);
+		if (*folded != '\0') {
+			xmms_token_index_update_distinct (index, i, values[i], folded, add);
+		}
+		g_free (folded);
+
+		for (j = 0; words[j] != NULL; j++) {
+			ids = g_hash_table_lookup (index->words[i], words[j]);
+			if (add) {
+				if (ids == NULL) {
+					ids = g_hash_table_new (NULL, NULL);
+					g_hash_table_insert (index->words[i], g_strdup (words[j]), ids);
+				}
+				g_hash_table_add (ids, GINT_TO_POINTER (id));
+			} else if (ids != NULL) {
+				g_hash_table_remove (ids, GINT_TO_POINTER (id));
+				if (g_hash_table_size (ids) == 0) {
+					g_hash_table_remove (index->words[i], words[j]);
+				}
+			}
+		}
+
+		g_strfreev (words);
+	}
+}
+
+static void
+xmms_token_index_remove_entry (xmms_token_index_t *index, gint32 id)
+{
+	gchar **values;
+
+	values = g_hash_table_lookup (index->entries, GINT_TO_POINTER (id));
+	if (values != NULL) {
+		xmms_token_index_update_words (index, id, values, FALSE);
+		g_hash_table_remove (index->entries, GINT_TO_POINTER (id));
+	}
+}
+
+/** Drop all entries, words and values, should hold the mutex. */
+static void
+xmms_token_index_clear (xmms_token_index_t *index)
+{
+	gint i;
+
+	for (i = 0; index->words != NULL && i < index->nkeys; i++) {
+		g_hash_table_destroy (index->words[i]);
+		g_ptr_array_free (index->sorted[i], TRUE);
+		g_hash_table_destroy (index->distinct[i]);
+	}
+	g_free (index->words);
+	g_free (index->sorted);
+	g_free (index->distinct);
+	index->words = NULL;
+	index->sorted = NULL;
+	index->distinct = NULL;
+
+	g_hash_table_remove_all (index->entries);
+	g_hash_table_remove_all (index->dirty);
+	index->built = FALSE;
+}
+
+/**
+ * Read the values of the entries in ids from the medialib, or of all
+ * entries if ids is NULL. Should hold the mutex.
+ */
+static void
+xmms_token_index_load (xmms_token_index_t *index,
+                       xmms_medialib_session_t *session, GHashTable *ids)
+{
+	const s4_resultrow_t *row;
+	const s4_result_t *result;
+	s4_sourcepref_t *sourcepref;
+	s4_condition_t *cond;
+	s4_fetchspec_t *fs;
+	s4_resultset_t *set;
+	const gchar *str;
+	gchar **values;
+	gint32 id;
+	gint i, j;
+
+	sourcepref = xmms_medialib_session_get_source_preferences (session);
+
+	fs = s4_fetchspec_create ();
+	s4_fetchspec_add (fs, "song_id", sourcepref, S4_FETCH_PARENT);
+	for (i = 0; i < index->nkeys; i++) {
+		s4_fetchspec_add (fs, index->keys[i], sourcepref, S4_FETCH_DATA);
+	}
+
+	if (ids == NULL) {
+		cond = s4_cond_new_custom_filter ((filter_function_t) xmms_token_index_all_filter,
+		                                  NULL, NULL, "song_id", NULL,
+		                                  S4_CMP_BINARY, 0, S4_COND_PARENT);
+	} else {
+		cond = s4_cond_new_custom_filter (xmms_token_index_ids_filter, ids,
+		                                  NULL, "song_id", sourcepref, 0, 0,
+		                                  S4_COND_PARENT);
+	}
+
+	s4_sourcepref_unref (sourcepref);
+
+	set = xmms_medialib_session_query (session, fs, cond);
+
+	for (i = 0; s4_resultset_get_row (set, i, &row); i++) {
+		if (!s4_resultrow_get_col (row, 0, &result) ||
+		    !s4_val_get_int (s4_result_get_val (result), &id)) {
+			continue;
+		}
+
+		values = g_new0 (gchar *, index->nkeys + 1);
+		for (j = 0; j < index->nkeys; j++) {
+			if (s4_resultrow_get_col (row, j + 1, &result) && result != NULL &&
+			    s4_val_get_str (s4_result_get_val (result), &str)) {
+				values[j] = g_strdup (str);
+			} else {
+				/* keep the array NULL terminated for g_strfreev */
+				values[j] = g_strdup ("");
+			}
+		}
+
+		xmms_token_index_update_words (index, id, values, TRUE);
+		g_hash_table_insert (index->entries, GINT_TO_POINTER (id), values);
+	}
+
+	s4_resultset_free (set);
+	s4_cond_free (cond);
+	s4_fetchspec_free (fs);
+}
+
+/**
+ * Bring the index up to date for a session that began at generation.
+ * Should hold the mutex.
+ *
+ * @returns FALSE if the session can't use the index, because some
+ * changes are newer than what it sees.
+ */
+static gboolean
+xmms_token_index_refresh (xmms_token_index_t *index,
+                          xmms_medialib_session_t *session, guint generation)
+{
+	GHashTableIter iter;
+	gpointer key, mark;
+	GHashTable *ids;
+	gint i;
+
+	if (!index->built) {
+		if (index->unbuilt_mark > generation) {
+			return FALSE;
+		}
+
+		index->words = g_new0 (GHashTable *, index->nkeys);
+		index->distinct = g_new0 (GHashTable *, index->nkeys);
+		index->sorted = g_new0 (GPtrArray *, index->nkeys);
+		for (i = 0; i < index->nkeys; i++) {
+			index->words[i] = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+			                                         (GDestroyNotify) g_hash_table_destroy);
+			index->distinct[i] = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+			                                            xmms_token_index_value_free);
+			index->sorted[i] = g_ptr_array_new ();
+		}
+
+		index->loading = TRUE;
+		xmms_token_index_load (index, session, NULL);
+		index->loading = FALSE;
+		for (i = 0; i < index->nkeys; i++) {
+			g_ptr_array_sort (index->sorted[i], xmms_token_index_value_compare);
+		}
+		index->built = TRUE;
+
+		XMMS_DBG ("Token index built, %u entries",
+		          g_hash_table_size (index->entries));
+	}
+
+	if (g_hash_table_size (index->dirty) == 0) {
+		return TRUE;
+	}
+
+	g_hash_table_iter_init (&iter, index->dirty);
+	while (g_hash_table_iter_next (&iter, &key, &mark)) {
+		if (GPOINTER_TO_UINT (mark) > generation) {
+			return FALSE;
+		}
+	}
+
+	ids = index->dirty;
+	index->dirty = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, ids);
+	while (g_hash_table_iter_next (&iter, &key, NULL)) {
+		xmms_token_index_remove_entry (index, GPOINTER_TO_INT (key));
+	}
+
+	xmms_token_index_load (index, session, ids);
+
+	g_hash_table_destroy (ids);
+
+	return TRUE;
+}
+
+xmms_token_index_t *
+xmms_token_index_new (void)
+{
+	xmms_token_index_t *index;
+
+	index = g_new0 (xmms_token_index_t, 1);
+	g_mutex_init (&index->mutex);
+	index->keys = g_new0 (gchar *, 1);
+	index->entries = g_hash_table_new_full (NULL, NULL, NULL,
+	                                        xmms_token_index_values_free);
+	index->dirty = g_hash_table_new (NULL, NULL);
+
+	return index;
+}
+
+void
+xmms_token_index_free (xmms_token_index_t *index)
+{
+	g_return_if_fail (index);
+
+	xmms_token_index_clear (index);
+	g_hash_table_destroy (index->entries);
+	g_hash_table_destroy (index->dirty);
+	g_strfreev (index->keys);
+	g_mutex_clear (&index->mutex);
+	g_free (index);
+}
+
+/**
+ * Set the comma separated keys to index, an empty string disables the
+ * index. It is rebuilt the next time it is used.
+ */
+void
+xmms_token_index_configure (xmms_token_index_t *index, const gchar *keys,
+                            gboolean fold_marks)
+{
+	GPtrArray *valid;
+	gchar **split;
+	gint i;
+
+	g_return_if_fail (index);
+
+	valid = g_ptr_array_new ();
+	split = g_strsplit (keys, ",", -1);
+	for (i = 0; split[i] != NULL; i++) {
+		g_strstrip (split[i]);
+		if (*split[i] != '\0') {
+			g_ptr_array_add (valid, g_strdup (split[i]));
+		}
+	}
+	g_strfreev (split);
+	g_ptr_array_add (valid, NULL);
+
+	g_mutex_lock (&index->mutex);
+
+	xmms_token_index_clear (index);
+	g_strfreev (index->keys);
+	index->nkeys = valid->len - 1;
+	index->keys = (gchar **) g_ptr_array_free (valid, FALSE);
+	index->fold_marks = fold_marks;
+
+	g_mutex_unlock (&index->mutex);
+}
+
+gboolean
+xmms_token_index_has_key (xmms_token_index_t *index, const gchar *key)
+{
+	gboolean ret = FALSE;
+	gint i;
+
+	g_mutex_lock (&index->mutex);
+	for (i = 0; !ret && i < index->nkeys; i++) {
+		ret = strcmp (index->keys[i], key) == 0;
+	}
+	g_mutex_unlock (&index->mutex);
+
+	return ret;
+}
+
+/**
+ * Mark the entries in a set of ids as changed, by a write that sessions
+ * beginning at generation or later see.
+ */
+void
+xmms_token_index_touch (xmms_token_index_t *index, GHashTable *entries,
+                        guint generation)
+{
+	GHashTableIter iter;
+	gpointer key, mark;
+
+	if (entries == NULL || g_hash_table_size (entries) == 0) {
+		return;
+	}
+
+	g_mutex_lock (&index->mutex);
+
+	if (!index->built) {
+		index->unbuilt_mark = MAX (index->unbuilt_mark, generation);
+	} else {
+		g_hash_table_iter_init (&iter, entries);
+		while (g_hash_table_iter_next (&iter, &key, NULL)) {
+			mark = g_hash_table_lookup (index->dirty, key);
+			g_hash_table_insert (index->dirty, key,
+			                     GUINT_TO_POINTER (MAX (GPOINTER_TO_UINT (mark), generation)));
+		}
+	}
+
+	g_mutex_unlock (&index->mutex);
+}
+
+/**
+ * Find the longest run of letters and digits outside the wildcards of
+ * a folded pattern, every value it matches has a word containing it.
+ */
+static gchar *
+xmms_token_index_pattern_run (const gchar *pattern)
+{
+	const gchar *p, *start = NULL, *best = NULL;
+	gsize best_len = 0;
+
+	for (p = pattern; ; p = g_utf8_next_char (p)) {
+		gboolean word = *p != '\0' && g_unichar_isalnum (g_utf8_get_char (p));
+
+		if (word && start == NULL) {
+			start = p;
+		} else if (!word && start != NULL) {
+			if (p - start > best_len) {
+				best = start;
+				best_len = p - start;
+			}
+			start = NULL;
+		}
+
+		if (*p == '\0') {
+			break;
+		}
+	}
+
+	return best != NULL ? g_strndup (best, best_len) : NULL;
+}
+
+/**
+ * Look up the entries whose value of key matches a glob pattern, or
+ * has a word matching it when token is set.
+ *
+ * @returns A new set of ids, or NULL if the index can't answer this
+ * and the filter has to go to s4.
+ */
+GHashTable *
+xmms_token_index_match (xmms_token_index_t *index,
+                        xmms_medialib_session_t *session, const gchar *key,
+                        const gchar *pattern, gboolean token, gboolean caseless)
+{
+	GHashTable *ret = NULL, *checked, *ids;
+	GHashTableIter iter, id_iter;
+	GPatternSpec *spec;
+	gpointer word, id;
+	gchar *folded, *run, *value, **values;
+	guint generation;
+	gint k;
+
+	/* a writing session sees changes the index doesn't have */
+	if (!xmms_medialib_session_get_generation (session, &generation)) {
+		return NULL;
+	}
+
+	/* words are folded, matching them case sensitively needs s4 */
+	if (token && !caseless) {
+		return NULL;
+	}
+
+	g_mutex_lock (&index->mutex);
+
+	for (k = 0; k < index->nkeys; k++) {
+		if (strcmp (index->keys[k], key) == 0) {
+			break;
+		}
+	}
+
+	if (k == index->nkeys || !xmms_token_index_refresh (index, session, generation)) {
+		g_mutex_unlock (&index->mutex);
+		return NULL;
+	}
+
+	folded = xmms_token_index_fold (index, pattern);
+
+	if (token) {
+		spec = g_pattern_spec_new (folded);
+		ret = g_hash_table_new (NULL, NULL);
+
+		g_hash_table_iter_init (&iter, index->words[k]);
+		while (g_hash_table_iter_next (&iter, &word, (gpointer *) &ids)) {
+			if (!g_pattern_match_string (spec, word)) {
+				continue;
+			}
+			g_hash_table_iter_init (&id_iter, ids);
+			while (g_hash_table_iter_next (&id_iter, &id, NULL)) {
+				g_hash_table_add (ret, id);
+			}
+		}
+
+		g_pattern_spec_free (spec);
+	} else if ((run = xmms_token_index_pattern_run (folded)) != NULL) {
+		spec = g_pattern_spec_new (caseless ? folded : pattern);
+		ret = g_hash_table_new (NULL, NULL);
+		checked = g_hash_table_new (NULL, NULL);
+
+		g_hash_table_iter_init (&iter, index->words[k]);
+		while (g_hash_table_iter_next (&iter, &word, (gpointer *) &ids)) {
+			if (strstr (word, run) == NULL) {
+				continue;
+			}
+			g_hash_table_iter_init (&id_iter, ids);
+			while (g_hash_table_iter_next (&id_iter, &id, NULL)) {
+				if (g_hash_table_contains (checked, id)) {
+					continue;
+				}
+				g_hash_table_add (checked, id);
+				values = g_hash_table_lookup (index->entries, id);
+				value = caseless ? xmms_token_index_fold (index, values[k]) : values[k];
+				if (g_pattern_match_string (spec, value)) {
+					g_hash_table_add (ret, id);
+				}
+				if (caseless) {
+					g_free (value);
+				}
+			}
+		}
+
+		g_hash_table_destroy (checked);
+		g_pattern_spec_free (spec);
+		g_free (run);
+	}
+
+	g_free (folded);
+
+	g_mutex_unlock (&index->mutex);
+
+	return ret;
+}
+
+/**
+ * Complete a prefix of a value of key, matched like a caseless match
+ * filter. The most common values come first, values as common in the
+ * order they sort in.
+ *
+ * @returns A new list of at most limit values, or NULL if the index
+ * can't answer this.
+ */
+xmmsv_t *
+xmms_token_index_complete (xmms_token_index_t *index,
+                           xmms_medialib_session_t *session, const gchar *key,
+                           const gchar *prefix, gint limit)
+{
+	xmms_token_index_value_t **top, *value;
+	GPtrArray *sorted;
+	xmmsv_t *ret;
+	guint generation, i;
+	gchar *folded;
+	gsize len;
+	gint k, j, n = 0;
+
+	g_return_val_if_fail (limit > 0, NULL);
+
+	if (!xmms_medialib_session_get_generation (session, &generation)) {
+		return NULL;
+	}
+
+	g_mutex_lock (&index->mutex);
+
+	for (k = 0; k < index->nkeys; k++) {
+		if (strcmp (index->keys[k], key) == 0) {
+			break;
+		}
+	}
+
+	if (k == index->nkeys || !xmms_token_index_refresh (index, session, generation)) {
+		g_mutex_unlock (&index->mutex);
+		return NULL;
+	}
+
+	folded = xmms_token_index_fold (index, prefix);
+	len = strlen (folded);
+	sorted = index->sorted[k];
+	top = g_new (xmms_token_index_value_t *, limit);
+
+	for (i = xmms_token_index_lower_bound (sorted, folded); i < sorted->len; i++) {
+		value = g_ptr_array_index (sorted, i);
+		if (strncmp (value->folded, folded, len) != 0) {
+			break;
+		}
+
+		if (n == limit && value->count <= top[n - 1]->count) {
+			continue;
+		}
+
+		/* top stays ordered, the last one out if it is full */
+		for (j = MIN (n, limit - 1); j > 0 && top[j - 1]->count < value->count; j--) {
+			top[j] = top[j - 1];
+		}
+		top[j] = value;
+		n = MIN (n + 1, limit);
+	}
+
+	ret = xmmsv_new_list ();
+	for (j = 0; j < n; j++) {
+		xmmsv_list_append_string (ret, top[j]->value);
+	}
+
+	g_free (top);
+	g_free (folded);
+
+	g_mutex_unlock (&index->mutex);
+
+	return ret;
+}
@@ -0,0 +1,177 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/** @file
+ * Span tracing for correlating playback glitches with what the
+ * other threads were doing. Each thread writes its events to a ring
+ * of its own without locking, and a dump gathers all the rings into
+ * the Chrome trace event format, which Perfetto reads too.
+ */
+
+#include <glib.h>
+
+#include <xmms/xmms_config.h>
+#include <xmmspriv/xmms_trace.h>
+
+/** Events each thread keeps, older ones are overwritten */
+#define XMMS_TRACE_EVENTS 8192
+
+typedef struct xmms_trace_event_St {
+	const gchar *name;
+	gint64 ts;
+	gchar phase;
+} xmms_trace_event_t;
+
+typedef struct xmms_trace_buffer_St {
+	guint tid;
+	/** Events written so far, only the owning thread writes */
+	gint pos;
+	xmms_trace_event_t events[XMMS_TRACE_EVENTS];
+} xmms_trace_buffer_t;
+
+gint xmms_trace_enabled = 0;
+
+static GPrivate trace_buffer;
+/** All the buffers ever created, they outlive their threads so a
+    dump still shows what those did */
+static GMutex trace_lock;
+static GSList *trace_buffers = NULL;
+static guint trace_next_tid = 1;
+
+static void
+on_trace_changed (xmms_object_t *object, xmmsv_t *_data, gpointer udata)
+{
+	gint enabled;
+
+	enabled = xmms_config_property_get_int ((xmms_config_property_t *) object);
+	g_atomic_int_set (&xmms_trace_enabled, !!enabled);
+}
+
+void
+xmms_trace_init (void)
+{
+	xmms_config_property_t *cv;
+
+	g_mutex_init (&trace_lock);
+
+	cv = xmms_config_property_register ("core.trace", "0",
+	                                    on_trace_changed, NULL);
+	on_trace_changed (XMMS_OBJECT (cv), NULL, NULL);
+}
+
+void
+xmms_trace_shutdown (void)
+{
+	g_atomic_int_set (&xmms_trace_enabled, 0);
+
+	g_mutex_lock (&trace_lock);
+	g_slist_free_full (trace_buffers, g_free);
+	trace_buffers = NULL;
+	g_mutex_unlock (&trace_lock);
+
+	g_mutex_clear (&trace_lock);
+}
+
+static xmms_trace_buffer_t *
+xmms_trace_buffer_get (void)
+{
+	xmms_trace_buffer_t *buffer;
+
+	buffer = g_private_get (&trace_buffer);
+	if (G_UNLIKELY (!buffer)) {
+		buffer = g_new0 (xmms_trace_buffer_t, 1);
+
+		g_mutex_lock (&trace_lock);
+		buffer->tid = trace_next_tid++;
+		trace_buffers = g_slist_prepend (trace_buffers, buffer);
+		g_mutex_unlock (&trace_lock);
+
+		g_private_set (&trace_buffer, buffer);
+	}
+
+	return buffer;
+}
+
+/**
+ * Record the beginning ('B') or end ('E') of a span in the calling
+ * thread's ring. Use #XMMS_TRACE_BEGIN and #XMMS_TRACE_END instead.
+ */
+void
+xmms_trace_event (const gchar *name, gchar phase)
+{
+	xmms_trace_buffer_t *buffer;
+	xmms_trace_event_t *event;
+	gint pos;
+
+	buffer = xmms_trace_buffer_get ();
+
+	pos = buffer->pos;
+	event = &buffer->events[pos % XMMS_TRACE_EVENTS];
+	event->name = name;
+	event->ts = g_get_monotonic_time ();
+	event->phase = phase;
+
+	/* publishes the event to a dump running meanwhile */
+	g_atomic_int_set (&buffer->pos, pos + 1);
+}
+
+static void
+xmms_trace_dump_buffer (GString *out, xmms_trace_buffer_t *buffer,
+                        gboolean *first)
+{
+	xmms_trace_event_t *event;
+	gint pos, start, i;
+
+	pos = g_atomic_int_get (&buffer->pos);
+
+	/* the oldest events may be overwritten while this runs, leave
+	 * them out rather than show half written ones */
+	start = MAX (0, pos - XMMS_TRACE_EVENTS + XMMS_TRACE_EVENTS / 16);
+
+	for (i = start; i < pos; i++) {
+		event = &buffer->events[i % XMMS_TRACE_EVENTS];
+
+		g_string_append_printf (out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\","
+		                        "\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":%u}",
+		                        *first ? "" : ",", event->name,
+		                        event->phase, event->ts, buffer->tid);
+		*first = FALSE;
+	}
+}
+
+/**
+ * All the events still in the rings as a Chrome trace event format
+ * JSON document, timestamps in µs on the monotonic clock.
+ */
+gchar *
+xmms_trace_dump (void)
+{
+	gboolean first = TRUE;
+	GString *out;
+	GSList *n;
+
+	out = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	g_mutex_lock (&trace_lock);
+	for (n = trace_buffers; n; n = g_slist_next (n)) {
+		xmms_trace_dump_buffer (out, n->data, &first);
+	}
+	g_mutex_unlock (&trace_lock);
+
+	g_string_append (out, "\n]}\n");
+
+	return g_string_free (out, FALSE);
+}
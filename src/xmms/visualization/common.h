@@ -21,6 +21,7 @@
 
 #include <xmmspriv/xmms_log.h>
 #include <xmmspriv/xmms_visualization.h>
+#include <xmmspriv/xmms_ringbuf.h>
 #include <xmmsc/xmmsc_visualization.h>
 
 /**
@@ -36,6 +37,20 @@ typedef struct {
 	xmms_visualization_t *vis;
 } xmms_vis_server_t;
 
+/* UDP chunks that go out together in one syscall */
+#define VIS_UDP_BATCH 4
+#define VIS_UDP_PACKET_SIZE (XMMS_VISPACKET_UDP_OFFSET + sizeof (xmmsc_vischunk_t))
+
+/**
+ * Packets waiting to be sent to a UDP client, allocated once.
+ */
+
+typedef struct {
+	gchar packets[VIS_UDP_BATCH][VIS_UDP_PACKET_SIZE];
+	gint lens[VIS_UDP_BATCH];
+	gint queued;
+} xmms_vis_udp_batch_t;
+
 /**
  * The structures for a vis client.
  */
@@ -43,18 +58,28 @@ typedef struct {
 typedef struct {
 	union {
 		xmmsc_vis_unixshm_t shm;
+		xmmsc_vis_shmring_t ring;
 		xmmsc_vis_udp_t udp;
 	} transport;
 	xmmsc_vis_transport_t type;
 	xmms_vis_server_t *server;
 	unsigned short format;
 	xmmsc_vis_properties_t prop;
+	xmms_vis_udp_batch_t *batch;
+	/* band levels after decay, for VIS_BANDS */
+	gfloat bands[XMMSC_VISUALIZATION_MAX_BANDS];
+	/* chunks written, left out to save time and lost on the way
+	   (client gone or not keeping up) */
+	guint sent;
+	guint skipped;
+	guint dropped;
 } xmms_vis_client_t;
 
 /* provided by object.c */
 xmms_vis_client_t *get_client (int32_t id);
 void delete_client (int32_t id);
-void send_data (int channels, int size, int16_t *buf);
+void properties_init (xmmsc_vis_properties_t *p);
+void queue_data (int channels, int size, int16_t *buf);
 
 /* provided by unixshm.c / dummy.c */
 int32_t init_shm (xmms_visualization_t *vis, int32_t id, int32_t shmid, xmms_error_t *err);
@@ -63,15 +88,20 @@ gboolean write_start_shm (int32_t id, xmmsc_vis_unixshm_t *t, xmmsc_vischunk_t *
 void write_finish_shm (int32_t id, xmmsc_vis_unixshm_t *t, xmmsc_vischunk_t *dest);
 
 gboolean write_shm (xmmsc_vis_unixshm_t *t, xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf);
+int32_t init_shmring (xmms_visualization_t *vis, int32_t id, int32_t shmid, xmms_error_t *err);
+void cleanup_shmring (xmmsc_vis_shmring_t *t);
+gboolean write_shmring (xmmsc_vis_shmring_t *t, xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf);
 
 /* provided by udp.c */
 int32_t init_udp (xmms_visualization_t *vis, int32_t id, xmms_error_t *err);
 void cleanup_udp (xmmsc_vis_udp_t *t, xmms_socket_t socket);
+gboolean setup_multicast (xmms_visualization_t *vis, const gchar *address);
 gboolean write_udp (xmmsc_vis_udp_t *t, xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf, int socket);
 
 /* provided by format.c */
 void fft_init (void);
-short fill_buffer (int16_t *dest, xmmsc_vis_properties_t* prop, int channels, int size, short *src);
+void format_chunk_begin (int samplerate);
+short fill_buffer (int16_t *dest, xmms_vis_client_t *c, int channels, int size, short *src);
 
 /* never call a fetch without a guaranteed release following! */
 #define x_fetch_client(id) \
@@ -85,6 +115,19 @@ short fill_buffer (int16_t *dest, xmmsc_vis_properties_t* prop, int channels, in
 #define x_release_client() \
 	g_mutex_unlock (&vis->clientlock);
 
+/* Play time marks kept for the samples in the tap */
+#define VIS_TAP_MARKS 128
+
+/**
+ * When the sample at tap position pos is to be played, on the
+ * monotonic clock.
+ */
+
+typedef struct {
+	guint64 pos;
+	gint64 play_at;
+} xmms_vis_mark_t;
+
 /**
  * The structures for the vis module
  */
@@ -99,6 +142,38 @@ struct xmms_visualization_St {
 	GMutex clientlock;
 	int32_t clientc;
 	xmms_vis_client_t **clientv;
+	/* clients in clientv, changed under clientlock */
+	gint attached;
+
+	/* Decoded samples on their way to the vis thread, written by the
+	 * xform or the output and read by the thread only */
+	xmms_ringbuf_t *tap;
+	gint tap_channels;
+	gint tap_rate;
+	/* visualization.source is "output", the xform leaves the tap be */
+	gint at_output;
+	/* bytes put in the tap and taken out, by the writer and the
+	 * thread respectively */
+	guint64 tap_written;
+	guint64 tap_read;
+	/* one mark per write, marks_wr counts them */
+	xmms_vis_mark_t marks[VIS_TAP_MARKS];
+	gint marks_wr;
+	GThread *thread;
+	gint running;
+
+	/* Only every decimate'th chunk goes out while sending them takes
+	 * too long, only touched by the thread */
+	gint decimate;
+	guint chunk_no;
+	guint adapt_in;
+	/* average time taken sending a chunk, in us, under clientlock */
+	gint64 send_time;
+
+	/* One stream for any number of receivers on the LAN, under
+	 * clientlock */
+	xmms_vis_client_t *multicast;
+	xmms_socket_t multicast_socket;
 };
 
 #endif
@@ -37,3 +37,19 @@ write_shm (xmmsc_vis_unixshm_t *t, xmms_vis_client_t *c, int32_t id, struct time
 {
 	return FALSE;
 }
+
+int32_t
+init_shmring (xmms_visualization_t *vis, int32_t id, int32_t shmid, xmms_error_t *err)
+{
+	xmms_error_set (err, XMMS_ERROR_NO_SAUSAGE,
+	                "Shared Memory not supported by this platform!");
+	return -1;
+}
+
+void cleanup_shmring (xmmsc_vis_shmring_t *t) {}
+
+gboolean
+write_shmring (xmmsc_vis_shmring_t *t, xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf)
+{
+	return FALSE;
+}
@@ -1,4 +1,5 @@
 #include <math.h>
+#include <string.h>
 #include "common.h"
 
 #define FFT_LEN XMMSC_VISUALIZATION_WINDOW_SIZE
@@ -10,114 +11,173 @@
 #define AMP_LOG_SCALE_DIVISOR		6.908f	/* divisor = -log threshold */
 #define FREQ_LOG_SCALE_BASE		2.0f
 
+#define FFT_HALF (FFT_LEN / 2)
+#define FFT_HALF_BITS (FFT_BITS - 1)
+
+
+/* Band levels are dB over this range below full scale */
+#define BANDS_DB_RANGE 60.0f
+
+/* Onsets are spectral flux this much over its average in the last
+   BEAT_HISTORY chunks (about half a second), at most one every
+   BEAT_HOLDOFF chunks */
+#define BEAT_HISTORY 43
+#define BEAT_THRESHOLD 1.5f
+#define BEAT_HOLDOFF 8
+
 static gfloat window[FFT_LEN];
+/* e^(-2 pi i k / FFT_LEN) */
+static gfloat twiddle[FFT_HALF][2];
+static guint16 bitrev[FFT_HALF];
 static gfloat spec[FFT_LEN/2];
 static gboolean fft_ready = FALSE;
 static gboolean fft_done;
+/* of the samples in the chunk, the bands depend on it */
+static gint rate = 44100;
+
+/* Everything below is worked out at most once per chunk, for the
+   first client that wants it. Only the vis thread gets here. */
+static gboolean levels_done;
+static short peak[2];
+static short rms[2];
+
+static struct {
+	gboolean done;
+	gint count;
+	gdouble min, max;
+	gfloat level[XMMSC_VISUALIZATION_MAX_BANDS];
+} bands;
+
+static gboolean beat_done;
+static gfloat beat_spec[FFT_HALF];
+static gfloat beat_flux[BEAT_HISTORY];
+static gint beat_pos;
+static gint beat_since;
+static short beat_out[2];
 
 void fft_init ()
 {
 	if (!fft_ready) {
-		int i;
+		int i, b;
 		/* calculate Hann window used to reduce spectral leakage */
 		for (i = 0; i < FFT_LEN; i++) {
 			window[i] = 0.5 - 0.5 * cos (2.0 * M_PI * i / FFT_LEN);
 		}
-		fft_done = TRUE;
+		for (i = 0; i < FFT_HALF; i++) {
+			twiddle[i][0] =  cos (2.0 * M_PI * i / FFT_LEN);
+			twiddle[i][1] = -sin (2.0 * M_PI * i / FFT_LEN);
+		}
+		for (i = 0; i < FFT_HALF; i++) {
+			bitrev[i] = 0;
+			for (b = 0; b < FFT_HALF_BITS; b++) {
+				if (i & (1 << b)) {
+					bitrev[i] |= 1 << (FFT_HALF_BITS - 1 - b);
+				}
+			}
+		}
+		fft_ready = TRUE;
 	}
 	fft_done = FALSE;
 }
 
+/**
+ * Forget what was computed for the last chunk, the next one is at
+ * samplerate.
+ */
+void
+format_chunk_begin (int samplerate)
+{
+	rate = samplerate;
+	fft_done = FALSE;
+	levels_done = FALSE;
+	bands.done = FALSE;
+	beat_done = FALSE;
+}
+
 /* interesting:	data->value.uint32 = xmms_sample_samples_to_ms (vis->format, pos); */
 
-static void
-fft (short *samples, gfloat *spec)
+static inline gfloat
+fft_sample (short *samples, gint i)
 {
-	gint nv2, k, l, j = 0, i;
-	gfloat t_r, t_i;
-	gfloat buf[FFT_LEN][2];
-
-	for (i = 0; i < FFT_LEN; i++){
-		buf[i][0]  = (float) samples[j++];
-		buf[i][0] += (float) samples[j++];
-		buf[i][0] /= (float) (1 << 17);
-		buf[i][0] *= window[i];
-		buf[i][1] = 0.0f;
-	}
-
-	/* reorder... */  /* this is crappy! Go rewrite it using real bitreversing */
-	nv2 = FFT_LEN / 2;
-	j = 1;
-
-	for (i = 1; i < FFT_LEN; i++) {
-		if (i < j) {
-			t_r = buf[i - 1][0];
-			t_i = buf[i - 1][1];
-			buf[i - 1][0] = buf[j - 1][0];
-			buf[i - 1][1] = buf[j - 1][1];
-			buf[j - 1][0] = t_r;
-			buf[j - 1][1] = t_i;
-		}
+	gfloat v;
 
-		k = nv2;
+	v  = (float) samples[2 * i];
+	v += (float) samples[2 * i + 1];
+	v /= (float) (1 << 17);
 
-		while (k < j) {
-			j -= k;
-			k >>= 1;
-		}
+	return v * window[i];
+}
 
-		j += k;
+/**
+ * Real input FFT: the FFT_LEN real samples are packed into a complex
+ * FFT of half the length, which is split into the real spectrum
+ * afterwards.
+ */
+static void
+fft (short *samples, gfloat *spec)
+{
+	gint le, half, step, k, m, j, i;
+	gfloat t_r, t_i, w_r, w_i, e_r, e_i, o_r, o_i;
+	gfloat buf[FFT_HALF][2];
+
+	/* even samples go to the real part, odd to the imaginary part,
+	 * stored in bit reversed order */
+	for (i = 0; i < FFT_HALF; i++) {
+		buf[bitrev[i]][0] = fft_sample (samples, 2 * i);
+		buf[bitrev[i]][1] = fft_sample (samples, 2 * i + 1);
 	}
 
-	/* do fft */
-	for (l = 1; l <= FFT_BITS; l++) {
-		gint le = 1 << l;
-		gint le1 = le / 2;
-		gfloat u_r = 1.0;
-		gfloat u_i = 0.0;
-		gfloat w_r =  cosf (M_PI / (float) le1);
-		gfloat w_i = -sinf (M_PI / (float) le1);
+	for (le = 2; le <= FFT_HALF; le <<= 1) {
+		half = le / 2;
+		step = FFT_LEN / le;
 
-		for (j = 1; j <= le1; j++) {
-			for (i = j; i <= FFT_LEN; i += le) {
-				gint ip = i + le1;
+		for (j = 0; j < half; j++) {
+			w_r = twiddle[j * step][0];
+			w_i = twiddle[j * step][1];
 
-				t_r = buf[ip - 1][0] * u_r - u_i * buf[ip - 1][1];
-				t_i = buf[ip - 1][1] * u_r + u_i * buf[ip - 1][0];
+			for (i = j; i < FFT_HALF; i += le) {
+				gint ip = i + half;
 
-				buf[ip - 1][0] = buf[i - 1][0] - t_r;
-				buf[ip - 1][1] = buf[i - 1][1] - t_i;
+				t_r = buf[ip][0] * w_r - buf[ip][1] * w_i;
+				t_i = buf[ip][0] * w_i + buf[ip][1] * w_r;
 
-				buf[i - 1][0] =  buf[i - 1][0] + t_r;
-				buf[i - 1][1] =  buf[i - 1][1] + t_i;
-			}
+				buf[ip][0] = buf[i][0] - t_r;
+				buf[ip][1] = buf[i][1] - t_i;
 
-			t_r = u_r * w_r - w_i * u_i;
-			u_i = w_r * u_i + w_i * u_r;
-			u_r = t_r;
+				buf[i][0] += t_r;
+				buf[i][1] += t_i;
+			}
 		}
 	}
 
-	/* output abs-value instead */
-	for (i = 0; i < nv2; i++) {
-		spec[i] = 2 * hypot (buf[i][0], buf[i][1]) / FFT_LEN;
+	/* split into the spectrum of the real input, output abs-value */
+	for (k = 0; k < FFT_HALF; k++) {
+		m = (FFT_HALF - k) & (FFT_HALF - 1);
+
+		e_r = (buf[k][0] + buf[m][0]) / 2;
+		e_i = (buf[k][1] - buf[m][1]) / 2;
+		o_r = (buf[k][1] + buf[m][1]) / 2;
+		o_i = (buf[m][0] - buf[k][0]) / 2;
+
+		t_r = e_r + twiddle[k][0] * o_r - twiddle[k][1] * o_i;
+		t_i = e_i + twiddle[k][0] * o_i + twiddle[k][1] * o_r;
+
+		spec[k] = 2 * sqrtf (t_r * t_r + t_i * t_i) / FFT_LEN;
 	}
 
 	/* correct the scale */
-	spec[nv2 - 1] /= 2;
+	spec[FFT_HALF - 1] /= 2;
 }
 
 /**
- * Calculate the FFT on the decoded data buffer.
+ * Calculate the FFT on the decoded data buffer, if it hasn't been
+ * already. Only works on stereo windows.
  */
-static short
-fill_buffer_fft (int16_t* dest, int size, short *src)
+static gboolean
+spectrum_get (int size, short *src)
 {
-	int i;
-	float tmp;
-
 	if (size != FFT_LEN * 2) {
-		return 0;
+		return FALSE;
 	}
 
 	if (!fft_done) {
@@ -125,6 +185,19 @@ fill_buffer_fft (int16_t* dest, int size, short *src)
 		fft_done = TRUE;
 	}
 
+	return TRUE;
+}
+
+static short
+fill_buffer_fft (int16_t* dest, int size, short *src)
+{
+	int i;
+	float tmp;
+
+	if (!spectrum_get (size, src)) {
+		return 0;
+	}
+
 	/* TODO: more sophisticated! */
 	for (i = 0; i < FFT_LEN / 2; ++i) {
 		if (spec[i] >= 1.0) {
@@ -144,40 +217,164 @@ fill_buffer_fft (int16_t* dest, int size, short *src)
 	return FFT_LEN / 2;
 }
 
-short
-fill_buffer (int16_t *dest, xmmsc_vis_properties_t* prop, int channels, int size, short *src)
+/**
+ * Peak and RMS of the first two channels, mono counts twice.
+ */
+static void
+levels_get (int channels, int size, short *src)
 {
-	int i, j;
-	if (prop->type == VIS_PEAK) {
-		short l = 0, r = 0;
-		for (i = 0; i < size; i += channels) {
-			if (src[i] > 0 && src[i] > l) {
-				l = src[i];
-			}
-			if (src[i] < 0 && -src[i] > l) {
-				l = -src[i];
-			}
-			if (channels > 1) {
-				if (src[i+1] > 0 && src[i+1] > r) {
-					r = src[i+1];
-				}
-				if (src[i+1] < 0 && -src[i+1] > r) {
-					r = -src[i+1];
-				}
-			}
+	gdouble sum[2] = { 0.0, 0.0 };
+	gint i, j, v, frames, n;
+
+	if (levels_done) {
+		return;
+	}
+	levels_done = TRUE;
+
+	n = MIN (channels, 2);
+	frames = size / channels;
+	peak[0] = peak[1] = 0;
+
+	for (i = 0; i < size; i += channels) {
+		for (j = 0; j < n; j++) {
+			v = ABS ((gint) src[i + j]);
+			peak[j] = MAX (peak[j], MIN (v, SHRT_MAX));
+			sum[j] += (gdouble) v * v;
 		}
-		if (channels == 1) {
-			r = l;
+	}
+
+	for (j = 0; j < n; j++) {
+		rms[j] = frames ? MIN (sqrt (sum[j] / frames), SHRT_MAX) : 0;
+	}
+	if (n == 1) {
+		peak[1] = peak[0];
+		rms[1] = rms[0];
+	}
+}
+
+static short
+fill_buffer_levels (int16_t *dest, xmmsc_vis_properties_t *prop, short *l)
+{
+	if (prop->stereo) {
+		dest[0] = htons (l[0]);
+		dest[1] = htons (l[1]);
+		return 2;
+	}
+	dest[0] = htons ((l[0] + l[1]) / 2);
+	return 1;
+}
+
+/**
+ * Log spaced bands as dB, rising at once and falling by the client's
+ * decay.
+ */
+static short
+fill_buffer_bands (int16_t *dest, xmms_vis_client_t *c, int size, short *src)
+{
+	xmmsc_vis_properties_t *prop = &c->prop;
+	gdouble ratio, lo, hi;
+	gfloat energy, db;
+	gint b, k, k0, k1;
+
+	if (!spectrum_get (size, src)) {
+		return 0;
+	}
+
+	if (!bands.done || bands.count != prop->bands ||
+	    bands.min != prop->bands_min || bands.max != prop->bands_max) {
+		ratio = pow (prop->bands_max / prop->bands_min, 1.0 / prop->bands);
+		lo = prop->bands_min;
+
+		for (b = 0; b < prop->bands; b++) {
+			hi = lo * ratio;
+
+			/* low bands are narrower than a bin, they get the
+			   one they are in */
+			k0 = CLAMP ((gint) (lo * FFT_LEN / rate), 0, FFT_HALF - 1);
+			k1 = CLAMP ((gint) ceil (hi * FFT_LEN / rate), k0 + 1, FFT_HALF);
+
+			energy = 0.0f;
+			for (k = k0; k < k1; k++) {
+				energy += spec[k] * spec[k];
+			}
+
+			db = 10.0f * log10f (energy + 1e-12f);
+			bands.level[b] = CLAMP ((db + BANDS_DB_RANGE) / BANDS_DB_RANGE,
+			                        0.0f, 1.0f);
+			lo = hi;
 		}
-		if (prop->stereo) {
-			dest[0] = htons (l);
-			dest[1] = htons (r);
-			size = 2;
-		} else {
-			dest[0] = htons ((l + r) / 2);
-			size = 1;
+
+		bands.done = TRUE;
+		bands.count = prop->bands;
+		bands.min = prop->bands_min;
+		bands.max = prop->bands_max;
+	}
+
+	for (b = 0; b < prop->bands; b++) {
+		c->bands[b] = MAX (bands.level[b], c->bands[b] * prop->bands_decay);
+		dest[b] = htons ((int16_t) (c->bands[b] * SHRT_MAX));
+	}
+
+	return prop->bands;
+}
+
+/**
+ * Onset detection by spectral flux, gives the onset strength (half
+ * scale at the threshold) and whether there is a beat in the chunk.
+ */
+static void
+beat_get (int size, short *src)
+{
+	gfloat flux = 0.0f, avg = 0.0f;
+	gint k;
+
+	if (beat_done) {
+		return;
+	}
+	beat_done = TRUE;
+
+	beat_out[0] = beat_out[1] = 0;
+	if (!spectrum_get (size, src)) {
+		return;
+	}
+
+	for (k = 0; k < FFT_HALF; k++) {
+		flux += MAX (spec[k] - beat_spec[k], 0.0f);
+	}
+	memcpy (beat_spec, spec, sizeof (beat_spec));
+
+	for (k = 0; k < BEAT_HISTORY; k++) {
+		avg += beat_flux[k];
+	}
+	avg /= BEAT_HISTORY;
+
+	beat_flux[beat_pos] = flux;
+	beat_pos = (beat_pos + 1) % BEAT_HISTORY;
+
+	if (beat_since < BEAT_HOLDOFF) {
+		beat_since++;
+	}
+
+	if (avg > 0.0f) {
+		beat_out[0] = MIN (flux / (avg * BEAT_THRESHOLD * 2), 1.0f) * SHRT_MAX;
+		if (flux > avg * BEAT_THRESHOLD && beat_since == BEAT_HOLDOFF) {
+			beat_out[1] = SHRT_MAX;
+			beat_since = 0;
 		}
 	}
+}
+
+short
+fill_buffer (int16_t *dest, xmms_vis_client_t *c, int channels, int size, short *src)
+{
+	xmmsc_vis_properties_t *prop = &c->prop;
+	int i, j;
+
+	if (prop->type == VIS_PEAK || prop->type == VIS_RMS) {
+		levels_get (channels, size, src);
+		size = fill_buffer_levels (dest, prop,
+		                           prop->type == VIS_PEAK ? peak : rms);
+	}
 	if (prop->type == VIS_PCM) {
 		for (i = 0, j = 0; i < size; i += channels, j++) {
 			short *l, *r;
@@ -205,5 +402,14 @@ fill_buffer (int16_t *dest, xmmsc_vis_properties_t* prop, int channels, int size
 	if (prop->type == VIS_SPECTRUM) {
 		size = fill_buffer_fft (dest, size, src);
 	}
+	if (prop->type == VIS_BANDS) {
+		size = fill_buffer_bands (dest, c, size, src);
+	}
+	if (prop->type == VIS_BEAT) {
+		beat_get (size, src);
+		dest[0] = htons (beat_out[0]);
+		dest[1] = htons (beat_out[1]);
+		size = 2;
+	}
 	return size;
 }
@@ -20,7 +20,10 @@
 
 #include <xmms/xmms_object.h>
 #include <xmms/xmms_sample.h>
+#include <xmms/xmms_config.h>
 #include <xmmspriv/xmms_ipc.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_footprint.h>
 
 #include "common.h"
 
@@ -32,14 +35,34 @@
 
 static xmms_visualization_t *vis = NULL;
 
+/* The tap holds this many windows of the widest stream it takes, the
+   decoder drops what doesn't fit rather than waiting for clients */
+#define VIS_TAP_WINDOWS 16
+#define VIS_TAP_CHANNELS 8
+/* the only rate the visualization effect takes */
+#define VIS_TAP_RATE 44100
+/* Sending chunks may take this much of the time they play for
+   before only some of them are sent, at most one in VIS_DECIMATE_MAX.
+   Decimation is reconsidered every VIS_ADAPT_CHUNKS sent chunks. */
+#define VIS_LOAD_HIGH 25
+#define VIS_LOAD_LOW 8
+#define VIS_DECIMATE_MAX 8
+#define VIS_ADAPT_CHUNKS 32
+/* Samples converted on the stack at a time when feeding from the
+   output */
+#define VIS_TAP_CONVERT 1024
+
 static int32_t xmms_visualization_client_query_version (xmms_visualization_t *vis, xmms_error_t *err);
 static int32_t xmms_visualization_client_register (xmms_visualization_t *vis, xmms_error_t *err);
 static int32_t xmms_visualization_client_init_shm (xmms_visualization_t *vis, int32_t id, const char *shmid, xmms_error_t *err);
 static int32_t xmms_visualization_client_init_udp (xmms_visualization_t *vis, int32_t id, xmms_error_t *err);
+static int32_t xmms_visualization_client_init_shmring (xmms_visualization_t *vis, int32_t id, const char *shmid, xmms_error_t *err);
 static int32_t xmms_visualization_client_set_property (xmms_visualization_t *vis, int32_t id, const gchar *key, const gchar *value, xmms_error_t *err);
 static int32_t xmms_visualization_client_set_properties (xmms_visualization_t *vis, int32_t id, xmmsv_t *prop, xmms_error_t *err);
 static void xmms_visualization_client_shutdown (xmms_visualization_t *vis, int32_t id, xmms_error_t *err);
+static xmmsv_t *xmms_visualization_client_client_stats (xmms_visualization_t *vis, int32_t id, xmms_error_t *err);
 static void xmms_visualization_destroy (xmms_object_t *object);
+static gpointer xmms_visualization_thread (gpointer udata);
 
 #include "visualization/object_ipc.c"
 
@@ -63,6 +86,8 @@ create_client (void)
 	if (!vis->clientv || (!(vis->clientv[id] = g_new (xmms_vis_client_t, 1)))) {
 		vis->clientc = 0;
 		id = -1;
+	} else {
+		g_atomic_int_inc (&vis->attached);
 	}
 
 	xmms_log_info ("Attached visualization client %d", id);
@@ -96,30 +121,81 @@ delete_client (int32_t id)
 
 	if (c->type == VIS_UNIXSHM) {
 		cleanup_shm (&c->transport.shm);
+	} else if (c->type == VIS_SHMRING) {
+		cleanup_shmring (&c->transport.ring);
 	} else if (c->type == VIS_UDP) {
 		if (c->server) {
 			cleanup_udp (&c->transport.udp, c->server->socket);
 		}
 	}
 
+	g_free (c->batch);
 	g_free (c);
 	vis->clientv[id] = NULL;
+	g_atomic_int_add (&vis->attached, -1);
 
 	xmms_log_info ("Removed visualization client %d", id);
 }
 
+static void
+on_multicast_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	const gchar *address;
+
+	address = xmms_config_property_get_string ((xmms_config_property_t *) object);
+
+	g_mutex_lock (&vis->clientlock);
+	setup_multicast (vis, address);
+	g_mutex_unlock (&vis->clientlock);
+}
+
+static void
+on_source_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	const gchar *source;
+
+	source = xmms_config_property_get_string ((xmms_config_property_t *) object);
+
+	/* anything else is the hook in the effect chain */
+	g_atomic_int_set (&vis->at_output, !g_ascii_strcasecmp (source, "output"));
+}
+
 /**
  * Initialize the Vis module.
  */
 xmms_visualization_t *
 xmms_visualization_new (xmms_output_t *output)
 {
+	xmms_config_property_t *prop;
+
 	vis = xmms_object_new (xmms_visualization_t, xmms_visualization_destroy);
 	g_mutex_init (&vis->clientlock);
 	vis->clientc = 0;
 	vis->output = output;
 	vis->serverc = 0;
 
+	vis->tap = xmms_ringbuf_new (VIS_TAP_WINDOWS * VIS_TAP_CHANNELS *
+	                             XMMSC_VISUALIZATION_WINDOW_SIZE * sizeof (short));
+	vis->tap_channels = 2;
+	vis->tap_rate = VIS_TAP_RATE;
+	vis->running = TRUE;
+	vis->decimate = 1;
+	vis->adapt_in = VIS_ADAPT_CHUNKS;
+
+	/* "chain" has the visualization effect feed the tap, "output"
+	   what goes to the soundcard, after all effects */
+	prop = xmms_config_property_register ("visualization.source", "chain",
+	                                      on_source_changed, NULL);
+	on_source_changed (XMMS_OBJECT (prop), NULL, NULL);
+
+	/* spectrum data for all the screens on the LAN, e.g. 239.255.42.1:9668 */
+	prop = xmms_config_property_register ("visualization.multicast_address", "",
+	                                      on_multicast_changed, NULL);
+	setup_multicast (vis, xmms_config_property_get_string (prop));
+
+	vis->thread = g_thread_new ("x2 visualization",
+	                            xmms_visualization_thread, vis);
+
 	xmms_object_ref (output);
 
 	xmms_visualization_register_ipc_commands (XMMS_OBJECT (vis));
@@ -139,6 +215,12 @@ xmms_visualization_destroy (xmms_object_t *object)
 
 	XMMS_DBG ("Deactivating visualization object.");
 
+	g_atomic_int_set (&vis->running, FALSE);
+	xmms_ringbuf_set_eos (vis->tap, TRUE);
+	g_thread_join (vis->thread);
+	xmms_ringbuf_destroy (vis->tap);
+	setup_multicast (vis, NULL);
+
 	xmms_object_unref (vis->output);
 
 	/* TODO: assure that the xform is already dead! */
@@ -168,12 +250,17 @@ xmms_visualization_client_query_version (xmms_visualization_t *vis, xmms_error_t
 	return XMMS_VISPACKET_VERSION;
 }
 
-static void
+void
 properties_init (xmmsc_vis_properties_t *p)
 {
 	p->type = VIS_PCM;
 	p->stereo = 1;
 	p->pcm_hardwire = 0;
+	/* third octaves over what can be heard */
+	p->bands = 30;
+	p->bands_min = 20.0;
+	p->bands_max = 20000.0;
+	p->bands_decay = 0.8;
 }
 
 static gboolean
@@ -186,6 +273,12 @@ property_set (xmmsc_vis_properties_t *p, const gchar* key, const gchar* data)
 			p->type = VIS_SPECTRUM;
 		} else if (!g_ascii_strcasecmp (data, "peak")) {
 			p->type = VIS_PEAK;
+		} else if (!g_ascii_strcasecmp (data, "rms")) {
+			p->type = VIS_RMS;
+		} else if (!g_ascii_strcasecmp (data, "bands")) {
+			p->type = VIS_BANDS;
+		} else if (!g_ascii_strcasecmp (data, "beat")) {
+			p->type = VIS_BEAT;
 		} else {
 			return FALSE;
 		}
@@ -193,6 +286,30 @@ property_set (xmmsc_vis_properties_t *p, const gchar* key, const gchar* data)
 		p->stereo = (atoi (data) > 0);
 	} else if (!g_ascii_strcasecmp (key, "pcm.hardwire")) {
 		p->pcm_hardwire = (atoi (data) > 0);
+	} else if (!g_ascii_strcasecmp (key, "bands")) {
+		p->bands = atoi (data);
+		if (p->bands < 1 || p->bands > XMMSC_VISUALIZATION_MAX_BANDS) {
+			p->bands = CLAMP (p->bands, 1, XMMSC_VISUALIZATION_MAX_BANDS);
+			return FALSE;
+		}
+	} else if (!g_ascii_strcasecmp (key, "bands.min") ||
+	           !g_ascii_strcasecmp (key, "bands.max")) {
+		gdouble freq = g_strtod (data, NULL);
+		/* the vis hook takes 44.1kHz only */
+		if (freq < 1.0 || freq > 22050.0) {
+			return FALSE;
+		}
+		if (!g_ascii_strcasecmp (key, "bands.min")) {
+			p->bands_min = freq;
+		} else {
+			p->bands_max = freq;
+		}
+	} else if (!g_ascii_strcasecmp (key, "bands.decay")) {
+		p->bands_decay = g_strtod (data, NULL);
+		if (p->bands_decay < 0.0 || p->bands_decay >= 1.0) {
+			p->bands_decay = CLAMP (p->bands_decay, 0.0, 0.99);
+			return FALSE;
+		}
 	/* TODO: all the stuff following */
 	} else if (!g_ascii_strcasecmp (key, "timeframe")) {
 		p->timeframe = g_strtod (data, NULL);
@@ -221,6 +338,9 @@ xmms_visualization_client_register (xmms_visualization_t *vis, xmms_error_t *err
 		c->type = VIS_NONE;
 		c->server = NULL;
 		c->format = 0;
+		c->batch = NULL;
+		c->sent = c->skipped = c->dropped = 0;
+		memset (c->bands, 0, sizeof (c->bands));
 		properties_init (&c->prop);
 	}
 	g_mutex_unlock (&vis->clientlock);
@@ -293,6 +413,20 @@ xmms_visualization_client_init_shm (xmms_visualization_t *vis, int32_t id, const
 	return init_shm (vis, id, shmid, err);
 }
 
+static int32_t
+xmms_visualization_client_init_shmring (xmms_visualization_t *vis, int32_t id, const char *shmidstr, xmms_error_t *err)
+{
+	int shmid;
+
+	XMMS_DBG ("Trying to init shm ring!");
+
+	if (sscanf (shmidstr, "%d", &shmid) != 1) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "couldn't parse shmid");
+		return -1;
+	}
+	return init_shmring (vis, id, shmid, err);
+}
+
 static int32_t
 xmms_visualization_client_init_udp (xmms_visualization_t *vis, int32_t id, xmms_error_t *err)
 {
@@ -308,11 +442,38 @@ xmms_visualization_client_shutdown (xmms_visualization_t *vis, int32_t id, xmms_
 	g_mutex_unlock (&vis->clientlock);
 }
 
+static xmmsv_t *
+xmms_visualization_client_client_stats (xmms_visualization_t *vis, int32_t id, xmms_error_t *err)
+{
+	xmms_vis_client_t *c;
+	xmmsv_t *ret;
+
+	g_mutex_lock (&vis->clientlock);
+	c = get_client (id);
+	if (!c) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "invalid server-side identifier provided");
+		g_mutex_unlock (&vis->clientlock);
+		return NULL;
+	}
+
+	ret = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("sent", c->sent),
+	                        XMMSV_DICT_ENTRY_INT ("skipped", c->skipped),
+	                        XMMSV_DICT_ENTRY_INT ("dropped", c->dropped),
+	                        XMMSV_DICT_ENTRY_INT ("decimation", g_atomic_int_get (&vis->decimate)),
+	                        XMMSV_DICT_ENTRY_INT ("send_time", vis->send_time),
+	                        XMMSV_DICT_END);
+	g_mutex_unlock (&vis->clientlock);
+
+	return ret;
+}
+
 static gboolean
 package_write (xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf)
 {
 	if (c->type == VIS_UNIXSHM) {
 		return write_shm (&c->transport.shm, c, id, time, channels, size, buf);
+	} else if (c->type == VIS_SHMRING) {
+		return write_shmring (&c->transport.ring, c, id, time, channels, size, buf);
 	} else if (c->type == VIS_UDP) {
 		if (c->server) {
 			return write_udp (&c->transport.udp, c, id, time, channels, size, buf, c->server->socket);
@@ -321,36 +482,321 @@ package_write (xmms_vis_client_t *c, int32_t id, struct timeval *time, int chann
 	return FALSE;
 }
 
-void
-send_data (int channels, int size, short *buf)
+/**
+ * Send fewer chunks while sending takes more than VIS_LOAD_HIGH
+ * percent of the time they play for, more again once it is below
+ * VIS_LOAD_LOW.
+ */
+static void
+decimation_adapt (int channels, int rate, int size)
+{
+	gint64 period;
+	gint load, decimate;
+
+	if (--vis->adapt_in > 0) {
+		return;
+	}
+	vis->adapt_in = VIS_ADAPT_CHUNKS;
+
+	decimate = vis->decimate;
+	period = (gint64) (size / channels) * G_USEC_PER_SEC / rate;
+	load = period ? vis->send_time * 100 / (period * decimate) : 0;
+
+	if (load > VIS_LOAD_HIGH && decimate < VIS_DECIMATE_MAX) {
+		decimate *= 2;
+	} else if (load < VIS_LOAD_LOW && decimate > 1) {
+		decimate /= 2;
+	} else {
+		return;
+	}
+
+	XMMS_DBG ("Visualization takes %d%% of the playing time, sending one in %d chunks",
+	          load, decimate);
+	g_atomic_int_set (&vis->decimate, decimate);
+}
+
+static void
+send_data (int channels, int rate, int size, short *buf, gint64 play_at)
 {
 	int i;
 	struct timeval time;
-	guint32 latency;
+	gint64 stamp, start;
 
-	if (!vis) {
+	if (vis->chunk_no++ % vis->decimate) {
+		g_mutex_lock (&vis->clientlock);
+		for (i = 0; i < vis->clientc; ++i) {
+			if (vis->clientv[i]) {
+				vis->clientv[i]->skipped++;
+			}
+		}
+		g_mutex_unlock (&vis->clientlock);
 		return;
 	}
 
-	latency = xmms_output_latency (vis->output);
+	start = g_get_monotonic_time ();
 
-	fft_init ();
+	/* whatever gets computed for one client is kept for the others */
+	format_chunk_begin (rate);
 
-	gettimeofday (&time, NULL);
-	time.tv_sec += (latency / 1000);
-	time.tv_usec += (latency % 1000) * 1000;
-	if (time.tv_usec > 1000000) {
-		time.tv_sec++;
-		time.tv_usec -= 1000000;
-	}
+	/* clients go by the wall clock */
+	stamp = g_get_real_time () + (play_at - start);
+	time.tv_sec = stamp / G_USEC_PER_SEC;
+	time.tv_usec = stamp % G_USEC_PER_SEC;
 
 	g_mutex_lock (&vis->clientlock);
 	for (i = 0; i < vis->clientc; ++i) {
-		if (vis->clientv[i]) {
-			package_write (vis->clientv[i], i, &time, channels, size, buf);
+		xmms_vis_client_t *c = vis->clientv[i];
+
+		if (!c) {
+			continue;
+		}
+		if (package_write (c, i, &time, channels, size, buf)) {
+			c->sent++;
+		} else if (c->type != VIS_NONE) {
+			c->dropped++;
 		}
 	}
+	if (vis->multicast) {
+		write_udp (&vis->multicast->transport.udp, vis->multicast, -1,
+		           &time, channels, size, buf, vis->multicast_socket);
+	}
+
+	/* a slow average, one chunk that took long doesn't matter */
+	vis->send_time += (g_get_monotonic_time () - start - vis->send_time) / 8;
 	g_mutex_unlock (&vis->clientlock);
+
+	decimation_adapt (channels, rate, size);
+}
+
+/**
+ * Work out the play time of tap position pos from the newest mark at
+ * or before it.
+ */
+static gint64
+play_time_get (xmms_visualization_t *v, guint64 pos, int channels, int rate)
+{
+	xmms_vis_mark_t mark;
+	guint wr, n, back, i;
+
+	/* every write to the tap leaves a mark, so there is one for
+	   whatever the thread waited for. Counts wrap, only their
+	   differences matter. */
+	wr = (guint) g_atomic_int_get (&v->marks_wr);
+
+	back = MIN (wr, VIS_TAP_MARKS - 1);
+	for (n = 1; n < back; n++) {
+		if (v->marks[(wr - n) % VIS_TAP_MARKS].pos <= pos) {
+			break;
+		}
+	}
+	i = wr - n;
+	mark = v->marks[i % VIS_TAP_MARKS];
+
+	/* the xform may have gone round the marks while we looked, the
+	   newest one is then as good as any */
+	wr = (guint) g_atomic_int_get (&v->marks_wr);
+	if (wr - i >= VIS_TAP_MARKS) {
+		mark = v->marks[(wr - 1) % VIS_TAP_MARKS];
+	}
+
+	return mark.play_at + ((gint64) pos - (gint64) mark.pos) * G_USEC_PER_SEC /
+	       (rate * channels * (gint64) sizeof (short));
+}
+
+/**
+ * Takes windows out of the tap and sends them to the clients, so
+ * that neither the FFT nor a slow client holds up the decoder.
+ */
+static gpointer
+xmms_visualization_thread (gpointer udata)
+{
+	xmms_visualization_t *v = udata;
+	short *buf;
+	guint len, read;
+	gint64 play_at;
+	int chan, rate;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
+	fft_init ();
+
+	buf = g_new (short, VIS_TAP_CHANNELS * XMMSC_VISUALIZATION_WINDOW_SIZE);
+
+	while (g_atomic_int_get (&v->running)) {
+		chan = g_atomic_int_get (&v->tap_channels);
+		rate = g_atomic_int_get (&v->tap_rate);
+		len = XMMSC_VISUALIZATION_WINDOW_SIZE * chan * sizeof (short);
+
+		xmms_ringbuf_wait_used_unlocked (v->tap, len);
+		if (!g_atomic_int_get (&v->running)) {
+			break;
+		}
+
+		play_at = play_time_get (v, v->tap_read, chan, rate);
+
+		read = xmms_ringbuf_read (v->tap, buf, len);
+		v->tap_read += read;
+		if (read < len) {
+			continue;
+		}
+
+		send_data (chan, rate, read / sizeof (short), buf, play_at);
+	}
+
+	g_free (buf);
+
+	return NULL;
+}
+
+/**
+ * Copy samples to the visualization thread, marked with when the
+ * first of them plays. Never blocks, what doesn't fit in the tap is
+ * dropped.
+ */
+static void
+tap_write (int channels, int rate, int size, const short *buf, gint64 play_at)
+{
+	xmms_vis_mark_t *m;
+	guint len, room;
+
+	if (channels < 1 || channels > VIS_TAP_CHANNELS) {
+		return;
+	}
+
+	/* a change in channels or rate skews a window or two, which
+	   nobody will notice on a visualization */
+	if (g_atomic_int_get (&vis->tap_channels) != channels) {
+		g_atomic_int_set (&vis->tap_channels, channels);
+	}
+	if (g_atomic_int_get (&vis->tap_rate) != rate) {
+		g_atomic_int_set (&vis->tap_rate, rate);
+	}
+
+	len = size * sizeof (short);
+	room = xmms_ringbuf_bytes_free (vis->tap);
+	if (len > room) {
+		/* keep to whole frames */
+		len = room - room % (channels * sizeof (short));
+	}
+
+	if (!len) {
+		return;
+	}
+
+	m = &vis->marks[(guint) vis->marks_wr % VIS_TAP_MARKS];
+	m->pos = vis->tap_written;
+	m->play_at = play_at;
+	g_atomic_int_inc (&vis->marks_wr);
+
+	vis->tap_written += xmms_ringbuf_write (vis->tap, buf, len);
+}
+
+/**
+ * Whether anybody takes what goes in the tap. In the small footprint
+ * mode nothing is analyzed while nobody does.
+ */
+static gboolean
+tap_wanted (void)
+{
+	return !xmms_footprint_enabled () ||
+	       g_atomic_int_get (&vis->attached) > 0 ||
+	       g_atomic_pointer_get (&vis->multicast) != NULL;
+}
+
+/**
+ * Samples from the visualization effect. Left alone when the tap is
+ * fed by the output.
+ */
+void
+queue_data (int channels, int size, short *buf)
+{
+	gint64 play_at;
+
+	if (!vis || g_atomic_int_get (&vis->at_output) || !tap_wanted ()) {
+		return;
+	}
+
+	/* called from the chain read, so whatever is ahead of this in
+	   the output buffer and the soundcard is what the output latency
+	   counts */
+	play_at = g_get_monotonic_time () +
+	          (gint64) xmms_output_latency (vis->output) * 1000;
+
+	tap_write (channels, VIS_TAP_RATE, size, buf, play_at);
+}
+
+/**
+ * Whether the output should hand what it plays to
+ * #xmms_visualization_output_feed.
+ */
+gboolean
+xmms_visualization_at_output (void)
+{
+	return vis && g_atomic_int_get (&vis->at_output);
+}
+
+/**
+ * Samples on their way to the soundcard, after all effects.
+ * Called by the output only, never blocks.
+ *
+ * @param format the format of buf
+ * @param buf interleaved samples
+ * @param len length of buf in bytes
+ * @param play_at when the first sample plays, on the monotonic clock
+ */
+void
+xmms_visualization_output_feed (const xmms_stream_type_t *format,
+                                const void *buf, gint len, gint64 play_at)
+{
+	short tmp[VIS_TAP_CONVERT];
+	gint fmt, channels, rate, n, done, i;
+	const gint32 *s32;
+	const gfloat *f;
+
+	if (!xmms_visualization_at_output () || !tap_wanted ()) {
+		return;
+	}
+
+	fmt = xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_FORMAT);
+	channels = xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	rate = xmms_stream_type_get_int (format, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+	if (channels < 1 || channels > VIS_TAP_CHANNELS || rate <= 0) {
+		return;
+	}
+
+	n = len / xmms_sample_size_get (fmt);
+
+	if (fmt == XMMS_SAMPLE_FORMAT_S16) {
+		tap_write (channels, rate, n, buf, play_at);
+		return;
+	}
+
+	if (fmt != XMMS_SAMPLE_FORMAT_S32 && fmt != XMMS_SAMPLE_FORMAT_FLOAT) {
+		/* nothing plays those these days */
+		return;
+	}
+
+	s32 = buf;
+	f = buf;
+
+	/* a piece at a time, each keeping to whole frames */
+	for (done = 0; done < n; ) {
+		gint count = MIN (n - done, VIS_TAP_CONVERT - VIS_TAP_CONVERT % channels);
+
+		if (fmt == XMMS_SAMPLE_FORMAT_S32) {
+			for (i = 0; i < count; i++) {
+				tmp[i] = s32[done + i] >> 16;
+			}
+		} else {
+			for (i = 0; i < count; i++) {
+				tmp[i] = (short) (CLAMP (f[done + i], -1.0f, 1.0f) * 32767.0f);
+			}
+		}
+
+		tap_write (channels, rate, count, tmp,
+		           play_at + (gint64) (done / channels) * G_USEC_PER_SEC / rate);
+		done += count;
+	}
 }
 
 /** @} */
@@ -14,6 +14,10 @@
  *  Lesser General Public License for more details.
  */
 
+#ifdef HAVE_SENDMMSG
+#define _GNU_SOURCE /* sendmmsg is a GNU extension */
+#endif
+
 #include <stdlib.h>
 #include <unistd.h>
 #include "common.h"
@@ -207,7 +211,129 @@ cleanup_udp (xmmsc_vis_udp_t *t, xmms_socket_t socket)
 {
 	socklen_t sl = sizeof (t->addr);
 	char packet = 'K';
-	sendto (socket, &packet, 1, 0, (struct sockaddr *)&t->addr, sl);
+
+	if (xmms_socket_valid (socket)) {
+		sendto (socket, &packet, 1, 0, (struct sockaddr *)&t->addr, sl);
+	}
+}
+
+/**
+ * Send the queued packets, with a single syscall where there is
+ * sendmmsg.
+ */
+static void
+flush_udp (xmmsc_vis_udp_t *t, xmms_vis_udp_batch_t *b, int socket)
+{
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[VIS_UDP_BATCH];
+	struct iovec iov[VIS_UDP_BATCH];
+	int i, sent;
+
+	memset (msgs, 0, sizeof (msgs));
+	for (i = 0; i < b->queued; i++) {
+		iov[i].iov_base = b->packets[i];
+		iov[i].iov_len = b->lens[i];
+		msgs[i].msg_hdr.msg_name = &t->addr;
+		msgs[i].msg_hdr.msg_namelen = sizeof (t->addr);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (i = 0; i < b->queued; i += sent) {
+		sent = sendmmsg (socket, msgs + i, b->queued - i, 0);
+		if (sent <= 0) {
+			/* it's UDP, the rest is as good as lost anyway */
+			break;
+		}
+	}
+#else
+	int i;
+
+	for (i = 0; i < b->queued; i++) {
+		sendto (socket, b->packets[i], b->lens[i], 0,
+		        (struct sockaddr *)&t->addr, sizeof (t->addr));
+	}
+#endif
+
+	b->queued = 0;
+}
+
+/**
+ * Stream to a multicast group given as "address:port", "[v6 address]:port"
+ * or not at all, if empty. Must hold clientlock.
+ */
+gboolean
+setup_multicast (xmms_visualization_t *vis, const gchar *address)
+{
+	struct addrinfo hints, *result;
+	xmms_vis_client_t *c;
+	gchar *host, *port;
+	int sock, ttl = 1, status;
+
+	if (vis->multicast) {
+		xmms_socket_close (vis->multicast_socket);
+		g_free (vis->multicast->batch);
+		g_free (vis->multicast);
+		vis->multicast = NULL;
+	}
+
+	if (!address || !*address) {
+		return TRUE;
+	}
+
+	host = g_strdup (address);
+	port = strrchr (host, ':');
+	if (!port) {
+		xmms_log_error ("Multicast address '%s' has no port", address);
+		g_free (host);
+		return FALSE;
+	}
+	*port++ = '\0';
+	if (host[0] == '[' && port - host > 2 && port[-2] == ']') {
+		port[-2] = '\0';
+		memmove (host, host + 1, strlen (host));
+	}
+
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+
+	status = getaddrinfo (host, port, &hints, &result);
+	g_free (host);
+	if (status != 0) {
+		xmms_log_error ("Invalid multicast address '%s': %s",
+		                address, gai_strerror (status));
+		return FALSE;
+	}
+
+	sock = socket (result->ai_family, result->ai_socktype, result->ai_protocol);
+	if (!xmms_socket_valid (sock)) {
+		xmms_log_error ("Could not open multicast socket!");
+		freeaddrinfo (result);
+		return FALSE;
+	}
+
+	/* the screens are on the LAN, keep it there */
+	if (result->ai_family == AF_INET6) {
+		setsockopt (sock, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &ttl, sizeof (ttl));
+	} else {
+		setsockopt (sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof (ttl));
+	}
+
+	c = g_new0 (xmms_vis_client_t, 1);
+	c->type = VIS_UDP;
+	memcpy (&c->transport.udp.addr, result->ai_addr, result->ai_addrlen);
+	properties_init (&c->prop);
+	c->prop.type = VIS_SPECTRUM;
+
+	freeaddrinfo (result);
+
+	vis->multicast = c;
+	vis->multicast_socket = sock;
+
+	xmms_log_info ("Streaming visualization data to %s", address);
+	return TRUE;
 }
 
 gboolean
@@ -219,15 +345,24 @@ write_udp (xmmsc_vis_udp_t *t, xmms_vis_client_t *c, int32_t id, struct timeval
 	int offset;
 	char* packet;
 
-	/* first check if the client is still there */
-	if (t->grace == 0) {
-		delete_client (id);
-		return FALSE;
+	/* first check if the client is still there, the multicast
+	   stream (id -1) has no one to answer */
+	if (id >= 0) {
+		if (t->grace == 0) {
+			delete_client (id);
+			return FALSE;
+		}
+		t->grace--;
+	}
+
+	if (!c->batch) {
+		c->batch = g_new0 (xmms_vis_udp_batch_t, 1);
 	}
 
-	packet = packet_init_data (&packet_d);
-	t->grace--;
-	XMMSC_VIS_UNALIGNED_WRITE (packet_d.__unaligned_grace, htons (t->grace), uint16_t);
+	packet = c->batch->packets[c->batch->queued];
+	packet_setup_data (&packet_d, packet);
+	XMMSC_VIS_UNALIGNED_WRITE (packet_d.__unaligned_grace,
+	                           htons (id >= 0 ? t->grace : G_MAXUINT16), uint16_t);
 	__unaligned_dest = packet_d.__unaligned_data;
 
 	XMMSC_VIS_UNALIGNED_WRITE (&__unaligned_dest->timestamp[0],
@@ -237,14 +372,15 @@ write_udp (xmmsc_vis_udp_t *t, xmms_vis_client_t *c, int32_t id, struct timeval
 
 
 	XMMSC_VIS_UNALIGNED_WRITE (&__unaligned_dest->format, (uint16_t)htons (c->format), uint16_t);
-	res = fill_buffer (__unaligned_dest->data, &c->prop, channels, size, buf);
+	res = fill_buffer (__unaligned_dest->data, c, channels, size, buf);
 	XMMSC_VIS_UNALIGNED_WRITE (&__unaligned_dest->size, (uint16_t)htons (res), uint16_t);
 
 	offset = ((char*)&__unaligned_dest->data - (char*)__unaligned_dest);
 
-	sendto (socket, packet, XMMS_VISPACKET_UDP_OFFSET + offset + res * sizeof (int16_t), 0, (struct sockaddr *)&t->addr, sizeof (t->addr));
-	free (packet);
-
+	c->batch->lens[c->batch->queued++] = XMMS_VISPACKET_UDP_OFFSET + offset + res * sizeof (int16_t);
+	if (c->batch->queued == VIS_UDP_BATCH) {
+		flush_udp (t, c->batch, socket);
+	}
 
 	return TRUE;
 }
@@ -19,9 +19,19 @@
 #include <sys/stat.h>
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 #include "common.h"
 
+/* How long a shmring client may leave a full ring untouched */
+#define VIS_SHMRING_GRACE (5 * G_TIME_SPAN_SECOND)
+
 #ifdef _SEM_SEMUN_UNDEFINED
 	union semun {
 	   int              val;    /* Value for SETVAL */
@@ -145,7 +155,7 @@ write_shm (xmmsc_vis_unixshm_t *t, xmms_vis_client_t *c, int32_t id, struct time
 
 	tv2net (dest->timestamp, time);
 	dest->format = htons (c->format);
-	res = fill_buffer (dest->data, &c->prop, channels, size, buf);
+	res = fill_buffer (dest->data, c, channels, size, buf);
 	dest->size = htons (res);
 	write_finish_shm (id, t, dest);
 
@@ -185,3 +195,109 @@ write_finish_shm (int32_t id, xmmsc_vis_unixshm_t *t, xmmsc_vischunk_t *dest)
 	t->pos = (t->pos + 1) % t->size;
 	increment_client (t);
 }
+
+int32_t
+init_shmring (xmms_visualization_t *vis, int32_t id, int32_t shmid, xmms_error_t *err)
+{
+	struct shmid_ds shm_desc;
+	xmmsc_vis_shmring_header_t *header;
+	xmms_vis_client_t *c;
+	xmmsc_vis_shmring_t *t;
+	uint32_t count;
+
+	x_fetch_client (id);
+
+	header = shmat (shmid, NULL, 0);
+	if (header == (void *) -1) {
+		xmms_error_set (err, XMMS_ERROR_NO_SAUSAGE, "couldn't attach to shared memory");
+		x_release_client ();
+		return -1;
+	}
+
+	/* the client sets up the header, but don't trust it further
+	   than the segment goes */
+	count = header->count;
+	if (shmctl (shmid, IPC_STAT, &shm_desc) == -1 ||
+	    !count || (count & (count - 1)) ||
+	    shm_desc.shm_segsz < sizeof (*header) + count * sizeof (xmmsc_vischunk_t)) {
+		xmms_error_set (err, XMMS_ERROR_INVAL, "invalid shared memory ring");
+		shmdt (header);
+		x_release_client ();
+		return -1;
+	}
+
+	c->type = VIS_SHMRING;
+	t = &c->transport.ring;
+	t->shmid = shmid;
+	t->header = header;
+	t->buffer = (xmmsc_vischunk_t *) (header + 1);
+	t->count = count;
+	t->pos = header->wr;
+	t->beat = header->heartbeat;
+	t->beat_time = g_get_monotonic_time ();
+
+	x_release_client ();
+
+	xmms_log_info ("Visualization client %d initialised using a shm ring", id);
+	return 0;
+}
+
+void
+cleanup_shmring (xmmsc_vis_shmring_t *t)
+{
+	shmdt (t->header);
+}
+
+/**
+ * Wake the client if it sleeps on wr, which is the only time the
+ * ring costs a syscall.
+ */
+static void
+wake_shmring_client (xmmsc_vis_shmring_t *t)
+{
+	if (!g_atomic_int_get ((gint *) &t->header->waiting)) {
+		return;
+	}
+
+#ifdef __linux__
+	syscall (SYS_futex, &t->header->wr, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+gboolean
+write_shmring (xmmsc_vis_shmring_t *t, xmms_vis_client_t *c, int32_t id, struct timeval *time, int channels, int size, short *buf)
+{
+	xmmsc_vischunk_t *dest;
+	uint32_t rd, beat;
+	gint64 now;
+	short res;
+
+	rd = g_atomic_int_get ((gint *) &t->header->rd);
+	if (t->pos - rd >= t->count) {
+		/* full, the client is behind or gone: give it a while
+		   after it last looked for data */
+		beat = t->header->heartbeat;
+		now = g_get_monotonic_time ();
+		if (beat != t->beat) {
+			t->beat = beat;
+			t->beat_time = now;
+		} else if (now - t->beat_time > VIS_SHMRING_GRACE) {
+			delete_client (id);
+		}
+		return FALSE;
+	}
+
+	dest = &t->buffer[t->pos & (t->count - 1)];
+	tv2net (dest->timestamp, time);
+	dest->format = htons (c->format);
+	res = fill_buffer (dest->data, c, channels, size, buf);
+	dest->size = htons (res);
+
+	/* publish the chunk only after it is written */
+	t->pos++;
+	g_atomic_int_set ((gint *) &t->header->wr, t->pos);
+
+	wake_shmring_client (t);
+
+	return TRUE;
+}
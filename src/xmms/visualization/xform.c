@@ -69,6 +69,12 @@ xmms_vis_init (xmms_xform_t *xform)
 {
 	g_return_val_if_fail (xform, FALSE);
 
+	if (xmms_visualization_at_output ()) {
+		/* the output feeds the clients, no need for the hook */
+		XMMS_DBG ("Visualization taken from the output, skipping hook");
+		return FALSE;
+	}
+
 	xmms_xform_outdata_type_copy (xform);
 
 	XMMS_DBG ("Visualization hook initialized successfully!");
@@ -92,14 +98,10 @@ xmms_vis_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
 
 	chan = xmms_xform_indata_get_int (xform, XMMS_STREAM_TYPE_FMT_CHANNELS);
 
-	/* perhaps rework this later */
-	if (len > XMMSC_VISUALIZATION_WINDOW_SIZE * chan * sizeof (short)) {
-		len = XMMSC_VISUALIZATION_WINDOW_SIZE * chan * sizeof (short);
-	}
-
 	read = xmms_xform_read (xform, buf, len, error);
 	if (read > 0) {
-		send_data (chan, read / sizeof (short), buf);
+		/* only a copy, the vis thread does the rest */
+		queue_data (chan, read / sizeof (short), buf);
 	}
 
 	return read;
@@ -21,12 +21,19 @@
 
 #include <string.h>
 
+#include <xmmspriv/xmms_browsecache.h>
+#include <xmmspriv/xmms_diskcache.h>
+#include <xmmspriv/xmms_sandbox.h>
 #include <xmmspriv/xmms_plugin.h>
 #include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_streamtype.h>
 #include <xmmspriv/xmms_medialib.h>
 #include <xmmspriv/xmms_utils.h>
 #include <xmmspriv/xmms_xform_plugin.h>
+#include <xmmspriv/xmms_trace.h>
+#include <xmmspriv/xmms_memstat.h>
+#include <xmmspriv/xmms_thread_role.h>
+#include <xmmspriv/xmms_footprint.h>
 #include <xmms/xmms_ipc.h>
 #include <xmms/xmms_log.h>
 #include <xmms/xmms_object.h>
@@ -51,9 +58,15 @@ struct xmms_xform_St {
 	gboolean eos;
 	gboolean error;
 
+	/** the buffered data is the buffered bytes from bufpos on, it's
+	 * only moved to the front when more wouldn't fit behind it */
 	char *buffer;
+	gint bufpos;
 	gint buffered;
 	gint buffersize;
+	/** stream position of the next byte read, hotspots are kept at
+	 * the position they were set at */
+	guint64 offset;
 
 	gboolean metadata_collected;
 
@@ -67,15 +80,30 @@ struct xmms_xform_St {
 	xmmsv_t *browse_dict;
 	gint browse_index;
 
-	/** used for line reading */
+	/** effects ending in this one that are read as one, see add_effects */
+	GPtrArray *fused;
+
+	/** see #xmms_xform_chain_stats, only written by the reader */
+	struct {
+		guint64 calls;
+		guint64 bytes;
+		gint64 time;
+		gint64 max;
+		guint64 seeks;
+		guint64 buffered;
+		guint64 copied;
+	} stats;
+
+	/** used for line reading, the unread data is from bufstart to bufend */
 	struct {
 		gchar buf[XMMS_XFORM_MAX_LINE_SIZE];
+		gchar *bufstart;
 		gchar *bufend;
 	} lr;
 };
 
 typedef struct xmms_xform_hotspot_St {
-	guint pos;
+	guint64 pos;
 	gchar *key;
 	xmmsv_t *obj;
 } xmms_xform_hotspot_t;
@@ -92,7 +120,15 @@ static xmms_xform_t *add_effects (xmms_xform_t *last,
 static xmms_xform_t *xmms_xform_new_effect (xmms_xform_t* last,
                                             xmms_medialib_entry_t entry,
                                             GList *goal_formats,
-                                            const gchar *name);
+                                            const gchar *name,
+                                            gboolean float_pipeline);
+static xmms_xform_t *xmms_xform_effect_convert (xmms_xform_t *last,
+                                                xmms_medialib_entry_t entry,
+                                                xmms_xform_plugin_t *effect);
+static void xmms_xform_fuse_effects (GPtrArray *run);
+static xmms_xform_t *xmms_xform_sandbox_add (xmms_xform_t *prev,
+                                             xmms_medialib_entry_t entry,
+                                             GList *goal_formats);
 static void xmms_xform_destroy (xmms_object_t *object);
 static xmms_stream_type_t *xmms_xform_get_out_stream_type (xmms_xform_t *xform);
 
@@ -267,18 +303,25 @@ xmms_xform_browse_method (xmms_xform_t *xform, const gchar *url,
 	return list;
 }
 
-xmmsv_t *
-xmms_xform_browse (const gchar *url, xmms_error_t *error)
+/* Listings are cached by the decoded url they were made from. Browsing
+ * a directory can list the directories in it ahead on the prefetch
+ * workers, as file pickers usually go there next.
+ */
+static xmms_browse_cache_t *browse_cache = NULL;
+static GThreadPool *browse_prefetch = NULL;
+static gint browse_quit = 0;
+
+#define XMMS_XFORM_BROWSE_PREFETCH_QUEUE 64
+
+static xmmsv_t *
+xmms_xform_browse_uncached (const gchar *durl, xmms_error_t *error)
 {
 	xmmsv_t *list = NULL;
-	gchar *durl;
 	xmms_xform_t *xform = NULL;
 	xmms_xform_t *xform2 = NULL;
 
 	xform = xmms_xform_new (NULL, NULL, NULL, 0, NULL);
 
-	durl = g_strdup (url);
-	xmms_medialib_decode_url (durl);
 	XMMS_DBG ("url = %s", durl);
 
 	xmms_xform_outdata_type_add (xform,
@@ -294,7 +337,6 @@ xmms_xform_browse (const gchar *url, xmms_error_t *error)
 	} else {
 		xmms_error_set (error, XMMS_ERROR_GENERIC, "Couldn't handle that URL");
 		xmms_object_unref (xform);
-		g_free (durl);
 		return NULL;
 	}
 
@@ -303,11 +345,196 @@ xmms_xform_browse (const gchar *url, xmms_error_t *error)
 	xmms_object_unref (xform);
 	xmms_object_unref (xform2);
 
+	return list;
+}
+
+xmmsv_t *
+xmms_xform_browse (const gchar *url, xmms_error_t *error)
+{
+	xmmsv_t *list = NULL;
+	gchar *durl, *key = NULL;
+
+	durl = g_strdup (url);
+	xmms_medialib_decode_url (durl);
+
+	if (browse_cache) {
+		key = xmms_browse_cache_key (durl);
+		list = xmms_browse_cache_lookup (browse_cache, key);
+	}
+
+	if (!list) {
+		list = xmms_xform_browse_uncached (durl, error);
+		if (list && key) {
+			xmms_browse_cache_insert (browse_cache, key, list);
+		}
+	}
+
+	g_free (key);
 	g_free (durl);
 
 	return list;
 }
 
+static void
+xmms_xform_browse_prefetch_worker (gpointer data, gpointer udata)
+{
+	xmmsv_t *list;
+	xmms_error_t err;
+	gchar *durl = data;
+	gchar *key;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_IMPORT);
+
+	if (g_atomic_int_get (&browse_quit)) {
+		g_free (durl);
+		return;
+	}
+
+	xmms_medialib_decode_url (durl);
+	key = xmms_browse_cache_key (durl);
+
+	list = xmms_browse_cache_lookup (browse_cache, key);
+	if (!list) {
+		xmms_error_reset (&err);
+		list = xmms_xform_browse_uncached (durl, &err);
+		if (list) {
+			xmms_browse_cache_insert (browse_cache, key, list);
+		}
+	}
+
+	if (list) {
+		xmmsv_unref (list);
+	}
+
+	g_free (key);
+	g_free (durl);
+}
+
+/**
+ * List the first directories of a listing ahead, as many as the
+ * browse.prefetch config property says.
+ */
+void
+xmms_xform_browse_prefetch (xmmsv_t *list)
+{
+	xmms_config_property_t *cfg;
+	xmmsv_list_iter_t *it;
+	xmmsv_t *val;
+	gint count;
+
+	if (!browse_prefetch) {
+		return;
+	}
+
+	cfg = xmms_config_lookup ("browse.prefetch");
+	count = cfg ? xmms_config_property_get_int (cfg) : 0;
+
+	xmmsv_get_list_iter (list, &it);
+	while (count > 0 && xmmsv_list_iter_entry (it, &val)) {
+		const gchar *path;
+		gint isdir = 0;
+
+		xmmsv_list_iter_next (it);
+
+		xmmsv_dict_entry_get_int (val, "isdir", &isdir);
+		if (isdir != 1 || !xmmsv_dict_entry_get_string (val, "path", &path)) {
+			continue;
+		}
+
+		/* don't pile up a share nobody waits for */
+		if (g_thread_pool_unprocessed (browse_prefetch) >= XMMS_XFORM_BROWSE_PREFETCH_QUEUE) {
+			break;
+		}
+
+		g_thread_pool_push (browse_prefetch, g_strdup (path), NULL);
+		count--;
+	}
+	xmmsv_list_iter_explicit_destroy (it);
+}
+
+/**
+ * Forget the cached listings of an encoded url and of all below it,
+ * and with parent set, of the directory it is in.
+ */
+void
+xmms_xform_browse_invalidate (const gchar *url, gboolean parent)
+{
+	gchar *durl, *key;
+
+	if (!browse_cache) {
+		return;
+	}
+
+	durl = g_strdup (url);
+	xmms_medialib_decode_url (durl);
+	key = xmms_browse_cache_key (durl);
+
+	xmms_browse_cache_invalidate (browse_cache, key, parent);
+
+	g_free (key);
+	g_free (durl);
+}
+
+static void
+xmms_xform_browse_cache_changed (xmms_object_t *object, xmmsv_t *data,
+                                 gpointer udata)
+{
+	xmms_config_property_t *size, *ttl;
+
+	size = xmms_config_lookup ("browse.cache_size");
+	ttl = xmms_config_lookup ("browse.cache_ttl");
+
+	xmms_browse_cache_configure (browse_cache,
+	                             MAX (xmms_config_property_get_int (size), 0),
+	                             (gint64) xmms_config_property_get_int (ttl) * 1000);
+}
+
+void
+xmms_xform_browse_cache_init (void)
+{
+	xmms_config_property_t *size, *ttl;
+
+	g_return_if_fail (!browse_cache);
+
+	/* listings to keep, and for how many seconds */
+	size = xmms_config_property_register ("browse.cache_size", "64",
+	                                      xmms_xform_browse_cache_changed,
+	                                      NULL);
+	ttl = xmms_config_property_register ("browse.cache_ttl", "30",
+	                                     xmms_xform_browse_cache_changed,
+	                                     NULL);
+	/* directories of a browsed one listed ahead */
+	xmms_config_property_register ("browse.prefetch", "8", NULL, NULL);
+
+	browse_cache = xmms_browse_cache_new (MAX (xmms_config_property_get_int (size), 0),
+	                                      (gint64) xmms_config_property_get_int (ttl) * 1000);
+
+	g_atomic_int_set (&browse_quit, 0);
+	browse_prefetch = g_thread_pool_new (xmms_xform_browse_prefetch_worker,
+	                                     NULL, 2, FALSE, NULL);
+}
+
+void
+xmms_xform_browse_cache_shutdown (void)
+{
+	xmms_config_property_t *cfg;
+
+	g_return_if_fail (browse_cache);
+
+	cfg = xmms_config_lookup ("browse.cache_size");
+	xmms_config_property_callback_remove (cfg, xmms_xform_browse_cache_changed, NULL);
+	cfg = xmms_config_lookup ("browse.cache_ttl");
+	xmms_config_property_callback_remove (cfg, xmms_xform_browse_cache_changed, NULL);
+
+	/* the queued urls are only freed */
+	g_atomic_int_set (&browse_quit, 1);
+	g_thread_pool_free (browse_prefetch, FALSE, TRUE);
+	browse_prefetch = NULL;
+
+	xmms_browse_cache_free (browse_cache);
+	browse_cache = NULL;
+}
+
 static void
 xmms_xform_destroy (xmms_object_t *object)
 {
@@ -327,8 +554,13 @@ xmms_xform_destroy (xmms_object_t *object)
 	g_hash_table_destroy (xform->privdata);
 	g_queue_free (xform->hotspots);
 
+	xmms_memstat_sub (XMMS_MEMSTAT_XFORM_BUFFERS, xform->buffersize);
 	g_free (xform->buffer);
 
+	if (xform->fused) {
+		g_ptr_array_free (xform->fused, TRUE);
+	}
+
 	if (xform->out_type) {
 		xmms_object_unref (xform->out_type);
 	}
@@ -356,6 +588,7 @@ xmms_xform_new (xmms_xform_plugin_t *plugin, xmms_xform_t *prev,
 	xform->entry = entry;
 	xform->medialib = medialib;
 	xform->goal_hints = goal_hints;
+	xform->lr.bufstart = &xform->lr.buf[0];
 	xform->lr.bufend = &xform->lr.buf[0];
 
 	if (prev) {
@@ -383,6 +616,7 @@ xmms_xform_new (xmms_xform_plugin_t *plugin, xmms_xform_t *prev,
 
 	xform->buffer = g_malloc (READ_CHUNK);
 	xform->buffersize = READ_CHUNK;
+	xmms_memstat_add (XMMS_MEMSTAT_XFORM_BUFFERS, READ_CHUNK);
 
 	return xform;
 }
@@ -393,6 +627,27 @@ xmms_xform_entry_get (xmms_xform_t *xform)
 	return xform->entry;
 }
 
+gchar *
+xmms_xform_entry_property_get_str (xmms_xform_t *xform, const gchar *key)
+{
+	xmms_medialib_session_t *session;
+	gchar *ret;
+
+	g_return_val_if_fail (xform, NULL);
+	g_return_val_if_fail (key, NULL);
+
+	if (!xform->medialib) {
+		return NULL;
+	}
+
+	do {
+		session = xmms_medialib_session_begin_ro (xform->medialib);
+		ret = xmms_medialib_entry_property_get_str (session, xform->entry, key);
+	} while (!xmms_medialib_session_commit (session));
+
+	return ret;
+}
+
 gpointer
 xmms_xform_private_data_get (xmms_xform_t *xform)
 {
@@ -414,6 +669,32 @@ xmms_xform_outdata_type_add (xmms_xform_t *xform, ...)
 	va_end (ap);
 }
 
+gboolean
+xmms_xform_outdata_type_accepted (xmms_xform_t *xform, ...)
+{
+	xmms_stream_type_t *type;
+	gboolean ret = FALSE;
+	GList *n;
+	va_list ap;
+
+	g_return_val_if_fail (xform, FALSE);
+
+	va_start (ap, xform);
+	type = xmms_stream_type_parse (ap);
+	va_end (ap);
+
+	for (n = xform->goal_hints; n; n = g_list_next (n)) {
+		if (xmms_stream_type_match (n->data, type)) {
+			ret = TRUE;
+			break;
+		}
+	}
+
+	xmms_object_unref (type);
+
+	return ret;
+}
+
 void
 xmms_xform_outdata_type_set (xmms_xform_t *xform, xmms_stream_type_t *type)
 {
@@ -712,13 +993,121 @@ xmms_xform_metadata_update (xmms_xform_t *xform)
 	} while (!xmms_medialib_session_commit (session));
 }
 
+/* Metadata changing while the chain is read, like the titles of a
+ * radio stream, is written by one worker, so the reader does not wait
+ * on the medialib. A change to an entry whose last one is not written
+ * yet is merged into it, so a burst of updates is a single write.
+ */
+typedef struct xmms_xform_metadata_job_St {
+	xmms_medialib_t *medialib;
+	xmms_medialib_entry_t entry;
+	gchar source[XMMS_PLUGIN_SHORTNAME_MAX_LEN + 8];
+	GHashTable *metadata;
+} xmms_xform_metadata_job_t;
+
+G_LOCK_DEFINE_STATIC (metadata_writer);
+static GThreadPool *metadata_writer = NULL;
+/** The jobs not yet started */
+static GList *metadata_pending = NULL;
+
+static void
+xmms_xform_metadata_job_free (xmms_xform_metadata_job_t *job)
+{
+	g_hash_table_unref (job->metadata);
+	xmms_object_unref (job->medialib);
+	g_free (job);
+}
+
+static void
+xmms_xform_metadata_writer (gpointer data, gpointer udata)
+{
+	xmms_xform_metadata_job_t *job = data;
+	xmms_medialib_session_t *session;
+	metadata_festate_t info;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_BACKGROUND);
+
+	G_LOCK (metadata_writer);
+	metadata_pending = g_list_remove (metadata_pending, job);
+	G_UNLOCK (metadata_writer);
+
+	do {
+		session = xmms_medialib_session_begin (job->medialib);
+
+		info.entry = job->entry;
+		info.session = session;
+		info.source = job->source;
+
+		g_hash_table_foreach (job->metadata, add_metadatum, &info);
+	} while (!xmms_medialib_session_commit (session));
+
+	xmms_xform_metadata_job_free (job);
+}
+
+static void
+xmms_xform_metadata_copy (gpointer key, gpointer value, gpointer udata)
+{
+	g_hash_table_replace ((GHashTable *) udata, g_strdup (key),
+	                      xmmsv_ref ((xmmsv_t *) value));
+}
+
+static void
+xmms_xform_metadata_update_deferred (xmms_xform_t *xform)
+{
+	xmms_xform_metadata_job_t *job = NULL;
+	gchar src[XMMS_PLUGIN_SHORTNAME_MAX_LEN + 8];
+	GList *n;
+
+	g_return_if_fail (xform->medialib);
+
+	g_snprintf (src, sizeof (src), "plugin/%s",
+	            xmms_xform_shortname (xform));
+
+	G_LOCK (metadata_writer);
+
+	if (!metadata_writer) {
+		metadata_writer = g_thread_pool_new (xmms_xform_metadata_writer,
+		                                     NULL, 1, FALSE, NULL);
+	}
+
+	for (n = metadata_pending; n; n = g_list_next (n)) {
+		xmms_xform_metadata_job_t *pending = n->data;
+		if (pending->entry == xform->entry &&
+		    strcmp (pending->source, src) == 0) {
+			job = pending;
+			break;
+		}
+	}
+
+	if (job) {
+		g_hash_table_foreach (xform->metadata, xmms_xform_metadata_copy,
+		                      job->metadata);
+	} else {
+		job = g_new0 (xmms_xform_metadata_job_t, 1);
+		job->medialib = xmms_object_ref (xform->medialib);
+		job->entry = xform->entry;
+		g_strlcpy (job->source, src, sizeof (job->source));
+		job->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+		                                       (GDestroyNotify) xmmsv_unref);
+		g_hash_table_foreach (xform->metadata, xmms_xform_metadata_copy,
+		                      job->metadata);
+
+		metadata_pending = g_list_prepend (metadata_pending, job);
+		g_thread_pool_push (metadata_writer, job, NULL);
+	}
+
+	G_UNLOCK (metadata_writer);
+
+	xform->metadata_changed = FALSE;
+}
+
 static void
 xmms_xform_auxdata_set_val (xmms_xform_t *xform, char *key, xmmsv_t *val)
 {
 	xmms_xform_hotspot_t *hs;
 
 	hs = g_new0 (xmms_xform_hotspot_t, 1);
-	hs->pos = xform->buffered;
+	hs->pos = xform->offset + xform->buffered;
 	hs->key = key;
 	hs->obj = val;
 
@@ -776,9 +1165,9 @@ xmms_xform_auxdata_get_val (xmms_xform_t *xform, const gchar *key)
 	/* privdata is always got from the previous xform */
 	xform = xform->prev;
 
-	/* check if we have unhandled current (pos 0) hotspots for this key */
+	/* check if we have unhandled current hotspots for this key */
 	for (i=0; (hs = g_queue_peek_nth (xform->hotspots, i)) != NULL; i++) {
-		if (hs->pos != 0) {
+		if (hs->pos != xform->offset) {
 			break;
 		} else if (hs->key && !strcmp (key, hs->key)) {
 			val = hs->obj;
@@ -836,21 +1225,119 @@ xmms_xform_shortname (xmms_xform_t *xform)
 	       : "unknown";
 }
 
+/**
+ * Call the read method of the xform, or for the last of a run of fused
+ * effects, read from the xform before the run and process the block
+ * with each effect in turn.
+ */
 static gint
-xmms_xform_this_peek (xmms_xform_t *xform, gpointer buf, gint siz,
-                      xmms_error_t *err)
+xmms_xform_plugin_read_block (xmms_xform_t *xform, gpointer buf, gint siz,
+                              xmms_error_t *err)
 {
-	while (xform->buffered < siz) {
-		gint res;
+	xmms_xform_t *effect;
+	gint res, i;
+
+	if (!xform->fused) {
+		return xmms_xform_plugin_read (xform->plugin, xform, buf, siz, err);
+	}
+
+	effect = g_ptr_array_index (xform->fused, 0);
+	res = xmms_xform_this_read (effect->prev, buf, siz, err);
+
+	if (res > 0) {
+		for (i = 0; i < xform->fused->len; i++) {
+			effect = g_ptr_array_index (xform->fused, i);
+			xmms_xform_plugin_process (effect->plugin, effect, buf, res);
+		}
+	}
+
+	return res;
+}
+
+/**
+ * Get room for len more bytes behind the buffered data, moving it to
+ * the front of the buffer if that makes enough room.
+ */
+static char *
+xmms_xform_buffer_reserve (xmms_xform_t *xform, gint len)
+{
+	if (xform->bufpos + xform->buffered + len <= xform->buffersize) {
+		return xform->buffer + xform->bufpos + xform->buffered;
+	}
+
+	if (xform->bufpos) {
+		memmove (xform->buffer, xform->buffer + xform->bufpos, xform->buffered);
+		xform->stats.copied += xform->buffered;
+		xform->bufpos = 0;
+	}
+
+	if (xform->buffered + len > xform->buffersize) {
+		gint old = xform->buffersize, cap;
+
+		/* past the cap it only grows by what is asked for */
+		cap = xform->buffersize * 2;
+		if (xmms_footprint_limit (XMMS_FOOTPRINT_XFORM_BUFFER)) {
+			cap = MIN (cap, MAX (xmms_footprint_limit (XMMS_FOOTPRINT_XFORM_BUFFER), old));
+		}
+
+		xform->buffersize = MAX (cap, xform->buffered + len);
+		xmms_memstat_add (XMMS_MEMSTAT_XFORM_BUFFERS,
+		                  xform->buffersize - old);
+		xform->buffer = g_realloc (xform->buffer, xform->buffersize);
+	}
+
+	return xform->buffer + xform->buffered;
+}
+
+/**
+ * Hand out up to len buffered bytes.
+ */
+static gint
+xmms_xform_buffer_take (xmms_xform_t *xform, gpointer buf, gint len)
+{
+	len = MIN (len, xform->buffered);
+	memcpy (buf, xform->buffer + xform->bufpos, len);
+
+	xform->bufpos += len;
+	xform->buffered -= len;
+	xform->offset += len;
+	xform->stats.copied += len;
 
-		if (xform->buffered + READ_CHUNK > xform->buffersize) {
-			xform->buffersize *= 2;
+	if (!xform->buffered) {
+		gint cap;
+
+		xform->bufpos = 0;
+
+		/* a peek far ahead grew it past the cap, give that back */
+		cap = xmms_footprint_limit (XMMS_FOOTPRINT_XFORM_BUFFER);
+		if (cap && xform->buffersize > MAX (cap, READ_CHUNK)) {
+			cap = MAX (cap, READ_CHUNK);
+			xmms_memstat_sub (XMMS_MEMSTAT_XFORM_BUFFERS,
+			                  xform->buffersize - cap);
+			xform->buffersize = cap;
 			xform->buffer = g_realloc (xform->buffer, xform->buffersize);
 		}
+	}
+
+	return len;
+}
+
+/**
+ * Make sure at least siz bytes are buffered in the xform (unless
+ * EOS is hit first), without consuming anything. Subsequent reads
+ * are served from the buffer.
+ *
+ * @returns the number of bytes buffered or -1 on error.
+ */
+gint
+xmms_xform_this_prefill (xmms_xform_t *xform, gint siz, xmms_error_t *err)
+{
+	while (xform->buffered < siz) {
+		gint res;
 
-		res = xmms_xform_plugin_read (xform->plugin, xform,
-		                              &xform->buffer[xform->buffered],
-		                              READ_CHUNK, err);
+		res = xmms_xform_plugin_read_block (xform,
+		                                    xmms_xform_buffer_reserve (xform, READ_CHUNK),
+		                                    READ_CHUNK, err);
 
 		if (res < -1) {
 			XMMS_DBG ("Read method of %s returned bad value (%d) - BUG IN PLUGIN",
@@ -869,21 +1356,28 @@ xmms_xform_this_peek (xmms_xform_t *xform, gpointer buf, gint siz,
 		}
 	}
 
-	/* might have eosed */
-	siz = MIN (siz, xform->buffered);
-	memcpy (buf, xform->buffer, siz);
-	return siz;
+	return xform->buffered;
 }
 
-static void
-xmms_xform_hotspot_callback (gpointer data, gpointer user_data)
+static gint
+xmms_xform_this_peek (xmms_xform_t *xform, gpointer buf, gint siz,
+                      xmms_error_t *err)
 {
-	xmms_xform_hotspot_t *hs = data;
-	gint *read = user_data;
+	if (xmms_xform_this_prefill (xform, siz, err) == -1) {
+		return -1;
+	}
 
-	hs->pos -= *read;
+	/* might have eosed */
+	siz = MIN (siz, xform->buffered);
+	memcpy (buf, xform->buffer + xform->bufpos, siz);
+	return siz;
 }
 
+/**
+ * Apply the hotspots that have been reached.
+ *
+ * @returns the number of bytes to the next one, or -1 if there is none.
+ */
 static gint
 xmms_xform_hotspots_update (xmms_xform_t *xform)
 {
@@ -891,7 +1385,7 @@ xmms_xform_hotspots_update (xmms_xform_t *xform)
 	gint ret = -1;
 
 	hs = g_queue_peek_head (xform->hotspots);
-	while (hs != NULL && hs->pos == 0) {
+	while (hs != NULL && hs->pos <= xform->offset) {
 		g_queue_pop_head (xform->hotspots);
 		if (hs->key) {
 			g_hash_table_insert (xform->privdata, hs->key, hs->obj);
@@ -900,15 +1394,15 @@ xmms_xform_hotspots_update (xmms_xform_t *xform)
 	}
 
 	if (hs != NULL) {
-		ret = hs->pos;
+		ret = hs->pos - xform->offset;
 	}
 
 	return ret;
 }
 
-gint
-xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, gint siz,
-                      xmms_error_t *err)
+static gint
+xmms_xform_this_read_real (xmms_xform_t *xform, gpointer buf, gint siz,
+                           xmms_error_t *err)
 {
 	gint read = 0;
 	gint nexths;
@@ -925,18 +1419,7 @@ xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, gint siz,
 	}
 
 	if (xform->buffered) {
-		read = MIN (siz, xform->buffered);
-		memcpy (buf, xform->buffer, read);
-		xform->buffered -= read;
-
-		/* buffer edited, update hotspot positions */
-		g_queue_foreach (xform->hotspots, &xmms_xform_hotspot_callback, &read);
-
-		if (xform->buffered) {
-			/* unless we are _peek:ing often
-			   this should be fine */
-			memmove (xform->buffer, &xform->buffer[read], xform->buffered);
-		}
+		read = xmms_xform_buffer_take (xform, buf, siz);
 	}
 
 	if (xform->eos) {
@@ -946,10 +1429,10 @@ xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, gint siz,
 	while (read < siz) {
 		gint res;
 
-		res = xmms_xform_plugin_read (xform->plugin, xform, buf + read, siz - read, err);
+		res = xmms_xform_plugin_read_block (xform, buf + read, siz - read, err);
 		if (xform->metadata_collected && xform->metadata_changed) {
-            xmms_xform_metadata_update (xform);
-        }
+			xmms_xform_metadata_update_deferred (xform);
+		}
 
 		if (res < -1) {
 			XMMS_DBG ("Read method of %s returned bad value (%d) - BUG IN PLUGIN", xmms_xform_shortname (xform), res);
@@ -967,25 +1450,121 @@ xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, gint siz,
                 xmms_xform_hotspots_update (xform);
             }
 
+			/* a hotspot was set while reading, keep the data for
+			   after it has been applied */
 			if (!g_queue_is_empty (xform->hotspots)) {
-				if (xform->buffered + res > xform->buffersize) {
-					xform->buffersize = MAX (xform->buffersize * 2,
-					                         xform->buffersize + res);
-					xform->buffer = g_realloc (xform->buffer,
-					                           xform->buffersize);
-				}
-
-				memmove (xform->buffer + xform->buffered, buf + read, res);
+				memcpy (xmms_xform_buffer_reserve (xform, res), buf + read, res);
 				xform->buffered += res;
+				xform->stats.buffered++;
+				xform->stats.copied += res;
 				break;
 			}
 			read += res;
+			xform->offset += res;
 		}
 	}
 
 	return read;
 }
 
+gint
+xmms_xform_this_read (xmms_xform_t *xform, gpointer buf, gint siz,
+                      xmms_error_t *err)
+{
+	gint64 start, time;
+	gint ret;
+
+	start = g_get_monotonic_time ();
+	ret = xmms_xform_this_read_real (xform, buf, siz, err);
+	time = g_get_monotonic_time () - start;
+
+	xform->stats.calls++;
+	xform->stats.time += time;
+	if (time > xform->stats.max) {
+		xform->stats.max = time;
+	}
+	if (ret > 0) {
+		xform->stats.bytes += ret;
+	}
+
+	return ret;
+}
+
+/**
+ * What each xform in the chain ending in last did since it was set
+ * up, from the first one on. The counters are read while the chain
+ * may be in use, they are only ever off by a read.
+ *
+ * @returns a list of dicts with the "name" of the xform and how many
+ * "calls" to read it there were, the "bytes" they gave, the "time"
+ * spent in it alone and the longest read including the xforms before
+ * it ("max"), both in us. Also the number of "seeks", how often a
+ * hotspot made it keep data "buffered" and the bytes it "copied"
+ * around in its buffer.
+ */
+xmmsv_t *
+xmms_xform_chain_stats (xmms_xform_t *last)
+{
+	xmms_xform_t *xform;
+	xmmsv_t *list, *dict;
+
+	list = xmmsv_new_list ();
+
+	for (xform = last; xform; xform = xform->prev) {
+		gint64 time = xform->stats.time;
+		xmms_xform_t *prev = xform->prev;
+
+		/* reads include the time reading from the previous one,
+		   fused effects in between are never read themselves */
+		while (prev && !prev->stats.time) {
+			prev = prev->prev;
+		}
+		if (prev) {
+			time -= prev->stats.time;
+		}
+
+		dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("name", xmms_xform_shortname (xform)),
+		                         XMMSV_DICT_ENTRY_INT ("calls", xform->stats.calls),
+		                         XMMSV_DICT_ENTRY_INT ("bytes", xform->stats.bytes),
+		                         XMMSV_DICT_ENTRY_INT ("time", MAX (time, 0)),
+		                         XMMSV_DICT_ENTRY_INT ("max", xform->stats.max),
+		                         XMMSV_DICT_ENTRY_INT ("seeks", xform->stats.seeks),
+		                         XMMSV_DICT_ENTRY_INT ("buffered", xform->stats.buffered),
+		                         XMMSV_DICT_ENTRY_INT ("copied", xform->stats.copied),
+		                         XMMSV_DICT_END);
+		xmmsv_list_insert (list, 0, dict);
+		xmmsv_unref (dict);
+	}
+
+	return list;
+}
+
+static void
+xmms_xform_chain_metadata_add (gpointer key, gpointer value, gpointer udata)
+{
+	xmmsv_dict_set ((xmmsv_t *) udata, key, value);
+}
+
+/**
+ * Get the metadata every xform of a chain has set as one dict, that of
+ * later xforms taking precedence.
+ */
+xmmsv_t *
+xmms_xform_chain_metadata (xmms_xform_t *last)
+{
+	xmmsv_t *dict;
+
+	if (last->prev) {
+		dict = xmms_xform_chain_metadata (last->prev);
+	} else {
+		dict = xmmsv_new_dict ();
+	}
+
+	g_hash_table_foreach (last->metadata, xmms_xform_chain_metadata_add, dict);
+
+	return dict;
+}
+
 gint64
 xmms_xform_this_seek (xmms_xform_t *xform, gint64 offset,
                       xmms_xform_seek_mode_t whence, xmms_error_t *err)
@@ -1007,12 +1586,15 @@ xmms_xform_this_seek (xmms_xform_t *xform, gint64 offset,
 		offset -= xform->buffered;
 	}
 
+	xform->stats.seeks++;
+
 	res = xmms_xform_plugin_seek (xform->plugin, xform, offset, whence, err);
 	if (res != -1) {
 		xmms_xform_hotspot_t *hs;
 
 		xform->eos = FALSE;
 		xform->buffered = 0;
+		xform->bufpos = 0;
 
 		/* flush the hotspot queue on seek */
 		while ((hs = g_queue_pop_head (xform->hotspots)) != NULL) {
@@ -1041,39 +1623,58 @@ xmms_xform_read_line (xmms_xform_t *xform, gchar *line, xmms_error_t *err)
 	g_return_val_if_fail (xform, NULL);
 	g_return_val_if_fail (line, NULL);
 
-	p = strchr (xform->lr.buf, '\n');
-
-	if (!p) {
+	/* read until there is a whole line, the buffer is full or the
+	 * stream ends, later lines are taken from what was read */
+	while (!(p = strchr (xform->lr.bufstart, '\n'))) {
 		gint l, r;
 
+		l = xform->lr.bufend - xform->lr.bufstart;
+		memmove (xform->lr.buf, xform->lr.bufstart, l);
+		xform->lr.bufstart = xform->lr.buf;
+		xform->lr.bufend = xform->lr.buf + l;
+
 		l = (XMMS_XFORM_MAX_LINE_SIZE - 1) - (xform->lr.bufend - xform->lr.buf);
-		if (l) {
-			r = xmms_xform_read (xform, xform->lr.bufend, l, err);
-			if (r < 0) {
-				return NULL;
-			}
-			xform->lr.bufend += r;
+		if (!l) {
+			break;
 		}
-		if (xform->lr.bufend <= xform->lr.buf)
+
+		r = xmms_xform_read (xform, xform->lr.bufend, l, err);
+		if (r < 0) {
 			return NULL;
+		}
+		if (r == 0) {
+			break;
+		}
 
+		xform->lr.bufend += r;
 		*(xform->lr.bufend) = '\0';
-		p = strchr (xform->lr.buf, '\n');
-		if (!p) {
-			p = xform->lr.bufend;
-		}
 	}
 
-	if (p > xform->lr.buf && *(p-1) == '\r') {
+	if (!p) {
+		if (xform->lr.bufend <= xform->lr.buf)
+			return NULL;
+
+		p = xform->lr.bufend;
+	}
+
+	if (p > xform->lr.bufstart && *(p-1) == '\r') {
 		*(p-1) = '\0';
 	} else {
 		*p = '\0';
 	}
 
-	strcpy (line, xform->lr.buf);
-	memmove (xform->lr.buf, p + 1, xform->lr.bufend - p);
-	xform->lr.bufend -= (p - xform->lr.buf) + 1;
-	*xform->lr.bufend = '\0';
+	strcpy (line, xform->lr.bufstart);
+
+	if (p < xform->lr.bufend) {
+		xform->lr.bufstart = p + 1;
+	} else {
+		xform->lr.bufstart = xform->lr.bufend;
+	}
+
+	if (xform->lr.bufstart == xform->lr.bufend) {
+		xform->lr.bufstart = xform->lr.bufend = xform->lr.buf;
+		*xform->lr.buf = '\0';
+	}
 
 	return line;
 }
@@ -1109,67 +1710,127 @@ xmms_xform_get_url (xmms_xform_t *xform)
 }
 
 
-typedef struct match_state_St {
-	xmms_xform_plugin_t *match;
-	const xmms_stream_type_t *out_type;
+/**
+ * Take the next plugin of the chain an entry was last played with, if
+ * it takes the stream type. The names used up are skipped.
+ *
+ * @returns the plugin, not referenced, or NULL.
+ */
+static xmms_xform_plugin_t *
+chain_hint_match (const xmms_stream_type_t *st, gchar ***hint)
+{
+	const gchar *mime;
+	gchar **name;
 	gint priority;
-} match_state_t;
 
-static gboolean
-xmms_xform_match (xmms_plugin_t *plugin, gpointer user_data)
-{
-	xmms_xform_plugin_t *xform_plugin = (xmms_xform_plugin_t *) plugin;
-	match_state_t *state = (match_state_t *) user_data;
-	gint priority = 0;
+	/* once decoded the goal formats pick the converters and effects */
+	mime = xmms_stream_type_get_str (st, XMMS_STREAM_TYPE_MIMETYPE);
+	if (!mime || strcmp (mime, "audio/pcm") == 0) {
+		return NULL;
+	}
 
-	g_assert (plugin->type == XMMS_PLUGIN_TYPE_XFORM);
+	for (name = *hint; *name; name++) {
+		xmms_xform_plugin_t *plugin;
+		gboolean supported;
 
-	XMMS_DBG ("Trying plugin '%s'", xmms_plugin_shortname_get (plugin));
-	if (!xmms_xform_plugin_supports (xform_plugin, state->out_type, &priority)) {
-		return TRUE;
-	}
+		plugin = xmms_xform_find_plugin (*name);
+		if (!plugin) {
+			continue;
+		}
 
-	XMMS_DBG ("Plugin '%s' matched (priority %d)",
-	          xmms_plugin_shortname_get (plugin), priority);
+		/* the plugin list keeps it around */
+		supported = xmms_xform_plugin_supports (plugin, st, &priority);
+		xmms_object_unref (plugin);
 
-	if (priority > state->priority) {
-		if (state->match) {
-			xmms_plugin_t *previous_plugin = (xmms_plugin_t *) state->match;
-			XMMS_DBG ("Using plugin '%s' (priority %d) instead of '%s' (priority %d)",
-			          xmms_plugin_shortname_get (plugin), priority,
-			          xmms_plugin_shortname_get (previous_plugin),
-			          state->priority);
+		if (supported) {
+			*hint = name + 1;
+			return plugin;
 		}
+	}
+
+	return NULL;
+}
+
+/* Start prev over for the next plugin after one failed to init */
+static gboolean
+xmms_xform_rewind (xmms_xform_t *xform)
+{
+	xmms_error_t err;
 
-		state->match = xform_plugin;
-		state->priority = priority;
+	/* the url the chain starts from has nothing to read */
+	if (!xform->plugin) {
+		return TRUE;
 	}
 
-	return TRUE;
+	xmms_error_reset (&err);
+
+	return xmms_xform_this_seek (xform, 0, XMMS_XFORM_SEEK_SET, &err) == 0;
 }
 
-xmms_xform_t *
-xmms_xform_find (xmms_xform_t *prev, xmms_medialib_entry_t entry,
-                 GList *goal_hints)
+static xmms_xform_t *
+xmms_xform_find_hinted (xmms_xform_t *prev, xmms_medialib_entry_t entry,
+                        GList *goal_hints, gchar ***hint)
 {
-	match_state_t state;
+	const xmms_stream_type_t *st = xmms_xform_get_out_stream_type (prev);
+	xmms_xform_plugin_t *match = NULL;
 	xmms_xform_t *xform = NULL;
+	GList *tried = NULL;
+
+	if (hint && *hint) {
+		match = chain_hint_match (st, hint);
+	}
+	if (!match) {
+		match = xmms_xform_plugin_find_match (st);
+	}
+
+	/* never tried in-process, the daemon would go down with it */
+	if (match && entry &&
+	    xmms_sandbox_wanted (xmms_plugin_shortname_get ((xmms_plugin_t *) match))) {
+		xform = xmms_xform_sandbox_add (prev, entry, goal_hints);
+		if (!xform) {
+			XMMS_DBG ("Sandboxed '%s' failed",
+			          xmms_plugin_shortname_get ((xmms_plugin_t *) match));
+		}
+		return xform;
+	}
 
-	state.out_type = xmms_xform_get_out_stream_type (prev);
-	state.match = NULL;
-	state.priority = -1;
+	while (match) {
+		xform = xmms_xform_new (match, prev, prev->medialib, entry, goal_hints);
+		if (xform || !entry) {
+			break;
+		}
 
-	xmms_plugin_foreach (XMMS_PLUGIN_TYPE_XFORM, xmms_xform_match, &state);
+		tried = g_list_prepend (tried, match);
 
-	if (state.match) {
-		xform = xmms_xform_new (state.match, prev, prev->medialib, entry, goal_hints);
-	} else {
+		if (!xmms_xform_rewind (prev)) {
+			XMMS_DBG ("Can't try other plugins, '%s' doesn't seek",
+			          xmms_xform_shortname (prev));
+			break;
+		}
+
+		match = xmms_xform_plugin_find_next_match (st, tried);
+		if (match) {
+			XMMS_DBG ("Trying '%s' instead",
+			          xmms_plugin_shortname_get ((xmms_plugin_t *) match));
+		}
+	}
+
+	g_list_free (tried);
+
+	if (!xform) {
 		XMMS_DBG ("Found no matching plugin...");
 	}
 
 	return xform;
 }
 
+xmms_xform_t *
+xmms_xform_find (xmms_xform_t *prev, xmms_medialib_entry_t entry,
+                 GList *goal_hints)
+{
+	return xmms_xform_find_hinted (prev, entry, goal_hints, NULL);
+}
+
 gboolean
 xmms_xform_iseos (xmms_xform_t *xform)
 {
@@ -1196,6 +1857,96 @@ xmms_xform_goal_hints_get (xmms_xform_t *xform)
 	return xform->goal_hints;
 }
 
+static gboolean
+has_goal_hint (GList *goal_formats, const gchar *hint)
+{
+	GList *n;
+
+	for (n = goal_formats; n; n = g_list_next (n)) {
+		const gchar *mime;
+
+		mime = xmms_stream_type_get_str (n->data, XMMS_STREAM_TYPE_MIMETYPE);
+		if (mime && strcmp (mime, hint) == 0) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+gboolean
+xmms_xform_is_probe (xmms_xform_t *xform)
+{
+	g_return_val_if_fail (xform, FALSE);
+
+	if (!has_goal_hint (xform->goal_hints, XMMS_XFORM_PROBE_MIMETYPE)) {
+		return FALSE;
+	}
+
+	/* segments of a file are cut from the decoded stream */
+	return !xmms_xform_metadata_has_val (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_STARTMS) &&
+	       !xmms_xform_metadata_has_val (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_STOPMS);
+}
+
+gboolean
+xmms_xform_is_analysis (xmms_xform_t *xform)
+{
+	g_return_val_if_fail (xform, FALSE);
+
+	return has_goal_hint (xform->goal_hints, XMMS_XFORM_ANALYSIS_MIMETYPE);
+}
+
+/* The first pcm goal with a channel count */
+static const xmms_stream_type_t *
+goal_pcm (const GList *goal_formats)
+{
+	const GList *n;
+
+	for (n = goal_formats; n; n = g_list_next (n)) {
+		const gchar *mime;
+
+		mime = xmms_stream_type_get_str (n->data, XMMS_STREAM_TYPE_MIMETYPE);
+		if (mime && strcmp (mime, "audio/pcm") == 0 &&
+		    xmms_stream_type_get_int (n->data, XMMS_STREAM_TYPE_FMT_CHANNELS) > 0) {
+			return n->data;
+		}
+	}
+
+	return NULL;
+}
+
+const xmms_stream_type_t *
+xmms_xform_goal_pcm_get (xmms_xform_t *xform)
+{
+	g_return_val_if_fail (xform, NULL);
+
+	return goal_pcm (xform->goal_hints);
+}
+
+/**
+ * A probe is done once the duration is known and the stream format is
+ * on the outdata type, what decoders would add is not worth setting
+ * them up for.
+ */
+static gboolean
+probe_done (xmms_xform_t *xform)
+{
+	const xmms_stream_type_t *type;
+
+	if (!xmms_xform_is_probe (xform)) {
+		return FALSE;
+	}
+
+	if (!xmms_xform_metadata_has_val (xform, XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION)) {
+		return FALSE;
+	}
+
+	type = xmms_xform_get_out_stream_type (xform);
+
+	return xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_SAMPLERATE) > 0 &&
+	       xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_CHANNELS) > 0;
+}
+
 
 static gboolean
 has_goalformat (xmms_xform_t *xform, GList *goal_formats)
@@ -1231,12 +1982,14 @@ outdata_type_metadata_collect (xmms_xform_t *xform)
 
 	type = xmms_xform_get_out_stream_type (xform);
 	mime = xmms_stream_type_get_str (type, XMMS_STREAM_TYPE_MIMETYPE);
-	if (strcmp (mime, "audio/pcm") != 0) {
+
+	/* a probe may stop at encoded data, only the format is pcm specific */
+	if (strcmp (mime, "audio/pcm") != 0 && !xmms_xform_is_probe (xform)) {
 		return;
 	}
 
 	val = xmms_stream_type_get_int (type, XMMS_STREAM_TYPE_FMT_FORMAT);
-	if (val != -1) {
+	if (val != -1 && strcmp (mime, "audio/pcm") == 0) {
 		const gchar *name = xmms_sample_name_get ((xmms_sample_format_t) val);
 		xmms_xform_metadata_set_str (xform,
 		                             XMMS_MEDIALIB_ENTRY_PROPERTY_SAMPLE_FMT,
@@ -1258,12 +2011,160 @@ outdata_type_metadata_collect (xmms_xform_t *xform)
 	}
 }
 
+/**
+ * Put the disk cache right after a remote transport. Streams the
+ * cache can't handle go on without it.
+ */
+static xmms_xform_t *
+xmms_xform_diskcache_add (xmms_xform_t *transport,
+                          xmms_medialib_entry_t entry, GList *goal_formats)
+{
+	xmms_plugin_t *plugin;
+	xmms_xform_t *xform;
+
+	if (!xmms_diskcache_wanted (xmms_xform_shortname (transport))) {
+		return transport;
+	}
+
+	plugin = xmms_plugin_find (XMMS_PLUGIN_TYPE_XFORM, "diskcache");
+	if (!plugin) {
+		return transport;
+	}
+
+	xform = xmms_xform_new ((xmms_xform_plugin_t *) plugin, transport,
+	                        transport->medialib, entry, goal_formats);
+	xmms_object_unref (plugin);
+
+	if (!xform) {
+		return transport;
+	}
+
+	xmms_object_unref (transport);
+
+	return xform;
+}
+
+/**
+ * Hand a decoder that is run in a host process of its own over to the
+ * sandbox, see sandbox_xform.c. The host sets up the chain from the
+ * url again, so the sandbox takes over right after the start of the
+ * chain and the xforms in between are dropped.
+ */
+static xmms_xform_t *
+xmms_xform_sandbox_add (xmms_xform_t *prev, xmms_medialib_entry_t entry,
+                        GList *goal_formats)
+{
+	xmms_plugin_t *plugin;
+	xmms_xform_t *xform;
+
+	plugin = xmms_plugin_find (XMMS_PLUGIN_TYPE_XFORM, "sandbox");
+	if (!plugin) {
+		return NULL;
+	}
+
+	while (prev->prev) {
+		prev = prev->prev;
+	}
+
+	xform = xmms_xform_new ((xmms_xform_plugin_t *) plugin, prev,
+	                        prev->medialib, entry, goal_formats);
+	xmms_object_unref (plugin);
+
+	return xform;
+}
+
+/* If a pcm goal takes the channel count, or says nothing about it */
+static gboolean
+goal_takes_channels (GList *goal_formats, gint channels)
+{
+	GList *n;
+
+	for (n = goal_formats; n; n = g_list_next (n)) {
+		const gchar *mime;
+		gint goal;
+
+		mime = xmms_stream_type_get_str (n->data, XMMS_STREAM_TYPE_MIMETYPE);
+		if (!mime || strcmp (mime, "audio/pcm") != 0) {
+			continue;
+		}
+
+		goal = xmms_stream_type_get_int (n->data, XMMS_STREAM_TYPE_FMT_CHANNELS);
+		if (goal <= 0 || goal == channels) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/**
+ * Put the channel mixer after a decoder whose channels the sample
+ * converter can't map to those of the goal, which it only does
+ * between mono and stereo. Streams it can't mix go on without it.
+ */
+static xmms_xform_t *
+xmms_xform_channelmix_add (xmms_xform_t *last, xmms_medialib_entry_t entry,
+                           GList *goal_formats, gchar ***hint)
+{
+	const xmms_stream_type_t *st, *goal;
+	xmms_plugin_t *plugin;
+	xmms_xform_t *xform;
+	const gchar *mime;
+	gint in, out;
+
+	st = xmms_xform_get_out_stream_type (last);
+	mime = xmms_stream_type_get_str (st, XMMS_STREAM_TYPE_MIMETYPE);
+	if (!mime || strcmp (mime, "audio/pcm") != 0) {
+		return last;
+	}
+
+	goal = goal_pcm (goal_formats);
+	in = xmms_stream_type_get_int (st, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	if (!goal || in <= 0 || goal_takes_channels (goal_formats, in)) {
+		return last;
+	}
+
+	out = xmms_stream_type_get_int (goal, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	if (in <= 2 && out <= 2) {
+		return last;
+	}
+
+	plugin = xmms_plugin_find (XMMS_PLUGIN_TYPE_XFORM, "channelmix");
+	if (!plugin) {
+		return last;
+	}
+
+	xform = xmms_xform_new ((xmms_xform_plugin_t *) plugin, last,
+	                        last->medialib, entry, goal_formats);
+	xmms_object_unref (plugin);
+
+	if (!xform) {
+		return last;
+	}
+
+	/* the chain it was set up with before names it too */
+	if (*hint && **hint && strcmp (**hint, "channelmix") == 0) {
+		(*hint)++;
+	}
+
+	xmms_object_unref (last);
+
+	return xform;
+}
+
+/**
+ * Set up the chain up to the goal formats. Each step tries the next
+ * plugin of the chain the entry was last set up with first, so those
+ * that failed on it before are skipped, and the others taking the
+ * stream in order of priority if one fails.
+ */
 static xmms_xform_t *
 chain_setup (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
-             const gchar *url, GList *goal_formats)
+             const gchar *url, const gchar *last_chain, GList *goal_formats)
 {
 	xmms_xform_t *xform, *last;
 	gchar *durl, *args;
+	gchar **names = NULL, **hint = NULL;
 
 	if (!entry) {
 		entry = 1; /* FIXME: this is soooo ugly, don't do this */
@@ -1305,20 +2206,37 @@ chain_setup (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
 
 	last = xform;
 
+	if (last_chain) {
+		names = g_strsplit (last_chain, ":", 0);
+		hint = names;
+	}
+
 	do {
-		xform = xmms_xform_find (last, entry, goal_formats);
+		xform = xmms_xform_find_hinted (last, entry, goal_formats, &hint);
 		if (!xform) {
 			xmms_log_error ("Couldn't set up chain for '%s' (%d)",
 			                durl, entry);
 			xmms_object_unref (last);
+			g_strfreev (names);
 			g_free (durl);
 
 			return NULL;
 		}
+		if (!last->prev) {
+			xform = xmms_xform_diskcache_add (xform, entry, goal_formats);
+		}
 		xmms_object_unref (last);
 		last = xform;
-	} while (!has_goalformat (xform, goal_formats));
 
+		if (probe_done (xform)) {
+			XMMS_DBG ("Probe done at '%s'", xmms_xform_shortname (xform));
+			break;
+		}
+
+		last = xmms_xform_channelmix_add (last, entry, goal_formats, &hint);
+	} while (!has_goalformat (last, goal_formats));
+
+	g_strfreev (names);
 	g_free (durl);
 
 	outdata_type_metadata_collect (last);
@@ -1326,6 +2244,18 @@ chain_setup (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
 	return last;
 }
 
+/**
+ * Set up the chain decoding url, without the segment plugin and the
+ * effects, for the decoder host of the sandbox.
+ */
+xmms_xform_t *
+xmms_xform_chain_setup_decoder (xmms_medialib_t *medialib,
+                                xmms_medialib_entry_t entry, const gchar *url,
+                                GList *goal_formats)
+{
+	return chain_setup (medialib, entry, url, NULL, goal_formats);
+}
+
 static void
 chain_finalize (xmms_medialib_session_t *session,
                 xmms_xform_t *xform, xmms_medialib_entry_t entry,
@@ -1367,6 +2297,8 @@ xmms_xform_chain_setup (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
 	xmms_medialib_session_t *session;
 	xmms_xform_t *ret = NULL;
 
+	XMMS_TRACE_BEGIN ("xform.chain_setup");
+
 	do {
 		session = xmms_medialib_session_begin (medialib);
 		if (ret != NULL)
@@ -1375,6 +2307,8 @@ xmms_xform_chain_setup (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
         XMMS_DBG ("xform chain setup ret = %p", ret);
 	} while (!xmms_medialib_session_commit (session));
 
+	XMMS_TRACE_END ("xform.chain_setup");
+
     XMMS_DBG ("Committed xform chain setup ret = %p", ret);
 	return ret;
 }
@@ -1409,9 +2343,13 @@ xmms_xform_chain_setup_url_session (xmms_medialib_t *medialib,
 	xmms_plugin_t *plugin;
 	xmms_xform_plugin_t *xform_plugin;
 	gboolean add_segment = FALSE;
+	gchar *last_chain;
 	gint priority;
 
-	last = chain_setup (medialib, entry, url, goal_formats);
+	last_chain = xmms_medialib_entry_property_get_str (session, entry,
+	                                                   XMMS_MEDIALIB_ENTRY_PROPERTY_CHAIN);
+	last = chain_setup (medialib, entry, url, last_chain, goal_formats);
+	g_free (last_chain);
 	if (!last) {
 		return NULL;
 	}
@@ -1421,17 +2359,20 @@ xmms_xform_chain_setup_url_session (xmms_medialib_t *medialib,
 	xform_plugin = (xmms_xform_plugin_t *) plugin;
 
 	/* if segment plugin input is the same as current output, include it
-	 * for collecting additional duration metadata on audio entries */
+	 * for collecting additional duration metadata on audio entries,
+	 * a probe of a whole file has nothing to cut */
 	if (xform_plugin) {
 		const xmms_stream_type_t *st = xmms_xform_get_out_stream_type (last);
-		add_segment = xmms_xform_plugin_supports (xform_plugin, st,
+		add_segment = !xmms_xform_is_probe (last) &&
+		              xmms_xform_plugin_supports (xform_plugin, st,
 		                                          &priority);
 		xmms_object_unref (plugin);
 	}
 
 	/* add segment plugin to the chain if it can be added */
 	if (add_segment) {
-		last = xmms_xform_new_effect (last, entry, goal_formats, "segment");
+		last = xmms_xform_new_effect (last, entry, goal_formats, "segment",
+		                              FALSE);
 		if (!last) {
 			return NULL;
 		}
@@ -1443,6 +2384,21 @@ xmms_xform_chain_setup_url_session (xmms_medialib_t *medialib,
 		if (!last) {
 			return NULL;
 		}
+
+		/* effects may have left the stream in float, convert it once
+		 * to what the output wants */
+		if (!has_goalformat (last, goal_formats)) {
+			xmms_xform_t *xform;
+
+			xform = xmms_xform_find (last, entry, goal_formats);
+			if (!xform) {
+				xmms_log_error ("Couldn't convert effect output for '%s'", url);
+				xmms_object_unref (last);
+				return NULL;
+			}
+			xmms_object_unref (last);
+			last = xform;
+		}
 	}
 
 	chain_finalize (session, last, entry, url, rehash);
@@ -1468,6 +2424,65 @@ xmms_xform_chain_setup_url (xmms_medialib_t *medialib,
 	return ret;
 }
 
+/**
+ * Decode an entry for an effect that analyzes the audio, and store the
+ * metadata the effect sets. Nothing else about the entry is changed,
+ * and the effect ends the stream once it has seen enough of it.
+ *
+ * @param goal_formats The format the effect takes, along with an
+ * #XMMS_XFORM_ANALYSIS_MIMETYPE goal
+ * @param name Short name of the effect
+ * @returns FALSE if the effect couldn't be set up or decoding failed
+ */
+gboolean
+xmms_xform_chain_analyze (xmms_medialib_t *medialib, xmms_medialib_entry_t entry,
+                          GList *goal_formats, const gchar *name)
+{
+	xmms_medialib_session_t *session;
+	xmms_xform_t *last;
+	xmms_error_t err;
+	gchar *url, *last_chain;
+	gchar buf[4096];
+	gint ret;
+
+	session = xmms_medialib_session_begin (medialib);
+	url = get_url_for_entry (session, entry);
+	last_chain = xmms_medialib_entry_property_get_str (session, entry,
+	                                                   XMMS_MEDIALIB_ENTRY_PROPERTY_CHAIN);
+	xmms_medialib_session_abort (session);
+
+	if (!url) {
+		g_free (last_chain);
+		return FALSE;
+	}
+
+	last = chain_setup (medialib, entry, url, last_chain, goal_formats);
+	g_free (last_chain);
+	g_free (url);
+	if (!last) {
+		return FALSE;
+	}
+
+	last = xmms_xform_new_effect (last, entry, goal_formats, name, FALSE);
+	if (strcmp (xmms_xform_shortname (last), name) != 0) {
+		xmms_object_unref (last);
+		return FALSE;
+	}
+
+	xmms_error_reset (&err);
+	do {
+		ret = xmms_xform_this_read (last, buf, sizeof (buf), &err);
+	} while (ret > 0);
+
+	if (last->metadata_changed) {
+		xmms_xform_metadata_update (last);
+	}
+
+	xmms_object_unref (last);
+
+	return ret == 0;
+}
+
 xmms_config_property_t *
 xmms_xform_config_lookup (xmms_xform_t *xform, const gchar *path)
 {
@@ -1480,10 +2495,23 @@ static xmms_xform_t *
 add_effects (xmms_xform_t *last, xmms_medialib_entry_t entry,
              GList *goal_formats)
 {
+	xmms_config_property_t *cfg;
+	GPtrArray *run = NULL;
+	gboolean fuse = TRUE, float_pipeline = FALSE;
 	gint effect_no;
 
+	cfg = xmms_config_lookup ("effect.fuse");
+	if (cfg) {
+		fuse = !!xmms_config_property_get_int (cfg);
+	}
+
+	cfg = xmms_config_lookup ("effect.float_pipeline");
+	if (cfg) {
+		float_pipeline = !!xmms_config_property_get_int (cfg);
+	}
+
 	for (effect_no = 0; TRUE; effect_no++) {
-		xmms_config_property_t *cfg;
+		xmms_xform_t *prev = last;
 		gchar key[64];
 		const gchar *name;
 
@@ -1500,15 +2528,141 @@ add_effects (xmms_xform_t *last, xmms_medialib_entry_t entry,
 			continue;
 		}
 
-		last = xmms_xform_new_effect (last, entry, goal_formats, name);
+		last = xmms_xform_new_effect (last, entry, goal_formats, name,
+		                              float_pipeline);
+		if (last == prev) {
+			/* skipped, the effects around it are still consecutive */
+			continue;
+		}
+
+		if (run && last->prev != prev) {
+			/* a converter was put in front of it, ending the run */
+			xmms_xform_fuse_effects (run);
+			run = NULL;
+		}
+
+		if (fuse && xmms_xform_plugin_can_process (last->plugin)) {
+			if (!run) {
+				run = g_ptr_array_new ();
+			}
+			g_ptr_array_add (run, last);
+		} else if (run) {
+			xmms_xform_fuse_effects (run);
+			run = NULL;
+		}
+	}
+
+	if (run) {
+		xmms_xform_fuse_effects (run);
 	}
 
 	return last;
 }
 
+/**
+ * Let the last of a run of effects that can process in place read for
+ * all of them, so the data passes through the run in one block instead
+ * of through one xform buffer each.
+ */
+static void
+xmms_xform_fuse_effects (GPtrArray *run)
+{
+	xmms_xform_t *last;
+
+	if (run->len < 2) {
+		g_ptr_array_free (run, TRUE);
+		return;
+	}
+
+	last = g_ptr_array_index (run, run->len - 1);
+	last->fused = run;
+
+	XMMS_DBG ("Fused %d effects ending in '%s'", run->len,
+	          xmms_xform_shortname (last));
+}
+
+/**
+ * Convert the stream ahead of an effect so that it processes float
+ * samples, or 16 bit ones if it can't handle either float or what the
+ * stream currently is.
+ */
+static xmms_xform_t *
+xmms_xform_effect_convert (xmms_xform_t *last, xmms_medialib_entry_t entry,
+                           xmms_xform_plugin_t *effect)
+{
+	xmms_plugin_t *plugin;
+	xmms_stream_type_t *type;
+	xmms_xform_t *xform;
+	const gchar *mime;
+	GList *goal;
+	gint format, channels, samplerate, priority;
+
+	mime = xmms_stream_type_get_str (last->out_type, XMMS_STREAM_TYPE_MIMETYPE);
+	if (!mime || strcmp (mime, "audio/pcm") != 0) {
+		return last;
+	}
+
+	format = xmms_stream_type_get_int (last->out_type, XMMS_STREAM_TYPE_FMT_FORMAT);
+	channels = xmms_stream_type_get_int (last->out_type, XMMS_STREAM_TYPE_FMT_CHANNELS);
+	samplerate = xmms_stream_type_get_int (last->out_type, XMMS_STREAM_TYPE_FMT_SAMPLERATE);
+
+	type = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                              XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                              XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_FLOAT,
+	                              XMMS_STREAM_TYPE_FMT_CHANNELS, channels,
+	                              XMMS_STREAM_TYPE_FMT_SAMPLERATE, samplerate,
+	                              XMMS_STREAM_TYPE_END);
+
+	if (format == XMMS_SAMPLE_FORMAT_FLOAT ||
+	    !xmms_xform_plugin_supports (effect, type, &priority)) {
+		xmms_object_unref (type);
+
+		if (xmms_xform_plugin_supports (effect, last->out_type, &priority)) {
+			return last;
+		}
+
+		type = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+		                              XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+		                              XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+		                              XMMS_STREAM_TYPE_FMT_CHANNELS, channels,
+		                              XMMS_STREAM_TYPE_FMT_SAMPLERATE, samplerate,
+		                              XMMS_STREAM_TYPE_END);
+
+		if (format == XMMS_SAMPLE_FORMAT_S16 ||
+		    !xmms_xform_plugin_supports (effect, type, &priority)) {
+			xmms_object_unref (type);
+			return last;
+		}
+	}
+
+	plugin = xmms_plugin_find (XMMS_PLUGIN_TYPE_XFORM, "converter");
+	if (!plugin) {
+		xmms_object_unref (type);
+		return last;
+	}
+
+	goal = g_list_prepend (NULL, type);
+	xform = xmms_xform_new ((xmms_xform_plugin_t *) plugin, last,
+	                        last->medialib, entry, goal);
+	xmms_object_unref (plugin);
+
+	if (xform) {
+		/* only used while initializing */
+		xform->goal_hints = NULL;
+		xmms_object_unref (last);
+		last = xform;
+	}
+
+	g_list_free (goal);
+	xmms_object_unref (type);
+
+	return last;
+}
+
 static xmms_xform_t *
 xmms_xform_new_effect (xmms_xform_t *last, xmms_medialib_entry_t entry,
-                       GList *goal_formats, const gchar *name)
+                       GList *goal_formats, const gchar *name,
+                       gboolean float_pipeline)
 {
 	xmms_plugin_t *plugin;
 	xmms_xform_plugin_t *xform_plugin;
@@ -1522,6 +2676,10 @@ xmms_xform_new_effect (xmms_xform_t *last, xmms_medialib_entry_t entry,
 	}
 
 	xform_plugin = (xmms_xform_plugin_t *) plugin;
+	if (float_pipeline) {
+		last = xmms_xform_effect_convert (last, entry, xform_plugin);
+	}
+
 	if (!xmms_xform_plugin_supports (xform_plugin, last->out_type, &priority)) {
 		xmms_log_info ("Effect '%s' doesn't support format, skipping",
 		               xmms_plugin_shortname_get (plugin));
@@ -0,0 +1,144 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * A buffer for the decoded data of xform plugins.
+ */
+
+#include <string.h>
+
+#include <xmms/xmms_xformplugin.h>
+
+/* The data lives between the read and the write offset of one linear
+ * buffer. Reads only move the read offset, the data is moved back to
+ * the front when a write would not fit behind it, and both offsets
+ * start over whenever the fifo runs empty, which is the usual case
+ * for a decoder handing out whole frames.
+ */
+struct xmms_xform_fifo_St {
+	guint8 *data;
+	gsize size;
+	gsize rpos;
+	gsize wpos;
+};
+
+#define XMMS_XFORM_FIFO_MIN_SIZE 4096
+
+xmms_xform_fifo_t *
+xmms_xform_fifo_new (void)
+{
+	return g_new0 (xmms_xform_fifo_t, 1);
+}
+
+void
+xmms_xform_fifo_free (xmms_xform_fifo_t *fifo)
+{
+	g_return_if_fail (fifo);
+
+	g_free (fifo->data);
+	g_free (fifo);
+}
+
+gsize
+xmms_xform_fifo_length (xmms_xform_fifo_t *fifo)
+{
+	g_return_val_if_fail (fifo, 0);
+
+	return fifo->wpos - fifo->rpos;
+}
+
+gpointer
+xmms_xform_fifo_reserve (xmms_xform_fifo_t *fifo, gsize len)
+{
+	gsize used;
+
+	g_return_val_if_fail (fifo, NULL);
+
+	if (fifo->size - fifo->wpos >= len) {
+		return fifo->data + fifo->wpos;
+	}
+
+	used = fifo->wpos - fifo->rpos;
+	if (fifo->rpos > 0) {
+		memmove (fifo->data, fifo->data + fifo->rpos, used);
+		fifo->rpos = 0;
+		fifo->wpos = used;
+	}
+
+	if (fifo->size - used < len) {
+		gsize size = MAX (fifo->size, XMMS_XFORM_FIFO_MIN_SIZE);
+
+		while (size - used < len) {
+			size *= 2;
+		}
+
+		fifo->data = g_realloc (fifo->data, size);
+		fifo->size = size;
+	}
+
+	return fifo->data + fifo->wpos;
+}
+
+void
+xmms_xform_fifo_commit (xmms_xform_fifo_t *fifo, gsize len)
+{
+	g_return_if_fail (fifo);
+	g_return_if_fail (len <= fifo->size - fifo->wpos);
+
+	fifo->wpos += len;
+}
+
+void
+xmms_xform_fifo_write (xmms_xform_fifo_t *fifo, gconstpointer data, gsize len)
+{
+	g_return_if_fail (fifo);
+
+	if (len == 0) {
+		return;
+	}
+
+	memcpy (xmms_xform_fifo_reserve (fifo, len), data, len);
+	fifo->wpos += len;
+}
+
+gsize
+xmms_xform_fifo_read (xmms_xform_fifo_t *fifo, gpointer buf, gsize len)
+{
+	g_return_val_if_fail (fifo, 0);
+
+	len = MIN (len, fifo->wpos - fifo->rpos);
+	if (len == 0) {
+		return 0;
+	}
+
+	memcpy (buf, fifo->data + fifo->rpos, len);
+	fifo->rpos += len;
+
+	if (fifo->rpos == fifo->wpos) {
+		fifo->rpos = fifo->wpos = 0;
+	}
+
+	return len;
+}
+
+void
+xmms_xform_fifo_clear (xmms_xform_fifo_t *fifo)
+{
+	g_return_if_fail (fifo);
+
+	fifo->rpos = fifo->wpos = 0;
+}
@@ -42,6 +42,14 @@ xmms_xform_object_init ()
 
 	xmms_xform_effect_callbacks_init ();
 
+	/* run consecutive effects that can process in place as one */
+	xmms_config_property_register ("effect.fuse", "1", NULL, NULL);
+
+	/* convert to float once before the effects instead of per effect */
+	xmms_config_property_register ("effect.float_pipeline", "0", NULL, NULL);
+
+	xmms_xform_browse_cache_init ();
+
 	return obj;
 }
 
@@ -50,13 +58,21 @@ xmms_xform_object_destroy (xmms_object_t *obj)
 {
 	XMMS_DBG ("Deactivating xform object");
 	xmms_xform_unregister_ipc_commands ();
+	xmms_xform_browse_cache_shutdown ();
 }
 
 static xmmsv_t *
 xmms_xform_client_browse (xmms_xform_object_t *obj, const gchar *url,
                           xmms_error_t *error)
 {
-	return xmms_xform_browse (url, error);
+	xmmsv_t *list;
+
+	list = xmms_xform_browse (url, error);
+	if (list) {
+		xmms_xform_browse_prefetch (list);
+	}
+
+	return list;
 }
 
 static void
@@ -14,24 +14,133 @@
  *  Lesser General Public License for more details.
  */
 
+#include <string.h>
+
 #include <xmmspriv/xmms_xform.h>
 #include <xmmspriv/xmms_xform_plugin.h>
+#include <xmmspriv/xmms_streamtype.h>
 #include <xmmspriv/xmms_metadata_mapper.h>
 #include <xmms/xmms_log.h>
 
+/* Number of resolved out types remembered by
+ * #xmms_xform_plugin_find_match */
+#define XMMS_XFORM_MATCH_CACHE_SIZE 256
+
 struct xmms_xform_plugin_St {
 	xmms_plugin_t plugin;
 	xmms_xform_methods_t methods;
 	GHashTable *metadata_mapper;
 	GList *in_types;
 	xmms_stream_type_t *default_out_type;
+	/** order of loading, later plugins win ties on priority */
+	guint seq;
 };
 
+/* Verified plugins by the mimetypes they take: exact mimetypes in the
+ * table, patterns in the wildcard bucket. Plugins deferred by the
+ * manifest are loaded while chains are set up, hence the lock. */
+static GRWLock index_lock;
+static GHashTable *index_exact;
+static GPtrArray *index_wildcard;
+static guint index_seq;
+
+/* Out type key -> best matching plugin, or NULL if none. Dropped when
+ * a priority changes. */
+G_LOCK_DEFINE_STATIC (match_cache);
+static GHashTable *match_cache;
+
+static void
+match_cache_clear (void)
+{
+	G_LOCK (match_cache);
+	if (match_cache) {
+		g_hash_table_remove_all (match_cache);
+	}
+	G_UNLOCK (match_cache);
+}
+
+static void
+priority_changed (xmms_object_t *object, xmmsv_t *data, gpointer userdata)
+{
+	match_cache_clear ();
+}
+
+static void
+index_bucket_add (GPtrArray *bucket, xmms_xform_plugin_t *plugin)
+{
+	/* a plugin's types are added right after each other */
+	if (!bucket->len ||
+	    g_ptr_array_index (bucket, bucket->len - 1) != plugin) {
+		g_ptr_array_add (bucket, plugin);
+	}
+}
+
+static void
+index_add (xmms_xform_plugin_t *plugin)
+{
+	GList *t;
+
+	g_rw_lock_writer_lock (&index_lock);
+
+	if (!index_exact) {
+		index_exact = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+		                                     (GDestroyNotify) g_ptr_array_unref);
+		index_wildcard = g_ptr_array_new ();
+	}
+
+	plugin->seq = ++index_seq;
+
+	for (t = plugin->in_types; t; t = g_list_next (t)) {
+		const gchar *mime;
+		GPtrArray *bucket;
+
+		mime = xmms_stream_type_get_str (t->data, XMMS_STREAM_TYPE_MIMETYPE);
+		if (!mime || strpbrk (mime, "*?")) {
+			index_bucket_add (index_wildcard, plugin);
+			continue;
+		}
+
+		bucket = g_hash_table_lookup (index_exact, mime);
+		if (!bucket) {
+			bucket = g_ptr_array_new ();
+			g_hash_table_insert (index_exact, g_strdup (mime), bucket);
+		}
+		index_bucket_add (bucket, plugin);
+	}
+
+	g_rw_lock_writer_unlock (&index_lock);
+
+	match_cache_clear ();
+}
+
+static void
+index_remove (xmms_xform_plugin_t *plugin)
+{
+	GHashTableIter iter;
+	GPtrArray *bucket;
+
+	if (!plugin->seq || !index_exact) {
+		return;
+	}
+
+	g_rw_lock_writer_lock (&index_lock);
+	g_hash_table_iter_init (&iter, index_exact);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &bucket)) {
+		g_ptr_array_remove (bucket, plugin);
+	}
+	g_ptr_array_remove (index_wildcard, plugin);
+	g_rw_lock_writer_unlock (&index_lock);
+
+	match_cache_clear ();
+}
+
 static void
 destroy (xmms_object_t *obj)
 {
 	xmms_xform_plugin_t *plugin = (xmms_xform_plugin_t *) obj;
 
+	index_remove (plugin);
+
 	g_list_free_full (plugin->in_types, xmms_object_unref);
 	xmms_object_unref (plugin->default_out_type);
 
@@ -75,6 +184,9 @@ xmms_xform_plugin_verify (xmms_plugin_t *_plugin)
 
 	/* more checks */
 
+	/* the plugin is about to be added to the plugin list */
+	index_add (plugin);
+
 	return TRUE;
 }
 
@@ -96,7 +208,8 @@ xmms_xform_plugin_indata_add (xmms_xform_plugin_t *plugin, ...)
 	priority = xmms_stream_type_get_int (t, XMMS_STREAM_TYPE_PRIORITY);
 	g_snprintf (config_value, sizeof (config_value), "%d", priority);
 	xmms_xform_plugin_config_property_register (plugin, config_key,
-	                                            config_value, NULL, NULL);
+	                                            config_value,
+	                                            priority_changed, NULL);
 	g_free (config_key);
 
 	plugin->in_types = g_list_prepend (plugin->in_types, t);
@@ -113,6 +226,28 @@ xmms_xform_plugin_set_out_stream_type (xmms_xform_plugin_t *plugin, ...)
 }
 
 
+/**
+ * The mimetypes of the types the plugin takes, "*" for the ones
+ * without, for the plugin manifest.
+ */
+xmmsv_t *
+xmms_xform_plugin_in_mimetypes (xmms_xform_plugin_t *plugin)
+{
+	xmmsv_t *list;
+	GList *t;
+
+	list = xmmsv_new_list ();
+
+	for (t = plugin->in_types; t; t = g_list_next (t)) {
+		const gchar *mime;
+
+		mime = xmms_stream_type_get_str (t->data, XMMS_STREAM_TYPE_MIMETYPE);
+		xmmsv_list_append_string (list, mime ? mime : "*");
+	}
+
+	return list;
+}
+
 xmms_stream_type_t *
 xmms_xform_plugin_get_out_stream_type (xmms_xform_plugin_t *plugin)
 {
@@ -157,6 +292,137 @@ xmms_xform_plugin_supports (const xmms_xform_plugin_t *plugin, const xmms_stream
 	return FALSE;
 }
 
+static void
+find_match_in (GPtrArray *bucket, const xmms_stream_type_t *st, GList *skip,
+               xmms_xform_plugin_t **best, gint *best_priority)
+{
+	gint priority;
+	guint i;
+
+	if (!bucket) {
+		return;
+	}
+
+	for (i = 0; i < bucket->len; i++) {
+		xmms_xform_plugin_t *plugin = g_ptr_array_index (bucket, i);
+
+		if (g_list_find (skip, plugin) ||
+		    !xmms_xform_plugin_supports (plugin, st, &priority)) {
+			continue;
+		}
+
+		if (priority > *best_priority ||
+		    (priority == *best_priority && *best && plugin->seq > (*best)->seq)) {
+			*best = plugin;
+			*best_priority = priority;
+		}
+	}
+}
+
+static xmms_xform_plugin_t *
+find_match (const xmms_stream_type_t *st, const gchar *mime, GList *skip)
+{
+	xmms_xform_plugin_t *best = NULL;
+	gint best_priority = -1;
+
+	g_rw_lock_reader_lock (&index_lock);
+	if (mime) {
+		find_match_in (g_hash_table_lookup (index_exact, mime), st, skip,
+		               &best, &best_priority);
+	}
+	find_match_in (index_wildcard, st, skip, &best, &best_priority);
+	g_rw_lock_reader_unlock (&index_lock);
+
+	if (best) {
+		XMMS_DBG ("Plugin '%s' matched (priority %d)",
+		          xmms_plugin_shortname_get ((xmms_plugin_t *) best),
+		          best_priority);
+	}
+
+	return best;
+}
+
+/**
+ * Find the plugin with the highest priority taking the stream type,
+ * the one loaded last if several have the same priority. Only plugins
+ * taking the mimetype of st, or a pattern, are looked at, and results
+ * for types without an url are remembered.
+ *
+ * @returns the plugin, not referenced, or NULL if none matches.
+ */
+xmms_xform_plugin_t *
+xmms_xform_plugin_find_match (const xmms_stream_type_t *st)
+{
+	xmms_xform_plugin_t *best;
+	const gchar *mime;
+	gpointer cached;
+	gchar *key = NULL;
+
+	g_return_val_if_fail (st, NULL);
+
+	/* before looking at the index, which it adds to */
+	mime = xmms_stream_type_get_str (st, XMMS_STREAM_TYPE_MIMETYPE);
+	if (mime) {
+		xmms_plugin_load_deferred (mime, NULL);
+	}
+
+	if (!index_exact) {
+		return NULL;
+	}
+
+	/* urls are different for every entry, not worth remembering */
+	if (!xmms_stream_type_get_str (st, XMMS_STREAM_TYPE_URL)) {
+		key = xmms_stream_type_key (st);
+
+		G_LOCK (match_cache);
+		if (match_cache &&
+		    g_hash_table_lookup_extended (match_cache, key, NULL, &cached)) {
+			G_UNLOCK (match_cache);
+			g_free (key);
+			return cached;
+		}
+		G_UNLOCK (match_cache);
+	}
+
+	best = find_match (st, mime, NULL);
+
+	if (key) {
+		G_LOCK (match_cache);
+		if (!match_cache) {
+			match_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+			                                     g_free, NULL);
+		}
+		if (g_hash_table_size (match_cache) >= XMMS_XFORM_MATCH_CACHE_SIZE) {
+			g_hash_table_remove_all (match_cache);
+		}
+		g_hash_table_insert (match_cache, key, best);
+		G_UNLOCK (match_cache);
+	}
+
+	return best;
+}
+
+/**
+ * Find the best plugin taking the stream type, like
+ * #xmms_xform_plugin_find_match, other than the ones that were tried
+ * already.
+ *
+ * @param tried plugins to leave out
+ * @returns the plugin, not referenced, or NULL if no other matches.
+ */
+xmms_xform_plugin_t *
+xmms_xform_plugin_find_next_match (const xmms_stream_type_t *st, GList *tried)
+{
+	g_return_val_if_fail (st, NULL);
+
+	if (!index_exact) {
+		return NULL;
+	}
+
+	return find_match (st, xmms_stream_type_get_str (st, XMMS_STREAM_TYPE_MIMETYPE),
+	                   tried);
+}
+
 void
 xmms_xform_plugin_metadata_basic_mapper_init (xmms_xform_plugin_t *xform_plugin,
                                                const xmms_xform_metadata_basic_mapping_t *mappings,
@@ -243,6 +509,12 @@ xmms_xform_plugin_can_destroy (const xmms_xform_plugin_t *plugin)
 	return !!plugin->methods.destroy;
 }
 
+gboolean
+xmms_xform_plugin_can_process (const xmms_xform_plugin_t *plugin)
+{
+	return !!plugin->methods.process;
+}
+
 gboolean
 xmms_xform_plugin_init (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform)
 {
@@ -258,6 +530,13 @@ xmms_xform_plugin_read (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform,
 	return plugin->methods.read (xform, buf, length, error);
 }
 
+void
+xmms_xform_plugin_process (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform,
+                           xmms_sample_t *buf, gint length)
+{
+	plugin->methods.process (xform, buf, length);
+}
+
 gint64
 xmms_xform_plugin_seek (const xmms_xform_plugin_t *plugin, xmms_xform_t *xform,
                         gint64 offset, xmms_xform_seek_mode_t whence,
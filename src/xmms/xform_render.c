@@ -0,0 +1,237 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * @file
+ * Rendering the output of synthesizing xform plugins ahead of time.
+ */
+
+#include <xmms/xmms_xformplugin.h>
+#include <xmms/xmms_log.h>
+#include <xmmspriv/xmms_thread_role.h>
+
+/* The worker renders a chunk at a time into the fifo while it holds
+ * less than the lead, without holding the lock, so the reader only
+ * waits when the worker has fallen behind. Stopping waits for the
+ * chunk being rendered and drops it along with the rest, so nothing
+ * rendered before a seek is read after it. With a prefill, reads wait
+ * until that much is rendered when starting and whenever the fifo ran
+ * empty, so a source delivering in bursts gets a jitter buffer.
+ */
+struct xmms_xform_render_St {
+	xmms_xform_t *xform;
+	xmms_xform_render_func_t func;
+	gint chunk_size;
+	gsize lead;
+	gsize prefill;
+
+	GThread *thread;
+	GMutex mutex;
+	GCond cond;
+
+	xmms_xform_fifo_t *fifo;
+	guint8 *chunk;
+
+	gboolean rendering;
+	gboolean filling;
+	gboolean stopped;
+	gboolean quit;
+	gboolean eos;
+	xmms_error_t error;
+};
+
+static gpointer
+xmms_xform_render_thread (gpointer udata)
+{
+	xmms_xform_render_t *render = udata;
+	xmms_error_t err;
+	gint ret;
+
+	xmms_thread_role_enter (XMMS_THREAD_ROLE_AUDIO);
+
+	g_mutex_lock (&render->mutex);
+
+	while (!render->quit) {
+		if (render->stopped || render->eos ||
+		    xmms_xform_fifo_length (render->fifo) >= render->lead) {
+			g_cond_wait (&render->cond, &render->mutex);
+			continue;
+		}
+
+		render->rendering = TRUE;
+		g_mutex_unlock (&render->mutex);
+
+		xmms_error_reset (&err);
+		ret = render->func (render->xform, render->chunk, render->chunk_size, &err);
+
+		g_mutex_lock (&render->mutex);
+		render->rendering = FALSE;
+
+		if (!render->stopped) {
+			if (ret > 0) {
+				xmms_xform_fifo_write (render->fifo, render->chunk, ret);
+			} else {
+				render->eos = TRUE;
+				render->error = err;
+			}
+		}
+
+		g_cond_broadcast (&render->cond);
+	}
+
+	g_mutex_unlock (&render->mutex);
+
+	return NULL;
+}
+
+xmms_xform_render_t *
+xmms_xform_render_new (xmms_xform_t *xform, xmms_xform_render_func_t func,
+                       gint chunk_size, gsize lead)
+{
+	xmms_xform_render_t *render;
+
+	g_return_val_if_fail (xform, NULL);
+	g_return_val_if_fail (func, NULL);
+	g_return_val_if_fail (chunk_size > 0, NULL);
+
+	render = g_new0 (xmms_xform_render_t, 1);
+	render->xform = xform;
+	render->func = func;
+	render->chunk_size = chunk_size;
+
+	/* nobody listens to what the mediainfo reader decodes */
+	if (!xmms_xform_is_probe (xform)) {
+		render->lead = lead;
+	}
+
+	g_mutex_init (&render->mutex);
+	g_cond_init (&render->cond);
+	xmms_error_reset (&render->error);
+
+	return render;
+}
+
+void
+xmms_xform_render_prefill (xmms_xform_render_t *render, gsize len)
+{
+	g_return_if_fail (render);
+
+	g_mutex_lock (&render->mutex);
+	render->prefill = MIN (len, render->lead);
+	render->filling = render->prefill > 0;
+	g_mutex_unlock (&render->mutex);
+}
+
+void
+xmms_xform_render_free (xmms_xform_render_t *render)
+{
+	g_return_if_fail (render);
+
+	if (render->thread) {
+		g_mutex_lock (&render->mutex);
+		render->quit = TRUE;
+		g_cond_broadcast (&render->cond);
+		g_mutex_unlock (&render->mutex);
+
+		g_thread_join (render->thread);
+
+		xmms_xform_fifo_free (render->fifo);
+		g_free (render->chunk);
+	}
+
+	g_cond_clear (&render->cond);
+	g_mutex_clear (&render->mutex);
+	g_free (render);
+}
+
+gint
+xmms_xform_render_read (xmms_xform_render_t *render, gpointer buf, gint len,
+                        xmms_error_t *err)
+{
+	gint ret;
+
+	g_return_val_if_fail (render, -1);
+	g_return_val_if_fail (!render->stopped, -1);
+
+	if (!render->lead) {
+		return render->func (render->xform, buf, len, err);
+	}
+
+	g_mutex_lock (&render->mutex);
+
+	/* started on the first read, the chain may only be set up */
+	if (!render->thread) {
+		render->fifo = xmms_xform_fifo_new ();
+		render->chunk = g_malloc (render->chunk_size);
+		render->thread = g_thread_new ("x2 render", xmms_xform_render_thread, render);
+	}
+
+	if (render->prefill && !xmms_xform_fifo_length (render->fifo)) {
+		render->filling = TRUE;
+	}
+
+	while (xmms_xform_fifo_length (render->fifo) <
+	       (render->filling ? render->prefill : 1) && !render->eos) {
+		g_cond_wait (&render->cond, &render->mutex);
+	}
+	render->filling = FALSE;
+
+	ret = xmms_xform_fifo_read (render->fifo, buf, len);
+	if (!ret && xmms_error_iserror (&render->error)) {
+		*err = render->error;
+		ret = -1;
+	}
+
+	if (xmms_xform_fifo_length (render->fifo) < render->lead) {
+		g_cond_broadcast (&render->cond);
+	}
+
+	g_mutex_unlock (&render->mutex);
+
+	return ret;
+}
+
+void
+xmms_xform_render_stop (xmms_xform_render_t *render)
+{
+	g_return_if_fail (render);
+
+	g_mutex_lock (&render->mutex);
+
+	render->stopped = TRUE;
+	while (render->rendering) {
+		g_cond_wait (&render->cond, &render->mutex);
+	}
+
+	if (render->fifo) {
+		xmms_xform_fifo_clear (render->fifo);
+	}
+	render->eos = FALSE;
+	xmms_error_reset (&render->error);
+
+	g_mutex_unlock (&render->mutex);
+}
+
+void
+xmms_xform_render_start (xmms_xform_render_t *render)
+{
+	g_return_if_fail (render);
+
+	g_mutex_lock (&render->mutex);
+	render->stopped = FALSE;
+	g_cond_broadcast (&render->cond);
+	g_mutex_unlock (&render->mutex);
+}
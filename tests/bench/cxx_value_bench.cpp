@@ -0,0 +1,174 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * Benchmarks of walking a large list of medialib infos through the
+ * C++ value wrappers, copying every field into a std::string against
+ * reading it in place.
+ */
+
+#include <xmmsclient/xmmsclient++/list.h>
+#include <xmmsclient/xmmsclient++/dict.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace
+{
+
+	typedef std::chrono::steady_clock bench_clock;
+
+	xmmsv_t* payload_infos( int count )
+	{
+		xmmsv_t* list = xmmsv_new_list();
+		char value[64];
+
+		for( int i = 0; i < count; ++i ) {
+			xmmsv_t* dict = xmmsv_new_dict();
+
+			xmmsv_dict_set_int( dict, "id", i + 1 );
+			std::snprintf( value, sizeof( value ), "Artist number %d", i % 100 );
+			xmmsv_dict_set_string( dict, "artist", value );
+			std::snprintf( value, sizeof( value ), "The title of track %d", i );
+			xmmsv_dict_set_string( dict, "title", value );
+			std::snprintf( value, sizeof( value ), "file:///music/%d.flac", i );
+			xmmsv_dict_set_string( dict, "url", value );
+
+			xmmsv_list_append( list, dict );
+			xmmsv_unref( dict );
+		}
+
+		return list;
+	}
+
+	xmmsv_t* payload_strings( int count )
+	{
+		xmmsv_t* list = xmmsv_new_list();
+		char value[64];
+
+		for( int i = 0; i < count; ++i ) {
+			std::snprintf( value, sizeof( value ), "file:///music/%d.flac", i );
+			xmmsv_list_append_string( list, value );
+		}
+
+		return list;
+	}
+
+	void report( const char* bench, int n,
+	             bench_clock::duration elapsed, size_t check )
+	{
+		double us = std::chrono::duration< double, std::micro >( elapsed ).count();
+
+		std::printf( "%-24s %10.1f entries/ms %10.3fus total %zu\n",
+		             bench, us ? n * 1000.0 / us : 0.0, us, check );
+	}
+
+	size_t bench_dict_copy( xmmsv_t* value )
+	{
+		Xmms::List< Xmms::Dict > list( value );
+		size_t len = 0;
+
+		for( Xmms::List< Xmms::Dict >::const_iterator it = list.begin();
+		     it != list.end(); ++it ) {
+			len += (*it).get< int32_t >( "id" );
+			len += (*it).get< std::string >( "artist" ).size();
+			len += (*it).get< std::string >( "title" ).size();
+			len += (*it).get< std::string >( "url" ).size();
+		}
+
+		return len;
+	}
+
+	size_t bench_dict_view( xmmsv_t* value )
+	{
+		Xmms::List< Xmms::Dict > list( value );
+		size_t len = 0;
+
+		for( const Xmms::Dict& dict : list ) {
+			len += dict.getInt( "id" );
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+			len += dict.getStringView( "artist" ).size();
+			len += dict.getStringView( "title" ).size();
+			len += dict.getStringView( "url" ).size();
+#else
+			len += std::strlen( dict.getCString( "artist" ) );
+			len += std::strlen( dict.getCString( "title" ) );
+			len += std::strlen( dict.getCString( "url" ) );
+#endif
+		}
+
+		return len;
+	}
+
+	size_t bench_string_copy( xmmsv_t* value )
+	{
+		Xmms::List< std::string > list( value );
+		size_t len = 0;
+
+		for( Xmms::List< std::string >::const_iterator it = list.begin();
+		     it != list.end(); ++it ) {
+			std::string s = *it;
+			len += s.size();
+		}
+
+		return len;
+	}
+
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+	size_t bench_string_view( xmmsv_t* value )
+	{
+		Xmms::List< std::string_view > list( value );
+		size_t len = 0;
+
+		for( std::string_view s : list ) {
+			len += s.size();
+		}
+
+		return len;
+	}
+#endif
+
+	void run( const char* name, size_t (*bench)( xmmsv_t* ),
+	          xmmsv_t* value, int count )
+	{
+		bench_clock::time_point t0 = bench_clock::now();
+		size_t check = bench( value );
+		report( name, count, bench_clock::now() - t0, check );
+	}
+
+}
+
+int main( int argc, char** argv )
+{
+	int count = argc > 1 ? std::atoi( argv[1] ) : 100000;
+
+	xmmsv_t* infos = payload_infos( count );
+	run( "dict get<std::string>", bench_dict_copy, infos, count );
+	run( "dict view", bench_dict_view, infos, count );
+	xmmsv_unref( infos );
+
+	xmmsv_t* strings = payload_strings( count );
+	run( "list std::string", bench_string_copy, strings, count );
+#ifdef XMMSCLIENTPP_HAVE_STRING_VIEW
+	run( "list std::string_view", bench_string_view, strings, count );
+#endif
+	xmmsv_unref( strings );
+
+	return 0;
+}
@@ -0,0 +1,437 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * Benchmarks of the value serializer, the ipc message framing and a
+ * round trip over the unix and tcp transports, for a few payloads
+ * that look like what clients and the server send each other.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <xmmsc/xmmsv.h>
+#include <xmmsc/xmmsv_coll.h>
+#include <xmmsc/xmmsc_ipc_msg.h>
+#include <xmmsc/xmmsc_ipc_transport.h>
+
+/* an arbitrary object and command, nobody interprets them */
+#define BENCH_OBJECT 1
+#define BENCH_CMD 32
+
+#define BENCH_TCP_URL "tcp://127.0.0.1:19667"
+
+typedef struct {
+	const gchar *name;
+	xmmsv_t *value;
+} bench_payload_t;
+
+typedef struct {
+	const gchar *format;
+	gint iterations;
+	gboolean transports;
+} bench_args_t;
+
+static bench_args_t args = { "pretty", 10000, TRUE };
+
+static xmmsv_t *
+payload_idlist (gint count)
+{
+	xmmsv_t *coll;
+	gint i;
+
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	for (i = 0; i < count; i++) {
+		xmmsv_coll_idlist_append (coll, i + 1);
+	}
+
+	return coll;
+}
+
+/* what medialib.get_info returns: key, source, value */
+static xmmsv_t *
+payload_info (void)
+{
+	static const gchar *keys[] = {
+		"artist", "album", "title", "genre", "url", "mime", "date",
+		"comment", "publisher", "album_id", "artist_id", "track_id"
+	};
+	xmmsv_t *info, *sources;
+	gchar value[64];
+	guint i;
+
+	info = xmmsv_new_dict ();
+
+	for (i = 0; i < G_N_ELEMENTS (keys); i++) {
+		g_snprintf (value, sizeof (value), "Some %s of a track", keys[i]);
+		sources = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("plugin/id3v2", value),
+		                            XMMSV_DICT_END);
+		xmmsv_dict_set (info, keys[i], sources);
+		xmmsv_unref (sources);
+	}
+
+	sources = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("plugin/mad", 254123),
+	                            XMMSV_DICT_END);
+	xmmsv_dict_set (info, "duration", sources);
+	xmmsv_unref (sources);
+
+	sources = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("server", 1),
+	                            XMMSV_DICT_END);
+	xmmsv_dict_set (info, "status", sources);
+	xmmsv_unref (sources);
+
+	return info;
+}
+
+/* a chain of unions and filters, as nested as a smart playlist gets */
+static xmmsv_t *
+payload_collection (gint depth)
+{
+	xmmsv_t *coll, *op;
+	gchar value[32];
+
+	if (depth == 0) {
+		coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+		return coll;
+	}
+
+	coll = xmmsv_new_coll (depth % 2 ? XMMS_COLLECTION_TYPE_UNION
+	                                 : XMMS_COLLECTION_TYPE_MATCH);
+	if (!(depth % 2)) {
+		g_snprintf (value, sizeof (value), "*artist %d*", depth);
+		xmmsv_coll_attribute_set_string (coll, "field", "artist");
+		xmmsv_coll_attribute_set_string (coll, "value", value);
+	}
+
+	op = payload_collection (depth - 1);
+	xmmsv_coll_add_operand (coll, op);
+	xmmsv_unref (op);
+
+	if (depth % 2) {
+		op = payload_idlist (16);
+		xmmsv_coll_add_operand (coll, op);
+		xmmsv_unref (op);
+	}
+
+	return coll;
+}
+
+static void
+report (const gchar *bench, const gchar *payload, gint n, gint64 elapsed,
+        gint bytes)
+{
+	gdouble rate, mean;
+
+	rate = elapsed ? n * (gdouble) G_USEC_PER_SEC / elapsed : 0.0;
+	mean = n ? elapsed / (gdouble) n : 0.0;
+
+	if (strcmp (args.format, "csv") == 0) {
+		g_print ("\"%s\",\"%s\",%d,%.1f,%.3f,%d\n",
+		         bench, payload, n, rate, mean, bytes);
+	} else {
+		g_print ("%-12s %-16s %10.1f ops/s %10.3fus %8d bytes\n",
+		         bench, payload, rate, mean, bytes);
+	}
+}
+
+static void
+bench_serialize (bench_payload_t *p)
+{
+	const unsigned char *data;
+	unsigned int len = 0;
+	xmmsv_t *bin, *value;
+	gint64 t0;
+	gint i;
+
+	t0 = g_get_monotonic_time ();
+	for (i = 0; i < args.iterations; i++) {
+		bin = xmmsv_serialize (p->value);
+		if (!i) {
+			xmmsv_get_bin (bin, &data, &len);
+		}
+		xmmsv_unref (bin);
+	}
+	report ("serialize", p->name, args.iterations, g_get_monotonic_time () - t0, len);
+
+	bin = xmmsv_serialize (p->value);
+
+	t0 = g_get_monotonic_time ();
+	for (i = 0; i < args.iterations; i++) {
+		value = xmmsv_deserialize (bin);
+		xmmsv_unref (value);
+	}
+	report ("deserialize", p->name, args.iterations, g_get_monotonic_time () - t0, len);
+
+	xmmsv_unref (bin);
+}
+
+static xmms_ipc_msg_t *
+msg_build (xmmsv_t *value)
+{
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_new (BENCH_OBJECT, BENCH_CMD);
+	xmms_ipc_msg_put_value (msg, value);
+
+	return msg;
+}
+
+static void
+bench_framing (bench_payload_t *p)
+{
+	unsigned char head[XMMS_IPC_MSG_HEAD_LEN];
+	xmms_ipc_transport_vec_t vec[2];
+	xmms_ipc_msg_t *msg, *copy;
+	xmmsv_t *value;
+	gint64 t0;
+	gint i, size;
+
+	t0 = g_get_monotonic_time ();
+	for (i = 0; i < args.iterations; i++) {
+		msg = msg_build (p->value);
+		xmms_ipc_msg_destroy (msg);
+	}
+
+	msg = msg_build (p->value);
+	size = xmms_ipc_msg_get_size (msg);
+	report ("put_value", p->name, args.iterations, g_get_monotonic_time () - t0, size);
+
+	/* the whole message is one buffer without a cookie to replace */
+	xmms_ipc_msg_get_unwritten (msg, false, 0, 0, head, vec);
+
+	t0 = g_get_monotonic_time ();
+	for (i = 0; i < args.iterations; i++) {
+		copy = xmms_ipc_msg_new_from_data ((unsigned char *) vec[0].buf, vec[0].len);
+		if (xmms_ipc_msg_get_value (copy, &value)) {
+			xmmsv_unref (value);
+		}
+		xmms_ipc_msg_destroy (copy);
+	}
+	report ("get_value", p->name, args.iterations, g_get_monotonic_time () - t0, size);
+
+	xmms_ipc_msg_destroy (msg);
+}
+
+static gboolean
+transport_wait (xmms_ipc_transport_t *t, gshort events)
+{
+	struct pollfd fd;
+
+	fd.fd = xmms_ipc_transport_fd_get (t);
+	fd.events = events;
+
+	return poll (&fd, 1, 5000) > 0;
+}
+
+/* the transports don't block, so wait for them between tries */
+static gboolean
+msg_write (xmms_ipc_msg_t *msg, xmms_ipc_transport_t *t)
+{
+	bool disconnected = false;
+	uint32_t xfered = 0;
+
+	while (!xmms_ipc_msg_write_transport_cookie (msg, 0, &xfered, t,
+	                                             &disconnected)) {
+		if (disconnected || !transport_wait (t, POLLOUT)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static xmms_ipc_msg_t *
+msg_read (xmms_ipc_transport_t *t)
+{
+	bool disconnected = false;
+	xmms_ipc_msg_t *msg;
+
+	msg = xmms_ipc_msg_alloc ();
+
+	while (!xmms_ipc_msg_read_transport (msg, t, &disconnected)) {
+		if (disconnected || !transport_wait (t, POLLIN)) {
+			xmms_ipc_msg_destroy (msg);
+			return NULL;
+		}
+	}
+
+	return msg;
+}
+
+/* sends back whatever it gets, like a server replying with the
+   argument it was given */
+static gpointer
+echo_thread (gpointer udata)
+{
+	xmms_ipc_transport_t *server = udata, *client;
+	xmms_ipc_msg_t *msg;
+
+	if (!transport_wait (server, POLLIN)) {
+		return NULL;
+	}
+
+	client = xmms_ipc_server_accept (server);
+	if (!client) {
+		return NULL;
+	}
+
+	while ((msg = msg_read (client))) {
+		gboolean ok = msg_write (msg, client);
+
+		xmms_ipc_msg_destroy (msg);
+		if (!ok) {
+			break;
+		}
+	}
+
+	xmms_ipc_transport_destroy (client);
+
+	return NULL;
+}
+
+static void
+bench_roundtrip (const gchar *name, const gchar *url, bench_payload_t *payloads)
+{
+	xmms_ipc_transport_t *server, *client;
+	GThread *echo;
+	gint i, j;
+
+	server = xmms_ipc_server_init (url);
+	if (!server) {
+		g_printerr ("Couldn't listen on %s, skipping\n", url);
+		return;
+	}
+
+	echo = g_thread_new ("echo", echo_thread, server);
+
+	client = xmms_ipc_client_init (url);
+	if (!client) {
+		g_printerr ("Couldn't connect to %s, skipping\n", url);
+		g_thread_join (echo);
+		xmms_ipc_transport_destroy (server);
+		return;
+	}
+
+	for (j = 0; payloads[j].name; j++) {
+		gint64 t0;
+		gint size = 0, n = args.iterations / 10 + 1;
+
+		t0 = g_get_monotonic_time ();
+		for (i = 0; i < n; i++) {
+			xmms_ipc_msg_t *msg, *reply;
+			xmmsv_t *value;
+
+			msg = msg_build (payloads[j].value);
+			size = xmms_ipc_msg_get_size (msg);
+
+			if (!msg_write (msg, client) || !(reply = msg_read (client))) {
+				g_printerr ("%s round trip failed\n", name);
+				xmms_ipc_msg_destroy (msg);
+				break;
+			}
+
+			if (xmms_ipc_msg_get_value (reply, &value)) {
+				xmmsv_unref (value);
+			}
+
+			xmms_ipc_msg_destroy (reply);
+			xmms_ipc_msg_destroy (msg);
+		}
+		report (name, payloads[j].name, i, g_get_monotonic_time () - t0, size);
+	}
+
+	/* the echo thread sees the disconnect and ends */
+	xmms_ipc_transport_destroy (client);
+	g_thread_join (echo);
+	xmms_ipc_transport_destroy (server);
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	bench_payload_t payloads[] = {
+		{ "idlist_100", payload_idlist (100) },
+		{ "idlist_10000", payload_idlist (10000) },
+		{ "info", payload_info () },
+		{ "collection_32", payload_collection (32) },
+		{ NULL, NULL }
+	};
+	gboolean no_transports = FALSE;
+	gchar *url;
+	gint i;
+
+	const GOptionEntry options[] = {
+		{
+			"format", 'f', 0,
+			G_OPTION_ARG_STRING, &args.format,
+			"'csv' or 'pretty' (default).", "<format>"
+		},
+		{
+			"iterations", 'i', 0,
+			G_OPTION_ARG_INT, &args.iterations,
+			"Run each benchmark <n> times, round trips a tenth of that (10000).", "<n>"
+		},
+		{
+			"no-transports", 'T', 0,
+			G_OPTION_ARG_NONE, &no_transports,
+			"Skip the round trips over sockets.", NULL
+		},
+		{
+			NULL
+		}
+	};
+
+	context = g_option_context_new ("- IPC Benchmarks");
+	g_option_context_add_main_entries (context, options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Option parsing failed: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	args.iterations = MAX (args.iterations, 1);
+	args.transports = !no_transports;
+
+	if (strcmp (args.format, "csv") == 0) {
+		g_print ("\"benchmark\",\"payload\",\"iterations\",\"ops_per_sec\",\"mean_us\",\"bytes\"\n");
+	}
+
+	for (i = 0; payloads[i].name; i++) {
+		bench_serialize (&payloads[i]);
+		bench_framing (&payloads[i]);
+	}
+
+	if (args.transports) {
+		url = g_strdup_printf ("unix:///tmp/xmms2-bench-%d", (gint) getpid ());
+		bench_roundtrip ("unix", url, payloads);
+		unlink (url + strlen ("unix://"));
+		g_free (url);
+
+		bench_roundtrip ("tcp", BENCH_TCP_URL, payloads);
+	}
+
+	for (i = 0; payloads[i].name; i++) {
+		xmmsv_unref (payloads[i].value);
+	}
+
+	return EXIT_SUCCESS;
+}
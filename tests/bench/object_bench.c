@@ -0,0 +1,183 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * Benchmarks of emitting server object signals, with a few handlers
+ * connected like the playtime and config signals have, from one
+ * thread and from several at once.
+ */
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmms/xmms_object.h>
+
+#define BENCH_SIGNAL XMMS_IPC_SIGNAL_PLAYBACK_PLAYTIME
+
+typedef struct {
+	const gchar *format;
+	gint iterations;
+	gint threads;
+} bench_args_t;
+
+static bench_args_t args = { "pretty", 1000000, 4 };
+
+typedef struct {
+	xmms_object_t *object;
+	xmmsv_t *value;
+} bench_emitter_t;
+
+static void
+handler (xmms_object_t *object, xmmsv_t *data, gpointer userdata)
+{
+	gint *calls = userdata;
+
+	g_atomic_int_inc (calls);
+}
+
+static void
+report (const gchar *bench, gint handlers, gint n, gint64 elapsed)
+{
+	gdouble rate, mean;
+
+	rate = elapsed ? n * (gdouble) G_USEC_PER_SEC / elapsed : 0.0;
+	mean = n ? elapsed * 1000.0 / n : 0.0;
+
+	if (strcmp (args.format, "csv") == 0) {
+		g_print ("\"%s\",%d,%d,%.1f,%.1f\n", bench, handlers, n, rate, mean);
+	} else {
+		g_print ("%-12s %4d handlers %12.1f emits/s %10.1fns\n",
+		         bench, handlers, rate, mean);
+	}
+}
+
+static void
+emit_loop (bench_emitter_t *emitter, gint n)
+{
+	gint i;
+
+	for (i = 0; i < n; i++) {
+		/* emit takes the reference */
+		xmmsv_ref (emitter->value);
+		xmms_object_emit (emitter->object, BENCH_SIGNAL, emitter->value);
+	}
+}
+
+static gpointer
+emit_thread (gpointer udata)
+{
+	emit_loop (udata, args.iterations);
+
+	return NULL;
+}
+
+static void
+bench_emit (gint count)
+{
+	bench_emitter_t emitter;
+	GThread **threads;
+	gint64 t0;
+	gint i, calls = 0;
+
+	emitter.object = xmms_object_new (xmms_object_t, NULL);
+	emitter.value = xmmsv_new_int (4711);
+
+	for (i = 0; i < count; i++) {
+		xmms_object_connect (emitter.object, BENCH_SIGNAL, handler, &calls);
+	}
+
+	t0 = g_get_monotonic_time ();
+	emit_loop (&emitter, args.iterations);
+	report ("emit", count, args.iterations, g_get_monotonic_time () - t0);
+
+	threads = g_new0 (GThread *, args.threads);
+
+	t0 = g_get_monotonic_time ();
+	for (i = 0; i < args.threads; i++) {
+		threads[i] = g_thread_new ("bench emit", emit_thread, &emitter);
+	}
+	for (i = 0; i < args.threads; i++) {
+		g_thread_join (threads[i]);
+	}
+	report ("emit_threads", count, args.iterations * args.threads,
+	        g_get_monotonic_time () - t0);
+
+	g_free (threads);
+
+	if (calls != count * args.iterations * (args.threads + 1)) {
+		g_printerr ("lost handler calls: %d\n", calls);
+	}
+
+	for (i = 0; i < count; i++) {
+		xmms_object_disconnect (emitter.object, BENCH_SIGNAL, handler, &calls);
+	}
+
+	xmmsv_unref (emitter.value);
+	xmms_object_unref (emitter.object);
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	gint handlers[] = { 0, 1, 4, 16 };
+	guint i;
+
+	const GOptionEntry options[] = {
+		{
+			"format", 'f', 0,
+			G_OPTION_ARG_STRING, &args.format,
+			"'csv' or 'pretty' (default).", "<format>"
+		},
+		{
+			"iterations", 'i', 0,
+			G_OPTION_ARG_INT, &args.iterations,
+			"Emit <n> times per thread (1000000).", "<n>"
+		},
+		{
+			"threads", 't', 0,
+			G_OPTION_ARG_INT, &args.threads,
+			"Number of threads emitting at once (4).", "<n>"
+		},
+		{
+			NULL
+		}
+	};
+
+	context = g_option_context_new ("- Object Signal Benchmarks");
+	g_option_context_add_main_entries (context, options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Option parsing failed: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	args.iterations = MAX (args.iterations, 1);
+	args.threads = MAX (args.threads, 1);
+
+	if (strcmp (args.format, "csv") == 0) {
+		g_print ("\"benchmark\",\"handlers\",\"emits\",\"emits_per_sec\",\"mean_ns\"\n");
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (handlers); i++) {
+		bench_emit (handlers[i]);
+	}
+
+	return EXIT_SUCCESS;
+}
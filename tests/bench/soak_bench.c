@@ -0,0 +1,603 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+/**
+ * Soak test of a running server: many clients subscribe to the usual
+ * broadcasts and send a mix of collection queries, medialib lookups
+ * and playlist listings at a steady rate, while the latency of every
+ * request is recorded. The server is expected to play through the
+ * null output meanwhile (xmms2d -o null, or --play here), and the
+ * output underruns it counts are reported along with the latencies.
+ *
+ * All clients share one main loop, so with enough of them the
+ * latencies include time spent waiting on this process too.
+ */
+
+#include <glib.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xmmsclient/xmmsclient.h>
+#include <xmmsclient/xmmsclient-glib.h>
+
+/* quarter octaves of microseconds, up to over an hour */
+#define SOAK_BUCKETS 128
+/* requests a client has waiting before it skips its turn */
+#define SOAK_MAX_INFLIGHT 4
+
+typedef enum {
+	SOAK_OP_QUERY,
+	SOAK_OP_MEDIALIB,
+	SOAK_OP_PLAYLIST,
+	SOAK_NUM_OPS
+} soak_op_t;
+
+typedef struct {
+	const gchar *name;
+	gint weight;
+	guint64 count;
+	guint64 errors;
+	guint64 skipped;
+	gint64 max;
+	guint64 buckets[SOAK_BUCKETS];
+} soak_stat_t;
+
+typedef struct {
+	xmmsc_connection_t *conn;
+	gint inflight;
+	gboolean connected;
+} soak_client_t;
+
+typedef struct {
+	soak_client_t *client;
+	soak_op_t op;
+	gint64 sent;
+} soak_request_t;
+
+typedef struct {
+	const gchar *path;
+	const gchar *format;
+	const gchar *mix;
+	gint clients;
+	gdouble rate;
+	gint duration;
+	gint interval;
+	gboolean play;
+	gdouble max_p99;
+	gint max_underruns;
+} soak_args_t;
+
+static soak_args_t args = { NULL, "pretty", "4:4:2", 100, 1.0, 60, 10,
+                            FALSE, 0.0, -1 };
+
+static soak_stat_t stats[SOAK_NUM_OPS] = {
+	{ "query", 4 },
+	{ "medialib", 4 },
+	{ "playlist", 2 }
+};
+
+static GMainLoop *mainloop;
+static xmmsc_connection_t *monitor;
+static GArray *media_ids;
+static guint64 broadcasts;
+static gint disconnects;
+static gint64 underruns_start = -1;
+static gint64 underruns_now = -1;
+static gint64 started;
+static gboolean failed;
+
+static gint
+soak_bucket (gint64 us)
+{
+	gint b;
+
+	b = (gint) (4.0 * log2 ((gdouble) us + 1.0));
+	return CLAMP (b, 0, SOAK_BUCKETS - 1);
+}
+
+/* the upper bound of a bucket, which is what percentiles report */
+static gint64
+soak_bucket_bound (gint b)
+{
+	return (gint64) exp2 ((b + 1) / 4.0);
+}
+
+static gint64
+soak_percentile (soak_stat_t *stat, gdouble p)
+{
+	guint64 seen = 0, want;
+	gint b;
+
+	if (!stat->count) {
+		return 0;
+	}
+
+	want = (guint64) ceil (stat->count * p);
+	for (b = 0; b < SOAK_BUCKETS; b++) {
+		seen += stat->buckets[b];
+		if (seen >= want) {
+			return MIN (soak_bucket_bound (b), stat->max);
+		}
+	}
+
+	return stat->max;
+}
+
+static gint
+soak_request_done (xmmsv_t *val, void *udata)
+{
+	soak_request_t *req = udata;
+	soak_stat_t *stat = &stats[req->op];
+	gint64 us;
+
+	us = g_get_monotonic_time () - req->sent;
+
+	req->client->inflight--;
+
+	if (xmmsv_is_error (val)) {
+		stat->errors++;
+		return FALSE;
+	}
+
+	stat->count++;
+	stat->max = MAX (stat->max, us);
+	stat->buckets[soak_bucket (us)]++;
+
+	return FALSE;
+}
+
+static gint
+soak_broadcast (xmmsv_t *val, void *udata)
+{
+	broadcasts++;
+	return TRUE;
+}
+
+static soak_op_t
+soak_pick_op (void)
+{
+	gint total = 0, r, i;
+
+	for (i = 0; i < SOAK_NUM_OPS; i++) {
+		total += stats[i].weight;
+	}
+
+	r = g_random_int_range (0, total);
+	for (i = 0; i < SOAK_NUM_OPS - 1; i++) {
+		if (r < stats[i].weight) {
+			break;
+		}
+		r -= stats[i].weight;
+	}
+
+	return i;
+}
+
+static xmmsc_result_t *
+soak_send (soak_client_t *client, soak_op_t op)
+{
+	xmmsv_t *coll, *order;
+	xmmsc_result_t *res;
+	gint id;
+
+	if (op == SOAK_OP_MEDIALIB && !media_ids->len) {
+		op = SOAK_OP_QUERY;
+	}
+
+	switch (op) {
+		case SOAK_OP_MEDIALIB:
+			id = g_array_index (media_ids, gint,
+			                    g_random_int_range (0, media_ids->len));
+			return xmmsc_medialib_get_info (client->conn, id);
+		case SOAK_OP_PLAYLIST:
+			return xmmsc_playlist_list_entries (client->conn, NULL);
+		default:
+			break;
+	}
+
+	/* a page of the library, the way a browsing client asks */
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	order = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("artist"),
+	                          XMMSV_LIST_ENTRY_STR ("album"),
+	                          XMMSV_LIST_ENTRY_STR ("tracknr"),
+	                          XMMSV_LIST_END);
+	res = xmmsc_coll_query_ids (client->conn, coll, order,
+	                            g_random_int_range (0, MAX (media_ids->len, 1)),
+	                            100);
+	xmmsv_unref (order);
+	xmmsv_unref (coll);
+
+	return res;
+}
+
+static gboolean
+soak_client_tick (gpointer udata)
+{
+	soak_client_t *client = udata;
+	soak_request_t *req;
+	xmmsc_result_t *res;
+	soak_op_t op;
+
+	if (!client->connected) {
+		return FALSE;
+	}
+
+	op = soak_pick_op ();
+
+	if (client->inflight >= SOAK_MAX_INFLIGHT) {
+		stats[op].skipped++;
+		return TRUE;
+	}
+
+	req = g_new0 (soak_request_t, 1);
+	req->client = client;
+	req->op = op;
+	req->sent = g_get_monotonic_time ();
+
+	res = soak_send (client, op);
+	client->inflight++;
+	xmmsc_result_notifier_set_full (res, soak_request_done, req, g_free);
+	xmmsc_result_unref (res);
+
+	return TRUE;
+}
+
+static gboolean
+soak_client_start (gpointer udata)
+{
+	soak_client_t *client = udata;
+
+	g_timeout_add (MAX ((guint) (1000.0 / args.rate), 1),
+	               soak_client_tick, client);
+	soak_client_tick (client);
+
+	return FALSE;
+}
+
+static void
+soak_client_disconnected (void *udata)
+{
+	soak_client_t *client = udata;
+
+	client->connected = FALSE;
+	disconnects++;
+}
+
+static void
+soak_subscribe (xmmsc_result_t *res)
+{
+	xmmsc_result_notifier_set (res, soak_broadcast, NULL);
+	xmmsc_result_unref (res);
+}
+
+static soak_client_t *
+soak_client_new (gint n)
+{
+	soak_client_t *client;
+	gchar name[32];
+
+	client = g_new0 (soak_client_t, 1);
+
+	g_snprintf (name, sizeof (name), "soak-%d", n);
+	client->conn = xmmsc_init (name);
+	if (!xmmsc_connect (client->conn, args.path)) {
+		g_printerr ("Client %d couldn't connect: %s\n", n,
+		            xmmsc_get_last_error (client->conn));
+		xmmsc_unref (client->conn);
+		g_free (client);
+		return NULL;
+	}
+
+	client->connected = TRUE;
+	xmmsc_mainloop_gmain_init (client->conn);
+	xmmsc_disconnect_callback_set (client->conn, soak_client_disconnected,
+	                               client);
+
+	soak_subscribe (xmmsc_broadcast_playback_status (client->conn));
+	soak_subscribe (xmmsc_broadcast_playback_current_id (client->conn));
+	soak_subscribe (xmmsc_broadcast_playlist_changed (client->conn));
+	soak_subscribe (xmmsc_broadcast_medialib_entry_updated (client->conn));
+
+	/* spread the clients over the first interval */
+	g_timeout_add (g_random_int_range (0, MAX ((gint) (1000.0 / args.rate), 1)),
+	               soak_client_start, client);
+
+	return client;
+}
+
+static gint
+soak_underruns_got (xmmsv_t *val, void *udata)
+{
+	gint64 underruns;
+
+	if (!xmmsv_dict_entry_get_int64 (val, "output_underruns", &underruns)) {
+		return FALSE;
+	}
+
+	if (underruns_start < 0) {
+		underruns_start = underruns;
+	}
+	underruns_now = underruns;
+
+	return FALSE;
+}
+
+static void
+soak_poll_underruns (void)
+{
+	xmmsc_result_t *res;
+
+	res = xmmsc_main_stats (monitor);
+	xmmsc_result_notifier_set (res, soak_underruns_got, NULL);
+	xmmsc_result_unref (res);
+}
+
+static void
+soak_report (gboolean final)
+{
+	gdouble elapsed;
+	gint64 underruns;
+	gint i;
+
+	elapsed = (g_get_monotonic_time () - started) / (gdouble) G_USEC_PER_SEC;
+	underruns = underruns_start < 0 ? -1 : underruns_now - underruns_start;
+
+	for (i = 0; i < SOAK_NUM_OPS; i++) {
+		soak_stat_t *s = &stats[i];
+
+		if (strcmp (args.format, "csv") == 0) {
+			g_print ("%.0f,\"%s\",%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT
+			         ",%" G_GUINT64_FORMAT ",%.3f,%.3f,%.3f,%.3f,%" G_GINT64_FORMAT
+			         ",%" G_GUINT64_FORMAT "\n",
+			         elapsed, s->name, s->count, s->errors, s->skipped,
+			         soak_percentile (s, 0.5) / 1000.0,
+			         soak_percentile (s, 0.9) / 1000.0,
+			         soak_percentile (s, 0.99) / 1000.0,
+			         s->max / 1000.0, underruns, broadcasts);
+		} else {
+			g_print ("%6.0fs %-9s %8" G_GUINT64_FORMAT " ok %5" G_GUINT64_FORMAT
+			         " err %5" G_GUINT64_FORMAT " skip  p50 %8.3fms  p90 %8.3fms"
+			         "  p99 %8.3fms  max %8.3fms\n",
+			         elapsed, s->name, s->count, s->errors, s->skipped,
+			         soak_percentile (s, 0.5) / 1000.0,
+			         soak_percentile (s, 0.9) / 1000.0,
+			         soak_percentile (s, 0.99) / 1000.0,
+			         s->max / 1000.0);
+		}
+
+		if (final && args.max_p99 > 0.0 &&
+		    soak_percentile (s, 0.99) / 1000.0 > args.max_p99) {
+			g_printerr ("%s p99 over %.3fms\n", s->name, args.max_p99);
+			failed = TRUE;
+		}
+	}
+
+	if (strcmp (args.format, "csv") != 0) {
+		g_print ("%6.0fs underruns %" G_GINT64_FORMAT ", %" G_GUINT64_FORMAT
+		         " broadcasts, %d disconnects\n",
+		         elapsed, underruns, broadcasts, disconnects);
+	}
+
+	if (final && args.max_underruns >= 0 && underruns > args.max_underruns) {
+		g_printerr ("%" G_GINT64_FORMAT " underruns, over %d\n",
+		            underruns, args.max_underruns);
+		failed = TRUE;
+	}
+
+	if (final && disconnects) {
+		failed = TRUE;
+	}
+}
+
+static gboolean
+soak_report_tick (gpointer udata)
+{
+	soak_report (FALSE);
+	soak_poll_underruns ();
+	return TRUE;
+}
+
+static gboolean
+soak_finish (gpointer udata)
+{
+	g_main_loop_quit (mainloop);
+	return FALSE;
+}
+
+static gint
+soak_ids_got (xmmsv_t *val, void *udata)
+{
+	xmmsv_list_iter_t *it;
+	gint32 id;
+
+	xmmsv_get_list_iter (val, &it);
+	for (; xmmsv_list_iter_entry_int (it, &id); xmmsv_list_iter_next (it)) {
+		g_array_append_val (media_ids, id);
+	}
+
+	return FALSE;
+}
+
+static gboolean
+soak_parse_mix (const gchar *mix)
+{
+	gchar **weights;
+	gint i, total = 0;
+
+	weights = g_strsplit (mix, ":", SOAK_NUM_OPS);
+	for (i = 0; i < SOAK_NUM_OPS && weights[i]; i++) {
+		stats[i].weight = MAX (atoi (weights[i]), 0);
+		total += stats[i].weight;
+	}
+	g_strfreev (weights);
+
+	return i == SOAK_NUM_OPS && total > 0;
+}
+
+gint
+main (gint argc, gchar **argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	xmmsc_result_t *res;
+	xmmsv_t *universe;
+	GPtrArray *clients;
+	soak_client_t *client;
+	gint i;
+
+	const GOptionEntry options[] = {
+		{
+			"path", 'p', 0,
+			G_OPTION_ARG_STRING, &args.path,
+			"Connect to <url> instead of XMMS_PATH.", "<url>"
+		},
+		{
+			"clients", 'c', 0,
+			G_OPTION_ARG_INT, &args.clients,
+			"Run <n> clients (100).", "<n>"
+		},
+		{
+			"rate", 'r', 0,
+			G_OPTION_ARG_DOUBLE, &args.rate,
+			"Requests per second each client sends (1).", "<r>"
+		},
+		{
+			"mix", 'm', 0,
+			G_OPTION_ARG_STRING, &args.mix,
+			"Weights of query:medialib:playlist requests (4:4:2).", "<mix>"
+		},
+		{
+			"duration", 'd', 0,
+			G_OPTION_ARG_INT, &args.duration,
+			"Stop after <s> seconds, 0 to run until killed (60).", "<s>"
+		},
+		{
+			"interval", 'i', 0,
+			G_OPTION_ARG_INT, &args.interval,
+			"Report every <s> seconds (10).", "<s>"
+		},
+		{
+			"play", 0, 0,
+			G_OPTION_ARG_NONE, &args.play,
+			"Start playback before loading the server.", NULL
+		},
+		{
+			"max-p99", 0, 0,
+			G_OPTION_ARG_DOUBLE, &args.max_p99,
+			"Fail if any p99 latency is over <ms>.", "<ms>"
+		},
+		{
+			"max-underruns", 0, 0,
+			G_OPTION_ARG_INT, &args.max_underruns,
+			"Fail if the output underran more than <n> times.", "<n>"
+		},
+		{
+			"format", 'f', 0,
+			G_OPTION_ARG_STRING, &args.format,
+			"'csv' or 'pretty' (default).", "<format>"
+		},
+		{
+			NULL
+		}
+	};
+
+	context = g_option_context_new ("- Soak test a running server");
+	g_option_context_add_main_entries (context, options, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("Option parsing failed: %s\n", error->message);
+		g_error_free (error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free (context);
+
+	if (!soak_parse_mix (args.mix)) {
+		g_printerr ("Bad request mix '%s'\n", args.mix);
+		return EXIT_FAILURE;
+	}
+	args.clients = MAX (args.clients, 1);
+	args.rate = MAX (args.rate, 0.001);
+	args.interval = MAX (args.interval, 1);
+
+	mainloop = g_main_loop_new (NULL, FALSE);
+	media_ids = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	monitor = xmmsc_init ("soak-monitor");
+	if (!xmmsc_connect (monitor, args.path)) {
+		g_printerr ("Couldn't connect: %s\n", xmmsc_get_last_error (monitor));
+		return EXIT_FAILURE;
+	}
+
+	/* the ids the medialib requests pick from */
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	res = xmmsc_coll_query_ids (monitor, universe, NULL, 0, 0);
+	xmmsc_result_wait (res);
+	soak_ids_got (xmmsc_result_get_value (res), NULL);
+	xmmsc_result_unref (res);
+	xmmsv_unref (universe);
+
+	if (args.play) {
+		res = xmmsc_playback_start (monitor);
+		xmmsc_result_wait (res);
+		xmmsc_result_unref (res);
+	}
+
+	xmmsc_mainloop_gmain_init (monitor);
+	soak_poll_underruns ();
+
+	clients = g_ptr_array_new ();
+	for (i = 0; i < args.clients; i++) {
+		client = soak_client_new (i);
+		if (!client) {
+			return EXIT_FAILURE;
+		}
+		g_ptr_array_add (clients, client);
+	}
+
+	if (strcmp (args.format, "csv") == 0) {
+		g_print ("\"elapsed\",\"request\",\"count\",\"errors\",\"skipped\","
+		         "\"p50_ms\",\"p90_ms\",\"p99_ms\",\"max_ms\",\"underruns\","
+		         "\"broadcasts\"\n");
+	}
+
+	started = g_get_monotonic_time ();
+	g_timeout_add_seconds (args.interval, soak_report_tick, NULL);
+	if (args.duration > 0) {
+		g_timeout_add_seconds (args.duration, soak_finish, NULL);
+	}
+
+	g_main_loop_run (mainloop);
+
+	/* one last look at the underruns, synchronously */
+	res = xmmsc_main_stats (monitor);
+	xmmsc_result_wait (res);
+	soak_underruns_got (xmmsc_result_get_value (res), NULL);
+	xmmsc_result_unref (res);
+
+	soak_report (TRUE);
+
+	for (i = 0; i < (gint) clients->len; i++) {
+		client = g_ptr_array_index (clients, i);
+		xmmsc_unref (client->conn);
+		g_free (client);
+	}
+	g_ptr_array_free (clients, TRUE);
+	xmmsc_unref (monitor);
+	g_array_free (media_ids, TRUE);
+	g_main_loop_unref (mainloop);
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
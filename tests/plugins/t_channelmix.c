@@ -0,0 +1,165 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+
+#include "xcu.h"
+
+#include <stdlib.h>
+
+#include "channelmix_matrix.h"
+#include "mixing_common/mixing.c"
+
+#define H 0.70710678
+
+SETUP (channelmix) {
+	srand (0);
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static void
+assert_row (const gfloat *row, const gdouble *expected, gint count)
+{
+	gint i;
+
+	for (i = 0; i < count; i++) {
+		CU_ASSERT_DOUBLE_EQUAL (expected[i], row[i], 0.0001);
+	}
+}
+
+CASE (test_downmix_surround_to_stereo)
+{
+	const gdouble left[] = { 1, 0, H, 0, H, 0 };
+	const gdouble right[] = { 0, 1, H, 0, 0, H };
+	gfloat *matrix;
+	gdouble sum = 1 + 2 * H;
+	gint i;
+
+	matrix = xmms_channelmix_matrix_standard (6, 2, 0.0, FALSE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix, left, 6);
+	assert_row (matrix + 6, right, 6);
+	g_free (matrix);
+
+	/* scaled so a full scale front, center and surround can't clip */
+	matrix = xmms_channelmix_matrix_standard (6, 2, 0.0, TRUE);
+	for (i = 0; i < 6; i++) {
+		CU_ASSERT_DOUBLE_EQUAL (left[i] / sum, matrix[i], 0.0001);
+	}
+	g_free (matrix);
+}
+
+CASE (test_downmix_to_mono)
+{
+	/* the surrounds fold to the fronts first */
+	const gdouble mono[] = { H, H, 1, 0.5, 0.5, 0.5 };
+	gfloat *matrix;
+
+	matrix = xmms_channelmix_matrix_standard (6, 1, 0.5, FALSE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix, mono, 6);
+	g_free (matrix);
+}
+
+CASE (test_downmix_back_to_side)
+{
+	/* 7.1 back channels go to the surrounds of 5.1 */
+	const gdouble back_left[] = { 0, 0, 0, 0, 1, 0, 1, 0 };
+	gfloat *matrix;
+
+	matrix = xmms_channelmix_matrix_standard (8, 6, 0.0, FALSE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix + 4 * 8, back_left, 8);
+	g_free (matrix);
+}
+
+CASE (test_upmix_keeps_channels)
+{
+	const gdouble left[] = { 1, 0 };
+	const gdouble right[] = { 0, 1 };
+	const gdouble none[] = { 0, 0 };
+	gfloat *matrix;
+	gint o;
+
+	matrix = xmms_channelmix_matrix_standard (2, 6, 0.0, TRUE);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix, left, 2);
+	assert_row (matrix + 2, right, 2);
+	for (o = 2; o < 6; o++) {
+		assert_row (matrix + 2 * o, none, 2);
+	}
+	g_free (matrix);
+
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_standard (9, 2, 0.0, TRUE));
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_standard (2, 0, 0.0, TRUE));
+}
+
+CASE (test_parse)
+{
+	const gchar *spec = "2:1=0.5 0.5; 6:2=1 0 0.7 0 0.7 0/0,1,0.7,0,0,0.7";
+	const gdouble left[] = { 1, 0, 0.7, 0, 0.7, 0 };
+	const gdouble right[] = { 0, 1, 0.7, 0, 0, 0.7 };
+	const gdouble mono[] = { 0.5, 0.5 };
+	gfloat *matrix;
+
+	matrix = xmms_channelmix_matrix_parse (spec, 6, 2);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix, left, 6);
+	assert_row (matrix + 6, right, 6);
+	g_free (matrix);
+
+	matrix = xmms_channelmix_matrix_parse (spec, 2, 1);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (matrix);
+	assert_row (matrix, mono, 2);
+	g_free (matrix);
+
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_parse (spec, 4, 2));
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_parse ("", 6, 2));
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_parse ("6:2=1 0 0.7", 6, 2));
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_parse ("2:1=1 1/1 1", 2, 1));
+	CU_ASSERT_PTR_NULL (xmms_channelmix_matrix_parse ("2:1=1 x", 2, 1));
+}
+
+CASE (test_planar_matches_interleaved)
+{
+	/* not a multiple of the vector width, so the tails are covered */
+	const gint frames = 37;
+	gfloat in[37 * 6], planes_in[37 * 6], planes_out[37 * 2];
+	gfloat expected[37 * 2], out[37 * 2];
+	gfloat *matrix;
+	gint i;
+
+	for (i = 0; i < frames * 6; i++) {
+		in[i] = rand () / (gfloat) RAND_MAX - 0.5;
+	}
+
+	matrix = xmms_channelmix_matrix_standard (6, 2, 0.0, TRUE);
+
+	xmms_mixing_matrix (in, 6, expected, 2, matrix, frames);
+
+	xmms_mixing_deinterleave (in, 6, planes_in, frames);
+	xmms_mixing_matrix_planar (planes_in, 6, planes_out, 2, matrix, frames);
+	xmms_mixing_interleave (planes_out, 2, out, frames);
+
+	for (i = 0; i < frames * 2; i++) {
+		CU_ASSERT_DOUBLE_EQUAL (expected[i], out[i], 0.00001);
+	}
+
+	g_free (matrix);
+}
@@ -0,0 +1,206 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <math.h>
+
+#include "iir.h"
+#include "iir_fpu.h"
+#include "iir_simd.h"
+
+#define FRAMES 8192
+
+static short input[FRAMES * EQ_CHANNELS];
+static short fpu_output[FRAMES * EQ_CHANNELS];
+static short other_output[FRAMES * EQ_CHANNELS];
+static short input_copy[FRAMES * EQ_CHANNELS];
+
+SETUP (equalizer) {
+	int i;
+
+	srand (0);
+
+	for (i = 0; i < FRAMES * EQ_CHANNELS; i++) {
+		input[i] = 12000 * sin (i * 0.013) + 8000 * sin (i * 0.31) + (rand () % 2000 - 1000);
+	}
+
+	init_iir ();
+
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static iir_state_t *
+new_state (const iir_engine_t *engine, int bands, int original)
+{
+	iir_state_t *st;
+	int i;
+
+	st = iir_new_with_engine (engine);
+	config_iir (st, 44100, bands, original);
+
+	for (i = 0; i < EQ_MAX_BANDS; i++) {
+		set_gain (st, i, 0, (i % 5) * 0.1 - 0.1);
+		set_gain (st, i, 1, (i % 3) * 0.1);
+	}
+	set_preamp (st, 0, 1.0);
+	set_preamp (st, 1, 0.9);
+
+	return st;
+}
+
+static void
+run_both (const iir_engine_t *engine, int bands, int original, int extra_filtering)
+{
+	iir_state_t *fpu, *other;
+	int i;
+
+	fpu = new_state (&iir_fpu_engine, bands, original);
+	other = new_state (engine, bands, original);
+
+	memcpy (fpu_output, input, sizeof (input));
+	memcpy (other_output, input, sizeof (input));
+
+	/* in two halves, so the history carried between calls is used */
+	for (i = 0; i < 2; i++) {
+		iir (fpu, fpu_output + i * FRAMES, FRAMES * sizeof (short),
+		     EQ_CHANNELS, extra_filtering);
+		iir (other, other_output + i * FRAMES, FRAMES * sizeof (short),
+		     EQ_CHANNELS, extra_filtering);
+	}
+
+	iir_free (fpu);
+	iir_free (other);
+}
+
+static int
+max_difference (void)
+{
+	int i, diff, ret = 0;
+
+	for (i = 0; i < FRAMES * EQ_CHANNELS; i++) {
+		diff = abs (fpu_output[i] - other_output[i]);
+		if (diff > ret) {
+			ret = diff;
+		}
+	}
+
+	return ret;
+}
+
+CASE (test_simd_matches_fpu)
+{
+	const iir_engine_t *simd;
+
+	simd = iir_simd_init ();
+	if (!simd) {
+		return;
+	}
+
+	/* the bands are only summed in a different order, which may be
+	 * off by one after truncating to 16 bits */
+	run_both (simd, 31, 0, 0);
+	CU_ASSERT (max_difference () <= 1);
+
+	run_both (simd, 10, 1, 0);
+	CU_ASSERT (max_difference () <= 1);
+
+	run_both (simd, 15, 0, 1);
+	CU_ASSERT (max_difference () <= 1);
+
+	run_both (simd, 31, 0, 1);
+	CU_ASSERT (max_difference () <= 1);
+}
+
+CASE (test_states_are_independent)
+{
+	iir_state_t *a, *b;
+
+	/* a in one go */
+	a = new_state (&iir_fpu_engine, 15, 0);
+	memcpy (fpu_output, input, sizeof (input));
+	iir (a, fpu_output, sizeof (fpu_output), EQ_CHANNELS, 1);
+	iir_free (a);
+
+	/* a in two halves, with b filtering other data in between */
+	a = new_state (&iir_fpu_engine, 15, 0);
+	b = new_state (&iir_fpu_engine, 31, 0);
+	set_gain (b, 0, 0, 0.9);
+
+	memcpy (other_output, input, sizeof (input));
+	iir (a, other_output, sizeof (other_output) / 2, EQ_CHANNELS, 1);
+
+	memcpy (input_copy, input, sizeof (input));
+	iir (b, input_copy, sizeof (input_copy), EQ_CHANNELS, 0);
+
+	iir (a, other_output + FRAMES, sizeof (other_output) / 2, EQ_CHANNELS, 1);
+
+	iir_free (a);
+	iir_free (b);
+
+	CU_ASSERT_EQUAL (0, max_difference ());
+}
+
+CASE (test_float_matches_s16)
+{
+	static float fpu_float[FRAMES * EQ_CHANNELS];
+	static float other_float[FRAMES * EQ_CHANNELS];
+	const iir_engine_t *simd;
+	iir_state_t *st;
+	int i, d, diff = 0;
+
+	/* the input scaled down, and kept clear of clipping */
+	for (i = 0; i < FRAMES * EQ_CHANNELS; i++) {
+		input_copy[i] = input[i] / 2;
+		fpu_float[i] = input_copy[i] / 32768.0;
+	}
+	memcpy (other_float, fpu_float, sizeof (fpu_float));
+
+	st = new_state (&iir_fpu_engine, 15, 0);
+	iir (st, input_copy, sizeof (input_copy), EQ_CHANNELS, 1);
+	iir_free (st);
+
+	st = new_state (&iir_fpu_engine, 15, 0);
+	iir_float (st, fpu_float, sizeof (fpu_float), EQ_CHANNELS, 1);
+	iir_free (st);
+
+	/* the 16 bit output is dithered and truncated */
+	for (i = 0; i < FRAMES * EQ_CHANNELS; i++) {
+		d = abs (input_copy[i] - (int) lrint (fpu_float[i] * 32768.0));
+		if (d > diff) {
+			diff = d;
+		}
+	}
+	CU_ASSERT (diff <= 2);
+
+	simd = iir_simd_init ();
+	if (!simd) {
+		return;
+	}
+
+	st = new_state (simd, 15, 0);
+	iir_float (st, other_float, sizeof (other_float), EQ_CHANNELS, 1);
+	iir_free (st);
+
+	for (i = 0; i < FRAMES * EQ_CHANNELS; i++) {
+		CU_ASSERT (fabs (fpu_float[i] - other_float[i]) < 1e-5);
+	}
+}
@@ -0,0 +1,128 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <math.h>
+
+#include "loudness_meter.h"
+
+#define RATE 48000
+
+SETUP (loudness) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static void
+feed_sine (xmms_loudness_meter_t *meter, gint channels, gint frames,
+           gdouble db, gdouble freq, gdouble phase)
+{
+	gint16 *buf;
+	gdouble a;
+	gint i, c;
+
+	a = pow (10.0, db / 20.0) * 32767;
+	buf = g_new (gint16, frames * channels);
+	for (i = 0; i < frames; i++) {
+		for (c = 0; c < channels; c++) {
+			buf[i * channels + c] = (gint16) floor (0.5 + a * sin (2 * M_PI * freq * i / RATE + phase));
+		}
+	}
+
+	xmms_loudness_meter_feed (meter, buf, frames);
+	g_free (buf);
+}
+
+static void
+feed_silence (xmms_loudness_meter_t *meter, gint channels, gint frames)
+{
+	gint16 *buf;
+
+	buf = g_new0 (gint16, frames * channels);
+	xmms_loudness_meter_feed (meter, buf, frames);
+	g_free (buf);
+}
+
+/* EBU Tech 3341, a 1kHz stereo sine at -23 dBFS reads -23 LUFS */
+CASE (test_reference_tone)
+{
+	xmms_loudness_meter_t *meter;
+	gdouble lufs;
+
+	meter = xmms_loudness_meter_new (2, RATE, -60.0);
+	feed_sine (meter, 2, 20 * RATE, -23.0, 1000.0, 0.0);
+
+	CU_ASSERT_TRUE (xmms_loudness_meter_integrated (meter, &lufs));
+	CU_ASSERT_DOUBLE_EQUAL (-23.0, lufs, 0.1);
+	CU_ASSERT_DOUBLE_EQUAL (pow (10.0, -23.0 / 20.0),
+	                        xmms_loudness_meter_true_peak (meter), 0.001);
+
+	xmms_loudness_meter_free (meter);
+}
+
+CASE (test_silence_is_gated)
+{
+	xmms_loudness_meter_t *meter;
+	guint64 lead, trail;
+	gdouble lufs, quiet;
+
+	meter = xmms_loudness_meter_new (2, RATE, -60.0);
+	feed_silence (meter, 2, 2 * RATE);
+	CU_ASSERT_FALSE (xmms_loudness_meter_integrated (meter, &lufs));
+	CU_ASSERT_FALSE (xmms_loudness_meter_silence (meter, &lead, &trail));
+
+	/* the quiet part is more than 10 LU down, it doesn't count */
+	feed_sine (meter, 2, 10 * RATE, -23.0, 1000.0, M_PI / 2);
+	feed_sine (meter, 2, 10 * RATE, -40.0, 1000.0, M_PI / 2);
+	feed_silence (meter, 2, RATE / 2);
+
+	CU_ASSERT_TRUE (xmms_loudness_meter_integrated (meter, &lufs));
+	CU_ASSERT_DOUBLE_EQUAL (-23.0, lufs, 0.2);
+
+	CU_ASSERT_TRUE (xmms_loudness_meter_silence (meter, &lead, &trail));
+	CU_ASSERT_EQUAL (2 * RATE, lead);
+	CU_ASSERT_TRUE (trail >= RATE / 2 && trail < RATE / 2 + 48);
+
+	xmms_loudness_meter_free (meter);
+
+	/* above the threshold nothing is silent */
+	meter = xmms_loudness_meter_new (1, RATE, -50.0);
+	feed_sine (meter, 1, RATE, -40.0, 1000.0, M_PI / 2);
+	CU_ASSERT_TRUE (xmms_loudness_meter_integrated (meter, &quiet));
+	CU_ASSERT_TRUE (xmms_loudness_meter_silence (meter, &lead, &trail));
+	CU_ASSERT_EQUAL (0, lead);
+	xmms_loudness_meter_free (meter);
+}
+
+CASE (test_true_peak_between_samples)
+{
+	xmms_loudness_meter_t *meter;
+	gdouble peak;
+
+	/* at a quarter of the rate, 45 degrees off, no sample is on a
+	 * crest, those are 3 dB above them */
+	meter = xmms_loudness_meter_new (1, RATE, -60.0);
+	feed_sine (meter, 1, RATE, -6.0, RATE / 4, M_PI / 4);
+
+	peak = xmms_loudness_meter_true_peak (meter);
+	CU_ASSERT_DOUBLE_EQUAL (pow (10.0, -6.0 / 20.0), peak, 0.02);
+
+	xmms_loudness_meter_free (meter);
+}
@@ -0,0 +1,139 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "replaygain_apply.h"
+
+/* not a multiple of the vector width, so the tails are covered */
+#define SAMPLES 1027
+
+static const gfloat gains[] = { 0.01, 0.5, 1.7, 14.9 };
+
+SETUP (replaygain) {
+	srand (0);
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static gboolean
+matches_generic (xmms_sample_format_t fmt, void *input, gint size)
+{
+	xmms_replaygain_apply_func_t best, generic;
+	gboolean ret = TRUE;
+	gchar *a, *b;
+	gint i;
+
+	best = xmms_replaygain_apply_get (fmt);
+	generic = xmms_replaygain_apply_get_generic (fmt);
+
+	a = g_malloc (SAMPLES * size);
+	b = g_malloc (SAMPLES * size);
+
+	for (i = 0; i < G_N_ELEMENTS (gains); i++) {
+		memcpy (a, input, SAMPLES * size);
+		memcpy (b, input, SAMPLES * size);
+
+		/* one sample in, so the vectors are unaligned */
+		best (a + size, SAMPLES - 1, gains[i]);
+		generic (b + size, SAMPLES - 1, gains[i]);
+
+		if (memcmp (a, b, SAMPLES * size) != 0) {
+			ret = FALSE;
+		}
+	}
+
+	g_free (a);
+	g_free (b);
+
+	return ret;
+}
+
+CASE (test_vector_matches_generic)
+{
+	xmms_samples16_t s16[SAMPLES];
+	xmms_samples32_t s32[SAMPLES];
+	xmms_samplefloat_t fl[SAMPLES];
+	gint i;
+
+	for (i = 0; i < SAMPLES; i++) {
+		s16[i] = rand () % 65536 - 32768;
+		s32[i] = (gint32) ((guint32) rand () << 16 ^ (guint32) rand ());
+		fl[i] = (gfloat) rand () / RAND_MAX - 0.5;
+	}
+
+	CU_ASSERT_TRUE (matches_generic (XMMS_SAMPLE_FORMAT_S16, s16, sizeof (s16[0])));
+	CU_ASSERT_TRUE (matches_generic (XMMS_SAMPLE_FORMAT_S32, s32, sizeof (s32[0])));
+	CU_ASSERT_TRUE (matches_generic (XMMS_SAMPLE_FORMAT_FLOAT, fl, sizeof (fl[0])));
+}
+
+CASE (test_clipping)
+{
+	xmms_samples16_t s16[SAMPLES];
+	xmms_samples32_t s32[SAMPLES];
+	gint i;
+
+	for (i = 0; i < SAMPLES; i++) {
+		s16[i] = i % 2 ? 30000 : -30000;
+		s32[i] = i % 2 ? 2000000000 : -2000000000;
+	}
+
+	xmms_replaygain_apply_get (XMMS_SAMPLE_FORMAT_S16) (s16, SAMPLES, 2.0);
+	xmms_replaygain_apply_get (XMMS_SAMPLE_FORMAT_S32) (s32, SAMPLES, 2.0);
+
+	for (i = 0; i < SAMPLES; i++) {
+		CU_ASSERT_EQUAL (i % 2 ? XMMS_SAMPLES16_MAX : XMMS_SAMPLES16_MIN, s16[i]);
+		CU_ASSERT_EQUAL (i % 2 ? XMMS_SAMPLES32_MAX : XMMS_SAMPLES32_MIN, s32[i]);
+	}
+}
+
+CASE (test_ramp)
+{
+	gfloat fl[SAMPLES - 1];
+	xmms_samples16_t s16[SAMPLES - 1];
+	gint i, frames = (SAMPLES - 1) / 2;
+
+	for (i = 0; i < SAMPLES - 1; i++) {
+		fl[i] = 0.5;
+		s16[i] = 10000;
+	}
+
+	CU_ASSERT_TRUE (xmms_replaygain_apply_ramp (XMMS_SAMPLE_FORMAT_FLOAT, fl,
+	                                            frames, 2, 1.0, 0.5));
+	CU_ASSERT_TRUE (xmms_replaygain_apply_ramp (XMMS_SAMPLE_FORMAT_S16, s16,
+	                                            frames, 2, 1.0, 0.5));
+	CU_ASSERT_FALSE (xmms_replaygain_apply_ramp (XMMS_SAMPLE_FORMAT_S32, s16,
+	                                             frames, 2, 1.0, 0.5));
+
+	/* both channels of a frame get the same gain, falling to the end */
+	for (i = 0; i < frames; i++) {
+		CU_ASSERT_EQUAL (fl[2 * i], fl[2 * i + 1]);
+		CU_ASSERT_EQUAL (s16[2 * i], s16[2 * i + 1]);
+		if (i > 0) {
+			CU_ASSERT_TRUE (fl[2 * i] < fl[2 * i - 2]);
+		}
+	}
+
+	CU_ASSERT_DOUBLE_EQUAL (0.5, fl[0], 0.001);
+	CU_ASSERT_DOUBLE_EQUAL (0.25, fl[2 * frames - 1], 0.0001);
+	CU_ASSERT_EQUAL (5000, s16[2 * frames - 1]);
+}
@@ -16,6 +16,14 @@
 
 #include "mlib_utils.h"
 
+/* Shape of the mock library, albums of up to MOCK_ALBUM_TRACKS
+   tracks by artists with up to MOCK_ARTIST_ALBUMS albums */
+#define MOCK_ALBUM_TRACKS 12
+#define MOCK_ARTIST_ALBUMS 8
+#define MOCK_GENRES 24
+/* entries added per session */
+#define MOCK_BATCH 10000
+
 xmms_medialib_entry_t
 xmms_mock_entry (xmms_medialib_t *medialib, gint tracknr, const gchar *artist,
                  const gchar *album, const gchar *title)
@@ -55,3 +63,83 @@ xmms_mock_entry (xmms_medialib_t *medialib, gint tracknr, const gchar *artist,
 
 	return entry;
 }
+
+/**
+ * Fill the medialib with entries that look like a music collection,
+ * the same ones for the same seed.
+ */
+void
+xmms_mock_library (xmms_medialib_t *medialib, gint entries, guint32 seed)
+{
+	xmms_medialib_session_t *session = NULL;
+	xmms_medialib_entry_t entry;
+	xmms_error_t err;
+	gint i, tracks = 0, albums = 0, album = 0, artist = 0;
+	GRand *rand;
+
+	xmms_error_reset (&err);
+
+	rand = g_rand_new_with_seed (seed);
+
+	for (i = 0; i < entries; i++) {
+		gchar url[64], str[64];
+
+		if (!session) {
+			session = xmms_medialib_session_begin (medialib);
+		}
+
+		if (tracks == 0) {
+			if (albums == 0) {
+				artist++;
+				albums = g_rand_int_range (rand, 1, MOCK_ARTIST_ALBUMS + 1);
+			}
+			albums--;
+			album++;
+			tracks = g_rand_int_range (rand, 1, MOCK_ALBUM_TRACKS + 1);
+		}
+		tracks--;
+
+		g_snprintf (url, sizeof (url), "file:///mock/%d/%d/%d.flac", artist, album, i);
+		entry = xmms_medialib_entry_new (session, url, &err);
+
+		g_snprintf (str, sizeof (str), "Artist %d", artist);
+		xmms_medialib_entry_property_set_str (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ARTIST,
+		                                      str);
+		g_snprintf (str, sizeof (str), "Album %d", album);
+		xmms_medialib_entry_property_set_str (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_ALBUM,
+		                                      str);
+		g_snprintf (str, sizeof (str), "Title %d", i);
+		xmms_medialib_entry_property_set_str (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE,
+		                                      str);
+		g_snprintf (str, sizeof (str), "Genre %d", g_rand_int_range (rand, 0, MOCK_GENRES));
+		xmms_medialib_entry_property_set_str (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_GENRE,
+		                                      str);
+		xmms_medialib_entry_property_set_int (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_TRACKNR,
+		                                      tracks + 1);
+		xmms_medialib_entry_property_set_int (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_DURATION,
+		                                      g_rand_int_range (rand, 60000, 600000));
+		xmms_medialib_entry_property_set_int (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE,
+		                                      g_rand_int_range (rand, 1 << 20, 64 << 20));
+		xmms_medialib_entry_property_set_int (session, entry,
+		                                      XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS,
+		                                      XMMS_MEDIALIB_ENTRY_STATUS_OK);
+
+		if ((i + 1) % MOCK_BATCH == 0) {
+			xmms_medialib_session_commit (session);
+			session = NULL;
+		}
+	}
+
+	if (session) {
+		xmms_medialib_session_commit (session);
+	}
+
+	g_rand_free (rand);
+}
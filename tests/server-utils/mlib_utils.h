@@ -22,5 +22,6 @@
 #include <xmmspriv/xmms_medialib.h>
 
 xmms_medialib_entry_t xmms_mock_entry (xmms_medialib_t *medialib, gint tracknr, const gchar *artist, const gchar *album, const gchar *title);
+void xmms_mock_library (xmms_medialib_t *medialib, gint entries, guint32 seed);
 
 #endif
@@ -17,6 +17,7 @@
 #include <glib.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 
 #include <xmmspriv/xmms_log.h>
 #include <xmmspriv/xmms_ipc.h>
@@ -28,6 +29,7 @@
 #include <utils/coll_utils.h>
 
 #include <server-utils/ipc_call.h>
+#include <server-utils/mlib_utils.h>
 
 #include <memory_status.h>
 
@@ -41,6 +43,7 @@ typedef gboolean (*xmms_test_predicate)(xmms_medialib_t *medialib, const gchar *
 typedef struct xmms_test_args_St {
 	enum {
 		PERFORMANCE,
+		BENCHMARK,
 		UNITTEST
 	} variant;
 	enum {
@@ -49,9 +52,17 @@ typedef struct xmms_test_args_St {
 	} format;
 	const gchar *database_path;
 	const gchar *testcase_path;
+	/* benchmark only, sizes of the mock libraries and runs per query */
+	const gchar *entries;
+	gint iterations;
 	gboolean debug;
 } xmms_test_args_t;
 
+/* synthetic medialibs are all made from the same seed */
+#define BENCHMARK_SEED 4711
+
+static gint benchmark_iterations;
+
 static void
 simple_log_handler (const gchar *log_domain, GLogLevelFlags log_level,
                     const gchar *message, gpointer user_data)
@@ -374,6 +385,99 @@ run_performance_test (xmms_medialib_t *medialib, const gchar *name, xmmsv_t *con
 }
 
 
+/**
+ * Peak resident set size of the whole process so far, in kB.
+ */
+static glong
+peak_memory_get (void)
+{
+	struct rusage usage;
+
+	if (getrusage (RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+
+	return usage.ru_maxrss;
+}
+
+static gint
+compare_duration (gconstpointer a, gconstpointer b)
+{
+	const gint64 *x = a, *y = b;
+
+	return (*x > *y) - (*x < *y);
+}
+
+/**
+ * Benchmark predicate, runs the query of a test case over the mock
+ * library benchmark_iterations times.
+ */
+static gboolean
+run_benchmark_test (xmms_medialib_t *medialib, const gchar *name, xmmsv_t *content,
+                    xmmsv_t *coll, xmmsv_t *specification, xmmsv_t *expected,
+                    gint format, const gchar *datasetname)
+{
+	xmms_medialib_session_t *session;
+	gint64 *durations, total = 0, p50, p99;
+	gboolean success = TRUE;
+	xmms_error_t err;
+	gdouble rate;
+	gint i, n;
+
+	n = benchmark_iterations;
+	durations = g_new (gint64, n);
+
+	for (i = 0; i < n; i++) {
+		gint64 t0;
+		xmmsv_t *ret;
+
+		xmms_error_reset (&err);
+
+		session = xmms_medialib_session_begin (medialib);
+
+		t0 = g_get_monotonic_time ();
+		ret = xmms_medialib_query (session, coll, specification, &err);
+		durations[i] = g_get_monotonic_time () - t0;
+
+		xmms_medialib_session_commit (session);
+
+		if (ret) {
+			xmmsv_unref (ret);
+		}
+
+		if (xmms_error_iserror (&err)) {
+			success = FALSE;
+			n = i + 1;
+			break;
+		}
+
+		total += durations[i];
+	}
+
+	qsort (durations, n, sizeof (gint64), compare_duration);
+	p50 = durations[n / 2];
+	p99 = durations[MIN (n - 1, n * 99 / 100)];
+	rate = total ? n * (gdouble) G_USEC_PER_SEC / total : 0.0;
+
+	if (format == FORMAT_CSV) {
+		g_print ("\"%s\",\"%s\",%d,%d,%.1f,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT ",%ld\n",
+		         datasetname, name, success, n, rate, p50, p99, peak_memory_get ());
+	} else {
+		g_print ("* Test %s\n", name);
+		if (!success) {
+			g_print ("   - Query failed: %s\n", xmms_error_message_get (&err));
+		} else {
+			g_print ("   - %.1f queries/s, p50 %.3fms, p99 %.3fms, peak memory %ldkB\n",
+			         rate, p50 / 1000.0, p99 / 1000.0, peak_memory_get ());
+		}
+	}
+
+	g_free (durations);
+
+	return success;
+}
+
+
 static gboolean
 run_tests (xmms_medialib_t *medialib, xmmsv_t *testcases, xmms_test_predicate predicate,
            gint format, const gchar *datasetname)
@@ -440,6 +544,56 @@ run_performance_tests (xmmsv_t *databases, xmmsv_t *testcases, gint format)
 }
 
 
+/**
+ * Run every test case over mock libraries of each of the sizes
+ * in entries, a comma separated list.
+ */
+static gboolean
+run_benchmark_tests (const gchar *entries, xmmsv_t *testcases, gint format)
+{
+	gboolean result = TRUE;
+	gchar **sizes;
+	gint i;
+
+	sizes = g_strsplit (entries, ",", 0);
+
+	for (i = 0; sizes[i] != NULL; i++) {
+		xmms_medialib_t *medialib;
+		gint64 t0;
+		gint count;
+
+		count = atoi (sizes[i]);
+		if (count <= 0) {
+			continue;
+		}
+
+		xmms_ipc_init ();
+		xmms_config_init ("memory://");
+		xmms_config_property_register ("medialib.path", "memory://", NULL, NULL);
+
+		medialib = xmms_medialib_init ();
+
+		t0 = g_get_monotonic_time ();
+		xmms_mock_library (medialib, count, BENCHMARK_SEED);
+
+		if (format == FORMAT_PRETTY) {
+			g_print ("Running suite with %d entries (created in %.1fs)\n", count,
+			         (g_get_monotonic_time () - t0) / (gdouble) G_USEC_PER_SEC);
+		}
+
+		result &= run_tests (medialib, testcases, run_benchmark_test, format, sizes[i]);
+
+		xmms_object_unref (medialib);
+		xmms_config_shutdown ();
+		xmms_ipc_shutdown ();
+	}
+
+	g_strfreev (sizes);
+
+	return result;
+}
+
+
 static void
 parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 {
@@ -450,12 +604,14 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 
 	args->database_path = "tests/server/databases";
 	args->testcase_path = "tests/server/medialib";
+	args->entries = "10000,100000,1000000";
+	args->iterations = 10;
 
 	const GOptionEntry options[] = {
 		{
 			"variant", 'v', 0,
 			G_OPTION_ARG_STRING, &variant,
-			"'performance' or 'unittest' (default).", "<variant>"
+			"'performance', 'benchmark' or 'unittest' (default).", "<variant>"
 		},
 		{
 			"format", 'f', 0,
@@ -472,6 +628,16 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 			G_OPTION_ARG_FILENAME, &args->testcase_path,
 			"Scan <path> for 1..n test cases.", "<path>"
 		},
+		{
+			"entries", 'n', 0,
+			G_OPTION_ARG_STRING, &args->entries,
+			"Benchmark over mock libraries of these sizes (10000,100000,1000000).", "<n,...>"
+		},
+		{
+			"iterations", 'i', 0,
+			G_OPTION_ARG_INT, &args->iterations,
+			"Benchmark each query <n> times (10).", "<n>"
+		},
 		{
 			"debug", 'd', 0,
 			G_OPTION_ARG_NONE, &args->debug,
@@ -494,6 +660,8 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 
 	if (strcmp (variant, "performance") == 0) {
 		args->variant = PERFORMANCE;
+	} else if (strcmp (variant, "benchmark") == 0) {
+		args->variant = BENCHMARK;
 	} else {
 		args->variant = UNITTEST;
 	}
@@ -504,6 +672,10 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
 		args->format = FORMAT_CSV;
 	}
 
+	if (args->iterations < 1) {
+		args->iterations = 1;
+	}
+
 	g_option_context_free (context);
 }
 
@@ -513,6 +685,7 @@ parse_command_line (gint argc, gchar **argv, xmms_test_args_t *args)
  * - load a number of tests from json files
  * - by default, run tests as unit tests
  * - optionally run tests as performance tests, but then require a db directory
+ * - or benchmark the queries on generated libraries of different sizes
  */
 gint
 main (gint argc, gchar **argv)
@@ -527,7 +700,8 @@ main (gint argc, gchar **argv)
 
 	g_log_set_default_handler (simple_log_handler, (gpointer) &args);
 
-	g_debug ("Test variant: %s", args.variant == UNITTEST ? "unit test" : "performance test");
+	g_debug ("Test variant: %s", args.variant == UNITTEST ? "unit test" :
+	         args.variant == BENCHMARK ? "benchmark" : "performance test");
 	g_debug ("Output format: %s", args.format == FORMAT_PRETTY ? "pretty" : "csv");
 	g_debug ("Database path: %s", args.database_path);
 	g_debug ("Testcase path: %s", args.testcase_path);
@@ -543,6 +717,15 @@ main (gint argc, gchar **argv)
 		databases = scan_path (args.database_path, filter_databases);
 		run_performance_tests (databases, testcases, args.format);
 		xmmsv_unref (databases);
+	} else if (args.variant == BENCHMARK) {
+		if (args.format == FORMAT_CSV)
+			g_print ("\"entries\",\"test\",\"success\",\"iterations\",\"queries_per_sec\",\"p50_us\",\"p99_us\",\"peak_memory_kb\"\n");
+		else
+			g_print (" - Running Benchmark -\n");
+
+		benchmark_iterations = args.iterations;
+		if (!run_benchmark_tests (args.entries, testcases, args.format))
+			exit_code = EXIT_FAILURE;
 	} else {
 		if (args.format == FORMAT_CSV)
 			g_print ("\"test\",\"success\"\n");
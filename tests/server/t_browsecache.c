@@ -0,0 +1,213 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+#include <utime.h>
+
+#include <xmmspriv/xmms_browsecache.h>
+
+SETUP (browsecache) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static xmmsv_t *
+make_listing (const gchar *path)
+{
+	xmmsv_t *list, *dict;
+
+	list = xmmsv_new_list ();
+	dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("path", path),
+	                         XMMSV_DICT_ENTRY_INT ("isdir", 0),
+	                         XMMSV_DICT_END);
+	xmmsv_list_append (list, dict);
+	xmmsv_unref (dict);
+
+	return list;
+}
+
+static gboolean
+cached (xmms_browse_cache_t *cache, const gchar *key)
+{
+	xmmsv_t *list;
+
+	list = xmms_browse_cache_lookup (cache, key);
+	if (list) {
+		xmmsv_unref (list);
+	}
+
+	return list != NULL;
+}
+
+CASE (test_key)
+{
+	gchar *key;
+
+	key = xmms_browse_cache_key ("smb://host/share/");
+	CU_ASSERT_STRING_EQUAL ("smb://host/share", key);
+	g_free (key);
+
+	key = xmms_browse_cache_key ("smb://host/share");
+	CU_ASSERT_STRING_EQUAL ("smb://host/share", key);
+	g_free (key);
+
+	key = xmms_browse_cache_key ("file:///");
+	CU_ASSERT_STRING_EQUAL ("file:///", key);
+	g_free (key);
+}
+
+CASE (test_lookup_copy)
+{
+	xmms_browse_cache_t *cache;
+	xmmsv_t *list, *ret;
+	const gchar *path;
+
+	cache = xmms_browse_cache_new (4, 60000);
+
+	CU_ASSERT_PTR_NULL (xmms_browse_cache_lookup (cache, "smb://host/a"));
+
+	list = make_listing ("smb://host/a/x.mp3");
+	xmms_browse_cache_insert (cache, "smb://host/a", list);
+	xmmsv_unref (list);
+
+	ret = xmms_browse_cache_lookup (cache, "smb://host/a");
+	CU_ASSERT_PTR_NOT_NULL (ret);
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (ret));
+	xmmsv_list_get (ret, 0, &list);
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_string (list, "path", &path));
+	CU_ASSERT_STRING_EQUAL ("smb://host/a/x.mp3", path);
+	xmmsv_unref (ret);
+
+	xmms_browse_cache_free (cache);
+}
+
+CASE (test_lru)
+{
+	xmms_browse_cache_t *cache;
+	xmmsv_t *list;
+	guint hits, misses, entries;
+
+	cache = xmms_browse_cache_new (2, 60000);
+	list = make_listing ("smb://host/x.mp3");
+
+	xmms_browse_cache_insert (cache, "smb://host/a", list);
+	xmms_browse_cache_insert (cache, "smb://host/b", list);
+	CU_ASSERT_TRUE (cached (cache, "smb://host/a"));
+	xmms_browse_cache_insert (cache, "smb://host/c", list);
+
+	/* b was the least recently used */
+	CU_ASSERT_TRUE (cached (cache, "smb://host/a"));
+	CU_ASSERT_FALSE (cached (cache, "smb://host/b"));
+	CU_ASSERT_TRUE (cached (cache, "smb://host/c"));
+
+	xmms_browse_cache_stats (cache, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (3, hits);
+	CU_ASSERT_EQUAL (1, misses);
+	CU_ASSERT_EQUAL (2, entries);
+
+	xmmsv_unref (list);
+	xmms_browse_cache_free (cache);
+}
+
+CASE (test_ttl)
+{
+	xmms_browse_cache_t *cache;
+	xmmsv_t *list;
+
+	cache = xmms_browse_cache_new (4, 0);
+	list = make_listing ("smb://host/x.mp3");
+
+	xmms_browse_cache_insert (cache, "smb://host/a", list);
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a"));
+
+	xmms_browse_cache_configure (cache, 4, 20);
+	xmms_browse_cache_insert (cache, "smb://host/a", list);
+	CU_ASSERT_TRUE (cached (cache, "smb://host/a"));
+
+	g_usleep (40000);
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a"));
+
+	xmmsv_unref (list);
+	xmms_browse_cache_free (cache);
+}
+
+CASE (test_invalidate)
+{
+	xmms_browse_cache_t *cache;
+	xmmsv_t *list;
+
+	cache = xmms_browse_cache_new (8, 60000);
+	list = make_listing ("smb://host/x.mp3");
+
+	xmms_browse_cache_insert (cache, "smb://host/a", list);
+	xmms_browse_cache_insert (cache, "smb://host/a/b", list);
+	xmms_browse_cache_insert (cache, "smb://host/a/b/c", list);
+	xmms_browse_cache_insert (cache, "smb://host/ab", list);
+	xmms_browse_cache_insert (cache, "smb://host/a/d", list);
+
+	/* b and below, and a as something changed in it */
+	xmms_browse_cache_invalidate (cache, "smb://host/a/b", TRUE);
+
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a"));
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a/b"));
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a/b/c"));
+	CU_ASSERT_TRUE (cached (cache, "smb://host/ab"));
+	CU_ASSERT_TRUE (cached (cache, "smb://host/a/d"));
+
+	xmms_browse_cache_invalidate (cache, "smb://host/a", FALSE);
+	CU_ASSERT_FALSE (cached (cache, "smb://host/a/d"));
+	CU_ASSERT_TRUE (cached (cache, "smb://host/ab"));
+
+	xmmsv_unref (list);
+	xmms_browse_cache_free (cache);
+}
+
+CASE (test_mtime)
+{
+	xmms_browse_cache_t *cache;
+	struct utimbuf times;
+	xmmsv_t *list;
+	gchar *dir, *key;
+
+	dir = g_dir_make_tmp ("browsecache-XXXXXX", NULL);
+	CU_ASSERT_PTR_NOT_NULL (dir);
+	key = g_strconcat ("file://", dir, NULL);
+
+	cache = xmms_browse_cache_new (4, 60000);
+	list = make_listing ("file:///x.mp3");
+
+	xmms_browse_cache_insert (cache, key, list);
+	CU_ASSERT_TRUE (cached (cache, key));
+
+	/* a file was added or removed in it */
+	times.actime = times.modtime = 1000;
+	CU_ASSERT_EQUAL (0, g_utime (dir, &times));
+	CU_ASSERT_FALSE (cached (cache, key));
+
+	g_rmdir (dir);
+
+	xmmsv_unref (list);
+	xmms_browse_cache_free (cache);
+	g_free (key);
+	g_free (dir);
+}
@@ -303,6 +303,67 @@ CASE (test_client_find)
 	xmmsv_unref (result);
 }
 
+CASE (test_client_find_idlist)
+{
+	xmms_medialib_entry_t entry, other;
+	xmmsv_t *idlist;
+	xmmsv_t *result;
+	const gchar *string;
+
+	entry = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	other = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	/* should be found, once */
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	xmmsv_coll_idlist_append (idlist, entry);
+	xmmsv_coll_idlist_append (idlist, other);
+	xmmsv_coll_idlist_append (idlist, entry);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("With"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_PLAYLISTS),
+	                        xmmsv_ref (idlist));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+	xmmsv_unref (idlist);
+
+	/* should not be found */
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	xmmsv_coll_idlist_append (idlist, other);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("Without"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_PLAYLISTS),
+	                        xmmsv_ref (idlist));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+	xmmsv_unref (idlist);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_FIND,
+	                        xmmsv_new_int (entry),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_PLAYLISTS));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_string (result, 0, &string));
+	CU_ASSERT_STRING_EQUAL ("With", string);
+	xmmsv_unref (result);
+
+	/* replacing the playlist drops it from the index */
+	idlist = xmmsv_new_coll (XMMS_COLLECTION_TYPE_IDLIST);
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_SAVE,
+	                        xmmsv_new_string ("With"),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_PLAYLISTS),
+	                        xmmsv_ref (idlist));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+	xmmsv_unref (idlist);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_FIND,
+	                        xmmsv_new_int (entry),
+	                        xmmsv_new_string (XMMS_COLLECTION_NS_PLAYLISTS));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
+	CU_ASSERT_EQUAL (0, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+}
+
 CASE (test_client_list)
 {
 	xmmsv_t *universe, *idlist;
@@ -402,6 +463,99 @@ CASE (test_client_query_infos)
 	xmmsv_unref (result);
 }
 
+CASE (test_client_query_cached)
+{
+	xmmsv_t *universe, *spec, *result;
+	guint hits, misses, entries;
+	gint count;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	spec = xmmsv_from_xson ("{ 'type': 'count' }");
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY,
+	                        xmmsv_ref (universe), xmmsv_ref (spec));
+	CU_ASSERT (xmmsv_get_int (result, &count));
+	CU_ASSERT_EQUAL (1, count);
+	xmmsv_unref (result);
+
+	/* same query again, served from the cache */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY,
+	                        xmmsv_ref (universe), xmmsv_ref (spec));
+	CU_ASSERT (xmmsv_get_int (result, &count));
+	CU_ASSERT_EQUAL (1, count);
+	xmmsv_unref (result);
+
+	xmms_collection_query_cache_stats (dag, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (1, hits);
+	CU_ASSERT_EQUAL (1, misses);
+	CU_ASSERT_EQUAL (1, entries);
+
+	/* a medialib change makes the cached result stale */
+	xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY,
+	                        xmmsv_ref (universe), xmmsv_ref (spec));
+	CU_ASSERT (xmmsv_get_int (result, &count));
+	CU_ASSERT_EQUAL (2, count);
+	xmmsv_unref (result);
+
+	xmms_collection_query_cache_stats (dag, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (1, hits);
+	CU_ASSERT_EQUAL (2, misses);
+
+	xmmsv_unref (universe);
+	xmmsv_unref (spec);
+}
+
+CASE (test_client_query_cursor)
+{
+	xmmsv_t *universe, *spec, *result;
+	gint id, count;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+	xmms_mock_entry (medialib, 3, "Red Fang", "Red Fang", "Night Destroyer");
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	spec = xmmsv_from_xson ("{ 'type': 'count' }");
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_OPEN,
+	                        universe, spec);
+	CU_ASSERT (xmmsv_get_int (result, &id));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_NEXT,
+	                        xmmsv_new_int (id), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_get_int (result, &count));
+	CU_ASSERT_EQUAL (2, count);
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_NEXT,
+	                        xmmsv_new_int (id), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_get_int (result, &count));
+	CU_ASSERT_EQUAL (1, count);
+	xmmsv_unref (result);
+
+	/* exhausted */
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_NEXT,
+	                        xmmsv_new_int (id), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
+	CU_ASSERT_EQUAL (0, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_CLOSE,
+	                        xmmsv_new_int (id));
+	CU_ASSERT (!xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (dag, XMMS_IPC_COMMAND_COLLECTION_QUERY_CURSOR_NEXT,
+	                        xmmsv_new_int (id), xmmsv_new_int (2));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+}
+
 CASE (test_client_query_infos2)
 {
 	xmmsv_t *universe, *ordered;
@@ -0,0 +1,153 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include <xmms/xmms_xformplugin.h>
+#include <xmmspriv/xmms_magic.h>
+
+typedef struct {
+	const gchar *mime;
+	const guchar *data;
+	guint len;
+} sample_header_t;
+
+/* a few of the rules the plugins register */
+static void
+register_rules (void)
+{
+	static gboolean registered = FALSE;
+
+	if (registered) {
+		return;
+	}
+
+	xmms_magic_add ("FLAC header", "audio/x-flac", "0 string fLaC", NULL);
+	xmms_magic_add ("ogg/vorbis header", "application/ogg",
+	                "0 string OggS", ">4 byte 0",
+	                ">>28 string \x01vorbis", NULL);
+	xmms_magic_add ("wave header", "audio/x-wav",
+	                "0 string RIFF", ">8 string WAVE",
+	                ">>12 string fmt ", NULL);
+	xmms_magic_add ("id3 header", "audio/mpeg", "0 string ID3", NULL);
+	xmms_magic_add ("mpeg header", "audio/mpeg", "0 beshort&0xfff6 0xfff2", NULL);
+	xmms_magic_add ("mod header", "audio/mod",
+	                "1080 string M.K.", NULL);
+	xmms_magic_add ("aiff header", "audio/x-aiff",
+	                "0 string FORM", ">8 string AIFF", NULL);
+
+	registered = TRUE;
+}
+
+SETUP (magic) {
+	register_rules ();
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static guint
+sample_headers (sample_header_t *samples, guchar *mod)
+{
+	static const guchar flac[] = "fLaC\0\0\0\x22";
+	static const guchar vorbis[] = "OggS\0\x02\0\0\0\0\0\0\0\0\0\0\0\0\0\0"
+	                               "\0\0\0\0\0\0\0\0\x01vorbis";
+	static const guchar wav[] = "RIFF\x24\0\0\0WAVEfmt \x10\0\0\0";
+	static const guchar id3[] = "ID3\x03\0\0\0\0\0\0";
+	static const guchar mp3[] = "\xff\xfb\x90\x64";
+	static const guchar aiff[] = "FORM\0\0\0\0AIFFCOMM";
+	static const guchar junk[] = "just some text, nothing to see";
+	guint n = 0;
+
+	memset (mod, 0, 1084);
+	memcpy (mod + 1080, "M.K.", 4);
+
+#define SAMPLE(m, d, l) samples[n].mime = m; samples[n].data = d; samples[n++].len = l
+	SAMPLE ("audio/x-flac", flac, sizeof (flac) - 1);
+	SAMPLE ("application/ogg", vorbis, sizeof (vorbis) - 1);
+	SAMPLE ("audio/x-wav", wav, sizeof (wav) - 1);
+	SAMPLE ("audio/mpeg", id3, sizeof (id3) - 1);
+	SAMPLE ("audio/mpeg", mp3, sizeof (mp3) - 1);
+	SAMPLE ("audio/x-aiff", aiff, sizeof (aiff) - 1);
+	SAMPLE ("audio/mod", mod, 1084);
+	SAMPLE (NULL, junk, sizeof (junk) - 1);
+#undef SAMPLE
+
+	return n;
+}
+
+CASE (test_match_headers)
+{
+	sample_header_t samples[8];
+	guchar mod[1084];
+	guint i, n;
+
+	n = sample_headers (samples, mod);
+
+	for (i = 0; i < n; i++) {
+		const gchar *mime = xmms_magic_match_data (samples[i].data, samples[i].len);
+		if (samples[i].mime) {
+			CU_ASSERT_STRING_EQUAL (samples[i].mime, mime);
+		} else {
+			CU_ASSERT_PTR_NULL (mime);
+		}
+	}
+}
+
+CASE (test_short_data)
+{
+	/* starts like a wave header, but stops before "WAVE" */
+	CU_ASSERT_PTR_NULL (xmms_magic_match_data ((const guchar *) "RIFF\0\0", 6));
+	CU_ASSERT_PTR_NULL (xmms_magic_match_data ((const guchar *) "", 0));
+}
+
+CASE (test_prefix_size)
+{
+	/* the mod rule needs the most */
+	CU_ASSERT (xmms_magic_prefix_size () >= 1084);
+}
+
+CASE (test_match_benchmark)
+{
+	sample_header_t samples[8];
+	guchar mod[1084];
+	gint64 start, elapsed;
+	guint i, j, n, matched = 0;
+	const guint rounds = 20000;
+
+	n = sample_headers (samples, mod);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < n; j++) {
+			if (xmms_magic_match_data (samples[j].data, samples[j].len)) {
+				matched++;
+			}
+		}
+	}
+	elapsed = g_get_monotonic_time () - start;
+
+	CU_ASSERT_EQUAL ((n - 1) * rounds, matched);
+
+	printf ("\n  magic: %u headers in %" G_GINT64_FORMAT " us, %.1f ns/header\n",
+	        n * rounds, elapsed, elapsed * 1000.0 / (n * rounds));
+}
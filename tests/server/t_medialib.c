@@ -1,5 +1,7 @@
 #include "xcu.h"
 
+#include <glib/gstdio.h>
+
 #include <xmmspriv/xmms_log.h>
 #include <xmmspriv/xmms_ipc.h>
 #include <xmmspriv/xmms_config.h>
@@ -210,6 +212,65 @@ CASE (test_not_resolved)
 	CU_ASSERT (entry == first || entry == second);
 }
 
+static void
+count_entry_changed (xmms_object_t *object, xmmsv_t *data, gpointer udata)
+{
+	gint *count = (gint *) udata;
+	(*count)++;
+}
+
+CASE (test_coalesced_notifications)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t first, second;
+	xmms_config_property_t *cfg;
+	gint changed = 0;
+
+	first = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_entries");
+	xmms_config_property_set_data (cfg, "2");
+	cfg = xmms_config_lookup ("medialib.notify_coalesce_ms");
+	xmms_config_property_set_data (cfg, "60000");
+
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                     count_entry_changed, &changed);
+
+	/* the same entry changed twice is only announced once */
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, first, "tracknr", 3);
+	xmms_medialib_session_commit (session);
+
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, first, "tracknr", 4);
+	xmms_medialib_session_commit (session);
+
+	CU_ASSERT_EQUAL (0, changed);
+
+	/* reaching the entry limit flushes the queue */
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, second, "tracknr", 5);
+	xmms_medialib_session_commit (session);
+
+	CU_ASSERT_EQUAL (2, changed);
+
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_property_set_int (session, second, "tracknr", 6);
+	xmms_medialib_session_commit (session);
+
+	CU_ASSERT_EQUAL (2, changed);
+
+	xmms_medialib_event_queue_flush (xmms_medialib_get_event_queue (medialib));
+
+	CU_ASSERT_EQUAL (3, changed);
+
+	xmms_object_disconnect (XMMS_OBJECT (medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRY_CHANGED,
+	                        count_entry_changed, &changed);
+}
+
 CASE (test_query_random_id)
 {
 	xmms_medialib_session_t *session;
@@ -574,6 +635,219 @@ CASE(test_client_get_info)
 	xmmsv_unref (result);
 }
 
+static void
+medialib_query_field (const gchar *field, const gchar *value)
+{
+	xmmsv_t *universe, *coll, *spec, *result;
+	xmms_error_t err;
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_EQUALS);
+	xmmsv_coll_add_operand (coll, universe);
+	xmmsv_coll_attribute_set_string (coll, "field", field);
+	xmmsv_coll_attribute_set_string (coll, "value", value);
+
+	spec = xmmsv_from_xson ("{ 'type': 'count' }");
+
+	xmms_error_reset (&err);
+	result = medialib_query (coll, spec, &err);
+	if (result) {
+		xmmsv_unref (result);
+	}
+
+	xmmsv_unref (spec);
+	xmmsv_unref (coll);
+	xmmsv_unref (universe);
+}
+
+CASE(test_client_index_stats)
+{
+	xmmsv_t *result, *usage;
+	gint indexed, filters;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+
+	medialib_query_field ("artist", "Red Fang");
+	medialib_query_field ("artist", "Kyuss");
+	medialib_query_field ("comment", "Stoner");
+
+	result = __xmms_ipc_call (XMMS_OBJECT (medialib), XMMS_IPC_COMMAND_MEDIALIB_INDEX_STATS, NULL);
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_DICT));
+
+	CU_ASSERT (xmmsv_dict_get (result, "artist", &usage));
+	CU_ASSERT (xmmsv_dict_entry_get_int (usage, "indexed", &indexed));
+	CU_ASSERT (xmmsv_dict_entry_get_int (usage, "filters", &filters));
+	CU_ASSERT_EQUAL (1, indexed);
+	CU_ASSERT_EQUAL (2, filters);
+
+	CU_ASSERT (xmmsv_dict_get (result, "comment", &usage));
+	CU_ASSERT (xmmsv_dict_entry_get_int (usage, "indexed", &indexed));
+	CU_ASSERT (xmmsv_dict_entry_get_int (usage, "filters", &filters));
+	CU_ASSERT_EQUAL (0, indexed);
+	CU_ASSERT_EQUAL (1, filters);
+
+	CU_ASSERT (xmmsv_dict_get (result, "url", &usage));
+	CU_ASSERT (xmmsv_dict_entry_get_int (usage, "filters", &filters));
+	CU_ASSERT_EQUAL (0, filters);
+
+	xmmsv_unref (result);
+}
+
+static gint
+medialib_count_ro (xmmsv_t *coll)
+{
+	xmms_medialib_session_t *session;
+	xmmsv_t *spec, *result;
+	xmms_error_t err;
+	gint count = -1;
+
+	spec = xmmsv_from_xson ("{ 'type': 'count' }");
+
+	xmms_error_reset (&err);
+	session = xmms_medialib_session_begin_ro (medialib);
+	result = xmms_medialib_query (session, coll, spec, &err);
+	xmmsv_get_int (result, &count);
+	xmms_medialib_session_commit (session);
+
+	xmmsv_unref (spec);
+
+	return count;
+}
+
+CASE(test_query_plan_cache)
+{
+	xmms_plan_cache_t *cache;
+	xmmsv_t *universe, *limit;
+	guint hits, misses, entries;
+
+	cache = xmms_medialib_get_plan_cache (medialib);
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+
+	medialib_query_field ("artist", "Red Fang");
+	medialib_query_field ("artist", "Red Fang");
+
+	xmms_plan_cache_stats (cache, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (1, hits);
+	CU_ASSERT_EQUAL (1, misses);
+	CU_ASSERT_EQUAL (1, entries);
+
+	/* a limit plan holds the ids of its operand, which a write
+	 * makes stale */
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	limit = xmmsv_new_coll (XMMS_COLLECTION_TYPE_LIMIT);
+	xmmsv_coll_add_operand (limit, universe);
+	xmmsv_coll_attribute_set_string (limit, "length", "10");
+
+	CU_ASSERT_EQUAL (1, medialib_count_ro (limit));
+	CU_ASSERT_EQUAL (1, medialib_count_ro (limit));
+
+	xmms_plan_cache_stats (cache, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (2, hits);
+
+	xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	CU_ASSERT_EQUAL (2, medialib_count_ro (limit));
+
+	xmms_plan_cache_stats (cache, &hits, &misses, &entries);
+	CU_ASSERT_EQUAL (2, hits);
+
+	xmmsv_unref (limit);
+	xmmsv_unref (universe);
+}
+
+static xmmsv_t *
+match_coll (const gchar *field, const gchar *pattern)
+{
+	xmmsv_t *universe, *match;
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	match = xmmsv_new_coll (XMMS_COLLECTION_TYPE_MATCH);
+	xmmsv_coll_add_operand (match, universe);
+	xmmsv_coll_attribute_set_string (match, "field", field);
+	xmmsv_coll_attribute_set_string (match, "value", pattern);
+	xmmsv_unref (universe);
+
+	return match;
+}
+
+CASE(test_query_token_index)
+{
+	xmmsv_t *fang, *dog, *thunder;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	xmms_mock_entry (medialib, 2, "Red Fang", "Murder the Mountains", "Wires");
+
+	fang = match_coll ("artist", "*fang*");
+	dog = match_coll ("title", "Prehistoric*");
+	thunder = match_coll ("title", "*thunder*");
+
+	CU_ASSERT_EQUAL (2, medialib_count_ro (fang));
+	CU_ASSERT_EQUAL (1, medialib_count_ro (dog));
+	CU_ASSERT_EQUAL (0, medialib_count_ro (thunder));
+
+	/* the index picks up committed writes */
+	xmms_mock_entry (medialib, 3, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	CU_ASSERT_EQUAL (3, medialib_count_ro (fang));
+	CU_ASSERT_EQUAL (1, medialib_count_ro (thunder));
+
+	xmmsv_unref (fang);
+	xmmsv_unref (dog);
+	xmmsv_unref (thunder);
+}
+
+CASE(test_client_complete)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	xmmsv_t *result;
+	const gchar *value;
+
+	xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	xmms_mock_entry (medialib, 2, "Red Fang", "Murder the Mountains", "Wires");
+	entry = xmms_mock_entry (medialib, 3, "Redd Kross", "Neurotica", "Neurotica");
+	xmms_mock_entry (medialib, 4, "Melvins", "Houdini", "Hooch");
+
+	/* the most common first */
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_COMPLETE,
+	                        xmmsv_new_string ("artist"),
+	                        xmmsv_new_string ("red"),
+	                        xmmsv_new_int (10));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_string (result, 0, &value));
+	CU_ASSERT_STRING_EQUAL ("Red Fang", value);
+	CU_ASSERT (xmmsv_list_get_string (result, 1, &value));
+	CU_ASSERT_STRING_EQUAL ("Redd Kross", value);
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_COMPLETE,
+	                        xmmsv_new_string ("artist"),
+	                        xmmsv_new_string (""),
+	                        xmmsv_new_int (1));
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+
+	/* follows committed writes */
+	session = xmms_medialib_session_begin (medialib);
+	xmms_medialib_entry_remove (session, entry);
+	xmms_medialib_session_commit (session);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_COMPLETE,
+	                        xmmsv_new_string ("artist"),
+	                        xmmsv_new_string ("RED"),
+	                        xmmsv_new_int (10));
+	CU_ASSERT_EQUAL (1, xmmsv_list_get_size (result));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_COMPLETE,
+	                        xmmsv_new_string ("genre"),
+	                        xmmsv_new_string ("r"),
+	                        xmmsv_new_int (10));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+}
+
 CASE(test_client_entry_add)
 {
 	xmms_medialib_session_t *session;
@@ -787,6 +1061,103 @@ CASE(test_client_property_remove)
 	xmmsv_unref (result);
 }
 
+static void
+assert_client_property (xmmsv_t *info, const gchar *key, xmmsv_t *expected)
+{
+	xmmsv_t *sources, *entry, *value;
+
+	CU_ASSERT (xmmsv_dict_get (info, key, &sources));
+	CU_ASSERT (xmmsv_list_get (sources, 0, &entry));
+	CU_ASSERT (xmmsv_list_get (entry, 1, &value));
+	CU_ASSERT (xmmsv_compare (expected, value));
+
+	xmmsv_unref (expected);
+}
+
+CASE(test_client_bulk_mutations)
+{
+	xmms_medialib_entry_t first, second;
+	xmmsv_t *result, *properties;
+	gint changed = 0;
+	gint id;
+
+	xmms_object_connect (XMMS_OBJECT (medialib),
+	                     XMMS_IPC_SIGNAL_MEDIALIB_ENTRIES_CHANGED,
+	                     count_entry_changed, &changed);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_ADD_ENTRIES,
+	                        xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("file:///a.mp3"),
+	                                          XMMSV_LIST_ENTRY_STR ("file:///b.mp3"),
+	                                          XMMSV_LIST_END));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_LIST));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (result));
+	CU_ASSERT (xmmsv_list_get_int (result, 0, &id));
+	first = id;
+	CU_ASSERT (xmmsv_list_get_int (result, 1, &id));
+	second = id;
+	CU_ASSERT_NOT_EQUAL (first, second);
+	xmmsv_unref (result);
+
+	/* one missing entry fails the whole call */
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTY_ENTRIES,
+	                        xmmsv_build_list (XMMSV_LIST_ENTRY_INT (first),
+	                                          XMMSV_LIST_ENTRY_INT (1337),
+	                                          XMMSV_LIST_END),
+	                        xmmsv_new_string ("client/unittest"),
+	                        xmmsv_new_string ("rating"),
+	                        xmmsv_new_int (4));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	CU_ASSERT_EQUAL (0, changed);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTY_ENTRIES,
+	                        xmmsv_build_list (XMMSV_LIST_ENTRY_INT (first),
+	                                          XMMSV_LIST_ENTRY_INT (second),
+	                                          XMMSV_LIST_END),
+	                        xmmsv_new_string ("client/unittest"),
+	                        xmmsv_new_string ("rating"),
+	                        xmmsv_new_int (4));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+
+	/* both entries are announced together */
+	CU_ASSERT_EQUAL (1, changed);
+
+	properties = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("comment", "Loud"),
+	                               XMMSV_DICT_ENTRY_INT ("rating", 5),
+	                               XMMSV_DICT_END);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTIES,
+	                        xmmsv_new_int (second),
+	                        xmmsv_new_string ("server"),
+	                        xmmsv_ref (properties));
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_ERROR));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_SET_PROPERTIES,
+	                        xmmsv_new_int (second),
+	                        xmmsv_new_string ("client/unittest"),
+	                        properties);
+	CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+	xmmsv_unref (result);
+
+	CU_ASSERT_EQUAL (2, changed);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_GET_INFO, xmmsv_new_int (first));
+	assert_client_property (result, "rating", xmmsv_new_int (4));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (medialib, XMMS_IPC_COMMAND_MEDIALIB_GET_INFO, xmmsv_new_int (second));
+	assert_client_property (result, "rating", xmmsv_new_int (5));
+	assert_client_property (result, "comment", xmmsv_new_string ("Loud"));
+	xmmsv_unref (result);
+
+	xmms_object_disconnect (XMMS_OBJECT (medialib),
+	                        XMMS_IPC_SIGNAL_MEDIALIB_ENTRIES_CHANGED,
+	                        count_entry_changed, &changed);
+}
+
 CASE(test_client_move_entry)
 {
 	xmms_medialib_session_t *session;
@@ -860,3 +1231,100 @@ CASE (test_session_locking)
 
 	CU_ASSERT_NOT_EQUAL (status, new_status);
 }
+
+CASE (test_entry_import)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t entry;
+	xmms_error_t err;
+	gint status;
+
+	xmms_error_reset (&err);
+
+	session = xmms_medialib_session_begin (medialib);
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_IMPORT_ADDED,
+	                 xmms_medialib_entry_import (session, "file:///a.flac", 100, 10, &err));
+	CU_ASSERT_TRUE (xmms_medialib_session_commit (session));
+
+	session = xmms_medialib_session_begin (medialib);
+	entry = xmms_medialib_entry_new_encoded (session, "file:///a.flac", &err);
+
+	/* size and lmod haven't been read yet */
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_IMPORT_UNCHANGED,
+	                 xmms_medialib_entry_import (session, "file:///a.flac", 200, 20, &err));
+
+	xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_SIZE, 100);
+	xmms_medialib_entry_property_set_int (session, entry, XMMS_MEDIALIB_ENTRY_PROPERTY_LMOD, 10);
+	xmms_medialib_entry_status_set (session, entry, XMMS_MEDIALIB_ENTRY_STATUS_OK);
+
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_IMPORT_UNCHANGED,
+	                 xmms_medialib_entry_import (session, "file:///a.flac", 100, 10, &err));
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_IMPORT_UNCHANGED,
+	                 xmms_medialib_entry_import (session, "file:///a.flac", -1, -1, &err));
+	status = xmms_medialib_entry_property_get_int (session, entry,
+	                                               XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_ENTRY_STATUS_OK, status);
+
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_IMPORT_CHANGED,
+	                 xmms_medialib_entry_import (session, "file:///a.flac", 100, 11, &err));
+	status = xmms_medialib_entry_property_get_int (session, entry,
+	                                               XMMS_MEDIALIB_ENTRY_PROPERTY_STATUS);
+	CU_ASSERT_EQUAL (XMMS_MEDIALIB_ENTRY_STATUS_REHASH, status);
+
+	xmms_medialib_session_abort (session);
+}
+
+CASE (test_dump_restore)
+{
+	xmms_medialib_session_t *session;
+	xmms_medialib_entry_t first, second, entry;
+	xmms_error_t err;
+	gchar *dir, *path, *url, *title;
+
+	xmms_error_reset (&err);
+
+	first = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse\tThunder\n");
+
+	dir = g_dir_make_tmp ("mlibdump-XXXXXX", NULL);
+	CU_ASSERT_PTR_NOT_NULL (dir);
+	path = g_build_filename (dir, "dump", NULL);
+
+	CU_ASSERT_EQUAL (2, xmms_medialib_dump (medialib, path, &err));
+	CU_ASSERT_FALSE (xmms_error_iserror (&err));
+
+	session = xmms_medialib_session_begin (medialib);
+	url = xmms_medialib_entry_property_get_str (session, second,
+	                                            XMMS_MEDIALIB_ENTRY_PROPERTY_URL);
+	xmms_medialib_entry_remove (session, first);
+	xmms_medialib_entry_remove (session, second);
+	xmms_medialib_session_commit (session);
+
+	CU_ASSERT_EQUAL (2, xmms_medialib_restore (medialib, path, &err));
+	CU_ASSERT_FALSE (xmms_error_iserror (&err));
+
+	/* restoring again merges with the entries of the same url */
+	CU_ASSERT_EQUAL (2, xmms_medialib_restore (medialib, path, &err));
+
+	session = xmms_medialib_session_begin (medialib);
+	CU_ASSERT_EQUAL (4, xmms_medialib_highest_id (session));
+	entry = xmms_medialib_entry_new_encoded (session, url, &err);
+	CU_ASSERT_EQUAL (2, xmms_medialib_entry_property_get_int (session, entry,
+	                                                          XMMS_MEDIALIB_ENTRY_PROPERTY_TRACKNR));
+	title = xmms_medialib_entry_property_get_str (session, entry,
+	                                              XMMS_MEDIALIB_ENTRY_PROPERTY_TITLE);
+	CU_ASSERT_STRING_EQUAL ("Reverse\tThunder\n", title);
+	xmms_medialib_session_commit (session);
+
+	/* the file is not a dump */
+	CU_ASSERT_EQUAL (-1, xmms_medialib_restore (medialib, dir, &err));
+	CU_ASSERT_TRUE (xmms_error_iserror (&err));
+
+	g_unlink (path);
+	g_rmdir (dir);
+
+	g_free (title);
+	g_free (url);
+	g_free (path);
+	g_free (dir);
+}
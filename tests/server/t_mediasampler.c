@@ -0,0 +1,150 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <glib.h>
+
+#include <xmmspriv/xmms_mediasampler.h>
+#include <xmmsc/xmmsv.h>
+
+static xmms_media_sampler_t *sampler;
+static GBytes *key;
+
+SETUP (mediasampler) {
+	sampler = xmms_media_sampler_new (2);
+	key = g_bytes_new_static ("source", 6);
+	return 0;
+}
+
+CLEANUP () {
+	g_bytes_unref (key);
+	xmms_media_sampler_free (sampler);
+	return 0;
+}
+
+static xmmsv_t *
+id_list (gint first, gint count)
+{
+	xmmsv_t *list = xmmsv_new_list ();
+	gint i;
+
+	for (i = 0; i < count; i++) {
+		xmmsv_list_append_int (list, first + i);
+	}
+
+	return list;
+}
+
+CASE (test_sample_members)
+{
+	xmms_medialib_entry_t out[64];
+	xmmsv_t *ids;
+	gint i;
+
+	CU_ASSERT_FALSE (xmms_media_sampler_lookup (sampler, key));
+	CU_ASSERT_EQUAL (0, xmms_media_sampler_sample (sampler, key, 1, out));
+
+	ids = id_list (10, 5);
+	xmms_media_sampler_insert (sampler, key, ids);
+	xmmsv_unref (ids);
+
+	CU_ASSERT_TRUE (xmms_media_sampler_lookup (sampler, key));
+	CU_ASSERT_EQUAL (64, xmms_media_sampler_sample (sampler, key, 64, out));
+	for (i = 0; i < 64; i++) {
+		CU_ASSERT_TRUE (out[i] >= 10 && out[i] < 15);
+	}
+}
+
+CASE (test_removed_entries_are_never_sampled)
+{
+	xmms_medialib_entry_t out[64];
+	xmmsv_t *ids;
+	gint i;
+
+	ids = id_list (1, 3);
+	xmms_media_sampler_insert (sampler, key, ids);
+	xmmsv_unref (ids);
+
+	xmms_media_sampler_entry_removed (sampler, 1);
+	xmms_media_sampler_entry_removed (sampler, 3);
+
+	CU_ASSERT_EQUAL (64, xmms_media_sampler_sample (sampler, key, 64, out));
+	for (i = 0; i < 64; i++) {
+		CU_ASSERT_EQUAL (2, out[i]);
+	}
+
+	xmms_media_sampler_entry_removed (sampler, 2);
+	CU_ASSERT_EQUAL (0, xmms_media_sampler_sample (sampler, key, 1, out));
+}
+
+CASE (test_changed_entries_are_rechecked)
+{
+	xmms_medialib_entry_t out[64];
+	xmmsv_t *ids, *pending, *members;
+	gint i;
+
+	ids = id_list (1, 2);
+	xmms_media_sampler_insert (sampler, key, ids);
+	xmmsv_unref (ids);
+
+	CU_ASSERT_PTR_NULL (xmms_media_sampler_pending_take (sampler, key));
+
+	/* 5 was added and matches, 1 changed and no longer does */
+	xmms_media_sampler_entry_changed (sampler, 5);
+	xmms_media_sampler_entry_changed (sampler, 1);
+
+	pending = xmms_media_sampler_pending_take (sampler, key);
+	CU_ASSERT_PTR_NOT_NULL (pending);
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (pending));
+	CU_ASSERT_PTR_NULL (xmms_media_sampler_pending_take (sampler, key));
+
+	members = id_list (5, 1);
+	xmms_media_sampler_update (sampler, key, pending, members);
+	xmmsv_unref (members);
+	xmmsv_unref (pending);
+
+	CU_ASSERT_EQUAL (64, xmms_media_sampler_sample (sampler, key, 64, out));
+	for (i = 0; i < 64; i++) {
+		CU_ASSERT_TRUE (out[i] == 2 || out[i] == 5);
+	}
+}
+
+CASE (test_least_recently_used_set_is_evicted)
+{
+	GBytes *other, *third;
+	xmmsv_t *ids;
+
+	other = g_bytes_new_static ("other", 5);
+	third = g_bytes_new_static ("third", 5);
+
+	ids = id_list (1, 1);
+	xmms_media_sampler_insert (sampler, key, ids);
+	xmms_media_sampler_insert (sampler, other, ids);
+	CU_ASSERT_TRUE (xmms_media_sampler_lookup (sampler, key));
+	xmms_media_sampler_insert (sampler, third, ids);
+	xmmsv_unref (ids);
+
+	CU_ASSERT_TRUE (xmms_media_sampler_lookup (sampler, key));
+	CU_ASSERT_FALSE (xmms_media_sampler_lookup (sampler, other));
+	CU_ASSERT_TRUE (xmms_media_sampler_lookup (sampler, third));
+
+	xmms_media_sampler_clear (sampler);
+	CU_ASSERT_FALSE (xmms_media_sampler_lookup (sampler, key));
+
+	g_bytes_unref (other);
+	g_bytes_unref (third);
+}
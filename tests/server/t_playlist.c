@@ -92,9 +92,9 @@ CASE (test_basic_functionality)
 
 	/* XMMS_PLAYLIST_CHANGED_ADD = 0, XMMS_PLAYLIST_CHANGED_UPDATE = 7 */
 	expected = xmmsv_from_xson ("[{                         'type': 7, 'name': 'Default' },"
-	                            " { 'position': 0, 'id': 2, 'type': 0, 'name': 'Default' },"
+	                            " { 'position': 0, 'id': 2, 'type': 0, 'name': 'Default', 'version': 1 },"
 	                            " {                         'type': 7, 'name': 'Default' },"
-	                            " { 'position': 1, 'id': 3, 'type': 0, 'name': 'Default' }]");
+	                            " { 'position': 1, 'id': 3, 'type': 0, 'name': 'Default', 'version': 2 }]");
 
 	CU_ASSERT (xmmsv_compare (expected, signals));
 	xmmsv_unref (signals);
@@ -211,7 +211,7 @@ CASE(test_medialib_remove)
 
 	result = xmms_future_await (future1, 2);
 	expected = xmmsv_from_xson ("[{                'type': 7, 'name': 'Default' },"
-	                            " { 'position': 0, 'type': 3, 'name': 'Default' }]");
+	                            " { 'position': 0, 'type': 3, 'name': 'Default', 'version': 3 }]");
 	CU_ASSERT (xmmsv_compare (expected, result));
 	xmmsv_unref (result);
 	xmmsv_unref (expected);
@@ -354,6 +354,137 @@ CASE(test_client_replace)
 	xmmsv_unref (empty);
 }
 
+#define REPLACE_RACE_ENTRIES 64
+
+typedef struct {
+	xmms_medialib_entry_t entries[REPLACE_RACE_ENTRIES];
+	gint done;
+} replace_race_t;
+
+static gpointer
+replace_race_add (gpointer udata)
+{
+	replace_race_t *race = udata;
+	xmms_error_t err;
+	gint i;
+
+	for (i = 1; i < REPLACE_RACE_ENTRIES; i++) {
+		xmms_error_reset (&err);
+		xmms_playlist_add_entry (playlist, "Default", race->entries[i], &err);
+		g_usleep (500);
+	}
+
+	g_atomic_int_set (&race->done, 1);
+
+	return NULL;
+}
+
+/* A sort replaces the playlist with an order over its own entries,
+ * entries added while it is being queried must not be lost. */
+CASE(test_client_replace_concurrent_add)
+{
+	replace_race_t race = { { 0 }, 0 };
+	xmmsv_t *reference, *order, *ordered, *result;
+	xmms_error_t err;
+	GThread *thread;
+	gint i, j, id;
+
+	for (i = 0; i < REPLACE_RACE_ENTRIES; i++) {
+		gchar *title = g_strdup_printf ("Track %d", i);
+		race.entries[i] = xmms_mock_entry (medialib, i + 1, "Red Fang", "Red Fang", title);
+		g_free (title);
+	}
+
+	xmms_error_reset (&err);
+	xmms_playlist_add_entry (playlist, "Default", race.entries[0], &err);
+
+	reference = xmmsv_new_coll (XMMS_COLLECTION_TYPE_REFERENCE);
+	xmmsv_coll_attribute_set_string (reference, "namespace", "Playlists");
+	xmmsv_coll_attribute_set_string (reference, "reference", "Default");
+
+	order = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("-tracknr"), XMMSV_LIST_END);
+	ordered = xmmsv_coll_add_order_operators (reference, order);
+	xmmsv_unref (reference);
+	xmmsv_unref (order);
+
+	thread = g_thread_new ("replace race", replace_race_add, &race);
+
+	while (!g_atomic_int_get (&race.done)) {
+		result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_REPLACE,
+		                        xmmsv_new_string ("Default"),
+		                        xmmsv_ref (ordered),
+		                        xmmsv_new_int (XMMS_PLAYLIST_CURRENT_ID_KEEP));
+		CU_ASSERT (xmmsv_is_type (result, XMMSV_TYPE_NONE));
+		xmmsv_unref (result);
+	}
+
+	g_thread_join (thread);
+	xmmsv_unref (ordered);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_LIST_ENTRIES,
+	                        xmmsv_new_string ("Default"));
+	CU_ASSERT_EQUAL (REPLACE_RACE_ENTRIES, xmmsv_list_get_size (result));
+	for (i = 0; i < REPLACE_RACE_ENTRIES; i++) {
+		for (j = 0; xmmsv_list_get_int (result, j, &id); j++) {
+			if (id == race.entries[i]) {
+				break;
+			}
+		}
+		CU_ASSERT_EQUAL (race.entries[i], id);
+	}
+	xmmsv_unref (result);
+}
+
+CASE(test_client_changes_since)
+{
+	xmms_medialib_entry_t first, second;
+	xmms_error_t err;
+	xmmsv_t *result, *list;
+	gint epoch, version;
+
+	first  = xmms_mock_entry (medialib, 1, "Red Fang", "Red Fang", "Prehistoric Dog");
+	second = xmms_mock_entry (medialib, 2, "Red Fang", "Red Fang", "Reverse Thunder");
+
+	/* an unknown epoch gets the whole playlist */
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CHANGES_SINCE,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (0), xmmsv_new_int (0));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (result, "epoch", &epoch));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (result, "version", &version));
+	CU_ASSERT_TRUE (xmmsv_dict_get (result, "entries", &list));
+	CU_ASSERT_EQUAL (0, xmmsv_list_get_size (list));
+	CU_ASSERT_EQUAL (0, version);
+	xmmsv_unref (result);
+
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, first, &err);
+	xmms_playlist_add_entry (playlist, XMMS_ACTIVE_PLAYLIST, second, &err);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CHANGES_SINCE,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (epoch), xmmsv_new_int (0));
+	CU_ASSERT_TRUE (xmmsv_dict_entry_get_int (result, "version", &version));
+	CU_ASSERT_EQUAL (2, version);
+	CU_ASSERT_FALSE (xmmsv_dict_has_key (result, "entries"));
+	CU_ASSERT_TRUE (xmmsv_dict_get (result, "changes", &list));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (list));
+	xmmsv_unref (result);
+
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CHANGES_SINCE,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (epoch), xmmsv_new_int (2));
+	CU_ASSERT_TRUE (xmmsv_dict_get (result, "changes", &list));
+	CU_ASSERT_EQUAL (0, xmmsv_list_get_size (list));
+	xmmsv_unref (result);
+
+	/* a version from another epoch isn't trusted */
+	result = XMMS_IPC_CALL (playlist, XMMS_IPC_COMMAND_PLAYLIST_CHANGES_SINCE,
+	                        xmmsv_new_string ("Default"),
+	                        xmmsv_new_int (epoch + 1), xmmsv_new_int (2));
+	CU_ASSERT_TRUE (xmmsv_dict_get (result, "entries", &list));
+	CU_ASSERT_EQUAL (2, xmmsv_list_get_size (list));
+	xmmsv_unref (result);
+}
+
 CASE(test_client_current_active)
 {
 	xmmsv_t *result;
@@ -0,0 +1,208 @@
+/*  XMMS2 - X Music Multiplexer System
+ *  Copyright (C) 2003-2023 XMMS2 Team
+ *
+ *  PLUGINS ARE NOT CONSIDERED TO BE DERIVED WORK !!!
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ */
+
+#include "xcu.h"
+
+#include <glib.h>
+#include <string.h>
+
+#include <xmmspriv/xmms_ringbuf.h>
+
+SETUP (ringbuf) {
+	return 0;
+}
+
+CLEANUP () {
+	return 0;
+}
+
+static gboolean
+count_hotspot (void *arg)
+{
+	gint *count = arg;
+
+	(*count)++;
+
+	return TRUE;
+}
+
+CASE (test_resize_keeps_data)
+{
+	xmms_ringbuf_t *rb;
+	guint8 in[48], out[48];
+	gint i, spots = 0;
+
+	for (i = 0; i < 48; i++) {
+		in[i] = i;
+	}
+
+	rb = xmms_ringbuf_new (64);
+
+	/* wrap the data around the end of the buffer */
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_write (rb, in, 48));
+	CU_ASSERT_EQUAL (40, xmms_ringbuf_read (rb, out, 40));
+	CU_ASSERT_EQUAL (40, xmms_ringbuf_write (rb, in, 40));
+	xmms_ringbuf_hotspot_set (rb, count_hotspot, NULL, &spots);
+	CU_ASSERT_EQUAL (8, xmms_ringbuf_write (rb, in + 40, 8));
+
+	CU_ASSERT_EQUAL (256, xmms_ringbuf_resize (rb, 256));
+	CU_ASSERT_EQUAL (256, xmms_ringbuf_size (rb));
+	CU_ASSERT_EQUAL (56, xmms_ringbuf_bytes_used (rb));
+
+	/* stops right before the hotspot */
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_read (rb, out, 48));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 40, 8));
+	CU_ASSERT_EQUAL (0, memcmp (out + 8, in, 40));
+	CU_ASSERT_EQUAL (0, spots);
+
+	CU_ASSERT_EQUAL (8, xmms_ringbuf_read (rb, out, 48));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 40, 8));
+	CU_ASSERT_EQUAL (1, spots);
+
+	xmms_ringbuf_destroy (rb);
+}
+
+CASE (test_resize_never_drops_data)
+{
+	xmms_ringbuf_t *rb;
+	guint8 in[48], out[48];
+
+	memset (in, 0x5a, sizeof (in));
+
+	rb = xmms_ringbuf_new (64);
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_write (rb, in, 48));
+
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_resize (rb, 16));
+	CU_ASSERT_EQUAL (0, xmms_ringbuf_bytes_free (rb));
+
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_read (rb, out, 48));
+	CU_ASSERT_EQUAL (0, memcmp (out, in, 48));
+
+	xmms_ringbuf_destroy (rb);
+}
+
+CASE (test_history_rewind_and_skip)
+{
+	xmms_ringbuf_t *rb;
+	guint8 in[64], out[64];
+	gint i;
+
+	for (i = 0; i < 64; i++) {
+		in[i] = i;
+	}
+
+	rb = xmms_ringbuf_new (64);
+	xmms_ringbuf_set_history (rb, 16);
+
+	/* the history is never handed to the writer */
+	CU_ASSERT_EQUAL (48, xmms_ringbuf_write (rb, in, 64));
+	CU_ASSERT_EQUAL (40, xmms_ringbuf_read (rb, out, 40));
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_history (rb));
+	CU_ASSERT_EQUAL (40, xmms_ringbuf_write (rb, in + 48, 16) +
+	                     xmms_ringbuf_write (rb, in, 24));
+	CU_ASSERT_EQUAL (0, xmms_ringbuf_bytes_free (rb));
+
+	/* the last 16 bytes read are still there */
+	CU_ASSERT_FALSE (xmms_ringbuf_rewind (rb, 17));
+	CU_ASSERT_TRUE (xmms_ringbuf_rewind (rb, 10));
+	CU_ASSERT_EQUAL (6, xmms_ringbuf_history (rb));
+	CU_ASSERT_EQUAL (10, xmms_ringbuf_read (rb, out, 10));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 30, 10));
+
+	CU_ASSERT_EQUAL (20, xmms_ringbuf_skip (rb, 20));
+	CU_ASSERT_EQUAL (4, xmms_ringbuf_read (rb, out, 4));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 60, 4));
+
+	xmms_ringbuf_clear (rb);
+	CU_ASSERT_EQUAL (0, xmms_ringbuf_history (rb));
+	CU_ASSERT_FALSE (xmms_ringbuf_rewind (rb, 1));
+
+	xmms_ringbuf_destroy (rb);
+}
+
+CASE (test_forward_stops_before_hotspots)
+{
+	xmms_ringbuf_t *rb;
+	guint8 in[32], out[32];
+	gint i, spots = 0;
+
+	for (i = 0; i < 32; i++) {
+		in[i] = i;
+	}
+
+	rb = xmms_ringbuf_new (64);
+	xmms_ringbuf_set_history (rb, 8);
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_write (rb, in, 16));
+	xmms_ringbuf_hotspot_set (rb, count_hotspot, NULL, &spots);
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_write (rb, in + 16, 16));
+
+	/* all or nothing, and never across the hotspot */
+	CU_ASSERT_FALSE (xmms_ringbuf_forward (rb, 17));
+	CU_ASSERT_TRUE (xmms_ringbuf_forward (rb, 10));
+	CU_ASSERT_EQUAL (8, xmms_ringbuf_history (rb));
+	CU_ASSERT_TRUE (xmms_ringbuf_forward (rb, 6));
+	CU_ASSERT_EQUAL (0, spots);
+
+	/* it is still run by the next read */
+	CU_ASSERT_FALSE (xmms_ringbuf_forward (rb, 1));
+	CU_ASSERT_EQUAL (4, xmms_ringbuf_read (rb, out, 4));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 16, 4));
+	CU_ASSERT_EQUAL (1, spots);
+
+	CU_ASSERT_TRUE (xmms_ringbuf_rewind (rb, 8));
+	CU_ASSERT_TRUE (xmms_ringbuf_forward (rb, 8));
+	CU_ASSERT_FALSE (xmms_ringbuf_forward (rb, 13));
+	CU_ASSERT_EQUAL (12, xmms_ringbuf_read (rb, out, 32));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 20, 12));
+
+	xmms_ringbuf_destroy (rb);
+}
+
+CASE (test_try_read_leaves_hotspots)
+{
+	xmms_ringbuf_t *rb;
+	guint8 in[32], out[32];
+	gboolean held = FALSE;
+	gint i, spots = 0;
+
+	for (i = 0; i < 32; i++) {
+		in[i] = i;
+	}
+
+	rb = xmms_ringbuf_new (64);
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_write (rb, in, 16));
+	xmms_ringbuf_hotspot_set (rb, count_hotspot, NULL, &spots);
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_write (rb, in + 16, 16));
+
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_try_read (rb, out, 32, &held));
+	CU_ASSERT_EQUAL (0, memcmp (out, in, 16));
+	CU_ASSERT_FALSE (held);
+
+	/* the hotspot stays for someone else to run */
+	CU_ASSERT_EQUAL (0, xmms_ringbuf_try_read (rb, out, 32, &held));
+	CU_ASSERT_TRUE (held);
+	CU_ASSERT_EQUAL (0, spots);
+
+	CU_ASSERT_EQUAL (1, xmms_ringbuf_peek (rb, out, 1));
+	CU_ASSERT_EQUAL (1, spots);
+
+	held = FALSE;
+	CU_ASSERT_EQUAL (16, xmms_ringbuf_try_read (rb, out, 32, &held));
+	CU_ASSERT_EQUAL (0, memcmp (out, in + 16, 16));
+	CU_ASSERT_FALSE (held);
+
+	xmms_ringbuf_destroy (rb);
+}
@@ -262,6 +262,72 @@ CASE (test_nomatch3)
 
 }
 
+CASE (test_match_url_pattern)
+{
+	xmms_stream_type_t *st1, *st2, *st3;
+
+	st1 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_MIMETYPE, "application/test",
+	                             XMMS_STREAM_TYPE_URL, "test://*",
+	                             XMMS_STREAM_TYPE_END);
+	st2 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_MIMETYPE, "application/test",
+	                             XMMS_STREAM_TYPE_URL, "test://some/file",
+	                             XMMS_STREAM_TYPE_END);
+	st3 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_MIMETYPE, "application/test",
+	                             XMMS_STREAM_TYPE_URL, "file://some/file",
+	                             XMMS_STREAM_TYPE_END);
+
+	CU_ASSERT_TRUE (xmms_stream_type_match (st1, st2));
+	CU_ASSERT_FALSE (xmms_stream_type_match (st1, st3));
+	CU_ASSERT_FALSE (xmms_stream_type_match (st2, st3));
+
+	xmms_object_unref (st1);
+	xmms_object_unref (st2);
+	xmms_object_unref (st3);
+}
+
+CASE (test_match_format)
+{
+	xmms_stream_type_t *st1, *st2;
+	gchar *key1, *key2;
+
+	st1 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                             XMMS_STREAM_TYPE_FMT_CHANNELS, 2,
+	                             XMMS_STREAM_TYPE_END);
+	st2 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_FMT_CHANNELS, 2,
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_END);
+
+	CU_ASSERT_TRUE (xmms_stream_type_match (st1, st2));
+	CU_ASSERT_TRUE (xmms_stream_type_match (st2, st1));
+
+	/* the same values give the same key, whatever their order */
+	key1 = xmms_stream_type_key (st1);
+	key2 = xmms_stream_type_key (st2);
+	CU_ASSERT_STRING_EQUAL (key1, key2);
+	g_free (key1);
+	g_free (key2);
+
+	xmms_object_unref (st2);
+
+	st2 = _xmms_stream_type_new ("dummy",
+	                             XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                             XMMS_STREAM_TYPE_FMT_FORMAT, XMMS_SAMPLE_FORMAT_S16,
+	                             XMMS_STREAM_TYPE_FMT_CHANNELS, 1,
+	                             XMMS_STREAM_TYPE_END);
+
+	CU_ASSERT_FALSE (xmms_stream_type_match (st1, st2));
+
+	xmms_object_unref (st1);
+	xmms_object_unref (st2);
+}
+
 static void
 destroy_list (gpointer data, gpointer user_data)
 {
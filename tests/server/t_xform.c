@@ -19,6 +19,7 @@
 #include <glib.h>
 
 #include <locale.h>
+#include <string.h>
 
 #include <xmmspriv/xmms_plugin.h>
 #include <xmmspriv/xmms_xform.h>
@@ -286,3 +287,388 @@ CASE(test_browse)
 	CU_ASSERT_BROWSE_ENTRY (result, 5, "file:///Last_Directory", 1, 0);
 	xmmsv_unref (result);
 }
+
+static gint fuse_test_effect_reads;
+static gint fuse_test_effect_blocks;
+
+static gint
+xmms_fuse_test_source_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                            xmms_error_t *error)
+{
+	gint *pos = xmms_xform_private_data_get (xform);
+	guchar *data = buf;
+	gint i;
+
+	len = MIN (len, 8192 - *pos);
+	for (i = 0; i < len; i++, (*pos)++) {
+		data[i] = *pos & 0x3f;
+	}
+
+	return len;
+}
+
+static gboolean
+xmms_fuse_test_source_init (xmms_xform_t *xform)
+{
+	xmms_xform_private_data_set (xform, g_new0 (gint, 1));
+	xmms_xform_outdata_type_add (xform, XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm", XMMS_STREAM_TYPE_END);
+	return TRUE;
+}
+
+static void
+xmms_fuse_test_source_destroy (xmms_xform_t *xform)
+{
+	g_free (xmms_xform_private_data_get (xform));
+}
+
+static gboolean
+xmms_fuse_test_source_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+
+	methods.init = xmms_fuse_test_source_init;
+	methods.destroy = xmms_fuse_test_source_destroy;
+	methods.read = xmms_fuse_test_source_read;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE, "application/x-url",
+	                              XMMS_STREAM_TYPE_URL, "fusetest://*",
+	                              XMMS_STREAM_TYPE_END);
+
+	return TRUE;
+}
+
+XMMS_XFORM_BUILTIN_DEFINE (fuse_test_source,
+                           "fuse test source",
+                           XMMS_VERSION,
+                           "fuse test source",
+                           xmms_fuse_test_source_plugin_setup);
+
+static gboolean
+xmms_fuse_test_effect_init (xmms_xform_t *xform)
+{
+	xmms_xform_outdata_type_copy (xform);
+	return TRUE;
+}
+
+static void
+xmms_fuse_test_inc_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len)
+{
+	guchar *data = buf;
+	gint i;
+
+	fuse_test_effect_blocks++;
+
+	for (i = 0; i < len; i++) {
+		data[i] += 1;
+	}
+}
+
+static void
+xmms_fuse_test_double_process (xmms_xform_t *xform, xmms_sample_t *buf, gint len)
+{
+	guchar *data = buf;
+	gint i;
+
+	for (i = 0; i < len; i++) {
+		data[i] *= 2;
+	}
+}
+
+/* only used when the effects are not fused */
+static gint
+xmms_fuse_test_inc_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                         xmms_error_t *error)
+{
+	fuse_test_effect_reads++;
+
+	len = xmms_xform_read (xform, buf, len, error);
+	if (len > 0) {
+		xmms_fuse_test_inc_process (xform, buf, len);
+	}
+
+	return len;
+}
+
+static gint
+xmms_fuse_test_double_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                            xmms_error_t *error)
+{
+	fuse_test_effect_reads++;
+
+	len = xmms_xform_read (xform, buf, len, error);
+	if (len > 0) {
+		xmms_fuse_test_double_process (xform, buf, len);
+	}
+
+	return len;
+}
+
+static void
+xmms_fuse_test_effect_setup (xmms_xform_plugin_t *xform_plugin,
+                             gint (*read)(xmms_xform_t *, gpointer, gint, xmms_error_t *),
+                             void (*process)(xmms_xform_t *, gpointer, gint))
+{
+	xmms_xform_methods_t methods;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+
+	methods.init = xmms_fuse_test_effect_init;
+	methods.read = read;
+	methods.seek = xmms_xform_seek;
+	methods.process = process;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE, "audio/pcm",
+	                              XMMS_STREAM_TYPE_END);
+}
+
+static gboolean
+xmms_fuse_test_inc_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_fuse_test_effect_setup (xform_plugin, xmms_fuse_test_inc_read,
+	                             xmms_fuse_test_inc_process);
+	return TRUE;
+}
+
+static gboolean
+xmms_fuse_test_double_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_fuse_test_effect_setup (xform_plugin, xmms_fuse_test_double_read,
+	                             xmms_fuse_test_double_process);
+	return TRUE;
+}
+
+XMMS_XFORM_BUILTIN_DEFINE (fuse_test_inc,
+                           "fuse test increment",
+                           XMMS_VERSION,
+                           "fuse test increment",
+                           xmms_fuse_test_inc_plugin_setup);
+
+XMMS_XFORM_BUILTIN_DEFINE (fuse_test_double,
+                           "fuse test double",
+                           XMMS_VERSION,
+                           "fuse test double",
+                           xmms_fuse_test_double_plugin_setup);
+
+/* reads the whole stream, checking that both effects were applied */
+static gint
+fuse_test_read_all (gboolean fuse)
+{
+	xmms_medialib_session_t *session;
+	xmms_stream_type_t *format;
+	xmms_error_t err;
+	xmms_xform_t *xform;
+	GList *goal_format;
+	guchar buf[1000];
+	gint i, r, pos = 0, bad = 0;
+
+	xmms_config_property_set_data (xmms_config_lookup ("effect.fuse"),
+	                               fuse ? "1" : "0");
+
+	format = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                                XMMS_STREAM_TYPE_MIMETYPE,
+	                                "audio/pcm",
+	                                XMMS_STREAM_TYPE_END);
+	goal_format = g_list_prepend (NULL, format);
+
+	session = xmms_medialib_session_begin (medialib);
+	xform = xmms_xform_chain_setup_url_session (medialib, session, 1,
+	                                            "fusetest://", goal_format,
+	                                            FALSE);
+	xmms_medialib_session_abort (session);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (xform);
+
+	xmms_error_reset (&err);
+	while ((r = xmms_xform_this_read (xform, buf, sizeof (buf), &err)) > 0) {
+		for (i = 0; i < r; i++, pos++) {
+			if (buf[i] != ((pos & 0x3f) + 1) * 2) {
+				bad++;
+			}
+		}
+	}
+
+	CU_ASSERT_EQUAL (0, r);
+	CU_ASSERT_EQUAL (8192, pos);
+
+	xmms_object_unref (xform);
+	g_list_free (goal_format);
+	xmms_object_unref (format);
+
+	return bad;
+}
+
+CASE(test_fused_effects)
+{
+	xmms_plugin_load (&xmms_builtin_fuse_test_source, NULL);
+	xmms_plugin_load (&xmms_builtin_fuse_test_inc, NULL);
+	xmms_plugin_load (&xmms_builtin_fuse_test_double, NULL);
+
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.0"),
+	                               "fuse_test_inc");
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.1"),
+	                               "fuse_test_double");
+
+	/* fused, the effects don't read at all */
+	fuse_test_effect_reads = fuse_test_effect_blocks = 0;
+	CU_ASSERT_EQUAL (0, fuse_test_read_all (TRUE));
+	CU_ASSERT_EQUAL (0, fuse_test_effect_reads);
+	CU_ASSERT_TRUE (fuse_test_effect_blocks > 0);
+
+	/* and the same output through separate reads */
+	fuse_test_effect_reads = 0;
+	CU_ASSERT_EQUAL (0, fuse_test_read_all (FALSE));
+	CU_ASSERT_TRUE (fuse_test_effect_reads > 0);
+
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.0"), "");
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.1"), "");
+}
+
+static gint hotspot_test_reads;
+static gint hotspot_test_bad;
+
+/* every block of 100 bytes is preceded by a hotspot with its number */
+static gint
+xmms_hotspot_test_source_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                               xmms_error_t *error)
+{
+	gint *block = xmms_xform_private_data_get (xform);
+
+	if (*block == 50) {
+		return 0;
+	}
+
+	xmms_xform_auxdata_set_int (xform, "block", *block);
+
+	len = MIN (len, 100);
+	memset (buf, *block, len);
+	(*block)++;
+
+	return len;
+}
+
+static gboolean
+xmms_hotspot_test_source_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_xform_methods_t methods;
+
+	XMMS_XFORM_METHODS_INIT (methods);
+
+	methods.init = xmms_fuse_test_source_init;
+	methods.destroy = xmms_fuse_test_source_destroy;
+	methods.read = xmms_hotspot_test_source_read;
+
+	xmms_xform_plugin_methods_set (xform_plugin, &methods);
+
+	xmms_xform_plugin_indata_add (xform_plugin,
+	                              XMMS_STREAM_TYPE_MIMETYPE, "application/x-url",
+	                              XMMS_STREAM_TYPE_URL, "hotspottest://*",
+	                              XMMS_STREAM_TYPE_END);
+
+	return TRUE;
+}
+
+/* reads never span a hotspot, and peeked data is what is read next */
+static gint
+xmms_hotspot_test_check_read (xmms_xform_t *xform, xmms_sample_t *buf, gint len,
+                              xmms_error_t *error)
+{
+	guchar peeked[10], *data = buf;
+	gint64 block = -1;
+	gint i, npeeked = 0;
+
+	if (hotspot_test_reads++ % 2) {
+		npeeked = xmms_xform_peek (xform, peeked, sizeof (peeked), error);
+	}
+
+	xmms_xform_auxdata_get_int64 (xform, "block", &block);
+
+	len = xmms_xform_read (xform, buf, len, error);
+
+	for (i = 0; i < len; i++) {
+		if (block != -1 && data[i] != block) {
+			hotspot_test_bad++;
+		}
+	}
+	for (i = 0; i < MIN (npeeked, len); i++) {
+		if (peeked[i] != data[i]) {
+			hotspot_test_bad++;
+		}
+	}
+
+	return len;
+}
+
+static gboolean
+xmms_hotspot_test_check_plugin_setup (xmms_xform_plugin_t *xform_plugin)
+{
+	xmms_fuse_test_effect_setup (xform_plugin, xmms_hotspot_test_check_read,
+	                             NULL);
+	return TRUE;
+}
+
+XMMS_XFORM_BUILTIN_DEFINE (hotspot_test_source,
+                           "hotspot test source",
+                           XMMS_VERSION,
+                           "hotspot test source",
+                           xmms_hotspot_test_source_plugin_setup);
+
+XMMS_XFORM_BUILTIN_DEFINE (hotspot_test_check,
+                           "hotspot test check",
+                           XMMS_VERSION,
+                           "hotspot test check",
+                           xmms_hotspot_test_check_plugin_setup);
+
+CASE(test_hotspots)
+{
+	xmms_medialib_session_t *session;
+	xmms_stream_type_t *format;
+	xmms_error_t err;
+	xmms_xform_t *xform;
+	GList *goal_format;
+	guchar buf[1000];
+	gint r, total = 0;
+
+	xmms_plugin_load (&xmms_builtin_hotspot_test_source, NULL);
+	xmms_plugin_load (&xmms_builtin_hotspot_test_check, NULL);
+
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.0"),
+	                               "hotspot_test_check");
+
+	format = _xmms_stream_type_new (XMMS_STREAM_TYPE_BEGIN,
+	                                XMMS_STREAM_TYPE_MIMETYPE,
+	                                "audio/pcm",
+	                                XMMS_STREAM_TYPE_END);
+	goal_format = g_list_prepend (NULL, format);
+
+	session = xmms_medialib_session_begin (medialib);
+	xform = xmms_xform_chain_setup_url_session (medialib, session, 1,
+	                                            "hotspottest://", goal_format,
+	                                            FALSE);
+	xmms_medialib_session_abort (session);
+	CU_ASSERT_PTR_NOT_NULL_FATAL (xform);
+
+	hotspot_test_reads = hotspot_test_bad = 0;
+
+	xmms_error_reset (&err);
+	while ((r = xmms_xform_this_read (xform, buf, sizeof (buf), &err)) > 0) {
+		total += r;
+	}
+
+	CU_ASSERT_EQUAL (0, r);
+	CU_ASSERT_EQUAL (5000, total);
+	CU_ASSERT_EQUAL (0, hotspot_test_bad);
+	CU_ASSERT_TRUE (hotspot_test_reads >= 50);
+
+	xmms_object_unref (xform);
+	g_list_free (goal_format);
+	xmms_object_unref (format);
+
+	xmms_config_property_set_data (xmms_config_lookup ("effect.order.0"), "");
+}
@@ -540,6 +540,67 @@ CASE (test_xmmsv_type_list_restrict_2) {
 
 }
 
+CASE (test_xmmsv_type_list_packed) {
+	xmmsv_t *value, *copy, *tmp, *boxed;
+	xmmsv_list_iter_t *it;
+	int sorted[] = {0, 1, 2, 4, 5, 6, 7, 7, 8, 9};
+	int32_t ival;
+	int i;
+
+	value = xmmsv_new_list ();
+	CU_ASSERT_TRUE (xmmsv_list_restrict_type (value, XMMSV_TYPE_INT64));
+
+	for (i = 0; i < 10; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_append_int (value, i));
+	}
+
+	/* boxed access hands out a value that stays valid across moves */
+	CU_ASSERT_TRUE (xmmsv_list_get (value, 3, &boxed));
+	CU_ASSERT_TRUE (xmmsv_get_int (boxed, &ival));
+	CU_ASSERT_EQUAL (3, ival);
+
+	CU_ASSERT_TRUE (xmmsv_list_move (value, 3, 0));
+	CU_ASSERT_TRUE (xmmsv_list_get (value, 0, &tmp));
+	CU_ASSERT_PTR_EQUAL (boxed, tmp);
+
+	CU_ASSERT_TRUE (xmmsv_list_set_int (value, 0, 42));
+	CU_ASSERT_TRUE (xmmsv_list_get_int (value, 0, &ival));
+	CU_ASSERT_EQUAL (42, ival);
+
+	tmp = xmmsv_new_string ("x");
+	CU_ASSERT_FALSE (xmmsv_list_append (value, tmp));
+	CU_ASSERT_FALSE (xmmsv_list_set (value, 0, tmp));
+	xmmsv_unref (tmp);
+
+	CU_ASSERT_TRUE (xmmsv_list_insert_int (value, 1, 7));
+	CU_ASSERT_TRUE (xmmsv_list_remove (value, 0));
+	CU_ASSERT_EQUAL (10, xmmsv_list_get_size (value));
+
+	/* { 7, 0, 1, 2, 4, ... 9 } */
+	CU_ASSERT_TRUE (xmmsv_get_list_iter (value, &it));
+	CU_ASSERT_TRUE (xmmsv_list_iter_entry_int (it, &ival));
+	CU_ASSERT_EQUAL (7, ival);
+	xmmsv_list_iter_next (it);
+	CU_ASSERT_TRUE (xmmsv_list_iter_entry (it, &tmp));
+	CU_ASSERT_TRUE (xmmsv_get_int (tmp, &ival));
+	CU_ASSERT_EQUAL (0, ival);
+	xmmsv_list_iter_explicit_destroy (it);
+
+	copy = xmmsv_copy (value);
+	xmmsv_list_sort (copy, list_compare_int);
+
+	for (i = 0; i < 10; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_get_int (copy, i, &ival));
+		CU_ASSERT_EQUAL (sorted[i], ival);
+	}
+
+	CU_ASSERT_TRUE (xmmsv_list_get_int (value, 0, &ival));
+	CU_ASSERT_EQUAL (7, ival);
+
+	xmmsv_unref (copy);
+	xmmsv_unref (value);
+}
+
 static void _dict_foreach (const char *key, xmmsv_t *value, void *udata)
 {
 	CU_ASSERT_EQUAL (xmmsv_get_type (value), XMMSV_TYPE_INT32);
@@ -914,6 +975,43 @@ CASE (test_xmmsv_type_bitbuffer_8_bits)
 	xmmsv_unref (value);
 }
 
+CASE (test_xmmsv_type_bitbuffer_unaligned)
+{
+	const unsigned char data[5] = { 1, 2, 3, 4, 5 };
+	unsigned char out[5];
+	xmmsv_t *value;
+	int64_t r;
+
+	value = xmmsv_new_bitbuffer ();
+
+	/* words and data crossing byte boundaries, and aligned again */
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_bits (value, 3, 5));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_bits (value, 32, -7));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_data (value, data, 5));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_bits (value, 5, 17));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_bits (value, 64, 0x0123456789abcdefLL));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_put_data (value, data, 5));
+	CU_ASSERT_EQUAL (3 + 32 + 40 + 5 + 64 + 40, xmmsv_bitbuffer_len (value));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_rewind (value));
+
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_bits (value, 3, &r));
+	CU_ASSERT_EQUAL (r, 5);
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_bits (value, 32, &r));
+	CU_ASSERT_EQUAL (r, 0xfffffff9);
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_data (value, out, 5));
+	CU_ASSERT_EQUAL (0, memcmp (data, out, 5));
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_bits (value, 5, &r));
+	CU_ASSERT_EQUAL (r, 17);
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_bits (value, 64, &r));
+	CU_ASSERT_EQUAL (r, 0x0123456789abcdefLL);
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_get_data (value, out, 5));
+	CU_ASSERT_EQUAL (0, memcmp (data, out, 5));
+
+	CU_ASSERT_FALSE (xmmsv_bitbuffer_get_bits (value, 1, &r));
+
+	xmmsv_unref (value);
+}
+
 CASE (test_xmmsv_type_bitbuffer)
 {
 	xmmsv_t *value;
@@ -1174,3 +1272,159 @@ CASE (test_xmmsv_deep_copy_collection)
 	xmmsv_unref (u);
 	xmmsv_unref (copy);
 }
+
+CASE (test_xmmsv_freeze)
+{
+	xmmsv_t *dict, *list, *copy, *v;
+	int64_t i;
+
+	list = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (1),
+	                         XMMSV_LIST_ENTRY_INT (2),
+	                         XMMSV_LIST_END);
+	CU_ASSERT_TRUE (xmmsv_list_restrict_type (list, XMMSV_TYPE_INT64));
+
+	dict = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("a", "b"),
+	                         XMMSV_DICT_ENTRY ("list", list),
+	                         XMMSV_DICT_END);
+
+	CU_ASSERT_PTR_EQUAL (dict, xmmsv_freeze (dict));
+	CU_ASSERT_TRUE (xmmsv_is_frozen (dict));
+	CU_ASSERT_TRUE (xmmsv_is_frozen (list));
+
+	CU_ASSERT_FALSE (xmmsv_dict_set_int (dict, "c", 1));
+	CU_ASSERT_FALSE (xmmsv_dict_remove (dict, "a"));
+	CU_ASSERT_FALSE (xmmsv_list_append_int (list, 3));
+	CU_ASSERT_FALSE (xmmsv_list_remove (list, 0));
+	CU_ASSERT_TRUE (xmmsv_list_restrict_type (list, XMMSV_TYPE_INT64));
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (dict, "list", &v));
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (v, 1, &i));
+	CU_ASSERT_EQUAL (2, i);
+
+	copy = xmmsv_copy (dict);
+	CU_ASSERT_FALSE (xmmsv_is_frozen (copy));
+	CU_ASSERT_TRUE (xmmsv_dict_set_int (copy, "c", 1));
+
+	xmmsv_unref (copy);
+	xmmsv_unref (dict);
+}
+
+CASE (test_xmmsv_intern_string)
+{
+	const char *a, *b, *key;
+	char buf[8] = "artist";
+	xmmsv_t *dict, *copy;
+	xmmsv_dict_iter_t *it;
+
+	a = xmmsv_intern_string ("artist");
+	b = xmmsv_intern_string (buf);
+	CU_ASSERT_PTR_NOT_NULL (a);
+	CU_ASSERT_PTR_EQUAL (a, b);
+	CU_ASSERT_STRING_EQUAL ("artist", a);
+
+	dict = xmmsv_new_dict ();
+	CU_ASSERT_TRUE (xmmsv_dict_set_string (dict, buf, "a"));
+	CU_ASSERT_TRUE (xmmsv_dict_set_string (dict, a, "b"));
+	CU_ASSERT_EQUAL (1, xmmsv_dict_get_size (dict));
+	CU_ASSERT_TRUE (xmmsv_dict_has_key (dict, "artist"));
+
+	/* the stored key is the interned one, also in copies */
+	copy = xmmsv_copy (dict);
+	CU_ASSERT_TRUE (xmmsv_get_dict_iter (copy, &it));
+	CU_ASSERT_TRUE (xmmsv_dict_iter_pair (it, &key, NULL));
+	CU_ASSERT_PTR_EQUAL (a, key);
+
+	xmmsv_unref (copy);
+	xmmsv_unref (dict);
+}
+
+CASE (test_xmmsv_arena)
+{
+	xmmsv_arena_t *arena;
+	xmmsv_t *list, *value;
+	const char *s;
+	int i;
+
+	arena = xmmsv_arena_new ();
+	CU_ASSERT_PTR_NULL (xmmsv_arena_use (arena));
+	CU_ASSERT_PTR_EQUAL (arena, xmmsv_arena_current ());
+
+	list = xmmsv_new_list ();
+	for (i = 0; i < 10000; i++) {
+		value = xmmsv_new_string ("a string in the arena");
+		xmmsv_list_append (list, value);
+		xmmsv_unref (value);
+	}
+
+	CU_ASSERT_PTR_EQUAL (arena, xmmsv_arena_use (NULL));
+	xmmsv_arena_release (arena);
+
+	/* values outlive the arena they were allocated from */
+	CU_ASSERT_TRUE (xmmsv_list_get_string (list, 9999, &s));
+	CU_ASSERT_STRING_EQUAL ("a string in the arena", s);
+	CU_ASSERT_TRUE (xmmsv_list_remove (list, 0));
+
+	xmmsv_unref (list);
+}
+
+CASE (test_xmmsv_list_large_head)
+{
+	xmmsv_t *list;
+	int64_t i, v;
+
+	list = xmmsv_new_list ();
+
+	/* large lists insert and remove at the front without moving the tail */
+	for (i = 0; i < 1000; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_insert_int (list, 0, i));
+	}
+	for (i = 0; i < 1000; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, i, &v));
+		CU_ASSERT_EQUAL (999 - i, v);
+	}
+
+	/* used as a queue */
+	for (i = 0; i < 5000; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_remove (list, 0));
+		CU_ASSERT_TRUE (xmmsv_list_append_int (list, 1000 + i));
+	}
+	CU_ASSERT_EQUAL (1000, xmmsv_list_get_size (list));
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, 0, &v));
+	CU_ASSERT_EQUAL (5000, v);
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, -1, &v));
+	CU_ASSERT_EQUAL (5999, v);
+
+	while (xmmsv_list_get_size (list) > 0) {
+		CU_ASSERT_TRUE (xmmsv_list_remove (list, 0));
+	}
+
+	xmmsv_unref (list);
+}
+
+CASE (test_xmmsv_copy_shares_ints)
+{
+	xmmsv_t *list, *copy;
+	int64_t i, v;
+
+	list = xmmsv_new_list ();
+	CU_ASSERT_TRUE (xmmsv_list_restrict_type (list, XMMSV_TYPE_INT64));
+	for (i = 0; i < 100; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_append_int (list, i));
+	}
+
+	copy = xmmsv_copy (list);
+
+	/* either side can be modified without the other noticing */
+	CU_ASSERT_TRUE (xmmsv_list_set_int (copy, 0, -1));
+	CU_ASSERT_TRUE (xmmsv_list_remove (list, 99));
+
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (list, 0, &v));
+	CU_ASSERT_EQUAL (0, v);
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (copy, 0, &v));
+	CU_ASSERT_EQUAL (-1, v);
+	CU_ASSERT_EQUAL (99, xmmsv_list_get_size (list));
+	CU_ASSERT_EQUAL (100, xmmsv_list_get_size (copy));
+
+	xmmsv_unref (list);
+	xmmsv_unref (copy);
+}
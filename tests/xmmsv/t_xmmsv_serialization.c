@@ -617,3 +617,180 @@ CASE (test_xmmsv_serialize_dict)
 
 	xmmsv_unref (value);
 }
+
+CASE (test_xmmsv_serialized_size)
+{
+	xmmsv_t *bin, *value, *ints, *coll, *universe;
+	const unsigned char *data;
+	unsigned int length;
+
+	ints = xmmsv_new_list ();
+	xmmsv_list_restrict_type (ints, XMMSV_TYPE_INT64);
+	xmmsv_list_append_int (ints, 1);
+	xmmsv_list_append_int (ints, 2);
+
+	universe = xmmsv_new_coll (XMMS_COLLECTION_TYPE_UNIVERSE);
+	coll = xmmsv_new_coll (XMMS_COLLECTION_TYPE_MATCH);
+	xmmsv_coll_add_operand (coll, universe);
+	xmmsv_coll_attribute_set_string (coll, "field", "artist");
+	xmmsv_unref (universe);
+
+	value = xmmsv_build_dict (XMMSV_DICT_ENTRY ("ints", ints),
+	                          XMMSV_DICT_ENTRY ("coll", coll),
+	                          XMMSV_DICT_ENTRY_STR ("str", "foo"),
+	                          XMMSV_DICT_ENTRY_FLOAT ("float", 1.5),
+	                          XMMSV_DICT_ENTRY ("bin", xmmsv_new_bin ((const unsigned char *) "xyz", 3)),
+	                          XMMSV_DICT_END);
+
+	bin = xmmsv_serialize (value);
+	CU_ASSERT_PTR_NOT_NULL (bin);
+	CU_ASSERT_TRUE (xmmsv_get_bin (bin, &data, &length));
+	CU_ASSERT_EQUAL (length, xmmsv_bitbuffer_serialized_size (value));
+
+	xmmsv_unref (bin);
+	xmmsv_unref (value);
+}
+
+CASE (test_xmmsv_serialize_compact)
+{
+	xmmsv_t *bb, *value, *ids, *names, *mixed, *item;
+	const char *s;
+	int64_t i, j;
+	xmmsv_type_t type;
+	int size;
+
+	/* unrestricted, so the compact encoding has to find out */
+	ids = xmmsv_new_list ();
+	for (i = 0; i < 1000; i++) {
+		xmmsv_list_append_int (ids, i % 7 ? i : -i * 1000);
+	}
+	xmmsv_list_append_int (ids, INT64_MAX);
+	xmmsv_list_append_int (ids, INT64_MIN);
+
+	names = xmmsv_build_list (XMMSV_LIST_ENTRY_STR ("foo"),
+	                          XMMSV_LIST_ENTRY_STR ("bar"),
+	                          XMMSV_LIST_END);
+	mixed = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (1),
+	                          XMMSV_LIST_ENTRY_STR ("bar"),
+	                          XMMSV_LIST_END);
+
+	value = xmmsv_build_dict (XMMSV_DICT_ENTRY ("ids", ids),
+	                          XMMSV_DICT_ENTRY ("names", names),
+	                          XMMSV_DICT_ENTRY ("mixed", mixed),
+	                          XMMSV_DICT_END);
+
+	size = xmmsv_bitbuffer_serialized_size_compact (value);
+	CU_ASSERT_TRUE (size > 0);
+	CU_ASSERT_TRUE (size < xmmsv_bitbuffer_serialized_size (value) / 4);
+
+	bb = xmmsv_new_bitbuffer ();
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_serialize_value_compact (bb, value));
+	CU_ASSERT_EQUAL (xmmsv_bitbuffer_len (bb) / 8, size);
+
+	xmmsv_unref (value);
+
+	xmmsv_bitbuffer_rewind (bb);
+	CU_ASSERT_TRUE (xmmsv_bitbuffer_deserialize_value (bb, &value));
+	xmmsv_unref (bb);
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (value, "ids", &item));
+	CU_ASSERT_EQUAL (xmmsv_list_get_size (item), 1002);
+	CU_ASSERT_TRUE (xmmsv_list_get_type (item, &type));
+	CU_ASSERT_EQUAL (type, XMMSV_TYPE_NONE);
+	for (i = 0; i < 1000; i++) {
+		CU_ASSERT_TRUE (xmmsv_list_get_int64 (item, i, &j));
+		CU_ASSERT_EQUAL (j, i % 7 ? i : -i * 1000);
+	}
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (item, 1000, &j));
+	CU_ASSERT_EQUAL (j, INT64_MAX);
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (item, 1001, &j));
+	CU_ASSERT_EQUAL (j, INT64_MIN);
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (value, "names", &item));
+	CU_ASSERT_TRUE (xmmsv_list_get_type (item, &type));
+	CU_ASSERT_EQUAL (type, XMMSV_TYPE_NONE);
+	CU_ASSERT_TRUE (xmmsv_list_get_string (item, 1, &s));
+	CU_ASSERT_STRING_EQUAL (s, "bar");
+
+	CU_ASSERT_TRUE (xmmsv_dict_get (value, "mixed", &item));
+	CU_ASSERT_TRUE (xmmsv_list_get_int64 (item, 0, &j));
+	CU_ASSERT_EQUAL (j, 1);
+	CU_ASSERT_TRUE (xmmsv_list_get_string (item, 1, &s));
+	CU_ASSERT_STRING_EQUAL (s, "bar");
+
+	xmmsv_unref (value);
+}
+
+CASE (test_xmmsv_serialize_keep_last)
+{
+	xmmsv_t *bb, *args, *payload, *ids, *c2c, *value, *item;
+	const unsigned char *data;
+	unsigned int len;
+	const char *s;
+	int32_t i;
+	int compact;
+
+	ids = xmmsv_new_list ();
+	for (i = 0; i < 100; i++) {
+		xmmsv_list_append_int (ids, i);
+	}
+	payload = xmmsv_build_dict (XMMSV_DICT_ENTRY_STR ("lyrics", "la la la"),
+	                            XMMSV_DICT_ENTRY ("ids", ids),
+	                            XMMSV_DICT_END);
+	args = xmmsv_build_list (XMMSV_LIST_ENTRY_INT (4),
+	                         XMMSV_LIST_ENTRY_INT (1),
+	                         XMMSV_LIST_ENTRY (xmmsv_ref (payload)),
+	                         XMMSV_LIST_END);
+
+	for (compact = 0; compact < 2; compact++) {
+		bb = xmmsv_new_bitbuffer ();
+		if (compact) {
+			CU_ASSERT_TRUE (xmmsv_bitbuffer_serialize_value_compact (bb, args));
+		} else {
+			CU_ASSERT_TRUE (xmmsv_bitbuffer_serialize_value (bb, args));
+		}
+		xmmsv_bitbuffer_rewind (bb);
+
+		CU_ASSERT_TRUE (xmmsv_bitbuffer_deserialize_list_keep_last (bb, compact, &value));
+		xmmsv_unref (bb);
+
+		CU_ASSERT_EQUAL (xmmsv_list_get_size (value), 3);
+		CU_ASSERT_TRUE (xmmsv_list_get_int32 (value, 0, &i));
+		CU_ASSERT_EQUAL (i, 4);
+
+		/* the payload is kept as the bytes it came in */
+		CU_ASSERT_TRUE (xmmsv_list_get (value, 2, &item));
+		CU_ASSERT_TRUE (xmmsv_get_bin (item, &data, &len));
+		CU_ASSERT_EQUAL (len, compact ? xmmsv_bitbuffer_serialized_size_compact (payload)
+		                              : xmmsv_bitbuffer_serialized_size (payload));
+
+		/* and written out as the value when wrapped, in either encoding */
+		c2c = xmmsv_build_dict (XMMSV_DICT_ENTRY_INT ("sender", 4),
+		                        XMMSV_DICT_ENTRY ("payload", xmmsv_ref (item)),
+		                        XMMSV_DICT_END);
+		xmmsv_unref (value);
+
+		bb = xmmsv_new_bitbuffer ();
+		CU_ASSERT_TRUE (xmmsv_bitbuffer_serialize_value (bb, c2c));
+		CU_ASSERT_EQUAL (xmmsv_bitbuffer_len (bb) / 8,
+		                 xmmsv_bitbuffer_serialized_size (c2c));
+		xmmsv_unref (c2c);
+
+		xmmsv_bitbuffer_rewind (bb);
+		CU_ASSERT_TRUE (xmmsv_bitbuffer_deserialize_value (bb, &value));
+		xmmsv_unref (bb);
+
+		CU_ASSERT_TRUE (xmmsv_dict_get (value, "payload", &item));
+		CU_ASSERT_TRUE (xmmsv_dict_entry_get_string (item, "lyrics", &s));
+		CU_ASSERT_STRING_EQUAL (s, "la la la");
+		CU_ASSERT_TRUE (xmmsv_dict_get (item, "ids", &item));
+		CU_ASSERT_EQUAL (xmmsv_list_get_size (item), 100);
+		CU_ASSERT_TRUE (xmmsv_list_get_int32 (item, 99, &i));
+		CU_ASSERT_EQUAL (i, 99);
+
+		xmmsv_unref (value);
+	}
+
+	xmmsv_unref (args);
+	xmmsv_unref (payload);
+}
@@ -150,7 +150,10 @@ class IpcFoo:
 
 		obj_enum.add_member('END')
 
-		for bcsig, obj, type in self.iter_broadcasts_and_signals():
+		# broadcasts and signals share one numbering, later ones are
+		# numbered after all the older ones wherever they are defined
+		bcsigs = sorted(self.iter_broadcasts_and_signals(), key=lambda t: t[0].since)
+		for bcsig, obj, type in bcsigs:
 			m = sig_enum.add_member('%s_%s' % (obj.name.upper(), bcsig.name.upper()))
 			bcsig.id = m
 		sig_enum.add_member('END')
@@ -285,6 +288,7 @@ class IpcSignalOrBroadcast(NamedElement, DocumentedElement):
 
 		self.id = None
 		self.return_value = None
+		self.since = int(_attribute_value(xml_element, 'since', 0))
 
 		#id_element = xml_element.getElementsByTagName('id')[0]
 		#self.id = int(id_element.firstChild.data.strip())